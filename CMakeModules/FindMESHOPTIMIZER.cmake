@@ -0,0 +1,27 @@
+# Locate meshoptimizer.
+# This module defines
+# MESHOPTIMIZER_LIBRARY
+# MESHOPTIMIZER_FOUND, if false, do not try to link to meshoptimizer
+# MESHOPTIMIZER_INCLUDE_DIR, where to find the headers
+
+SET(MESHOPTIMIZER_DIR "" CACHE PATH "Root directory of meshoptimizer distribution")
+
+FIND_PATH(MESHOPTIMIZER_INCLUDE_DIR meshoptimizer.h
+  PATHS
+    ${MESHOPTIMIZER_DIR}
+    $ENV{MESHOPTIMIZER_DIR}
+  PATH_SUFFIXES include src
+)
+
+FIND_LIBRARY(MESHOPTIMIZER_LIBRARY
+  NAMES meshoptimizer
+  PATHS
+    ${MESHOPTIMIZER_DIR}/lib
+    $ENV{MESHOPTIMIZER_DIR}
+  PATH_SUFFIXES lib64 lib
+)
+
+SET(MESHOPTIMIZER_FOUND "NO")
+IF(MESHOPTIMIZER_LIBRARY AND MESHOPTIMIZER_INCLUDE_DIR)
+  SET(MESHOPTIMIZER_FOUND "YES")
+ENDIF(MESHOPTIMIZER_LIBRARY AND MESHOPTIMIZER_INCLUDE_DIR)
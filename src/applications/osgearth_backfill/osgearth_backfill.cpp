@@ -32,6 +32,8 @@
 
 
 #include <iostream>
+#include <fstream>
+#include <cstdio>
 #include <sstream>
 
 using namespace osgEarth;
@@ -55,6 +57,10 @@ usage( const std::string& msg = "" )
         << "            [--min-level <num>]             : The minimum level to stop backfilling to.  (default=0)\n"
         << "            [--max-level <num>]             : The level to start backfilling from(default=inf)\n"                
         << "            [--db-options]                : db options string to pass to the image writer in quotes (e.g., \"JPEG_QUALITY 60\")\n"
+        << "            [--lanczos]                     : downsample with a Lanczos filter instead of a box filter\n"
+        << "            [--incremental]                 : only regenerate tiles older than their children\n"
+        << "            [--changes <file>]              : only regenerate the ancestors of the tiles listed in the file,\n"
+        << "                                              one \"lod/x/y\" per line (implies --incremental)\n"
         << std::endl
         << "         [--quiet]               : suppress progress output" << std::endl;
 
@@ -107,6 +113,13 @@ main(int argc, char** argv)
 
     osg::ref_ptr<osgDB::Options> options = new osgDB::Options(dbOptions);
 
+    bool lanczos = args.read( "--lanczos" );
+
+    bool incremental = args.read( "--incremental" );
+
+    std::string changesFile;
+    args.read( "--changes", changesFile );
+
 
     std::string tmsPath;
 
@@ -129,5 +142,29 @@ main(int argc, char** argv)
     backfiller.setMinLevel( minLevel );
     backfiller.setMaxLevel( maxLevel );
     backfiller.setBounds( bounds );
+
+    if ( lanczos )
+        backfiller.setFilter( TMSBackFiller::FILTER_LANCZOS );
+
+    if ( incremental || !changesFile.empty() )
+        backfiller.setIncremental( true );
+
+    if ( !changesFile.empty() )
+    {
+        std::ifstream in( changesFile.c_str() );
+        if ( !in.is_open() )
+        {
+            return usage( "Failed to open change list " + changesFile );
+        }
+
+        std::string line;
+        while ( std::getline(in, line) )
+        {
+            unsigned lod, x, y;
+            if ( sscanf(line.c_str(), "%u/%u/%u", &lod, &x, &y) == 3 )
+                backfiller.addChangedTile( lod, x, y );
+        }
+    }
+
     backfiller.process( tmsPath, options.get() );
 }
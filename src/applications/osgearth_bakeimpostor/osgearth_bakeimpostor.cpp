@@ -0,0 +1,123 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2020 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/Common>
+#include <osgEarth/Notify>
+#include <osgEarth/Registry>
+#include <osgEarth/ShaderGenerator>
+#include <osgEarth/ImpostorBaker>
+#include <osgDB/ReadFile>
+#include <osgDB/WriteFile>
+#include <osgDB/FileNameUtils>
+#include <osgViewer/Viewer>
+
+#define LC "[bakeimpostor] "
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+int
+usage(const char* name, const std::string& error)
+{
+    OE_NOTICE
+        << "Error: " << error
+        << "\nUsage:"
+        << "\n" << name << " model.osgb"
+        << "\n  --out impostor.png   ; color output; normals go to impostor.normals.png"
+        << "\n  --frames n           ; frames along each side of the grid (default 8)"
+        << "\n  --size n             ; pixel size of one frame (default 128)"
+        << std::endl;
+
+    return -1;
+}
+
+int
+main(int argc, char** argv)
+{
+    osgEarth::initialize();
+
+    osg::ArgumentParser arguments(&argc, argv);
+
+    std::string out;
+    if (!arguments.read("--out", out))
+        return usage(argv[0], "Missing --out");
+
+    ImpostorBaker baker;
+
+    unsigned value;
+    if (arguments.read("--frames", value))
+        baker.setNumFrames(value);
+    if (arguments.read("--size", value))
+        baker.setFrameSize(value);
+
+    osg::ref_ptr<osg::Node> model = osgDB::readRefNodeFiles(arguments);
+    if (!model.valid())
+        return usage(argv[0], "Failed to load a model");
+
+    Registry::shaderGenerator().run(model.get());
+
+    osg::ref_ptr<osg::Image> color = new osg::Image();
+    osg::ref_ptr<osg::Image> normals = new osg::Image();
+    osg::ref_ptr<osg::Camera> bake = baker.createCamera(model.get(), color.get(), normals.get());
+
+    // render one frame offscreen to run the bake
+    osg::ref_ptr<osg::GraphicsContext::Traits> traits = new osg::GraphicsContext::Traits();
+    traits->width = 1;
+    traits->height = 1;
+    traits->pbuffer = true;
+    traits->glContextVersion = osg::DisplaySettings::instance()->getGLContextVersion();
+    traits->glContextProfileMask = osg::DisplaySettings::instance()->getGLContextProfileMask();
+
+    osg::ref_ptr<osg::GraphicsContext> gc = osg::GraphicsContext::createGraphicsContext(traits.get());
+    if (!gc.valid())
+    {
+        // some drivers have no pbuffers, so fall back on a window
+        traits->pbuffer = false;
+        gc = osg::GraphicsContext::createGraphicsContext(traits.get());
+    }
+    if (!gc.valid())
+        return usage(argv[0], "Failed to create a graphics context");
+
+    osgViewer::Viewer viewer;
+    viewer.setThreadingModel(viewer.SingleThreaded);
+    viewer.getCamera()->setGraphicsContext(gc.get());
+    viewer.getCamera()->setViewport(0, 0, 1, 1);
+    viewer.setSceneData(bake.get());
+    viewer.realize();
+    viewer.frame();
+
+    std::string normalsOut =
+        osgDB::getNameLessExtension(out) + ".normals." + osgDB::getFileExtension(out);
+
+    if (!osgDB::writeImageFile(*color.get(), out) ||
+        !osgDB::writeImageFile(*normals.get(), normalsOut))
+    {
+        OE_WARN << LC << "Failed to write " << out << " or " << normalsOut << std::endl;
+        return -1;
+    }
+
+    OE_NOTICE << LC << "Wrote " << out << " and " << normalsOut
+        << " (" << baker.getNumFrames() << "x" << baker.getNumFrames() << " frames of "
+        << baker.getFrameSize() << " pixels)" << std::endl;
+
+    return 0;
+}
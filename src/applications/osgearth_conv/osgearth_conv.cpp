@@ -33,6 +33,12 @@
 #include <iomanip>
 #include <algorithm>
 #include <iterator>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
 
 using namespace osgEarth;
 
@@ -50,24 +56,132 @@ int usage(char** argv)
         << "\n    --osg-options [OSG options string]  : options to pass to OSG readers/writers"
         << "\n    --extents [minLat] [minLong] [maxLat] [maxLong] : Lat/Long extends to copy"
         << "\n    --no-overwrite                      : skip tiles that already exist in the destination"
+        << "\n    --threads [int]                     : number of threads reading from the input"
+        << "\n    --writers [int]                     : number of threads writing to the output (default = 1)"
+        << "\n    --queue-size [int]                  : max tiles read but not yet written (default = 8 per reader)"
         << std::endl;
 
     return 0;
 }
 
 
+// Tiles that have been read and are waiting to be written.
+// It holds a bounded number of tiles, and readers block while it is full,
+// so memory use stays flat no matter how large the job is.
+struct WriteQueue
+{
+    struct Tile
+    {
+        TileKey key;
+        osg::ref_ptr<const osg::Image> image;
+        osg::ref_ptr<const osg::HeightField> heightField;
+    };
+
+    WriteQueue(unsigned capacity) : _capacity(std::max(capacity, 1u)), _closed(false) { }
+
+    // Called by the readers; blocks while the queue is full
+    void push(const Tile& tile)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _notFull.wait(lock, [this]() { return _tiles.size() < _capacity || _closed; });
+        if (!_closed)
+        {
+            _tiles.push_back(tile);
+            _notEmpty.notify_one();
+        }
+    }
+
+    // Called by the writers; waits for tiles and takes up to "max" of them.
+    // Returns false once the queue is closed and drained.
+    bool pop(std::vector<Tile>& batch, unsigned max)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _notEmpty.wait(lock, [this]() { return !_tiles.empty() || _closed; });
+        if (_tiles.empty())
+            return false;
+
+        while (!_tiles.empty() && batch.size() < max)
+        {
+            batch.push_back(_tiles.front());
+            _tiles.pop_front();
+        }
+        _notFull.notify_all();
+        return true;
+    }
+
+    // No more tiles are coming; writers exit once the queue is drained
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _closed = true;
+        _notEmpty.notify_all();
+        _notFull.notify_all();
+    }
+
+    unsigned _capacity;
+    bool _closed;
+    std::deque<Tile> _tiles;
+    std::mutex _mutex;
+    std::condition_variable _notFull, _notEmpty;
+};
+
+
+// Write stage: drains the queue in batches and writes to the output layer.
+// Encoding happens inside the layer's write call (MBTiles, for example,
+// encodes outside its database lock and groups inserts into transactions),
+// so extra writers widen the encode stage while the store stays serialized.
+struct TileWriter
+{
+    TileWriter(TileLayer* output, WriteQueue& queue) :
+        _output(output), _queue(queue), _written(0), _failed(0) { }
+
+    void run()
+    {
+        ImageLayer* imageLayer = dynamic_cast<ImageLayer*>(_output.get());
+        ElevationLayer* elevationLayer = dynamic_cast<ElevationLayer*>(_output.get());
+
+        std::vector<WriteQueue::Tile> batch;
+        while (_queue.pop(batch, 64u))
+        {
+            for (std::vector<WriteQueue::Tile>::const_iterator i = batch.begin(); i != batch.end(); ++i)
+            {
+                Status status;
+                if (i->image.valid() && imageLayer)
+                    status = imageLayer->writeImage(i->key, i->image.get(), 0L);
+                else if (i->heightField.valid() && elevationLayer)
+                    status = elevationLayer->writeHeightField(i->key, i->heightField.get(), 0L);
+
+                if (status.isOK())
+                {
+                    ++_written;
+                }
+                else
+                {
+                    ++_failed;
+                    OE_WARN << i->key.str() << ": " << status.message() << std::endl;
+                }
+            }
+            batch.clear();
+        }
+    }
+
+    osg::ref_ptr<TileLayer> _output;
+    WriteQueue& _queue;
+    std::atomic<unsigned> _written, _failed;
+};
+
+
+// Read stage: runs on the visitor's threads and hands tiles to the writers.
 struct ImageLayerTileCopy : public TileHandler
 {
-    ImageLayerTileCopy(ImageLayer* source, ImageLayer* dest, bool overwrite)
-        : _source(source), _dest(dest), _overwrite(overwrite)
+    ImageLayerTileCopy(ImageLayer* source, ImageLayer* dest, bool overwrite, WriteQueue& queue)
+        : _source(source), _dest(dest), _overwrite(overwrite), _queue(queue)
     {
         //nop
     }
 
     bool handleTile(const TileKey& key, const TileVisitor& tv)
     {
-        bool ok = false;
-
         // if overwriting is disabled, check to see whether the destination
         // already has data for the key
         if (_overwrite == false)
@@ -81,15 +195,14 @@ struct ImageLayerTileCopy : public TileHandler
         GeoImage image = _source->createImage(key);
         if (image.valid())
         {
-            Status status = _dest->writeImage(key, image.getImage(), 0L);
-            ok = status.isOK();
-            if (!ok)
-            {
-                OE_WARN << key.str() << ": " << status.message() << std::endl;
-            }
+            WriteQueue::Tile tile;
+            tile.key = key;
+            tile.image = image.getImage();
+            _queue.push(tile);
+            return true;
         }
 
-        return ok;
+        return false;
     }
 
     bool hasData(const TileKey& key) const
@@ -100,21 +213,20 @@ struct ImageLayerTileCopy : public TileHandler
     osg::ref_ptr<ImageLayer> _source;
     osg::ref_ptr<ImageLayer> _dest;
     bool _overwrite;
+    WriteQueue& _queue;
 };
 
 
 struct ElevationLayerTileCopy : public TileHandler
 {
-    ElevationLayerTileCopy(ElevationLayer* source, ElevationLayer* dest, bool overwrite)
-        : _source(source), _dest(dest), _overwrite(overwrite)
+    ElevationLayerTileCopy(ElevationLayer* source, ElevationLayer* dest, bool overwrite, WriteQueue& queue)
+        : _source(source), _dest(dest), _overwrite(overwrite), _queue(queue)
     {
         //nop
     }
 
     bool handleTile(const TileKey& key, const TileVisitor& tv)
     {
-        bool ok = false;
-
         // if overwriting is disabled, check to see whether the destination
         // already has data for the key
         if (_overwrite == false)
@@ -128,16 +240,17 @@ struct ElevationLayerTileCopy : public TileHandler
         GeoHeightField hf = _source->createHeightField(key, 0L);
         if ( hf.valid() )
         {
-            Status s = _dest->writeHeightField(key, hf.getHeightField(), 0L);
-            ok = s.isOK();
-            if (!ok)
-                OE_WARN << key.str() << ": " << s.message() << std::endl;
+            WriteQueue::Tile tile;
+            tile.key = key;
+            tile.heightField = hf.getHeightField();
+            _queue.push(tile);
+            return true;
         }
         else
         {
             OE_WARN << key.str() << " : " << hf.getStatus().message() << std::endl;
         }
-        return ok;
+        return false;
     }
 
     bool hasData(const TileKey& key) const
@@ -148,6 +261,7 @@ struct ElevationLayerTileCopy : public TileHandler
     osg::ref_ptr<ElevationLayer> _source;
     osg::ref_ptr<ElevationLayer> _dest;
     bool _overwrite;
+    WriteQueue& _queue;
 };
 
 
@@ -182,12 +296,14 @@ struct ProgressReporter : public osgEarth::ProgressCallback
         double secsToGo = fmod(timeToGo,60.0);
         double minsTotal = projectedTotalTime/60.0;
         double secsTotal = fmod(projectedTotalTime,60.0);
+        double tilesPerSecond = timeSoFar > 0.0 ? current/timeSoFar : 0.0;
 
         std::cout
             << std::fixed
             << std::setprecision(1) << "\r"
             << (int)current << "/" << (int)total
             << " " << int(100.0f*percentage) << "% complete, " 
+            << tilesPerSecond << " tiles/s, "
             << (int)minsTotal << "m" << (int)secsTotal << "s projected, "
             << (int)minsToGo << "m" << (int)secsToGo << "s remaining          "
             << std::flush;
@@ -231,6 +347,9 @@ struct ProgressReporter : public osgEarth::ProgressCallback
  *      --max-level [int]     : max level of detail to copy
  *      --extents [minLat] [minLong] [maxLat] [maxLong] : Lat/Long extends to copy (*)
  *      --no-overwrite        : don't overwrite data that already exists
+ *      --threads [int]       : number of threads reading from the input
+ *      --writers [int]       : number of threads writing to the output (default = 1)
+ *      --queue-size [int]    : max tiles read but not yet written
  *
  * OSG arguments:
  *
@@ -375,19 +494,32 @@ main(int argc, char** argv)
     if (args.read("--no-overwrite"))
         overwrite = false;
 
+    // Tiles flow from the readers (the visitor's threads) through a bounded
+    // queue to the writers.
+    unsigned numWriters = 1;
+    args.read("--writers", numWriters);
+    numWriters = std::max(numWriters, 1u);
+
+    unsigned queueSize = std::max(numThreads, 1u) * 8u;
+    args.read("--queue-size", queueSize);
+
+    WriteQueue queue(queueSize);
+
     if (dynamic_cast<ImageLayer*>(input.get()) && dynamic_cast<ImageLayer*>(output.get()))
     {
         visitor->setTileHandler(new ImageLayerTileCopy(
             dynamic_cast<ImageLayer*>(input.get()),
             dynamic_cast<ImageLayer*>(output.get()),
-            overwrite));
+            overwrite,
+            queue));
     }
     else if (dynamic_cast<ElevationLayer*>(input.get()) && dynamic_cast<ElevationLayer*>(output.get()))
     {
         visitor->setTileHandler(new ElevationLayerTileCopy(
             dynamic_cast<ElevationLayer*>(input.get()),
             dynamic_cast<ElevationLayer*>(output.get()),
-            overwrite));
+            overwrite,
+            queue));
     }
 
     // set the manula extents, if specified:
@@ -445,17 +577,45 @@ main(int argc, char** argv)
 
     osg::Timer_t t0 = osg::Timer::instance()->tick();
 
+    std::vector<std::shared_ptr<TileWriter> > writers;
+    std::vector<std::thread> writerThreads;
+    for (unsigned i = 0; i < numWriters; ++i)
+    {
+        writers.push_back(std::make_shared<TileWriter>(output.get(), queue));
+        writerThreads.push_back(std::thread(&TileWriter::run, writers.back().get()));
+    }
+
     visitor->run( outputProfile.get() );
 
+    // let the writers drain the queue
+    queue.close();
+    for (unsigned i = 0; i < writerThreads.size(); ++i)
+        writerThreads[i].join();
+
+    // flush any batched writes to the output
+    output->close();
+
     osg::Timer_t t1 = osg::Timer::instance()->tick();
 
+    unsigned written = 0, failed = 0;
+    for (unsigned i = 0; i < writers.size(); ++i)
+    {
+        written += writers[i]->_written;
+        failed += writers[i]->_failed;
+    }
+
+    double seconds = osg::Timer::instance()->delta_s(t0, t1);
+
     std::cout
         << std::endl
         << "Complete. Time = "
         << std::fixed
         << std::setprecision(1)
-        << osg::Timer::instance()->delta_s(t0, t1)
-        << " seconds." << std::endl;
+        << seconds
+        << " seconds; "
+        << written << " tiles written ("
+        << (seconds > 0.0 ? (double)written/seconds : 0.0) << " tiles/s), "
+        << failed << " failed." << std::endl;
 
     return 0;
 }
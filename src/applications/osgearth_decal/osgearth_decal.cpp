@@ -44,6 +44,9 @@ usage(const char* name)
 {
     OE_NOTICE
         << "\nUsage: " << name << " file.earth" << std::endl
+        << "    --size <meters>  : decal size" << std::endl
+        << "    --count <n>      : decals per click" << std::endl
+        << "    --gpu            : draw elevation decals on the GPU" << std::endl
         << MapNodeHelper().usage() << std::endl;
 
     return 0;
@@ -64,6 +67,7 @@ struct App
     std::stack<std::string> _undoStack;
     unsigned _idGenerator;
     unsigned _decalsPerClick;
+    bool _gpu;
     std::vector<const Layer*> _layersToRefresh;
 
     App()
@@ -85,6 +89,7 @@ struct App
         _minLevel = 11u;
         _size = 0.0f;
         _decalsPerClick = 1u;
+        _gpu = false;
     }
 
     void init(MapNode* mapNode)
@@ -132,6 +137,7 @@ struct App
         _elevLayer = new DecalElevationLayer();
         _elevLayer->setName("Elevation Decals");
         _elevLayer->setMinLevel(_minLevel);
+        _elevLayer->setGPU(_gpu);
         mapNode->getMap()->addLayer(_elevLayer.get());
         _layersToRefresh.push_back(_elevLayer.get());
 
@@ -184,8 +190,15 @@ struct App
         }
 
 
-        // Tell the terrain engine to regenerate the effected area.
-        _mapNode->getTerrainEngine()->invalidateRegion(_layersToRefresh, extent, _minLevel, INT_MAX);
+        // Tell the terrain engine to regenerate the effected area. Elevation
+        // decals the terrain draws on the GPU don't need it.
+        std::vector<const Layer*> layers;
+        for (unsigned i = 0; i < _layersToRefresh.size(); ++i)
+        {
+            if (_layersToRefresh[i] != _elevLayer.get() || !_elevLayer->isDecalOnGPU(id))
+                layers.push_back(_layersToRefresh[i]);
+        }
+        _mapNode->getTerrainEngine()->invalidateRegion(layers, extent, _minLevel, INT_MAX);
     }
 
 
@@ -341,6 +354,8 @@ main(int argc, char** argv)
         app._decalsPerClick = 1u;
         arguments.read("--count", app._decalsPerClick);
 
+        app._gpu = arguments.read("--gpu");
+
         app.init(MapNode::get(node));
 
         viewer.setSceneData(node);
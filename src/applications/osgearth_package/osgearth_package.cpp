@@ -32,14 +32,20 @@
 #include <osgEarth/ImageLayer>
 #include <osgEarth/ElevationLayer>
 #include <osgEarth/TMS>
+#include <osgEarth/FeatureModelLayer>
+#include <osgEarth/FeatureModelGraph>
+#include <osgEarth/JsonUtils>
 
 #include <osgEarth/OGRFeatureSource>
 
 #include <osgEarth/TMSPackager>
 
 #include <iostream>
+#include <fstream>
 #include <sstream>
 #include <iterator>
+#include <map>
+#include <set>
 
 using namespace osgEarth;
 using namespace osgEarth::Contrib;
@@ -71,11 +77,23 @@ usage( const std::string& msg = "" )
         << "            [--keep-empties]                : writes out fully transparent image tiles (normally discarded)\n"
         << "            [--continue-single-color]       : continues to subdivide single color tiles, subdivision typicall stops on single color images\n"
         << "            [--elevation-pixel-depth]       : pixeldepth for elevations\n"
+        << "            [--elevation-ext <extension>]   : elevation tile format, tif (default) or qhf (packed heightfield)\n"
         << "            [--db-options]                  : osgDB options string to pass to the image writer in quotes (e.g., \"JPEG_QUALITY 60\")\n"
         << "            [--mp]                          : Use multiprocessing to process the tiles.  Useful for GDAL sources as this avoids the global GDAL lock" << std::endl
         << "            [--mt]                          : Use multithreading to process the tiles." << std::endl
         << "            [--concurrency]                 : The number of threads or processes to use if --mp or --mt are provided." << std::endl
         << "            [--alpha-mask]                  : Mask out imagery that isn't in the provided extents." << std::endl
+        << "            [--verbose]                     : Displays progress of the operation" << std::endl
+        << std::endl
+        << "         --3dtiles                          : make a 3D Tiles tileset from a feature model layer\n"
+        << "            <earth_file>                    : earth file containing the layer (required)\n"
+        << "            --out <path>                    : root output folder of the tileset (required)\n"
+        << "            [--layer <name>]                : feature model layer to export (default=first one)\n"
+        << "            [--bounds xmin ymin xmax ymax]* : bounds to package (in map coordinates; default=entire layer)\n"
+        << "            [--max-level <num>]             : tile level at which to build the features (default=source max level or 14)\n"
+        << "            [--min-level <num>]             : top level of the tileset hierarchy (default=0)\n"
+        << "            [--db-options]                  : osgDB options string to pass to the b3dm writer in quotes\n"
+        << "            [--concurrency]                 : The number of threads building tiles (default=all cores)\n"
         << "            [--verbose]                     : Displays progress of the operation" << std::endl;
 
     return -1;
@@ -183,6 +201,10 @@ makeTMS( osg::ArgumentParser& args )
     std::string extension;
     args.read( "--ext", extension );
 
+    // elevation tile format (tif or qhf)
+    std::string elevationExtension = "tif";
+    args.read( "--elevation-ext", elevationExtension );
+
     // find a .earth file on the command line
     std::string earthFile = findArgumentWithExtension( args, ".earth" );
 
@@ -326,6 +348,7 @@ makeTMS( osg::ArgumentParser& args )
     packager.setVisitor(visitor.get());
     packager.setDestination(rootFolder);
     packager.setElevationPixelDepth(elevationPixelDepth);
+    packager.setElevationExtension(elevationExtension);
     packager.setWriteOptions(options.get());
     packager.setOverwrite(overwrite);
     packager.setKeepEmpties(keepEmpties);
@@ -472,6 +495,297 @@ makeTMS( osg::ArgumentParser& args )
     return 0;
 }
 
+namespace
+{
+    // Screen-space error (in pixels) at which 3D Tiles clients refine by
+    // default, and the screen height and field of view we assume when
+    // converting that to a geometric error.
+    const double CLIENT_SSE = 16.0;
+    const double CLIENT_SCREEN_HEIGHT = 1080.0;
+    const double CLIENT_TAN_HALF_FOV = 0.57735; // 60 degrees
+
+    /** Builds the features of each tile and writes them out as b3dm. */
+    class B3DMTileHandler : public TileHandler
+    {
+    public:
+        struct Tile
+        {
+            TileKey key;
+            osg::BoundingSphered bound;
+            std::string uri;
+        };
+
+        B3DMTileHandler(FeatureModelGraph* graph, const std::string& rootFolder, const osgDB::Options* options) :
+            _graph(graph),
+            _rootFolder(rootFolder),
+            _options(options) { }
+
+        bool handleTile(const TileKey& key, const TileVisitor& tv)
+        {
+            osg::ref_ptr<osg::Group> tile = _graph->buildTile(key, _options.get());
+
+            if (tile.valid() && tile->getNumChildren() > 0 && tile->getBound().valid())
+            {
+                unsigned x, y;
+                key.getTileXY(x, y);
+                std::string uri = Stringify() << key.getLOD() << "/" << x << "/" << y << ".b3dm";
+                std::string path = osgDB::concatPaths(_rootFolder, uri);
+                osgDB::makeDirectoryForFile(path);
+
+                if (osgDB::writeNodeFile(*tile.get(), path, _options.get()))
+                {
+                    // the float bound loses a little precision in ECEF, so pad it a bit
+                    const osg::BoundingSphere& bs = tile->getBound();
+                    Tile record;
+                    record.key = key;
+                    record.bound.set(osg::Vec3d(bs.center()), (double)bs.radius() + 1.0);
+                    record.uri = uri;
+
+                    Threading::ScopedMutexLock lock(_mutex);
+                    _tiles.push_back(record);
+                }
+                else
+                {
+                    OE_WARN << LC << "Failed to write " << path << std::endl;
+                }
+            }
+
+            return true;
+        }
+
+        const std::vector<Tile>& getTiles() const { return _tiles; }
+
+    private:
+        osg::ref_ptr<FeatureModelGraph> _graph;
+        std::string _rootFolder;
+        osg::ref_ptr<const osgDB::Options> _options;
+        Threading::Mutex _mutex;
+        std::vector<Tile> _tiles;
+    };
+
+    /** The tileset hierarchy above the written tiles. */
+    struct TilesetNode
+    {
+        osg::BoundingSphered bound;
+        std::string uri;
+        std::set<TileKey> children;
+    };
+    typedef std::map<TileKey, TilesetNode> TilesetNodes;
+
+    // Writes a node and the nodes below it. A node's geometric error is
+    // what a client sees if it draws the node instead of its children;
+    // we pick it so that a client refines at about the range osgEarth
+    // would page in the children (their radius times the tile size factor).
+    Json::Value
+    makeTilesetNode(const TilesetNode& top, const TilesetNodes& nodes, double errorPerMeter)
+    {
+        const TilesetNode* node = &top;
+
+        // skip over empty nodes with one child; they add nothing
+        while (node->uri.empty() && node->children.size() == 1u)
+            node = &nodes.find(*node->children.begin())->second;
+
+        Json::Value tile(Json::objectValue);
+
+        Json::Value sphere(Json::arrayValue);
+        sphere.append(node->bound.center().x());
+        sphere.append(node->bound.center().y());
+        sphere.append(node->bound.center().z());
+        sphere.append(node->bound.radius());
+        tile["boundingVolume"]["sphere"] = sphere;
+
+        double maxChildRadius = 0.0;
+        if (!node->children.empty())
+        {
+            Json::Value children(Json::arrayValue);
+            for (auto& childKey : node->children)
+            {
+                const TilesetNode& child = nodes.find(childKey)->second;
+                children.append(makeTilesetNode(child, nodes, errorPerMeter));
+                maxChildRadius = osg::maximum(maxChildRadius, child.bound.radius());
+            }
+            tile["children"] = children;
+        }
+        tile["geometricError"] = maxChildRadius * errorPerMeter;
+
+        if (!node->uri.empty())
+            tile["content"]["uri"] = node->uri;
+
+        return tile;
+    }
+}
+
+/** Packages a feature model layer as a 3D Tiles tileset. */
+int
+make3DTiles( osg::ArgumentParser& args )
+{
+    osgDB::Registry::instance()->getReaderWriterForExtension("b3dm");
+
+    unsigned int maxLevel = ~0u;
+    while (args.read("--max-level", maxLevel));
+
+    unsigned int minLevel = 0;
+    while (args.read("--min-level", minLevel));
+
+    std::vector< Bounds > bounds;
+    double xmin=DBL_MAX, ymin=DBL_MAX, xmax=DBL_MIN, ymax=DBL_MIN;
+    while (args.read("--bounds", xmin, ymin, xmax, ymax ))
+    {
+        Bounds b;
+        b.xMin() = xmin, b.yMin() = ymin, b.xMax() = xmax, b.yMax() = ymax;
+        bounds.push_back( b );
+    }
+
+    std::string layerName;
+    args.read("--layer", layerName);
+
+    bool verbose = args.read("--verbose");
+
+    unsigned int concurrency = 0;
+    args.read("-c", concurrency);
+    args.read("--concurrency", concurrency);
+
+    std::string dbOptions;
+    args.read( "--db-options", dbOptions );
+    std::string::size_type n = 0;
+    while( (n = dbOptions.find( '"', n )) != dbOptions.npos )
+    {
+        dbOptions.erase( n, 1 );
+    }
+    osg::ref_ptr<osgDB::Options> options = new osgDB::Options( dbOptions );
+
+    std::string earthFile = findArgumentWithExtension( args, ".earth" );
+
+    std::string rootFolder;
+    if( !args.read( "--out", rootFolder ) )
+        rootFolder = Stringify() << earthFile << ".3dtiles";
+
+    osg::ref_ptr<MapNode> mapNode = MapNode::load( args );
+    if( !mapNode.valid() )
+        return usage( "Failed to load a valid .earth file" );
+
+    Map* map = mapNode->getMap();
+
+    FeatureModelLayer* layer = layerName.empty() ?
+        map->getLayer<FeatureModelLayer>() :
+        map->getLayerByName<FeatureModelLayer>(layerName);
+
+    if (!layer)
+        return usage( "Failed to find a feature model layer" );
+
+    FeatureModelGraph* graph = layer->getFeatureModelGraph();
+    if (!graph)
+        return usage( Stringify() << "Layer \"" << layer->getName() << "\" failed to open: " << layer->getStatus().message() );
+
+    // A tiled source is built on its own tiles; anything else on the map's.
+    const FeatureProfile* featureProfile = layer->getFeatureSource()->getFeatureProfile();
+    const Profile* profile = map->getProfile();
+    if (featureProfile && featureProfile->isTiled())
+    {
+        profile = featureProfile->getTilingProfile();
+        if (maxLevel == ~0u)
+            maxLevel = featureProfile->getMaxLevel();
+    }
+    if (maxLevel == ~0u)
+        maxLevel = 14u;
+    minLevel = osg::minimum(minLevel, maxLevel);
+
+    osgDB::makeDirectory( rootFolder );
+    if( !osgDB::fileExists( rootFolder ) )
+        return usage( "Failed to create root output folder" );
+
+    osg::ref_ptr<B3DMTileHandler> handler = new B3DMTileHandler(graph, rootFolder, options.get());
+
+    // Build the tiles in parallel; only the content level gets geometry.
+    osg::ref_ptr<MultithreadedTileVisitor> visitor = new MultithreadedTileVisitor(handler.get());
+    if (concurrency > 0)
+        visitor->setNumThreads(concurrency);
+    visitor->setMinLevel(maxLevel);
+    visitor->setMaxLevel(maxLevel);
+
+    for (unsigned int i = 0; i < bounds.size(); i++)
+    {
+        visitor->addExtent( GeoExtent(mapNode->getMapSRS(), bounds[i]).transform(profile->getSRS()) );
+    }
+    if (bounds.empty() && layer->getExtent().isValid())
+    {
+        visitor->addExtent( layer->getExtent().transform(profile->getSRS()) );
+    }
+
+    osg::ref_ptr< ProgressCallback > progress = new ConsoleProgressCallback();
+    if (verbose)
+    {
+        visitor->setProgressCallback( progress.get() );
+    }
+
+    osg::Timer_t start = osg::Timer::instance()->tick();
+    visitor->run(profile);
+
+    const std::vector<B3DMTileHandler::Tile>& tiles = handler->getTiles();
+    if (tiles.empty())
+    {
+        std::cout << "No features found; nothing to write" << std::endl;
+        return 1;
+    }
+
+    // Assemble the hierarchy from the content tiles up to the min level.
+    TilesetNodes nodes;
+    for (auto& tile : tiles)
+    {
+        TilesetNode& leaf = nodes[tile.key];
+        leaf.bound = tile.bound;
+        leaf.uri = tile.uri;
+
+        TileKey key = tile.key;
+        while (key.getLOD() > minLevel)
+        {
+            TileKey parentKey = key.createParentKey();
+            TilesetNode& parent = nodes[parentKey];
+            parent.children.insert(key);
+            parent.bound.expandBy(tile.bound);
+            key = parentKey;
+        }
+    }
+
+    double tileSizeFactor = layer->getLayout().tileSizeFactor().get();
+    double errorPerMeter = tileSizeFactor * CLIENT_SSE * 2.0 * CLIENT_TAN_HALF_FOV / CLIENT_SCREEN_HEIGHT;
+
+    // One root tile holds the top of the hierarchy.
+    TilesetNode root;
+    for (auto& i : nodes)
+    {
+        if (i.first.getLOD() == minLevel)
+        {
+            root.children.insert(i.first);
+            root.bound.expandBy(i.second.bound);
+        }
+    }
+    Json::Value tileset(Json::objectValue);
+    tileset["asset"]["version"] = "1.0";
+    tileset["asset"]["generator"] = "osgearth_package";
+    tileset["root"] = makeTilesetNode(root, nodes, errorPerMeter);
+    tileset["root"]["refine"] = "ADD";
+    tileset["geometricError"] = root.bound.radius() * errorPerMeter;
+
+    std::string tilesetFile = osgDB::concatPaths(rootFolder, "tileset.json");
+    std::ofstream out(tilesetFile.c_str());
+    if (!out.is_open())
+        return usage( Stringify() << "Failed to write " << tilesetFile );
+
+    Json::StyledWriter writer;
+    out << writer.write(tileset);
+    out.close();
+
+    if (verbose)
+    {
+        osg::Timer_t end = osg::Timer::instance()->tick();
+        OE_NOTICE << LC << "Wrote " << tiles.size() << " tiles and " << tilesetFile
+            << " in " << prettyPrintTime( osg::Timer::instance()->delta_s( start, end ) ) << std::endl;
+    }
+
+    return 0;
+}
+
 /**
  * Data packaging tool for osgEarth.
  */
@@ -485,6 +799,9 @@ main( int argc, char** argv )
     if( args.read( "--tms" ) )
         return makeTMS( args );
 
+    else if( args.read( "--3dtiles" ) )
+        return make3DTiles( args );
+
     else
         return usage();
 }
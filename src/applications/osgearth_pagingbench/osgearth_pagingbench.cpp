@@ -0,0 +1,412 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2020 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgViewer/Viewer>
+#include <osgDB/DatabasePager>
+#include <osgEarth/Notify>
+#include <osgEarth/EarthManipulator>
+#include <osgEarth/ExampleResources>
+#include <osgEarth/JsonUtils>
+#include <osgEarth/MapNode>
+#include <osgEarth/Memory>
+#include <osgEarth/Registry>
+#include <osgEarth/TerrainEngineNode>
+#include <osgEarth/Viewpoint>
+#include <osgEarth/XmlUtils>
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+
+#define LC "[pagingbench] "
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+int
+usage(const char* name)
+{
+    OE_NOTICE
+        << "\nReplays a camera path and reports paging and frame-time statistics."
+        << "\nUsage: " << name << " file.earth --path path.xml [options]" << std::endl
+        << "\n    --path <file>           Viewpoints to visit, as <viewpoints><viewpoint .../>...</viewpoints>"
+        << "\n    --record <file>         Fly the map interactively and record the path instead"
+        << "\n    --record-interval <s>   Seconds between recorded viewpoints (default = 0.5)"
+        << "\n    --fly-time <s>          Seconds to fly between viewpoints that have no times (default = 5)"
+        << "\n    --settle-frames <n>     Idle frames that mean the view is at full resolution (default = 10)"
+        << "\n    --timeout <s>           Most seconds to wait for full resolution at a viewpoint (default = 60)"
+        << "\n    --fps <n>               Simulation frames per second; the path takes the same number"
+        << "\n                            of frames on every run however long they take (default = 60)"
+        << "\n    --out <file>            Write the results as JSON"
+        << "\n    --cache-only            Read data from the cache only, for an offline run"
+        << std::endl
+        << MapNodeHelper().usage() << std::endl;
+
+    return 0;
+}
+
+namespace
+{
+    //! A viewpoint on the path; recorded paths carry the time it was reached
+    struct Waypoint
+    {
+        Viewpoint _vp;
+        optional<double> _time;
+    };
+
+    bool readPath(const std::string& filename, std::vector<Waypoint>& out)
+    {
+        Config conf;
+        if (!XmlDocument::readConfig(URI(filename), 0L, conf))
+            return false;
+
+        const Config* list = conf.find("viewpoints");
+        if (!list)
+            return false;
+
+        for (ConfigSet::const_iterator i = list->children().begin(); i != list->children().end(); ++i)
+        {
+            Waypoint wp;
+            wp._vp = Viewpoint(*i);
+            i->get("time", wp._time);
+            if (wp._vp.isValid())
+                out.push_back(wp);
+        }
+        return !out.empty();
+    }
+
+    bool writePath(const std::string& filename, const std::vector<Waypoint>& path)
+    {
+        Config list("viewpoints");
+        for (unsigned i = 0; i < path.size(); ++i)
+        {
+            Config vp = path[i]._vp.getConfig();
+            vp.set("time", path[i]._time);
+            list.add(vp);
+        }
+
+        std::ofstream out(filename.c_str());
+        if (!out.is_open())
+            return false;
+
+        osg::ref_ptr<XmlDocument> doc = new XmlDocument(list);
+        doc->store(out);
+        return true;
+    }
+
+    double lerpAngle(double a, double b, double t)
+    {
+        double d = fmod(b - a + 540.0, 360.0) - 180.0;
+        return a + d*t;
+    }
+
+    //! Interpolates between two viewpoints. Range interpolates
+    //! logarithmically so the zoom speed looks steady.
+    Viewpoint interpolate(const Viewpoint& a, const Viewpoint& b, double t)
+    {
+        GeoPoint pa = a.focalPoint().get(), pb = b.focalPoint().get();
+        pa.makeGeographic();
+        pb = pb.transform(pa.getSRS());
+
+        double ra = osg::maximum(a.range()->as(Units::METERS), 1.0);
+        double rb = osg::maximum(b.range()->as(Units::METERS), 1.0);
+
+        Viewpoint vp;
+        vp.focalPoint() = GeoPoint(
+            pa.getSRS(),
+            lerpAngle(pa.x(), pb.x(), t),
+            pa.y() + (pb.y() - pa.y())*t,
+            pa.z() + (pb.z() - pa.z())*t,
+            pb.altitudeMode());
+        vp.heading() = Angle(lerpAngle(a.heading()->as(Units::DEGREES), b.heading()->as(Units::DEGREES), t), Units::DEGREES);
+        vp.pitch() = Angle(a.pitch()->as(Units::DEGREES) + (b.pitch()->as(Units::DEGREES) - a.pitch()->as(Units::DEGREES))*t, Units::DEGREES);
+        vp.range() = Distance(exp(log(ra) + (log(rb) - log(ra))*t), Units::METERS);
+        return vp;
+    }
+
+    double percentile(std::vector<double> values, double p)
+    {
+        if (values.empty())
+            return 0.0;
+        std::sort(values.begin(), values.end());
+        unsigned i = (unsigned)osg::clampBetween(ceil(p * (double)values.size()) - 1.0, 0.0, (double)(values.size() - 1));
+        return values[i];
+    }
+
+    //! Runs frames at a fixed simulation rate and collects the statistics
+    struct Benchmark
+    {
+        Benchmark(osgViewer::Viewer& viewer, TerrainEngineNode* engine, double fps) :
+            _viewer(viewer), _engine(engine), _dt(1.0 / fps), _simTime(0.0),
+            _numFrames(0u), _wallTime_s(0.0), _idleFrames(0u)
+        {
+            _engine->getLoadingStats(_start);
+            _last = _start;
+        }
+
+        void frame()
+        {
+            const osg::Timer* timer = osg::Timer::instance();
+            osg::Timer_t t0 = timer->tick();
+
+            _simTime += _dt;
+            _viewer.frame(_simTime);
+
+            double ms = timer->delta_m(t0, timer->tick());
+            _frameTimes_ms.push_back(ms);
+            _wallTime_s += 0.001 * ms;
+            ++_numFrames;
+
+            TerrainEngineNode::LoadingStats stats;
+            _engine->getLoadingStats(stats);
+            _mergeTimes_ms.push_back(1000.0 * (stats._mergeTime_s - _last._mergeTime_s));
+
+            bool idle =
+                stats._numRequests == 0u &&
+                stats._numMergesPending == 0u &&
+                !_viewer.getDatabasePager()->getRequestsInProgress();
+            _idleFrames = idle ? _idleFrames + 1u : 0u;
+
+            _last = stats;
+        }
+
+        //! Runs frames until the terrain stops loading, and returns the
+        //! seconds it took (or -1 upon timeout)
+        double settle(unsigned settleFrames, double timeout_s)
+        {
+            double start = _wallTime_s;
+            _idleFrames = 0u;
+            while (!_viewer.done() && _idleFrames < settleFrames)
+            {
+                frame();
+                if (_wallTime_s - start > timeout_s)
+                    return -1.0;
+            }
+            return _wallTime_s - start;
+        }
+
+        osgViewer::Viewer& _viewer;
+        osg::ref_ptr<TerrainEngineNode> _engine;
+        double _dt;
+        double _simTime;
+        unsigned _numFrames;
+        double _wallTime_s;
+        unsigned _idleFrames;
+        TerrainEngineNode::LoadingStats _start, _last;
+        std::vector<double> _frameTimes_ms;
+        std::vector<double> _mergeTimes_ms;
+        std::vector<double> _settleTimes_s;
+    };
+
+    int record(osgViewer::Viewer& viewer, EarthManipulator* manip, const std::string& filename, double interval)
+    {
+        std::vector<Waypoint> path;
+        const osg::Timer* timer = osg::Timer::instance();
+        osg::Timer_t start = timer->tick();
+        double next = 0.0;
+
+        OE_NOTICE << LC << "Recording; close the window to save " << filename << std::endl;
+
+        while (!viewer.done())
+        {
+            viewer.frame();
+
+            double t = timer->delta_s(start, timer->tick());
+            if (t >= next)
+            {
+                Waypoint wp;
+                wp._vp = manip->getViewpoint();
+                wp._time = t;
+                path.push_back(wp);
+                next = t + interval;
+            }
+        }
+
+        if (!writePath(filename, path))
+        {
+            OE_WARN << LC << "Failed to write " << filename << std::endl;
+            return -1;
+        }
+
+        OE_NOTICE << LC << "Recorded " << path.size() << " viewpoints" << std::endl;
+        return 0;
+    }
+}
+
+int
+main(int argc, char** argv)
+{
+    osgEarth::initialize();
+
+    osg::ArgumentParser arguments(&argc,argv);
+
+    if (arguments.read("--help"))
+        return usage(argv[0]);
+
+    std::string pathFile, recordFile, outFile;
+    double recordInterval = 0.5, flyTime = 5.0, timeout = 60.0, fps = 60.0;
+    unsigned settleFrames = 10u;
+
+    arguments.read("--path", pathFile);
+    arguments.read("--record", recordFile);
+    arguments.read("--record-interval", recordInterval);
+    arguments.read("--fly-time", flyTime);
+    arguments.read("--settle-frames", settleFrames);
+    arguments.read("--timeout", timeout);
+    arguments.read("--fps", fps);
+    arguments.read("--out", outFile);
+
+    if (arguments.read("--cache-only"))
+        Registry::instance()->setOverrideCachePolicy(CachePolicy::CACHE_ONLY);
+
+    if (pathFile.empty() && recordFile.empty())
+        return usage(argv[0]);
+
+    osgViewer::Viewer viewer(arguments);
+    viewer.getDatabasePager()->setUnrefImageDataAfterApplyPolicy(true, false);
+    viewer.getCamera()->setSmallFeatureCullingPixelSize(-1.0f);
+    viewer.getCamera()->setNearFarRatio(0.0001);
+
+    EarthManipulator* manip = new EarthManipulator(arguments);
+    viewer.setCameraManipulator(manip);
+
+    osg::Node* node = MapNodeHelper().load(arguments, &viewer);
+    MapNode* mapNode = MapNode::get(node);
+    if (!mapNode)
+        return usage(argv[0]);
+
+    viewer.setSceneData(node);
+
+    if (!recordFile.empty())
+        return record(viewer, manip, recordFile, recordInterval);
+
+    std::vector<Waypoint> path;
+    if (!readPath(pathFile, path))
+    {
+        OE_WARN << LC << "No viewpoints in " << pathFile << std::endl;
+        return -1;
+    }
+
+    // The benchmark drives the camera itself; keep the manipulator from
+    // adjusting it based on whatever terrain happens to be loaded.
+    manip->getSettings()->setTerrainAvoidanceEnabled(false);
+    manip->getSettings()->setThrowingEnabled(false);
+
+    TerrainEngineNode* engine = mapNode->getTerrainEngine();
+    TerrainEngineNode::LoadingStats stats;
+    if (!engine->getLoadingStats(stats))
+    {
+        OE_WARN << LC << "The terrain engine doesn't report loading statistics" << std::endl;
+        return -1;
+    }
+
+    viewer.realize();
+
+    // Start at full resolution on the first viewpoint, so every run
+    // measures the same work from the same state.
+    manip->setViewpoint(path[0]._vp);
+    Benchmark warmup(viewer, engine, fps);
+    if (warmup.settle(settleFrames, timeout) < 0.0)
+        OE_WARN << LC << "Timed out loading the first viewpoint" << std::endl;
+
+    Benchmark bench(viewer, engine, fps);
+    bench._simTime = warmup._simTime;
+
+    for (unsigned i = 1; i < path.size() && !viewer.done(); ++i)
+    {
+        double duration = path[i]._time.isSet() && path[i-1]._time.isSet() ?
+            path[i]._time.get() - path[i-1]._time.get() :
+            flyTime;
+        unsigned frames = osg::maximum(1u, (unsigned)(duration * fps + 0.5));
+
+        for (unsigned f = 1; f <= frames && !viewer.done(); ++f)
+        {
+            manip->setViewpoint(interpolate(path[i-1]._vp, path[i]._vp, (double)f / (double)frames));
+            bench.frame();
+        }
+
+        // Viewpoint lists wait for full resolution at every stop;
+        // recorded paths fly through and wait only at the end.
+        if (!path[i]._time.isSet() || i == path.size() - 1)
+        {
+            double s = bench.settle(settleFrames, timeout);
+            bench._settleTimes_s.push_back(s);
+            OE_NOTICE << LC << "Viewpoint " << i << ": "
+                << (s >= 0.0 ? std::to_string(s) + " s to full resolution" : std::string("timed out"))
+                << std::endl;
+        }
+    }
+
+    double numMerged = (double)(bench._last._numMerged - bench._start._numMerged);
+    double mergeTime_ms = 1000.0 * (bench._last._mergeTime_s - bench._start._mergeTime_s);
+    double peakMemory_mb = (double)Memory::getProcessPeakPhysicalUsage() / 1048576.0;
+
+    double settleTotal = 0.0, settleMax = 0.0;
+    unsigned timeouts = 0u;
+    for (unsigned i = 0; i < bench._settleTimes_s.size(); ++i)
+    {
+        if (bench._settleTimes_s[i] < 0.0)
+            ++timeouts;
+        else
+        {
+            settleTotal += bench._settleTimes_s[i];
+            settleMax = osg::maximum(settleMax, bench._settleTimes_s[i]);
+        }
+    }
+
+    Json::Value results(Json::objectValue);
+    results["frames"] = bench._numFrames;
+    results["wall_time_s"] = bench._wallTime_s;
+    results["frame_time_ms_p50"] = percentile(bench._frameTimes_ms, 0.50);
+    results["frame_time_ms_p90"] = percentile(bench._frameTimes_ms, 0.90);
+    results["frame_time_ms_p99"] = percentile(bench._frameTimes_ms, 0.99);
+    results["frame_time_ms_max"] = percentile(bench._frameTimes_ms, 1.0);
+    results["tiles_loaded"] = numMerged;
+    results["tiles_loaded_per_s"] = bench._wallTime_s > 0.0 ? numMerged / bench._wallTime_s : 0.0;
+    results["merge_time_ms"] = mergeTime_ms;
+    results["merge_time_ms_per_frame_p99"] = percentile(bench._mergeTimes_ms, 0.99);
+    results["time_to_full_res_s_total"] = settleTotal;
+    results["time_to_full_res_s_max"] = settleMax;
+    results["time_to_full_res_timeouts"] = timeouts;
+    results["peak_memory_mb"] = peakMemory_mb;
+
+    Json::Value settle(Json::arrayValue);
+    for (unsigned i = 0; i < bench._settleTimes_s.size(); ++i)
+        settle.append(bench._settleTimes_s[i]);
+    results["time_to_full_res_s"] = settle;
+
+    std::string json = Json::StyledWriter().write(results);
+    std::cout << json;
+
+    if (!outFile.empty())
+    {
+        std::ofstream out(outFile.c_str());
+        if (!out.is_open())
+        {
+            OE_WARN << LC << "Failed to write " << outFile << std::endl;
+            return -1;
+        }
+        out << json;
+    }
+
+    return 0;
+}
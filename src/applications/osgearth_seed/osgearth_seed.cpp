@@ -41,6 +41,7 @@
 #include <osgEarth/OGRFeatureSource>
 
 #include <iostream>
+#include <iomanip>
 #include <sstream>
 #include <iterator>
 
@@ -49,7 +50,7 @@ using namespace osgEarth;
 #define LC "[osgearth_cache] "
 
 int list( osg::ArgumentParser& args );
-int seed( osg::ArgumentParser& args );
+int seed( osg::ArgumentParser& args, bool merge =false );
 int purge( osg::ArgumentParser& args );
 int usage( const std::string& msg );
 int message( const std::string& msg );
@@ -61,6 +62,8 @@ int main(int argc, char** argv)
 
     if ( args.read( "--seed") )
         return seed( args );
+    else if ( args.read( "--merge" ) )
+        return seed( args, true );
     else if ( args.read( "--list" ) )
         return list( args );
     else if ( args.read( "--purge" ) )
@@ -91,7 +94,16 @@ int usage( const std::string& msg )
         << "        [--mp]                          ; Use multiprocessing to process the tiles.  Useful for GDAL sources as this avoids the global GDAL lock" << std::endl
         << "        [--mt]                          ; Use multithreading to process the tiles." << std::endl
         << "        [--concurrency]                 ; The number of threads or processes to use if --mp or --mt are provided." << std::endl
-        << "        [--verbose]                     ; Displays progress of the seed operation" << std::endl
+        << "        [--verbose]                     ; Displays progress of the seed operation, with rate and ETA per level" << std::endl
+        << "        [--resume]                      ; Record checkpoints in the cache, and skip work finished by an earlier run" << std::endl
+        << "        [--checkpoint-level level]      ; Level of the subtrees that --resume records (default=8)" << std::endl
+        << "        [--max-rate tiles_per_second]   ; Limit the rate of tile requests across all threads" << std::endl
+        << "        [--shard i/N]                   ; Seed only shard i (0-based) of N, e.g. one node of a farm" << std::endl
+        << "        [--shard-level level]           ; Level at which the key space is split into shards (default=8)" << std::endl
+        << std::endl
+        << "    --merge file.earth                  ; Copies tiles from other caches (e.g. from each shard) into the cache in a .earth file" << std::endl
+        << "        --from path                     ; Path of a cache to merge (repeatable); it must use the same cache driver" << std::endl
+        << "        [...]                           ; Same --min-level, --max-level, --bounds, --index, --image and --elevation as the seed" << std::endl
         << std::endl
         << "    --purge file.earth                  ; Purges a layer cache in a .earth file (interactive)" << std::endl
         << std::endl;
@@ -99,6 +111,47 @@ int usage( const std::string& msg )
     return -1;
 }
 
+/**
+ * Prints overall progress, plus the rate and ETA of each level
+ * that's in progress, every few seconds.
+ */
+struct SeedProgressCallback : public ProgressCallback
+{
+    SeedProgressCallback() : _last(0) { }
+
+    bool reportProgress(double current, double total, unsigned, unsigned, const std::string&)
+    {
+        osg::Timer_t now = osg::Timer::instance()->tick();
+        if (_visitor.valid() && (_last == 0 || osg::Timer::instance()->delta_s(_last, now) >= 5.0 || current >= total))
+        {
+            _last = now;
+            std::cout << std::fixed << std::setprecision(1)
+                << "Processed " << (unsigned)current << " of " << (unsigned)total << " tiles" << std::endl;
+
+            for (unsigned lod = _visitor->getMinLevel(); lod <= _visitor->getMaxLevel(); ++lod)
+            {
+                TileVisitor::LevelProgress p;
+                if (!_visitor->getLevelProgress(lod, p))
+                    break;
+
+                if (p.processed > 0 && p.processed < p.total)
+                {
+                    std::cout
+                        << "    LOD " << std::setw(2) << lod << ": "
+                        << p.processed << " / " << p.total << " tiles, "
+                        << p.tilesPerSecond << " tiles/s, ETA "
+                        << (p.etaSeconds >= 0.0 ? prettyPrintTime(p.etaSeconds) : std::string("?"))
+                        << std::endl;
+                }
+            }
+        }
+        return false;
+    }
+
+    osg::observer_ptr<TileVisitor> _visitor;
+    osg::Timer_t _last;
+};
+
 int message( const std::string& msg )
 {
     if ( !msg.empty() )
@@ -108,7 +161,7 @@ int message( const std::string& msg )
     return 0;
 }
 
-int seed( osg::ArgumentParser& args )
+int seed( osg::ArgumentParser& args, bool merge )
 {    
     osgDB::Registry::instance()->getReaderWriterForExtension("png");
     osgDB::Registry::instance()->getReaderWriterForExtension("jpg");
@@ -140,6 +193,33 @@ int seed( osg::ArgumentParser& args )
 
     bool verbose = args.read("--verbose");
 
+    bool resume = args.read("--resume");
+
+    int checkpointLevel = 8;
+    args.read("--checkpoint-level", checkpointLevel);
+
+    double maxRate = 0.0;
+    args.read("--max-rate", maxRate);
+
+    unsigned shardIndex = 0, shardCount = 1;
+    std::string shard;
+    if (args.read("--shard", shard))
+    {
+        if (sscanf(shard.c_str(), "%u/%u", &shardIndex, &shardCount) != 2 || shardCount == 0 || shardIndex >= shardCount)
+            return usage("--shard must be i/N, with 0 <= i < N");
+    }
+
+    int shardLevel = 8;
+    args.read("--shard-level", shardLevel);
+
+    std::vector<std::string> mergeFrom;
+    std::string mergePath;
+    while (args.read("--from", mergePath))
+        mergeFrom.push_back(mergePath);
+
+    if (merge && mergeFrom.empty())
+        return usage("--merge requires at least one --from path");
+
     unsigned int batchSize = 0;
     args.read("--batchsize", batchSize);
 
@@ -281,13 +361,30 @@ int seed( osg::ArgumentParser& args )
         }        
     }
 
-    osg::ref_ptr< ProgressCallback > progress = new ConsoleProgressCallback();
+    osg::ref_ptr< SeedProgressCallback > progress = new SeedProgressCallback();
+    progress->_visitor = visitor.get();
     
     if (verbose)
     {
         visitor->setProgressCallback( progress.get() );
     }
 
+    if (resume && checkpointLevel >= 0)
+    {
+        visitor->setCheckpointLevel( checkpointLevel );
+    }
+
+    if (maxRate > 0.0)
+    {
+        visitor->setMaxTilesPerSecond( maxRate );
+    }
+
+    if (shardCount > 1 && !merge)
+    {
+        visitor->setShard( shardIndex, shardCount, shardLevel >= 0 ? shardLevel : 0 );
+        OE_NOTICE << "Seeding shard " << shardIndex << " of " << shardCount << " (split at level " << shardLevel << ")" << std::endl;
+    }
+
     if ( minLevel >= 0 )
         visitor->setMinLevel( minLevel );
     if ( maxLevel >= 0 )
@@ -308,6 +405,47 @@ int seed( osg::ArgumentParser& args )
 
     osgEarth::Map* map = mapNode->getMap();
 
+    // Merging the caches of other nodes into ours
+    if (merge)
+    {
+        Cache* cache = map->getCache();
+        if (!cache)
+            return usage("The .earth file has no cache to merge into");
+
+        TileLayerVector layers;
+        if (imageLayerIndex >= 0)
+            layers.push_back(map->getLayerAt<ImageLayer>(imageLayerIndex));
+        else if (elevationLayerIndex >= 0)
+            layers.push_back(map->getLayerAt<ElevationLayer>(elevationLayerIndex));
+        else
+            map->getLayers(layers);
+
+        for (unsigned int i = 0; i < mergeFrom.size(); ++i)
+        {
+            Config conf = cache->getCacheOptions().getConfig();
+            conf.set("path", mergeFrom[i]);
+            osg::ref_ptr<Cache> source = osgEarth::Util::CacheFactory::create(CacheOptions(conf));
+            if (!source.valid() || source->getStatus().isError())
+            {
+                std::cout << "Failed to open cache at " << mergeFrom[i] << std::endl;
+                return 1;
+            }
+
+            for (unsigned int j = 0; j < layers.size(); ++j)
+            {
+                if (!layers[j].valid())
+                    continue;
+
+                osg::Timer_t start = osg::Timer::instance()->tick();
+                unsigned int count = seeder.merge(layers[j].get(), map, source.get());
+                osg::Timer_t end = osg::Timer::instance()->tick();
+                OE_NOTICE << "Merged " << count << " tiles of layer " << layers[j]->getName()
+                    << " from " << mergeFrom[i] << " in " << prettyPrintTime( osg::Timer::instance()->delta_s( start, end ) ) << std::endl;
+            }
+        }
+        return 0;
+    }
+
     // They want to seed an image layer
     if (imageLayerIndex >= 0)
     {
@@ -26,6 +26,7 @@
 #include <osgEarth/Registry>
 #include <osgEarth/TerrainEngineNode>
 #include <osgEarth/ExampleResources>
+#include <osgEarth/TileStreamService>
 #include <osgDB/ReaderWriter>
 #include <osgDB/ReadFile>
 #include <osgDB/Registry>
@@ -462,6 +463,28 @@ public:
 
 
 static TileImageServer* _server;
+static osg::ref_ptr<TileStreamService> _streamService;
+
+// Serves the map's layers to TileStream layers; see TileStreamService
+class TileStreamRequestHandler: public HTTPRequestHandler
+{
+public:
+    void handleRequest(HTTPServerRequest& request,
+                       HTTPServerResponse& response)
+    {
+        std::string body;
+        if (_streamService->handleRequest(request.getURI(), body))
+        {
+            response.setContentType("application/octet-stream");
+            response.sendBuffer(body.data(), body.size());
+        }
+        else
+        {
+            response.setStatus(Poco::Net::HTTPResponse::HTTP_NOT_FOUND);
+            response.send();
+        }
+    }
+};
 
 class TileRequestHandler: public HTTPRequestHandler
 {
@@ -527,6 +550,12 @@ class TileRequestHandlerFactory : public HTTPRequestHandlerFactory
     HTTPRequestHandler* createRequestHandler(
         const HTTPServerRequest& request)
     {
+        if (_streamService.valid() &&
+            (startsWith(request.getURI(), "/changes") || startsWith(request.getURI(), "/tiles/")))
+        {
+            return new TileStreamRequestHandler();
+        }
+
         StringTokenizer tok("/");
         StringVector tized;
         tok.tokenize(request.getURI(), tized);
@@ -620,6 +649,11 @@ main(int argc, char** argv)
 
     _server = new TileImageServer( mapNode.get() );
 
+    if (mapNode.valid())
+    {
+        _streamService = new TileStreamService(mapNode->getMap());
+    }
+
     TileHTTPServer app(port);
     return app.run(argc, argv);
 }
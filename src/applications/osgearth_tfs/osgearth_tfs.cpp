@@ -23,6 +23,9 @@
 #include <osg/Notify>
 #include <osgEarth/TFSPackager>
 #include <osgEarth/OGRFeatureSource>
+#include <osgEarth/Registry>
+#include <fstream>
+#include <sstream>
 
 using namespace osgEarth;
 using namespace osgEarth::Contrib;
@@ -52,6 +55,12 @@ usage( const std::string& msg )
         << "    --crop             ; Crops features instead of doing a centroid check.  Features can be added to multiple tiles when cropping is enabled" << std::endl
         << "    --dest-srs         ; The destination SRS string in any format osgEarth can understand (wkt, proj4, epsg).  If none is specified the source data SRS will be used" << std::endl
         << "    --bounds minx miny maxx maxy ; The bounding box to use as Level 0.  Feature extent will be used by default" << std::endl
+        << "    --generalize       ; Simplifies feature geometry to the resolution of the tiles" << std::endl
+        << "    --generalize-resolution ; Number of cells across a tile that simplified geometry must resolve (default is 256)" << std::endl
+        << "    --styles           ; A style sheet (or earth file); only the attributes it references are written" << std::endl
+        << "    --keep             ; An attribute to write, in addition to those the styles reference.  Can be repeated" << std::endl
+        << "    --mvt              ; Writes Mapbox vector tiles into an MBTiles file (the --out destination) instead of TFS" << std::endl
+        << "    --threads          ; The number of tiles to write concurrently" << std::endl
         << std::endl;
 
     return -1;
@@ -106,6 +115,30 @@ int main(int argc, char** argv)
     std::string destSRS;
     while(arguments.read("--dest-srs", destSRS));
 
+    bool generalize = arguments.read("--generalize");
+
+    unsigned int generalizeResolution = 256;
+    while (arguments.read("--generalize-resolution", generalizeResolution));
+
+    std::string stylesFile;
+    while (arguments.read("--styles", stylesFile));
+
+    std::set<std::string> attributes;
+    std::string attribute;
+    while (arguments.read("--keep", attribute))
+    {
+        attributes.insert(attribute);
+    }
+
+    bool mvt = arguments.read("--mvt");
+
+    unsigned int threads = 0;
+    while (arguments.read("--threads", threads));
+    if (threads > 0)
+    {
+        Registry::instance()->getJobArena("features.package")->setConcurrency(threads);
+    }
+
     std::string grid;
     float gridSizeMeters = -1.0f;
     while (arguments.read("--grid", grid));
@@ -210,6 +243,8 @@ int main(int argc, char** argv)
         << "  OrderBy=" << queryOrderBy << std::endl
         << "  Method= " << method << std::endl
         << "  DestSRS= " << destSRS << std::endl
+        << "  Generalize= " << (generalize ? "yes" : "no") << std::endl
+        << "  Format= " << (mvt ? "MVT" : "TFS") << std::endl
         << std::endl;
 
     //buildTFS( features.get(), firstLevel, maxLevel, maxFeatures, destination, layer, description, query, cropMethod);
@@ -221,6 +256,22 @@ int main(int argc, char** argv)
     packager.setMethod( cropMethod );    
     packager.setDestSRS( destSRS );
     packager.setLod0Extent(ext);
+    packager.setGeneralize( generalize );
+    packager.setGeneralizeResolution( generalizeResolution );
+    packager.setFormat( mvt ? TFSPackager::FORMAT_MVT : TFSPackager::FORMAT_TFS );
+    packager.setAttributes( attributes );
+
+    if (!stylesFile.empty())
+    {
+        std::ifstream in( stylesFile.c_str() );
+        if (!in.is_open())
+        {
+            return usage( "Failed to read the styles from " + stylesFile );
+        }
+        std::stringstream buf;
+        buf << in.rdbuf();
+        packager.addReferencedAttributes( buf.str() );
+    }
 
     packager.package( features.get(), destination, layer, description );
     osg::Timer_t endTime = osg::Timer::instance()->tick();
@@ -0,0 +1,80 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2020 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/Common>
+#include <osgEarth/Notify>
+#include <osgEarth/ModelTiler>
+#include <osgDB/ReadFile>
+
+#define LC "[tilemodel] "
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+int
+usage(const char* name, const std::string& error)
+{
+    OE_NOTICE
+        << "Error: " << error
+        << "\nUsage:"
+        << "\n" << name << " model.osgb"
+        << "\n  --out folder          ; output folder; load folder/tiles.json in a tiled model layer"
+        << "\n  --max-triangles n     ; most triangles in one cell (default 65536)"
+        << "\n  --max-depth n         ; deepest level of the octree (default 8)"
+        << std::endl;
+
+    return -1;
+}
+
+int
+main(int argc, char** argv)
+{
+    osgEarth::initialize();
+
+    osg::ArgumentParser arguments(&argc, argv);
+
+    std::string out;
+    if (!arguments.read("--out", out))
+        return usage(argv[0], "Missing --out");
+
+    ModelTiler tiler;
+
+    unsigned value;
+    if (arguments.read("--max-triangles", value))
+        tiler.setMaxTrianglesPerCell(value);
+    if (arguments.read("--max-depth", value))
+        tiler.setMaxDepth(value);
+
+    osg::ref_ptr<osg::Node> model = osgDB::readRefNodeFiles(arguments);
+    if (!model.valid())
+        return usage(argv[0], "Failed to load a model");
+
+    Status status = tiler.tile(model.get(), out);
+    if (status.isError())
+    {
+        OE_WARN << LC << status.message() << std::endl;
+        return -1;
+    }
+
+    OE_NOTICE << LC << "Wrote " << out << std::endl;
+    return 0;
+}
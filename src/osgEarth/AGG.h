@@ -729,10 +729,25 @@ namespace agg
 
             m_scanline.reset(m_outline.min_x(), m_outline.max_x(), dx, dy);
 
+            // The renderer clips away rows outside its buffer, so only sweep
+            // the rows it can draw. Cells are sorted by row; skip the ones
+            // below (keeping their cover) and stop at the first one above.
+            int y_begin = -dy;
+            int y_end = int(r.rbuf().height()) - dy;
+
             cover = 0;
             const cell* cur_cell = *cells++;
+            while(cur_cell && cur_cell->y < y_begin)
+            {
+                cover += cur_cell->cover;
+                cur_cell = *cells++;
+            }
+            if(!cur_cell) return;
+
             for(;;)
             {
+                if(cur_cell->y >= y_end) break;
+
                 const cell* start_cell = cur_cell;
 
                 int coord  = cur_cell->packed_coord;
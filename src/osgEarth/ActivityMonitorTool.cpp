@@ -19,6 +19,9 @@
 
 #include <osgEarth/ActivityMonitorTool>
 #include <osgEarth/Registry>
+#include <osgEarth/Counters>
+#include <iomanip>
+#include <sstream>
 
 using namespace osgEarth;
 using namespace osgEarth::Contrib;
@@ -27,11 +30,64 @@ using namespace osgEarth::Util::Controls;
 //-----------------------------------------------------------------------
 
 ActivityMonitorTool::ActivityMonitorTool(VBox* vbox) :
-_vbox( vbox )
+_vbox( vbox ),
+_showCounters( false ),
+_counterInterval( 30u ),
+_framesSinceCounters( 0u )
 {
     //nop
 }
 
+void
+ActivityMonitorTool::updateCounterLines()
+{
+    Util::Counters::Stats stats;
+    Util::Counters::getStats(stats);
+
+    _counterLines.clear();
+
+    std::ostringstream buf;
+    buf << std::fixed;
+
+    for (const auto& c : stats._counters)
+    {
+        if (c._total == 0)
+            continue;
+        buf.str("");
+        buf << c._name << ": " << c._frame << " / " << c._total;
+        _counterLines.push_back(buf.str());
+    }
+
+    for (const auto& g : stats._gauges)
+    {
+        if (g._value == 0)
+            continue;
+        buf.str("");
+        const std::string suffix(".bytes");
+        if (g._name.size() > suffix.size() &&
+            g._name.compare(g._name.size() - suffix.size(), suffix.size(), suffix) == 0)
+        {
+            buf << g._name << ": " << std::setprecision(1) << (double)g._value / 1048576.0 << " MB";
+        }
+        else
+        {
+            buf << g._name << ": " << g._value;
+        }
+        _counterLines.push_back(buf.str());
+    }
+
+    for (const auto& h : stats._histograms)
+    {
+        if (h._count == 0)
+            continue;
+        buf.str("");
+        buf << h._name << ": " << std::setprecision(2)
+            << "p50=" << h._p50 << " p99=" << h._p99 << " max=" << h._max
+            << " (" << h._count << ")";
+        _counterLines.push_back(buf.str());
+    }
+}
+
 bool
 ActivityMonitorTool::handle(const osgGA::GUIEventAdapter& ea, osgGA::GUIActionAdapter& aa)
 {
@@ -42,13 +98,35 @@ ActivityMonitorTool::handle(const osgGA::GUIEventAdapter& ea, osgGA::GUIActionAd
         {
             std::set<std::string> activity;
             Registry::instance()->getActivities(activity);
-            if ( activity != _prev )
+
+            bool countersChanged = false;
+            if (_showCounters)
+            {
+                if (_framesSinceCounters == 0u)
+                {
+                    updateCounterLines();
+                    countersChanged = true;
+                }
+                _framesSinceCounters = (_framesSinceCounters + 1u) % _counterInterval;
+            }
+            else if (!_counterLines.empty())
+            {
+                _counterLines.clear();
+                _framesSinceCounters = 0u;
+                countersChanged = true;
+            }
+
+            if ( activity != _prev || countersChanged )
             {            
                 _vbox->clearControls();
                 for(std::set<std::string>::const_iterator i = activity.begin(); i != activity.end(); ++i)
                 {
                     _vbox->addControl( new LabelControl(*i) );
                 }
+                for(std::vector<std::string>::const_iterator i = _counterLines.begin(); i != _counterLines.end(); ++i)
+                {
+                    _vbox->addControl( new LabelControl(*i, 12.0f) );
+                }
                 _prev = activity;
             }
         }        
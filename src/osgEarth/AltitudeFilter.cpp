@@ -69,13 +69,17 @@ AltitudeFilter::pushAndDontClamp( FeatureList& features, FilterContext& cx )
 {
     OE_PROFILING_ZONE;
 
-    NumericExpression scaleExpr;
+    CompiledNumericExpression scaleExpr;
     if ( _altitude.valid() && _altitude->verticalScale().isSet() )
-        scaleExpr = *_altitude->verticalScale();
+        scaleExpr.compile( *_altitude->verticalScale() );
 
-    NumericExpression offsetExpr;
+    CompiledNumericExpression offsetExpr;
     if ( _altitude.valid() && _altitude->verticalOffset().isSet() )
-        offsetExpr = *_altitude->verticalOffset();
+        offsetExpr.compile( *_altitude->verticalOffset() );
+
+    CompiledStringExpression script;
+    if ( _altitude.valid() && _altitude->script().isSet() )
+        script.compile( StringExpression(_altitude->script().get()) );
 
     bool gpuClamping =
         _altitude.valid() &&
@@ -90,10 +94,9 @@ AltitudeFilter::pushAndDontClamp( FeatureList& features, FilterContext& cx )
         Feature* feature = i->get();
         
         // run a symbol script if present.
-        if ( _altitude.valid() && _altitude->script().isSet() )
+        if ( !script.empty() )
         {
-            StringExpression temp( _altitude->script().get() );
-            feature->eval( temp, &cx );
+            feature->eval( script, &cx );
         }
         if (feature->getGeometry() == 0L)
             continue;
@@ -167,13 +170,17 @@ AltitudeFilter::pushAndClamp( FeatureList& features, FilterContext& cx )
     // establish an elevation query interface based on the features' SRS.
     ElevationQuery eq(map.get());
 
-    NumericExpression scaleExpr;
+    CompiledNumericExpression scaleExpr;
     if ( _altitude->verticalScale().isSet() )
-        scaleExpr = *_altitude->verticalScale();
+        scaleExpr.compile( *_altitude->verticalScale() );
 
-    NumericExpression offsetExpr;
+    CompiledNumericExpression offsetExpr;
     if ( _altitude->verticalOffset().isSet() )
-        offsetExpr = *_altitude->verticalOffset();
+        offsetExpr.compile( *_altitude->verticalOffset() );
+
+    CompiledStringExpression script;
+    if ( _altitude->script().isSet() )
+        script.compile( StringExpression(_altitude->script().get()) );
 
     // whether to record the min/max height-above-terrain values.
     bool collectHATs =
@@ -193,10 +200,9 @@ AltitudeFilter::pushAndClamp( FeatureList& features, FilterContext& cx )
         Feature* feature = i->get();
         
         // run a symbol script if present.
-        if ( _altitude.valid() && _altitude->script().isSet() )
+        if ( !script.empty() )
         {
-            StringExpression temp( _altitude->script().get() );
-            feature->eval( temp, &cx );
+            feature->eval( script, &cx );
         }
         if (feature->getGeometry() == 0L)
             continue;
@@ -18,6 +18,8 @@
  */
 #include <osgEarth/AnnotationLayer>
 #include <osgEarth/AnnotationRegistry>
+#include <osgEarth/HTM>
+#include <cfloat>
 
 using namespace osgEarth;
 
@@ -29,13 +31,15 @@ Config
 AnnotationLayer::Options::getConfig() const
 {
     Config conf = VisibleLayer::Options::getConfig();
+    conf.set("spatial_index", _spatialIndex);
     return conf;
 }
 
 void
 AnnotationLayer::Options::fromConfig(const Config& conf)
 {
-    // NOP
+    _spatialIndex.init(false);
+    conf.get("spatial_index", _spatialIndex);
 }
 
 //...................................................................
@@ -45,7 +49,20 @@ AnnotationLayer::init()
 {
     VisibleLayer::init();
 
-    _root = new osg::Group();
+    if (options().spatialIndex() == true)
+    {
+        // cull by cell, including against the horizon, but never hide
+        // annotations by range; that's up to the layer and the nodes.
+        Contrib::HTMGroup* htm = new Contrib::HTMGroup();
+        htm->setDebug(false);
+        htm->setHorizonCulling(true);
+        htm->setMaxRange(FLT_MAX);
+        _root = htm;
+    }
+    else
+    {
+        _root = new osg::Group();
+    }
 
     deserialize();
 
@@ -81,6 +98,15 @@ AnnotationLayer::deserialize()
     AnnotationRegistry::instance()->create(0L, options().getConfig(), getReadOptions(), group);
     if (group)
     {
-        _root->addChild(group);
+        if (options().spatialIndex() == true)
+        {
+            // index the annotations themselves, not the group holding them
+            for (unsigned i = 0; i < group->getNumChildren(); ++i)
+                _root->addChild(group->getChild(i));
+        }
+        else
+        {
+            _root->addChild(group);
+        }
     }
 }
@@ -18,8 +18,25 @@
  */
 #include <osgEarth/ArcGISTilePackage>
 #include <osgEarth/XmlUtils>
+#include <osgEarth/Containers>
+#include <osgEarth/Threading>
 #include <osgDB/FileUtils>
 #include <osgDB/FileNameUtils>
+#include <cstring>
+#include <fstream>
+#include <streambuf>
+
+#ifdef _WIN32
+#   ifndef WIN32_LEAN_AND_MEAN
+#       define WIN32_LEAN_AND_MEAN
+#   endif
+#   include <windows.h>
+#else
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <fcntl.h>
+#   include <unistd.h>
+#endif
 
 using namespace osgEarth;
 using namespace osgEarth::ArcGIS;
@@ -80,14 +97,170 @@ namespace osgEarth { namespace ArcGIS
 
 } }
 
+namespace osgEarth { namespace ArcGIS
+{
+    /**
+     * Read-only view of an entire bundle file. Nothing writes to a
+     * bundle while it's in use, so the bytes under a view never change.
+     */
+    class MappedFile : public osg::Referenced
+    {
+    public:
+        static MappedFile* open(const std::string& path)
+        {
+            osg::ref_ptr<MappedFile> m = new MappedFile();
+#ifdef _WIN32
+            HANDLE file = ::CreateFileA(path.c_str(), GENERIC_READ,
+                FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+            if (file == INVALID_HANDLE_VALUE)
+                return 0L;
+
+            LARGE_INTEGER size;
+            if (::GetFileSizeEx(file, &size) && size.QuadPart > 0)
+            {
+                HANDLE mapping = ::CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+                if (mapping)
+                {
+                    m->_data = (const char*)::MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+                    m->_size = (unsigned long long)size.QuadPart;
+                    ::CloseHandle(mapping);
+                }
+            }
+            ::CloseHandle(file);
+#else
+            int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0)
+                return 0L;
+
+            struct stat st;
+            if (::fstat(fd, &st) == 0 && st.st_size > 0)
+            {
+                void* ptr = ::mmap(0L, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+                if (ptr != MAP_FAILED)
+                {
+                    m->_data = (const char*)ptr;
+                    m->_size = (unsigned long long)st.st_size;
+                }
+            }
+            ::close(fd);
+#endif
+            return m->_data ? m.release() : 0L;
+        }
+
+        const char* data() const { return _data; }
+
+        unsigned long long size() const { return _size; }
+
+    protected:
+        MappedFile() : _data(0L), _size(0u) { }
+
+        virtual ~MappedFile()
+        {
+            if (_data)
+            {
+#ifdef _WIN32
+                ::UnmapViewOfFile(_data);
+#else
+                ::munmap(const_cast<char*>(_data), (size_t)_size);
+#endif
+            }
+        }
+
+        const char* _data;
+        unsigned long long _size;
+    };
+} }
+
+namespace
+{
+    // istream source over memory, so tiles decode from the mapping
+    // without first being copied into a string.
+    struct MemoryStreamBuf : public std::streambuf
+    {
+        MemoryStreamBuf(const char* data, std::size_t length)
+        {
+            char* p = const_cast<char*>(data);
+            setg(p, p, p + length);
+        }
+
+        // image readers may peek at the header and rewind
+        pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode) override
+        {
+            char* p =
+                dir == std::ios_base::beg ? eback() + off :
+                dir == std::ios_base::cur ? gptr() + off :
+                egptr() + off;
+
+            if (p < eback() || p > egptr())
+                return pos_type(off_type(-1));
+
+            setg(eback(), p, egptr());
+            return pos_type(p - eback());
+        }
+
+        pos_type seekpos(pos_type pos, std::ios_base::openmode which) override
+        {
+            return seekoff(off_type(pos), std::ios_base::beg, which);
+        }
+    };
+
+    unsigned int readUInt32LE(const char* p)
+    {
+        const unsigned char* u = (const unsigned char*)p;
+        return (unsigned int)u[0] | ((unsigned int)u[1] << 8) | ((unsigned int)u[2] << 16) | ((unsigned int)u[3] << 24);
+    }
+
+    unsigned long long readUInt64LE(const char* p)
+    {
+        const unsigned char* u = (const unsigned char*)p;
+        unsigned long long result = 0u;
+        for (int i = 7; i >= 0; --i)
+            result = (result << 8) | u[i];
+        return result;
+    }
+}
+
 //........................................................................
 
-BundleReader::BundleReader(const std::string& bundleFile, unsigned int bundleSize) :
+Bundle::Bundle(const std::string& bundleFile, unsigned int bundleSize) :
     _bundleFile(bundleFile),
+    _bundleSize(bundleSize),
     _lod(0),
-    _colOffset(0),
     _rowOffset(0),
-    _bundleSize(bundleSize)
+    _colOffset(0)
+{
+    std::string base = osgDB::getNameLessExtension(_bundleFile);
+    std::string baseName = osgDB::getSimpleFileName(base);
+
+    _rowOffset = hexFromString(baseName.substr(1, 4));
+    _colOffset = hexFromString(baseName.substr(6, 4));
+
+    std::string path = osgDB::getFilePath(_bundleFile);
+
+    std::string levelDir = osgDB::getSimpleFileName(path);
+    _lod = as<unsigned int>(levelDir.substr(1, 2), 0);
+}
+
+Bundle::~Bundle()
+{
+    //nop
+}
+
+osg::Image* Bundle::readImage(unsigned long long offset, unsigned long long size) const
+{
+    if (!_file.valid() || size == 0 || offset > _file->size() || size > _file->size() - offset)
+        return 0;
+
+    MemoryStreamBuf buf(_file->data() + offset, (std::size_t)size);
+    std::istream in(&buf);
+    return ImageUtils::readStream(in, 0);
+}
+
+//........................................................................
+
+BundleReader::BundleReader(const std::string& bundleFile, unsigned int bundleSize) :
+    Bundle(bundleFile, bundleSize)
 {
     init();
 }
@@ -97,21 +270,13 @@ void BundleReader::init()
     std::string base = osgDB::getNameLessExtension(_bundleFile);
     _indexFile = base + ".bundlx";
 
-    // Open the bundle
-    _in.open(_bundleFile.c_str(), std::ofstream::binary);
-
     // Read the index
+    _index.clear();
     readIndex(_indexFile, _index);
 
-    std::string baseName = osgDB::getSimpleFileName(base);
-
-    _rowOffset = hexFromString(baseName.substr(1, 4));
-    _colOffset = hexFromString(baseName.substr(6, 4));
-
-    std::string path = osgDB::getFilePath(_bundleFile);
-
-    std::string levelDir = osgDB::getSimpleFileName(path);
-    _lod = as<unsigned int>(levelDir.substr(1, 2), 0);
+    // Map the bundle
+    if (!_index.empty())
+        _file = MappedFile::open(_bundleFile);
 }
 
 /**
@@ -133,7 +298,7 @@ void BundleReader::readIndex(const std::string& filename, std::vector<int>& inde
     }
 }
 
-osg::Image* BundleReader::readImage(const TileKey& key)
+osg::Image* BundleReader::readImage(const TileKey& key) const
 {
     // Figure out the index for the tilekey
     unsigned int row = key.getTileX() - _colOffset;
@@ -141,59 +306,39 @@ osg::Image* BundleReader::readImage(const TileKey& key)
     return readImage(i);
 }
 
-osg::Image* BundleReader::readImage(unsigned int index)
+osg::Image* BundleReader::readImage(unsigned int index) const
 {
-    if (index < 0 || index >= _index.size()) return 0;
-
-    _in.seekg(_index[index], std::ios::beg);
-    std::vector<char> sizeBuffer;
-    sizeBuffer.resize(4);
-    _in.read(&sizeBuffer[0], 4);
-    int size = computeOffset(sizeBuffer);
-    if (size > 0)
-    {
-        std::string image;
-        image.resize(size);
-        _in.read(&image[0], size);
-        std::stringstream ss(image);
-        return ImageUtils::readStream(ss, 0);
-    }
+    if (!_file.valid() || index >= _index.size()) return 0;
 
-    return 0;
+    // Each tile starts with its size
+    unsigned long long offset = (unsigned int)_index[index];
+    if (offset + 4u > _file->size())
+        return 0;
+
+    unsigned int size = readUInt32LE(_file->data() + offset);
+    return Bundle::readImage(offset + 4u, size);
 }
 
 //........................................................................
 const unsigned long long M = pow(2, 40);
 
 BundleReader2::BundleReader2(const std::string& bundleFile, unsigned int bundleSize) :
-    _bundleFile(bundleFile),
-    _lod(0),
-    _colOffset(0),
-    _rowOffset(0),
-    _bundleSize(bundleSize)
+    Bundle(bundleFile, bundleSize)
 {
     init();
 }
 
 void BundleReader2::init()
 {
-    std::string base = osgDB::getNameLessExtension(_bundleFile);
-
-    // Open the bundle
-    _in.open(_bundleFile.c_str(), std::ofstream::binary);
+    // Map the bundle, which holds its own index
+    _file = MappedFile::open(_bundleFile);
 
     // Read the index
+    _index.clear();
     readIndex(_index);
 
-    std::string baseName = osgDB::getSimpleFileName(base);
-
-    _rowOffset = hexFromString(baseName.substr(1, 4));
-    _colOffset = hexFromString(baseName.substr(6, 4));
-
-    std::string path = osgDB::getFilePath(_bundleFile);
-
-    std::string levelDir = osgDB::getSimpleFileName(path);
-    _lod = as<unsigned int>(levelDir.substr(1, 2), 0);
+    if (_index.empty())
+        _file = 0L;
 }
 
 /**
@@ -201,28 +346,22 @@ void BundleReader2::init()
 */
 void BundleReader2::readIndex(std::vector<unsigned long long>& index)
 {
-    // Go past the bundle header
-    _in.seekg(64);
+    // The index follows the 64-byte bundle header
+    const unsigned long long headerSize = 64u;
+    const unsigned int numEntries = _bundleSize * _bundleSize;
 
-    const unsigned int numEntries = 128 * 128;
-    index = std::vector<unsigned long long>(numEntries, 0);
+    if (!_file.valid() || _file->size() < headerSize + numEntries * sizeof(unsigned long long))
+        return;
 
-    //unsigned long long indexBuffer[numEntries];
-    _in.read((char*)&index[0], numEntries * sizeof(unsigned long long));
-    unsigned int numGoodEntries = 0;
-    for (unsigned int i = 0; i < numEntries; i++)
+    index.resize(numEntries);
+    const char* ptr = _file->data() + headerSize;
+    for (unsigned int i = 0; i < numEntries; ++i, ptr += sizeof(unsigned long long))
     {
-        unsigned long long tile_index = index[i];
-        unsigned long long tileOffset = tile_index % (unsigned long long)M;
-        unsigned long long tileSize = floor((unsigned long long)tile_index / M);
-        if (tileSize > 0)
-        {
-            numGoodEntries++;
-        }
+        index[i] = readUInt64LE(ptr);
     }
 }
 
-osg::Image* BundleReader2::readImage(const TileKey& key)
+osg::Image* BundleReader2::readImage(const TileKey& key) const
 {
     unsigned int col = key.getTileX() - _colOffset;
     unsigned int row = key.getTileY() - _rowOffset;
@@ -230,25 +369,17 @@ osg::Image* BundleReader2::readImage(const TileKey& key)
     return readImage(i);
 }
 
-osg::Image* BundleReader2::readImage(unsigned int index)
+osg::Image* BundleReader2::readImage(unsigned int index) const
 {
-    if (index < 0 || index >= _index.size()) return 0;
+    if (index >= _index.size()) return 0;
 
+    // Each entry packs the tile's offset into its low 40 bits and its size
+    // into the high 24
     unsigned long long tile_index = _index[index];
-    unsigned long long tileOffset = tile_index % (unsigned long long)M;
-    unsigned long long tileSize = floor((unsigned long long)tile_index / M);
-
-    _in.seekg(tileOffset, std::ios::beg);
-    if (tileSize > 0)
-    {
-        std::string imageData;
-        imageData.resize(tileSize);
-        _in.read(&imageData[0], tileSize);
-        std::stringstream ss(imageData);
-        return ImageUtils::readStream(ss, 0);
-    }
+    unsigned long long tileOffset = tile_index % M;
+    unsigned long long tileSize = tile_index / M;
 
-    return 0;
+    return Bundle::readImage(tileOffset, tileSize);
 }
 
 //........................................................................
@@ -271,6 +402,17 @@ ArcGISTilePackageImageLayer::Options::fromConfig(const Config& conf)
 
 REGISTER_OSGEARTH_LAYER(arcgistilepackageimage, ArcGISTilePackageImageLayer);
 
+// Open bundles, shared by every thread reading the layer
+struct ArcGISTilePackageImageLayer::BundleCache
+{
+    BundleCache() :
+        _bundles(true, 32u),
+        _opening("ArcGISTilePackageImageLayer.BundleCache(OE)") { }
+
+    LRUCache<std::string, osg::ref_ptr<Bundle> > _bundles;
+    Threading::SingleFlight<std::string, osg::ref_ptr<Bundle> > _opening;
+};
+
 OE_LAYER_PROPERTY_IMPL(ArcGISTilePackageImageLayer, URI, URL, url);
 
 void
@@ -280,6 +422,7 @@ ArcGISTilePackageImageLayer::init()
     _bundleSize = 128u;
     _extension = "png";
     _storageFormat = STORAGE_FORMAT_COMPACT;
+    _bundles = std::make_shared<BundleCache>();
 }
 
 ArcGISTilePackageImageLayer::~ArcGISTilePackageImageLayer()
@@ -296,6 +439,9 @@ ArcGISTilePackageImageLayer::openImplementation()
 
     readConf();
 
+    // the bundle layout may have changed
+    _bundles = std::make_shared<BundleCache>();
+
     // establish a profile if we don't already have one:
     if (!getProfile())
     {
@@ -334,19 +480,11 @@ ArcGISTilePackageImageLayer::createImageImplementation(const TileKey& key, Progr
     buf << ".bundle";
 
     std::string bundleFile = buf.str();
-    if (osgDB::fileExists(bundleFile))
+
+    osg::ref_ptr<Bundle> bundle = getBundle(bundleFile);
+    if (bundle.valid())
     {
-        osg::Image* result = NULL;
-        if (_storageFormat == STORAGE_FORMAT_COMPACT)
-        {
-            BundleReader reader(bundleFile, _bundleSize);
-            result = reader.readImage(key);
-        }
-        if (_storageFormat == STORAGE_FORMAT_COMPACTV2)
-        {
-            BundleReader2 reader(bundleFile, _bundleSize);
-            result = reader.readImage(key);
-        }
+        osg::Image* result = bundle->readImage(key);
         if (result)
         {
             return GeoImage(result, key.getExtent());
@@ -355,6 +493,35 @@ ArcGISTilePackageImageLayer::createImageImplementation(const TileKey& key, Progr
     return GeoImage::INVALID;
 }
 
+osg::ref_ptr<Bundle>
+ArcGISTilePackageImageLayer::getBundle(const std::string& bundleFile) const
+{
+    std::shared_ptr<BundleCache> cache = _bundles;
+
+    // Missing and unreadable bundles are cached too, so that reads
+    // under them don't keep going to the file system.
+    osg::ref_ptr<Bundle> bundle = cache->_opening.run(bundleFile, [&](bool&) -> osg::ref_ptr<Bundle>
+    {
+        LRUCache<std::string, osg::ref_ptr<Bundle> >::Record record;
+        if (cache->_bundles.get(bundleFile, record))
+            return record.value();
+
+        osg::ref_ptr<Bundle> result;
+        if (_storageFormat == STORAGE_FORMAT_COMPACTV2)
+            result = new BundleReader2(bundleFile, _bundleSize);
+        else
+            result = new BundleReader(bundleFile, _bundleSize);
+
+        cache->_bundles.insert(bundleFile, result);
+        return result;
+    });
+
+    if (bundle.valid() && !bundle->valid())
+        bundle = 0L;
+
+    return bundle;
+}
+
 void
 ArcGISTilePackageImageLayer::readConf()
 {
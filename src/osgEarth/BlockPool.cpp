@@ -0,0 +1,160 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2020 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#include <osgEarth/BlockPool>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+#define GRAIN 16u
+#define MAX_BLOCK_SIZE 512u
+#define NUM_CLASSES (MAX_BLOCK_SIZE / GRAIN)
+
+// Most free blocks a thread holds onto per size class
+#define MAX_CACHED 1024u
+
+namespace
+{
+    bool envEnabled()
+    {
+        const char* value = ::getenv("OSGEARTH_BLOCK_POOL");
+        return value == 0L || ::strcmp(value, "0") != 0;
+    }
+
+    std::atomic<bool> s_enabled(envEnabled());
+
+    struct FreeBlock
+    {
+        FreeBlock* _next;
+    };
+
+    struct ThreadCache
+    {
+        ThreadCache();
+        ~ThreadCache();
+        FreeBlock* _heads[NUM_CLASSES];
+        unsigned _counts[NUM_CLASSES];
+    };
+
+    // Trivially destructible, so it's still readable while other
+    // thread_local destructors free objects after the cache is gone.
+    enum CacheState { CACHE_UNBORN, CACHE_ALIVE, CACHE_DEAD };
+    thread_local CacheState s_cacheState = CACHE_UNBORN;
+
+    thread_local ThreadCache s_cache;
+
+    ThreadCache::ThreadCache()
+    {
+        for (unsigned i = 0; i < NUM_CLASSES; ++i)
+        {
+            _heads[i] = 0L;
+            _counts[i] = 0u;
+        }
+        s_cacheState = CACHE_ALIVE;
+    }
+
+    ThreadCache::~ThreadCache()
+    {
+        s_cacheState = CACHE_DEAD;
+        for (unsigned i = 0; i < NUM_CLASSES; ++i)
+        {
+            while (_heads[i])
+            {
+                FreeBlock* block = _heads[i];
+                _heads[i] = block->_next;
+                ::operator delete(block);
+            }
+        }
+    }
+
+    inline unsigned sizeClass(std::size_t bytes)
+    {
+        return bytes > 0u ? (unsigned)((bytes - 1u) / GRAIN) : 0u;
+    }
+}
+
+void*
+BlockPool::allocate(std::size_t bytes)
+{
+    if (bytes > MAX_BLOCK_SIZE)
+        return ::operator new(bytes);
+
+    // Always allocate the full class size, even when not pooling, so any
+    // block freed into a class can serve any request that maps to it.
+    unsigned c = sizeClass(bytes);
+
+    if (s_enabled && s_cacheState != CACHE_DEAD)
+    {
+        // touching s_cache constructs it on this thread's first use
+        ThreadCache& cache = s_cache;
+        if (cache._heads[c])
+        {
+            FreeBlock* block = cache._heads[c];
+            cache._heads[c] = block->_next;
+            --cache._counts[c];
+            return block;
+        }
+    }
+
+    return ::operator new((c + 1u) * GRAIN);
+}
+
+void
+BlockPool::deallocate(void* ptr, std::size_t bytes)
+{
+    if (ptr == 0L)
+        return;
+
+    if (bytes > MAX_BLOCK_SIZE || !s_enabled || s_cacheState == CACHE_DEAD)
+    {
+        ::operator delete(ptr);
+        return;
+    }
+
+    unsigned c = sizeClass(bytes);
+    ThreadCache& cache = s_cache;
+    if (cache._counts[c] >= MAX_CACHED)
+    {
+        ::operator delete(ptr);
+        return;
+    }
+
+    FreeBlock* block = static_cast<FreeBlock*>(ptr);
+    block->_next = cache._heads[c];
+    cache._heads[c] = block;
+    ++cache._counts[c];
+}
+
+void
+BlockPool::setEnabled(bool value)
+{
+    s_enabled = value;
+}
+
+bool
+BlockPool::isEnabled()
+{
+    return s_enabled;
+}
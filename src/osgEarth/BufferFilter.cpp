@@ -18,9 +18,14 @@
  */
 #include <osgEarth/BufferFilter>
 #include <osgEarth/FilterContext>
+#include <osgEarth/Registry>
+#include <osgEarth/Threading>
 
 #define LC "[BufferFilter] "
 
+// buffering is expensive, so even small lists are worth splitting
+#define MIN_FEATURES_PER_CHUNK 8u
+
 using namespace osgEarth;
 
 bool
@@ -84,34 +89,77 @@ BufferFilter::push( FeatureList& input, FilterContext& context )
         return context;
     }
 
-    //OE_NOTICE << "Buffer: input = " << input.size() << " features" << std::endl;
-    for( FeatureList::iterator i = input.begin(); i != input.end(); )
+    BufferParameters params;
+
+    params._capStyle =
+            _capStyle == Stroke::LINECAP_ROUND  ? BufferParameters::CAP_ROUND :
+            _capStyle == Stroke::LINECAP_SQUARE ? BufferParameters::CAP_SQUARE :
+            _capStyle == Stroke::LINECAP_FLAT   ? BufferParameters::CAP_FLAT :
+                                                  BufferParameters::CAP_SQUARE;
+
+    params._cornerSegs = _numQuadSegs;
+
+    // Each feature buffers independently (every call converts to GEOS in its
+    // own context), so split the list into contiguous chunks and buffer them
+    // concurrently.
+    std::vector<Feature*> features;
+    features.reserve(input.size());
+    for( FeatureList::iterator i = input.begin(); i != input.end(); ++i )
+        features.push_back(i->get());
+
+    std::vector< osg::ref_ptr<Geometry> > output(features.size());
+    double distance = _distance.value();
+
+    auto bufferChunk = [&features, &output, &params, distance](unsigned begin, unsigned end)
     {
-        Feature* feature = i->get();
-        if ( !feature || !feature->getGeometry() )
-            continue;
+        for(unsigned i = begin; i < end; ++i)
+        {
+            Feature* feature = features[i];
+            if ( feature && feature->getGeometry() )
+                feature->getGeometry()->buffer( distance, output[i], params );
+        }
+    };
 
-        osg::ref_ptr<Geometry> output;
+    Threading::JobArena* arena = Registry::instance()->getJobArena("features.build");
+    unsigned size = (unsigned)features.size();
+    unsigned numChunks = osg::maximum(1u, osg::minimum(arena->getConcurrency() + 1u, size / MIN_FEATURES_PER_CHUNK));
 
-        BufferParameters params;
-        
-        params._capStyle =
-                _capStyle == Stroke::LINECAP_ROUND  ? BufferParameters::CAP_ROUND :
-                _capStyle == Stroke::LINECAP_SQUARE ? BufferParameters::CAP_SQUARE :
-                _capStyle == Stroke::LINECAP_FLAT   ? BufferParameters::CAP_FLAT :
-                                                      BufferParameters::CAP_SQUARE;
+    // Dispatch all but the first chunk, which we buffer in this thread
+    // since it would otherwise just sit and wait.
+    std::vector<Threading::Future<osg::Referenced> > futures;
+    for(unsigned c = 1; c < numChunks; ++c)
+    {
+        Threading::Promise<osg::Referenced> promise;
+        futures.push_back(promise.getFuture());
+
+        unsigned begin = (c*size)/numChunks, end = ((c+1)*size)/numChunks;
+        Threading::runInJobArena(arena, [promise, begin, end, &bufferChunk]() mutable {
+            bufferChunk(begin, end);
+            promise.resolve(0L);
+        });
+    }
 
-        params._cornerSegs = _numQuadSegs;
+    bufferChunk(0u, size/numChunks);
 
-        if ( feature->getGeometry()->buffer( _distance.value(), output, params ) )
+    // Wait for everything; the jobs reference our stack.
+    Threading::when_all(futures).get();
+
+    unsigned n = 0u;
+    for( FeatureList::iterator i = input.begin(); i != input.end(); ++n )
+    {
+        Feature* feature = i->get();
+        if ( output[n].valid() )
         {
-            feature->setGeometry( output.get() );
+            feature->setGeometry( output[n].get() );
             ++i;
         }
         else
         {
+            if ( feature )
+            {
+                OE_DEBUG << LC << "feature " << feature->getFID() << " yielded no geometry" << std::endl;
+            }
             i = input.erase( i );
-            OE_DEBUG << LC << "feature " << feature->getFID() << " yielded no geometry" << std::endl;
         }
     }
 
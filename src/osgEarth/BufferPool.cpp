@@ -0,0 +1,215 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2020 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#include <osgEarth/BufferPool>
+#include <osgEarth/Memory>
+#include <osgEarth/Threading>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+namespace
+{
+    bool envEnabled()
+    {
+        const char* value = ::getenv("OSGEARTH_BUFFER_POOL");
+        return value == 0L || ::strcmp(value, "0") != 0;
+    }
+
+    std::atomic<bool> s_enabled(envEnabled());
+
+    struct Pool
+    {
+        Pool() : _bytes(0u), _maxBytes(64u * 1048576u), _gauge(Memory::getCPUGauge("bufferpool")) { }
+
+        Threading::Mutex _mutex;
+        std::unordered_map<std::size_t, std::vector<unsigned char*> > _free;
+        std::size_t _bytes;
+        std::size_t _maxBytes;
+        Gauge _gauge;
+
+        // call with the mutex held
+        void evictTo(std::size_t limit)
+        {
+            for (auto i = _free.begin(); i != _free.end() && _bytes > limit; )
+            {
+                while (!i->second.empty() && _bytes > limit)
+                {
+                    delete [] i->second.back();
+                    i->second.pop_back();
+                    _bytes -= i->first;
+                }
+                if (i->second.empty())
+                    i = _free.erase(i);
+                else
+                    ++i;
+            }
+            _gauge.set((std::int64_t)_bytes);
+        }
+    };
+
+    // leaked on purpose so images destroyed during static
+    // destruction can still return their buffers
+    Pool& pool()
+    {
+        static Pool* s_pool = new Pool();
+        return *s_pool;
+    }
+}
+
+unsigned char*
+BufferPool::allocate(std::size_t bytes)
+{
+    if (s_enabled && bytes > 0u)
+    {
+        Pool& p = pool();
+        Threading::ScopedMutexLock lock(p._mutex);
+        auto i = p._free.find(bytes);
+        if (i != p._free.end() && !i->second.empty())
+        {
+            unsigned char* buffer = i->second.back();
+            i->second.pop_back();
+            p._bytes -= bytes;
+            p._gauge.set((std::int64_t)p._bytes);
+            return buffer;
+        }
+    }
+
+    return new unsigned char[bytes];
+}
+
+void
+BufferPool::release(unsigned char* buffer, std::size_t bytes)
+{
+    if (buffer == 0L)
+        return;
+
+    if (s_enabled)
+    {
+        Pool& p = pool();
+        Threading::ScopedMutexLock lock(p._mutex);
+        if (p._bytes + bytes <= p._maxBytes)
+        {
+            p._free[bytes].push_back(buffer);
+            p._bytes += bytes;
+            p._gauge.set((std::int64_t)p._bytes);
+            return;
+        }
+    }
+
+    delete [] buffer;
+}
+
+void
+BufferPool::setMaxBytes(std::size_t value)
+{
+    Pool& p = pool();
+    Threading::ScopedMutexLock lock(p._mutex);
+    p._maxBytes = value;
+    p.evictTo(value);
+}
+
+std::size_t
+BufferPool::getMaxBytes()
+{
+    Pool& p = pool();
+    Threading::ScopedMutexLock lock(p._mutex);
+    return p._maxBytes;
+}
+
+std::size_t
+BufferPool::getBytes()
+{
+    Pool& p = pool();
+    Threading::ScopedMutexLock lock(p._mutex);
+    return p._bytes;
+}
+
+void
+BufferPool::clear()
+{
+    Pool& p = pool();
+    Threading::ScopedMutexLock lock(p._mutex);
+    p.evictTo(0u);
+}
+
+void
+BufferPool::setEnabled(bool value)
+{
+    s_enabled = value;
+    if (!value)
+        clear();
+}
+
+bool
+BufferPool::isEnabled()
+{
+    return s_enabled;
+}
+
+//........................................................................
+
+PooledImage::PooledImage() :
+    osg::Image(),
+    _pooledData(0L),
+    _pooledBytes(0u)
+{
+    //nop
+}
+
+PooledImage::~PooledImage()
+{
+    releasePooled();
+}
+
+void
+PooledImage::releasePooled()
+{
+    if (_pooledData)
+    {
+        BufferPool::release(_pooledData, _pooledBytes);
+        _pooledData = 0L;
+        _pooledBytes = 0u;
+    }
+}
+
+void
+PooledImage::allocatePooled(int s, int t, int r, GLenum pixelFormat, GLenum dataType, int packing)
+{
+    std::size_t bytes =
+        (std::size_t)osg::Image::computeRowWidthInBytes(s, pixelFormat, dataType, packing) *
+        (std::size_t)t * (std::size_t)r;
+
+    unsigned char* buffer = BufferPool::allocate(bytes);
+
+    // NO_DELETE, since we hand the buffer back to the pool ourselves.
+    // Release the old buffer after setImage, which may still reference it.
+    setImage(s, t, r, pixelFormat, pixelFormat, dataType, buffer, NO_DELETE, packing);
+
+    releasePooled();
+    _pooledData = buffer;
+    _pooledBytes = bytes;
+}
@@ -26,6 +26,7 @@
 #include <osgEarth/LineSymbol>
 #include <osgEarth/PolygonSymbol>
 #include <osgEarth/MeshSubdivider>
+#include <osgEarth/MeshConsolidator>
 #include <osgEarth/ResourceCache>
 #include <osgEarth/Tessellator>
 #include <osgEarth/Utils>
@@ -52,6 +53,9 @@
 
 #define OE_TEST OE_NULL
 
+// Smallest number of features worth handing to a worker thread
+#define MIN_FEATURES_PER_CHUNK 64u
+
 using namespace osgEarth;
 
 namespace
@@ -108,6 +112,70 @@ BuildGeometryFilter::processPolygons(FeatureList& features, FilterContext& conte
 {
     osg::Geode* geode = new osg::Geode();
 
+    // Features are independent of each other, so we can split the list into
+    // contiguous chunks and build them concurrently. Scripts and the feature
+    // name expression evaluate through shared, non-thread-safe state, so
+    // they force a serial build.
+    Threading::JobArena* arena = Registry::instance()->getJobArena("features.build");
+
+    unsigned numChunks = 1u;
+    if ( !_featureNameExpr.isSet() &&
+         (context.getSession() == 0L || context.getSession()->getScriptEngine() == 0L) )
+    {
+        numChunks = osg::minimum(
+            arena->getConcurrency() + 1u,
+            (unsigned)features.size() / MIN_FEATURES_PER_CHUNK);
+    }
+
+    if ( numChunks <= 1u )
+    {
+        buildPolygons(features, context, geode);
+        return geode;
+    }
+
+    std::vector<FeatureList> chunks(numChunks);
+    unsigned n = 0u, size = (unsigned)features.size();
+    for(FeatureList::iterator f = features.begin(); f != features.end(); ++f, ++n)
+        chunks[(n*numChunks)/size].push_back(*f);
+
+    // Dispatch all but the first chunk, which we build in this thread
+    // since it would otherwise just sit and wait.
+    std::vector<Threading::Future<osg::Geode> > futures;
+    for(unsigned c = 1; c < numChunks; ++c)
+    {
+        Threading::Promise<osg::Geode> promise;
+        futures.push_back(promise.getFuture());
+
+        Threading::runInJobArena(arena, [this, promise, c, &chunks, &context]() mutable {
+            osg::ref_ptr<osg::Geode> chunkGeode = new osg::Geode();
+            buildPolygons(chunks[c], context, chunkGeode.get());
+            promise.resolve(chunkGeode.get());
+        });
+    }
+
+    buildPolygons(chunks[0], context, geode);
+
+    // Wait for everything; the jobs reference our stack. Then append the
+    // results in chunk order so the output doesn't depend on timing.
+    Threading::Future<Threading::FutureVector<osg::Geode> > all = Threading::when_all(futures);
+    osg::ref_ptr<Threading::FutureVector<osg::Geode> > results = all.get();
+    if ( results.valid() )
+    {
+        for(unsigned c = 0; c < results->size(); ++c)
+        {
+            osg::Geode* chunkGeode = (*results)[c].get();
+            for(unsigned i = 0; chunkGeode && i < chunkGeode->getNumDrawables(); ++i)
+                geode->addDrawable(chunkGeode->getDrawable(i));
+        }
+    }
+
+    OE_TEST << LC << "Num drawables = " << geode->getNumDrawables() << "\n";
+    return geode;
+}
+
+void
+BuildGeometryFilter::buildPolygons(FeatureList& features, FilterContext& context, osg::Geode* geode)
+{
     bool makeECEF = false;
     const SpatialReference* featureSRS = 0L;
     //const SpatialReference* mapSRS = 0L;
@@ -192,7 +260,11 @@ BuildGeometryFilter::processPolygons(FeatureList& features, FilterContext& conte
                 hats->push_back( i->z() );
 
             // build the geometry:
-            tileAndBuildPolygon(part, featureSRS, outputSRS, makeECEF, true, osgGeom.get(), w2l);
+            bool osgTessellator = poly->tessellation().isSet() ?
+                poly->tessellation() == PolygonSymbol::TESSELLATION_OSG :
+                _useOSGTessellator.get();
+
+            tileAndBuildPolygon(part, featureSRS, outputSRS, makeECEF, true, osgTessellator, osgGeom.get(), w2l);
 
             osg::Vec3Array* allPoints = static_cast<osg::Vec3Array*>(osgGeom->getVertexArray());
             if (allPoints && allPoints->size() > 0)
@@ -248,9 +320,6 @@ BuildGeometryFilter::processPolygons(FeatureList& features, FilterContext& conte
             }
         }
     }
-
-    OE_TEST << LC << "Num drawables = " << geode->getNumDrawables() << "\n";
-    return geode;
 }
 
 namespace
@@ -749,6 +818,25 @@ namespace
         }
     }
 
+    /**
+     * Appends a ring to a geometry as a line loop for the tessellator.
+     */
+    void appendRing(osg::Geometry* osgGeom, osg::Vec3Array* points)
+    {
+        GLenum mode = GL_LINE_LOOP;
+        if ( osgGeom->getVertexArray() == 0L )
+        {
+            osgGeom->addPrimitiveSet( new osg::DrawArrays( mode, 0, points->size() ) );
+            osgGeom->setVertexArray( points );
+        }
+        else
+        {
+            osg::Vec3Array* v = static_cast<osg::Vec3Array*>(osgGeom->getVertexArray());
+            osgGeom->addPrimitiveSet( new osg::DrawArrays( mode, v->size(), points->size() ) );
+            std::copy(points->begin(), points->end(), std::back_inserter(*v));
+        }
+    }
+
     /**
      * Tesselates an osg::Geometry using the osgEarth tesselator.
      * If it fails, fall back to the osgUtil tesselator.
@@ -938,6 +1026,7 @@ BuildGeometryFilter::tileAndBuildPolygon(Geometry*               ring,
                                          const SpatialReference* outputSRS,
                                          bool                    makeECEF,
                                          bool                    tessellate,
+                                         bool                    osgTessellator,
                                          osg::Geometry*          osgGeom,
                                          const osg::Matrixd      &world2local)
 {
@@ -982,14 +1071,16 @@ BuildGeometryFilter::tileAndBuildPolygon(Geometry*               ring,
             osg::Matrix world2cell;
             cellCenter.createWorldToLocal( world2cell );
 
-            // build the localized polygon:
-            buildPolygon(geom, featureSRS, outputSRS, makeECEF, temp.get(), world2cell);
+            // build the localized polygon. Holes stay separate rings unless
+            // the tessellator can't cut them out itself.
+            bool bridgeHoles = !osgTessellator && !Tessellator::supportsHoles();
+            buildPolygon(geom, featureSRS, outputSRS, makeECEF, bridgeHoles, temp.get(), world2cell);
 
             // if successful, transform the verts back into our master LTP:
             if ( temp->getNumPrimitiveSets() > 0 )
             {
                 // Tesselate the polygon while the coordinates are still in the LTP
-                if (tesselateGeometry( temp.get(), useOSGTessellator().value() ))
+                if (tesselateGeometry( temp.get(), osgTessellator ))
                 {
                     osg::Vec3Array* verts = static_cast<osg::Vec3Array*>(temp->getVertexArray());
                     if ( verts->getNumElements() > 0 )
@@ -1059,6 +1150,7 @@ BuildGeometryFilter::buildPolygon(Geometry*               ring,
                                   const SpatialReference* featureSRS,
                                   const SpatialReference* outputSRS,
                                   bool                    makeECEF,
+                                  bool                    bridgeHoles,
                                   osg::Geometry*          osgGeom,
                                   const osg::Matrixd      &world2local)
 {
@@ -1071,6 +1163,29 @@ BuildGeometryFilter::buildPolygon(Geometry*               ring,
     transformAndLocalize( ring->asVector(), featureSRS, allPoints.get(), outputSRS, world2local, makeECEF );
 
     Polygon* poly = dynamic_cast<Polygon*>(ring);
+
+    // Outer boundary and holes as separate rings, for a tessellator that
+    // handles holes itself.
+    if ( poly && !bridgeHoles )
+    {
+        appendRing( osgGeom, allPoints.get() );
+
+        for( RingCollection::const_iterator h = poly->getHoles().begin(); h != poly->getHoles().end(); ++h )
+        {
+            Geometry* hole = h->get();
+            if ( hole->isValid() )
+            {
+                hole->rewind(osgEarth::Geometry::ORIENTATION_CW);
+
+                osg::ref_ptr<osg::Vec3Array> holePoints = new osg::Vec3Array();
+                transformAndLocalize( hole->asVector(), featureSRS, holePoints.get(), outputSRS, world2local, makeECEF );
+                appendRing( osgGeom, holePoints.get() );
+            }
+        }
+        return;
+    }
+
+    // Otherwise, bridge each hole into the outer boundary to make a single ring.
     if ( poly )
     {
         RingCollection ordered(poly->getHoles().begin(), poly->getHoles().end());
@@ -1207,19 +1322,7 @@ BuildGeometryFilter::buildPolygon(Geometry*               ring,
         }
     }
 
-    GLenum mode = GL_LINE_LOOP;
-    if ( osgGeom->getVertexArray() == 0L )
-    {
-        osgGeom->addPrimitiveSet( new osg::DrawArrays( mode, 0, allPoints->size() ) );
-        osgGeom->setVertexArray( allPoints.get() );
-    }
-    else
-    {
-        osg::Vec3Array* v = static_cast<osg::Vec3Array*>(osgGeom->getVertexArray());
-        osgGeom->addPrimitiveSet( new osg::DrawArrays( mode, v->size(), allPoints->size() ) );
-        //v->reserve(v->size() + allPoints->size());
-        std::copy(allPoints->begin(), allPoints->end(), std::back_inserter(*v));
-    }
+    appendRing( osgGeom, allPoints.get() );
 }
 
 
@@ -1425,9 +1528,8 @@ BuildGeometryFilter::push( FeatureList& input, FilterContext& context )
         osg::ref_ptr<osg::Geode> geode = processPolygons(polygons, context);
         if ( geode->getNumDrawables() > 0 )
         {
-            osgUtil::Optimizer::MergeGeometryVisitor mg;
-            mg.setTargetMaximumNumberOfVertices(Registry::instance()->getMaxNumberOfVertsPerDrawable());
-            geode->accept(mg);
+            // Concatenate the per-part meshes straight into pre-sized arrays.
+            MeshConsolidator::mergeTriangleMeshes(*geode, Registry::instance()->getMaxNumberOfVertsPerDrawable());
 
             if (_optimizeVertexOrdering == true)
             {
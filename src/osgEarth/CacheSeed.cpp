@@ -22,6 +22,10 @@
 
 #include <osgEarth/CacheSeed>
 #include <osgEarth/ImageLayer>
+#include <osgEarth/ElevationLayer>
+#include <osgEarth/Cache>
+#include <osgEarth/StringUtils>
+#include <osgEarth/HTTPClient>
 
 #define LC "[CacheSeed] "
 
@@ -41,6 +45,9 @@ bool CacheTileHandler::handleTile(const TileKey& key, const TileVisitor& tv)
     ImageLayer* imageLayer = dynamic_cast< ImageLayer* >( _layer.get() );
     ElevationLayer* elevationLayer = dynamic_cast< ElevationLayer* >( _layer.get() );    
 
+    // Seeding yields to interactive requests against the same servers
+    HTTPClient::ScopedPriority priority(HTTPClient::PRIORITY_BACKGROUND);
+
     // Just call createImage or createHeightField on the layer and the it will be cached!
     if (imageLayer)
     {                
@@ -97,6 +104,95 @@ std::string CacheTileHandler::getProcessString() const
 }
 
 
+std::string CacheTileHandler::getCheckpointKey(const TileKey& key, const TileVisitor& tv) const
+{
+    // A checkpoint only holds for the same max level and extents;
+    // a deeper or wider seed has to visit the subtree again.
+    std::string extents;
+    for (unsigned int i = 0; i < tv.getExtents().size(); ++i)
+        extents += tv.getExtents()[i].toString();
+
+    return Stringify()
+        << "_seed/" << tv.getMaxLevel()
+        << "/" << std::hex << hashString(extents)
+        << "/" << key.str();
+}
+
+bool CacheTileHandler::isSubtreeComplete(const TileKey& key, const TileVisitor& tv) const
+{
+    CacheSettings* settings = _layer->getCacheSettings();
+    CacheBin* bin = settings ? settings->getCacheBin() : 0L;
+    if (!bin || !settings->cachePolicy()->isCacheReadable())
+        return false;
+
+    return bin->getRecordStatus(getCheckpointKey(key, tv)) != CacheBin::STATUS_NOT_FOUND;
+}
+
+void CacheTileHandler::setSubtreeComplete(const TileKey& key, const TileVisitor& tv)
+{
+    CacheSettings* settings = _layer->getCacheSettings();
+    CacheBin* bin = settings ? settings->getCacheBin() : 0L;
+    if (!bin || !settings->cachePolicy()->isCacheWriteable())
+        return;
+
+    osg::ref_ptr<StringObject> done = new StringObject(key.str());
+    bin->write(getCheckpointKey(key, tv), done.get(), Config(), 0L);
+}
+
+/***************************************************************************************/
+
+CacheMergeTileHandler::CacheMergeTileHandler( TileLayer* layer, const Map* map, Cache* source ):
+_layer( layer ),
+_map( map ),
+_source( source ),
+_numMerged( 0u )
+{
+    // The source cache was made from the same earth file, so the layer's
+    // bin has the same ID there.
+    CacheSettings* settings = _layer->getCacheSettings();
+    CacheBin* bin = settings ? settings->getCacheBin() : 0L;
+    if (bin && _source.valid())
+    {
+        _sourceBin = _source->addBin(bin->getID());
+    }
+}
+
+bool CacheMergeTileHandler::handleTile(const TileKey& key, const TileVisitor& tv)
+{
+    CacheSettings* settings = _layer->getCacheSettings();
+    CacheBin* bin = settings ? settings->getCacheBin() : 0L;
+    if (!bin || !_sourceBin.valid())
+        return false;
+
+    // Same record keys the layers use in createImageInKeyProfile and
+    // createHeightFieldInKeyProfile.
+    bool isImage = dynamic_cast<ImageLayer*>(_layer.get()) != 0L;
+    std::string cacheKey = Cache::makeCacheKey(
+        Stringify() << key.str() << "-" << std::hex << key.getProfile()->getHorizSignature(),
+        isImage ? "image" : "elevation");
+
+    ReadResult r = isImage ?
+        _sourceBin->readImage(cacheKey, 0L) :
+        _sourceBin->readObject(cacheKey, 0L);
+
+    if (r.succeeded())
+    {
+        if (bin->write(cacheKey, r.getObject(), r.metadata(), 0L))
+        {
+            ++_numMerged;
+        }
+        return true;
+    }
+
+    // Keep going below keys that aren't in range, as the seed did.
+    return !_layer->isKeyInLegalRange(key);
+}
+
+bool CacheMergeTileHandler::hasData( const TileKey& key ) const
+{
+    return _layer->mayHaveData(key);
+}
+
 
 /***************************************************************************************/
 
@@ -119,4 +215,12 @@ void CacheSeed::run( TileLayer* layer, const Map* map )
 {
     _visitor->setTileHandler( new CacheTileHandler( layer, map ) );
     _visitor->run( map->getProfile() );
-}
\ No newline at end of file
+}
+
+unsigned int CacheSeed::merge( TileLayer* layer, const Map* map, Cache* source )
+{
+    osg::ref_ptr<CacheMergeTileHandler> handler = new CacheMergeTileHandler( layer, map, source );
+    _visitor->setTileHandler( handler.get() );
+    _visitor->run( map->getProfile() );
+    return handler->getNumMerged();
+}
@@ -45,8 +45,11 @@ namespace
 {
     struct MyGraphicsContext
     {
-        MyGraphicsContext()
+        MyGraphicsContext(bool create)
         {
+            if (!create)
+                return;
+
             // If the number of graphics context is > 0 or < 32 (the default, unitialized value of osg::DisplaySettings::instance()->getMaxNumberOfGraphicsContexts()) then warn users
             // to call osgEarth::initialize before realizing any graphics windows to avoid issues with the maxNumberOfGraphicsContexts being different than the
             // actual number of registered GraphicsContexts in osg.  This can cause issues with unrefAfterApply due to faulty logic in osg::Texture::areAllTextureObjectsLoaded
@@ -126,7 +129,7 @@ namespace
 
 #define SAYBOOL(X) (X?"yes":"no")
 
-Capabilities::Capabilities() :
+Capabilities::Capabilities(bool queryGL) :
 _maxFFPTextureUnits     ( 1 ),
 _maxGPUTextureUnits     ( 1 ),
 _maxGPUTextureCoordSets ( 1 ),
@@ -161,7 +164,8 @@ _supportsRGTC           ( false ),
 _supportsTextureBuffer  ( false ),
 _maxTextureBufferSize   ( 0 ),
 _isCoreProfile          ( true ),
-_supportsVertexArrayObjects ( false )
+_supportsVertexArrayObjects ( false ),
+_supportsBindlessTexture ( false )
 {
     // little hack to force the osgViewer library to link so we can create a graphics context
     osgViewerGetVersion();
@@ -185,7 +189,7 @@ _supportsVertexArrayObjects ( false )
     osg::GraphicsContext* gc = NULL;
     unsigned int id = 0;
 #ifndef __ANDROID__
-    MyGraphicsContext mgc;
+    MyGraphicsContext mgc(queryGL);
     if ( mgc.valid() )
     {
         gc = mgc._gc.get();
@@ -195,6 +199,8 @@ _supportsVertexArrayObjects ( false )
 
 #ifndef __ANDROID__
     if ( gc != NULL )
+#else
+    if ( queryGL )
 #endif
     {
         OE_INFO << LC << "Capabilities: " << std::endl;
@@ -403,6 +409,11 @@ _supportsVertexArrayObjects ( false )
         OE_DEBUG << LC << buf.str() << std::endl;
 
         _supportsVertexArrayObjects = osg::isGLExtensionOrVersionSupported(id, "GL_ARB_vertex_array_object", 3.0);
+
+        _supportsBindlessTexture =
+            osg::isGLExtensionSupported(id, "GL_ARB_bindless_texture") &&
+            osg::isGLExtensionOrVersionSupported(id, "GL_ARB_copy_image", 4.3f);
+        OE_DEBUG << LC << "  Bindless textures = " << SAYBOOL(_supportsBindlessTexture) << std::endl;
     }
 }
 
@@ -183,7 +183,9 @@ _resources(resources),
 _constrainMaxYToFrustum(false),
 _constrainRttBoxToDrapingSetBounds(true),
 _useProjectionFitting(true),
-_minNearFarRatio(0.25)
+_minNearFarRatio(0.25),
+_reuseThreshold(0.0f),
+_revision(0u)
 {
     if (::getenv("OSGEARTH_DRAPING_DEBUG"))
         _debug = true;
@@ -221,6 +223,10 @@ _minNearFarRatio(0.25)
     c = ::getenv("OSGEARTH_DRAPING_USE_PROJECTION_FITTING");
     if (c)
         _useProjectionFitting = atoi(c)?true:false;
+
+    c = ::getenv("OSGEARTH_DRAPING_REUSE_THRESHOLD");
+    if (c)
+        setCascadeReuseThreshold((float)atof(c));
 }
 
 void
@@ -259,6 +265,18 @@ CascadeDrapingDecorator::setMinimumNearFarRatio(double value)
     _minNearFarRatio = value;
 }
 
+void
+CascadeDrapingDecorator::setCascadeReuseThreshold(float value)
+{
+    _reuseThreshold = osg::maximum(value, 0.0f);
+}
+
+void
+CascadeDrapingDecorator::dirty()
+{
+    ++_revision;
+}
+
 void
 CascadeDrapingDecorator::traverse(osg::NodeVisitor& nv)
 {
@@ -750,6 +768,29 @@ void CascadeDrapingDecorator::Cascade::makeProj(double rttFar)
     _rttProj.makeOrtho(_box.xMin(), _box.xMax(), _box.yMin(), _box.yMax(), -rttFar*4, rttFar);
 }
 
+double CascadeDrapingDecorator::Cascade::computeDrift(const osg::Matrix& rttViewProj, unsigned texSize) const
+{
+    // Where the corners of the new projection land in the texture as it was
+    // last rendered; the farthest one is how far the cascade has drifted.
+    osg::Matrix iRttViewProj;
+    iRttViewProj.invert(rttViewProj);
+    osg::Matrix newToRendered = iRttViewProj * _renderedView * _renderedProj;
+
+    double drift = 0.0;
+    for (int x = -1; x <= 1; x += 2)
+    {
+        for (int y = -1; y <= 1; y += 2)
+        {
+            osg::Vec3d corner(x, y, 0.0);
+            osg::Vec3d rendered = corner * newToRendered;
+            drift = osg::maximum(drift, osg::Vec2d(rendered.x() - corner.x(), rendered.y() - corner.y()).length());
+        }
+    }
+
+    // clip space spans 2 units across the texture
+    return drift * 0.5 * (double)texSize;
+}
+
 // Computes the "coverage" of the RTT region in normalized [0..1] clip space.
 // If the width and height are 1.0, that means the RTT region will fit exactly 
 // within the camera's viewport. For example, a heightNDC of 3.0 means that the
@@ -1121,20 +1162,72 @@ CascadeDrapingDecorator::CameraLocal::traverse(osgUtil::CullVisitor* cv, Cascade
     ArrayUniform texMat("oe_Draping_texMatrix", osg::Uniform::FLOAT_MAT4, _terrainSS.get(), decorator._maxCascades);
     unsigned i;
 
+    // Decide which cascades to render. A cascade can keep last frame's texture
+    // when the draped content is the same and its projection has drifted less
+    // than the threshold. Cascades drifting past it render one per frame, in
+    // turn, unless they drift so far that they can't wait.
+    bool render[8];
+    bool reuse =
+        decorator._reuseThreshold > 0.0f &&
+        _numCascades == _renderedNumCascades &&
+        decorator._revision == _renderedRevision &&
+        bounds == _renderedBound;
+
+    bool stale[8];
+    for (i = 0; i < _numCascades; ++i)
+    {
+        Cascade& cascade = _cascades[i];
+        render[i] = !reuse || !cascade._rendered;
+        stale[i] = false;
+
+        if (!render[i])
+        {
+            double drift = cascade.computeDrift(rttView * cascade._rttProj, decorator._texSize);
+            render[i] = drift > 4.0 * decorator._reuseThreshold;
+            stale[i] = drift > decorator._reuseThreshold;
+        }
+    }
+
+    for (unsigned turn = 0; turn < _numCascades; ++turn)
+    {
+        unsigned next = (_nextStale + turn) % _numCascades;
+        if (stale[next] && !render[next])
+        {
+            render[next] = true;
+            _nextStale = next + 1;
+            break;
+        }
+    }
+
+    bool renderAny = false;
+
     for (i = 0; i < _numCascades; ++i)
     {
         Cascade& cascade = _cascades[i];
         osg::Camera* rtt = cascade._rtt.get();
 
-        // configure the RTT camera's matrices:
-        rtt->setViewMatrix(rttView);
-        rtt->setProjectionMatrix(cascade._rttProj);
+        if (render[i])
+        {
+            // configure the RTT camera's matrices:
+            rtt->setViewMatrix(rttView);
+            rtt->setProjectionMatrix(cascade._rttProj);
+
+            cascade._renderedView = rttView;
+            cascade._renderedProj = cascade._rttProj;
+            cascade._rendered = true;
+            renderAny = true;
+        }
 
         // Create the texture matrix that will transform the RTT frame into texture [0..1] space.
         // Doing this on the CPU avoids precision errors on the GPU.
-        texMat.setElement(i, iCamMV * rttView * cascade._rttProj * clipToTex);
+        // Use the matrices the cascade's texture was actually rendered with.
+        texMat.setElement(i, iCamMV * cascade._renderedView * cascade._renderedProj * clipToTex);
     }
 
+    _renderedNumCascades = _numCascades;
+    _renderedRevision = decorator._revision;
+    _renderedBound = bounds;
+
     if (i < _maxCascades)
     {
         // install a "marker" matrix that tells the shader we're past the final cascade.
@@ -1143,16 +1236,24 @@ CascadeDrapingDecorator::CameraLocal::traverse(osgUtil::CullVisitor* cv, Cascade
     }
 
     // traverse and write to the texture.
-    if (_numCascades > 0u)
+    if (renderAny)
     {
         cv->pushStateSet(_rttSS.get());
         for (unsigned i = 0; i < _numCascades; ++i)
         {
-            Cascade& c = _cascades[i];
-            c._rtt->accept(*cv);
+            if (render[i])
+            {
+                Cascade& c = _cascades[i];
+                c._rtt->accept(*cv);
+            }
         }
         cv->popStateSet(); // _rttSS
     }
+    else
+    {
+        // nothing culled the draping set, so reset it for the next frame
+        decorator._manager.get(camera).endFrame();
+    }
 }
 
 void
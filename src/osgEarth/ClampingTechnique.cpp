@@ -24,6 +24,8 @@
 #include <osgEarth/CullingUtils>
 #include <osgEarth/Registry>
 #include <osgEarth/Shaders>
+#include <osgEarth/TerrainEngineNode>
+#include <osgEarth/GPUTimer>
 
 #include <osg/Depth>
 #include <osg/PolygonMode>
@@ -81,9 +83,14 @@ namespace
 
         unsigned _renderLeafCount;
 
+        // matrices and terrain revision of the last depth capture
+        bool        _captured;
+        osg::Matrix _capturedView, _capturedProj;
+        unsigned    _capturedRevision;
+
         META_Object(osgEarth,LocalPerViewData);
-        LocalPerViewData() { }
-        LocalPerViewData(const LocalPerViewData& rhs, const osg::CopyOp& co) { }
+        LocalPerViewData() : _captured(false), _capturedRevision(0u) { }
+        LocalPerViewData(const LocalPerViewData& rhs, const osg::CopyOp& co) : _captured(false), _capturedRevision(0u) { }
         
         void resizeGLObjectBuffers(unsigned maxSize) {
             if (_rttTexture.valid())
@@ -118,13 +125,36 @@ namespace
         }
     };
 #endif
+
+    // How far, in texels, the corners of a new depth projection land from
+    // where they were in the captured depth texture.
+    double computeDrift(const osg::Matrix& viewProj, const osg::Matrix& capturedViewProj, int texSize)
+    {
+        osg::Matrix newToCaptured = osg::Matrix::inverse(viewProj) * capturedViewProj;
+
+        double drift = 0.0;
+        for (int x = -1; x <= 1; x += 2)
+        {
+            for (int y = -1; y <= 1; y += 2)
+            {
+                osg::Vec3d corner(x, y, 0.0);
+                osg::Vec3d captured = corner * newToCaptured;
+                drift = osg::maximum(drift, osg::Vec2d(captured.x() - corner.x(), captured.y() - corner.y()).length());
+            }
+        }
+
+        // clip space spans 2 units across the texture
+        return drift * 0.5 * (double)texSize;
+    }
 }
 
 //---------------------------------------------------------------------------
 
 ClampingTechnique::ClampingTechnique() :
 _textureSize( 1024 ),
-_engine(0L)
+_engine(0L),
+_reuseThreshold(0.0f),
+_terrainRevision(0u)
 {
     // disable if GLSL is not supported
     _supported = Registry::capabilities().supportsGLSL();
@@ -196,6 +226,8 @@ ClampingTechnique::setUpCamera(OverlayDecorator::TechRTTParams& params)
     params._rttCamera->setFinalDrawCallback( new RttOut() );
 #endif
 
+    GPUTimer::install( params._rttCamera.get(), "clamping" );
+
     // set up a StateSet for the RTT camera.
     osg::StateSet* rttStateSet = params._rttCamera->getOrCreateStateSet();
 
@@ -328,23 +360,42 @@ ClampingTechnique::cullOverlayGroup(OverlayDecorator::TechRTTParams& params,
 {
     if ( params._rttCamera.valid() && hasData(params) )
     {
-        // update the RTT camera.
-        params._rttCamera->setViewMatrix      ( params._rttViewMatrix );
-        params._rttCamera->setProjectionMatrix( params._rttProjMatrix );
-        
-        // set the primary-camera-to-rtt-camera transformation matrix,
-        // which lets you perform vertex shader operations from the perspective
-        // of the primary camera (morphing, etc.) so that things match up
-        // between the two cameras.
-        osg::Matrix viewMatrixInverse = osg::Matrix::inverse(params._rttViewMatrix);
-        params._rttToPrimaryMatrixUniform->set(viewMatrixInverse * (*cv->getModelViewMatrix()));
-
-        // create the depth texture (render the terrain to tex)
-        params._rttCamera->accept( *cv );
-        
-
         LocalPerViewData& local = *static_cast<LocalPerViewData*>(params._techniqueData.get());
 
+        // Capture the terrain depth again unless the last capture is still
+        // good: same terrain, and a projection that barely moved.
+        unsigned terrainRevision = _terrainRevision;
+        bool capture =
+            _reuseThreshold <= 0.0f ||
+            !local._captured ||
+            local._capturedRevision != terrainRevision ||
+            computeDrift(
+                params._rttViewMatrix * params._rttProjMatrix,
+                local._capturedView * local._capturedProj,
+                *_textureSize) > _reuseThreshold;
+
+        if (capture)
+        {
+            // update the RTT camera.
+            params._rttCamera->setViewMatrix      ( params._rttViewMatrix );
+            params._rttCamera->setProjectionMatrix( params._rttProjMatrix );
+
+            // set the primary-camera-to-rtt-camera transformation matrix,
+            // which lets you perform vertex shader operations from the perspective
+            // of the primary camera (morphing, etc.) so that things match up
+            // between the two cameras.
+            osg::Matrix viewMatrixInverse = osg::Matrix::inverse(params._rttViewMatrix);
+            params._rttToPrimaryMatrixUniform->set(viewMatrixInverse * (*cv->getModelViewMatrix()));
+
+            // create the depth texture (render the terrain to tex)
+            params._rttCamera->accept( *cv );
+
+            local._captured = true;
+            local._capturedView = params._rttViewMatrix;
+            local._capturedProj = params._rttProjMatrix;
+            local._capturedRevision = terrainRevision;
+        }
+
         // construct a matrix that transforms from camera view coords to depth texture
         // clip coords directly. This will avoid precision loss in the 32-bit shader.
         static osg::Matrix s_scaleBiasMat = 
@@ -357,12 +408,13 @@ ClampingTechnique::cullOverlayGroup(OverlayDecorator::TechRTTParams& params,
 
         osg::Matrix vm;
         vm.invert( *cv->getModelViewMatrix() );
+        // (the matrices the depth texture was captured with)
         osg::Matrix cameraViewToDepthView =
             vm *
-            params._rttViewMatrix;
+            local._capturedView;
 
         osg::Matrix depthViewToDepthClip = 
-            params._rttProjMatrix *
+            local._capturedProj *
             s_scaleBiasMat;
 
         osg::Matrix cameraViewToDepthClip =
@@ -419,12 +471,34 @@ ClampingTechnique::setTextureSize( int texSize )
 }
 
 
+void
+ClampingTechnique::setReuseThreshold(float texels)
+{
+    _reuseThreshold = osg::maximum(texels, 0.0f);
+}
+
+
+void
+ClampingTechnique::onTileUpdate(const TileKey& key, osg::Node* graph, TerrainCallbackContext& context)
+{
+    // the terrain changed height somewhere, so no captured depth is current.
+    ++_terrainRevision;
+}
+
+
 void
 ClampingTechnique::onInstall( TerrainEngineNode* engine )
 {
     // save a pointer to the terrain engine.
     _engine = engine;
 
+    // watch for terrain changes that invalidate a reused depth capture.
+    if ( engine && engine->getTerrain() )
+    {
+        _terrainCallback = new TerrainCallbackAdapter<ClampingTechnique>(this);
+        engine->getTerrain()->addTerrainCallback( _terrainCallback.get() );
+    }
+
     if ( !_textureSize.isSet() )
     {
         unsigned maxSize = Registry::capabilities().getMaxFastTextureSize();
@@ -436,5 +510,11 @@ ClampingTechnique::onInstall( TerrainEngineNode* engine )
 void
 ClampingTechnique::onUninstall( TerrainEngineNode* engine )
 {
+    if ( engine && engine->getTerrain() && _terrainCallback.valid() )
+    {
+        engine->getTerrain()->removeTerrainCallback( _terrainCallback.get() );
+    }
+    _terrainCallback = 0L;
+
     _engine = 0L;
 }
@@ -1,13 +1,541 @@
 #include <osgEarth/ClusterNode>
+#include <osgEarth/CullingUtils>
+#include <osgEarth/Horizon>
+#include <osgEarth/MapNode>
+#include <osgEarth/Registry>
+#include <osgEarth/Threading>
 
 #include <osgEarth/kdbush.hpp>
 
+#include <osg/Polytope>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <memory>
+#include <unordered_map>
+
 typedef std::pair<int, int> TPoint;
 typedef std::vector< std::size_t > TIds;
 
 using namespace osgEarth;
 using namespace osgEarth::Contrib;
 
+// Finest level of the grid. Cells at level L are 2^-L of the normalized
+// map across, so at 20 a cell is about 40m.
+#define MAX_LEVEL 20
+
+namespace
+{
+    inline unsigned long long cellKey(unsigned cx, unsigned cy)
+    {
+        return ((unsigned long long)cx << 32) | (unsigned long long)cy;
+    }
+
+    inline unsigned cellCoord(double v, int level)
+    {
+        double n = (double)(1u << level);
+        return (unsigned)osg::clampBetween(v * n, 0.0, n - 1.0);
+    }
+}
+
+// Clusters for one view, ready to swap in
+struct ClusterNode::Result : public osg::Referenced
+{
+    struct Entry
+    {
+        osg::NodeList nodes;
+        osg::Vec3d world;
+    };
+    std::vector<Entry> clusters;
+};
+
+// Hierarchical grid over the nodes' positions, in normalized map coordinates
+// (web mercator for a geographic map, the profile extent for a projected one).
+// Every level keeps the count of nodes in each occupied cell; only the finest
+// level lists the nodes themselves.
+struct ClusterNode::Index : public osg::Referenced
+{
+    struct Point
+    {
+        osg::ref_ptr<osg::Node> node;
+        osg::Vec3d world;
+        double x, y;
+        bool indexed;
+    };
+
+    struct Cell
+    {
+        Cell() : count(0u) { }
+        unsigned count;
+        std::vector<unsigned> points; // finest level only
+    };
+
+    typedef std::unordered_map<unsigned long long, Cell> Level;
+
+    // what a background job needs to know about the view
+    struct View
+    {
+        osg::Matrixd mvpw;
+        mutable osg::Polytope frustum;
+        osg::ref_ptr<Horizon> horizon;
+        double width, height;
+        int level;
+        bool leaves; // zoomed in past the finest level
+        unsigned radius;
+        osg::ref_ptr<CanClusterCallback> canCluster;
+        unsigned revision;
+    };
+
+    Threading::ReadWriteMutex mutex;
+    osg::ref_ptr<const SpatialReference> srs;
+    GeoExtent extent; // projected maps only
+    std::vector<Point> points;
+    std::vector<unsigned> freeSlots;
+    std::unordered_map<osg::Node*, unsigned> lookup;
+    std::vector<Level> levels;
+    double maxHeight;
+    std::atomic_uint revision;
+
+    Threading::Mutex jobMutex;
+    std::unique_ptr<View> pendingView;
+    bool running;
+    osg::ref_ptr<Result> latest;
+
+    Index() : levels(MAX_LEVEL + 1), maxHeight(0.0), revision(0u), running(false) { }
+
+    bool normalize(const osg::Vec3d& world, double& x, double& y, double& height) const;
+    osg::Vec3d denormalize(double x, double y) const;
+    double normalizedPerMeter(double latitude) const;
+
+    void insert(unsigned i);
+    void erase(unsigned i);
+    void add(osg::Node* node);
+    void remove(osg::Node* node);
+    void update(osg::Node* node);
+    void clear();
+    void setSRS(const SpatialReference* value, const GeoExtent& value2);
+
+    void request(View* view);
+    void run();
+    Result* cluster(const View& view);
+    void visit(const View& view, int level, unsigned cx, unsigned cy, std::vector<std::vector<unsigned> >& groups);
+    void gather(int level, unsigned cx, unsigned cy, std::vector<unsigned>& out) const;
+    bool isVisible(const View& view, const osg::Vec3d& world, osg::Vec3d& screen) const;
+};
+
+bool
+ClusterNode::Index::normalize(const osg::Vec3d& world, double& x, double& y, double& height) const
+{
+    GeoPoint p;
+    if (!srs.valid() || !p.fromWorld(srs.get(), world))
+        return false;
+
+    height = p.z();
+
+    if (srs->isGeographic())
+    {
+        double lat = osg::DegreesToRadians(osg::clampBetween(p.y(), -85.0511, 85.0511));
+        x = (p.x() + 180.0) / 360.0;
+        y = 0.5 - log(tan(osg::PI_4 + 0.5*lat)) / (2.0*osg::PI);
+    }
+    else
+    {
+        x = (p.x() - extent.xMin()) / extent.width();
+        y = (extent.yMax() - p.y()) / extent.height();
+    }
+    x = osg::clampBetween(x, 0.0, 1.0);
+    y = osg::clampBetween(y, 0.0, 1.0);
+    return true;
+}
+
+osg::Vec3d
+ClusterNode::Index::denormalize(double x, double y) const
+{
+    GeoPoint p;
+    if (srs->isGeographic())
+    {
+        double lat = atan(sinh(osg::PI * (1.0 - 2.0*y)));
+        p = GeoPoint(srs.get(), x*360.0 - 180.0, osg::RadiansToDegrees(lat), 0.0, ALTMODE_ABSOLUTE);
+    }
+    else
+    {
+        p = GeoPoint(srs.get(), extent.xMin() + x*extent.width(), extent.yMax() - y*extent.height(), 0.0, ALTMODE_ABSOLUTE);
+    }
+    osg::Vec3d world;
+    p.toWorld(world);
+    return world;
+}
+
+double
+ClusterNode::Index::normalizedPerMeter(double latitude) const
+{
+    if (srs->isGeographic())
+    {
+        double circumference = 2.0 * osg::PI * srs->getEllipsoid()->getRadiusEquator();
+        return 1.0 / (circumference * osg::maximum(cos(osg::DegreesToRadians(latitude)), 0.01));
+    }
+    return 1.0 / extent.width();
+}
+
+void
+ClusterNode::Index::insert(unsigned i)
+{
+    Point& point = points[i];
+    double height;
+    point.indexed = normalize(point.world, point.x, point.y, height);
+    if (!point.indexed)
+        return;
+
+    maxHeight = osg::maximum(maxHeight, fabs(height));
+
+    for (int level = 0; level <= MAX_LEVEL; ++level)
+    {
+        Cell& cell = levels[level][cellKey(cellCoord(point.x, level), cellCoord(point.y, level))];
+        ++cell.count;
+        if (level == MAX_LEVEL)
+            cell.points.push_back(i);
+    }
+}
+
+void
+ClusterNode::Index::erase(unsigned i)
+{
+    Point& point = points[i];
+    if (!point.indexed)
+        return;
+
+    for (int level = 0; level <= MAX_LEVEL; ++level)
+    {
+        Level::iterator c = levels[level].find(cellKey(cellCoord(point.x, level), cellCoord(point.y, level)));
+        if (c == levels[level].end())
+            continue;
+
+        Cell& cell = c->second;
+        if (level == MAX_LEVEL)
+        {
+            std::vector<unsigned>::iterator p = std::find(cell.points.begin(), cell.points.end(), i);
+            if (p != cell.points.end())
+            {
+                *p = cell.points.back();
+                cell.points.pop_back();
+            }
+        }
+        if (--cell.count == 0u)
+            levels[level].erase(c);
+    }
+    point.indexed = false;
+}
+
+void
+ClusterNode::Index::add(osg::Node* node)
+{
+    Threading::ScopedWriteLock lock(mutex);
+    if (lookup.find(node) != lookup.end())
+        return;
+
+    unsigned i;
+    if (!freeSlots.empty())
+    {
+        i = freeSlots.back();
+        freeSlots.pop_back();
+    }
+    else
+    {
+        i = points.size();
+        points.push_back(Point());
+    }
+
+    lookup[node] = i;
+    points[i].node = node;
+    points[i].world = node->getBound().center();
+    insert(i);
+    ++revision;
+}
+
+void
+ClusterNode::Index::remove(osg::Node* node)
+{
+    Threading::ScopedWriteLock lock(mutex);
+    std::unordered_map<osg::Node*, unsigned>::iterator n = lookup.find(node);
+    if (n == lookup.end())
+        return;
+
+    erase(n->second);
+    points[n->second].node = 0L;
+    freeSlots.push_back(n->second);
+    lookup.erase(n);
+    ++revision;
+}
+
+void
+ClusterNode::Index::update(osg::Node* node)
+{
+    Threading::ScopedWriteLock lock(mutex);
+    std::unordered_map<osg::Node*, unsigned>::iterator n = lookup.find(node);
+    if (n == lookup.end())
+        return;
+
+    osg::Vec3d world = node->getBound().center();
+    if (world == points[n->second].world)
+        return;
+
+    erase(n->second);
+    points[n->second].world = world;
+    insert(n->second);
+    ++revision;
+}
+
+void
+ClusterNode::Index::clear()
+{
+    Threading::ScopedWriteLock lock(mutex);
+    points.clear();
+    freeSlots.clear();
+    lookup.clear();
+    for (unsigned i = 0; i < levels.size(); ++i)
+        levels[i].clear();
+    maxHeight = 0.0;
+    ++revision;
+}
+
+void
+ClusterNode::Index::setSRS(const SpatialReference* value, const GeoExtent& value2)
+{
+    Threading::ScopedWriteLock lock(mutex);
+    srs = value;
+    extent = value2;
+
+    for (unsigned i = 0; i < levels.size(); ++i)
+        levels[i].clear();
+    maxHeight = 0.0;
+    for (unsigned i = 0; i < points.size(); ++i)
+    {
+        points[i].indexed = false;
+        if (points[i].node.valid())
+            insert(i);
+    }
+    ++revision;
+}
+
+void
+ClusterNode::Index::request(View* view)
+{
+    Threading::ScopedMutexLock lock(jobMutex);
+
+    // a running job picks up the newest view when it finishes
+    pendingView.reset(view);
+    if (running)
+        return;
+
+    running = true;
+    osg::ref_ptr<Index> self = this;
+    Threading::runInJobArena(Registry::instance()->getJobArena("annotations.cluster"), [self]() {
+        self->run();
+    });
+}
+
+void
+ClusterNode::Index::run()
+{
+    for (;;)
+    {
+        std::unique_ptr<View> view;
+        {
+            Threading::ScopedMutexLock lock(jobMutex);
+            if (!pendingView)
+            {
+                running = false;
+                return;
+            }
+            view.swap(pendingView);
+        }
+
+        osg::ref_ptr<Result> result = cluster(*view);
+
+        Threading::ScopedMutexLock lock(jobMutex);
+        latest = result;
+    }
+}
+
+bool
+ClusterNode::Index::isVisible(const View& view, const osg::Vec3d& world, osg::Vec3d& screen) const
+{
+    if (!view.frustum.contains(world))
+        return false;
+
+    if (view.horizon.valid() && !view.horizon->isVisible(world))
+        return false;
+
+    screen = world * view.mvpw;
+    return
+        screen.x() >= 0 && screen.x() <= view.width &&
+        screen.y() >= 0 && screen.y() <= view.height;
+}
+
+void
+ClusterNode::Index::gather(int level, unsigned cx, unsigned cy, std::vector<unsigned>& out) const
+{
+    Level::const_iterator c = levels[level].find(cellKey(cx, cy));
+    if (c == levels[level].end())
+        return;
+
+    if (level == MAX_LEVEL)
+    {
+        out.insert(out.end(), c->second.points.begin(), c->second.points.end());
+        return;
+    }
+
+    for (unsigned i = 0; i < 4; ++i)
+        gather(level + 1, 2*cx + (i & 1), 2*cy + (i >> 1), out);
+}
+
+void
+ClusterNode::Index::visit(const View& view, int level, unsigned cx, unsigned cy, std::vector<std::vector<unsigned> >& groups)
+{
+    Level::const_iterator c = levels[level].find(cellKey(cx, cy));
+    if (c == levels[level].end())
+        return;
+
+    // The corners of the coarsest cells don't bound the curve of the
+    // earth between them, so only cull the finer ones.
+    if (level > 2)
+    {
+        double size = 1.0 / (double)(1u << level);
+        osg::BoundingSphere bound;
+        bound.expandBy(denormalize(cx*size, cy*size));
+        bound.expandBy(denormalize((cx+1)*size, cy*size));
+        bound.expandBy(denormalize(cx*size, (cy+1)*size));
+        bound.expandBy(denormalize((cx+1)*size, (cy+1)*size));
+        bound.expandBy(denormalize((cx+0.5)*size, (cy+0.5)*size));
+        bound.radius() += maxHeight;
+
+        if (!view.frustum.contains(bound))
+            return;
+        if (view.horizon.valid() && !view.horizon->isVisible(bound))
+            return;
+    }
+
+    if (level < view.level)
+    {
+        for (unsigned i = 0; i < 4; ++i)
+            visit(view, level + 1, 2*cx + (i & 1), 2*cy + (i >> 1), groups);
+        return;
+    }
+
+    std::vector<unsigned> members;
+    gather(level, cx, cy, members);
+
+    std::vector<unsigned> visible;
+    osg::Vec3d screen;
+    for (unsigned i = 0; i < members.size(); ++i)
+    {
+        if (isVisible(view, points[members[i]].world, screen))
+            visible.push_back(members[i]);
+    }
+
+    if (view.leaves)
+    {
+        for (unsigned i = 0; i < visible.size(); ++i)
+            groups.push_back(std::vector<unsigned>(1, visible[i]));
+    }
+
+    else if (!view.canCluster.valid())
+    {
+        if (!visible.empty())
+            groups.push_back(visible);
+    }
+
+    else
+    {
+        // split the cell into groups that can cluster with their first node
+        unsigned first = groups.size();
+        for (unsigned i = 0; i < visible.size(); ++i)
+        {
+            osg::Node* node = points[visible[i]].node.get();
+            unsigned g = first;
+            for (; g < groups.size(); ++g)
+            {
+                if ((*view.canCluster)(points[groups[g][0]].node.get(), node))
+                    break;
+            }
+            if (g == groups.size())
+                groups.push_back(std::vector<unsigned>());
+            groups[g].push_back(visible[i]);
+        }
+    }
+}
+
+ClusterNode::Result*
+ClusterNode::Index::cluster(const View& view)
+{
+    Threading::ScopedReadLock lock(mutex);
+
+    osg::ref_ptr<Result> result = new Result();
+
+    // groups of visible nodes, one per grid cell (or finer)
+    std::vector<std::vector<unsigned> > groups;
+    if (srs.valid())
+        visit(view, 0, 0u, 0u, groups);
+
+    if (groups.empty())
+        return result.release();
+
+    // Neighboring cells can still overlap on screen, so merge groups whose
+    // first nodes are within the radius, exactly as the nodes themselves
+    // used to be merged.
+    std::vector<TPoint> screens(groups.size());
+    for (unsigned g = 0; g < groups.size(); ++g)
+    {
+        osg::Vec3d screen = points[groups[g][0]].world * view.mvpw;
+        screens[g] = TPoint((int)screen.x(), (int)screen.y());
+    }
+
+    kdbush::KDBush<TPoint> kdindex(screens);
+    std::vector<bool> clustered(groups.size(), false);
+    int radius = (int)view.radius;
+
+    for (unsigned g = 0; g < groups.size(); ++g)
+    {
+        if (clustered[g])
+            continue;
+
+        const Point& seed = points[groups[g][0]];
+
+        TIds indices;
+        kdindex.range(screens[g].first - radius, screens[g].second - radius, screens[g].first + radius, screens[g].second + radius, indices);
+
+        Result::Entry entry;
+        entry.world = seed.world;
+
+        for (unsigned j = 0; j < indices.size(); ++j)
+        {
+            unsigned k = indices[j];
+            if (clustered[k])
+                continue;
+
+            if (k != g && view.canCluster.valid() && !(*view.canCluster)(seed.node.get(), points[groups[k][0]].node.get()))
+                continue;
+
+            for (unsigned i = 0; i < groups[k].size(); ++i)
+                entry.nodes.push_back(points[groups[k][i]].node.get());
+            clustered[k] = true;
+        }
+
+        if (!clustered[g])
+        {
+            for (unsigned i = 0; i < groups[g].size(); ++i)
+                entry.nodes.push_back(points[groups[g][i]].node.get());
+            clustered[g] = true;
+        }
+
+        result->clusters.push_back(entry);
+    }
+
+    return result.release();
+}
+
+//........................................................................
+
 ClusterNode::ClusterNode(MapNode* mapNode, osg::Image* defaultImage) :
     _radius(50),
     _mapNode(mapNode),
@@ -15,18 +543,26 @@ ClusterNode::ClusterNode(MapNode* mapNode, osg::Image* defaultImage) :
     _enabled(true),
     _dirty(true),
     _defaultImage(defaultImage),
-    _dirtyIndex(true)
+    _lastRevision(0u)
 {
     setCullingActive(false);
-    
-    _horizon = new Horizon();
+
+    _index = new Index();
+    if (mapNode)
+        _index->setSRS(mapNode->getMapSRS(), mapNode->getMap()->getProfile()->getExtent());
+}
+
+ClusterNode::~ClusterNode()
+{
+    //nop
 }
 
 void ClusterNode::addNode(osg::Node* node)
 {
+    if (!node)
+        return;
     _nodes.push_back(node);
-    _dirty = true;
-    _dirtyIndex = true;
+    _index->add(node);
 }
 
 void ClusterNode::removeNode(osg::Node* node)
@@ -36,15 +572,19 @@ void ClusterNode::removeNode(osg::Node* node)
     {
         _nodes.erase(itr);
     }
-    _dirty = true;
-    _dirtyIndex = true;
+    _index->remove(node);
+}
+
+void ClusterNode::updateNode(osg::Node* node)
+{
+    if (node)
+        _index->update(node);
 }
 
 void ClusterNode::clear()
 {
     _nodes.clear();
-    _dirty = true;
-    _dirtyIndex = true;
+    _index->clear();
 }
 
 unsigned int ClusterNode::getRadius() const
@@ -80,9 +620,13 @@ void ClusterNode::setMapNode(MapNode* mapNode)
     {
         _mapNode = mapNode;
         _dirty = true;
-        _dirtyIndex = true;
         _labelPool.clear();
         _nextLabel = 0;
+
+        if (mapNode)
+            _index->setSRS(mapNode->getMapSRS(), mapNode->getMap()->getProfile()->getExtent());
+        else
+            _index->setSRS(0L, GeoExtent::INVALID);
     }
 }
 
@@ -109,158 +653,52 @@ void ClusterNode::setCanClusterCallback(ClusterNode::CanClusterCallback* callbac
     _dirty = true;
 }
 
-namespace
-{
-    bool boundSort(const osg::ref_ptr< osg::Node> &i, const osg::ref_ptr< osg::Node> &j)
-    {
-        osg::BoundingSphere bsI = i->getBound();
-        osg::BoundingSphere bsJ = j->getBound();
-
-        return bsI.center().x() < bsJ.center().x();
-    }
-}
-void ClusterNode::buildIndex()
-{
-    if (_dirtyIndex)
-    {
-        _clusterIndex.clear();
-
-        std::sort(_nodes.begin(), _nodes.end(), boundSort);
-
-        unsigned int maxNodes = 10000;
-
-        osg::Group* currentGroup = 0;
-
-        for (unsigned int i = 0; i < _nodes.size(); i++)
-        {
-            if (!currentGroup || currentGroup->getNumChildren() >= maxNodes)
-            {
-                currentGroup = new osg::Group;
-                _clusterIndex.push_back(currentGroup);
-            }
-            currentGroup->addChild(_nodes[i]);                      
-        }
-    }
-    _dirtyIndex = false;
-}
-
-
-void ClusterNode::getClusters(osgUtil::CullVisitor* cv, ClusterList& out)
+void ClusterNode::requestClusters(osgUtil::CullVisitor* cv)
 {
-    _nextLabel = 0;
-
     osg::Camera* camera = cv->getCurrentCamera();
-
-    osg::Viewport* viewport = camera->getViewport();
-    if (!viewport)
-    {
+    const osg::Viewport* viewport = camera->getViewport();
+    const SpatialReference* srs = _mapNode->getMapSRS();
+    if (!viewport || !srs)
         return;
-    }
-
-    osg::Matrixd mvpw = camera->getViewMatrix() *
-        camera->getProjectionMatrix() *
-        camera->getViewport()->computeWindowMatrix();
 
-    std::vector<TPoint> points;
-
-    osg::NodeList validPlaces;
-
-    buildIndex();
-
-    for (osg::NodeList::iterator itr = _clusterIndex.begin(); itr != _clusterIndex.end(); ++itr)
+    Index::View* view = new Index::View();
+    view->mvpw = camera->getViewMatrix() * camera->getProjectionMatrix() * viewport->computeWindowMatrix();
+    view->frustum.setToUnitFrustum(true, true);
+    view->frustum.transformProvidingInverse(camera->getViewMatrix() * camera->getProjectionMatrix());
+    view->width = viewport->width();
+    view->height = viewport->height();
+    view->radius = _radius;
+    view->canCluster = _canClusterCallback.get();
+    view->revision = _index->revision;
+
+    osg::Vec3d eye, center, up;
+    camera->getViewMatrixAsLookAt(eye, center, up);
+    if (srs->isGeographic())
     {
-        osg::Group* index = static_cast<osg::Group*>(itr->get());
-        if (cv->isCulled(index->getBound()))
-        {
-            continue;
-        }
-
-        for (unsigned int i = 0; i < index->getNumChildren(); i++)
-        {
-            osg::Node* node = index->getChild(i);
-            osg::Vec3d world = node->getBound().center();
-
-            if (cv->isCulled(*node))
-            {
-                continue;
-            }
-
-            if (!_horizon->isVisible(world))
-            {
-                continue;
-            }
-
-            osg::Vec3d screen = world * mvpw;
-
-            if (screen.x() >= 0 && screen.x() <= viewport->width() &&
-                screen.y() >= 0 && screen.y() <= viewport->height())
-            {
-                validPlaces.push_back(node);
-                points.push_back(TPoint(screen.x(), screen.y()));
-            }
-        }
+        view->horizon = new Horizon(srs);
+        view->horizon->setEye(eye);
     }
 
-    if (validPlaces.size() == 0) return;
-
-    kdbush::KDBush<TPoint> index(points);
-    std::set< unsigned int > clustered;
-
-    for (unsigned int i = 0; i < validPlaces.size(); i++)
-    {
-        TPoint &screen = points[i];
-        osg::Node* node = validPlaces[i].get();
-
-        // If this thing is already part of a cluster then just continue.
-        if (clustered.find(i) != clustered.end())
-        {
-            continue;
-        }
-
-        osg::Vec3d world = node->getBound().center();
-
-        // Get any matching indices that are part of this cluster.
-        TIds indices;
-
-        index.range(screen.first - _radius, screen.second - _radius, screen.first + _radius, screen.second + _radius, indices);
-
-        // Create a new cluster.
-        Cluster cluster;
-
-        unsigned int actualCount = 0;
-
-        // Add all of the points to the cluster.
-        for (unsigned int j = 0; j < indices.size(); j++)
-        {
-            if (clustered.find(indices[j]) == clustered.end())
-            {
-                if (_canClusterCallback.valid())
-                {
-                    bool canCluster = (*_canClusterCallback)(node, validPlaces[indices[j]].get());
-                    if (!canCluster) {
-                        continue;
-                    }
-                }
-                cluster.nodes.push_back(validPlaces[indices[j]]);
-                actualCount++;
-                clustered.insert(indices[j]);
-            }
-        }
-
-        std::stringstream buf;
-        buf << actualCount << std::endl;
-
-        PlaceNode* marker = getOrCreateLabel();
-        GeoPoint markerPos;
-        markerPos.fromWorld(_mapNode->getMapSRS(), world);
-        marker->setPosition(markerPos);
-        marker->setText(buf.str());
+    // Pick the finest level whose cells are at least the radius across
+    GeoPoint eyeGeo;
+    eyeGeo.fromWorld(srs, eye);
+    double height = osg::maximum(eyeGeo.isValid() ? eyeGeo.z() : 1.0, 1.0);
+
+    double metersPerPixel;
+    double fovy, aspect, zNear, zFar, left, right, bottom, top;
+    if (camera->getProjectionMatrixAsPerspective(fovy, aspect, zNear, zFar))
+        metersPerPixel = 2.0 * height * tan(osg::DegreesToRadians(0.5*fovy)) / view->height;
+    else if (camera->getProjectionMatrixAsOrtho(left, right, bottom, top, zNear, zFar))
+        metersPerPixel = (top - bottom) / view->height;
+    else
+        metersPerPixel = height / view->height;
 
-        cluster.marker = marker;
-        out.push_back(cluster);
+    double cellSize = osg::maximum((double)_radius, 1.0) * metersPerPixel * _index->normalizedPerMeter(eyeGeo.y());
+    int level = (int)floor(-log(cellSize) / log(2.0));
+    view->leaves = level > MAX_LEVEL;
+    view->level = osg::clampBetween(level, 0, MAX_LEVEL);
 
-        clustered.insert(i);
-    }
+    _index->request(view);
 }
 
 void ClusterNode::traverse(osg::NodeVisitor& nv)
@@ -275,31 +713,59 @@ void ClusterNode::traverse(osg::NodeVisitor& nv)
             for (osg::NodeList::iterator itr = _nodes.begin(); itr != _nodes.end(); ++itr)
             {
                 itr->get()->accept(nv);
-            }            
+            }
         }
         else
         {
             if (_mapNode.valid())
             {
                 const osg::Matrixd &currentViewMatrix = cv->getCurrentCamera()->getViewMatrix();
-                if (_lastViewMatrix != currentViewMatrix || _dirty)
+                const osg::Matrixd &currentProjectionMatrix = cv->getCurrentCamera()->getProjectionMatrix();
+                unsigned revision = _index->revision;
+                if (_lastViewMatrix != currentViewMatrix || _lastProjectionMatrix != currentProjectionMatrix || _lastRevision != revision || _dirty)
                 {
-                    osg::Vec3d eye, center, up;
-                    cv->getCurrentCamera()->getViewMatrixAsLookAt(eye, center, up);
+                    requestClusters(cv);
+                    _dirty = false;
+                    _lastViewMatrix = currentViewMatrix;
+                    _lastProjectionMatrix = currentProjectionMatrix;
+                    _lastRevision = revision;
+                }
 
-                    _horizon->setEye(eye);
+                // Swap in the newest clusters from the background job
+                osg::ref_ptr<Result> result;
+                {
+                    Threading::ScopedMutexLock lock(_index->jobMutex);
+                    result = _index->latest;
+                }
 
+                if (result.valid() && result != _shownResult)
+                {
+                    _shownResult = result;
                     _clusters.clear();
-                    getClusters(cv, _clusters);
+                    _nextLabel = 0;
 
-                    // Style the clusters if need be
-                    if (_styleCallback)
+                    for (std::vector<Result::Entry>::const_iterator i = result->clusters.begin(); i != result->clusters.end(); ++i)
                     {
-                        for (ClusterList::iterator itr = _clusters.begin(); itr != _clusters.end(); ++itr)
+                        Cluster cluster;
+                        cluster.nodes = i->nodes;
+
+                        std::stringstream buf;
+                        buf << cluster.nodes.size() << std::endl;
+
+                        PlaceNode* marker = getOrCreateLabel();
+                        GeoPoint markerPos;
+                        markerPos.fromWorld(_mapNode->getMapSRS(), i->world);
+                        marker->setPosition(markerPos);
+                        marker->setText(buf.str());
+                        cluster.marker = marker;
+
+                        // Style the clusters if need be
+                        if (_styleCallback)
                         {
-                            Cluster& cluster = *itr;
                             (*_styleCallback)(cluster);
                         }
+
+                        _clusters.push_back(cluster);
                     }
                 }
 
@@ -318,8 +784,6 @@ void ClusterNode::traverse(osg::NodeVisitor& nv)
                         cluster.nodes[0]->accept(nv);
                     }
                 }
-                _dirty = false;
-                _lastViewMatrix = currentViewMatrix;
             }
         }
     }
@@ -354,6 +818,4 @@ PlaceNode* ClusterNode::getOrCreateLabel()
     ++_nextLabel;
 
     return node;
-
-
-}
\ No newline at end of file
+}
@@ -18,6 +18,13 @@
  */
 #include <osgEarth/Composite>
 #include <osgEarth/Progress>
+#include <osgEarth/VirtualProgram>
+#include <osg/BlendEquation>
+#include <osg/BlendFunc>
+#include <osg/Geometry>
+#include <osg/Texture2D>
+#include <osgUtil/CullVisitor>
+#include <deque>
 
 using namespace osgEarth;
 
@@ -39,12 +46,16 @@ CompositeImageLayer::Options::getConfig() const
         }
         conf.set(layersConf);
     }
+    conf.set("gpu_compositing", _gpuCompositing);
     return conf;
 }
 
 void
 CompositeImageLayer::Options::fromConfig(const Config& conf)
 {
+    _gpuCompositing.setDefault(false);
+    conf.get("gpu_compositing", _gpuCompositing);
+
     const ConfigSet& layers = conf.child("layers").children();
     for( ConfigSet::const_iterator i = layers.begin(); i != layers.end(); ++i )
     {
@@ -72,6 +83,297 @@ namespace osgEarth { namespace Composite
 
     // some helper types.    
     typedef std::vector<ImageInfo> ImageMixVector;   
+
+    // Fetches an image from each layer for the key, filling in missing
+    // ones from ancestor keys when at least one layer has data. Returns
+    // false if the request was canceled.
+    bool collectImages(
+        const ImageLayerVector& layers,
+        const TileKey& key,
+        ProgressCallback* progress,
+        ImageMixVector& images)
+    {
+        images.reserve(layers.size());
+
+        // Try to get an image from each of the layers for the given key.
+        for (ImageLayerVector::const_iterator itr = layers.begin(); itr != layers.end(); ++itr)
+        {
+            ImageLayer* layer = itr->get();
+            ImageInfo imageInfo;
+            imageInfo.opacity = layer->getOpacity();
+            imageInfo.bestAvailableKey = layer->getBestAvailableTileKey(key);
+            
+            // if there is possibly actual data for this key...
+            if (imageInfo.bestAvailableKey == key)
+            {
+                GeoImage image = layer->createImage(key, progress);
+                if (image.valid())
+                {
+                    imageInfo.image = image.getImage();
+                }
+
+                // If the progress got cancelled or it needs a retry then return NULL to prevent this tile from being built and cached with incomplete or partial data.
+                if (progress && progress->isCanceled())
+                {
+                    OE_DEBUG << LC << " createImage was cancelled or needs retry for " << key.str() << std::endl;
+                    return false;
+                }
+            }
+
+            images.push_back(imageInfo);
+        }
+
+        // Determine the output texture size to use based on the image that were created.
+        unsigned numValidImages = 0;
+        osg::Vec2s textureSize;
+        for (unsigned int i = 0; i < images.size(); i++)
+        {
+            ImageInfo& info = images[i];
+            if (info.image.valid())
+            {
+                if (numValidImages == 0)
+                {
+                    textureSize.set( info.image->s(), info.image->t());
+                }
+                numValidImages++;        
+            }
+        } 
+
+        // Create fallback images if we have some valid data but not for all the layers
+        if (numValidImages > 0 && numValidImages < images.size())
+        {
+            for (unsigned int i = 0; i < images.size(); i++)
+            {
+                ImageInfo& info = images[i];
+                ImageLayer* layer = layers[i].get();
+                if (info.image.valid() == false && info.bestAvailableKey.valid())
+                {
+                    TileKey currentKey = info.bestAvailableKey; //key.createParentKey();
+
+                    GeoImage image;
+                    while (!image.valid() && currentKey.valid())
+                    {
+                        image = layer->createImage(currentKey, progress);
+                        if (image.valid())
+                        {
+                            break;
+                        }
+
+                        // If the progress got cancelled or it needs a retry then return INVALID
+                        // to prevent this tile from being built and cached with incomplete or partial data.
+                        if (progress && progress->isCanceled())
+                        {
+                            OE_DEBUG << LC << " createImage was cancelled or needs retry for " << key.str() << std::endl;
+                            return false;
+                        }
+
+                        currentKey = currentKey.createParentKey();
+                    }
+
+                    if (image.valid())
+                    {
+                        bool bilinear = layer->isCoverage() ? false : true;
+                        GeoImage cropped = image.crop( key.getExtent(), true, textureSize.x(), textureSize.y(), bilinear);
+                        info.image = cropped.getImage();
+                    }                    
+                }
+            }
+        }
+
+        return !(progress && progress->isCanceled());
+    }
+
+    const char* compositeVS =
+        "#version " GLSL_VERSION_STR "\n"
+        "out vec2 oe_Composite_uv; \n"
+        "void oe_Composite_VS(inout vec4 vertex) \n"
+        "{ \n"
+        "    oe_Composite_uv = vertex.xy; \n"
+        "} \n";
+
+    const char* compositeFS =
+        "#version " GLSL_VERSION_STR "\n"
+        "in vec2 oe_Composite_uv; \n"
+        "uniform sampler2D oe_Composite_tex; \n"
+        "uniform float oe_Composite_opacity; \n"
+        "void oe_Composite_FS(inout vec4 color) \n"
+        "{ \n"
+        "    color = texture(oe_Composite_tex, oe_Composite_uv); \n"
+        "    color.a *= oe_Composite_opacity; \n"
+        "} \n";
+
+    /**
+     * Blends the images of a composite tile into a texture on the GPU.
+     * Each call to composite() queues a pre-render camera that draws one
+     * unit quad per image, and the next cull traversal of this node runs
+     * it. The first image is copied and the rest are blended with the
+     * same math as ImageUtils::mix.
+     */
+    class GPUCompositor : public osg::Group
+    {
+    public:
+        GPUCompositor()
+        {
+            setCullingActive(false);
+
+            _quad = new osg::Geometry();
+            _quad->setName("CompositeImageLayer quad");
+            _quad->setUseVertexBufferObjects(true);
+            _quad->setUseDisplayList(false);
+            osg::Vec3Array* verts = new osg::Vec3Array();
+            verts->push_back(osg::Vec3(0, 0, 0));
+            verts->push_back(osg::Vec3(1, 0, 0));
+            verts->push_back(osg::Vec3(1, 1, 0));
+            verts->push_back(osg::Vec3(0, 1, 0));
+            _quad->setVertexArray(verts);
+            _quad->addPrimitiveSet(new osg::DrawArrays(GL_TRIANGLE_FAN, 0, 4));
+
+            _stateSet = new osg::StateSet();
+            _stateSet->setMode(GL_DEPTH_TEST, osg::StateAttribute::OFF | osg::StateAttribute::PROTECTED);
+            _stateSet->setMode(GL_CULL_FACE, osg::StateAttribute::OFF | osg::StateAttribute::PROTECTED);
+            _stateSet->addUniform(new osg::Uniform("oe_Composite_tex", 0));
+
+            VirtualProgram* vp = VirtualProgram::getOrCreate(_stateSet.get());
+            vp->setName("CompositeImageLayer");
+            vp->setInheritShaders(false);
+            vp->setFunction("oe_Composite_VS", compositeVS, ShaderComp::LOCATION_VERTEX_MODEL);
+            vp->setFunction("oe_Composite_FS", compositeFS, ShaderComp::LOCATION_FRAGMENT_COLORING);
+
+            _copy = new osg::StateSet();
+            _copy->setMode(GL_BLEND, osg::StateAttribute::OFF);
+            _copy->addUniform(new osg::Uniform("oe_Composite_opacity", 1.0f));
+
+            // rgb = dest*(1-sa) + src*sa, alpha = max(sa, da)
+            _blend = new osg::StateSet();
+            _blend->setAttributeAndModes(new osg::BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA), osg::StateAttribute::ON);
+            _blend->setAttributeAndModes(new osg::BlendEquation(osg::BlendEquation::FUNC_ADD, osg::BlendEquation::RGBA_MAX), osg::StateAttribute::ON);
+        }
+
+        osg::Texture2D* composite(const ImageMixVector& images, const ImageLayer* layer)
+        {
+            int width = 0, height = 0;
+            for (unsigned i = 0; i < images.size(); ++i)
+            {
+                if (images[i].image.valid())
+                {
+                    width = osg::maximum(width, images[i].image->s());
+                    height = osg::maximum(height, images[i].image->t());
+                }
+            }
+            if (width == 0 || height == 0)
+                return 0L;
+
+            osg::Texture2D* output = new osg::Texture2D();
+            output->setTextureSize(width, height);
+            output->setInternalFormat(GL_RGBA8);
+            output->setSourceFormat(GL_RGBA);
+            output->setSourceType(GL_UNSIGNED_BYTE);
+            output->setWrap(osg::Texture::WRAP_S, osg::Texture::CLAMP_TO_EDGE);
+            output->setWrap(osg::Texture::WRAP_T, osg::Texture::CLAMP_TO_EDGE);
+            output->setResizeNonPowerOfTwoHint(false);
+            output->setMaxAnisotropy(4.0f);
+            output->setFilter(osg::Texture::MAG_FILTER, layer->options().magFilter().get());
+
+            // Disable mip mapping for npot tiles
+            bool pot = ((width & (width-1)) == 0) && ((height & (height-1)) == 0);
+            osg::Texture::FilterMode minFilter = layer->options().minFilter().get();
+            bool mipmap = pot && minFilter != osg::Texture::LINEAR && minFilter != osg::Texture::NEAREST;
+            output->setFilter(osg::Texture::MIN_FILTER, mipmap ? minFilter : osg::Texture::LINEAR);
+
+            osg::Camera* camera = new osg::Camera();
+            camera->setName("CompositeImageLayer");
+            camera->setReferenceFrame(osg::Camera::ABSOLUTE_RF);
+            camera->setRenderOrder(osg::Camera::PRE_RENDER);
+            camera->setRenderTargetImplementation(osg::Camera::FRAME_BUFFER_OBJECT);
+            camera->setImplicitBufferAttachmentMask(0, 0);
+            camera->setComputeNearFarMode(osg::CullSettings::DO_NOT_COMPUTE_NEAR_FAR);
+            camera->setProjectionMatrixAsOrtho2D(0.0, 1.0, 0.0, 1.0);
+            camera->setViewMatrix(osg::Matrix::identity());
+            camera->setViewport(0, 0, width, height);
+            camera->setClearColor(osg::Vec4(0, 0, 0, 0));
+            camera->setClearMask(GL_COLOR_BUFFER_BIT);
+            camera->setAllowEventFocus(false);
+            camera->setCullingActive(false);
+            camera->attach(osg::Camera::COLOR_BUFFER, output, 0u, 0u, mipmap);
+            camera->setStateSet(_stateSet.get());
+
+            int bin = 0;
+            for (unsigned i = 0; i < images.size(); ++i)
+            {
+                const ImageInfo& info = images[i];
+                if (!info.image.valid())
+                    continue;
+
+                osg::Texture2D* input = new osg::Texture2D(info.image.get());
+                input->setWrap(osg::Texture::WRAP_S, osg::Texture::CLAMP_TO_EDGE);
+                input->setWrap(osg::Texture::WRAP_T, osg::Texture::CLAMP_TO_EDGE);
+                input->setFilter(osg::Texture::MIN_FILTER, osg::Texture::LINEAR);
+                input->setFilter(osg::Texture::MAG_FILTER, osg::Texture::LINEAR);
+                input->setResizeNonPowerOfTwoHint(false);
+                input->setUnRefImageDataAfterApply(true);
+
+                // For GL_RED, swizzle the RGBA all to RED in order to match old GL_LUMINANCE behavior
+                if (info.image->getPixelFormat() == GL_RED)
+                    input->setSwizzle(osg::Vec4i(GL_RED, GL_RED, GL_RED, GL_RED));
+
+                // the render bin number keeps the draws in layer order
+                osg::Group* pass = new osg::Group();
+                osg::StateSet* ss = pass->getOrCreateStateSet();
+                ss->setRenderBinDetails(bin, "RenderBin");
+                ss->setTextureAttribute(0, input, osg::StateAttribute::ON);
+                ss->merge(bin == 0 ? *_copy.get() : *_blend.get());
+                if (bin > 0)
+                    ss->addUniform(new osg::Uniform("oe_Composite_opacity", osg::clampBetween(info.opacity, 0.0f, 1.0f)));
+                pass->addChild(_quad.get());
+                camera->addChild(pass);
+                ++bin;
+            }
+
+            Threading::ScopedMutexLock lock(_mutex);
+            _pending.push_back(camera);
+            return output;
+        }
+
+        virtual void traverse(osg::NodeVisitor& nv)
+        {
+            if (nv.getVisitorType() == osg::NodeVisitor::CULL_VISITOR)
+            {
+                std::vector< osg::ref_ptr<osg::Camera> > cameras;
+                {
+                    Threading::ScopedMutexLock lock(_mutex);
+                    cameras.swap(_pending);
+
+                    // hold on to cameras until the draw that used them is done
+                    unsigned frame = nv.getFrameStamp() ? nv.getFrameStamp()->getFrameNumber() : 0u;
+                    while (!_retired.empty() && _retired.front().second + 2u < frame)
+                        _retired.pop_front();
+                    for (unsigned i = 0; i < cameras.size(); ++i)
+                        _retired.push_back(std::make_pair(cameras[i], frame));
+                }
+
+                for (unsigned i = 0; i < cameras.size(); ++i)
+                {
+                    cameras[i]->accept(nv);
+                }
+            }
+
+            osg::Group::traverse(nv);
+        }
+
+        virtual void releaseGLObjects(osg::State* state) const
+        {
+            osg::Group::releaseGLObjects(state);
+            _quad->releaseGLObjects(state);
+            _stateSet->releaseGLObjects(state);
+        }
+
+    private:
+        osg::ref_ptr<osg::Geometry> _quad;
+        osg::ref_ptr<osg::StateSet> _stateSet, _copy, _blend;
+        Threading::Mutex _mutex;
+        std::vector< osg::ref_ptr<osg::Camera> > _pending;
+        std::deque< std::pair<osg::ref_ptr<osg::Camera>, unsigned> > _retired;
+    };
 } }
 
 REGISTER_OSGEARTH_LAYER(compositeimage, CompositeImageLayer);
@@ -271,6 +573,25 @@ CompositeImageLayer::openImplementation()
 
     setProfile( profile.get() );
 
+    if (options().gpuCompositing() == true)
+    {
+        // Tiles the terrain gets from createTexture never go through the
+        // cache, so a cached layer has to keep compositing on the CPU.
+        if (getCacheSettings()->isCacheEnabled())
+        {
+            OE_WARN << LC << "gpu_compositing is not available with a cache; compositing on the CPU" << std::endl;
+        }
+        else
+        {
+            if (!_layerNodes.valid())
+                _layerNodes = new osg::Group();
+
+            _compositor = new Composite::GPUCompositor();
+            _layerNodes->addChild(_compositor.get());
+            setUseCreateTexture();
+        }
+    }
+
     return Status::NoError;
 }
 
@@ -288,104 +609,48 @@ CompositeImageLayer::closeImplementation()
         _layerNodes->removeChildren(0, _layerNodes->getNumChildren());
     }
 
+    _compositor = NULL;
+
     dataExtents().clear();
     return Status::OK();
 }
 
-GeoImage
-CompositeImageLayer::createImageImplementation(const TileKey& key, ProgressCallback* progress) const
+TextureWindow
+CompositeImageLayer::createTexture(const TileKey& key, ProgressCallback* progress) const
 {
-    Composite::ImageMixVector images;
-    images.reserve(_layers.size());
-
-    // Try to get an image from each of the layers for the given key.
-    for (ImageLayerVector::const_iterator itr = _layers.begin(); itr != _layers.end(); ++itr)
+    Composite::GPUCompositor* compositor = static_cast<Composite::GPUCompositor*>(_compositor.get());
+    if (compositor == NULL || getStatus().isError())
     {
-        ImageLayer* layer = itr->get();
-        Composite::ImageInfo imageInfo;
-        imageInfo.opacity = layer->getOpacity();
-        imageInfo.bestAvailableKey = layer->getBestAvailableTileKey(key);
-        
-        // if there is possibly actual data for this key...
-        if (imageInfo.bestAvailableKey == key)
-        {
-            GeoImage image = layer->createImage(key, progress);
-            if (image.valid())
-            {
-                imageInfo.image = image.getImage();
-            }
-
-            // If the progress got cancelled or it needs a retry then return NULL to prevent this tile from being built and cached with incomplete or partial data.
-            if (progress && progress->isCanceled())
-            {
-                OE_DEBUG << LC << " createImage was cancelled or needs retry for " << key.str() << std::endl;
-                return GeoImage::INVALID;
-            }
-        }
-
-        images.push_back(imageInfo);
+        return TextureWindow();
     }
 
-    // Determine the output texture size to use based on the image that were created.
-    unsigned numValidImages = 0;
-    osg::Vec2s textureSize;
-    for (unsigned int i = 0; i < images.size(); i++)
+    Composite::ImageMixVector images;
+    if (!Composite::collectImages(_layers, key, progress, images))
     {
-        Composite::ImageInfo& info = images[i];
-        if (info.image.valid())
-        {
-            if (numValidImages == 0)
-            {
-                textureSize.set( info.image->s(), info.image->t());
-            }
-            numValidImages++;        
-        }
-    } 
+        return TextureWindow();
+    }
 
-    // Create fallback images if we have some valid data but not for all the layers
-    if (numValidImages > 0 && numValidImages < images.size())
+    osg::Texture2D* texture = compositor->composite(images, this);
+    if (texture == NULL)
     {
-        for (unsigned int i = 0; i < images.size(); i++)
-        {
-            Composite::ImageInfo& info = images[i];
-            ImageLayer* layer = _layers[i].get();
-            if (info.image.valid() == false && info.bestAvailableKey.valid())
-            {
-                TileKey currentKey = info.bestAvailableKey; //key.createParentKey();
-
-                GeoImage image;
-                while (!image.valid() && currentKey.valid())
-                {
-                    image = layer->createImage(currentKey, progress);
-                    if (image.valid())
-                    {
-                        break;
-                    }
-
-                    // If the progress got cancelled or it needs a retry then return INVALID
-                    // to prevent this tile from being built and cached with incomplete or partial data.
-                    if (progress && progress->isCanceled())
-                    {
-                        OE_DEBUG << LC << " createImage was cancelled or needs retry for " << key.str() << std::endl;
-                        return GeoImage::INVALID;
-                    }
+        return TextureWindow();
+    }
 
-                    currentKey = currentKey.createParentKey();
-                }
+    return TextureWindow(texture, osg::Matrix::identity());
+}
 
-                if (image.valid())
-                {
-                    bool bilinear = layer->isCoverage() ? false : true;
-                    GeoImage cropped = image.crop( key.getExtent(), true, textureSize.x(), textureSize.y(), bilinear);
-                    info.image = cropped.getImage();
-                }                    
-            }
-        }
+GeoImage
+CompositeImageLayer::createImageImplementation(const TileKey& key, ProgressCallback* progress) const
+{
+    Composite::ImageMixVector images;
+    if (!Composite::collectImages(_layers, key, progress, images))
+    {
+        return GeoImage::INVALID;
     }
 
     // Now finally create the output image.
     //Recompute the number of valid images
-    numValidImages = 0;
+    unsigned numValidImages = 0;
     for (unsigned int i = 0; i < images.size(); i++)
     {
         Composite::ImageInfo& info = images[i];
@@ -70,10 +70,7 @@ Config::setReferrer( const std::string& referrer )
 bool
 Config::fromXML( std::istream& in )
 {
-    osg::ref_ptr<XmlDocument> xml = XmlDocument::load( in );
-    if ( xml.valid() )
-        *this = xml->getConfig();
-    return xml.valid();
+    return XmlDocument::readConfig( in, URIContext(), *this );
 }
 
 #if 1
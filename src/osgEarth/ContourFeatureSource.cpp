@@ -0,0 +1,482 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+ * Copyright 2020 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarth/ContourFeatureSource>
+#include <osgEarth/ElevationPool>
+#include <osgEarth/FeatureCursor>
+#include <osgEarth/Registry>
+#include <osgEarth/Threading>
+#include <deque>
+#include <cmath>
+
+#define LC "[ContourFeatureSource] " << getName() << ": "
+
+// arena in which tiles are contoured
+#define ARENA_NAME "features.contours"
+
+// most tiles to contour for one query
+#define MAX_TILES_PER_QUERY 4096
+
+using namespace osgEarth;
+
+namespace osgEarth {
+    namespace Features {
+        REGISTER_OSGEARTH_LAYER(contourfeatures, ContourFeatureSource);
+        REGISTER_OSGEARTH_LAYER(contour_features, ContourFeatureSource);
+    }
+}
+
+namespace
+{
+    typedef std::deque<osg::Vec3d> Line;
+    typedef std::map<int, std::vector<Line> > LinesByContour;
+
+    // Contour lines of one tile, keyed by contour number
+    struct ContourTile : public osg::Referenced
+    {
+        LinesByContour _lines;
+    };
+
+    // Endpoint identity for joining lines. Points on a shared grid edge
+    // are computed the same way on both sides, so they only differ by
+    // rounding in the tile extents.
+    struct PointKey
+    {
+        long long _x, _y;
+        PointKey(const osg::Vec3d& p) : _x(::llround(p.x() * 1e9)), _y(::llround(p.y() * 1e9)) { }
+        bool operator < (const PointKey& rhs) const {
+            return _x < rhs._x || (_x == rhs._x && _y < rhs._y);
+        }
+        bool operator == (const PointKey& rhs) const {
+            return _x == rhs._x && _y == rhs._y;
+        }
+    };
+
+    // Joins lines that share endpoints into the longest possible lines.
+    void chain(std::vector<Line>& lines)
+    {
+        typedef std::map<PointKey, std::vector<unsigned> > EndMap;
+        EndMap ends;
+        for (unsigned i = 0; i < lines.size(); ++i)
+        {
+            ends[PointKey(lines[i].front())].push_back(i);
+            ends[PointKey(lines[i].back())].push_back(i);
+        }
+
+        std::vector<bool> used(lines.size(), false);
+        std::vector<Line> output;
+
+        for (unsigned i = 0; i < lines.size(); ++i)
+        {
+            if (used[i])
+                continue;
+
+            used[i] = true;
+            Line current;
+            current.swap(lines[i]);
+
+            // grow the back, then the front
+            for (unsigned side = 0; side < 2; ++side)
+            {
+                for (;;)
+                {
+                    PointKey end(side == 0 ? current.back() : current.front());
+                    EndMap::const_iterator e = ends.find(end);
+                    int next = -1;
+                    if (e != ends.end())
+                    {
+                        for (unsigned k = 0; k < e->second.size() && next < 0; ++k)
+                            if (!used[e->second[k]])
+                                next = e->second[k];
+                    }
+                    if (next < 0)
+                        break;
+
+                    used[next] = true;
+                    Line& other = lines[next];
+                    bool forward = PointKey(other.front()) == end;
+
+                    if (side == 0)
+                    {
+                        if (forward)
+                            current.insert(current.end(), other.begin() + 1, other.end());
+                        else
+                            current.insert(current.end(), other.rbegin() + 1, other.rend());
+                    }
+                    else
+                    {
+                        if (forward)
+                            current.insert(current.begin(), other.rbegin(), other.rend() - 1);
+                        else
+                            current.insert(current.begin(), other.begin(), other.end() - 1);
+                    }
+                    Line().swap(other);
+                }
+            }
+
+            output.push_back(Line());
+            output.back().swap(current);
+        }
+
+        lines.swap(output);
+    }
+
+    // Where a contour crosses the grid edge from a to b. Callers always
+    // pass an edge's corners in grid order, so neighbors compute the same point.
+    inline osg::Vec3d crossing(const osg::Vec3d& a, float va, const osg::Vec3d& b, float vb, double level)
+    {
+        double t = (level - (double)va) / ((double)vb - (double)va);
+        return osg::Vec3d(a.x() + (b.x() - a.x()) * t, a.y() + (b.y() - a.y()) * t, level);
+    }
+
+    // Samples a tile on a size x size grid and runs marching squares over it.
+    ContourTile* contourTile(
+        const TileKey& key,
+        const Map* map,
+        unsigned size,
+        double base,
+        double interval,
+        ProgressCallback* progress)
+    {
+        osg::ref_ptr<ContourTile> tile = new ContourTile();
+
+        const GeoExtent& extent = key.getExtent();
+        const SpatialReference* srs = extent.getSRS();
+        const SpatialReference* mapSRS = map->getSRS();
+
+        // the last row and column sit exactly on the tile edge, so they
+        // match the first row and column of the neighbor
+        std::vector<double> xs(size), ys(size);
+        for (unsigned i = 0; i < size; ++i)
+        {
+            xs[i] = i + 1 == size ? extent.xMax() : extent.xMin() + extent.width() * (double)i / (double)(size - 1);
+            ys[i] = i + 1 == size ? extent.yMax() : extent.yMin() + extent.height() * (double)i / (double)(size - 1);
+        }
+
+        std::vector<osg::Vec3d> coords(size * size);
+        for (unsigned j = 0; j < size; ++j)
+            for (unsigned i = 0; i < size; ++i)
+                coords[j*size + i].set(xs[i], ys[j], 0.0);
+
+        if (!srs->isHorizEquivalentTo(mapSRS) && !srs->transform(coords, mapSRS))
+            return 0L;
+
+        double latitude = extent.getCentroid().y();
+        double resolution = srs->transformUnits(extent.width() / (double)(size - 1), mapSRS, latitude);
+
+        std::vector<osg::Vec4d> points(coords.size());
+        for (unsigned i = 0; i < coords.size(); ++i)
+            points[i].set(coords[i].x(), coords[i].y(), 0.0, resolution);
+
+        ElevationPool::WorkingSet ws;
+        if (map->getElevationPool()->sampleMapCoords(points, &ws, progress) <= 0)
+            return tile.release();
+
+        std::vector<float> values(points.size());
+        for (unsigned i = 0; i < points.size(); ++i)
+            values[i] = (float)points[i].z();
+
+        // segments, keyed by contour number
+        LinesByContour segments;
+
+        for (unsigned j = 0; j + 1 < size; ++j)
+        {
+            if (progress && progress->isCanceled())
+                return 0L;
+
+            for (unsigned i = 0; i + 1 < size; ++i)
+            {
+                // corners counterclockwise from the lower left
+                unsigned c[4] = { j*size + i, j*size + i + 1, (j+1)*size + i + 1, (j+1)*size + i };
+                float v[4] = { values[c[0]], values[c[1]], values[c[2]], values[c[3]] };
+                if (v[0] == NO_DATA_VALUE || v[1] == NO_DATA_VALUE || v[2] == NO_DATA_VALUE || v[3] == NO_DATA_VALUE)
+                    continue;
+
+                osg::Vec3d p[4] = {
+                    osg::Vec3d(xs[i], ys[j], 0), osg::Vec3d(xs[i+1], ys[j], 0),
+                    osg::Vec3d(xs[i+1], ys[j+1], 0), osg::Vec3d(xs[i], ys[j+1], 0) };
+
+                float vmin = osg::minimum(osg::minimum(v[0], v[1]), osg::minimum(v[2], v[3]));
+                float vmax = osg::maximum(osg::maximum(v[0], v[1]), osg::maximum(v[2], v[3]));
+                int k0 = (int)std::ceil(((double)vmin - base) / interval);
+                int k1 = (int)std::floor(((double)vmax - base) / interval);
+
+                for (int k = k0; k <= k1; ++k)
+                {
+                    double level = base + (double)k * interval;
+                    unsigned code =
+                        (v[0] >= level ? 1u : 0u) | (v[1] >= level ? 2u : 0u) |
+                        (v[2] >= level ? 4u : 0u) | (v[3] >= level ? 8u : 0u);
+
+                    if (code == 0u || code == 15u)
+                        continue;
+
+                    // edges: 0 = bottom, 1 = right, 2 = top, 3 = left
+                    osg::Vec3d e[4];
+                    if ((code & 1u) != ((code >> 1) & 1u)) e[0] = crossing(p[0], v[0], p[1], v[1], level);
+                    if (((code >> 1) & 1u) != ((code >> 2) & 1u)) e[1] = crossing(p[1], v[1], p[2], v[2], level);
+                    if (((code >> 3) & 1u) != ((code >> 2) & 1u)) e[2] = crossing(p[3], v[3], p[2], v[2], level);
+                    if ((code & 1u) != ((code >> 3) & 1u)) e[3] = crossing(p[0], v[0], p[3], v[3], level);
+
+                    int pairs[4] = { -1, -1, -1, -1 };
+                    switch (code)
+                    {
+                    case 1: case 14: pairs[0] = 3; pairs[1] = 0; break;
+                    case 2: case 13: pairs[0] = 0; pairs[1] = 1; break;
+                    case 3: case 12: pairs[0] = 3; pairs[1] = 1; break;
+                    case 4: case 11: pairs[0] = 1; pairs[1] = 2; break;
+                    case 6: case 9:  pairs[0] = 0; pairs[1] = 2; break;
+                    case 7: case 8:  pairs[0] = 3; pairs[1] = 2; break;
+                    case 5: case 10:
+                    {
+                        // saddle: the cell center decides which corners connect
+                        bool centerAbove = 0.25*((double)v[0] + v[1] + v[2] + v[3]) >= level;
+                        if (centerAbove == (code == 5u)) {
+                            pairs[0] = 0; pairs[1] = 1; pairs[2] = 2; pairs[3] = 3;
+                        }
+                        else {
+                            pairs[0] = 3; pairs[1] = 0; pairs[2] = 1; pairs[3] = 2;
+                        }
+                        break;
+                    }
+                    }
+
+                    std::vector<Line>& lines = segments[k];
+                    for (unsigned s = 0; s < 4 && pairs[s] >= 0; s += 2)
+                    {
+                        lines.push_back(Line());
+                        lines.back().push_back(e[pairs[s]]);
+                        lines.back().push_back(e[pairs[s+1]]);
+                    }
+                }
+            }
+        }
+
+        for (LinesByContour::iterator i = segments.begin(); i != segments.end(); ++i)
+        {
+            chain(i->second);
+            tile->_lines[i->first].swap(i->second);
+        }
+
+        return tile.release();
+    }
+}
+
+//.........................................................
+
+Config
+ContourFeatureSource::Options::getConfig() const
+{
+    Config conf = FeatureSource::Options::getConfig();
+    conf.set("interval", interval());
+    conf.set("base", base());
+    conf.set("level", level());
+    conf.set("tile_size", tileSize());
+    conf.set("attribute", attribute());
+    return conf;
+}
+
+void
+ContourFeatureSource::Options::fromConfig(const Config& conf)
+{
+    interval().init(100.0);
+    base().init(0.0);
+    level().init(12u);
+    tileSize().init(65u);
+    attribute().init("elevation");
+    conf.get("interval", interval());
+    conf.get("base", base());
+    conf.get("level", level());
+    conf.get("tile_size", tileSize());
+    conf.get("attribute", attribute());
+}
+
+//.........................................................
+
+OE_LAYER_PROPERTY_IMPL(ContourFeatureSource, double, Interval, interval);
+OE_LAYER_PROPERTY_IMPL(ContourFeatureSource, double, Base, base);
+OE_LAYER_PROPERTY_IMPL(ContourFeatureSource, unsigned, Level, level);
+OE_LAYER_PROPERTY_IMPL(ContourFeatureSource, unsigned, TileSize, tileSize);
+OE_LAYER_PROPERTY_IMPL(ContourFeatureSource, std::string, Attribute, attribute);
+
+void
+ContourFeatureSource::init()
+{
+    FeatureSource::init();
+}
+
+Status
+ContourFeatureSource::openImplementation()
+{
+    Status parent = FeatureSource::openImplementation();
+    if (parent.isError())
+        return parent;
+
+    if (options().interval().get() <= 0.0)
+        return Status(Status::ConfigurationError, "Contour interval must be positive");
+
+    if (options().tileSize().get() < 2u)
+        return Status(Status::ConfigurationError, "Tile size must be at least 2");
+
+    // Establish the feature profile.
+    osg::ref_ptr<const Profile> globalGeodetic = Profile::create("global-geodetic");
+
+    FeatureProfile* profile = new FeatureProfile(globalGeodetic->getExtent());
+    profile->setTilingProfile(globalGeodetic.get());
+    profile->setFirstLevel(options().level().get());
+    profile->setMaxLevel(options().level().get());
+
+    setFeatureProfile(profile);
+
+    return Status::NoError;
+}
+
+void
+ContourFeatureSource::addedToMap(const Map* map)
+{
+    _map = map;
+    FeatureSource::addedToMap(map);
+}
+
+void
+ContourFeatureSource::removedFromMap(const Map* map)
+{
+    FeatureSource::removedFromMap(map);
+    _map = 0L;
+}
+
+FeatureCursor*
+ContourFeatureSource::createFeatureCursorImplementation(const Query& query, ProgressCallback* progress)
+{
+    osg::ref_ptr<const Map> map;
+    if (!_map.lock(map) || !getFeatureProfile())
+        return 0L;
+
+    const Profile* tiling = getFeatureProfile()->getTilingProfile();
+    unsigned level = options().level().get();
+
+    // contour at our own level whatever the query asks for, and join
+    // the pieces if that takes more than one tile
+    GeoExtent extent;
+    std::vector<TileKey> keys;
+    if (query.tileKey().isSet())
+    {
+        const TileKey& key = query.tileKey().get();
+        extent = key.getExtent();
+        if (key.getLOD() == level && key.getProfile()->isHorizEquivalentTo(tiling))
+            keys.push_back(key);
+        else
+            tiling->getIntersectingTiles(extent, level, keys);
+    }
+    else if (query.bounds().isSet())
+    {
+        extent = GeoExtent(getFeatureProfile()->getSRS(), query.bounds().get());
+        tiling->getIntersectingTiles(extent, level, keys);
+    }
+    else
+    {
+        OE_WARN << LC << "Queries need a tile key or bounds" << std::endl;
+        return 0L;
+    }
+
+    if (keys.size() > MAX_TILES_PER_QUERY)
+    {
+        OE_WARN << LC << "Query covers " << keys.size() << " tiles; the limit is " << MAX_TILES_PER_QUERY << std::endl;
+        return 0L;
+    }
+
+    unsigned size = options().tileSize().get();
+    double base = options().base().get();
+    double interval = options().interval().get();
+
+    LinesByContour lines;
+
+    if (keys.size() == 1u)
+    {
+        osg::ref_ptr<ContourTile> tile = contourTile(keys[0], map.get(), size, base, interval, progress);
+        if (tile.valid())
+            lines.swap(tile->_lines);
+    }
+    else
+    {
+        Threading::JobArena* arena = Registry::instance()->getJobArena(ARENA_NAME);
+        osg::ref_ptr<ProgressCallback> safeProgress = progress;
+        std::vector<Threading::Future<ContourTile> > tiles;
+
+        for (unsigned i = 0; i < keys.size(); ++i)
+        {
+            Threading::Promise<ContourTile> promise;
+            tiles.push_back(promise.getFuture());
+            TileKey key = keys[i];
+
+            Threading::runInJobArena(arena, [promise, key, map, size, base, interval, safeProgress]() mutable
+            {
+                if (promise.isCanceled())
+                    return;
+                osg::ref_ptr<ContourTile> tile = contourTile(key, map.get(), size, base, interval, safeProgress.get());
+                promise.resolve(tile.get());
+            });
+        }
+
+        for (unsigned i = 0; i < tiles.size(); ++i)
+        {
+            ContourTile* tile = tiles[i].get(progress);
+            if (!tile)
+                continue;
+
+            for (LinesByContour::iterator c = tile->_lines.begin(); c != tile->_lines.end(); ++c)
+            {
+                std::vector<Line>& out = lines[c->first];
+                out.insert(out.end(), c->second.begin(), c->second.end());
+            }
+        }
+
+        // stitch across the tile seams
+        for (LinesByContour::iterator c = lines.begin(); c != lines.end(); ++c)
+            chain(c->second);
+    }
+
+    if (progress && progress->isCanceled())
+        return 0L;
+
+    FeatureList features;
+    const SpatialReference* srs = getFeatureProfile()->getSRS();
+
+    for (LinesByContour::const_iterator c = lines.begin(); c != lines.end(); ++c)
+    {
+        double elevation = base + (double)c->first * interval;
+
+        for (std::vector<Line>::const_iterator line = c->second.begin(); line != c->second.end(); ++line)
+        {
+            if (line->size() < 2)
+                continue;
+
+            LineString* geom = new LineString(line->size());
+            for (Line::const_iterator p = line->begin(); p != line->end(); ++p)
+                geom->push_back(*p);
+
+            Feature* feature = new Feature(geom, srs);
+            feature->set(options().attribute().get(), elevation);
+            features.push_back(feature);
+        }
+    }
+
+    applyFilters(features, extent);
+
+    return new FeatureListCursor(features);
+}
@@ -38,6 +38,10 @@ ContourMapLayer::Options::getMetadata()
         { "name" : "ContourMap",
           "properties" : [
             { "name": "grayscale", "description" : "", "type" : "bool", "default" : "" },
+            { "name": "fill", "description" : "Whether to color the terrain by elevation", "type" : "bool", "default" : "true" },
+            { "name": "line_interval", "description" : "Elevation between isolines in meters; 0 for none", "type" : "float", "default" : "0" },
+            { "name": "line_color", "description" : "Color of the isolines", "type" : "color", "default" : "#0000007f" },
+            { "name": "line_width", "description" : "Width of the isolines in pixels", "type" : "float", "default" : "1" },
           ]
         }
     ));
@@ -48,6 +52,10 @@ ContourMapLayer::Options::getConfig() const
 {
     Config conf = VisibleLayer::Options::getConfig();
     conf.set("grayscale", _grayscale);
+    conf.set("fill", _fill);
+    conf.set("line_interval", _lineInterval);
+    conf.set("line_color", _lineColor);
+    conf.set("line_width", _lineWidth);
     return conf;
 }
 
@@ -55,7 +63,15 @@ void
 ContourMapLayer::Options::fromConfig(const Config& conf)
 {
     _grayscale.init(false);
+    _fill.init(true);
+    _lineInterval.init(0.0f);
+    _lineColor.init(Color(0.0f, 0.0f, 0.0f, 0.5f));
+    _lineWidth.init(1.0f);
     conf.get("grayscale", _grayscale);
+    conf.get("fill", _fill);
+    conf.get("line_interval", _lineInterval);
+    conf.get("line_color", _lineColor);
+    conf.get("line_width", _lineWidth);
 }
 
 //........................................................................
@@ -64,6 +80,78 @@ REGISTER_OSGEARTH_LAYER(contourmap, ContourMapLayer);
 
 OE_LAYER_PROPERTY_IMPL(ContourMapLayer, bool, Grayscale, grayscale);
 
+void
+ContourMapLayer::setFill(const bool& value)
+{
+    options().fill() = value;
+    updateDisplayMode();
+}
+
+const bool&
+ContourMapLayer::getFill() const
+{
+    return options().fill().get();
+}
+
+void
+ContourMapLayer::setLineInterval(const float& value)
+{
+    options().lineInterval() = value;
+    updateDisplayMode();
+}
+
+const float&
+ContourMapLayer::getLineInterval() const
+{
+    return options().lineInterval().get();
+}
+
+void
+ContourMapLayer::setLineColor(const Color& value)
+{
+    options().lineColor() = value;
+    updateDisplayMode();
+}
+
+const Color&
+ContourMapLayer::getLineColor() const
+{
+    return options().lineColor().get();
+}
+
+void
+ContourMapLayer::setLineWidth(const float& value)
+{
+    options().lineWidth() = value;
+    updateDisplayMode();
+}
+
+const float&
+ContourMapLayer::getLineWidth() const
+{
+    return options().lineWidth().get();
+}
+
+void
+ContourMapLayer::updateDisplayMode()
+{
+    osg::StateSet* stateset = getOrCreateStateSet();
+
+    if (getFill())
+        stateset->setDefine("OE_CONTOUR_FILL");
+    else
+        stateset->removeDefine("OE_CONTOUR_FILL");
+
+    if (getLineInterval() > 0.0f)
+        stateset->setDefine("OE_CONTOUR_LINES");
+    else
+        stateset->removeDefine("OE_CONTOUR_LINES");
+
+    _lineInterval->set(getLineInterval());
+    _lineColor->set(getLineColor());
+    _lineWidth->set(getLineWidth() * Registry::instance()->getDevicePixelRatio());
+}
+
 void
 ContourMapLayer::setTransferFunction(osg::TransferFunction1D* xfer)
 {
@@ -98,6 +186,18 @@ ContourMapLayer::init()
 #endif
     stateset->addUniform(_xferSampler.get());
 
+    // isolines:
+    _lineInterval = new osg::Uniform(osg::Uniform::FLOAT, "oe_contour_lineInterval");
+    stateset->addUniform(_lineInterval.get());
+
+    _lineColor = new osg::Uniform(osg::Uniform::FLOAT_VEC4, "oe_contour_lineColor");
+    stateset->addUniform(_lineColor.get());
+
+    _lineWidth = new osg::Uniform(osg::Uniform::FLOAT, "oe_contour_lineWidth");
+    stateset->addUniform(_lineWidth.get());
+
+    updateDisplayMode();
+
     // Create a 1D texture from the transfer function's image.
     _xferTexture = new TextureType();
     _xferTexture->setResizeNonPowerOfTwoHint(false);
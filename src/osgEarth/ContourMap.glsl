@@ -4,19 +4,36 @@ $GLSL_DEFAULT_PRECISION_FLOAT
 #pragma vp_entryPoint oe_contour_fragment
 #pragma vp_location   fragment_coloring
 #pragma vp_order 0.5
+#pragma import_defines(OE_CONTOUR_FILL)
+#pragma import_defines(OE_CONTOUR_LINES)
 
 in vec4 oe_layer_tilec;
 uniform sampler1D oe_contour_xfer;
 uniform float oe_contour_min;
 uniform float oe_contour_range;
 
+uniform float oe_contour_lineInterval;
+uniform vec4 oe_contour_lineColor;
+uniform float oe_contour_lineWidth;
+
 float oe_terrain_getElevation(in vec2 uv);
 
 void oe_contour_fragment( inout vec4 color )
 {
     float height = oe_terrain_getElevation(oe_layer_tilec.st);
+
+#ifdef OE_CONTOUR_FILL
     float height_normalized = (height-oe_contour_min)/oe_contour_range;
     float lookup = clamp( height_normalized, 0.0, 1.0 );
     vec4 texel = texture( oe_contour_xfer, lookup );
     color.rgb = mix(color.rgb, texel.rgb, texel.a);
+#endif
+
+#ifdef OE_CONTOUR_LINES
+    // distance to the nearest isoline, in pixels
+    float f = height / oe_contour_lineInterval;
+    float d = abs(fract(f + 0.5) - 0.5) / max(fwidth(f), 1e-6);
+    float line = 1.0 - clamp(d - 0.5*oe_contour_lineWidth + 0.5, 0.0, 1.0);
+    color.rgb = mix(color.rgb, oe_contour_lineColor.rgb, line * oe_contour_lineColor.a);
+#endif
 }
@@ -0,0 +1,365 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2020 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#include <osgEarth/Counters>
+#include <osgEarth/Threading>
+#include <osg/Math>
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <map>
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+namespace
+{
+    // bucket b holds values in [2^(b-BUCKET_SHIFT-1), 2^(b-BUCKET_SHIFT));
+    // the first and last buckets also take everything below and above.
+    const int BUCKET_SHIFT = 10;
+
+    struct HistogramSlot
+    {
+        std::atomic<std::uint64_t> _buckets[Counters::NUM_BUCKETS];
+        std::atomic<double> _sum;
+        std::atomic<double> _max;
+    };
+
+    // One thread's counts. Only the owning thread writes them, so an
+    // update is a relaxed load and store rather than a locked add.
+    struct ThreadBlock
+    {
+        ThreadBlock()
+        {
+            for (unsigned i = 0; i < Counters::MAX_COUNTERS; ++i)
+                _counts[i].store(0, std::memory_order_relaxed);
+            for (unsigned h = 0; h < Counters::MAX_HISTOGRAMS; ++h)
+            {
+                for (unsigned b = 0; b < Counters::NUM_BUCKETS; ++b)
+                    _histograms[h]._buckets[b].store(0u, std::memory_order_relaxed);
+                _histograms[h]._sum.store(0.0, std::memory_order_relaxed);
+                _histograms[h]._max.store(0.0, std::memory_order_relaxed);
+            }
+        }
+
+        std::atomic<std::int64_t> _counts[Counters::MAX_COUNTERS];
+        HistogramSlot _histograms[Counters::MAX_HISTOGRAMS];
+    };
+
+    struct HistogramTotals
+    {
+        HistogramTotals() : _sum(0.0), _max(0.0) {
+            std::fill(_buckets, _buckets + Counters::NUM_BUCKETS, 0u);
+        }
+        std::uint64_t _buckets[Counters::NUM_BUCKETS];
+        double _sum;
+        double _max;
+
+        std::uint64_t count() const {
+            std::uint64_t n = 0u;
+            for (unsigned b = 0; b < Counters::NUM_BUCKETS; ++b) n += _buckets[b];
+            return n;
+        }
+    };
+
+    struct Data
+    {
+        Data() : _mutex("Counters(OE)"), _lastFrame(~0u)
+        {
+            std::fill(_retiredCounts, _retiredCounts + Counters::MAX_COUNTERS, 0);
+            std::fill(_prevCounts, _prevCounts + Counters::MAX_COUNTERS, 0);
+            std::fill(_prevHistogramCounts, _prevHistogramCounts + Counters::MAX_HISTOGRAMS, 0u);
+        }
+
+        Threading::Mutex _mutex;
+
+        std::vector<std::string> _counterNames;
+        std::map<std::string, unsigned> _counterIDs;
+        std::vector<std::string> _histogramNames;
+        std::map<std::string, unsigned> _histogramIDs;
+
+        // a deque, so gauges never move once handed out
+        std::deque<std::pair<std::string, std::atomic<std::int64_t> > > _gauges;
+        std::map<std::string, std::atomic<std::int64_t>*> _gaugeIDs;
+
+        std::vector<ThreadBlock*> _blocks;
+
+        // counts from threads that have exited
+        std::int64_t _retiredCounts[Counters::MAX_COUNTERS];
+        HistogramTotals _retiredHistograms[Counters::MAX_HISTOGRAMS];
+
+        // totals as of the previous frame, for the per-frame deltas
+        std::int64_t _prevCounts[Counters::MAX_COUNTERS];
+        std::uint64_t _prevHistogramCounts[Counters::MAX_HISTOGRAMS];
+
+        unsigned _lastFrame;
+        Counters::Stats _stats;
+    };
+
+    // Never destroyed, so threads that exit during shutdown can still retire.
+    Data& data()
+    {
+        static Data* s_data = new Data();
+        return *s_data;
+    }
+
+    std::atomic<bool> s_enabled(true);
+
+    void accumulate(const HistogramSlot& slot, HistogramTotals& out)
+    {
+        for (unsigned b = 0; b < Counters::NUM_BUCKETS; ++b)
+            out._buckets[b] += slot._buckets[b].load(std::memory_order_relaxed);
+        out._sum += slot._sum.load(std::memory_order_relaxed);
+        out._max = std::max(out._max, slot._max.load(std::memory_order_relaxed));
+    }
+
+    // Folds an exiting thread's counts into the retired totals.
+    struct LocalBlock
+    {
+        LocalBlock() : _block(0L) { }
+
+        ~LocalBlock()
+        {
+            if (_block)
+            {
+                Data& d = data();
+                Threading::ScopedMutexLock lock(d._mutex);
+                for (unsigned i = 0; i < Counters::MAX_COUNTERS; ++i)
+                    d._retiredCounts[i] += _block->_counts[i].load(std::memory_order_relaxed);
+                for (unsigned h = 0; h < Counters::MAX_HISTOGRAMS; ++h)
+                    accumulate(_block->_histograms[h], d._retiredHistograms[h]);
+                d._blocks.erase(std::remove(d._blocks.begin(), d._blocks.end(), _block), d._blocks.end());
+                delete _block;
+            }
+        }
+
+        ThreadBlock* get()
+        {
+            if (!_block)
+            {
+                _block = new ThreadBlock();
+                Data& d = data();
+                Threading::ScopedMutexLock lock(d._mutex);
+                d._blocks.push_back(_block);
+            }
+            return _block;
+        }
+
+        ThreadBlock* _block;
+    };
+
+    thread_local LocalBlock t_local;
+
+    unsigned findOrCreate(
+        const std::string& name,
+        std::vector<std::string>& names,
+        std::map<std::string, unsigned>& ids,
+        unsigned limit)
+    {
+        std::map<std::string, unsigned>::const_iterator i = ids.find(name);
+        if (i != ids.end())
+            return i->second;
+        if (names.size() >= limit)
+            return ~0u;
+        unsigned id = names.size();
+        names.push_back(name);
+        ids[name] = id;
+        return id;
+    }
+
+    double percentile(const HistogramTotals& h, std::uint64_t count, double p)
+    {
+        std::uint64_t target = (std::uint64_t)ceil(p * (double)count);
+        std::uint64_t sum = 0u;
+        for (unsigned b = 0; b < Counters::NUM_BUCKETS; ++b)
+        {
+            sum += h._buckets[b];
+            if (sum >= target && sum > 0u)
+                return std::min(ldexp(1.0, (int)b - BUCKET_SHIFT), h._max);
+        }
+        return h._max;
+    }
+}
+
+//........................................................................
+
+Counter::Counter(const std::string& name)
+{
+    Data& d = data();
+    Threading::ScopedMutexLock lock(d._mutex);
+    _id = findOrCreate(name, d._counterNames, d._counterIDs, Counters::MAX_COUNTERS);
+}
+
+void
+Counter::add(std::int64_t value) const
+{
+    if (_id < Counters::MAX_COUNTERS && s_enabled.load(std::memory_order_relaxed))
+    {
+        std::atomic<std::int64_t>& slot = t_local.get()->_counts[_id];
+        slot.store(slot.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+}
+
+Gauge::Gauge(const std::string& name)
+{
+    Data& d = data();
+    Threading::ScopedMutexLock lock(d._mutex);
+    std::map<std::string, std::atomic<std::int64_t>*>::const_iterator i = d._gaugeIDs.find(name);
+    if (i != d._gaugeIDs.end())
+    {
+        _value = i->second;
+    }
+    else
+    {
+        d._gauges.emplace_back();
+        d._gauges.back().first = name;
+        d._gauges.back().second.store(0, std::memory_order_relaxed);
+        _value = &d._gauges.back().second;
+        d._gaugeIDs[name] = _value;
+    }
+}
+
+Histogram::Histogram(const std::string& name)
+{
+    Data& d = data();
+    Threading::ScopedMutexLock lock(d._mutex);
+    _id = findOrCreate(name, d._histogramNames, d._histogramIDs, Counters::MAX_HISTOGRAMS);
+}
+
+void
+Histogram::record(double value) const
+{
+    if (_id < Counters::MAX_HISTOGRAMS && s_enabled.load(std::memory_order_relaxed))
+    {
+        int e = 0;
+        frexp(std::max(value, 0.0), &e);
+        unsigned b = (unsigned)osg::clampBetween(e + BUCKET_SHIFT, 0, (int)Counters::NUM_BUCKETS - 1);
+
+        HistogramSlot& slot = t_local.get()->_histograms[_id];
+        slot._buckets[b].store(slot._buckets[b].load(std::memory_order_relaxed) + 1u, std::memory_order_relaxed);
+        slot._sum.store(slot._sum.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+        if (value > slot._max.load(std::memory_order_relaxed))
+            slot._max.store(value, std::memory_order_relaxed);
+    }
+}
+
+//........................................................................
+
+void
+Counters::frame(unsigned frameNumber)
+{
+    Data& d = data();
+    Threading::ScopedMutexLock lock(d._mutex);
+
+    if (frameNumber == d._lastFrame)
+        return;
+    d._lastFrame = frameNumber;
+
+    Stats& stats = d._stats;
+    stats._frameNumber = frameNumber;
+
+    stats._counters.resize(d._counterNames.size());
+    for (unsigned i = 0; i < d._counterNames.size(); ++i)
+    {
+        std::int64_t total = d._retiredCounts[i];
+        for (unsigned t = 0; t < d._blocks.size(); ++t)
+            total += d._blocks[t]->_counts[i].load(std::memory_order_relaxed);
+
+        CounterStats& c = stats._counters[i];
+        c._name = d._counterNames[i];
+        c._total = total;
+        c._frame = total - d._prevCounts[i];
+        d._prevCounts[i] = total;
+    }
+
+    stats._gauges.resize(d._gauges.size());
+    for (unsigned i = 0; i < d._gauges.size(); ++i)
+    {
+        stats._gauges[i]._name = d._gauges[i].first;
+        stats._gauges[i]._value = d._gauges[i].second.load(std::memory_order_relaxed);
+    }
+
+    stats._histograms.resize(d._histogramNames.size());
+    for (unsigned i = 0; i < d._histogramNames.size(); ++i)
+    {
+        HistogramTotals totals = d._retiredHistograms[i];
+        for (unsigned t = 0; t < d._blocks.size(); ++t)
+            accumulate(d._blocks[t]->_histograms[i], totals);
+
+        HistogramStats& h = stats._histograms[i];
+        h._name = d._histogramNames[i];
+        h._count = totals.count();
+        h._frameCount = h._count - d._prevHistogramCounts[i];
+        h._mean = h._count > 0u ? totals._sum / (double)h._count : 0.0;
+        h._max = totals._max;
+        h._p50 = percentile(totals, h._count, 0.50);
+        h._p90 = percentile(totals, h._count, 0.90);
+        h._p99 = percentile(totals, h._count, 0.99);
+        d._prevHistogramCounts[i] = h._count;
+    }
+}
+
+void
+Counters::getStats(Stats& out)
+{
+    Data& d = data();
+    {
+        Threading::ScopedMutexLock lock(d._mutex);
+        out = d._stats;
+    }
+
+    std::sort(out._counters.begin(), out._counters.end(),
+        [](const CounterStats& a, const CounterStats& b) { return a._name < b._name; });
+    std::sort(out._gauges.begin(), out._gauges.end(),
+        [](const GaugeStats& a, const GaugeStats& b) { return a._name < b._name; });
+    std::sort(out._histograms.begin(), out._histograms.end(),
+        [](const HistogramStats& a, const HistogramStats& b) { return a._name < b._name; });
+}
+
+void
+Counters::getGauges(std::vector<GaugeStats>& out)
+{
+    Data& d = data();
+    {
+        Threading::ScopedMutexLock lock(d._mutex);
+        out.resize(d._gauges.size());
+        for (unsigned i = 0; i < d._gauges.size(); ++i)
+        {
+            out[i]._name = d._gauges[i].first;
+            out[i]._value = d._gauges[i].second.load(std::memory_order_relaxed);
+        }
+    }
+
+    std::sort(out.begin(), out.end(),
+        [](const GaugeStats& a, const GaugeStats& b) { return a._name < b._name; });
+}
+
+void
+Counters::setEnabled(bool value)
+{
+    s_enabled = value;
+}
+
+bool
+Counters::isEnabled()
+{
+    return s_enabled;
+}
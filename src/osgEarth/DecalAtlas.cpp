@@ -0,0 +1,215 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+ * Copyright 2020 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarth/DecalAtlas>
+#include <osgEarth/HeightFieldUtils>
+#include <osgEarth/Layer>
+#include <cstring>
+
+using namespace osgEarth;
+
+#define LC "[DecalAtlas] "
+
+DecalAtlas::DecalAtlas(unsigned size, unsigned capacity) :
+    _size(osg::maximum(size, 2u)),
+    _capacity(osg::maximum(capacity, 1u)),
+    _serial(0u),
+    _revision(0u),
+    _mutex("DecalAtlas(OE)")
+{
+    //nop
+}
+
+GeoExtent
+DecalAtlas::toDecalSRS(const GeoExtent& extent, const Decal& decal) const
+{
+    return extent.transform(decal._extent.getSRS());
+}
+
+unsigned
+DecalAtlas::add(const Layer* owner, const std::string& id, const GeoHeightField& heightField)
+{
+    if (!heightField.valid() || !heightField.getExtent().isValid())
+        return 0u;
+
+    Threading::ScopedMutexLock lock(_mutex);
+
+    // The texture is allocated in full up front, so the layers can be
+    // rewritten in place later on without reallocating it on the GPU.
+    if (!_texture.valid())
+    {
+        _texture = new osg::Texture2DArray();
+        _texture->setTextureSize(_size, _size, _capacity);
+        _texture->setInternalFormat(GL_R32F);
+        _texture->setSourceFormat(GL_RED);
+        _texture->setSourceType(GL_FLOAT);
+        _texture->setFilter(osg::Texture::MIN_FILTER, osg::Texture::LINEAR);
+        _texture->setFilter(osg::Texture::MAG_FILTER, osg::Texture::LINEAR);
+        _texture->setWrap(osg::Texture::WRAP_S, osg::Texture::CLAMP_TO_EDGE);
+        _texture->setWrap(osg::Texture::WRAP_T, osg::Texture::CLAMP_TO_EDGE);
+        _texture->setResizeNonPowerOfTwoHint(false);
+        _texture->setUnRefImageDataAfterApply(false);
+
+        for (unsigned i = 0; i < _capacity; ++i)
+        {
+            osg::Image* image = new osg::Image();
+            image->allocateImage(_size, _size, 1, GL_RED, GL_FLOAT);
+            image->setInternalTextureFormat(GL_R32F);
+            ::memset(image->data(), 0, image->getTotalSizeInBytes());
+            _texture->setImage(i, image);
+        }
+
+        for (unsigned i = _capacity; i > 0; --i)
+            _freeLayers.push_back(i - 1);
+    }
+
+    if (_freeLayers.empty())
+    {
+        OE_DEBUG << LC << "Atlas is full; decal \"" << id << "\" will only appear in reloaded tiles" << std::endl;
+        return 0u;
+    }
+
+    Decal decal;
+    decal._owner = owner;
+    decal._id = id;
+    decal._extent = heightField.getExtent();
+    decal._serial = _serial + 1u;
+    decal._layer = _freeLayers.back();
+    _freeLayers.pop_back();
+
+    // Resample the heights into the layer. No-data posts offset nothing.
+    const osg::HeightField* hf = heightField.getHeightField();
+    osg::Image* image = _texture->getImage(decal._layer);
+    float* ptr = reinterpret_cast<float*>(image->data());
+    for (unsigned t = 0; t < _size; ++t)
+    {
+        double v = (double)t / (double)(_size - 1);
+        for (unsigned s = 0; s < _size; ++s)
+        {
+            double u = (double)s / (double)(_size - 1);
+            float h = HeightFieldUtils::getHeightAtNormalizedLocation(hf, u, v);
+            *ptr++ = h != NO_DATA_VALUE ? h : 0.0f;
+        }
+    }
+    image->dirty();
+
+    _decals.push_back(decal);
+    _serial = decal._serial;
+    ++_revision;
+
+    return decal._serial;
+}
+
+void
+DecalAtlas::remove(const Layer* owner, const std::string& id)
+{
+    Threading::ScopedMutexLock lock(_mutex);
+
+    for (std::list<Decal>::iterator i = _decals.begin(); i != _decals.end(); ++i)
+    {
+        if (i->_owner == owner && i->_id == id)
+        {
+            _freeLayers.push_back(i->_layer);
+            _decals.erase(i);
+            ++_revision;
+            return;
+        }
+    }
+}
+
+void
+DecalAtlas::clear(const Layer* owner)
+{
+    Threading::ScopedMutexLock lock(_mutex);
+
+    unsigned count = _decals.size();
+    for (std::list<Decal>::iterator i = _decals.begin(); i != _decals.end(); )
+    {
+        if (i->_owner == owner)
+        {
+            _freeLayers.push_back(i->_layer);
+            i = _decals.erase(i);
+        }
+        else ++i;
+    }
+
+    if (_decals.size() != count)
+        ++_revision;
+}
+
+DecalAtlas::TileDecals*
+DecalAtlas::getTileDecals(const GeoExtent& extent, unsigned serial) const
+{
+    osg::ref_ptr<TileDecals> out;
+
+    Threading::ScopedMutexLock lock(_mutex);
+
+    // Decals are in serial order, so the oldest make the cut when
+    // there are too many.
+    for (std::list<Decal>::const_iterator i = _decals.begin(); i != _decals.end(); ++i)
+    {
+        const Decal& decal = *i;
+        if (decal._serial <= serial)
+            continue;
+
+        GeoExtent tileExtent = toDecalSRS(extent, decal);
+        if (!tileExtent.isValid() || !decal._extent.intersectionSameSRS(tileExtent).isValid())
+            continue;
+
+        if (!out.valid())
+            out = new TileDecals();
+
+        if (out->_num == MAX_DECALS_PER_TILE)
+        {
+            out->_overflow = decal._owner;
+            break;
+        }
+
+        out->_rects[out->_num].set(
+            (decal._extent.xMin() - tileExtent.xMin()) / tileExtent.width(),
+            (decal._extent.yMin() - tileExtent.yMin()) / tileExtent.height(),
+            (decal._extent.xMax() - tileExtent.xMin()) / tileExtent.width(),
+            (decal._extent.yMax() - tileExtent.yMin()) / tileExtent.height());
+
+        out->_layers[out->_num] = (float)decal._layer;
+        ++out->_num;
+    }
+
+    return out.release();
+}
+
+bool
+DecalAtlas::intersects(const GeoExtent& extent, unsigned from, unsigned to) const
+{
+    if (from >= to)
+        return false;
+
+    Threading::ScopedMutexLock lock(_mutex);
+
+    for (std::list<Decal>::const_iterator i = _decals.begin(); i != _decals.end(); ++i)
+    {
+        const Decal& decal = *i;
+        if (decal._serial <= from || decal._serial > to)
+            continue;
+
+        GeoExtent tileExtent = toDecalSRS(extent, decal);
+        if (tileExtent.isValid() && decal._extent.intersectionSameSRS(tileExtent).isValid())
+            return true;
+    }
+    return false;
+}
@@ -22,6 +22,7 @@
 #include <osgEarth/VirtualProgram>
 #include <osgEarth/HeightFieldUtils>
 #include <osgEarth/ImageToHeightFieldConverter>
+#include <osgEarth/TerrainResources>
 #include <osg/MatrixTransform>
 #include <osg/BlendFunc>
 #include <osg/BlendEquation>
@@ -216,17 +217,21 @@ Config
 DecalElevationLayer::Options::getConfig() const
 {
     Config conf = ElevationLayer::Options::getConfig();
+    conf.set("gpu", _gpu);
     return conf;
 }
 
 void
 DecalElevationLayer::Options::fromConfig(const Config& conf)
 {
-    //nop
+    _gpu.init(false);
+    conf.get("gpu", _gpu);
 }
 
 //........................................................................
 
+OE_LAYER_PROPERTY_IMPL(DecalElevationLayer, bool, GPU, gpu);
+
 void
 DecalElevationLayer::init()
 {
@@ -242,6 +247,30 @@ DecalElevationLayer::init()
     layerHints().cachePolicy() = CachePolicy::NO_CACHE;
 }
 
+void
+DecalElevationLayer::setTerrainResources(TerrainResources* res)
+{
+    ElevationLayer::setTerrainResources(res);
+
+    if (res)
+    {
+        _atlas = res->getDecalAtlas();
+    }
+}
+
+void
+DecalElevationLayer::removedFromMap(const Map* map)
+{
+    ElevationLayer::removedFromMap(map);
+
+    osg::ref_ptr<DecalAtlas> atlas;
+    if (_atlas.lock(atlas))
+    {
+        atlas->clear(this);
+    }
+    _atlas = NULL;
+}
+
 GeoHeightField
 DecalElevationLayer::createHeightFieldImplementation(const TileKey& key, ProgressCallback* progress) const
 {
@@ -371,6 +400,14 @@ DecalElevationLayer::addDecal(
     Decal& decal = _decalList.back();
     decal._heightfield = GeoHeightField(hf, extent);
 
+    // Let the terrain draw the decal until its tiles reload, instead
+    // of the application having to invalidate them.
+    osg::ref_ptr<DecalAtlas> atlas;
+    decal._gpu =
+        getGPU() == true &&
+        _atlas.lock(atlas) &&
+        atlas->add(this, id, decal._heightfield) > 0u;
+
     _decalIndex[id] = --_decalList.end();
 
     // data changed so up the revsion.
@@ -423,6 +460,14 @@ DecalElevationLayer::addDecal(
     Decal& decal = _decalList.back();
     decal._heightfield = GeoHeightField(hf, extent);
 
+    // Let the terrain draw the decal until its tiles reload, instead
+    // of the application having to invalidate them.
+    osg::ref_ptr<DecalAtlas> atlas;
+    decal._gpu =
+        getGPU() == true &&
+        _atlas.lock(atlas) &&
+        atlas->add(this, id, decal._heightfield) > 0u;
+
     _decalIndex[id] = --_decalList.end();
 
     // data changed so up the revsion.
@@ -438,6 +483,10 @@ DecalElevationLayer::removeDecal(const std::string& id)
     DecalIndex::iterator i = _decalIndex.find(id);
     if (i != _decalIndex.end())
     {
+        osg::ref_ptr<DecalAtlas> atlas;
+        if (i->second->_gpu && _atlas.lock(atlas))
+            atlas->remove(this, id);
+
         _decalList.erase(i->second);
         _decalIndex.erase(i);
 
@@ -462,11 +511,24 @@ void
 DecalElevationLayer::clearDecals()
 {
     Threading::ScopedMutexLock lock(layerMutex());
+
+    osg::ref_ptr<DecalAtlas> atlas;
+    if (_atlas.lock(atlas))
+        atlas->clear(this);
+
     _decalIndex.clear();
     _decalList.clear();
     bumpRevision();
 }
 
+bool
+DecalElevationLayer::isDecalOnGPU(const std::string& id) const
+{
+    Threading::ScopedMutexLock lock(layerMutex());
+    DecalIndex::const_iterator i = _decalIndex.find(id);
+    return i != _decalIndex.end() && i->second->_gpu;
+}
+
 //........................................................................
 
 
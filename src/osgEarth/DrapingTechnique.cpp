@@ -24,6 +24,7 @@
 #include <osgEarth/Registry>
 #include <osgEarth/Shaders>
 #include <osgEarth/Lighting>
+#include <osgEarth/GPUTimer>
 
 #include <osg/BlendFunc>
 #include <osg/Texture2D>
@@ -524,6 +525,8 @@ DrapingTechnique::setUpCamera(OverlayDecorator::TechRTTParams& params)
     //       while we are changing its children.
     params._rttCamera->addChild( params._group );
 
+    GPUTimer::install( params._rttCamera.get(), "draping" );
+
     // add to the terrain stateset, i.e. the stateset that the OverlayDecorator will
     // apply to the terrain before cull-traversing it. This will activate the projective
     // texturing on the terrain.
@@ -21,6 +21,8 @@
 #include <osgEarth/Map>
 #include <osgEarth/Progress>
 #include <osgEarth/Metrics>
+#include <osgEarth/Memory>
+#include <cfloat>
 
 using namespace osgEarth;
 
@@ -42,35 +44,50 @@ namespace
         p.x() = 0.5f*(p.x()+1.0f);
         p.y() = 0.5f*(p.y()+1.0f);
     }
+
+    const Util::Gauge s_elevationBytes = Util::Memory::getCPUGauge("elevation");
+
+    // Narrows [t0,t1] to the part of the segment p + t*d that lies
+    // within [lo,hi] on one axis. Returns false if nothing is left.
+    inline bool clipSlab(double p, double d, double lo, double hi, double& t0, double& t1)
+    {
+        if (d == 0.0)
+            return p >= lo && p <= hi;
+
+        double a = (lo - p) / d, b = (hi - p) / d;
+        if (a > b) std::swap(a, b);
+        t0 = osg::maximum(t0, a);
+        t1 = osg::minimum(t1, b);
+        return t0 <= t1;
+    }
 }
 
 ElevationTexture::ElevationTexture(const TileKey& key, const GeoHeightField& in_hf, float* resolutions) :
     _tilekey(key),
     _extent(in_hf.getExtent()),
-    _resolutions(resolutions)
+    _resolutions(resolutions),
+    _accountedBytes(0)
 {
     if (in_hf.valid())
     {
         _heightField = in_hf.getHeightField();
 
-        osg::Vec4 value;
-
         osg::Image* heights = new osg::Image();
         heights->allocateImage(_heightField->getNumColumns(), _heightField->getNumRows(), 1, GL_RED, GL_FLOAT);
         heights->setInternalTextureFormat(GL_R32F);
 
-        ImageUtils::PixelWriter write(heights);
-        // TODO: speed this up since we know the format
         for(unsigned row=0; row<_heightField->getNumRows(); ++row)
         {
+            float* ptr = (float*)heights->data(0, row);
             for(unsigned col=0; col<_heightField->getNumColumns(); ++col)
             {
-                value.r() = _heightField->getHeight(col, row);
-                write(value, col, row);
+                ptr[col] = _heightField->getHeight(col, row);
             }
         }
         setImage(heights);
 
+        buildPyramid();
+
         setDataVariance(osg::Object::STATIC);
         setInternalFormat(GL_R32F);
         setFilter(osg::Texture::MAG_FILTER, osg::Texture::LINEAR);
@@ -87,11 +104,21 @@ ElevationTexture::ElevationTexture(const TileKey& key, const GeoHeightField& in_
         _resolution = Distance(
             getExtent().height() / ((double)(getImage(0)->s()-1)),
             getExtent().getSRS()->getUnits());
+
+        // the heights, the heightfield they came from, the pyramid and the resolutions
+        _accountedBytes = heights->getTotalSizeInBytes() * 2;
+        for (const auto& level : _pyramid)
+            _accountedBytes += level.minmax.size() * sizeof(osg::Vec2f);
+        if (_resolutions)
+            _accountedBytes += heights->s() * heights->t() * sizeof(float);
+        s_elevationBytes.add(_accountedBytes);
     }
 }
 
 ElevationTexture::~ElevationTexture()
 {
+    s_elevationBytes.add(-_accountedBytes);
+
     if (_resolutions)
         delete [] _resolutions;
 }
@@ -115,6 +142,259 @@ ElevationTexture::getElevationUV(double u, double v) const
 }
 
 
+void
+ElevationTexture::buildPyramid()
+{
+    _pyramid.clear();
+
+    const osg::HeightField* hf = _heightField.get();
+    if (hf == NULL || hf->getNumColumns() < 2 || hf->getNumRows() < 2)
+        return;
+
+    // min > max marks an entry with no valid heights
+    const osg::Vec2f empty(FLT_MAX, -FLT_MAX);
+
+    MinMaxLevel base;
+    base.cols = hf->getNumColumns() - 1;
+    base.rows = hf->getNumRows() - 1;
+    base.minmax.assign(base.cols*base.rows, empty);
+
+    for(unsigned r=0; r<base.rows; ++r)
+    {
+        for(unsigned c=0; c<base.cols; ++c)
+        {
+            osg::Vec2f& mm = base.minmax[r*base.cols + c];
+            for(unsigned k=0; k<4; ++k)
+            {
+                float h = hf->getHeight(c + (k & 1), r + (k >> 1));
+                if (h != NO_DATA_VALUE)
+                {
+                    mm[0] = osg::minimum(mm[0], h);
+                    mm[1] = osg::maximum(mm[1], h);
+                }
+            }
+        }
+    }
+    _pyramid.push_back(base);
+
+    while(_pyramid.back().cols > 1 || _pyramid.back().rows > 1)
+    {
+        const MinMaxLevel& below = _pyramid.back();
+
+        MinMaxLevel level;
+        level.cols = (below.cols + 1) / 2;
+        level.rows = (below.rows + 1) / 2;
+        level.minmax.assign(level.cols*level.rows, empty);
+
+        for(unsigned r=0; r<level.rows; ++r)
+        {
+            for(unsigned c=0; c<level.cols; ++c)
+            {
+                osg::Vec2f& mm = level.minmax[r*level.cols + c];
+                for(unsigned k=0; k<4; ++k)
+                {
+                    unsigned cc = 2*c + (k & 1), rr = 2*r + (k >> 1);
+                    if (cc < below.cols && rr < below.rows)
+                    {
+                        const osg::Vec2f& child = below.at(cc, rr);
+                        mm[0] = osg::minimum(mm[0], child[0]);
+                        mm[1] = osg::maximum(mm[1], child[1]);
+                    }
+                }
+            }
+        }
+
+        _pyramid.push_back(level);
+    }
+}
+
+bool
+ElevationTexture::getElevationRange(float& out_min, float& out_max) const
+{
+    if (_pyramid.empty())
+        return false;
+
+    const osg::Vec2f& mm = _pyramid.back().at(0, 0);
+    if (mm[0] > mm[1])
+        return false;
+
+    out_min = mm[0], out_max = mm[1];
+    return true;
+}
+
+bool
+ElevationTexture::getElevationRangeUV(double u0, double v0, double u1, double v1, float& out_min, float& out_max) const
+{
+    if (_pyramid.empty())
+        return false;
+
+    if (u0 > u1) std::swap(u0, u1);
+    if (v0 > v1) std::swap(v0, v1);
+
+    // range of base cells under the rectangle:
+    const MinMaxLevel& base = _pyramid.front();
+    int c0 = osg::clampBetween((int)floor(u0*(double)base.cols), 0, (int)base.cols-1);
+    int c1 = osg::clampBetween((int)ceil(u1*(double)base.cols)-1, c0, (int)base.cols-1);
+    int r0 = osg::clampBetween((int)floor(v0*(double)base.rows), 0, (int)base.rows-1);
+    int r1 = osg::clampBetween((int)ceil(v1*(double)base.rows)-1, r0, (int)base.rows-1);
+
+    // climb until the rectangle spans at most 2x2 entries:
+    unsigned L = 0;
+    while(L+1 < _pyramid.size() && ((c1>>L)-(c0>>L) > 1 || (r1>>L)-(r0>>L) > 1))
+        ++L;
+
+    const MinMaxLevel& level = _pyramid[L];
+    osg::Vec2f range(FLT_MAX, -FLT_MAX);
+    for(int r = (r0>>L); r <= (r1>>L); ++r)
+    {
+        for(int c = (c0>>L); c <= (c1>>L); ++c)
+        {
+            const osg::Vec2f& mm = level.at(c, r);
+            range[0] = osg::minimum(range[0], mm[0]);
+            range[1] = osg::maximum(range[1], mm[1]);
+        }
+    }
+
+    if (range[0] > range[1])
+        return false;
+
+    out_min = range[0], out_max = range[1];
+    return true;
+}
+
+bool
+ElevationTexture::intersect(const osg::Vec3d& start, const osg::Vec3d& end, osg::Vec3d& out_hit) const
+{
+    if (_pyramid.empty() || !getExtent().isValid())
+        return false;
+
+    // work in grid coordinates, where cell (c,r) spans [c,c+1]x[r,r+1]:
+    const MinMaxLevel& base = _pyramid.front();
+    double sx = (double)base.cols / getExtent().width();
+    double sy = (double)base.rows / getExtent().height();
+
+    osg::Vec3d p(
+        (start.x() - getExtent().xMin())*sx,
+        (start.y() - getExtent().yMin())*sy,
+        start.z());
+
+    osg::Vec3d d(
+        (end.x() - start.x())*sx,
+        (end.y() - start.y())*sy,
+        end.z() - start.z());
+
+    double t = DBL_MAX;
+    intersect(_pyramid.size()-1, 0, 0, p, d, t);
+    if (t > 1.0)
+        return false;
+
+    out_hit = start + (end - start)*t;
+    return true;
+}
+
+void
+ElevationTexture::intersect(unsigned L, unsigned c, unsigned r, const osg::Vec3d& p, const osg::Vec3d& d, double& inout_t) const
+{
+    const MinMaxLevel& base = _pyramid.front();
+    unsigned span = 1u << L;
+
+    // part of the segment over this entry, ending at the best hit so far:
+    double t0 = 0.0, t1 = osg::minimum(1.0, inout_t);
+    if (!clipSlab(p.x(), d.x(), c*span, osg::minimum((c+1)*span, base.cols), t0, t1) ||
+        !clipSlab(p.y(), d.y(), r*span, osg::minimum((r+1)*span, base.rows), t0, t1))
+    {
+        return;
+    }
+
+    // skip entries with no data, or that the segment passes over
+    const osg::Vec2f& mm = _pyramid[L].at(c, r);
+    if (mm[0] > mm[1] || osg::minimum(p.z() + d.z()*t0, p.z() + d.z()*t1) > mm[1])
+        return;
+
+    if (L > 0)
+    {
+        // descend into the children in the order the segment reaches them
+        const MinMaxLevel& below = _pyramid[L-1];
+        unsigned half = span >> 1;
+        double childT[4];
+        unsigned childC[4], childR[4], n = 0;
+
+        for(unsigned k=0; k<4; ++k)
+        {
+            unsigned cc = 2*c + (k & 1), rr = 2*r + (k >> 1);
+            if (cc >= below.cols || rr >= below.rows)
+                continue;
+
+            double ct0 = t0, ct1 = t1;
+            if (clipSlab(p.x(), d.x(), cc*half, osg::minimum((cc+1)*half, base.cols), ct0, ct1) &&
+                clipSlab(p.y(), d.y(), rr*half, osg::minimum((rr+1)*half, base.rows), ct0, ct1))
+            {
+                unsigned i = n++;
+                for(; i > 0 && childT[i-1] > ct0; --i)
+                {
+                    childT[i] = childT[i-1], childC[i] = childC[i-1], childR[i] = childR[i-1];
+                }
+                childT[i] = ct0, childC[i] = cc, childR[i] = rr;
+            }
+        }
+
+        for(unsigned i=0; i<n && childT[i] < inout_t; ++i)
+        {
+            intersect(L-1, childC[i], childR[i], p, d, inout_t);
+        }
+        return;
+    }
+
+    // Base cell: the bilinear surface along the segment is quadratic in t,
+    // so solve for where the segment's height meets it.
+    const osg::HeightField* hf = _heightField.get();
+    float h00 = hf->getHeight(c, r), h10 = hf->getHeight(c+1, r);
+    float h01 = hf->getHeight(c, r+1), h11 = hf->getHeight(c+1, r+1);
+    if (h00 == NO_DATA_VALUE || h10 == NO_DATA_VALUE || h01 == NO_DATA_VALUE || h11 == NO_DATA_VALUE)
+        return;
+
+    double A = h10 - h00, B = h01 - h00, C = h00 - h10 - h01 + h11;
+    double a0 = p.x() - (double)c, a1 = d.x();
+    double b0 = p.y() - (double)r, b1 = d.y();
+
+    // f(t) = segment height - surface height = qa*t^2 + qb*t + qc
+    double qa = -(C*a1*b1);
+    double qb = d.z() - (A*a1 + B*b1 + C*(a0*b1 + a1*b0));
+    double qc = p.z() - (h00 + A*a0 + B*b0 + C*a0*b0);
+
+    double hit = DBL_MAX;
+
+    if (qa*t0*t0 + qb*t0 + qc <= 0.0)
+    {
+        hit = t0;
+    }
+    else if (fabs(qa) < 1e-12)
+    {
+        if (qb != 0.0)
+        {
+            double t = -qc / qb;
+            if (t >= t0 && t <= t1)
+                hit = t;
+        }
+    }
+    else
+    {
+        double disc = qb*qb - 4.0*qa*qc;
+        if (disc >= 0.0)
+        {
+            double sq = sqrt(disc);
+            double ta = (-qb - sq) / (2.0*qa), tb = (-qb + sq) / (2.0*qa);
+            if (ta > tb) std::swap(ta, tb);
+            if (ta >= t0 && ta <= t1) hit = ta;
+            else if (tb >= t0 && tb <= t1) hit = tb;
+        }
+    }
+
+    if (hit < inout_t)
+        inout_t = hit;
+}
+
+
 #undef LC
 #define LC "[NormalMapGenerator] "
 
@@ -196,8 +476,11 @@ NormalMapGenerator::createNormalMap(
         }
     }
 
+    // neighbors straddle tile edges, so use the batch sampler that
+    // resolves each tile only once:
     int sampleOK = map->getElevationPool()->sampleMapCoords(
         points,
+        NULL,
         workingSet,
         progress);
 
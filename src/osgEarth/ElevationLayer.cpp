@@ -22,7 +22,10 @@
 #include <osgEarth/MemCache>
 #include <osgEarth/Metrics>
 #include <osgEarth/NetworkMonitor>
+#include <osgEarth/Trace>
+#include <osgDB/Registry>
 #include <cinttypes>
+#include <sstream>
 
 using namespace osgEarth;
 using namespace OpenThreads;
@@ -42,6 +45,7 @@ ElevationLayer::Options::getConfig() const
     conf.set("nodata_policy", "default",     _noDataPolicy, NODATA_INTERPOLATE );
     conf.set("nodata_policy", "interpolate", _noDataPolicy, NODATA_INTERPOLATE );
     conf.set("nodata_policy", "msl",         _noDataPolicy, NODATA_MSL );
+    conf.set("cache_format", cacheFormat());
     return conf;
 }
 
@@ -57,6 +61,7 @@ ElevationLayer::Options::fromConfig( const Config& conf )
     conf.get("nodata_policy", "default",     _noDataPolicy, NODATA_INTERPOLATE );
     conf.get("nodata_policy", "interpolate", _noDataPolicy, NODATA_INTERPOLATE );
     conf.get("nodata_policy", "msl",         _noDataPolicy, NODATA_MSL );
+    conf.get("cache_format", cacheFormat());
 }
 
 //------------------------------------------------------------------------
@@ -85,6 +90,33 @@ namespace
 
         return true;
     }
+
+    // encode a heightfield with the plugin for a format extension,
+    // to store in the cache in place of the native record.
+    StringObject* encodeHeightField(const osg::HeightField* hf, const std::string& format)
+    {
+        osgDB::ReaderWriter* rw = osgDB::Registry::instance()->getReaderWriterForExtension(format);
+        if (!rw)
+            return NULL;
+
+        std::stringstream buf;
+        if (!rw->writeObject(*hf, buf, NULL).success())
+            return NULL;
+
+        return new StringObject(buf.str());
+    }
+
+    // decode a cache record written by encodeHeightField.
+    osg::HeightField* decodeHeightField(const StringObject* so, const std::string& format)
+    {
+        osgDB::ReaderWriter* rw = osgDB::Registry::instance()->getReaderWriterForExtension(format);
+        if (!rw)
+            return NULL;
+
+        std::istringstream buf(so->getString());
+        osgDB::ReaderWriter::ReadResult rr = rw->readObject(buf, NULL);
+        return rr.validObject() ? dynamic_cast<osg::HeightField*>(rr.takeObject()) : NULL;
+    }
 }
 
 //------------------------------------------------------------------------
@@ -159,6 +191,18 @@ ElevationLayer::getNoDataPolicy() const
     return options().noDataPolicy().get();
 }
 
+void
+ElevationLayer::setCacheFormat(const std::string& value)
+{
+    options().cacheFormat() = value;
+}
+
+const std::string&
+ElevationLayer::getCacheFormat() const
+{
+    return options().cacheFormat().get();
+}
+
 void
 ElevationLayer::normalizeNoDataValues(osg::HeightField* hf) const
 {
@@ -255,13 +299,19 @@ ElevationLayer::assembleHeightField(const TileKey& key,
         {
             const TileKey& layerKey = intersectingTiles[i];
 
-            if ( isKeyInLegalRange(layerKey) )
+            if ( isKeyInLegalRange(layerKey) && !isKnownMissing(layerKey) )
             {
                 GeoHeightField hf = createHeightFieldImplementation(layerKey, progress);
                 if (hf.valid())
                 {
                     heightFields.push_back( hf );
                 }
+                else if (
+                    hf.getStatus().code() == Status::ResourceUnavailable &&
+                    !(progress && progress->isCanceled()))
+                {
+                    setKnownMissing(layerKey);
+                }
             }
         }
 
@@ -352,19 +402,28 @@ ElevationLayer::createHeightField(const TileKey& key, ProgressCallback* progress
     OE_PROFILING_ZONE_TEXT(key.str());
 
     // If the layer is disabled, bail out
-    if (!isOpen())
+    if (!openOnDemand())
     {
         return GeoHeightField::INVALID;
     }
 
     NetworkMonitor::ScopedRequestLayer layerRequest(getName());
 
-    // prevents 2 threads from creating the same object at the same time
-    //_sentry.lock(key);
-
-    GeoHeightField result = createHeightFieldInKeyProfile(key, progress);
-
-    //_sentry.unlock(key);
+    // Concurrent requests for the same tile share a single fetch and decode.
+    // Height fields are not modified by their consumers, so everyone gets
+    // the same one (just like the L2 cache).
+    std::string flightKey = Stringify()
+        << getRevision() << "/" << key.str() << "/" << key.getProfile()->getHorizSignature();
+
+    GeoHeightField result = _inFlight.run(
+        flightKey,
+        [&](bool& share) {
+            GeoHeightField hf = createHeightFieldInKeyProfile(key, progress);
+            // a canceled result says nothing about the other requests
+            share = !(progress && progress->isCanceled());
+            return hf;
+        },
+        progress);
 
     return result;
 }
@@ -428,11 +487,24 @@ ElevationLayer::createHeightFieldInKeyProfile(const TileKey& key, ProgressCallba
 
         if ( cacheBin && policy.isCacheReadable() )
         {
+            Trace::Scope trace("cache.read", "layer");
+            if (trace.active())
+                trace.setDetail(getName() + " " + key.str());
+
             ReadResult r = cacheBin->readObject(cacheKey, 0L);
             if ( r.succeeded() )
             {
                 bool expired = policy.isExpired(r.lastModifiedTime());
                 cachedHF = r.get<osg::HeightField>();
+
+                // packed record; the metadata names the format that wrote it
+                if (!cachedHF.valid() && r.get<StringObject>())
+                {
+                    std::string format = r.metadata().value("format");
+                    if (!format.empty())
+                        cachedHF = decodeHeightField(r.get<StringObject>(), format);
+                }
+
                 if ( cachedHF && validateHeightField(cachedHF.get()) )
                 {
                     if (!expired)
@@ -442,6 +514,8 @@ ElevationLayer::createHeightFieldInKeyProfile(const TileKey& key, ProgressCallba
                     }
                 }
             }
+            NetworkMonitor::recordCacheRead(getName(), fromCache);
+            (fromCache ? _cacheHits : _cacheMisses).add();
         }
 
         // if we're cache-only, but didn't get data from the cache, fail silently.
@@ -461,11 +535,30 @@ ElevationLayer::createHeightFieldInKeyProfile(const TileKey& key, ProgressCallba
 
             if (key.getProfile()->isHorizEquivalentTo(getProfile()))
             {
-                result = createHeightFieldImplementation(key, progress);
+                // Skip the source entirely for tiles it recently told us it doesn't have.
+                if (!isKnownMissing(key))
+                {
+                    Trace::Scope trace("elevation.create", "layer");
+                    if (trace.active())
+                        trace.setDetail(getName() + " " + key.str());
+
+                    result = createHeightFieldImplementation(key, progress);
+
+                    if (!result.valid() &&
+                        result.getStatus().code() == Status::ResourceUnavailable &&
+                        !(progress && progress->isCanceled()))
+                    {
+                        setKnownMissing(key);
+                    }
+                }
             }
             else
             {
                 // If the profiles are different, use a compositing method to assemble the tile.
+                Trace::Scope trace("elevation.assemble", "layer");
+                if (trace.active())
+                    trace.setDetail(getName() + " " + key.str());
+
                 osg::ref_ptr<osg::HeightField> hf;
                 assembleHeightField(key, hf, progress);
                 result = GeoHeightField(hf.get(), key.getExtent());
@@ -497,7 +590,7 @@ ElevationLayer::createHeightFieldInKeyProfile(const TileKey& key, ProgressCallba
                 VerticalDatum::transform(
                     getProfile()->getSRS()->getVerticalDatum(),    // from
                     key.getExtent().getSRS()->getVerticalDatum(),  // to
-                    key.getExtent(),
+                    key,
                     hf.get() );
             }
 
@@ -521,7 +614,23 @@ ElevationLayer::createHeightFieldInKeyProfile(const TileKey& key, ProgressCallba
                  policy.isCacheWriteable() )
             {
                 OE_PROFILING_ZONE_NAMED("cache write");
-                cacheBin->write(cacheKey, hf.get(), 0L);
+
+                osg::ref_ptr<StringObject> packed;
+                if (!options().cacheFormat()->empty())
+                {
+                    packed = encodeHeightField(hf.get(), options().cacheFormat().get());
+                }
+
+                if (packed.valid())
+                {
+                    Config meta;
+                    meta.set("format", options().cacheFormat().get());
+                    cacheBin->write(cacheKey, packed.get(), meta, 0L);
+                }
+                else
+                {
+                    cacheBin->write(cacheKey, hf.get(), 0L);
+                }
             }
 
             // If we have an expired heightfield from the cache and were not able to create
@@ -646,6 +755,112 @@ namespace
     };
 
     typedef std::vector<LayerData> LayerDataVector;
+
+    // Samples a GeoHeightField at the posts of a grid in the heightfield's
+    // own SRS. The results are identical to GeoHeightField::getElevation,
+    // but the extent test and the pixel coordinate are computed once per
+    // column and once per row instead of once per post.
+    struct RowSampler
+    {
+        RowSampler() : _hf(0L) { }
+
+        RowSampler(const GeoHeightField& ghf, double xmin, double dx, unsigned numColumns, RasterInterpolation interp) :
+            _hf(ghf.getHeightField()),
+            _extent(ghf.getExtent()),
+            _interp(interp),
+            _insideX(numColumns),
+            _px(numColumns),
+            _colMin(numColumns),
+            _colMax(numColumns)
+        {
+            // same intervals and clamping as getElevation/getHeightAtLocation
+            _xInterval = _extent.width() / (double)(_hf->getNumColumns()-1);
+            _yInterval = _extent.height() / (double)(_hf->getNumRows()-1);
+
+            // GeoExtent::contains tests x and y independently, so test each
+            // column (and later each row) against the extent's centroid.
+            _extent.getCentroid(_centerX, _centerY);
+            int lastCol = (int)(_hf->getNumColumns() - 1);
+
+            for (unsigned c = 0; c < numColumns; ++c)
+            {
+                double x = xmin + (dx * (double)c);
+                _insideX[c] = _extent.contains(x, _centerY) ? 1 : 0;
+                _px[c] = osg::clampBetween((x - _extent.xMin()) / _xInterval, 0.0, (double)lastCol);
+                _colMin[c] = osg::maximum((int)floor(_px[c]), 0);
+                _colMax[c] = osg::maximum(osg::minimum((int)ceil(_px[c]), lastCol), 0);
+                if (_colMin[c] > _colMax[c]) _colMin[c] = _colMax[c];
+            }
+        }
+
+        //! Prepares to sample the posts at y; false if the row is outside the extent
+        bool setRow(double y)
+        {
+            if (!_extent.contains(_centerX, y))
+                return false;
+
+            int lastRow = (int)(_hf->getNumRows() - 1);
+            _py = osg::clampBetween((y - _extent.yMin()) / _yInterval, 0.0, (double)lastRow);
+            _rowMin = osg::maximum((int)floor(_py), 0);
+            _rowMax = osg::maximum(osg::minimum((int)ceil(_py), lastRow), 0);
+            if (_rowMin > _rowMax) _rowMin = _rowMax;
+            return true;
+        }
+
+        //! Height at column c of the current row, or NO_DATA_VALUE
+        float sample(unsigned c) const
+        {
+            if (!_insideX[c])
+                return NO_DATA_VALUE;
+
+            if (_interp != INTERP_BILINEAR)
+                return HeightFieldUtils::getHeightAtPixel(_hf, _px[c], _py, _interp);
+
+            // HeightFieldUtils::getHeightAtPixel, INTERP_BILINEAR, step for step
+            int colMin = _colMin[c], colMax = _colMax[c];
+            double px = _px[c], py = _py;
+
+            float urHeight = _hf->getHeight(colMax, _rowMax);
+            float llHeight = _hf->getHeight(colMin, _rowMin);
+            float ulHeight = _hf->getHeight(colMin, _rowMax);
+            float lrHeight = _hf->getHeight(colMax, _rowMin);
+
+            if (!HeightFieldUtils::validateSamples(urHeight, llHeight, ulHeight, lrHeight))
+                return NO_DATA_VALUE;
+
+            float result;
+            if ((colMax == colMin) && (_rowMax == _rowMin))
+            {
+                result = _hf->getHeight((int)px, (int)py);
+            }
+            else if (colMax == colMin)
+            {
+                result = ((double)_rowMax - py) * llHeight + (py - (double)_rowMin) * ulHeight;
+            }
+            else if (_rowMax == _rowMin)
+            {
+                result = ((double)colMax - px) * llHeight + (px - (double)colMin) * lrHeight;
+            }
+            else
+            {
+                double r1 = ((double)colMax - px) * (double)llHeight + (px - (double)colMin) * (double)lrHeight;
+                double r2 = ((double)colMax - px) * (double)ulHeight + (px - (double)colMin) * (double)urHeight;
+                result = ((double)_rowMax - py) * (double)r1 + (py - (double)_rowMin) * (double)r2;
+            }
+            return result;
+        }
+
+        const osg::HeightField* _hf;
+        GeoExtent _extent;
+        RasterInterpolation _interp;
+        double _xInterval, _yInterval;
+        double _centerX, _centerY;
+        std::vector<char> _insideX;
+        std::vector<double> _px;
+        std::vector<int> _colMin, _colMax;
+        double _py;
+        int _rowMin, _rowMax;
+    };
 }
 
 bool
@@ -790,28 +1005,16 @@ ElevationLayerVector::populateHeightField(
     double   dx         = key.getExtent().width() / (double)(numColumns-1);
     double   dy         = key.getExtent().height() / (double)(numRows-1);
 
-    // We will load the actual heightfields on demand. We might not need them all.
-    GeoHeightFieldVector heightFields(contenders.size());
-    std::vector<TileKey> heightFieldActualKeys(contenders.size());
+    // Offset fields load on demand. We might not need them all.
     GeoHeightFieldVector offsetFields(offsets.size());
-    std::vector<bool>    heightFallback(contenders.size(), false);
-    std::vector<bool>    heightFailed(contenders.size(), false);
     std::vector<bool>    offsetFailed(offsets.size(), false);
 
-    // The maximum number of heightfields to keep in this local cache
-    const unsigned maxHeightFields = 50;
-    unsigned numHeightFieldsInCache = 0;
-
     const SpatialReference* keySRS = keyToUse.getProfile()->getSRS();
 
     bool realData = false;
 
     unsigned int total = numColumns * numRows;
 
-    int nodataCount = 0;
-
-    TileKey actualKey; // Storage if a new key needs to be constructed
-
     bool requiresResample = true;
 
     // If we only have a single contender layer, and the tile is the same size as the requested
@@ -848,132 +1051,174 @@ ElevationLayerVector::populateHeightField(
     // If we need to mosaic multiple layers or resample it to a new output tilesize go through a resampling loop.
     if (requiresResample)
     {
-        for (unsigned c = 0; c < numColumns; ++c)
+        // Coverage mask: the index of the layer that supplied each post,
+        // or -1 for a post that is still a hole. Layers are visited in
+        // priority order and each one only fills the remaining holes, so
+        // lower-priority layers are never fetched once the tile is full.
+        std::vector<int>   resolvedIndex(total, -1);
+        std::vector<float> resolution(total, FLT_MAX);
+        std::vector<unsigned> rowHoles(numRows, numColumns);
+        unsigned holes = total;
+
+        for (unsigned i = 0; i < contenders.size() && holes > 0; ++i)
         {
-            double x = xmin + (dx * (double)c);
-
-            // periodically check for cancelation
             if (progress && progress->isCanceled())
             {
                 return false;
             }
 
-            for (unsigned r = 0; r < numRows; ++r)
-            {
-                double y = ymin + (dy * (double)r);
-
-                // Collect elevations from each layer as necessary.
-                int resolvedIndex = -1;
-
-                float resolution = FLT_MAX;
+            ElevationLayer* layer = contenders[i].layer.get();
 
-                osg::Vec3 normal_sum(0, 0, 0);
-
-                for (int i = 0; i < contenders.size() && resolvedIndex < 0; ++i)
+            // Skip the layer if none of its data extents reach a hole.
+            if (!layer->getDataExtents().empty())
+            {
+                unsigned cmin = numColumns, cmax = 0, rmin = numRows, rmax = 0;
+                for (unsigned r = 0; r < numRows; ++r)
                 {
-                    ElevationLayer* layer = contenders[i].layer.get();
-                    TileKey& contenderKey = contenders[i].key;
-                    int index = contenders[i].index;
-
-                    if (heightFailed[i])
+                    if (rowHoles[r] == 0)
                         continue;
 
-                    GeoHeightField& layerHF = heightFields[i];
-                    TileKey& actualKey = heightFieldActualKeys[i];
-
-                    if (!layerHF.valid())
+                    for (unsigned c = 0; c < numColumns; ++c)
                     {
-                        // We couldn't get the heightfield from the cache, so try to create it.
-                        // We also fallback on parent layers to make sure that we have data at the location even if it's fallback.
-                        while (!layerHF.valid() && actualKey.valid() && layer->isKeyInLegalRange(actualKey))
+                        if (resolvedIndex[r*numColumns + c] < 0)
                         {
-                            layerHF = layer->createHeightField(actualKey, progress);
-                            if (!layerHF.valid())
-                            {
-                                actualKey.makeParent();
-                            }
+                            cmin = osg::minimum(cmin, c); cmax = osg::maximum(cmax, c);
+                            rmin = osg::minimum(rmin, r); rmax = osg::maximum(rmax, r);
                         }
+                    }
+                }
 
-                        // Mark this layer as fallback if necessary.
-                        if (layerHF.valid())
-                        {
-                            //TODO: check this. Should it be actualKey != keyToUse...?
-                            heightFallback[i] = 
-                                contenders[i].isFallback ||
-                                (actualKey != contenderKey);
+                // pad by half a post since sampling interpolates neighbors
+                GeoExtent holesExtent(
+                    keySRS,
+                    xmin + dx * ((double)cmin - 0.5), ymin + dy * ((double)rmin - 0.5),
+                    xmin + dx * ((double)cmax + 0.5), ymin + dy * ((double)rmax + 0.5));
 
-                            numHeightFieldsInCache++;
-                        }
-                        else
-                        {
-                            heightFailed[i] = true;
+                if (!layer->intersectsDataExtents(holesExtent))
+                {
+                    // The layer would have been fetched before, so it still
+                    // counts toward real data.
+                    if (!contenders[i].isFallback)
+                        realData = true;
+                    continue;
+                }
+            }
+
+            // Fall back on parent keys to make sure that we have data at the
+            // location even if it's fallback.
+            TileKey actualKey = contenders[i].key;
+            GeoHeightField layerHF;
+            while (!layerHF.valid() && actualKey.valid() && layer->isKeyInLegalRange(actualKey))
+            {
+                layerHF = layer->createHeightField(actualKey, progress);
+                if (!layerHF.valid())
+                {
+                    actualKey.makeParent();
+                }
+            }
+
+            if (!layerHF.valid())
+            {
 #ifdef ANALYZE
-                            layerAnalysis[layer].failed = true;
-                            layerAnalysis[layer].actualKeyValid = actualKey->valid();
-                            if (progress) layerAnalysis[layer].message = progress->message();
+                layerAnalysis[layer].failed = true;
+                layerAnalysis[layer].actualKeyValid = actualKey.valid();
+                if (progress) layerAnalysis[layer].message = progress->message();
 #endif
-                            continue;
-                        }
-                    }
+                continue;
+            }
 
-                    if (layerHF.valid())
-                    {
-                        bool isFallback = heightFallback[i];
+            //TODO: check this. Should it be actualKey != keyToUse...?
+            bool isFallback =
+                contenders[i].isFallback ||
+                (actualKey != contenders[i].key);
 #ifdef ANALYZE
-                        layerAnalysis[layer].fallback = isFallback;
+            layerAnalysis[layer].fallback = isFallback;
 #endif
 
-                        // We only have real data if this is not a fallback heightfield.
-                        if (!isFallback)
-                        {
-                            realData = true;
-                        }
+            // We only have real data if this is not a fallback heightfield.
+            if (!isFallback)
+            {
+                realData = true;
+            }
 
-                        float elevation;
-                        if (layerHF.getElevation(keySRS, x, y, interpolation, keySRS, elevation))
-                        {
-                            if (elevation != NO_DATA_VALUE)
-                            {
-                                // remember the index so we can only apply offset layers that
-                                // sit on TOP of this layer.
-                                resolvedIndex = index;
+            float layerResolution = actualKey.getResolution(numColumns).second;
 
-                                hf->setHeight(c, r, elevation);
+            // A heightfield in the tile's own SRS is sampled a row at a time,
+            // with the extent test and pixel mapping done once per column.
+            // Anything else goes through the general per-post path.
+            RowSampler sampler;
+            bool useSampler = layerHF.getExtent().getSRS() == keySRS;
+            if (useSampler)
+            {
+                sampler = RowSampler(layerHF, xmin, dx, numColumns, interpolation);
+            }
 
-                                resolution = actualKey.getResolution(hf->getNumColumns()).second;
-#ifdef ANALYZE
-                                layerAnalysis[layer].samples++;
-#endif
-                            }
-                            else
-                            {
-                                ++nodataCount;
-                            }
-                        }
-                    }
+            for (unsigned r = 0; r < numRows; ++r)
+            {
+                // skip rows that are already full or that the layer does not cover
+                if (rowHoles[r] == 0)
+                    continue;
+
+                double y = ymin + (dy * (double)r);
+
+                if (useSampler && !sampler.setRow(y))
+                    continue;
+
+                for (unsigned c = 0; c < numColumns; ++c)
+                {
+                    unsigned k = r*numColumns + c;
+                    if (resolvedIndex[k] >= 0)
+                        continue;
 
+                    float elevation = NO_DATA_VALUE;
+                    if (useSampler)
+                    {
+                        elevation = sampler.sample(c);
+                    }
+                    else
+                    {
+                        double x = xmin + (dx * (double)c);
+                        if (!layerHF.getElevation(keySRS, x, y, interpolation, keySRS, elevation))
+                            elevation = NO_DATA_VALUE;
+                    }
 
-                    // Clear the heightfield cache if we have too many heightfields in the cache.
-                    if (numHeightFieldsInCache >= maxHeightFields)
+                    if (elevation != NO_DATA_VALUE)
                     {
-                        //OE_NOTICE << "Clearing cache" << std::endl;
-                        for (unsigned int k = 0; k < heightFields.size(); k++)
-                        {
-                            heightFields[k] = GeoHeightField::INVALID;
-                            heightFallback[k] = false;
-                        }
-                        numHeightFieldsInCache = 0;
+                        // remember the index so we can only apply offset layers that
+                        // sit on TOP of this layer.
+                        resolvedIndex[k] = contenders[i].index;
+                        resolution[k] = layerResolution;
+                        hf->setHeight(c, r, elevation);
+                        --rowHoles[r];
+                        --holes;
+#ifdef ANALYZE
+                        layerAnalysis[layer].samples++;
+#endif
                     }
                 }
+            }
+        }
+
+        for (unsigned r = 0; r < numRows && !offsets.empty(); ++r)
+        {
+            double y = ymin + (dy * (double)r);
+
+            // periodically check for cancelation
+            if (progress && progress->isCanceled())
+            {
+                return false;
+            }
+
+            for (unsigned c = 0; c < numColumns; ++c)
+            {
+                double x = xmin + (dx * (double)c);
+                int resolved = resolvedIndex[r*numColumns + c];
 
                 for (int i = offsets.size() - 1; i >= 0; --i)
                 {
-                    if (progress && progress->isCanceled())
-                        return false;
-
                     // Only apply an offset layer if it sits on top of the resolved layer
                     // (or if there was no resolved layer).
-                    if (resolvedIndex >= 0 && offsets[i].index < resolvedIndex)
+                    if (resolved >= 0 && offsets[i].index < resolved)
                         continue;
 
                     TileKey& contenderKey = offsets[i].key;
@@ -1011,13 +1256,14 @@ ElevationLayerVector::populateHeightField(
                         //    (float)contenderKey.getResolution(hf->getNumColumns()).second);
                     }
                 }
-
-                if (resolutions)
-                {
-                    resolutions[r*numColumns+c] = resolution;
-                }
             }
         }
+
+        if (resolutions)
+        {
+            for (unsigned k = 0; k < total; ++k)
+                resolutions[k] = resolution[k];
+        }
     }
 
 #ifdef ANALYZE
@@ -24,9 +24,17 @@
 #include <osgEarth/Registry>
 #include <osgEarth/Containers>
 #include <osgEarth/Progress>
+#include <osgEarth/SIMD>
 
 #include <thread>
 #include <chrono>
+#include <algorithm>
+
+#if defined(OE_SIMD_AVX2)
+    #include <immintrin.h>
+#elif defined(OE_SIMD_SSE2)
+    #include <emmintrin.h>
+#endif
 
 using namespace osgEarth;
 
@@ -38,13 +46,68 @@ ElevationPool::MapCallbackAdapter::onMapModelChanged(const MapModelChange& c)
     _pool->clear();
 }
 
+ElevationPool::GlobalLUT::GlobalLUT()
+{
+    for (unsigned i = 0; i < NUM_STRIPES; ++i)
+    {
+        _stripes[i]._mutex.setName("ElevPool LUT(OE)");
+        _stripes[i]._puts = 0u;
+    }
+}
+
+bool
+ElevationPool::GlobalLUT::get(const Internal::RevElevationKey& key, Pointer& output)
+{
+    Stripe& st = stripe(key);
+    Threading::ScopedMutexLock lock(st._mutex);
+    auto i = st._lut.find(key);
+    if (i != st._lut.end())
+    {
+        // observer_ptr::lock is the safe promotion; it fails
+        // if the texture is already on its way out.
+        i->second.lock(output);
+    }
+    return output.valid();
+}
+
+void
+ElevationPool::GlobalLUT::put(const Internal::RevElevationKey& key, ElevationTexture* tex)
+{
+    Stripe& st = stripe(key);
+    Threading::ScopedMutexLock lock(st._mutex);
+    st._lut[key] = tex;
+
+    // we already hold the lock, so this is the cheap time to
+    // drop entries whose textures have expired.
+    if (++st._puts % SWEEP_INTERVAL == 0)
+    {
+        for (auto i = st._lut.begin(); i != st._lut.end(); )
+        {
+            if (!i->second.valid())
+                i = st._lut.erase(i);
+            else
+                ++i;
+        }
+    }
+}
+
+void
+ElevationPool::GlobalLUT::clear()
+{
+    for (unsigned i = 0; i < NUM_STRIPES; ++i)
+    {
+        Threading::ScopedMutexLock lock(_stripes[i]._mutex);
+        _stripes[i]._lut.clear();
+        _stripes[i]._puts = 0u;
+    }
+}
+
 ElevationPool::ElevationPool() :
     _index(NULL),
     _tileSize(257),
     _mapDataDirty(true),
     _workers(0),
-    _refreshMutex("ElevPool(OE)"),
-    _globalLUTMutex("ElevPool LUT(OE)")
+    _refreshMutex("ElevPool(OE)")
 {
     // small L2 cache to use if the caller doesn't supply a working set
     _L2 = new WorkingSet(32u);
@@ -162,9 +225,7 @@ ElevationPool::refresh(const Map* map)
 
     _L2->_lru.clear();
 
-    _globalLUTMutex.write_lock();
     _globalLUT.clear();
-    _globalLUTMutex.write_unlock();
 }
 
 unsigned
@@ -185,7 +246,8 @@ ElevationPool::getLOD(double x, double y) const
 }
 
 ElevationPool::WorkingSet::WorkingSet(unsigned size) :
-    _lru(true, size)
+    _lru(true, size),
+    _shared(NULL)
 {
     //nop
 }
@@ -215,6 +277,15 @@ ElevationPool::findExistingRaster(
             *fromWS = true;
             return true;
         }
+
+        // Then the shared cache behind it, if there is one
+        if (ws->_shared && ws->_shared->_lru.get(key, record))
+        {
+            OE_DEBUG << LC << key._tilekey.str() << " - Cache hit (Shared working set)" << std::endl;
+            output = record.value();
+            *fromL2 = true;
+            return true;
+        }
     }
 
     if (_L2)
@@ -231,29 +302,11 @@ ElevationPool::findExistingRaster(
 
     // Next check the system LUT -- see if someone somewhere else
     // already has it (the terrain or another WorkingSet)
-    optional<Internal::RevElevationKey> orphanedKey;
-    _globalLUTMutex.read_lock();
-    OE_DEBUG << "Global LUT size = " << _globalLUT.size() << std::endl;
-    auto i =_globalLUT.find(key);
-    if (i != _globalLUT.end())
+    // (an orphaned entry just reads as a miss; it gets overwritten
+    // or swept by a later put)
+    if (_globalLUT.get(key, output))
     {
-        i->second.lock(output);
-        if (output.valid())
-        {
-            *fromLUT = true;
-        }
-        else
-        {
-            // observer was orphaned..remove it
-            orphanedKey = key;
-        }
-    }
-    _globalLUTMutex.read_unlock();
-
-    if (orphanedKey.isSet())
-    {
-        Threading::ScopedWriteLock lock(_globalLUTMutex);
-        _globalLUT.erase(orphanedKey.get());
+        *fromLUT = true;
     }
 
     // found it, so stick it in the L2 cache
@@ -353,6 +406,11 @@ ElevationPool::getOrCreateRaster(
     if (ws)
     {
         ws->_lru.insert(key, result.get());
+
+        if (ws->_shared && !fromWS && !fromL2)
+        {
+            ws->_shared->_lru.insert(key, result.get());
+        }
     }
 
     // update if L2 cache, but ONLY if the user did not supply
@@ -366,10 +424,7 @@ ElevationPool::getOrCreateRaster(
     // update system weak-LUT:
     if (!fromLUT)
     {
-        Threading::ScopedWriteLock lock(_globalLUTMutex);
-        //_globalLUT.lock();
-        _globalLUT[key] = result.get();
-        //_globalLUT.unlock();
+        _globalLUT.put(key, result.get());
     }
 
     return result;
@@ -377,6 +432,15 @@ ElevationPool::getOrCreateRaster(
 
 namespace
 {
+#ifdef OE_SIMD_SSE2
+    // _mm_min_epi32 is SSE4.1
+    inline __m128i sse2_min_epi32(__m128i a, __m128i b)
+    {
+        __m128i agtb = _mm_cmpgt_epi32(a, b);
+        return _mm_or_si128(_mm_and_si128(agtb, b), _mm_andnot_si128(agtb, a));
+    }
+#endif
+
     typedef vector_map<
         Internal::RevElevationKey,
         osg::ref_ptr<ElevationTexture> > QuickCache;
@@ -419,6 +483,175 @@ namespace
         a.BOT = a.LL * (1.0f - smix) + a.LR * smix;
         out = a.TOP * (1.0f - tmix) + a.BOT * tmix;
     }
+
+    // Bilinear sampling of a row-major float grid at a batch of
+    // pixel-space coordinates (s in [0..cols-1], t in [0..rows-1]),
+    // starting at index "i". This is the reference implementation; the
+    // vector versions below run it for whatever is left past their last
+    // full batch.
+    void sampleBilinearFrom(
+        const float* grid, int cols, int rows,
+        const float* s, const float* t, unsigned i, unsigned n,
+        float* out)
+    {
+        for (; i < n; ++i)
+        {
+            float fs = osg::maximum(s[i], 0.0f);
+            float ft = osg::maximum(t[i], 0.0f);
+            int s0 = osg::minimum((int)fs, cols - 1);
+            int t0 = osg::minimum((int)ft, rows - 1);
+            int s1 = osg::minimum(s0 + 1, cols - 1);
+            int t1 = osg::minimum(t0 + 1, rows - 1);
+            float smix = osg::minimum(fs - (float)s0, 1.0f);
+            float tmix = osg::minimum(ft - (float)t0, 1.0f);
+
+            const float* row0 = grid + t0 * cols;
+            const float* row1 = grid + t1 * cols;
+            float top = row0[s0] + (row0[s1] - row0[s0]) * smix;
+            float bot = row1[s0] + (row1[s1] - row1[s0]) * smix;
+            out[i] = top + (bot - top) * tmix;
+        }
+    }
+
+    void sampleBilinear_scalar(
+        const float* grid, int cols, int rows,
+        const float* s, const float* t, unsigned n,
+        float* out)
+    {
+        sampleBilinearFrom(grid, cols, rows, s, t, 0u, n, out);
+    }
+
+#ifdef OE_SIMD_SSE2
+    // Gathers the four corners for four points at a time and computes
+    // the weights and blends in vector registers.
+    void sampleBilinear_sse2(
+        const float* grid, int cols, int rows,
+        const float* s, const float* t, unsigned n,
+        float* out)
+    {
+        unsigned i = 0;
+
+        const __m128i maxS = _mm_set1_epi32(cols - 1);
+        const __m128i maxT = _mm_set1_epi32(rows - 1);
+        const __m128i one = _mm_set1_epi32(1);
+        const __m128 zero = _mm_setzero_ps();
+
+        alignas(16) int s0[4], s1[4], t0[4], t1[4];
+        alignas(16) float ul[4], ur[4], ll[4], lr[4];
+
+        for (; i + 4 <= n; i += 4)
+        {
+            __m128 vs = _mm_max_ps(_mm_loadu_ps(s + i), zero);
+            __m128 vt = _mm_max_ps(_mm_loadu_ps(t + i), zero);
+
+            // coordinates are non-negative, so truncation is floor:
+            __m128i is0 = _mm_cvttps_epi32(vs);
+            __m128i it0 = _mm_cvttps_epi32(vt);
+            is0 = sse2_min_epi32(is0, maxS);
+            it0 = sse2_min_epi32(it0, maxT);
+            __m128i is1 = sse2_min_epi32(_mm_add_epi32(is0, one), maxS);
+            __m128i it1 = sse2_min_epi32(_mm_add_epi32(it0, one), maxT);
+
+            __m128 smix = _mm_min_ps(_mm_sub_ps(vs, _mm_cvtepi32_ps(is0)), _mm_set1_ps(1.0f));
+            __m128 tmix = _mm_min_ps(_mm_sub_ps(vt, _mm_cvtepi32_ps(it0)), _mm_set1_ps(1.0f));
+
+            _mm_store_si128((__m128i*)s0, is0);
+            _mm_store_si128((__m128i*)s1, is1);
+            _mm_store_si128((__m128i*)t0, it0);
+            _mm_store_si128((__m128i*)t1, it1);
+
+            for (int k = 0; k < 4; ++k)
+            {
+                const float* row0 = grid + t0[k] * cols;
+                const float* row1 = grid + t1[k] * cols;
+                ul[k] = row0[s0[k]];
+                ur[k] = row0[s1[k]];
+                ll[k] = row1[s0[k]];
+                lr[k] = row1[s1[k]];
+            }
+
+            __m128 top = _mm_add_ps(_mm_load_ps(ul), _mm_mul_ps(_mm_sub_ps(_mm_load_ps(ur), _mm_load_ps(ul)), smix));
+            __m128 bot = _mm_add_ps(_mm_load_ps(ll), _mm_mul_ps(_mm_sub_ps(_mm_load_ps(lr), _mm_load_ps(ll)), smix));
+            _mm_storeu_ps(out + i, _mm_add_ps(top, _mm_mul_ps(_mm_sub_ps(bot, top), tmix)));
+        }
+
+        sampleBilinearFrom(grid, cols, rows, s, t, i, n, out);
+    }
+#endif
+
+#ifdef OE_SIMD_AVX2
+    // Eight points at a time, with hardware gathers for the corners.
+    // Multiplies and adds stay separate (no FMA) so results match the
+    // scalar reference exactly.
+    OE_SIMD_TARGET("avx2")
+    void sampleBilinear_avx2(
+        const float* grid, int cols, int rows,
+        const float* s, const float* t, unsigned n,
+        float* out)
+    {
+        unsigned i = 0;
+
+        const __m256i maxS = _mm256_set1_epi32(cols - 1);
+        const __m256i maxT = _mm256_set1_epi32(rows - 1);
+        const __m256i vcols = _mm256_set1_epi32(cols);
+        const __m256i one = _mm256_set1_epi32(1);
+        const __m256 zero = _mm256_setzero_ps();
+        const __m256 onef = _mm256_set1_ps(1.0f);
+
+        for (; i + 8 <= n; i += 8)
+        {
+            __m256 vs = _mm256_max_ps(_mm256_loadu_ps(s + i), zero);
+            __m256 vt = _mm256_max_ps(_mm256_loadu_ps(t + i), zero);
+
+            __m256i is0 = _mm256_min_epi32(_mm256_cvttps_epi32(vs), maxS);
+            __m256i it0 = _mm256_min_epi32(_mm256_cvttps_epi32(vt), maxT);
+            __m256i is1 = _mm256_min_epi32(_mm256_add_epi32(is0, one), maxS);
+            __m256i it1 = _mm256_min_epi32(_mm256_add_epi32(it0, one), maxT);
+
+            __m256 smix = _mm256_min_ps(_mm256_sub_ps(vs, _mm256_cvtepi32_ps(is0)), onef);
+            __m256 tmix = _mm256_min_ps(_mm256_sub_ps(vt, _mm256_cvtepi32_ps(it0)), onef);
+
+            __m256i row0 = _mm256_mullo_epi32(it0, vcols);
+            __m256i row1 = _mm256_mullo_epi32(it1, vcols);
+
+            __m256 ul = _mm256_i32gather_ps(grid, _mm256_add_epi32(row0, is0), 4);
+            __m256 ur = _mm256_i32gather_ps(grid, _mm256_add_epi32(row0, is1), 4);
+            __m256 ll = _mm256_i32gather_ps(grid, _mm256_add_epi32(row1, is0), 4);
+            __m256 lr = _mm256_i32gather_ps(grid, _mm256_add_epi32(row1, is1), 4);
+
+            __m256 top = _mm256_add_ps(ul, _mm256_mul_ps(_mm256_sub_ps(ur, ul), smix));
+            __m256 bot = _mm256_add_ps(ll, _mm256_mul_ps(_mm256_sub_ps(lr, ll), smix));
+            _mm256_storeu_ps(out + i, _mm256_add_ps(top, _mm256_mul_ps(_mm256_sub_ps(bot, top), tmix)));
+        }
+
+        sampleBilinearFrom(grid, cols, rows, s, t, i, n, out);
+    }
+#endif
+
+    typedef void (*SampleBilinearFunc)(const float*, int, int, const float*, const float*, unsigned, float*);
+
+    struct SampleBilinearDispatch : public Util::SIMD::Dispatch<SampleBilinearFunc>
+    {
+        SampleBilinearDispatch() : Util::SIMD::Dispatch<SampleBilinearFunc>(sampleBilinear_scalar)
+        {
+#ifdef OE_SIMD_SSE2
+            add(Util::SIMD::SSE2, sampleBilinear_sse2);
+#endif
+#ifdef OE_SIMD_AVX2
+            add(Util::SIMD::AVX2, sampleBilinear_avx2);
+#endif
+        }
+    };
+
+    const SampleBilinearDispatch s_sampleBilinear;
+
+    inline void sampleBilinear(
+        const float* grid, int cols, int rows,
+        const float* s, const float* t, unsigned n,
+        float* out)
+    {
+        s_sampleBilinear.get()(grid, cols, rows, s, t, n, out);
+    }
 }
 
 int
@@ -564,6 +797,171 @@ ElevationPool::sampleMapCoords(
     return count;
 }
 
+int
+ElevationPool::sampleMapCoords(
+    std::vector<osg::Vec4d>& points,
+    std::vector<float>* out_resolutions,
+    WorkingSet* ws,
+    ProgressCallback* progress)
+{
+    OE_PROFILING_ZONE;
+
+    if (points.empty())
+        return -1;
+
+    osg::ref_ptr<const Map> map;
+    if (_map.lock(map) == false || map->getProfile() == NULL)
+        return -1;
+
+    sync(map.get(), ws);
+    ScopedAtomicCounter counter(_workers);
+
+    const Profile* profile = map->getProfile();
+    double pw = profile->getExtent().width();
+    double ph = profile->getExtent().height();
+    double pxmin = profile->getExtent().xMin();
+    double pymin = profile->getExtent().yMin();
+
+    const Units& units = map->getSRS()->getUnits();
+    Distance pointRes(0.0, units);
+
+    if (out_resolutions)
+        out_resolutions->assign(points.size(), 0.0f);
+
+    // Pass 1: find the tile each point falls in, packed as (lod, ty, tx)
+    // so that sorting groups all the points that share a raster.
+    std::vector<std::pair<unsigned long long, unsigned> > order(points.size());
+    {
+        OE_PROFILING_ZONE_NAMED("createTileKeys");
+
+        unsigned tw = 1, th = 1, lod = 0;
+        float lastRes = -1.0f;
+
+        for (unsigned i = 0; i < points.size(); ++i)
+        {
+            const osg::Vec4d& p = points[i];
+
+            if (p.w() >= 0.0f && p.w() != lastRes)
+            {
+                pointRes.set(p.w(), units);
+
+                double resolutionInMapUnits = pointRes.asDistance(units, p.y());
+
+                unsigned maxLOD = profile->getLevelOfDetailForHorizResolution(
+                    resolutionInMapUnits,
+                    ELEVATION_TILE_SIZE);
+
+                lod = osg::minimum(getLOD(p.x(), p.y()), maxLOD);
+
+                profile->getNumTiles(lod, tw, th);
+
+                lastRes = p.w();
+            }
+
+            double rx = (p.x() - pxmin) / pw, ry = (p.y() - pymin) / ph;
+            unsigned tx = osg::clampBelow((unsigned)(rx * (double)tw), tw - 1u);
+            unsigned ty = osg::clampBelow((unsigned)((1.0 - ry) * (double)th), th - 1u);
+
+            order[i].first =
+                ((unsigned long long)lod << 58) |
+                ((unsigned long long)(ty & 0x1FFFFFFF) << 29) |
+                (unsigned long long)(tx & 0x1FFFFFFF);
+            order[i].second = i;
+        }
+
+        std::sort(order.begin(), order.end());
+    }
+
+    Internal::RevElevationKey key;
+    key._revision = getElevationRevision(map.get());
+
+    osg::ref_ptr<ElevationTexture> raster;
+    std::vector<float> s, t, h;
+    int count = 0;
+
+    // Pass 2: resolve each raster once and sample all of its points together.
+    for (unsigned first = 0; first < order.size(); )
+    {
+        unsigned long long packed = order[first].first;
+        unsigned last = first + 1;
+        while (last < order.size() && order[last].first == packed)
+            ++last;
+
+        key._tilekey = TileKey(
+            (unsigned)(packed >> 58),
+            (unsigned)(packed & 0x1FFFFFFF),
+            (unsigned)((packed >> 29) & 0x1FFFFFFF),
+            profile);
+
+        raster = key._tilekey.valid() ? getOrCreateRaster(
+            key,       // key to query
+            map.get(), // map to query
+            true,      // fall back on lower resolution data if necessary
+            ws,        // user's workingset
+            progress) : 0L;
+
+        if (progress && progress->isCanceled())
+        {
+            return -1;
+        }
+
+        const osg::HeightField* hf = raster.valid() ? raster->getHeightField() : 0L;
+
+        if (hf && hf->getNumColumns() > 0 && hf->getNumRows() > 0)
+        {
+            OE_PROFILING_ZONE_NAMED("sample");
+
+            const GeoExtent& ex = raster->getExtent();
+            int cols = hf->getNumColumns(), rows = hf->getNumRows();
+            double sizeS = (double)(cols - 1), sizeT = (double)(rows - 1);
+            unsigned n = last - first;
+
+            s.resize(n), t.resize(n), h.resize(n);
+            for (unsigned j = 0; j < n; ++j)
+            {
+                const osg::Vec4d& p = points[order[first + j].second];
+
+                // Note: clamping can happen on the map edges..
+                double u = osg::clampBetween((p.x() - ex.xMin()) / ex.width(), 0.0, 1.0);
+                double v = osg::clampBetween((p.y() - ex.yMin()) / ex.height(), 0.0, 1.0);
+                s[j] = (float)(u * sizeS);
+                t[j] = (float)(v * sizeT);
+            }
+
+            sampleBilinear((const float*)hf->getFloatArray()->getDataPointer(), cols, rows, &s[0], &t[0], n, &h[0]);
+
+            float nominalRes = (float)(ex.height() / osg::maximum(sizeT, 1.0));
+
+            for (unsigned j = 0; j < n; ++j)
+            {
+                unsigned i = order[first + j].second;
+                points[i].z() = h[j];
+
+                if (h[j] != NO_DATA_VALUE)
+                {
+                    ++count;
+
+                    if (out_resolutions)
+                    {
+                        (*out_resolutions)[i] = raster->getResolutions() ?
+                            raster->getResolution((int)s[j], (int)t[j]) :
+                            nominalRes;
+                    }
+                }
+            }
+        }
+        else
+        {
+            for (unsigned j = first; j < last; ++j)
+                points[order[j].second].z() = NO_DATA_VALUE;
+        }
+
+        first = last;
+    }
+
+    return count;
+}
+
 int
 ElevationPool::sampleMapCoords(
     std::vector<osg::Vec3d>& points,
@@ -830,16 +1228,29 @@ ElevationPool::getTile(
 
 namespace osgEarth { namespace Internal
 {
+    typedef PerThread<ElevationPool::WorkingSet> PerThreadWorkingSets;
+
+    // Working set for the calling thread, backed by a shared one
+    inline ElevationPool::WorkingSet* getLocalWorkingSet(
+        PerThreadWorkingSets* local,
+        ElevationPool::WorkingSet* shared)
+    {
+        ElevationPool::WorkingSet& ws = local->get();
+        ws.setSharedWorkingSet(shared);
+        return &ws;
+    }
+
     struct SampleElevationOp : public osg::Operation
     {
         osg::observer_ptr<const Map> _map;
         GeoPoint _p;
         Distance _res;
-        ElevationPool::WorkingSet* _ws;
+        PerThreadWorkingSets* _local;
+        ElevationPool::WorkingSet* _shared;
         Promise<RefElevationSample> _promise;
 
-        SampleElevationOp(osg::observer_ptr<const Map> map, const GeoPoint& p, const Distance& res, ElevationPool::WorkingSet* ws) :
-            _map(map), _p(p), _res(res), _ws(ws), _promise(OE_MUTEX_NAME) { }
+        SampleElevationOp(osg::observer_ptr<const Map> map, const GeoPoint& p, const Distance& res, PerThreadWorkingSets* local, ElevationPool::WorkingSet* shared) :
+            _map(map), _p(p), _res(res), _local(local), _shared(shared), _promise(OE_MUTEX_NAME) { }
 
         void operator()(osg::Object*)
         {
@@ -848,7 +1259,8 @@ namespace osgEarth { namespace Internal
                 osg::ref_ptr<const Map> map;
                 if (_map.lock(map))
                 {
-                    ElevationSample sample = map->getElevationPool()->getSample(_p, _res, _ws);
+                    ElevationSample sample = map->getElevationPool()->getSample(
+                        _p, _res, getLocalWorkingSet(_local, _shared));
                     _promise.resolve(new RefElevationSample(sample.elevation(), sample.resolution()));
                     return;
                 }
@@ -857,15 +1269,45 @@ namespace osgEarth { namespace Internal
             _promise.resolve(NULL);
         }
     };
+
+    struct PrefetchElevationOp : public osg::Operation
+    {
+        osg::observer_ptr<const Map> _map;
+        std::vector<GeoPoint> _points;
+        Distance _res;
+        PerThreadWorkingSets* _local;
+        ElevationPool::WorkingSet* _shared;
+
+        PrefetchElevationOp(osg::observer_ptr<const Map> map, const Distance& res, PerThreadWorkingSets* local, ElevationPool::WorkingSet* shared) :
+            _map(map), _res(res), _local(local), _shared(shared) { }
+
+        void operator()(osg::Object*)
+        {
+            osg::ref_ptr<const Map> map;
+            if (_map.lock(map))
+            {
+                ElevationPool::WorkingSet* ws = getLocalWorkingSet(_local, _shared);
+                for (auto& p : _points)
+                {
+                    map->getElevationPool()->getSample(p, _res, ws);
+                }
+            }
+        }
+    };
 }}
 
 AsyncElevationSampler::AsyncElevationSampler(
     const Map* map,
     unsigned numThreads) :
 
-    _map(map)
+    _map(map),
+    _wsPerThread("AsyncElevationSampler(OE)")
 {
-    _threadPool = new ThreadPool(numThreads);
+    // Runs in the shared "elevation" arena rather than a private pool;
+    // "numThreads" guarantees the arena at least that much concurrency.
+    _arena = Registry::instance()->getJobArena("elevation");
+    if (_arena->getConcurrency() < numThreads)
+        _arena->setConcurrency(numThreads);
 }
 
 Future<RefElevationSample>
@@ -879,8 +1321,68 @@ AsyncElevationSampler::getSample(
     const GeoPoint& p,
     const Distance& resolution)
 {
-    Internal::SampleElevationOp* op = new Internal::SampleElevationOp(_map, p, resolution, &_ws);
+    Internal::SampleElevationOp* op = new Internal::SampleElevationOp(_map, p, resolution, &_wsPerThread, &_ws);
     Future<RefElevationSample> result = op->_promise.getFuture();
-    _threadPool->run(op);
+    _arena->run(op);
     return result;
 }
+
+void
+AsyncElevationSampler::prefetch(
+    const GeoExtent& extent,
+    const Distance& resolution)
+{
+    osg::ref_ptr<const Map> map;
+    if (_map.lock(map) == false || map->getProfile() == NULL || !extent.isValid())
+        return;
+
+    const Profile* profile = map->getProfile();
+    GeoExtent ex = extent.transform(map->getSRS());
+    if (!ex.isValid())
+        return;
+
+    double resolutionInMapUnits = SpatialReference::transformUnits(
+        resolution,
+        map->getSRS(),
+        ex.getCentroid().y());
+
+    unsigned lod = profile->getLevelOfDetailForHorizResolution(
+        resolutionInMapUnits,
+        ELEVATION_TILE_SIZE);
+
+    double tw, th;
+    profile->getTileDimensions(lod, tw, th);
+
+    // One sample per tile (plus the far edges) touches every raster a
+    // query in the extent would need, without computing keys here.
+    unsigned cols = (unsigned)ceil(ex.width() / tw) + 1u;
+    unsigned rows = (unsigned)ceil(ex.height() / th) + 1u;
+
+    // Prefetching more than the shared cache holds would just evict
+    // the first rasters before they were used.
+    if (cols*rows > _ws._lru.getMaxSize())
+    {
+        OE_DEBUG << LC << "Prefetch of " << cols*rows << " tiles truncated to "
+            << _ws._lru.getMaxSize() << std::endl;
+    }
+
+    unsigned budget = _ws._lru.getMaxSize();
+
+    for (unsigned r = 0; r < rows && budget > 0; ++r)
+    {
+        double y = osg::minimum(ex.yMin() + (double)r*th, ex.yMax());
+
+        // one job per row of tiles
+        Internal::PrefetchElevationOp* op = new Internal::PrefetchElevationOp(
+            _map, resolution, &_wsPerThread, &_ws);
+
+        for (unsigned c = 0; c < cols && budget > 0; ++c, --budget)
+        {
+            double x = osg::minimum(ex.xMin() + (double)c*tw, ex.xMax());
+            op->_points.push_back(GeoPoint(map->getSRS(), x, y, 0.0, ALTMODE_ABSOLUTE));
+        }
+
+        // lower priority than real sample requests
+        _arena->run(op, -1.0f);
+    }
+}
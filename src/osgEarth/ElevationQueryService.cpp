@@ -0,0 +1,347 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+ * Copyright 2020 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarth/ElevationQueryService>
+#include <osgEarth/Map>
+#include <osgEarth/Registry>
+#include <osgEarth/JsonUtils>
+#include <osgEarth/Endian>
+#include <cstring>
+
+#define LC "[ElevationQueryService] "
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+// arena in which batches run; kept apart from "elevation" so that a client
+// blocking in query() from an elevation job can't starve the dispatchers.
+#define ARENA_NAME "elevation.query"
+
+namespace
+{
+    const char REQUEST_MAGIC[4] = { 'O', 'E', 'Q', '1' };
+    const char RESPONSE_MAGIC[4] = { 'O', 'E', 'R', '1' };
+
+    void appendU32(std::string& out, std::uint32_t value)
+    {
+        value = htole32(value);
+        out.append((const char*)&value, 4);
+    }
+
+    void appendF32(std::string& out, float value)
+    {
+        std::uint32_t bits;
+        ::memcpy(&bits, &value, 4);
+        appendU32(out, bits);
+    }
+
+    std::uint32_t readU32(const char* in)
+    {
+        std::uint32_t value;
+        ::memcpy(&value, in, 4);
+        return le32toh(value);
+    }
+
+    double readF64(const char* in)
+    {
+        std::uint64_t bits;
+        ::memcpy(&bits, in, 8);
+        bits = le64toh(bits);
+        double value;
+        ::memcpy(&value, &bits, 8);
+        return value;
+    }
+
+    std::string jsonError(const std::string& message)
+    {
+        Json::Value root(Json::objectValue);
+        root["error"] = message;
+        return Json::FastWriter().write(root);
+    }
+}
+
+//........................................................................
+
+ElevationQueryService::ElevationQueryService(const Map* map, unsigned cacheSize) :
+    _map(map),
+    _defaultResolution(30.0, Units::METERS),
+    _maxBatchSize(16384u),
+    _l2(cacheSize),
+    _queueMutex(OE_MUTEX_NAME),
+    _numDispatchers(0u)
+{
+    //nop
+}
+
+ElevationQueryService::Future
+ElevationQueryService::submit(const std::vector<osg::Vec4d>& points)
+{
+    Request request;
+    request._points = points;
+    Future future = request._promise.getFuture();
+
+    if (points.empty())
+    {
+        Response* response = new Response();
+        response->_ok = true;
+        request._promise.resolve(response);
+        return future;
+    }
+
+    Threading::JobArena* arena = Registry::instance()->getJobArena(ARENA_NAME);
+    bool startDispatcher = false;
+    {
+        Threading::ScopedMutexLock lock(_queueMutex);
+        _queue.push_back(request);
+
+        // Dispatchers drain the queue until it's empty, so a new one is only
+        // needed while there are threads to spare.
+        if (_numDispatchers < osg::maximum(1u, arena->getConcurrency()))
+        {
+            ++_numDispatchers;
+            startDispatcher = true;
+        }
+    }
+
+    if (startDispatcher)
+    {
+        osg::ref_ptr<ElevationQueryService> self = this;
+        Threading::runInJobArena(arena, [self]() { self->dispatch(); });
+    }
+
+    return future;
+}
+
+int
+ElevationQueryService::query(
+    std::vector<osg::Vec4d>& points,
+    std::vector<float>* out_resolutions)
+{
+    Future future = submit(points);
+    Response* response = future.get();
+    if (!response || !response->_ok)
+        return -1;
+
+    int count = 0;
+    for (unsigned i = 0; i < points.size(); ++i)
+    {
+        points[i].z() = response->_elevations[i];
+        if (points[i].z() != NO_DATA_VALUE)
+            ++count;
+    }
+
+    if (out_resolutions)
+        *out_resolutions = response->_resolutions;
+
+    return count;
+}
+
+void
+ElevationQueryService::dispatch()
+{
+    std::vector<Request> batch;
+
+    for (;;)
+    {
+        batch.clear();
+        {
+            Threading::ScopedMutexLock lock(_queueMutex);
+            if (_queue.empty())
+            {
+                --_numDispatchers;
+                return;
+            }
+
+            // Take whole requests up to the batch size, but always at least one.
+            unsigned total = 0u;
+            while (!_queue.empty() &&
+                (batch.empty() || total + _queue.front()._points.size() <= _maxBatchSize))
+            {
+                total += _queue.front()._points.size();
+                batch.push_back(_queue.front());
+                _queue.pop_front();
+            }
+        }
+
+        sampleBatch(batch);
+    }
+}
+
+void
+ElevationQueryService::sampleBatch(std::vector<Request>& batch)
+{
+    osg::ref_ptr<const Map> map;
+    _map.lock(map);
+
+    std::vector<osg::Vec4d> points;
+    std::vector<float> resolutions;
+    int result = -1;
+
+    if (map.valid())
+    {
+        double defaultRes = SpatialReference::transformUnits(_defaultResolution, map->getSRS(), 0.0);
+
+        for (unsigned r = 0; r < batch.size(); ++r)
+        {
+            const std::vector<osg::Vec4d>& in = batch[r]._points;
+            for (unsigned i = 0; i < in.size(); ++i)
+            {
+                points.push_back(in[i]);
+                if (points.back().w() <= 0.0)
+                    points.back().w() = defaultRes;
+            }
+        }
+
+        ElevationPool::WorkingSet ws(64u);
+        ws.setSharedWorkingSet(&_l2);
+        result = map->getElevationPool()->sampleMapCoords(points, &resolutions, &ws, 0L);
+    }
+
+    unsigned offset = 0u;
+    for (unsigned r = 0; r < batch.size(); ++r)
+    {
+        unsigned size = batch[r]._points.size();
+
+        osg::ref_ptr<Response> response = new Response();
+        response->_ok = result >= 0;
+        if (response->_ok)
+        {
+            response->_elevations.resize(size);
+            response->_resolutions.assign(resolutions.begin() + offset, resolutions.begin() + offset + size);
+            for (unsigned i = 0; i < size; ++i)
+                response->_elevations[i] = (float)points[offset + i].z();
+        }
+        offset += size;
+
+        batch[r]._promise.resolve(response.get());
+    }
+}
+
+bool
+ElevationQueryService::handleJSON(const std::string& request, std::string& out_response)
+{
+    osg::ref_ptr<const Map> map;
+    if (!_map.lock(map))
+    {
+        out_response = jsonError("Map is not available");
+        return false;
+    }
+
+    Json::Value root;
+    if (!Json::Reader().parse(request, root) || !root.isObject() || !root["points"].isArray())
+    {
+        out_response = jsonError("Request must be an object with a \"points\" array");
+        return false;
+    }
+
+    osg::ref_ptr<const SpatialReference> srs = map->getSRS();
+    if (root.isMember("srs"))
+    {
+        srs = SpatialReference::get(root["srs"].asString());
+        if (!srs.valid())
+        {
+            out_response = jsonError("Unrecognized SRS \"" + root["srs"].asString() + "\"");
+            return false;
+        }
+    }
+
+    double res = 0.0;
+    if (root.isMember("resolution"))
+    {
+        res = SpatialReference::transformUnits(
+            Distance(root["resolution"].asDouble(), Units::METERS), map->getSRS(), 0.0);
+    }
+
+    const Json::Value& jsonPoints = root["points"];
+    std::vector<osg::Vec3d> coords(jsonPoints.size());
+    for (unsigned i = 0; i < jsonPoints.size(); ++i)
+    {
+        const Json::Value& p = jsonPoints[i];
+        if (!p.isArray() || p.size() < 2)
+        {
+            out_response = jsonError("Each point must be an array [x, y]");
+            return false;
+        }
+        coords[i].set(p[0u].asDouble(), p[1u].asDouble(), 0.0);
+    }
+
+    if (!srs->isHorizEquivalentTo(map->getSRS()) && !srs->transform(coords, map->getSRS()))
+    {
+        out_response = jsonError("Failed to transform points to the map SRS");
+        return false;
+    }
+
+    std::vector<osg::Vec4d> points(coords.size());
+    for (unsigned i = 0; i < coords.size(); ++i)
+        points[i].set(coords[i].x(), coords[i].y(), 0.0, res);
+
+    std::vector<float> resolutions;
+    if (query(points, &resolutions) < 0)
+    {
+        out_response = jsonError("Elevation query failed");
+        return false;
+    }
+
+    Json::Value elevations(Json::arrayValue);
+    Json::Value jsonResolutions(Json::arrayValue);
+    for (unsigned i = 0; i < points.size(); ++i)
+    {
+        elevations.append(points[i].z() != NO_DATA_VALUE ? Json::Value(points[i].z()) : Json::Value());
+        jsonResolutions.append(Json::Value((double)resolutions[i]));
+    }
+
+    Json::Value response(Json::objectValue);
+    response["elevations"] = elevations;
+    response["resolutions"] = jsonResolutions;
+    out_response = Json::FastWriter().write(response);
+    return true;
+}
+
+bool
+ElevationQueryService::handleBinary(const std::string& request, std::string& out_response)
+{
+    if (request.size() < 8 || ::memcmp(request.data(), REQUEST_MAGIC, 4) != 0)
+        return false;
+
+    const char* in = request.data();
+    std::uint32_t count = readU32(in + 4);
+    if ((request.size() - 8) / 24 < count)
+        return false;
+
+    std::vector<osg::Vec4d> points(count);
+    for (std::uint32_t i = 0; i < count; ++i)
+    {
+        const char* p = in + 8 + 24 * i;
+        points[i].set(readF64(p), readF64(p + 8), 0.0, readF64(p + 16));
+    }
+
+    std::vector<float> resolutions;
+    if (count > 0 && query(points, &resolutions) < 0)
+        return false;
+
+    out_response.clear();
+    out_response.reserve(8 + 8 * count);
+    out_response.append(RESPONSE_MAGIC, 4);
+    appendU32(out_response, count);
+    for (std::uint32_t i = 0; i < count; ++i)
+        appendF32(out_response, (float)points[i].z());
+    for (std::uint32_t i = 0; i < count; ++i)
+        appendF32(out_response, resolutions[i]);
+
+    return true;
+}
@@ -26,6 +26,7 @@
 #include <osgEarth/MouseCoordsTool>
 #include <osgEarth/Shadowing>
 #include <osgEarth/ActivityMonitorTool>
+#include <osgEarth/GPUTimer>
 #include <osgEarth/LogarithmicDepthBuffer>
 #include <osgEarth/SimpleOceanLayer>
 
@@ -438,6 +439,9 @@ MapNodeHelper::parse(MapNode*             mapNode,
     // parse out custom example arguments first:
     bool useCoords     = args.read("--coords");
     bool showActivity  = args.read("--activity");
+    bool showCounters  = args.read("--counters");
+    if (args.read("--gpu-timers"))
+        GPUTimer::setEnabled(true);
     bool useLogDepth2  = args.read("--logdepth2");
     bool useLogDepth   = !args.read("--nologdepth") && !useLogDepth2; //args.read("--logdepth");
     bool kmlUI         = args.read("--kmlui");
@@ -558,13 +562,15 @@ MapNodeHelper::parse(MapNode*             mapNode,
     }
 
     // activity monitor (debugging)
-    if ( showActivity )
+    if ( showActivity || showCounters )
     {
         VBox* vbox = new VBox();
         vbox->setBackColor( Color(Color::Black, 0.8) );
         vbox->setHorizAlign( Control::ALIGN_RIGHT );
         vbox->setVertAlign( Control::ALIGN_BOTTOM );
-        view->addEventHandler( new ActivityMonitorTool(vbox) );
+        ActivityMonitorTool* monitor = new ActivityMonitorTool(vbox);
+        monitor->setShowCounters( showCounters );
+        view->addEventHandler( monitor );
         canvas->addControl( vbox );
     }
 
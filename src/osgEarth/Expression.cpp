@@ -22,6 +22,7 @@
 #include <osgEarth/Expression>
 #include <osgEarth/StringUtils>
 #include <algorithm>
+#include <map>
 
 using namespace osgEarth;
 
@@ -565,3 +566,250 @@ StringExpression::evalURI() const
 {
     return URI(eval(), _uriContext);
 }
+
+//------------------------------------------------------------------------
+
+CompiledNumericExpression::CompiledNumericExpression() :
+_maxDepth(0u)
+{
+    //nop
+}
+
+CompiledNumericExpression::CompiledNumericExpression(const NumericExpression& expr) :
+_maxDepth(0u)
+{
+    compile(expr);
+}
+
+double
+CompiledNumericExpression::apply(Op op, double op1, double op2)
+{
+    switch(op)
+    {
+    case ADD:  return op1 + op2;
+    case SUB:  return op1 - op2;
+    case MULT: return op1 * op2;
+    case DIV:  return op1 / op2;
+    case MOD:  return fmod(op1, op2);
+    case MIN:  return osg::minimum(op1, op2);
+    default:   return osg::maximum(op1, op2);
+    }
+}
+
+void
+CompiledNumericExpression::compile(const NumericExpression& expr)
+{
+    _src = expr._src;
+    _code.clear();
+    _vars.clear();
+    _maxDepth = 0u;
+
+    // RPN index of each variable atom => its name
+    std::map<unsigned, std::string> varAtoms;
+    for (NumericExpression::Variables::const_iterator v = expr._vars.begin(); v != expr._vars.end(); ++v)
+        varAtoms[v->second] = v->first;
+
+    // The stack depth at each step doesn't depend on the data, so an operator
+    // that would underflow can be dropped here, just as eval() skips it.
+    unsigned depth = 0u;
+
+    for (unsigned i = 0; i < expr._rpn.size(); ++i)
+    {
+        const NumericExpression::Atom& a = expr._rpn[i];
+        Instruction in;
+        in.value = 0.0;
+        in.var = 0u;
+
+        if (a.first == NumericExpression::OPERAND || a.first == NumericExpression::VARIABLE)
+        {
+            std::map<unsigned, std::string>::const_iterator v = varAtoms.find(i);
+            if (a.first == NumericExpression::VARIABLE && v != varAtoms.end())
+            {
+                in.op = LOAD;
+                std::vector<std::string>::iterator name = std::find(_vars.begin(), _vars.end(), v->second);
+                in.var = (unsigned)(name - _vars.begin());
+                if (name == _vars.end())
+                    _vars.push_back(v->second);
+            }
+            else
+            {
+                in.op = PUSH;
+                in.value = a.second;
+            }
+            _code.push_back(in);
+            _maxDepth = std::max(_maxDepth, ++depth);
+        }
+        else if (a.first >= NumericExpression::ADD && a.first <= NumericExpression::MAX)
+        {
+            if (depth < 2u)
+                continue;
+
+            in.op =
+                a.first == NumericExpression::ADD  ? ADD :
+                a.first == NumericExpression::SUB  ? SUB :
+                a.first == NumericExpression::MULT ? MULT :
+                a.first == NumericExpression::DIV  ? DIV :
+                a.first == NumericExpression::MOD  ? MOD :
+                a.first == NumericExpression::MIN  ? MIN :
+                MAX;
+
+            // fold literal operands
+            unsigned n = _code.size();
+            if (_code[n-1].op == PUSH && _code[n-2].op == PUSH)
+            {
+                _code[n-2].value = apply(in.op, _code[n-2].value, _code[n-1].value);
+                _code.pop_back();
+            }
+            else
+            {
+                _code.push_back(in);
+            }
+            --depth;
+        }
+    }
+}
+
+double
+CompiledNumericExpression::eval(const double* values) const
+{
+    if (_code.empty())
+        return 0.0;
+
+    double fixed[16];
+    std::vector<double> dynamic;
+    double* s = fixed;
+    if (_maxDepth > 16u)
+    {
+        dynamic.resize(_maxDepth);
+        s = &dynamic[0];
+    }
+
+    unsigned top = 0u;
+    for (std::vector<Instruction>::const_iterator in = _code.begin(); in != _code.end(); ++in)
+    {
+        switch(in->op)
+        {
+        case PUSH: s[top++] = in->value; break;
+        case LOAD: s[top++] = values[in->var]; break;
+        default:
+            --top;
+            s[top-1] = apply(in->op, s[top-1], s[top]);
+        }
+    }
+
+    double value = s[top-1];
+    return !osg::isNaN(value) ? value : 0.0;
+}
+
+void
+CompiledNumericExpression::eval(const double* const* columns, unsigned count, double* output) const
+{
+    if (count == 0u)
+        return;
+
+    if (_code.empty())
+    {
+        std::fill(output, output + count, 0.0);
+        return;
+    }
+
+    // A stack of columns: each instruction runs down a whole column, which
+    // keeps the inner loops branch-free and lets the compiler vectorize them.
+    std::vector<double> stack(_maxDepth * count);
+    unsigned top = 0u;
+
+    for (std::vector<Instruction>::const_iterator in = _code.begin(); in != _code.end(); ++in)
+    {
+        if (in->op == PUSH)
+        {
+            std::fill(&stack[top*count], &stack[top*count] + count, in->value);
+            ++top;
+            continue;
+        }
+        if (in->op == LOAD)
+        {
+            std::copy(columns[in->var], columns[in->var] + count, &stack[top*count]);
+            ++top;
+            continue;
+        }
+
+        --top;
+        double* a = &stack[(top-1)*count];
+        const double* b = &stack[top*count];
+        switch(in->op)
+        {
+        case ADD:  for (unsigned i = 0; i < count; ++i) a[i] += b[i]; break;
+        case SUB:  for (unsigned i = 0; i < count; ++i) a[i] -= b[i]; break;
+        case MULT: for (unsigned i = 0; i < count; ++i) a[i] *= b[i]; break;
+        case DIV:  for (unsigned i = 0; i < count; ++i) a[i] /= b[i]; break;
+        case MOD:  for (unsigned i = 0; i < count; ++i) a[i] = fmod(a[i], b[i]); break;
+        case MIN:  for (unsigned i = 0; i < count; ++i) a[i] = osg::minimum(a[i], b[i]); break;
+        default:   for (unsigned i = 0; i < count; ++i) a[i] = osg::maximum(a[i], b[i]); break;
+        }
+    }
+
+    const double* result = &stack[(top-1)*count];
+    for (unsigned i = 0; i < count; ++i)
+        output[i] = !osg::isNaN(result[i]) ? result[i] : 0.0;
+}
+
+//------------------------------------------------------------------------
+
+CompiledStringExpression::CompiledStringExpression(const StringExpression& expr)
+{
+    compile(expr);
+}
+
+void
+CompiledStringExpression::compile(const StringExpression& expr)
+{
+    _src = expr._src;
+    _parts.clear();
+    _vars.clear();
+
+    // a literal set with setLiteral() has no atoms, just a value
+    if (expr._infix.empty() && !expr._dirty)
+    {
+        Part part;
+        part.isVariable = false;
+        part.text = expr._value;
+        part.var = 0u;
+        _parts.push_back(part);
+        return;
+    }
+
+    for (StringExpression::AtomVector::const_iterator a = expr._infix.begin(); a != expr._infix.end(); ++a)
+    {
+        Part part;
+        part.isVariable = a->first == StringExpression::VARIABLE;
+        part.var = 0u;
+
+        if (part.isVariable)
+        {
+            std::vector<std::string>::iterator name = std::find(_vars.begin(), _vars.end(), a->second);
+            part.var = (unsigned)(name - _vars.begin());
+            if (name == _vars.end())
+                _vars.push_back(a->second);
+            _parts.push_back(part);
+        }
+        else if (!_parts.empty() && !_parts.back().isVariable)
+        {
+            // merge adjacent literals
+            _parts.back().text += a->second;
+        }
+        else
+        {
+            part.text = a->second;
+            _parts.push_back(part);
+        }
+    }
+}
+
+std::string
+CompiledStringExpression::eval(const std::string* values) const
+{
+    std::string result;
+    for (std::vector<Part>::const_iterator p = _parts.begin(); p != _parts.end(); ++p)
+        result += p->isVariable ? values[p->var] : p->text;
+    return result;
+}
@@ -30,6 +30,7 @@
 #include <osgEarth/Tessellator>
 #include <osgEarth/LineDrawable>
 #include <osgEarth/StateSetCache>
+#include <osgEarth/MeshConsolidator>
 #include <osgEarth/Registry>
 
 #include <osg/Geode>
@@ -44,6 +45,9 @@
 
 #define LC "[ExtrudeGeometryFilter] "
 
+// Smallest number of features worth handing to a worker thread
+#define MIN_FEATURES_PER_CHUNK 32u
+
 using namespace osgEarth;
 
 namespace
@@ -100,7 +104,6 @@ void
 ExtrudeGeometryFilter::reset( const FilterContext& context )
 {
     _cosWallAngleThresh = cos( _wallAngleThresh_deg );
-    _geodes.clear();
     
     if ( _styleDirty )
     {
@@ -534,7 +537,8 @@ ExtrudeGeometryFilter::buildWallGeometry(const Structure&     structure,
                                          osg::Geometry*       walls,
                                          const osg::Vec4&     wallColor,
                                          const osg::Vec4&     wallBaseColor,
-                                         const SkinResource*  wallSkin)
+                                         const SkinResource*  wallSkin,
+                                         unsigned             wallSkinLayer)
 {
     bool madeGeom = true;
 
@@ -552,7 +556,7 @@ ExtrudeGeometryFilter::buildWallGeometry(const Structure&     structure,
     {
         bias.set (wallSkin->imageBiasS().get(),  wallSkin->imageBiasT().get());
         scale.set(wallSkin->imageScaleS().get(), wallSkin->imageScaleT().get());
-        layer = (float)wallSkin->imageLayer().get();
+        layer = (float)wallSkinLayer;
     }
 
     // create all the OSG geometry components
@@ -704,7 +708,8 @@ bool
 ExtrudeGeometryFilter::buildRoofGeometry(const Structure&     structure,
                                          osg::Geometry*       roof,
                                          const osg::Vec4&     roofColor,
-                                         const SkinResource*  roofSkin)
+                                         const SkinResource*  roofSkin,
+                                         unsigned             roofSkinLayer)
 {    
     osg::Vec3Array* verts = new osg::Vec3Array();
     roof->setVertexArray( verts );
@@ -751,7 +756,7 @@ ExtrudeGeometryFilter::buildRoofGeometry(const Structure&     structure,
 
                 if ( tex )
                 {
-                    tex->push_back( osg::Vec3f(f->left.roofTexU, f->left.roofTexV, (float)0.0f) );
+                    tex->push_back( osg::Vec3f(f->left.roofTexU, f->left.roofTexV, (float)roofSkinLayer) );
                 }
 
                 if ( anchors )
@@ -783,8 +788,12 @@ ExtrudeGeometryFilter::buildRoofGeometry(const Structure&     structure,
     int v = verts->size();
 
     // Tessellate the roof lines into polygons.
+    bool osgTessellator =
+        _roofPolygonSymbol.valid() &&
+        _roofPolygonSymbol->tessellation() == PolygonSymbol::TESSELLATION_OSG;
+
     osgEarth::Tessellator oeTess;
-    if (!oeTess.tessellateGeometry(*roof))
+    if (osgTessellator || !oeTess.tessellateGeometry(*roof))
     {
         //fallback to osg tessellator
         OE_DEBUG << LC << "Falling back on OSG tessellator (" << roof->getName() << ")" << std::endl;
@@ -950,7 +959,8 @@ ExtrudeGeometryFilter::addDrawable(osg::Drawable*       drawable,
                                    osg::StateSet*       stateSet,
                                    const std::string&   name,
                                    Feature*             feature,
-                                   FeatureIndexBuilder* index )
+                                   FeatureIndexBuilder* index,
+                                   BuildState&          state )
 {
     // find the geode for the active stateset, creating a new one if necessary. NULL is a 
     // valid key as well.
@@ -958,7 +968,7 @@ ExtrudeGeometryFilter::addDrawable(osg::Drawable*       drawable,
     
     if (dynamic_cast<LineDrawable*>(drawable))
     {
-        geode = _lineGroups[stateSet].get();
+        geode = state.lineGroups[stateSet].get();
         if (!geode)
         {
             geode = new LineGroup();
@@ -966,17 +976,17 @@ ExtrudeGeometryFilter::addDrawable(osg::Drawable*       drawable,
             {
                 geode->getOrCreateStateSet()->merge(*stateSet);
             }
-            _lineGroups[stateSet] = geode;
+            state.lineGroups[stateSet] = geode;
         }
     }
     else
     {
-        geode = _geodes[stateSet].get();
+        geode = state.geodes[stateSet].get();
         if (!geode)
         {
             geode = new osg::Geode();
             geode->setStateSet(stateSet);
-            _geodes[stateSet] = geode;
+            state.geodes[stateSet] = geode;
         }
     }
 
@@ -994,27 +1004,42 @@ ExtrudeGeometryFilter::addDrawable(osg::Drawable*       drawable,
 }
 
 bool
-ExtrudeGeometryFilter::process( FeatureList& features, FilterContext& context )
+ExtrudeGeometryFilter::process( FeatureList& features, FilterContext& context, BuildState& state )
 {
+    // compile the expressions once for the whole list
+    CompiledStringExpression polyScript;
+    if (_polySymbol.valid() && _polySymbol->script().isSet())
+        polyScript.compile(StringExpression(_polySymbol->script().get()));
+
+    CompiledStringExpression extrusionScript;
+    if ( _extrusionSymbol->script().isSet() )
+        extrusionScript.compile(StringExpression(_extrusionSymbol->script().get()));
+
+    CompiledNumericExpression heightExpr;
+    if ( state.heightExpr.isSet() )
+        heightExpr.compile(state.heightExpr.get());
+
+    CompiledStringExpression featureNameExpr;
+    if ( !_featureNameExpr.empty() )
+        featureNameExpr.compile(_featureNameExpr);
+
     for( FeatureList::iterator f = features.begin(); f != features.end(); ++f )
     {
         Feature* input = f->get();
 
         // run a symbol script if present.
-        if (_polySymbol.valid() && _polySymbol->script().isSet())
+        if (!polyScript.empty())
         {
-            StringExpression temp(_polySymbol->script().get());
-            input->eval(temp, &context);
+            input->eval(polyScript, &context);
         }
 
         if (input->getGeometry() == 0L)
             continue;
 
         // run a symbol script if present.
-        if ( _extrusionSymbol->script().isSet() )
+        if ( !extrusionScript.empty() )
         {
-            StringExpression temp( _extrusionSymbol->script().get() );
-            input->eval( temp, &context );
+            input->eval( extrusionScript, &context );
         }
 
         if (input->getGeometry() == 0L)
@@ -1056,9 +1081,9 @@ ExtrudeGeometryFilter::process( FeatureList& features, FilterContext& context )
             {
                 height = _heightCallback->operator()(input, context);
             }
-            else if ( _heightExpr.isSet() )
+            else if ( state.heightExpr.isSet() )
             {
-                height = input->eval( _heightExpr.mutable_value(), &context );
+                height = input->eval( heightExpr, &context );
             }
             else
             {
@@ -1141,9 +1166,17 @@ ExtrudeGeometryFilter::process( FeatureList& features, FilterContext& context )
                     wallBaseColor = wallColor;
                 }
 
-                buildWallGeometry(structure, walls.get(), wallColor, wallBaseColor, wallSkin);
+                // Skins in the shared array all draw with its one stateset
+                // and pick their layer with the third texture coordinate.
+                unsigned wallSkinLayer = wallSkin ? wallSkin->imageLayer().get() : 0u;
+                if ( wallSkin && _wallSkinArray.valid() && _wallSkinArray->getLayer(wallSkin, wallSkinLayer) )
+                {
+                    wallStateSet = _wallSkinArray->stateSet.get();
+                }
+
+                buildWallGeometry(structure, walls.get(), wallColor, wallBaseColor, wallSkin, wallSkinLayer);
 
-                if ( wallSkin )
+                if ( wallSkin && !wallStateSet.valid() )
                 {
                     // Get a stateset for the individual wall stateset
                     context.resourceCache()->getOrCreateStateSet(wallSkin, wallStateSet, context.getDBOptions());
@@ -1159,9 +1192,15 @@ ExtrudeGeometryFilter::process( FeatureList& features, FilterContext& context )
                     roofColor = _roofPolygonSymbol->fill()->color();
                 }
 
-                buildRoofGeometry(structure, rooflines.get(), roofColor, roofSkin);
+                unsigned roofSkinLayer = roofSkin ? roofSkin->imageLayer().get() : 0u;
+                if ( roofSkin && _roofSkinArray.valid() && _roofSkinArray->getLayer(roofSkin, roofSkinLayer) )
+                {
+                    roofStateSet = _roofSkinArray->stateSet.get();
+                }
 
-                if ( roofSkin )
+                buildRoofGeometry(structure, rooflines.get(), roofColor, roofSkin, roofSkinLayer);
+
+                if ( roofSkin && !roofStateSet.valid() )
                 {
                     // Get a stateset for the individual roof skin
                     context.resourceCache()->getOrCreateStateSet(roofSkin, roofStateSet, context.getDBOptions());
@@ -1184,28 +1223,28 @@ ExtrudeGeometryFilter::process( FeatureList& features, FilterContext& context )
             // Set up for feature naming and feature indexing:
             std::string name;
             if ( !_featureNameExpr.empty() )
-                name = input->eval( _featureNameExpr, &context );
+                name = input->eval( featureNameExpr, &context );
 
             FeatureIndexBuilder* index = context.featureIndex();
 
             if ( walls.valid() && walls->getVertexArray() && walls->getVertexArray()->getNumElements() > 0 )
             {
-                addDrawable( walls.get(), wallStateSet.get(), name, input, index );
+                addDrawable( walls.get(), wallStateSet.get(), name, input, index, state );
             }
 
             if ( rooflines.valid() && rooflines->getVertexArray() && rooflines->getVertexArray()->getNumElements() > 0 )
             {
-                addDrawable( rooflines.get(), roofStateSet.get(), name, input, index );
+                addDrawable( rooflines.get(), roofStateSet.get(), name, input, index, state );
             }
 
             if ( baselines.valid() && baselines->getVertexArray() && baselines->getVertexArray()->getNumElements() > 0 )
             {
-                addDrawable( baselines.get(), 0L, name, input, index );
+                addDrawable( baselines.get(), 0L, name, input, index, state );
             }
 
             if ( outlines.valid() )
             {
-                addDrawable( outlines.get(), 0L, name, input, index );
+                addDrawable( outlines.get(), 0L, name, input, index, state );
             }
         }
     }
@@ -1228,6 +1267,8 @@ ExtrudeGeometryFilter::push( FeatureList& input, FilterContext& context )
     // establish the active resource library, if applicable.
     _wallResLib = 0L;
     _roofResLib = 0L;
+    _wallSkinArray = 0L;
+    _roofSkinArray = 0L;
 
     const StyleSheet* sheet = context.getSession() ? context.getSession()->styles() : 0L;
 
@@ -1257,35 +1298,140 @@ ExtrudeGeometryFilter::push( FeatureList& input, FilterContext& context )
         }
     }
 
+    // gather the skins into shared texture arrays, if requested
+    if ( context.resourceCache() )
+    {
+        if ( _wallResLib.valid() && _wallSkinSymbol->atlas() == true )
+        {
+            context.resourceCache()->getOrCreateSkinArray(
+                _wallResLib.get(), _wallSkinSymbol.get(), _wallSkinArray, context.getDBOptions());
+        }
+
+        if ( _roofResLib.valid() && _roofSkinSymbol->atlas() == true )
+        {
+            context.resourceCache()->getOrCreateSkinArray(
+                _roofResLib.get(), _roofSkinSymbol.get(), _roofSkinArray, context.getDBOptions());
+        }
+    }
+
     // calculate the localization matrices (_local2world and _world2local)
     computeLocalizers( context );
 
+    // Features are independent of each other, so we can split the list into
+    // contiguous chunks and extrude them concurrently. Scripts, the feature
+    // name expression, and a user height callback evaluate through shared
+    // state that isn't thread-safe, so they force a serial build.
+    Threading::JobArena* arena = Registry::instance()->getJobArena("features.build");
+
+    unsigned numChunks = 1u;
+    if ( _featureNameExpr.empty() && !_heightCallback.valid() &&
+         (context.getSession() == 0L || context.getSession()->getScriptEngine() == 0L) )
+    {
+        numChunks = osg::minimum(
+            arena->getConcurrency() + 1u,
+            (unsigned)input.size() / MIN_FEATURES_PER_CHUNK);
+    }
+    numChunks = osg::maximum(numChunks, 1u);
+
+    std::vector<BuildState> states(numChunks);
+    for(unsigned c = 0; c < numChunks; ++c)
+        states[c].heightExpr = _heightExpr;
+
     // push all the features through the extruder.
-    bool ok = process( input, context );
+    bool ok = true;
+
+    if ( numChunks == 1u )
+    {
+        ok = process( input, context, states[0] );
+    }
+    else
+    {
+        std::vector<FeatureList> chunks(numChunks);
+        unsigned n = 0u, size = (unsigned)input.size();
+        for(FeatureList::iterator f = input.begin(); f != input.end(); ++f, ++n)
+            chunks[(n*numChunks)/size].push_back(*f);
+
+        // Dispatch all but the first chunk, which we build in this thread
+        // since it would otherwise just sit and wait.
+        std::vector<char> chunkOK(numChunks, 1);
+        std::vector<Threading::Future<osg::Referenced> > futures;
+        for(unsigned c = 1; c < numChunks; ++c)
+        {
+            Threading::Promise<osg::Referenced> promise;
+            futures.push_back(promise.getFuture());
+
+            Threading::runInJobArena(arena, [this, promise, c, &chunks, &states, &chunkOK, &context]() mutable {
+                chunkOK[c] = process(chunks[c], context, states[c]) ? 1 : 0;
+                promise.resolve(0L);
+            });
+        }
+
+        chunkOK[0] = process( chunks[0], context, states[0] ) ? 1 : 0;
+
+        // Wait for everything; the jobs reference our stack.
+        Threading::when_all(futures).get();
+
+        for(unsigned c = 0; c < numChunks; ++c)
+            ok = ok && chunkOK[c] != 0;
+    }
+
+    // Gather the per-chunk geodes by stateset, in chunk order so the
+    // output doesn't depend on timing.
+    SortedGeodeMap geodes, lineGroups;
+    for(unsigned c = 0; c < numChunks; ++c)
+    {
+        for(int pass = 0; pass < 2; ++pass)
+        {
+            SortedGeodeMap& from = pass == 0 ? states[c].geodes : states[c].lineGroups;
+            SortedGeodeMap& to   = pass == 0 ? geodes : lineGroups;
+
+            for( SortedGeodeMap::iterator i = from.begin(); i != from.end(); ++i )
+            {
+                osg::ref_ptr<osg::Geode>& target = to[i->first];
+                if ( !target.valid() )
+                {
+                    target = i->second.get();
+                }
+                else
+                {
+                    for(unsigned d = 0; d < i->second->getNumDrawables(); ++d)
+                        target->addDrawable( i->second->getDrawable(d) );
+                }
+            }
+        }
+    }
 
     // parent geometry with a delocalizer (if necessary)
     osg::Group* group = createDelocalizeGroup();
     
-    for( SortedGeodeMap::iterator i = _geodes.begin(); i != _geodes.end(); ++i )
+    for( SortedGeodeMap::iterator i = geodes.begin(); i != geodes.end(); ++i )
     {
         group->addChild( i->second.get() );
     }
-    _geodes.clear();
 
-    for (SortedGeodeMap::iterator i = _lineGroups.begin(); i != _lineGroups.end(); ++i)
+    for (SortedGeodeMap::iterator i = lineGroups.begin(); i != lineGroups.end(); ++i)
     {
         group->addChild(i->second.get());
     }
-    _lineGroups.clear();
 
     if ( _mergeGeometry == true && _featureNameExpr.empty() )
     {
         osg::ref_ptr<StateSetCache> cache = new StateSetCache();
         cache->consolidateStateSets(group);
 
+        // Concatenate the per-part meshes straight into pre-sized arrays.
+        unsigned maxVerts = Registry::instance()->getMaxNumberOfVertsPerDrawable();
+        for( SortedGeodeMap::iterator i = geodes.begin(); i != geodes.end(); ++i )
+        {
+            MeshConsolidator::mergeTriangleMeshes( *i->second.get(), maxVerts );
+        }
+
         osgUtil::Optimizer::MergeGeometryVisitor mg;
-        mg.setTargetMaximumNumberOfVertices(Registry::instance()->getMaxNumberOfVertsPerDrawable());
-        group->accept(mg);
+        mg.setTargetMaximumNumberOfVertices(maxVerts);
+        for( SortedGeodeMap::iterator i = lineGroups.begin(); i != lineGroups.end(); ++i )
+        {
+            i->second->accept(mg);
+        }
     }
 
     // Prepare buffer objects.
@@ -535,6 +535,79 @@ Feature::eval(StringExpression& expr, Session* session) const
     return expr.eval();
 }
 
+double
+Feature::eval(const CompiledNumericExpression& expr, FilterContext const* context) const
+{
+    double fixed[8];
+    std::vector<double> dynamic;
+    double* values = fixed;
+    if (expr.getNumVariables() > 8u)
+    {
+        dynamic.resize(expr.getNumVariables());
+        values = &dynamic[0];
+    }
+
+    for (unsigned i = 0; i < expr.getNumVariables(); ++i)
+    {
+        double val = 0.0;
+        AttributeTable::const_iterator ai = _attrs.find(expr.getVariable(i));
+        if (ai != _attrs.end())
+        {
+            val = ai->second.getDouble(0.0);
+        }
+        else if (context && context->getSession())
+        {
+            //No attr found, look for script
+            ScriptEngine* engine = context->getSession()->getScriptEngine();
+            if (engine)
+            {
+                ScriptResult result = engine->run(expr.getVariable(i), this, context);
+                if (result.success())
+                    val = result.asDouble();
+                else {
+                    OE_WARN << LC << "Feature Script error on '" << expr.expr() << "': " << result.message() << std::endl;
+                }
+            }
+        }
+        values[i] = val;
+    }
+
+    return expr.eval(values);
+}
+
+std::string
+Feature::eval(const CompiledStringExpression& expr, FilterContext const* context) const
+{
+    std::vector<std::string> values(expr.getNumVariables());
+
+    for (unsigned i = 0; i < expr.getNumVariables(); ++i)
+    {
+        AttributeTable::const_iterator ai = _attrs.find(expr.getVariable(i));
+        if (ai != _attrs.end())
+        {
+            values[i] = ai->second.getString();
+        }
+        else if (context && context->getSession())
+        {
+            //No attr found, look for script
+            ScriptEngine* engine = context->getSession()->getScriptEngine();
+            if (engine)
+            {
+                ScriptResult result = engine->run(expr.getVariable(i), this, context);
+                if (result.success())
+                    values[i] = result.asString();
+                else
+                {
+                    // Couldn't execute it as code, just take it as a string literal.
+                    values[i] = expr.getVariable(i);
+                    OE_DEBUG << LC << "Feature Script error on '" << expr.expr() << "': " << result.message() << std::endl;
+                }
+            }
+        }
+    }
+
+    return expr.eval(values.empty() ? 0L : &values[0]);
+}
 
 bool
 Feature::getWorldBound(const SpatialReference* srs,
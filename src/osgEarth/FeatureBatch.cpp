@@ -0,0 +1,524 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+ * Copyright 2020 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarth/FeatureBatch>
+#include <algorithm>
+
+#define LC "[FeatureBatch] "
+
+using namespace osgEarth;
+
+//---------------------------------------------------------------------------
+
+FeatureBatch::FeatureBatch()
+{
+    _firstPart.push_back(0u);
+}
+
+FeatureBatch::FeatureBatch(const SpatialReference* srs) :
+    _srs(srs)
+{
+    _firstPart.push_back(0u);
+}
+
+void
+FeatureBatch::reserve(unsigned features, unsigned coords)
+{
+    _fids.reserve(features);
+    _types.reserve(features);
+    _firstPart.reserve(features + 1);
+    _parts.reserve(features);
+    _coords.reserve(coords);
+    for (std::vector<Column>::iterator c = _columns.begin(); c != _columns.end(); ++c)
+    {
+        c->set.reserve(features);
+        if (c->type == ATTRTYPE_DOUBLE) c->doubles.reserve(features);
+        else if (c->type == ATTRTYPE_INT || c->type == ATTRTYPE_BOOL) c->ints.reserve(features);
+        else c->offsets.reserve(features * 2);
+    }
+}
+
+void
+FeatureBatch::clear()
+{
+    _fids.clear();
+    _types.clear();
+    _firstPart.resize(1);
+    _parts.clear();
+    _coords.clear();
+    for (std::vector<Column>::iterator c = _columns.begin(); c != _columns.end(); ++c)
+    {
+        c->doubles.clear();
+        c->ints.clear();
+        c->offsets.clear();
+        c->set.clear();
+    }
+    _strings.clear();
+    _arrays.clear();
+    _styles.clear();
+    _geoInterps.clear();
+}
+
+int
+FeatureBatch::getSlot(const std::string& name) const
+{
+    std::map<std::string, unsigned, CIStringComp>::const_iterator i = _slots.find(name);
+    return i != _slots.end() ? (int)i->second : -1;
+}
+
+unsigned
+FeatureBatch::getOrAddSlot(const std::string& name, AttributeType type)
+{
+    std::map<std::string, unsigned, CIStringComp>::const_iterator i = _slots.find(name);
+    if (i != _slots.end())
+        return i->second;
+
+    unsigned slot = (unsigned)_columns.size();
+    _slots[name] = slot;
+    _columns.push_back(Column());
+    Column& c = _columns.back();
+    c.name = name;
+    c.type = type == ATTRTYPE_UNSPECIFIED ? ATTRTYPE_STRING : type;
+
+    // earlier rows have no value in the new column
+    for (unsigned row = 0; row < size(); ++row)
+    {
+        c.set.push_back(VALUE_ABSENT);
+        if (c.type == ATTRTYPE_DOUBLE) c.doubles.push_back(0.0);
+        else if (c.type == ATTRTYPE_INT || c.type == ATTRTYPE_BOOL) c.ints.push_back(0);
+        else { c.offsets.push_back(0u); c.offsets.push_back(0u); }
+    }
+    return slot;
+}
+
+void
+FeatureBatch::appendRow()
+{
+    for (std::vector<Column>::iterator c = _columns.begin(); c != _columns.end(); ++c)
+    {
+        c->set.push_back(VALUE_ABSENT);
+        if (c->type == ATTRTYPE_DOUBLE) c->doubles.push_back(0.0);
+        else if (c->type == ATTRTYPE_INT || c->type == ATTRTYPE_BOOL) c->ints.push_back(0);
+        else { c->offsets.push_back(0u); c->offsets.push_back(0u); }
+    }
+}
+
+unsigned
+FeatureBatch::addFeature(FeatureID fid, Geometry::Type type)
+{
+    unsigned index = size();
+    _fids.push_back(fid);
+    _types.push_back(type);
+    _firstPart.push_back((unsigned)_parts.size());
+    appendRow();
+    return index;
+}
+
+void
+FeatureBatch::addPart(const osg::Vec3d* coords, unsigned count, Geometry::Type type, bool hole)
+{
+    if (empty())
+        return;
+
+    Part part;
+    part.offset = (unsigned)_coords.size();
+    part.count = count;
+    part.type = type;
+    part.hole = hole;
+    _parts.push_back(part);
+    _coords.insert(_coords.end(), coords, coords + count);
+    _firstPart.back() = (unsigned)_parts.size();
+}
+
+void
+FeatureBatch::addGeometry(const Geometry* geom)
+{
+    if (geom->getType() == Geometry::TYPE_MULTI)
+    {
+        const MultiGeometry* multi = static_cast<const MultiGeometry*>(geom);
+        for (GeometryCollection::const_iterator i = multi->getComponents().begin(); i != multi->getComponents().end(); ++i)
+        {
+            if (i->valid())
+                addGeometry(i->get());
+        }
+        return;
+    }
+
+    const osg::Vec3d* data = geom->empty() ? 0L : &geom->front();
+    addPart(data, (unsigned)geom->size(), geom->getType(), false);
+
+    if (geom->getType() == Geometry::TYPE_POLYGON)
+    {
+        const RingCollection& holes = static_cast<const Polygon*>(geom)->getHoles();
+        for (RingCollection::const_iterator h = holes.begin(); h != holes.end(); ++h)
+        {
+            if (h->valid())
+                addPart((*h)->empty() ? 0L : &(*h)->front(), (unsigned)(*h)->size(), Geometry::TYPE_RING, true);
+        }
+    }
+}
+
+unsigned
+FeatureBatch::add(const Feature* feature)
+{
+    if (!_srs.valid())
+        _srs = feature->getSRS();
+
+    const Geometry* geom = feature->getGeometry();
+    unsigned index = addFeature(feature->getFID(), geom ? geom->getType() : Geometry::TYPE_UNKNOWN);
+
+    if (geom)
+        addGeometry(geom);
+
+    const AttributeTable& attrs = feature->getAttrs();
+    for (AttributeTable::const_iterator a = attrs.begin(); a != attrs.end(); ++a)
+    {
+        unsigned slot = getOrAddSlot(a->first, a->second.first);
+        setValue(slot, index, a->second);
+    }
+
+    if (feature->style().isSet())
+        _styles[index] = feature->style().get();
+
+    if (feature->geoInterp().isSet())
+        _geoInterps[index] = feature->geoInterp().get();
+
+    return index;
+}
+
+void
+FeatureBatch::add(const FeatureList& features)
+{
+    for (FeatureList::const_iterator f = features.begin(); f != features.end(); ++f)
+    {
+        if (f->valid())
+            add(f->get());
+    }
+}
+
+unsigned
+FeatureBatch::getFirstCoord(unsigned i) const
+{
+    return _firstPart[i] < _firstPart[i + 1] ? _parts[_firstPart[i]].offset : 0u;
+}
+
+unsigned
+FeatureBatch::getNumCoords(unsigned i) const
+{
+    unsigned count = 0;
+    for (unsigned p = _firstPart[i]; p < _firstPart[i + 1]; ++p)
+        count += _parts[p].count;
+    return count;
+}
+
+double
+FeatureBatch::getDouble(unsigned slot, unsigned i, double defaultValue) const
+{
+    const Column& c = _columns[slot];
+    if (c.set[i] != VALUE_SET)
+        return defaultValue;
+    if (c.type == ATTRTYPE_DOUBLE)
+        return c.doubles[i];
+    if (c.type == ATTRTYPE_INT || c.type == ATTRTYPE_BOOL)
+        return (double)c.ints[i];
+
+    AttributeValue value;
+    getValue(slot, i, value);
+    return value.getDouble(defaultValue);
+}
+
+long long
+FeatureBatch::getInt(unsigned slot, unsigned i, long long defaultValue) const
+{
+    const Column& c = _columns[slot];
+    if (c.set[i] != VALUE_SET)
+        return defaultValue;
+    if (c.type == ATTRTYPE_INT || c.type == ATTRTYPE_BOOL)
+        return c.ints[i];
+    if (c.type == ATTRTYPE_DOUBLE)
+        return (long long)c.doubles[i];
+
+    AttributeValue value;
+    getValue(slot, i, value);
+    return value.getInt(defaultValue);
+}
+
+bool
+FeatureBatch::getBool(unsigned slot, unsigned i, bool defaultValue) const
+{
+    const Column& c = _columns[slot];
+    if (c.set[i] != VALUE_SET)
+        return defaultValue;
+    if (c.type == ATTRTYPE_INT || c.type == ATTRTYPE_BOOL)
+        return c.ints[i] != 0;
+    if (c.type == ATTRTYPE_DOUBLE)
+        return c.doubles[i] != 0.0;
+
+    AttributeValue value;
+    getValue(slot, i, value);
+    return value.getBool(defaultValue);
+}
+
+std::string
+FeatureBatch::getString(unsigned slot, unsigned i) const
+{
+    const Column& c = _columns[slot];
+    if (c.set[i] != VALUE_SET)
+        return std::string();
+    if (c.type == ATTRTYPE_STRING)
+        return std::string(_strings.data() + c.offsets[2 * i], c.offsets[2 * i + 1] - c.offsets[2 * i]);
+
+    AttributeValue value;
+    getValue(slot, i, value);
+    return value.getString();
+}
+
+void
+FeatureBatch::setDouble(unsigned slot, unsigned i, double v)
+{
+    AttributeValue value;
+    value.first = ATTRTYPE_DOUBLE;
+    value.second.doubleValue = v;
+    value.second.set = true;
+    setValue(slot, i, value);
+}
+
+void
+FeatureBatch::setInt(unsigned slot, unsigned i, long long v)
+{
+    AttributeValue value;
+    value.first = ATTRTYPE_INT;
+    value.second.intValue = v;
+    value.second.set = true;
+    setValue(slot, i, value);
+}
+
+void
+FeatureBatch::setBool(unsigned slot, unsigned i, bool v)
+{
+    AttributeValue value;
+    value.first = ATTRTYPE_BOOL;
+    value.second.boolValue = v;
+    value.second.set = true;
+    setValue(slot, i, value);
+}
+
+void
+FeatureBatch::setString(unsigned slot, unsigned i, const std::string& v)
+{
+    AttributeValue value;
+    value.first = ATTRTYPE_STRING;
+    value.second.stringValue = v;
+    value.second.set = true;
+    setValue(slot, i, value);
+}
+
+void
+FeatureBatch::setNull(unsigned slot, unsigned i)
+{
+    _columns[slot].set[i] = VALUE_NULL;
+}
+
+void
+FeatureBatch::setValue(unsigned slot, unsigned i, const AttributeValue& value)
+{
+    Column& c = _columns[slot];
+    c.set[i] = value.second.set ? VALUE_SET : VALUE_NULL;
+    if (!value.second.set)
+        return;
+
+    // values are converted to the column's type, which is fixed by
+    // the first feature that carried the attribute
+    switch (c.type)
+    {
+    case ATTRTYPE_DOUBLE:
+        c.doubles[i] = value.getDouble();
+        break;
+    case ATTRTYPE_INT:
+        c.ints[i] = value.getInt();
+        break;
+    case ATTRTYPE_BOOL:
+        c.ints[i] = value.getBool() ? 1 : 0;
+        break;
+    case ATTRTYPE_DOUBLEARRAY:
+        {
+            const std::vector<double>& a = value.getDoubleArrayValue();
+            c.offsets[2 * i] = (unsigned)_arrays.size();
+            _arrays.insert(_arrays.end(), a.begin(), a.end());
+            c.offsets[2 * i + 1] = (unsigned)_arrays.size();
+        }
+        break;
+    default:
+        {
+            std::string s = value.getString();
+            c.offsets[2 * i] = (unsigned)_strings.size();
+            _strings.insert(_strings.end(), s.begin(), s.end());
+            c.offsets[2 * i + 1] = (unsigned)_strings.size();
+        }
+        break;
+    }
+}
+
+void
+FeatureBatch::getValue(unsigned slot, unsigned i, AttributeValue& value) const
+{
+    const Column& c = _columns[slot];
+    value.first = c.type;
+    value.second.set = c.set[i] == VALUE_SET;
+    if (!value.second.set)
+        return;
+
+    switch (c.type)
+    {
+    case ATTRTYPE_DOUBLE:
+        value.second.doubleValue = c.doubles[i];
+        break;
+    case ATTRTYPE_INT:
+        value.second.intValue = c.ints[i];
+        break;
+    case ATTRTYPE_BOOL:
+        value.second.boolValue = c.ints[i] != 0;
+        break;
+    case ATTRTYPE_DOUBLEARRAY:
+        value.second.doubleArrayValue.assign(
+            _arrays.begin() + c.offsets[2 * i],
+            _arrays.begin() + c.offsets[2 * i + 1]);
+        break;
+    default:
+        value.second.stringValue.assign(
+            _strings.begin() + c.offsets[2 * i],
+            _strings.begin() + c.offsets[2 * i + 1]);
+        break;
+    }
+}
+
+bool
+FeatureBatch::eval(const CompiledNumericExpression& expr, std::vector<double>& output) const
+{
+    unsigned numVars = expr.getNumVariables();
+    std::vector<int> slots(numVars);
+    for (unsigned v = 0; v < numVars; ++v)
+    {
+        slots[v] = getSlot(expr.getVariable(v));
+        if (slots[v] < 0)
+            return false;
+    }
+
+    output.resize(size());
+    if (empty())
+        return true;
+
+    // numeric columns that are fully set are read in place
+    std::vector<std::vector<double> > converted(numVars);
+    std::vector<const double*> columns(numVars);
+    for (unsigned v = 0; v < numVars; ++v)
+    {
+        const Column& c = _columns[slots[v]];
+        bool direct =
+            c.type == ATTRTYPE_DOUBLE &&
+            std::find(c.set.begin(), c.set.end(), (unsigned char)VALUE_ABSENT) == c.set.end() &&
+            std::find(c.set.begin(), c.set.end(), (unsigned char)VALUE_NULL) == c.set.end();
+
+        if (direct)
+        {
+            columns[v] = &c.doubles[0];
+        }
+        else
+        {
+            converted[v].resize(size());
+            for (unsigned i = 0; i < size(); ++i)
+                converted[v][i] = getDouble(slots[v], i, 0.0);
+            columns[v] = &converted[v][0];
+        }
+    }
+
+    expr.eval(numVars > 0 ? &columns[0] : 0L, size(), &output[0]);
+    return true;
+}
+
+Feature*
+FeatureBatch::createFeature(unsigned i) const
+{
+    // rebuild the geometry hierarchy from the flat parts
+    GeometryCollection geoms;
+    for (unsigned p = _firstPart[i]; p < _firstPart[i + 1]; ++p)
+    {
+        const Part& part = _parts[p];
+        const osg::Vec3d* begin = part.count > 0 ? &_coords[part.offset] : 0L;
+
+        if (part.hole && !geoms.empty() && geoms.back()->getType() == Geometry::TYPE_POLYGON)
+        {
+            Ring* hole = new Ring(part.count);
+            hole->insert(hole->end(), begin, begin + part.count);
+            static_cast<Polygon*>(geoms.back().get())->getHoles().push_back(hole);
+        }
+        else
+        {
+            Geometry* geom =
+                part.type == Geometry::TYPE_POLYGON ? new Polygon(part.count) :
+                part.type == Geometry::TYPE_RING ? new Ring(part.count) :
+                part.type == Geometry::TYPE_LINESTRING ? new LineString(part.count) :
+                part.type == Geometry::TYPE_POINT ? new Point(part.count) :
+                part.type == Geometry::TYPE_POINTSET ? new PointSet(part.count) :
+                new Geometry(part.count);
+            geom->insert(geom->end(), begin, begin + part.count);
+            geoms.push_back(geom);
+        }
+    }
+
+    osg::ref_ptr<Geometry> geom;
+    if (_types[i] == Geometry::TYPE_MULTI)
+        geom = new MultiGeometry(geoms);
+    else if (!geoms.empty())
+        geom = geoms.front().get();
+
+    Feature* feature = new Feature(geom.get(), _srs.get(), Style(), _fids[i]);
+
+    AttributeValue value;
+    for (unsigned slot = 0; slot < _columns.size(); ++slot)
+    {
+        if (_columns[slot].set[i] == VALUE_SET)
+        {
+            getValue(slot, i, value);
+            feature->set(_columns[slot].name, value);
+        }
+        else if (_columns[slot].set[i] == VALUE_NULL)
+        {
+            feature->setNull(_columns[slot].name, _columns[slot].type);
+        }
+    }
+
+    std::map<unsigned, Style>::const_iterator style = _styles.find(i);
+    if (style != _styles.end())
+        feature->style() = style->second;
+
+    std::map<unsigned, GeoInterpolation>::const_iterator interp = _geoInterps.find(i);
+    if (interp != _geoInterps.end())
+        feature->geoInterp() = interp->second;
+
+    return feature;
+}
+
+void
+FeatureBatch::getFeatures(FeatureList& output) const
+{
+    for (unsigned i = 0; i < size(); ++i)
+    {
+        output.push_back(createFeature(i));
+    }
+}
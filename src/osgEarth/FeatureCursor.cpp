@@ -46,6 +46,22 @@ FeatureCursor::fill(FeatureList& list)
     }
 }
 
+bool
+FeatureCursor::nextBatch(FeatureBatch& output, unsigned maxFeatures)
+{
+    unsigned count = 0;
+    while (hasMore() && (maxFeatures == 0 || count < maxFeatures))
+    {
+        osg::ref_ptr<Feature> feature = nextFeature();
+        if (feature.valid())
+        {
+            output.add(feature.get());
+            ++count;
+        }
+    }
+    return count > 0;
+}
+
 //---------------------------------------------------------------------------
 
 FeatureListCursor::FeatureListCursor(const FeatureList& features) :
@@ -17,6 +17,11 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>
  */
 #include <osgEarth/FeatureElevationLayer>
+#include <osgEarth/Registry>
+#include <osgEarth/Progress>
+#include <osgEarth/Threading>
+#include <algorithm>
+#include <atomic>
 
 using namespace osgEarth;
 
@@ -27,6 +32,243 @@ using namespace osgEarth;
 REGISTER_OSGEARTH_LAYER(featureelevation, FeatureElevationLayer);
 REGISTER_OSGEARTH_LAYER(feature_elevation, FeatureElevationLayer);
 
+namespace
+{
+    // One polygon ring edge, spanning [ymin, ymax) in the tile's SRS
+    struct Edge
+    {
+        double xi, yi, xj, yj;
+        double ymin, ymax;
+        unsigned ring; // 0 = outer boundary, 1+ = holes
+
+        bool operator < (const Edge& rhs) const { return ymin < rhs.ymin; }
+
+        // X where the edge crosses the scanline at "y" (same
+        // arithmetic as Ring::contains2D)
+        inline double crossing(double y) const {
+            return (xj - xi) * (y - yi) / (yj - yi) + xi;
+        }
+    };
+
+    // A polygon feature prepared for scanline rasterization
+    struct RasterPolygon
+    {
+        float h;
+        Bounds bounds;
+        std::vector<Edge> edges; // sorted by ymin
+        osg::Matrix localToWorld, worldToLocal;
+    };
+
+    void addEdges(std::vector<Edge>& edges, const std::vector<osg::Vec3d>& ring, unsigned ringIndex, Bounds& bounds)
+    {
+        for (unsigned i = 0, j = ring.size() - 1; i < ring.size(); j = i++)
+        {
+            bounds.expandBy(ring[i].x(), ring[i].y());
+
+            // horizontal edges never cross a scanline
+            if (ring[i].y() == ring[j].y())
+                continue;
+
+            Edge e;
+            e.xi = ring[i].x(), e.yi = ring[i].y();
+            e.xj = ring[j].x(), e.yj = ring[j].y();
+            e.ymin = osg::minimum(e.yi, e.yj);
+            e.ymax = osg::maximum(e.yi, e.yj);
+            e.ring = ringIndex;
+            edges.push_back(e);
+        }
+    }
+
+    // Sorts the crossings for one scanline by ring, then by X
+    struct Crossing
+    {
+        unsigned ring;
+        double x;
+        bool operator < (const Crossing& rhs) const {
+            return ring < rhs.ring || (ring == rhs.ring && x < rhs.x);
+        }
+    };
+
+    const unsigned MIN_ROWS_PER_STRIP = 32u;
+
+    // Rasterizes polygon features into a heightfield, a strip of rows at a
+    // time. Each row only visits the polygons binned to it, and each of
+    // those only the edges whose Y span reaches the row, so the cost goes
+    // with the number of polygon edges instead of posts x features.
+    struct StripRasterizer : public osg::Referenced
+    {
+        std::vector<RasterPolygon> _polygons;
+        std::vector<std::vector<unsigned> > _rows; // polygon indices per row, in feature order
+        osg::ref_ptr<osg::HeightField> _hf;
+        const SpatialReference* _keySRS;
+        const SpatialReference* _featureSRS;
+        bool _transformRequired;
+        double _xmin, _ymin, _dx, _dy;
+        double _offset;
+        osg::ref_ptr<ProgressCallback> _progress;
+        unsigned _numStrips;
+        std::atomic_uint _next;
+        std::vector<Threading::Promise<osg::Referenced> > _done;
+
+        StripRasterizer() : _numStrips(1u), _next(0u) { }
+
+        // First column whose X is at or after "x"
+        unsigned firstColumnAt(double x) const
+        {
+            unsigned numCols = _hf->getNumColumns();
+            double f = ceil((x - _xmin) / _dx);
+            if (f <= 0.0) return 0u;
+            if (f >= (double)numCols) return numCols;
+            unsigned c = (unsigned)f;
+            while (c > 0 && _xmin + _dx*(double)(c-1) >= x) --c;
+            while (c < numCols && _xmin + _dx*(double)c < x) ++c;
+            return c;
+        }
+
+        // Height of a post covered by polygon "p"
+        float height(const RasterPolygon& p, double geoX, double geoY) const
+        {
+            float h = p.h;
+
+            if (_keySRS->isGeographic())
+            {
+                // for a round earth, must adjust the final elevation accounting for the
+                // curvature of the earth; so we have to adjust it in the feature boundary's
+                // local tangent plane.
+                GeoPoint geo(_keySRS, geoX, geoY, 0.0, ALTMODE_ABSOLUTE);
+                if (_transformRequired)
+                    geo = geo.transform(_featureSRS);
+
+                // Get the ECEF location of the post:
+                osg::Vec3d ecef;
+                geo.toWorld(ecef);
+
+                // Move it into Local Tangent Plane coordinates:
+                osg::Vec3d local = ecef * p.worldToLocal;
+
+                // Reset the Z to zero, since the LTP is centered on the "h" elevation:
+                local.z() = 0.0;
+
+                // Back into ECEF:
+                ecef = local * p.localToWorld;
+
+                // And back into lat/long/alt:
+                geo.fromWorld(geo.getSRS(), ecef);
+
+                h = geo.z();
+            }
+
+            return h;
+        }
+
+        void rasterizeRow(unsigned row, std::vector<Crossing>& crossings, std::vector<char>& covered, std::vector<char>& written)
+        {
+            double geoY = _ymin + (_dy * (double)row);
+
+            std::fill(written.begin(), written.end(), 0);
+
+            for (unsigned index : _rows[row])
+            {
+                const RasterPolygon& p = _polygons[index];
+
+                crossings.clear();
+                for (const Edge& e : p.edges)
+                {
+                    if (e.ymin > geoY)
+                        break;
+                    if (geoY < e.ymax)
+                        crossings.push_back(Crossing{ e.ring, e.crossing(geoY) });
+                }
+                if (crossings.empty())
+                    continue;
+
+                std::sort(crossings.begin(), crossings.end());
+
+                // Even-odd spans of each ring: posts inside the boundary are
+                // covered, then posts inside any hole are not.
+                unsigned lo = covered.size(), hi = 0u;
+                for (unsigned k = 0; k + 1 < crossings.size(); )
+                {
+                    if (crossings[k].ring != crossings[k+1].ring)
+                    {
+                        ++k;
+                        continue;
+                    }
+
+                    unsigned c0 = firstColumnAt(crossings[k].x);
+                    unsigned c1 = firstColumnAt(crossings[k+1].x);
+                    char value = crossings[k].ring == 0u ? 1 : 0;
+                    if (value)
+                        lo = osg::minimum(lo, c0), hi = osg::maximum(hi, c1);
+                    for (unsigned c = c0; c < c1; ++c)
+                        covered[c] = value;
+                    k += 2;
+                }
+
+                // The first feature to cover a post sets its height.
+                for (unsigned c = lo; c < hi; ++c)
+                {
+                    if (covered[c] && !written[c])
+                    {
+                        double geoX = _xmin + (_dx * (double)c);
+                        _hf->setHeight(c, row, height(p, geoX, geoY) + _offset);
+                        written[c] = 1;
+                    }
+                    covered[c] = 0;
+                }
+            }
+        }
+
+        bool rasterizeNextStrip()
+        {
+            unsigned strip = _next++;
+            if (strip >= _numStrips)
+                return false;
+
+            unsigned rows = _hf->getNumRows();
+            unsigned row0 = (strip*rows) / _numStrips;
+            unsigned row1 = ((strip+1)*rows) / _numStrips;
+
+            std::vector<Crossing> crossings;
+            std::vector<char> covered(_hf->getNumColumns(), 0);
+            std::vector<char> written(_hf->getNumColumns(), 0);
+
+            for (unsigned row = row0; row < row1; ++row)
+            {
+                if (_progress.valid() && _progress->isCanceled())
+                    break;
+
+                rasterizeRow(row, crossings, covered, written);
+            }
+
+            _done[strip].resolve(0L);
+            return true;
+        }
+    };
+
+    void rasterizeInStrips(StripRasterizer* job)
+    {
+        Threading::JobArena* arena = Registry::instance()->getJobArena("features.rasterize");
+
+        unsigned rows = job->_hf->getNumRows();
+        job->_numStrips = osg::maximum(1u, osg::minimum(arena->getConcurrency() + 1u, rows / MIN_ROWS_PER_STRIP));
+        job->_done.resize(job->_numStrips);
+
+        osg::ref_ptr<StripRasterizer> job_ref(job);
+        for (unsigned s = 1; s < job->_numStrips; ++s)
+        {
+            Threading::runInJobArena(arena, [job_ref]() {
+                job_ref->rasterizeNextStrip();
+            });
+        }
+
+        while (job->rasterizeNextStrip());
+
+        for (unsigned s = 0; s < job->_numStrips; ++s)
+            job->_done[s].getFuture().get();
+    }
+}
+
 //............................................................................
 
 void
@@ -147,127 +389,122 @@ FeatureElevationLayer::createHeightFieldImplementation(const TileKey& key, Progr
     if (!features)
         return GeoHeightField(Status::ServiceUnavailable);
 
+    // No features here; this lets the layer remember not to ask again
+    if (!intersects(key))
+        return GeoHeightField(Status::ResourceUnavailable);
+
     int tileSize = getTileSize();
 
-    if (intersects(key))
-    {
-        //Get the extents of the tile
-        double xmin, ymin, xmax, ymax;
-        key.getExtent().getBounds(xmin, ymin, xmax, ymax);
+    //Get the extents of the tile
+    double xmin, ymin, xmax, ymax;
+    key.getExtent().getBounds(xmin, ymin, xmax, ymax);
 
-        const SpatialReference* featureSRS = features->getFeatureProfile()->getSRS();
-        GeoExtent extentInFeatureSRS = key.getExtent().transform(featureSRS);
+    const SpatialReference* featureSRS = features->getFeatureProfile()->getSRS();
+    GeoExtent extentInFeatureSRS = key.getExtent().transform(featureSRS);
 
-        const SpatialReference* keySRS = key.getProfile()->getSRS();
+    const SpatialReference* keySRS = key.getProfile()->getSRS();
 
-        // populate feature list
-        // assemble a spatial query. It helps if your features have a spatial index.
-        Query query;
-        query.bounds() = extentInFeatureSRS.bounds();
+    // populate feature list
+    // assemble a spatial query. It helps if your features have a spatial index.
+    Query query;
+    query.bounds() = extentInFeatureSRS.bounds();
 
-        FeatureList featureList;
-        osg::ref_ptr<FeatureCursor> cursor = features->createFeatureCursor(query, progress);
-        while (cursor.valid() && cursor->hasMore())
+    FeatureList featureList;
+    osg::ref_ptr<FeatureCursor> cursor = features->createFeatureCursor(query, progress);
+    while (cursor.valid() && cursor->hasMore())
+    {
+        Feature* f = cursor->nextFeature();
+        if (f && f->getGeometry())
+            featureList.push_back(f);
+    }
+
+    // We now have a feature list in feature SRS.
+    if (featureList.empty())
+        return GeoHeightField(Status::ResourceUnavailable);
+
+    if (progress && progress->isCanceled())
+        return GeoHeightField::INVALID;
+
+    bool transformRequired = !keySRS->isHorizEquivalentTo(featureSRS);
+
+    //Only allocate the heightfield if we actually intersect any features.
+    osg::ref_ptr<osg::HeightField> hf = new osg::HeightField;
+    hf->allocate(tileSize, tileSize);
+    for (unsigned int i = 0; i < hf->getHeightList().size(); ++i) hf->getHeightList()[i] = NO_DATA_VALUE;
+
+    osg::ref_ptr<StripRasterizer> job = new StripRasterizer();
+    job->_hf = hf.get();
+    job->_keySRS = keySRS;
+    job->_featureSRS = featureSRS;
+    job->_transformRequired = transformRequired;
+    job->_xmin = xmin;
+    job->_ymin = ymin;
+    job->_dx = (xmax - xmin) / (tileSize - 1);
+    job->_dy = (ymax - ymin) / (tileSize - 1);
+    job->_offset = options().offset().get();
+    job->_progress = progress;
+    job->_rows.resize(tileSize);
+
+    // Build an edge table for each polygon, in the key's SRS so that
+    // every scanline is a row of posts, and bin the polygons by row.
+    std::vector<osg::Vec3d> ring;
+    for (FeatureList::iterator f = featureList.begin(); f != featureList.end(); ++f)
+    {
+        const osgEarth::Polygon* boundary = dynamic_cast<const osgEarth::Polygon*>((*f)->getGeometry());
+        if (!boundary)
         {
-            Feature* f = cursor->nextFeature();
-            if (f && f->getGeometry())
-                featureList.push_back(f);
+            OE_WARN << LC << "NOT A POLYGON" << std::endl;
+            continue;
         }
 
-        // We now have a feature list in feature SRS.
+        job->_polygons.push_back(RasterPolygon());
+        RasterPolygon& p = job->_polygons.back();
+        p.h = (*f)->getDouble(options().attr().get());
 
-        bool transformRequired = !keySRS->isHorizEquivalentTo(featureSRS);
+        ring = boundary->asVector();
+        if (transformRequired)
+            featureSRS->transform(ring, keySRS);
+        addEdges(p.edges, ring, 0u, p.bounds);
 
-        if (!featureList.empty())
+        for (unsigned k = 0; k < boundary->getHoles().size(); ++k)
         {
-            if (progress && progress->isCanceled())
-                return GeoHeightField::INVALID;
+            Bounds holeBounds;
+            ring = boundary->getHoles()[k]->asVector();
+            if (transformRequired)
+                featureSRS->transform(ring, keySRS);
+            addEdges(p.edges, ring, k + 1u, holeBounds);
+        }
 
-            //Only allocate the heightfield if we actually intersect any features.
-            osg::ref_ptr<osg::HeightField> hf = new osg::HeightField;
-            hf->allocate(tileSize, tileSize);
-            for (unsigned int i = 0; i < hf->getHeightList().size(); ++i) hf->getHeightList()[i] = NO_DATA_VALUE;
+        std::sort(p.edges.begin(), p.edges.end());
 
-            // Iterate over the output heightfield and sample the data that was read into it.
-            double dx = (xmax - xmin) / (tileSize - 1);
-            double dy = (ymax - ymin) / (tileSize - 1);
+        if (keySRS->isGeographic())
+        {
+            Bounds bounds = boundary->getBounds();
+            GeoPoint anchor(featureSRS, bounds.center().x(), bounds.center().y(), p.h, ALTMODE_ABSOLUTE);
+            if (transformRequired)
+                anchor = anchor.transform(keySRS);
+
+            // For transforming between ECEF and local tangent plane:
+            anchor.createLocalToWorld(p.localToWorld);
+            p.worldToLocal.invert(p.localToWorld);
+        }
 
-            for (int c = 0; c < tileSize; ++c)
-            {
-                double geoX = xmin + (dx * (double)c);
-                for (int r = 0; r < tileSize; ++r)
-                {
-                    double geoY = ymin + (dy * (double)r);
+        if (p.edges.empty())
+            continue;
 
-                    float h = NO_DATA_VALUE;
+        int r0 = osg::maximum((int)floor((p.bounds.yMin() - ymin) / job->_dy), 0);
+        int r1 = osg::minimum((int)ceil((p.bounds.yMax() - ymin) / job->_dy), tileSize - 1);
+        unsigned index = job->_polygons.size() - 1;
+        for (int r = r0; r <= r1; ++r)
+            job->_rows[r].push_back(index);
+    }
 
-                    for (FeatureList::iterator f = featureList.begin(); f != featureList.end(); ++f)
-                    {
-                        if (progress && progress->isCanceled())
-                            return GeoHeightField::INVALID;
-
-                        osgEarth::Polygon* boundary = dynamic_cast<osgEarth::Polygon*>((*f)->getGeometry());
-
-                        if (!boundary)
-                        {
-                            OE_WARN << LC << "NOT A POLYGON" << std::endl;
-                        }
-                        else
-                        {
-                            GeoPoint geo(keySRS, geoX, geoY, 0.0, ALTMODE_ABSOLUTE);
-
-                            if (transformRequired)
-                                geo = geo.transform(featureSRS);
-
-                            if (boundary->contains2D(geo.x(), geo.y()))
-                            {
-                                h = (*f)->getDouble(options().attr().get());
-
-                                if (keySRS->isGeographic())
-                                {
-                                    // for a round earth, must adjust the final elevation accounting for the
-                                    // curvature of the earth; so we have to adjust it in the feature boundary's
-                                    // local tangent plane.
-                                    Bounds bounds = boundary->getBounds();
-                                    GeoPoint anchor(featureSRS, bounds.center().x(), bounds.center().y(), h, ALTMODE_ABSOLUTE);
-                                    if (transformRequired)
-                                        anchor = anchor.transform(keySRS);
-
-                                    // For transforming between ECEF and local tangent plane:
-                                    osg::Matrix localToWorld, worldToLocal;
-                                    anchor.createLocalToWorld(localToWorld);
-                                    worldToLocal.invert(localToWorld);
-
-                                    // Get the ECEF location of the anchor point:
-                                    osg::Vec3d ecef;
-                                    geo.toWorld(ecef);
-
-                                    // Move it into Local Tangent Plane coordinates:
-                                    osg::Vec3d local = ecef * worldToLocal;
-
-                                    // Reset the Z to zero, since the LTP is centered on the "h" elevation:
-                                    local.z() = 0.0;
-
-                                    // Back into ECEF:
-                                    ecef = local * localToWorld;
-
-                                    // And back into lat/long/alt:
-                                    geo.fromWorld(geo.getSRS(), ecef);
-
-                                    h = geo.z();
-                                }
-                                break;
-                            }
-                        }
-                    }
+    rasterizeInStrips(job.get());
 
-                    hf->setHeight(c, r, h + options().offset().get());
-                }
-            }
-            return GeoHeightField(hf.release(), key.getExtent());
-        }
-    }
-    return GeoHeightField::INVALID;
+    if (progress && progress->isCanceled())
+        return GeoHeightField::INVALID;
+
+    return GeoHeightField(hf.release(), key.getExtent());
 }
 
 bool
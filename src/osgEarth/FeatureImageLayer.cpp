@@ -27,6 +27,15 @@
 #include <osgEarth/Registry>
 #include <osgEarth/Progress>
 #include <osgEarth/LandCover>
+#include <osgEarth/Containers>
+#include <osgEarth/Threading>
+#include <osgEarth/rtree.h>
+#include <osg/BlendFunc>
+#include <osg/MatrixTransform>
+#include <osgUtil/Tessellator>
+#include <algorithm>
+#include <atomic>
+#include <limits>
 
 using namespace osgEarth;
 
@@ -94,9 +103,10 @@ namespace osgEarth { namespace FeatureImageLayerImpl
         }
     };
 
-    // rasterizes a geometry to color
-    void rasterize(const Geometry* geometry, const osg::Vec4& color, RenderFrame& frame,
-                   agg::rasterizer& ras, agg::rendering_buffer& buffer)
+    // rasterizes a geometry to color; "row0" is the image row at the
+    // bottom of the buffer
+    void rasterize(const Geometry* geometry, const osg::Vec4& color, const RenderFrame& frame,
+                   agg::rasterizer& ras, agg::rendering_buffer& buffer, int row0)
     {
         unsigned a = (unsigned)(127.0f+(color.a()*255.0f)/2.0f); // scale alpha up
         agg::rgba8 fgColor = agg::rgba8( (unsigned)(color.r()*255.0f), (unsigned)(color.g()*255.0f), (unsigned)(color.b()*255.0f), a );
@@ -119,14 +129,14 @@ namespace osgEarth { namespace FeatureImageLayerImpl
             }
         }
         agg::renderer<agg::span_abgr32, agg::rgba8> ren(buffer);
-        ras.render(ren, fgColor);
+        ras.render(ren, fgColor, 0, -row0);
 
         ras.reset();
     }
 
 
-    void rasterizeCoverage(const Geometry* geometry, float value, RenderFrame& frame,
-                           agg::rasterizer& ras, agg::rendering_buffer& buffer)
+    void rasterizeCoverage(const Geometry* geometry, float value, const RenderFrame& frame,
+                           agg::rasterizer& ras, agg::rendering_buffer& buffer, int row0)
     {
         ConstGeometryIterator gi( geometry );
         while( gi.hasMore() )
@@ -147,10 +157,145 @@ namespace osgEarth { namespace FeatureImageLayerImpl
         }
 
         agg::renderer<span_coverage32, float32> ren(buffer);
-        ras.render(ren, value);
+        ras.render(ren, value, 0, -row0);
         ras.reset();
     }
 
+    // One cropped geometry to rasterize, with what to draw and the range
+    // of image rows it can touch
+    struct RasterCommand
+    {
+        osg::ref_ptr<Geometry> _geometry;
+        osg::Vec4f _color;
+        float _value;
+        bool _coverage;
+        int _rowMin, _rowMax;
+    };
+
+    // Fewest image rows worth handing to another thread
+    #define MIN_ROWS_PER_STRIP 32
+
+    // Rasterizes a list of commands into an image in horizontal strips of
+    // rows. Every strip runs all the commands that touch it in order, so
+    // overlapping features blend exactly as they would in one pass.
+    //
+    // Strips are claimed from a counter by the pool jobs and by the
+    // calling thread alike, so the caller only ever waits on strips that
+    // are already being drawn; a job that starts after all the strips are
+    // claimed has nothing to do.
+    struct StripRasterizer : public osg::Referenced
+    {
+        std::vector<RasterCommand> _commands;
+        RenderFrame _frame;
+        osg::ref_ptr<osg::Image> _image;
+        double _gamma;
+        unsigned _numStrips;
+        std::atomic_uint _next;
+        std::vector<Threading::Promise<osg::Referenced> > _done;
+
+        StripRasterizer() : _gamma(1.0), _numStrips(1u), _next(0u) { }
+
+        bool renderNextStrip()
+        {
+            unsigned strip = _next++;
+            if (strip >= _numStrips)
+                return false;
+
+            unsigned rows = _image->t();
+            int row0 = (strip*rows) / _numStrips;
+            int row1 = ((strip+1)*rows) / _numStrips;
+
+            agg::rendering_buffer rbuf(
+                _image->data(0, row0),
+                _image->s(), row1 - row0,
+                _image->s() * 4);
+
+            agg::rasterizer ras;
+            ras.gamma(_gamma);
+            ras.filling_rule(agg::fill_even_odd);
+
+            for (std::vector<RasterCommand>::const_iterator i = _commands.begin(); i != _commands.end(); ++i)
+            {
+                if (i->_rowMax < row0 || i->_rowMin >= row1)
+                    continue;
+
+                if (i->_coverage)
+                    rasterizeCoverage(i->_geometry.get(), i->_value, _frame, ras, rbuf, row0);
+                else
+                    rasterize(i->_geometry.get(), i->_color, _frame, ras, rbuf, row0);
+            }
+
+            _done[strip].resolve(0L);
+            return true;
+        }
+    };
+
+    // Builds a drawable of a command for the GPU rasterizer. All the rings
+    // are tessellated together with the odd winding rule, which matches
+    // the even-odd fill of the CPU path. Vertices are relative to "origin"
+    // so they keep their precision as floats.
+    osg::Geometry* createDrawable(const RasterCommand& command, const osg::Vec3d& origin)
+    {
+        osg::ref_ptr<osg::Geometry> drawable = new osg::Geometry();
+        drawable->setUseVertexBufferObjects(true);
+
+        osg::Vec3Array* verts = new osg::Vec3Array();
+        drawable->setVertexArray(verts);
+
+        ConstGeometryIterator gi(command._geometry.get());
+        while (gi.hasMore())
+        {
+            const Geometry* g = gi.next();
+            if (g->size() < 3)
+                continue;
+
+            unsigned first = verts->size();
+            for (Geometry::const_iterator p = g->begin(); p != g->end(); p++)
+                verts->push_back(*p - origin);
+
+            drawable->addPrimitiveSet(new osg::DrawArrays(GL_POLYGON, first, verts->size() - first));
+        }
+
+        if (verts->empty())
+            return 0L;
+
+        osgUtil::Tessellator tess;
+        tess.setTessellationType(osgUtil::Tessellator::TESS_TYPE_GEOMETRY);
+        tess.setWindingType(osgUtil::Tessellator::TESS_WINDING_ODD);
+        tess.retessellatePolygons(*drawable);
+
+        // same alpha boost the CPU path applies
+        const osg::Vec4f& c = command._color;
+        unsigned a = (unsigned)(127.0f+(c.a()*255.0f)/2.0f);
+        osg::Vec4Array* colors = new osg::Vec4Array(osg::Array::BIND_OVERALL, 1);
+        (*colors)[0].set(c.r(), c.g(), c.b(), (float)a / 255.0f);
+        drawable->setColorArray(colors);
+
+        return drawable.release();
+    }
+
+    void rasterizeInStrips(StripRasterizer* job)
+    {
+        Threading::JobArena* arena = Registry::instance()->getJobArena("features.rasterize");
+
+        unsigned rows = job->_image->t();
+        job->_numStrips = osg::maximum(1u, osg::minimum(arena->getConcurrency() + 1u, rows / MIN_ROWS_PER_STRIP));
+        job->_done.resize(job->_numStrips);
+
+        osg::ref_ptr<StripRasterizer> job_ref(job);
+        for (unsigned s = 1; s < job->_numStrips; ++s)
+        {
+            Threading::runInJobArena(arena, [job_ref]() {
+                job_ref->renderNextStrip();
+            });
+        }
+
+        while (job->renderNextStrip());
+
+        for (unsigned s = 0; s < job->_numStrips; ++s)
+            job->_done[s].getFuture().get();
+    }
+
     FeatureCursor* createCursor(FeatureSource* fs, FeatureFilterChain* chain, FilterContext& cx, const Query& query, ProgressCallback* progress)
     {
         FeatureCursor* cursor = fs->createFeatureCursor(query, progress);
@@ -171,6 +316,8 @@ FeatureImageLayer::Options::getConfig() const
     featureSource().set(conf, "features");
     styleSheet().set(conf, "styles");
     conf.set("gamma", gamma());
+    conf.set("feature_cache_levels", featureCacheLevels());
+    conf.set("gpu_rasterization", gpuRasterization());
 
     if (filters().empty() == false)
     {
@@ -187,10 +334,14 @@ void
 FeatureImageLayer::Options::fromConfig(const Config& conf)
 {
     gamma().init(1.3);
+    featureCacheLevels().init(2u);
+    gpuRasterization().init(false);
 
     featureSource().get(conf, "features");
     styleSheet().get(conf, "styles");
     conf.get("gamma", gamma());
+    conf.get("feature_cache_levels", featureCacheLevels());
+    conf.get("gpu_rasterization", gpuRasterization());
 
     const Config& filtersConf = conf.child("filters");
     for(ConfigSet::const_iterator i = filtersConf.children().begin(); i != filtersConf.children().end(); ++i)
@@ -231,9 +382,41 @@ FeatureImageLayer::openImplementation()
 
     _filterChain = FeatureFilterChain::create(options().filters(), getReadOptions());
 
+    setFeatureCacheLevels(options().featureCacheLevels().get());
+
+    // Coverage tiles hold float values, which only the CPU path writes.
+    if (options().gpuRasterization() == true)
+    {
+        if (options().coverage() == true)
+        {
+            OE_WARN << LC << "GPU rasterization does not support coverage data; using the CPU" << std::endl;
+        }
+        else
+        {
+            // the rasterizer's node captures a graphics context to render on
+            _rasterizer = new TileRasterizer(getTileSize(), getTileSize());
+
+            _gpuStateSet = new osg::StateSet();
+            _gpuStateSet->setAttributeAndModes(new osg::BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA), 1);
+        }
+    }
+
     return Status::NoError;
 }
 
+Status
+FeatureImageLayer::closeImplementation()
+{
+    _rasterizer = NULL;
+    return ImageLayer::closeImplementation();
+}
+
+osg::Node*
+FeatureImageLayer::getNode() const
+{
+    return _rasterizer.valid() ? _rasterizer->getNode() : NULL;
+}
+
 void
 FeatureImageLayer::addedToMap(const Map* map)
 {
@@ -265,6 +448,7 @@ FeatureImageLayer::setFeatureSource(FeatureSource* fs)
     {
         options().featureSource().setLayer(fs);
         _featureProfile = 0L;
+        setFeatureCacheLevels(options().featureCacheLevels().get());
 
         if (fs)
         {
@@ -370,6 +554,11 @@ FeatureImageLayer::createImageImplementation(const TileKey& key, ProgressCallbac
         return GeoImage::INVALID;
     }
 
+    if (_rasterizer.valid())
+    {
+        return createImageOnGPU(key, progress);
+    }
+
     // allocate the image.
     osg::ref_ptr<osg::Image> image;
 
@@ -398,6 +587,50 @@ FeatureImageLayer::createImageImplementation(const TileKey& key, ProgressCallbac
     }
 }
 
+GeoImage
+FeatureImageLayer::createImageOnGPU(const TileKey& key, ProgressCallback* progress) const
+{
+    // The features go into a scene graph instead of an image:
+    // renderFeaturesForStyle() adds to the group it finds in the
+    // target image's user data.
+    osg::ref_ptr<osg::Group> content = new osg::Group();
+    content->setStateSet(_gpuStateSet.get());
+
+    // The target has the tile's size, which sets line widths and such,
+    // but no pixels.
+    osg::ref_ptr<osg::Image> target = new osg::Image();
+    target->setImage(getTileSize(), getTileSize(), 1, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, NULL, osg::Image::NO_DELETE);
+    target->setUserData(content.get());
+
+    render(key, _session.get(), getStyleSheet(), target.get(), progress);
+
+    if (progress && progress->isCanceled())
+        return GeoImage::INVALID;
+
+    if (content->getNumChildren() == 0)
+        return GeoImage::INVALID;
+
+    Threading::Future<osg::Image> result = _rasterizer->render(content.get(), key.getExtent());
+    osg::ref_ptr<osg::Image> image = result.get(progress);
+
+    if (!image.valid() && !result.isAvailable())
+    {
+        // Not rendered; most likely the rasterizer has no graphics context
+        // yet. Ask the terrain to try this tile again later.
+        if (progress && !progress->isCanceled())
+        {
+            progress->setRetryDelay(1.0f);
+            progress->cancel();
+        }
+        return GeoImage::INVALID;
+    }
+
+    if (!image.valid())
+        return GeoImage::INVALID;
+
+    return GeoImage(image.get(), key.getExtent());
+}
+
 bool
 FeatureImageLayer::preProcess(osg::Image* image) const
 {
@@ -593,19 +826,11 @@ FeatureImageLayer::renderFeaturesForStyle(Session*           session,
     FilterContext polysContext = xform.push(polygons, context);
     FilterContext linesContext = xform.push(lines, context);
 
-    // set up the AGG renderer:
-    agg::rendering_buffer rbuf(image->data(), image->s(), image->t(), image->s() * 4);
-
-    // Create the renderer and the rasterizer
-    agg::rasterizer ras;
-
-    // Setup the rasterizer
-    if (options().coverage() == true)
-        ras.gamma(1.0);
-    else
-        ras.gamma(options().gamma().get());
-
-    ras.filling_rule(agg::fill_even_odd);
+    // Crop and color everything first, then rasterize it all in strips:
+    osg::ref_ptr<StripRasterizer> rasterizer = new StripRasterizer();
+    rasterizer->_frame = frame;
+    rasterizer->_image = image;
+    rasterizer->_gamma = options().coverage() == true ? 1.0 : options().gamma().get();
 
     // construct an extent for cropping the geometry to our tile.
     // extend just outside the actual extents so we don't get edge artifacts:
@@ -643,6 +868,8 @@ FeatureImageLayer::renderFeaturesForStyle(Session*           session,
     if (covsym && covsym->valueExpression().isSet())
         covValue = covsym->valueExpression().get();
 
+    std::vector<RasterCommand>& commands = rasterizer->_commands;
+
     // render the polygons
     for (FeatureList::iterator i = polygons.begin(); i != polygons.end(); i++)
     {
@@ -656,17 +883,14 @@ FeatureImageLayer::renderFeaturesForStyle(Session*           session,
                 feature->style().isSet() && feature->style()->has<PolygonSymbol>() ? feature->style()->get<PolygonSymbol>() :
                 masterPoly;
 
-            if (options().coverage() == true && covValue.isSet())
-            {
-                float value = (float)feature->eval(covValue.mutable_value(), &context);
-                rasterizeCoverage(croppedGeometry.get(), value, frame, ras, rbuf);
-            }
+            RasterCommand command;
+            command._geometry = croppedGeometry;
+            command._coverage = options().coverage() == true && covValue.isSet();
+            if (command._coverage)
+                command._value = (float)feature->eval(covValue.mutable_value(), &context);
             else
-            {
-                Color color = poly ? poly->fill()->color() : Color::White;
-                rasterize(croppedGeometry.get(), color, frame, ras, rbuf);
-            }
-
+                command._color = poly ? poly->fill()->color() : Color::White;
+            commands.push_back(command);
         }
     }
 
@@ -683,24 +907,87 @@ FeatureImageLayer::renderFeaturesForStyle(Session*           session,
                 feature->style().isSet() && feature->style()->has<LineSymbol>() ? feature->style()->get<LineSymbol>() :
                 masterLine;
 
-            if (options().coverage() == true && covValue.isSet())
-            {
-                float value = (float)feature->eval(covValue.mutable_value(), &context);
-                rasterizeCoverage(croppedGeometry.get(), value, frame, ras, rbuf);
-            }
+            RasterCommand command;
+            command._geometry = croppedGeometry;
+            command._coverage = options().coverage() == true && covValue.isSet();
+            if (command._coverage)
+                command._value = (float)feature->eval(covValue.mutable_value(), &context);
             else
-            {
-                osg::Vec4f color = line ? static_cast<osg::Vec4>(line->stroke()->color()) : osg::Vec4(1, 1, 1, 1);
-                rasterize(croppedGeometry.get(), color, frame, ras, rbuf);
-            }
+                command._color = line ? static_cast<osg::Vec4>(line->stroke()->color()) : osg::Vec4(1, 1, 1, 1);
+            commands.push_back(command);
+        }
+    }
+
+    // Rows each geometry can touch, padded for antialiasing, so that
+    // strips can skip the ones that miss them entirely
+    for (std::vector<RasterCommand>::iterator i = commands.begin(); i != commands.end(); ++i)
+    {
+        Bounds b = i->_geometry->getBounds();
+        i->_rowMin = (int)floor(frame.yf*(b.yMin()-frame.ymin)) - 1;
+        i->_rowMax = (int)ceil(frame.yf*(b.yMax()-frame.ymin)) + 1;
+    }
+
+    if (commands.empty())
+        return true;
+
+    // GPU target? Add the content to its scene graph instead.
+    osg::Group* gpuContent = dynamic_cast<osg::Group*>(image->getUserData());
+    if (gpuContent)
+    {
+        osg::Vec3d origin;
+        imageExtent.getCentroid(origin.x(), origin.y());
+
+        osg::Geode* geode = new osg::Geode();
+        for (std::vector<RasterCommand>::const_iterator i = commands.begin(); i != commands.end(); ++i)
+        {
+            osg::Geometry* drawable = createDrawable(*i, origin);
+            if (drawable)
+                geode->addDrawable(drawable);
         }
+
+        osg::MatrixTransform* local = new osg::MatrixTransform(osg::Matrix::translate(origin));
+        local->addChild(geode);
+        gpuContent->addChild(local);
+        return true;
     }
 
+    rasterizeInStrips(rasterizer.get());
+
     return true;
 }
 
 //........................................................................
 
+struct FeatureImageRenderer::FeatureCache
+{
+    typedef RTree<unsigned, double, 2> SpatialIndex;
+
+    // Features queried for one ancestor tile, indexed by their bounds
+    struct Entry : public osg::Referenced
+    {
+        FeatureList _features;
+        SpatialIndex _index;
+    };
+
+    FeatureCache(unsigned levels) :
+        _levels(levels),
+        _entries(true, 16u),
+        _inFlight("FeatureImageRenderer.FeatureCache(OE)") { }
+
+    unsigned _levels;
+    LRUCache<std::string, osg::ref_ptr<Entry> > _entries;
+    Threading::SingleFlight<std::string, osg::ref_ptr<Entry> > _inFlight;
+};
+
+void
+FeatureImageRenderer::setFeatureCacheLevels(unsigned levels)
+{
+    if (levels > 0u)
+        _featureCache = std::make_shared<FeatureCache>(levels);
+    else
+        _featureCache = nullptr;
+}
+
 bool
 FeatureImageRenderer::render(const TileKey& key,
                              Session* session,
@@ -859,6 +1146,19 @@ FeatureImageRenderer::getFeatures(Session* session,
                                   const GeoExtent& imageExtent,
                                   FeatureList& features,
                                   ProgressCallback* progress) const
+{
+    if (!getCachedFeatures(session, query, imageExtent, features, progress))
+    {
+        queryFeatures(session, query, imageExtent, features, progress);
+    }
+}
+
+void
+FeatureImageRenderer::queryFeatures(Session* session,
+                                    const Query& query,
+                                    const GeoExtent& imageExtent,
+                                    FeatureList& features,
+                                    ProgressCallback* progress) const
 {
     // first we need the overall extent of the layer:
     const GeoExtent& featuresExtent = session->getFeatureSource()->getFeatureProfile()->getExtent();
@@ -928,3 +1228,101 @@ FeatureImageRenderer::getFeatures(Session* session,
     }
 }
 
+bool
+FeatureImageRenderer::getCachedFeatures(Session* session,
+                                        const Query& query,
+                                        const GeoExtent& imageExtent,
+                                        FeatureList& features,
+                                        ProgressCallback* progress) const
+{
+    // Sharing only works with sources that query by bounds; a tiled source
+    // already returns one tile's features per query. A limited or bounded
+    // query would return a different set for the larger extent.
+    std::shared_ptr<FeatureCache> cache = _featureCache;
+    FeatureSource* fs = session->getFeatureSource();
+    const FeatureProfile* fp = fs->getFeatureProfile();
+
+    if (!cache ||
+        fp->isTiled() ||
+        !query.tileKey().isSet() ||
+        query.bounds().isSet() ||
+        query.limit().isSet())
+    {
+        return false;
+    }
+
+    const TileKey& key = query.tileKey().get();
+    TileKey ancestorKey = key.createAncestorKey(key.getLOD() > cache->_levels ? key.getLOD() - cache->_levels : 0u);
+    if (!ancestorKey.valid())
+        return false;
+
+    std::string cacheKey = Stringify()
+        << fs->getRevision() << ';'
+        << ancestorKey.str() << ';'
+        << query.expression().getOrUse("") << ';'
+        << query.orderby().getOrUse("");
+
+    osg::ref_ptr<FeatureCache::Entry> entry = cache->_inFlight.run(cacheKey, [&](bool& share) -> osg::ref_ptr<FeatureCache::Entry>
+    {
+        LRUCache<std::string, osg::ref_ptr<FeatureCache::Entry> >::Record record;
+        if (cache->_entries.get(cacheKey, record))
+            return record.value();
+
+        Query ancestorQuery = query;
+        ancestorQuery.tileKey() = ancestorKey;
+
+        osg::ref_ptr<FeatureCache::Entry> result = new FeatureCache::Entry();
+        queryFeatures(session, ancestorQuery, ancestorKey.getExtent(), result->_features, progress);
+
+        if (progress && progress->isCanceled())
+        {
+            share = false;
+            return 0L;
+        }
+
+        unsigned n = 0u;
+        for (FeatureList::const_iterator i = result->_features.begin(); i != result->_features.end(); ++i, ++n)
+        {
+            Bounds b = i->get()->getGeometry()->getBounds();
+            double a_min[2] = { b.xMin(), b.yMin() };
+            double a_max[2] = { b.xMax(), b.yMax() };
+            result->_index.Insert(a_min, a_max, n);
+        }
+
+        cache->_entries.insert(cacheKey, result);
+        return result;
+    },
+    progress);
+
+    // only a canceled request comes back empty-handed
+    if (!entry.valid())
+        return true;
+
+    // Same query extent the uncached path would send to the source:
+    const GeoExtent& featuresExtent = fp->getExtent();
+    GeoExtent featuresExtentWGS84 = featuresExtent.transform( featuresExtent.getSRS()->getGeographicSRS() );
+    GeoExtent imageExtentWGS84 = imageExtent.transform( featuresExtent.getSRS()->getGeographicSRS() );
+    GeoExtent queryExtentWGS84 = featuresExtentWGS84.intersectionSameSRS( imageExtentWGS84 );
+    if ( queryExtentWGS84.isValid() )
+    {
+        Bounds queryBounds = queryExtentWGS84.transform( featuresExtent.getSRS() ).bounds();
+        double a_min[2] = { queryBounds.xMin(), queryBounds.yMin() };
+        double a_max[2] = { queryBounds.xMax(), queryBounds.yMax() };
+
+        std::vector<unsigned> hits;
+        entry->_index.Search(a_min, a_max, &hits, std::numeric_limits<int>::max());
+
+        // keep the source's order, and copy the features because
+        // rendering transforms them in place
+        std::vector<const Feature*> all(entry->_features.size());
+        unsigned n = 0u;
+        for (FeatureList::const_iterator i = entry->_features.begin(); i != entry->_features.end(); ++i)
+            all[n++] = i->get();
+
+        std::sort(hits.begin(), hits.end());
+        for (std::vector<unsigned>::const_iterator i = hits.begin(); i != hits.end(); ++i)
+            features.push_back(new Feature(*all[*i]));
+    }
+
+    return true;
+}
@@ -21,6 +21,7 @@
 #include <osgEarth/CropFilter>
 #include <osgEarth/FeatureSourceIndexNode>
 #include <osgEarth/FilterContext>
+#include <osgEarth/GeneralizeFilter>
 
 #include <osgEarth/MapInfo>
 #include <osgEarth/Capabilities>
@@ -37,6 +38,7 @@
 #include <osgEarth/ElevationRanges>
 #include <osgEarth/LineDrawable>
 #include <osgEarth/NetworkMonitor>
+#include <osgEarth/OcclusionPyramid>
 
 #include <osg/CullFace>
 #include <osg/PagedLOD>
@@ -46,6 +48,7 @@
 #include <osg/ShapeDrawable>
 #include <osgDB/FileNameUtils>
 #include <osgDB/ReaderWriter>
+#include <osgDB/Registry>
 #include <osgDB/WriteFile>
 #include <osgUtil/Optimizer>
 
@@ -375,13 +378,35 @@ namespace
 }
 
 
+//---------------------------------------------------------------------------
+
+// relays edits in the feature source to the graph
+struct FeatureModelGraph::EditCallback : public FeatureSourceCallback
+{
+    osg::observer_ptr<FeatureModelGraph> _graph;
+
+    EditCallback(FeatureModelGraph* graph) : _graph(graph) { }
+
+    void onFeaturesChanged(FeatureSource* source, const GeoExtent& extent, const std::vector<FeatureID>& fids) override
+    {
+        osg::ref_ptr<FeatureModelGraph> graph;
+        if (_graph.lock(graph))
+            graph->onFeaturesChanged(extent, fids);
+    }
+};
+
 //---------------------------------------------------------------------------
 
 FeatureModelGraph::FeatureModelGraph(const FeatureModelOptions& options) :
     _options(options),
     _featureExtentClamped(false),
     _useTiledSource(false),
-    _blacklistMutex("FMG BlackList(OE)")
+    _blacklistMutex("FMG BlackList(OE)"),
+    _tileBuildMutex("FMG TileBuilds(OE)"),
+    _numTileBuilds(0u),
+    _editMutex("FMG Edits(OE)"),
+    _nextTileID(0u),
+    _generalized(true, 16384u)
 {
     //NOP
 }
@@ -663,6 +688,12 @@ FeatureModelGraph::open()
 
     ADJUST_EVENT_TRAV_COUNT(this, 1);
 
+    // listen for edits so we can rebuild just the tiles they touch
+    // (the update traversal merges the rebuilt tiles).
+    _featureSourceCallback = new EditCallback(this);
+    _session->getFeatureSource()->addCallback(_featureSourceCallback.get());
+    ADJUST_UPDATE_TRAV_COUNT(this, 1);
+
     redraw();
 
     return Status::OK();
@@ -670,7 +701,10 @@ FeatureModelGraph::open()
 
 FeatureModelGraph::~FeatureModelGraph()
 {
-    //nop
+    if (_featureSourceCallback.valid() && _session.valid() && _session->getFeatureSource())
+    {
+        _session->getFeatureSource()->removeCallback(_featureSourceCallback.get());
+    }
 }
 
 void
@@ -859,18 +893,24 @@ FeatureModelGraph::load(
 
     osg::Group* result = 0L;
 
+    // the tile parameters, remembered so an edit can rebuild the geometry in place
+    osg::Group* geometry = 0L;
+    bool built = false;
+    FeatureLevel level(0.0f, FLT_MAX);
+    GeoExtent tileExtent;
+    TileKey key;
+
     if (_useTiledSource)
     {
         // A "tiled" source has a pre-generted tile hierarchy, but no range information.
         // We will calcluate the LOD ranges here, as a function of the tile radius and the
         // "tile size factor" ... see below.
-        osg::Group* geometry = 0L;
         const FeatureProfile* featureProfile = _session->getFeatureSource()->getFeatureProfile();
 
         if ((int)lod >= featureProfile->getFirstLevel())
         {
             // The extent of this tile:
-            GeoExtent tileExtent = s_getTileExtent(lod, tileX, tileY, _usableFeatureExtent);
+            tileExtent = s_getTileExtent(lod, tileX, tileY, _usableFeatureExtent);
 
             // Calculate the bounds of this new tile:
             osg::BoundingSphered tileBound = getBoundInWorldCoords(tileExtent);
@@ -879,7 +919,7 @@ FeatureModelGraph::load(
             // the geographic radius of the tile times the multiplier.
             float tileFactor = _options.layout().isSet() ? _options.layout()->tileSizeFactor().get() : 15.0f;
             double maxRange = tileBound.radius() * tileFactor;
-            FeatureLevel level(0, maxRange);
+            level = FeatureLevel(0, maxRange);
 
 
             // Construct a tile key that will be used to query the source for this tile.
@@ -889,10 +929,11 @@ FeatureModelGraph::load(
             featureProfile->getTilingProfile()->getNumTiles(lod, w, h);
             int invertedTileY = h - tileY - 1;
 
-            TileKey key(lod, tileX, invertedTileY, featureProfile->getTilingProfile());
+            key = TileKey(lod, tileX, invertedTileY, featureProfile->getTilingProfile());
 
             geometry = buildTile(level, tileExtent, &key, readOptions);
             result = geometry;
+            built = true;
         }
 
         // check whether more levels exist below the current level.
@@ -924,6 +965,8 @@ FeatureModelGraph::load(
 
         FeatureLevel all(0.0f, FLT_MAX);
         result = buildTile(all, GeoExtent::INVALID, (const TileKey*)0L, readOptions);
+        geometry = result;
+        built = true;
     }
 
     else if ((int)lod < _lodmap.size())
@@ -933,19 +976,19 @@ FeatureModelGraph::load(
         // current LOD points to an actual FeatureLevel, we build the geometry for that
         // level in the tile.
 
-        osg::Group* geometry = 0L;
-        const FeatureLevel* level = _lodmap[lod];
-        if (level)
+        if (_lodmap[lod])
         {
             // There exists a real data level at this LOD. So build the geometry that will
             // represent this tile.
-            GeoExtent tileExtent =
+            level = *_lodmap[lod];
+            tileExtent =
                 lod > 0 ?
                 s_getTileExtent(lod, tileX, tileY, _usableFeatureExtent) :
                 _usableFeatureExtent;
 
-            geometry = buildTile(*level, tileExtent, (const TileKey*)0L, readOptions);
+            geometry = buildTile(level, tileExtent, (const TileKey*)0L, readOptions);
             result = geometry;
+            built = true;
         }
 
         if (lod < _lodmap.size() - 1)
@@ -976,6 +1019,16 @@ FeatureModelGraph::load(
         //RemoveEmptyGroupsVisitor::run( result );
     }
 
+    if (built)
+    {
+        // geometry is either the result itself or one of its children
+        trackTile(
+            geometry == result ? 0L : result,
+            geometry,
+            level, tileExtent, key.valid() ? &key : 0L,
+            readOptions);
+    }
+
     if (result->getNumChildren() == 0)
     {
         // if the result group contains no data, blacklist it so we never try to load it again.
@@ -990,6 +1043,31 @@ FeatureModelGraph::load(
     return result;
 }
 
+osg::Group*
+FeatureModelGraph::buildTile(const TileKey& key, const osgDB::Options* readOptions)
+{
+    if (!key.valid() || !_usableFeatureExtent.isValid())
+        return 0L;
+
+    GeoExtent tileExtent = _usableFeatureExtent.intersectionSameSRS(
+        key.getExtent().transform(_usableFeatureExtent.getSRS()));
+
+    if (!tileExtent.isValid())
+        return 0L;
+
+    FeatureLevel all(0.0f, FLT_MAX);
+
+    // only a tiled source knows what to do with a key from its own profile
+    const Profile* tilingProfile = _useTiledSource ?
+        _session->getFeatureSource()->getFeatureProfile()->getTilingProfile() : 0L;
+
+    bool passKey =
+        tilingProfile &&
+        key.getProfile()->isHorizEquivalentTo(tilingProfile);
+
+    return buildTile(all, tileExtent, passKey ? &key : 0L, readOptions);
+}
+
 static int s_count = 0u;
 
 void
@@ -1156,6 +1234,26 @@ FeatureModelGraph::readTileFromCache(const std::string&    cacheKey,
         if (rr.succeeded())
         {
             group = dynamic_cast<osg::Group*>(rr.getNode());
+
+            // packed record; the metadata names the format that wrote it
+            if (!group.valid() && rr.get<StringObject>())
+            {
+                std::string format = rr.metadata().value("format");
+                osgDB::ReaderWriter* rw = format.empty() ? 0L :
+                    osgDB::Registry::instance()->getReaderWriterForExtension(format);
+                if (rw)
+                {
+                    std::istringstream buf(rr.get<StringObject>()->getString());
+#if OSG_VERSION_GREATER_OR_EQUAL(3,6,3)
+                    osgDB::ReaderWriter::ReadResult nr = rw->readNode(buf, localOptions.get());
+#else
+                    osgDB::ReaderWriter::ReadResult nr = rw->readNode(buf, readOptions);
+#endif
+                    if (nr.validNode())
+                        group = dynamic_cast<osg::Group*>(nr.getNode());
+                }
+            }
+
             OE_DEBUG << LC << "Loaded from the cache (key = " << cacheKey << ")\n";
             ++_cacheHits;
 
@@ -1208,7 +1306,27 @@ FeatureModelGraph::writeTileToCache(const std::string&    cacheKey,
 
     if (cacheBin && policy->isCacheWriteable())
     {
-        cacheBin->writeNode(cacheKey, node, Config(), writeOptions);
+        osg::ref_ptr<StringObject> packed;
+        const std::string& format = _options.nodeCachingFormat().get();
+        if (!format.empty())
+        {
+            osgDB::ReaderWriter* rw = osgDB::Registry::instance()->getReaderWriterForExtension(format);
+            std::stringstream buf;
+            if (rw && rw->writeNode(*node, buf, writeOptions).success())
+                packed = new StringObject(buf.str());
+        }
+
+        if (packed.valid())
+        {
+            Config meta;
+            meta.set("format", format);
+            cacheBin->write(cacheKey, packed.get(), meta, writeOptions);
+        }
+        else
+        {
+            // no format set, or the tile holds something the format can't represent
+            cacheBin->writeNode(cacheKey, node, Config(), writeOptions);
+        }
         OE_DEBUG << LC << "Wrote " << cacheKey << " to cache\n";
     }
     return true;
@@ -1236,7 +1354,8 @@ FeatureModelGraph::buildTile(const FeatureLevel& level,
     // Try to read it from a cache:
     std::string cacheKey = makeCacheKey(level, extent, key);
 
-    if (_options.nodeCaching() == true)
+    // (a cached tile predates any edit made to its features since)
+    if (_options.nodeCaching() == true && !isEdited(extent))
     {
         group = readTileFromCache(cacheKey, readOptions);
     }
@@ -1244,6 +1363,28 @@ FeatureModelGraph::buildTile(const FeatureLevel& level,
     // Not there? Build it
     if (!group.valid())
     {
+        // Wait for a build slot if this layer limits concurrent builds
+        unsigned maxBuilds = _options.maxConcurrentTileBuilds().get();
+        if (maxBuilds > 0u)
+        {
+            std::unique_lock<Threading::Mutex> lock(_tileBuildMutex);
+            while (_numTileBuilds >= maxBuilds)
+                _tileBuildSlotFree.wait(lock);
+            ++_numTileBuilds;
+        }
+
+        struct ReleaseBuildSlot {
+            FeatureModelGraph* _graph;
+            bool _held;
+            ~ReleaseBuildSlot() {
+                if (_held) {
+                    std::unique_lock<Threading::Mutex> lock(_graph->_tileBuildMutex);
+                    --_graph->_numTileBuilds;
+                    _graph->_tileBuildSlotFree.notify_one();
+                }
+            }
+        } releaseBuildSlot = { this, maxBuilds > 0u };
+
         osg::ref_ptr<ProgressCallback> progress = new MyProgressCallback(_session.get());
 
         // set up for feature indexing if appropriate:
@@ -1373,6 +1514,12 @@ FeatureModelGraph::buildTile(const FeatureLevel& level,
             }
         }
 
+        // install an occlusion culler.
+        if (_options.occlusionCulling() == true && OcclusionPyramid::isSupported())
+        {
+            group->addCullCallback(new OcclusionPyramid::CullCallback());
+        }
+
         return group.release();
     }
 
@@ -1391,9 +1538,105 @@ FeatureModelGraph::createCursor(FeatureSource* fs, FilterContext& cx, const Quer
     {
         cursor = new FilteredFeatureCursor(cursor, _filterChain.get(), cx);
     }
+
+    if (cursor && _options.generalize() == true)
+    {
+        cursor = generalize(cursor, cx, query);
+    }
     return cursor;
 }
 
+FeatureCursor*
+FeatureModelGraph::generalize(FeatureCursor* cursor, FilterContext& cx, const Query& query) const
+{
+    if (!query.bounds().isSet() || query.bounds()->width() <= 0.0)
+        return cursor;
+
+    // Which LOD is this, and is it the finest? The finest tiles always get
+    // the full geometry.
+    unsigned lod, finest;
+    if (_useTiledSource && query.tileKey().isSet())
+    {
+        lod = query.tileKey()->getLOD();
+        finest = _session->getFeatureSource()->getFeatureProfile()->getMaxLevel();
+    }
+    else if (!_lodmap.empty() && _usableFeatureExtent.isValid())
+    {
+        double ratio = _usableFeatureExtent.width() / query.bounds()->width();
+        lod = ratio > 1.0 ? (unsigned)(log(ratio)/log(2.0) + 0.5) : 0u;
+        finest = _lodmap.size() - 1;
+    }
+    else
+    {
+        return cursor;
+    }
+
+    if (lod >= finest)
+        return cursor;
+
+    osg::ref_ptr<FeatureCursor> input = cursor;
+    FeatureList features;
+    input->fill(features);
+
+    // A tile generalized before (and since paged out) comes from the cache,
+    // as long as every feature in it does:
+    std::set<FeatureID> fids;
+    std::vector<osg::ref_ptr<Geometry> > cached;
+    cached.reserve(features.size());
+    bool cacheable = true, fromCache = true;
+
+    for (FeatureList::const_iterator i = features.begin(); i != features.end() && cacheable; ++i)
+    {
+        // the cache is keyed by FID, so they have to be unique
+        cacheable = i->get()->getGeometry() && fids.insert(i->get()->getFID()).second;
+
+        GeneralizedCache::Record r;
+        if (fromCache && _generalized.get(GeneralizedKey(lod, i->get()->getFID()), r))
+            cached.push_back(r.value());
+        else
+            fromCache = false;
+    }
+
+    if (cacheable && fromCache && !features.empty())
+    {
+        unsigned k = 0;
+        for (FeatureList::iterator i = features.begin(); i != features.end(); ++k)
+        {
+            if (cached[k].valid())
+            {
+                i->get()->setGeometry(cached[k]->clone());
+                ++i;
+            }
+            else
+            {
+                i = features.erase(i);
+            }
+        }
+    }
+    else
+    {
+        GeneralizeFilter filter(query.bounds()->width() / (double)std::max(_options.generalizeResolution().get(), 1u));
+        filter.push(features, cx);
+
+        if (cacheable)
+        {
+            for (FeatureList::const_iterator i = features.begin(); i != features.end(); ++i)
+            {
+                _generalized.insert(GeneralizedKey(lod, i->get()->getFID()), i->get()->getGeometry()->clone());
+                fids.erase(i->get()->getFID());
+            }
+
+            // remember the ones that went away, too
+            for (std::set<FeatureID>::const_iterator fid = fids.begin(); fid != fids.end(); ++fid)
+            {
+                _generalized.insert(GeneralizedKey(lod, *fid), osg::ref_ptr<Geometry>());
+            }
+        }
+    }
+
+    return new FeatureListCursor(features);
+}
+
 osg::Group*
 FeatureModelGraph::build(const Style&          defaultStyle,
     const Query&          baseQuery,
@@ -1643,11 +1886,13 @@ FeatureModelGraph::queryAndSortIntoStyleGroups(const Query&            query,
             return;
     }
 
-    // next create a style group per bin.
+    // resolve a style per bin; bins in map order keep the output deterministic.
+    std::vector<Style> binStyles;
+    std::vector<FeatureList*> binFeatures;
+
     for (std::map<std::string, FeatureList>::iterator i = styleBins.begin(); i != styleBins.end(); ++i)
     {
         const std::string& styleString = i->first;
-        FeatureList&       workingSet = i->second;
 
         // resolve the style:
         Style combinedStyle;
@@ -1672,15 +1917,72 @@ FeatureModelGraph::queryAndSortIntoStyleGroups(const Query&            query,
                 combinedStyle = *selectedStyle;
         }
 
-        // if there is a valid style, create the node and add it. (Otherwise we will skip
+        // if there is a valid style, queue the bin for compilation. (Otherwise we will skip
         // the feature.)
         if (!combinedStyle.empty())
         {
-            osg::Group* styleGroup = createStyleGroup(combinedStyle, workingSet, context, readOptions, query);
-            if (styleGroup)
-                parent->addChild(styleGroup);
+            binStyles.push_back(combinedStyle);
+            binFeatures.push_back(&i->second);
         }
     }
+
+    if (binStyles.empty())
+        return;
+
+    std::vector<osg::ref_ptr<osg::Group> > styleGroups(binStyles.size());
+
+    // Compile the bins concurrently. Script engines are not thread-safe,
+    // so style sheets that use one stay on this thread.
+    bool parallel =
+        _options.parallelStyleGroups() == true &&
+        binStyles.size() > 1 &&
+        _session->getScriptEngine() == 0L;
+
+    if (parallel)
+    {
+        OE_PROFILING_ZONE_NAMED("parallel style groups");
+
+        Threading::JobArena* arena = Registry::instance()->getJobArena("features.compile");
+
+        // Dispatch all but the first bin, which we compile in this thread
+        // since it would otherwise just sit and wait.
+        std::vector<Threading::Future<osg::Group> > futures;
+        for (unsigned b = 1; b < binStyles.size(); ++b)
+        {
+            Threading::Promise<osg::Group> promise;
+            futures.push_back(promise.getFuture());
+
+            Threading::runInJobArena(arena, [this, promise, b, &binStyles, &binFeatures, &context, readOptions, &query]() mutable {
+                osg::ref_ptr<osg::Group> styleGroup = createStyleGroup(binStyles[b], *binFeatures[b], context, readOptions, query);
+                promise.resolve(styleGroup.get());
+            });
+        }
+
+        styleGroups[0] = createStyleGroup(binStyles[0], *binFeatures[0], context, readOptions, query);
+
+        // Wait for everything, even if canceled; the jobs reference our stack.
+        Threading::Future<Threading::FutureVector<osg::Group> > all = Threading::when_all(futures);
+        osg::ref_ptr<Threading::FutureVector<osg::Group> > results = all.get();
+        if (results.valid())
+        {
+            for (unsigned b = 1; b < binStyles.size(); ++b)
+                styleGroups[b] = (*results)[b - 1].get();
+        }
+    }
+    else
+    {
+        for (unsigned b = 0; b < binStyles.size(); ++b)
+        {
+            styleGroups[b] = createStyleGroup(binStyles[b], *binFeatures[b], context, readOptions, query);
+        }
+    }
+
+    // merge in bin order, regardless of which finished first
+    for (unsigned b = 0; b < styleGroups.size(); ++b)
+    {
+        if (styleGroups[b].valid())
+            parent->addChild(styleGroups[b].get());
+    }
 }
 
 
@@ -1880,6 +2182,13 @@ FeatureModelGraph::redraw()
     // clear it out
     removeChildren(0, getNumChildren());
 
+    {
+        Threading::ScopedMutexLock lock(_editMutex);
+        _builtTiles.clear();
+        _pendingEdits.clear();
+        _rebuiltTiles.clear();
+    }
+
     // initialize the index if necessary.
     if (_options.featureIndexing()->enabled() == true)
     {
@@ -1901,6 +2210,9 @@ FeatureModelGraph::redraw()
 
         //Remove all current children
         node = buildTile(defaultLevel, GeoExtent::INVALID, 0, _session->getDBOptions());
+        if (!node)
+            node = new osg::Group();
+        trackTile(0L, node->asGroup(), defaultLevel, GeoExtent::INVALID, 0L, _session->getDBOptions());
         // We're just building the entire node now with no paging, so run the post merge operations immediately.
         runPostMergeOperations(node);
     }
@@ -1946,6 +2258,215 @@ FeatureModelGraph::redraw()
     addChild(node);
 }
 
+void
+FeatureModelGraph::trackTile(osg::Group* container,
+    osg::Group* geometry,
+    const FeatureLevel& level,
+    const GeoExtent& extent,
+    const TileKey* key,
+    const osgDB::Options* readOptions)
+{
+    if (!container && !geometry)
+        return;
+
+    Threading::ScopedMutexLock lock(_editMutex);
+
+    BuiltTile& tile = _builtTiles[_nextTileID++];
+    tile._container = container;
+    tile._geometry = geometry;
+    tile._level = level;
+    tile._extent = extent;
+    if (key)
+        tile._key = *key;
+    tile._readOptions = readOptions;
+}
+
+void
+FeatureModelGraph::onFeaturesChanged(const GeoExtent& extent, const std::vector<FeatureID>& fids)
+{
+    // picks between now and the rebuild should not see the old attributes
+    if (_featureIndex.valid())
+    {
+        _featureIndex->invalidateFeatures(fids);
+    }
+
+    // nor should generalized copies of the old geometry survive
+    _generalized.clear();
+
+    // a tile that was empty may not be anymore
+    {
+        Threading::ScopedWriteLock exclusiveLock(_blacklistMutex);
+        _blacklist.clear();
+    }
+
+    Threading::ScopedMutexLock lock(_editMutex);
+    _pendingEdits.push_back(extent);
+
+    // an edit of unknown extent touches everything; otherwise a long
+    // editing session collapses its history into a single extent.
+    if (!_editedExtents.empty() && !_editedExtents.front().isValid())
+        return;
+
+    if (!extent.isValid())
+    {
+        _editedExtents.assign(1, GeoExtent::INVALID);
+    }
+    else if (_editedExtents.size() >= 64u)
+    {
+        GeoExtent all = extent;
+        for (std::vector<GeoExtent>::const_iterator e = _editedExtents.begin(); e != _editedExtents.end(); ++e)
+            all.expandToInclude(*e);
+        _editedExtents.assign(1, all);
+    }
+    else
+    {
+        _editedExtents.push_back(extent);
+    }
+}
+
+bool
+FeatureModelGraph::isEdited(const GeoExtent& extent) const
+{
+    Threading::ScopedMutexLock lock(_editMutex);
+
+    for (std::vector<GeoExtent>::const_iterator e = _editedExtents.begin(); e != _editedExtents.end(); ++e)
+    {
+        // an invalid extent means "somewhere" or "everywhere"
+        if (!e->isValid() || !extent.isValid() || e->intersects(extent))
+            return true;
+    }
+    return false;
+}
+
+void
+FeatureModelGraph::rebuildEditedTiles()
+{
+    Threading::ScopedMutexLock lock(_editMutex);
+
+    if (_pendingEdits.empty())
+        return;
+
+    osg::observer_ptr<FeatureModelGraph> graph_weak(this);
+    Threading::JobArena* arena = Registry::instance()->getJobArena("features.edit");
+
+    for (BuiltTiles::iterator t = _builtTiles.begin(); t != _builtTiles.end(); )
+    {
+        BuiltTile& tile = t->second;
+
+        // forget tiles the pager has expired
+        if (!tile._geometry.valid() && !tile._container.valid())
+        {
+            t = _builtTiles.erase(t);
+            continue;
+        }
+
+        bool touched = false;
+        for (std::vector<GeoExtent>::const_iterator e = _pendingEdits.begin(); e != _pendingEdits.end() && !touched; ++e)
+        {
+            touched = !e->isValid() || !tile._extent.isValid() || e->intersects(tile._extent);
+        }
+
+        if (touched)
+        {
+            if (tile._rebuilding)
+            {
+                // rebuild again once the current rebuild merges
+                tile._editedAgain = true;
+            }
+            else
+            {
+                tile._rebuilding = true;
+
+                unsigned id = t->first;
+                FeatureLevel level = tile._level;
+                GeoExtent extent = tile._extent;
+                TileKey key = tile._key;
+                osg::ref_ptr<const osgDB::Options> readOptions = tile._readOptions;
+
+                Threading::runInJobArena(arena, [graph_weak, id, level, extent, key, readOptions]() {
+                    osg::ref_ptr<FeatureModelGraph> graph;
+                    if (!graph_weak.lock(graph))
+                        return;
+
+                    RebuiltTile rebuilt;
+                    rebuilt._id = id;
+                    rebuilt._geometry = graph->buildTile(level, extent, key.valid() ? &key : 0L, readOptions.get());
+
+                    // an empty group keeps the tile's place for the next edit
+                    if (!rebuilt._geometry.valid())
+                        rebuilt._geometry = new osg::Group();
+
+                    graph->runPreMergeOperations(rebuilt._geometry.get());
+
+                    Threading::ScopedMutexLock lock(graph->_editMutex);
+                    graph->_rebuiltTiles.push_back(rebuilt);
+                });
+            }
+        }
+        ++t;
+    }
+
+    _pendingEdits.clear();
+}
+
+void
+FeatureModelGraph::mergeRebuiltTiles()
+{
+    std::vector<RebuiltTile> rebuiltTiles;
+    {
+        Threading::ScopedMutexLock lock(_editMutex);
+        if (_rebuiltTiles.empty())
+            return;
+        rebuiltTiles.swap(_rebuiltTiles);
+    }
+
+    for (std::vector<RebuiltTile>::iterator r = rebuiltTiles.begin(); r != rebuiltTiles.end(); ++r)
+    {
+        osg::ref_ptr<osg::Group> container, oldGeometry;
+        bool editedAgain = false;
+        {
+            Threading::ScopedMutexLock lock(_editMutex);
+            BuiltTiles::iterator t = _builtTiles.find(r->_id);
+            if (t == _builtTiles.end())
+                continue;
+
+            BuiltTile& tile = t->second;
+            tile._container.lock(container);
+            tile._geometry.lock(oldGeometry);
+            tile._geometry = r->_geometry.get();
+            tile._rebuilding = false;
+            editedAgain = tile._editedAgain;
+            tile._editedAgain = false;
+
+            if (editedAgain)
+                _pendingEdits.push_back(tile._extent);
+        }
+
+        // The new tile tagged its features before the old one goes away,
+        // so picked object IDs stay the same across the swap.
+        bool merged = false;
+        if (oldGeometry.valid())
+        {
+            osg::Group* parent =
+                container.valid() ? container.get() :
+                oldGeometry->getNumParents() > 0 ? oldGeometry->getParent(0) :
+                0L;
+
+            if (parent)
+                merged = parent->replaceChild(oldGeometry.get(), r->_geometry.get());
+        }
+        else if (container.valid())
+        {
+            merged = container->addChild(r->_geometry.get());
+        }
+
+        if (merged)
+        {
+            runPostMergeOperations(r->_geometry.get());
+        }
+    }
+}
+
 void
 FeatureModelGraph::traverse(osg::NodeVisitor& nv)
 {
@@ -1957,6 +2478,13 @@ FeatureModelGraph::traverse(osg::NodeVisitor& nv)
 
         osg::Group::traverse(nv);
     }
+    else if (nv.getVisitorType() == nv.UPDATE_VISITOR)
+    {
+        mergeRebuiltTiles();
+        rebuildEditedTiles();
+
+        osg::Group::traverse(nv);
+    }
     else
     {
         osg::Group::traverse(nv);
@@ -192,6 +192,14 @@ FeatureModelLayer::getNode() const
     return _root.get();
 }
 
+FeatureModelGraph*
+FeatureModelLayer::getFeatureModelGraph() const
+{
+    return _root.valid() && _root->getNumChildren() > 0 ?
+        dynamic_cast<FeatureModelGraph*>(_root->getChild(0)) :
+        0L;
+}
+
 Status
 FeatureModelLayer::openImplementation()
 {
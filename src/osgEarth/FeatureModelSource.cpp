@@ -40,6 +40,11 @@ using namespace osgEarth;
 //........................................................................
 
 FeatureModelOptions::FeatureModelOptions(const ConfigOptions& co) :
+_parallelStyleGroups( true ),
+_maxConcurrentTileBuilds( 0u ),
+_generalize( false ),
+_generalizeResolution( 256u ),
+_occlusionCulling( false ),
 _lit               ( true ),
 _maxGranularity_deg( 1.0 ),
 _clusterCulling    ( false ),
@@ -67,6 +72,12 @@ FeatureModelOptions::fromConfig(const Config& conf)
     conf.get( "backface_culling", _backfaceCulling );
     conf.get( "alpha_blending",   _alphaBlending );
     conf.get( "node_caching",     _nodeCaching );
+    conf.get( "parallel_style_groups", _parallelStyleGroups );
+    conf.get( "max_concurrent_tile_builds", _maxConcurrentTileBuilds );
+    conf.get( "node_caching_format", _nodeCachingFormat );
+    conf.get( "generalize", _generalize );
+    conf.get( "generalize_resolution", _generalizeResolution );
+    conf.get( "occlusion_culling", _occlusionCulling );
     
     conf.get( "session_wide_resource_cache", _sessionWideResourceCache );
 
@@ -93,6 +104,12 @@ FeatureModelOptions::getConfig() const
     conf.set( "backface_culling", _backfaceCulling );
     conf.set( "alpha_blending",   _alphaBlending );
     conf.set( "node_caching",     _nodeCaching );
+    conf.set( "parallel_style_groups", _parallelStyleGroups );
+    conf.set( "max_concurrent_tile_builds", _maxConcurrentTileBuilds );
+    conf.set( "node_caching_format", _nodeCachingFormat );
+    conf.set( "generalize", _generalize );
+    conf.set( "generalize_resolution", _generalizeResolution );
+    conf.set( "occlusion_culling", _occlusionCulling );
     
     conf.set( "session_wide_resource_cache", _sessionWideResourceCache );
 
@@ -42,6 +42,8 @@
 #include <osg/BoundingSphere>
 #include <osg/Polytope>
 #include <osg/Transform>
+#include <osg/MatrixTransform>
+#include <cstring>
 
 #define LC "[FeatureNode] "
 
@@ -56,7 +58,10 @@ _options           ( options ),
 _needsRebuild      ( true ),
 _styleSheet        ( styleSheet ),
 _clampDirty        (false),
-_index             ( 0 )
+_clampUpdating     (false),
+_clampIncremental  (_clamperData),
+_index             ( 0 ),
+_featuresPerPiece  ( 0u )
 {
     _features.push_back( feature );
 
@@ -78,7 +83,10 @@ _options        ( options ),
 _needsRebuild   ( true ),
 _styleSheet     ( styleSheet ),
 _clampDirty     ( false ),
-_index          ( 0 )
+_clampUpdating  ( false ),
+_clampIncremental( _clamperData ),
+_index          ( 0 ),
+_featuresPerPiece( 0u )
 {
     _features.insert( _features.end(), features.begin(), features.end() );
     setStyle( style );
@@ -122,14 +130,16 @@ FeatureNode::build()
     osg::Node* node = _compiled.get();
     if (_needsRebuild || !_compiled.valid() )
     {
-        // Clone the Features before rendering as the GeometryCompiler and it's filters can change the coordinates
-        // of the geometry when performing localization or converting to geocentric.
         _extent = GeoExtent::INVALID;
+        _pieces.clear();
+        _pieceOf.clear();
 
-        FeatureList clone;
-        for(FeatureList::iterator itr = _features.begin(); itr != _features.end(); ++itr)
+        // Split the features into pieces that can be rebuilt on their own.
+        unsigned perPiece = _featuresPerPiece > 0u ? _featuresPerPiece : (unsigned)_features.size();
+        unsigned count = 0u;
+        for(FeatureList::iterator itr = _features.begin(); itr != _features.end(); ++itr, ++count)
         {
-            Feature* feature = new Feature( *itr->get(), osg::CopyOp::DEEP_COPY_ALL);
+            Feature* feature = itr->get();
             GeoExtent featureExtent(feature->getSRS(), feature->getGeometry()->getBounds());
 
             if (_extent.isInvalid())
@@ -140,7 +150,12 @@ FeatureNode::build()
             {
                 _extent.expandToInclude( featureExtent );
             }
-            clone.push_back( feature );
+
+            if (count % perPiece == 0u)
+                _pieces.push_back(Piece());
+
+            _pieces.back()._features.push_back(feature);
+            _pieceOf[feature] = _pieces.size()-1;
         }
 
         // prep the compiler:
@@ -149,21 +164,28 @@ FeatureNode::build()
 
         FilterContext context( session, new FeatureProfile( _extent ), _extent, _index);
 
-        _compiled = compiler.compile( clone, style, context );
-        node = _compiled.get();
-        _needsRebuild = false;
-
-        // Compute the world bounds
-        osg::BoundingSphered bounds;
-        for( FeatureList::iterator itr = _features.begin(); itr != _features.end(); ++itr)
+        if (_pieces.size() == 1)
+        {
+            _compiled = compilePiece(_pieces.front(), compiler, context);
+        }
+        else
         {
-            osg::BoundingSphered bs;
-            itr->get()->getWorldBound(getMapNode()->getMapSRS(), bs);
-            bounds.expandBy(bs);
+            osg::Group* group = new osg::Group();
+            for (unsigned i = 0; i < _pieces.size(); ++i)
+            {
+                // empty pieces get a placeholder so they can be rebuilt later
+                osg::ref_ptr<osg::Node> piece = compilePiece(_pieces[i], compiler, context);
+                if (!piece.valid())
+                    _pieces[i]._node = piece = new osg::Group();
+                group->addChild(piece.get());
+            }
+            _compiled = group;
         }
 
-        // The polytope will ensure we only clamp to intersecting tiles:
-        Feature::getWorldBoundingPolytope(bounds, getMapNode()->getMapSRS(), _featurePolytope);
+        node = _compiled.get();
+        _needsRebuild = false;
+
+        updateWorldBounds();
     }
 
     if ( node )
@@ -211,7 +233,8 @@ FeatureNode::build()
                 SetDataVarianceVisitor sdv(osg::Object::DYNAMIC);
                 this->accept(sdv);
 
-                getMapNode()->getTerrain()->addTerrainCallback(_clampCallback.get());
+                // only tiles under the features can affect them
+                getMapNode()->getTerrain()->addTerrainCallback(_clampCallback.get(), _extent);
                 clamp(getMapNode()->getTerrain()->getGraph(), getMapNode()->getTerrain());
             }
             else
@@ -304,73 +327,439 @@ void FeatureNode::dirty()
     build();
 }
 
-// This will be called by AnnotationNode when a new terrain tile comes in.
+void FeatureNode::dirty(Feature* feature)
+{
+    FeatureList features;
+    features.push_back(feature);
+    dirty(features);
+}
+
+void FeatureNode::dirty(const FeatureList& features)
+{
+    if (_needsRebuild || !_compiled.valid() || !getMapNode())
+    {
+        dirty();
+        return;
+    }
+
+    std::set<unsigned> pieces;
+    for (FeatureList::const_iterator i = features.begin(); i != features.end(); ++i)
+    {
+        std::map<const Feature*, unsigned>::const_iterator p = _pieceOf.find(i->get());
+        if (p == _pieceOf.end())
+        {
+            // a feature we never compiled
+            dirty();
+            return;
+        }
+        pieces.insert(p->second);
+    }
+
+    if (!pieces.empty())
+    {
+        rebuildPieces(pieces);
+    }
+}
+
+osg::Node*
+FeatureNode::compilePiece(Piece& piece, GeometryCompiler& compiler, const FilterContext& context)
+{
+    // Clone the Features before rendering as the GeometryCompiler and it's filters can change the coordinates
+    // of the geometry when performing localization or converting to geocentric.
+    FeatureList clone;
+    piece._bound.init();
+    for (FeatureList::iterator itr = piece._features.begin(); itr != piece._features.end(); ++itr)
+    {
+        clone.push_back(new Feature(*itr->get(), osg::CopyOp::DEEP_COPY_ALL));
+
+        osg::BoundingSphered bs;
+        itr->get()->getWorldBound(getMapNode()->getMapSRS(), bs);
+        piece._bound.expandBy(bs);
+    }
+
+    piece._node = compiler.compile(clone, getStyle(), context);
+    return piece._node.get();
+}
+
 void
-FeatureNode::onTileUpdate(const TileKey&          key,
-                         osg::Node*              graph,
-                         TerrainCallbackContext& context)
+FeatureNode::updateWorldBounds()
+{
+    osg::BoundingSphered bounds;
+    for (unsigned i = 0; i < _pieces.size(); ++i)
+    {
+        bounds.expandBy(_pieces[i]._bound);
+    }
+
+    // The polytope will ensure we only clamp to intersecting tiles:
+    Feature::getWorldBoundingPolytope(bounds, getMapNode()->getMapSRS(), _featurePolytope);
+}
+
+namespace
+{
+    // Whether a newly compiled subgraph has the same structure as the old one,
+    // so that the old one can take on its data without changing any nodes.
+    bool sameStructure(osg::Node* oldNode, osg::Node* newNode)
+    {
+        if (::strcmp(oldNode->className(), newNode->className()) != 0)
+            return false;
+
+        if (oldNode->asGeometry())
+            return true;
+
+        // other drawables (e.g. text) can't be patched
+        if (oldNode->asDrawable())
+            return false;
+
+        if (oldNode->asTransform() && !oldNode->asTransform()->asMatrixTransform())
+            return false;
+
+        osg::Group* oldGroup = oldNode->asGroup();
+        osg::Group* newGroup = newNode->asGroup();
+        if (!oldGroup || oldGroup->getNumChildren() != newGroup->getNumChildren())
+            return false;
+
+        for (unsigned i = 0; i < oldGroup->getNumChildren(); ++i)
+        {
+            if (!sameStructure(oldGroup->getChild(i), newGroup->getChild(i)))
+                return false;
+        }
+        return true;
+    }
+
+    // Copies the new array's data into the old one when their layouts match, so that
+    // only that range of the buffer object uploads again.
+    bool copyArray(osg::Array* oldArray, osg::Array* newArray)
+    {
+        if (!oldArray && !newArray)
+            return true;
+
+        if (oldArray && newArray &&
+            oldArray->getType() == newArray->getType() &&
+            oldArray->getBinding() == newArray->getBinding() &&
+            oldArray->getNumElements() == newArray->getNumElements() &&
+            oldArray->getTotalDataSize() == newArray->getTotalDataSize())
+        {
+            if (newArray->getTotalDataSize() > 0u)
+            {
+                ::memcpy(const_cast<GLvoid*>(oldArray->getDataPointer()), newArray->getDataPointer(), newArray->getTotalDataSize());
+                oldArray->dirty();
+            }
+            return true;
+        }
+        return false;
+    }
+
+    void patchPrimitiveSets(osg::Geometry* oldGeom, osg::Geometry* newGeom)
+    {
+        bool same = oldGeom->getNumPrimitiveSets() == newGeom->getNumPrimitiveSets();
+        for (unsigned i = 0; same && i < oldGeom->getNumPrimitiveSets(); ++i)
+        {
+            osg::PrimitiveSet* a = oldGeom->getPrimitiveSet(i);
+            osg::PrimitiveSet* b = newGeom->getPrimitiveSet(i);
+            same =
+                a->getType() == b->getType() &&
+                a->getMode() == b->getMode() &&
+                a->getNumIndices() == b->getNumIndices() &&
+                a->getTotalDataSize() == b->getTotalDataSize();
+        }
+
+        if (!same)
+        {
+            oldGeom->setPrimitiveSetList(newGeom->getPrimitiveSetList());
+            return;
+        }
+
+        for (unsigned i = 0; i < oldGeom->getNumPrimitiveSets(); ++i)
+        {
+            osg::PrimitiveSet* a = oldGeom->getPrimitiveSet(i);
+            osg::PrimitiveSet* b = newGeom->getPrimitiveSet(i);
+
+            osg::DrawArrays* da = dynamic_cast<osg::DrawArrays*>(a);
+            osg::DrawArrays* db = dynamic_cast<osg::DrawArrays*>(b);
+            osg::DrawArrayLengths* dla = dynamic_cast<osg::DrawArrayLengths*>(a);
+            osg::DrawArrayLengths* dlb = dynamic_cast<osg::DrawArrayLengths*>(b);
+            if (da && db)
+            {
+                da->setFirst(db->getFirst());
+                da->setCount(db->getCount());
+            }
+            else if (dla && dlb)
+            {
+                dla->setFirst(dlb->getFirst());
+                std::copy(dlb->begin(), dlb->end(), dla->begin());
+            }
+            else if (a->getDataPointer() && b->getDataPointer())
+            {
+                ::memcpy(const_cast<GLvoid*>(a->getDataPointer()), b->getDataPointer(), b->getTotalDataSize());
+            }
+            else
+            {
+                oldGeom->setPrimitiveSet(i, b);
+                continue;
+            }
+            a->dirty();
+        }
+    }
+
+    void patchStateSet(osg::Node* oldNode, osg::Node* newNode)
+    {
+        osg::StateSet* a = oldNode->getStateSet();
+        osg::StateSet* b = newNode->getStateSet();
+        if (a != b && (!a || !b || a->compare(*b, true) != 0))
+            oldNode->setStateSet(b);
+    }
+
+    // Moves the new subgraph's data into the old one, which sameStructure() accepted.
+    void patch(osg::Node* oldNode, osg::Node* newNode, GeometryClamper::LocalData& clampData)
+    {
+        patchStateSet(oldNode, newNode);
+
+        osg::Geometry* oldGeom = oldNode->asGeometry();
+        if (oldGeom)
+        {
+            osg::Geometry* newGeom = newNode->asGeometry();
+
+            // the clamper's copy of the unclamped verts is stale now
+            clampData.erase(oldGeom->getVertexArray());
+
+            if (!copyArray(oldGeom->getVertexArray(), newGeom->getVertexArray()))
+                oldGeom->setVertexArray(newGeom->getVertexArray());
+
+            if (!copyArray(oldGeom->getNormalArray(), newGeom->getNormalArray()))
+                oldGeom->setNormalArray(newGeom->getNormalArray());
+
+            if (!copyArray(oldGeom->getColorArray(), newGeom->getColorArray()))
+                oldGeom->setColorArray(newGeom->getColorArray());
+
+            if (!copyArray(oldGeom->getSecondaryColorArray(), newGeom->getSecondaryColorArray()))
+                oldGeom->setSecondaryColorArray(newGeom->getSecondaryColorArray());
+
+            if (!copyArray(oldGeom->getFogCoordArray(), newGeom->getFogCoordArray()))
+                oldGeom->setFogCoordArray(newGeom->getFogCoordArray());
+
+            unsigned numTexCoords = osg::maximum(oldGeom->getNumTexCoordArrays(), newGeom->getNumTexCoordArrays());
+            for (unsigned i = 0; i < numTexCoords; ++i)
+            {
+                if (!copyArray(oldGeom->getTexCoordArray(i), newGeom->getTexCoordArray(i)))
+                    oldGeom->setTexCoordArray(i, newGeom->getTexCoordArray(i));
+            }
+
+            unsigned numAttribs = osg::maximum(oldGeom->getNumVertexAttribArrays(), newGeom->getNumVertexAttribArrays());
+            for (unsigned i = 0; i < numAttribs; ++i)
+            {
+                if (!copyArray(oldGeom->getVertexAttribArray(i), newGeom->getVertexAttribArray(i)))
+                    oldGeom->setVertexAttribArray(i, newGeom->getVertexAttribArray(i));
+            }
+
+            patchPrimitiveSets(oldGeom, newGeom);
+
+            oldGeom->dirtyBound();
+            return;
+        }
+
+        osg::MatrixTransform* oldXform = dynamic_cast<osg::MatrixTransform*>(oldNode);
+        if (oldXform)
+        {
+            oldXform->setMatrix(static_cast<osg::MatrixTransform*>(newNode)->getMatrix());
+        }
+
+        osg::Group* oldGroup = oldNode->asGroup();
+        osg::Group* newGroup = newNode->asGroup();
+        for (unsigned i = 0; i < oldGroup->getNumChildren(); ++i)
+        {
+            patch(oldGroup->getChild(i), newGroup->getChild(i), clampData);
+        }
+        oldNode->dirtyBound();
+    }
+}
+
+void
+FeatureNode::rebuildPieces(const std::set<unsigned>& pieces)
 {
-    if (!_clampDirty)
+    const Style &style = getStyle();
+
+    GeometryCompilerOptions options = _options;
+
+    AnnotationUtils::AltitudePolicy ap;
+    AnnotationUtils::getAltitudePolicy( style, ap );
+
+    if ( ap.sceneClamping )
+    {
+        options.ignoreAltitudeSymbol() = true;
+    }
+
+    // Compile against the same extent as the full build, so the pieces
+    // share its local reference frame.
+    GeoExtent oldExtent = _extent;
+    for (std::set<unsigned>::const_iterator i = pieces.begin(); i != pieces.end(); ++i)
+    {
+        const FeatureList& features = _pieces[*i]._features;
+        for (FeatureList::const_iterator f = features.begin(); f != features.end(); ++f)
+        {
+            _extent.expandToInclude(GeoExtent(f->get()->getSRS(), f->get()->getGeometry()->getBounds()));
+        }
+    }
+
+    GeometryCompiler compiler( options );
+    Session* session = new Session( getMapNode()->getMap(), _styleSheet.get() );
+    FilterContext context( session, new FeatureProfile( oldExtent ), oldExtent, _index);
+
+    osg::ref_ptr<Terrain> terrain = getMapNode()->getTerrain();
+
+    for (std::set<unsigned>::const_iterator i = pieces.begin(); i != pieces.end(); ++i)
     {
-        bool needsClamp;
+        Piece& piece = _pieces[*i];
+        osg::ref_ptr<osg::Node> oldNode = piece._node.get();
+        osg::ref_ptr<osg::Node> newNode = compilePiece(piece, compiler, context);
+        if (!newNode.valid())
+            piece._node = newNode = new osg::Group();
 
-        if (key.valid())
+        if (oldNode.valid() && sameStructure(oldNode.get(), newNode.get()))
         {
-            osg::Polytope tope;
-            key.getExtent().createPolytope(tope);
-            needsClamp = tope.contains(this->getBound());
+            patch(oldNode.get(), newNode.get(), _clamperData);
+            piece._node = oldNode.get();
+        }
+        else if (_pieces.size() > 1)
+        {
+            FindNodesVisitor<osg::Geometry> geoms;
+            oldNode->accept(geoms);
+            for (unsigned g = 0; g < geoms._results.size(); ++g)
+                _clamperData.erase(geoms._results[g]->getVertexArray());
+
+            if (ap.sceneClamping)
+            {
+                SetDataVarianceVisitor sdv(osg::Object::DYNAMIC);
+                newNode->accept(sdv);
+            }
+
+            _compiled->asGroup()->replaceChild(oldNode.get(), newNode.get());
         }
         else
         {
-            // without a valid tilekey we don't know the extent of the change,
-            // so clamping is required.
-            needsClamp = true;
+            // the compiled graph is the piece itself
+            dirty();
+            return;
         }
 
-        if (needsClamp)
+        if (ap.sceneClamping && terrain.valid())
         {
-            _clampDirty = true;
-            ADJUST_UPDATE_TRAV_COUNT(this, +1);
-            //clamp(graph, context.getTerrain());
+            GeometryClamper clamper(_clamperData);
+            if (setupClamper(clamper, terrain.get()))
+            {
+                clamper.setTerrainPatch(terrain->getGraph());
+                piece._node->accept(clamper);
+            }
         }
     }
+
+    updateWorldBounds();
+
+    // tiles under the grown extent have to reach the clamp callback
+    if (ap.sceneClamping && terrain.valid() && _extent != oldExtent)
+    {
+        terrain->addTerrainCallback(_clampCallback.get(), _extent);
+    }
 }
 
+// This will be called by AnnotationNode when a new terrain tile comes in.
 void
-FeatureNode::clamp(osg::Node* graph, const Terrain* terrain)
+FeatureNode::onTileUpdate(const TileKey&          key,
+                         osg::Node*              graph,
+                         TerrainCallbackContext& context)
 {
-    if ( terrain && graph )
+    // a full clamp is already on the way
+    if (_clampDirty)
+        return;
+
+    if (key.valid())
     {
-        const AltitudeSymbol* alt = getStyle().get<AltitudeSymbol>();
-        if (alt && alt->technique() != alt->TECHNIQUE_SCENE)
+        osg::Polytope tope;
+        key.getExtent().createPolytope(tope);
+        if (!tope.contains(this->getBound()))
             return;
 
-        bool relative = alt && alt->clamping() == alt->CLAMP_RELATIVE_TO_TERRAIN && alt->technique() == alt->TECHNIQUE_SCENE;
-        float offset = alt ? alt->verticalOffset()->eval() : 0.0f;
+        // re-clamp just the part under the new tile, in the background
+        _clampIncremental.dirty(key);
+    }
+    else
+    {
+        // without a valid tilekey we don't know the extent of the change,
+        // so clamping is required.
+        _clampDirty = true;
+    }
+
+    if (!_clampUpdating)
+    {
+        _clampUpdating = true;
+        ADJUST_UPDATE_TRAV_COUNT(this, +1);
+    }
+}
+
+bool
+FeatureNode::setupClamper(GeometryClamper& clamper, const Terrain* terrain) const
+{
+    const AltitudeSymbol* alt = getStyle().get<AltitudeSymbol>();
+    if (alt && alt->technique() != alt->TECHNIQUE_SCENE)
+        return false;
+
+    bool relative = alt && alt->clamping() == alt->CLAMP_RELATIVE_TO_TERRAIN && alt->technique() == alt->TECHNIQUE_SCENE;
+    float offset = alt ? alt->verticalOffset()->eval() : 0.0f;
 
+    clamper.setTerrainSRS( terrain->getSRS() );
+    clamper.setUseVertexZ( relative );
+    clamper.setOffset( offset );
+    return true;
+}
+
+void
+FeatureNode::clamp(osg::Node* graph, const Terrain* terrain)
+{
+    if ( terrain && graph )
+    {
         GeometryClamper clamper(_clamperData);
+        if (!setupClamper(clamper, terrain))
+            return;
+
         clamper.setTerrainPatch( graph );
-        clamper.setTerrainSRS( terrain->getSRS() );
-        clamper.setUseVertexZ( relative );
-        clamper.setOffset( offset );
 
         this->accept( clamper );
+
+        // a full clamp supersedes any partial one
+        _clampIncremental.reset();
     }
 }
 
 void
 FeatureNode::traverse(osg::NodeVisitor& nv)
 {
-    if (nv.getVisitorType() == nv.UPDATE_VISITOR && _clampDirty)
+    if (nv.getVisitorType() == nv.UPDATE_VISITOR && _clampUpdating)
     {
         if (getMapNode())
         {
+            bool busy = false;
             osg::ref_ptr<Terrain> terrain = getMapNode()->getTerrain();
             if (terrain.valid())
-                clamp(terrain->getGraph(), terrain.get());
+            {
+                if (_clampDirty)
+                {
+                    clamp(terrain->getGraph(), terrain.get());
+                }
+                else
+                {
+                    GeometryClamper clamper(_clamperData);
+                    if (setupClamper(clamper, terrain.get()))
+                        busy = _clampIncremental.update(this, clamper, getMapNode()->getMap());
+                    else
+                        _clampIncremental.reset();
+                }
+            }
 
-            ADJUST_UPDATE_TRAV_COUNT(this, -1);
             _clampDirty = false;
+            if (!busy)
+            {
+                ADJUST_UPDATE_TRAV_COUNT(this, -1);
+                _clampUpdating = false;
+            }
         }
     }
     AnnotationNode::traverse(nv);
@@ -386,7 +775,10 @@ FeatureNode::FeatureNode(const Config&         conf,
                          const osgDB::Options* readOptions ) :
 AnnotationNode(conf, readOptions),
 _clampDirty(false),
-_index(0)
+_clampUpdating(false),
+_clampIncremental(_clamperData),
+_index(0),
+_featuresPerPiece(0u)
 {
     osg::ref_ptr<Geometry> geom;
     if ( conf.hasChild("geometry") )
@@ -0,0 +1,607 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+ * Copyright 2020 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarth/FeatureQueryEngine>
+#include <osgEarth/PackedRTree>
+#include <osgEarth/Registry>
+#include <osgEarth/Progress>
+#include <osgEarth/Threading>
+
+#define LC "[FeatureQueryEngine] "
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+#define ARENA_NAME "features.query"
+
+// shapes with fewer segments than this are tested without an index
+#define MIN_SEGMENTS_TO_INDEX 32u
+
+namespace
+{
+    struct Segment2D
+    {
+        osg::Vec2d a, b;
+    };
+
+    double cross(const osg::Vec2d& o, const osg::Vec2d& a, const osg::Vec2d& b)
+    {
+        return (a.x() - o.x())*(b.y() - o.y()) - (a.y() - o.y())*(b.x() - o.x());
+    }
+
+    double pointSegmentDistance2(const osg::Vec2d& p, const Segment2D& s)
+    {
+        osg::Vec2d ab = s.b - s.a;
+        double len2 = ab.length2();
+        double t = len2 > 0.0 ? osg::clampBetween(((p - s.a) * ab) / len2, 0.0, 1.0) : 0.0;
+        return (s.a + ab*t - p).length2();
+    }
+
+    // true if the segments cross at a single point interior to both
+    bool properlyCross(const Segment2D& s, const Segment2D& t)
+    {
+        double d1 = cross(t.a, t.b, s.a), d2 = cross(t.a, t.b, s.b);
+        double d3 = cross(s.a, s.b, t.a), d4 = cross(s.a, s.b, t.b);
+        return ((d1 > 0.0 && d2 < 0.0) || (d1 < 0.0 && d2 > 0.0)) &&
+               ((d3 > 0.0 && d4 < 0.0) || (d3 < 0.0 && d4 > 0.0));
+    }
+
+    double segmentDistance2(const Segment2D& s, const Segment2D& t)
+    {
+        if (properlyCross(s, t))
+            return 0.0;
+
+        return osg::minimum(
+            osg::minimum(pointSegmentDistance2(s.a, t), pointSegmentDistance2(s.b, t)),
+            osg::minimum(pointSegmentDistance2(t.a, s), pointSegmentDistance2(t.b, s)));
+    }
+
+    // Read-only 2D view of a geometry for predicate tests; safe to share
+    // between threads once built.
+    struct Shape : public osg::Referenced
+    {
+        osg::ref_ptr<const Geometry> _geom;
+        Bounds _bounds;
+        std::vector<Segment2D> _segments;
+        std::vector<const Ring*> _areas;
+        std::vector<osg::Vec2d> _partVerts; // one vertex of each part
+        osg::ref_ptr<PackedRTree> _segmentIndex;
+
+        Shape(const Geometry* geom) : _geom(geom)
+        {
+            _bounds = geom->getBounds();
+
+            ConstGeometryIterator parts(geom, true);
+            while (parts.hasMore())
+            {
+                const Geometry* part = parts.next();
+                if (part->empty())
+                    continue;
+
+                _partVerts.push_back(osg::Vec2d(part->front().x(), part->front().y()));
+
+                if (part->getType() == Geometry::TYPE_POINT || part->getType() == Geometry::TYPE_POINTSET || part->size() == 1)
+                {
+                    for (unsigned i = 0; i < part->size(); ++i)
+                    {
+                        Segment2D s;
+                        s.a.set((*part)[i].x(), (*part)[i].y());
+                        s.b = s.a;
+                        _segments.push_back(s);
+                    }
+                    continue;
+                }
+
+                bool closed = part->getType() == Geometry::TYPE_RING || part->getType() == Geometry::TYPE_POLYGON;
+                unsigned count = closed ? part->size() : part->size() - 1;
+                for (unsigned i = 0; i < count; ++i)
+                {
+                    const osg::Vec3d& a = (*part)[i];
+                    const osg::Vec3d& b = (*part)[(i + 1) % part->size()];
+                    Segment2D s;
+                    s.a.set(a.x(), a.y());
+                    s.b.set(b.x(), b.y());
+                    _segments.push_back(s);
+                }
+            }
+
+            ConstGeometryIterator areas(geom, false);
+            while (areas.hasMore())
+            {
+                const Geometry* part = areas.next();
+                if ((part->getType() == Geometry::TYPE_POLYGON || part->getType() == Geometry::TYPE_RING) && part->size() >= 3)
+                    _areas.push_back(static_cast<const Ring*>(part));
+            }
+
+            if (_segments.size() >= MIN_SEGMENTS_TO_INDEX)
+            {
+                _segmentIndex = new PackedRTree();
+                _segmentIndex->reserve(_segments.size());
+                for (unsigned i = 0; i < _segments.size(); ++i)
+                {
+                    const Segment2D& s = _segments[i];
+                    _segmentIndex->add(i, Bounds(
+                        osg::minimum(s.a.x(), s.b.x()), osg::minimum(s.a.y(), s.b.y()),
+                        osg::maximum(s.a.x(), s.b.x()), osg::maximum(s.a.y(), s.b.y())));
+                }
+                _segmentIndex->build();
+            }
+        }
+
+        bool containsPoint(const osg::Vec2d& p) const
+        {
+            for (unsigned i = 0; i < _areas.size(); ++i)
+                if (_areas[i]->contains2D(p.x(), p.y()))
+                    return true;
+            return false;
+        }
+
+        // Calls func with each of this shape's segments that might come
+        // within "pad" of segment s; stops when func returns true.
+        template<typename FUNC>
+        bool anySegmentNear(const Segment2D& s, double pad, FUNC func) const
+        {
+            if (!_segmentIndex.valid())
+            {
+                for (unsigned i = 0; i < _segments.size(); ++i)
+                    if (func(_segments[i]))
+                        return true;
+                return false;
+            }
+
+            std::vector<FeatureID> hits;
+            _segmentIndex->search(Bounds(
+                osg::minimum(s.a.x(), s.b.x()) - pad, osg::minimum(s.a.y(), s.b.y()) - pad,
+                osg::maximum(s.a.x(), s.b.x()) + pad, osg::maximum(s.a.y(), s.b.y()) + pad),
+                hits);
+            for (unsigned i = 0; i < hits.size(); ++i)
+                if (func(_segments[(unsigned)hits[i]]))
+                    return true;
+            return false;
+        }
+
+        // Whether any part of "other" comes within "distance" of this shape
+        bool isWithinDistance(const Shape& other, double distance) const
+        {
+            // one inside the other?
+            for (unsigned i = 0; i < other._partVerts.size(); ++i)
+                if (containsPoint(other._partVerts[i]))
+                    return true;
+            for (unsigned i = 0; i < _partVerts.size(); ++i)
+                if (other.containsPoint(_partVerts[i]))
+                    return true;
+
+            double d2 = distance*distance;
+            for (unsigned i = 0; i < other._segments.size(); ++i)
+            {
+                const Segment2D& s = other._segments[i];
+                if (anySegmentNear(s, distance, [&](const Segment2D& t) { return segmentDistance2(s, t) <= d2; }))
+                    return true;
+            }
+            return false;
+        }
+
+        // Whether "other" lies entirely inside this shape's areas
+        bool contains(const Shape& other) const
+        {
+            if (_areas.empty() || !_bounds.contains(other._bounds))
+                return false;
+
+            for (unsigned i = 0; i < other._partVerts.size(); ++i)
+                if (!containsPoint(other._partVerts[i]))
+                    return false;
+
+            // the parts start inside; any crossing would take them out
+            for (unsigned i = 0; i < other._segments.size(); ++i)
+            {
+                const Segment2D& s = other._segments[i];
+                if (anySegmentNear(s, 0.0, [&](const Segment2D& t) { return properlyCross(s, t); }))
+                    return false;
+            }
+            return true;
+        }
+    };
+
+    bool test(const Shape& target, const Shape& feature, FeatureQueryEngine::Predicate predicate, double distance)
+    {
+        switch (predicate)
+        {
+        case FeatureQueryEngine::PREDICATE_WITHIN:
+            return target.contains(feature);
+        case FeatureQueryEngine::PREDICATE_WITHIN_DISTANCE:
+            return target.isWithinDistance(feature, distance);
+        default:
+            return target.isWithinDistance(feature, 0.0);
+        }
+    }
+
+    Bounds expand(const Bounds& b, double pad)
+    {
+        return Bounds(b.xMin() - pad, b.yMin() - pad, b.xMax() + pad, b.yMax() + pad);
+    }
+
+    double toSourceUnits(const Distance& distance, const SpatialReference* srs, const Bounds& near)
+    {
+        if (distance.getValue() <= 0.0 || !srs)
+            return 0.0;
+        return SpatialReference::transformUnits(distance, srs, near.center().y());
+    }
+
+    // The grid of chunks a query runs in. Every feature belongs to exactly
+    // one cell (the one under the center of its bounds), so a feature
+    // returned by several cells' queries is only reported once.
+    struct ChunkGrid
+    {
+        Bounds _bounds;
+        unsigned _cols, _rows;
+
+        ChunkGrid(const Bounds& bounds, unsigned numChunks) : _bounds(bounds)
+        {
+            _cols = osg::maximum(1u, (unsigned)::ceil(::sqrt((double)numChunks)));
+            _rows = osg::maximum(1u, (numChunks + _cols - 1) / _cols);
+        }
+
+        unsigned size() const { return _cols*_rows; }
+
+        Bounds cell(unsigned i) const
+        {
+            double w = _bounds.width() / (double)_cols, h = _bounds.height() / (double)_rows;
+            double x0 = _bounds.xMin() + (double)(i % _cols)*w;
+            double y0 = _bounds.yMin() + (double)(i / _cols)*h;
+            return Bounds(x0, y0, x0 + w, y0 + h);
+        }
+
+        unsigned owner(const Bounds& b) const
+        {
+            osg::Vec3d c = b.center();
+            double u = (c.x() - _bounds.xMin()) / osg::maximum(_bounds.width(), 1e-12);
+            double v = (c.y() - _bounds.yMin()) / osg::maximum(_bounds.height(), 1e-12);
+            unsigned col = (unsigned)osg::clampBetween((int)(u*(double)_cols), 0, (int)_cols - 1);
+            unsigned row = (unsigned)osg::clampBetween((int)(v*(double)_rows), 0, (int)_rows - 1);
+            return row*_cols + col;
+        }
+    };
+
+    struct ChunkResult : public osg::Referenced
+    {
+        FeatureList _features;
+        std::vector<unsigned> _counts;
+    };
+
+    typedef Threading::Future<ChunkResult> ChunkFuture;
+
+    // Streams the features of each chunk as it finishes, in chunk order.
+    class ChunkCursor : public FeatureCursor
+    {
+    public:
+        ChunkCursor(const std::vector<ChunkFuture>& chunks, int limit, ProgressCallback* progress) :
+            FeatureCursor(progress),
+            _chunks(chunks),
+            _next(0u),
+            _limit(limit),
+            _count(0)
+        {
+            //nop
+        }
+
+        bool hasMore() const override
+        {
+            if (_limit >= 0 && _count >= _limit)
+                return false;
+
+            while (_current.empty() && _next < _chunks.size())
+            {
+                if (_progress.valid() && _progress->isCanceled())
+                    return false;
+
+                ChunkResult* result = _chunks[_next++].get(_progress.get());
+                if (result)
+                    _current.swap(result->_features);
+            }
+            return !_current.empty();
+        }
+
+        Feature* nextFeature() override
+        {
+            if (!hasMore())
+                return 0L;
+
+            _last = _current.front();
+            _current.pop_front();
+            ++_count;
+            return _last.get();
+        }
+
+    private:
+        mutable std::vector<ChunkFuture> _chunks;
+        mutable unsigned _next;
+        mutable FeatureList _current;
+        osg::ref_ptr<Feature> _last;
+        int _limit;
+        int _count;
+    };
+
+    // Join features indexed by their bounds, padded by the join distance
+    struct JoinTable : public osg::Referenced
+    {
+        FeatureList _features;
+        std::vector<osg::ref_ptr<Shape> > _shapes;
+        std::vector<double> _pads;
+        osg::ref_ptr<PackedRTree> _index;
+
+        JoinTable() : _index(new PackedRTree()) { }
+    };
+
+    // Counts are only known once every chunk is done, so this cursor
+    // sums them the first time it's asked for a feature.
+    class JoinCursor : public FeatureCursor
+    {
+    public:
+        JoinCursor(const std::vector<ChunkFuture>& chunks, JoinTable* table, const std::string& attr, ProgressCallback* progress) :
+            FeatureCursor(progress),
+            _chunks(chunks),
+            _table(table),
+            _attr(attr),
+            _done(false)
+        {
+            //nop
+        }
+
+        bool hasMore() const override
+        {
+            if (!_done)
+            {
+                _done = true;
+
+                std::vector<unsigned> counts(_table->_shapes.size(), 0u);
+                for (unsigned c = 0; c < _chunks.size(); ++c)
+                {
+                    ChunkResult* result = _chunks[c].get(_progress.get());
+                    if (!result || (_progress.valid() && _progress->isCanceled()))
+                        return false;
+                    for (unsigned j = 0; j < result->_counts.size(); ++j)
+                        counts[j] += result->_counts[j];
+                }
+
+                unsigned j = 0;
+                for (FeatureList::iterator i = _table->_features.begin(); i != _table->_features.end(); ++i, ++j)
+                {
+                    i->get()->set(_attr, (int)counts[j]);
+                    _current.push_back(i->get());
+                }
+            }
+            return !_current.empty();
+        }
+
+        Feature* nextFeature() override
+        {
+            if (!hasMore())
+                return 0L;
+
+            _last = _current.front();
+            _current.pop_front();
+            return _last.get();
+        }
+
+    private:
+        mutable std::vector<ChunkFuture> _chunks;
+        osg::ref_ptr<JoinTable> _table;
+        std::string _attr;
+        mutable bool _done;
+        mutable FeatureList _current;
+        osg::ref_ptr<Feature> _last;
+    };
+
+    // Work area of a query: the source extent and the query's own bounds,
+    // cut down to the area of interest.
+    Bounds getSearchBounds(const FeatureSource* source, const Query& query, const Bounds& interest)
+    {
+        Bounds bounds = interest;
+
+        const FeatureProfile* profile = source->getFeatureProfile();
+        if (profile && profile->getExtent().isValid())
+            bounds = bounds.intersectionWith(profile->getExtent().bounds());
+
+        if (query.bounds().isSet())
+            bounds = bounds.intersectionWith(query.bounds().get());
+        else if (query.tileKey().isSet())
+            bounds = bounds.intersectionWith(query.tileKey().get().getExtent().bounds());
+
+        return bounds;
+    }
+
+    Query getChunkQuery(const Query& query, const Bounds& cell)
+    {
+        Query q(query);
+        q.tileKey().unset();
+        q.limit().unset();
+        q.bounds() = cell;
+        return q;
+    }
+}
+
+//........................................................................
+
+FeatureQueryEngine::FeatureQueryEngine(FeatureSource* source) :
+_source(source),
+_numChunks(0u)
+{
+    //nop
+}
+
+FeatureCursor*
+FeatureQueryEngine::select(
+    const Query& query,
+    const Geometry* target,
+    Predicate predicate,
+    const Distance& distance,
+    ProgressCallback* progress) const
+{
+    std::vector<ChunkFuture> chunks;
+    int limit = query.limit().isSet() ? query.limit().get() : -1;
+
+    if (!_source.valid() || !target || !_source->getFeatureProfile())
+        return new ChunkCursor(chunks, limit, progress);
+
+    osg::ref_ptr<const Shape> shape = new Shape(target);
+    double pad = predicate == PREDICATE_WITHIN_DISTANCE ?
+        toSourceUnits(distance, _source->getFeatureProfile()->getSRS(), shape->_bounds) : 0.0;
+
+    Bounds bounds = getSearchBounds(_source.get(), query, expand(shape->_bounds, pad));
+    if (!bounds.isValid())
+        return new ChunkCursor(chunks, limit, progress);
+
+    Threading::JobArena* arena = Registry::instance()->getJobArena(ARENA_NAME);
+    ChunkGrid grid(bounds, _numChunks > 0u ? _numChunks : 4u * osg::maximum(1u, arena->getConcurrency()));
+
+    osg::ref_ptr<FeatureSource> source = _source;
+    osg::ref_ptr<ProgressCallback> safeProgress = progress;
+
+    for (unsigned c = 0; c < grid.size(); ++c)
+    {
+        Threading::Promise<ChunkResult> promise;
+        chunks.push_back(promise.getFuture());
+
+        Threading::runInJobArena(arena, [promise, source, shape, grid, c, query, predicate, pad, safeProgress]() mutable
+        {
+            osg::ref_ptr<ChunkResult> result = new ChunkResult();
+
+            osg::ref_ptr<FeatureCursor> cursor = source->createFeatureCursor(
+                getChunkQuery(query, grid.cell(c)), safeProgress.get());
+
+            Bounds interest = expand(shape->_bounds, pad);
+            while (cursor.valid() && cursor->hasMore())
+            {
+                if (promise.isCanceled() || (safeProgress.valid() && safeProgress->isCanceled()))
+                    break;
+
+                osg::ref_ptr<Feature> feature = cursor->nextFeature();
+                if (!feature.valid() || !feature->getGeometry())
+                    continue;
+
+                Bounds b = feature->getGeometry()->getBounds();
+                if (grid.owner(b) != c || !interest.intersects(b))
+                    continue;
+
+                Shape featureShape(feature->getGeometry());
+                if (test(*shape, featureShape, predicate, pad))
+                    result->_features.push_back(feature);
+            }
+
+            promise.resolve(result.get());
+        });
+    }
+
+    return new ChunkCursor(chunks, limit, progress);
+}
+
+FeatureCursor*
+FeatureQueryEngine::join(
+    const Query& query,
+    const FeatureList& joinFeatures,
+    Predicate predicate,
+    const Distance& distance,
+    const std::string& countAttribute,
+    ProgressCallback* progress) const
+{
+    std::vector<ChunkFuture> chunks;
+
+    osg::ref_ptr<JoinTable> table = new JoinTable();
+
+    if (!_source.valid() || !_source->getFeatureProfile())
+        return new JoinCursor(chunks, table.get(), countAttribute, progress);
+
+    const SpatialReference* srs = _source->getFeatureProfile()->getSRS();
+
+    Bounds interest;
+    for (FeatureList::const_iterator i = joinFeatures.begin(); i != joinFeatures.end(); ++i)
+    {
+        if (!i->valid() || !i->get()->getGeometry())
+            continue;
+
+        osg::ref_ptr<Shape> shape = new Shape(i->get()->getGeometry());
+        double pad = predicate == PREDICATE_WITHIN_DISTANCE ?
+            toSourceUnits(distance, srs, shape->_bounds) : 0.0;
+
+        Bounds padded = expand(shape->_bounds, pad);
+        table->_index->add(table->_shapes.size(), padded);
+        table->_features.push_back(osg::clone(i->get(), osg::CopyOp::DEEP_COPY_ALL));
+        table->_shapes.push_back(shape);
+        table->_pads.push_back(pad);
+        interest.expandBy(padded);
+    }
+    table->_index->build();
+
+    Bounds bounds = table->_shapes.empty() ? Bounds() : getSearchBounds(_source.get(), query, interest);
+
+    if (bounds.isValid())
+    {
+        Threading::JobArena* arena = Registry::instance()->getJobArena(ARENA_NAME);
+        ChunkGrid grid(bounds, _numChunks > 0u ? _numChunks : 4u * osg::maximum(1u, arena->getConcurrency()));
+
+        osg::ref_ptr<FeatureSource> source = _source;
+        osg::ref_ptr<ProgressCallback> safeProgress = progress;
+
+        for (unsigned c = 0; c < grid.size(); ++c)
+        {
+            Threading::Promise<ChunkResult> promise;
+            chunks.push_back(promise.getFuture());
+
+            Threading::runInJobArena(arena, [promise, source, table, grid, c, query, predicate, safeProgress]() mutable
+            {
+                osg::ref_ptr<ChunkResult> result = new ChunkResult();
+                result->_counts.assign(table->_shapes.size(), 0u);
+
+                osg::ref_ptr<FeatureCursor> cursor = source->createFeatureCursor(
+                    getChunkQuery(query, grid.cell(c)), safeProgress.get());
+
+                std::vector<FeatureID> hits;
+                while (cursor.valid() && cursor->hasMore())
+                {
+                    if (promise.isCanceled() || (safeProgress.valid() && safeProgress->isCanceled()))
+                        break;
+
+                    osg::ref_ptr<Feature> feature = cursor->nextFeature();
+                    if (!feature.valid() || !feature->getGeometry())
+                        continue;
+
+                    Bounds b = feature->getGeometry()->getBounds();
+                    if (grid.owner(b) != c)
+                        continue;
+
+                    hits.clear();
+                    table->_index->search(b, hits);
+                    if (hits.empty())
+                        continue;
+
+                    Shape featureShape(feature->getGeometry());
+                    for (unsigned h = 0; h < hits.size(); ++h)
+                    {
+                        unsigned j = (unsigned)hits[h];
+                        if (test(*table->_shapes[j], featureShape, predicate, table->_pads[j]))
+                            ++result->_counts[j];
+                    }
+                }
+
+                promise.resolve(result.get());
+            });
+        }
+    }
+
+    return new JoinCursor(chunks, table.get(), countAttribute, progress);
+}
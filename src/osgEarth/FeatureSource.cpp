@@ -177,6 +177,16 @@ FeatureSource::isBlacklisted( FeatureID fid ) const
     return _blacklist.find( fid ) != _blacklist.end();
 }
 
+void
+FeatureSource::notifyFeaturesChanged(const GeoExtent& extent, const std::vector<FeatureID>& fids)
+{
+    for (CallbackVector::iterator i = _callbacks.begin(); i != _callbacks.end(); ++i)
+    {
+        FeatureSourceCallback* cb = dynamic_cast<FeatureSourceCallback*>(i->get());
+        if (cb) cb->onFeaturesChanged(this, extent, fids);
+    }
+}
+
 void
 FeatureSource::applyFilters(FeatureList& features, const GeoExtent& extent) const
 {
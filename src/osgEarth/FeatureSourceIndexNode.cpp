@@ -107,7 +107,11 @@ FeatureSourceIndexNode::tagDrawable(osg::Drawable* drawable, Feature* feature)
 {
     if ( !feature || !_index.valid() ) return OSGEARTH_OBJECTID_EMPTY;
     RefIDPair* r = _index->tagDrawable( drawable, feature );
-    if ( r ) _fids[ feature->getFID() ] = r;
+    if ( r )
+    {
+        Threading::ScopedMutexLock lock( _fidsMutex );
+        _fids[ feature->getFID() ] = r;
+    }
     return r ? r->_oid : OSGEARTH_OBJECTID_EMPTY;
 }
 
@@ -116,7 +120,11 @@ FeatureSourceIndexNode::tagAllDrawables(osg::Node* node, Feature* feature)
 {
     if ( !feature || !_index.valid() ) return OSGEARTH_OBJECTID_EMPTY;
     RefIDPair* r = _index->tagAllDrawables( node, feature );
-    if ( r ) _fids[ feature->getFID() ] = r;
+    if ( r )
+    {
+        Threading::ScopedMutexLock lock( _fidsMutex );
+        _fids[ feature->getFID() ] = r;
+    }
     return r ? r->_oid : OSGEARTH_OBJECTID_EMPTY;
 }
 
@@ -125,7 +133,11 @@ FeatureSourceIndexNode::tagNode(osg::Node* node, Feature* feature)
 {
     if ( !feature || !_index.valid() ) return OSGEARTH_OBJECTID_EMPTY;
     RefIDPair* r = _index->tagNode( node, feature );
-    if ( r ) _fids[ feature->getFID() ] = r;
+    if ( r )
+    {
+        Threading::ScopedMutexLock lock( _fidsMutex );
+        _fids[ feature->getFID() ] = r;
+    }
     return r ? r->_oid : OSGEARTH_OBJECTID_EMPTY;
 }
 
@@ -370,6 +382,12 @@ FeatureSourceIndex::tagDrawable(osg::Drawable* drawable, Feature* feature)
         ObjectID oid = f->second->_oid;
         _masterIndex->tagDrawable( drawable, oid );
         p = f->second.get();
+
+        // a rebuilt tile re-tags the feature; keep the newest copy
+        if ( _embed )
+        {
+            _embeddedFeatures[fid] = feature;
+        }
     }
     else
     {
@@ -403,6 +421,12 @@ FeatureSourceIndex::tagAllDrawables(osg::Node* node, Feature* feature)
         ObjectID oid = f->second->_oid;
         _masterIndex->tagAllDrawables( node, oid );
         p = f->second.get();
+
+        // a rebuilt tile re-tags the feature; keep the newest copy
+        if ( _embed )
+        {
+            _embeddedFeatures[fid] = feature;
+        }
     }
     else
     {
@@ -437,6 +461,12 @@ FeatureSourceIndex::tagNode(osg::Node* node, Feature* feature)
         oid = f->second->_oid;
         _masterIndex->tagNode( node, oid );
         p = f->second.get();
+
+        // a rebuilt tile re-tags the feature; keep the newest copy
+        if ( _embed )
+        {
+            _embeddedFeatures[fid] = feature;
+        }
     }
     else
     {
@@ -456,6 +486,17 @@ FeatureSourceIndex::tagNode(osg::Node* node, Feature* feature)
     return p;
 }
 
+void
+FeatureSourceIndex::invalidateFeatures(const std::vector<FeatureID>& fids)
+{
+    Threading::ScopedMutexLock lock(_mutex);
+
+    for (std::vector<FeatureID>::const_iterator fid = fids.begin(); fid != fids.end(); ++fid)
+    {
+        _embeddedFeatures.erase( *fid );
+    }
+}
+
 Feature*
 FeatureSourceIndex::getFeature(ObjectID oid) const
 {
@@ -471,7 +512,9 @@ FeatureSourceIndex::getFeature(ObjectID oid) const
             FeatureMap::const_iterator j = _embeddedFeatures.find( fid );
             feature = j != _embeddedFeatures.end() ? j->second.get() : 0L;
         }
-        else if ( _featureSource.valid() && _featureSource->supportsGetFeature() )
+
+        // not embedded, or invalidated by an edit since it was embedded
+        if ( !feature && _featureSource.valid() && _featureSource->supportsGetFeature() )
         {
             feature = _featureSource->getFeature( fid );
         }
@@ -40,6 +40,19 @@ FeatureFilter::~FeatureFilter()
 {
 }
 
+FilterContext
+FeatureFilter::push(FeatureBatch& input, FilterContext& context)
+{
+    FeatureList features;
+    input.getFeatures(features);
+
+    FilterContext output = push(features, context);
+
+    input.clear();
+    input.add(features);
+    return output;
+}
+
 /********************************************************************************/
 
 #undef LC
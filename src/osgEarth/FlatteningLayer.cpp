@@ -21,6 +21,13 @@
 #include <osgEarth/HeightFieldUtils>
 #include <osgEarth/FeatureCursor>
 #include <osgEarth/Containers>
+#include <osgEarth/SIMD>
+
+#if defined(OE_SIMD_AVX2)
+    #include <immintrin.h>
+#elif defined(OE_SIMD_SSE2)
+    #include <emmintrin.h>
+#endif
 
 using namespace osgEarth;
 using namespace osgEarth::Contrib;
@@ -311,6 +318,7 @@ namespace
         osg::Vec3d A;   // endpoint of segment
         osg::Vec3d B;   // other endpoint of segment;
         double T;       // segment parameter of closest point
+        unsigned segment; // index of the segment in the grid
 
         // used later:
         float elevPROJ; // elevation at point on segment
@@ -377,11 +385,231 @@ namespace
         return samples.size() > 0 ? (numer / (double)(samples.size())) : FLT_MAX;
     }
 
+    // One line segment of a flattening feature, in the working SRS.
+    struct SegmentRecord
+    {
+        osg::Vec3d A, B;
+        double innerRadius;
+        double outerRadius;
+    };
+
+    // Line segments binned into a uniform grid. Each cell lists every
+    // segment whose outer (buffer) radius reaches into it, so a post only
+    // needs to test the segments of the one cell it falls in.
+    struct SegmentGrid
+    {
+        std::vector<SegmentRecord> segments;
+        std::vector<std::vector<unsigned> > cells;
+        double xmin, ymin;
+        double cellWidth, cellHeight;
+        int numCols, numRows;
+
+        SegmentGrid() : xmin(0), ymin(0), cellWidth(1), cellHeight(1), numCols(0), numRows(0) { }
+
+        // Index of the cell containing (x, y), or -1 if it's off the grid
+        inline int cellAt(double x, double y) const
+        {
+            int c = (int)floor((x - xmin) / cellWidth);
+            int r = (int)floor((y - ymin) / cellHeight);
+            if (c < 0 || c >= numCols || r < 0 || r >= numRows)
+                return -1;
+            return r*numCols + c;
+        }
+
+        // Bins the segments, covering at most "window" (the area the
+        // posts that will query the grid can fall in).
+        void build(const Bounds& window, unsigned cellsAcross)
+        {
+            cells.clear();
+            numCols = numRows = 0;
+
+            Bounds b;
+            for (auto& seg : segments)
+            {
+                b.expandBy(osg::minimum(seg.A.x(), seg.B.x()) - seg.outerRadius, osg::minimum(seg.A.y(), seg.B.y()) - seg.outerRadius);
+                b.expandBy(osg::maximum(seg.A.x(), seg.B.x()) + seg.outerRadius, osg::maximum(seg.A.y(), seg.B.y()) + seg.outerRadius);
+            }
+            b = b.intersectionWith(window);
+            if (!b.isValid() || b.width() <= 0.0 || b.height() <= 0.0)
+                return;
+
+            xmin = b.xMin(), ymin = b.yMin();
+            cellWidth = osg::maximum(window.width(), window.height()) / (double)cellsAcross;
+            cellHeight = cellWidth;
+            numCols = osg::clampBetween((int)ceil(b.width() / cellWidth), 1, (int)cellsAcross);
+            numRows = osg::clampBetween((int)ceil(b.height() / cellHeight), 1, (int)cellsAcross);
+            cellWidth = b.width() / (double)numCols;
+            cellHeight = b.height() / (double)numRows;
+            cells.resize(numCols*numRows);
+
+            for (unsigned i = 0; i < segments.size(); ++i)
+            {
+                const SegmentRecord& seg = segments[i];
+                int c0 = (int)floor((osg::minimum(seg.A.x(), seg.B.x()) - seg.outerRadius - xmin) / cellWidth);
+                int c1 = (int)floor((osg::maximum(seg.A.x(), seg.B.x()) + seg.outerRadius - xmin) / cellWidth);
+                int r0 = (int)floor((osg::minimum(seg.A.y(), seg.B.y()) - seg.outerRadius - ymin) / cellHeight);
+                int r1 = (int)floor((osg::maximum(seg.A.y(), seg.B.y()) + seg.outerRadius - ymin) / cellHeight);
+                c0 = osg::maximum(c0, 0), c1 = osg::minimum(c1, numCols - 1);
+                r0 = osg::maximum(r0, 0), r1 = osg::minimum(r1, numRows - 1);
+                for (int r = r0; r <= r1; ++r)
+                    for (int c = c0; c <= c1; ++c)
+                        cells[r*numCols + c].push_back(i);
+            }
+        }
+    };
+
+    // Everything the flattening needs from the features of one parent tile.
+    struct TileFeatures : public osg::Referenced
+    {
+        MultiGeometry geoms;
+        WidthsList widths;
+        SegmentGrid grid;
+    };
+
+    // Squared distance from each of a run of points to segment AB, and
+    // the segment parameter of the closest point. "seg" is
+    // { Ax, Ay, ABx, ABy, 1/|AB|^2 } (0 for the last for a zero-length
+    // segment, which puts the closest point at A).
+    void segmentDistances_scalar(
+        const double* seg,
+        const double* px, const double* py, unsigned n,
+        double* outD2, double* outT)
+    {
+        for (unsigned i = 0; i < n; ++i)
+        {
+            double apx = px[i] - seg[0];
+            double apy = py[i] - seg[1];
+            double t = clamp((apx*seg[2] + apy*seg[3]) * seg[4], 0.0, 1.0);
+            double dx = apx - seg[2]*t;
+            double dy = apy - seg[3]*t;
+            outD2[i] = dx*dx + dy*dy;
+            outT[i] = t;
+        }
+    }
+
+#ifdef OE_SIMD_SSE2
+    void segmentDistances_sse2(
+        const double* seg,
+        const double* px, const double* py, unsigned n,
+        double* outD2, double* outT)
+    {
+        const __m128d ax = _mm_set1_pd(seg[0]), ay = _mm_set1_pd(seg[1]);
+        const __m128d abx = _mm_set1_pd(seg[2]), aby = _mm_set1_pd(seg[3]);
+        const __m128d invL2 = _mm_set1_pd(seg[4]);
+        const __m128d zero = _mm_setzero_pd(), one = _mm_set1_pd(1.0);
+
+        unsigned i = 0;
+        for (; i + 2 <= n; i += 2)
+        {
+            __m128d apx = _mm_sub_pd(_mm_loadu_pd(px + i), ax);
+            __m128d apy = _mm_sub_pd(_mm_loadu_pd(py + i), ay);
+            __m128d t = _mm_mul_pd(_mm_add_pd(_mm_mul_pd(apx, abx), _mm_mul_pd(apy, aby)), invL2);
+            t = _mm_max_pd(_mm_min_pd(t, one), zero);
+            __m128d dx = _mm_sub_pd(apx, _mm_mul_pd(abx, t));
+            __m128d dy = _mm_sub_pd(apy, _mm_mul_pd(aby, t));
+            _mm_storeu_pd(outD2 + i, _mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy)));
+            _mm_storeu_pd(outT + i, t);
+        }
+
+        segmentDistances_scalar(seg, px + i, py + i, n - i, outD2 + i, outT + i);
+    }
+#endif
+
+#ifdef OE_SIMD_AVX2
+    OE_SIMD_TARGET("avx2")
+    void segmentDistances_avx2(
+        const double* seg,
+        const double* px, const double* py, unsigned n,
+        double* outD2, double* outT)
+    {
+        const __m256d ax = _mm256_set1_pd(seg[0]), ay = _mm256_set1_pd(seg[1]);
+        const __m256d abx = _mm256_set1_pd(seg[2]), aby = _mm256_set1_pd(seg[3]);
+        const __m256d invL2 = _mm256_set1_pd(seg[4]);
+        const __m256d zero = _mm256_setzero_pd(), one = _mm256_set1_pd(1.0);
+
+        unsigned i = 0;
+        for (; i + 4 <= n; i += 4)
+        {
+            __m256d apx = _mm256_sub_pd(_mm256_loadu_pd(px + i), ax);
+            __m256d apy = _mm256_sub_pd(_mm256_loadu_pd(py + i), ay);
+            __m256d t = _mm256_mul_pd(_mm256_add_pd(_mm256_mul_pd(apx, abx), _mm256_mul_pd(apy, aby)), invL2);
+            t = _mm256_max_pd(_mm256_min_pd(t, one), zero);
+            __m256d dx = _mm256_sub_pd(apx, _mm256_mul_pd(abx, t));
+            __m256d dy = _mm256_sub_pd(apy, _mm256_mul_pd(aby, t));
+            _mm256_storeu_pd(outD2 + i, _mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy)));
+            _mm256_storeu_pd(outT + i, t);
+        }
+
+        segmentDistances_scalar(seg, px + i, py + i, n - i, outD2 + i, outT + i);
+    }
+#endif
+
+    typedef void (*SegmentDistancesFunc)(const double*, const double*, const double*, unsigned, double*, double*);
+
+    struct SegmentDistancesDispatch : public Util::SIMD::Dispatch<SegmentDistancesFunc>
+    {
+        SegmentDistancesDispatch() : Util::SIMD::Dispatch<SegmentDistancesFunc>(segmentDistances_scalar)
+        {
+#ifdef OE_SIMD_SSE2
+            add(Util::SIMD::SSE2, segmentDistances_sse2);
+#endif
+#ifdef OE_SIMD_AVX2
+            add(Util::SIMD::AVX2, segmentDistances_avx2);
+#endif
+        }
+    };
+
+    const SegmentDistancesDispatch s_segmentDistances;
+
+    // Offers segment "index" as one of a post's (at most Maxsamples) closest
+    // segments, replacing the farthest one collected so far if it's closer.
+    void addSample(Samples& samples, const SegmentRecord& seg, unsigned index, double D2, double t)
+    {
+        static const unsigned Maxsamples = 4;
+
+        Sample* b;
+        if (samples.size() < Maxsamples)
+        {
+            // If we haven't collected the maximum number of samples yet,
+            // just add this to the list:
+            samples.push_back(Sample());
+            b = &samples.back();
+        }
+        else
+        {
+            // If we are maxed out on samples, find the farthest one we have so far
+            // and replace it if the new point is closer:
+            unsigned max_i = 0;
+            for (unsigned i=1; i<samples.size(); ++i)
+                if (samples[i].D2 > samples[max_i].D2)
+                    max_i = i;
+
+            b = &samples[max_i];
+
+            if (b->D2 < D2)
+                b = 0L;
+        }
+
+        if (b)
+        {
+            b->D2 = D2;
+            b->A = seg.A;
+            b->B = seg.B;
+            b->T = t;
+            b->segment = index;
+            b->innerRadius = seg.innerRadius;
+            b->outerRadius = seg.outerRadius;
+        }
+    }
+
     /**
      * Create a heightfield that flattens the terrain around linear geometry.
      * lineWidth = width of completely flat area
      * bufferWidth = width of transition from flat area to natural terrain
      *
+     * Works one heightfield row at a time: posts that fall in the same grid
+     * cell are measured against that cell's segments in one vectorized pass.
+     *
      * Note: this algorithm only samples elevation data from the source (elevation pool).
      * As it progresses, however, it is creating new modified elevation data -- but later
      * points will continue to derive their source data from the original data. This means
@@ -392,138 +620,104 @@ namespace
      * source elevation into the heightfield as a starting point, and then sample that
      * modifiable heightfield as we go along.
      */
-    bool integrateLines(const TileKey& key, osg::HeightField* hf, const MultiGeometry* geom, const SpatialReference* geomSRS,
-                        WidthsList& widths, ElevationPool* pool, ElevationPool::WorkingSet* workingSet,
+    bool integrateLines(const TileKey& key, osg::HeightField* hf, const SegmentGrid& grid, const SpatialReference* geomSRS,
+                        ElevationPool* pool, ElevationPool::WorkingSet* workingSet,
                         bool fillAllPixels, ProgressCallback* progress)
     {
         bool wroteChanges = false;
 
         const GeoExtent& ex = key.getExtent();
 
-        double col_interval = ex.width() / (double)(hf->getNumColumns()-1);
-        double row_interval = ex.height() / (double)(hf->getNumRows()-1);
+        const unsigned numCols = hf->getNumColumns();
+        const unsigned numRows = hf->getNumRows();
+
+        double col_interval = ex.width() / (double)(numCols-1);
+        double row_interval = ex.height() / (double)(numRows-1);
 
-        osg::Vec3d Pex, P, PROJ;
         GeoPoint EP(geomSRS, 0, 0, 0);
 
         ElevationSample elevSample;
 
         bool needsTransform = ex.getSRS() != geomSRS;
+
+        // Segment endpoint elevations, sampled the first time a post needs them
+        const float NOT_SAMPLED = FLT_MAX;
+        std::vector<float> elevA(grid.segments.size(), NOT_SAMPLED);
+        std::vector<float> elevB(grid.segments.size(), NOT_SAMPLED);
+
+        std::vector<osg::Vec3d> points(numCols);
+        std::vector<double> px(numCols), py(numCols), D2(numCols), T(numCols);
+        std::vector<int> cell(numCols);
+        std::vector<Samples> rowSamples(numCols);
+
+        SegmentDistancesFunc segmentDistances = s_segmentDistances.get();
         
         // Loop over the new heightfield.
-        for (unsigned col = 0; col < hf->getNumColumns(); ++col)
+        for (unsigned row = 0; row < numRows; ++row)
         {
-            Pex.x() = ex.xMin() + (double)col * col_interval;
+            // check for cancelation periodically
+            //if (progress && progress->isCanceled())
+            //    return false;
 
-            for (unsigned row = 0; row < hf->getNumRows(); ++row)
+            for (unsigned col = 0; col < numCols; ++col)
             {
-                // check for cancelation periodically
-                //if (progress && progress->isCanceled())
-                //    return false;
+                points[col].set(ex.xMin() + (double)col * col_interval, ex.yMin() + (double)row * row_interval, 0.0);
+            }
 
-                Pex.y() = ex.yMin() + (double)row * row_interval;
+            // Move the points into the working SRS if necessary
+            if (needsTransform)
+                ex.getSRS()->transform(points, geomSRS);
 
-                // Move the point into the working SRS if necessary
-                if (needsTransform)
-                    ex.getSRS()->transform(Pex, geomSRS, P);
-                else
-                    P = Pex;
+            for (unsigned col = 0; col < numCols; ++col)
+            {
+                px[col] = points[col].x();
+                py[col] = points[col].y();
+                cell[col] = grid.cellAt(px[col], py[col]);
+                rowSamples[col].clear();
+            }
 
-                // For each point, we need to find the closest line segments to that point
-                // because the elevation values on these line segments will be the flattening
-                // value. There may be more than one line segment that falls within the search
-                // radius; we will collect up to MaxSamples of these for each heightfield point.
-                static const unsigned Maxsamples = 4;
-                Samples samples;
+            // For each point, we need to find the closest line segments to that point
+            // because the elevation values on these line segments will be the flattening
+            // value. There may be more than one line segment that falls within the search
+            // radius; we will collect up to Maxsamples of these for each heightfield point.
+            // Consecutive posts in the same cell share a candidate list, so measure them
+            // against each candidate together.
+            for (unsigned c0 = 0; c0 < numCols; )
+            {
+                unsigned c1 = c0 + 1;
+                while (c1 < numCols && cell[c1] == cell[c0])
+                    ++c1;
 
-                for (unsigned int geomIndex = 0; geomIndex < geom->getNumComponents(); geomIndex++)
+                if (cell[c0] >= 0)
                 {
-                    Widths w = widths[geomIndex];
-                    double innerRadius = w.lineWidth * 0.5;
-                    double outerRadius = innerRadius + w.bufferWidth;
-                    double outerRadius2 = outerRadius * outerRadius;
-
-                    Geometry* component = geom->getComponents()[geomIndex].get();
-                    // Search for line segments.
-                    ConstGeometryIterator giter(component);
-                    while (giter.hasMore())
+                    const std::vector<unsigned>& candidates = grid.cells[cell[c0]];
+                    for (unsigned index : candidates)
                     {
-                        const Geometry* part = giter.next();                        
-
-                        for (int i = 0; i < part->size()-1; ++i)
-                        {
-                            // AB is a candidate line segment:
-                            const osg::Vec3d& A = (*part)[i];
-                            const osg::Vec3d& B = (*part)[i+1];
-
-                            osg::Vec3d AB = B - A;    // current segment AB
-
-                            double t;                 // parameter [0..1] on segment AB
-                            double D2;                // shortest distance from point P to segment AB, squared
-                            double L2 = AB.length2(); // length (squared) of segment AB
-                            osg::Vec3d AP = P - A;    // vector from endpoint A to point P
-
-                            if (L2 == 0.0)
-                            {
-                                // trivial case: zero-length segment
-                                t = 0.0;
-                                D2 = AP.length2();
-                            }
-                            else
-                            {
-                                // Calculate parameter "t" [0..1] which will yield the closest point on AB to P.
-                                // Clamping it means the closest point won't be beyond the endpoints of the segment.
-                                t = clamp((AP * AB)/L2, 0.0, 1.0);
-
-                                // project our point P onto segment AB:
-                                PROJ.set( A + AB*t );
-
-                                // measure the distance (squared) from P to the projected point on AB:
-                                D2 = (P - PROJ).length2();
-                            }
-
-                            // If the distance from our point to the line segment falls within
-                            // the maximum flattening distance, store it.
-                            if (D2 <= outerRadius2)
-                            {
-                                // see if P is a new sample.
-                                Sample* b;
-                                if (samples.size() < Maxsamples)
-                                {
-                                    // If we haven't collected the maximum number of samples yet,
-                                    // just add this to the list:
-                                    samples.push_back(Sample());
-                                    b = &samples.back();
-                                }
-                                else
-                                {
-                                    // If we are maxed out on samples, find the farthest one we have so far
-                                    // and replace it if the new point is closer:
-                                    unsigned max_i = 0;
-                                    for (unsigned i=1; i<samples.size(); ++i)
-                                        if (samples[i].D2 > samples[max_i].D2)
-                                            max_i = i;
+                        const SegmentRecord& s = grid.segments[index];
+                        double abx = s.B.x() - s.A.x(), aby = s.B.y() - s.A.y();
+                        double L2 = abx*abx + aby*aby;
+                        double seg[5] = { s.A.x(), s.A.y(), abx, aby, L2 > 0.0 ? 1.0/L2 : 0.0 };
 
-                                    b = &samples[max_i];
+                        segmentDistances(seg, &px[c0], &py[c0], c1 - c0, &D2[c0], &T[c0]);
 
-                                    if (b->D2 < D2)
-                                        b = 0L;
-                                }
-
-                                if (b)
-                                {
-                                    b->D2 = D2;
-                                    b->A = A;
-                                    b->B = B;
-                                    b->T = t;
-                                    b->innerRadius = innerRadius;
-                                    b->outerRadius = outerRadius;
-                                }
-                            }
+                        // If the distance from our point to the line segment falls within
+                        // the maximum flattening distance, store it.
+                        double outerRadius2 = s.outerRadius * s.outerRadius;
+                        for (unsigned col = c0; col < c1; ++col)
+                        {
+                            if (D2[col] <= outerRadius2)
+                                addSample(rowSamples[col], s, index, D2[col], T[col]);
                         }
                     }
                 }
 
+                c0 = c1;
+            }
+
+            for (unsigned col = 0; col < numCols; ++col)
+            {
+                Samples& samples = rowSamples[col];
+
                 // Remove unnecessary sample points that lie on the endpoint of a segment
                 // that abuts another segment in our list.
                 for (unsigned i = 0; i < samples.size();) {
@@ -540,9 +734,7 @@ namespace
                 if (samples.size() > 0)
                 {
                     // The original elevation at our point:
-                    //float elevP = pool->getElevation(P.x(), P.y());
-
-                    EP.x() = P.x(), EP.y() = P.y();
+                    EP.x() = px[col], EP.y() = py[col];
 
                     elevSample = pool->getSample(EP, workingSet);
                     float elevP = elevSample.elevation().getValue();
@@ -558,35 +750,36 @@ namespace
                         double blend = clamp(
                             (sample.D - sample.innerRadius) / (sample.outerRadius - sample.innerRadius),
                             0.0, 1.0);
+
+                        float& eA = elevA[sample.segment];
+                        float& eB = elevB[sample.segment];
+
+                        if (sample.T != 1.0 && eA == NOT_SAMPLED)
+                        {
+                            EP.x() = sample.A.x(), EP.y() = sample.A.y();
+                            eA = pool->getSample(EP, workingSet).elevation();
+                        }
+                        if (sample.T != 0.0 && eB == NOT_SAMPLED)
+                        {
+                            EP.x() = sample.B.x(), EP.y() = sample.B.y();
+                            eB = pool->getSample(EP, workingSet).elevation();
+                        }
+
+                        float elevAtA = eA == NO_DATA_VALUE ? elevP : eA;
+                        float elevAtB = eB == NO_DATA_VALUE ? elevP : eB;
                         
                         if (sample.T == 0.0)
                         {
-                            EP.x() = sample.A.x(), EP.y() = sample.A.y();
-                            sample.elevPROJ = pool->getSample(EP, workingSet).elevation();
-                            if (sample.elevPROJ == NO_DATA_VALUE)
-                                sample.elevPROJ = elevP;
+                            sample.elevPROJ = elevAtA;
                         }
                         else if (sample.T == 1.0)
                         {
-                            EP.x() = sample.B.x(), EP.y() = sample.B.y();
-                            sample.elevPROJ = pool->getSample(EP, workingSet).elevation();
-                            if (sample.elevPROJ == NO_DATA_VALUE)
-                                sample.elevPROJ = elevP;
+                            sample.elevPROJ = elevAtB;
                         }
                         else
                         {
-                            EP.x() = sample.A.x(), EP.y() = sample.A.y();
-                            float elevA = pool->getSample(EP, workingSet).elevation();
-                            if (elevA == NO_DATA_VALUE)
-                                elevA = elevP;
-
-                            EP.x() = sample.B.x(), EP.y() = sample.B.y();
-                            float elevB = pool->getSample(EP, workingSet).elevation();
-                            if (elevB == NO_DATA_VALUE)
-                                elevB = elevP;
-
                             // linear interpolation of height from point A to point B on the segment:
-                            sample.elevPROJ = mix(elevA, elevB, sample.T);
+                            sample.elevPROJ = mix(elevAtA, elevAtB, sample.T);
                         }
 
                         // smoothstep interpolation of along the buffer (perpendicular to the segment)
@@ -607,7 +800,7 @@ namespace
                 else if (fillAllPixels)
                 {
                     // No close segments were found, so just copy over the source data.
-                    EP.x() = P.x(), EP.y() = P.y();
+                    EP.x() = px[col], EP.y() = py[col];
                     float h = pool->getSample(EP, workingSet).elevation();
                     hf->setHeight(col, row, h);
 
@@ -620,14 +813,14 @@ namespace
     }
     
 
-    bool integrate(const TileKey& key, osg::HeightField* hf, const MultiGeometry* geom, const SpatialReference* geomSRS,
-                   WidthsList& widths, ElevationPool* pool, ElevationPool::WorkingSet* workingSet,
+    bool integrate(const TileKey& key, osg::HeightField* hf, TileFeatures* features, const SpatialReference* geomSRS,
+                   ElevationPool* pool, ElevationPool::WorkingSet* workingSet,
                    bool fillAllPixels, ProgressCallback* progress)
     {
-        if (geom->isLinear())
-            return integrateLines(key, hf, geom, geomSRS, widths, pool, workingSet, fillAllPixels, progress);
+        if (features->geoms.isLinear())
+            return integrateLines(key, hf, features->grid, geomSRS, pool, workingSet, fillAllPixels, progress);
         else
-            return integratePolygons(key, hf, geom, geomSRS, widths, pool, workingSet, fillAllPixels, progress);
+            return integratePolygons(key, hf, &features->geoms, geomSRS, features->widths, pool, workingSet, fillAllPixels, progress);
     }
 }
 
@@ -844,6 +1037,63 @@ FlatteningLayer::createHeightFieldImplementation(const TileKey& key, ProgressCal
     
     osg::ref_ptr<osg::HeightField> hf;
 
+    // We must do all the feature processing in a projected system since we're using vector math.
+    const SpatialReference* querySRS = featureProfile->getTilingProfile() ?
+        featureProfile->getTilingProfile()->getSRS() :
+        featureSRS;
+
+    const SpatialReference* workingSRS = querySRS->isGeographic() ? SpatialReference::get("spherical-mercator") :
+        querySRS;
+
+    // Neighboring tiles share their parent's query, so fetch (and index) the
+    // features for the whole parent tile once and reuse them.
+    TileKey featureKey = key.getLOD() > 0 ? key.createParentKey() : key;
+
+    osg::ref_ptr<osg::Referenced> cached = getFeatures(featureKey, workingSRS, progress);
+    TileFeatures* features = static_cast<TileFeatures*>(cached.get());
+
+    if (features && !features->geoms.getComponents().empty())
+    {
+        if (!hf.valid())
+        {
+            // Make an empty heightfield to populate:
+            hf = HeightFieldUtils::createReferenceHeightField(
+                key.getExtent(),
+                osgEarth::ELEVATION_TILE_SIZE,
+                osgEarth::ELEVATION_TILE_SIZE,
+                //257, 257,           // base tile size for elevation data
+                0u,                 // no border
+                true);              // initialize to HAE (0.0) heights
+
+            // Initialize to NO DATA.
+            hf->getFloatArray()->assign(hf->getNumColumns()*hf->getNumRows(), NO_DATA_VALUE);
+        }
+
+        // Create an elevation query envelope at the LOD we are creating
+        bool fill = (options().fill() == true);             
+        integrate(key, hf.get(), features, workingSRS, _pool.get(), &_elevWorkingSet, fill, progress);
+    }
+
+    return GeoHeightField(hf.get(), key.getExtent());
+}
+
+osg::ref_ptr<osg::Referenced>
+FlatteningLayer::getFeatures(const TileKey& key, const SpatialReference* workingSRS, ProgressCallback* progress) const
+{
+    // One query per key at a time; siblings arriving together wait for
+    // the first one and then use its result.
+    Threading::ScopedGate<TileKey> gate(_featureGate, key);
+
+    {
+        Threading::ScopedMutexLock lock(_featureCacheMutex);
+        LRUCache<TileKey, osg::ref_ptr<osg::Referenced> >::Record record;
+        if (_featureCache.get(key, record))
+            return record.value();
+    }
+
+    const FeatureProfile* featureProfile = getFeatureSource()->getFeatureProfile();
+    const SpatialReference* featureSRS = featureProfile->getSRS();
+
     // If the feature source has a tiling profile, we are going to have to map the incoming
     // TileKey to a set of intersecting TileKeys in the feature source's tiling profile.
     GeoExtent queryExtent;
@@ -854,14 +1104,14 @@ FlatteningLayer::createHeightFieldImplementation(const TileKey& key, ProgressCal
 
     if (!queryExtent.isValid())
     {
-        return GeoHeightField::INVALID;
+        return 0L;
     }
 
     // Lat/Long extent:
     GeoExtent geoExtent = queryExtent.transform(featureSRS->getGeographicSRS());
     if (!geoExtent.isValid())
     {
-        return GeoHeightField::INVALID;
+        return 0L;
     }
 
     // Buffer the query extent to include the potentially flattened area.
@@ -882,19 +1132,6 @@ FlatteningLayer::createHeightFieldImplementation(const TileKey& key, ProgressCal
     double queryBuffer = 0.5*linewidth + bufferwidth;
     queryExtent.expand(queryBuffer, queryBuffer);
 
-    // We must do all the feature processing in a projected system since we're using vector math.
-#if 0
-    osg::ref_ptr<const SpatialReference> workingSRS = queryExtent.getSRS();
-    //if (workingSRS->isGeographic())
-    {
-        osg::Vec3d refPos = queryExtent.getCentroid();
-        workingSRS = workingSRS->createTangentPlaneSRS(refPos);
-    }
-#else
-    const SpatialReference* workingSRS = queryExtent.getSRS()->isGeographic() ? SpatialReference::get("spherical-mercator") :
-        queryExtent.getSRS();
-#endif
-
     bool needsTransform = !featureSRS->isHorizEquivalentTo(workingSRS);
 
     osg::ref_ptr< StyleSheet > styleSheet = new StyleSheet();
@@ -902,14 +1139,16 @@ FlatteningLayer::createHeightFieldImplementation(const TileKey& key, ProgressCal
     osg::ref_ptr< Session > session = new Session( _map.get(), styleSheet.get());
 
     // We will collection all the feature geometries in this multigeometry:
-    MultiGeometry geoms;
-    WidthsList widths;
+    osg::ref_ptr<TileFeatures> features = new TileFeatures();
+
+    std::vector<Query> queries;
 
     if (featureProfile->getTilingProfile())
     {
-        // Tiled source, must resolve complete set of intersecting tiles:
+        // Tiled source, must resolve complete set of intersecting tiles.
+        // Use the LOD of the child tiles that will share these features.
         std::vector<TileKey> intersectingKeys;
-        featureProfile->getTilingProfile()->getIntersectingTiles(queryExtent, key.getLOD(), intersectingKeys);
+        featureProfile->getTilingProfile()->getIntersectingTiles(queryExtent, key.getLOD() + 1, intersectingKeys);
 
         UnorderedSet<TileKey> featureKeys;
         for (int i = 0; i < intersectingKeys.size(); ++i)
@@ -925,45 +1164,7 @@ FlatteningLayer::createHeightFieldImplementation(const TileKey& key, ProgressCal
         {
             Query query;        
             query.tileKey() = *i;
-
-            osg::ref_ptr<FeatureCursor> cursor = getFeatureSource()->createFeatureCursor(query, progress);
-            while (cursor.valid() && cursor->hasMore())
-            {
-                Feature* feature = cursor->nextFeature();
-
-                double lineWidth = 0.0;
-                double bufferWidth = 0.0;
-                if (options().lineWidth().isSet())
-                {
-                    NumericExpression lineWidthExpr(options().lineWidth().get());
-                    lineWidth = feature->eval(lineWidthExpr, session.get());
-                }
-
-                if (options().bufferWidth().isSet())
-                {
-                    NumericExpression bufferWidthExpr(options().bufferWidth().get());
-                    bufferWidth = feature->eval(bufferWidthExpr, session.get());
-                }
-
-                // Transform the feature geometry to our working (projected) SRS.
-                if (needsTransform)
-                    feature->transform(workingSRS);
-
-                lineWidth = SpatialReference::transformUnits(
-                    Distance(lineWidth, Units::METERS),
-                    featureSRS,
-                    geoExtent.getCentroid().y());
-
-                bufferWidth = SpatialReference::transformUnits(
-                    Distance(bufferWidth, Units::METERS),
-                    featureSRS,
-                    geoExtent.getCentroid().y());
-
-                //TODO: optimization: test the geometry bounds against the expanded tilekey bounds
-                //      in order to discard geometries we don't care about
-                geoms.getComponents().push_back(feature->getGeometry());
-                widths.push_back(Widths(bufferWidth, lineWidth));
-            }
+            queries.push_back(query);
         }
     }
     else
@@ -972,8 +1173,11 @@ FlatteningLayer::createHeightFieldImplementation(const TileKey& key, ProgressCal
         // Set up the query; bounds must be in the feature SRS:
         Query query;
         query.bounds() = queryExtent.bounds();
+        queries.push_back(query);
+    }
 
-        // Run the query and fill the list.
+    for (auto& query : queries)
+    {
         osg::ref_ptr<FeatureCursor> cursor = getFeatureSource()->createFeatureCursor(query, progress);
         while (cursor.valid() && cursor->hasMore())
         {
@@ -1007,39 +1211,64 @@ FlatteningLayer::createHeightFieldImplementation(const TileKey& key, ProgressCal
                 featureSRS,
                 geoExtent.getCentroid().y());
 
-            // Transform the feature geometry to our working (projected) SRS.
-            if (needsTransform)
-                feature->transform(workingSRS);
-
-            //TODO: optimization: test the geometry bounds against the expanded tilekey bounds
-            //      in order to discard geometries we don't care about
-
-            geoms.getComponents().push_back(feature->getGeometry());
-            widths.push_back(Widths(bufferWidth, lineWidth));
+            features->geoms.getComponents().push_back(feature->getGeometry());
+            features->widths.push_back(Widths(bufferWidth, lineWidth));
         }
     }
 
-    if (!geoms.getComponents().empty())
+    if (progress && progress->isCanceled())
     {
-        if (!hf.valid())
+        return 0L;
+    }
+
+    // Index the line segments for integrateLines:
+    if (features->geoms.isLinear())
+    {
+        double maxOuterRadius = 0.0;
+
+        for (unsigned i = 0; i < features->geoms.getNumComponents(); ++i)
         {
-            // Make an empty heightfield to populate:
-            hf = HeightFieldUtils::createReferenceHeightField(
-                queryExtent,
-                osgEarth::ELEVATION_TILE_SIZE,
-                osgEarth::ELEVATION_TILE_SIZE,
-                //257, 257,           // base tile size for elevation data
-                0u,                 // no border
-                true);              // initialize to HAE (0.0) heights
+            const Widths& w = features->widths[i];
+            double innerRadius = w.lineWidth * 0.5;
+            double outerRadius = innerRadius + w.bufferWidth;
+            maxOuterRadius = osg::maximum(maxOuterRadius, outerRadius);
 
-            // Initialize to NO DATA.
-            hf->getFloatArray()->assign(hf->getNumColumns()*hf->getNumRows(), NO_DATA_VALUE);
+            ConstGeometryIterator giter(features->geoms.getComponents()[i].get());
+            while (giter.hasMore())
+            {
+                const Geometry* part = giter.next();
+                for (int j = 0; j < (int)part->size() - 1; ++j)
+                {
+                    SegmentRecord seg;
+                    seg.A = (*part)[j];
+                    seg.B = (*part)[j+1];
+                    seg.innerRadius = innerRadius;
+                    seg.outerRadius = outerRadius;
+                    features->grid.segments.push_back(seg);
+                }
+            }
         }
 
-        // Create an elevation query envelope at the LOD we are creating
-        bool fill = (options().fill() == true);             
-        integrate(key, hf.get(), &geoms, workingSRS, widths, _pool.get(), &_elevWorkingSet, fill, progress);
+        // Only the part of the features near this tile matters.
+        Bounds window;
+        GeoExtent workingExtent = key.getExtent().transform(workingSRS);
+        if (workingExtent.isValid())
+        {
+            window = workingExtent.bounds();
+            window = Bounds(
+                window.xMin() - maxOuterRadius, window.yMin() - maxOuterRadius,
+                window.xMax() + maxOuterRadius, window.yMax() + maxOuterRadius);
+        }
+
+        // A tile is half its parent's width, so this puts a few dozen posts
+        // in each cell.
+        features->grid.build(window, 64u);
     }
 
-    return GeoHeightField(hf.get(), key.getExtent());
+    {
+        Threading::ScopedMutexLock lock(_featureCacheMutex);
+        _featureCache.insert(key, features.get());
+    }
+
+    return features.get();
 }
@@ -23,6 +23,7 @@
 #include <osg/Fog>
 #include <osgEarth/Shaders>
 #include <osgEarth/Registry>
+#include <osgEarth/ShaderFactory>
 
 #define LC "[Fog] "
 
@@ -32,24 +33,17 @@ using namespace osgEarth::Util;
 
 void FogCallback::operator() (osg::StateAttribute* attr, osg::NodeVisitor* nv)
 {
-    // Update the oe_fog_algo uniform to reflect the current algorithm.
+    // Update the fog algorithm feature; the shaders specialize on it.
     osg::Fog* fog = static_cast<osg::Fog*>(attr);
+    int algo =
+        fog->getMode() == osg::Fog::LINEAR ? 0 :
+        fog->getMode() == osg::Fog::EXP ? 1 :
+        2;
+
     for (unsigned int i = 0; i < attr->getNumParents(); i++)
     {
         osg::StateSet* stateSet = attr->getParent(i);
-
-        if (fog->getMode() == osg::Fog::LINEAR)
-        {
-            stateSet->getOrCreateUniform("oe_fog_algo", osg::Uniform::INT)->set(0);
-        }
-        else if (fog->getMode() == osg::Fog::EXP)
-        {
-            stateSet->getOrCreateUniform("oe_fog_algo", osg::Uniform::INT)->set(1);
-        }
-        else if (fog->getMode() == osg::Fog::EXP2)
-        {
-            stateSet->getOrCreateUniform("oe_fog_algo", osg::Uniform::INT)->set(2);
-        }
+        Registry::shaderFactory()->setFeature(stateSet, "OE_FOG_ALGO", "oe_fog_algo", algo);
     }
 }
 
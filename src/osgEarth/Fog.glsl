@@ -4,7 +4,8 @@ $GLSL_DEFAULT_PRECISION_FLOAT
 #pragma vp_entryPoint oe_fog_vertex
 #pragma vp_location   vertex_view
 
-uniform int oe_fog_algo;
+// 0 = linear, 1 = exp, 2 = exp2
+#pragma vp_feature OE_FOG_ALGO oe_fog_algo
 
 out float oe_fogFactor;
 
@@ -13,12 +14,12 @@ void oe_fog_vertex(inout vec4 vertexVIEW)
     float z = length( vertexVIEW.xyz );
 
 	// linear fog
-	if (oe_fog_algo == 0)
+	if (OE_FOG_ALGO == 0)
 	{
 	  oe_fogFactor = clamp((gl_Fog.end - z) / (gl_Fog.end - gl_Fog.start), 0.0, 1.0);
 	}
 	// exp fog
-	else if (oe_fog_algo == 1)
+	else if (OE_FOG_ALGO == 1)
 	{	
 	  oe_fogFactor = clamp(exp( -gl_Fog.density * z ), 0.0, 1.0);
 	}	
@@ -0,0 +1,193 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2020 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#include <osgEarth/FrameGovernor>
+#include <osgEarth/Counters>
+#include <osgEarth/Metrics>
+#include <osgEarth/StringUtils>
+#include <osg/Math>
+#include <osg/Timer>
+#include <atomic>
+#include <cstdlib>
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+// Smoothing factor for the frame time average
+#define SMOOTHING 0.1
+
+// Frames between quality changes when dropping and when recovering
+#define DROP_INTERVAL 10u
+#define RECOVER_INTERVAL 60u
+
+// How far over the target before dropping quality, and how far
+// under before raising it again. With vsync on, frames at the display
+// rate land a hair over a target equal to it, so "under" allows a bit.
+#define DROP_THRESHOLD 1.1
+#define RECOVER_THRESHOLD 1.02
+
+#define STEP 0.1f
+
+namespace
+{
+    double envTarget()
+    {
+        const char* value = ::getenv("OSGEARTH_FRAME_GOVERNOR");
+        return value ? as<double>(value, 16.6) : 0.0;
+    }
+
+    std::atomic<bool> s_enabled(envTarget() > 0.0);
+    std::atomic<double> s_target(envTarget() > 0.0 ? envTarget() : 16.6);
+    std::atomic<float> s_quality(1.0f);
+    std::atomic<double> s_frameTime(0.0);
+
+    std::atomic<float> s_floors[FrameGovernor::NUM_BUDGETS] = {
+        { 0.25f },  // MERGES
+        { 0.5f },   // LOD_SCALE
+        { 0.25f },  // GROUND_COVER
+        { 0.5f },   // DECLUTTER
+        { 0.25f }   // SHADOWS
+    };
+
+    // only touched by frame(), from the update traversal
+    unsigned s_lastFrameNumber = ~0u;
+    osg::Timer_t s_lastTick = 0;
+    unsigned s_framesSinceChange = 0u;
+
+    const Gauge s_qualityGauge("governor.quality_pct");
+}
+
+void
+FrameGovernor::setEnabled(bool value)
+{
+    s_enabled = value;
+    if (!value)
+        s_quality = 1.0f;
+}
+
+bool
+FrameGovernor::isEnabled()
+{
+    return s_enabled;
+}
+
+void
+FrameGovernor::setTargetFrameTime(double ms)
+{
+    s_target = osg::maximum(ms, 1.0);
+}
+
+double
+FrameGovernor::getTargetFrameTime()
+{
+    return s_target;
+}
+
+void
+FrameGovernor::setFloor(Budget budget, float value)
+{
+    if (budget < NUM_BUDGETS)
+        s_floors[budget] = osg::clampBetween(value, 0.1f, 1.0f);
+}
+
+float
+FrameGovernor::getFloor(Budget budget)
+{
+    return budget < NUM_BUDGETS ? s_floors[budget].load() : 1.0f;
+}
+
+void
+FrameGovernor::frame(unsigned frameNumber)
+{
+    if (frameNumber == s_lastFrameNumber)
+        return;
+    s_lastFrameNumber = frameNumber;
+
+    osg::Timer_t now = osg::Timer::instance()->tick();
+    double dt = s_lastTick != 0 ? osg::Timer::instance()->delta_m(s_lastTick, now) : 0.0;
+    s_lastTick = now;
+
+    // nothing to measure yet, or the app stalled (loading, paused in a
+    // debugger) and the gap says nothing about rendering cost
+    if (dt <= 0.0 || dt > 1000.0 || !s_enabled)
+        return;
+
+    double smoothed = s_frameTime > 0.0 ?
+        s_frameTime + (dt - s_frameTime) * SMOOTHING :
+        dt;
+    s_frameTime = smoothed;
+
+    ++s_framesSinceChange;
+
+    float quality = s_quality;
+    double target = s_target;
+
+    if (smoothed > target * DROP_THRESHOLD)
+    {
+        if (quality > 0.0f && s_framesSinceChange >= DROP_INTERVAL)
+        {
+            quality = osg::maximum(quality - STEP, 0.0f);
+            s_framesSinceChange = 0u;
+        }
+    }
+    else if (smoothed < target * RECOVER_THRESHOLD)
+    {
+        if (quality < 1.0f && s_framesSinceChange >= RECOVER_INTERVAL)
+        {
+            quality = osg::minimum(quality + STEP, 1.0f);
+            s_framesSinceChange = 0u;
+        }
+    }
+    else
+    {
+        // holding steady; don't bank frames toward the next change
+        s_framesSinceChange = 0u;
+    }
+
+    // snap to the step so the levels repeat exactly
+    quality = (float)osg::round(quality / STEP) * STEP;
+
+    s_quality = quality;
+    s_qualityGauge.set((std::int64_t)osg::round(quality * 100.0f));
+    OE_PROFILING_PLOT("Governor quality", quality);
+}
+
+float
+FrameGovernor::getQuality()
+{
+    return s_enabled ? s_quality.load() : 1.0f;
+}
+
+double
+FrameGovernor::getFrameTime()
+{
+    return s_frameTime;
+}
+
+float
+FrameGovernor::getScale(Budget budget)
+{
+    if (!s_enabled || budget >= NUM_BUDGETS)
+        return 1.0f;
+
+    float floor = s_floors[budget];
+    return floor + (1.0f - floor) * s_quality.load();
+}
@@ -34,6 +34,7 @@
 #include <osgDB/ImageOptions>
 
 #include <sstream>
+#include <cfloat>
 #include <stdlib.h>
 #include <memory.h>
 
@@ -1020,6 +1021,152 @@ GDAL::Driver::getInterpolatedValue(GDALRasterBand* band, double x, double y, boo
     return result;
 }
 
+namespace
+{
+    // Catmull-Rom weights for the four samples around t in [0..1)
+    inline void cubicWeights(double t, double* w)
+    {
+        w[0] = ((-t + 2.0) * t - 1.0) * t * 0.5;
+        w[1] = ((3.0 * t - 5.0) * t * t + 2.0) * 0.5;
+        w[2] = ((-3.0 * t + 4.0) * t + 1.0) * t * 0.5;
+        w[3] = (t - 1.0) * t * t * 0.5;
+    }
+
+    // Cubic B-spline weights for the four samples around t in [0..1)
+    inline void cubicSplineWeights(double t, double* w)
+    {
+        double it = 1.0 - t;
+        w[0] = it * it * it / 6.0;
+        w[1] = (3.0 * t * t * t - 6.0 * t * t + 4.0) / 6.0;
+        w[2] = (-3.0 * t * t * t + 3.0 * t * t + 3.0 * t + 1.0) / 6.0;
+        w[3] = t * t * t / 6.0;
+    }
+}
+
+float
+GDAL::Driver::getInterpolatedValue(const float* window, int winCol, int winRow, int winCols, int winRows, double c, double r)
+{
+    const int rasterCols = _warpedDS->GetRasterXSize();
+    const int rasterRows = _warpedDS->GetRasterYSize();
+
+    //Apply half pixel offset, using the edge values within half a pixel of the dataset
+    r -= 0.5;
+    c -= 0.5;
+
+    if (c < 0 && c >= -0.5)
+        c = 0;
+    else if (c > rasterCols - 1 && c <= rasterCols - 0.5)
+        c = rasterCols - 1;
+
+    if (r < 0 && r >= -0.5)
+        r = 0;
+    else if (r > rasterRows - 1 && r <= rasterRows - 0.5)
+        r = rasterRows - 1;
+
+    if (c < 0 || r < 0 || c > rasterCols - 1 || r > rasterRows - 1)
+        return NO_DATA_VALUE;
+
+    // clamps a pixel to the dataset and the window before reading it
+    const int colLo = osg::maximum(0, winCol), colHi = osg::minimum(rasterCols, winCol + winCols) - 1;
+    const int rowLo = osg::maximum(0, winRow), rowHi = osg::minimum(rasterRows, winRow + winRows) - 1;
+    auto pixel = [&](int col, int row) {
+        return window[(osg::clampBetween(row, rowLo, rowHi) - winRow) * winCols + (osg::clampBetween(col, colLo, colHi) - winCol)];
+    };
+
+    RasterInterpolation interp = gdalOptions().interpolation().get();
+
+    if (interp == INTERP_CUBIC || interp == INTERP_CUBICSPLINE)
+    {
+        int col = (int)floor(c);
+        int row = (int)floor(r);
+        double wx[4], wy[4];
+        if (interp == INTERP_CUBIC)
+        {
+            cubicWeights(c - (double)col, wx);
+            cubicWeights(r - (double)row, wy);
+        }
+        else
+        {
+            cubicSplineWeights(c - (double)col, wx);
+            cubicSplineWeights(r - (double)row, wy);
+        }
+
+        double sum = 0.0;
+        bool valid = true;
+        for (int j = 0; j < 4 && valid; ++j)
+        {
+            double rowSum = 0.0;
+            for (int i = 0; i < 4; ++i)
+            {
+                float v = pixel(col - 1 + i, row - 1 + j);
+                if (v == NO_DATA_VALUE)
+                {
+                    valid = false;
+                    break;
+                }
+                rowSum += wx[i] * (double)v;
+            }
+            sum += wy[j] * rowSum;
+        }
+
+        if (valid)
+            return (float)sum;
+
+        // Not enough valid neighbors for the cubic kernel; fall back on bilinear.
+        interp = INTERP_BILINEAR;
+    }
+
+    int rowMin = osg::maximum((int)floor(r), 0);
+    int rowMax = osg::maximum(osg::minimum((int)ceil(r), rasterRows - 1), 0);
+    int colMin = osg::maximum((int)floor(c), 0);
+    int colMax = osg::maximum(osg::minimum((int)ceil(c), rasterCols - 1), 0);
+
+    if (rowMin > rowMax) rowMin = rowMax;
+    if (colMin > colMax) colMin = colMax;
+
+    float llHeight = pixel(colMin, rowMin);
+    float ulHeight = pixel(colMin, rowMax);
+    float lrHeight = pixel(colMax, rowMin);
+    float urHeight = pixel(colMax, rowMax);
+
+    if (urHeight == NO_DATA_VALUE || llHeight == NO_DATA_VALUE || ulHeight == NO_DATA_VALUE || lrHeight == NO_DATA_VALUE)
+    {
+        return NO_DATA_VALUE;
+    }
+
+    if (interp == INTERP_AVERAGE)
+    {
+        double x_rem = c - (int)c;
+        double y_rem = r - (int)r;
+
+        double w00 = (1.0 - y_rem) * (1.0 - x_rem) * (double)llHeight;
+        double w01 = (1.0 - y_rem) * x_rem * (double)lrHeight;
+        double w10 = y_rem * (1.0 - x_rem) * (double)ulHeight;
+        double w11 = y_rem * x_rem * (double)urHeight;
+
+        return (float)(w00 + w01 + w10 + w11);
+    }
+
+    if ((colMax == colMin) && (rowMax == rowMin))
+    {
+        return llHeight;
+    }
+    else if (colMax == colMin)
+    {
+        return ((float)rowMax - r) * llHeight + (r - (float)rowMin) * ulHeight;
+    }
+    else if (rowMax == rowMin)
+    {
+        return ((float)colMax - c) * llHeight + (c - (float)colMin) * lrHeight;
+    }
+    else
+    {
+        float r1 = ((float)colMax - c) * llHeight + (c - (float)colMin) * lrHeight;
+        float r2 = ((float)colMax - c) * ulHeight + (c - (float)colMin) * urHeight;
+        return ((float)rowMax - r) * r1 + (r - (float)rowMin) * r2;
+    }
+}
+
 bool
 GDAL::Driver::intersects(const TileKey& key)
 {
@@ -1527,6 +1674,46 @@ GDAL::Driver::createHeightField(const TileKey& key,
         }
         else
         {
+            // Read the pixels under the tile, plus an apron for the interpolation
+            // kernel, with a single RasterIO and interpolate from memory.
+            double cornerX[4] = { xmin, xmax, xmin, xmax };
+            double cornerY[4] = { ymin, ymin, ymax, ymax };
+            double cMin = DBL_MAX, cMax = -DBL_MAX, rMin = DBL_MAX, rMax = -DBL_MAX;
+            for (int i = 0; i < 4; ++i)
+            {
+                double pc, pr;
+                geoToPixel(cornerX[i], cornerY[i], pc, pr);
+                cMin = osg::minimum(cMin, pc); cMax = osg::maximum(cMax, pc);
+                rMin = osg::minimum(rMin, pr); rMax = osg::maximum(rMax, pr);
+            }
+
+            RasterInterpolation interp = gdalOptions().interpolation().get();
+            int apron = (interp == INTERP_CUBIC || interp == INTERP_CUBICSPLINE) ? 2 : 1;
+
+            int winColMin = osg::maximum(0, (int)floor(cMin - 0.5) - apron);
+            int winColMax = osg::minimum(_warpedDS->GetRasterXSize() - 1, (int)ceil(cMax - 0.5) + apron);
+            int winRowMin = osg::maximum(0, (int)floor(rMin - 0.5) - apron);
+            int winRowMax = osg::minimum(_warpedDS->GetRasterYSize() - 1, (int)ceil(rMax - 0.5) + apron);
+
+            if (winColMin > winColMax || winRowMin > winRowMax)
+            {
+                std::vector<float>& heightList = hf->getHeightList();
+                std::fill(heightList.begin(), heightList.end(), NO_DATA_VALUE);
+                return hf.release();
+            }
+
+            int winCols = winColMax - winColMin + 1;
+            int winRows = winRowMax - winRowMin + 1;
+            std::vector<float> window(winCols * winRows, NO_DATA_VALUE);
+
+            rasterIO(band, GF_Read, winColMin, winRowMin, winCols, winRows, &window[0], winCols, winRows, GDT_Float32, 0, 0);
+
+            for (float& v : window)
+            {
+                if (!isValidValue(v, band))
+                    v = NO_DATA_VALUE;
+            }
+
             double dx = (xmax - xmin) / (tileSize - 1);
             double dy = (ymax - ymin) / (tileSize - 1);
             for (unsigned r = 0; r < tileSize; ++r)
@@ -1535,7 +1722,9 @@ GDAL::Driver::createHeightField(const TileKey& key,
                 for (unsigned c = 0; c < tileSize; ++c)
                 {
                     double geoX = xmin + (dx * (double)c);
-                    float h = getInterpolatedValue(band, geoX, geoY) * _linearUnits;
+                    double pc, pr;
+                    geoToPixel(geoX, geoY, pc, pr);
+                    float h = getInterpolatedValue(&window[0], winColMin, winRowMin, winCols, winRows, pc, pr) * _linearUnits;
                     hf->setHeight(c, r, h);
                 }
             }
@@ -1683,6 +1872,194 @@ GDAL::Driver::createHeightFieldWithVRT(const TileKey& key,
     }
     return hf.release();
 }
+
+//...................................................................
+
+namespace
+{
+    typedef std::unordered_map<std::string, osg::observer_ptr<GDAL::DriverPool> > DriverPools;
+
+    Threading::Mutex s_driverPoolsMutex;
+    DriverPools s_driverPools;
+}
+
+osg::ref_ptr<GDAL::DriverPool>
+GDAL::DriverPool::get(const std::string& key, const Factory& factory)
+{
+    Threading::ScopedMutexLock lock(s_driverPoolsMutex);
+
+    osg::ref_ptr<DriverPool> pool;
+    if (s_driverPools[key].lock(pool))
+        return pool;
+
+    // prune the pools no layer holds any more
+    for (DriverPools::iterator i = s_driverPools.begin(); i != s_driverPools.end(); )
+    {
+        if (!i->second.valid() && i->first != key)
+            i = s_driverPools.erase(i);
+        else
+            ++i;
+    }
+
+    pool = new DriverPool(factory);
+    s_driverPools[key] = pool.get();
+    return pool;
+}
+
+GDAL::DriverPool::DriverPool(const Factory& factory) :
+    _size(0u),
+    _factory(factory)
+{
+    //nop
+}
+
+void
+GDAL::DriverPool::adopt(Driver* driver)
+{
+    if (driver)
+    {
+        Threading::ScopedMutexLock lock(_mutex);
+        if (_size < Registry::instance()->getMaxGDALDriversPerDataset())
+        {
+            ++_size;
+            _idle.push_back(driver);
+            _available.notify_one();
+        }
+    }
+}
+
+osg::ref_ptr<GDAL::Driver>
+GDAL::DriverPool::checkout()
+{
+    {
+        std::unique_lock<Threading::Mutex> lock(_mutex);
+
+        while (_idle.empty() && _size >= Registry::instance()->getMaxGDALDriversPerDataset())
+        {
+            _available.wait(lock);
+        }
+
+        if (!_idle.empty())
+        {
+            osg::ref_ptr<Driver> driver = _idle.back();
+            _idle.pop_back();
+            return driver;
+        }
+
+        // reserve a slot, and open the driver outside the lock
+        ++_size;
+    }
+
+    osg::ref_ptr<Driver> driver = _factory();
+
+    if (!driver.valid())
+    {
+        Threading::ScopedMutexLock lock(_mutex);
+        --_size;
+        _available.notify_one();
+    }
+
+    return driver;
+}
+
+void
+GDAL::DriverPool::checkin(Driver* driver)
+{
+    if (driver)
+    {
+        Threading::ScopedMutexLock lock(_mutex);
+        _idle.push_back(driver);
+        _available.notify_one();
+    }
+}
+
+namespace
+{
+    // Everything a pooled driver needs to open, copied out of a layer so
+    // the pool does not depend on the layer that first created it
+    struct DriverSettings
+    {
+        std::string _name;
+        GDAL::Options _gdalOptions;
+        unsigned _tileSize;
+        optional<float> _noDataValue, _minValidValue, _maxValidValue;
+        optional<unsigned> _maxDataLevel;
+        osg::ref_ptr<const Profile> _overrideProfile;
+        osg::ref_ptr<const osgDB::Options> _readOptions;
+
+        DriverSettings(
+            const std::string& name,
+            const GDAL::Options& gdalOptions,
+            const TileLayer::Options& layerOptions,
+            const Profile* overrideProfile,
+            const osgDB::Options* readOptions) :
+            _name(name),
+            _gdalOptions(gdalOptions),
+            _tileSize(layerOptions.tileSize().get()),
+            _noDataValue(layerOptions.noDataValue()),
+            _minValidValue(layerOptions.minValidValue()),
+            _maxValidValue(layerOptions.maxValidValue()),
+            _maxDataLevel(layerOptions.maxDataLevel()),
+            _overrideProfile(overrideProfile),
+            _readOptions(readOptions) { }
+
+        // identifies drivers that are interchangeable
+        std::string key() const
+        {
+            Config conf("gdal");
+            _gdalOptions.writeTo(conf);
+            conf.set("url", _gdalOptions.url()->full());
+            conf.set("tile_size", _tileSize);
+            conf.set("nodata_value", _noDataValue);
+            conf.set("min_valid_value", _minValidValue);
+            conf.set("max_valid_value", _maxValidValue);
+            conf.set("max_data_level", _maxDataLevel);
+            if (_overrideProfile.valid())
+                conf.set("profile", _overrideProfile->getFullSignature());
+            return conf.toJSON();
+        }
+
+        Status open(osg::ref_ptr<GDAL::Driver>& driver, DataExtentList* out_dataExtents) const
+        {
+            driver = new GDAL::Driver();
+
+            if (_noDataValue.isSet())
+                driver->setNoDataValue(_noDataValue.get());
+            if (_minValidValue.isSet())
+                driver->setMinValidValue(_minValidValue.get());
+            if (_maxValidValue.isSet())
+                driver->setMaxValidValue(_maxValidValue.get());
+            if (_maxDataLevel.isSet())
+                driver->setMaxDataLevel(_maxDataLevel.get());
+            if (_overrideProfile.valid())
+                driver->setOverrideProfile(_overrideProfile.get());
+
+            Status status = driver->open(
+                _name,
+                _gdalOptions,
+                _tileSize,
+                out_dataExtents,
+                _readOptions.get());
+
+            if (status.isError())
+                driver = NULL;
+
+            return status;
+        }
+
+        GDAL::DriverPool::Factory factory() const
+        {
+            DriverSettings settings(*this);
+            return [settings]() -> GDAL::Driver*
+            {
+                osg::ref_ptr<GDAL::Driver> driver;
+                settings.open(driver, NULL);
+                return driver.release();
+            };
+        }
+    };
+}
+
 //...................................................................
 
 GDAL::Options::Options(const ConfigOptions& input)
@@ -1766,69 +2143,41 @@ GDALImageLayer::openImplementation()
     if (parent.isError())
         return parent;
 
-    // GDAL thread-safety requirement: each thread requires a separate GDALDataSet.
-    // So we just encapsulate the entire setup once per thread.
-    // https://trac.osgeo.org/gdal/wiki/FAQMiscellaneous#IstheGDALlibrarythread-safe
-    osg::ref_ptr<GDAL::Driver>& driver = _driverPerThread.get();
-
-    osg::ref_ptr<const Profile> profile;
-    Status s = openOnThisThread(driver, &profile, &_overrideProfile);
-    if (s.isError())
-        return s;
-
-    if (profile.valid())
-        setProfile(profile.get());
-
-    return s;
-}
-
-Status
-GDALImageLayer::openOnThisThread(
-    osg::ref_ptr<GDAL::Driver>& driver, 
-    osg::ref_ptr<const Profile>* out_profile,
-    osg::ref_ptr<const Profile>* out_overrideProfile) const
-{
-    driver = new GDAL::Driver();
-
-    if (options().noDataValue().isSet())
-        driver->setNoDataValue( options().noDataValue().get() );
-    if (options().minValidValue().isSet())
-        driver->setMinValidValue( options().minValidValue().get() );
-    if (options().maxValidValue().isSet())
-        driver->setMaxValidValue( options().maxValidValue().get() );
-    if (options().maxDataLevel().isSet())
-        driver->setMaxDataLevel( options().maxDataLevel().get() );
-
     // If the user set an override profile, save it
     // TODO: may want to elevate this to Layer
-    if (getProfile() && out_overrideProfile)
+    if (getProfile())
     {
-        *out_overrideProfile = getProfile();
+        _overrideProfile = getProfile();
     }
 
-    if (_overrideProfile.valid())
-    {
-        driver->setOverrideProfile(_overrideProfile.get());
-    }
+    DriverSettings settings(getName(), options(), options(), _overrideProfile.get(), getReadOptions());
+
+    // GDAL thread-safety requirement: a GDALDataset may only be used by one
+    // thread at a time. Rather than opening it once per thread, share a
+    // bounded pool of drivers with every layer reading the same source.
+    // https://trac.osgeo.org/gdal/wiki/FAQMiscellaneous#IstheGDALlibrarythread-safe
+    _drivers = GDAL::DriverPool::get(settings.key(), settings.factory());
+
+    // With the profile and data extents in the cache, opening the dataset
+    // can wait for the pool's first read.
+    Config cached;
+    if (readCachedMetadata(cached))
+        return Status::NoError;
 
-    DataExtentList* de = out_profile ? &const_cast<GDALImageLayer*>(this)->dataExtents() : NULL;
+    // Open one driver here to discover the profile and data extents.
+    osg::ref_ptr<GDAL::Driver> driver;
+    Status s = settings.open(driver, &dataExtents());
+    if (s.isError())
+        return s;
 
-    Status status = driver->open(
-        getName(),
-        options(),
-        options().tileSize().get(),
-        de,
-        getReadOptions());
+    if (driver->getProfile())
+        setProfile(driver->getProfile());
 
-    if (status.isError())
-        return status;
+    _drivers->adopt(driver.get());
 
-    if (driver->getProfile() && out_profile)
-    {
-        *out_profile = driver->getProfile();
-    }
+    writeCachedMetadata();
 
-    return Status::NoError;
+    return s;
 }
 
 Status
@@ -1837,7 +2186,7 @@ GDALImageLayer::closeImplementation()
     // safely shut down all per-thread handles.
     {
         Threading::ScopedWriteLock exclusive(_workers);
-        _driverPerThread.clear();
+        _drivers = NULL;
     }
     dataExtents().clear();
     setProfile(NULL); // must do this to support override profiles
@@ -1854,13 +2203,7 @@ GDALImageLayer::createImageImplementation(const TileKey& key, ProgressCallback*
     if (isClosing())
         return GeoImage::INVALID;
 
-    osg::ref_ptr<GDAL::Driver>& driver = _driverPerThread.get();
-    if (!driver.valid())
-    {
-        // calling openImpl with NULL params limits the setup
-        // since we already called this during openImplementation
-        openOnThisThread(driver, NULL, NULL);
-    }
+    GDAL::DriverPool::Lease driver(_drivers.get());
 
     osg::ref_ptr<osg::Image> image;
     if (driver.valid())
@@ -1920,69 +2263,41 @@ GDALElevationLayer::openImplementation()
     if (parent.isError())
         return parent;
 
-    // GDAL thread-safety requirement: each thread requires a separate GDALDataSet.
-    // So we just encapsulate the entire setup once per thread.
-    // https://trac.osgeo.org/gdal/wiki/FAQMiscellaneous#IstheGDALlibrarythread-safe
-    osg::ref_ptr<GDAL::Driver>& driver = _driverPerThread.get();
-
-    osg::ref_ptr<const Profile> profile;
-    Status s = openOnThisThread(driver, &profile, &_overrideProfile);
-    if (s.isError())
-        return s;
-
-    if (profile.valid())
-        setProfile(profile.get());
-
-    return s;
-}
-
-Status
-GDALElevationLayer::openOnThisThread(
-    osg::ref_ptr<GDAL::Driver>& driver, 
-    osg::ref_ptr<const Profile>* out_profile,
-    osg::ref_ptr<const Profile>* out_overrideProfile) const
-{
-    driver = new GDAL::Driver();
-
-    if (options().noDataValue().isSet())
-        driver->setNoDataValue( options().noDataValue().get() );
-    if (options().minValidValue().isSet())
-        driver->setMinValidValue( options().minValidValue().get() );
-    if (options().maxValidValue().isSet())
-        driver->setMaxValidValue( options().maxValidValue().get() );
-    if (options().maxDataLevel().isSet())
-        driver->setMaxDataLevel( options().maxDataLevel().get() );
-
     // If the user set an override profile, save it
     // TODO: may want to elevate this to Layer
-    if (getProfile() && out_overrideProfile)
+    if (getProfile())
     {
-        *out_overrideProfile = getProfile();
+        _overrideProfile = getProfile();
     }
 
-    if (_overrideProfile.valid())
-    {
-        driver->setOverrideProfile(_overrideProfile.get());
-    }
+    DriverSettings settings(getName(), options(), options(), _overrideProfile.get(), getReadOptions());
+
+    // GDAL thread-safety requirement: a GDALDataset may only be used by one
+    // thread at a time. Rather than opening it once per thread, share a
+    // bounded pool of drivers with every layer reading the same source.
+    // https://trac.osgeo.org/gdal/wiki/FAQMiscellaneous#IstheGDALlibrarythread-safe
+    _drivers = GDAL::DriverPool::get(settings.key(), settings.factory());
+
+    // With the profile and data extents in the cache, opening the dataset
+    // can wait for the pool's first read.
+    Config cached;
+    if (readCachedMetadata(cached))
+        return Status::NoError;
 
-    DataExtentList* de = out_profile ? &const_cast<GDALElevationLayer*>(this)->dataExtents() : NULL;
+    // Open one driver here to discover the profile and data extents.
+    osg::ref_ptr<GDAL::Driver> driver;
+    Status s = settings.open(driver, &dataExtents());
+    if (s.isError())
+        return s;
 
-    Status status = driver->open(
-        getName(),
-        options(),
-        options().tileSize().get(),
-        de,
-        getReadOptions());
+    if (driver->getProfile())
+        setProfile(driver->getProfile());
 
-    if (status.isError())
-        return status;
+    _drivers->adopt(driver.get());
 
-    if (driver->getProfile() && out_profile)
-    {
-        *out_profile = driver->getProfile();
-    }
+    writeCachedMetadata();
 
-    return Status::NoError;
+    return s;
 }
 
 Status
@@ -1991,7 +2306,7 @@ GDALElevationLayer::closeImplementation()
     // safely shut down all per-thread handles.
     {
         Threading::ScopedWriteLock exclusive(_workers);
-        _driverPerThread.clear();
+        _drivers = NULL;
     }
     dataExtents().clear();
     setProfile(NULL); // must do this to support override profiles
@@ -2008,16 +2323,10 @@ GDALElevationLayer::createHeightFieldImplementation(const TileKey& key, Progress
     if (isClosing())
         return GeoHeightField::INVALID;
 
-    osg::ref_ptr<GDAL::Driver>& driver = _driverPerThread.get();
-    if (!driver.valid())
-    {
-        // calling openImpl with NULL params limits the setup
-        // since we already called this during openImplementation
-        openOnThisThread(driver, NULL, NULL);
-    }
+    GDAL::DriverPool::Lease driver(_drivers.get());
 
     osg::ref_ptr<osg::HeightField> heightfield;
-    if (driver)
+    if (driver.valid())
     {
         if (*_options->useVRT())
         {
@@ -0,0 +1,230 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2020 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#include <osgEarth/GPUTimer>
+#include <osgEarth/Metrics>
+#include <osgEarth/Threading>
+#include <osg/GLExtensions>
+#include <osg/State>
+#include <atomic>
+#include <cstdlib>
+#include <map>
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+#ifndef GL_TIMESTAMP
+#define GL_TIMESTAMP 0x8E28
+#endif
+#ifndef GL_QUERY_RESULT
+#define GL_QUERY_RESULT 0x8866
+#endif
+#ifndef GL_QUERY_RESULT_AVAILABLE
+#define GL_QUERY_RESULT_AVAILABLE 0x8867
+#endif
+
+namespace
+{
+    std::atomic<bool> s_enabled(::getenv("OSGEARTH_GPU_TIMERS") != 0L);
+
+    struct Timers
+    {
+        Threading::Mutex _mutex;
+        std::map<std::string, osg::ref_ptr<GPUTimer> > _byName;
+    };
+
+    Timers& timers()
+    {
+        // leaked on purpose, so a draw thread still running at exit
+        // never sees it destroyed
+        static Timers* s_timers = new Timers();
+        return *s_timers;
+    }
+
+    struct BeginCameraTimer : public osg::Camera::DrawCallback
+    {
+        BeginCameraTimer(GPUTimer* timer, osg::Camera::DrawCallback* next) :
+            _timer(timer), _next(next) { }
+
+        void operator()(osg::RenderInfo& ri) const
+        {
+            _timer->begin(ri);
+            if (_next.valid())
+                (*_next)(ri);
+        }
+
+        osg::ref_ptr<GPUTimer> _timer;
+        osg::ref_ptr<osg::Camera::DrawCallback> _next;
+    };
+
+    struct EndCameraTimer : public osg::Camera::DrawCallback
+    {
+        EndCameraTimer(GPUTimer* timer, osg::Camera::DrawCallback* next) :
+            _timer(timer), _next(next) { }
+
+        void operator()(osg::RenderInfo& ri) const
+        {
+            if (_next.valid())
+                (*_next)(ri);
+            _timer->end(ri);
+        }
+
+        osg::ref_ptr<GPUTimer> _timer;
+        osg::ref_ptr<osg::Camera::DrawCallback> _next;
+    };
+}
+
+GPUTimer::PerContext::PerContext() :
+    _initialized(false),
+    _supported(false),
+    _next(0u),
+    _open(~0u),
+    _glGenQueries(0L),
+    _glQueryCounter(0L),
+    _glGetQueryObjectiv(0L),
+    _glGetQueryObjectui64v(0L)
+{
+    for (unsigned i = 0; i < NUM_SLOTS; ++i)
+        _pending[i] = false;
+}
+
+GPUTimer::GPUTimer(const std::string& name) :
+    _name(name),
+    _plotName("GPU " + name + " ms"),
+    _histogram("gpu." + name + "_ms")
+{
+    //nop
+}
+
+GPUTimer*
+GPUTimer::get(const std::string& name)
+{
+    Timers& t = timers();
+    Threading::ScopedMutexLock lock(t._mutex);
+    osg::ref_ptr<GPUTimer>& timer = t._byName[name];
+    if (!timer.valid())
+        timer = new GPUTimer(name);
+    return timer.get();
+}
+
+void
+GPUTimer::setEnabled(bool value)
+{
+    s_enabled = value;
+}
+
+bool
+GPUTimer::isEnabled()
+{
+    return s_enabled;
+}
+
+void
+GPUTimer::install(osg::Camera* camera, const std::string& name)
+{
+    if (camera)
+    {
+        GPUTimer* timer = get(name);
+        camera->setInitialDrawCallback(new BeginCameraTimer(timer, camera->getInitialDrawCallback()));
+        camera->setFinalDrawCallback(new EndCameraTimer(timer, camera->getFinalDrawCallback()));
+    }
+}
+
+void
+GPUTimer::harvest(PerContext& pc, unsigned slot) const
+{
+    GLuint64_t t0 = 0u, t1 = 0u;
+    pc._glGetQueryObjectui64v(pc._queries[2*slot], GL_QUERY_RESULT, &t0);
+    pc._glGetQueryObjectui64v(pc._queries[2*slot+1], GL_QUERY_RESULT, &t1);
+    pc._pending[slot] = false;
+
+    if (t1 >= t0)
+    {
+        double ms = (double)(t1 - t0) * 1e-6;
+        _histogram.record(ms);
+        OE_PROFILING_PLOT(_plotName.c_str(), (float)ms);
+    }
+}
+
+void
+GPUTimer::begin(osg::RenderInfo& ri) const
+{
+    if (!s_enabled)
+        return;
+
+    PerContext& pc = _pc[ri.getState()->getContextID()];
+
+    if (!pc._initialized)
+    {
+        pc._initialized = true;
+        osg::setGLExtensionFuncPtr(pc._glGenQueries, "glGenQueries", "glGenQueriesARB");
+        osg::setGLExtensionFuncPtr(pc._glQueryCounter, "glQueryCounter", "glQueryCounterARB");
+        osg::setGLExtensionFuncPtr(pc._glGetQueryObjectiv, "glGetQueryObjectiv", "glGetQueryObjectivARB");
+        osg::setGLExtensionFuncPtr(pc._glGetQueryObjectui64v, "glGetQueryObjectui64v", "glGetQueryObjectui64vEXT");
+
+        pc._supported =
+            pc._glGenQueries && pc._glQueryCounter &&
+            pc._glGetQueryObjectiv && pc._glGetQueryObjectui64v;
+
+        if (pc._supported)
+            pc._glGenQueries(2*NUM_SLOTS, pc._queries);
+    }
+
+    // already open (re-entered from a nested pass)
+    if (!pc._supported || pc._open != ~0u)
+        return;
+
+    unsigned slot = pc._next;
+    if (pc._pending[slot])
+    {
+        // still in flight; skip this measurement rather than wait for it
+        GLint available = 0;
+        pc._glGetQueryObjectiv(pc._queries[2*slot+1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            return;
+
+        harvest(pc, slot);
+    }
+
+    pc._glQueryCounter(pc._queries[2*slot], GL_TIMESTAMP);
+    pc._open = slot;
+}
+
+void
+GPUTimer::end(osg::RenderInfo& ri) const
+{
+    PerContext& pc = _pc[ri.getState()->getContextID()];
+    if (pc._open == ~0u)
+        return;
+
+    unsigned slot = pc._open;
+    pc._glQueryCounter(pc._queries[2*slot+1], GL_TIMESTAMP);
+    pc._pending[slot] = true;
+    pc._open = ~0u;
+    pc._next = (slot + 1u) % NUM_SLOTS;
+}
+
+void
+GPUTimer::DrawCallback::drawImplementation(osg::RenderInfo& ri, const osg::Drawable* drawable) const
+{
+    GPUTimer::Scope scope(_timer.get(), ri);
+    drawable->drawImplementation(ri);
+}
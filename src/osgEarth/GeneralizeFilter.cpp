@@ -0,0 +1,358 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+ * Copyright 2020 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarth/GeneralizeFilter>
+#include <osgEarth/FilterContext>
+#include <osgEarth/TopologyGraph>
+#include <algorithm>
+#include <set>
+
+using namespace osgEarth;
+
+OSGEARTH_REGISTER_SIMPLE_FEATUREFILTER(generalize, GeneralizeFilter );
+
+namespace
+{
+    // a line or ring of a feature, and where its verts start in the topology
+    struct Part
+    {
+        Geometry* geom;
+        bool      ring;
+        unsigned  offset;
+        unsigned  count;  // not counting the closing point of a closed ring
+    };
+
+    void collectParts(Geometry* geom, std::vector<Part>& parts)
+    {
+        if (geom->getType() == Geometry::TYPE_MULTI)
+        {
+            GeometryCollection& c = static_cast<MultiGeometry*>(geom)->getComponents();
+            for (GeometryCollection::iterator i = c.begin(); i != c.end(); ++i)
+                collectParts(i->get(), parts);
+        }
+        else if (geom->getType() == Geometry::TYPE_POLYGON)
+        {
+            Part outer = { geom, true, 0u, 0u };
+            parts.push_back(outer);
+
+            RingCollection& holes = static_cast<Polygon*>(geom)->getHoles();
+            for (RingCollection::iterator i = holes.begin(); i != holes.end(); ++i)
+            {
+                Part hole = { i->get(), true, 0u, 0u };
+                parts.push_back(hole);
+            }
+        }
+        else if (geom->getType() == Geometry::TYPE_RING || geom->getType() == Geometry::TYPE_LINESTRING)
+        {
+            Part part = { geom, geom->getType() == Geometry::TYPE_RING, 0u, 0u };
+            parts.push_back(part);
+        }
+    }
+
+    // removes collapsed rings; returns false if nothing is left of geom
+    bool prune(Geometry* geom, const std::set<Geometry*>& collapsed)
+    {
+        if (geom->getType() == Geometry::TYPE_MULTI)
+        {
+            GeometryCollection& c = static_cast<MultiGeometry*>(geom)->getComponents();
+            for (GeometryCollection::iterator i = c.begin(); i != c.end(); )
+            {
+                if (prune(i->get(), collapsed))
+                    ++i;
+                else
+                    i = c.erase(i);
+            }
+            return !c.empty();
+        }
+        else if (geom->getType() == Geometry::TYPE_POLYGON)
+        {
+            if (collapsed.find(geom) != collapsed.end())
+                return false;
+
+            RingCollection& holes = static_cast<Polygon*>(geom)->getHoles();
+            for (RingCollection::iterator i = holes.begin(); i != holes.end(); )
+            {
+                if (collapsed.find(i->get()) != collapsed.end())
+                    i = holes.erase(i);
+                else
+                    ++i;
+            }
+            return true;
+        }
+        else
+        {
+            return collapsed.find(geom) == collapsed.end();
+        }
+    }
+
+    // lexical order, so a shared boundary is always simplified in the same direction
+    inline bool lessXY(const osg::Vec3d& a, const osg::Vec3d& b)
+    {
+        return a.x() < b.x() || (a.x() == b.x() && a.y() < b.y());
+    }
+
+    // squared XY distance from p to the segment ab
+    inline double distance2(const osg::Vec3d& p, const osg::Vec3d& a, const osg::Vec3d& b)
+    {
+        double dx = b.x() - a.x(), dy = b.y() - a.y();
+        double len2 = dx*dx + dy*dy;
+        double t = len2 > 0.0 ? osg::clampBetween(((p.x() - a.x())*dx + (p.y() - a.y())*dy) / len2, 0.0, 1.0) : 0.0;
+        double ex = a.x() + t*dx - p.x(), ey = a.y() + t*dy - p.y();
+        return ex*ex + ey*ey;
+    }
+
+    // Douglas-Peucker over a chain whose two ends are already kept
+    void simplifyChain(const std::vector<const osg::Vec3d*>& chain, std::vector<char>& keep, double tolerance2)
+    {
+        std::vector<std::pair<unsigned, unsigned> > stack;
+        stack.push_back(std::make_pair(0u, (unsigned)chain.size() - 1u));
+
+        while (!stack.empty())
+        {
+            unsigned first = stack.back().first, last = stack.back().second;
+            stack.pop_back();
+
+            double maxDist2 = tolerance2;
+            unsigned farthest = 0u;
+            for (unsigned i = first + 1; i < last; ++i)
+            {
+                double d2 = distance2(*chain[i], *chain[first], *chain[last]);
+                if (d2 > maxDist2)
+                {
+                    maxDist2 = d2;
+                    farthest = i;
+                }
+            }
+
+            if (farthest > 0u)
+            {
+                keep[farthest] = 1;
+                stack.push_back(std::make_pair(first, farthest));
+                stack.push_back(std::make_pair(farthest, last));
+            }
+        }
+    }
+
+    // Simplifies one part, given which of its verts must stay.
+    // Returns false if a ring collapsed.
+    bool simplifyPart(const Part& part, std::vector<char>& keep, double tolerance2)
+    {
+        Geometry& g = *part.geom;
+        unsigned n = part.count;
+
+        if (!part.ring)
+        {
+            if (n < 3)
+                return true;
+            keep[0] = keep[n - 1] = 1;
+        }
+        else if (n < 3)
+        {
+            return false;
+        }
+
+        std::vector<unsigned> fixed;
+        for (unsigned i = 0; i < n; ++i)
+            if (keep[i]) fixed.push_back(i);
+
+        // a ring needs at least two anchors to split it into chains:
+        if (part.ring && fixed.size() < 2)
+        {
+            unsigned anchor = fixed.empty() ? 0u : fixed[0];
+            unsigned farthest = anchor;
+            double maxDist2 = -1.0;
+            for (unsigned i = 0; i < n; ++i)
+            {
+                double d2 = (g[i] - g[anchor]).length2();
+                if (d2 > maxDist2)
+                {
+                    maxDist2 = d2;
+                    farthest = i;
+                }
+            }
+            keep[anchor] = keep[farthest] = 1;
+            fixed.clear();
+            for (unsigned i = 0; i < n; ++i)
+                if (keep[i]) fixed.push_back(i);
+        }
+
+        unsigned numChains = part.ring ? (unsigned)fixed.size() : (unsigned)fixed.size() - 1u;
+        std::vector<unsigned> indices;
+        std::vector<const osg::Vec3d*> chain;
+        std::vector<char> chainKeep;
+
+        for (unsigned c = 0; c < numChains; ++c)
+        {
+            unsigned a = fixed[c];
+            unsigned b = fixed[(c + 1) % fixed.size()];
+
+            indices.clear();
+            for (unsigned i = a; ; i = (i + 1) % n)
+            {
+                indices.push_back(i);
+                if (i == b && indices.size() > 1) break;
+            }
+
+            if (indices.size() < 3)
+                continue;
+
+            if (lessXY(g[b], g[a]))
+                std::reverse(indices.begin(), indices.end());
+
+            chain.resize(indices.size());
+            for (unsigned i = 0; i < indices.size(); ++i)
+                chain[i] = &g[indices[i]];
+
+            chainKeep.assign(indices.size(), 0);
+            simplifyChain(chain, chainKeep, tolerance2);
+
+            for (unsigned i = 0; i < indices.size(); ++i)
+                if (chainKeep[i]) keep[indices[i]] = 1;
+        }
+
+        bool closed = g.size() > n;
+
+        unsigned out = 0;
+        for (unsigned i = 0; i < n; ++i)
+            if (keep[i]) g[out++] = g[i];
+
+        if (part.ring && out < 3)
+            return false;
+
+        g.resize(out);
+        if (closed)
+            g.push_back(g.front());
+
+        return true;
+    }
+}
+
+bool
+GeneralizeFilter::isSupported()
+{
+    return true;
+}
+
+GeneralizeFilter::GeneralizeFilter() :
+GeneralizeFilterOptions()
+{
+    //NOP
+}
+
+GeneralizeFilter::GeneralizeFilter( double tolerance ) :
+GeneralizeFilterOptions()
+{
+    _tolerance = tolerance;
+}
+
+GeneralizeFilter::GeneralizeFilter( const Config& conf ):
+GeneralizeFilterOptions( conf )
+{
+    //nop
+}
+
+FilterContext
+GeneralizeFilter::push( FeatureList& input, FilterContext& context )
+{
+    if ( !isSupported() )
+    {
+        OE_WARN << "GeneralizeFilter support not enabled" << std::endl;
+        return context;
+    }
+
+    if ( tolerance().get() <= 0.0 )
+        return context;
+
+    std::vector<Part> parts;
+    for (FeatureList::iterator i = input.begin(); i != input.end(); ++i)
+    {
+        if (i->valid() && i->get()->getGeometry())
+            collectParts(i->get()->getGeometry(), parts);
+    }
+
+    if (parts.empty())
+        return context;
+
+    // Number the verts of all parts; a closed ring's last point is a repeat
+    // of its first and doesn't count.
+    unsigned total = 0u;
+    for (std::vector<Part>::iterator p = parts.begin(); p != parts.end(); ++p)
+    {
+        Geometry& g = *p->geom;
+        p->offset = total;
+        p->count = g.size();
+        if (p->ring && g.size() > 1 && g.front() == g.back())
+            --p->count;
+        total += p->count;
+    }
+
+    // Which verts must stay: any vert where features (or parts) meet has
+    // something other than exactly two neighbors in the topology.
+    std::vector<char> keep(total, 0);
+
+    if (preserveTopology() == true)
+    {
+        // float verts, so store them relative to the first one
+        const osg::Vec3d& origin = parts.front().geom->front();
+        osg::ref_ptr<osg::Vec3Array> verts = new osg::Vec3Array();
+        verts->reserve(total);
+        for (std::vector<Part>::const_iterator p = parts.begin(); p != parts.end(); ++p)
+            for (unsigned i = 0; i < p->count; ++i)
+                verts->push_back(osg::Vec3((*p->geom)[i] - origin));
+
+        osg::ref_ptr<TopologyGraph> graph = new TopologyGraph();
+        std::vector<TopologyGraph::Index> index;
+        index.reserve(total);
+        for (unsigned v = 0; v < total; ++v)
+            index.push_back(graph->add(verts.get(), v));
+
+        for (std::vector<Part>::const_iterator p = parts.begin(); p != parts.end(); ++p)
+        {
+            for (unsigned i = 0; i + 1 < p->count; ++i)
+                graph->addEdge(index[p->offset + i], index[p->offset + i + 1]);
+            if (p->ring && p->count > 2)
+                graph->addEdge(index[p->offset + p->count - 1], index[p->offset]);
+        }
+
+        for (unsigned v = 0; v < total; ++v)
+            keep[v] = graph->getNumEdges(index[v]) != 2u ? 1 : 0;
+    }
+
+    double tolerance2 = tolerance().get() * tolerance().get();
+    std::set<Geometry*> collapsed;
+    std::vector<char> partKeep;
+
+    for (std::vector<Part>::const_iterator p = parts.begin(); p != parts.end(); ++p)
+    {
+        partKeep.assign(keep.begin() + p->offset, keep.begin() + p->offset + p->count);
+        if (!simplifyPart(*p, partKeep, tolerance2))
+            collapsed.insert(p->geom);
+    }
+
+    // drop what collapsed:
+    for (FeatureList::iterator i = input.begin(); i != input.end(); )
+    {
+        Geometry* geom = i->valid() ? i->get()->getGeometry() : 0L;
+        if (geom && !collapsed.empty() && !prune(geom, collapsed))
+            i = input.erase(i);
+        else
+            ++i;
+    }
+
+    return context;
+}
@@ -23,6 +23,7 @@
 #include <osgEarth/Registry>
 #include <osgEarth/Terrain>
 #include <osgEarth/GDAL>
+#include <osgEarth/BufferPool>
 
 using namespace osgEarth;
 
@@ -1871,8 +1872,8 @@ GeoImage::addTransparentBorder(bool leftBorder, bool rightBorder, bool bottomBor
     if (topBorder)    newT += buffer;
     if (bottomBorder) newT += buffer;
 
-    osg::Image* newImage = new osg::Image;
-    newImage->allocateImage(newS, newT, image->r(), image->getPixelFormat(), image->getDataType(), image->getPacking());
+    PooledImage* newImage = new PooledImage();
+    newImage->allocatePooled(newS, newT, image->r(), image->getPixelFormat(), image->getDataType(), image->getPacking());
     newImage->setInternalTextureFormat(image->getInternalTextureFormat());
     memset(newImage->data(), 0, newImage->getImageSizeInBytes());
     unsigned startC = leftBorder ? buffer : 0;
@@ -1893,6 +1894,120 @@ GeoImage::addTransparentBorder(bool leftBorder, bool rightBorder, bool bottomBor
 
 namespace
 {
+    // Whether the mapping between two SRSs is separable, i.e. x in one
+    // depends only on x in the other (and y only on y). That holds between
+    // geographic and spherical mercator coordinates on the same datum.
+    bool isSeparable(const SpatialReference* a, const SpatialReference* b)
+    {
+        return
+            (a->isGeographic() || a->isSphericalMercator()) &&
+            (b->isGeographic() || b->isSphericalMercator()) &&
+            a->getGeographicSRS()->isHorizEquivalentTo(b->getGeographicSRS());
+    }
+
+    // Computes the source-SRS coordinates of a numx * numy grid of points
+    // spanning an extent in the destination SRS, column-major like
+    // SpatialReference::transformExtentPoints. Separable SRS pairs transform
+    // one row and one column of points; other pairs of SRSs transform a
+    // sparse control grid and interpolate it, unless interpolating would be
+    // off by more than a fraction of a source pixel (srcRes).
+    void computeSourcePoints(
+        const GeoExtent& src_extent, const GeoExtent& dest_extent,
+        double xmin, double ymin, double xmax, double ymax,
+        double* x, double* y, unsigned numx, unsigned numy,
+        double srcRes)
+    {
+        const SpatialReference* from = dest_extent.getSRS();
+        const SpatialReference* to = src_extent.getSRS();
+
+        const double dx = numx > 1 ? (xmax - xmin) / (double)(numx - 1) : 0.0;
+        const double dy = numy > 1 ? (ymax - ymin) / (double)(numy - 1) : 0.0;
+
+        if (isSeparable(from, to))
+        {
+            std::vector<osg::Vec3d> row(numx), col(numy);
+            double midx = 0.5 * (xmin + xmax), midy = 0.5 * (ymin + ymax);
+            for (unsigned c = 0; c < numx; ++c)
+                row[c].set(xmin + dx * (double)c, midy, 0.0);
+            for (unsigned r = 0; r < numy; ++r)
+                col[r].set(midx, ymin + dy * (double)r, 0.0);
+
+            if (from->transform(row, to) && from->transform(col, to))
+            {
+                for (unsigned c = 0; c < numx; ++c)
+                {
+                    for (unsigned r = 0; r < numy; ++r)
+                    {
+                        x[c*numy + r] = row[c].x();
+                        y[c*numy + r] = col[r].y();
+                    }
+                }
+                return;
+            }
+        }
+
+        const unsigned cells = 16u;
+
+        if (numx > cells && numy > cells)
+        {
+            // control grid at the corners of cells*cells cells, plus a check
+            // point at the center of each cell.
+            const unsigned gridSize = cells + 1;
+            std::vector<double> gx(gridSize * gridSize), gy(gridSize * gridSize);
+            std::vector<osg::Vec3d> check(cells * cells);
+            const double cdx = (xmax - xmin) / (double)cells, cdy = (ymax - ymin) / (double)cells;
+            for (unsigned c = 0; c < cells; ++c)
+                for (unsigned r = 0; r < cells; ++r)
+                    check[c*cells + r].set(xmin + cdx * ((double)c + 0.5), ymin + cdy * ((double)r + 0.5), 0.0);
+
+            if (from->transformExtentPoints(to, xmin, ymin, xmax, ymax, &gx[0], &gy[0], gridSize, gridSize) &&
+                from->transform(check, to))
+            {
+                double maxError = 0.0;
+                for (unsigned c = 0; c < cells; ++c)
+                {
+                    for (unsigned r = 0; r < cells; ++r)
+                    {
+                        unsigned i00 = c * gridSize + r, i10 = i00 + gridSize;
+                        double ix = 0.25 * (gx[i00] + gx[i00+1] + gx[i10] + gx[i10+1]);
+                        double iy = 0.25 * (gy[i00] + gy[i00+1] + gy[i10] + gy[i10+1]);
+                        const osg::Vec3d& p = check[c*cells + r];
+                        maxError = osg::maximum(maxError, osg::maximum(fabs(p.x() - ix), fabs(p.y() - iy)));
+                    }
+                }
+
+                if (maxError <= 0.125 * srcRes)
+                {
+                    for (unsigned c = 0; c < numx; ++c)
+                    {
+                        double gc = (double)c * (double)cells / (double)(numx - 1);
+                        unsigned c0 = osg::minimum((unsigned)gc, cells - 1);
+                        double fx = gc - (double)c0;
+
+                        for (unsigned r = 0; r < numy; ++r)
+                        {
+                            double gr = (double)r * (double)cells / (double)(numy - 1);
+                            unsigned r0 = osg::minimum((unsigned)gr, cells - 1);
+                            double fy = gr - (double)r0;
+
+                            unsigned i00 = c0 * gridSize + r0, i10 = i00 + gridSize;
+                            x[c*numy + r] =
+                                (gx[i00] * (1.0 - fy) + gx[i00+1] * fy) * (1.0 - fx) +
+                                (gx[i10] * (1.0 - fy) + gx[i10+1] * fy) * fx;
+                            y[c*numy + r] =
+                                (gy[i00] * (1.0 - fy) + gy[i00+1] * fy) * (1.0 - fx) +
+                                (gy[i10] * (1.0 - fy) + gy[i10+1] * fy) * fx;
+                        }
+                    }
+                    return;
+                }
+            }
+        }
+
+        // transform every point
+        from->transformExtentPoints(to, xmin, ymin, xmax, ymax, x, y, numx, numy);
+    }
+
     osg::Image* manualReproject(
         const osg::Image* image, 
         const GeoExtent&  src_extent, 
@@ -1908,9 +2023,9 @@ namespace
             height = osg::minimum(image->s(), image->t());
         }
 
-        osg::Image *result = new osg::Image();
+        PooledImage* result = new PooledImage();
         //result->allocateImage(width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE);
-        result->allocateImage(width, height, image->r(), image->getPixelFormat(), image->getDataType()); //GL_UNSIGNED_BYTE);
+        result->allocatePooled(width, height, image->r(), image->getPixelFormat(), image->getDataType()); //GL_UNSIGNED_BYTE);
         result->setInternalTextureFormat(image->getInternalTextureFormat());
 
         //Initialize the image to be completely transparent/black
@@ -1933,11 +2048,20 @@ namespace
         double *srcPointsX = new double[numPixels * 2];
         double *srcPointsY = srcPointsX + numPixels;
 
-        dest_extent.getSRS()->transformExtentPoints(
-            src_extent.getSRS(),
+        computeSourcePoints(
+            src_extent, dest_extent,
             dest_extent.xMin() + .5 * dx, dest_extent.yMin() + .5 * dy,
             dest_extent.xMax() - .5 * dx, dest_extent.yMax() - .5 * dy,
-            srcPointsX, srcPointsY, width, height);
+            srcPointsX, srcPointsY, width, height,
+            osg::minimum(src_extent.width() / (double)image->s(), src_extent.height() / (double)image->t()));
+
+        // Nearest-neighbor reads can copy raw pixels, since the result has
+        // the same format as the source.
+        const unsigned pixelBytes = image->getPixelSizeInBits() / 8;
+        const bool copyPixels =
+            !image->isCompressed() &&
+            image->getPixelSizeInBits() % 8 == 0 &&
+            pixelBytes > 0;
 
         ImageUtils::PixelReader ia(image);
         osg::Vec4 color;
@@ -1956,18 +2080,19 @@ namespace
            int pixel = 0;
            double xfac = (image->s() - 1) / src_extent.width();
            double yfac = (image->t() - 1) / src_extent.height();
-           for (unsigned int c = 0; c < width; ++c)
+           // sample points are column-major; write the result row by row
+           for (unsigned int r = 0; r < height; ++r)
            {
-              for (unsigned int r = 0; r < height; ++r)
+              for (unsigned int c = 0; c < width; ++c)
               {
+                 pixel = c * height + r;
                  double src_x = srcPointsX[pixel];
                  double src_y = srcPointsY[pixel];
 
                  if (src_x < src_extent.xMin() || src_x > src_extent.xMax() || src_y < src_extent.yMin() || src_y > src_extent.yMax())
                  {
-                    //If the sample point is outside of the bound of the source extent, increment the pixel and keep looping through.
+                    //If the sample point is outside of the bound of the source extent, keep looping through.
                     //OE_WARN << LC << "ERROR: sample point out of bounds: " << src_x << ", " << src_y << std::endl;
-                    pixel++;
                     continue;
                  }
 
@@ -1979,6 +2104,12 @@ namespace
 
                  color.set(0,0,0,0);
 
+                 if (!interpolate && copyPixels)
+                 {
+                    memcpy(result->data(c, r, depth), image->data(px_i, py_i, depth), pixelBytes);
+                    continue;
+                 }
+
                  // TODO: consider this again later. Causes blockiness.
                  if (!interpolate) //! isSrcContiguous ) // non-contiguous space- use nearest neighbot
                  {
@@ -2043,7 +2174,6 @@ namespace
                  }
 
                  writer(color, c, r, depth);
-                 pixel++;
               }
            }
         }
@@ -19,6 +19,7 @@
 
 #include <osgEarth/Geoid>
 #include <osgEarth/HeightFieldUtils>
+#include <algorithm>
 
 #define LC "[Geoid] "
 
@@ -91,6 +92,49 @@ Geoid::getHeight(double lat_deg, double lon_deg, const RasterInterpolation& inte
     return result;
 }
 
+void
+Geoid::getHeights(double west, double south, double xstep, double ystep,
+                  unsigned cols, unsigned rows, float* out,
+                  const RasterInterpolation& interp) const
+{
+    std::fill(out, out + cols*rows, 0.0f);
+
+    if ( !_valid || !_bounds.isValid() )
+        return;
+
+    // Bounds::contains and the normalized pixel location are separable in
+    // x and y, so compute them once per column and once per row.
+    double colsMax = (double)(_hf->getNumColumns() - 1);
+    double rowsMax = (double)(_hf->getNumRows() - 1);
+
+    std::vector<double> px(cols);
+    std::vector<char> insideX(cols);
+    for (unsigned c = 0; c < cols; ++c)
+    {
+        double lon_deg = west + xstep*double(c);
+        insideX[c] = lon_deg >= _bounds.xMin() && lon_deg <= _bounds.xMax();
+        double nlon = (lon_deg-_bounds.xMin())/_bounds.width();
+        px[c] = osg::clampBetween(nlon, 0.0, 1.0) * colsMax;
+    }
+
+    for (unsigned r = 0; r < rows; ++r)
+    {
+        double lat_deg = south + ystep*double(r);
+        if (lat_deg < _bounds.yMin() || lat_deg > _bounds.yMax())
+            continue;
+
+        double nlat = (lat_deg-_bounds.yMin())/_bounds.height();
+        double py = osg::clampBetween(nlat, 0.0, 1.0) * rowsMax;
+
+        float* row = out + r*cols;
+        for (unsigned c = 0; c < cols; ++c)
+        {
+            if (insideX[c])
+                row[c] = HeightFieldUtils::getHeightAtPixel(_hf.get(), px[c], py, interp);
+        }
+    }
+}
+
 bool
 Geoid::isEquivalentTo( const Geoid& rhs ) const
 {
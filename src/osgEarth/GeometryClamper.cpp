@@ -17,7 +17,12 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>
  */
 #include <osgEarth/GeometryClamper>
+#include <osgEarth/Map>
+#include <osgEarth/ElevationPool>
+#include <osgEarth/Registry>
 #include <osg/Geometry>
+#include <algorithm>
+#include <cfloat>
 
 #define LC "[GeometryClamper] "
 
@@ -26,6 +31,30 @@ using namespace osgEarth::Util;
 
 #define ZOFFSETS_NAME "GeometryClamper::zOffsets"
 
+// elevation tiles in the ElevationPool are this many samples across
+#define ELEVATION_TILE_SIZE 257
+
+namespace
+{
+    void dirtyGeometry(osg::Geometry* geom, osg::Vec3Array* verts)
+    {
+        geom->dirtyBound();
+        if ( geom->getUseVertexBufferObjects() )
+        {
+            verts->getVertexBufferObject()->setUsage( GL_DYNAMIC_DRAW_ARB );
+            verts->dirty();
+        }
+        else
+        {
+#if OSG_VERSION_LESS_THAN(3,6,0)
+            geom->dirtyDisplayList();
+#else
+            geom->dirtyGLObjects();
+#endif
+        }
+    }
+}
+
 //-----------------------------------------------------------------------
 
 GeometryClamper::GeometryClamper(GeometryClamper::LocalData& localData) :
@@ -92,19 +121,73 @@ GeometryClamper::apply(osg::Drawable& drawable)
     bool geomDirty = false;
 
     GeometryData& data = _localData[verts];
-    
-    bool storeAltitudes = false;
 
     if (!data._verts.valid() || data._verts->size() != verts->size())
     {
         data._verts = osg::clone(verts, osg::CopyOp::DEEP_COPY_ALL);
         data._altitudes = new osg::FloatArray();
         data._altitudes->reserve(verts->size());
-        storeAltitudes = true;
+        data._buckets.clear();
+
+        for( unsigned k=0; k<verts->size(); ++k )
+        {
+            if ( isGeocentric )
+            {
+                // should really be the alt along the n_vector but leave for now
+                // since most scene-clamped geometry will be in relative to a
+                // local tangent plane anyway -gw
+                data._altitudes->push_back( (*verts)[k].z() );
+            }
+            else
+            {
+                osg::Vec3d vw = (*verts)[k];
+                vw = vw * local2world;
+                data._altitudes->push_back( float(vw.z()) - _offset);
+            }
+        }
+    }
+
+    // which vertices to clamp:
+    std::vector<unsigned> indices;
+    if (_regions.empty())
+    {
+        indices.resize(verts->size());
+        for (unsigned k = 0; k < indices.size(); ++k)
+            indices[k] = k;
+    }
+    else
+    {
+        if (data._buckets.empty() || data._bucketMatrix != local2world)
+        {
+            buildBuckets(data, local2world);
+        }
+        getIndicesInRegions(data, indices);
+    }
+
+    if (indices.empty())
+        return;
+
+    GeometryClamper::Batch::Item* item = 0L;
+    if (_batch.valid())
+    {
+        _batch->_srs = _terrainSRS.get();
+        _batch->_items.push_back(GeometryClamper::Batch::Item());
+        item = &_batch->_items.back();
+        item->_geom = geom;
+        item->_verts = verts;
+        item->_modifiedCount = verts->getModifiedCount();
+        item->_world2local = world2local;
+        item->_indices.swap(indices);
+        item->_world.reserve(item->_indices.size());
+        item->_heights.reserve(item->_indices.size());
     }
 
-    for( unsigned k=0; k<verts->size(); ++k )
+    const std::vector<unsigned>& toClamp = item ? item->_indices : indices;
+
+    for( unsigned i=0; i<toClamp.size(); ++i )
     {
+        unsigned k = toClamp[i];
+
         osg::Vec3d vw = (*verts)[k];
         vw = vw * local2world;
 
@@ -112,23 +195,13 @@ GeometryClamper::apply(osg::Drawable& drawable)
         {
             // normal to the ellipsoid:
             n_vector = em->computeLocalUpVector(vw.x(),vw.y(),vw.z());
-
-            // if we need to store the original altitudes:
-            if (storeAltitudes)
-            {
-                // should really be the alt along the n_vector but leave for now
-                // since most scene-clamped geometry will be in relative to a
-                // local tangent plane anyway -gw
-                data._altitudes->push_back( (*verts)[k].z() );
-            }
         }
 
-        else
+        if (item)
         {
-            if (storeAltitudes)
-            {
-                data._altitudes->push_back( float(vw.z()) - _offset);
-            }
+            item->_world.push_back(vw);
+            item->_heights.push_back(_offset + (_useVertexZ ? (*data._altitudes)[k] : 0.0f));
+            continue;
         }
 
         _lsi->reset();
@@ -165,25 +238,236 @@ GeometryClamper::apply(osg::Drawable& drawable)
 
     if ( geomDirty )
     {
-        geom->dirtyBound();
-        if ( geom->getUseVertexBufferObjects() )
+        dirtyGeometry(geom, verts);
+
+        OE_DEBUG << LC << "clamped " << count << " verts." << std::endl;
+    }
+}
+
+void
+GeometryClamper::buildBuckets(GeometryData& data, const osg::Matrixd& local2world)
+{
+    // bucket by the original (unclamped) positions, which don't move
+    // when the terrain changes underneath them
+    std::vector<osg::Vec3d> coords(data._verts->size());
+    double xmin = DBL_MAX, ymin = DBL_MAX, xmax = -DBL_MAX, ymax = -DBL_MAX;
+    for (unsigned k = 0; k < coords.size(); ++k)
+    {
+        osg::Vec3d world = osg::Vec3d((*data._verts)[k]) * local2world;
+        _terrainSRS->transformFromWorld(world, coords[k]);
+        xmin = osg::minimum(xmin, coords[k].x()), xmax = osg::maximum(xmax, coords[k].x());
+        ymin = osg::minimum(ymin, coords[k].y()), ymax = osg::maximum(ymax, coords[k].y());
+    }
+
+    // aim for a few dozen vertices per bucket
+    unsigned dim = osg::clampBetween((unsigned)::sqrt((double)coords.size() / 32.0), 1u, 64u);
+    data._bucketCols = dim;
+    data._bucketRows = dim;
+    data._bucketX0 = xmin;
+    data._bucketY0 = ymin;
+    data._bucketWidth = osg::maximum((xmax - xmin) / (double)dim, 1e-9);
+    data._bucketHeight = osg::maximum((ymax - ymin) / (double)dim, 1e-9);
+    data._bucketMatrix = local2world;
+
+    data._buckets.assign(dim*dim, std::vector<unsigned>());
+    for (unsigned k = 0; k < coords.size(); ++k)
+    {
+        unsigned col = osg::minimum((unsigned)((coords[k].x() - xmin) / data._bucketWidth), dim - 1);
+        unsigned row = osg::minimum((unsigned)((coords[k].y() - ymin) / data._bucketHeight), dim - 1);
+        data._buckets[row*dim + col].push_back(k);
+    }
+}
+
+void
+GeometryClamper::getIndicesInRegions(GeometryData& data, std::vector<unsigned>& out_indices)
+{
+    std::vector<GeoExtent> regions;
+    for (unsigned i = 0; i < _regions.size(); ++i)
+    {
+        GeoExtent region = _regions[i].transform(_terrainSRS.get());
+        if (region.isValid())
+            regions.push_back(region);
+    }
+
+    for (unsigned row = 0; row < data._bucketRows; ++row)
+    {
+        for (unsigned col = 0; col < data._bucketCols; ++col)
         {
-            verts->getVertexBufferObject()->setUsage( GL_DYNAMIC_DRAW_ARB );
-            verts->dirty();
+            const std::vector<unsigned>& bucket = data._buckets[row*data._bucketCols + col];
+            if (bucket.empty())
+                continue;
+
+            double x0 = data._bucketX0 + (double)col * data._bucketWidth;
+            double y0 = data._bucketY0 + (double)row * data._bucketHeight;
+            GeoExtent cell(_terrainSRS.get(), x0, y0, x0 + data._bucketWidth, y0 + data._bucketHeight);
+
+            for (unsigned i = 0; i < regions.size(); ++i)
+            {
+                if (regions[i].intersects(cell, false))
+                {
+                    out_indices.insert(out_indices.end(), bucket.begin(), bucket.end());
+                    break;
+                }
+            }
         }
-        else
+    }
+
+    std::sort(out_indices.begin(), out_indices.end());
+}
+
+//-----------------------------------------------------------------------
+
+bool
+GeometryClamper::Batch::compute(const Map* map, double resolution, ProgressCallback* progress)
+{
+    if (!map || !_srs.valid())
+        return false;
+
+    std::vector<osg::Vec4d> points;
+    for (unsigned i = 0; i < _items.size(); ++i)
+    {
+        const Item& item = _items[i];
+        for (unsigned k = 0; k < item._world.size(); ++k)
         {
-#if OSG_VERSION_LESS_THAN(3,6,0)
-            geom->dirtyDisplayList();
-#else
-            geom->dirtyGLObjects();
-#endif
+            osg::Vec3d p;
+            _srs->transformFromWorld(item._world[k], p);
+            points.push_back(osg::Vec4d(p.x(), p.y(), 0.0, resolution));
         }
+    }
 
-        OE_DEBUG << LC << "clamped " << count << " verts." << std::endl;
+    if (map->getElevationPool()->sampleMapCoords(points, 0L, 0L, progress) < 0)
+        return false;
+
+    unsigned p = 0u;
+    for (unsigned i = 0; i < _items.size(); ++i)
+    {
+        Item& item = _items[i];
+        item._results.resize(item._world.size());
+        item._valid.assign(item._world.size(), false);
+        for (unsigned k = 0; k < item._world.size(); ++k, ++p)
+        {
+            if (points[p].z() == NO_DATA_VALUE)
+                continue;
+
+            osg::Vec3d world;
+            osg::Vec3d clamped(points[p].x(), points[p].y(), points[p].z() + item._heights[k]);
+            if (_srs->transformToWorld(clamped, world))
+            {
+                item._results[k] = world * item._world2local;
+                item._valid[k] = true;
+            }
+        }
+    }
+
+    return true;
+}
+
+void
+GeometryClamper::Batch::apply()
+{
+    for (unsigned i = 0; i < _items.size(); ++i)
+    {
+        Item& item = _items[i];
+        if (item._geom->getVertexArray() != item._verts.get() ||
+            item._verts->getModifiedCount() != item._modifiedCount ||
+            item._results.empty())
+            continue;
+
+        osg::Vec3Array& verts = *item._verts;
+        bool geomDirty = false;
+        for (unsigned k = 0; k < item._indices.size(); ++k)
+        {
+            if (item._valid[k] && item._indices[k] < verts.size())
+            {
+                verts[item._indices[k]] = item._results[k];
+                geomDirty = true;
+            }
+        }
+
+        if (geomDirty)
+        {
+            dirtyGeometry(item._geom.get(), item._verts.get());
+        }
+    }
+}
+
+//-----------------------------------------------------------------------
+
+IncrementalGeometryClamper::IncrementalGeometryClamper(GeometryClamper::LocalData& data) :
+_data(data),
+_resolution(DBL_MAX),
+_running(false)
+{
+    //nop
+}
+
+void
+IncrementalGeometryClamper::dirty(const TileKey& key)
+{
+    _regions.push_back(key.getExtent());
+
+    // sample at the resolution of the finest tile that changed
+    _resolution = osg::minimum(
+        _resolution,
+        key.getExtent().width() / (double)(ELEVATION_TILE_SIZE - 1));
+}
+
+void
+IncrementalGeometryClamper::reset()
+{
+    _regions.clear();
+    _resolution = DBL_MAX;
+    _result = Threading::Future<GeometryClamper::Batch>();
+    _running = false;
+}
+
+bool
+IncrementalGeometryClamper::update(osg::Node* subgraph, GeometryClamper& clamper, const Map* map)
+{
+    if (_running)
+    {
+        if (!_result.isAvailable() && !_result.isAbandoned())
+            return true;
+
+        osg::ref_ptr<GeometryClamper::Batch> batch = _result.get();
+        if (batch.valid())
+            batch->apply();
+        _result = Threading::Future<GeometryClamper::Batch>();
+        _running = false;
     }
+
+    if (_regions.empty() || !map)
+        return false;
+
+    osg::ref_ptr<GeometryClamper::Batch> batch = new GeometryClamper::Batch();
+    for (unsigned i = 0; i < _regions.size(); ++i)
+        clamper.addRegion(_regions[i]);
+    clamper.setBatch(batch.get());
+    subgraph->accept(clamper);
+
+    double resolution = _resolution;
+    _regions.clear();
+    _resolution = DBL_MAX;
+
+    if (batch->empty())
+        return false;
+
+    Threading::Promise<GeometryClamper::Batch> promise;
+    _result = promise.getFuture();
+    _running = true;
+
+    osg::ref_ptr<const Map> safeMap = map;
+    Threading::runInJobArena(Registry::instance()->getJobArena("annotations.clamp"), [promise, batch, safeMap, resolution]() mutable {
+        if (!promise.isCanceled() && batch->compute(safeMap.get(), resolution))
+            promise.resolve(batch.get());
+        else
+            promise.resolve(0L);
+    });
+
+    return true;
 }
 
+//-----------------------------------------------------------------------
 
 void
 GeometryClamperCallback::onTileUpdate(const TileKey&          key, 
@@ -36,6 +36,7 @@
 #include <osgEarth/ShaderUtils>
 #include <osgEarth/Utils>
 #include <osgEarth/Metrics>
+#include <osgEarth/Counters>
 
 #include <osg/MatrixTransform>
 #include <osg/Timer>
@@ -52,6 +53,12 @@ using namespace osgEarth::Util;
 
 //#define PROFILING 1
 
+namespace
+{
+    const Histogram s_acmrBefore("features.acmr.before");
+    const Histogram s_acmrAfter("features.acmr.after");
+}
+
 //-----------------------------------------------------------------------
 
 GeometryCompilerOptions GeometryCompilerOptions::s_defaults(true);
@@ -74,6 +81,7 @@ _geoInterp             ( GEOINTERP_GREAT_CIRCLE ),
 _optimizeStateSharing  ( true ),
 _optimize              ( false ),
 _optimizeVertexOrdering( true ),
+_optimizeMeshes        ( false ),
 _validate              ( false ),
 _maxPolyTilingAngle    ( 45.0f ),
 _useOSGTessellator     ( false )
@@ -94,6 +102,7 @@ _geoInterp             ( s_defaults.geoInterp().value() ),
 _optimizeStateSharing  ( s_defaults.optimizeStateSharing().value() ),
 _optimize              ( s_defaults.optimize().value() ),
 _optimizeVertexOrdering( s_defaults.optimizeVertexOrdering().value() ),
+_optimizeMeshes        ( s_defaults.optimizeMeshes().value() ),
 _validate              ( s_defaults.validate().value() ),
 _maxPolyTilingAngle    ( s_defaults.maxPolygonTilingAngle().value() ),
 _useOSGTessellator     (s_defaults.useOSGTessellator().value())
@@ -115,6 +124,7 @@ GeometryCompilerOptions::fromConfig( const Config& conf )
     conf.get( "optimize_state_sharing", _optimizeStateSharing );
     conf.get( "optimize", _optimize );
     conf.get( "optimize_vertex_ordering", _optimizeVertexOrdering);
+    conf.get( "optimize_meshes", _optimizeMeshes );
     conf.get( "validate", _validate );
     conf.get( "max_polygon_tiling_angle", _maxPolyTilingAngle );
     conf.get( "use_osg_tessellator", _useOSGTessellator);
@@ -139,6 +149,7 @@ GeometryCompilerOptions::getConfig() const
     conf.set( "optimize_state_sharing", _optimizeStateSharing );
     conf.set( "optimize", _optimize );
     conf.set( "optimize_vertex_ordering", _optimizeVertexOrdering);
+    conf.set( "optimize_meshes", _optimizeMeshes );
     conf.set( "validate", _validate );
     conf.set( "max_polygon_tiling_angle", _maxPolyTilingAngle );
     conf.set( "use_osg_tessellator", _useOSGTessellator);
@@ -514,10 +525,10 @@ GeometryCompiler::compile(FeatureList&          workingSet,
         osg::ref_ptr<StateSetCache> sscache;
         if ( sharedCX.getSession() )
         {
-            // with a shared cache, don't combine statesets. They may be
-            // in the live graph
+            // share with everything else the session has built; the cache is
+            // thread safe, and only the new graph's statesets get replaced
             sscache = sharedCX.getSession()->getStateSetCache();
-            sscache->consolidateStateAttributes( resultGroup.get() );
+            sscache->optimize( resultGroup.get() );
         }
         else 
         {
@@ -555,6 +566,23 @@ GeometryCompiler::compile(FeatureList&          workingSet,
 
         if ( trackHistory ) history.push_back( "optimize" );
     }
+
+    if ( _options.optimizeMeshes() == true )
+    {
+        MeshOptimizer mo;
+        resultGroup->accept( mo );
+
+        if ( mo.getNumTriangles() > 0 )
+        {
+            s_acmrBefore.record( mo.getACMRBefore() );
+            s_acmrAfter.record( mo.getACMRAfter() );
+
+            OE_DEBUG << LC << "Mesh optimizer: " << mo.getNumTriangles() << " triangles, ACMR "
+                << mo.getACMRBefore() << " -> " << mo.getACMRAfter() << std::endl;
+        }
+
+        if ( trackHistory ) history.push_back( "optimize meshes" );
+    }
     
 
     //test: dump the tile to disk
@@ -22,6 +22,8 @@
 #include <osgEarth/HTM>
 #include <osgEarth/LabelNode>
 #include <osgEarth/DrapeableNode>
+#include <osgEarth/Horizon>
+#include <osgEarth/NodeUtils>
 
 using namespace osgEarth;
 using namespace osgEarth::Contrib;
@@ -134,6 +136,31 @@ _settings(settings)
         drape->addChild(text);
         _debug = drape;
     }
+
+    setCullCallback(settings._horizonCull.get());
+}
+
+osg::BoundingSphere
+HTMNode::computeBound() const
+{
+    // Any object whose bound changed dirtied this cell on the way up.
+    // Hand the ones that left the cell to the group to re-insert; the
+    // scene graph can't change here since we may be in the cull.
+    unsigned numObjects = _isLeaf ? _children.size() : _children.size() - 4;
+    for (unsigned i = 0; i < numObjects; ++i)
+    {
+        osg::Node* node = _children[i].get();
+        const osg::BoundingSphere& bs = node->getBound();
+        if (bs.valid() && !contains(bs.center()))
+        {
+            Threading::ScopedMutexLock lock(_settings._movedMutex);
+            _settings._moved.push_back(std::make_pair(
+                osg::ref_ptr<osg::Group>(const_cast<HTMNode*>(this)),
+                osg::ref_ptr<osg::Node>(node)));
+        }
+    }
+
+    return osg::Group::computeBound();
 }
 
 void
@@ -220,15 +247,20 @@ HTMNode::insert(osg::Node* node)
         const osg::Vec3d& p = node->getBound().center();
 
         // last four children are the subcells
-        for (int i = _children.size() - 1; i >= _children.size()-4; --i)
+        int n = (int)_children.size();
+        for (int i = n - 1; i >= n - 4; --i)
         {
             HTMNode* child = dynamic_cast<HTMNode*>(_children[i].get());
             if ( child && child->contains(p) )
             {
                 child->insert(node);
-                break;
+                return;
             }
         }
+
+        // on an edge the subcells don't quite cover; keep it here,
+        // ahead of the subcells
+        insertChild( 0, node );
     }
 }
 
@@ -291,17 +323,41 @@ HTMGroup::HTMGroup()
     _settings._maxCellSize = 500000;
     _settings._storeObjectsInLeavesOnly = false;
 
+    HorizonCullCallback* horizonCull = new HorizonCullCallback();
+    horizonCull->setEnabled(false);
+    _settings._horizonCull = horizonCull;
+
     // hopefully prevent the OSG optimizer from altering this graph:
     setDataVariance( osg::Object::DYNAMIC );
 
+    // for re-inserting objects that move
+    ADJUST_UPDATE_TRAV_COUNT(this, +1);
+
     reinitialize();
 }
 
+void
+HTMGroup::setHorizonCulling(bool value)
+{
+    static_cast<HorizonCullCallback*>(_settings._horizonCull.get())->setEnabled(value);
+}
+
+bool
+HTMGroup::getHorizonCulling() const
+{
+    return static_cast<const HorizonCullCallback*>(_settings._horizonCull.get())->getEnabled();
+}
+
 void
 HTMGroup::reinitialize()
 {
     _children.clear();
 
+    {
+        Threading::ScopedMutexLock lock(_settings._movedMutex);
+        _settings._moved.clear();
+    }
+
     double rx = 1.0;
     double ry = 1.0;
     double rz = 1.0;
@@ -331,21 +387,47 @@ HTMGroup::insert(osg::Node* node)
     osg::Vec3d p = node->getBound().center();
     p.normalize(); // need?
 
-    bool inserted = false;
-
     for(unsigned i=0; i<_children.size(); ++i)
     {
         HTMNode* child = static_cast<HTMNode*>(_children[i].get());
         if ( child->contains(p) )
         {
             child->insert(node);
-            inserted = true;
-            break;
+            return true;
         }
     }
 
-    return inserted;
+    // No position yet (or at the center of the earth). Park it in the
+    // first cell; once its bound changes, that cell hands it back to us.
+    static_cast<HTMNode*>(_children[0].get())->insertChild(0, node);
+    return true;
+}
+
+void
+HTMGroup::rebalance()
+{
+    std::vector<std::pair<osg::ref_ptr<osg::Group>, osg::ref_ptr<osg::Node> > > moved;
+    {
+        Threading::ScopedMutexLock lock(_settings._movedMutex);
+        if (_settings._moved.empty())
+            return;
+        moved.swap(_settings._moved);
+    }
+
+    for(unsigned i=0; i<moved.size(); ++i)
+    {
+        osg::Group* cell = moved[i].first.get();
+        osg::Node* node = moved[i].second.get();
+
+        // a cell can report the same object more than once
+        if (cell->getChildIndex(node) < cell->getNumChildren())
+        {
+            cell->osg::Group::removeChild(node);
+            insert(node);
+        }
+    }
 }
+
 bool 
 HTMGroup::addChild(osg::Node* child)
 {
@@ -358,13 +440,48 @@ HTMGroup::insertChild(unsigned index, osg::Node* child)
     return insert( child );
 }
 
+bool
+HTMGroup::removeChild(osg::Node* child)
+{
+    if (!child)
+        return false;
+
+    // objects live in the cells, so look for one of ours among its parents
+    for(unsigned i=0; i<child->getNumParents(); ++i)
+    {
+        HTMNode* cell = dynamic_cast<HTMNode*>(child->getParent(i));
+        if (cell && cell->uses(_settings))
+        {
+            return cell->osg::Group::removeChild(child);
+        }
+    }
+    return false;
+}
+
 bool 
 HTMGroup::removeChildren(unsigned pos, unsigned numChildrenToRemove)
 {
-    OE_WARN << LC << "removeChildren() not implemented for HTM" << std::endl;
+    if (pos == 0 && numChildrenToRemove >= getNumChildren())
+    {
+        reinitialize();
+        return true;
+    }
+
+    OE_WARN << LC << "removeChildren() only supports removing everything for HTM" << std::endl;
     return false;
 }
 
+void
+HTMGroup::traverse(osg::NodeVisitor& nv)
+{
+    if (nv.getVisitorType() == nv.UPDATE_VISITOR)
+    {
+        rebalance();
+    }
+
+    osg::Group::traverse(nv);
+}
+
 bool 
 HTMGroup::replaceChild(osg::Node* origChild, osg::Node* newChild)
 {
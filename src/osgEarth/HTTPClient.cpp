@@ -19,10 +19,16 @@
 #include <osgEarth/HTTPClient>
 #include <osgEarth/Progress>
 #include <osgEarth/Metrics>
+#include <osgEarth/NetworkMonitor>
+#include <osgEarth/Trace>
 #include <osgEarth/Version>
 #include <osgDB/ReadFile>
 #include <osgDB/FileNameUtils>
 #include <curl/curl.h>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <random>
 
 // Whether to use WinInet instead of cURL - CMAKE option
 #ifdef OSGEARTH_USE_WININET_FOR_HTTP
@@ -53,12 +59,16 @@ namespace osgEarth
 
         void writeHeader(const char* ptr, size_t realsize)
         {
-            std::string header(ptr);
-            StringTokenizer tok(":");
-            StringVector tized;
-            tok.tokenize(header, tized);
-            if ( tized.size() >= 2 )
-                _headers[tized[0]] = tized[1];
+            // split on the first colon only; values like dates and
+            // quoted entity tags must survive intact
+            std::string header(ptr, realsize);
+            std::string::size_type colon = header.find(':');
+            if ( colon != std::string::npos )
+            {
+                std::string name = trim(header.substr(0, colon));
+                if ( !name.empty() )
+                    _headers[name] = trim(header.substr(colon+1));
+            }
         }
 
         std::ostream* _stream;
@@ -269,6 +279,11 @@ void HTTPRequest::setLastModified( const DateTime &lastModified)
     addHeader("If-Modified-Since", lastModified.asRFC1123());
 }
 
+void HTTPRequest::setETag( const std::string& etag )
+{
+    addHeader("If-None-Match", etag);
+}
+
 
 std::string
 HTTPRequest::getURL() const
@@ -404,6 +419,9 @@ namespace
     static long                        s_timeout = 0;
     static long                        s_connectTimeout = 0;
     static float                       s_retryDelay_s = 0.5f;
+    static float                       s_maxRetryDelay_s = 30.0f;
+
+    thread_local HTTPClient::Priority  s_threadPriority = HTTPClient::PRIORITY_PREFETCH;
 
     // HTTP debugging.
     static bool                        s_HTTP_DEBUG = false;
@@ -420,6 +438,412 @@ namespace
 
 namespace
 {
+    /**
+     * Request scheduling for one host: a token bucket that paces the
+     * request rate, a cap on requests in flight, and the count of
+     * consecutive failures that drives the retry backoff. Waiting
+     * requests are admitted in HTTPClient::Priority order.
+     */
+    class HostLimiter : public osg::Referenced
+    {
+    public:
+        HostLimiter() :
+            _rate(0.0),
+            _burst(1.0),
+            _maxActive(0u),
+            _tokens(1.0),
+            _active(0u),
+            _failures(0u),
+            _last(std::chrono::steady_clock::now())
+        {
+            for (int i = 0; i < NUM_PRIORITIES; ++i)
+                _waiting[i] = 0u;
+        }
+
+        //! Tighten the limits to include the ones in a layer's options
+        void configure(const HTTPLimits& limits)
+        {
+            Threading::ScopedMutexLock lock(_mutex);
+
+            if (limits.maxRequestsPerSecond() > 0.0f)
+            {
+                double rate = limits.maxRequestsPerSecond();
+                _rate = _rate > 0.0 ? osg::minimum(_rate, rate) : rate;
+            }
+            if (limits.burst() > 0u)
+            {
+                _burst = _burst > 1.0 ? osg::minimum(_burst, (double)limits.burst()) : (double)limits.burst();
+            }
+            if (limits.maxConcurrentRequests() > 0u)
+            {
+                _maxActive = _maxActive > 0u ? osg::minimum(_maxActive, limits.maxConcurrentRequests()) : limits.maxConcurrentRequests();
+            }
+        }
+
+        //! Wait until a request at this priority may go out. Set holdSlot
+        //! if the caller will call release() when the request completes.
+        //! Returns false if the progress callback canceled the wait.
+        bool acquire(HTTPClient::Priority priority, bool holdSlot, ProgressCallback* progress)
+        {
+            std::unique_lock<Threading::Mutex> lock(_mutex);
+
+            if (_rate <= 0.0 && _maxActive == 0u)
+            {
+                if (holdSlot) ++_active;
+                return true;
+            }
+
+            ++_waiting[priority];
+
+            for(;;)
+            {
+                refill();
+
+                bool preempted = false;
+                for (int p = 0; p < (int)priority; ++p)
+                    preempted = preempted || _waiting[p] > 0u;
+
+                bool haveSlot = !holdSlot || _maxActive == 0u || _active < _maxActive;
+                bool haveToken = _rate <= 0.0 || _tokens >= 1.0;
+
+                if (!preempted && haveSlot && haveToken)
+                    break;
+
+                if (progress && progress->isCanceled())
+                {
+                    --_waiting[priority];
+                    _cond.notify_all();
+                    return false;
+                }
+
+                // wake up when the next token is due, or when a slot frees up;
+                // poll now and then regardless to notice cancelation.
+                double wait_s = 0.1;
+                if (!preempted && haveSlot && !haveToken)
+                    wait_s = osg::minimum(wait_s, (1.0 - _tokens) / _rate);
+
+                _cond.wait_for(lock, std::chrono::duration<double>(wait_s));
+            }
+
+            --_waiting[priority];
+            if (holdSlot) ++_active;
+            if (_rate > 0.0) _tokens -= 1.0;
+
+            // lower priorities may have been waiting on us
+            _cond.notify_all();
+            return true;
+        }
+
+        void release()
+        {
+            Threading::ScopedMutexLock lock(_mutex);
+            if (_active > 0u)
+                --_active;
+            _cond.notify_all();
+        }
+
+        void recordResult(bool failed)
+        {
+            Threading::ScopedMutexLock lock(_mutex);
+            _failures = failed ? _failures + 1u : 0u;
+        }
+
+        //! Exponential backoff with "equal jitter": half the delay is
+        //! fixed and the other half random.
+        float getRetryDelay(float base_s, float max_s) const
+        {
+            unsigned failures;
+            {
+                Threading::ScopedMutexLock lock(_mutex);
+                failures = _failures;
+            }
+            if (failures <= 1u)
+                return base_s;
+
+            double delay = osg::minimum((double)max_s, (double)base_s * (double)(1u << osg::minimum(failures - 1u, 16u)));
+
+            static thread_local std::minstd_rand s_prng(
+                (unsigned)std::hash<std::thread::id>()(std::this_thread::get_id()));
+            std::uniform_real_distribution<double> jitter(0.5, 1.0);
+            return (float)(delay * jitter(s_prng));
+        }
+
+    private:
+        enum { NUM_PRIORITIES = HTTPClient::PRIORITY_BACKGROUND + 1 };
+
+        void refill()
+        {
+            std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+            if (_rate > 0.0)
+            {
+                double elapsed_s = std::chrono::duration<double>(now - _last).count();
+                _tokens = osg::minimum(osg::maximum(_burst, 1.0), _tokens + elapsed_s * _rate);
+            }
+            _last = now;
+        }
+
+        mutable Threading::Mutex _mutex;
+        std::condition_variable_any _cond;
+        double _rate;
+        double _burst;
+        unsigned _maxActive;
+        double _tokens;
+        unsigned _active;
+        unsigned _waiting[NUM_PRIORITIES];
+        unsigned _failures;
+        std::chrono::steady_clock::time_point _last;
+    };
+
+    static Threading::Mutex s_hostLimitersMutex("HTTPClient HostLimiters(OE)");
+    static UnorderedMap<std::string, osg::ref_ptr<HostLimiter> > s_hostLimiters;
+
+    //! "host[:port]" part of a URL, lowercased
+    std::string getHostKey(const std::string& url)
+    {
+        std::string::size_type start = url.find("://");
+        start = start == std::string::npos ? 0 : start + 3;
+        std::string::size_type end = url.find_first_of("/?#", start);
+        std::string host = url.substr(start, end == std::string::npos ? std::string::npos : end - start);
+
+        // drop any user:password@
+        std::string::size_type at = host.rfind('@');
+        if (at != std::string::npos)
+            host = host.substr(at + 1);
+
+        return osgEarth::toLower(host);
+    }
+
+    HostLimiter* getHostLimiter(const std::string& url)
+    {
+        std::string key = getHostKey(url);
+        Threading::ScopedMutexLock lock(s_hostLimitersMutex);
+        osg::ref_ptr<HostLimiter>& limiter = s_hostLimiters[key];
+        if (!limiter.valid())
+            limiter = new HostLimiter();
+        return limiter.get();
+    }
+
+    // Failures that mean the host is overloaded or unreachable,
+    // and that retries should back off.
+    bool isHostFailure(const HTTPResponse& response)
+    {
+        return
+            !response.isCanceled() &&
+            (response.getCode() == 0 ||
+             response.getCode() == 429 ||
+             response.getCodeCategory() == HTTPResponse::CATEGORY_SERVER_ERROR);
+    }
+}
+
+//.........................................................................
+
+namespace
+{
+    void readCurlProxyOptions(const osgDB::Options* options, std::string& proxy_host, std::string& proxy_port)
+    {
+        // try to set proxy host/port by reading the CURL proxy options
+        if ( options )
+        {
+            std::istringstream iss( options->getOptionString() );
+            std::string opt;
+            while( iss >> opt )
+            {
+                int index = opt.find( "=" );
+                if( opt.substr( 0, index ) == "OSG_CURL_PROXY" )
+                {
+                    proxy_host = opt.substr( index+1 );
+                }
+                else if ( opt.substr( 0, index ) == "OSG_CURL_PROXYPORT" )
+                {
+                    proxy_port = opt.substr( index+1 );
+                }
+            }
+        }
+    }
+
+    // Resolves the proxy address ("host:port", or empty for none) and the
+    // proxy credentials from the global settings, the options and the
+    // environment, in increasing order of precedence.
+    void getCurlProxySettings(const osgDB::Options* options, std::string& proxy_addr, std::string& proxy_auth)
+    {
+        std::string proxy_host;
+        std::string proxy_port = "8080";
+
+        //TODO: don't do all this proxy setup on every GET. Just do it once per client, or only when
+        // the proxy information changes.
+
+        //Try to get the proxy settings from the global settings
+        if (s_proxySettings.isSet())
+        {
+            proxy_host = s_proxySettings.get().hostName();
+            std::stringstream buf;
+            buf << s_proxySettings.get().port();
+            proxy_port = buf.str();
+
+            std::string proxy_username = s_proxySettings.get().userName();
+            std::string proxy_password = s_proxySettings.get().password();
+            if (!proxy_username.empty() && !proxy_password.empty())
+            {
+                proxy_auth = proxy_username + std::string(":") + proxy_password;
+            }
+        }
+
+        //Try to get the proxy settings from the local options that are passed in.
+        readCurlProxyOptions( options, proxy_host, proxy_port );
+
+        optional< ProxySettings > proxySettings;
+        ProxySettings::fromOptions( options, proxySettings );
+        if (proxySettings.isSet())
+        {
+            proxy_host = proxySettings.get().hostName();
+            proxy_port = toString<int>(proxySettings.get().port());
+            OE_DEBUG << LC << "Read proxy settings from options " << proxy_host << " " << proxy_port << std::endl;
+        }
+
+        //Try to get the proxy settings from the environment variable
+        const char* proxyEnvAddress = getenv("OSG_CURL_PROXY");
+        if (proxyEnvAddress) //Env Proxy Settings
+        {
+            proxy_host = std::string(proxyEnvAddress);
+
+            const char* proxyEnvPort = getenv("OSG_CURL_PROXYPORT"); //Searching Proxy Port on Env
+            if (proxyEnvPort)
+            {
+                proxy_port = std::string( proxyEnvPort );
+            }
+        }
+
+        const char* proxyEnvAuth = getenv("OSGEARTH_CURL_PROXYAUTH");
+        if (proxyEnvAuth)
+        {
+            proxy_auth = std::string(proxyEnvAuth);
+        }
+
+        if ( !proxy_host.empty() )
+        {
+            std::stringstream buf;
+            buf << proxy_host << ":" << proxy_port;
+            proxy_addr = buf.str();
+
+            if ( s_HTTP_DEBUG )
+            {
+                OE_NOTICE << LC << "Using proxy: " << proxy_addr << std::endl;
+
+                if (!proxy_auth.empty())
+                {
+                    OE_NOTICE << LC << "Using proxy authentication " << proxy_auth << std::endl;
+                }
+            }
+        }
+    }
+
+    // Request headers in curl form. Caller frees the list.
+    curl_slist* makeCurlHeaders(const HTTPRequest& request)
+    {
+        struct curl_slist *headers=NULL;
+        for (HTTPRequest::Parameters::const_iterator itr = request.getHeaders().begin(); itr != request.getHeaders().end(); ++itr)
+        {
+            std::stringstream buf;
+            buf << osgEarth::toLower(itr->first) << ": " << itr->second;
+            headers = curl_slist_append(headers, buf.str().c_str());
+        }
+
+        // Disable the default Pragma: no-cache that curl adds by default.
+        headers = curl_slist_append(headers, "pragma: ");
+        return headers;
+    }
+
+    // Builds the response for a finished transfer on a curl easy handle
+    HTTPResponse makeCurlResponse(
+        CURL* handle,
+        CURLcode res,
+        bool usedProxy,
+        HTTPResponse::Part* part,
+        StreamObject& sp,
+        const std::string& url)
+    {
+        if (usedProxy)
+        {
+            long connect_code = 0L;
+            CURLcode r = curl_easy_getinfo(handle, CURLINFO_HTTP_CONNECTCODE, &connect_code);
+            if ( r != CURLE_OK )
+            {
+                OE_WARN << LC << "Proxy connect error: " << curl_easy_strerror(r) << std::endl;
+                return HTTPResponse(0);
+            }
+        }
+
+        long response_code = 0L;
+        curl_easy_getinfo( handle, CURLINFO_RESPONSE_CODE, &response_code );
+
+        if (s_simResponseCode > 0)
+        {
+            unsigned hash = std::hash<double>()(osg::Timer::instance()->tick()) % 10;
+            if (hash == 0)
+                response_code = s_simResponseCode;
+        }
+
+        HTTPResponse response( response_code );
+
+        // read the response content type:
+        char* content_type_cp;
+
+        curl_easy_getinfo( handle, CURLINFO_CONTENT_TYPE, &content_type_cp );
+
+        if ( content_type_cp != NULL )
+        {
+            response.setMimeType(content_type_cp);
+        }
+
+        // read the file time:
+        response.setLastModified(getCurlFileTime( handle ));
+
+        if (res == CURLE_OK)
+        {
+            // check for multipart content
+            if (response.getMimeType().length() > 9 &&
+                ::strstr( response.getMimeType().c_str(), "multipart" ) == response.getMimeType().c_str() )
+            {
+                OE_DEBUG << LC << "detected multipart data; decoding..." << std::endl;
+
+                //TODO: parse out the "wcs" -- this is WCS-specific
+                if ( !decodeMultipartStream( "wcs", part, response.getParts() ) )
+                {
+                    // error decoding an invalid multipart stream.
+                    // should we do anything, or just leave the response empty?
+                }
+            }
+            else
+            {
+                for (Headers::iterator itr = sp._headers.begin(); itr != sp._headers.end(); ++itr)
+                {
+                    part->_headers[itr->first] = itr->second;
+                }
+
+                // Write the headers to the metadata
+                response.getParts().push_back( part );
+            }
+        }
+
+        else if (res == CURLE_ABORTED_BY_CALLBACK || res == CURLE_OPERATION_TIMEDOUT)
+        {
+            //If we were aborted by a callback, then it was cancelled by a user
+            response.setCanceled(true);
+        }
+
+        else
+        {
+            response.setMessage(curl_easy_strerror(res));
+
+            if (res == CURLE_GOT_NOTHING)
+            {
+                OE_DEBUG << LC << "CURLE_GOT_NOTHING for " << url << std::endl;
+            }
+        }
+
+        return response;
+    }
+
     class CURLImplementation : public HTTPClient::Implementation
     {
     public:
@@ -469,86 +893,18 @@ namespace
                 options->getAuthenticationMap() :
                 osgDB::Registry::instance()->getAuthenticationMap();
 
-            std::string proxy_host;
-            std::string proxy_port = "8080";
-            std::string proxy_auth;
-
-            //TODO: don't do all this proxy setup on every GET. Just do it once per client, or only when
-            // the proxy information changes.
-
-            //Try to get the proxy settings from the global settings
-            if (s_proxySettings.isSet())
-            {
-                proxy_host = s_proxySettings.get().hostName();
-                std::stringstream buf;
-                buf << s_proxySettings.get().port();
-                proxy_port = buf.str();
-
-                std::string proxy_username = s_proxySettings.get().userName();
-                std::string proxy_password = s_proxySettings.get().password();
-                if (!proxy_username.empty() && !proxy_password.empty())
-                {
-                    proxy_auth = proxy_username + std::string(":") + proxy_password;
-                }
-            }
-
-            //Try to get the proxy settings from the local options that are passed in.
-            readOptions( options, proxy_host, proxy_port );
-
-            optional< ProxySettings > proxySettings;
-            ProxySettings::fromOptions( options, proxySettings );
-            if (proxySettings.isSet())
-            {
-                proxy_host = proxySettings.get().hostName();
-                proxy_port = toString<int>(proxySettings.get().port());
-                OE_DEBUG << LC << "Read proxy settings from options " << proxy_host << " " << proxy_port << std::endl;
-            }
-
-            //Try to get the proxy settings from the environment variable
-            const char* proxyEnvAddress = getenv("OSG_CURL_PROXY");
-            if (proxyEnvAddress) //Env Proxy Settings
-            {
-                proxy_host = std::string(proxyEnvAddress);
-
-                const char* proxyEnvPort = getenv("OSG_CURL_PROXYPORT"); //Searching Proxy Port on Env
-                if (proxyEnvPort)
-                {
-                    proxy_port = std::string( proxyEnvPort );
-                }
-            }
-
-            const char* proxyEnvAuth = getenv("OSGEARTH_CURL_PROXYAUTH");
-            if (proxyEnvAuth)
-            {
-                proxy_auth = std::string(proxyEnvAuth);
-            }
-
             // Set up proxy server:
-            std::string proxy_addr;
-            if ( !proxy_host.empty() )
-            {
-                std::stringstream buf;
-                buf << proxy_host << ":" << proxy_port;
-                std::string bufStr;
-                bufStr = buf.str();
-                proxy_addr = bufStr;
-
-                if ( s_HTTP_DEBUG )
-                {
-                    OE_NOTICE << LC << "Using proxy: " << proxy_addr << std::endl;
-                }
+            std::string proxy_addr, proxy_auth;
+            getCurlProxySettings(options, proxy_addr, proxy_auth);
 
+            if ( !proxy_addr.empty() )
+            {
                 //curl_easy_setopt( _curl_handle, CURLOPT_HTTPPROXYTUNNEL, 1 );
                 curl_easy_setopt( _curl_handle, CURLOPT_PROXY, proxy_addr.c_str() );
 
                 //Setup the proxy authentication if setup
                 if (!proxy_auth.empty())
                 {
-                    if ( s_HTTP_DEBUG )
-                    {
-                        OE_NOTICE << LC << "Using proxy authentication " << proxy_auth << std::endl;
-                    }
-
                     curl_easy_setopt( _curl_handle, CURLOPT_PROXYUSERPWD, proxy_auth.c_str());
                 }
             }
@@ -609,19 +965,7 @@ namespace
 
 
             // Set any headers
-            struct curl_slist *headers=NULL;
-            if (!request.getHeaders().empty())
-            {
-                for (HTTPRequest::Parameters::const_iterator itr = request.getHeaders().begin(); itr != request.getHeaders().end(); ++itr)
-                {
-                    std::stringstream buf;
-                    buf << osgEarth::toLower(itr->first) << ": " << itr->second;
-                    headers = curl_slist_append(headers, buf.str().c_str());
-                }
-            }
-
-            // Disable the default Pragma: no-cache that curl adds by default.
-            headers = curl_slist_append(headers, "pragma: ");
+            struct curl_slist *headers = makeCurlHeaders(request);
             curl_easy_setopt(_curl_handle, CURLOPT_HTTPHEADER, headers);
 
             osg::ref_ptr<HTTPResponse::Part> part = new HTTPResponse::Part();
@@ -636,7 +980,6 @@ namespace
             }
 
             CURLcode res;
-            long response_code = 0L;
 
             OE_START_TIMER(get_duration);
 
@@ -661,92 +1004,8 @@ namespace
             curl_easy_setopt( _curl_handle, CURLOPT_WRITEDATA, (void*)0 );
             curl_easy_setopt( _curl_handle, CURLOPT_PROGRESSDATA, (void*)0);
 
-            if (!proxy_addr.empty())
-            {
-                long connect_code = 0L;
-                CURLcode r = curl_easy_getinfo(_curl_handle, CURLINFO_HTTP_CONNECTCODE, &connect_code);
-                if ( r != CURLE_OK )
-                {
-                    OE_WARN << LC << "Proxy connect error: " << curl_easy_strerror(r) << std::endl;
-
-                    // Free the headers
-                    if (headers)
-                    {
-                        curl_slist_free_all(headers);
-                    }
-
-                    return HTTPResponse(0);
-                }
-            }
-
-            curl_easy_getinfo( _curl_handle, CURLINFO_RESPONSE_CODE, &response_code );
-
-            if (s_simResponseCode > 0)
-            {
-                unsigned hash = std::hash<double>()(osg::Timer::instance()->tick()) % 10;
-                if (hash == 0)
-                    response_code = s_simResponseCode;
-            }
-
-            HTTPResponse response( response_code );
-
-
-
-            // read the response content type:
-            char* content_type_cp;
-
-            curl_easy_getinfo( _curl_handle, CURLINFO_CONTENT_TYPE, &content_type_cp );
-
-            if ( content_type_cp != NULL )
-            {
-                response.setMimeType(content_type_cp);
-            }
-
-            // read the file time:
-            response.setLastModified(getCurlFileTime( _curl_handle ));
-
-            if (res == CURLE_OK)
-            {
-                // check for multipart content
-                if (response.getMimeType().length() > 9 &&
-                    ::strstr( response.getMimeType().c_str(), "multipart" ) == response.getMimeType().c_str() )
-                {
-                    OE_DEBUG << LC << "detected multipart data; decoding..." << std::endl;
-
-                    //TODO: parse out the "wcs" -- this is WCS-specific
-                    if ( !decodeMultipartStream( "wcs", part.get(), response.getParts() ) )
-                    {
-                        // error decoding an invalid multipart stream.
-                        // should we do anything, or just leave the response empty?
-                    }
-                }
-                else
-                {
-                    for (Headers::iterator itr = sp._headers.begin(); itr != sp._headers.end(); ++itr)
-                    {
-                        part->_headers[itr->first] = itr->second;
-                    }
-
-                    // Write the headers to the metadata
-                    response.getParts().push_back( part.get() );
-                }
-            }
-
-            else if (res == CURLE_ABORTED_BY_CALLBACK || res == CURLE_OPERATION_TIMEDOUT)
-            {
-                //If we were aborted by a callback, then it was cancelled by a user
-                response.setCanceled(true);
-            }
-
-            else
-            {
-                response.setMessage(curl_easy_strerror(res));
-
-                if (res == CURLE_GOT_NOTHING)
-                {
-                    OE_DEBUG << LC << "CURLE_GOT_NOTHING for " << url << std::endl;
-                }
-            }
+            HTTPResponse response = makeCurlResponse(
+                _curl_handle, res, !proxy_addr.empty(), part.get(), sp, url);
 
             response.setDuration(OE_STOP_TIMER(get_duration));
 
@@ -755,7 +1014,7 @@ namespace
                 TimeStamp filetime = getCurlFileTime(_curl_handle);
 
                 OE_NOTICE << LC
-                    << "GET(" << response_code << ") " << response.getMimeType() << ": \""
+                    << "GET(" << response.getCode() << ") " << response.getMimeType() << ": \""
                     << url << "\" (" << DateTime(filetime).asRFC1123() << ") t="
                     << std::setprecision(4) << response.getDuration() << "s" << std::endl;
 
@@ -836,39 +1095,380 @@ namespace
             curl_easy_setopt( _curl_handle, CURLOPT_CONNECTTIMEOUT, value );
         }
 
-        void readOptions(const osgDB::Options* options, std::string& proxy_host, std::string& proxy_port) const
+    private:
+        void* _curl_handle;
+        mutable std::string _previousPassword;
+        mutable long _previousHttpAuthentication;
+    };
+}
+
+Future<RefHTTPResponse>
+HTTPClient::Implementation::doGetAsync(
+    const HTTPRequest&    request,
+    const osgDB::Options* options,
+    ProgressCallback*     progress) const
+{
+    Promise<RefHTTPResponse> promise;
+    promise.resolve(new RefHTTPResponse(doGet(request, options, progress)));
+    return promise.getFuture();
+}
+
+HTTPClient::Implementation*
+CURLHTTPImplementationFactory::create() const
+{
+    return new CURLImplementation();
+}
+
+//........................................................................
+
+namespace
+{
+    class CURLMultiEngine;
+
+    // One GET in flight on the shared multi handle
+    struct CURLTransfer
+    {
+        CURLTransfer() : _handle(0L), _headers(0L), _sp(0L), _usedProxy(false) { _errorBuf[0] = 0; }
+
+        CURL* _handle;
+        curl_slist* _headers;
+        std::string _url;
+        std::string _proxyAddr, _proxyAuth, _userpwd;
+        osg::ref_ptr<HTTPResponse::Part> _part;
+        StreamObject _sp;
+        bool _usedProxy;
+        char _errorBuf[CURL_ERROR_SIZE];
+        osg::ref_ptr<ProgressCallback> _progress;
+        Promise<RefHTTPResponse> _promise;
+        osg::Timer_t _start;
+    };
+
+    // Aborts a transfer whose caller went away or canceled it
+    static int CurlMultiProgressCallback(void *clientp, double dltotal, double dlnow, double ultotal, double ulnow)
+    {
+        CURLTransfer* t = (CURLTransfer*)clientp;
+        if (t->_promise.isCanceled() || t->_promise.isAbandoned())
+            return 1;
+        return CurlProgressCallback(t->_progress.get(), dltotal, dlnow, ultotal, ulnow);
+    }
+
+    /**
+     * Process-wide curl_multi event loop. Every CURLMultiImplementation
+     * submits its transfers here, so all threads share one connection
+     * pool (plus DNS and TLS session caches via curl_share) and HTTP/2
+     * servers multiplex concurrent requests over a single connection.
+     */
+    class CURLMultiEngine
+    {
+    public:
+        static CURLMultiEngine& instance()
+        {
+            static CURLMultiEngine s_engine;
+            return s_engine;
+        }
+
+        void submit(CURLTransfer* t)
         {
-            // try to set proxy host/port by reading the CURL proxy options
-            if ( options )
             {
-                std::istringstream iss( options->getOptionString() );
-                std::string opt;
-                while( iss >> opt )
+                Threading::ScopedMutexLock lock(_queueMutex);
+                _incoming.push_back(t);
+                if (!_thread.joinable())
+                    _thread = std::thread(&CURLMultiEngine::run, this);
+            }
+            _work.set();
+#if LIBCURL_VERSION_NUM >= 0x074400 // 7.68.0
+            curl_multi_wakeup(_multi);
+#endif
+        }
+
+        CURLSH* share() const { return _share; }
+
+    private:
+        CURLMultiEngine() :
+            _done(false),
+            _queueMutex("CURLMultiEngine(OE)")
+        {
+            _multi = curl_multi_init();
+
+            unsigned maxHost = 16u;
+            const char* maxHostEnv = ::getenv("OSGEARTH_HTTP_MAX_HOST_CONNECTIONS");
+            if (maxHostEnv)
+                maxHost = osgEarth::as<unsigned>(std::string(maxHostEnv), maxHost);
+
+#if LIBCURL_VERSION_NUM >= 0x071e00 // 7.30.0
+            curl_multi_setopt(_multi, CURLMOPT_MAX_HOST_CONNECTIONS, (long)maxHost);
+#endif
+#if LIBCURL_VERSION_NUM >= 0x072b00 // 7.43.0
+            curl_multi_setopt(_multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+#endif
+
+            _share = curl_share_init();
+            curl_share_setopt(_share, CURLSHOPT_LOCKFUNC, &CURLMultiEngine::lockShare);
+            curl_share_setopt(_share, CURLSHOPT_UNLOCKFUNC, &CURLMultiEngine::unlockShare);
+            curl_share_setopt(_share, CURLSHOPT_USERDATA, this);
+            curl_share_setopt(_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+            curl_share_setopt(_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+        }
+
+        ~CURLMultiEngine()
+        {
+            _done = true;
+            _work.set();
+#if LIBCURL_VERSION_NUM >= 0x074400
+            curl_multi_wakeup(_multi);
+#endif
+            if (_thread.joinable())
+                _thread.join();
+
+            curl_multi_cleanup(_multi);
+            curl_share_cleanup(_share);
+        }
+
+        static void lockShare(CURL*, curl_lock_data data, curl_lock_access, void* userptr)
+        {
+            static_cast<CURLMultiEngine*>(userptr)->_shareMutex[data % CURL_LOCK_DATA_LAST].lock();
+        }
+
+        static void unlockShare(CURL*, curl_lock_data data, void* userptr)
+        {
+            static_cast<CURLMultiEngine*>(userptr)->_shareMutex[data % CURL_LOCK_DATA_LAST].unlock();
+        }
+
+        void run()
+        {
+            int running = 0;
+
+            while (!_done)
+            {
+                std::vector<CURLTransfer*> incoming;
                 {
-                    int index = opt.find( "=" );
-                    if( opt.substr( 0, index ) == "OSG_CURL_PROXY" )
-                    {
-                        proxy_host = opt.substr( index+1 );
-                    }
-                    else if ( opt.substr( 0, index ) == "OSG_CURL_PROXYPORT" )
+                    Threading::ScopedMutexLock lock(_queueMutex);
+                    incoming.swap(_incoming);
+                }
+
+                for (auto t : incoming)
+                {
+                    t->_start = osg::Timer::instance()->tick();
+                    curl_multi_add_handle(_multi, t->_handle);
+                    ++running;
+                }
+
+                if (running == 0)
+                {
+                    _work.wait(100u);
+                    _work.reset();
+                    continue;
+                }
+
+                curl_multi_perform(_multi, &running);
+
+                CURLMsg* msg;
+                int left;
+                while ((msg = curl_multi_info_read(_multi, &left)) != 0L)
+                {
+                    if (msg->msg == CURLMSG_DONE)
                     {
-                        proxy_port = opt.substr( index+1 );
+                        CURLTransfer* t = 0L;
+                        curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char**)&t);
+                        curl_multi_remove_handle(_multi, msg->easy_handle);
+                        finish(t, msg->data.result);
                     }
                 }
+
+                if (running > 0)
+                {
+#if LIBCURL_VERSION_NUM >= 0x074200 // 7.66.0
+                    curl_multi_poll(_multi, NULL, 0, 100, NULL);
+#else
+                    curl_multi_wait(_multi, NULL, 0, 10, NULL);
+#endif
+                }
+            }
+
+            // shutting down; cancel whatever is left
+            std::vector<CURLTransfer*> leftover;
+            {
+                Threading::ScopedMutexLock lock(_queueMutex);
+                leftover.swap(_incoming);
+            }
+            for (auto t : leftover)
+            {
+                finish(t, CURLE_ABORTED_BY_CALLBACK);
             }
         }
 
+        void finish(CURLTransfer* t, CURLcode res)
+        {
+            osg::ref_ptr<RefHTTPResponse> response = new RefHTTPResponse(makeCurlResponse(
+                t->_handle, res, t->_usedProxy, t->_part.get(), t->_sp, t->_url));
+
+            response->setDuration(osg::Timer::instance()->delta_s(t->_start, osg::Timer::instance()->tick()));
+
+            if (s_HTTP_DEBUG)
+            {
+                OE_NOTICE << LC
+                    << "GET(" << response->getCode() << ") " << response->getMimeType() << ": \""
+                    << t->_url << "\" t=" << std::setprecision(4) << response->getDuration() << "s (multi)" << std::endl;
+            }
+
+            t->_promise.resolve(response.get());
+
+            curl_easy_cleanup(t->_handle);
+            if (t->_headers)
+                curl_slist_free_all(t->_headers);
+            delete t;
+        }
+
+        CURLM* _multi;
+        CURLSH* _share;
+        Threading::Mutex _shareMutex[CURL_LOCK_DATA_LAST];
+        std::atomic<bool> _done;
+        std::thread _thread;
+        Threading::Mutex _queueMutex;
+        std::vector<CURLTransfer*> _incoming;
+        Threading::Event _work;
+    };
+
+    class CURLMultiImplementation : public HTTPClient::Implementation
+    {
+    public:
+        CURLMultiImplementation() : _timeout(0L), _connectTimeout(0L) { }
+
+        void initialize()
+        {
+            CURLMultiEngine::instance();
+        }
+
+        HTTPResponse doGet(
+            const HTTPRequest&    request,
+            const osgDB::Options* options,
+            ProgressCallback*     progress) const
+        {
+            Future<RefHTTPResponse> future = doGetAsync(request, options, progress);
+
+            osg::ref_ptr<RefHTTPResponse> response = future.get(progress);
+            if (response.valid())
+            {
+                return *response.get();
+            }
+
+            // caller gave up; make sure the transfer stops too
+            future.cancel();
+            HTTPResponse canceled(0L);
+            canceled.setCanceled(true);
+            return canceled;
+        }
+
+        Future<RefHTTPResponse> doGetAsync(
+            const HTTPRequest&    request,
+            const osgDB::Options* options,
+            ProgressCallback*     progress) const
+        {
+            CURLTransfer* t = new CURLTransfer();
+            Future<RefHTTPResponse> future = t->_promise.getFuture();
+
+            t->_url = request.getURL();
+
+            osg::ref_ptr< URLRewriter > rewriter = HTTPClient::getURLRewriter();
+            if (rewriter.valid())
+            {
+                t->_url = rewriter->rewrite(t->_url);
+            }
+
+            t->_handle = curl_easy_init();
+            CURL* h = t->_handle;
+
+            curl_easy_setopt(h, CURLOPT_PRIVATE, (char*)t);
+            curl_easy_setopt(h, CURLOPT_SHARE, CURLMultiEngine::instance().share());
+            curl_easy_setopt(h, CURLOPT_NOSIGNAL, 1L);
+            curl_easy_setopt(h, CURLOPT_WRITEFUNCTION, StreamObjectReadCallback);
+            curl_easy_setopt(h, CURLOPT_HEADERFUNCTION, StreamObjectHeaderCallback);
+            curl_easy_setopt(h, CURLOPT_FOLLOWLOCATION, (void*)1);
+            curl_easy_setopt(h, CURLOPT_MAXREDIRS, (void*)5);
+            curl_easy_setopt(h, CURLOPT_PROGRESSFUNCTION, &CurlMultiProgressCallback);
+            curl_easy_setopt(h, CURLOPT_PROGRESSDATA, (void*)t);
+            curl_easy_setopt(h, CURLOPT_NOPROGRESS, (void*)0);
+            curl_easy_setopt(h, CURLOPT_FILETIME, true);
+            curl_easy_setopt(h, CURLOPT_ENCODING, "");
+            curl_easy_setopt(h, CURLOPT_SSL_VERIFYPEER, (void*)0);
+            curl_easy_setopt(h, CURLOPT_USERAGENT, _userAgent.c_str());
+            curl_easy_setopt(h, CURLOPT_TIMEOUT, _timeout);
+            curl_easy_setopt(h, CURLOPT_CONNECTTIMEOUT, _connectTimeout);
+
+#if LIBCURL_VERSION_NUM >= 0x072f00 // 7.47.0
+            // HTTP/2 over TLS where the server offers it, and wait for an
+            // existing connection to multiplex on rather than opening another
+            curl_easy_setopt(h, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2TLS);
+            curl_easy_setopt(h, CURLOPT_PIPEWAIT, 1L);
+#endif
+
+            getCurlProxySettings(options, t->_proxyAddr, t->_proxyAuth);
+            if (!t->_proxyAddr.empty())
+            {
+                t->_usedProxy = true;
+                curl_easy_setopt(h, CURLOPT_PROXY, t->_proxyAddr.c_str());
+                if (!t->_proxyAuth.empty())
+                    curl_easy_setopt(h, CURLOPT_PROXYUSERPWD, t->_proxyAuth.c_str());
+            }
+
+            const osgDB::AuthenticationMap* authenticationMap = (options && options->getAuthenticationMap()) ?
+                options->getAuthenticationMap() :
+                osgDB::Registry::instance()->getAuthenticationMap();
+
+            const osgDB::AuthenticationDetails* details = authenticationMap ?
+                authenticationMap->getAuthenticationDetails(t->_url) :
+                0;
+
+            if (details)
+            {
+                t->_userpwd = details->username + ":" + details->password;
+                curl_easy_setopt(h, CURLOPT_USERPWD, t->_userpwd.c_str());
+#if LIBCURL_VERSION_NUM >= 0x070a07
+                curl_easy_setopt(h, CURLOPT_HTTPAUTH, details->httpAuthentication);
+#endif
+            }
+
+            t->_headers = makeCurlHeaders(request);
+            curl_easy_setopt(h, CURLOPT_HTTPHEADER, t->_headers);
+
+            t->_part = new HTTPResponse::Part();
+            t->_sp._stream = &t->_part->_stream;
+            t->_progress = progress;
+
+            curl_easy_setopt(h, CURLOPT_URL, t->_url.c_str());
+            curl_easy_setopt(h, CURLOPT_ERRORBUFFER, (void*)t->_errorBuf);
+            curl_easy_setopt(h, CURLOPT_WRITEDATA, (void*)&t->_sp);
+            curl_easy_setopt(h, CURLOPT_HEADERDATA, (void*)&t->_sp);
+
+            osg::ref_ptr< ConfigHandler > configHandler = HTTPClient::getConfigHandler();
+            if (configHandler.valid())
+            {
+                configHandler->onInitialize(h);
+                configHandler->onGet(h);
+            }
+
+            CURLMultiEngine::instance().submit(t);
+
+            return future;
+        }
+
+        void setUserAgent(const std::string& value) { _userAgent = value; }
+
+        void setTimeout(long value) { _timeout = value; }
+
+        void setConnectTimeout(long value) { _connectTimeout = value; }
+
     private:
-        void* _curl_handle;
-        mutable std::string _previousPassword;
-        mutable long _previousHttpAuthentication;
+        std::string _userAgent;
+        long _timeout;
+        long _connectTimeout;
     };
 }
 
 HTTPClient::Implementation*
-CURLHTTPImplementationFactory::create() const
+CURLMultiHTTPImplementationFactory::create() const
 {
-    return new CURLImplementation();
+    return new CURLMultiImplementation();
 }
 
 #ifdef OSGEARTH_USE_WININET_FOR_HTTP
@@ -1346,6 +1946,33 @@ float HTTPClient::getRetryDelay()
     return s_retryDelay_s;
 }
 
+float HTTPClient::getRetryDelay(const std::string& url)
+{
+    // only asked for when a failed request is about to be retried
+    NetworkMonitor::recordRetry(getHostKey(url), NetworkMonitor::getRequestLayer());
+    return getHostLimiter(url)->getRetryDelay(s_retryDelay_s, s_maxRetryDelay_s);
+}
+
+void HTTPClient::setMaxRetryDelay(float value_s)
+{
+    s_maxRetryDelay_s = value_s;
+}
+
+float HTTPClient::getMaxRetryDelay()
+{
+    return s_maxRetryDelay_s;
+}
+
+void HTTPClient::setThreadPriority(Priority value)
+{
+    s_threadPriority = value;
+}
+
+HTTPClient::Priority HTTPClient::getThreadPriority()
+{
+    return s_threadPriority;
+}
+
 URLRewriter* HTTPClient::getURLRewriter()
 {
     return s_rewriter.get();
@@ -1371,6 +1998,12 @@ HTTPClient::globalInit()
 {
 #ifndef OSGEARTH_USE_WININET_FOR_HTTP
     curl_global_init(CURL_GLOBAL_ALL);
+
+    if (::getenv("OSGEARTH_HTTP_MULTI"))
+    {
+        OE_INFO << LC << "Using the shared curl_multi HTTP engine" << std::endl;
+        setImplementationFactory(new CURLMultiHTTPImplementationFactory());
+    }
 #endif
 }
 
@@ -1413,6 +2046,33 @@ HTTPClient::get( const std::string&    url,
     return getClient().doGet( url, options, progress);
 }
 
+Future<RefHTTPResponse>
+HTTPClient::getAsync(const HTTPRequest&    request,
+                     const osgDB::Options* options,
+                     ProgressCallback*     progress)
+{
+    HTTPClient& client = getClient();
+    client.initialize();
+
+    // Async requests still draw from the host's rate budget, but they
+    // don't occupy one of its concurrent-request slots.
+    HostLimiter* limiter = getHostLimiter(request.getURL());
+    optional<HTTPLimits> limits;
+    if (HTTPLimits::fromOptions(options, limits))
+        limiter->configure(limits.get());
+
+    if (!limiter->acquire(getThreadPriority(), false, progress))
+    {
+        HTTPResponse response(0);
+        response.setCanceled(true);
+        Promise<RefHTTPResponse> canceled;
+        canceled.resolve(new RefHTTPResponse(response));
+        return canceled.getFuture();
+    }
+
+    return client._impl->doGetAsync( request, options, progress );
+}
+
 ReadResult
 HTTPClient::readImage(const HTTPRequest&    request,
                       const osgDB::Options* options,
@@ -1460,10 +2120,58 @@ HTTPClient::doGet(const HTTPRequest&    request,
     OE_PROFILING_ZONE;
     OE_PROFILING_ZONE_TEXT(Stringify() << "url " << request.getURL());
 
+    Trace::Scope trace("http.get", "network");
+    if (trace.active())
+        trace.setDetail(request.getURL());
+
     initialize();
 
+    // Honor any per-host limits, waiting our turn by priority.
+    HostLimiter* limiter = getHostLimiter(request.getURL());
+    optional<HTTPLimits> limits;
+    if (HTTPLimits::fromOptions(options, limits))
+        limiter->configure(limits.get());
+
+    bool telemetry = NetworkMonitor::getTelemetryEnabled();
+    osg::Timer_t queueStart = telemetry ? osg::Timer::instance()->tick() : 0;
+    std::int64_t queueStart_us = trace.active() ? Trace::now() : 0;
+
+    bool acquired = limiter->acquire(getThreadPriority(), true, progress);
+
+    if (trace.active())
+        Trace::complete("http.queue", "network", queueStart_us, Trace::now() - queueStart_us);
+
+    if (!acquired)
+    {
+        HTTPResponse canceled(0);
+        canceled.setCanceled(true);
+        return canceled;
+    }
+
+    osg::Timer_t transferStart = telemetry ? osg::Timer::instance()->tick() : 0;
+
     HTTPResponse response = _impl->doGet(request, options, progress);
 
+    limiter->release();
+    if (!response.isCanceled())
+        limiter->recordResult(isHostFailure(response));
+
+    if (telemetry && !response.isCanceled())
+    {
+        osg::Timer_t end = osg::Timer::instance()->tick();
+        unsigned long long bytes = 0;
+        for (unsigned i = 0; i < response.getNumParts(); ++i)
+            bytes += response.getPartSize(i);
+
+        NetworkMonitor::recordRequest(
+            getHostKey(request.getURL()),
+            NetworkMonitor::getRequestLayer(),
+            osg::Timer::instance()->delta_m(queueStart, transferStart),
+            osg::Timer::instance()->delta_m(transferStart, end),
+            bytes,
+            !response.isOK());
+    }
+
     OE_PROFILING_ZONE_TEXT(Stringify() << "response_code " << response.getCode());
     if (response.isCanceled())
     {
@@ -1614,7 +2322,7 @@ HTTPClient::doReadImage(const HTTPRequest&    request,
         {
             if (callback)
             {
-                callback->setRetryDelay(getRetryDelay());
+                callback->setRetryDelay(getRetryDelay(request.getURL()));
                 callback->cancel();
 
                 if (response.getCode() == 503)
@@ -1708,7 +2416,7 @@ HTTPClient::doReadNode(const HTTPRequest&    request,
         {
             if (callback)
             {
-                callback->setRetryDelay(getRetryDelay());
+                callback->setRetryDelay(getRetryDelay(request.getURL()));
                 callback->cancel();
 
                 if ( s_HTTP_DEBUG )
@@ -1793,7 +2501,7 @@ HTTPClient::doReadObject(const HTTPRequest&    request,
         {
             if (callback)
             {
-                callback->setRetryDelay(getRetryDelay());
+                callback->setRetryDelay(getRetryDelay(request.getURL()));
                 callback->cancel();
 
                 if ( s_HTTP_DEBUG )
@@ -1852,7 +2560,7 @@ HTTPClient::doReadString(const HTTPRequest&    request,
         {
             if (callback)
             {
-                callback->setRetryDelay(getRetryDelay());
+                callback->setRetryDelay(getRetryDelay(request.getURL()));
                 callback->cancel();
 
                 if ( s_HTTP_DEBUG )
@@ -111,6 +111,62 @@ ProxySettings::apply( osgDB::Options* dbOptions ) const
     }
 }
 
+//----------------------------------------------------------------------------
+
+HTTPLimits::HTTPLimits( const Config& conf ) :
+    _maxRequestsPerSecond(0.0f),
+    _burst(0u),
+    _maxConcurrentRequests(0u)
+{
+    mergeConfig( conf );
+}
+
+void
+HTTPLimits::mergeConfig( const Config& conf )
+{
+    _maxRequestsPerSecond = conf.value<float>( "rate", _maxRequestsPerSecond );
+    _burst = conf.value<unsigned>( "burst", _burst );
+    _maxConcurrentRequests = conf.value<unsigned>( "max_concurrent", _maxConcurrentRequests );
+}
+
+Config
+HTTPLimits::getConfig() const
+{
+    Config conf( "http_limits" );
+    conf.add( "rate", toString(_maxRequestsPerSecond) );
+    conf.add( "burst", toString(_burst) );
+    conf.add( "max_concurrent", toString(_maxConcurrentRequests) );
+
+    return conf;
+}
+
+bool
+HTTPLimits::fromOptions( const osgDB::Options* dbOptions, optional<HTTPLimits>& out )
+{
+    if ( dbOptions )
+    {
+        std::string jsonString = dbOptions->getPluginStringData( "osgEarth::HTTPLimits" );
+        if ( !jsonString.empty() )
+        {
+            Config conf;
+            conf.fromJSON( jsonString );
+            out = HTTPLimits( conf );
+            return true;
+        }
+    }
+    return false;
+}
+
+void
+HTTPLimits::apply( osgDB::Options* dbOptions ) const
+{
+    if ( dbOptions )
+    {
+        Config conf = getConfig();
+        dbOptions->setPluginStringData( "osgEarth::HTTPLimits", conf.toJSON() );
+    }
+}
+
 //------------------------------------------------------------------------
 
 URIReadCallback::URIReadCallback()
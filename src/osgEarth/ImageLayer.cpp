@@ -23,6 +23,7 @@
 #include <osgEarth/Capabilities>
 #include <osgEarth/Metrics>
 #include <osgEarth/NetworkMonitor>
+#include <osgEarth/Trace>
 #include <cinttypes>
 
 using namespace osgEarth;
@@ -48,13 +49,16 @@ ImageLayer::Options::fromConfig(const Config& conf)
     _minFilter.setDefault( osg::Texture::LINEAR_MIPMAP_LINEAR );
     _magFilter.setDefault( osg::Texture::LINEAR );
     _textureCompression.setDefault( OE_TEXCOMP_NONE );
+    _cacheCompressedTextures.setDefault( false );
     _shared.setDefault( false );
     _coverage.setDefault( false );
+    _virtualTexture.setDefault( false );
     _reprojectedTileSize.setDefault( 256 );
 
     conf.get( "nodata_image",   _noDataImageFilename );
     conf.get( "shared",         _shared );
     conf.get( "coverage",       _coverage );
+    conf.get( "virtual_texture", _virtualTexture );
     conf.get( "feather_pixels", _featherPixels);
     conf.get( "altitude",       _altitude );
     conf.get( "edge_buffer_ratio", _edgeBufferRatio);
@@ -87,6 +91,7 @@ ImageLayer::Options::fromConfig(const Config& conf)
     conf.get("texture_compression", "on",   _textureCompression, OE_TEXCOMP_AUTO);
     conf.get("texture_compression", "fastdxt", _textureCompression, OE_TEXCOMP_FASTDXT);
     conf.get("texture_compression", "dxt", _textureCompression, OE_TEXCOMP_FASTDXT);
+    conf.get("cache_compressed_textures", _cacheCompressedTextures);
 
     // uniform names
     conf.get("shared_sampler", _shareTexUniformName);
@@ -101,6 +106,7 @@ ImageLayer::Options::getConfig() const
     conf.set( "nodata_image",   _noDataImageFilename );
     conf.set( "shared",         _shared );
     conf.set( "coverage",       _coverage );
+    conf.set( "virtual_texture", _virtualTexture );
     conf.set( "feather_pixels", _featherPixels );
     conf.set( "altitude",       _altitude );
     conf.set( "edge_buffer_ratio", _edgeBufferRatio);
@@ -135,6 +141,7 @@ ImageLayer::Options::getConfig() const
     conf.set("texture_compression", "auto", _textureCompression, OE_TEXCOMP_AUTO);
     conf.set("texture_compression", "fastdxt", _textureCompression, OE_TEXCOMP_FASTDXT);
     conf.set("texture_compression", "dxt", _textureCompression, OE_TEXCOMP_FASTDXT);
+    conf.set("cache_compressed_textures", _cacheCompressedTextures);
 
     // uniform names
     conf.set("shared_sampler", _shareTexUniformName);
@@ -169,6 +176,18 @@ ImageLayer::getCoverage() const
     return options().coverage().get();
 }
 
+void
+ImageLayer::setVirtualTexture(bool value)
+{
+    setOptionThatRequiresReopen(options().virtualTexture(), value);
+}
+
+bool
+ImageLayer::getVirtualTexture() const
+{
+    return options().virtualTexture().get();
+}
+
 void
 ImageLayer::setSharedTextureUniformName(const std::string& value)
 {
@@ -331,19 +350,38 @@ ImageLayer::createImage(const TileKey&    key,
     OE_PROFILING_ZONE_TEXT(getName());
     //OE_PROFILING_ZONE_TEXT(key.str());
 
-    if (!isOpen())
+    if (!openOnDemand())
     {
         return GeoImage::INVALID;
     }
 
     NetworkMonitor::ScopedRequestLayer layerRequest(getName());
 
-    // prevents 2 threads from creating the same object at the same time
-    //_sentry.lock(key);
+    // Concurrent requests for the same tile (from different cameras, the
+    // elevation pool, a seeder...) share a single fetch and decode.
+    std::string flightKey = Stringify()
+        << getRevision() << "/" << key.str() << "/" << key.getProfile()->getHorizSignature();
 
-    GeoImage result = createImageInKeyProfile( key, progress );
+    bool joined = false;
+    GeoImage result = _inFlight.run(
+        flightKey,
+        [&](bool& share) {
+            GeoImage image = createImageInKeyProfile(key, progress);
+            // a canceled result says nothing about the other requests
+            share = !(progress && progress->isCanceled());
+            return image;
+        },
+        progress,
+        &joined);
 
-    //_sentry.unlock(key);
+    // Consumers may modify their image (mipmapping, compression) so
+    // anyone who joined another request gets a copy of their own.
+    if (joined && result.valid() && result.getImage())
+    {
+        result = GeoImage(
+            osg::clone(result.getImage(), osg::CopyOp::DEEP_COPY_ALL),
+            result.getExtent());
+    }
 
     return result;
 }
@@ -412,6 +450,10 @@ ImageLayer::createImageInKeyProfile(const TileKey& key, ProgressCallback* progre
     // map profile, we can try this first.
     if ( cacheBin && policy.isCacheReadable() )
     {
+        Trace::Scope trace("cache.read", "layer");
+        if (trace.active())
+            trace.setDetail(getName() + " " + key.str());
+
         ReadResult r = cacheBin->readImage(cacheKey, 0L);
         if ( r.succeeded() )
         {
@@ -420,6 +462,8 @@ ImageLayer::createImageInKeyProfile(const TileKey& key, ProgressCallback* progre
             if (!expired)
             {
                 OE_DEBUG << "Got cached image for " << key.str() << std::endl;
+                NetworkMonitor::recordCacheRead(getName(), true);
+                _cacheHits.add();
                 return GeoImage( cachedImage.get(), key.getExtent() );
             }
             else
@@ -427,6 +471,8 @@ ImageLayer::createImageInKeyProfile(const TileKey& key, ProgressCallback* progre
                 OE_DEBUG << "Expired image for " << key.str() << std::endl;
             }
         }
+        NetworkMonitor::recordCacheRead(getName(), false);
+        _cacheMisses.add();
     }
 
     // The data was not in the cache. If we are cache-only, fail sliently
@@ -445,11 +491,30 @@ ImageLayer::createImageInKeyProfile(const TileKey& key, ProgressCallback* progre
 
     if (key.getProfile()->isHorizEquivalentTo(getProfile()))
     {
-        result = createImageImplementation(key, progress);
+        // Skip the source entirely for tiles it recently told us it doesn't have.
+        if (!isKnownMissing(key))
+        {
+            Trace::Scope trace("image.create", "layer");
+            if (trace.active())
+                trace.setDetail(getName() + " " + key.str());
+
+            result = createImageImplementation(key, progress);
+
+            if (!result.valid() &&
+                result.getStatus().code() == Status::ResourceUnavailable &&
+                !(progress && progress->isCanceled()))
+            {
+                setKnownMissing(key);
+            }
+        }
     }
     else
     {
         // If the profiles are different, use a compositing method to assemble the tile.
+        Trace::Scope trace("image.assemble", "layer");
+        if (trace.active())
+            trace.setDetail(getName() + " " + key.str());
+
         result = assembleImage( key, progress );
     }
 
@@ -483,7 +548,20 @@ ImageLayer::createImageInKeyProfile(const TileKey& key, ProgressCallback* progre
             OE_INFO << LC << "WARNING! mismatched extents." << std::endl;
         }
 
-        cacheBin->write(cacheKey, result.getImage(), 0L);
+        // Optionally store the tile GPU-ready, so a cache hit needs no
+        // decoding or compression before it goes to the GPU.
+        osg::ref_ptr<const osg::Image> cacheImage = result.getImage();
+        if (options().cacheCompressedTextures() == true &&
+            !isCoverage() &&
+            (options().textureCompression() == OE_TEXCOMP_FASTDXT ||
+             options().textureCompression() == OE_TEXCOMP_AUTO))
+        {
+            osg::Image* compressed = compressImageForCache(result.getImage());
+            if (compressed)
+                cacheImage = compressed;
+        }
+
+        cacheBin->write(cacheKey, cacheImage.get(), 0L);
     }
 
     if ( result.valid() )
@@ -704,6 +782,12 @@ ImageLayer::writeImageImplementation(const TileKey& key, const osg::Image* image
     return Status(Status::ServiceUnavailable);
 }
 
+osg::Image*
+ImageLayer::compressImageForCache(const osg::Image* input) const
+{
+    return ImageUtils::compressImage(input);
+}
+
 void
 ImageLayer::applyTextureCompressionMode(osg::Texture* tex) const
 {
@@ -716,6 +800,13 @@ ImageLayer::applyTextureCompressionMode(osg::Texture* tex) const
         tex->setInternalFormatMode(osg::Texture::USE_IMAGE_DATA_FORMAT);
     }
 
+    // Already compressed (e.g., from a cache_compressed_textures cache):
+    // upload it as-is
+    else if ( tex->getImage(0) && ImageUtils::isCompressed(tex->getImage(0)) )
+    {
+        tex->setInternalFormatMode(osg::Texture::USE_IMAGE_DATA_FORMAT);
+    }
+
 
     else if ( options().textureCompression() == OE_TEXCOMP_AUTO )
     {
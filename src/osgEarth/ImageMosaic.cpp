@@ -18,6 +18,7 @@
  */
 
 #include <osgEarth/ImageMosaic>
+#include <osgEarth/ImageUtils>
 
 #define LC "[ImageMosaic] "
 
@@ -131,4 +132,63 @@ ImageMosaic::createImage()
     return image.release();
 }
 
+bool
+ImageMosaic::compositeUnder(osg::Image* dest, const osg::Image* src)
+{
+    if (!dest || !src || dest->s() != src->s() || dest->t() != src->t() || dest->r() != src->r() ||
+        !ImageUtils::PixelReader::supports(src) ||
+        !ImageUtils::PixelWriter::supports(dest))
+    {
+        return false;
+    }
+
+    // Without alpha the destination was opaque to begin with.
+    if (!ImageUtils::hasAlphaChannel(dest))
+        return true;
+
+    bool srcHasAlpha = ImageUtils::hasAlphaChannel(src);
+    bool opaque = true;
+
+    ImageUtils::PixelReader readDest(dest);
+    ImageUtils::PixelReader readSrc(src);
+    ImageUtils::PixelWriter writeDest(dest);
+    std::vector<osg::Vec4f> d, c;
+
+    for (int r = 0; r < dest->r(); ++r)
+    {
+        for (int t = 0; t < dest->t(); ++t)
+        {
+            readDest.readRow(d, t, r);
+
+            bool rowOpaque = true;
+            for (int s = 0; s < dest->s() && rowOpaque; ++s)
+                rowOpaque = d[s].a() >= 1.0f;
+            if (rowOpaque)
+                continue;
+
+            readSrc.readRow(c, t, r);
+            for (int s = 0; s < dest->s(); ++s)
+            {
+                float da = d[s].a();
+                if (da >= 1.0f)
+                    continue;
+
+                // the same blend as ImageUtils::mix of dest over src
+                float sa = srcHasAlpha ? c[s].a() : 1.0f;
+                osg::Vec4f out(
+                    c[s].r()*(1.0f-da) + d[s].r()*da,
+                    c[s].g()*(1.0f-da) + d[s].g()*da,
+                    c[s].b()*(1.0f-da) + d[s].b()*da,
+                    osg::maximum(sa, da));
+                writeDest(out, s, t, r);
+
+                if (out.a() < 1.0f)
+                    opaque = false;
+            }
+        }
+    }
+
+    return opaque;
+}
+
 /***************************************************************************/
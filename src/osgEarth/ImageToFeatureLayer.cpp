@@ -130,12 +130,14 @@ ImageToFeatureSource::createFeatureCursorImplementation(const Query& query, Prog
             double pixHeight = key.getExtent().height() / (double)image.getImage()->t();
 
             ImageUtils::PixelReader reader(image.getImage());
-            osg::Vec4f color;
+            std::vector<osg::Vec4f> row;
 
             for (unsigned int r = 0; r < (unsigned)image.getImage()->t(); r++)
             {
                 double y = key.getExtent().yMin() + (double)r * pixHeight;
 
+                reader.readRow(row, r);
+
                 double minX = 0;
                 double maxX = 0;
                 float value = 0.0;
@@ -144,7 +146,7 @@ ImageToFeatureSource::createFeatureCursorImplementation(const Query& query, Prog
                 {
                     double x = key.getExtent().xMin() + (double)c * pixWidth;
 
-                    reader(color, c, r);
+                    const osg::Vec4f& color = row[c];
 
                     // Starting a new row.  Initialize the values.
                     if (c == 0)
@@ -21,6 +21,7 @@
 #include <osgEarth/Registry>
 #include <osgEarth/Capabilities>
 #include <osgEarth/Metrics>
+#include <osgEarth/BufferPool>
 
 #include <osg/GLU>
 #include <osgDB/Registry>
@@ -53,6 +54,25 @@ ImageUtils::cloneImage( const osg::Image* input )
 
     if ( !input ) return 0L;
 
+    // Plain images (the usual case in tile pipelines) copy into a pooled
+    // buffer; anything with mipmaps or custom row lengths take the general path.
+    if ( !input->isMipmap() && input->isDataContiguous() && input->data() != 0L &&
+         (input->getRowLength() == 0 || input->getRowLength() == input->s()) )
+    {
+        PooledImage* clone = new PooledImage();
+        clone->allocatePooled(input->s(), input->t(), input->r(), input->getPixelFormat(), input->getDataType(), input->getPacking());
+        clone->setInternalTextureFormat(input->getInternalTextureFormat());
+        clone->setOrigin(input->getOrigin());
+        clone->setFileName(input->getFileName());
+        clone->setPixelAspectRatio(input->getPixelAspectRatio());
+        clone->setName(input->getName());
+        clone->setDataVariance(input->getDataVariance());
+        if (input->getUserDataContainer())
+            clone->setUserDataContainer(osg::clone(input->getUserDataContainer(), osg::CopyOp::DEEP_COPY_ALL));
+        memcpy(clone->data(), input->data(), input->getTotalSizeInBytes());
+        return clone;
+    }
+
     osg::Image* clone = osg::clone( input, osg::CopyOp::DEEP_COPY_ALL );
     clone->dirty();
     return clone;
@@ -162,6 +182,317 @@ ImageUtils::createBumpMap(const osg::Image* input)
     return output;
 }
 
+namespace
+{
+    // Direct kernels for the pixel formats most tiles use: RGBA8, RGB8
+    // and single-channel 32-bit float. They run on whole rows of raw pixel
+    // data with the format dispatch and float conversion of PixelReader/
+    // PixelWriter hoisted out of the inner loops, leaving loops simple
+    // enough for the compiler to vectorize. Other formats take the
+    // generic PixelReader/PixelWriter paths.
+
+    //! Number of channels in an image the kernels support, or 0
+    int fastChannels(const osg::Image* image)
+    {
+        if (!image || (image->getRowLength() != 0 && image->getRowLength() != image->s()))
+            return 0;
+
+        GLenum pf = image->getPixelFormat();
+
+        if (image->getDataType() == GL_UNSIGNED_BYTE)
+        {
+            if (pf == GL_RGBA) return 4;
+            if (pf == GL_RGB) return 3;
+        }
+        else if (image->getDataType() == GL_FLOAT)
+        {
+            if (pf == GL_RED || pf == GL_LUMINANCE) return 1;
+        }
+        return 0;
+    }
+
+    template<typename T> inline T toChannel(float v);
+
+    template<> inline GLubyte toChannel<GLubyte>(float v) {
+        return (GLubyte)osg::clampBetween(v + 0.5f, 0.0f, 255.0f);
+    }
+
+    template<> inline GLfloat toChannel<GLfloat>(float v) {
+        return v;
+    }
+
+    // For each output column (or row), the two input columns to sample and
+    // the weight of the second one, matching the generic resizeImage math.
+    void computeResizeSamples(int in, unsigned out, bool bilinear,
+        std::vector<int>& lo, std::vector<int>& hi, std::vector<float>& w)
+    {
+        lo.resize(out); hi.resize(out); w.resize(out);
+
+        for (unsigned i = 0; i < out; ++i)
+        {
+            float ratio = (float)i / (float)out;
+            float x = ratio * (float)in;
+            if (x >= in) x = in - 1;
+            else if (x < 0) x = 0.0f;
+
+            if (bilinear)
+            {
+                int x0 = osg::maximum((int)floor(x), 0);
+                int x1 = osg::maximum(osg::minimum((int)ceil(x), in - 1), 0);
+                if (x0 > x1) x0 = x1;
+                lo[i] = x0;
+                hi[i] = x1;
+                w[i] = x1 == x0 ? 0.0f : x - (float)x0;
+            }
+            else
+            {
+                int n = (x - (int)x) <= (ceil(x) - x) ?
+                    (int)x :
+                    osg::minimum(1 + (int)x, in - 1);
+                lo[i] = hi[i] = n;
+                w[i] = 0.0f;
+            }
+        }
+    }
+
+    template<typename T, int N>
+    void resizeKernel(const osg::Image* input, osg::Image* output,
+        unsigned out_s, unsigned out_t, unsigned mipmapLevel, bool bilinear)
+    {
+        std::vector<int> col0, col1, row0, row1;
+        std::vector<float> colW, rowW;
+        computeResizeSamples(input->s(), out_s, bilinear, col0, col1, colW);
+        computeResizeSamples(input->t(), out_t, bilinear, row0, row1, rowW);
+
+        // same addressing as the PixelWriter
+        unsigned char* outBase = mipmapLevel == 0 ? output->data() : output->getMipmapData(mipmapLevel);
+        unsigned outRowBytes = output->getRowStepInBytes() >> mipmapLevel;
+        unsigned outImageBytes = output->getImageSizeInBytes() >> mipmapLevel;
+
+        for (int layer = 0; layer < input->r(); ++layer)
+        {
+            for (unsigned row = 0; row < out_t; ++row)
+            {
+                const T* src0 = (const T*)input->data(0, row0[row], layer);
+                const T* src1 = (const T*)input->data(0, row1[row], layer);
+                T* dst = (T*)(outBase + row * outRowBytes + layer * outImageBytes);
+
+                if (!bilinear)
+                {
+                    for (unsigned col = 0; col < out_s; ++col)
+                        for (int i = 0; i < N; ++i)
+                            dst[col*N + i] = src0[col0[col]*N + i];
+                    continue;
+                }
+
+                const float wy1 = rowW[row], wy0 = 1.0f - wy1;
+
+                for (unsigned col = 0; col < out_s; ++col)
+                {
+                    const T* ll = src0 + col0[col]*N;
+                    const T* lr = src0 + col1[col]*N;
+                    const T* ul = src1 + col0[col]*N;
+                    const T* ur = src1 + col1[col]*N;
+                    const float wx1 = colW[col], wx0 = 1.0f - wx1;
+
+                    for (int i = 0; i < N; ++i)
+                    {
+                        float r1 = (float)ll[i] * wx0 + (float)lr[i] * wx1;
+                        float r2 = (float)ul[i] * wx0 + (float)ur[i] * wx1;
+                        dst[col*N + i] = toChannel<T>(r1 * wy0 + r2 * wy1);
+                    }
+                }
+            }
+        }
+    }
+
+    template<int SN, int DN>
+    void mixKernel(osg::Image* dest, const osg::Image* src, float a)
+    {
+        const float r255 = 1.0f / 255.0f;
+
+        for (int layer = 0; layer < src->r(); ++layer)
+        {
+            for (int row = 0; row < src->t(); ++row)
+            {
+                const GLubyte* s = src->data(0, row, layer);
+                GLubyte* d = dest->data(0, row, layer);
+
+                for (int col = 0; col < src->s(); ++col, s += SN, d += DN)
+                {
+                    float sa = SN == 4 ? a * (float)s[SN-1] * r255 : a;
+                    float da = DN == 4 ? (float)d[DN-1] * r255 : 1.0f;
+
+                    for (int i = 0; i < 3; ++i)
+                        d[i] = toChannel<GLubyte>((float)d[i] * (1.0f - sa) + (float)s[i] * sa);
+
+                    if (DN == 4)
+                        d[DN-1] = toChannel<GLubyte>(osg::maximum(sa, da) * 255.0f);
+                }
+            }
+        }
+    }
+
+    // 2x2 box filter from one mipmap level to the next
+    template<typename T, int N>
+    void downsampleKernel(
+        const unsigned char* src, int src_s, int src_t, unsigned srcRowBytes,
+        unsigned char* dst, int dst_s, int dst_t, unsigned dstRowBytes)
+    {
+        for (int row = 0; row < dst_t; ++row)
+        {
+            const T* s0 = (const T*)(src + osg::minimum(2*row, src_t-1) * srcRowBytes);
+            const T* s1 = (const T*)(src + osg::minimum(2*row+1, src_t-1) * srcRowBytes);
+            T* d = (T*)(dst + row * dstRowBytes);
+
+            for (int col = 0; col < dst_s; ++col)
+            {
+                int c0 = osg::minimum(2*col, src_s-1) * N;
+                int c1 = osg::minimum(2*col+1, src_s-1) * N;
+
+                for (int i = 0; i < N; ++i)
+                {
+                    float sum = (float)s0[c0+i] + (float)s0[c1+i] + (float)s1[c0+i] + (float)s1[c1+i];
+                    d[col*N + i] = toChannel<T>(sum * 0.25f);
+                }
+            }
+        }
+    }
+
+    // Single-channel float pixel access for bicubicUpsample
+    struct FloatPixelReader
+    {
+        const osg::Image* _image;
+        FloatPixelReader(const osg::Image* image) : _image(image) { }
+        float operator()(int s, int t) const { return *(const float*)_image->data(s, t); }
+    };
+
+    struct FloatPixelWriter
+    {
+        osg::Image* _image;
+        FloatPixelWriter(osg::Image* image) : _image(image) { }
+        void operator()(float value, int s, int t) { *(float*)_image->data(s, t) = value; }
+    };
+
+    template<typename V, typename READER, typename WRITER>
+    bool bicubicUpsampleImpl(const osg::Image* source, osg::Image* target, unsigned quadrant, unsigned stride)
+    {
+        const int border = 1; // don't change this.
+
+        int width = ((source->s() - 2*border)/2)+1 + 2*border;
+        int height = ((source->t() - 2*border)/2)+1 + 2*border;
+
+        int s_off = quadrant == 0 || quadrant == 2 ? 0 : source->s()-width;
+        int t_off = quadrant == 2 || quadrant == 3 ? 0 : source->t()-height;
+
+        READER readSource(source);
+        WRITER writeTarget(target);
+        READER readTarget(target);
+
+        // copy the main box, which is all odd-numbered cells when there is a border size = 1.
+        for (int t = 1; t<height-1; ++t)
+        {
+            for (int s = 1; s<width-1; ++s)
+            {
+                V value = readSource(s_off+s, t_off+t);
+                writeTarget(value, (s-1)*2+1, (t-1)*2+1);
+            }
+        }
+
+        // copy the corner border cells.
+        writeTarget(readSource(s_off, t_off), 0, 0); // upper left.
+        writeTarget(readSource(s_off + width - 1, t_off), target->s()-1, 0);
+        writeTarget(readSource(s_off, t_off + height - 1), 0, target->t()-1);
+        writeTarget(readSource(s_off + width - 1, t_off + height - 1), target->s() - 1, target->t() - 1);
+
+        // copy the border intermediate cells.
+        for (int s=1; s<width-1; ++s) // top/bottom:
+        {
+            writeTarget(readSource(s_off+s, t_off), (s-1)*2+1, 0);
+            writeTarget(readSource(s_off+s, t_off + height - 1), (s-1)*2+1, target->t()-1);
+        }
+        for (int t = 1; t < height-1; ++t) // left/right:
+        {
+            writeTarget(readSource(s_off, t_off+t), 0, (t-1)*2+1);
+            writeTarget(readSource(s_off + width - 1, t_off + t), target->s()-1, (t-1)*2+1);
+        }
+
+        // now interpolate the missing columns, including the border cells.
+        for (int s = 2; s<target->s()-2; s += 2)
+        {
+            for (int t = 0; t < target->t(); )
+            {
+                int offset = (s-1) % stride; // the minus1 accounts for the border
+                int s0 = osg::maximum(s - offset, 0);
+                int s1 = osg::minimum(s0 + (int)stride, target->s()-1);
+                double mu = (double)offset / (double)(s1-s0);
+                V p1 = readTarget(s0, t);
+                V p2 = readTarget(s1, t);
+                double mu2 = (1.0 - cos(mu*osg::PI))*0.5;
+                V v = (p1*(1.0-mu2)) + (p2*mu2);
+                writeTarget(v, s, t);
+
+                if (t == 0 || t == target->t()-2) t+=1; else t+=2;
+            }
+        }
+
+        // next interpolate the odd numbered rows
+        for (int s = 0; s < target->s();)
+        {
+            for (int t = 2; t<target->t()-2; t += 2)
+            {
+                int offset = (t-1) % stride; // the minus1 accounts for the border
+                int t0 = osg::maximum(t - offset, 0);
+                int t1 = osg::minimum(t0 + (int)stride, target->t()-1);
+                double mu = (double)offset / double(t1-t0);
+
+                V p1 = readTarget(s, t0);
+                V p2 = readTarget(s, t1);
+                double mu2 = (1.0 - cos(mu*osg::PI))*0.5;
+                V v = (p1*(1.0-mu2)) + (p2*mu2);
+                writeTarget(v, s, t);
+            }
+
+            if (s == 0 || s == target->s()-2) s+=1; else s+=2;
+        }
+
+        // then interpolate the centers
+        for (int s = 2; s<target->s()-2; s += 2)
+        {
+            for (int t = 2; t<target->t()-2; t += 2)
+            {
+                int s_offset = (s-1) % stride;
+                int s0 = osg::maximum(s - s_offset, 0);
+                int s1 = osg::minimum(s0 + (int)stride, target->s()-1);
+
+                int t_offset = (t-1) % stride;
+                int t0 = osg::maximum(t - t_offset, 0);
+                int t1 = osg::minimum(t0 + (int)stride, target->t()-1);
+
+                double mu, mu2;
+
+                V p1 = readTarget(s0, t);
+                V p2 = readTarget(s1, t);
+                mu = (double)s_offset / (double)(s1-s0);
+                mu2 = (1.0 - cos(mu*osg::PI))*0.5;
+                V v1 = (p1*(1.0-mu2)) + (p2*mu2);
+
+                V p3 = readTarget(s, t0);
+                V p4 = readTarget(s, t1);
+                mu = (double)t_offset / (double)(t1-t0);
+                mu2 = (1.0 - cos(mu*osg::PI))*0.5;
+                V v2 = (p3*(1.0-mu2)) + (p4*mu2);
+
+                V v = (v1+v2)*0.5;
+
+                writeTarget(v, s, t);
+            }
+        }
+
+        return true;
+    }
+}
+
 bool
 ImageUtils::resizeImage(const osg::Image* input,
                         unsigned int out_s, unsigned int out_t,
@@ -189,17 +520,18 @@ ImageUtils::resizeImage(const osg::Image* input,
 
     if ( !output.valid() )
     {
-        output = new osg::Image();
+        PooledImage* pooled = new PooledImage();
+        output = pooled;
 
         if ( PixelWriter::supports(input) )
         {
-            output->allocateImage( out_s, out_t, input->r(), input->getPixelFormat(), input->getDataType(), input->getPacking() );
+            pooled->allocatePooled( out_s, out_t, input->r(), input->getPixelFormat(), input->getDataType(), input->getPacking() );
             output->setInternalTextureFormat( input->getInternalTextureFormat() );
         }
         else
         {
             // for unsupported write formats, convert to normalized RGBA8 automatically.
-            output->allocateImage( out_s, out_t, input->r(), GL_RGBA, GL_UNSIGNED_BYTE );
+            pooled->allocatePooled( out_s, out_t, input->r(), GL_RGBA, GL_UNSIGNED_BYTE );
             output->setInternalTextureFormat( GL_RGB8A_INTERNAL );
         }
     }
@@ -209,10 +541,27 @@ ImageUtils::resizeImage(const osg::Image* input,
         output->setInternalTextureFormat( input->getInternalTextureFormat() );
     }
 
+    int channels = fastChannels(input);
+    bool fast =
+        channels > 0 &&
+        fastChannels(output.get()) == channels &&
+        output->getPixelFormat() == input->getPixelFormat() &&
+        output->getDataType() == input->getDataType() &&
+        output->r() >= input->r();
+
     if ( in_s == out_s && in_t == out_t && mipmapLevel == 0 && input->getInternalTextureFormat() == output->getInternalTextureFormat() )
     {
         memcpy( output->data(), input->data(), input->getTotalSizeInBytes() );
     }
+    else if ( fast )
+    {
+        if ( channels == 4 )
+            resizeKernel<GLubyte, 4>( input, output.get(), out_s, out_t, mipmapLevel, bilinear );
+        else if ( channels == 3 )
+            resizeKernel<GLubyte, 3>( input, output.get(), out_s, out_t, mipmapLevel, bilinear );
+        else
+            resizeKernel<GLfloat, 1>( input, output.get(), out_s, out_t, mipmapLevel, bilinear );
+    }
     else
     {
         PixelReader read( input );
@@ -339,119 +688,13 @@ ImageUtils::bicubicUpsample(const osg::Image* source,
                             unsigned quadrant,
                             unsigned stride)
 {
-    const int border = 1; // don't change this.
-
-    int width = ((source->s() - 2*border)/2)+1 + 2*border;
-    int height = ((source->t() - 2*border)/2)+1 + 2*border;
-
-    int s_off = quadrant == 0 || quadrant == 2 ? 0 : source->s()-width;
-    int t_off = quadrant == 2 || quadrant == 3 ? 0 : source->t()-height;
-
-    ImageUtils::PixelReader readSource(source);
-    ImageUtils::PixelWriter writeTarget(target);
-    ImageUtils::PixelReader readTarget(target);
-
-    // copy the main box, which is all odd-numbered cells when there is a border size = 1.
-    for (int t = 1; t<height-1; ++t)
-    {
-        for (int s = 1; s<width-1; ++s)
-        {
-            osg::Vec4 value = readSource(s_off+s, t_off+t);
-            writeTarget(value, (s-1)*2+1, (t-1)*2+1);
-        }
-    }
-
-    // copy the corner border cells.
-    writeTarget(readSource(s_off, t_off), 0, 0); // upper left.
-    writeTarget(readSource(s_off + width - 1, t_off), target->s()-1, 0);
-    writeTarget(readSource(s_off, t_off + height - 1), 0, target->t()-1);
-    writeTarget(readSource(s_off + width - 1, t_off + height - 1), target->s() - 1, target->t() - 1);
-
-    // copy the border intermediate cells.
-    for (int s=1; s<width-1; ++s) // top/bottom:
-    {
-        writeTarget(readSource(s_off+s, t_off), (s-1)*2+1, 0);
-        writeTarget(readSource(s_off+s, t_off + height - 1), (s-1)*2+1, target->t()-1);
-    }
-    for (int t = 1; t < height-1; ++t) // left/right:
-    {
-        writeTarget(readSource(s_off, t_off+t), 0, (t-1)*2+1);
-        writeTarget(readSource(s_off + width - 1, t_off + t), target->s()-1, (t-1)*2+1);
-    }
-
-    // now interpolate the missing columns, including the border cells.
-    for (int s = 2; s<target->s()-2; s += 2)
-    {
-        for (int t = 0; t < target->t(); )
-        {
-            int offset = (s-1) % stride; // the minus1 accounts for the border
-            int s0 = osg::maximum(s - offset, 0);
-            int s1 = osg::minimum(s0 + (int)stride, target->s()-1);
-            double mu = (double)offset / (double)(s1-s0);
-            osg::Vec4 p1 = readTarget(s0, t);
-            osg::Vec4 p2 = readTarget(s1, t);
-            double mu2 = (1.0 - cos(mu*osg::PI))*0.5;
-            osg::Vec4 v = (p1*(1.0-mu2)) + (p2*mu2);
-            writeTarget(v, s, t);
-
-            if (t == 0 || t == target->t()-2) t+=1; else t+=2;
-        }
-    }
-
-    // next interpolate the odd numbered rows
-    for (int s = 0; s < target->s();)
-    {
-        for (int t = 2; t<target->t()-2; t += 2)
-        {
-            int offset = (t-1) % stride; // the minus1 accounts for the border
-            int t0 = osg::maximum(t - offset, 0);
-            int t1 = osg::minimum(t0 + (int)stride, target->t()-1);
-            double mu = (double)offset / double(t1-t0);
-
-            osg::Vec4 p1 = readTarget(s, t0);
-            osg::Vec4 p2 = readTarget(s, t1);
-            double mu2 = (1.0 - cos(mu*osg::PI))*0.5;
-            osg::Vec4 v = (p1*(1.0-mu2)) + (p2*mu2);
-            writeTarget(v, s, t);
-        }
-
-        if (s == 0 || s == target->s()-2) s+=1; else s+=2;
-    }
-
-    // then interpolate the centers
-    for (int s = 2; s<target->s()-2; s += 2)
+    if (fastChannels(source) == 1 && fastChannels(target) == 1 &&
+        source->getPixelFormat() == target->getPixelFormat())
     {
-        for (int t = 2; t<target->t()-2; t += 2)
-        {
-            int s_offset = (s-1) % stride;
-            int s0 = osg::maximum(s - s_offset, 0);
-            int s1 = osg::minimum(s0 + (int)stride, target->s()-1);
-
-            int t_offset = (t-1) % stride;
-            int t0 = osg::maximum(t - t_offset, 0);
-            int t1 = osg::minimum(t0 + (int)stride, target->t()-1);
-
-            double mu, mu2;
-
-            osg::Vec4 p1 = readTarget(s0, t);
-            osg::Vec4 p2 = readTarget(s1, t);
-            mu = (double)s_offset / (double)(s1-s0);
-            mu2 = (1.0 - cos(mu*osg::PI))*0.5;
-            osg::Vec4 v1 = (p1*(1.0-mu2)) + (p2*mu2);
-
-            osg::Vec4 p3 = readTarget(s, t0);
-            osg::Vec4 p4 = readTarget(s, t1);
-            mu = (double)t_offset / (double)(t1-t0);
-            mu2 = (1.0 - cos(mu*osg::PI))*0.5;
-            osg::Vec4 v2 = (p3*(1.0-mu2)) + (p4*mu2);
-
-            osg::Vec4 v = (v1+v2)*0.5;
-
-            writeTarget(v, s, t);
-        }
+        return bicubicUpsampleImpl<float, FloatPixelReader, FloatPixelWriter>(source, target, quadrant, stride);
     }
 
-    return true;
+    return bicubicUpsampleImpl<osg::Vec4, PixelReader, PixelWriter>(source, target, quadrant, stride);
 }
 
 bool
@@ -518,7 +761,10 @@ ImageUtils::generateMipmaps(osg::Image* input)
     for( int i=1; i<numLevels; ++i )
     {
         mipOffsets.push_back(totalSizeBytes);
-        totalSizeBytes += (imageSizeBytes >> i);
+        int level_s = osg::maximum(input->s() >> i, 1);
+        int level_t = osg::maximum(input->t() >> i, 1);
+        totalSizeBytes += level_t * osg::Image::computeRowWidthInBytes(
+            level_s, input->getPixelFormat(), input->getDataType(), input->getPacking());
     }
 
     // allocate space for the new data and copy over level 0 of the old data
@@ -537,6 +783,34 @@ ImageUtils::generateMipmaps(osg::Image* input)
 
     input->setMipmapLevels(mipOffsets);
 
+    int channels = fastChannels(input);
+    if (channels > 0)
+    {
+        // box-filter each level from the one above it
+        for(int level=1; level<numLevels; ++level)
+        {
+            int src_s = osg::maximum(input->s() >> (level-1), 1);
+            int src_t = osg::maximum(input->t() >> (level-1), 1);
+            int dst_s = osg::maximum(input->s() >> level, 1);
+            int dst_t = osg::maximum(input->t() >> level, 1);
+            unsigned srcRowBytes = osg::Image::computeRowWidthInBytes(src_s, input->getPixelFormat(), input->getDataType(), input->getPacking());
+            unsigned dstRowBytes = osg::Image::computeRowWidthInBytes(dst_s, input->getPixelFormat(), input->getDataType(), input->getPacking());
+            const unsigned char* src = input->getMipmapData(level-1);
+            unsigned char* dst = input->getMipmapData(level);
+
+            if (channels == 4)
+                downsampleKernel<GLubyte, 4>(src, src_s, src_t, srcRowBytes, dst, dst_s, dst_t, dstRowBytes);
+            else if (channels == 3)
+                downsampleKernel<GLubyte, 3>(src, src_s, src_t, srcRowBytes, dst, dst_s, dst_t, dstRowBytes);
+            else
+                downsampleKernel<GLfloat, 1>(src, src_s, src_t, srcRowBytes, dst, dst_s, dst_t, dstRowBytes);
+        }
+
+        input->dirty();
+
+        return true;
+    }
+
     // now, populate the image levels.
     osg::PixelStorageModes psm;
     psm.pack_alignment = input->getPacking();
@@ -553,8 +827,8 @@ ImageUtils::generateMipmaps(osg::Image* input)
             input->t(),
             input->getDataType(),
             input->data(),
-            input->s() >> level,
-            input->t() >> level,
+            osg::maximum(input->s() >> level, 1),
+            osg::maximum(input->t() >> level, 1),
             input->getDataType(),
             input->getMipmapData(level));
     }
@@ -564,6 +838,79 @@ ImageUtils::generateMipmaps(osg::Image* input)
     return true;
 }
 
+osg::Image*
+ImageUtils::compressImage(const osg::Image* input)
+{
+    if (input == 0L ||
+        ImageUtils::isCompressed(input) ||
+        !ImageUtils::isPowerOfTwo(input) ||
+        input->getDataType() != GL_UNSIGNED_BYTE ||
+        input->s() < 4 || input->t() < 4 || input->r() != 1)
+    {
+        return 0L;
+    }
+
+    osg::Texture::InternalFormatMode mode;
+    if (input->getPixelFormat() == GL_RGB)
+        mode = osg::Texture::USE_S3TC_DXT1_COMPRESSION;
+    else if (input->getPixelFormat() == GL_RGBA)
+        mode = osg::Texture::USE_S3TC_DXT5_COMPRESSION;
+    else
+        return 0L;
+
+    osgDB::ImageProcessor* imageProcessor = osgDB::Registry::instance()->getImageProcessorForExtension("fastdxt");
+    if (!imageProcessor)
+        return 0L;
+
+    // Build the mipmaps first, since the terrain can't generate them
+    // for a compressed image later.
+    osg::ref_ptr<osg::Image> mipmapped = new osg::Image(*input, osg::CopyOp::DEEP_COPY_ALL);
+    ImageUtils::generateMipmaps(mipmapped.get());
+
+    // Compress each level separately. DXT works in 4x4 blocks,
+    // so the chain stops at 4x4.
+    std::vector<osg::ref_ptr<osg::Image> > levels;
+    unsigned totalSize = 0u;
+    unsigned numLevels = osg::maximum(mipmapped->getNumMipmapLevels(), 1u);
+    for (unsigned level = 0; level < numLevels; ++level)
+    {
+        int s = osg::maximum(mipmapped->s() >> level, 1);
+        int t = osg::maximum(mipmapped->t() >> level, 1);
+        if (s < 4 || t < 4)
+            break;
+
+        osg::ref_ptr<osg::Image> levelImage = new osg::Image();
+        levelImage->allocateImage(s, t, 1, input->getPixelFormat(), GL_UNSIGNED_BYTE);
+        ::memcpy(levelImage->data(), mipmapped->getMipmapData(level), levelImage->getTotalSizeInBytes());
+
+        imageProcessor->compress(*levelImage, mode, false, false, osgDB::ImageProcessor::USE_CPU, osgDB::ImageProcessor::FASTEST);
+        if (!ImageUtils::isCompressed(levelImage.get()))
+            return 0L;
+
+        totalSize += levelImage->getTotalSizeInBytes();
+        levels.push_back(levelImage);
+    }
+
+    unsigned char* data = new unsigned char[totalSize];
+    osg::Image::MipmapDataType offsets;
+    unsigned offset = 0u;
+    for (unsigned i = 0; i < levels.size(); ++i)
+    {
+        if (i > 0)
+            offsets.push_back(offset);
+        ::memcpy(data + offset, levels[i]->data(), levels[i]->getTotalSizeInBytes());
+        offset += levels[i]->getTotalSizeInBytes();
+    }
+
+    GLenum format = levels[0]->getPixelFormat();
+    osg::Image* output = new osg::Image();
+    output->setImage(input->s(), input->t(), 1, format, format, GL_UNSIGNED_BYTE, data, osg::Image::USE_NEW_DELETE);
+    if (!offsets.empty())
+        output->setMipmapLevels(offsets);
+
+    return output;
+}
+
 osg::Image*
 ImageUtils::createMipmapBlendedImage( const osg::Image* primary, const osg::Image* secondary )
 {
@@ -755,6 +1102,18 @@ ImageUtils::mix(osg::Image* dest, const osg::Image* src, float a)
         return false;
     }
 
+    int srcChannels = fastChannels(src);
+    int destChannels = fastChannels(dest);
+    if (srcChannels >= 3 && destChannels >= 3)
+    {
+        a = osg::clampBetween( a, 0.0f, 1.0f );
+        if (srcChannels == 4 && destChannels == 4)      mixKernel<4, 4>(dest, src, a);
+        else if (srcChannels == 4 && destChannels == 3) mixKernel<4, 3>(dest, src, a);
+        else if (srcChannels == 3 && destChannels == 4) mixKernel<3, 4>(dest, src, a);
+        else                                            mixKernel<3, 3>(dest, src, a);
+        return true;
+    }
+
     PixelVisitor<MixImage> mixer;
     mixer._a = osg::clampBetween( a, 0.0f, 1.0f );
     mixer._srcHasAlpha = hasAlphaChannel(src); //src->getPixelSizeInBits() == 32;
@@ -806,8 +1165,8 @@ ImageUtils::cropImage(const osg::Image* image,
     //OE_NOTICE << "Copying from " << windowX << ", " << windowY << ", " << windowWidth << ", " << windowHeight << std::endl;
 
     //Allocate the croppped image
-    osg::Image* cropped = new osg::Image;
-    cropped->allocateImage(windowWidth, windowHeight, image->r(), image->getPixelFormat(), image->getDataType());
+    PooledImage* cropped = new PooledImage();
+    cropped->allocatePooled(windowWidth, windowHeight, image->r(), image->getPixelFormat(), image->getDataType());
     cropped->setInternalTextureFormat( image->getInternalTextureFormat() );
 
     for (int layer=0; layer<image->r(); ++layer)
@@ -1130,6 +1489,31 @@ ImageUtils::convert(const osg::Image* image, GLenum pixelFormat, GLenum dataType
         return result;
     }
 
+    // Fast conversion if possible : RGBA8 to RGB8
+    if ( dataType == GL_UNSIGNED_BYTE && pixelFormat == GL_RGB && fastChannels(image) == 4 )
+    {
+        osg::Image* result = new osg::Image();
+        result->allocateImage(image->s(), image->t(), image->r(), GL_RGB, GL_UNSIGNED_BYTE);
+        result->setInternalTextureFormat(GL_RGB8_INTERNAL);
+
+        for (int r = 0; r < image->r(); ++r)
+        {
+            for (int t = 0; t < image->t(); ++t)
+            {
+                const unsigned char* pSrcData = image->data(0, t, r);
+                unsigned char* pDstData = result->data(0, t, r);
+                for (int s = 0; s < image->s(); ++s, pSrcData += 4, pDstData += 3)
+                {
+                    pDstData[0] = pSrcData[0];
+                    pDstData[1] = pSrcData[1];
+                    pDstData[2] = pSrcData[2];
+                }
+            }
+        }
+
+        return result;
+    }
+
     // Test if generic conversion is possible
     if ( !canConvert(image, pixelFormat, dataType) )
         return 0L;
@@ -1829,38 +2213,62 @@ namespace
         }
     };
 
+    // The per-pixel and per-span read functions for one format
+    struct Readers
+    {
+        Readers() : _pixel(0L), _span(0L) { }
+        Readers(ImageUtils::PixelReader::ReaderFunc pixel, ImageUtils::PixelReader::SpanReaderFunc span) :
+            _pixel(pixel), _span(span) { }
+        ImageUtils::PixelReader::ReaderFunc _pixel;
+        ImageUtils::PixelReader::SpanReaderFunc _span;
+    };
+
+    // Reads a span with a direct (inlinable) call to the format's reader per pixel
+    template<typename R>
+    void readSpan(const ImageUtils::PixelReader* ia, osg::Vec4f* out, int s, int t, int count, int r, int m)
+    {
+        for (int i = 0; i < count; ++i)
+            R::read(ia, out[i], s + i, t, r, m);
+    }
+
+    template<typename R>
+    inline Readers readers()
+    {
+        return Readers(&R::read, &readSpan<R>);
+    }
+
     template<int GLFormat>
-    inline ImageUtils::PixelReader::ReaderFunc
+    inline Readers
     chooseReader(GLenum dataType)
     {
         switch (dataType)
         {
         case GL_BYTE:
-            return &ColorReader<GLFormat, GLbyte>::read;
+            return readers<ColorReader<GLFormat, GLbyte> >();
         case GL_UNSIGNED_BYTE:
-            return &ColorReader<GLFormat, GLubyte>::read;
+            return readers<ColorReader<GLFormat, GLubyte> >();
         case GL_SHORT:
-            return &ColorReader<GLFormat, GLshort>::read;
+            return readers<ColorReader<GLFormat, GLshort> >();
         case GL_UNSIGNED_SHORT:
-            return &ColorReader<GLFormat, GLushort>::read;
+            return readers<ColorReader<GLFormat, GLushort> >();
         case GL_INT:
-            return &ColorReader<GLFormat, GLint>::read;
+            return readers<ColorReader<GLFormat, GLint> >();
         case GL_UNSIGNED_INT:
-            return &ColorReader<GLFormat, GLuint>::read;
+            return readers<ColorReader<GLFormat, GLuint> >();
         case GL_FLOAT:
-            return &ColorReader<GLFormat, GLfloat>::read;
+            return readers<ColorReader<GLFormat, GLfloat> >();
         case GL_UNSIGNED_SHORT_5_5_5_1:
-            return &ColorReader<GL_UNSIGNED_SHORT_5_5_5_1, GLushort>::read;
+            return readers<ColorReader<GL_UNSIGNED_SHORT_5_5_5_1, GLushort> >();
         case GL_UNSIGNED_BYTE_3_3_2:
-            return &ColorReader<GL_UNSIGNED_BYTE_3_3_2, GLubyte>::read;
+            return readers<ColorReader<GL_UNSIGNED_BYTE_3_3_2, GLubyte> >();
         case GL_UNSIGNED_INT_8_8_8_8_REV:
-            return &ColorReader<GLFormat, GLubyte>::read;
+            return readers<ColorReader<GLFormat, GLubyte> >();
         default:
-            return &ColorReader<0, GLbyte>::read;
+            return readers<ColorReader<0, GLbyte> >();
         }
     }
 
-    inline ImageUtils::PixelReader::ReaderFunc
+    inline Readers
     getReader( GLenum pixelFormat, GLenum dataType )
     {
         switch( pixelFormat )
@@ -1896,10 +2304,10 @@ namespace
             return chooseReader<GL_BGRA>(dataType);
             break;
         case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
-            return &ColorReader<GL_COMPRESSED_RGB_S3TC_DXT1_EXT, GLubyte>::read;
+            return readers<ColorReader<GL_COMPRESSED_RGB_S3TC_DXT1_EXT, GLubyte> >();
             break;
         default:
-            return 0L;
+            return Readers();
             break;
         }
     }
@@ -1932,12 +2340,14 @@ ImageUtils::PixelReader::setImage(const osg::Image* image)
         _rowBytes = _image->getRowStepInBytes(); //getRowSizeInBytes();
         _imageBytes = _image->getImageSizeInBytes();
         GLenum dataType = _image->getDataType();
-        _reader = getReader( _image->getPixelFormat(), dataType );
-        if ( !_reader )
+        Readers funcs = getReader( _image->getPixelFormat(), dataType );
+        if ( !funcs._pixel )
         {
             OE_WARN << "[PixelReader] No reader found for pixel format " << std::hex << _image->getPixelFormat() << std::endl;
-            _reader = &ColorReader<0,GLbyte>::read;
+            funcs = readers<ColorReader<0,GLbyte> >();
         }
+        _reader = funcs._pixel;
+        _spanReader = funcs._span;
     }
 }
 
@@ -2217,33 +2627,53 @@ ImageUtils::PixelReader::operator()(osg::Vec4f& out, double u, double v, int r,
 
     else // sample as image
     {
-        double sizeS = (double)(_image->s() - 1);
-        double sizeT = (double)(_image->t() - 1);
-
         // u, v => [0..1]
-        double s = u * sizeS;
-        double t = v * sizeT;
-
-        double s0 = osg::maximum(floor(s), 0.0);
-        double s1 = osg::minimum(s0 + 1.0, sizeS);
-        double smix = s0 < s1 ? (s - s0) / (s1 - s0) : 0.0;
+        readBilinear(out, u * (double)(_image->s() - 1), v * (double)(_image->t() - 1), r, m);
+    }
+}
 
-        double t0 = osg::maximum(floor(t), 0.0);
-        double t1 = osg::minimum(t0 + 1.0, sizeT);
-        double tmix = t0 < t1 ? (t - t0) / (t1 - t0) : 0.0;
+void
+ImageUtils::PixelReader::readBilinear(osg::Vec4f& out, double s, double t, int r, int m) const
+{
+    double sizeS = (double)(_image->s() - 1);
+    double sizeT = (double)(_image->t() - 1);
 
-        osg::Vec4f UL, UR, LL, LR;
+    double s0 = osg::maximum(floor(s), 0.0);
+    double s1 = osg::minimum(s0 + 1.0, sizeS);
+    double smix = s0 < s1 ? (s - s0) / (s1 - s0) : 0.0;
 
-        (*_reader)(this, UL, (int)s0, (int)t0, r, m); // upper left
-        (*_reader)(this, UR, (int)s1, (int)t0, r, m); // upper right
-        (*_reader)(this, LL, (int)s0, (int)t1, r, m); // lower left
-        (*_reader)(this, LR, (int)s1, (int)t1, r, m); // lower right
+    double t0 = osg::maximum(floor(t), 0.0);
+    double t1 = osg::minimum(t0 + 1.0, sizeT);
+    double tmix = t0 < t1 ? (t - t0) / (t1 - t0) : 0.0;
 
-        osg::Vec4f TOP = UL * (1.0f - smix) + UR * smix;
-        osg::Vec4f BOT = LL * (1.0f - smix) + LR * smix;
+    // UL, UR, LL, LR
+    osg::Vec4f p[4];
 
-        out = TOP * (1.0f - tmix) + BOT * tmix;
+    if (s0 < s1 && m == 0)
+    {
+        // two 2-pixel spans instead of four single reads
+        (*_spanReader)(this, &p[0], (int)s0, (int)t0, 2, r, m);
+        (*_spanReader)(this, &p[2], (int)s0, (int)t1, 2, r, m);
     }
+    else
+    {
+        (*_reader)(this, p[0], (int)s0, (int)t0, r, m);
+        (*_reader)(this, p[1], (int)s1, (int)t0, r, m);
+        (*_reader)(this, p[2], (int)s0, (int)t1, r, m);
+        (*_reader)(this, p[3], (int)s1, (int)t1, r, m);
+    }
+
+    osg::Vec4f TOP = p[0] * (1.0f - smix) + p[1] * smix;
+    osg::Vec4f BOT = p[2] * (1.0f - smix) + p[3] * smix;
+
+    out = TOP * (1.0f - tmix) + BOT * tmix;
+}
+
+void
+ImageUtils::PixelReader::readRow(std::vector<osg::Vec4f>& output, int t, int r) const
+{
+    output.resize(_image->s());
+    (*_spanReader)(this, &output[0], 0, t, _image->s(), r, 0);
 }
 
 osg::Vec4f
@@ -2257,7 +2687,7 @@ ImageUtils::PixelReader::operator()(double u, double v, int r, int m) const
 bool
 ImageUtils::PixelReader::supports( GLenum pixelFormat, GLenum dataType )
 {
-    return getReader(pixelFormat, dataType) != 0L;
+    return getReader(pixelFormat, dataType)._pixel != 0L;
 }
 
 //------------------------------------------------------------------------
@@ -0,0 +1,211 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+ * Copyright 2020 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarth/ImpostorBaker>
+#include <osgEarth/VirtualProgram>
+#include <osgEarth/CullingUtils>
+#include <osg/ComputeBoundsVisitor>
+#include <osgUtil/CullVisitor>
+
+#define LC "[ImpostorBaker] "
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+namespace
+{
+    // Writes the unlit color to the first target and the local normal
+    // and depth to the second.
+    const char* bakeFS =
+        "#version " GLSL_VERSION_STR "\n"
+        "layout(location=0) out vec4 oe_ImpostorBaker_color; \n"
+        "layout(location=1) out vec4 oe_ImpostorBaker_normal; \n"
+        "uniform mat4 oe_ImpostorBaker_viewMatrix; \n"
+        "vec3 vp_Normal; \n"
+        "void oe_ImpostorBaker_output(inout vec4 color) \n"
+        "{ \n"
+        "    if (color.a < 0.15) \n"
+        "        discard; \n"
+        "    vec3 N = normalize(gl_FrontFacing ? vp_Normal : -vp_Normal); \n"
+        "    N = transpose(mat3(oe_ImpostorBaker_viewMatrix)) * N; \n"
+        "    oe_ImpostorBaker_color = color; \n"
+        "    oe_ImpostorBaker_normal = vec4(N*0.5+0.5, gl_FragCoord.z); \n"
+        "} \n";
+
+    // Which graphics contexts have drawn a bake
+    struct BakeState : public osg::Referenced
+    {
+        osg::buffered_value<int> _done;
+    };
+
+    // Culls the bake camera until it has drawn once in the context
+    struct CullOnce : public osg::NodeCallback
+    {
+        CullOnce(BakeState* state) : _state(state) { }
+
+        void operator()(osg::Node* node, osg::NodeVisitor* nv)
+        {
+            osgUtil::CullVisitor* cv = Culling::asCullVisitor(nv);
+            if (cv && cv->getState() && _state->_done[cv->getState()->getContextID()] != 0)
+                return;
+            traverse(node, nv);
+        }
+
+        osg::ref_ptr<BakeState> _state;
+    };
+
+    struct MarkDone : public osg::Camera::DrawCallback
+    {
+        MarkDone(BakeState* state) : _state(state) { }
+
+        void operator()(osg::RenderInfo& ri) const
+        {
+            _state->_done[ri.getContextID()] = 1;
+        }
+
+        osg::ref_ptr<BakeState> _state;
+    };
+}
+
+ImpostorBaker::ImpostorBaker() :
+    _numFrames(8u),
+    _frameSize(128u)
+{
+    //nop
+}
+
+osg::BoundingSphere
+ImpostorBaker::getFrameBound(osg::Node* model)
+{
+    osg::ComputeBoundsVisitor cbv;
+    if (model)
+        model->accept(cbv);
+
+    const osg::BoundingBox& box = cbv.getBoundingBox();
+    if (!box.valid())
+        return osg::BoundingSphere();
+
+    return osg::BoundingSphere(box.center(), box.radius());
+}
+
+osg::Vec3
+ImpostorBaker::getFrameDirection(unsigned i, unsigned j, unsigned numFrames)
+{
+    // hemi-octahedral map: the center looks straight down and the edges
+    // of the square look along the horizon.
+    float u = numFrames > 1 ? (float)i / (float)(numFrames - 1) : 0.5f;
+    float v = numFrames > 1 ? (float)j / (float)(numFrames - 1) : 0.5f;
+    float tx = u * 2.0f - 1.0f, ty = v * 2.0f - 1.0f;
+    float px = (tx + ty) * 0.5f, py = (tx - ty) * 0.5f;
+    osg::Vec3 dir(px, py, 1.0f - fabs(px) - fabs(py));
+    dir.normalize();
+    return dir;
+}
+
+osg::Camera*
+ImpostorBaker::createFrames(osg::Node* model) const
+{
+    osg::BoundingSphere bs = getFrameBound(model);
+    float r = bs.radius() > 0.0f ? bs.radius() : 1.0f;
+    unsigned size = getAtlasSize();
+
+    osg::Camera* camera = new osg::Camera();
+    camera->setName("ImpostorBaker");
+    camera->setRenderOrder(osg::Camera::PRE_RENDER);
+    camera->setRenderTargetImplementation(osg::Camera::FRAME_BUFFER_OBJECT);
+    camera->setReferenceFrame(osg::Camera::ABSOLUTE_RF);
+    camera->setComputeNearFarMode(osg::CullSettings::DO_NOT_COMPUTE_NEAR_FAR);
+    camera->setViewport(0, 0, size, size);
+    camera->setClearColor(osg::Vec4(0.0f, 0.0f, 0.0f, 0.0f));
+    camera->setClearMask(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    // Bake the model by itself, unlit; whoever draws the impostor
+    // lights it with the baked normals.
+    osg::StateSet* ss = camera->getOrCreateStateSet();
+    ss->setMode(GL_BLEND, osg::StateAttribute::OFF | osg::StateAttribute::OVERRIDE);
+    ss->setMode(GL_CULL_FACE, osg::StateAttribute::OFF | osg::StateAttribute::OVERRIDE);
+
+    VirtualProgram* vp = VirtualProgram::getOrCreate(ss);
+    vp->setName("ImpostorBaker");
+    vp->setInheritShaders(false);
+    vp->setFunction("oe_ImpostorBaker_output", bakeFS, ShaderComp::LOCATION_FRAGMENT_OUTPUT);
+
+    // One nested camera per frame, each drawing into its own cell.
+    // The cells don't overlap, so they can share the one clear.
+    for (unsigned j = 0; j < _numFrames; ++j)
+    {
+        for (unsigned i = 0; i < _numFrames; ++i)
+        {
+            osg::Vec3 dir = getFrameDirection(i, j, _numFrames);
+            osg::Vec3 right = osg::Vec3(0, 0, 1) ^ dir;
+            if (right.length2() < 1e-6f)
+                right.set(1, 0, 0);
+            right.normalize();
+            osg::Vec3 up = dir ^ right;
+
+            osg::Camera* frame = new osg::Camera();
+            frame->setRenderOrder(osg::Camera::NESTED_RENDER);
+            frame->setReferenceFrame(osg::Camera::ABSOLUTE_RF);
+            frame->setComputeNearFarMode(osg::CullSettings::DO_NOT_COMPUTE_NEAR_FAR);
+            frame->setClearMask(0);
+            frame->setViewport(i * _frameSize, j * _frameSize, _frameSize, _frameSize);
+            frame->setProjectionMatrixAsOrtho(-r, r, -r, r, r, 3.0f * r);
+            frame->setViewMatrixAsLookAt(bs.center() + dir * (2.0f * r), bs.center(), up);
+            frame->getOrCreateStateSet()->addUniform(new osg::Uniform(
+                "oe_ImpostorBaker_viewMatrix", osg::Matrixf(frame->getViewMatrix())));
+            frame->addChild(model);
+            camera->addChild(frame);
+        }
+    }
+
+    return camera;
+}
+
+osg::Camera*
+ImpostorBaker::createCamera(osg::Node* model, osg::Texture2DArray* atlas, unsigned layer) const
+{
+    if (!model || !atlas)
+        return 0L;
+
+    osg::Camera* camera = createFrames(model);
+    camera->attach(osg::Camera::COLOR_BUFFER0, atlas, 0u, layer, true);
+    camera->attach(osg::Camera::COLOR_BUFFER1, atlas, 0u, layer + 1u, true);
+
+    osg::ref_ptr<BakeState> state = new BakeState();
+    camera->setCullCallback(new CullOnce(state.get()));
+    camera->setFinalDrawCallback(new MarkDone(state.get()));
+
+    return camera;
+}
+
+osg::Camera*
+ImpostorBaker::createCamera(osg::Node* model, osg::Image* color, osg::Image* normals) const
+{
+    if (!model || !color || !normals)
+        return 0L;
+
+    unsigned size = getAtlasSize();
+    color->allocateImage(size, size, 1, GL_RGBA, GL_UNSIGNED_BYTE);
+    normals->allocateImage(size, size, 1, GL_RGBA, GL_UNSIGNED_BYTE);
+
+    osg::Camera* camera = createFrames(model);
+    camera->attach(osg::Camera::COLOR_BUFFER0, color);
+    camera->attach(osg::Camera::COLOR_BUFFER1, normals);
+
+    return camera;
+}
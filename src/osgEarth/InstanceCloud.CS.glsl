@@ -0,0 +1,79 @@
+#version 430
+
+// Culls a fixed set of instances against the view frustum and the LOD
+// ranges, and appends each survivor to the visible list of its LOD.
+layout(local_size_x=64, local_size_y=1, local_size_z=1) in;
+
+struct DrawElementsIndirectCommand
+{
+    uint count;
+    uint instanceCount;
+    uint firstIndex;
+    uint baseVertex;
+    uint baseInstance;
+};
+
+layout(binding=0, std430) buffer CommandBuffer
+{
+    DrawElementsIndirectCommand cmd[];
+};
+
+// keep me vec4-aligned
+struct Instance
+{
+    mat4 xform;
+    float rangeScale;
+    uint objectID;
+    vec2 reserved;
+};
+
+layout(binding=1, std430) readonly buffer InstanceBuffer
+{
+    Instance instance[];
+};
+
+// one bucket of oe_ic_bucketSize slots per LOD
+layout(binding=2, std430) writeonly buffer VisibleBuffer
+{
+    uint visible[];
+};
+
+#define MAX_LODS 8
+
+uniform mat4 oe_ic_modelView;
+uniform vec4 oe_ic_planes[6];       // view-space frustum planes
+uniform vec4 oe_ic_bound;           // model bounding sphere
+uniform vec2 oe_ic_ranges[MAX_LODS];
+uniform uint oe_ic_numInstances;
+uniform uint oe_ic_numLODs;
+uniform uint oe_ic_bucketSize;
+
+void main()
+{
+    uint i = gl_GlobalInvocationID.x;
+    if (i >= oe_ic_numInstances)
+        return;
+
+    mat4 mvm = oe_ic_modelView * instance[i].xform;
+    vec3 center = (mvm * vec4(oe_ic_bound.xyz, 1.0)).xyz;
+
+    float scale = max(length(mvm[0].xyz), max(length(mvm[1].xyz), length(mvm[2].xyz)));
+    float radius = oe_ic_bound.w * scale;
+
+    for(int p=0; p<6; ++p)
+    {
+        if (dot(oe_ic_planes[p].xyz, center) + oe_ic_planes[p].w < -radius)
+            return;
+    }
+
+    float range = length(center) / max(instance[i].rangeScale, 1e-6);
+
+    for(uint lod=0; lod<oe_ic_numLODs; ++lod)
+    {
+        if (range >= oe_ic_ranges[lod].x && range < oe_ic_ranges[lod].y)
+        {
+            uint slot = atomicAdd(cmd[lod].instanceCount, 1);
+            visible[lod*oe_ic_bucketSize + slot] = i;
+        }
+    }
+}
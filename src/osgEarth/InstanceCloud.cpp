@@ -23,11 +23,17 @@
 #include <osgEarth/ShaderLoader>
 #include <osgEarth/Math>
 #include <osgEarth/Registry>
+#include <osgEarth/Shaders>
+#include <osgEarth/VirtualProgram>
+#include <osgEarth/GPUTimer>
 #include <osg/Program>
 #include <osg/GLExtensions>
 #include <osg/GraphicsContext>
+#include <osg/Polytope>
+#include <osg/buffered_value>
 #include <osgUtil/Optimizer>
 #include <iterator>
+#include <cstring>
 
 #ifndef GL_DYNAMIC_STORAGE_BIT
 #define GL_DYNAMIC_STORAGE_BIT 0x0100
@@ -47,14 +53,21 @@ using namespace osgEarth;
 #define GL_DRAW_INDIRECT_BUFFER 0x8F3F
 #endif
 
+#ifndef GL_COPY_READ_BUFFER
+#define GL_COPY_READ_BUFFER 0x8F36
+#define GL_COPY_WRITE_BUFFER 0x8F37
+#endif
+
 InstanceCloud::InstancingData::InstancingData() :
     commands(NULL),
     points(NULL),
     numTilesAllocated(0u),
+    drawStarted(false),
     ssboOffsetAlignment(-1)
 {
     // polyfill for pre-OSG 3.6 support
     osg::setGLExtensionFuncPtr(_glBufferStorage, "glBufferStorage", "glBufferStorageARB");
+    osg::setGLExtensionFuncPtr(_glCopyBufferSubData, "glCopyBufferSubData", "glCopyBufferSubDataARB");
 }
 
 InstanceCloud::InstancingData::~InstancingData()
@@ -74,14 +87,21 @@ InstanceCloud::InstancingData::allocateGLObjects(osg::State* state, unsigned num
     {
         OE_DEBUG << LC << "Reallocate from " << numTilesAllocated << " to " << numTiles << " tiles" << std::endl;
 
-        releaseGLObjects(state);
-
         // this is OK b/c there should only be one InstanceCloud per context id..
         // save it for release time.
         contextID = state->getContextID();
 
         osg::GLExtensions* ext = state->get<osg::GLExtensions>();
 
+        // Tiles already in the buffers keep their slots, so copy them over
+        // into the bigger ones:
+        unsigned numTilesToKeep = _glCopyBufferSubData ? numTilesAllocated : 0u;
+        osg::ref_ptr<GLBuffer> oldCommandBuffer = commandBuffer;
+        osg::ref_ptr<GLBuffer> oldRenderBuffer = renderBuffer;
+
+        if (commands)
+            delete [] commands;
+
         numTilesAllocated = numTiles;
 
         commands = new DrawElementsIndirectCommand[numTilesAllocated];
@@ -112,8 +132,8 @@ InstanceCloud::InstancingData::allocateGLObjects(osg::State* state, unsigned num
         _glBufferStorage(
             GL_SHADER_STORAGE_BUFFER,
             commandBufferSize,
-            NULL,                    // uninitialized memory
-            GL_DYNAMIC_STORAGE_BIT); // so we can reset each frame
+            &commands[0],            // every tile starts out empty
+            GL_DYNAMIC_STORAGE_BIT); // so we can reset tiles before computing them
         state->getGraphicsContext()->add(new GLBufferReleaser(commandBuffer.get()));
         
         // Buffer for the output data (culled points, written by compute shader)
@@ -131,6 +151,22 @@ InstanceCloud::InstancingData::allocateGLObjects(osg::State* state, unsigned num
             NULL,   // uninitialized memory
             0);     // only GPU will write to this buffer
         state->getGraphicsContext()->add(new GLBufferReleaser(renderBuffer.get()));
+
+        if (numTilesToKeep > 0u && oldCommandBuffer.valid() && oldRenderBuffer.valid())
+        {
+            ext->glBindBuffer(GL_COPY_READ_BUFFER, oldCommandBuffer->_handle);
+            ext->glBindBuffer(GL_COPY_WRITE_BUFFER, commandBuffer->_handle);
+            _glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0,
+                numTilesToKeep * sizeof(DrawElementsIndirectCommand));
+
+            ext->glBindBuffer(GL_COPY_READ_BUFFER, oldRenderBuffer->_handle);
+            ext->glBindBuffer(GL_COPY_WRITE_BUFFER, renderBuffer->_handle);
+            _glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0,
+                numTilesToKeep * renderBufferTileSize);
+
+            ext->glBindBuffer(GL_COPY_READ_BUFFER, 0);
+            ext->glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        }
     }
 }
 
@@ -147,6 +183,7 @@ InstanceCloud::InstancingData::releaseGLObjects(osg::State* state) const
 
     commandBuffer = NULL;
     renderBuffer = NULL;
+    numTilesAllocated = 0u;
 }
 
 InstanceCloud::InstanceCloud()
@@ -217,16 +254,6 @@ InstanceCloud::preCull(osg::RenderInfo& ri)
 {
     osg::GLExtensions* ext = ri.getState()->get<osg::GLExtensions>();
 
-    // Reset all the instance counts to zero by copying the empty
-    // prototype buffer to the GPU
-    ext->glBindBuffer(GL_SHADER_STORAGE_BUFFER, _data.commandBuffer->_handle);
-
-    ext->glBufferSubData(
-        GL_SHADER_STORAGE_BUFFER, 
-        0,
-        _data.numTilesAllocated * sizeof(DrawElementsIndirectCommand),
-        &_data.commands[0]);
-
     // Bind our SSBOs to their respective layout indices in the shader
     ext->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING_COMMAND_BUFFER, _data.commandBuffer->_handle);
 
@@ -238,6 +265,24 @@ InstanceCloud::cullTile(osg::RenderInfo& ri, unsigned tileNum)
 {
     osg::GLExtensions* ext = ri.getState()->get<osg::GLExtensions>();
 
+    // Reset the tile's instance count to zero by copying the empty
+    // prototype command to the GPU. Other tiles keep their results.
+    ext->glBindBuffer(GL_SHADER_STORAGE_BUFFER, _data.commandBuffer->_handle);
+
+    ext->glBufferSubData(
+        GL_SHADER_STORAGE_BUFFER,
+        tileNum * sizeof(DrawElementsIndirectCommand),
+        sizeof(DrawElementsIndirectCommand),
+        &_data.commands[tileNum]);
+
+    // the compute shader writes the tile's instances from the start of this range:
+    ext->glBindBufferRange(
+        GL_SHADER_STORAGE_BUFFER,
+        BINDING_RENDER_BUFFER,
+        _data.renderBuffer->_handle,
+        tileNum * _data.renderBufferTileSize,
+        _data.renderBufferTileSize);
+
     ext->glDispatchCompute(_data.numX, _data.numY, 1);
 }
 
@@ -254,6 +299,7 @@ InstanceCloud::drawTile(osg::RenderInfo& ri, unsigned tileNum)
 {
     _data.tileToDraw = tileNum;
     _geom->draw(ri);
+    _data.drawStarted = true;
 }
 
 void
@@ -262,6 +308,7 @@ InstanceCloud::endFrame(osg::RenderInfo& ri)
     // be a good citizen
     osg::GLExtensions* ext = ri.getState()->get<osg::GLExtensions>();
     ext->glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    _data.drawStarted = false;
 }
 
 InstanceCloud::Renderer::Renderer(InstancingData* data) :
@@ -278,7 +325,8 @@ InstanceCloud::Renderer::drawImplementation(osg::RenderInfo& ri, const osg::Draw
 
     osg::GLExtensions* ext = state.get<osg::GLExtensions>();
 
-    if (_data->tileToDraw == 0)
+    // the first tile drawn sets up the shared state:
+    if (!_data->drawStarted)
     {
         const osg::Geometry* geom = drawable->asGeometry();
 
@@ -353,7 +401,7 @@ InstanceCloud::ModelCruncher::ModelCruncher() :
     _texcoords = new osg::Vec3Array(osg::Array::BIND_PER_VERTEX);
     _geom->setTexCoordArray(7, _texcoords);
 
-    _primset = new osg::DrawElementsUShort(GL_TRIANGLES);
+    _primset = new osg::DrawElementsUInt(GL_TRIANGLES);
     _geom->addPrimitiveSet(_primset);
 }
 
@@ -373,20 +421,26 @@ InstanceCloud::ModelCruncher::add(osg::Node* node)
 
 namespace
 {
-    template<typename T> void append(T* dest, const osg::Array* src, int numVerts)
+    // Appends numVerts values from src to dest, supplying the default value
+    // for a missing array or one whose type or binding we can't expand
+    template<typename T> void append(T* dest, const osg::Array* src, int numVerts, const typename T::ElementDataType& defaultValue)
     {
-        if (src->getBinding() == osg::Array::BIND_PER_VERTEX)
+        const T* src_typed = dynamic_cast<const T*>(src);
+        dest->reserveArray(dest->size() + numVerts);
+
+        if (src_typed && src->getBinding() == osg::Array::BIND_PER_VERTEX && (int)src->getNumElements() >= numVerts)
         {
-            dest->reserveArray(dest->size() + src->getNumElements());
-            const T* src_typed = static_cast<const T*>(src);
-            std::copy(src_typed->begin(), src_typed->end(), std::back_inserter(*dest));
+            std::copy(src_typed->begin(), src_typed->begin() + numVerts, std::back_inserter(*dest));
         }
-        else if (src->getBinding() == osg::Array::BIND_OVERALL)
+        else
         {
-            dest->reserveArray(dest->size() + numVerts);
-            const T* src_typed = static_cast<const T*>(src);
+            typename T::ElementDataType value =
+                src_typed && src->getBinding() == osg::Array::BIND_OVERALL && src->getNumElements() > 0 ?
+                (*src_typed)[0] :
+                defaultValue;
+
             for(int i=0; i<numVerts; ++i)
-                dest->push_back((*src_typed)[0]);
+                dest->push_back(value);
         }
     }
 }
@@ -394,6 +448,10 @@ namespace
 void
 InstanceCloud::ModelCruncher::finalize()
 {
+    // an untextured model has no atlas
+    if (_imagesToAdd.empty())
+        return;
+
     _atlas = new osg::Texture2DArray();
 
     int s = -1, t = -1;
@@ -508,15 +566,21 @@ InstanceCloud::ModelCruncher::apply(osg::Geometry& node)
 {
     bool pushed = pushStateSet(node);
 
+    if (node.getVertexArray() == NULL)
+    {
+        if (pushed) popStateSet();
+        return;
+    }
+
     int offset = _verts->size();
     int size = node.getVertexArray()->getNumElements();
 
-    append(_verts, node.getVertexArray(), size);
-    append(_normals, node.getNormalArray(), size);
-    append(_colors, node.getColorArray(), size);
+    append(_verts, node.getVertexArray(), size, osg::Vec3(0,0,0));
+    append(_normals, node.getNormalArray(), size, osg::Vec3(0,0,1));
+    append(_colors, node.getColorArray(), size, osg::Vec4(1,1,1,1));
 
-    // find the current texture in the atlas
-    int layer = 0;
+    // find the current texture in the atlas (-1 = untextured)
+    int layer = -1;
     if (!_textureStack.empty())
     {
         AtlasIndexLUT::iterator i = _atlasLUT.find(_textureStack.back());
@@ -526,28 +590,22 @@ InstanceCloud::ModelCruncher::apply(osg::Geometry& node)
         }
     }
 
+    // keep the texcoords aligned with the verts even when the geometry has none
     osg::Vec2Array* texcoords = dynamic_cast<osg::Vec2Array*>(node.getTexCoordArray(0));
-    if (texcoords)
+    _texcoords->reserve(_texcoords->size() + size);
+    for(int i=0; i<size; ++i)
     {
-        // find the current texture in the atlas
-        int layer = 0;
-        if (!_textureStack.empty())
-        {
-            AtlasIndexLUT::iterator i = _atlasLUT.find(_textureStack.back());
-            if (i != _atlasLUT.end())
-            {
-                layer = i->second;
-            }
-        }
-
-        _texcoords->reserve(_texcoords->size() + texcoords->size());
-        for(int i=0; i<texcoords->size(); ++i)
+        if (texcoords && i < (int)texcoords->size())
         {
             _texcoords->push_back(osg::Vec3(
                 (*texcoords)[i].x(),
                 (*texcoords)[i].y(),
                 layer));
         }
+        else
+        {
+            _texcoords->push_back(osg::Vec3(0, 0, texcoords ? layer : -1));
+        }
     }
 
     for(unsigned i=0; i < node.getNumPrimitiveSets(); ++i)
@@ -565,3 +623,450 @@ InstanceCloud::ModelCruncher::apply(osg::Geometry& node)
 
     if (pushed) popStateSet();
 }
+
+//...................................................................
+
+#define IC_BINDING_COMMAND_BUFFER 0
+#define IC_BINDING_INSTANCE_BUFFER 1
+#define IC_BINDING_VISIBLE_BUFFER 2
+#define IC_WORKGROUP_SIZE 64
+
+struct CulledInstanceCloud::Data
+{
+    typedef InstanceCloud::DrawElementsIndirectCommand DrawElementsIndirectCommand;
+
+    // keep me vec4-aligned (see Instance in the shaders)
+    struct Instance
+    {
+        GLfloat xform[16];
+        GLfloat rangeScale;
+        GLuint  objectID;
+        GLfloat reserved[2];
+    };
+
+    struct LOD
+    {
+        GLuint firstIndex;
+        GLuint count;
+        float  minRange;
+        float  maxRange;
+    };
+
+    struct UniformLocations
+    {
+        GLint modelView, planes, bound, ranges, numInstances, numLODs, bucketSize;
+    };
+
+    // GL objects, per graphics context
+    struct GCState
+    {
+        osg::ref_ptr<GLBuffer> commandBuffer;
+        osg::ref_ptr<GLBuffer> instanceBuffer;
+        osg::ref_ptr<GLBuffer> visibleBuffer;
+        GLuint capacity;
+        GLint bucketBytes;
+        GLint ssboOffsetAlignment;
+        unsigned revision;
+        const osg::Program::PerContextProgram* pcp;
+        UniformLocations uniforms;
+
+        GCState() : capacity(0u), bucketBytes(0), ssboOffsetAlignment(-1), revision(~0u), pcp(NULL) { }
+    };
+
+    Data()
+    {
+        init();
+    }
+
+    Data(const Data& rhs) :
+        cruncher(rhs.cruncher),
+        lods(rhs.lods),
+        instances(rhs.instances),
+        bound(rhs.bound)
+    {
+        init();
+    }
+
+    void init()
+    {
+        revision = 0u;
+
+        Shaders shaders;
+        std::string source = ShaderLoader::load(shaders.InstanceCloudCompute, shaders);
+        computeProgram = new osg::Program();
+        computeProgram->addShader(new osg::Shader(osg::Shader::COMPUTE, source));
+        computeStateSet = new osg::StateSet();
+        computeStateSet->setAttribute(computeProgram.get(), osg::StateAttribute::ON);
+
+        // polyfill for pre-OSG 3.6 support
+        osg::setGLExtensionFuncPtr(_glBufferStorage, "glBufferStorage", "glBufferStorageARB");
+        osg::setGLExtensionFuncPtr(_glDrawElementsIndirect, "glDrawElementsIndirect", "glDrawElementsIndirectARB");
+    }
+
+    void allocate(osg::State& state, GCState& gc) const;
+    void cull(osg::State& state, GCState& gc) const;
+
+    osg::ref_ptr<InstanceCloud::ModelCruncher> cruncher;
+    std::vector<LOD> lods;
+    std::vector<Instance> instances;
+    osg::BoundingSphere bound;
+    unsigned revision;
+
+    osg::ref_ptr<osg::Program> computeProgram;
+    osg::ref_ptr<osg::StateSet> computeStateSet;
+    mutable osg::buffered_object<GCState> gc;
+
+    // pre-OSG 3.6 support
+    void (GL_APIENTRY * _glBufferStorage)(GLenum, GLuint, const void*, GLenum);
+    void (GL_APIENTRY * _glDrawElementsIndirect)(GLenum, GLenum, const void*);
+};
+
+void
+CulledInstanceCloud::Data::allocate(osg::State& state, GCState& gc) const
+{
+    osg::GLExtensions* ext = state.get<osg::GLExtensions>();
+
+    if (gc.ssboOffsetAlignment < 0)
+    {
+        glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &gc.ssboOffsetAlignment);
+    }
+
+    if (!gc.commandBuffer.valid())
+    {
+        gc.commandBuffer = new GLBuffer();
+        ext->glGenBuffers(1, &gc.commandBuffer->_handle);
+        ext->glBindBuffer(GL_SHADER_STORAGE_BUFFER, gc.commandBuffer->_handle);
+        _glBufferStorage(
+            GL_SHADER_STORAGE_BUFFER,
+            MAX_LODS * sizeof(DrawElementsIndirectCommand),
+            NULL,                    // uninitialized memory
+            GL_DYNAMIC_STORAGE_BIT); // so we can reset each frame
+        state.getGraphicsContext()->add(new GLBufferReleaser(gc.commandBuffer.get()));
+    }
+
+    // grow geometrically so adding instances one at a time stays cheap
+    if (gc.capacity < instances.size())
+    {
+        gc.capacity = osg::maximum((GLuint)instances.size(), 2u*gc.capacity);
+
+        gc.instanceBuffer = new GLBuffer();
+        ext->glGenBuffers(1, &gc.instanceBuffer->_handle);
+        ext->glBindBuffer(GL_SHADER_STORAGE_BUFFER, gc.instanceBuffer->_handle);
+        _glBufferStorage(
+            GL_SHADER_STORAGE_BUFFER,
+            gc.capacity * sizeof(Instance),
+            NULL,
+            GL_DYNAMIC_STORAGE_BIT);
+        state.getGraphicsContext()->add(new GLBufferReleaser(gc.instanceBuffer.get()));
+
+        // One bucket per LOD, each big enough for every instance.
+        // Align properly to satisfy glBindBufferRange
+        gc.bucketBytes = align((GLint)(gc.capacity * sizeof(GLuint)), gc.ssboOffsetAlignment);
+
+        gc.visibleBuffer = new GLBuffer();
+        ext->glGenBuffers(1, &gc.visibleBuffer->_handle);
+        ext->glBindBuffer(GL_SHADER_STORAGE_BUFFER, gc.visibleBuffer->_handle);
+        _glBufferStorage(
+            GL_SHADER_STORAGE_BUFFER,
+            MAX_LODS * gc.bucketBytes,
+            NULL,   // uninitialized memory
+            0);     // only GPU will write to this buffer
+        state.getGraphicsContext()->add(new GLBufferReleaser(gc.visibleBuffer.get()));
+
+        gc.revision = ~0u;
+    }
+
+    if (gc.revision != revision)
+    {
+        ext->glBindBuffer(GL_SHADER_STORAGE_BUFFER, gc.instanceBuffer->_handle);
+        ext->glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, instances.size() * sizeof(Instance), &instances[0]);
+        gc.revision = revision;
+    }
+}
+
+void
+CulledInstanceCloud::Data::cull(osg::State& state, GCState& gc) const
+{
+    osg::GLExtensions* ext = state.get<osg::GLExtensions>();
+
+    // Reset the instance counts to zero by copying the prototype
+    // commands to the GPU
+    DrawElementsIndirectCommand commands[MAX_LODS];
+    for(unsigned i=0; i<lods.size(); ++i)
+    {
+        commands[i].count = lods[i].count;
+        commands[i].instanceCount = 0;
+        commands[i].firstIndex = lods[i].firstIndex;
+        commands[i].baseVertex = 0;
+        commands[i].baseInstance = 0;
+    }
+
+    ext->glBindBuffer(GL_SHADER_STORAGE_BUFFER, gc.commandBuffer->_handle);
+    ext->glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, lods.size() * sizeof(DrawElementsIndirectCommand), &commands[0]);
+
+    ext->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, IC_BINDING_COMMAND_BUFFER, gc.commandBuffer->_handle);
+    ext->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, IC_BINDING_INSTANCE_BUFFER, gc.instanceBuffer->_handle);
+    ext->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, IC_BINDING_VISIBLE_BUFFER, gc.visibleBuffer->_handle);
+
+    state.apply(computeStateSet.get());
+
+    const osg::Program::PerContextProgram* pcp = state.getLastAppliedProgramObject();
+    if (pcp)
+    {
+        UniformLocations& u = gc.uniforms;
+        if (gc.pcp != pcp)
+        {
+            u.modelView = pcp->getUniformLocation(osg::Uniform::getNameID("oe_ic_modelView"));
+            u.planes = pcp->getUniformLocation(osg::Uniform::getNameID("oe_ic_planes"));
+            u.bound = pcp->getUniformLocation(osg::Uniform::getNameID("oe_ic_bound"));
+            u.ranges = pcp->getUniformLocation(osg::Uniform::getNameID("oe_ic_ranges"));
+            u.numInstances = pcp->getUniformLocation(osg::Uniform::getNameID("oe_ic_numInstances"));
+            u.numLODs = pcp->getUniformLocation(osg::Uniform::getNameID("oe_ic_numLODs"));
+            u.bucketSize = pcp->getUniformLocation(osg::Uniform::getNameID("oe_ic_bucketSize"));
+            gc.pcp = pcp;
+        }
+
+        // frustum planes in view space
+        osg::Polytope tope;
+        tope.setToUnitFrustum(true, true);
+        tope.transformProvidingInverse(state.getProjectionMatrix());
+
+        GLfloat planes[24];
+        for(unsigned i=0; i<6; ++i)
+        {
+            const osg::Plane& plane = tope.getPlaneList()[i];
+            for(unsigned k=0; k<4; ++k)
+                planes[i*4+k] = plane[k];
+        }
+
+        GLfloat ranges[MAX_LODS*2];
+        for(unsigned i=0; i<lods.size(); ++i)
+        {
+            ranges[i*2] = lods[i].minRange;
+            ranges[i*2+1] = lods[i].maxRange;
+        }
+
+        osg::Matrixf mvm(state.getModelViewMatrix());
+        GLfloat boundv[4] = { bound.center().x(), bound.center().y(), bound.center().z(), bound.radius() };
+
+        ext->glUniformMatrix4fv(u.modelView, 1, GL_FALSE, mvm.ptr());
+        ext->glUniform4fv(u.planes, 6, planes);
+        ext->glUniform4fv(u.bound, 1, boundv);
+        ext->glUniform2fv(u.ranges, lods.size(), ranges);
+        ext->glUniform1ui(u.numInstances, instances.size());
+        ext->glUniform1ui(u.numLODs, lods.size());
+        ext->glUniform1ui(u.bucketSize, gc.bucketBytes / sizeof(GLuint));
+
+        ext->glDispatchCompute((instances.size() + IC_WORKGROUP_SIZE - 1) / IC_WORKGROUP_SIZE, 1, 1);
+
+        ext->glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+    }
+
+    // restore the drawable's program
+    state.apply();
+}
+
+bool
+CulledInstanceCloud::isSupported()
+{
+    return Registry::capabilities().supportsGLSL(430u);
+}
+
+CulledInstanceCloud::CulledInstanceCloud() :
+    osg::Geometry(),
+    _data(new Data())
+{
+    setUseVertexBufferObjects(true);
+    setUseDisplayList(false);
+}
+
+CulledInstanceCloud::CulledInstanceCloud(const CulledInstanceCloud& rhs, const osg::CopyOp& copy) :
+    osg::Geometry(rhs, copy),
+    _data(new Data(*rhs._data))
+{
+    //nop
+}
+
+CulledInstanceCloud::~CulledInstanceCloud()
+{
+    delete _data;
+}
+
+bool
+CulledInstanceCloud::addLOD(osg::Node* model, float minRange, float maxRange)
+{
+    if (!model || _data->lods.size() >= MAX_LODS)
+        return false;
+
+    // every LOD lives in one geometry, so the draws share the arrays
+    if (!_data->cruncher.valid())
+    {
+        _data->cruncher = new InstanceCloud::ModelCruncher();
+
+        osg::Geometry* geom = _data->cruncher->_geom.get();
+        setVertexArray(geom->getVertexArray());
+        setNormalArray(geom->getNormalArray());
+        setColorArray(geom->getColorArray());
+        setTexCoordArray(7, geom->getTexCoordArray(7));
+        addPrimitiveSet(geom->getPrimitiveSet(0));
+        setStateSet(geom->getOrCreateStateSet());
+
+        Shaders shaders;
+        VirtualProgram* vp = VirtualProgram::getOrCreate(getStateSet());
+        vp->setName("CulledInstanceCloud");
+        shaders.load(vp, shaders.InstanceCloud);
+    }
+
+    Data::LOD lod;
+    lod.firstIndex = _data->cruncher->_primset->size();
+    _data->cruncher->add(model);
+    lod.count = _data->cruncher->_primset->size() - lod.firstIndex;
+    lod.minRange = minRange;
+    lod.maxRange = maxRange;
+    _data->lods.push_back(lod);
+
+    _data->bound.expandBy(model->getBound());
+
+    // rebuild the atlas with any new textures
+    _data->cruncher->finalize();
+    if (_data->cruncher->getAtlas())
+        getStateSet()->setDefine("OE_IC_USE_ATLAS");
+
+    getVertexArray()->dirty();
+    getNormalArray()->dirty();
+    getColorArray()->dirty();
+    getTexCoordArray(7)->dirty();
+    getPrimitiveSet(0)->dirty();
+    dirtyBound();
+
+    return true;
+}
+
+unsigned
+CulledInstanceCloud::getNumLODs() const
+{
+    return _data->lods.size();
+}
+
+void
+CulledInstanceCloud::addInstance(const osg::Matrixf& xform, float rangeScale, ObjectID objectID)
+{
+    Data::Instance instance;
+    ::memcpy(instance.xform, xform.ptr(), sizeof(instance.xform));
+    instance.rangeScale = rangeScale;
+    instance.objectID = objectID;
+    instance.reserved[0] = instance.reserved[1] = 0.0f;
+    _data->instances.push_back(instance);
+    ++_data->revision;
+    dirtyBound();
+}
+
+void
+CulledInstanceCloud::clearInstances()
+{
+    _data->instances.clear();
+    ++_data->revision;
+    dirtyBound();
+}
+
+unsigned
+CulledInstanceCloud::getNumInstances() const
+{
+    return _data->instances.size();
+}
+
+osg::BoundingBox
+CulledInstanceCloud::computeBoundingBox() const
+{
+    osg::BoundingBox box;
+    if (!_data->bound.valid())
+        return box;
+
+    for(unsigned i=0; i<_data->instances.size(); ++i)
+    {
+        osg::Matrixf xform(_data->instances[i].xform);
+        osg::Vec3 center = _data->bound.center() * xform;
+        float scale = osg::maximum(
+            xform.getScale().x(),
+            osg::maximum(xform.getScale().y(), xform.getScale().z()));
+        float radius = _data->bound.radius() * scale;
+        osg::Vec3 radius3(radius, radius, radius);
+        box.expandBy(center - radius3);
+        box.expandBy(center + radius3);
+    }
+    return box;
+}
+
+void
+CulledInstanceCloud::drawImplementation(osg::RenderInfo& ri) const
+{
+    if (_data->lods.empty() || _data->instances.empty() || !isSupported())
+        return;
+
+    osg::State& state = *ri.getState();
+    osg::GLExtensions* ext = state.get<osg::GLExtensions>();
+    Data::GCState& gc = _data->gc[state.getContextID()];
+
+    static const osg::ref_ptr<Util::GPUTimer> s_cullTimer = Util::GPUTimer::get("instances.cull");
+    static const osg::ref_ptr<Util::GPUTimer> s_drawTimer = Util::GPUTimer::get("instances.draw");
+
+    // First pass: cull the instances into the per-LOD visible lists
+    _data->allocate(state, gc);
+    {
+        Util::GPUTimer::Scope gpuTimer(s_cullTimer.get(), ri);
+        _data->cull(state, gc);
+    }
+
+    // Second pass: one indirect draw per LOD
+    Util::GPUTimer::Scope gpuTimer(s_drawTimer.get(), ri);
+    drawVertexArraysImplementation(ri);
+
+    osg::GLBufferObject* ebo = getPrimitiveSet(0)->getOrCreateGLBufferObject(state.getContextID());
+    state.bindElementBufferObject(ebo);
+
+    ext->glBindBuffer(GL_DRAW_INDIRECT_BUFFER, gc.commandBuffer->_handle);
+    ext->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, IC_BINDING_INSTANCE_BUFFER, gc.instanceBuffer->_handle);
+
+    for(unsigned i=0; i<_data->lods.size(); ++i)
+    {
+        if (_data->lods[i].count == 0)
+            continue;
+
+        // activate the visible list for this LOD:
+        ext->glBindBufferRange(
+            GL_SHADER_STORAGE_BUFFER,
+            IC_BINDING_VISIBLE_BUFFER,
+            gc.visibleBuffer->_handle,
+            i * gc.bucketBytes,
+            gc.bucketBytes);
+
+        _data->_glDrawElementsIndirect(
+            GL_TRIANGLES,
+            GL_UNSIGNED_INT,
+            (const void*)(i * sizeof(Data::DrawElementsIndirectCommand)));
+    }
+
+    // be a good citizen
+    ext->glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+void
+CulledInstanceCloud::resizeGLObjectBuffers(unsigned maxSize)
+{
+    osg::Geometry::resizeGLObjectBuffers(maxSize);
+    _data->computeStateSet->resizeGLObjectBuffers(maxSize);
+    _data->gc.resize(maxSize);
+}
+
+void
+CulledInstanceCloud::releaseGLObjects(osg::State* state) const
+{
+    osg::Geometry::releaseGLObjects(state);
+    _data->computeStateSet->releaseGLObjects(state);
+
+    if (state)
+        _data->gc[state->getContextID()] = Data::GCState();
+    else
+        for(unsigned i=0; i<_data->gc.size(); ++i)
+            _data->gc[i] = Data::GCState();
+}
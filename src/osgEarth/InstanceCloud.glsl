@@ -0,0 +1,74 @@
+#version 430
+$GLSL_DEFAULT_PRECISION_FLOAT
+
+#pragma vp_name       InstanceCloud VS
+#pragma vp_entryPoint oe_ic_setInstancePosition
+#pragma vp_location   vertex_model
+#pragma vp_order      0.0
+
+struct Instance
+{
+    mat4 xform;
+    float rangeScale;
+    uint objectID;
+    vec2 reserved;
+};
+
+layout(binding=1, std430) readonly buffer InstanceBuffer
+{
+    Instance instance[];
+};
+
+// the visible list of the LOD being drawn (written by the compute shader)
+layout(binding=2, std430) readonly buffer VisibleBuffer
+{
+    uint visible[];
+};
+
+// Stage-global containing object ID
+uint oe_index_objectid;
+vec3 vp_Normal;
+
+// texture coordinate and atlas layer (-1 = untextured)
+out vec3 oe_ic_texCoord;
+
+void oe_ic_setInstancePosition(inout vec4 vertex)
+{
+    uint i = visible[gl_InstanceID];
+    mat4 xform = instance[i].xform;
+
+    vertex = xform * vertex;
+    vp_Normal = mat3(xform) * vp_Normal;
+
+    oe_index_objectid = instance[i].objectID;
+    oe_ic_texCoord = gl_MultiTexCoord7.xyz;
+}
+
+
+[break]
+
+#version $GLSL_VERSION_STR
+$GLSL_DEFAULT_PRECISION_FLOAT
+
+#pragma vp_name       InstanceCloud FS
+#pragma vp_entryPoint oe_ic_applyTexture
+#pragma vp_location   fragment_coloring
+#pragma vp_order      0.0
+
+#pragma import_defines(OE_IC_USE_ATLAS)
+
+in vec3 oe_ic_texCoord;
+
+#ifdef OE_IC_USE_ATLAS
+uniform sampler2DArray oe_GroundCover_atlas;
+#endif
+
+void oe_ic_applyTexture(inout vec4 color)
+{
+#ifdef OE_IC_USE_ATLAS
+    if (oe_ic_texCoord.z >= 0.0)
+    {
+        color *= texture(oe_GroundCover_atlas, oe_ic_texCoord);
+    }
+#endif
+}
@@ -27,10 +27,14 @@
 #include <osgEarth/JsonUtils>
 
 #include <sstream>
+#include <vector>
 
 #include <string.h>
 #include <stdlib.h>
 
+#include <rapidjson/reader.h>
+#include <rapidjson/memorystream.h>
+
 #if _MSC_VER >= 1400 // VC++ 8.0
 #pragma warning( disable : 4996 )   // disable warning about strdup being deprecated.
 #endif
@@ -2033,15 +2037,125 @@ collectComments_(false)
     //nop
 }
 
+namespace
+{
+   // Builds a Value straight from rapidjson's SAX events, with the
+   // same number typing as Reader::decodeNumber.
+   struct ValueBuilder : public rapidjson::BaseReaderHandler<rapidjson::UTF8<>, ValueBuilder>
+   {
+      ValueBuilder( Value &root ) : root_(root) { }
+
+      Value &root_;
+      std::vector<Value*> stack_;
+      std::string key_;
+
+      Value &next()
+      {
+         if ( stack_.empty() )
+            return root_;
+         Value &parent = *stack_.back();
+         if ( parent.isArray() )
+            return parent.append( Value() );
+         return parent[ key_ ];
+      }
+
+      bool put( Value value )
+      {
+         next().swap( value );
+         return true;
+      }
+
+      bool positive( uint64_t value )
+      {
+         if ( value / 10u >= Value::maxUInt / 10u )
+            return put( Value( (double)value ) );
+         if ( value <= Value::UInt(Value::maxInt) )
+            return put( Value( Value::Int(value) ) );
+         return put( Value( Value::UInt(value) ) );
+      }
+
+      bool negative( uint64_t magnitude )
+      {
+         if ( magnitude / 10u >= (Value::UInt(Value::maxInt) + 1u) / 10u )
+            return put( Value( -(double)magnitude ) );
+         return put( Value( -Value::Int(magnitude) ) );
+      }
+
+      bool Null() { return put( Value() ); }
+      bool Bool( bool b ) { return put( Value(b) ); }
+      bool Int( int i ) { return i < 0 ? negative( 0u - (uint64_t)(int64_t)i ) : positive( (uint64_t)i ); }
+      bool Uint( unsigned u ) { return positive( u ); }
+      bool Int64( int64_t i ) { return i < 0 ? negative( 0u - (uint64_t)i ) : positive( (uint64_t)i ); }
+      bool Uint64( uint64_t u ) { return positive( u ); }
+      bool Double( double d ) { return put( Value(d) ); }
+
+      bool String( const char *str, rapidjson::SizeType length, bool )
+      {
+         return put( Value( std::string(str, length) ) );
+      }
+
+      bool Key( const char *str, rapidjson::SizeType length, bool )
+      {
+         key_.assign( str, length );
+         return true;
+      }
+
+      bool StartObject()
+      {
+         Value &value = next();
+         value = Value( objectValue );
+         stack_.push_back( &value );
+         return true;
+      }
+
+      bool StartArray()
+      {
+         Value &value = next();
+         value = Value( arrayValue );
+         stack_.push_back( &value );
+         return true;
+      }
+
+      bool EndObject( rapidjson::SizeType ) { stack_.pop_back(); return true; }
+      bool EndArray( rapidjson::SizeType ) { stack_.pop_back(); return true; }
+   };
+
+   // Like Reader::parse, stops after the first complete value. Comments aren't
+   // accepted so that a document with any falls back to the json-cpp reader,
+   // which can keep them.
+   const unsigned FastParseFlags =
+      rapidjson::kParseStopWhenDoneFlag | rapidjson::kParseFullPrecisionFlag;
+
+   template<unsigned FLAGS, typename STREAM>
+   bool parseFast( STREAM &stream, Value &root )
+   {
+      ValueBuilder builder( root );
+      rapidjson::Reader reader;
+      if ( reader.Parse<FLAGS>( stream, builder ) )
+         return true;
+      root = Value();
+      return false;
+   }
+}
+
 bool
 Reader::parse( const std::string &document, 
                Value &root,
                bool collectComments )
 {
+   // parse our own copy in place; restore it if we need the slow path
+   document_ = document;
+   rapidjson::InsituStringStream insitu( &document_[0] );
+   if ( parseFast<FastParseFlags | rapidjson::kParseInsituFlag>( insitu, root ) )
+   {
+      errors_.clear();
+      return true;
+   }
+
    document_ = document;
    const char *begin = document_.c_str();
    const char *end = begin + document_.length();
-   return parse( begin, end, root, collectComments );
+   return readDocument( begin, end, root, collectComments );
 }
 
 bool
@@ -2065,6 +2179,20 @@ bool
 Reader::parse( const char *beginDoc, const char *endDoc, 
                Value &root,
                bool collectComments )
+{
+   rapidjson::MemoryStream stream( beginDoc, endDoc - beginDoc );
+   if ( parseFast<FastParseFlags>( stream, root ) )
+   {
+      errors_.clear();
+      return true;
+   }
+   return readDocument( beginDoc, endDoc, root, collectComments );
+}
+
+bool 
+Reader::readDocument( const char *beginDoc, const char *endDoc, 
+                      Value &root,
+                      bool collectComments )
 {
    begin_ = beginDoc;
    end_ = endDoc;
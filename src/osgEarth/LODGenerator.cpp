@@ -0,0 +1,339 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+ * Copyright 2020 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarth/LODGenerator>
+#include <osgEarth/ImageUtils>
+#include <osgUtil/Simplifier>
+#include <osg/ComputeBoundsVisitor>
+#include <osg/Geometry>
+#include <osg/LOD>
+#include <osg/Material>
+#include <osg/Texture>
+#include <osg/TriangleFunctor>
+#include <cfloat>
+
+#define LC "[LODGenerator] "
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+// name that marks an LOD made by the generator
+#define GENERATED_LOD_NAME "osgEarth.LODGenerator"
+
+namespace
+{
+    struct CountTriangles
+    {
+        CountTriangles() : _count(0u) { }
+        void operator()(const osg::Vec3&, const osg::Vec3&, const osg::Vec3&, bool) { ++_count; }
+        unsigned _count;
+    };
+
+    // Counts triangles and averages the colors of a model.
+    struct SurveyVisitor : public osg::NodeVisitor
+    {
+        SurveyVisitor() : osg::NodeVisitor(TRAVERSE_ALL_CHILDREN), _triangles(0u), _numColors(0u)
+        {
+            setNodeMaskOverride(~0);
+        }
+
+        void apply(osg::Node& node)
+        {
+            push(node.getStateSet());
+            traverse(node);
+            pop(node.getStateSet());
+        }
+
+        void apply(osg::Drawable& drawable)
+        {
+            push(drawable.getStateSet());
+
+            osg::TriangleFunctor<CountTriangles> counter;
+            drawable.accept(counter);
+            _triangles += counter._count;
+
+            // prefer vertex colors, then the texture, then the material
+            osg::Geometry* geom = drawable.asGeometry();
+            osg::Vec4Array* colors = geom ? dynamic_cast<osg::Vec4Array*>(geom->getColorArray()) : 0L;
+            osg::Vec4 color;
+            if (colors && !colors->empty())
+            {
+                for (auto& c : *colors)
+                    color += c;
+                color /= (float)colors->size();
+            }
+            else if (!_textures.empty() && _textures.back())
+            {
+                color = average(_textures.back());
+            }
+            else if (!_materials.empty() && _materials.back())
+            {
+                color = _materials.back()->getDiffuse(osg::Material::FRONT);
+            }
+            else
+            {
+                color.set(1, 1, 1, 1);
+            }
+            _color += color;
+            ++_numColors;
+
+            pop(drawable.getStateSet());
+        }
+
+        void push(osg::StateSet* ss)
+        {
+            if (!ss)
+                return;
+
+            osg::Material* material = dynamic_cast<osg::Material*>(ss->getAttribute(osg::StateAttribute::MATERIAL));
+            _materials.push_back(material ? material : (_materials.empty() ? 0L : _materials.back()));
+
+            osg::Texture* tex = dynamic_cast<osg::Texture*>(ss->getTextureAttribute(0, osg::StateAttribute::TEXTURE));
+            osg::Image* image = tex && tex->getNumImages() > 0 ? tex->getImage(0) : 0L;
+            _textures.push_back(image ? image : (_textures.empty() ? 0L : _textures.back()));
+        }
+
+        void pop(osg::StateSet* ss)
+        {
+            if (!ss)
+                return;
+            _materials.pop_back();
+            _textures.pop_back();
+        }
+
+        // average of a grid of samples from the image
+        osg::Vec4 average(const osg::Image* image)
+        {
+            ImageUtils::PixelReader read(image);
+            if (!read.supports(image))
+                return osg::Vec4(1, 1, 1, 1);
+
+            const unsigned n = 8u;
+            osg::Vec4 sum;
+            for (unsigned t = 0; t < n; ++t)
+                for (unsigned s = 0; s < n; ++s)
+                    sum += read((s + 0.5f) / (float)n, (t + 0.5f) / (float)n);
+            return sum / (float)(n * n);
+        }
+
+        unsigned _triangles;
+        osg::Vec4 _color;
+        unsigned _numColors;
+        std::vector<osg::Material*> _materials;
+        std::vector<osg::Image*> _textures;
+    };
+
+    // A lit box in one color that fills the model's bounds.
+    osg::Node* createProxy(const osg::BoundingBox& box, const osg::Vec4& color)
+    {
+        static const int faces[6][4] = {
+            {0, 2, 6, 4}, {1, 5, 7, 3},     // -x, +x
+            {0, 4, 5, 1}, {2, 3, 7, 6},     // -y, +y
+            {0, 1, 3, 2}, {4, 6, 7, 5} };   // -z, +z
+
+        static const osg::Vec3 normals[6] = {
+            osg::Vec3(-1, 0, 0), osg::Vec3(1, 0, 0),
+            osg::Vec3(0, -1, 0), osg::Vec3(0, 1, 0),
+            osg::Vec3(0, 0, -1), osg::Vec3(0, 0, 1) };
+
+        osg::Vec3Array* verts = new osg::Vec3Array();
+        osg::Vec3Array* norms = new osg::Vec3Array();
+        for (unsigned f = 0; f < 6; ++f)
+        {
+            for (unsigned v = 0; v < 4; ++v)
+            {
+                verts->push_back(box.corner(faces[f][v]));
+                norms->push_back(normals[f]);
+            }
+        }
+
+        osg::Vec4Array* colors = new osg::Vec4Array(osg::Array::BIND_OVERALL);
+        colors->push_back(color);
+
+        osg::DrawElementsUByte* indices = new osg::DrawElementsUByte(GL_TRIANGLES);
+        for (unsigned f = 0; f < 6; ++f)
+        {
+            unsigned i = f * 4;
+            indices->push_back(i); indices->push_back(i + 1); indices->push_back(i + 2);
+            indices->push_back(i); indices->push_back(i + 2); indices->push_back(i + 3);
+        }
+
+        osg::Geometry* geom = new osg::Geometry();
+        geom->setName("LODGenerator proxy");
+        geom->setUseVertexBufferObjects(true);
+        geom->setVertexArray(verts);
+        geom->setNormalArray(norms, osg::Array::BIND_PER_VERTEX);
+        geom->setColorArray(colors);
+        geom->addPrimitiveSet(indices);
+        return geom;
+    }
+
+    template<typename FUNC>
+    struct FindChains : public osg::NodeVisitor
+    {
+        FindChains(const FUNC& func) : osg::NodeVisitor(TRAVERSE_ALL_CHILDREN), _func(func)
+        {
+            setNodeMaskOverride(~0);
+        }
+
+        void apply(osg::LOD& lod)
+        {
+            traverse(lod);
+            if (LODGenerator::isGenerated(&lod))
+                _func(lod);
+        }
+
+        const FUNC& _func;
+    };
+
+    template<typename FUNC>
+    void forEachChain(osg::Node* graph, const FUNC& func)
+    {
+        if (graph)
+        {
+            FindChains<FUNC> visitor(func);
+            graph->accept(visitor);
+        }
+    }
+}
+
+LODGenerator::LODGenerator() :
+    _useProxy(true),
+    _minTriangles(64u)
+{
+    _levels.push_back(Level(1.0f, 15.0f));
+    _levels.push_back(Level(0.4f, 40.0f));
+    _levels.push_back(Level(0.1f, 120.0f));
+}
+
+osg::Node*
+LODGenerator::generate(osg::Node* model) const
+{
+    if (!model || _levels.empty() || isGenerated(model))
+        return model;
+
+    SurveyVisitor survey;
+    model->accept(survey);
+
+    if (survey._triangles < _minTriangles)
+        return model;
+
+    osg::ComputeBoundsVisitor cbv;
+    model->accept(cbv);
+    const osg::BoundingBox& box = cbv.getBoundingBox();
+    if (!box.valid())
+        return model;
+
+    float radius = box.radius();
+
+    osg::LOD* lod = new osg::LOD();
+    lod->setName(GENERATED_LOD_NAME);
+    lod->setCenterMode(osg::LOD::USER_DEFINED_CENTER);
+    lod->setCenter(box.center());
+    lod->setRadius(radius);
+
+    float minRange = 0.0f;
+    for (unsigned i = 0; i < _levels.size(); ++i)
+    {
+        const Level& level = _levels[i];
+        float maxRange = level._range * radius;
+
+        osg::ref_ptr<osg::Node> node;
+        if (level._ratio >= 1.0f)
+        {
+            node = model;
+        }
+        else
+        {
+            // copy the geometry, but share the state
+            node = osg::clone(model,
+                osg::CopyOp::DEEP_COPY_NODES |
+                osg::CopyOp::DEEP_COPY_DRAWABLES |
+                osg::CopyOp::DEEP_COPY_ARRAYS |
+                osg::CopyOp::DEEP_COPY_PRIMITIVES);
+
+            osgUtil::Simplifier simplifier(level._ratio);
+            node->accept(simplifier);
+        }
+
+        lod->addChild(node.get(), minRange, maxRange);
+        minRange = maxRange;
+    }
+
+    if (_useProxy)
+    {
+        osg::Vec4 color = survey._numColors > 0 ? survey._color / (float)survey._numColors : osg::Vec4(1, 1, 1, 1);
+        color.a() = 1.0f;
+        lod->addChild(createProxy(box, color), minRange, FLT_MAX);
+    }
+    else
+    {
+        // let the coarsest level draw to any distance
+        lod->setRange(lod->getNumChildren() - 1, lod->getMinRange(lod->getNumChildren() - 1), FLT_MAX);
+    }
+
+    OE_DEBUG << LC << "Generated " << lod->getNumChildren() << " levels for "
+        << survey._triangles << " triangles, radius " << radius << std::endl;
+
+    return lod;
+}
+
+bool
+LODGenerator::isGenerated(const osg::Node* node)
+{
+    return node && dynamic_cast<const osg::LOD*>(node) && node->getName() == GENERATED_LOD_NAME;
+}
+
+void
+LODGenerator::removeChains(osg::Node* graph)
+{
+    std::vector< osg::ref_ptr<osg::LOD> > chains;
+    forEachChain(graph, [&](osg::LOD& lod) { chains.push_back(&lod); });
+
+    for (auto& lod : chains)
+    {
+        if (lod->getNumChildren() == 0)
+            continue;
+
+        osg::ref_ptr<osg::Node> finest = lod->getChild(0);
+        osg::Node::ParentList parents = lod->getParents();
+        for (auto parent : parents)
+            parent->replaceChild(lod.get(), finest.get());
+    }
+}
+
+void
+LODGenerator::fitChains(osg::Node* graph, const osg::BoundingSphere& bound)
+{
+    if (!bound.valid())
+        return;
+
+    float r = bound.radius();
+
+    forEachChain(graph, [&](osg::LOD& lod)
+    {
+        lod.setCenter(bound.center());
+        lod.setRadius(r);
+        for (unsigned i = 0; i < lod.getNumChildren(); ++i)
+        {
+            float minRange = i == 0 ? 0.0f : lod.getMinRange(i) + r;
+            float maxRange = lod.getMaxRange(i) < FLT_MAX ? lod.getMaxRange(i) + r : FLT_MAX;
+            lod.setRange(i, minRange, maxRange);
+        }
+    });
+}
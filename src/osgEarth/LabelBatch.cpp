@@ -0,0 +1,1163 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2020 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/LabelBatch>
+#include <osgEarth/PlaceNode>
+#include <osgEarth/AnnotationUtils>
+#include <osgEarth/ScreenSpaceLayoutImpl>
+#include <osgEarth/CullingUtils>
+#include <osgEarth/Horizon>
+#include <osgEarth/ImageUtils>
+#include <osgEarth/NodeUtils>
+#include <osgEarth/Registry>
+#include <osgEarth/Capabilities>
+#include <osgEarth/Lighting>
+#include <osgEarth/VirtualProgram>
+#include <osgEarth/ShaderGenerator>
+
+#include <osg/Geometry>
+#include <osg/Texture2D>
+#include <osg/TextureBuffer>
+#include <osg/Depth>
+#include <osgText/Font>
+#include <osgText/Text>
+#include <osgUtil/CullVisitor>
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+#include <map>
+#include <set>
+
+#define LC "[LabelBatch] "
+
+using namespace osgEarth;
+
+namespace
+{
+    // Each quad is four texels in the instance buffer:
+    //   anchor (xyz relative to the batch origin, w = label index)
+    //   pixel rectangle around the anchor (x0, y0, x1, y1)
+    //   atlas rectangle (s0, t0, s1, t1)
+    //   color
+    const char* batchVS_model =
+        "#version " GLSL_VERSION_STR "\n"
+        "#extension GL_EXT_gpu_shader4 : enable \n"
+        "#extension GL_ARB_draw_instanced : enable \n"
+        "uniform samplerBuffer oe_LabelBatch_quads; \n"
+        "uniform samplerBuffer oe_LabelBatch_visibility; \n"
+        "out vec2 oe_LabelBatch_texcoord; \n"
+        "out vec4 oe_LabelBatch_color; \n"
+        "vec2 oe_LabelBatch_corner; \n"
+        "vec4 oe_LabelBatch_rect; \n"
+        "void oe_LabelBatch_VS_model(inout vec4 vertex) \n"
+        "{ \n"
+        "    int i = 4 * gl_InstanceID; \n"
+        "    vec4 anchor = texelFetch(oe_LabelBatch_quads, i); \n"
+        "    vec4 tex = texelFetch(oe_LabelBatch_quads, i+2); \n"
+        "    oe_LabelBatch_rect = texelFetch(oe_LabelBatch_quads, i+1); \n"
+        "    oe_LabelBatch_color = texelFetch(oe_LabelBatch_quads, i+3); \n"
+        "    oe_LabelBatch_color.a *= texelFetch(oe_LabelBatch_visibility, int(anchor.w)).r; \n"
+        "    oe_LabelBatch_corner = vertex.xy; \n"
+        "    oe_LabelBatch_texcoord = mix(tex.xy, tex.zw, vertex.xy); \n"
+        "    vertex = vec4(anchor.xyz, 1.0); \n"
+        "} \n";
+
+    const char* batchVS_clip =
+        "#version " GLSL_VERSION_STR "\n"
+        "uniform vec2 oe_LabelBatch_viewport; \n"
+        "out vec4 oe_LabelBatch_color; \n"
+        "vec2 oe_LabelBatch_corner; \n"
+        "vec4 oe_LabelBatch_rect; \n"
+        "void oe_LabelBatch_VS_clip(inout vec4 vertex) \n"
+        "{ \n"
+        "    // collapse hidden quads outside the clip volume \n"
+        "    if (oe_LabelBatch_color.a <= 0.0) { \n"
+        "        vertex = vec4(2.0, 2.0, 2.0, 1.0); \n"
+        "        return; \n"
+        "    } \n"
+        "    // snap the anchor to a pixel so the glyphs sample the atlas 1:1 \n"
+        "    vec2 anchor = floor((vertex.xy/vertex.w*0.5 + 0.5)*oe_LabelBatch_viewport + 0.5); \n"
+        "    vec2 pixel = anchor + mix(oe_LabelBatch_rect.xy, oe_LabelBatch_rect.zw, oe_LabelBatch_corner); \n"
+        "    vertex.xy = (pixel/oe_LabelBatch_viewport*2.0 - 1.0) * vertex.w; \n"
+        "} \n";
+
+    const char* batchFS =
+        "#version " GLSL_VERSION_STR "\n"
+        "in vec2 oe_LabelBatch_texcoord; \n"
+        "in vec4 oe_LabelBatch_color; \n"
+        "uniform sampler2D oe_LabelBatch_atlas; \n"
+        "void oe_LabelBatch_FS(inout vec4 color) \n"
+        "{ \n"
+        "    color = oe_LabelBatch_color * texture(oe_LabelBatch_atlas, oe_LabelBatch_texcoord); \n"
+        "    if (color.a < 0.004) discard; \n"
+        "} \n";
+
+    const int ATLAS_UNIT = 0;
+    const int QUADS_UNIT = 1;
+    const int VISIBILITY_UNIT = 2;
+
+    // one glyph or icon
+    struct Quad
+    {
+        osg::Vec4f rect;  // pixels, relative to the anchor
+        osg::Vec4f tex;   // atlas pixels
+        osg::Vec4f color;
+    };
+
+    struct Label
+    {
+        GeoPoint                 position;
+        std::string              text;
+        Style                    style;
+        osg::ref_ptr<osg::Image> icon;
+        float                    priority;
+
+        // set by layout():
+        bool              laidOut;
+        bool              valid;
+        osg::Vec3d        world;
+        std::vector<Quad> quads;
+        osg::BoundingBox  box;
+    };
+
+    /**
+     * Shelf-packed RGBA atlas of glyph bitmaps and icon images. Glyphs are
+     * stored white, with their coverage in alpha, so the same shader colors
+     * text and passes icons through. The atlas grows taller as it fills,
+     * so rectangles are kept in pixels and normalized when drawn.
+     */
+    class Atlas
+    {
+    public:
+        Atlas() : _x(0u), _y(0u), _rowHeight(0u), _maxHeight(4096u) { }
+
+        void init()
+        {
+            _image = new osg::Image();
+            _image->allocateImage(1024, 256, 1, GL_RGBA, GL_UNSIGNED_BYTE);
+            ::memset(_image->data(), 0, _image->getTotalSizeInBytes());
+            _image->setDataVariance(osg::Object::DYNAMIC);
+
+            _texture = new osg::Texture2D(_image.get());
+            _texture->setFilter(osg::Texture::MIN_FILTER, osg::Texture::LINEAR);
+            _texture->setFilter(osg::Texture::MAG_FILTER, osg::Texture::LINEAR);
+            _texture->setWrap(osg::Texture::WRAP_S, osg::Texture::CLAMP_TO_EDGE);
+            _texture->setWrap(osg::Texture::WRAP_T, osg::Texture::CLAMP_TO_EDGE);
+            _texture->setResizeNonPowerOfTwoHint(false);
+            _texture->setUnRefImageDataAfterApply(false);
+            _texture->setDataVariance(osg::Object::DYNAMIC);
+
+            int maxSize = Registry::capabilities().getMaxTextureSize();
+            if (maxSize > 0)
+                _maxHeight = osg::minimum(_maxHeight, (unsigned)maxSize);
+        }
+
+        osg::Texture2D* getTexture() const { return _texture.get(); }
+        unsigned width() const { return _image->s(); }
+        unsigned height() const { return _image->t(); }
+
+        //! Finds or loads a glyph. tex is empty (all zero) for a glyph
+        //! with no bitmap, like a space.
+        osgText::Glyph* getGlyph(osgText::Font* font, unsigned res, unsigned code, osg::Vec4f& tex)
+        {
+            GlyphKey key(std::make_pair(font, res), code);
+            GlyphMap::const_iterator i = _glyphs.find(key);
+            if (i != _glyphs.end())
+            {
+                tex = i->second.second;
+                return i->second.first.get();
+            }
+
+            _fonts.insert(font);
+
+            osg::ref_ptr<osgText::Glyph> glyph = font->getGlyph(osgText::FontResolution(res, res), code);
+            tex.set(0, 0, 0, 0);
+
+            unsigned x, y;
+            if (glyph.valid() && glyph->data() && glyph->s() > 0 && glyph->t() > 0 &&
+                allocate(glyph->s(), glyph->t(), x, y))
+            {
+                bool bytes = glyph->getPixelSizeInBits() == 8;
+                bool alpha = glyph->getPixelFormat() == GL_ALPHA;
+                ImageUtils::PixelReader read(glyph.get());
+
+                for (int r = 0; r < glyph->t(); ++r)
+                {
+                    for (int c = 0; c < glyph->s(); ++c)
+                    {
+                        unsigned char coverage;
+                        if (bytes)
+                        {
+                            coverage = *glyph->data(c, r);
+                        }
+                        else
+                        {
+                            osg::Vec4f v = read(c, r);
+                            coverage = (unsigned char)(osg::clampBetween(alpha ? v.a() : v.r(), 0.0f, 1.0f) * 255.0f);
+                        }
+
+                        unsigned char* dst = _image->data(x + c, y + r);
+                        dst[0] = dst[1] = dst[2] = 255;
+                        dst[3] = coverage;
+                    }
+                }
+
+                _image->dirty();
+                tex.set(x, y, x + glyph->s(), y + glyph->t());
+            }
+
+            _glyphs[key] = std::make_pair(glyph, tex);
+            return glyph.get();
+        }
+
+        //! Finds or copies an icon image into the atlas
+        bool getIcon(osg::Image* image, osg::Vec4f& tex)
+        {
+            IconMap::const_iterator i = _icons.find(image);
+            if (i != _icons.end())
+            {
+                tex = i->second.second;
+                return tex.z() > tex.x();
+            }
+
+            tex.set(0, 0, 0, 0);
+
+            unsigned x, y;
+            if (!ImageUtils::PixelReader::supports(image))
+            {
+                OE_WARN << LC << "Icon format not supported: " << image->getFileName() << std::endl;
+            }
+            else if (!allocate(image->s(), image->t(), x, y))
+            {
+                OE_WARN << LC << "Atlas is full; skipping icon " << image->getFileName() << std::endl;
+            }
+            else
+            {
+                bool flip = image->getOrigin() == osg::Image::TOP_LEFT;
+                ImageUtils::PixelReader read(image);
+
+                for (int r = 0; r < image->t(); ++r)
+                {
+                    for (int c = 0; c < image->s(); ++c)
+                    {
+                        osg::Vec4f v = read(c, flip ? image->t() - 1 - r : r);
+                        unsigned char* dst = _image->data(x + c, y + r);
+                        for (unsigned k = 0; k < 4; ++k)
+                            dst[k] = (unsigned char)(osg::clampBetween(v[k], 0.0f, 1.0f) * 255.0f);
+                    }
+                }
+
+                _image->dirty();
+                tex.set(x, y, x + image->s(), y + image->t());
+            }
+
+            _icons[image] = std::make_pair(osg::ref_ptr<osg::Image>(image), tex);
+            return tex.z() > tex.x();
+        }
+
+    private:
+        typedef std::pair<std::pair<const osgText::Font*, unsigned>, unsigned> GlyphKey;
+        typedef std::map<GlyphKey, std::pair<osg::ref_ptr<osgText::Glyph>, osg::Vec4f> > GlyphMap;
+        typedef std::map<const osg::Image*, std::pair<osg::ref_ptr<osg::Image>, osg::Vec4f> > IconMap;
+
+        osg::ref_ptr<osg::Image> _image;
+        osg::ref_ptr<osg::Texture2D> _texture;
+        GlyphMap _glyphs;
+        IconMap _icons;
+        std::set<osg::ref_ptr<osgText::Font> > _fonts; // keeps the glyph keys valid
+        unsigned _x, _y, _rowHeight, _maxHeight;
+
+        // reserves a w x h rectangle, with a pixel of padding so that
+        // neighbors don't bleed into each other
+        bool allocate(unsigned w, unsigned h, unsigned& x, unsigned& y)
+        {
+            const unsigned pad = 1u;
+
+            if (w + pad > width())
+                return false;
+
+            if (_x + w + pad > width())
+            {
+                _y += _rowHeight;
+                _x = 0u;
+                _rowHeight = 0u;
+            }
+
+            while (_y + h + pad > height())
+            {
+                if (!grow())
+                    return false;
+            }
+
+            x = _x;
+            y = _y;
+            _x += w + pad;
+            _rowHeight = osg::maximum(_rowHeight, h + pad);
+            return true;
+        }
+
+        // doubles the height; rows count from the bottom, so the old
+        // contents keep their pixel coordinates
+        bool grow()
+        {
+            unsigned t = height() * 2u;
+            if (t > _maxHeight)
+                return false;
+
+            osg::ref_ptr<osg::Image> image = new osg::Image();
+            image->allocateImage(width(), t, 1, GL_RGBA, GL_UNSIGNED_BYTE);
+            ::memset(image->data(), 0, image->getTotalSizeInBytes());
+            ::memcpy(image->data(), _image->data(), _image->getTotalSizeInBytes());
+            image->setDataVariance(osg::Object::DYNAMIC);
+
+            _image = image.get();
+            _texture->setImage(_image.get());
+            return true;
+        }
+    };
+
+    // Declutter state for one camera
+    struct PerCamera
+    {
+        PerCamera() : _lastTime(0), _revision(~0u) { }
+
+        osg::ref_ptr<osg::StateSet>      _stateSet;
+        osg::ref_ptr<osg::Image>         _visibility;
+        osg::ref_ptr<osg::TextureBuffer> _tbo;
+        osg::ref_ptr<osg::Uniform>       _viewport;
+        std::vector<unsigned>            _ids;   // label ID of each visibility slot
+        std::vector<float>               _alpha;
+        std::vector<char>                _visible;
+        std::vector<std::pair<float, unsigned> > _order;
+        Internal::ScreenSpaceGrid        _grid;
+        osg::Timer_t                     _lastTime;
+        unsigned                         _revision;
+    };
+
+    // the icon offset that anchors an icon of size (s, t) per its alignment
+    osg::Vec2f getIconOffset(const IconSymbol* icon, float s, float t)
+    {
+        if (!icon || !icon->alignment().isSet())
+            return osg::Vec2f(0.0f, t / 2.0f);
+
+        switch (icon->alignment().get())
+        {
+        case IconSymbol::ALIGN_LEFT_TOP:      return osg::Vec2f(s / 2.0f, -t / 2.0f);
+        case IconSymbol::ALIGN_LEFT_CENTER:   return osg::Vec2f(s / 2.0f, 0.0f);
+        case IconSymbol::ALIGN_LEFT_BOTTOM:   return osg::Vec2f(s / 2.0f, t / 2.0f);
+        case IconSymbol::ALIGN_CENTER_TOP:    return osg::Vec2f(0.0f, -t / 2.0f);
+        case IconSymbol::ALIGN_CENTER_CENTER: return osg::Vec2f(0.0f, 0.0f);
+        case IconSymbol::ALIGN_RIGHT_TOP:     return osg::Vec2f(-s / 2.0f, -t / 2.0f);
+        case IconSymbol::ALIGN_RIGHT_CENTER:  return osg::Vec2f(-s / 2.0f, 0.0f);
+        case IconSymbol::ALIGN_RIGHT_BOTTOM:  return osg::Vec2f(-s / 2.0f, t / 2.0f);
+        case IconSymbol::ALIGN_CENTER_BOTTOM:
+        default:                              return osg::Vec2f(0.0f, t / 2.0f);
+        }
+    }
+
+    // the text position relative to an icon box, as in TextSymbolizer
+    osg::Vec2f getTextPosition(int align, const osg::BoundingBox& box)
+    {
+        switch (align)
+        {
+        case TextSymbol::ALIGN_LEFT_TOP:                return osg::Vec2f(box.xMax(), box.yMin());
+        case TextSymbol::ALIGN_LEFT_CENTER:             return osg::Vec2f(box.xMax(), box.center().y());
+        case TextSymbol::ALIGN_LEFT_BOTTOM:
+        case TextSymbol::ALIGN_LEFT_BOTTOM_BASE_LINE:
+        case TextSymbol::ALIGN_LEFT_BASE_LINE:          return osg::Vec2f(box.xMax(), box.yMax());
+        case TextSymbol::ALIGN_RIGHT_TOP:               return osg::Vec2f(box.xMin(), box.yMin());
+        case TextSymbol::ALIGN_RIGHT_CENTER:            return osg::Vec2f(box.xMin(), box.center().y());
+        case TextSymbol::ALIGN_RIGHT_BOTTOM:
+        case TextSymbol::ALIGN_RIGHT_BOTTOM_BASE_LINE:
+        case TextSymbol::ALIGN_RIGHT_BASE_LINE:         return osg::Vec2f(box.xMin(), box.yMax());
+        case TextSymbol::ALIGN_CENTER_TOP:              return osg::Vec2f(box.center().x(), box.yMin());
+        case TextSymbol::ALIGN_CENTER_BOTTOM:
+        case TextSymbol::ALIGN_CENTER_BOTTOM_BASE_LINE:
+        case TextSymbol::ALIGN_CENTER_BASE_LINE:        return osg::Vec2f(box.center().x(), box.yMax());
+        case TextSymbol::ALIGN_CENTER_CENTER:
+        default:                                        return osg::Vec2f(box.center().x(), box.center().y());
+        }
+    }
+
+    // pixel offsets of the halo copies of each glyph
+    void getHaloOffsets(const TextSymbol* ts, float h, std::vector<osg::Vec2f>& offsets)
+    {
+        osgText::Text::BackdropType type = ts->haloBackdropType().isSet() ?
+            ts->haloBackdropType().get() : osgText::Text::OUTLINE;
+
+        switch (type)
+        {
+        case osgText::Text::DROP_SHADOW_BOTTOM_RIGHT:  offsets.push_back(osg::Vec2f( h, -h)); break;
+        case osgText::Text::DROP_SHADOW_CENTER_RIGHT:  offsets.push_back(osg::Vec2f( h,  0)); break;
+        case osgText::Text::DROP_SHADOW_TOP_RIGHT:     offsets.push_back(osg::Vec2f( h,  h)); break;
+        case osgText::Text::DROP_SHADOW_BOTTOM_CENTER: offsets.push_back(osg::Vec2f( 0, -h)); break;
+        case osgText::Text::DROP_SHADOW_TOP_CENTER:    offsets.push_back(osg::Vec2f( 0,  h)); break;
+        case osgText::Text::DROP_SHADOW_BOTTOM_LEFT:   offsets.push_back(osg::Vec2f(-h, -h)); break;
+        case osgText::Text::DROP_SHADOW_CENTER_LEFT:   offsets.push_back(osg::Vec2f(-h,  0)); break;
+        case osgText::Text::DROP_SHADOW_TOP_LEFT:      offsets.push_back(osg::Vec2f(-h,  h)); break;
+        case osgText::Text::OUTLINE:
+            for (int dy = -1; dy <= 1; ++dy)
+                for (int dx = -1; dx <= 1; ++dx)
+                    if (dx != 0 || dy != 0)
+                        offsets.push_back(osg::Vec2f(dx*h, dy*h));
+            break;
+        default:
+            break;
+        }
+    }
+
+    // orders (distance, label index) pairs for decluttering
+    struct SortCandidates
+    {
+        const std::vector<float>& _priorities;
+        bool _byPriority, _byDistance;
+
+        SortCandidates(const std::vector<float>& priorities, bool byPriority, bool byDistance) :
+            _priorities(priorities), _byPriority(byPriority), _byDistance(byDistance) { }
+
+        bool operator()(const std::pair<float, unsigned>& lhs, const std::pair<float, unsigned>& rhs) const
+        {
+            if (_byPriority && _priorities[lhs.second] != _priorities[rhs.second])
+                return _priorities[lhs.second] > _priorities[rhs.second];
+            if (_byDistance && lhs.first != rhs.first)
+                return lhs.first < rhs.first;
+            return lhs.second < rhs.second;
+        }
+    };
+
+    inline void shift(osg::Vec4f& rect, float dx, float dy)
+    {
+        rect[0] += dx; rect[1] += dy; rect[2] += dx; rect[3] += dy;
+    }
+}
+
+//........................................................................
+
+struct LabelBatch::Data
+{
+    Data() : nextID(0u), declutter(true), dirty(false), revision(0u) { }
+
+    mutable Threading::Mutex mutex;
+    std::map<unsigned, Label> labels;
+    unsigned nextID;
+    bool declutter;
+    bool dirty;
+    osg::ref_ptr<const osgDB::Options> readOptions;
+    std::map<std::string, osg::ref_ptr<osgText::Font> > fonts;
+
+    Atlas                            atlas;
+    osg::ref_ptr<osg::Geometry>      geom;
+    osg::ref_ptr<osg::DrawArrays>    draw;
+    osg::ref_ptr<osg::Image>         quads;
+    osg::ref_ptr<osg::TextureBuffer> quadsTBO;
+
+    // one entry per drawn label, for the cull traversal; rebuilt in the
+    // update traversal
+    std::vector<unsigned>         ids;
+    std::vector<osg::Vec3f>       anchors; // relative to the batch origin
+    std::vector<osg::Vec3d>       worlds;
+    std::vector<osg::BoundingBox> boxes;
+    std::vector<float>            priorities;
+    unsigned                      revision;
+
+    PerObjectFastMap<osg::Camera*, PerCamera> perCamera;
+
+    osgText::Font* getFont(const TextSymbol* ts)
+    {
+        if (ts && ts->font().isSet())
+        {
+            std::map<std::string, osg::ref_ptr<osgText::Font> >::iterator i = fonts.find(ts->font().get());
+            if (i == fonts.end())
+                i = fonts.insert(std::make_pair(ts->font().get(), osgText::readRefFontFile(ts->font().get()))).first;
+            if (i->second.valid())
+                return i->second.get();
+        }
+        return Registry::instance()->getDefaultFont();
+    }
+
+    void layout(Label& label);
+    void rebuild(LabelBatch* batch);
+    void cull(osgUtil::CullVisitor* cv, PerCamera& pc);
+};
+
+void
+LabelBatch::Data::layout(Label& label)
+{
+    label.laidOut = true;
+    label.quads.clear();
+    label.box.init();
+    label.valid = label.position.isValid() && label.position.toWorld(label.world);
+    if (!label.valid)
+        return;
+
+    const float dpr = Registry::instance()->getDevicePixelRatio();
+    const TextSymbol* ts = label.style.get<TextSymbol>();
+    osg::ref_ptr<const InstanceSymbol> instance = label.style.get<InstanceSymbol>();
+    const IconSymbol* icon = instance.valid() ? instance->asIcon() : 0L;
+
+    // icon:
+    osg::ref_ptr<osg::Image> image = label.icon.get();
+    if (!image.valid() && icon)
+    {
+        if (icon->url().isSet())
+            image = icon->url()->evalURI().getImage(readOptions.get());
+        else if (icon->getImage())
+            image = icon->getImage();
+    }
+
+    osg::BoundingBox imageBox(0, 0, 0, 0, 0, 0);
+    bool hasIcon = false;
+    Quad iconQuad;
+
+    if (image.valid() && atlas.getIcon(image.get(), iconQuad.tex))
+    {
+        float scale = icon && icon->scale().isSet() ? (float)icon->scale()->eval() : 1.0f;
+        float s = dpr * scale * image->s();
+        float t = dpr * scale * image->t();
+        osg::Vec2f offset = getIconOffset(icon, s, t);
+
+        iconQuad.rect.set(offset.x() - s/2.0f, offset.y() - t/2.0f, offset.x() + s/2.0f, offset.y() + t/2.0f);
+        iconQuad.color.set(1.0f, 1.0f, 1.0f, 1.0f);
+        imageBox.set(iconQuad.rect[0], iconQuad.rect[1], 0.0f, iconQuad.rect[2], iconQuad.rect[3], 0.0f);
+        hasIcon = true;
+    }
+
+    // text:
+    std::string text = label.text;
+    if (text.empty() && ts && ts->content().isSet())
+        text = ts->content()->eval();
+
+    std::vector<Quad> glyphs;
+    unsigned numLines = 1u;
+
+    if (!text.empty())
+    {
+        int align = ts ? ts->alignment().get() : TextSymbol::ALIGN_BASE_LINE;
+        if (hasIcon && !(ts && ts->alignment().isSet()))
+            align = TextSymbol::ALIGN_LEFT_CENTER;
+
+        osgText::String::Encoding encoding = ts && ts->encoding().isSet() ?
+            AnnotationUtils::convertTextSymbolEncoding(ts->encoding().get()) :
+            osgText::String::ENCODING_UNDEFINED;
+        osgText::String str(text, encoding);
+
+        osgText::Font* font = getFont(ts);
+        float size = (ts && ts->size().isSet() ? (float)ts->size()->eval() : 16.0f) * dpr;
+        unsigned res = osg::maximum(1u, (unsigned)(size + 0.5f));
+        float bitmapScale = size / (float)res;
+
+        osg::Vec4f fill = ts && ts->fill().isSet() ? osg::Vec4f(ts->fill()->color()) : osg::Vec4f(1, 1, 1, 1);
+
+        // glyphs along each baseline, lines starting at x=0; glyph metrics
+        // are in units of the character size
+        std::vector<unsigned> lineStart(1, 0u);
+        std::vector<float> lineWidth(1, 0.0f);
+        float penX = 0.0f;
+
+        for (osgText::String::const_iterator c = str.begin(); c != str.end(); ++c)
+        {
+            if (*c == '\n')
+            {
+                lineStart.push_back(glyphs.size());
+                lineWidth.push_back(0.0f);
+                penX = 0.0f;
+                continue;
+            }
+
+            Quad q;
+            osgText::Glyph* glyph = font ? atlas.getGlyph(font, res, *c, q.tex) : 0L;
+            if (!glyph)
+                continue;
+
+            if (q.tex.z() > q.tex.x())
+            {
+                osg::Vec2f bearing = glyph->getHorizontalBearing() * size;
+                float baseline = -(float)(lineStart.size() - 1u) * size;
+                q.rect.set(
+                    penX + bearing.x(),
+                    baseline + bearing.y(),
+                    penX + bearing.x() + bitmapScale * glyph->s(),
+                    baseline + bearing.y() + bitmapScale * glyph->t());
+                q.color = fill;
+                glyphs.push_back(q);
+            }
+
+            penX += glyph->getHorizontalAdvance() * size;
+            lineWidth.back() = penX;
+        }
+
+        numLines = lineStart.size();
+        lineStart.push_back(glyphs.size());
+
+        // justify each line horizontally:
+        bool left =
+            align == TextSymbol::ALIGN_LEFT_TOP || align == TextSymbol::ALIGN_LEFT_CENTER ||
+            align == TextSymbol::ALIGN_LEFT_BOTTOM || align == TextSymbol::ALIGN_LEFT_BASE_LINE ||
+            align == TextSymbol::ALIGN_LEFT_BOTTOM_BASE_LINE;
+        bool right =
+            align == TextSymbol::ALIGN_RIGHT_TOP || align == TextSymbol::ALIGN_RIGHT_CENTER ||
+            align == TextSymbol::ALIGN_RIGHT_BOTTOM || align == TextSymbol::ALIGN_RIGHT_BASE_LINE ||
+            align == TextSymbol::ALIGN_RIGHT_BOTTOM_BASE_LINE;
+
+        osg::BoundingBox ink;
+        for (unsigned line = 0; line < numLines; ++line)
+        {
+            float dx = left ? 0.0f : right ? -lineWidth[line] : -lineWidth[line] / 2.0f;
+            for (unsigned g = lineStart[line]; g < lineStart[line + 1]; ++g)
+            {
+                shift(glyphs[g].rect, dx, 0.0f);
+                ink.expandBy(glyphs[g].rect[0], glyphs[g].rect[1], 0.0f);
+                ink.expandBy(glyphs[g].rect[2], glyphs[g].rect[3], 0.0f);
+            }
+        }
+
+        // then place the block vertically:
+        osg::Vec2f pos = getTextPosition(align, imageBox);
+        float dy = pos.y();
+        if (ink.valid())
+        {
+            switch (align)
+            {
+            case TextSymbol::ALIGN_LEFT_TOP:
+            case TextSymbol::ALIGN_CENTER_TOP:
+            case TextSymbol::ALIGN_RIGHT_TOP:
+                dy = pos.y() - ink.yMax(); break;
+            case TextSymbol::ALIGN_LEFT_CENTER:
+            case TextSymbol::ALIGN_CENTER_CENTER:
+            case TextSymbol::ALIGN_RIGHT_CENTER:
+                dy = pos.y() - ink.center().y(); break;
+            case TextSymbol::ALIGN_LEFT_BOTTOM:
+            case TextSymbol::ALIGN_CENTER_BOTTOM:
+            case TextSymbol::ALIGN_RIGHT_BOTTOM:
+                dy = pos.y() - ink.yMin(); break;
+            case TextSymbol::ALIGN_LEFT_BOTTOM_BASE_LINE:
+            case TextSymbol::ALIGN_CENTER_BOTTOM_BASE_LINE:
+            case TextSymbol::ALIGN_RIGHT_BOTTOM_BASE_LINE:
+                dy = pos.y() + (float)(numLines - 1u) * size; break;
+            default:
+                break;
+            }
+        }
+
+        for (std::vector<Quad>::iterator g = glyphs.begin(); g != glyphs.end(); ++g)
+            shift(g->rect, pos.x(), dy);
+
+        // halo copies go first so the fill draws over them:
+        if (ts && ts->halo().isSet())
+        {
+            std::vector<osg::Vec2f> offsets;
+            getHaloOffsets(ts, osg::maximum(1.0f, floor(0.07f * size + 0.5f)), offsets);
+
+            osg::Vec4f haloColor(ts->halo()->color());
+            for (std::vector<osg::Vec2f>::const_iterator o = offsets.begin(); o != offsets.end(); ++o)
+            {
+                for (std::vector<Quad>::const_iterator g = glyphs.begin(); g != glyphs.end(); ++g)
+                {
+                    Quad q = *g;
+                    shift(q.rect, o->x(), o->y());
+                    q.color = haloColor;
+                    label.quads.push_back(q);
+                }
+            }
+        }
+    }
+
+    // the icon goes under the text:
+    if (hasIcon)
+        label.quads.insert(label.quads.begin(), iconQuad);
+
+    label.quads.insert(label.quads.end(), glyphs.begin(), glyphs.end());
+
+    osg::Vec2f pixelOffset;
+    if (ts && ts->pixelOffset().isSet())
+        pixelOffset.set(ts->pixelOffset()->x(), ts->pixelOffset()->y());
+
+    for (std::vector<Quad>::iterator q = label.quads.begin(); q != label.quads.end(); ++q)
+    {
+        shift(q->rect, pixelOffset.x(), pixelOffset.y());
+        label.box.expandBy(q->rect[0], q->rect[1], 0.0f);
+        label.box.expandBy(q->rect[2], q->rect[3], 0.0f);
+    }
+}
+
+void
+LabelBatch::Data::rebuild(LabelBatch* batch)
+{
+    Threading::ScopedMutexLock lock(mutex);
+    dirty = false;
+
+    ids.clear();
+    anchors.clear();
+    worlds.clear();
+    boxes.clear();
+    priorities.clear();
+
+    unsigned numQuads = 0u;
+    for (std::map<unsigned, Label>::iterator i = labels.begin(); i != labels.end(); ++i)
+    {
+        Label& label = i->second;
+        if (!label.laidOut)
+            layout(label);
+        if (label.valid && !label.quads.empty())
+            numQuads += label.quads.size();
+    }
+
+    unsigned maxQuads = (unsigned)osg::maximum(Registry::capabilities().getMaxTextureBufferSize(), 0) / 4u;
+    if (maxQuads > 0u && numQuads > maxQuads)
+    {
+        OE_WARN << LC << numQuads << " quads exceed the " << maxQuads << " a texture buffer can hold; skipping the rest" << std::endl;
+        numQuads = maxQuads;
+    }
+
+    if (numQuads > 0u && (!quads.valid() || (unsigned)quads->s() != numQuads * 4u))
+    {
+        quads = new osg::Image();
+        quads->allocateImage(numQuads * 4u, 1, 1, GL_RGBA, GL_FLOAT);
+        quads->setDataVariance(osg::Object::DYNAMIC);
+        quadsTBO->setImage(quads.get());
+    }
+
+    osg::Vec3d origin;
+    osg::BoundingBox bounds;
+    float atlasWidth = (float)atlas.width(), atlasHeight = (float)atlas.height();
+    osg::Vec4f* ptr = numQuads > 0u ? reinterpret_cast<osg::Vec4f*>(quads->data()) : 0L;
+    unsigned written = 0u;
+
+    for (std::map<unsigned, Label>::const_iterator i = labels.begin(); i != labels.end() && written < numQuads; ++i)
+    {
+        const Label& label = i->second;
+        if (!label.valid || label.quads.empty())
+            continue;
+
+        // keep coordinates small, relative to the first label
+        if (ids.empty())
+            origin = label.world;
+
+        unsigned index = ids.size();
+        ids.push_back(i->first);
+        anchors.push_back(label.world - origin);
+        worlds.push_back(label.world);
+        boxes.push_back(label.box);
+        priorities.push_back(label.priority);
+        bounds.expandBy(anchors.back());
+
+        for (std::vector<Quad>::const_iterator q = label.quads.begin(); q != label.quads.end() && written < numQuads; ++q, ++written)
+        {
+            (*ptr++).set(anchors.back().x(), anchors.back().y(), anchors.back().z(), (float)index);
+            *ptr++ = q->rect;
+            (*ptr++).set(q->tex[0] / atlasWidth, q->tex[1] / atlasHeight, q->tex[2] / atlasWidth, q->tex[3] / atlasHeight);
+            *ptr++ = q->color;
+        }
+    }
+
+    if (numQuads > 0u)
+        quads->dirty();
+
+    draw->setNumInstances(numQuads);
+    geom->setNodeMask(numQuads > 0u ? ~0u : 0u);
+    geom->setInitialBound(bounds);
+    geom->dirtyBound();
+
+    batch->setMatrix(osg::Matrix::translate(origin));
+
+    ++revision;
+}
+
+void
+LabelBatch::Data::cull(osgUtil::CullVisitor* cv, PerCamera& pc)
+{
+    const osg::Viewport* vp = cv->getViewport();
+    if (!vp)
+        return;
+
+    unsigned n = ids.size();
+
+    if (!pc._stateSet.valid())
+    {
+        pc._visibility = new osg::Image();
+        pc._visibility->setDataVariance(osg::Object::DYNAMIC);
+
+        pc._tbo = new osg::TextureBuffer();
+        pc._tbo->setInternalFormat(GL_R32F);
+        pc._tbo->setUnRefImageDataAfterApply(false);
+        pc._tbo->setDataVariance(osg::Object::DYNAMIC);
+
+        pc._viewport = new osg::Uniform("oe_LabelBatch_viewport", osg::Vec2f());
+
+        pc._stateSet = new osg::StateSet();
+        pc._stateSet->setDataVariance(osg::Object::DYNAMIC);
+        pc._stateSet->setTextureAttribute(VISIBILITY_UNIT, pc._tbo.get());
+        pc._stateSet->addUniform(pc._viewport.get());
+    }
+
+    // labels changed, so carry each one's fade state to its new slot
+    if (pc._revision != revision)
+    {
+        std::map<unsigned, float> previous;
+        for (unsigned i = 0; i < pc._ids.size(); ++i)
+            previous[pc._ids[i]] = pc._alpha[i];
+
+        pc._ids = ids;
+        pc._alpha.assign(n, 0.0f);
+        for (unsigned i = 0; i < n; ++i)
+        {
+            std::map<unsigned, float>::const_iterator p = previous.find(ids[i]);
+            if (p != previous.end())
+                pc._alpha[i] = p->second;
+        }
+
+        pc._visibility->allocateImage(osg::maximum(n, 1u), 1, 1, GL_RED, GL_FLOAT);
+        ::memset(pc._visibility->data(), 0, pc._visibility->getTotalSizeInBytes());
+        for (unsigned i = 0; i < n; ++i)
+            reinterpret_cast<float*>(pc._visibility->data())[i] = pc._alpha[i];
+        pc._tbo->setImage(pc._visibility.get());
+
+        pc._revision = revision;
+    }
+
+    pc._viewport->set(osg::Vec2f(vp->width(), vp->height()));
+
+    const ScreenSpaceLayoutOptions& options = ScreenSpaceLayout::getOptions();
+    bool declutter = this->declutter && ScreenSpaceLayout::globallyEnabled;
+
+    osg::Matrix mvp = (*cv->getModelViewMatrix()) * (*cv->getProjectionMatrix());
+    osg::ref_ptr<Horizon> horizon = Horizon::get(*cv);
+
+    // find the labels on screen, in front of the horizon:
+    pc._visible.assign(n, 0);
+    pc._order.clear();
+
+    std::vector<osg::Vec2f> window(n);
+    for (unsigned i = 0; i < n; ++i)
+    {
+        osg::Vec4d clip = osg::Vec4d(osg::Vec3d(anchors[i]), 1.0) * mvp;
+        if (clip.w() <= 0.0)
+            continue;
+
+        osg::Vec3d ndc(clip.x() / clip.w(), clip.y() / clip.w(), clip.z() / clip.w());
+        if (ndc.x() < -1.0 || ndc.x() > 1.0 || ndc.y() < -1.0 || ndc.y() > 1.0 || ndc.z() > 1.0)
+            continue;
+
+        if (horizon.valid() && !horizon->isVisible(worlds[i]))
+            continue;
+
+        // the same pixel snapping as the shader:
+        window[i].set(
+            floor((ndc.x()*0.5 + 0.5) * vp->width() + 0.5),
+            floor((ndc.y()*0.5 + 0.5) * vp->height() + 0.5));
+
+        pc._order.push_back(std::make_pair((float)clip.w(), i));
+    }
+
+    if (declutter)
+    {
+        // highest priority first, then closest first, per the layout options:
+        std::sort(pc._order.begin(), pc._order.end(), SortCandidates(
+            priorities, options.sortByPriority() == true, options.sortByDistance() == true));
+
+        pc._grid.reset(0.0f, 0.0f, vp->width(), vp->height());
+    }
+
+    unsigned limit = declutter ? options.maxObjects().get() : ~0u;
+    unsigned count = 0u;
+
+    for (unsigned k = 0; k < pc._order.size() && count < limit; ++k)
+    {
+        unsigned i = pc._order[k].second;
+
+        if (declutter)
+        {
+            osg::BoundingBox box = boxes[i];
+            box.xMin() += window[i].x(); box.xMax() += window[i].x();
+            box.yMin() += window[i].y(); box.yMax() += window[i].y();
+
+            if (priorities[i] != FLT_MAX && pc._grid.overlaps(box, &boxes[i]))
+                continue;
+
+            pc._grid.insert(&boxes[i], box);
+        }
+
+        pc._visible[i] = 1;
+        ++count;
+    }
+
+    // fade toward the new visibility:
+    osg::Timer_t now = osg::Timer::instance()->tick();
+    float dt = pc._lastTime != 0 ? (float)osg::Timer::instance()->delta_s(pc._lastTime, now) : 0.0f;
+    pc._lastTime = now;
+
+    float inTime = options.inAnimationTime().get();
+    float outTime = options.outAnimationTime().get();
+
+    float* out = reinterpret_cast<float*>(pc._visibility->data());
+    bool changed = false;
+
+    for (unsigned i = 0; i < n; ++i)
+    {
+        float alpha = pc._alpha[i];
+        if (pc._visible[i])
+            alpha = inTime > 0.0f ? osg::minimum(1.0f, alpha + dt / inTime) : 1.0f;
+        else
+            alpha = outTime > 0.0f ? osg::maximum(0.0f, alpha - dt / outTime) : 0.0f;
+
+        if (alpha != pc._alpha[i])
+        {
+            pc._alpha[i] = out[i] = alpha;
+            changed = true;
+        }
+    }
+
+    if (changed)
+        pc._visibility->dirty();
+}
+
+//........................................................................
+
+LabelBatch::LabelBatch() :
+osg::MatrixTransform(),
+_data(new Data())
+{
+    // This class makes its own shaders
+    ShaderGenerator::setIgnoreHint(this, true);
+
+    _data->atlas.init();
+
+    _data->quadsTBO = new osg::TextureBuffer();
+    _data->quadsTBO->setInternalFormat(GL_RGBA32F_ARB);
+    _data->quadsTBO->setUnRefImageDataAfterApply(false);
+    _data->quadsTBO->setDataVariance(osg::Object::DYNAMIC);
+
+    // one unit quad, drawn once per glyph or icon
+    osg::Vec3Array* corners = new osg::Vec3Array();
+    corners->push_back(osg::Vec3(0, 0, 0));
+    corners->push_back(osg::Vec3(1, 0, 0));
+    corners->push_back(osg::Vec3(0, 1, 0));
+    corners->push_back(osg::Vec3(1, 1, 0));
+
+    _data->draw = new osg::DrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+    _data->geom = new osg::Geometry();
+    _data->geom->setName("LabelBatch");
+    _data->geom->setUseVertexBufferObjects(true);
+    _data->geom->setUseDisplayList(false);
+    _data->geom->setVertexArray(corners);
+    _data->geom->addPrimitiveSet(_data->draw.get());
+    _data->geom->setDataVariance(osg::Object::DYNAMIC);
+    _data->geom->setCullingActive(false);
+    _data->geom->setNodeMask(0u);
+
+    osg::StateSet* ss = _data->geom->getOrCreateStateSet();
+    ss->setTextureAttribute(ATLAS_UNIT, _data->atlas.getTexture());
+    ss->setTextureAttribute(QUADS_UNIT, _data->quadsTBO.get());
+    ss->addUniform(new osg::Uniform("oe_LabelBatch_atlas", ATLAS_UNIT));
+    ss->getOrCreateUniform("oe_LabelBatch_quads", osg::Uniform::SAMPLER_BUFFER)->set(QUADS_UNIT);
+    ss->getOrCreateUniform("oe_LabelBatch_visibility", osg::Uniform::SAMPLER_BUFFER)->set(VISIBILITY_UNIT);
+
+    // draw in the same order as the other labels, over the scene
+    ss->setRenderBinDetails(ScreenSpaceLayout::getOptions().renderOrder().get(), "DepthSortedBin");
+    ss->setAttributeAndModes(new osg::Depth(osg::Depth::ALWAYS, 0, 1, false), 1);
+    ss->setMode(GL_BLEND, 1);
+    ss->setMode(GL_CULL_FACE, 0);
+    ss->setDefine(OE_LIGHTING_DEFINE, osg::StateAttribute::OFF | osg::StateAttribute::PROTECTED);
+    ss->setDefine("OE_DISABLE_DEFAULT_SHADER");
+
+    VirtualProgram* vp = VirtualProgram::getOrCreate(ss);
+    vp->setName("LabelBatch");
+    vp->setFunction("oe_LabelBatch_VS_model", batchVS_model, ShaderComp::LOCATION_VERTEX_MODEL);
+    vp->setFunction("oe_LabelBatch_VS_clip", batchVS_clip, ShaderComp::LOCATION_VERTEX_CLIP);
+    vp->setFunction("oe_LabelBatch_FS", batchFS, ShaderComp::LOCATION_FRAGMENT_COLORING);
+
+    addChild(_data->geom.get());
+
+    // rebuilds happen in the update traversal
+    ADJUST_UPDATE_TRAV_COUNT(this, +1);
+}
+
+LabelBatch::~LabelBatch()
+{
+    delete _data;
+}
+
+unsigned
+LabelBatch::add(const GeoPoint& position, const std::string& text, const Style& style, osg::Image* icon, float priority)
+{
+    Threading::ScopedMutexLock lock(_data->mutex);
+
+    unsigned id = _data->nextID++;
+    Label& label = _data->labels[id];
+    label.position = position;
+    label.text = text;
+    label.style = style;
+    label.icon = icon;
+    label.priority = priority;
+    label.laidOut = false;
+    label.valid = false;
+
+    _data->dirty = true;
+    return id;
+}
+
+unsigned
+LabelBatch::add(const GeoPositionNode* node)
+{
+    if (!node)
+        return ~0u;
+
+    const PlaceNode* place = dynamic_cast<const PlaceNode*>(node);
+
+    return add(
+        node->getPosition(),
+        node->getText(),
+        node->getStyle(),
+        place ? place->getIconImage() : 0L,
+        node->getPriority());
+}
+
+void
+LabelBatch::setPosition(unsigned id, const GeoPoint& position)
+{
+    Threading::ScopedMutexLock lock(_data->mutex);
+    std::map<unsigned, Label>::iterator i = _data->labels.find(id);
+    if (i == _data->labels.end())
+        return;
+
+    Label& label = i->second;
+    label.position = position;
+
+    // the glyphs stay put relative to the anchor, so only a label that
+    // never had a valid position needs a new layout
+    if (label.laidOut)
+    {
+        if (label.valid)
+            label.valid = position.isValid() && position.toWorld(label.world);
+        else
+            label.laidOut = false;
+    }
+
+    _data->dirty = true;
+}
+
+void
+LabelBatch::remove(unsigned id)
+{
+    Threading::ScopedMutexLock lock(_data->mutex);
+    if (_data->labels.erase(id) > 0)
+        _data->dirty = true;
+}
+
+void
+LabelBatch::clear()
+{
+    Threading::ScopedMutexLock lock(_data->mutex);
+    _data->labels.clear();
+    _data->dirty = true;
+}
+
+unsigned
+LabelBatch::size() const
+{
+    Threading::ScopedMutexLock lock(_data->mutex);
+    return _data->labels.size();
+}
+
+void
+LabelBatch::setDeclutter(bool value)
+{
+    _data->declutter = value;
+}
+
+bool
+LabelBatch::getDeclutter() const
+{
+    return _data->declutter;
+}
+
+void
+LabelBatch::setReadOptions(const osgDB::Options* value)
+{
+    Threading::ScopedMutexLock lock(_data->mutex);
+    _data->readOptions = value;
+}
+
+void
+LabelBatch::traverse(osg::NodeVisitor& nv)
+{
+    if (nv.getVisitorType() == nv.UPDATE_VISITOR)
+    {
+        if (_data->dirty)
+            _data->rebuild(this);
+    }
+
+    else if (nv.getVisitorType() == nv.CULL_VISITOR)
+    {
+        osgUtil::CullVisitor* cv = Culling::asCullVisitor(nv);
+        if (cv && !_data->ids.empty())
+        {
+            PerCamera& pc = _data->perCamera.get(cv->getCurrentCamera());
+            _data->cull(cv, pc);
+
+            cv->pushStateSet(pc._stateSet.get());
+            osg::MatrixTransform::traverse(nv);
+            cv->popStateSet();
+        }
+        return;
+    }
+
+    osg::MatrixTransform::traverse(nv);
+}
+
+namespace
+{
+    struct ResizePerCamera : public PerObjectFastMap<osg::Camera*, PerCamera>::Functor
+    {
+        unsigned _size;
+        ResizePerCamera(unsigned size) : _size(size) { }
+        void operator()(PerCamera& pc) {
+            if (pc._stateSet.valid()) pc._stateSet->resizeGLObjectBuffers(_size);
+        }
+    };
+
+    struct ReleasePerCamera : public PerObjectFastMap<osg::Camera*, PerCamera>::ConstFunctor
+    {
+        osg::State* _state;
+        ReleasePerCamera(osg::State* state) : _state(state) { }
+        void operator()(const PerCamera& pc) const {
+            if (pc._stateSet.valid()) pc._stateSet->releaseGLObjects(_state);
+        }
+    };
+}
+
+void
+LabelBatch::resizeGLObjectBuffers(unsigned maxSize)
+{
+    osg::MatrixTransform::resizeGLObjectBuffers(maxSize);
+    ResizePerCamera f(maxSize);
+    _data->perCamera.forEach(f);
+}
+
+void
+LabelBatch::releaseGLObjects(osg::State* state) const
+{
+    osg::MatrixTransform::releaseGLObjects(state);
+    ReleasePerCamera f(state);
+    _data->perCamera.forEach(f);
+}
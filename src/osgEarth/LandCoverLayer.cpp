@@ -30,6 +30,77 @@ using namespace osgEarth::Util;
 
 REGISTER_OSGEARTH_LAYER(landcover, LandCoverLayer);
 
+namespace
+{
+    // Maps one raw coverage value to a dictionary code through the code LUT.
+    // Values under 1.0 are normalized codes (e.g., data coming from a server
+    // might be encoded this way); anything else is the code itself.
+    inline float transcode(float value, const std::vector<float>& lut)
+    {
+        if (value == NO_DATA_VALUE)
+            return NO_DATA_VALUE;
+
+        int code =
+            value < 1.0f ? (int)(value*255.0f) :
+            value < (float)lut.size() ? (int)value :
+            -1;
+
+        return code >= 0 && code < (int)lut.size() ? lut[code] : NO_DATA_VALUE;
+    }
+
+    // Nearest-neighbor reader for a coverage tile, which may be an ancestor
+    // tile mapped onto the output through a scale/bias. The source column of
+    // every output column is computed once so that each output row is a
+    // gather from a single source row. Float coverage tiles are read straight
+    // from memory; other formats go through a PixelReader.
+    class CoverageSampler
+    {
+    public:
+        CoverageSampler(const osg::Image* image, const osg::Matrixd& scaleBias, int width) :
+            _image(image),
+            _read(image),
+            _direct(LandCover::isLandCover(image))
+        {
+            _scale = scaleBias(0,0);
+            _tbias = scaleBias(3,1)*image->t();
+            double sbias = scaleBias(3,0)*image->s();
+
+            _cols.resize(width);
+            for(int s=0; s<width; ++s)
+                _cols[s] = osg::clampBetween((int)(s*_scale+sbias), 0, image->s()-1);
+        }
+
+        //! Reads the resampled values of row t of the output into "out"
+        void readRow(float* out, int t) const
+        {
+            int row = osg::clampBetween((int)(t*_scale+_tbias), 0, _image->t()-1);
+
+            if (_direct)
+            {
+                const float* in = (const float*)_image->data(0, row);
+                for(unsigned s=0; s<_cols.size(); ++s)
+                    out[s] = in[_cols[s]];
+            }
+            else
+            {
+                osg::Vec4 value;
+                for(unsigned s=0; s<_cols.size(); ++s)
+                {
+                    _read(value, _cols[s], row);
+                    out[s] = value.r();
+                }
+            }
+        }
+
+    private:
+        const osg::Image* _image;
+        ImageUtils::PixelReader _read;
+        bool _direct;
+        double _scale, _tbias;
+        std::vector<int> _cols;
+    };
+}
+
 //........................................................................
 
 #undef  LC
@@ -289,60 +360,57 @@ LandCoverLayer::createImageImplementation(const TileKey& key, ProgressCallback*
 
         osg::ref_ptr<osg::Image> output = LandCover::createImage(getTileSize());
 
-        ImageUtils::PixelReader read(img.getImage());
-        ImageUtils::PixelWriter write(output.get());
+        const osg::Image* input = img.getImage();
+
+        bool sameSize =
+            input->s() == output->s() &&
+            input->t() == output->t();
+
+        bool isByte =
+            sameSize &&
+            _byteLUT.size() == 256u &&
+            input->getDataType() == GL_UNSIGNED_BYTE &&
+            (input->getPixelFormat() == GL_RED || input->getPixelFormat() == GL_LUMINANCE);
 
+        bool isFloat =
+            sameSize &&
+            LandCover::isLandCover(input);
+
+        ImageUtils::PixelReader read(input);
         osg::Vec4 pixel;
-        bool wrotePixel;
         unsigned pixelsWritten = 0u;
 
-        // Transcode the layer-specific codes into the dictionary codes:
+        // Transcode the layer-specific codes into the dictionary codes,
+        // a row at a time. 8-bit and float sources index the LUTs directly.
         for (int t = 0; t < output->t(); ++t)
         {
-            for (int s = 0; s < output->s(); ++s)
-            {
-                read(pixel, s, t);
-
-                wrotePixel = false;
+            float* out = (float*)output->data(0, t);
 
-                if (pixel.r() != NO_DATA_VALUE)
+            if (isByte)
+            {
+                const GLubyte* in = input->data(0, t);
+                for (int s = 0; s < output->s(); ++s)
+                    out[s] = _byteLUT[in[s]];
+            }
+            else if (isFloat)
+            {
+                const float* in = (const float*)input->data(0, t);
+                for (int s = 0; s < output->s(); ++s)
+                    out[s] = transcode(in[s], _codeLUT);
+            }
+            else
+            {
+                for (int s = 0; s < output->s(); ++s)
                 {
-                    if (pixel.r() < 1.0f)
-                    {
-                        // normalized code; convert to unnormalized.
-                        // e.g., data coming from a server might be encoded this way
-                        int code = (int)(pixel.r()*255.0f);
-                        if (code < _codemap.size())
-                        {
-                            int value = _codemap[code];
-                            if (value >= 0)
-                            {
-                                pixel.r() = (float)value;
-                                write(pixel, s, t);
-                                wrotePixel = true;
-                                pixelsWritten++;
-                            }
-                        }
-                    }
-                    else
-                    {
-                        // unnormalized
-                        int code = (int)pixel.r();
-                        if (code < _codemap.size() && _codemap[code] >= 0)
-                        {
-                            pixel.r() = (float)_codemap[code];
-                            write(pixel, s, t);
-                            wrotePixel = true;
-                            pixelsWritten++;
-                        }
-                    }
+                    read(pixel, s, t);
+                    out[s] = transcode(pixel.r(), _codeLUT);
                 }
+            }
 
-                if (!wrotePixel)
-                {
-                    pixel.r() = NO_DATA_VALUE;
-                    write(pixel, s, t);
-                }
+            for (int s = 0; s < output->s(); ++s)
+            {
+                if (out[s] != NO_DATA_VALUE)
+                    ++pixelsWritten;
             }
         }
 
@@ -595,6 +663,26 @@ LandCoverLayer::buildCodeMap(CodeMap& codemap)
             codemap[value] = lcClass->getValue();
         }
     }
+
+    _codeLUT.resize(codemap.size());
+    for (unsigned i = 0; i < codemap.size(); ++i)
+        _codeLUT[i] = codemap[i] >= 0 ? (float)codemap[i] : NO_DATA_VALUE;
+
+    // Run every 8-bit value through the same reader the general path uses,
+    // so the byte LUT matches it exactly.
+    osg::ref_ptr<osg::Image> bytes = new osg::Image();
+    bytes->allocateImage(256, 1, 1, GL_RED, GL_UNSIGNED_BYTE);
+    for (unsigned i = 0; i < 256; ++i)
+        bytes->data()[i] = (GLubyte)i;
+
+    ImageUtils::PixelReader readBytes(bytes.get());
+    osg::Vec4 pixel;
+    _byteLUT.resize(256);
+    for (unsigned i = 0; i < 256; ++i)
+    {
+        readBytes(pixel, i, 0);
+        _byteLUT[i] = transcode(pixel.r(), _codeLUT);
+    }
 }
 
 //........................................................................
@@ -638,7 +726,7 @@ LandCoverLayerVector::populateLandCoverImage(
     bool fallback = false;          // whether to fall back on parent tiles for a component
     bool needsClone = false;        // whether to clone the output image
 
-    osg::Vec4 value;
+    std::vector<float> row;
     unsigned numValues = 0u;
     unsigned numNoDataValues = 1u;
 
@@ -678,25 +766,19 @@ LandCoverLayerVector::populateLandCoverImage(
         if (!comp.valid())
             continue;  
         
-        ImageUtils::PixelReader readInput(comp.getImage());
-
-        // scale and bias to read an ancestor (fallback) tile if necessary.
-        double 
-            scale = compScaleBias(0,0), 
-            sbias = compScaleBias(3,0)*readInput.s(),
-            tbias = compScaleBias(3,1)*readInput.t();
-
         // If this is the first image, scan the image for NO_DATA values.
         if (!output.valid())
         {
+            CoverageSampler readInput(comp.getImage(), compScaleBias, comp.getImage()->s());
             numNoDataValues = 0u;
+            row.resize(comp.getImage()->s());
 
-            for(int t=0; t<readInput.t() && numNoDataValues == 0u; ++t)
+            for(int t=0; t<comp.getImage()->t() && numNoDataValues == 0u; ++t)
             {
-                for(int s=0; s<readInput.s() && numNoDataValues == 0u; ++s)
+                readInput.readRow(&row[0], t);
+                for(unsigned s=0; s<row.size() && numNoDataValues == 0u; ++s)
                 {
-                    readInput(value, (int)(s*scale+sbias), (int)(t*scale+tbias));
-                    if (value.r() == NO_DATA_VALUE)
+                    if (row[s] == NO_DATA_VALUE)
                     {
                         numNoDataValues++;
                     }
@@ -710,35 +792,57 @@ LandCoverLayerVector::populateLandCoverImage(
             continue;
         }
 
-        // The second image to arrive requires that we clone the data
-        // since we are going to modify it.
+        // The second image to arrive requires that we copy the data
+        // since we are going to modify it. Copy it into a float coverage
+        // image so the compositing below can work on raw rows.
         if (needsClone)
         {
-            output = osg::clone(output.get(), osg::CopyOp::DEEP_COPY_ALL);
+            if (LandCover::isLandCover(output.get()))
+            {
+                output = osg::clone(output.get(), osg::CopyOp::DEEP_COPY_ALL);
+            }
+            else
+            {
+                CoverageSampler readOutput(output.get(), osg::Matrixd::identity(), output->s());
+                osg::ref_ptr<osg::Image> copy = LandCover::createImage(output->s(), output->t());
+                for(int t=0; t<copy->t(); ++t)
+                    readOutput.readRow((float*)copy->data(0, t), t);
+                output = copy.get();
+            }
             needsClone = false;
         }
 
         // now composite this image under the previous one, 
         // accumulating a count of NO_DATA values along the way.
-        ImageUtils::PixelReader readOutput(output.get());
-        ImageUtils::PixelWriter writeOutput(output.get());
-
         numNoDataValues = 0u;
 
-        for(int t=0; t<readOutput.t(); ++t)
+        CoverageSampler readComp(comp.getImage(), compScaleBias, output->s());
+        row.resize(output->s());
+
+        for(int t=0; t<output->t(); ++t)
         {
-            for(int s=0; s<readOutput.s(); ++s)
+            float* out = (float*)output->data(0, t);
+
+            unsigned rowNoData = 0u;
+            for(int s=0; s<output->s(); ++s)
             {
-                readOutput(value, s, t);
+                if (out[s] == NO_DATA_VALUE)
+                    ++rowNoData;
+            }
 
-                if (value.r() == NO_DATA_VALUE)
-                {
-                    readInput(value, (int)(s*scale+sbias), (int)(t*scale+tbias));
+            if (rowNoData == 0u)
+                continue;
+
+            readComp.readRow(&row[0], t);
 
-                    if (value.r() == NO_DATA_VALUE)
+            for(int s=0; s<output->s(); ++s)
+            {
+                if (out[s] == NO_DATA_VALUE)
+                {
+                    if (row[s] == NO_DATA_VALUE)
                         numNoDataValues++;
                     else
-                        writeOutput(value, s, t);
+                        out[s] = row[s];
                 }
             }
         }
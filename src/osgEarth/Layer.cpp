@@ -44,6 +44,7 @@ Layer::Options::getConfig() const
     conf.set("attribution", attribution());
     conf.set("terrain", terrainPatch());
     conf.set("proxy", _proxySettings );
+    conf.set("http_limits", _httpLimits );
 
     for(std::vector<ShaderOptions>::const_iterator i = shaders().begin();
         i != shaders().end();
@@ -86,6 +87,7 @@ Layer::Options::fromConfig(const Config& conf)
     conf.get("terrain", terrainPatch());
     conf.get("patch", terrainPatch());
     conf.get("proxy", _proxySettings );
+    conf.get("http_limits", _httpLimits );
 }
 
 //.................................................................
@@ -145,6 +147,12 @@ Layer::setReadOptions(const osgDB::Options* readOptions)
     {
         options().proxySettings()->apply(_readOptions.get());
     }
+
+    //Store the per-host request limits as well.
+    if (options().httpLimits().isSet())
+    {
+        options().httpLimits()->apply(_readOptions.get());
+    }
 }
 
 const osgDB::Options*
@@ -259,6 +267,8 @@ Layer::init()
     _renderType = RENDERTYPE_NONE;
     _status.set(Status::ResourceUnavailable, getEnabled() ? "Layer closed" : "Layer disabled");
     _isClosing = false;
+    _openDeferred = false;
+    _openingOnDemand = false;
 
     // For detecting scene graph changes at runtime
     _sceneGraphCallbacks = new SceneGraphCallbacks(this);
@@ -300,6 +310,9 @@ Layer::open()
 
     setStatus(openImplementation());
 
+    // clear this last, so openOnDemand() callers never see a half-open layer
+    _openDeferred = false;
+
     if (isOpen())
     {
         fireCallback(&LayerCallback::onOpen);
@@ -308,6 +321,35 @@ Layer::open()
     return getStatus();
 }
 
+void
+Layer::deferOpen()
+{
+    if (!isOpen() && getEnabled())
+    {
+        _openDeferred = true;
+        _status.set(Status::ResourceUnavailable, "Layer opens on demand");
+    }
+}
+
+bool
+Layer::openOnDemand()
+{
+    if (_openDeferred)
+    {
+        // recursive, since openImplementation() may call setVisible();
+        // past the lock, _openingOnDemand means we're re-entering
+        Threading::ScopedRecursiveMutexLock lock(_openOnDemandMutex);
+        if (_openDeferred && !_openingOnDemand)
+        {
+            OE_INFO << LC << "Opening on demand" << std::endl;
+            _openingOnDemand = true;
+            open();
+            _openingOnDemand = false;
+        }
+    }
+    return isOpen();
+}
+
 const Status&
 Layer::open(const osgDB::Options* readOptions)
 {
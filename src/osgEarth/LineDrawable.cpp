@@ -23,13 +23,19 @@
 #include <osgEarth/LineFunctor>
 #include <osgEarth/GLUtils>
 #include <osgEarth/CullingUtils>
+#include <osgEarth/NodeUtils>
 
+#include <osg/GLExtensions>
 #include <osg/LineStipple>
 #include <osg/LineWidth>
 #include <osgUtil/Optimizer>
 
 #include <osgDB/ObjectWrapper>
 
+#include <algorithm>
+#include <cstring>
+#include <map>
+
 
 #if defined(OSG_GLES1_AVAILABLE) || defined(OSG_GLES2_AVAILABLE) || defined(OSG_GLES3_AVAILABLE)
 #define OE_GLES_AVAILABLE
@@ -48,6 +54,14 @@ using namespace osgEarth;
 // Comment this out to test the non-GLSL path
 //#define USE_GPU
 
+// pre OSG-3.6 support
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+
+// SSBO binding of the per-line styles in a batched LineGroup (see batchVS)
+#define LINE_STYLE_BUFFER_BINDING 3
+
 namespace osgEarth { namespace Serializers { namespace LineGroup
 {
     REGISTER_OBJECT_WRAPPER(
@@ -56,24 +70,647 @@ namespace osgEarth { namespace Serializers { namespace LineGroup
         osgEarth::LineGroup,
         "osg::Object osg::Node osg::Group osg::Geode osgEarth::LineGroup")
     {
-        // no properties
+        ADD_BOOL_SERIALIZER( Batched, false );
     }
 } } }
 
-LineGroup::LineGroup()
+namespace
+{
+    // Fetches the style of the line that a batched vertex belongs to.
+    const char* batchVS =
+        "#version 430\n"
+        "in float oe_LineDrawable_line; \n"
+        "struct oe_LineDrawable_Style { float width; int pattern; int factor; int reserved; }; \n"
+        "layout(binding=3, std430) readonly buffer oe_LineDrawable_Styles { \n"
+        "    oe_LineDrawable_Style oe_LineDrawable_styles[]; \n"
+        "}; \n"
+        "float oe_LineDrawable_width; \n"
+        "flat out ivec2 oe_LineDrawable_stipple; \n"
+        "void oe_LineDrawable_batch_VS(inout vec4 vertex) \n"
+        "{ \n"
+        "    oe_LineDrawable_Style style = oe_LineDrawable_styles[int(oe_LineDrawable_line)]; \n"
+        "    oe_LineDrawable_width = style.width; \n"
+        "    oe_LineDrawable_stipple = ivec2(style.pattern, style.factor); \n"
+        "} \n";
+
+    // Same layout as the GL structure
+    struct DrawElementsIndirectCommand
+    {
+        GLuint count;
+        GLuint instanceCount;
+        GLuint firstIndex;
+        GLint  baseVertex;
+        GLuint baseInstance;
+    };
+
+    // Same layout as oe_LineDrawable_Style in batchVS
+    struct LineStyle
+    {
+        GLfloat width;
+        GLint   pattern;
+        GLint   factor;
+        GLint   reserved;
+    };
+
+    // One LineDrawable's place in the shared buffers of a batch.
+    // Capacities leave room for a line to grow without moving the others.
+    struct Slot
+    {
+        osg::ref_ptr<LineDrawable> line;
+        osg::ref_ptr<const osg::PrimitiveSet> primset;
+        unsigned vertexOffset, vertexCapacity, numVerts;
+        unsigned indexOffset, numIndices;
+        unsigned modifiedCounts[4];
+        unsigned revision;
+
+        unsigned indexCapacity() const { return vertexCapacity * 3u / 2u; }
+    };
+
+    // Shared buffers of a batched LineGroup, and the draw callback that
+    // renders all of them with one glMultiDrawElementsIndirect.
+    struct Batch : public osg::Drawable::DrawCallback
+    {
+        std::vector<Slot> slots;
+        std::vector<LineStyle> styles;
+        std::vector<DrawElementsIndirectCommand> commands;
+
+        osg::ref_ptr<osg::Vec3Array> current;
+        osg::ref_ptr<osg::Vec3Array> previous;
+        osg::ref_ptr<osg::Vec3Array> next;
+        osg::ref_ptr<osg::Vec4Array> colors;
+        osg::ref_ptr<osg::FloatArray> lineIndices;
+        osg::ref_ptr<osg::DrawElementsUInt> elements;
+
+        // bumps when lines move in the buffers (OSG re-uploads everything)
+        unsigned layout;
+        // bumps when lines change in place (we re-upload those lines)
+        unsigned revision;
+
+        struct GL
+        {
+            GL() : capacity(0u), layout(~0u), revision(0u), _glBufferStorage(NULL), _glMultiDrawElementsIndirect(NULL) { }
+            osg::ref_ptr<GLBuffer> styles;
+            osg::ref_ptr<GLBuffer> commands;
+            unsigned capacity;
+            unsigned layout;
+            unsigned revision;
+
+            // pre-OSG 3.6 support
+            void (GL_APIENTRY * _glBufferStorage)(GLenum, GLuint, const void*, GLenum);
+            void (GL_APIENTRY * _glMultiDrawElementsIndirect)(GLenum, GLenum, const void*, GLsizei, GLsizei);
+        };
+        mutable osg::buffered_object<GL> _gl;
+
+        Batch() : layout(0u), revision(0u)
+        {
+            current = new osg::Vec3Array(osg::Array::BIND_PER_VERTEX);
+            colors = new osg::Vec4Array(osg::Array::BIND_PER_VERTEX);
+            previous = new osg::Vec3Array(osg::Array::BIND_PER_VERTEX);
+            previous->setNormalize(false);
+            next = new osg::Vec3Array(osg::Array::BIND_PER_VERTEX);
+            next->setNormalize(false);
+            lineIndices = new osg::FloatArray(osg::Array::BIND_PER_VERTEX);
+            lineIndices->setNormalize(false);
+            elements = new osg::DrawElementsUInt(GL_TRIANGLES);
+        }
+
+        void allocate(GL& gl, osg::State& state) const
+        {
+            osg::GLExtensions* ext = state.get<osg::GLExtensions>();
+
+            if (!gl._glBufferStorage)
+            {
+                osg::setGLExtensionFuncPtr(gl._glBufferStorage, "glBufferStorage", "glBufferStorageARB");
+                osg::setGLExtensionFuncPtr(gl._glMultiDrawElementsIndirect, "glMultiDrawElementsIndirect", "glMultiDrawElementsIndirectARB");
+            }
+
+            // leave room to grow; the old buffers go away with their releasers
+            gl.capacity = slots.size() + slots.size()/2u;
+
+            gl.styles = new GLBuffer();
+            ext->glGenBuffers(1, &gl.styles->_handle);
+            ext->glBindBuffer(GL_SHADER_STORAGE_BUFFER, gl.styles->_handle);
+            gl._glBufferStorage(GL_SHADER_STORAGE_BUFFER, gl.capacity * sizeof(LineStyle), NULL, GL_DYNAMIC_STORAGE_BIT);
+            state.getGraphicsContext()->add(new GLBufferReleaser(gl.styles.get()));
+
+            gl.commands = new GLBuffer();
+            ext->glGenBuffers(1, &gl.commands->_handle);
+            ext->glBindBuffer(GL_DRAW_INDIRECT_BUFFER, gl.commands->_handle);
+            gl._glBufferStorage(GL_DRAW_INDIRECT_BUFFER, gl.capacity * sizeof(DrawElementsIndirectCommand), NULL, GL_DYNAMIC_STORAGE_BIT);
+            state.getGraphicsContext()->add(new GLBufferReleaser(gl.commands.get()));
+        }
+
+        // Copies part of an array to its buffer object, unless the buffer
+        // object is due for a complete upload anyway.
+        void subload(osg::State& state, const osg::Array* array, unsigned first, unsigned count) const
+        {
+            osg::GLBufferObject* bo = array->getOrCreateGLBufferObject(state.getContextID());
+            if (bo && !bo->isDirty() && count > 0u)
+            {
+                unsigned size = array->getElementSize();
+                state.bindVertexBufferObject(bo);
+                state.get<osg::GLExtensions>()->glBufferSubData(
+                    GL_ARRAY_BUFFER_ARB,
+                    bo->getOffset(array->getBufferIndex()) + first*size,
+                    count*size,
+                    static_cast<const char*>(array->getDataPointer()) + first*size);
+            }
+        }
+
+        void subload(osg::State& state, const osg::DrawElementsUInt* de, unsigned first, unsigned count) const
+        {
+            osg::GLBufferObject* bo = de->getOrCreateGLBufferObject(state.getContextID());
+            if (bo && !bo->isDirty() && count > 0u)
+            {
+                state.bindElementBufferObject(bo);
+                state.get<osg::GLExtensions>()->glBufferSubData(
+                    GL_ELEMENT_ARRAY_BUFFER_ARB,
+                    bo->getOffset(de->getBufferIndex()) + first*sizeof(GLuint),
+                    count*sizeof(GLuint),
+                    &(*de)[first]);
+            }
+        }
+
+        void drawImplementation(osg::RenderInfo& ri, const osg::Drawable* drawable) const
+        {
+            if (slots.empty())
+                return;
+
+            osg::State& state = *ri.getState();
+            osg::GLExtensions* ext = state.get<osg::GLExtensions>();
+            GL& gl = _gl[state.getContextID()];
+
+            if (gl.layout != layout)
+            {
+                if (gl.capacity < slots.size())
+                    allocate(gl, state);
+
+                ext->glBindBuffer(GL_SHADER_STORAGE_BUFFER, gl.styles->_handle);
+                ext->glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, styles.size()*sizeof(LineStyle), &styles[0]);
+
+                ext->glBindBuffer(GL_DRAW_INDIRECT_BUFFER, gl.commands->_handle);
+                ext->glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, commands.size()*sizeof(DrawElementsIndirectCommand), &commands[0]);
+
+                gl.layout = layout;
+                gl.revision = revision;
+            }
+
+            else if (gl.revision != revision)
+            {
+                for (unsigned i = 0; i < slots.size(); ++i)
+                {
+                    const Slot& slot = slots[i];
+                    if (slot.revision > gl.revision)
+                    {
+                        subload(state, current.get(), slot.vertexOffset, slot.numVerts);
+                        subload(state, previous.get(), slot.vertexOffset, slot.numVerts);
+                        subload(state, next.get(), slot.vertexOffset, slot.numVerts);
+                        subload(state, colors.get(), slot.vertexOffset, slot.numVerts);
+                        subload(state, elements.get(), slot.indexOffset, slot.numIndices);
+
+                        ext->glBindBuffer(GL_SHADER_STORAGE_BUFFER, gl.styles->_handle);
+                        ext->glBufferSubData(GL_SHADER_STORAGE_BUFFER, i*sizeof(LineStyle), sizeof(LineStyle), &styles[i]);
+
+                        ext->glBindBuffer(GL_DRAW_INDIRECT_BUFFER, gl.commands->_handle);
+                        ext->glBufferSubData(GL_DRAW_INDIRECT_BUFFER, i*sizeof(DrawElementsIndirectCommand), sizeof(DrawElementsIndirectCommand), &commands[i]);
+                    }
+                }
+                gl.revision = revision;
+            }
+
+            if (!gl._glMultiDrawElementsIndirect)
+                return;
+
+            drawable->asGeometry()->drawVertexArraysImplementation(ri);
+
+            state.bindElementBufferObject(elements->getOrCreateGLBufferObject(state.getContextID()));
+
+            ext->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, LINE_STYLE_BUFFER_BINDING, gl.styles->_handle);
+
+            ext->glBindBuffer(GL_DRAW_INDIRECT_BUFFER, gl.commands->_handle);
+
+            gl._glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, NULL, (GLsizei)commands.size(), 0);
+
+            // be a good citizen
+            ext->glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        }
+
+        void resizeGLObjectBuffers(unsigned maxSize)
+        {
+            _gl.resize(maxSize);
+        }
+
+        void releaseGLObjects(osg::State* state) const
+        {
+            if (state)
+                _gl[state->getContextID()] = GL();
+            else
+                for (unsigned i = 0; i < _gl.size(); ++i)
+                    _gl[i] = GL();
+        }
+    };
+
+    // The batch's bound is that of its lines, not of the slack space.
+    struct BatchBound : public osg::Drawable::ComputeBoundingBoxCallback
+    {
+        osg::ref_ptr<Batch> _batch;
+
+        BatchBound(Batch* batch) : _batch(batch) { }
+
+        osg::BoundingBox computeBound(const osg::Drawable&) const
+        {
+            osg::BoundingBox box;
+            for (std::vector<Slot>::const_iterator i = _batch->slots.begin(); i != _batch->slots.end(); ++i)
+                box.expandBy(i->line->getBoundingBox());
+            return box;
+        }
+    };
+
+    inline unsigned align4(unsigned value)
+    {
+        return (value + 3u) & ~3u;
+    }
+}
+
+struct LineGroup::Data
+{
+    Data() : batched(false) { }
+
+    bool batched;
+    osg::ref_ptr<Batch> batch;
+    osg::ref_ptr<osg::Geometry> geom;
+    osg::ref_ptr<osg::StateSet> gpuStateSet;
+    std::vector<LineDrawable*> lines;
+
+    static bool isBatchable(const osg::Node* node);
+    void build();
+    void sync(LineGroup* group);
+    void layout();
+    void copy(unsigned i);
+    bool changed(unsigned i) const;
+    void makeStyle(const LineDrawable* line, LineStyle& style) const;
+    void makeCommand(const Slot& slot, DrawElementsIndirectCommand& command) const;
+};
+
+bool
+LineGroup::Data::isBatchable(const osg::Node* node)
+{
+    const LineDrawable* line = dynamic_cast<const LineDrawable*>(node);
+    return
+        line &&
+        line->_useGPU &&
+        line->_current && line->_previous && line->_next && line->_colors &&
+        line->_gpuStateSet.valid();
+}
+
+void
+LineGroup::Data::build()
+{
+    batch = new Batch();
+
+    geom = new osg::Geometry();
+    geom->setName("osgEarth::LineGroup batch");
+    geom->setUseVertexBufferObjects(true);
+    geom->setUseDisplayList(false);
+    geom->setDataVariance(osg::Object::DYNAMIC);
+    geom->setVertexArray(batch->current.get());
+    geom->setColorArray(batch->colors.get());
+    geom->setVertexAttribArray(LineDrawable::PreviousVertexAttrLocation, batch->previous.get());
+    geom->setVertexAttribArray(LineDrawable::NextVertexAttrLocation, batch->next.get());
+    geom->setVertexAttribArray(LineDrawable::LineIndexVertexAttrLocation, batch->lineIndices.get());
+    geom->addPrimitiveSet(batch->elements.get());
+    geom->setDrawCallback(batch.get());
+    geom->setComputeBoundingBoxCallback(new BatchBound(batch.get()));
+
+    osg::StateSet* ss = geom->getOrCreateStateSet();
+    ss->setDefine("OE_LINE_BATCH");
+
+    VirtualProgram* vp = VirtualProgram::getOrCreate(ss);
+    vp->setName("osgEarth::LineGroup");
+    vp->setFunction("oe_LineDrawable_batch_VS", batchVS, ShaderComp::LOCATION_VERTEX_MODEL);
+    vp->addBindAttribLocation("oe_LineDrawable_line", LineDrawable::LineIndexVertexAttrLocation);
+}
+
+void
+LineGroup::Data::makeStyle(const LineDrawable* line, LineStyle& style) const
+{
+    style.width = line->_width;
+    style.pattern = line->_pattern;
+    style.factor = line->_factor;
+    style.reserved = 0;
+}
+
+void
+LineGroup::Data::makeCommand(const Slot& slot, DrawElementsIndirectCommand& command) const
+{
+    const LineDrawable* line = slot.line.get();
+
+    // first and count select whole segments, six indices apiece,
+    // the same ones the oe_LineDrawable_limits uniform would.
+    unsigned first = 0u, end = slot.numIndices;
+    if (line->_first > 0u || line->_count > 0u)
+    {
+        unsigned numSegments = slot.numIndices / 6u;
+        unsigned firstSegment = 0u, endSegment = numSegments;
+
+        if (line->_mode == GL_LINE_STRIP)
+        {
+            firstSegment = line->_first;
+            if (line->_count > 0u)
+                endSegment = line->_first + line->_count - 1u;
+        }
+        else if (line->_mode == GL_LINES)
+        {
+            firstSegment = (line->_first + 1u) / 2u;
+            if (line->_count > 0u)
+                endSegment = (line->_first + line->_count) / 2u;
+        }
+
+        first = 6u * std::min(firstSegment, numSegments);
+        end = 6u * std::min(endSegment, numSegments);
+    }
+
+    command.count = end > first ? end - first : 0u;
+    command.instanceCount = command.count > 0u && line->getNodeMask() != 0u ? 1u : 0u;
+    command.firstIndex = slot.indexOffset + first;
+    command.baseVertex = slot.vertexOffset;
+    command.baseInstance = 0u;
+}
+
+bool
+LineGroup::Data::changed(unsigned i) const
+{
+    const Slot& slot = batch->slots[i];
+    const LineDrawable* line = slot.line.get();
+
+    const osg::PrimitiveSet* primset = line->getNumPrimitiveSets() > 0u ? line->getPrimitiveSet(0) : 0L;
+    if (line->_current->size() != slot.numVerts ||
+        primset != slot.primset.get() ||
+        (primset && primset->getNumIndices() != slot.numIndices) ||
+        line->_current->getModifiedCount() != slot.modifiedCounts[0] ||
+        line->_previous->getModifiedCount() != slot.modifiedCounts[1] ||
+        line->_next->getModifiedCount() != slot.modifiedCounts[2] ||
+        line->_colors->getModifiedCount() != slot.modifiedCounts[3])
+    {
+        return true;
+    }
+
+    LineStyle style;
+    makeStyle(line, style);
+    if (::memcmp(&style, &batch->styles[i], sizeof(LineStyle)) != 0)
+        return true;
+
+    DrawElementsIndirectCommand command;
+    makeCommand(slot, command);
+    return ::memcmp(&command, &batch->commands[i], sizeof(DrawElementsIndirectCommand)) != 0;
+}
+
+void
+LineGroup::Data::copy(unsigned i)
+{
+    Slot& slot = batch->slots[i];
+    const LineDrawable* line = slot.line.get();
+
+    slot.numVerts = line->_current->size();
+    std::copy(line->_current->begin(), line->_current->end(), batch->current->begin() + slot.vertexOffset);
+    std::copy(line->_previous->begin(), line->_previous->end(), batch->previous->begin() + slot.vertexOffset);
+    std::copy(line->_next->begin(), line->_next->end(), batch->next->begin() + slot.vertexOffset);
+    std::copy(
+        line->_colors->begin(),
+        line->_colors->begin() + std::min((unsigned)line->_colors->size(), slot.numVerts),
+        batch->colors->begin() + slot.vertexOffset);
+
+    slot.primset = line->getNumPrimitiveSets() > 0u ? line->getPrimitiveSet(0) : 0L;
+    const osg::DrawElements* de = slot.primset.valid() ? slot.primset->getDrawElements() : 0L;
+    slot.numIndices = de ? de->getNumIndices() : 0u;
+    for (unsigned e = 0; e < slot.numIndices; ++e)
+        (*batch->elements)[slot.indexOffset + e] = de->index(e);
+
+    slot.modifiedCounts[0] = line->_current->getModifiedCount();
+    slot.modifiedCounts[1] = line->_previous->getModifiedCount();
+    slot.modifiedCounts[2] = line->_next->getModifiedCount();
+    slot.modifiedCounts[3] = line->_colors->getModifiedCount();
+
+    makeStyle(line, batch->styles[i]);
+    makeCommand(slot, batch->commands[i]);
+}
+
+void
+LineGroup::Data::layout()
+{
+    std::vector<Slot>& slots = batch->slots;
+
+    unsigned numVerts = 0u, numIndices = 0u;
+    for (std::vector<Slot>::iterator slot = slots.begin(); slot != slots.end(); ++slot)
+    {
+        slot->vertexOffset = numVerts;
+        slot->indexOffset = numIndices;
+        numVerts += slot->vertexCapacity;
+        numIndices += slot->indexCapacity();
+    }
+
+    batch->current->resize(numVerts);
+    batch->previous->resize(numVerts);
+    batch->next->resize(numVerts);
+    batch->colors->resize(numVerts);
+    batch->lineIndices->resize(numVerts);
+    batch->elements->resize(numIndices);
+    batch->styles.resize(slots.size());
+    batch->commands.resize(slots.size());
+
+    for (unsigned i = 0; i < slots.size(); ++i)
+    {
+        copy(i);
+        std::fill(
+            batch->lineIndices->begin() + slots[i].vertexOffset,
+            batch->lineIndices->begin() + slots[i].vertexOffset + slots[i].vertexCapacity,
+            (float)i);
+    }
+
+    batch->current->dirty();
+    batch->previous->dirty();
+    batch->next->dirty();
+    batch->colors->dirty();
+    batch->lineIndices->dirty();
+    batch->elements->dirty();
+    ++batch->layout;
+
+    geom->dirtyBound();
+}
+
+void
+LineGroup::Data::sync(LineGroup* group)
+{
+    if (!geom.valid())
+        build();
+
+    lines.clear();
+    for (unsigned i = 0; i < group->getNumChildren(); ++i)
+    {
+        if (isBatchable(group->getChild(i)))
+            lines.push_back(static_cast<LineDrawable*>(group->getChild(i)));
+    }
+
+    std::vector<Slot>& slots = batch->slots;
+
+    bool relayout = lines.size() != slots.size();
+
+    for (unsigned i = 0; i < slots.size() && !relayout; ++i)
+    {
+        relayout = slots[i].line.get() != lines[i];
+    }
+
+    // a line that outgrew its space doubles it, so a growing line
+    // only moves the others now and then:
+    for (unsigned i = 0; i < slots.size() && i < lines.size(); ++i)
+    {
+        const LineDrawable* line = slots[i].line.get();
+        unsigned numIndices = line->getNumPrimitiveSets() > 0u ? line->getPrimitiveSet(0)->getNumIndices() : 0u;
+        if (line->_current->size() > slots[i].vertexCapacity || numIndices > slots[i].indexCapacity())
+        {
+            slots[i].vertexCapacity = align4(std::max(16u, 2u * (unsigned)line->_current->size()));
+            relayout = true;
+        }
+    }
+
+    if (relayout)
+    {
+        std::map<const LineDrawable*, unsigned> capacities;
+        for (std::vector<Slot>::const_iterator slot = slots.begin(); slot != slots.end(); ++slot)
+            capacities[slot->line.get()] = slot->vertexCapacity;
+
+        slots.resize(lines.size());
+        for (unsigned i = 0; i < lines.size(); ++i)
+        {
+            Slot& slot = slots[i];
+            slot.line = lines[i];
+            slot.primset = 0L;
+            slot.vertexCapacity = align4(lines[i]->_current->size());
+            slot.revision = batch->revision;
+
+            std::map<const LineDrawable*, unsigned>::const_iterator c = capacities.find(lines[i]);
+            if (c != capacities.end())
+                slot.vertexCapacity = std::max(slot.vertexCapacity, c->second);
+        }
+
+        if (!lines.empty())
+            gpuStateSet = lines.front()->_gpuStateSet.get();
+
+        layout();
+    }
+
+    else
+    {
+        bool dirty = false;
+        unsigned revision = batch->revision + 1u;
+
+        for (unsigned i = 0; i < slots.size(); ++i)
+        {
+            if (changed(i))
+            {
+                copy(i);
+                slots[i].revision = revision;
+                dirty = true;
+            }
+        }
+
+        if (dirty)
+        {
+            batch->revision = revision;
+            geom->dirtyBound();
+        }
+    }
+}
+
+LineGroup::LineGroup() :
+_data(new Data())
 {
     //nop
 }
 
 LineGroup::LineGroup(const LineGroup& rhs, const osg::CopyOp& copy) :
-osg::Geode(rhs, copy)
+osg::Geode(rhs, copy),
+_data(new Data())
 {
-    //nop
+    setBatched(rhs.getBatched());
 }
 
 LineGroup::~LineGroup()
 {
-    //nop
+    delete _data;
+}
+
+void
+LineGroup::setBatched(bool value)
+{
+    if (_data->batched != value)
+    {
+        _data->batched = value;
+
+        // batches sync in the update traversal
+        ADJUST_UPDATE_TRAV_COUNT(this, value ? +1 : -1);
+    }
+}
+
+bool
+LineGroup::getBatched() const
+{
+    return _data->batched;
+}
+
+void
+LineGroup::traverse(osg::NodeVisitor& nv)
+{
+    if (_data->batched && Registry::capabilities().supportsGLSL(430u))
+    {
+        if (nv.getVisitorType() == nv.UPDATE_VISITOR)
+        {
+            _data->sync(this);
+        }
+
+        else if (nv.getVisitorType() == nv.CULL_VISITOR && _data->geom.valid())
+        {
+            // lines the batch cannot draw go on their own:
+            for (unsigned i = 0; i < getNumChildren(); ++i)
+            {
+                if (!Data::isBatchable(getChild(i)))
+                    getChild(i)->accept(nv);
+            }
+
+            if (!_data->batch->slots.empty())
+            {
+                osgUtil::CullVisitor* cv = Culling::asCullVisitor(nv);
+                cv->pushStateSet(_data->gpuStateSet.get());
+                _data->geom->accept(nv);
+                cv->popStateSet();
+            }
+            return;
+        }
+    }
+
+    osg::Geode::traverse(nv);
+}
+
+void
+LineGroup::resizeGLObjectBuffers(unsigned maxSize)
+{
+    osg::Geode::resizeGLObjectBuffers(maxSize);
+    if (_data->geom.valid())
+    {
+        _data->geom->resizeGLObjectBuffers(maxSize);
+        _data->batch->resizeGLObjectBuffers(maxSize);
+    }
+}
+
+void
+LineGroup::releaseGLObjects(osg::State* state) const
+{
+    osg::Geode::releaseGLObjects(state);
+    if (_data->geom.valid())
+    {
+        _data->geom->releaseGLObjects(state);
+        _data->batch->releaseGLObjects(state);
+    }
 }
 
 namespace
@@ -326,6 +963,7 @@ namespace osgEarth { namespace Serializers { namespace LineDrawable
 // static attribute binding locations. Changable by the user.
 int LineDrawable::PreviousVertexAttrLocation = 9;
 int LineDrawable::NextVertexAttrLocation = 10;
+int LineDrawable::LineIndexVertexAttrLocation = 11;
 
 LineDrawable::LineDrawable() :
 osg::Geometry(),
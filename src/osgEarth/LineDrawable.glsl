@@ -47,14 +47,24 @@ void oe_LineDrawable_VS_VIEW(inout vec4 currView)
 #pragma vp_name GPU Lines Screen Projected Clip
 #pragma vp_entryPoint oe_LineDrawable_VS_CLIP
 #pragma vp_location vertex_clip
-#pragma import_defines(OE_LINE_SMOOTH)
+#pragma import_defines(OE_LINE_SMOOTH, OE_LINE_BATCH)
 
 // Set by the InstallCameraUniform callback
 uniform vec3 oe_Camera;
 
+#ifdef OE_LINE_BATCH
+// Set per line by a batched LineGroup
+float oe_LineDrawable_width;
+flat out ivec2 oe_LineDrawable_stipple;
+#define OE_LINE_WIDTH oe_LineDrawable_width
+#define OE_LINE_STIPPLE_PATTERN oe_LineDrawable_stipple[0]
+#else
 // Set by GLUtils methods
 uniform float oe_GL_LineWidth;
 uniform int oe_GL_LineStipplePattern;
+#define OE_LINE_WIDTH oe_GL_LineWidth
+#define OE_LINE_STIPPLE_PATTERN oe_GL_LineStipplePattern
+#endif
 
 // Input attributes for adjacent points
 in vec3 oe_LineDrawable_prev;
@@ -88,9 +98,9 @@ void oe_LineDrawable_VS_CLIP(inout vec4 currClip)
     vec2 nextPixel = ((nextClip.xy/nextClip.w)+1.0) * 0.5*oe_Camera.xy;
 
 #ifdef OE_LINE_SMOOTH
-    float thickness = floor(oe_GL_LineWidth + 1.0);
+    float thickness = floor(OE_LINE_WIDTH + 1.0);
 #else
-    float thickness = max(0.5, floor(oe_GL_LineWidth));
+    float thickness = max(0.5, floor(OE_LINE_WIDTH));
 #endif
 
     float len = thickness;
@@ -163,7 +173,7 @@ void oe_LineDrawable_VS_CLIP(inout vec4 currClip)
     currClip.xy += offset;
 
     // prepare for stippling:
-    if (oe_GL_LineStipplePattern != 0xffff)
+    if (OE_LINE_STIPPLE_PATTERN != 0xffff)
     {
         // Line creation is done. Now, calculate a rotation angle
         // for use by out fragment shader to do GPU stippling. 
@@ -196,10 +206,18 @@ void oe_LineDrawable_VS_CLIP(inout vec4 currClip)
 #pragma vp_name GPU Lines Screen Projected FS
 #pragma vp_entryPoint oe_LineDrawable_Stippler_FS
 #pragma vp_location fragment_coloring
-#pragma import_defines(OE_LINE_SMOOTH)
+#pragma import_defines(OE_LINE_SMOOTH, OE_LINE_BATCH)
 
+#ifdef OE_LINE_BATCH
+flat in ivec2 oe_LineDrawable_stipple;
+#define OE_LINE_STIPPLE_PATTERN oe_LineDrawable_stipple[0]
+#define OE_LINE_STIPPLE_FACTOR oe_LineDrawable_stipple[1]
+#else
 uniform int oe_GL_LineStippleFactor;
 uniform int oe_GL_LineStipplePattern;
+#define OE_LINE_STIPPLE_PATTERN oe_GL_LineStipplePattern
+#define OE_LINE_STIPPLE_FACTOR oe_GL_LineStippleFactor
+#endif
 
 flat in vec2 oe_LineDrawable_rv;
 flat in int oe_LineDrawable_draw;
@@ -213,7 +231,7 @@ void oe_LineDrawable_Stippler_FS(inout vec4 color)
     if (oe_LineDrawable_draw == 0)
         discard;
 
-    if (oe_GL_LineStipplePattern != 0xffff)
+    if (OE_LINE_STIPPLE_PATTERN != 0xffff)
     {
         // coordinate of the fragment, shifted to 0:
         vec2 coord = (gl_FragCoord.xy - 0.5);
@@ -226,8 +244,8 @@ void oe_LineDrawable_Stippler_FS(inout vec4 color)
             * coord;
 
         // sample the stippling pattern (16-bits repeating)
-        int ci = int(mod(coordProj.x, 16.0 * float(oe_GL_LineStippleFactor))) / oe_GL_LineStippleFactor;
-        int pattern16 = 0xffff & (oe_GL_LineStipplePattern & (1 << ci));
+        int ci = int(mod(coordProj.x, 16.0 * float(OE_LINE_STIPPLE_FACTOR))) / OE_LINE_STIPPLE_FACTOR;
+        int pattern16 = 0xffff & (OE_LINE_STIPPLE_PATTERN & (1 << ci));
         if (pattern16 == 0)
             discard; 
 
@@ -0,0 +1,441 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+ * Copyright 2020 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarth/LineOfSightEngine>
+#include <osgEarth/ElevationPool>
+#include <osgEarth/Map>
+#include <osgEarth/Progress>
+#include <osgEarth/Registry>
+#include <osgEarth/Threading>
+#include <cfloat>
+#include <cstring>
+
+#define LC "[LineOfSightEngine] "
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+#define MIN_RAYS_PER_CHUNK 16u
+#define MIN_ROWS_PER_CHUNK 8u
+
+// Rays are cut into pieces no longer than this (in meters) and each
+// piece is straight in map coordinates. At this length the chord sits
+// under a millimeter from the true line.
+#define MAX_PIECE_LENGTH 500.0
+
+namespace
+{
+    bool isCanceled(ProgressCallback* progress)
+    {
+        return progress && progress->isCanceled();
+    }
+
+    // Resolution in map units along X and Y at a latitude
+    void getCellSize(const SpatialReference* srs, const Distance& res, double lat, double& out_x, double& out_y)
+    {
+        out_x = SpatialReference::transformUnits(res, srs, srs->isGeographic() ? lat : 0.0);
+        out_y = SpatialReference::transformUnits(res, srs, 0.0);
+    }
+
+    // Runs func(begin, end) over [0..size) in chunks in the arena, with
+    // the first chunk on the calling thread.
+    template<typename FUNC>
+    void runChunks(unsigned size, unsigned minPerChunk, FUNC& func)
+    {
+        Threading::JobArena* arena = Registry::instance()->getJobArena("elevation");
+        unsigned numChunks = osg::maximum(1u, osg::minimum(arena->getConcurrency() + 1u, size / minPerChunk));
+
+        std::vector<Threading::Future<osg::Referenced> > futures;
+        for(unsigned c = 1; c < numChunks; ++c)
+        {
+            Threading::Promise<osg::Referenced> promise;
+            futures.push_back(promise.getFuture());
+
+            unsigned begin = (c*size)/numChunks, end = ((c+1)*size)/numChunks;
+            Threading::runInJobArena(arena, [promise, begin, end, &func]() mutable {
+                func(begin, end);
+                promise.resolve(0L);
+            });
+        }
+
+        func(0u, size/numChunks);
+
+        // Wait for everything; the jobs reference our stack.
+        Threading::when_all(futures).get();
+    }
+
+    // Finds the first point where the map-coordinate segment a->b passes
+    // into the terrain. Walks the elevation tiles under the segment in
+    // order and lets each tile's min/max pyramid skip what the segment
+    // clears.
+    bool intersectPiece(
+        ElevationPool* pool,
+        const Profile* profile,
+        unsigned lod,
+        const osg::Vec3d& a,
+        const osg::Vec3d& b,
+        osg::Vec3d& out_hit,
+        ElevationPool::WorkingSet* ws,
+        ProgressCallback* progress)
+    {
+        double tw, th;
+        profile->getTileDimensions(lod, tw, th);
+        const GeoExtent& pe = profile->getExtent();
+
+        // tile grid coordinates of the segment (column from xMin, row from yMin)
+        double x0 = (a.x() - pe.xMin()) / tw, y0 = (a.y() - pe.yMin()) / th;
+        double dx = (b.x() - a.x()) / tw, dy = (b.y() - a.y()) / th;
+
+        int col = (int)floor(x0), row = (int)floor(y0);
+        int stepC = dx > 0.0 ? 1 : -1, stepR = dy > 0.0 ? 1 : -1;
+        double tMaxX = dx != 0.0 ? ((dx > 0.0 ? col + 1 : col) - x0) / dx : DBL_MAX;
+        double tMaxY = dy != 0.0 ? ((dy > 0.0 ? row + 1 : row) - y0) / dy : DBL_MAX;
+        double tDeltaX = dx != 0.0 ? fabs(1.0 / dx) : DBL_MAX;
+        double tDeltaY = dy != 0.0 ? fabs(1.0 / dy) : DBL_MAX;
+
+        TileKey lastKey;
+        for(;;)
+        {
+            TileKey key = profile->createTileKey(
+                pe.xMin() + ((double)col + 0.5)*tw,
+                pe.yMin() + ((double)row + 0.5)*th,
+                lod);
+
+            if (key.valid() && key != lastKey)
+            {
+                osg::ref_ptr<ElevationTexture> tex;
+                if (pool->getTile(key, true, tex, ws, progress) && tex.valid() &&
+                    tex->intersect(a, b, out_hit))
+                {
+                    return true;
+                }
+                lastKey = key;
+            }
+
+            if (isCanceled(progress) || osg::minimum(tMaxX, tMaxY) > 1.0)
+                break;
+
+            if (tMaxX < tMaxY)
+                col += stepC, tMaxX += tDeltaX;
+            else
+                row += stepR, tMaxY += tDeltaY;
+        }
+        return false;
+    }
+
+    // Largest elevation under each 2^L x 2^L block of a square grid
+    struct MaxPyramid
+    {
+        std::vector<std::vector<float> > _levels;
+        std::vector<int> _dims;
+
+        void build(const std::vector<float>& base, int dim)
+        {
+            _levels.push_back(base);
+            _dims.push_back(dim);
+            while (dim > 1)
+            {
+                int next = (dim + 1) / 2;
+                const std::vector<float>& below = _levels.back();
+                std::vector<float> level(next*next);
+                for(int r = 0; r < next; ++r)
+                {
+                    for(int c = 0; c < next; ++c)
+                    {
+                        int c1 = osg::minimum(2*c+1, dim-1), r1 = osg::minimum(2*r+1, dim-1);
+                        level[r*next+c] = osg::maximum(
+                            osg::maximum(below[(2*r)*dim + 2*c], below[(2*r)*dim + c1]),
+                            osg::maximum(below[r1*dim + 2*c], below[r1*dim + c1]));
+                    }
+                }
+                _levels.push_back(level);
+                _dims.push_back(next);
+                dim = next;
+            }
+        }
+
+        inline float get(int L, int c, int r) const { return _levels[L][r*_dims[L] + c]; }
+        inline int top() const { return (int)_levels.size() - 1; }
+    };
+
+    // Parameter at which a ray from (x0,y0) along (dx,dy) leaves a box
+    inline double exitParam(double x0, double y0, double dx, double dy, double xmin, double ymin, double xmax, double ymax)
+    {
+        double tx = dx > 0.0 ? (xmax - x0) / dx : dx < 0.0 ? (xmin - x0) / dx : DBL_MAX;
+        double ty = dy > 0.0 ? (ymax - y0) / dy : dy < 0.0 ? (ymin - y0) / dy : DBL_MAX;
+        return osg::minimum(tx, ty);
+    }
+
+    // Whether cell (ti,tj) at height th is visible from cell (oi,oj) at
+    // height oh. Climbs the pyramid while the ray clears whole blocks and
+    // drops back down when a block reaches the ray.
+    bool isVisible(const MaxPyramid& pyr, int oi, int oj, double oh, int ti, int tj, double th)
+    {
+        if (oi == ti && oj == tj)
+            return true;
+
+        const double EPS = 1e-9;
+        double x0 = oi + 0.5, y0 = oj + 0.5;
+        double dx = ti - oi, dy = tj - oj, dh = th - oh;
+        double len2 = dx*dx + dy*dy;
+
+        double t = exitParam(x0, y0, dx, dy, oi, oj, oi+1, oj+1) + EPS;
+        int L = 0;
+
+        while (t < 1.0)
+        {
+            int ci = (int)floor(x0 + t*dx), cj = (int)floor(y0 + t*dy);
+            if (ci == ti && cj == tj)
+                return true;
+
+            int span = 1 << L;
+            int li = ci >> L, lj = cj >> L;
+            double tExit = osg::minimum(1.0, exitParam(x0, y0, dx, dy,
+                li*span, lj*span, (li+1)*span, (lj+1)*span));
+
+            if (L > 0)
+            {
+                double rayLow = oh + dh*(dh < 0.0 ? tExit : t);
+                if (pyr.get(L, li, lj) < rayLow)
+                {
+                    t = tExit + EPS;
+                    if (L < pyr.top()) ++L;
+                }
+                else
+                {
+                    --L;
+                }
+            }
+            else
+            {
+                // compare the cell's post against the ray where it passes the post
+                double tc = ((ci + 0.5 - x0)*dx + (cj + 0.5 - y0)*dy) / len2;
+                tc = osg::clampBetween(tc, t, tExit);
+                if (pyr.get(0, ci, cj) > oh + dh*tc)
+                    return false;
+
+                t = tExit + EPS;
+                if (L < pyr.top()) ++L;
+            }
+        }
+        return true;
+    }
+}
+
+LineOfSightEngine::LineOfSightEngine(const Map* map) :
+    _map(map),
+    _resolution(30.0, Units::METERS),
+    _maxViewshedSize(4096u)
+{
+    //nop
+}
+
+bool
+LineOfSightEngine::compute(const Rays& rays, Results& out_results, ProgressCallback* progress) const
+{
+    osg::ref_ptr<const Map> map;
+    if (!_map.lock(map) || map->getProfile() == 0L)
+        return false;
+
+    out_results.assign(rays.size(), Result());
+
+    const SpatialReference* srs = map->getSRS();
+    const Profile* profile = map->getProfile();
+    ElevationPool* pool = map->getElevationPool();
+    double res_m = _resolution.as(Units::METERS);
+    if (res_m <= 0.0)
+        return false;
+
+    auto computeChunk = [&](unsigned begin, unsigned end)
+    {
+        ElevationPool::WorkingSet ws;
+        std::vector<osg::Vec4d> ends(2);
+
+        for(unsigned i = begin; i < end && !isCanceled(progress); ++i)
+        {
+            GeoPoint a = rays[i]._start.transform(srs);
+            GeoPoint b = rays[i]._end.transform(srs);
+            if (!a.isValid() || !b.isValid())
+                continue;
+
+            double cellX, cellY;
+            getCellSize(srs, _resolution, a.y(), cellX, cellY);
+
+            // resolve heights above the terrain
+            if (a.altitudeMode() == ALTMODE_RELATIVE || b.altitudeMode() == ALTMODE_RELATIVE)
+            {
+                ends[0].set(a.x(), a.y(), 0.0, cellY);
+                ends[1].set(b.x(), b.y(), 0.0, cellY);
+                if (pool->sampleMapCoords(ends, &ws, progress) < 0)
+                    continue;
+
+                if (a.altitudeMode() == ALTMODE_RELATIVE && ends[0].z() != NO_DATA_VALUE)
+                    a.z() += ends[0].z();
+                if (b.altitudeMode() == ALTMODE_RELATIVE && ends[1].z() != NO_DATA_VALUE)
+                    b.z() += ends[1].z();
+                a.altitudeMode() = ALTMODE_ABSOLUTE;
+                b.altitudeMode() = ALTMODE_ABSOLUTE;
+            }
+
+            osg::Vec3d wa, wb;
+            if (!a.toWorld(wa) || !b.toWorld(wb))
+                continue;
+
+            double len = (wb - wa).length();
+            unsigned lod = profile->getLevelOfDetailForHorizResolution(cellY, ELEVATION_TILE_SIZE);
+
+            Result& result = out_results[i];
+            result._valid = true;
+            result._visible = true;
+
+            if (len <= res_m)
+                continue;
+
+            // Leave half a cell at each end so points sitting on the
+            // ground don't count as their own obstruction.
+            double t0 = 0.5*res_m/len, t1 = 1.0 - t0;
+            unsigned pieces = (unsigned)ceil((t1-t0)*len / MAX_PIECE_LENGTH);
+
+            osg::Vec3d prev;
+            srs->transformFromWorld(wa + (wb-wa)*t0, prev);
+
+            for(unsigned p = 1; p <= pieces && result._visible; ++p)
+            {
+                osg::Vec3d next;
+                srs->transformFromWorld(wa + (wb-wa)*(t0 + (t1-t0)*(double)p/(double)pieces), next);
+
+                osg::Vec3d hit;
+                if (intersectPiece(pool, profile, lod, prev, next, hit, &ws, progress))
+                {
+                    result._visible = false;
+                    result._hit = GeoPoint(srs, hit, ALTMODE_ABSOLUTE);
+                }
+                prev = next;
+            }
+        }
+    };
+
+    runChunks((unsigned)rays.size(), MIN_RAYS_PER_CHUNK, computeChunk);
+
+    return !isCanceled(progress);
+}
+
+GeoImage
+LineOfSightEngine::computeViewshed(
+    const GeoPoint& observer,
+    const Distance& radius,
+    const Distance& targetHeight,
+    ProgressCallback* progress) const
+{
+    osg::ref_ptr<const Map> map;
+    if (!_map.lock(map) || map->getProfile() == 0L)
+        return GeoImage::INVALID;
+
+    const SpatialReference* srs = map->getSRS();
+    ElevationPool* pool = map->getElevationPool();
+
+    GeoPoint obs = observer.transform(srs);
+    double res_m = _resolution.as(Units::METERS);
+    double radius_m = radius.as(Units::METERS);
+    if (!obs.isValid() || res_m <= 0.0 || radius_m <= 0.0)
+        return GeoImage::INVALID;
+
+    // square grid of cells centered on the observer
+    int half = (int)ceil(radius_m / res_m);
+    if (2*half+1 > (int)_maxViewshedSize)
+    {
+        half = osg::maximum(1, ((int)_maxViewshedSize - 1) / 2);
+        res_m = radius_m / (double)half;
+        OE_INFO << LC << "Viewshed resolution reduced to " << res_m << "m" << std::endl;
+    }
+    int size = 2*half + 1;
+
+    double cellX, cellY;
+    getCellSize(srs, Distance(res_m, Units::METERS), obs.y(), cellX, cellY);
+    double xmin = obs.x() - ((double)half + 0.5)*cellX;
+    double ymin = obs.y() - ((double)half + 0.5)*cellY;
+
+    // Terrain heights, lowered by the earth's curvature relative to the
+    // observer's horizontal plane. That lets rays march in a flat grid.
+    double R = srs->getEllipsoid()->getRadiusEquator();
+    std::vector<float> heights(size*size, 0.0f);
+
+    auto sampleRows = [&](unsigned begin, unsigned end)
+    {
+        ElevationPool::WorkingSet ws;
+        std::vector<osg::Vec4d> points;
+        points.reserve(size*(end-begin));
+        for(unsigned r = begin; r < end; ++r)
+            for(int c = 0; c < size; ++c)
+                points.push_back(osg::Vec4d(xmin + ((double)c + 0.5)*cellX, ymin + ((double)r + 0.5)*cellY, 0.0, cellY));
+
+        if (isCanceled(progress) || pool->sampleMapCoords(points, nullptr, &ws, progress) < 0)
+            return;
+
+        for(unsigned r = begin, k = 0; r < end; ++r)
+        {
+            for(int c = 0; c < size; ++c, ++k)
+            {
+                double di = (double)(c - half), dj = (double)((int)r - half);
+                double d2 = (di*di + dj*dj)*res_m*res_m;
+                double h = points[k].z() != NO_DATA_VALUE ? points[k].z() : 0.0;
+                heights[r*size + c] = (float)(h - d2/(2.0*R));
+            }
+        }
+    };
+    runChunks((unsigned)size, MIN_ROWS_PER_CHUNK, sampleRows);
+
+    if (isCanceled(progress))
+        return GeoImage::INVALID;
+
+    double observerZ = obs.z();
+    if (obs.altitudeMode() == ALTMODE_RELATIVE)
+        observerZ += heights[half*size + half];
+    double targetZ = targetHeight.as(Units::METERS);
+
+    MaxPyramid pyramid;
+    pyramid.build(heights, size);
+
+    osg::ref_ptr<osg::Image> image = new osg::Image();
+    image->allocateImage(size, size, 1, GL_LUMINANCE, GL_UNSIGNED_BYTE);
+    ::memset(image->data(), 0, image->getTotalSizeInBytes());
+
+    auto marchRows = [&](unsigned begin, unsigned end)
+    {
+        for(unsigned r = begin; r < end && !isCanceled(progress); ++r)
+        {
+            int dj = (int)r - half;
+            for(int c = 0; c < size; ++c)
+            {
+                int di = c - half;
+                if (di*di + dj*dj > half*half)
+                    continue;
+
+                if (isVisible(pyramid, half, half, observerZ, c, (int)r, heights[r*size + c] + targetZ))
+                    *image->data(c, r) = 255;
+            }
+        }
+    };
+    runChunks((unsigned)size, MIN_ROWS_PER_CHUNK, marchRows);
+
+    if (isCanceled(progress))
+        return GeoImage::INVALID;
+
+    GeoExtent extent(srs, xmin, ymin, xmin + (double)size*cellX, ymin + (double)size*cellY);
+    return GeoImage(image.get(), extent);
+}
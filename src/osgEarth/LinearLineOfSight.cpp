@@ -252,6 +252,7 @@ LinearLineOfSightNode::compute(osg::Node* node, bool backgroundThread)
 
 
       osgUtil::LineSegmentIntersector* lsi = new osgUtil::LineSegmentIntersector(_startWorld, _endWorld);
+      lsi->setIntersectionLimit(osgUtil::Intersector::LIMIT_NEAREST);
       osgUtil::IntersectionVisitor iv( lsi );
 
       node->accept( iv );
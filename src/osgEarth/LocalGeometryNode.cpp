@@ -36,14 +36,16 @@ using namespace osgEarth;
 
 
 LocalGeometryNode::LocalGeometryNode() :
-GeoPositionNode()
+GeoPositionNode(),
+_clampIncremental(_clamperData)
 {
     construct();
 }
 
 LocalGeometryNode::LocalGeometryNode(Geometry*    geom,
                                      const Style& style) :
-GeoPositionNode()
+GeoPositionNode(),
+_clampIncremental(_clamperData)
 {
     construct();
     setStyle(style);
@@ -55,6 +57,7 @@ LocalGeometryNode::construct()
 {
     _geom = 0L;
     _clampInUpdateTraversal = false;
+    _clampDirty = false;
     _perVertexClampingEnabled = false;
 }
 
@@ -79,6 +82,7 @@ LocalGeometryNode::compileGeometry()
 
     // any old clamping data is out of date, so clear it
     _clamperData.clear();
+    _clampIncremental.reset();
     _perVertexClampingEnabled = false;
     _clampCallback = NULL;
     
@@ -217,27 +221,29 @@ LocalGeometryNode::onTileUpdate(const TileKey&          key,
                                 osg::Node*              graph, 
                                 TerrainCallbackContext& context)
 {
-    // If we are already set to clamp, ignore this
-    if (_clampInUpdateTraversal)
+    // If we are already set to clamp everything, ignore this
+    if (_clampDirty)
         return;
 
-    bool needsClamp;
-
     // Does the tile key's polytope intersect the world bounds or this object?
     // (taking getParent(0) gives the world-tranformed bounds vs. local bounds)
     if (key.valid())
     {
         osg::Polytope tope;
         key.getExtent().createPolytope(tope);
-        needsClamp = tope.contains(getBound());
+        if (!tope.contains(getBound()))
+            return;
+
+        // re-clamp just the part under the new tile, in the background
+        _clampIncremental.dirty(key);
     }
     else
     {
         // with no key, must clamp no matter what
-        needsClamp = true;
+        _clampDirty = true;
     }
 
-    if (needsClamp)
+    if (!_clampInUpdateTraversal)
     {
         _clampInUpdateTraversal = true;
         ADJUST_UPDATE_TRAV_COUNT(this, +1);
@@ -277,20 +283,53 @@ LocalGeometryNode::clamp(osg::Node* graph, const Terrain* terrain)
         clamper.setOffset(getPosition().alt());
 
         this->accept( clamper );
+
+        // a full clamp supersedes any partial one
+        _clampIncremental.reset();
         
         OE_DEBUG << LC << "LGN: clamped.\n";
     }
 }
 
+bool
+LocalGeometryNode::reclampIncremental()
+{
+    if (_perVertexClampingEnabled && getMapNode())
+    {
+        osg::ref_ptr<Terrain> terrain = getGeoTransform()->getTerrain();
+        if (terrain.valid())
+        {
+            GeometryClamper clamper(_clamperData);
+            clamper.setTerrainSRS( terrain->getSRS() );
+
+            // same compensation as in clamp()
+            clamper.setOffset(getPosition().alt());
+
+            return _clampIncremental.update(this, clamper, getMapNode()->getMap());
+        }
+    }
+
+    _clampIncremental.reset();
+    return false;
+}
+
 void
 LocalGeometryNode::traverse(osg::NodeVisitor& nv)
 {
     if (nv.getVisitorType() == nv.UPDATE_VISITOR && _clampInUpdateTraversal)
     {
-        reclamp();
+        bool busy = false;
+        if (_clampDirty)
+            reclamp();
+        else
+            busy = reclampIncremental();
 
-        _clampInUpdateTraversal = false;
-        ADJUST_UPDATE_TRAV_COUNT(this, -1);
+        _clampDirty = false;
+        if (!busy)
+        {
+            _clampInUpdateTraversal = false;
+            ADJUST_UPDATE_TRAV_COUNT(this, -1);
+        }
     }
     GeoPositionNode::traverse(nv);
 }
@@ -302,7 +341,8 @@ OSGEARTH_REGISTER_ANNOTATION( local_geometry, osgEarth::LocalGeometryNode );
 
 LocalGeometryNode::LocalGeometryNode(const Config&         conf,
                                      const osgDB::Options* options) :
-GeoPositionNode(conf, options)
+GeoPositionNode(conf, options),
+_clampIncremental(_clamperData)
 {
     construct();
 
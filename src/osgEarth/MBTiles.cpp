@@ -60,6 +60,7 @@ MBTiles::Options::writeTo(Config& conf) const
     conf.set("filename", _url);
     conf.set("format", _format);
     conf.set("compress", _compress);
+    conf.set("write_batch_size", _writeBatchSize);
 }
 
 void
@@ -67,11 +68,13 @@ MBTiles::Options::readFrom(const Config& conf)
 {
     format().init("png");
     compress().init(false);
+    writeBatchSize().init(256u);
 
     conf.get("filename", _url);
     conf.get("url", _url); // compat for consistency with other drivers
     conf.get("format", _format);
     conf.get("compress", _compress);
+    conf.get("write_batch_size", _writeBatchSize);
 }
 
 //...................................................................
@@ -139,6 +142,13 @@ MBTilesImageLayer::openImplementation()
     return Status::NoError;
 }
 
+Status
+MBTilesImageLayer::closeImplementation()
+{
+    _driver.close();
+    return ImageLayer::closeImplementation();
+}
+
 void
 MBTilesImageLayer::setDataExtents(const DataExtentList& values)
 {
@@ -242,6 +252,13 @@ MBTilesElevationLayer::openImplementation()
     return Status::NoError;
 }
 
+Status
+MBTilesElevationLayer::closeImplementation()
+{
+    _driver.close();
+    return ElevationLayer::closeImplementation();
+}
+
 void
 MBTilesElevationLayer::setDataExtents(const DataExtentList& values)
 {
@@ -308,11 +325,60 @@ MBTiles::Driver::Driver() :
     _maxLevel(19),
     _forceRGB(false),
     _database(NULL),
-    _mutex("MBTiles Driver(OE)")
+    _readOnly(true),
+    _mutex("MBTiles Driver(OE)"),
+    _selectTile(NULL),
+    _insertTile(NULL),
+    _writeBatchSize(1u),
+    _numWritesInBatch(0u),
+    _readConnections("MBTiles Driver Read Connections(OE)")
 {
     //nop
 }
 
+MBTiles::Driver::~Driver()
+{
+    close();
+}
+
+void
+MBTiles::Driver::close()
+{
+    Threading::ScopedMutexLock exclusiveLock(_mutex);
+
+    if (_database == NULL)
+        return;
+
+    sqlite3* database = (sqlite3*)_database;
+
+    commitBatch();
+
+    sqlite3_finalize((sqlite3_stmt*)_selectTile);
+    sqlite3_finalize((sqlite3_stmt*)_insertTile);
+    _selectTile = NULL;
+    _insertTile = NULL;
+
+    {
+        Threading::ScopedMutexLock lock(_readConnections);
+        for (auto& i : _readConnections)
+        {
+            sqlite3_finalize((sqlite3_stmt*)i.second._selectTile);
+            sqlite3_close((sqlite3*)i.second._database);
+        }
+    }
+    _readConnections.clear();
+
+    if (!_readOnly)
+    {
+        // fold the WAL back into the main file so the .mbtiles stands alone
+        sqlite3_exec(database, "PRAGMA wal_checkpoint(TRUNCATE)", 0L, 0L, 0L);
+        sqlite3_exec(database, "PRAGMA journal_mode=DELETE", 0L, 0L, 0L);
+    }
+
+    sqlite3_close(database);
+    _database = NULL;
+}
+
 Status
 MBTiles::Driver::open(
     const std::string& name,
@@ -334,6 +400,10 @@ MBTiles::Driver::open(
     }
 
     bool readWrite = isWritingRequested;
+    _readOnly = !readWrite;
+    _fullFilename = fullFilename;
+    _writeBatchSize = std::max(options.writeBatchSize().get(), 1u);
+    _numWritesInBatch = 0u;
 
     bool isNewDatabase = readWrite && !osgDB::fileExists(fullFilename);
 
@@ -370,6 +440,19 @@ MBTiles::Driver::open(
             << "Database \"" << fullFilename << "\": " << sqlite3_errmsg(database));
     }
 
+    // WAL lets readers proceed while a writer is working, and makes the
+    // many small commits of a tile export much cheaper.
+    if (readWrite)
+    {
+        sqlite3* db = (sqlite3*)_database;
+        sqlite3_busy_timeout(db, 5000);
+        if (SQLITE_OK != sqlite3_exec(db, "PRAGMA journal_mode=WAL", 0L, 0L, 0L))
+        {
+            OE_WARN << LC << "Failed to enable WAL journaling: " << sqlite3_errmsg(db) << std::endl;
+        }
+        sqlite3_exec(db, "PRAGMA synchronous=NORMAL", 0L, 0L, 0L);
+    }
+
     // New database setup:
     if (isNewDatabase)
     {
@@ -585,14 +668,69 @@ MBTiles::Driver::readMaxLevel()
     return result;
 }
 
+MBTiles::Driver::Connection*
+MBTiles::Driver::getReadConnection() const
+{
+    Connection& conn = _readConnections.get();
+    if (conn._database == NULL)
+    {
+        sqlite3* database = NULL;
+        int rc = sqlite3_open_v2(_fullFilename.c_str(), &database, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, 0L);
+        if (rc != SQLITE_OK)
+        {
+            OE_WARN << LC << "Failed to open read connection: " << sqlite3_errmsg(database) << std::endl;
+            sqlite3_close(database);
+            return NULL;
+        }
+
+        sqlite3_stmt* select = NULL;
+        std::string query = "SELECT tile_data from tiles where zoom_level = ? AND tile_column = ? AND tile_row = ?";
+        rc = sqlite3_prepare_v2(database, query.c_str(), -1, &select, 0L);
+        if (rc != SQLITE_OK)
+        {
+            OE_WARN << LC << "Failed to prepare SQL: " << query << "; " << sqlite3_errmsg(database) << std::endl;
+            sqlite3_close(database);
+            return NULL;
+        }
+
+        conn._database = database;
+        conn._selectTile = select;
+    }
+    return &conn;
+}
+
+bool
+MBTiles::Driver::readTileData(void* handle, int z, int x, int y, std::string& out) const
+{
+    sqlite3_stmt* select = (sqlite3_stmt*)handle;
+
+    sqlite3_bind_int( select, 1, z );
+    sqlite3_bind_int( select, 2, x );
+    sqlite3_bind_int( select, 3, y );
+
+    bool found = false;
+    int rc = sqlite3_step( select );
+    if ( rc == SQLITE_ROW)
+    {
+        // the pointer returned from _blob gets freed internally by sqlite, supposedly
+        const char* data = (const char*)sqlite3_column_blob( select, 0 );
+        int dataLen = sqlite3_column_bytes( select, 0 );
+        out.assign( data, dataLen );
+        found = true;
+    }
+
+    // ready the statement for next time
+    sqlite3_reset( select );
+    sqlite3_clear_bindings( select );
+    return found;
+}
+
 ReadResult
 MBTiles::Driver::read(
     const TileKey& key,
     ProgressCallback* progress,
     const osgDB::Options* readOptions) const
 {
-    Threading::ScopedMutexLock exclusiveLock(_mutex);
-
     int z = key.getLevelOfDetail();
     int x = key.getTileX();
     int y = key.getTileY();
@@ -612,68 +750,87 @@ MBTiles::Driver::read(
     key.getProfile()->getNumTiles(key.getLevelOfDetail(), numCols, numRows);
     y  = numRows - y - 1;
 
-    sqlite3* database = (sqlite3*)_database;
+    std::string dataBuffer;
+    bool found = false;
 
-    //Get the image
-    sqlite3_stmt* select = NULL;
-    std::string query = "SELECT tile_data from tiles where zoom_level = ? AND tile_column = ? AND tile_row = ?";
-    int rc = sqlite3_prepare_v2( database, query.c_str(), -1, &select, 0L );
-    if ( rc != SQLITE_OK )
+    if (_readOnly)
     {
-        OE_WARN << LC << "Failed to prepare SQL: " << query << "; " << sqlite3_errmsg(database) << std::endl;
-        return ReadResult::RESULT_READER_ERROR;
-    }
+        if (_database == NULL)
+            return ReadResult::RESULT_READER_ERROR;
 
-    bool valid = true;
-
-    sqlite3_bind_int( select, 1, z );
-    sqlite3_bind_int( select, 2, x );
-    sqlite3_bind_int( select, 3, y );
+        // this thread's own connection; no locking required
+        Connection* conn = getReadConnection();
+        if (conn == NULL)
+            return ReadResult::RESULT_READER_ERROR;
 
-    osg::Image* result = NULL;
-    rc = sqlite3_step( select );
-    if ( rc == SQLITE_ROW)
+        found = readTileData(conn->_selectTile, z, x, y, dataBuffer);
+    }
+    else
     {
-        // the pointer returned from _blob gets freed internally by sqlite, supposedly
-        const char* data = (const char*)sqlite3_column_blob( select, 0 );
-        int dataLen = sqlite3_column_bytes( select, 0 );
+        // writable database: share the main connection so we can see
+        // tiles in the uncommitted batch
+        Threading::ScopedMutexLock exclusiveLock(_mutex);
 
-        std::string dataBuffer( data, dataLen );
+        sqlite3* database = (sqlite3*)_database;
+        if (database == NULL)
+            return ReadResult::RESULT_READER_ERROR;
 
-        // decompress if necessary:
-        if ( _compressor.valid() )
+        if (_selectTile == NULL)
         {
-            std::istringstream inputStream(dataBuffer);
-            std::string value;
-            if ( !_compressor->decompress(inputStream, value) )
+            sqlite3_stmt* select = NULL;
+            std::string query = "SELECT tile_data from tiles where zoom_level = ? AND tile_column = ? AND tile_row = ?";
+            int rc = sqlite3_prepare_v2( database, query.c_str(), -1, &select, 0L );
+            if ( rc != SQLITE_OK )
             {
-                OE_WARN << LC << "Decompression failed" << std::endl;
-                valid = false;
-            }
-            else
-            {
-                dataBuffer = value;
+                OE_WARN << LC << "Failed to prepare SQL: " << query << "; " << sqlite3_errmsg(database) << std::endl;
+                return ReadResult::RESULT_READER_ERROR;
             }
+            const_cast<Driver*>(this)->_selectTile = select;
         }
 
-        // decode the raw image data:
-        if ( valid )
-        {
-            std::istringstream inputStream(dataBuffer);
-            result = ImageUtils::readStream(inputStream, _dbOptions.get());
-        }
+        found = readTileData(_selectTile, z, x, y, dataBuffer);
     }
-    else
+
+    if (!found)
     {
-        OE_DEBUG << LC << "SQL QUERY failed for " << query << ": " << std::endl;
-        valid = false;
+        OE_DEBUG << LC << "No tile at " << key.str() << std::endl;
+        return ReadResult::RESULT_NOT_FOUND;
     }
 
-    sqlite3_finalize( select );
+    // decompress if necessary:
+    if ( _compressor.valid() )
+    {
+        std::istringstream inputStream(dataBuffer);
+        std::string value;
+        if ( !_compressor->decompress(inputStream, value) )
+        {
+            OE_WARN << LC << "Decompression failed" << std::endl;
+            return ReadResult::RESULT_READER_ERROR;
+        }
+        dataBuffer.swap(value);
+    }
+
+    // decode the raw image data:
+    std::istringstream inputStream(dataBuffer);
+    osg::Image* result = ImageUtils::readStream(inputStream, _dbOptions.get());
 
     return ReadResult(result);
 }
 
+void
+MBTiles::Driver::commitBatch()
+{
+    // call with _mutex held
+    if (_numWritesInBatch > 0u)
+    {
+        sqlite3* database = (sqlite3*)_database;
+        if (SQLITE_OK != sqlite3_exec(database, "COMMIT", 0L, 0L, 0L))
+        {
+            OE_WARN << LC << "Failed to commit tiles: " << sqlite3_errmsg(database) << std::endl;
+        }
+        _numWritesInBatch = 0u;
+    }
+}
 
 Status
 MBTiles::Driver::write(
@@ -684,8 +841,6 @@ MBTiles::Driver::write(
     if (!key.valid() || !image)
         return Status::AssertionFailure;
 
-    Threading::ScopedMutexLock exclusiveLock(_mutex);
-
     // encode the data stream:
     std::stringstream buf;
     osgDB::ReaderWriter::WriteResult wr;
@@ -727,16 +882,32 @@ MBTiles::Driver::write(
     key.getProfile()->getNumTiles(key.getLevelOfDetail(), numCols, numRows);
     y = numRows - y - 1;
 
+    // Everything above runs in parallel; only the database work is serialized.
+    Threading::ScopedMutexLock exclusiveLock(_mutex);
+
     sqlite3* database = (sqlite3*)_database;
+    if (database == NULL)
+        return Status(Status::ServiceUnavailable, "Database is closed");
 
     // Prep the insert statement:
-    sqlite3_stmt* insert = NULL;
     std::string query = "INSERT OR REPLACE INTO tiles (zoom_level, tile_column, tile_row, tile_data) VALUES (?, ?, ?, ?)";
-    int rc = sqlite3_prepare_v2(database, query.c_str(), -1, &insert, 0L);
-    if (rc != SQLITE_OK)
+    if (_insertTile == NULL)
     {
-        return Status(Status::GeneralError, Stringify()
-            << "Failed to prepare SQL: " << query << "; " << sqlite3_errmsg(database));
+        sqlite3_stmt* insert = NULL;
+        int rc = sqlite3_prepare_v2(database, query.c_str(), -1, &insert, 0L);
+        if (rc != SQLITE_OK)
+        {
+            return Status(Status::GeneralError, Stringify()
+                << "Failed to prepare SQL: " << query << "; " << sqlite3_errmsg(database));
+        }
+        _insertTile = insert;
+    }
+    sqlite3_stmt* insert = (sqlite3_stmt*)_insertTile;
+
+    // group writes into a transaction; a commit per tile is ruinously slow
+    if (_numWritesInBatch == 0u)
+    {
+        sqlite3_exec(database, "BEGIN", 0L, 0L, 0L);
     }
 
     // bind parameters:
@@ -748,12 +919,21 @@ MBTiles::Driver::write(
     sqlite3_bind_blob(insert, 4, value.c_str(), value.length(), SQLITE_STATIC);
 
     // run the sql.
-    bool ok = true;
+    int rc;
     int tries = 0;
     do {
         rc = sqlite3_step(insert);
     } while (++tries < 100 && (rc == SQLITE_BUSY || rc == SQLITE_LOCKED));
 
+    sqlite3_reset(insert);
+    sqlite3_clear_bindings(insert);
+
+    // counts failed inserts too, so the open transaction always gets closed
+    if (++_numWritesInBatch >= _writeBatchSize)
+    {
+        commitBatch();
+    }
+
     if (SQLITE_OK != rc && SQLITE_DONE != rc)
     {
 #if SQLITE_VERSION_NUMBER >= 3007015
@@ -761,11 +941,8 @@ MBTiles::Driver::write(
 #else
         return Status(Status::GeneralError, Stringify()<< "Failed query: " << query << "(" << rc << ")" << rc << "; " << sqlite3_errmsg(database));
 #endif
-        ok = false;
     }
 
-    sqlite3_finalize(insert);
-
     // adjust the max level if necessary
     if (key.getLOD() > _maxLevel)
     {
@@ -24,6 +24,8 @@
 #include <osgEarth/OGRFeatureSource>
 
 #include <osgEarth/FeatureNode>
+#include <osgEarth/LineDrawable>
+#include <osgEarth/Containers>
 
 #include <osgEarth/Registry>
 #include <osgEarth/PagedNode>
@@ -407,16 +409,226 @@ namespace
         }
     }
 
+    //! Line segments of a piece of grid in geographic coordinates, as pairs
+    //! of endpoints. Independent of styling, so they're cached and shared.
+    struct GridLines : public osg::Referenced
+    {
+        std::vector<osg::Vec3d> _segments;
+    };
+
+    typedef LRUCache<std::string, osg::ref_ptr<GridLines> > GridLinesCache;
+
+    GridLinesCache& gridLinesCache()
+    {
+        static GridLinesCache s_cache(true, 4096u);
+        return s_cache;
+    }
+
+    //! Clips the segment (a, b) to a 2D box in place (Liang-Barsky).
+    //! Returns false if none of it is inside.
+    bool clipSegment(osg::Vec3d& a, osg::Vec3d& b, const Bounds& box)
+    {
+        osg::Vec3d d = b - a;
+        const double p[4] = { -d.x(), d.x(), -d.y(), d.y() };
+        const double q[4] = { a.x() - box.xMin(), box.xMax() - a.x(), a.y() - box.yMin(), box.yMax() - a.y() };
+
+        double t0 = 0.0, t1 = 1.0;
+        for (int i = 0; i < 4; ++i)
+        {
+            if (p[i] == 0.0)
+            {
+                if (q[i] < 0.0)
+                    return false;
+            }
+            else
+            {
+                double t = q[i] / p[i];
+                if (p[i] < 0.0)
+                    t0 = osg::maximum(t0, t);
+                else
+                    t1 = osg::minimum(t1, t);
+            }
+        }
+
+        if (t0 >= t1)
+            return false;
+
+        b = a + d*t1;
+        a = a + d*t0;
+        return true;
+    }
+
+    //! One square of the UTM grid, clipped to the GZD or SQID area it's in
+    struct UTMSquare
+    {
+        osg::ref_ptr<const SpatialReference> _utm;
+        osg::ref_ptr<const SpatialReference> _geo;
+        double _x0, _y0;
+        Bounds _clip;
+
+        UTMSquare() : _x0(0.0), _y0(0.0) { }
+    };
+
+    //! Computes the lines "interval" meters apart across a square "size"
+    //! meters on a side, clipped to the square's area. This is all analytic
+    //! (a batch projection and a clip) so there's no feature processing.
+    //! Each line gets a few segments to follow the curve of the projection.
+    osg::ref_ptr<GridLines> getGridLines(const UTMSquare& square, double size, double interval)
+    {
+        std::string key = Stringify() << std::setprecision(12)
+            << square._utm->getHorizInitString() << ' '
+            << square._x0 << ' ' << square._y0 << ' ' << size << ' ' << interval << ' '
+            << square._clip.xMin() << ' ' << square._clip.yMin() << ' '
+            << square._clip.xMax() << ' ' << square._clip.yMax();
+
+        GridLinesCache::Record rec;
+        if (gridLinesCache().get(key, rec))
+            return rec.value();
+
+        unsigned numLines = (unsigned)(size/interval + 0.5);
+        unsigned parts = osg::clampBetween((unsigned)(size/12500.0), 1u, 8u);
+
+        std::vector<osg::Vec3d> points;
+        points.reserve(2 * (numLines+1) * (parts+1));
+
+        // south-north lines:
+        for (unsigned i = 0; i <= numLines; ++i)
+            for (unsigned p = 0; p <= parts; ++p)
+                points.push_back(osg::Vec3d(square._x0 + interval*i, square._y0 + size*p/parts, 0));
+
+        // west-east lines:
+        for (unsigned i = 0; i <= numLines; ++i)
+            for (unsigned p = 0; p <= parts; ++p)
+                points.push_back(osg::Vec3d(square._x0 + size*p/parts, square._y0 + interval*i, 0));
+
+        square._utm->transform(points, square._geo.get());
+
+        osg::ref_ptr<GridLines> lines = new GridLines();
+        for (unsigned first = 0; first < points.size(); first += parts+1)
+        {
+            for (unsigned p = first; p < first+parts; ++p)
+            {
+                osg::Vec3d a = points[p], b = points[p+1];
+                if (clipSegment(a, b, square._clip))
+                {
+                    lines->_segments.push_back(a);
+                    lines->_segments.push_back(b);
+                }
+            }
+        }
+
+        gridLinesCache().insert(key, lines);
+        return lines;
+    }
+
+    //! Whether a style draws nothing but plain lines, in which case
+    //! we can skip the feature compiler.
+    bool isSimpleLineStyle(const Style& style)
+    {
+        for (SymbolList::const_iterator i = style.symbols().begin(); i != style.symbols().end(); ++i)
+        {
+            if (dynamic_cast<const LineSymbol*>(i->get()) == 0L)
+                return false;
+        }
+        return style.has<LineSymbol>();
+    }
+
+    //! Node that draws grid lines in a style: a single batch of segments in
+    //! a LineDrawable, or a compiled FeatureNode for anything fancier
+    //! (like terrain clamping).
+    osg::Node* createGridNode(const GridLines* lines, const SpatialReference* geo, const Style& style)
+    {
+        if (lines == 0L || lines->_segments.empty())
+            return new osg::Group();
+
+        if (!isSimpleLineStyle(style))
+        {
+            osg::ref_ptr<MultiGeometry> geom = new MultiGeometry();
+            for (unsigned i = 0; i+1 < lines->_segments.size(); i += 2)
+            {
+                LineString* ls = new LineString(2);
+                ls->push_back(lines->_segments[i]);
+                ls->push_back(lines->_segments[i+1]);
+                geom->getComponents().push_back(ls);
+            }
+            osg::ref_ptr<Feature> feature = new Feature(geom.get(), geo);
+            GeometryCompilerOptions gco;
+            gco.shaderPolicy() = SHADERPOLICY_INHERIT;
+            return new FeatureNode(feature.get(), style, gco);
+        }
+
+        std::vector<osg::Vec3d> world(lines->_segments);
+        geo->transform(world, geo->getGeocentricSRS());
+
+        osg::BoundingBoxd box;
+        for (unsigned i = 0; i < world.size(); ++i)
+            box.expandBy(world[i]);
+        osg::Vec3d center = box.center();
+
+        const LineSymbol* line = style.get<LineSymbol>();
+
+        LineDrawable* drawable = new LineDrawable(GL_LINES);
+
+        if (line->useGLLines() == true)
+            drawable->setUseGPU(false);
+
+        drawable->reserve(world.size());
+        for (unsigned i = 0; i < world.size(); ++i)
+            drawable->pushVertex(world[i] - center);
+
+        if (line->stroke().isSet())
+        {
+            if (line->stroke()->width().isSet())
+                drawable->setLineWidth(line->stroke()->width().get());
+
+            if (line->stroke()->stipplePattern().isSet())
+                drawable->setStipplePattern(line->stroke()->stipplePattern().get());
+
+            if (line->stroke()->stippleFactor().isSet())
+                drawable->setStippleFactor(line->stroke()->stippleFactor().get());
+
+            if (line->stroke()->smooth().isSet())
+                drawable->setLineSmooth(line->stroke()->smooth().get());
+        }
+
+        drawable->setColor(line->stroke()->color());
+        drawable->finish();
+
+        LineGroup* group = new LineGroup();
+        group->addChild(drawable);
+
+        osg::MatrixTransform* mt = new osg::MatrixTransform(osg::Matrixd::translate(center));
+        mt->addChild(group);
+        return mt;
+    }
+
+    //! The square of an SQID feature from the SQID data file
+    UTMSquare getSQIDSquare(const Feature* feature)
+    {
+        UTMSquare square;
+        square._geo = feature->getSRS();
+        square._clip = feature->getGeometry()->getBounds();
+        square._x0 = feature->getDouble("easting");
+        square._y0 = feature->getDouble("northing");
+
+        osg::Vec2d centroid = square._clip.center2d();
+        square._utm = square._geo->createUTMFromLonLat(
+            Angle(centroid.x(), Units::DEGREES),
+            Angle(centroid.y(), Units::DEGREES) );
+
+        return square;
+    }
+
     struct GeomCell : public PagedNode
     {
         double _size;        
-        osg::ref_ptr<Feature> _feature;
+        UTMSquare _square;
         Style _style;
         bool _hasChild;
         const MGRSGraticule* _parent;
     
         GeomCell(double size);
-        void setupData(Feature* feature, const MGRSGraticule* parent);
+        void setupData(const UTMSquare& square, const MGRSGraticule* parent);
         osg::Node* loadChild();
         bool hasChild() const;
         osg::BoundingSphere getChildBound() const;
@@ -430,10 +642,8 @@ namespace
     {
         double _size;
         const MGRSGraticule* _parent;
-        osg::ref_ptr<Feature> _feature;
+        UTMSquare _square;
         Style _style;
-        GeoExtent _extent;
-        osg::ref_ptr<const SpatialReference> _utm;
 
         GeomGrid(double size)
         {
@@ -444,48 +654,78 @@ namespace
             setAdditive(false);
         }
 
-        void setupData(Feature* feature, const MGRSGraticule* parent)
+        void setupData(const UTMSquare& square, const MGRSGraticule* parent)
         {
-            _feature = feature;
+            _square = square;
             _parent = parent;
             std::string styleName = Stringify() << (int)(_size*0.1);
             _style = *parent->getStyleSheet()->getStyle(styleName, true);
             setNode(build());
         }
 
-        osg::Node* loadChild()
+        //! Cells in one column of the grid
+        osg::Group* loadColumn(unsigned column) const
         {
             osg::Group* group = new osg::Group();
 
-            double x0 = _feature->getDouble("easting");
-            double y0 = _feature->getDouble("northing");
             double interval = _size * 0.1;
+            double x = _square._x0 + interval*column;
+            unsigned numRows = (unsigned)(_size/interval + 0.5);
 
-            for (double x = x0; x < x0 + _size; x += interval)
+            for (unsigned row = 0; row < numRows; ++row)
             {
-                for (double y = y0; y < y0 + _size; y += interval)
+                UTMSquare square(_square);
+                square._x0 = x;
+                square._y0 = _square._y0 + interval*row;
+
+                // skip the squares entirely outside the clip area
+                osg::ref_ptr<GridLines> outline = getGridLines(square, interval, interval);
+                if (!outline->_segments.empty())
                 {
-                    osg::ref_ptr<LineString> polygon = new LineString();
-                    polygon->push_back(x, y);
-                    polygon->push_back(x+interval, y);
-                    polygon->push_back(x+interval, y+interval);
-                    polygon->push_back(x, y+interval);
-                    polygon->push_back(x, y);
-
-                    osg::ref_ptr<Feature> f = new Feature(polygon.get(), _utm.get());
-                    f->transform(_feature->getSRS());
-
-                    osg::ref_ptr<Geometry> croppedGeom;
-                    if (f->getGeometry()->crop(_extent.bounds(), croppedGeom))
-                    {
-                        f->setGeometry(croppedGeom.get());
-                        f->set("easting", x);
-                        f->set("northing", y);
-                        GeomCell* child = new GeomCell(interval);
-                        child->setupData(f.get(), _parent);
-                        child->setupPaging();
-                        group->addChild(child);
-                    }                 
+                    GeomCell* child = new GeomCell(interval);
+                    child->setupData(square, _parent);
+                    child->setupPaging();
+                    group->addChild(child);
+                }
+            }
+
+            return group;
+        }
+
+        osg::Node* loadChild()
+        {
+            double interval = _size * 0.1;
+            unsigned numColumns = (unsigned)(_size/interval + 0.5);
+
+            // The cells are independent, so build the columns concurrently.
+            // This thread does the first one instead of waiting idle.
+            Threading::JobArena* arena = Registry::instance()->getJobArena("features.build");
+
+            std::vector<Threading::Future<osg::Group> > futures;
+            for (unsigned c = 1; c < numColumns; ++c)
+            {
+                Threading::Promise<osg::Group> promise;
+                futures.push_back(promise.getFuture());
+
+                Threading::runInJobArena(arena, [this, promise, c]() mutable {
+                    osg::ref_ptr<osg::Group> column = loadColumn(c);
+                    promise.resolve(column.get());
+                });
+            }
+
+            osg::Group* group = loadColumn(0);
+
+            // Wait for all of them, since the jobs use this object. Then
+            // collect the cells in column order.
+            Threading::Future<Threading::FutureVector<osg::Group> > all = Threading::when_all(futures);
+            osg::ref_ptr<Threading::FutureVector<osg::Group> > results = all.get();
+            if (results.valid())
+            {
+                for (unsigned c = 0; c < results->size(); ++c)
+                {
+                    osg::Group* column = (*results)[c].get();
+                    for (unsigned i = 0; column && i < column->getNumChildren(); ++i)
+                        group->addChild(column->getChild(i));
                 }
             }
             
@@ -504,52 +744,8 @@ namespace
 
         osg::Node* build()
         {
-            _extent = GeoExtent(_feature->getSRS(), _feature->getGeometry()->getBounds());
-            double lon, lat;
-            _extent.getCentroid(lon, lat);
-            _utm = _feature->getSRS()->createUTMFromLonLat(
-                Angle(lon, Units::DEGREES),
-                Angle(lat, Units::DEGREES) );
-
-            double x0 = _feature->getDouble("easting");
-            double y0 = _feature->getDouble("northing");
-
-            double interval = _size * 0.1;
-
-            osg::ref_ptr<MultiGeometry> grid = new MultiGeometry();
-
-            // south-north lines:
-            for (double x=x0; x<=x0+_size; x += interval)
-            {
-                LineString* ls = new LineString();
-                ls->push_back(osg::Vec3d(x, y0, 0));
-                ls->push_back(osg::Vec3d(x, y0+_size, 0));
-                grid->getComponents().push_back(ls);
-            }
-            
-            // west-east lines:
-            for (double y=y0; y<=y0+_size; y+=interval)
-            {
-                LineString* ls = new LineString();
-                ls->push_back(osg::Vec3d(x0, y, 0));
-                ls->push_back(osg::Vec3d(x0+_size, y, 0));
-                grid->getComponents().push_back(ls);
-            }
-
-            osg::ref_ptr<Feature> f = new Feature(grid.get(), _utm.get());
-            f->transform(_feature->getSRS());
-
-            osg::ref_ptr<Geometry> croppedGeom;
-            if (f->getGeometry()->crop(_extent.bounds(), croppedGeom))
-            {
-                f->setGeometry(croppedGeom.get());
-            }
-
-            GeometryCompilerOptions gco;
-            gco.shaderPolicy() = SHADERPOLICY_INHERIT;
-            FeatureNode* node = new FeatureNode(f.get(), _style, gco);
-            
-            return node;
+            osg::ref_ptr<GridLines> lines = getGridLines(_square, _size, _size * 0.1);
+            return createGridNode(lines.get(), _square._geo.get(), _style);
         }
         
 #ifdef DEBUG_MODE
@@ -574,9 +770,9 @@ namespace
         setAdditive(true);
     }
 
-    void GeomCell::setupData(Feature* feature, const MGRSGraticule* parent)
+    void GeomCell::setupData(const UTMSquare& square, const MGRSGraticule* parent)
     {
-        _feature = feature;
+        _square = square;
         _parent = parent;
         std::string styleName = Stringify() << (int)(_size);
         _style = *parent->getStyleSheet()->getStyle(styleName, true);
@@ -586,7 +782,7 @@ namespace
     osg::Node* GeomCell::loadChild()
     {
         GeomGrid* child = new GeomGrid(_size);
-        child->setupData(_feature.get(), _parent);
+        child->setupData(_square, _parent);
         child->setupPaging();
         return child;
     }
@@ -599,17 +795,14 @@ namespace
 
     osg::BoundingSphere GeomCell::getChildBound() const
     {
-        osg::ref_ptr<GeomGrid> child = new GeomGrid(_size);
-        child->setupData(_feature.get(), _parent);
-        return child->getBound();
+        // the grid covers the same area as the cell outline
+        return getChild(0)->getBound();
     }
 
     osg::Node* GeomCell::build()
     {
-        GeometryCompilerOptions gco;
-        gco.shaderPolicy() = SHADERPOLICY_INHERIT;
-        FeatureNode* node = new FeatureNode(_feature.get(), _style, gco);
-        return node;
+        osg::ref_ptr<GridLines> outline = getGridLines(_square, _size, _size);
+        return createGridNode(outline.get(), _square._geo.get(), _style);
     }
 
     void GeomCell::traverse(osg::NodeVisitor& nv)
@@ -650,7 +843,7 @@ namespace
         osg::Node* loadChild()
         {
             GeomGrid* child = new GeomGrid(100000.0);
-            child->setupData(_feature.get(), _parent);
+            child->setupData(getSQIDSquare(_feature.get()), _parent);
             child->setupPaging();
             return child;
         }
@@ -662,9 +855,8 @@ namespace
 
         osg::BoundingSphere getChildBound() const
         {
-            GeomGrid* child = new GeomGrid(100000.0);
-            child->setupData(_feature.get(), _parent);
-            return child->getBound();
+            // the grid covers the same area as the SQID cell
+            return getChild(0)->getBound();
         }
 
         osg::Node* build()
@@ -836,7 +1028,36 @@ namespace
                 features.push_back( latFeature );
             }
 
-            osg::Node* geomNode = compiler.compile(features, lineStyle, context);
+            osg::Node* geomNode = 0L;
+            if (isSimpleLineStyle(lineStyle))
+            {
+                // Tessellate the lines here (at the same granularity the
+                // compiler would use) and draw them directly. There are over
+                // a thousand GZDs, so this saves a lot of startup time.
+                unsigned tessellation = lineStyle.get<LineSymbol>()->tessellation().getOrUse(20u);
+                osg::ref_ptr<GridLines> lines = new GridLines();
+                for (FeatureList::const_iterator i = features.begin(); i != features.end(); ++i)
+                {
+                    const Geometry* line = i->get()->getGeometry();
+                    const osg::Vec3d& p0 = line->front();
+                    const osg::Vec3d& p1 = line->back();
+                    unsigned parts = osg::maximum(tessellation, (unsigned)ceil((p1 - p0).length()));
+
+                    std::vector<osg::Vec3d> points;
+                    TessellateOperator::tessellateGeo(p0, p1, parts, i->get()->geoInterp().get(), points);
+                    for (unsigned p = 0; p+1 < points.size(); ++p)
+                    {
+                        lines->_segments.push_back(points[p]);
+                        lines->_segments.push_back(points[p+1]);
+                    }
+                }
+                geomNode = createGridNode(lines.get(), extent.getSRS(), lineStyle);
+            }
+            else
+            {
+                geomNode = compiler.compile(features, lineStyle, context);
+            }
+
             if ( geomNode ) 
                 group->addChild( geomNode );
 
@@ -26,6 +26,9 @@
 #include <osgEarth/FeatureSource>
 #include <osgDB/Registry>
 #include <list>
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
 #include <stdio.h>
 #include <stdlib.h>
 #include "vector_tile.pb.h"
@@ -66,7 +69,98 @@ namespace osgEarth { namespace MVT
         return (n >> 1) ^ (-(n & 1));
     }
 
-    Geometry* decodeLine(const mapnik::vector::tile_feature& feature, const TileKey& key, unsigned int tileres)
+    // Maps integer tile coordinates to map coordinates. Computed once
+    // per layer instead of once per vertex.
+    struct TileTransform
+    {
+        TileTransform(const TileKey& key, unsigned int tileres)
+        {
+            const GeoExtent& ex = key.getExtent();
+            x0 = ex.xMin();
+            y0 = ex.yMax();
+            sx = ex.width() / (double)tileres;
+            sy = ex.height() / (double)tileres;
+        }
+        double x0, y0, sx, sy;
+    };
+
+    // Read-only streambuf over a memory block, so the (possibly compressed)
+    // tile blob can be handed to a compressor without copying it.
+    struct MemoryBuffer : public std::streambuf
+    {
+        MemoryBuffer(const char* data, std::size_t len)
+        {
+            char* p = const_cast<char*>(data);
+            setg(p, p, p + len);
+        }
+    };
+
+    // zlib (0x78 ..) or gzip (0x1f 0x8b) header?
+    bool isCompressed(const char* data, std::size_t len)
+    {
+        if (len < 2)
+            return false;
+        unsigned char b0 = (unsigned char)data[0], b1 = (unsigned char)data[1];
+        return
+            (b0 == 0x1f && b1 == 0x8b) ||
+            (b0 == 0x78 && ((b0 << 8) | b1) % 31 == 0);
+    }
+
+    // Converts a layer's value table once, so features that share a value
+    // don't each convert (and copy) the protobuf message.
+    void decodeValues(const mapnik::vector::tile_layer& layer, std::vector<AttributeValue>& output)
+    {
+        output.resize(layer.values().size());
+        for (int i = 0; i < layer.values().size(); ++i)
+        {
+            const mapnik::vector::tile_value& value = layer.values().Get(i);
+            AttributeValue& a = output[i];
+            a.second.set = true;
+
+            if (value.has_bool_value())
+            {
+                a.first = ATTRTYPE_BOOL;
+                a.second.boolValue = value.bool_value();
+            }
+            else if (value.has_double_value())
+            {
+                a.first = ATTRTYPE_DOUBLE;
+                a.second.doubleValue = value.double_value();
+            }
+            else if (value.has_float_value())
+            {
+                a.first = ATTRTYPE_DOUBLE;
+                a.second.doubleValue = value.float_value();
+            }
+            else if (value.has_int_value())
+            {
+                a.first = ATTRTYPE_INT;
+                a.second.intValue = (long long)value.int_value();
+            }
+            else if (value.has_sint_value())
+            {
+                a.first = ATTRTYPE_INT;
+                a.second.intValue = (long long)value.sint_value();
+            }
+            else if (value.has_string_value())
+            {
+                a.first = ATTRTYPE_STRING;
+                a.second.stringValue = value.string_value();
+            }
+            else if (value.has_uint_value())
+            {
+                a.first = ATTRTYPE_INT;
+                a.second.intValue = (long long)value.uint_value();
+            }
+            else
+            {
+                a.first = ATTRTYPE_UNSPECIFIED;
+                a.second.set = false;
+            }
+        }
+    }
+
+    Geometry* decodeLine(const mapnik::vector::tile_feature& feature, const TileTransform& xform)
     {
         unsigned int length = 0;
         int cmd = -1;
@@ -105,11 +199,8 @@ namespace osgEarth { namespace MVT
                     x += px;
                     y += py;
 
-                    double width = key.getExtent().width();
-                    double height = key.getExtent().height();
-
-                    double geoX = key.getExtent().xMin() + (width/(double)tileres) * (double)x;
-                    double geoY = key.getExtent().yMax() - (height/(double)tileres) * (double)y;
+                    double geoX = xform.x0 + xform.sx * (double)x;
+                    double geoY = xform.y0 - xform.sy * (double)y;
 
                     if (currentLine.valid())
                     {
@@ -142,7 +233,7 @@ namespace osgEarth { namespace MVT
         }
     }
 
-    Geometry* decodePoint(const mapnik::vector::tile_feature& feature, const TileKey& key, unsigned int tileres)
+    Geometry* decodePoint(const mapnik::vector::tile_feature& feature, const TileTransform& xform)
     {
         unsigned int length = 0;
         int cmd = -1;
@@ -174,11 +265,8 @@ namespace osgEarth { namespace MVT
                     x += px;
                     y += py;
 
-                    double width = key.getExtent().width();
-                    double height = key.getExtent().height();
-
-                    double geoX = key.getExtent().xMin() + (width/(double)tileres) * (double)x;
-                    double geoY = key.getExtent().yMax() - (height/(double)tileres) * (double)y;
+                    double geoX = xform.x0 + xform.sx * (double)x;
+                    double geoY = xform.y0 - xform.sy * (double)y;
                     geometry->push_back(geoX, geoY, 0);
                 }
             }
@@ -187,7 +275,7 @@ namespace osgEarth { namespace MVT
         return geometry;
     }
 
-    Geometry* decodePolygon(const mapnik::vector::tile_feature& feature, const  TileKey& key, unsigned int tileres)
+    Geometry* decodePolygon(const mapnik::vector::tile_feature& feature, const TileTransform& xform)
     {
         /*
          https://github.com/mapbox/vector-tile-spec/tree/master/2.1
@@ -238,11 +326,8 @@ namespace osgEarth { namespace MVT
                     x += px;
                     y += py;
 
-                    double width = key.getExtent().width();
-                    double height = key.getExtent().height();
-
-                    double geoX = key.getExtent().xMin() + (width/(double)tileres) * (double)x;
-                    double geoY = key.getExtent().yMax() - (height/(double)tileres) * (double)y;
+                    double geoX = xform.x0 + xform.sx * (double)x;
+                    double geoY = xform.y0 - xform.sy * (double)y;
                     currentRing->push_back(geoX, geoY, 0);
                 }
                 else if (cmd == (SEG_CLOSE & ((1 << cmd_bits) - 1)))
@@ -310,83 +395,113 @@ namespace osgEarth { namespace MVT
         }
     }
 
-    bool readTile(std::istream& in, const TileKey& key, FeatureList& features)
+    bool readTile(const char* data, std::size_t len, const TileKey& key, FeatureList& features)
     {
         features.clear();
 
-        // Get the compressor
-        osg::ref_ptr< osgDB::BaseCompressor> compressor = osgDB::Registry::instance()->getObjectWrapperManager()->findCompressor("zlib");
-        if (!compressor.valid())
+        mapnik::vector::tile tile;
+        bool parsed = false;
+
+        if (isCompressed(data, len))
         {
-            return false;
+            // Get the compressor
+            osg::ref_ptr< osgDB::BaseCompressor> compressor = osgDB::Registry::instance()->getObjectWrapperManager()->findCompressor("zlib");
+            if (!compressor.valid())
+            {
+                return false;
+            }
+
+            MemoryBuffer buf(data, len);
+            std::istream in(&buf);
+            std::string value;
+            if (compressor->decompress(in, value))
+            {
+                parsed = tile.ParseFromString(value);
+            }
         }
 
-        // Decompress the tile
-        std::string original((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
-        in.seekg (0, std::ios::beg);
-        std::string value;
-        if (!compressor->decompress(in, value))
+        // uncompressed (or not really compressed after all): parse in place
+        if (!parsed)
         {
-            value = original;
+            parsed = tile.ParseFromArray(data, (int)len);
         }
 
-
-        mapnik::vector::tile tile;
-
-        if (tile.ParseFromString(value))
+        if (parsed)
         {
+            const SpatialReference* srs = key.getProfile()->getSRS();
+            std::vector<AttributeValue> values;
+
             for (int i = 0; i < tile.layers().size(); i++)
             {
                 const mapnik::vector::tile_layer &layer = tile.layers().Get(i);
 
+                TileTransform xform(key, layer.extent());
+                decodeValues(layer, values);
+
                 for (int j = 0; j < layer.features().size(); j++)
                 {
                     const mapnik::vector::tile_feature &feature = layer.features().Get(j);
 
-                    osg::ref_ptr< Feature > oeFeature = new Feature(0, key.getProfile()->getSRS());
+                    // Decode the geometry first so rejected features never touch the attributes
+                    osg::ref_ptr< osgEarth::Geometry > geometry;
+
+                    eGeomType geomType = static_cast<eGeomType>(feature.type());
+                    if (geomType == MVT::Polygon)
+                    {
+                        geometry = decodePolygon(feature, xform);
+                    }
+                    else if (geomType == MVT::LineString)
+                    {
+                        geometry = decodeLine(feature, xform);
+                    }
+                    else if (geomType == MVT::Point)
+                    {
+                        geometry = decodePoint(feature, xform);
+
+                        // This is a bit of a hack, but if a point is outside of the extents we remove it.
+                        // Lines and Polygons that extend outside of the tileset we keep though b/c we assume that they are just slightly going outside of the
+                        // extent.  Should probably make this an option somewhere.
+                        if (geometry)
+                        {
+                            if (!key.getExtent().contains(geometry->getBounds().center()))
+                            {
+                                geometry = NULL;
+                            }
+                        }
+                    }
+                    else
+                    {
+                        geometry = decodeLine(feature, xform);
+                    }
+
+                    if (!geometry)
+                        continue;
+
+                    osg::ref_ptr< Feature > oeFeature = new Feature(0, srs);
 
                     // Set the layer name as "mvt_layer" so we can filter it later
                     oeFeature->set("mvt_layer", layer.name());
 
                     // Read attributes
-                    for (int k = 0; k < feature.tags().size(); k+=2)
+                    for (int k = 0; k + 1 < feature.tags().size(); k+=2)
                     {
-                        std::string key = layer.keys().Get(feature.tags().Get(k));
-                        mapnik::vector::tile_value value = layer.values().Get(feature.tags().Get(k+1));
+                        unsigned keyIndex = feature.tags().Get(k);
+                        unsigned valueIndex = feature.tags().Get(k+1);
+                        if ((int)keyIndex >= layer.keys().size() || valueIndex >= values.size())
+                            continue;
 
-                        if (value.has_bool_value())
-                        {
-                            oeFeature->set(key, value.bool_value());
-                        }
-                        else if (value.has_double_value())
-                        {
-                            oeFeature->set(key, value.double_value());
-                        }
-                        else if (value.has_float_value())
-                        {
-                            oeFeature->set(key, value.float_value());
-                        }
-                        else if (value.has_int_value())
-                        {
-                            oeFeature->set(key, (long long)value.int_value());
-                        }
-                        else if (value.has_sint_value())
-                        {
-                            oeFeature->set(key, (long long)value.sint_value());
-                        }
-                        else if (value.has_string_value())
-                        {
-                            oeFeature->set(key, value.string_value());
-                        }
-                        else if (value.has_uint_value())
+                        const std::string& key = layer.keys().Get(keyIndex);
+                        const AttributeValue& value = values[valueIndex];
+
+                        if (value.second.set)
                         {
-                            oeFeature->set(key, (long long)value.uint_value());
+                            oeFeature->set(key, value);
                         }
 
                         // Special path for getting heights from our test dataset.
-                        if (key == "other_tags")
+                        if (key == "other_tags" && value.first == ATTRTYPE_STRING)
                         {
-                            std::string other_tags = value.string_value();
+                            const std::string& other_tags = value.second.stringValue;
 
                             StringTokenizer tok("=>");
                             StringVector tized;
@@ -407,55 +522,287 @@ namespace osgEarth { namespace MVT
                         }
                     }
 
+                    oeFeature->setGeometry( geometry.get() );
+                    features.push_back(oeFeature.get());
+                }
+            }
+        }
+        else
+        {
+            OE_WARN << "Failed to parse mvt" << key.str() << std::endl;
+            return false;
+        }
 
+        return true;
+    }
 
-                    osg::ref_ptr< osgEarth::Geometry > geometry;
+    bool readTile(std::istream& in, const TileKey& key, FeatureList& features)
+    {
+        std::string buffer((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        return readTile(buffer.data(), buffer.size(), key, features);
+    }
 
-                    eGeomType geomType = static_cast<eGeomType>(feature.type());
-                    if (geomType == MVT::Polygon)
-                    {
-                        geometry = decodePolygon(feature, key, layer.extent());
-                    }
-                    else if (geomType == MVT::LineString)
-                    {
-                        geometry = decodeLine(feature, key, layer.extent());
-                    }
-                    else if (geomType == MVT::Point)
-                    {
-                        geometry = decodePoint(feature, key, layer.extent());
+    inline unsigned zig_zag_encode(int n)
+    {
+        return (unsigned)((n << 1) ^ (n >> 31));
+    }
 
-                        // This is a bit of a hack, but if a point is outside of the extents we remove it.
-                        // Lines and Polygons that extend outside of the tileset we keep though b/c we assume that they are just slightly going outside of the
-                        // extent.  Should probably make this an option somewhere.
-                        if (geometry)
-                        {
-                            if (!key.getExtent().contains(geometry->getBounds().center()))
-                            {
-                                geometry = NULL;
-                            }
-                        }
-                    }
-                    else
-                    {
-                        geometry = decodeLine(feature, key, layer.extent());
-                    }
+    inline unsigned command(int cmd, unsigned count)
+    {
+        return (count << CMD_BITS) | (cmd & ((1 << CMD_BITS) - 1));
+    }
 
-                    if (geometry)
-                    {
-                        oeFeature->setGeometry( geometry.get() );
-                        features.push_back(oeFeature.get());
-                    }
+    typedef std::vector<std::pair<int, int> > TilePoints;
+
+    // Writes the geometry commands of one feature, keeping track of the
+    // cursor across parts as the deltas require.
+    struct GeometryEncoder
+    {
+        GeometryEncoder(const TileTransform& xform, mapnik::vector::tile_feature* feature) :
+            _xform(xform), _feature(feature), _x(0), _y(0) { }
+
+        // Quantizes a part to tile coordinates, dropping repeated points.
+        void quantize(const Geometry* part, bool ring, TilePoints& pts) const
+        {
+            pts.clear();
+            for (Geometry::const_iterator i = part->begin(); i != part->end(); ++i)
+            {
+                int x = (int)floor((i->x() - _xform.x0) / _xform.sx + 0.5);
+                int y = (int)floor((_xform.y0 - i->y()) / _xform.sy + 0.5);
+                if (pts.empty() || pts.back().first != x || pts.back().second != y)
+                    pts.push_back(std::make_pair(x, y));
+            }
+            if (ring && pts.size() > 1 && pts.front() == pts.back())
+                pts.pop_back();
+        }
+
+        void point(const std::pair<int, int>& p)
+        {
+            _feature->add_geometry(zig_zag_encode(p.first - _x));
+            _feature->add_geometry(zig_zag_encode(p.second - _y));
+            _x = p.first, _y = p.second;
+        }
 
+        void points(const TilePoints& pts)
+        {
+            _feature->add_geometry(command(CMD_MOVETO, pts.size()));
+            for (TilePoints::const_iterator p = pts.begin(); p != pts.end(); ++p)
+                point(*p);
+        }
+
+        void path(const TilePoints& pts, bool ring)
+        {
+            _feature->add_geometry(command(CMD_MOVETO, 1));
+            point(pts[0]);
+            _feature->add_geometry(command(CMD_LINETO, pts.size() - 1));
+            for (unsigned i = 1; i < pts.size(); ++i)
+                point(pts[i]);
+            if (ring)
+                _feature->add_geometry(command(CMD_CLOSEPATH, 1));
+        }
+
+        // Signed area in tile coordinates (y down), positive if clockwise on screen
+        static double area(const TilePoints& pts)
+        {
+            double a = 0.0;
+            for (unsigned i = 0; i < pts.size(); ++i)
+            {
+                const std::pair<int, int>& p = pts[i];
+                const std::pair<int, int>& q = pts[(i + 1) % pts.size()];
+                a += (double)p.first * (double)q.second - (double)q.first * (double)p.second;
+            }
+            return 0.5 * a;
+        }
+
+        // The spec wants exterior rings clockwise in tile coordinates, and holes
+        // counter-clockwise: the reverse of what the reader expects on the map.
+        bool ring(const Geometry* part, bool exterior, TilePoints& pts)
+        {
+            quantize(part, true, pts);
+            if (pts.size() < 3)
+                return false;
+            double a = area(pts);
+            if (a == 0.0)
+                return false;
+            if ((a > 0.0) != exterior)
+                std::reverse(pts.begin(), pts.end());
+            path(pts, true);
+            return true;
+        }
+
+        bool encode(const Geometry* geom)
+        {
+            TilePoints pts;
+            bool wrote = false;
+
+            if (geom->getType() == Geometry::TYPE_MULTI)
+            {
+                const GeometryCollection& c = static_cast<const MultiGeometry*>(geom)->getComponents();
+                for (GeometryCollection::const_iterator i = c.begin(); i != c.end(); ++i)
+                    wrote = encode(i->get()) || wrote;
+            }
+            else if (geom->getType() == Geometry::TYPE_POLYGON)
+            {
+                if (ring(geom, true, pts))
+                {
+                    wrote = true;
+                    const RingCollection& holes = static_cast<const osgEarth::Polygon*>(geom)->getHoles();
+                    for (RingCollection::const_iterator i = holes.begin(); i != holes.end(); ++i)
+                        ring(i->get(), false, pts);
+                }
+            }
+            else if (geom->getType() == Geometry::TYPE_RING)
+            {
+                wrote = ring(geom, true, pts);
+            }
+            else if (geom->getType() == Geometry::TYPE_LINESTRING)
+            {
+                quantize(geom, false, pts);
+                if (pts.size() >= 2)
+                {
+                    path(pts, false);
+                    wrote = true;
+                }
+            }
+            else if (geom->getType() == Geometry::TYPE_POINTSET)
+            {
+                quantize(geom, false, pts);
+                if (!pts.empty())
+                {
+                    points(pts);
+                    wrote = true;
                 }
             }
+            return wrote;
         }
-        else
+
+        const TileTransform& _xform;
+        mapnik::vector::tile_feature* _feature;
+        int _x, _y;
+    };
+
+    eGeomType getGeomType(const Geometry* geom)
+    {
+        switch (geom->getComponentType())
         {
-            OE_WARN << "Failed to parse mvt" << key.str() << std::endl;
-            return false;
+        case Geometry::TYPE_POLYGON:
+        case Geometry::TYPE_RING:
+            return MVT::Polygon;
+        case Geometry::TYPE_LINESTRING:
+            return MVT::LineString;
+        case Geometry::TYPE_POINTSET:
+            return MVT::Point;
+        default:
+            return MVT::Unknown;
         }
+    }
 
-        return true;
+    // Builds the layer's key and value tables, sharing entries between features.
+    struct TagTable
+    {
+        TagTable(mapnik::vector::tile_layer* layer) : _layer(layer) { }
+
+        unsigned key(const std::string& name)
+        {
+            std::map<std::string, unsigned>::iterator i = _keys.find(name);
+            if (i != _keys.end())
+                return i->second;
+            unsigned index = _keys.size();
+            _layer->add_keys(name);
+            return _keys[name] = index;
+        }
+
+        // returns false for values MVT can't hold
+        bool value(const AttributeValue& a, unsigned& index)
+        {
+            std::stringstream buf;
+            buf << std::setprecision(17) << (int)a.first << ':';
+            switch (a.first)
+            {
+            case ATTRTYPE_STRING: buf << a.second.stringValue; break;
+            case ATTRTYPE_INT:    buf << a.second.intValue; break;
+            case ATTRTYPE_DOUBLE: buf << a.second.doubleValue; break;
+            case ATTRTYPE_BOOL:   buf << a.second.boolValue; break;
+            default: return false;
+            }
+
+            std::string id = buf.str();
+            std::map<std::string, unsigned>::iterator i = _values.find(id);
+            if (i != _values.end())
+            {
+                index = i->second;
+                return true;
+            }
+
+            index = _values.size();
+            mapnik::vector::tile_value* v = _layer->add_values();
+            switch (a.first)
+            {
+            case ATTRTYPE_STRING: v->set_string_value(a.second.stringValue); break;
+            case ATTRTYPE_INT:    v->set_sint_value(a.second.intValue); break;
+            case ATTRTYPE_DOUBLE: v->set_double_value(a.second.doubleValue); break;
+            default:              v->set_bool_value(a.second.boolValue); break;
+            }
+            _values[id] = index;
+            return true;
+        }
+
+        mapnik::vector::tile_layer* _layer;
+        std::map<std::string, unsigned> _keys;
+        std::map<std::string, unsigned> _values;
+    };
+
+    bool writeTile(const FeatureList& features, const TileKey& key, const std::string& layerName, std::string& output, unsigned extent)
+    {
+        mapnik::vector::tile tile;
+        mapnik::vector::tile_layer* layer = tile.add_layers();
+        layer->set_version(2);
+        layer->set_name(layerName);
+        layer->set_extent(extent);
+
+        TileTransform xform(key, extent);
+        TagTable tags(layer);
+
+        for (FeatureList::const_iterator i = features.begin(); i != features.end(); ++i)
+        {
+            const Feature* f = i->get();
+            const Geometry* geom = f ? f->getGeometry() : 0L;
+            if (!geom)
+                continue;
+
+            eGeomType type = getGeomType(geom);
+            if (type == MVT::Unknown)
+                continue;
+
+            mapnik::vector::tile_feature* feature = layer->add_features();
+            GeometryEncoder encoder(xform, feature);
+            if (!encoder.encode(geom))
+            {
+                layer->mutable_features()->RemoveLast();
+                continue;
+            }
+
+            feature->set_type(static_cast<mapnik::vector::tile_GeomType>(type));
+            if (f->getFID() >= 0)
+                feature->set_id((unsigned long long)f->getFID());
+
+            const AttributeTable& attrs = f->getAttrs();
+            for (AttributeTable::const_iterator a = attrs.begin(); a != attrs.end(); ++a)
+            {
+                // the reader puts the layer name here
+                if (!a->second.second.set || a->first == "mvt_layer")
+                    continue;
+
+                unsigned value;
+                if (tags.value(a->second, value))
+                {
+                    feature->add_tags(tags.key(a->first));
+                    feature->add_tags(value);
+                }
+            }
+        }
+
+        return tile.SerializeToString(&output);
     }
 
 }} // namespace osgEarth::MVT
@@ -467,13 +814,16 @@ MVTFeatureSourceOptions::getConfig() const
 {
     Config conf = FeatureSource::Options::getConfig();
     conf.set("url", url());
+    conf.set("tile_cache_size", tileCacheSize());
     return conf;
 }
 
 void
 MVTFeatureSourceOptions::fromConfig(const Config& conf)
 {
+    tileCacheSize().init(32u);
     conf.get("url", url());
+    conf.get("tile_cache_size", tileCacheSize());
 }
 
 //........................................................................
@@ -513,6 +863,9 @@ MVTFeatureSource::init()
     _maxLevel = 14u;
     _database = 0L;
 
+    _tileCache.clear();
+    _tileCache.setMaxSize(options().tileCacheSize().get());
+
     _compressor = osgDB::Registry::instance()->getObjectWrapperManager()->findCompressor("zlib");
     if (!_compressor.valid())
     {
@@ -531,6 +884,68 @@ MVTFeatureSource::createFeatureCursorImplementation(const Query& query, Progress
 
     TileKey key = *query.tileKey();
 
+    FeatureList features;
+
+    // Recently decoded tile? Filters modify features in place, so hand out copies.
+    if (options().tileCacheSize() > 0u)
+    {
+        LRUCache<TileKey, FeatureList>::Record record;
+        bool hit;
+        {
+            Threading::ScopedMutexLock lock(_tileCacheMutex);
+            hit = _tileCache.get(key, record);
+        }
+        if (hit)
+        {
+            for (FeatureList::const_iterator i = record.value().begin(); i != record.value().end(); ++i)
+            {
+                features.push_back(new Feature(*i->get()));
+            }
+        }
+        else
+        {
+            readTileFromDatabase(key, features);
+
+            FeatureList cached;
+            for (FeatureList::const_iterator i = features.begin(); i != features.end(); ++i)
+            {
+                cached.push_back(new Feature(*i->get()));
+            }
+            Threading::ScopedMutexLock lock(_tileCacheMutex);
+            _tileCache.insert(key, cached);
+        }
+    }
+    else
+    {
+        readTileFromDatabase(key, features);
+    }
+
+    // apply filters before returning.
+    applyFilters(features, query.tileKey()->getExtent());
+
+    // If we have any features and we have an fid attribute, override the fid of the features
+    if (options().fidAttribute().isSet())
+    {
+        for (FeatureList::iterator itr = features.begin(); itr != features.end(); ++itr)
+        {
+            std::string attr = itr->get()->getString(options().fidAttribute().get());
+            FeatureID fid = as<FeatureID>(attr, 0);
+            itr->get()->setFID(fid);
+        }
+    }
+
+    if (!features.empty())
+    {
+        //OE_NOTICE << "Returning " << features.size() << " features" << std::endl;
+        return new FeatureListCursor(features);
+    }
+
+    return 0;
+}
+
+bool
+MVTFeatureSource::readTileFromDatabase(const TileKey& key, FeatureList& features)
+{
     int z = key.getLevelOfDetail();
     int tileX = key.getTileX();
     int tileY = key.getTileY();
@@ -547,7 +962,7 @@ MVTFeatureSource::createFeatureCursorImplementation(const Query& query, Progress
     {
         OE_WARN << LC << "Failed to prepare SQL: " << queryStr << "; "
             << sqlite3_errmsg((sqlite3*)_database) << std::endl;
-        return NULL;
+        return false;
     }
 
     bool valid = true;
@@ -558,16 +973,13 @@ MVTFeatureSource::createFeatureCursorImplementation(const Query& query, Progress
 
     rc = sqlite3_step(select);
 
-    FeatureList features;
-
     if (rc == SQLITE_ROW)
     {
-        // the pointer returned from _blob gets freed internally by sqlite, supposedly
+        // the pointer returned from _blob gets freed internally by sqlite, supposedly;
+        // it stays valid until the statement is finalized, so decode straight from it.
         const char* data = (const char*)sqlite3_column_blob(select, 0);
         int dataLen = sqlite3_column_bytes(select, 0);
-        std::string dataBuffer(data, dataLen);
-        std::stringstream in(dataBuffer);
-        MVT::readTile(in, key, features);
+        valid = MVT::readTile(data, dataLen, key, features);
     }
     else
     {
@@ -576,28 +988,7 @@ MVTFeatureSource::createFeatureCursorImplementation(const Query& query, Progress
     }
 
     sqlite3_finalize(select);
-
-    // apply filters before returning.
-    applyFilters(features, query.tileKey()->getExtent());
-
-    // If we have any features and we have an fid attribute, override the fid of the features
-    if (options().fidAttribute().isSet())
-    {
-        for (FeatureList::iterator itr = features.begin(); itr != features.end(); ++itr)
-        {
-            std::string attr = itr->get()->getString(options().fidAttribute().get());
-            FeatureID fid = as<FeatureID>(attr, 0);
-            itr->get()->setFID(fid);
-        }
-    }
-
-    if (!features.empty())
-    {
-        //OE_NOTICE << "Returning " << features.size() << " features" << std::endl;
-        return new FeatureListCursor(features);
-    }
-
-    return 0;
+    return valid;
 }
 
 void
@@ -656,8 +1047,6 @@ MVTFeatureSource::iterateTiles(int zoomLevel, int limit, int offset, const GeoEx
         // the pointer returned from _blob gets freed internally by sqlite, supposedly
         const char* data = (const char*)sqlite3_column_blob(select, 3);
         int dataLen = sqlite3_column_bytes(select, 3);
-        std::string dataBuffer(data, dataLen);
-        std::stringstream in(dataBuffer);
 
         FeatureList features;
 
@@ -674,7 +1063,7 @@ MVTFeatureSource::iterateTiles(int zoomLevel, int limit, int offset, const GeoEx
         }
 
 
-        MVT::readTile(in, key, features);
+        MVT::readTile(data, dataLen, key, features);
 
         // apply filters before returning.
         applyFilters(features, key.getExtent());
@@ -19,11 +19,101 @@
 #include <osgEarth/Map>
 #include <osgEarth/MapModelChange>
 #include <osgEarth/Registry>
+#include <osgEarth/VisibleLayer>
+#include <osg/Timer>
+#include <algorithm>
+#include <set>
+#include <unordered_map>
 
 using namespace osgEarth;
 
 #define LC "[Map] "
 
+namespace
+{
+    // Layers from one call to Map::addLayers(), opening on the job system.
+    // A layer starts when every layer it depends on is done.
+    struct LayerOpenBatch : public osg::Referenced
+    {
+        LayerVector _layers;
+        std::vector<std::vector<unsigned> > _dependents;
+        std::vector<unsigned> _numWaitingOn;
+        std::vector<bool> _done;
+        unsigned _numDone;
+        Threading::JobArena* _arena;
+        Threading::Mutex _mutex;
+        Threading::Event _allDone;
+
+        LayerOpenBatch() : _numDone(0u), _arena(nullptr) { }
+
+        bool isDone(unsigned i)
+        {
+            Threading::ScopedMutexLock lock(_mutex);
+            return _done[i];
+        }
+
+        void start(unsigned i)
+        {
+            osg::ref_ptr<LayerOpenBatch> batch(this);
+            Threading::runInJobArena(_arena, [batch, i]()
+            {
+                Layer* layer = batch->_layers[i].get();
+                std::string activity = "Open layer " + layer->getName();
+                Registry::instance()->startActivity(activity);
+
+                osg::Timer_t t0 = osg::Timer::instance()->tick();
+                layer->open();
+
+                OE_INFO << LC << "Opened layer \"" << layer->getName() << "\" in "
+                    << osg::Timer::instance()->delta_s(t0, osg::Timer::instance()->tick()) << "s"
+                    << (layer->isOpen() ? "" : " (failed)") << std::endl;
+
+                Registry::instance()->endActivity(activity);
+                batch->finish(i);
+            });
+        }
+
+        void finish(unsigned i)
+        {
+            std::vector<unsigned> next;
+            {
+                Threading::ScopedMutexLock lock(_mutex);
+                _done[i] = true;
+                for (auto d : _dependents[i])
+                    if (--_numWaitingOn[d] == 0u)
+                        next.push_back(d);
+                if (++_numDone == _layers.size())
+                    _allDone.set();
+            }
+            for (auto d : next)
+                start(d);
+        }
+    };
+
+    // Collects the layers named anywhere in a layer's configuration,
+    // except by its own top-level "name"
+    void findLayerNames(
+        const Config& conf,
+        const std::unordered_map<std::string, unsigned>& indexOfName,
+        bool topLevel,
+        std::set<unsigned>& output)
+    {
+        if (!topLevel)
+        {
+            auto i = indexOfName.find(conf.value());
+            if (i != indexOfName.end())
+                output.insert(i->second);
+        }
+
+        for (auto& child : conf.children())
+        {
+            if (topLevel && child.key() == "name")
+                continue;
+            findLayerNames(child, indexOfName, false, output);
+        }
+    }
+}
+
 //...................................................................
 
 Map::LayerCB::LayerCB(Map* map) : _map(map) { }
@@ -60,6 +150,9 @@ Map::Options::getConfig() const
     conf.set( "elevation_interpolation", "triangulate", elevationInterpolation(), INTERP_TRIANGULATE);
 
     conf.set( "profile_layer", profileLayer() );
+    conf.set( "open_layers_in_parallel", openLayersInParallel() );
+    conf.set( "layer_open_timeout", layerOpenTimeout() );
+    conf.set( "open_layers_on_demand", openLayersOnDemand() );
 
     return conf;
 }
@@ -68,7 +161,9 @@ void
 Map::Options::fromConfig(const Config& conf)
 {
     elevationInterpolation().init(INTERP_BILINEAR);
-    
+    openLayersInParallel().init(true);
+    openLayersOnDemand().init(false);
+
     conf.get( "name",         name() );
     conf.get( "profile",      profile() );
     conf.get( "cache",        cache() );  
@@ -87,6 +182,9 @@ Map::Options::fromConfig(const Config& conf)
     conf.get( "elevation_interpolation", "triangulate", elevationInterpolation(), INTERP_TRIANGULATE);
 
     conf.get( "profile_layer", profileLayer() );
+    conf.get( "open_layers_in_parallel", openLayersInParallel() );
+    conf.get( "layer_open_timeout", layerOpenTimeout() );
+    conf.get( "open_layers_on_demand", openLayersOnDemand() );
 }
 
 //...................................................................
@@ -187,6 +285,15 @@ Map::getElevationPool() const
 void
 Map::notifyOnLayerOpenOrClose(Layer* layer)
 {
+    // An open on demand can happen on any thread (in a data query), so
+    // hold the news for the update traversal.
+    if (layer->_openingOnDemand)
+    {
+        Threading::ScopedMutexLock lock(_layersOpenedOnDemand.mutex());
+        _layersOpenedOnDemand.push_back(layer);
+        return;
+    }
+
     // bump the revision safely:
     Revision newRevision;
     {
@@ -407,7 +514,10 @@ Map::addLayer(Layer* layer)
 
     layer->setReadOptions(getReadOptions());
 
-    layer->open();
+    if (shouldDeferOpen(layer))
+        layer->deferOpen();
+    else
+        layer->open();
 
     // do we need this? Won't the callback to this?
     if (layer->isOpen() && getProfile() != NULL)
@@ -454,8 +564,17 @@ Map::insertLayer(Layer* layer, unsigned index)
 
     layer->setReadOptions(getReadOptions());
 
-    layer->open();
+    if (shouldDeferOpen(layer))
+        layer->deferOpen();
+    else
+        layer->open();
 
+    insertOpenedLayer(layer, index);
+}
+
+void
+Map::insertOpenedLayer(Layer* layer, unsigned index)
+{
     if (layer->isOpen() && getProfile() != NULL)
     {
         layer->addedToMap(this);
@@ -596,18 +715,80 @@ Map::addLayers(const LayerVector& layers)
 
     //osgEarth::Registry::instance()->clearBlacklist();
 
-    for(LayerVector::const_iterator layerRef = layers.begin();
-        layerRef != layers.end();
-        ++layerRef)
+    // Layers still opening when this returns join the map later,
+    // in addLayersOpenedInBackground().
+    std::vector<PendingLayer> pending;
+    std::set<Layer*> opening;
+
+    // Invisible layers can wait until they're needed, unless another
+    // layer in the batch refers to them by name.
+    LayerVector toOpen;
+    if (options().openLayersOnDemand() == true)
     {
-        Layer* layer = layerRef->get();
-        if ( !layer )
-            continue;
+        std::unordered_map<std::string, unsigned> indexOfName;
+        for (unsigned i = 0; i < layers.size(); ++i)
+            if (layers[i].valid() && !layers[i]->getName().empty())
+                indexOfName[layers[i]->getName()] = i;
 
-        layer->setReadOptions(getReadOptions());
+        std::set<unsigned> referenced;
+        for (unsigned i = 0; i < layers.size(); ++i)
+        {
+            if (!layers[i].valid())
+                continue;
+            std::set<unsigned> names;
+            findLayerNames(layers[i]->getConfig(), indexOfName, true, names);
+            names.erase(i);
+            referenced.insert(names.begin(), names.end());
+        }
 
-        // open, but don't call addedToMap(layer) yet.
-        layer->open();
+        unsigned numDeferred = 0u;
+        for (unsigned i = 0; i < layers.size(); ++i)
+        {
+            Layer* layer = layers[i].get();
+            if (layer && referenced.count(i) == 0 && shouldDeferOpen(layer))
+            {
+                layer->setReadOptions(getReadOptions());
+                layer->deferOpen();
+                ++numDeferred;
+            }
+            else
+            {
+                toOpen.push_back(layers[i]);
+            }
+        }
+
+        if (numDeferred > 0u)
+        {
+            OE_INFO << LC << numDeferred << " invisible layer(s) will open on demand" << std::endl;
+        }
+    }
+    else
+    {
+        toOpen = layers;
+    }
+
+    if (options().openLayersInParallel() == true && toOpen.size() > 1)
+    {
+        openLayersInParallel(toOpen, pending);
+
+        for (auto& p : pending)
+            opening.insert(p._layer.get());
+    }
+    else
+    {
+        for(LayerVector::const_iterator layerRef = toOpen.begin();
+            layerRef != toOpen.end();
+            ++layerRef)
+        {
+            Layer* layer = layerRef->get();
+            if ( !layer )
+                continue;
+
+            layer->setReadOptions(getReadOptions());
+
+            // open, but don't call addedToMap(layer) yet.
+            layer->open();
+        }
     }
 
     unsigned firstIndex;
@@ -626,7 +807,7 @@ Map::addLayers(const LayerVector& layers)
             ++layerRef)
         {
             Layer* layer = layerRef->get();
-            if ( !layer )
+            if ( !layer || opening.count(layer) > 0 )
                 continue;
 
             _layers.push_back( layer );
@@ -641,7 +822,7 @@ Map::addLayers(const LayerVector& layers)
         ++layerRef)
     {
         Layer* layer = layerRef->get();
-        if ( !layer )
+        if ( !layer || opening.count(layer) > 0 )
             continue;
 
         if (layer->isOpen() && getProfile() != NULL)
@@ -659,6 +840,244 @@ Map::addLayers(const LayerVector& layers)
                 MapModelChange::ADD_LAYER, newRevision, layer, index++));
         }
     }
+
+    if (!pending.empty())
+    {
+        OE_INFO << LC << pending.size() << " layer(s) will finish opening in the background" << std::endl;
+
+        Threading::ScopedMutexLock lock(_pendingLayers.mutex());
+        _pendingLayers.insert(_pendingLayers.end(), pending.begin(), pending.end());
+    }
+}
+
+bool
+Map::shouldDeferOpen(const Layer* layer) const
+{
+    if (options().openLayersOnDemand() != true || layer->isOpen())
+        return false;
+
+    const VisibleLayer* visibleLayer = dynamic_cast<const VisibleLayer*>(layer);
+    return visibleLayer && visibleLayer->getEnabled() && !visibleLayer->getVisible();
+}
+
+void
+Map::openLayersInParallel(const LayerVector& layers, std::vector<PendingLayer>& out_pending)
+{
+    osg::ref_ptr<LayerOpenBatch> batch = new LayerOpenBatch();
+
+    for (auto& layer : layers)
+    {
+        if (layer.valid())
+        {
+            layer->setReadOptions(getReadOptions());
+            batch->_layers.push_back(layer);
+        }
+    }
+
+    unsigned numLayers = batch->_layers.size();
+    batch->_dependents.resize(numLayers);
+    batch->_numWaitingOn.assign(numLayers, 0u);
+    batch->_done.assign(numLayers, false);
+
+    // A layer that names another layer in the batch (a LayerReference,
+    // a composite's components, a mask or clamping source) opens after it.
+    std::unordered_map<std::string, unsigned> indexOfName;
+    for (unsigned i = 0; i < numLayers; ++i)
+    {
+        const std::string& name = batch->_layers[i]->getName();
+        if (!name.empty())
+            indexOfName[name] = i;
+    }
+
+    for (unsigned i = 0; i < numLayers; ++i)
+    {
+        std::set<unsigned> dependencies;
+        findLayerNames(batch->_layers[i]->getConfig(), indexOfName, true, dependencies);
+        dependencies.erase(i);
+
+        for (auto d : dependencies)
+        {
+            batch->_dependents[d].push_back(i);
+            ++batch->_numWaitingOn[i];
+        }
+    }
+
+    // Layers caught in a dependency cycle would never open, so drop
+    // what they wait on and open them in any order.
+    std::vector<unsigned> waitingOn = batch->_numWaitingOn;
+    std::vector<unsigned> ready;
+    for (unsigned i = 0; i < numLayers; ++i)
+        if (waitingOn[i] == 0u)
+            ready.push_back(i);
+
+    while (!ready.empty())
+    {
+        unsigned d = ready.back();
+        ready.pop_back();
+        for (auto i : batch->_dependents[d])
+            if (--waitingOn[i] == 0u)
+                ready.push_back(i);
+    }
+
+    for (unsigned i = 0; i < numLayers; ++i)
+    {
+        if (waitingOn[i] > 0u)
+        {
+            OE_WARN << LC << "Layer \"" << batch->_layers[i]->getName()
+                << "\" is part of a dependency cycle" << std::endl;
+
+            batch->_numWaitingOn[i] = 0u;
+            for (auto& dependents : batch->_dependents)
+                dependents.erase(std::remove(dependents.begin(), dependents.end(), i), dependents.end());
+        }
+    }
+
+    osg::Timer_t startTime = osg::Timer::instance()->tick();
+
+    batch->_arena = Registry::instance()->getJobArena("layers.open");
+
+    if (numLayers == 0u)
+        batch->_allDone.set();
+
+    std::vector<unsigned> roots;
+    for (unsigned i = 0; i < numLayers; ++i)
+        if (batch->_numWaitingOn[i] == 0u)
+            roots.push_back(i);
+
+    for (auto i : roots)
+        batch->start(i);
+
+    // Wait for the batch; Event::wait() may wake early, hence the loop.
+    if (options().layerOpenTimeout().isSet())
+    {
+        double timeout = std::max(options().layerOpenTimeout().get(), 0.0f);
+        double elapsed;
+        while (!batch->_allDone.isSet() &&
+            (elapsed = osg::Timer::instance()->delta_s(startTime, osg::Timer::instance()->tick())) < timeout)
+        {
+            batch->_allDone.wait((unsigned)std::max(1.0, (timeout - elapsed) * 1000.0));
+        }
+    }
+    else
+    {
+        while (!batch->_allDone.isSet())
+            batch->_allDone.wait();
+    }
+
+    Threading::ScopedMutexLock lock(batch->_mutex);
+
+    for (unsigned i = 0; i < numLayers; ++i)
+    {
+        if (!batch->_done[i])
+        {
+            PendingLayer p;
+            p._layer = batch->_layers[i];
+            p._batch = batch.get();
+            p._index = i;
+            out_pending.push_back(p);
+        }
+    }
+
+    OE_INFO << LC << "Opened " << (numLayers - out_pending.size()) << " of " << numLayers
+        << " layers in " << osg::Timer::instance()->delta_s(startTime, osg::Timer::instance()->tick())
+        << "s" << std::endl;
+}
+
+unsigned
+Map::getNumLayersOpening() const
+{
+    Threading::ScopedMutexLock lock(_pendingLayers.mutex());
+    return _pendingLayers.size();
+}
+
+void
+Map::addLayersOpenedInBackground()
+{
+    LayerVector openedOnDemand;
+    {
+        Threading::ScopedMutexLock lock(_layersOpenedOnDemand.mutex());
+        openedOnDemand.swap(_layersOpenedOnDemand);
+    }
+
+    for (auto& layer : openedOnDemand)
+    {
+        if (layer->isOpen() && getIndexOfLayer(layer.get()) != getNumLayers())
+            notifyOnLayerOpenOrClose(layer.get());
+    }
+
+    std::vector<PendingLayer> opened;
+    {
+        Threading::ScopedMutexLock lock(_pendingLayers.mutex());
+        if (_pendingLayers.empty())
+            return;
+
+        for (auto p = _pendingLayers.begin(); p != _pendingLayers.end(); )
+        {
+            LayerOpenBatch* batch = static_cast<LayerOpenBatch*>(p->_batch.get());
+            if (batch->isDone(p->_index))
+            {
+                opened.push_back(*p);
+                p = _pendingLayers.erase(p);
+            }
+            else ++p;
+        }
+    }
+
+    for (auto& p : opened)
+    {
+        Layer* layer = p._layer.get();
+
+        // already added by someone else?
+        if (getIndexOfLayer(layer) != getNumLayers())
+            continue;
+
+        // Keep the order of addLayers(): land after the nearest layer that
+        // preceded this one in its batch, or before the nearest that
+        // followed it, whichever is in the map.
+        LayerOpenBatch* batch = static_cast<LayerOpenBatch*>(p._batch.get());
+        unsigned numLayers = getNumLayers();
+        unsigned index = numLayers;
+
+        for (int i = (int)p._index - 1; i >= 0 && index == numLayers; --i)
+        {
+            unsigned k = getIndexOfLayer(batch->_layers[i].get());
+            if (k < numLayers)
+                index = k + 1;
+        }
+
+        if (index == numLayers)
+        {
+            for (unsigned i = p._index + 1; i < batch->_layers.size(); ++i)
+            {
+                unsigned k = getIndexOfLayer(batch->_layers[i].get());
+                if (k < numLayers)
+                {
+                    index = k;
+                    break;
+                }
+            }
+        }
+
+        insertOpenedLayer(layer, index);
+    }
+}
+
+void
+Map::reopenLayersWithNewerMetadata()
+{
+    LayerVector layers;
+    getLayers(layers);
+
+    for (auto& layer : layers)
+    {
+        TileLayer* tileLayer = dynamic_cast<TileLayer*>(layer.get());
+        if (tileLayer && tileLayer->isOpen() && tileLayer->hasNewerMetadata())
+        {
+            OE_INFO << LC << "Reopening layer \"" << layer->getName() << "\" with new source metadata" << std::endl;
+            tileLayer->close();
+            tileLayer->open();
+        }
+    }
 }
 
 void
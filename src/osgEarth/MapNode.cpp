@@ -31,6 +31,8 @@
 #include <osgEarth/GLUtils>
 #include <osgEarth/HorizonClipPlane>
 #include <osgEarth/SceneGraphCallback>
+#include <osgEarth/Counters>
+#include <osgEarth/FrameGovernor>
 #include <osgUtil/Optimizer>
 
 using namespace osgEarth;
@@ -196,6 +198,7 @@ MapNode::Options::getConfig() const
     conf.set( "overlay_mipmapping",       overlayMipMapping() );
     conf.set( "overlay_resolution_ratio", overlayResolutionRatio() );
     conf.set( "cascade_draping",          useCascadeDraping() );
+    conf.set( "clamping_reuse_threshold", clampingReuseThreshold() );
     conf.set( "draping_render_bin_number",drapingRenderBinNumber() );
 
     if (terrain().isSet() && !terrain()->empty())
@@ -214,6 +217,7 @@ MapNode::Options::fromConfig(const Config& conf)
     overlayTextureSize().init(4096);
     overlayResolutionRatio().init(3.0f);
     useCascadeDraping().init(false);
+    clampingReuseThreshold().init(0.0f);
     terrain().init(TerrainOptions());
     drapingRenderBinNumber().init(1);
 
@@ -224,6 +228,7 @@ MapNode::Options::fromConfig(const Config& conf)
     conf.get( "overlay_mipmapping",       overlayMipMapping() );
     conf.get( "overlay_resolution_ratio", overlayResolutionRatio() );
     conf.get( "cascade_draping",          useCascadeDraping() );
+    conf.get( "clamping_reuse_threshold", clampingReuseThreshold() );
     conf.get( "draping_render_bin_number",drapingRenderBinNumber() );
 
     if ( conf.hasChild( "terrain" ) )
@@ -339,6 +344,9 @@ MapNode::open()
     // This needs to happen AFTER calling _terrainEngine->setMap().
     _mapCallback->invokeOnLayerAdded(_map.get());
 
+    // Layers that open in the background join the map in the update traversal
+    ADJUST_UPDATE_TRAV_COUNT(this, +1);
+
     // initialize terrain-level lighting:
     if ( options().terrain()->enableLighting().isSet() )
     {
@@ -353,6 +361,7 @@ MapNode::open()
 
     // install the Clamping technique for overlays:
     ClampingTechnique* clamping = new ClampingTechnique();
+    clamping->setReuseThreshold(options().clampingReuseThreshold().get());
     overlayDecorator->addTechnique(clamping);
     _clampingManager = &clamping->getClampingManager();
 
@@ -851,6 +860,18 @@ MapNode::traverse( osg::NodeVisitor& nv )
 
     else
     {
+        if (nv.getVisitorType() == nv.UPDATE_VISITOR)
+        {
+            if (nv.getFrameStamp())
+            {
+                Util::Counters::frame(nv.getFrameStamp()->getFrameNumber());
+                Util::FrameGovernor::frame(nv.getFrameStamp()->getFrameNumber());
+            }
+
+            _map->addLayersOpenedInBackground();
+            _map->reopenLayersWithNewerMetadata();
+        }
+
         if (dynamic_cast<osgUtil::BaseOptimizerVisitor*>(&nv) == 0L)
             osg::Group::traverse( nv );
     }
@@ -17,6 +17,10 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>
  */
 #include <osgEarth/MemCache>
+#include <osgEarth/Memory>
+#include <osg/Image>
+#include <osg/Shape>
+#include <list>
 
 using namespace osgEarth;
 
@@ -24,37 +28,213 @@ using namespace osgEarth;
 
 //#define CLONE_DATA
 
+// Upper limit on the number of independently locked stripes per bin
+#define MAX_STRIPES 16u
+
 //------------------------------------------------------------------------
 
 namespace
 {
     typedef std::pair<osg::ref_ptr<const osg::Object>, Config> MemCacheEntry;
-    typedef LRUCache<std::string, MemCacheEntry> MemCacheLRU;
+
+    // Approximate memory held by a cached object
+    unsigned long long estimateSize(const osg::Object* object)
+    {
+        const osg::Image* image = dynamic_cast<const osg::Image*>(object);
+        if (image)
+            return image->getTotalSizeInBytesIncludingMipmaps();
+
+        const osg::HeightField* hf = dynamic_cast<const osg::HeightField*>(object);
+        if (hf && hf->getFloatArray())
+            return hf->getFloatArray()->getTotalDataSize();
+
+        const StringObject* str = dynamic_cast<const StringObject*>(object);
+        if (str)
+            return str->getString().size();
+
+        return sizeof(osg::Object);
+    }
+
+    // bytes held by all memory caches, for the memory report
+    const Util::Gauge s_memCacheBytes = Util::Memory::getCPUGauge("memcache");
+
+    /**
+     * One independently locked slice of a MemCacheBin. Keys hash to a single
+     * stripe, so threads reading different keys rarely wait on each other.
+     *
+     * In LRU mode a hit moves the entry to the back of the list. In CLOCK
+     * (second chance) mode a hit only sets the entry's reference bit; the
+     * eviction sweep gives referenced entries one more pass instead.
+     */
+    struct Stripe
+    {
+        struct Entry
+        {
+            std::string _key;
+            MemCacheEntry _value;
+            unsigned long long _bytes;
+            bool _referenced;
+        };
+        typedef std::list<Entry> List;
+
+        Stripe() : _bytes(0u), _queries(0u), _hits(0u), _mutex("MemCacheBin.Stripe(OE)") { }
+
+        List _list; // front = next eviction candidate
+        std::unordered_map<std::string, List::iterator> _index;
+        unsigned long long _bytes;
+        unsigned _queries;
+        unsigned _hits;
+        mutable Threading::Mutex _mutex;
+    };
 
     struct MemCacheBin : public CacheBin
     {
-        MemCacheBin( const std::string& id, unsigned maxSize )
-            : CacheBin( id ),
-              _lru    ( true /* MT-safe */, maxSize )
+        MemCacheBin( const std::string& id, unsigned maxSize, unsigned long long maxBytes, bool clock )
+            : CacheBin  ( id ),
+              _maxSize  ( maxSize ),
+              _maxBytes ( maxBytes ),
+              _clock    ( clock )
         {
-            //nop
+            // a few entries per stripe at least, so small caches stay effective
+            unsigned numStripes = maxBytes > 0u ? MAX_STRIPES : osg::clampBetween(maxSize / 8u, 1u, MAX_STRIPES);
+            for (unsigned i = 0; i < numStripes; ++i)
+                _stripes.emplace_back(new Stripe());
+            _maxSizePerStripe = osg::maximum(maxSize / numStripes, 1u);
+            _maxBytesPerStripe = maxBytes / numStripes;
+        }
+
+        ~MemCacheBin()
+        {
+            for (auto& s : _stripes)
+                s_memCacheBytes.add(-(std::int64_t)s->_bytes);
+        }
+
+        Stripe& stripe(const std::string& key)
+        {
+            return *_stripes[_hash(key) % _stripes.size()];
+        }
+
+        bool get(const std::string& key, MemCacheEntry& out)
+        {
+            Stripe& s = stripe(key);
+            Threading::ScopedMutexLock lock(s._mutex);
+            ++s._queries;
+            auto i = s._index.find(key);
+            if (i == s._index.end())
+                return false;
+
+            ++s._hits;
+            if (_clock)
+                i->second->_referenced = true;
+            else
+                s._list.splice(s._list.end(), s._list, i->second);
+
+            out = i->second->_value;
+            return true;
+        }
+
+        void insert(const std::string& key, const MemCacheEntry& value)
+        {
+            unsigned long long bytes = estimateSize(value.first.get());
+            std::int64_t delta = (std::int64_t)bytes;
+
+            Stripe& s = stripe(key);
+            Threading::ScopedMutexLock lock(s._mutex);
+
+            auto i = s._index.find(key);
+            if (i != s._index.end())
+            {
+                s._bytes -= i->second->_bytes;
+                delta -= (std::int64_t)i->second->_bytes;
+                i->second->_value = value;
+                i->second->_bytes = bytes;
+                i->second->_referenced = false;
+                s._list.splice(s._list.end(), s._list, i->second);
+            }
+            else
+            {
+                Stripe::Entry entry;
+                entry._key = key;
+                entry._value = value;
+                entry._bytes = bytes;
+                entry._referenced = false;
+                s._list.push_back(entry);
+                s._index[key] = std::prev(s._list.end());
+            }
+            s._bytes += bytes;
+
+            // With a byte budget, it replaces the entry count limit.
+            // Always keep the newest entry, even if it's over budget by itself.
+            while (s._list.size() > 1u &&
+                   (_maxBytesPerStripe > 0u ? s._bytes > _maxBytesPerStripe : s._list.size() > _maxSizePerStripe))
+            {
+                Stripe::List::iterator victim = s._list.begin();
+                if (victim->_referenced)
+                {
+                    // second chance
+                    victim->_referenced = false;
+                    s._list.splice(s._list.end(), s._list, victim);
+                }
+                else
+                {
+                    s._bytes -= victim->_bytes;
+                    delta -= (std::int64_t)victim->_bytes;
+                    s._index.erase(victim->_key);
+                    s._list.erase(victim);
+                }
+            }
+
+            s_memCacheBytes.add(delta);
+        }
+
+        void erase(const std::string& key)
+        {
+            Stripe& s = stripe(key);
+            Threading::ScopedMutexLock lock(s._mutex);
+            auto i = s._index.find(key);
+            if (i != s._index.end())
+            {
+                s._bytes -= i->second->_bytes;
+                s_memCacheBytes.add(-(std::int64_t)i->second->_bytes);
+                s._list.erase(i->second);
+                s._index.erase(i);
+            }
+        }
+
+        bool has(const std::string& key) const
+        {
+            const Stripe& s = *_stripes[_hash(key) % _stripes.size()];
+            Threading::ScopedMutexLock lock(s._mutex);
+            return s._index.find(key) != s._index.end();
+        }
+
+        CacheStats getStats() const
+        {
+            unsigned entries = 0u, queries = 0u, hits = 0u;
+            for (auto& s : _stripes)
+            {
+                Threading::ScopedMutexLock lock(s->_mutex);
+                entries += s->_list.size();
+                queries += s->_queries;
+                hits += s->_hits;
+            }
+            return CacheStats(entries, _maxSize, queries, queries > 0 ? (float)hits / (float)queries : 0.0f);
         }
 
         ReadResult readObject(const std::string& key, const osgDB::Options*)
         {
-            MemCacheLRU::Record rec;
-            _lru.get(key, rec);
+            MemCacheEntry rec;
 
             // clone required since the cache is in memory
 
-            if ( rec.valid() )
+            if ( get(key, rec) )
             {
 #ifdef CLONE_DATA
                 return ReadResult( 
-                   osg::clone(rec.value().first.get(), osg::CopyOp::DEEP_COPY_ALL),
-                   rec.value().second );
+                   osg::clone(rec.first.get(), osg::CopyOp::DEEP_COPY_ALL),
+                   rec.second );
 #else
-                return ReadResult(const_cast<osg::Object*>(rec.value().first.get()), rec.value().second);
+                return ReadResult(const_cast<osg::Object*>(rec.first.get()), rec.second);
 #endif
             }
             else
@@ -79,9 +259,9 @@ namespace
             {
 #ifdef CLONE_DATA
                 osg::ref_ptr<const osg::Object> cloned = osg::clone(object, osg::CopyOp::DEEP_COPY_ALL);
-                _lru.insert( key, std::make_pair(cloned.get(), meta) );
+                insert( key, std::make_pair(cloned.get(), meta) );
 #else
-                _lru.insert( key, std::make_pair(object, meta) );
+                insert( key, std::make_pair(object, meta) );
 #endif
                 return true;
             }
@@ -91,26 +271,33 @@ namespace
 
         bool remove(const std::string& key)
         {
-            _lru.erase(key);
+            erase(key);
             return true;
         }
 
         bool touch(const std::string& key)
         {
-            // just doing a get will put it at the front of the LRU list
-            MemCacheLRU::Record dummy;
-            return _lru.get(key, dummy);
+            // just doing a get will refresh it in the eviction order
+            MemCacheEntry dummy;
+            return get(key, dummy);
         }
 
         RecordStatus getRecordStatus( const std::string& key )
         {
             // ignore minTime; MemCache does not support expiration
-            return _lru.has(key) ? STATUS_OK : STATUS_NOT_FOUND;
+            return has(key) ? STATUS_OK : STATUS_NOT_FOUND;
         }
 
         bool purge()
         {
-            _lru.clear();
+            for (auto& s : _stripes)
+            {
+                Threading::ScopedMutexLock lock(s->_mutex);
+                s->_list.clear();
+                s->_index.clear();
+                s_memCacheBytes.add(-(std::int64_t)s->_bytes);
+                s->_bytes = 0u;
+            }
             return true;
         }
 
@@ -119,7 +306,13 @@ namespace
             return key;
         }
 
-        MemCacheLRU _lru;
+        unsigned _maxSize;
+        unsigned _maxSizePerStripe;
+        unsigned long long _maxBytes;
+        unsigned long long _maxBytesPerStripe;
+        bool _clock;
+        std::hash<std::string> _hash;
+        std::vector<std::unique_ptr<Stripe> > _stripes;
     };
     
 
@@ -129,7 +322,9 @@ namespace
 //------------------------------------------------------------------------
 
 MemCache::MemCache( unsigned maxBinSize ) :
-_maxBinSize( osg::maximum(maxBinSize, 1u) )
+_maxBinSize( osg::maximum(maxBinSize, 1u) ),
+_maxBinBytes( 0u ),
+_useClockEviction( false )
 {
     //nop
 }
@@ -137,7 +332,7 @@ _maxBinSize( osg::maximum(maxBinSize, 1u) )
 CacheBin*
 MemCache::addBin( const std::string& binID )
 {
-    return _bins.getOrCreate( binID, new MemCacheBin(binID, _maxBinSize) );
+    return _bins.getOrCreate( binID, new MemCacheBin(binID, _maxBinSize, _maxBinBytes, _useClockEviction) );
 }
 
 CacheBin*
@@ -158,7 +353,7 @@ MemCache::getOrCreateDefaultBin()
         // double check
         if ( !_defaultBin.valid() )
         {
-            _defaultBin = new MemCacheBin("__default", _maxBinSize);
+            _defaultBin = new MemCacheBin("__default", _maxBinSize, _maxBinBytes, _useClockEviction);
         }
     }
 
@@ -170,6 +365,6 @@ void
 MemCache::dumpStats(const std::string& binID)
 {
     MemCacheBin* bin = static_cast<MemCacheBin*>(getBin(binID));
-    CacheStats stats = bin->_lru.getStats();
+    CacheStats stats = bin->getStats();
     OE_INFO << LC << "hit ratio = " << stats._hitRatio << std::endl;
 }
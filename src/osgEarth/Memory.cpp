@@ -20,6 +20,14 @@
 * along with this program.  If not, see <http://www.gnu.org/licenses/>
 */
 #include <osgEarth/Memory>
+#include <osg/BufferObject>
+#include <osg/GraphicsContext>
+#include <osg/Texture>
+#include <osg/Version>
+#include <iomanip>
+#include <map>
+#include <ostream>
+#include <sstream>
 
 using namespace osgEarth;
 using namespace osgEarth::Util;
@@ -174,3 +182,101 @@ Memory::getProcessPeakPrivateUsage()
     return (size_t)0L;
 #endif
 }
+
+//........................................................................
+
+namespace
+{
+    bool parseGaugeName(const std::string& name, const std::string& prefix, std::string& category)
+    {
+        const std::string suffix(".bytes");
+        if (name.size() <= prefix.size() + suffix.size() ||
+            name.compare(0, prefix.size(), prefix) != 0 ||
+            name.compare(name.size() - suffix.size(), suffix.size(), suffix) != 0)
+        {
+            return false;
+        }
+        category = name.substr(prefix.size(), name.size() - prefix.size() - suffix.size());
+        return true;
+    }
+
+    std::string megabytes(std::int64_t bytes)
+    {
+        std::ostringstream buf;
+        buf << std::fixed << std::setprecision(1) << (double)bytes / 1048576.0;
+        return buf.str();
+    }
+}
+
+Gauge
+Memory::getCPUGauge(const std::string& category)
+{
+    return Gauge("memory." + category + ".bytes");
+}
+
+Gauge
+Memory::getGPUGauge(const std::string& category)
+{
+    return Gauge("gpu." + category + ".bytes");
+}
+
+void
+Memory::getReport(Report& out)
+{
+    out = Report();
+    out._processPhysicalBytes = getProcessPhysicalUsage();
+    out._processPrivateBytes = getProcessPrivateUsage();
+
+    for (unsigned id = 0; id < osg::GraphicsContext::getMaxContextID() + 1u; ++id)
+    {
+#if OSG_VERSION_GREATER_OR_EQUAL(3,5,6)
+        out._glTextureBytes += osg::get<osg::TextureObjectManager>(id)->getCurrTexturePoolSize();
+        out._glBufferBytes += osg::get<osg::GLBufferObjectManager>(id)->getCurrGLBufferObjectPoolSize();
+#else
+        out._glTextureBytes += osg::Texture::getTextureObjectManager(id)->getCurrTexturePoolSize();
+        out._glBufferBytes += osg::GLBufferObjectManager::getGLBufferObjectManager(id)->getCurrGLBufferObjectPoolSize();
+#endif
+    }
+
+    std::vector<Counters::GaugeStats> gauges;
+    Counters::getGauges(gauges);
+
+    std::map<std::string, Category> categories;
+    for (const auto& g : gauges)
+    {
+        std::string name;
+        if (parseGaugeName(g._name, "memory.", name))
+            categories[name]._cpuBytes += g._value;
+        else if (parseGaugeName(g._name, "gpu.", name))
+            categories[name]._gpuBytes += g._value;
+    }
+
+    for (auto& c : categories)
+    {
+        c.second._name = c.first;
+        out._categories.push_back(c.second);
+    }
+}
+
+void
+Memory::writeReport(const Report& report, std::ostream& out)
+{
+    out << std::left << std::setw(24) << "Category" << std::right
+        << std::setw(12) << "CPU (MB)" << std::setw(12) << "GPU (MB)" << "\n";
+
+    for (const auto& c : report._categories)
+    {
+        out << std::left << std::setw(24) << c._name << std::right
+            << std::setw(12) << megabytes(c._cpuBytes)
+            << std::setw(12) << megabytes(c._gpuBytes) << "\n";
+    }
+
+    out << std::left << std::setw(24) << "GL textures (all)" << std::right
+        << std::setw(12) << "" << std::setw(12) << megabytes(report._glTextureBytes) << "\n"
+        << std::left << std::setw(24) << "GL buffers (all)" << std::right
+        << std::setw(12) << "" << std::setw(12) << megabytes(report._glBufferBytes) << "\n"
+        << std::left << std::setw(24) << "Process physical" << std::right
+        << std::setw(12) << megabytes(report._processPhysicalBytes) << "\n"
+        << std::left << std::setw(24) << "Process private" << std::right
+        << std::setw(12) << megabytes(report._processPrivateBytes) << std::endl;
+}
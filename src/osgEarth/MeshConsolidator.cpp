@@ -30,6 +30,7 @@
 #include <limits>
 #include <map>
 #include <iterator>
+#include <cstring>
 
 using namespace osgEarth;
 using namespace osgEarth::Util;
@@ -719,3 +720,272 @@ MeshConsolidator::run( osg::Geode& geode )
     for( DrawableList::iterator i = dontConsolidate.begin(); i != dontConsolidate.end(); ++i )
         geode.addDrawable( i->get() );
 }
+
+//------------------------------------------------------------------------
+
+namespace
+{
+    // Array slots used to compare the layouts of two geometries
+    enum {
+        SLOT_VERTEX = 0,
+        SLOT_NORMAL = 1,
+        SLOT_COLOR = 2,
+        SLOT_TEXCOORD = 16,
+        SLOT_ATTRIB = 64
+    };
+
+    typedef std::vector<std::pair<unsigned, const osg::Array*> > SlotArrays;
+
+    struct CountTriangles
+    {
+        unsigned _count;
+        CountTriangles() : _count(0u) { }
+        void operator()(unsigned, unsigned, unsigned) { ++_count; }
+    };
+
+    struct AppendTriangles
+    {
+        osg::DrawElements* _de;
+        unsigned _offset;
+        AppendTriangles() : _de(0L), _offset(0u) { }
+        void operator()(unsigned i0, unsigned i1, unsigned i2)
+        {
+            _de->addElement(i0 + _offset);
+            _de->addElement(i1 + _offset);
+            _de->addElement(i2 + _offset);
+        }
+    };
+
+    // Collects the arrays of a geometry by slot, returning false if the
+    // geometry is not a plain per-vertex triangle mesh.
+    bool getMergeableArrays(const osg::Geometry& geom, SlotArrays& arrays)
+    {
+        if (strcmp(geom.className(), "Geometry") != 0 || strcmp(geom.libraryName(), "osg") != 0)
+            return false;
+
+        if (geom.getUserData() || geom.getSecondaryColorArray() || geom.getFogCoordArray())
+            return false;
+
+        const osg::Array* verts = geom.getVertexArray();
+        if (!verts || verts->getNumElements() == 0)
+            return false;
+
+        for (unsigned i = 0; i < geom.getNumPrimitiveSets(); ++i)
+        {
+            const osg::PrimitiveSet* p = geom.getPrimitiveSet(i);
+            if (p->getNumInstances() > 0 || p->getUserData())
+                return false;
+
+            GLenum mode = p->getMode();
+            if (mode != GL_TRIANGLES && mode != GL_TRIANGLE_STRIP && mode != GL_TRIANGLE_FAN &&
+                mode != GL_QUADS && mode != GL_QUAD_STRIP && mode != GL_POLYGON)
+                return false;
+        }
+
+        arrays.clear();
+        arrays.push_back(std::make_pair((unsigned)SLOT_VERTEX, verts));
+        if (geom.getNormalArray())
+            arrays.push_back(std::make_pair((unsigned)SLOT_NORMAL, geom.getNormalArray()));
+        if (geom.getColorArray())
+            arrays.push_back(std::make_pair((unsigned)SLOT_COLOR, geom.getColorArray()));
+        for (unsigned i = 0; i < geom.getNumTexCoordArrays(); ++i)
+            if (geom.getTexCoordArray(i))
+                arrays.push_back(std::make_pair(SLOT_TEXCOORD + i, geom.getTexCoordArray(i)));
+        for (unsigned i = 0; i < geom.getNumVertexAttribArrays(); ++i)
+            if (geom.getVertexAttribArray(i))
+                arrays.push_back(std::make_pair(SLOT_ATTRIB + i, geom.getVertexAttribArray(i)));
+
+        for (unsigned a = 1; a < arrays.size(); ++a)
+        {
+            if (arrays[a].second->getBinding() != osg::Array::BIND_PER_VERTEX ||
+                arrays[a].second->getNumElements() != verts->getNumElements())
+                return false;
+        }
+
+        return true;
+    }
+
+    // Geometries that can share one output geometry
+    struct MeshGroup
+    {
+        const osg::StateSet* _stateSet;
+        std::vector<std::pair<unsigned, osg::Array::Type> > _layout;
+
+        struct Batch
+        {
+            std::vector<osg::Geometry*> _geoms;
+            unsigned _numVerts;
+            unsigned _numTris;
+            Batch() : _numVerts(0u), _numTris(0u) { }
+        };
+        std::vector<Batch> _batches;
+
+        bool matches(const osg::StateSet* stateSet, const SlotArrays& arrays) const
+        {
+            if (stateSet != _stateSet || arrays.size() != _layout.size())
+                return false;
+            for (unsigned a = 0; a < arrays.size(); ++a)
+                if (arrays[a].first != _layout[a].first || arrays[a].second->getType() != _layout[a].second)
+                    return false;
+            return true;
+        }
+    };
+
+    osg::Geometry* mergeBatch(const MeshGroup::Batch& batch)
+    {
+        const osg::Geometry* first = batch._geoms.front();
+
+        osg::Geometry* output = new osg::Geometry();
+        output->setUseVertexBufferObjects(first->getUseVertexBufferObjects());
+        output->setUseDisplayList(first->getUseDisplayList());
+        output->setStateSet(const_cast<osg::StateSet*>(first->getStateSet()));
+
+        // allocate every output array at its final size:
+        SlotArrays arrays;
+        getMergeableArrays(*first, arrays);
+
+        std::vector<osg::Array*> outputs;
+        outputs.reserve(arrays.size());
+
+        for (unsigned a = 0; a < arrays.size(); ++a)
+        {
+            const osg::Array* src = arrays[a].second;
+            osg::Array* dst = static_cast<osg::Array*>(src->cloneType());
+            dst->setBinding(src->getBinding());
+            dst->setNormalize(src->getNormalize());
+            dst->setPreserveDataType(src->getPreserveDataType());
+            dst->resizeArray(batch._numVerts);
+            outputs.push_back(dst);
+
+            unsigned slot = arrays[a].first;
+            if (slot == SLOT_VERTEX)
+                output->setVertexArray(dst);
+            else if (slot == SLOT_NORMAL)
+                output->setNormalArray(dst);
+            else if (slot == SLOT_COLOR)
+                output->setColorArray(dst);
+            else if (slot < SLOT_ATTRIB)
+                output->setTexCoordArray(slot - SLOT_TEXCOORD, dst);
+            else
+                output->setVertexAttribArray(slot - SLOT_ATTRIB, dst);
+        }
+
+        osg::DrawElements* de;
+        if (batch._numVerts <= 0xFFFF)
+            de = new osg::DrawElementsUShort(GL_TRIANGLES);
+        else
+            de = new osg::DrawElementsUInt(GL_TRIANGLES);
+        de->reserveElements(batch._numTris * 3);
+
+        osg::TriangleIndexFunctor<AppendTriangles> append;
+        append._de = de;
+
+        for (unsigned g = 0; g < batch._geoms.size(); ++g)
+        {
+            const osg::Geometry* geom = batch._geoms[g];
+            getMergeableArrays(*geom, arrays);
+
+            unsigned numVerts = geom->getVertexArray()->getNumElements();
+            for (unsigned a = 0; a < arrays.size(); ++a)
+            {
+                unsigned size = outputs[a]->getElementSize();
+                char* dst = static_cast<char*>(const_cast<GLvoid*>(outputs[a]->getDataPointer()));
+                ::memcpy(dst + append._offset*size, arrays[a].second->getDataPointer(), numVerts*size);
+            }
+
+            geom->accept(append);
+            append._offset += numVerts;
+        }
+
+        output->addPrimitiveSet(de);
+        return output;
+    }
+}
+
+void
+MeshConsolidator::mergeTriangleMeshes( osg::Geode& geode, unsigned maxNumVerts )
+{
+    if ( geode.getNumDrawables() <= 1 )
+        return;
+
+    if ( maxNumVerts == 0u )
+        maxNumVerts = ~0u;
+
+    // hold references, since we are about to rebuild the geode:
+    DrawableList originals;
+    originals.reserve( geode.getNumDrawables() );
+    for( unsigned i=0; i<geode.getNumDrawables(); ++i )
+        originals.push_back( geode.getDrawable(i) );
+
+    std::vector<MeshGroup> groups;
+    DrawableList dontConsolidate;
+    SlotArrays arrays;
+
+    // sort the geometries into groups of like layout, and each group
+    // into batches no bigger than the vertex limit:
+    for( DrawableList::iterator i = originals.begin(); i != originals.end(); ++i )
+    {
+        osg::Geometry* geom = i->get()->asGeometry();
+        if ( !geom || !getMergeableArrays(*geom, arrays) )
+        {
+            dontConsolidate.push_back( i->get() );
+            continue;
+        }
+
+        osg::TriangleIndexFunctor<CountTriangles> count;
+        geom->accept( count );
+        if ( count._count == 0u )
+        {
+            dontConsolidate.push_back( i->get() );
+            continue;
+        }
+
+        MeshGroup* group = 0L;
+        for( unsigned g=0; g<groups.size() && !group; ++g )
+            if ( groups[g].matches(geom->getStateSet(), arrays) )
+                group = &groups[g];
+
+        if ( !group )
+        {
+            groups.push_back( MeshGroup() );
+            group = &groups.back();
+            group->_stateSet = geom->getStateSet();
+            for( unsigned a=0; a<arrays.size(); ++a )
+                group->_layout.push_back( std::make_pair(arrays[a].first, arrays[a].second->getType()) );
+        }
+
+        unsigned numVerts = geom->getVertexArray()->getNumElements();
+        if ( group->_batches.empty() || 
+             (group->_batches.back()._numVerts > 0u && group->_batches.back()._numVerts + numVerts > maxNumVerts) )
+        {
+            group->_batches.push_back( MeshGroup::Batch() );
+        }
+
+        MeshGroup::Batch& batch = group->_batches.back();
+        batch._geoms.push_back( geom );
+        batch._numVerts += numVerts;
+        batch._numTris += count._count;
+    }
+
+    DrawableList results;
+    for( unsigned g=0; g<groups.size(); ++g )
+    {
+        for( unsigned b=0; b<groups[g]._batches.size(); ++b )
+        {
+            const MeshGroup::Batch& batch = groups[g]._batches[b];
+            if ( batch._geoms.size() == 1 )
+                results.push_back( batch._geoms.front() );
+            else
+                results.push_back( mergeBatch(batch) );
+        }
+    }
+
+    // re-build the geode:
+    geode.removeDrawables( 0, geode.getNumDrawables() );
+
+    for( DrawableList::iterator i = results.begin(); i != results.end(); ++i )
+        geode.addDrawable( i->get() );
+
+    for( DrawableList::iterator i = dontConsolidate.begin(); i != dontConsolidate.end(); ++i )
+        geode.addDrawable( i->get() );
+}
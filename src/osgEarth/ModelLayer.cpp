@@ -19,6 +19,8 @@
 #include <osgEarth/ModelLayer>
 #include <osgEarth/GLUtils>
 #include <osgEarth/GeoTransform>
+#include <osgEarth/LODGenerator>
+#include <osgEarth/ModelTiler>
 #include <osgEarth/Registry>
 #include <osg/CullStack>
 #include <osg/Depth>
@@ -44,6 +46,8 @@ ModelLayer::Options::getConfig() const
     conf.set("loading_priority_scale", _loadingPriorityScale);
     conf.set("loading_priority_offset", _loadingPriorityOffset);
     conf.set("paged", _paged);
+    conf.set("auto_lod", _autoLOD);
+    conf.set("tiled", _tiled);
 
     conf.set("shader_policy", "disable", _shaderPolicy, SHADERPOLICY_DISABLE);
     conf.set("shader_policy", "inherit", _shaderPolicy, SHADERPOLICY_INHERIT);
@@ -72,6 +76,8 @@ ModelLayer::Options::fromConfig( const Config& conf )
     _loadingPriorityScale.init(1.0f);
     _loadingPriorityOffset.init(0.0f);
     _paged.init(false);
+    _autoLOD.init(false);
+    _tiled.init(false);
 
     conf.get("url", _url);
     conf.get("lod_scale", _lodScale);
@@ -80,6 +86,8 @@ ModelLayer::Options::fromConfig( const Config& conf )
     conf.get("loading_priority_scale", _loadingPriorityScale);
     conf.get("loading_priority_offset", _loadingPriorityOffset);
     conf.get("paged", _paged);
+    conf.get("auto_lod", _autoLOD);
+    conf.get("tiled", _tiled);
 
     conf.get("shader_policy", "disable", _shaderPolicy, SHADERPOLICY_DISABLE);
     conf.get("shader_policy", "inherit", _shaderPolicy, SHADERPOLICY_INHERIT);
@@ -199,6 +207,8 @@ REGISTER_OSGEARTH_LAYER(model, ModelLayer);
 OE_LAYER_PROPERTY_IMPL(ModelLayer, URI, URL, url);
 OE_LAYER_PROPERTY_IMPL(ModelLayer, float, LODScale, lodScale);
 OE_LAYER_PROPERTY_IMPL(ModelLayer, bool, Paged, paged);
+OE_LAYER_PROPERTY_IMPL(ModelLayer, bool, AutoLOD, autoLOD);
+OE_LAYER_PROPERTY_IMPL(ModelLayer, bool, Tiled, tiled);
 OE_LAYER_PROPERTY_IMPL(ModelLayer, GeoPoint, Location, location);
 OE_LAYER_PROPERTY_IMPL(ModelLayer, osg::Vec3, Orientation, orientation);
 OE_LAYER_PROPERTY_IMPL(ModelLayer, unsigned, MaskMinLevel, maskMinLevel);
@@ -285,17 +295,30 @@ ModelLayer::openImplementation()
         localReadOptions->getDatabasePathList().push_back(
             osgDB::getFilePath(options().url()->full()) );
             
-        // Only support paging if user has enabled it and provided a min/max range
+        // Only support paging if user has enabled it and provided a min/max range.
+        // A tiled model does its own paging.
         bool usePagedLOD = 
             (options().paged() == true) &&
+            (options().tiled() != true) &&
             (options().minVisibleRange().isSet() || options().maxVisibleRange().isSet());
 
         osg::ref_ptr<osg::Node> result;
         osg::ref_ptr<osg::Node> modelNode;
         osg::ref_ptr<osg::Group> modelNodeParent;
 
+        // A tiled model streams its own cells, so load just the index:
+        if (options().tiled() == true)
+        {
+            modelNode = ModelTiler::load(options().url().get(), 6.0f, localReadOptions.get());
+            if (!modelNode.valid())
+            {
+                return Status(Status::ResourceUnavailable,
+                    Stringify() << "Failed to load tiled model from URL (" << options().url()->full() << ")");
+            }
+        }
+
         // If we're not paging, just load the node now:
-        if (!usePagedLOD)
+        else if (!usePagedLOD)
         {
             ReadResult rr = options().url()->readNode(localReadOptions.get());
             if (rr.failed())
@@ -304,6 +327,11 @@ ModelLayer::openImplementation()
                     Stringify() << "Failed to load model from URL ("<<rr.errorDetail()<<")");
             }
             modelNode = rr.getNode();
+
+            if (options().autoLOD() == true)
+            {
+                modelNode = LODGenerator().generate(modelNode.get());
+            }
         }
 
         // Apply the location and orientation, if available:
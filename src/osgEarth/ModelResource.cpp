@@ -22,6 +22,7 @@
 #include <osgEarth/Registry>
 #include <osgEarth/Capabilities>
 #include <osgEarth/ImageUtils>
+#include <osgEarth/LODGenerator>
 #include <osgUtil/Optimizer>
 #include <osg/ComputeBoundsVisitor>
 
@@ -34,7 +35,8 @@ using namespace osgEarth;
 ModelResource::ModelResource( const Config& conf ) :
 InstanceResource( conf ),
 _canScaleToFitXY(true),
-_canScaleToFitZ(true)
+_canScaleToFitZ(true),
+_autoLOD(false)
 {
     mergeConfig( conf );
 }
@@ -44,6 +46,7 @@ ModelResource::mergeConfig( const Config& conf )
 {
     conf.get("can_scale_to_fit_xy", _canScaleToFitXY);
     conf.get("can_scale_to_fit_z",  _canScaleToFitZ);
+    conf.get("auto_lod",            _autoLOD);
 }
 
 Config
@@ -53,6 +56,7 @@ ModelResource::getConfig() const
     conf.key() = "model";
     conf.set("can_scale_to_fit_xy", _canScaleToFitXY);
     conf.set("can_scale_to_fit_z",  _canScaleToFitZ);
+    conf.set("auto_lod",            _autoLOD);
     return conf;
 }
 
@@ -133,6 +137,15 @@ ModelResource::createNodeFromURI( const URI& uri, const osgDB::Options* dbOption
         // Disable automatic texture unref since resources can be shared/paged.
         SetUnRefPolicyToFalse visitor;
         node->accept( visitor );
+
+        // The chain is cached along with the model, so every instance
+        // shares the simplified levels and their ranges.
+        if ( _autoLOD == true )
+        {
+            osg::ref_ptr<osg::Node> model = node;
+            node = LODGenerator().generate( model.get() );
+            model.release();
+        }
     }
     else // failing that, fall back on the old encoding format..
     {
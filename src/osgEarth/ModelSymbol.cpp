@@ -39,7 +39,8 @@ _maxSizeY(rhs._maxSizeY),
 _scaleX( rhs._scaleX ),
 _scaleY( rhs._scaleY ),
 _scaleZ( rhs._scaleZ ),
-_orientationFromFeature( rhs._orientationFromFeature )
+_orientationFromFeature( rhs._orientationFromFeature ),
+_autoLOD( rhs._autoLOD )
 {
     // nop
 }
@@ -57,7 +58,8 @@ _maxSizeY ( FLT_MAX ),
 _scaleX    ( NumericExpression(1.0) ),
 _scaleY    ( NumericExpression(1.0) ),
 _scaleZ    ( NumericExpression(1.0) ),
-_orientationFromFeature ( false )
+_orientationFromFeature ( false ),
+_autoLOD  ( false )
 {
     mergeConfig( conf );
 }
@@ -85,6 +87,7 @@ ModelSymbol::getConfig() const
     conf.set( "scale_z", _scaleZ );
 
     conf.set( "orientation_from_feature", _orientationFromFeature);
+    conf.set( "auto_lod", _autoLOD );
 
     conf.setNonSerializable( "ModelSymbol::node", _node.get() );
     return conf;
@@ -111,6 +114,7 @@ ModelSymbol::mergeConfig( const Config& conf )
     conf.get( "scale_z", _scaleZ );
 
     conf.get( "orientation_from_feature", _orientationFromFeature );
+    conf.get( "auto_lod", _autoLOD );
 
     _node = conf.getNonSerializable<osg::Node>( "ModelSymbol::node" );
 }
@@ -118,7 +122,10 @@ ModelSymbol::mergeConfig( const Config& conf )
 InstanceResource*
 ModelSymbol::createResource() const
 {
-    return new ModelResource();
+    ModelResource* res = new ModelResource();
+    if ( _autoLOD.isSet() )
+        res->autoLOD() = _autoLOD.get();
+    return res;
 }
 
 void
@@ -159,6 +166,9 @@ ModelSymbol::parseSLD(const Config& c, Style& style)
 	else if (match(c.key(), "model-max-auto-scale")) {
 		style.getOrCreate<ModelSymbol>()->maxAutoScale() = as<double>(c.value(), DBL_MAX);
 	}
+    else if ( match(c.key(), "model-auto-lod") ) {
+        style.getOrCreate<ModelSymbol>()->autoLOD() = as<bool>(c.value(), false);
+    }
     else if ( match(c.key(), "model-scale-x") ) {
         style.getOrCreate<ModelSymbol>()->scaleX() = NumericExpression(c.value());
     }
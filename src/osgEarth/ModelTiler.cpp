@@ -0,0 +1,553 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+ * Copyright 2020 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarth/ModelTiler>
+#include <osgEarth/PagedNode>
+#include <osgEarth/Config>
+#include <osgEarth/Notify>
+#include <osgEarth/Registry>
+#include <osg/Geometry>
+#include <osg/TriangleIndexFunctor>
+#include <osgDB/FileUtils>
+#include <osgDB/FileNameUtils>
+#include <osgDB/WriteFile>
+#include <osgUtil/Simplifier>
+#include <osgUtil/Optimizer>
+#include <fstream>
+#include <unordered_map>
+
+#define LC "[ModelTiler] "
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+namespace
+{
+    const char* INDEX_FILE_NAME = "tiles.json";
+
+    // One drawable of the model, with its vertices moved into model
+    // coordinates and the state accumulated along its path.
+    struct Source
+    {
+        osg::ref_ptr<osg::StateSet> _stateSet;
+        osg::ref_ptr<osg::Vec3Array> _verts;
+        osg::ref_ptr<osg::Vec3Array> _normals;   // per vertex, or null
+        osg::ref_ptr<osg::Vec4Array> _colors;    // per vertex, or null
+        osg::Vec4 _color;                        // used when _colors is null
+        osg::ref_ptr<osg::Vec2Array> _texcoords; // per vertex, or null
+    };
+
+    struct Triangle
+    {
+        unsigned _source;
+        unsigned _index[3];
+        osg::Vec3 _centroid;
+    };
+
+    struct Model
+    {
+        std::vector<Source> _sources;
+        std::vector<Triangle> _triangles;
+    };
+
+    struct CollectTriangles
+    {
+        Model* _model;
+        unsigned _source;
+
+        void operator()(unsigned i0, unsigned i1, unsigned i2)
+        {
+            const osg::Vec3Array& verts = *_model->_sources[_source]._verts;
+            Triangle t;
+            t._source = _source;
+            t._index[0] = i0, t._index[1] = i1, t._index[2] = i2;
+            t._centroid = (verts[i0] + verts[i1] + verts[i2]) / 3.0f;
+            _model->_triangles.push_back(t);
+        }
+    };
+
+    // Gathers the triangles of a model in model coordinates. LODs and
+    // switches contribute only their active (finest) children.
+    struct Collector : public osg::NodeVisitor
+    {
+        Collector(Model& model) :
+            osg::NodeVisitor(TRAVERSE_ACTIVE_CHILDREN),
+            _model(model)
+        {
+            setNodeMaskOverride(~0);
+            _matrices.push_back(osg::Matrix::identity());
+            _states.push_back(0L);
+        }
+
+        void apply(osg::Node& node)
+        {
+            pushState(node.getStateSet());
+            traverse(node);
+            _states.pop_back();
+        }
+
+        void apply(osg::Transform& xform)
+        {
+            osg::Matrix matrix = _matrices.back();
+            xform.computeLocalToWorldMatrix(matrix, this);
+            _matrices.push_back(matrix);
+            apply(static_cast<osg::Node&>(xform));
+            _matrices.pop_back();
+        }
+
+        void apply(osg::Drawable& drawable)
+        {
+            osg::Geometry* geom = drawable.asGeometry();
+            osg::Vec3Array* verts = geom ? dynamic_cast<osg::Vec3Array*>(geom->getVertexArray()) : 0L;
+            if (!verts || verts->empty())
+                return;
+
+            unsigned numVerts = verts->size();
+            const osg::Matrix& matrix = _matrices.back();
+            osg::Matrix inverse = osg::Matrix::inverse(matrix);
+
+            Source source;
+            pushState(drawable.getStateSet());
+            source._stateSet = _states.back().get();
+            _states.pop_back();
+
+            source._verts = new osg::Vec3Array(numVerts);
+            for (unsigned i = 0; i < numVerts; ++i)
+                (*source._verts)[i] = (*verts)[i] * matrix;
+
+            osg::Vec3Array* normals = dynamic_cast<osg::Vec3Array*>(geom->getNormalArray());
+            if (normals && normals->getBinding() == osg::Array::BIND_PER_VERTEX && normals->size() == numVerts)
+            {
+                source._normals = new osg::Vec3Array(numVerts);
+                for (unsigned i = 0; i < numVerts; ++i)
+                {
+                    osg::Vec3 n = osg::Matrix::transform3x3(inverse, (*normals)[i]);
+                    n.normalize();
+                    (*source._normals)[i] = n;
+                }
+            }
+
+            source._color.set(1, 1, 1, 1);
+            osg::Vec4Array* colors = dynamic_cast<osg::Vec4Array*>(geom->getColorArray());
+            if (colors && colors->getBinding() == osg::Array::BIND_PER_VERTEX && colors->size() == numVerts)
+                source._colors = colors;
+            else if (colors && colors->getBinding() == osg::Array::BIND_OVERALL && !colors->empty())
+                source._color = colors->front();
+
+            osg::Vec2Array* texcoords = dynamic_cast<osg::Vec2Array*>(geom->getTexCoordArray(0));
+            if (texcoords && texcoords->size() == numVerts)
+                source._texcoords = texcoords;
+
+            _model._sources.push_back(source);
+
+            osg::TriangleIndexFunctor<CollectTriangles> collect;
+            collect._model = &_model;
+            collect._source = _model._sources.size() - 1;
+            geom->accept(collect);
+        }
+
+        // Pushes the state in effect below a node: the state above merged
+        // with the node's own. Merged states are reused, so geometry that
+        // drew with the same state still shares it.
+        void pushState(osg::StateSet* stateSet)
+        {
+            osg::StateSet* parent = _states.back().get();
+            if (!stateSet || !parent)
+            {
+                _states.push_back(stateSet ? stateSet : parent);
+                return;
+            }
+
+            osg::ref_ptr<osg::StateSet>& merged = _merged[std::make_pair(parent, stateSet)];
+            if (!merged.valid())
+            {
+                merged = new osg::StateSet(*parent);
+                merged->merge(*stateSet);
+            }
+            _states.push_back(merged.get());
+        }
+
+        Model& _model;
+        std::vector<osg::Matrix> _matrices;
+        std::vector<osg::ref_ptr<osg::StateSet> > _states;
+        std::map<std::pair<osg::StateSet*, osg::StateSet*>, osg::ref_ptr<osg::StateSet> > _merged;
+    };
+
+    struct CountTriangles
+    {
+        unsigned _count;
+        CountTriangles() : _count(0u) { }
+        void operator()(unsigned, unsigned, unsigned) { ++_count; }
+    };
+
+    unsigned countTriangles(osg::Node* node)
+    {
+        struct Counter : public osg::NodeVisitor
+        {
+            Counter() : osg::NodeVisitor(TRAVERSE_ALL_CHILDREN), _count(0u) { }
+            void apply(osg::Drawable& drawable)
+            {
+                osg::TriangleIndexFunctor<CountTriangles> count;
+                drawable.accept(count);
+                _count += count._count;
+            }
+            unsigned _count;
+        };
+        Counter counter;
+        node->accept(counter);
+        return counter._count;
+    }
+
+    // Writes the cells of the octree, depth first.
+    struct CellBuilder
+    {
+        const Model& _model;
+        unsigned _maxTriangles;
+        unsigned _maxDepth;
+        std::string _folder;
+        const osgDB::Options* _writeOptions;
+        unsigned _numCells;
+        Status _status;
+
+        CellBuilder(const Model& model, unsigned maxTriangles, unsigned maxDepth, const std::string& folder, const osgDB::Options* writeOptions) :
+            _model(model),
+            _maxTriangles(osg::maximum(maxTriangles, 1u)),
+            _maxDepth(maxDepth),
+            _folder(folder),
+            _writeOptions(writeOptions),
+            _numCells(0u) { }
+
+        // Merges the triangles into one geometry per state set
+        osg::Node* merge(const std::vector<unsigned>& triangles) const
+        {
+            struct Batch
+            {
+                osg::ref_ptr<osg::Geometry> _geom;
+                osg::Vec3Array* _verts;
+                osg::Vec3Array* _normals;
+                osg::Vec4Array* _colors;
+                osg::Vec2Array* _texcoords;
+                osg::DrawElementsUInt* _elements;
+                std::unordered_map<unsigned long long, unsigned> _remap;
+            };
+
+            std::map<osg::StateSet*, Batch> batches;
+            bool hasNormals = false, hasTexcoords = false;
+            for (auto t : triangles)
+            {
+                const Source& source = _model._sources[_model._triangles[t]._source];
+                hasNormals = hasNormals || source._normals.valid();
+                hasTexcoords = hasTexcoords || source._texcoords.valid();
+            }
+
+            for (auto t : triangles)
+            {
+                const Triangle& tri = _model._triangles[t];
+                const Source& source = _model._sources[tri._source];
+
+                Batch& batch = batches[source._stateSet.get()];
+                if (!batch._geom.valid())
+                {
+                    batch._geom = new osg::Geometry();
+                    batch._geom->setUseVertexBufferObjects(true);
+                    batch._geom->setUseDisplayList(false);
+                    batch._geom->setStateSet(source._stateSet.get());
+                    batch._verts = new osg::Vec3Array();
+                    batch._geom->setVertexArray(batch._verts);
+                    batch._colors = new osg::Vec4Array(osg::Array::BIND_PER_VERTEX);
+                    batch._geom->setColorArray(batch._colors);
+                    batch._normals = hasNormals ? new osg::Vec3Array(osg::Array::BIND_PER_VERTEX) : 0L;
+                    if (batch._normals)
+                        batch._geom->setNormalArray(batch._normals);
+                    batch._texcoords = hasTexcoords ? new osg::Vec2Array() : 0L;
+                    if (batch._texcoords)
+                        batch._geom->setTexCoordArray(0, batch._texcoords);
+                    batch._elements = new osg::DrawElementsUInt(GL_TRIANGLES);
+                    batch._geom->addPrimitiveSet(batch._elements);
+                }
+
+                for (unsigned k = 0; k < 3; ++k)
+                {
+                    unsigned i = tri._index[k];
+                    unsigned long long key = ((unsigned long long)tri._source << 32) | i;
+                    auto r = batch._remap.find(key);
+                    if (r == batch._remap.end())
+                    {
+                        r = batch._remap.emplace(key, batch._verts->size()).first;
+                        batch._verts->push_back((*source._verts)[i]);
+                        batch._colors->push_back(source._colors.valid() ? (*source._colors)[i] : source._color);
+                        if (batch._normals)
+                            batch._normals->push_back(source._normals.valid() ? (*source._normals)[i] : osg::Vec3(0, 0, 1));
+                        if (batch._texcoords)
+                            batch._texcoords->push_back(source._texcoords.valid() ? (*source._texcoords)[i] : osg::Vec2(0, 0));
+                    }
+                    batch._elements->push_back(r->second);
+                }
+            }
+
+            osg::Group* group = new osg::Group();
+            for (auto& b : batches)
+                group->addChild(b.second._geom.get());
+            return group;
+        }
+
+        // Simplified copy of a cell for its parent to draw
+        osg::Node* makeProxy(osg::Node* detail, unsigned targetTriangles) const
+        {
+            unsigned count = countTriangles(detail);
+            if (count <= targetTriangles)
+                return detail;
+
+            // copy the geometry, but share the state
+            osg::Node* proxy = osg::clone(detail,
+                osg::CopyOp::DEEP_COPY_NODES |
+                osg::CopyOp::DEEP_COPY_DRAWABLES |
+                osg::CopyOp::DEEP_COPY_ARRAYS |
+                osg::CopyOp::DEEP_COPY_PRIMITIVES);
+
+            // proxies of inner cells gather geometry from many cells
+            osgUtil::Optimizer::MergeGeometryVisitor mergeGeometry;
+            proxy->accept(mergeGeometry);
+
+            osgUtil::Simplifier simplifier((float)targetTriangles / (float)count);
+            proxy->accept(simplifier);
+            return proxy;
+        }
+
+        bool write(osg::Node* node, const std::string& url)
+        {
+            std::string path = osgDB::concatPaths(_folder, url);
+            if (!osgDB::writeNodeFile(*node, path, _writeOptions))
+            {
+                _status = Status::Error(Status::ResourceUnavailable, Stringify() << "Failed to write " << path);
+                return false;
+            }
+            ++_numCells;
+            return true;
+        }
+
+        // Builds a cell and the cells below it, and fills in the cell's
+        // index entry. Returns the cell's contents, which the parent
+        // simplifies into its proxy.
+        osg::ref_ptr<osg::Node> build(std::vector<unsigned>& triangles, const std::string& id, unsigned depth, Config& entry)
+        {
+            osg::BoundingBoxd box;
+            for (auto t : triangles)
+            {
+                const Triangle& tri = _model._triangles[t];
+                const osg::Vec3Array& verts = *_model._sources[tri._source]._verts;
+                for (unsigned k = 0; k < 3; ++k)
+                    box.expandBy(verts[tri._index[k]]);
+            }
+
+            std::string url = id + ".osgb";
+            entry.set("url", url);
+            entry.set("center", optional<osg::Vec3d>(box.center()));
+            entry.set("radius", box.radius());
+
+            osg::ref_ptr<osg::Node> contents;
+
+            if (triangles.size() <= _maxTriangles || depth >= _maxDepth)
+            {
+                contents = merge(triangles);
+            }
+            else
+            {
+                // split at the center of the box, by centroid
+                std::vector<unsigned> octants[8];
+                osg::Vec3d center = box.center();
+                for (auto t : triangles)
+                {
+                    const osg::Vec3& c = _model._triangles[t]._centroid;
+                    unsigned o =
+                        (c.x() >= center.x() ? 1u : 0u) |
+                        (c.y() >= center.y() ? 2u : 0u) |
+                        (c.z() >= center.z() ? 4u : 0u);
+                    octants[o].push_back(t);
+                }
+                std::vector<unsigned>().swap(triangles);
+
+                unsigned numChildren = 0u;
+                for (unsigned o = 0; o < 8; ++o)
+                    if (!octants[o].empty())
+                        ++numChildren;
+
+                // together, the proxies cost about as much as one full cell
+                unsigned target = osg::maximum(_maxTriangles / numChildren, 1u);
+
+                osg::ref_ptr<osg::Group> group = new osg::Group();
+                for (unsigned o = 0; o < 8 && _status.isOK(); ++o)
+                {
+                    if (octants[o].empty())
+                        continue;
+
+                    Config child("cell");
+                    osg::ref_ptr<osg::Node> detail = build(octants[o], id + (char)('0' + o), depth + 1u, child);
+                    if (detail.valid())
+                        group->addChild(makeProxy(detail.get(), target));
+                    entry.add(child);
+                }
+                contents = group.get();
+            }
+
+            if (!_status.isOK() || !write(contents.get(), url))
+                return 0L;
+
+            return contents;
+        }
+    };
+
+    // One cell of a tiled model at runtime. It shows the proxy from its
+    // parent until it comes in range, and then its own file: the full
+    // triangles for a leaf, or a cell for each child.
+    struct TiledModelCell : public PagedNode
+    {
+        TiledModelCell(const Config& entry, const URIContext& context, float rangeFactor, const osgDB::Options* readOptions, osg::Node* proxy) :
+            _entry(entry),
+            _context(context),
+            _readOptions(readOptions)
+        {
+            optional<osg::Vec3d> center;
+            entry.get("center", center);
+            _bound.set(center.get(), entry.value("radius", 0.0));
+            _url = URI(entry.value("url"), context);
+
+            setRangeFactor(rangeFactor);
+            setAdditive(false);
+            setNode(proxy);
+            setupPaging();
+        }
+
+        osg::BoundingSphere getChildBound() const
+        {
+            return _bound;
+        }
+
+        osg::Node* loadChild()
+        {
+            osg::ref_ptr<osg::Node> node = _url.getNode(_readOptions.get());
+            if (!node.valid())
+            {
+                OE_WARN << LC << "Failed to load " << _url.full() << std::endl;
+                return 0L;
+            }
+
+            ConfigSet children = _entry.children("cell");
+            if (children.empty())
+                return node.release();
+
+            // an inner cell's file holds the proxies of its children, in order
+            osg::Group* proxies = node->asGroup();
+            osg::Group* group = new osg::Group();
+            unsigned i = 0;
+            for (auto& child : children)
+            {
+                osg::Node* proxy = proxies && i < proxies->getNumChildren() ? proxies->getChild(i) : 0L;
+                group->addChild(new TiledModelCell(child, _context, getRangeFactor(), _readOptions.get(), proxy));
+                ++i;
+            }
+            return group;
+        }
+
+        Config _entry;
+        URIContext _context;
+        URI _url;
+        osg::BoundingSphere _bound;
+        osg::ref_ptr<const osgDB::Options> _readOptions;
+    };
+}
+
+ModelTiler::ModelTiler() :
+    _maxTriangles(65536u),
+    _maxDepth(8u)
+{
+    //nop
+}
+
+Status
+ModelTiler::tile(osg::Node* model, const std::string& folder, const osgDB::Options* writeOptions) const
+{
+    if (!model)
+        return Status::Error(Status::ConfigurationError, "No model");
+
+    osgDB::makeDirectory(folder);
+    if (!osgDB::fileExists(folder))
+        return Status::Error(Status::ResourceUnavailable, Stringify() << "Failed to create " << folder);
+
+    Model source;
+    Collector collector(source);
+    model->accept(collector);
+
+    if (source._triangles.empty())
+        return Status::Error(Status::ResourceUnavailable, "Model has no triangles");
+
+    OE_INFO << LC << "Tiling " << source._triangles.size() << " triangles" << std::endl;
+
+    std::vector<unsigned> triangles(source._triangles.size());
+    for (unsigned i = 0; i < triangles.size(); ++i)
+        triangles[i] = i;
+
+    CellBuilder builder(source, _maxTriangles, _maxDepth, folder, writeOptions);
+    Config root("cell");
+    builder.build(triangles, "c", 0u, root);
+    if (builder._status.isError())
+        return builder._status;
+
+    Config index("tiles");
+    index.set("version", 1);
+    index.add(root);
+
+    std::string indexPath = osgDB::concatPaths(folder, INDEX_FILE_NAME);
+    std::ofstream out(indexPath.c_str());
+    if (!out.is_open())
+        return Status::Error(Status::ResourceUnavailable, Stringify() << "Failed to write " << indexPath);
+    out << index.toJSON(true);
+
+    OE_INFO << LC << "Wrote " << builder._numCells << " cells to " << folder << std::endl;
+    return Status::OK();
+}
+
+osg::Node*
+ModelTiler::load(const URI& index, float rangeFactor, const osgDB::Options* readOptions)
+{
+    std::string json = index.getString(readOptions);
+    Config conf;
+    if (json.empty() || !conf.fromJSON(json))
+    {
+        OE_WARN << LC << "Failed to read the index " << index.full() << std::endl;
+        return 0L;
+    }
+
+    // fromJSON may or may not wrap the content in its root key
+    const Config& tiles = conf.hasChild("tiles") ? conf.child("tiles") : conf;
+    if (!tiles.hasChild("cell"))
+    {
+        OE_WARN << LC << "No cells in " << index.full() << std::endl;
+        return 0L;
+    }
+
+    // Cells share textures through the object cache
+    osg::ref_ptr<osgDB::Options> options = Registry::cloneOrCreateOptions(readOptions);
+    options->setObjectCacheHint(osgDB::Options::CACHE_IMAGES);
+
+    // the root has nobody to carry its proxy, so it always pages in
+    TiledModelCell* root = new TiledModelCell(tiles.child("cell"), URIContext(index.full()), rangeFactor, options.get(), 0L);
+    root->setRange(FLT_MAX);
+    root->setupPaging();
+    return root;
+}
@@ -0,0 +1,236 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+ * Copyright 2020 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarth/NegativeTileCache>
+#include <osgEarth/CacheBin>
+#include <osgEarth/TileKey>
+#include <osgEarth/Profile>
+#include <osgEarth/Notify>
+#include <cstring>
+
+using namespace osgEarth;
+
+#define LC "[NegativeTileCache] "
+
+namespace
+{
+    const std::uint32_t MAGIC = 0x544e454f; // "OENT"
+    const std::uint32_t VERSION = 1;
+
+    struct Header
+    {
+        std::uint32_t magic;
+        std::uint32_t version;
+        std::int64_t  created;
+        std::uint64_t count;
+    };
+
+    // FNV-1a; it has to be the same everywhere since the hashes are saved
+    inline std::uint64_t fnv1a(const std::string& s, std::uint64_t h =14695981039346656037ull)
+    {
+        for (unsigned i = 0; i < s.length(); ++i)
+        {
+            h ^= (unsigned char)s[i];
+            h *= 1099511628211ull;
+        }
+        return h;
+    }
+}
+
+NegativeTileCache::NegativeTileCache(TimeSpan ttl) :
+    _ttl(ttl),
+    _created(0),
+    _unsaved(0u),
+    _filter(FILTER_BITS / 64u),
+    _mutex(OE_MUTEX_NAME)
+{
+    reset(DateTime().asTimeStamp());
+}
+
+NegativeTileCache::~NegativeTileCache()
+{
+    //nop
+}
+
+NegativeTileCache::Hash
+NegativeTileCache::hash(const TileKey& key)
+{
+    return fnv1a(key.getProfile()->getHorizSignature(), fnv1a(key.str()));
+}
+
+bool
+NegativeTileCache::filterContains(Hash h) const
+{
+    // double hashing: bit i = h1 + i*h2
+    std::uint32_t h1 = (std::uint32_t)h, h2 = (std::uint32_t)(h >> 32) | 1u;
+    for (unsigned i = 0; i < NUM_HASHES; ++i)
+    {
+        std::uint32_t bit = (h1 + i * h2) % FILTER_BITS;
+        if ((_filter[bit >> 6].load(std::memory_order_relaxed) & (1ull << (bit & 63))) == 0)
+            return false;
+    }
+    return true;
+}
+
+void
+NegativeTileCache::filterAdd(Hash h)
+{
+    std::uint32_t h1 = (std::uint32_t)h, h2 = (std::uint32_t)(h >> 32) | 1u;
+    for (unsigned i = 0; i < NUM_HASHES; ++i)
+    {
+        std::uint32_t bit = (h1 + i * h2) % FILTER_BITS;
+        _filter[bit >> 6].fetch_or(1ull << (bit & 63), std::memory_order_relaxed);
+    }
+}
+
+bool
+NegativeTileCache::isExpired() const
+{
+    return _ttl > 0 && DateTime().asTimeStamp() - _created > _ttl;
+}
+
+void
+NegativeTileCache::reset(TimeStamp created)
+{
+    _hashes.clear();
+    for (unsigned i = 0; i < _filter.size(); ++i)
+        _filter[i].store(0u, std::memory_order_relaxed);
+    _created = created;
+    _unsaved = 0u;
+}
+
+bool
+NegativeTileCache::contains(const TileKey& key) const
+{
+    Hash h = hash(key);
+
+    // most keys are NOT in the set, and the filter says so without a lock.
+    if (!filterContains(h))
+        return false;
+
+    Threading::ScopedMutexLock lock(_mutex);
+    return !isExpired() && _hashes.find(h) != _hashes.end();
+}
+
+void
+NegativeTileCache::add(const TileKey& key)
+{
+    Hash h = hash(key);
+
+    Threading::ScopedMutexLock lock(_mutex);
+
+    if (isExpired())
+        reset(DateTime().asTimeStamp());
+
+    if (_hashes.size() < MAX_KEYS && _hashes.insert(h).second)
+    {
+        filterAdd(h);
+        ++_unsaved;
+    }
+}
+
+void
+NegativeTileCache::clear()
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    reset(DateTime().asTimeStamp());
+}
+
+unsigned
+NegativeTileCache::size() const
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    return _hashes.size();
+}
+
+bool
+NegativeTileCache::read(CacheBin* bin, const std::string& cacheKey)
+{
+    if (!bin)
+        return false;
+
+    ReadResult r = bin->readString(cacheKey, 0L);
+    if (!r.succeeded())
+        return false;
+
+    const std::string& buf = r.getString();
+    if (buf.size() < sizeof(Header))
+        return false;
+
+    Header header;
+    ::memcpy(&header, buf.data(), sizeof(Header));
+    if (header.magic != MAGIC || header.version != VERSION ||
+        buf.size() < sizeof(Header) + header.count * sizeof(Hash))
+    {
+        return false;
+    }
+
+    Threading::ScopedMutexLock lock(_mutex);
+
+    reset((TimeStamp)header.created);
+    if (isExpired())
+    {
+        reset(DateTime().asTimeStamp());
+        return false;
+    }
+
+    const char* ptr = buf.data() + sizeof(Header);
+    for (std::uint64_t i = 0; i < header.count && _hashes.size() < MAX_KEYS; ++i, ptr += sizeof(Hash))
+    {
+        Hash h;
+        ::memcpy(&h, ptr, sizeof(Hash));
+        if (_hashes.insert(h).second)
+            filterAdd(h);
+    }
+
+    OE_DEBUG << LC << "Restored " << _hashes.size() << " missing tiles from " << cacheKey << std::endl;
+    return true;
+}
+
+bool
+NegativeTileCache::write(CacheBin* bin, const std::string& cacheKey)
+{
+    if (!bin)
+        return false;
+
+    std::string buf;
+    {
+        Threading::ScopedMutexLock lock(_mutex);
+
+        Header header;
+        header.magic = MAGIC;
+        header.version = VERSION;
+        header.created = (std::int64_t)_created;
+        header.count = _hashes.size();
+
+        buf.resize(sizeof(Header) + _hashes.size() * sizeof(Hash));
+        ::memcpy(&buf[0], &header, sizeof(Header));
+
+        char* ptr = &buf[sizeof(Header)];
+        for (auto h : _hashes)
+        {
+            ::memcpy(ptr, &h, sizeof(Hash));
+            ptr += sizeof(Hash);
+        }
+
+        _unsaved = 0u;
+    }
+
+    osg::ref_ptr<StringObject> obj = new StringObject(buf);
+    return bin->write(cacheKey, obj.get(), Config(), 0L);
+}
@@ -19,8 +19,11 @@
 
 #include <osgEarth/NetworkMonitor>
 #include <osgEarth/Threading>
+#include <osg/Math>
 #include <osgDB/fstream>
 #include <iomanip>
+#include <cmath>
+#include <cstdlib>
 
 using namespace osgEarth;
 
@@ -31,6 +34,95 @@ namespace
     static unsigned long s_requestId = 0;
     static bool s_enabled = false;
     static std::map<unsigned int, std::string> s_requestLayer;
+
+    static bool s_telemetryEnabled = ::getenv("OSGEARTH_NETWORK_TELEMETRY") != 0L;
+    static osgEarth::Threading::Mutex s_statsMutex("NetworkMonitor Stats(OE)");
+    static NetworkMonitor::StatsTable s_hostStats;
+    static NetworkMonitor::StatsTable s_layerStats;
+
+    const double HISTOGRAM_FIRST_LIMIT_MS = 0.1;
+    const double HISTOGRAM_BUCKETS_PER_DOUBLING = 4.0;
+
+    // Prometheus label values escape backslash, quote and newline
+    std::string escapeLabel(const std::string& in)
+    {
+        std::string out;
+        out.reserve(in.size());
+        for (std::string::const_iterator c = in.begin(); c != in.end(); ++c)
+        {
+            if (*c == '\\') out += "\\\\";
+            else if (*c == '"') out += "\\\"";
+            else if (*c == '\n') out += "\\n";
+            else out += *c;
+        }
+        return out;
+    }
+
+    void touch(NetworkMonitor::Stats& stats)
+    {
+        osg::Timer_t now = osg::Timer::instance()->tick();
+        if (stats.requests == 0 && stats.cacheHits == 0 && stats.cacheMisses == 0 && stats.retries == 0)
+            stats.firstTime = now;
+        stats.lastTime = now;
+    }
+
+    void writeStats(std::ostream& out, const char* prefix, const char* label, const NetworkMonitor::StatsTable& table)
+    {
+        struct Counter { const char* name; const char* help; unsigned long long NetworkMonitor::Stats::*member; };
+        const Counter counters[] = {
+            { "requests_total",     "HTTP requests completed",                &NetworkMonitor::Stats::requests },
+            { "failures_total",     "HTTP requests that failed",              &NetworkMonitor::Stats::failures },
+            { "retries_total",      "Failed HTTP requests scheduled to retry", &NetworkMonitor::Stats::retries },
+            { "bytes_total",        "Bytes received",                         &NetworkMonitor::Stats::bytes },
+            { "cache_hits_total",   "Cache reads that found data",            &NetworkMonitor::Stats::cacheHits },
+            { "cache_misses_total", "Cache reads that found nothing",         &NetworkMonitor::Stats::cacheMisses }
+        };
+
+        for (unsigned c = 0; c < sizeof(counters) / sizeof(counters[0]); ++c)
+        {
+            out << "# HELP " << prefix << counters[c].name << " " << counters[c].help << "\n"
+                << "# TYPE " << prefix << counters[c].name << " counter\n";
+            for (NetworkMonitor::StatsTable::const_iterator i = table.begin(); i != table.end(); ++i)
+            {
+                out << prefix << counters[c].name << "{" << label << "=\"" << escapeLabel(i->first) << "\"} "
+                    << i->second.*(counters[c].member) << "\n";
+            }
+        }
+
+        out << "# HELP " << prefix << "bytes_per_second Receive throughput\n"
+            << "# TYPE " << prefix << "bytes_per_second gauge\n";
+        for (NetworkMonitor::StatsTable::const_iterator i = table.begin(); i != table.end(); ++i)
+        {
+            out << prefix << "bytes_per_second{" << label << "=\"" << escapeLabel(i->first) << "\"} "
+                << i->second.getBytesPerSecond() << "\n";
+        }
+
+        struct Summary { const char* name; const char* help; NetworkMonitor::Histogram NetworkMonitor::Stats::*member; };
+        const Summary summaries[] = {
+            { "request_duration_seconds",    "Total HTTP request time",          &NetworkMonitor::Stats::latency },
+            { "queue_wait_duration_seconds", "Time spent waiting on host limits", &NetworkMonitor::Stats::queueWait },
+            { "transfer_duration_seconds",   "Time spent transferring",          &NetworkMonitor::Stats::transfer }
+        };
+        const double quantiles[] = { 0.5, 0.95, 0.99 };
+
+        for (unsigned s = 0; s < sizeof(summaries) / sizeof(summaries[0]); ++s)
+        {
+            out << "# HELP " << prefix << summaries[s].name << " " << summaries[s].help << "\n"
+                << "# TYPE " << prefix << summaries[s].name << " summary\n";
+            for (NetworkMonitor::StatsTable::const_iterator i = table.begin(); i != table.end(); ++i)
+            {
+                const NetworkMonitor::Histogram& h = i->second.*(summaries[s].member);
+                std::string name = escapeLabel(i->first);
+                for (unsigned q = 0; q < 3; ++q)
+                {
+                    out << prefix << summaries[s].name << "{" << label << "=\"" << name << "\",quantile=\"" << quantiles[q] << "\"} "
+                        << h.percentile(quantiles[q]) * 0.001 << "\n";
+                }
+                out << prefix << summaries[s].name << "_sum{" << label << "=\"" << name << "\"} " << h.sum * 0.001 << "\n"
+                    << prefix << summaries[s].name << "_count{" << label << "=\"" << name << "\"} " << h.count << "\n";
+            }
+        }
+    }
 }
 
 #define LC "[NetworkMonitor] "
@@ -134,6 +226,177 @@ void NetworkMonitor::setRequestLayer(const std::string& name)
 std::string NetworkMonitor::getRequestLayer()
 {
     osgEarth::Threading::ScopedReadLock lock(s_requestsMutex);
-    return s_requestLayer[osgEarth::Threading::getCurrentThreadId()];
+    std::map<unsigned int, std::string>::const_iterator i = s_requestLayer.find(osgEarth::Threading::getCurrentThreadId());
+    return i != s_requestLayer.end() ? i->second : std::string();
+}
+
+//------------------------------------------------------------------------
+
+NetworkMonitor::Histogram::Histogram() :
+    count(0),
+    sum(0.0)
+{
+    for (unsigned i = 0; i <= NUM_BUCKETS; ++i)
+        counts[i] = 0;
+}
+
+double NetworkMonitor::Histogram::getBucketLimit(unsigned bucket)
+{
+    return HISTOGRAM_FIRST_LIMIT_MS * std::pow(2.0, (double)bucket / HISTOGRAM_BUCKETS_PER_DOUBLING);
+}
+
+void NetworkMonitor::Histogram::add(double ms)
+{
+    unsigned bucket = 0;
+    if (ms > HISTOGRAM_FIRST_LIMIT_MS)
+    {
+        double b = std::ceil(std::log(ms / HISTOGRAM_FIRST_LIMIT_MS) / std::log(2.0) * HISTOGRAM_BUCKETS_PER_DOUBLING);
+        bucket = b >= (double)NUM_BUCKETS ? (unsigned)NUM_BUCKETS : (unsigned)b;
+    }
+    ++counts[bucket];
+    ++count;
+    sum += ms;
+}
+
+double NetworkMonitor::Histogram::percentile(double p) const
+{
+    if (count == 0)
+        return 0.0;
+
+    // rank of the sample we want, then interpolate within its bucket
+    double rank = osg::clampBetween(p, 0.0, 1.0) * (double)count;
+    unsigned long long seen = 0;
+    for (unsigned i = 0; i < NUM_BUCKETS; ++i)
+    {
+        if (counts[i] > 0 && (double)(seen + counts[i]) >= rank)
+        {
+            double lo = i > 0 ? getBucketLimit(i - 1) : 0.0;
+            double hi = getBucketLimit(i);
+            return lo + (hi - lo) * ((rank - (double)seen) / (double)counts[i]);
+        }
+        seen += counts[i];
+    }
+    return getBucketLimit(NUM_BUCKETS - 1);
+}
+
+NetworkMonitor::Stats::Stats() :
+    requests(0),
+    failures(0),
+    retries(0),
+    bytes(0),
+    cacheHits(0),
+    cacheMisses(0),
+    firstTime(0),
+    lastTime(0)
+{
+    //nop
+}
+
+double NetworkMonitor::Stats::getBytesPerSecond() const
+{
+    double s = osg::Timer::instance()->delta_s(firstTime, lastTime);
+    return s > 0.0 ? (double)bytes / s : 0.0;
+}
+
+double NetworkMonitor::Stats::getCacheHitRatio() const
+{
+    unsigned long long reads = cacheHits + cacheMisses;
+    return reads > 0 ? (double)cacheHits / (double)reads : 0.0;
+}
+
+void NetworkMonitor::setTelemetryEnabled(bool enabled)
+{
+    s_telemetryEnabled = enabled;
+}
+
+bool NetworkMonitor::getTelemetryEnabled()
+{
+    return s_telemetryEnabled;
+}
+
+void NetworkMonitor::recordRequest(
+    const std::string& host,
+    const std::string& layer,
+    double queueWait_ms,
+    double transfer_ms,
+    unsigned long long bytes,
+    bool failed)
+{
+    if (!s_telemetryEnabled)
+        return;
+
+    osgEarth::Threading::ScopedMutexLock lock(s_statsMutex);
+
+    Stats* tables[2] = { &s_hostStats[host], layer.empty() ? 0L : &s_layerStats[layer] };
+    for (unsigned i = 0; i < 2; ++i)
+    {
+        Stats* stats = tables[i];
+        if (!stats) continue;
+        touch(*stats);
+        ++stats->requests;
+        if (failed) ++stats->failures;
+        stats->bytes += bytes;
+        stats->latency.add(queueWait_ms + transfer_ms);
+        stats->queueWait.add(queueWait_ms);
+        stats->transfer.add(transfer_ms);
+    }
+}
+
+void NetworkMonitor::recordRetry(const std::string& host, const std::string& layer)
+{
+    if (!s_telemetryEnabled)
+        return;
+
+    osgEarth::Threading::ScopedMutexLock lock(s_statsMutex);
+    Stats& hostStats = s_hostStats[host];
+    touch(hostStats);
+    ++hostStats.retries;
+    if (!layer.empty())
+    {
+        Stats& layerStats = s_layerStats[layer];
+        touch(layerStats);
+        ++layerStats.retries;
+    }
+}
+
+void NetworkMonitor::recordCacheRead(const std::string& layer, bool hit)
+{
+    if (!s_telemetryEnabled)
+        return;
+
+    osgEarth::Threading::ScopedMutexLock lock(s_statsMutex);
+    Stats& stats = s_layerStats[layer];
+    touch(stats);
+    if (hit) ++stats.cacheHits;
+    else ++stats.cacheMisses;
+}
+
+void NetworkMonitor::getHostStats(StatsTable& out)
+{
+    osgEarth::Threading::ScopedMutexLock lock(s_statsMutex);
+    out = s_hostStats;
+}
+
+void NetworkMonitor::getLayerStats(StatsTable& out)
+{
+    osgEarth::Threading::ScopedMutexLock lock(s_statsMutex);
+    out = s_layerStats;
+}
+
+void NetworkMonitor::clearStats()
+{
+    osgEarth::Threading::ScopedMutexLock lock(s_statsMutex);
+    s_hostStats.clear();
+    s_layerStats.clear();
+}
+
+void NetworkMonitor::writePrometheus(std::ostream& out)
+{
+    StatsTable hosts, layers;
+    getHostStats(hosts);
+    getLayerStats(layers);
+
+    writeStats(out, "osgearth_host_", "host", hosts);
+    writeStats(out, "osgearth_layer_", "layer", layers);
 }
 
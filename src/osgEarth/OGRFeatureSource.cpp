@@ -24,10 +24,16 @@
 
 #include <osgEarth/Registry>
 #include <osgEarth/StringUtils>
+#include <osgEarth/FileUtils>
+#include <osgDB/FileUtils>
+#include <osgDB/FileNameUtils>
 #include <list>
 #include <cpl_error.h>
+#include <cpl_vsi.h>
 #include <ogr_api.h>
 #include <queue>
+#include <fstream>
+#include <atomic>
 
 #define LC "[OGRFeatureSource] "
 
@@ -105,7 +111,11 @@ _nextHandleToQueue( 0L ),
 _resultSetEndReached(false),
 _profile          ( profile ),
 _filters          ( filters ),
-_rewindPolygons   (rewindPolygons)
+_rewindPolygons   (rewindPolygons),
+_nextFid          ( 0u ),
+_useFids          ( false ),
+_prefetch         ( false ),
+_prefetchPending  ( false )
 {
     std::string expr;
     std::string from = OGR_FD_GetName(OGR_L_GetLayerDefn(_layerHandle));
@@ -197,6 +207,40 @@ _rewindPolygons   (rewindPolygons)
     readChunk();
 }
 
+OGR::OGRFeatureCursor::OGRFeatureCursor(OGRDataSourceH                dsHandle,
+                                        OGRLayerH                     layerHandle,
+                                        const FeatureSource*          source,
+                                        const FeatureProfile*         profile,
+                                        const std::vector<FeatureID>& fids,
+                                        const Query&                  query,
+                                        const FeatureFilterChain*     filters,
+                                        ProgressCallback*             progress,
+                                        bool                          rewindPolygons
+                                        ) :
+FeatureCursor     ( progress ),
+_source           ( source ),
+_dsHandle         ( dsHandle ),
+_layerHandle      ( layerHandle ),
+_resultSetHandle  ( layerHandle ),
+_spatialFilter    ( 0L ),
+_query            ( query ),
+_chunkSize        ( 500 ),
+_nextHandleToQueue( 0L ),
+_resultSetEndReached(false),
+_profile          ( profile ),
+_filters          ( filters ),
+_rewindPolygons   (rewindPolygons),
+_fids             ( fids ),
+_nextFid          ( 0u ),
+_useFids          ( true ),
+_prefetch         ( false ),
+_prefetchPending  ( false )
+{
+    // the features come straight off the layer by FID, so there is no
+    // result set to release; _resultSetHandle == _layerHandle marks that.
+    readChunk();
+}
+
 OGR::OGRFeatureCursor::OGRFeatureCursor(OGRLayerH resultSetHandle, const FeatureProfile* profile) :
     FeatureCursor(NULL),
     _resultSetHandle(resultSetHandle),
@@ -206,7 +250,11 @@ OGR::OGRFeatureCursor::OGRFeatureCursor(OGRLayerH resultSetHandle, const Feature
     _spatialFilter(0L),
     _chunkSize(500),
     _nextHandleToQueue(0L),
-    _resultSetEndReached(false)
+    _resultSetEndReached(false),
+    _nextFid(0u),
+    _useFids(false),
+    _prefetch(false),
+    _prefetchPending(false)
 {
     if (_resultSetHandle)
     {
@@ -216,8 +264,103 @@ OGR::OGRFeatureCursor::OGRFeatureCursor(OGRLayerH resultSetHandle, const Feature
     readChunk();
 }
 
+OGR::OGRFeatureCursor::OGRFeatureCursor(OGRDataSourceH              dsHandle,
+                                        const std::string&          memFile,
+                                        const FeatureSource*        source,
+                                        const FeatureProfile*       profile,
+                                        const Query&                query,
+                                        const FeatureFilterChain*   filters,
+                                        const std::string&          fidAttribute,
+                                        ProgressCallback*           progress,
+                                        bool                        rewindPolygons
+                                        ) :
+FeatureCursor     ( progress ),
+_source           ( source ),
+_dsHandle         ( dsHandle ),
+_layerHandle      ( OGR_DS_GetLayer(dsHandle, 0) ),
+_spatialFilter    ( 0L ),
+_query            ( query ),
+_chunkSize        ( 500 ),
+_nextHandleToQueue( 0L ),
+_resultSetEndReached(false),
+_profile          ( profile ),
+_filters          ( filters ),
+_rewindPolygons   (rewindPolygons),
+_nextFid          ( 0u ),
+_useFids          ( false ),
+_fidAttribute     ( fidAttribute ),
+_memFile          ( memFile ),
+_prefetch         ( true ),
+_prefetchPending  ( false )
+{
+    // read the layer itself; there is no result set to release
+    _resultSetHandle = _layerHandle;
+
+    // the server already did the spatial query; the bounds only set up the filter context
+    if (_query.tileKey().isSet() && !_query.bounds().isSet() && profile)
+    {
+        GeoExtent localEx = _query.tileKey()->getExtent().transform(profile->getSRS());
+        _query.bounds() = localEx.bounds();
+    }
+
+    if (_resultSetHandle)
+    {
+        OGR_L_ResetReading(_resultSetHandle);
+    }
+
+    readChunk();
+}
+
+OGR::OGRFeatureCursor*
+OGR::OGRFeatureCursor::openDocument(const std::string&          data,
+                                    const std::string&          driverName,
+                                    const std::string&          extension,
+                                    const FeatureSource*        source,
+                                    const FeatureProfile*       profile,
+                                    const Query&                query,
+                                    const FeatureFilterChain*   filters,
+                                    const std::string&          fidAttribute,
+                                    ProgressCallback*           progress,
+                                    bool                        rewindPolygons)
+{
+    OGRSFDriverH driver = OGRGetDriverByName(driverName.c_str());
+    if (!driver || data.empty())
+        return 0L;
+
+    // OGR drivers read large files incrementally, but parse a document
+    // passed as a string all at once; so hand it over as a memory file.
+    static std::atomic<unsigned> s_count(0u);
+    std::string memFile = Stringify() << "/vsimem/osgEarth_document_" << s_count++ << extension;
+
+    GByte* copy = (GByte*)VSIMalloc(data.size());
+    if (!copy)
+        return 0L;
+    memcpy(copy, data.data(), data.size());
+
+    VSILFILE* fp = VSIFileFromMemBuffer(memFile.c_str(), copy, data.size(), TRUE);
+    if (!fp)
+    {
+        VSIFree(copy);
+        return 0L;
+    }
+    VSIFCloseL(fp);
+
+    OGRDataSourceH ds = OGROpen(memFile.c_str(), FALSE, &driver);
+    if (!ds)
+    {
+        VSIUnlink(memFile.c_str());
+        return 0L;
+    }
+
+    return new OGRFeatureCursor(ds, memFile, source, profile, query, filters, fidAttribute, progress, rewindPolygons);
+}
+
 OGR::OGRFeatureCursor::~OGRFeatureCursor()
 {
+    // the background decode uses the datasource
+    if ( _prefetchPending )
+        _prefetching.get();
+
     if ( _nextHandleToQueue )
         OGR_F_Destroy( _nextHandleToQueue );
 
@@ -229,6 +372,13 @@ OGR::OGRFeatureCursor::~OGRFeatureCursor()
 
     if ( _dsHandle )
         OGRReleaseDataSource( _dsHandle );
+
+    if ( !_memFile.empty() )
+    {
+        VSIUnlink( _memFile.c_str() );
+        // the GML driver may leave a schema file next to the document
+        VSIUnlink( (osgDB::getNameLessExtension(_memFile) + ".gfs").c_str() );
+    }
 }
 
 bool
@@ -262,80 +412,145 @@ OGR::OGRFeatureCursor::readChunk()
 {
     if ( !_resultSetHandle )
         return;
+
+    if ( _prefetch )
+    {
+        // take what the background decode produced (decoding here if
+        // nothing was started) and start on the next chunk right away
+        if ( _prefetchPending )
+        {
+            _prefetching.get();
+            _prefetchPending = false;
+        }
+
+        while( _prefetched.empty() && !_resultSetEndReached )
+            decodeChunk( _prefetched );
+
+        for(FeatureList::const_iterator i = _prefetched.begin(); i != _prefetched.end(); ++i)
+        {
+            _queue.push( i->get() );
+        }
+        _prefetched.clear();
+
+        startPrefetch();
+        return;
+    }
     
     while( _queue.size() < _chunkSize && !_resultSetEndReached )
     {
         FeatureList filterList;
-        while( filterList.size() < _chunkSize && !_resultSetEndReached )
+        decodeChunk( filterList );
+
+        for(FeatureList::const_iterator i = filterList.begin(); i != filterList.end(); ++i)
+        {
+            _queue.push( i->get() );
+        }
+    }
+}
+
+void
+OGR::OGRFeatureCursor::startPrefetch()
+{
+    if ( _resultSetEndReached )
+        return;
+
+    Threading::Promise<osg::Referenced> promise;
+    _prefetching = promise.getFuture();
+    _prefetchPending = true;
+
+    // the destructor waits for this, so the cursor outlives the job
+    OGRFeatureCursor* cursor = this;
+    Threading::runInJobArena(Registry::instance()->getJobArena("features.prefetch"), [cursor, promise]() mutable {
+        while( cursor->_prefetched.empty() && !cursor->_resultSetEndReached )
+            cursor->decodeChunk( cursor->_prefetched );
+        promise.resolve(0L);
+    });
+}
+
+// decodes up to a chunk of features and runs them through the filters
+void
+OGR::OGRFeatureCursor::decodeChunk(FeatureList& filterList)
+{
+    while( filterList.size() < _chunkSize && !_resultSetEndReached )
+    {
+        OGRFeatureH handle = 0L;
+        if (_useFids)
+        {
+            // skip FIDs that no longer resolve (e.g. deleted features)
+            while (!handle && _nextFid < _fids.size())
+                handle = OGR_L_GetFeature( _layerHandle, _fids[_nextFid++] );
+        }
+        else
         {
-            OGRFeatureH handle = OGR_L_GetNextFeature( _resultSetHandle );
-            if ( handle )
+            handle = OGR_L_GetNextFeature( _resultSetHandle );
+        }
+
+        if ( handle )
+        {
+            /*
+            // Crop the geometry by the spatial filter.  Could be useful for tiling.
+            if (_spatialFilter)
             {
-                /*
-                // Crop the geometry by the spatial filter.  Could be useful for tiling.
-                if (_spatialFilter)
-                {
-                    OGRGeometryH geomRef = OGR_F_GetGeometryRef(handle);
-                    OGRGeometryH intersection = OGR_G_Intersection(geomRef, _spatialFilter);
-                    OGR_F_SetGeometry(handle, intersection);
-                }
-                */
-                osg::ref_ptr<Feature> feature = OgrUtils::createFeature( handle, _profile.get(), _rewindPolygons);
+                OGRGeometryH geomRef = OGR_F_GetGeometryRef(handle);
+                OGRGeometryH intersection = OGR_G_Intersection(geomRef, _spatialFilter);
+                OGR_F_SetGeometry(handle, intersection);
+            }
+            */
+            osg::ref_ptr<Feature> feature = OgrUtils::createFeature( handle, _profile.get(), _rewindPolygons);
+
+            if (feature.valid() && !_fidAttribute.empty())
+            {
+                feature->setFID( Strings::as<FeatureID>(feature->getString(_fidAttribute), 0) );
+            }
 
-                if (feature.valid())
+            if (feature.valid())
+            {
+                if (_source == NULL || !_source->isBlacklisted(feature->getFID()))
                 {
-                    if (_source == NULL || !_source->isBlacklisted(feature->getFID()))
+                    if (validateGeometry( feature->getGeometry() ))
                     {
-                        if (validateGeometry( feature->getGeometry() ))
-                        {
-                            filterList.push_back( feature.release() );
-                        }
-                        else
-                        {
-                            OE_DEBUG << LC << "Invalid geometry found at feature " << feature->getFID() << std::endl;
-                        }
+                        filterList.push_back( feature.release() );
                     }
                     else
                     {
-                        OE_DEBUG << LC << "Blacklisted feature " << feature->getFID() << " skipped" << std::endl;
+                        OE_DEBUG << LC << "Invalid geometry found at feature " << feature->getFID() << std::endl;
                     }
                 }
                 else
                 {
-                    OE_DEBUG << LC << "Skipping NULL feature" << std::endl;
+                    OE_DEBUG << LC << "Blacklisted feature " << feature->getFID() << " skipped" << std::endl;
                 }
-                OGR_F_Destroy( handle );
             }
             else
             {
-                _resultSetEndReached = true;
+                OE_DEBUG << LC << "Skipping NULL feature" << std::endl;
             }
+            OGR_F_Destroy( handle );
         }
-
-        // preprocess the features using the filter list:
-        if ( _filters.valid() && !_filters->empty() )
+        else
         {
-            FilterContext cx;
-            cx.setProfile( _profile.get() );
-            if (_query.bounds().isSet())
-            {
-                cx.extent() = GeoExtent(_profile->getSRS(), _query.bounds().get());
-            }
-            else
-            {
-                cx.extent() = _profile->getExtent();
-            }
+            _resultSetEndReached = true;
+        }
+    }
 
-            for( FeatureFilterChain::const_iterator i = _filters->begin(); i != _filters->end(); ++i )
-            {
-                FeatureFilter* filter = i->get();
-                cx = filter->push( filterList, cx );
-            }
+    // preprocess the features using the filter list:
+    if ( _filters.valid() && !_filters->empty() )
+    {
+        FilterContext cx;
+        cx.setProfile( _profile.get() );
+        if (_query.bounds().isSet())
+        {
+            cx.extent() = GeoExtent(_profile->getSRS(), _query.bounds().get());
+        }
+        else
+        {
+            cx.extent() = _profile->getExtent();
         }
 
-        for(FeatureList::const_iterator i = filterList.begin(); i != filterList.end(); ++i)
+        for( FeatureFilterChain::const_iterator i = _filters->begin(); i != _filters->end(); ++i )
         {
-            _queue.push( i->get() );
+            FeatureFilter* filter = i->get();
+            cx = filter->push( filterList, cx );
         }
     }
 }
@@ -351,6 +566,7 @@ OGRFeatureSource::Options::getConfig() const
     conf.set("ogr_driver", _ogrDriver);
     conf.set("build_spatial_index", _buildSpatialIndex);
     conf.set("force_rebuild_spatial_index", _forceRebuildSpatialIndex);
+    conf.set("packed_spatial_index", _packedSpatialIndex);
     conf.set("geometry", _geometryConfig);
     conf.set("geometry_url", _geometryUrl);
     conf.set("layer", _layer);
@@ -366,6 +582,7 @@ OGRFeatureSource::Options::fromConfig(const Config& conf)
     conf.get("ogr_driver", _ogrDriver);
     conf.get("build_spatial_index", _buildSpatialIndex);
     conf.get("force_rebuild_spatial_index", _forceRebuildSpatialIndex);
+    conf.get("packed_spatial_index", _packedSpatialIndex);
     conf.get("geometry", _geometryConfig);
     conf.get("geometry_url", _geometryUrl);
     conf.get("layer", _layer);
@@ -395,6 +612,7 @@ OGRFeatureSource::init()
     _needsSync = false;
     _writable = false;
     _geometryType = Geometry::TYPE_UNKNOWN;
+    _index = 0L;
 }
 
 Status
@@ -608,6 +826,12 @@ OGRFeatureSource::openImplementation()
         //Get the feature count
         _featureCount = OGR_L_GetFeatureCount(_layerHandle, 1);
 
+        // load or build the packed index for read-only layers, if requested.
+        if (options().packedSpatialIndex() == true && !_writable)
+        {
+            initPackedIndex();
+        }
+
         // establish the feature schema:
         initSchema();
 
@@ -674,6 +898,65 @@ OGRFeatureSource::openImplementation()
     return Status::NoError;
 }
 
+void
+OGRFeatureSource::initPackedIndex()
+{
+    osg::ref_ptr<PackedRTree> index = new PackedRTree();
+
+    // The sidecar lives next to a local file and is stamped with the
+    // file's size and modification time, so editing the data invalidates it.
+    // Anything else (a database, a /vsi path) gets an in-memory index only.
+    std::string filename;
+    PackedRTree::Stamp stamp;
+    if (osgDB::fileExists(_source))
+    {
+        std::ifstream in(_source.c_str(), std::ios::binary | std::ios::ate);
+        stamp.size = in.is_open() ? (unsigned long long)in.tellg() : 0ull;
+        stamp.timestamp = (long long)getLastModifiedTime(_source);
+
+        filename = _source;
+        if (options().layer().isSet())
+            filename += "." + options().layer().get();
+        filename += ".oeidx";
+
+        if (index->read(filename, stamp))
+        {
+            OE_INFO << LC << getName() << " : loaded packed spatial index (" << index->size() << " features)" << std::endl;
+            _index = index.get();
+            return;
+        }
+    }
+
+    OE_INFO << LC << "Building packed spatial index for " << getName() << std::endl;
+
+    if (_featureCount > 0)
+        index->reserve((unsigned)_featureCount);
+
+    OGR_L_ResetReading(_layerHandle);
+    OGRFeatureH handle;
+    while ((handle = OGR_L_GetNextFeature(_layerHandle)) != 0L)
+    {
+        OGRGeometryH geom = OGR_F_GetGeometryRef(handle);
+        if (geom && !OGR_G_IsEmpty(geom))
+        {
+            OGREnvelope env;
+            OGR_G_GetEnvelope(geom, &env);
+            index->add(OGR_F_GetFID(handle), Bounds(env.MinX, env.MinY, env.MaxX, env.MaxY));
+        }
+        OGR_F_Destroy(handle);
+    }
+    OGR_L_ResetReading(_layerHandle);
+
+    index->build();
+
+    if (!filename.empty() && !index->write(filename, stamp))
+    {
+        OE_INFO << LC << getName() << " : cannot write \"" << filename << "\"; keeping the packed index in memory" << std::endl;
+    }
+
+    _index = index.get();
+}
+
 const Status&
 OGRFeatureSource::create(const FeatureProfile* profile,
                          const FeatureSchema& schema,
@@ -817,6 +1100,35 @@ OGRFeatureSource::createFeatureCursorImplementation(const Query& query, Progress
 
             OE_DEBUG << newQuery.getConfig().toJSON(true) << std::endl;
 
+            // A pure spatial query can be answered from the packed index;
+            // anything with SQL in it goes through OGR.
+            if (_index.valid() &&
+                !newQuery.expression().isSet() &&
+                !newQuery.orderby().isSet() &&
+                (newQuery.bounds().isSet() || newQuery.tileKey().isSet()))
+            {
+                Bounds bounds;
+                if (newQuery.bounds().isSet())
+                    bounds = newQuery.bounds().get();
+                else
+                    bounds = newQuery.tileKey()->getExtent().transform(getFeatureProfile()->getSRS()).bounds();
+
+                std::vector<FeatureID> fids;
+                _index->search(bounds, fids);
+
+                return new OGR::OGRFeatureCursor(
+                    dsHandle,
+                    layerHandle,
+                    this,
+                    getFeatureProfile(),
+                    fids,
+                    newQuery,
+                    getFilters(),
+                    progress,
+                    *_options->rewindPolygons()
+                    );
+            }
+
             // cursor is responsible for the OGR handles.
             return new OGR::OGRFeatureCursor(
                 dsHandle,
@@ -846,9 +1158,25 @@ OGRFeatureSource::deleteFeature(FeatureID fid)
 {
     if (_writable && _layerHandle)
     {
+        // remember where the feature was, so listeners know what to rebuild
+        GeoExtent extent;
+        OGRFeatureH handle = OGR_L_GetFeature(_layerHandle, fid);
+        if (handle)
+        {
+            OGRGeometryH geom = OGR_F_GetGeometryRef(handle);
+            if (geom && !OGR_G_IsEmpty(geom))
+            {
+                OGREnvelope env;
+                OGR_G_GetEnvelope(geom, &env);
+                extent = GeoExtent(getFeatureProfile()->getSRS(), env.MinX, env.MinY, env.MaxX, env.MaxY);
+            }
+            OGR_F_Destroy(handle);
+        }
+
         if (OGR_L_DeleteFeature(_layerHandle, fid) == OGRERR_NONE)
         {
             _needsSync = true;
+            notifyFeaturesChanged(extent, std::vector<FeatureID>(1, fid));
             return true;
         }
     }
@@ -899,6 +1227,7 @@ OGRFeatureSource::getSchema() const
 bool
 OGRFeatureSource::insertFeature(Feature* feature)
 {
+    FeatureID fid = feature->getFID();
     OGRFeatureH feature_handle = OGR_F_Create(OGR_L_GetLayerDefn(_layerHandle));
     if (feature_handle)
     {
@@ -951,6 +1280,9 @@ OGRFeatureSource::insertFeature(Feature* feature)
             return false;
         }
 
+        // the driver assigns the new feature's ID
+        fid = OGR_F_GetFID(feature_handle);
+
         // clean up the feature
         OGR_F_Destroy(feature_handle);
     }
@@ -963,6 +1295,11 @@ OGRFeatureSource::insertFeature(Feature* feature)
 
     dirty();
 
+    GeoExtent extent = feature->getExtent();
+    if (extent.isValid() && getFeatureProfile() && !extent.getSRS()->isHorizEquivalentTo(getFeatureProfile()->getSRS()))
+        extent = extent.transform(getFeatureProfile()->getSRS());
+    notifyFeaturesChanged(extent, std::vector<FeatureID>(1, fid));
+
     return true;
 }
 
@@ -22,7 +22,17 @@
 
 #include <osgEarth/ObjectIndex>
 #include <osgEarth/Registry>
+#include <osgEarth/Capabilities>
 #include <osg/Geometry>
+#include <cstring>
+
+#ifndef GL_R32UI
+#define GL_R32UI 0x8236
+#endif
+
+#ifndef GL_RED_INTEGER
+#define GL_RED_INTEGER 0x8D94
+#endif
 
 using namespace osgEarth;
 
@@ -34,6 +44,9 @@ using namespace osgEarth;
 // Object IDs under this reserved
 #define STARTING_OBJECT_ID 10
 
+// Initial size of the selection buffer, in texels of 16 objects each
+#define INITIAL_SELECTION_TEXELS 1024
+
 namespace
 {
     const char* indexVertexInit =
@@ -57,11 +70,60 @@ namespace
         "    else \n"
         "        oe_index_objectid = 0u; \n"
         "} \n";
+
+    const char* selectionVertex =
+        "#version " GLSL_VERSION_STR "\n"
+        GLSL_DEFAULT_PRECISION_FLOAT "\n"
+
+        "#pragma vp_entryPoint oe_index_readSelection \n"
+        "#pragma vp_location   vertex_view \n"
+        "#pragma vp_order      first \n"
+
+        "uniform usamplerBuffer oe_index_selection_tbo; \n"
+        "uniform uint oe_index_selection_size; \n"    // size of the TBO in texels
+        "uint oe_index_objectid; \n"
+        "flat out uint oe_index_selection; \n"
+
+        "void oe_index_readSelection(inout vec4 vertex) \n"
+        "{ \n"
+        "    uint texel = oe_index_objectid >> 4u; \n"
+        "    if ( texel < oe_index_selection_size ) \n"
+        "    { \n"
+        "        uint bits = texelFetch(oe_index_selection_tbo, int(texel)).r; \n"
+        "        oe_index_selection = (bits >> ((oe_index_objectid & 15u) * 2u)) & 3u; \n"
+        "    } \n"
+        "    else \n"
+        "    { \n"
+        "        oe_index_selection = 0u; \n"
+        "    } \n"
+        "} \n";
+
+    const char* selectionFragment =
+        "#version " GLSL_VERSION_STR "\n"
+        GLSL_DEFAULT_PRECISION_FLOAT "\n"
+
+        "#pragma vp_entryPoint oe_index_applySelection \n"
+        "#pragma vp_location   fragment_coloring \n"
+        "#pragma vp_order      last \n"
+
+        "uniform vec4 oe_index_highlight_color; \n"
+        "flat in uint oe_index_selection; \n"
+
+        "void oe_index_applySelection(inout vec4 color) \n"
+        "{ \n"
+        "    if ( (oe_index_selection & 2u) != 0u ) \n"
+        "        discard; \n"
+        "    if ( (oe_index_selection & 1u) != 0u ) \n"
+        "        color.rgb = mix(color.rgb, oe_index_highlight_color.rgb, oe_index_highlight_color.a); \n"
+        "} \n";
 }
 
 ObjectIndex::ObjectIndex() :
+_base( 0u ),
+_size( 0u ),
 _idGen( STARTING_OBJECT_ID ),
-_mutex("ObjectIndex(OE)")
+_mutex("ObjectIndex(OE)"),
+_selectionMutex("ObjectIndex.selection(OE)")
 {
     _attribName     = "oe_index_objectid_attr";
     _attribLocation = osg::Drawable::SECONDARY_COLORS;
@@ -69,6 +131,23 @@ _mutex("ObjectIndex(OE)")
 
     // set up the shader package.
     _shaders.add( "ObjectIndex.vert.glsl", indexVertexInit );
+
+    _selectionShaders.add( "ObjectIndex.selection.vert.glsl", selectionVertex );
+    _selectionShaders.add( "ObjectIndex.selection.frag.glsl", selectionFragment );
+
+    // selection state, two bits per object:
+    _selectionImage = new osg::Image();
+    _selectionImage->allocateImage(INITIAL_SELECTION_TEXELS, 1, 1, GL_RED_INTEGER, GL_UNSIGNED_INT);
+    _selectionImage->setInternalTextureFormat(GL_R32UI);
+    ::memset(_selectionImage->data(), 0, _selectionImage->getTotalSizeInBytes());
+
+    _selectionTBO = new osg::TextureBuffer(_selectionImage.get());
+    _selectionTBO->setInternalFormat(GL_R32UI);
+    _selectionTBO->setUnRefImageDataAfterApply(false);
+    _selectionTBO->setDataVariance(osg::Object::DYNAMIC);
+
+    _selectionSize = new osg::Uniform("oe_index_selection_size", (unsigned)INITIAL_SELECTION_TEXELS);
+    _highlightColor = new osg::Uniform("oe_index_highlight_color", osg::Vec4f(1.0f, 1.0f, 0.0f, 0.5f));
 }
 
 bool
@@ -85,7 +164,7 @@ ObjectIndex::loadShaders(VirtualProgram* vp) const
 void
 ObjectIndex::setObjectIDAtrribLocation(int value)
 {
-    if ( _index.size() == 0 )
+    if ( _index.empty() )
     {
         _attribLocation = value;
     } 
@@ -98,7 +177,7 @@ ObjectIndex::setObjectIDAtrribLocation(int value)
 ObjectID
 ObjectIndex::insert(osg::Referenced* object)
 {
-    Threading::ScopedMutexLock excl( _mutex );
+    Threading::ScopedWriteLock excl( _mutex );
     return insertImpl( object );
 }
 
@@ -107,39 +186,111 @@ ObjectIndex::insertImpl(osg::Referenced* object)
 {
     // internal: assume mutex is locked
     ObjectID id = ++_idGen;
-    _index[id] = object;
-    OE_DEBUG << LC << "Insert " << id << "; size = " << _index.size() << "\n";
+
+    // IDs only grow, so a new object always lands at the back.
+    if ( _index.empty() )
+        _base = id;
+    _index.resize( id - _base + 1 );
+
+    Entry& entry = _index.back();
+    entry._object = object;
+    entry._used = true;
+    ++_size;
+
+    OE_DEBUG << LC << "Insert " << id << "; size = " << _size << "\n";
     return id;
 }
 
+ObjectID
+ObjectIndex::insertRange(unsigned count)
+{
+    Threading::ScopedWriteLock excl( _mutex );
+    if ( count == 0u )
+        return OSGEARTH_OBJECTID_EMPTY;
+
+    // _idGen only changes under the write lock, so it's safe to
+    // advance it in one step.
+    ObjectID first = (ObjectID)_idGen + 1u;
+    _idGen.exchange( first + count - 1u );
+
+    if ( _index.empty() )
+        _base = first;
+    _index.resize( first + count - _base );
+    for(ObjectID id = first; id < first + count; ++id)
+        _index[id - _base]._used = true;
+    _size += count;
+
+    OE_DEBUG << LC << "Insert range " << first << "+" << count << "; size = " << _size << "\n";
+    return first;
+}
+
+void
+ObjectIndex::set(ObjectID id, osg::Referenced* object)
+{
+    Threading::ScopedWriteLock excl( _mutex );
+    if ( id >= _base && id - _base < _index.size() && _index[id - _base]._used )
+    {
+        _index[id - _base]._object = object;
+    }
+}
+
 osg::Referenced*
 ObjectIndex::getImpl(ObjectID id) const
 {
     // assume the mutex is locked
-    IndexMap::const_iterator i = _index.find(id);
-    return i != _index.end() ? i->second.get() : 0L;
+    if ( id < _base || id - _base >= _index.size() )
+        return 0L;
+    return _index[id - _base]._object.get();
 }
 
 void
 ObjectIndex::remove(ObjectID id)
 {
-    Threading::ScopedMutexLock excl(_mutex);
+    Threading::ScopedWriteLock excl(_mutex);
     removeImpl(id);
 }
 
+void
+ObjectIndex::removeRange(ObjectID first, unsigned count)
+{
+    Threading::ScopedWriteLock excl(_mutex);
+    for(ObjectID id = first; id < first + count; ++id)
+        removeImpl(id);
+}
+
 void
 ObjectIndex::removeImpl(ObjectID id)
 {
     // internal - assume mutex is locked
-    _index.erase( id );
-    OE_DEBUG << "Remove " << id << "; size = " << _index.size() << "\n";
+    if ( id < _base || id - _base >= _index.size() )
+        return;
+
+    Entry& entry = _index[id - _base];
+    if ( !entry._used )
+        return;
+
+    entry._object = 0L;
+    entry._used = false;
+    --_size;
 
+    // trim unused slots from both ends so the array spans only live IDs
+    while( !_index.empty() && !_index.front()._used )
+    {
+        _index.pop_front();
+        ++_base;
+    }
+    while( !_index.empty() && !_index.back()._used )
+    {
+        _index.pop_back();
+    }
+
+    OE_DEBUG << "Remove " << id << "; size = " << _size << "\n";
 }
 
 ObjectID
 ObjectIndex::tagDrawable(osg::Drawable* drawable, osg::Referenced* object)
 {
-    Threading::ScopedMutexLock lock(_mutex);
+    Threading::ScopedWriteLock lock(_mutex);
     ObjectID oid = insertImpl(object);
     tagDrawable(drawable, oid);
     return oid;
@@ -191,7 +342,7 @@ namespace
 ObjectID
 ObjectIndex::tagAllDrawables(osg::Node* node, osg::Referenced* object)
 {
-    Threading::ScopedMutexLock lock(_mutex);
+    Threading::ScopedWriteLock lock(_mutex);
     ObjectID oid = insertImpl(object);
     tagAllDrawables(node, oid);
     return oid;
@@ -210,7 +361,7 @@ ObjectIndex::tagAllDrawables(osg::Node* node, ObjectID id) const
 ObjectID
 ObjectIndex::tagNode(osg::Node* node, osg::Referenced* object)
 {
-    Threading::ScopedMutexLock lock(_mutex);
+    Threading::ScopedWriteLock lock(_mutex);
     ObjectID oid = insertImpl(object);
     tagNode(node, oid);
     return oid;
@@ -323,3 +474,102 @@ ObjectIndex::updateObjectID(osg::Node* node,
 
     return true;
 }
+
+void
+ObjectIndex::setSelection(ObjectID id, unsigned flags)
+{
+    Threading::ScopedMutexLock lock(_selectionMutex);
+    setSelectionImpl(id, flags);
+    _selectionImage->dirty();
+}
+
+void
+ObjectIndex::setSelectionImpl(ObjectID id, unsigned flags)
+{
+    // internal - assume selection mutex is locked
+    unsigned texel = id >> 4;
+    unsigned numTexels = _selectionImage->s();
+
+    if ( texel >= numTexels )
+    {
+        if ( flags == SELECTION_NONE )
+            return;
+
+        int maxTexels = Registry::capabilities().getMaxTextureBufferSize();
+        if ( maxTexels > 0 && texel >= (unsigned)maxTexels )
+        {
+            OE_WARN << LC << "Object ID " << id << " exceeds the selection buffer capacity\n";
+            return;
+        }
+
+        // grow by doubling to amortize the copies
+        while( numTexels <= texel )
+            numTexels *= 2u;
+        if ( maxTexels > 0 )
+            numTexels = osg::minimum(numTexels, (unsigned)maxTexels);
+
+        osg::ref_ptr<osg::Image> image = new osg::Image();
+        image->allocateImage(numTexels, 1, 1, GL_RED_INTEGER, GL_UNSIGNED_INT);
+        image->setInternalTextureFormat(GL_R32UI);
+        ::memset(image->data(), 0, image->getTotalSizeInBytes());
+        ::memcpy(image->data(), _selectionImage->data(), _selectionImage->getTotalSizeInBytes());
+
+        _selectionImage = image.get();
+        _selectionTBO->setImage(image.get());
+        _selectionSize->set(numTexels);
+    }
+
+    GLuint* bits = reinterpret_cast<GLuint*>(_selectionImage->data()) + texel;
+    unsigned shift = (id & 15u) * 2u;
+    *bits = (*bits & ~(3u << shift)) | ((flags & 3u) << shift);
+}
+
+unsigned
+ObjectIndex::getSelection(ObjectID id) const
+{
+    Threading::ScopedMutexLock lock(_selectionMutex);
+    unsigned texel = id >> 4;
+    if ( texel >= (unsigned)_selectionImage->s() )
+        return SELECTION_NONE;
+    const GLuint* bits = reinterpret_cast<const GLuint*>(_selectionImage->data()) + texel;
+    return (*bits >> ((id & 15u) * 2u)) & 3u;
+}
+
+void
+ObjectIndex::clearSelection()
+{
+    Threading::ScopedMutexLock lock(_selectionMutex);
+    ::memset(_selectionImage->data(), 0, _selectionImage->getTotalSizeInBytes());
+    _selectionImage->dirty();
+}
+
+void
+ObjectIndex::setHighlightColor(const osg::Vec4f& value)
+{
+    _highlightColor->set(value);
+}
+
+osg::Vec4f
+ObjectIndex::getHighlightColor() const
+{
+    osg::Vec4f value;
+    _highlightColor->get(value);
+    return value;
+}
+
+bool
+ObjectIndex::installSelection(osg::StateSet* stateSet, int textureImageUnit) const
+{
+    if ( !stateSet )
+        return false;
+
+    VirtualProgram* vp = VirtualProgram::getOrCreate(stateSet);
+    loadShaders(vp);
+    _selectionShaders.loadAll(vp);
+
+    stateSet->setTextureAttribute(textureImageUnit, _selectionTBO.get(), osg::StateAttribute::ON);
+    stateSet->getOrCreateUniform("oe_index_selection_tbo", osg::Uniform::UNSIGNED_INT_SAMPLER_BUFFER)->set(textureImageUnit);
+    stateSet->addUniform(_selectionSize.get());
+    stateSet->addUniform(_highlightColor.get());
+    return true;
+}
@@ -0,0 +1,32 @@
+#version 430
+
+// Reduces a depth buffer to one texel per block of pixels, keeping the
+// farthest depth in each block.
+layout(local_size_x=8, local_size_y=8, local_size_z=1) in;
+
+layout(binding=0, r32f) uniform writeonly image2D oe_hiz_out;
+
+uniform sampler2D oe_hiz_depth;
+uniform ivec2 oe_hiz_size;     // size of the depth buffer
+uniform int oe_hiz_block;      // depth pixels per output texel (each way)
+
+void main()
+{
+    ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+    if (any(greaterThanEqual(texel, imageSize(oe_hiz_out))))
+        return;
+
+    ivec2 start = texel * oe_hiz_block;
+    ivec2 end = min(start + ivec2(oe_hiz_block), oe_hiz_size);
+
+    float depth = 0.0;
+    for(int y=start.y; y<end.y; ++y)
+    {
+        for(int x=start.x; x<end.x; ++x)
+        {
+            depth = max(depth, texelFetch(oe_hiz_depth, ivec2(x, y), 0).r);
+        }
+    }
+
+    imageStore(oe_hiz_out, texel, vec4(depth));
+}
@@ -0,0 +1,551 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2020 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#include <osgEarth/OcclusionPyramid>
+#include <osgEarth/Shaders>
+#include <osgEarth/ShaderLoader>
+#include <osgEarth/Registry>
+#include <osgEarth/Capabilities>
+#include <osgEarth/Containers>
+#include <osgEarth/CullingUtils>
+#include <osgEarth/GLUtils>
+#include <osgEarth/Threading>
+#include <osg/Texture2D>
+#include <osg/GLExtensions>
+#include <osg/Version>
+#include <osgUtil/RenderStage>
+#include <algorithm>
+#include <climits>
+#include <cfloat>
+#include <cmath>
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+#define LC "[OcclusionPyramid] "
+
+// Largest size of the depth grid the GPU reduces to, in texels each way
+#define MAX_GRID_SIZE 256
+
+// Oldest depth capture, in frames, that a test will use
+#define MAX_DEPTH_AGE 4u
+
+// Number of depth captures that can be in flight at once
+#define NUM_READBACKS 2
+
+// Fence syncs arrived in osg::GLExtensions with OSG 3.6
+#if OSG_VERSION_GREATER_OR_EQUAL(3,6,0)
+#define OE_HAVE_GL_SYNC
+#endif
+
+#ifdef OE_HAVE_GL_SYNC
+#include <osg/BindImageTexture>
+#endif
+
+#ifndef GL_PIXEL_PACK_BUFFER
+#define GL_PIXEL_PACK_BUFFER 0x88EB
+#endif
+
+#ifndef GL_STREAM_READ
+#define GL_STREAM_READ 0x88E1
+#endif
+
+#ifndef GL_READ_ONLY
+#define GL_READ_ONLY 0x88B8
+#endif
+
+#ifndef GL_R32F
+#define GL_R32F 0x822E
+#endif
+
+#ifndef GL_DEPTH_COMPONENT24
+#define GL_DEPTH_COMPONENT24 0x81A6
+#endif
+
+#ifndef GL_SAMPLE_BUFFERS
+#define GL_SAMPLE_BUFFERS 0x80A8
+#endif
+
+#ifndef GL_SYNC_GPU_COMMANDS_COMPLETE
+#define GL_SYNC_GPU_COMMANDS_COMPLETE 0x9117
+#define GL_ALREADY_SIGNALED 0x911A
+#define GL_CONDITION_SATISFIED 0x911C
+#endif
+
+// Farthest depths of one capture, from the finest level (one texel per block
+// of pixels) to a single texel
+struct OcclusionPyramid::Test::Pyramid : public osg::Referenced
+{
+    std::vector<std::vector<float> > levels;
+    std::vector<unsigned> widths;
+    std::vector<unsigned> heights;
+    double scaleX, scaleY;  // finest-level texels across the viewport
+    osg::Matrix viewProj;   // capture frame to clip space, at capture time
+    unsigned frame;
+
+    void build(const float* grid, unsigned w, unsigned h)
+    {
+        levels.resize(1);
+        levels[0].assign(grid, grid + w*h);
+        widths.assign(1, w);
+        heights.assign(1, h);
+
+        while (w > 1 || h > 1)
+        {
+            unsigned nw = (w + 1) / 2, nh = (h + 1) / 2;
+            std::vector<float> next(nw*nh);
+            const std::vector<float>& prev = levels.back();
+
+            for (unsigned y = 0; y < nh; ++y)
+            {
+                unsigned y0 = 2 * y, y1 = osg::minimum(2 * y + 1, h - 1);
+                for (unsigned x = 0; x < nw; ++x)
+                {
+                    unsigned x0 = 2 * x, x1 = osg::minimum(2 * x + 1, w - 1);
+                    next[y*nw + x] = osg::maximum(
+                        osg::maximum(prev[y0*w + x0], prev[y0*w + x1]),
+                        osg::maximum(prev[y1*w + x0], prev[y1*w + x1]));
+                }
+            }
+
+            levels.push_back(std::vector<float>());
+            levels.back().swap(next);
+            widths.push_back(nw);
+            heights.push_back(nh);
+            w = nw, h = nh;
+        }
+    }
+};
+
+OcclusionPyramid::Test::Test(const Pyramid* pyramid, const osg::Matrix& eyeToPrevClip) :
+    _pyramid(pyramid),
+    _eyeToPrevClip(eyeToPrevClip)
+{
+    //nop
+}
+
+OcclusionPyramid::Test::~Test()
+{
+    //nop
+}
+
+bool
+OcclusionPyramid::Test::isOccluded(const osg::BoundingBox& box, const osg::Matrix& modelView) const
+{
+    if (!box.valid() || !_pyramid.valid())
+        return false;
+
+    const Pyramid& p = *_pyramid.get();
+    osg::Matrix toClip = modelView * _eyeToPrevClip;
+
+    double xmin = DBL_MAX, ymin = DBL_MAX, zmin = DBL_MAX;
+    double xmax = -DBL_MAX, ymax = -DBL_MAX;
+
+    for (unsigned i = 0; i < 8; ++i)
+    {
+        osg::Vec4d clip = osg::Vec4d(box.corner(i), 1.0) * toClip;
+
+        // a box that reaches behind the eye is never occluded
+        if (clip.w() <= 0.0)
+            return false;
+
+        double x = clip.x() / clip.w(), y = clip.y() / clip.w(), z = clip.z() / clip.w();
+        xmin = osg::minimum(xmin, x), xmax = osg::maximum(xmax, x);
+        ymin = osg::minimum(ymin, y), ymax = osg::maximum(ymax, y);
+        zmin = osg::minimum(zmin, z);
+    }
+
+    // crossing the near plane, or off screen (the frustum culler's business)
+    if (zmin < -1.0 || xmax < -1.0 || xmin > 1.0 || ymax < -1.0 || ymin > 1.0)
+        return false;
+
+    float depth = (float)(zmin*0.5 + 0.5);
+
+    // screen rectangle in finest-level texels
+    double tx0 = (osg::maximum(xmin, -1.0)*0.5 + 0.5) * p.scaleX;
+    double tx1 = (osg::minimum(xmax,  1.0)*0.5 + 0.5) * p.scaleX;
+    double ty0 = (osg::maximum(ymin, -1.0)*0.5 + 0.5) * p.scaleY;
+    double ty1 = (osg::minimum(ymax,  1.0)*0.5 + 0.5) * p.scaleY;
+
+    // the level at which the rectangle spans at most two texels each way
+    double span = osg::maximum(tx1 - tx0, ty1 - ty0);
+    unsigned level = span > 1.0 ? (unsigned)ceil(log(span) / log(2.0)) : 0u;
+    level = osg::minimum(level, (unsigned)p.levels.size() - 1u);
+
+    unsigned w = p.widths[level], h = p.heights[level];
+    unsigned x0 = osg::minimum((unsigned)tx0 >> level, w - 1), x1 = osg::minimum((unsigned)tx1 >> level, w - 1);
+    unsigned y0 = osg::minimum((unsigned)ty0 >> level, h - 1), y1 = osg::minimum((unsigned)ty1 >> level, h - 1);
+
+    const std::vector<float>& depths = p.levels[level];
+    for (unsigned y = y0; y <= y1; ++y)
+    {
+        for (unsigned x = x0; x <= x1; ++x)
+        {
+            if (depths[y*w + x] >= depth)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+namespace
+{
+    typedef OcclusionPyramid::Test::Pyramid Pyramid;
+
+    struct CaptureDrawable;
+
+    struct CameraState : public osg::Referenced
+    {
+        CameraState() : _frame(~0u) { }
+
+        Threading::Mutex _mutex;
+        unsigned _frame;                       // frame of the last cull
+        osg::ref_ptr<OcclusionPyramid::Test> _test;
+        osg::ref_ptr<const Pyramid> _latest;   // most recent capture
+        osg::ref_ptr<CaptureDrawable> _capture;
+        osg::ref_ptr<osg::StateSet> _captureStateSet;
+
+        void publish(Pyramid* pyramid)
+        {
+            Threading::ScopedMutexLock lock(_mutex);
+            if (!_latest.valid() || pyramid->frame > _latest->frame)
+                _latest = pyramid;
+        }
+    };
+
+    // Drawn last in a camera's render stage: reduces the depth buffer on
+    // the GPU and reads it back without waiting for it.
+    struct CaptureDrawable : public osg::Drawable
+    {
+        struct Readback
+        {
+            Readback() : _fence(0L), _size(0), _width(0u), _height(0u), _frame(0u) { }
+            osg::ref_ptr<GLBuffer> _pbo;
+#ifdef OE_HAVE_GL_SYNC
+            GLsync _fence;
+#else
+            void* _fence;
+#endif
+            GLsizeiptr _size;
+            unsigned _width, _height;
+            double _scaleX, _scaleY;
+            osg::Matrix _viewProj;
+            unsigned _frame;
+        };
+
+        struct GCState
+        {
+            GCState() : _next(0u), _pcp(NULL), _warned(false) { }
+            Readback _readbacks[NUM_READBACKS];
+            unsigned _next;
+            const osg::Program::PerContextProgram* _pcp;
+            GLint _sizeUL, _blockUL;
+            bool _warned;
+        };
+
+        CaptureDrawable(CameraState* cs) :
+            _cameraState(cs)
+        {
+            setUseDisplayList(false);
+            setUseVertexBufferObjects(false);
+
+            _depthTex = new osg::Texture2D();
+            _depthTex->setInternalFormat(GL_DEPTH_COMPONENT24);
+            _depthTex->setSourceFormat(GL_DEPTH_COMPONENT);
+            _depthTex->setSourceType(GL_FLOAT);
+            _depthTex->setFilter(osg::Texture::MIN_FILTER, osg::Texture::NEAREST);
+            _depthTex->setFilter(osg::Texture::MAG_FILTER, osg::Texture::NEAREST);
+            _depthTex->setResizeNonPowerOfTwoHint(false);
+
+            _gridTex = new osg::Texture2D();
+            _gridTex->setInternalFormat(GL_R32F);
+            _gridTex->setSourceFormat(GL_RED);
+            _gridTex->setSourceType(GL_FLOAT);
+            _gridTex->setFilter(osg::Texture::MIN_FILTER, osg::Texture::NEAREST);
+            _gridTex->setFilter(osg::Texture::MAG_FILTER, osg::Texture::NEAREST);
+            _gridTex->setResizeNonPowerOfTwoHint(false);
+
+            Shaders shaders;
+            std::string source = ShaderLoader::load(shaders.OcclusionPyramidComputer, shaders);
+            osg::Program* program = new osg::Program();
+            program->addShader(new osg::Shader(osg::Shader::COMPUTE, source));
+
+            _computeStateSet = new osg::StateSet();
+            _computeStateSet->setAttribute(program, osg::StateAttribute::ON);
+            _computeStateSet->setTextureAttribute(0, _depthTex.get(), osg::StateAttribute::ON);
+            _computeStateSet->setTextureAttribute(1, _gridTex.get(), osg::StateAttribute::ON);
+            _computeStateSet->addUniform(new osg::Uniform("oe_hiz_depth", 0));
+#ifdef OE_HAVE_GL_SYNC
+            _computeStateSet->setAttribute(new osg::BindImageTexture(0, _gridTex.get(), osg::BindImageTexture::WRITE_ONLY, GL_R32F, 0, GL_FALSE));
+#endif
+        }
+
+        void drawImplementation(osg::RenderInfo& ri) const;
+
+        // publishes any readbacks the GPU has finished
+        void collect(osg::State& state, GCState& gc) const;
+
+        void resizeGLObjectBuffers(unsigned maxSize)
+        {
+            osg::Drawable::resizeGLObjectBuffers(maxSize);
+            _computeStateSet->resizeGLObjectBuffers(maxSize);
+            _gc.resize(maxSize);
+        }
+
+        void releaseGLObjects(osg::State* state) const
+        {
+            osg::Drawable::releaseGLObjects(state);
+            _computeStateSet->releaseGLObjects(state);
+            if (state)
+                _gc[state->getContextID()] = GCState();
+        }
+
+        CameraState* _cameraState;
+        osg::ref_ptr<osg::Texture2D> _depthTex;
+        osg::ref_ptr<osg::Texture2D> _gridTex;
+        osg::ref_ptr<osg::StateSet> _computeStateSet;
+        mutable osg::buffered_object<GCState> _gc;
+    };
+
+    void
+    CaptureDrawable::collect(osg::State& state, GCState& gc) const
+    {
+#ifdef OE_HAVE_GL_SYNC
+        osg::GLExtensions* ext = state.get<osg::GLExtensions>();
+
+        for (unsigned i = 0; i < NUM_READBACKS; ++i)
+        {
+            Readback& rb = gc._readbacks[i];
+            if (!rb._fence)
+                continue;
+
+            GLenum status = ext->glClientWaitSync(rb._fence, 0, 0);
+            if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+                continue;
+
+            ext->glDeleteSync(rb._fence);
+            rb._fence = 0L;
+
+            ext->glBindBuffer(GL_PIXEL_PACK_BUFFER, rb._pbo->_handle);
+            const float* grid = static_cast<const float*>(ext->glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY));
+            if (grid)
+            {
+                osg::ref_ptr<Pyramid> pyramid = new Pyramid();
+                pyramid->build(grid, rb._width, rb._height);
+                pyramid->scaleX = rb._scaleX;
+                pyramid->scaleY = rb._scaleY;
+                pyramid->viewProj = rb._viewProj;
+                pyramid->frame = rb._frame;
+                ext->glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+                _cameraState->publish(pyramid.get());
+            }
+            ext->glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        }
+#endif
+    }
+
+    void
+    CaptureDrawable::drawImplementation(osg::RenderInfo& ri) const
+    {
+#ifdef OE_HAVE_GL_SYNC
+        osg::State& state = *ri.getState();
+        const osg::Viewport* vp = state.getCurrentViewport();
+        if (!vp || vp->width() < 1.0 || vp->height() < 1.0)
+            return;
+
+        osg::GLExtensions* ext = state.get<osg::GLExtensions>();
+        GCState& gc = _gc[state.getContextID()];
+
+        collect(state, gc);
+
+        // skip this frame if the oldest capture is still in flight
+        Readback& rb = gc._readbacks[gc._next];
+        if (rb._fence)
+            return;
+
+        // can't copy the depth out of a multisampled framebuffer
+        GLint sampleBuffers = 0;
+        glGetIntegerv(GL_SAMPLE_BUFFERS, &sampleBuffers);
+        if (sampleBuffers > 0)
+        {
+            if (!gc._warned)
+            {
+                OE_WARN << LC << "Occlusion culling is not available with a multisampled framebuffer" << std::endl;
+                gc._warned = true;
+            }
+            return;
+        }
+
+        int w = (int)vp->width(), h = (int)vp->height();
+        int block = osg::maximum(1, osg::maximum((w + MAX_GRID_SIZE - 1) / MAX_GRID_SIZE, (h + MAX_GRID_SIZE - 1) / MAX_GRID_SIZE));
+        int gw = (w + block - 1) / block, gh = (h + block - 1) / block;
+
+        if (_depthTex->getTextureWidth() != w || _depthTex->getTextureHeight() != h)
+        {
+            _depthTex->setTextureSize(w, h);
+            _depthTex->dirtyTextureObject();
+            _gridTex->setTextureSize(gw, gh);
+            _gridTex->dirtyTextureObject();
+        }
+
+        // First: copy the depth buffer and reduce it to the grid
+        state.apply(_computeStateSet.get());
+
+        state.setActiveTextureUnit(0);
+        _depthTex->copyTexSubImage2D(state, 0, 0, (int)vp->x(), (int)vp->y(), w, h);
+
+        const osg::Program::PerContextProgram* pcp = state.getLastAppliedProgramObject();
+        osg::Texture::TextureObject* gridObject = _gridTex->getTextureObject(state.getContextID());
+        if (pcp && gridObject)
+        {
+            if (gc._pcp != pcp)
+            {
+                gc._sizeUL = pcp->getUniformLocation(osg::Uniform::getNameID("oe_hiz_size"));
+                gc._blockUL = pcp->getUniformLocation(osg::Uniform::getNameID("oe_hiz_block"));
+                gc._pcp = pcp;
+            }
+
+            ext->glUniform2i(gc._sizeUL, w, h);
+            ext->glUniform1i(gc._blockUL, block);
+            ext->glDispatchCompute((gw + 7) / 8, (gh + 7) / 8, 1);
+            ext->glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT | GL_PIXEL_BUFFER_BARRIER_BIT);
+
+            // Second: start reading the grid back into a pixel buffer
+            GLsizeiptr size = gw * gh * sizeof(GLfloat);
+            if (!rb._pbo.valid() || rb._size < size)
+            {
+                rb._pbo = new GLBuffer();
+                ext->glGenBuffers(1, &rb._pbo->_handle);
+                ext->glBindBuffer(GL_PIXEL_PACK_BUFFER, rb._pbo->_handle);
+                ext->glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+                state.getGraphicsContext()->add(new GLBufferReleaser(rb._pbo.get()));
+                rb._size = size;
+            }
+
+            state.setActiveTextureUnit(1);
+            glBindTexture(GL_TEXTURE_2D, gridObject->id());
+            ext->glBindBuffer(GL_PIXEL_PACK_BUFFER, rb._pbo->_handle);
+            glPixelStorei(GL_PACK_ALIGNMENT, 4);
+            glGetTexImage(GL_TEXTURE_2D, 0, GL_RED, GL_FLOAT, 0L);
+            ext->glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+            rb._fence = ext->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            rb._width = gw;
+            rb._height = gh;
+            rb._scaleX = (double)w / (double)block;
+            rb._scaleY = (double)h / (double)block;
+            rb._viewProj = state.getModelViewMatrix() * state.getProjectionMatrix();
+            rb._frame = state.getFrameStamp() ? state.getFrameStamp()->getFrameNumber() : 0u;
+
+            gc._next = (gc._next + 1u) % NUM_READBACKS;
+        }
+
+        // restore the previous state
+        state.apply();
+#endif
+    }
+
+    CameraState& getCameraState(const osg::Camera* camera)
+    {
+        static PerObjectFastMap<const osg::Camera*, osg::ref_ptr<CameraState> > s_cameraStates;
+        osg::ref_ptr<CameraState>& cs = s_cameraStates.get(camera);
+        if (!cs.valid())
+            cs = new CameraState();
+        return *cs.get();
+    }
+}
+
+bool
+OcclusionPyramid::isSupported()
+{
+#ifdef OE_HAVE_GL_SYNC
+    return Registry::capabilities().supportsGLSL(430u);
+#else
+    return false;
+#endif
+}
+
+osg::ref_ptr<OcclusionPyramid::Test>
+OcclusionPyramid::cull(osgUtil::CullVisitor* cv)
+{
+    if (!cv || !cv->getFrameStamp() || !cv->getCurrentRenderStage() || !isSupported())
+        return 0L;
+
+    const osg::Camera* camera = cv->getCurrentCamera();
+    if (!camera)
+        return 0L;
+
+    unsigned frame = cv->getFrameStamp()->getFrameNumber();
+
+    CameraState& cs = getCameraState(camera);
+    Threading::ScopedMutexLock lock(cs._mutex);
+
+    if (cs._frame == frame)
+        return cs._test;
+
+    cs._frame = frame;
+    cs._test = 0L;
+
+    // World-to-eye matrix of this camera; the capture records its matrices
+    // relative to it so a later frame can reproject into the old depth.
+    const osg::RefMatrix* initial = cv->getCurrentRenderStage()->getInitialViewMatrix();
+    osg::Matrix view = initial ? osg::Matrix(*initial) : camera->getViewMatrix();
+
+    // Queue this frame's capture at the very end of the render stage:
+    if (!cs._capture.valid())
+    {
+        cs._capture = new CaptureDrawable(&cs);
+        cs._captureStateSet = new osg::StateSet();
+        cs._captureStateSet->setRenderBinDetails(INT_MAX, "RenderBin");
+        cs._captureStateSet->setNestRenderBins(false);
+    }
+
+    cv->pushStateSet(cs._captureStateSet.get());
+    cv->addDrawable(cs._capture.get(), cv->createOrReuseMatrix(view));
+    cv->popStateSet();
+
+    // Test against the most recent capture, if it's fresh enough:
+    if (cs._latest.valid() && frame - cs._latest->frame <= MAX_DEPTH_AGE)
+    {
+        cs._test = new Test(cs._latest.get(), osg::Matrix::inverse(view) * cs._latest->viewProj);
+    }
+
+    return cs._test;
+}
+
+void
+OcclusionPyramid::CullCallback::operator()(osg::Node* node, osg::NodeVisitor* nv)
+{
+    osgUtil::CullVisitor* cv = Culling::asCullVisitor(nv);
+    if (cv)
+    {
+        osg::ref_ptr<Test> test = cull(cv);
+        if (test.valid())
+        {
+            osg::BoundingBox box;
+            box.expandBy(node->getBound());
+            if (test->isOccluded(box, *cv->getModelViewMatrix()))
+                return;
+        }
+    }
+    traverse(node, nv);
+}
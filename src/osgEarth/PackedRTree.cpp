@@ -0,0 +1,338 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+ * Copyright 2020 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarth/PackedRTree>
+#include <osgEarth/Threading>
+#include <osg/Math>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace osgEarth;
+
+#define PACKED_RTREE_MAGIC "OERT"
+#define PACKED_RTREE_VERSION 1u
+
+namespace
+{
+    // Position of (x,y) along a 16-bit Hilbert curve. Branch-free version of
+    // the classic algorithm from http://threadlocalmutex.com/?p=126 .
+    unsigned hilbert(unsigned x, unsigned y)
+    {
+        unsigned a = x ^ y;
+        unsigned b = 0xFFFF ^ a;
+        unsigned c = 0xFFFF ^ (x | y);
+        unsigned d = x & (y ^ 0xFFFF);
+
+        unsigned A = a | (b >> 1);
+        unsigned B = (a >> 1) ^ a;
+        unsigned C = ((c >> 1) ^ (b & (d >> 1))) ^ c;
+        unsigned D = ((a & (c >> 1)) ^ (d >> 1)) ^ d;
+
+        a = A; b = B; c = C; d = D;
+        A = ((a & (a >> 2)) ^ (b & (b >> 2)));
+        B = ((a & (b >> 2)) ^ (b & ((a ^ b) >> 2)));
+        C ^= ((a & (c >> 2)) ^ (b & (d >> 2)));
+        D ^= ((b & (c >> 2)) ^ ((a ^ b) & (d >> 2)));
+
+        a = A; b = B; c = C; d = D;
+        A = ((a & (a >> 4)) ^ (b & (b >> 4)));
+        B = ((a & (b >> 4)) ^ (b & ((a ^ b) >> 4)));
+        C ^= ((a & (c >> 4)) ^ (b & (d >> 4)));
+        D ^= ((b & (c >> 4)) ^ ((a ^ b) & (d >> 4)));
+
+        a = A; b = B; c = C; d = D;
+        C ^= ((a & (c >> 8)) ^ (b & (d >> 8)));
+        D ^= ((b & (c >> 8)) ^ ((a ^ b) & (d >> 8)));
+
+        a = C ^ (C >> 1);
+        b = D ^ (D >> 1);
+
+        unsigned i0 = x ^ y;
+        unsigned i1 = b | (0xFFFF ^ (i0 | a));
+
+        i0 = (i0 | (i0 << 8)) & 0x00FF00FF;
+        i0 = (i0 | (i0 << 4)) & 0x0F0F0F0F;
+        i0 = (i0 | (i0 << 2)) & 0x33333333;
+        i0 = (i0 | (i0 << 1)) & 0x55555555;
+
+        i1 = (i1 | (i1 << 8)) & 0x00FF00FF;
+        i1 = (i1 | (i1 << 4)) & 0x0F0F0F0F;
+        i1 = (i1 | (i1 << 2)) & 0x33333333;
+        i1 = (i1 | (i1 << 1)) & 0x55555555;
+
+        return (i1 << 1) | i0;
+    }
+
+    // End of each level of the tree in the node array, leaves first
+    void computeLevels(unsigned numItems, unsigned nodeSize, std::vector<unsigned>& levelEnds)
+    {
+        levelEnds.clear();
+        if (numItems == 0u)
+            return;
+
+        unsigned n = numItems, total = numItems;
+        levelEnds.push_back(total);
+        while (n > 1u)
+        {
+            n = (n + nodeSize - 1u) / nodeSize;
+            total += n;
+            levelEnds.push_back(total);
+        }
+    }
+
+    struct FileHeader
+    {
+        char magic[4];
+        unsigned version;
+        unsigned nodeSize;
+        unsigned numItems;
+        unsigned numNodes;
+        unsigned numLevels;
+        PackedRTree::Stamp stamp;
+    };
+}
+
+PackedRTree::PackedRTree(unsigned nodeSize) :
+    _nodeSize(osg::maximum(nodeSize, 2u)),
+    _numItems(0u)
+{
+    //nop
+}
+
+void
+PackedRTree::reserve(unsigned numItems)
+{
+    _nodes.reserve(numItems + numItems / (_nodeSize - 1) + 1);
+}
+
+void
+PackedRTree::add(FeatureID fid, const Bounds& bounds)
+{
+    Node node;
+    node.xmin = bounds.xMin();
+    node.ymin = bounds.yMin();
+    node.xmax = bounds.xMax();
+    node.ymax = bounds.yMax();
+    node.index = fid;
+    _nodes.push_back(node);
+    _bounds.expandBy(bounds);
+}
+
+void
+PackedRTree::build()
+{
+    // any nodes past the leaves are from a previous build:
+    if (!_levelEnds.empty())
+        _nodes.resize(_levelEnds[0]);
+
+    _numItems = (unsigned)_nodes.size();
+    if (_numItems == 0u)
+    {
+        _levelEnds.clear();
+        return;
+    }
+
+    // sort the leaves along the Hilbert curve through the total extent,
+    // so that items close in space end up in the same nodes.
+    double width = _bounds.width(), height = _bounds.height();
+    double sx = width > 0.0 ? 65535.0 / width : 0.0;
+    double sy = height > 0.0 ? 65535.0 / height : 0.0;
+
+    std::vector<std::pair<unsigned, unsigned> > order(_numItems); // hilbert value, leaf
+    for (unsigned i = 0; i < _numItems; ++i)
+    {
+        const Node& n = _nodes[i];
+        unsigned x = (unsigned)(sx * (0.5*(n.xmin + n.xmax) - _bounds.xMin()));
+        unsigned y = (unsigned)(sy * (0.5*(n.ymin + n.ymax) - _bounds.yMin()));
+        order[i] = std::make_pair(hilbert(x, y), i);
+    }
+    std::sort(order.begin(), order.end());
+
+    std::vector<Node> sorted;
+    computeLevels(_numItems, _nodeSize, _levelEnds);
+    sorted.resize(_levelEnds.back());
+    for (unsigned i = 0; i < _numItems; ++i)
+        sorted[i] = _nodes[order[i].second];
+
+    // pack each level into full nodes of the level below:
+    for (unsigned level = 1; level < _levelEnds.size(); ++level)
+    {
+        unsigned childBegin = level > 1 ? _levelEnds[level - 2] : 0u;
+        unsigned childEnd = _levelEnds[level - 1];
+        unsigned p = childEnd;
+
+        for (unsigned c = childBegin; c < childEnd; c += _nodeSize, ++p)
+        {
+            Node& parent = sorted[p];
+            parent.xmin = sorted[c].xmin, parent.ymin = sorted[c].ymin;
+            parent.xmax = sorted[c].xmax, parent.ymax = sorted[c].ymax;
+            parent.index = c;
+
+            unsigned last = osg::minimum(c + _nodeSize, childEnd);
+            for (unsigned i = c + 1; i < last; ++i)
+            {
+                parent.xmin = osg::minimum(parent.xmin, sorted[i].xmin);
+                parent.ymin = osg::minimum(parent.ymin, sorted[i].ymin);
+                parent.xmax = osg::maximum(parent.xmax, sorted[i].xmax);
+                parent.ymax = osg::maximum(parent.ymax, sorted[i].ymax);
+            }
+        }
+    }
+
+    _nodes.swap(sorted);
+}
+
+void
+PackedRTree::search(const Bounds& bounds, std::vector<FeatureID>& output) const
+{
+    if (_nodes.empty())
+        return;
+
+    std::size_t first = output.size();
+
+    // depth-first without recursion: (node, level) pairs
+    std::vector<std::pair<unsigned, unsigned> > stack;
+    stack.reserve(_levelEnds.size() * _nodeSize);
+    stack.push_back(std::make_pair((unsigned)_nodes.size() - 1u, (unsigned)_levelEnds.size() - 1u));
+
+    while (!stack.empty())
+    {
+        unsigned pos = stack.back().first, level = stack.back().second;
+        stack.pop_back();
+
+        const Node& node = _nodes[pos];
+        if (node.xmax < bounds.xMin() || node.xmin > bounds.xMax() ||
+            node.ymax < bounds.yMin() || node.ymin > bounds.yMax())
+        {
+            continue;
+        }
+
+        if (level == 0u)
+        {
+            output.push_back((FeatureID)node.index);
+        }
+        else
+        {
+            unsigned begin = (unsigned)node.index;
+            unsigned end = osg::minimum(begin + _nodeSize, _levelEnds[level - 1]);
+            for (unsigned c = begin; c < end; ++c)
+                stack.push_back(std::make_pair(c, level - 1u));
+        }
+    }
+
+    // report in source order, which is usually the cheapest order
+    // in which to read the items back
+    std::sort(output.begin() + first, output.end());
+}
+
+bool
+PackedRTree::write(const std::string& filename, const Stamp& stamp) const
+{
+    FileHeader header;
+    ::memcpy(header.magic, PACKED_RTREE_MAGIC, 4);
+    header.version = PACKED_RTREE_VERSION;
+    header.nodeSize = _nodeSize;
+    header.numItems = _numItems;
+    header.numNodes = (unsigned)_nodes.size();
+    header.numLevels = (unsigned)_levelEnds.size();
+    header.stamp = stamp;
+
+    // Write to a private temp file and rename it into place, so another
+    // process opening the same source never sees a partial index.
+    std::stringstream temp;
+    temp << filename << "." << Threading::getCurrentThreadId() << "_" << ::rand() << ".tmp";
+    {
+        std::ofstream fout(temp.str().c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!fout.is_open())
+            return false;
+
+        fout.write((const char*)&header, sizeof(header));
+        if (!_levelEnds.empty())
+            fout.write((const char*)&_levelEnds[0], _levelEnds.size() * sizeof(unsigned));
+        if (!_nodes.empty())
+            fout.write((const char*)&_nodes[0], _nodes.size() * sizeof(Node));
+
+        if (!fout)
+        {
+            fout.close();
+            ::remove(temp.str().c_str());
+            return false;
+        }
+    }
+
+    ::remove(filename.c_str());
+    if (::rename(temp.str().c_str(), filename.c_str()) != 0)
+    {
+        ::remove(temp.str().c_str());
+        return false;
+    }
+    return true;
+}
+
+bool
+PackedRTree::read(const std::string& filename, const Stamp& stamp)
+{
+    std::ifstream fin(filename.c_str(), std::ios::in | std::ios::binary);
+    if (!fin.is_open())
+        return false;
+
+    FileHeader header;
+    if (!fin.read((char*)&header, sizeof(header)) ||
+        ::memcmp(header.magic, PACKED_RTREE_MAGIC, 4) != 0 ||
+        header.version != PACKED_RTREE_VERSION ||
+        !(header.stamp == stamp) ||
+        header.nodeSize < 2u)
+    {
+        return false;
+    }
+
+    // the header must describe exactly the tree we would have built:
+    std::vector<unsigned> expected;
+    computeLevels(header.numItems, header.nodeSize, expected);
+
+    unsigned numNodes = expected.empty() ? 0u : expected.back();
+    if (expected.size() != header.numLevels || numNodes != header.numNodes)
+        return false;
+
+    std::vector<unsigned> levelEnds(header.numLevels);
+    std::vector<Node> nodes(header.numNodes);
+
+    if ((header.numLevels > 0 && !fin.read((char*)&levelEnds[0], levelEnds.size() * sizeof(unsigned))) ||
+        (header.numNodes > 0 && !fin.read((char*)&nodes[0], nodes.size() * sizeof(Node))) ||
+        levelEnds != expected)
+    {
+        return false;
+    }
+
+    _nodeSize = header.nodeSize;
+    _numItems = header.numItems;
+    _levelEnds.swap(levelEnds);
+    _nodes.swap(nodes);
+
+    _bounds = Bounds();
+    if (!_nodes.empty())
+    {
+        const Node& root = _nodes.back();
+        _bounds = Bounds(root.xmin, root.ymin, root.xmax, root.ymax);
+    }
+    return true;
+}
@@ -17,10 +17,18 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>
  */
 #include <osgEarth/PagedNode>
-#include <osgEarth/Utils>
+#include <osgEarth/NodeUtils>
+#include <osgEarth/CullingUtils>
+#include <osgEarth/Progress>
+#include <osgEarth/Registry>
+#include <osgEarth/Metrics>
+#include <osgEarth/Threading>
 
-#include <osgDB/Registry>
-#include <osgDB/FileNameUtils>
+#include <osgUtil/CullVisitor>
+#include <osgUtil/IncrementalCompileOperation>
+#include <osgViewer/View>
+#include <osgViewer/ViewerBase>
+#include <osg/Timer>
 
 #define LC "[PagedNode] "
 
@@ -28,53 +36,286 @@ using namespace osgEarth;
 using namespace osgEarth::Util;
 
 namespace
-{    
-    struct PagedNodePseudoLoader : public osgDB::ReaderWriter
+{
+    // Paging state shared by all PagedNodes
+    struct Pager
     {
-        PagedNodePseudoLoader()
+        Pager() :
+            mergeBudget(2.0),
+            compileBudget(4.0),
+            expirationTime(10.0),
+            frame(0u),
+            numRequests(0u),
+            numCompiling(0u),
+            numMerging(0u),
+            numLoaded(0u),
+            loadTime(0.0),
+            compileTime(0.0),
+            mergeFrame(~0u),
+            mergeTimeThisFrame(0.0),
+            mergeTimeLastFrame(0.0),
+            mergesThisFrame(0u),
+            mutex("PagedNode(OE)"),
+            requestMutex("PagedNode.requests(OE)")
         {
-            supportsExtension( "osgearth_pseudo_pagednode", "" );
         }
 
-        const char* className() const
-        { // override
-            return "PagedNodePseudoLoader";
+        double mergeBudget;
+        double compileBudget;
+        double expirationTime;
+
+        // latest frame culled; read by requests to detect cancelation
+        std::atomic_uint frame;
+
+        std::atomic_uint numRequests;
+        std::atomic_uint numCompiling;
+        std::atomic_uint numMerging;
+        std::atomic_uint numLoaded;
+
+        // running averages in milliseconds
+        double loadTime;
+        double compileTime;
+
+        // merge time spent in the frame being updated
+        unsigned mergeFrame;
+        double mergeTimeThisFrame;
+        double mergeTimeLastFrame;
+        unsigned mergesThisFrame;
+
+        // views with no ICO, waiting for the shared one
+        std::vector<osg::observer_ptr<osgViewer::View> > viewsWithoutICO;
+        osg::ref_ptr<osgUtil::IncrementalCompileOperation> ico;
+
+        Threading::Mutex mutex;
+
+        // guards each node's request between cull and update
+        Threading::Mutex requestMutex;
+
+        void average(double& avg, double sample)
+        {
+            Threading::ScopedMutexLock lock(mutex);
+            avg = avg > 0.0 ? avg * 0.9 + sample * 0.1 : sample;
         }
 
-        ReadResult readNode(const std::string& uri, const Options* options) const
+        // Installs the shared ICO on views that have none. Runs in the
+        // update traversal, between frames of the GL threads.
+        void installICO()
         {
-            if ( !acceptsExtension( osgDB::getLowerCaseFileExtension(uri) ) )
-                return ReadResult::FILE_NOT_HANDLED;
+            std::vector<osg::observer_ptr<osgViewer::View> > views;
+            {
+                Threading::ScopedMutexLock lock(mutex);
+                if (viewsWithoutICO.empty())
+                    return;
+                views.swap(viewsWithoutICO);
+            }
 
-            osg::ref_ptr<PagedNode> node;
-            if (!OptionsData<PagedNode>::lock(options, "osgEarth.PagedNode", node))
+            for (auto& i : views)
             {
-                OE_WARN << "Internal error - no PagedNode object in OptionsData\n";
-                return ReadResult::ERROR_IN_READING_FILE;
+                osg::ref_ptr<osgViewer::View> view;
+                if (!i.lock(view) || !view->getDatabasePager() || !view->getViewerBase())
+                    continue;
+
+                if (view->getDatabasePager()->getIncrementalCompileOperation())
+                    continue;
+
+                if (!ico.valid())
+                {
+                    ico = new osgUtil::IncrementalCompileOperation();
+                    ico->setTargetFrameRate(60.0);
+                    ico->setMinimumTimeAvailableForGLCompileAndDeletePerFrame(compileBudget * 0.001);
+                }
+
+                OE_INFO << LC << "Installing an IncrementalCompileOperation ("
+                    << compileBudget << " ms per frame)" << std::endl;
+
+                view->getViewerBase()->setIncrementalCompileOperation(ico.get());
+            }
+        }
+
+        // True if the frame's merge budget allows another merge.
+        // Always allow one per frame so paging keeps moving.
+        bool canMerge(unsigned frameNumber)
+        {
+            if (frameNumber != mergeFrame)
+            {
+                mergeFrame = frameNumber;
+                mergeTimeLastFrame = mergeTimeThisFrame;
+                mergeTimeThisFrame = 0.0;
+                mergesThisFrame = 0u;
             }
+            return mergesThisFrame == 0u || mergeTimeThisFrame < mergeBudget;
+        }
 
-            return node->loadChild();
+        void merged(double ms)
+        {
+            mergeTimeThisFrame += ms;
+            ++mergesThisFrame;
         }
     };
 
-    REGISTER_OSGPLUGIN(osgearth_pseudo_pagednode, PagedNodePseudoLoader);
+    Pager& pager()
+    {
+        static Pager s_pager;
+        return s_pager;
+    }
+
+    double millisecondsSince(osg::Timer_t start)
+    {
+        return osg::Timer::instance()->delta_m(start, osg::Timer::instance()->tick());
+    }
 }
 
+/**
+ * Progress of a request for the child. Reports cancelation once the
+ * PagedNode is gone or has not been in range since the previous frame.
+ */
+struct PagedNodeLoadProgress : public ProgressCallback
+{
+    PagedNodeLoadProgress(PagedNode* node, std::atomic_uint* lastInRangeFrame) :
+        _node(node), _lastInRangeFrame(lastInRangeFrame) { }
+
+    virtual bool shouldCancel() const
+    {
+        osg::ref_ptr<PagedNode> node;
+        if (!_node.lock(node))
+            return true;
+
+        return pager().frame - *_lastInRangeFrame > 1u;
+    }
+
+    osg::observer_ptr<PagedNode> _node;
+    std::atomic_uint* _lastInRangeFrame;
+};
+
+/**
+ * Loads the child on the "pager" job arena and compiles it with the
+ * view's ICO. The PagedNode merges it once it is ready.
+ */
+struct PagedNode::Loader :
+    public osg::Operation,
+    public osgUtil::IncrementalCompileOperation::CompileCompletedCallback
+{
+    enum State { LOADING, COMPILING, READY, DONE };
+
+    Loader(PagedNode* node, osgUtil::IncrementalCompileOperation* ico) :
+        osg::Operation("PagedNode::Loader", false),
+        _node(node),
+        _ico(ico),
+        _progress(new PagedNodeLoadProgress(node, &node->_lastInRangeFrame)),
+        _state(LOADING),
+        _compileStart(0)
+    {
+        ++pager().numRequests;
+    }
+
+    virtual ~Loader()
+    {
+        setState(DONE);
+    }
+
+    //! Moves to the next state, keeping the metrics in step.
+    void setState(State state)
+    {
+        int previous = _state.exchange(state);
+        if (previous == state)
+            return;
+
+        Pager& p = pager();
+        if (previous == LOADING) --p.numRequests;
+        else if (previous == COMPILING) --p.numCompiling;
+        else if (previous == READY) --p.numMerging;
+
+        if (state == COMPILING) ++p.numCompiling;
+        else if (state == READY) ++p.numMerging;
+    }
+
+    virtual void operator()(osg::Object*)
+    {
+        OE_PROFILING_ZONE_NAMED("PagedNode::load");
+
+        osg::ref_ptr<PagedNode> node;
+        if (_node.lock(node) && !_progress->isCanceled())
+        {
+            osg::Timer_t start = osg::Timer::instance()->tick();
+            _result = node->loadChild();
+            pager().average(pager().loadTime, millisecondsSince(start));
+        }
+
+        osg::ref_ptr<osgUtil::IncrementalCompileOperation> ico;
+        if (_result.valid() && _ico.lock(ico) && !ico->getContextSet().empty())
+        {
+            _compileStart = osg::Timer::instance()->tick();
+            _compileSet = new osgUtil::IncrementalCompileOperation::CompileSet(_result.get());
+            _compileSet->_compileCompletedCallback = this;
+            setState(COMPILING);
+            ico->add(_compileSet.get());
+        }
+        else
+        {
+            setState(READY);
+        }
+    }
+
+    //! Called by the ICO during the update traversal
+    virtual bool compileCompleted(osgUtil::IncrementalCompileOperation::CompileSet*)
+    {
+        // break the reference cycle between us and the compile set
+        _compileSet = NULL;
+        pager().average(pager().compileTime, millisecondsSince(_compileStart));
+        setState(READY);
+        return true;
+    }
+
+    //! Stops waiting on the ICO, which may never finish if its
+    //! contexts went away.
+    void abandonCompile()
+    {
+        osg::ref_ptr<osgUtil::IncrementalCompileOperation> ico;
+        if (_compileSet.valid() && _ico.lock(ico))
+        {
+            _compileSet->_compileCompletedCallback = NULL;
+            ico->remove(_compileSet.get());
+        }
+        _compileSet = NULL;
+        setState(READY);
+    }
+
+    osg::observer_ptr<PagedNode> _node;
+    osg::observer_ptr<osgUtil::IncrementalCompileOperation> _ico;
+    osg::ref_ptr<PagedNodeLoadProgress> _progress;
+    osg::ref_ptr<osg::Node> _result;
+    osg::ref_ptr<osgUtil::IncrementalCompileOperation::CompileSet> _compileSet;
+    std::atomic_int _state;
+    osg::Timer_t _compileStart;
+};
+
+
 PagedNode::PagedNode() :
+    _additive(false),
     _rangeFactor(6.0f),
-    _additive(false)
+    _rangeMode(osg::LOD::DISTANCE_FROM_EYE_POINT),
+    _minRange(FLT_MAX),
+    _pagingEnabled(false),
+    _lastInRangeFrame(0u),
+    _lastInRangeTime(0.0)
 {
-    _plod = new osg::PagedLOD;
-    addChild(_plod);
-
     _attachPoint = new osg::Group;
+    addChild(_attachPoint);
+}
+
+PagedNode::~PagedNode()
+{
+    if (_child.valid())
+        --pager().numLoaded;
 
-    _plod->addChild( _attachPoint );     
+    // a waiting request will see that we're gone and quit
+    if (_loader.valid() && _loader->_state == Loader::COMPILING)
+        _loader->abandonCompile();
 }
 
-void PagedNode::setRangeMode(osg::LOD::RangeMode mode)
+void PagedNode::setRangeMode(const osg::LOD::RangeMode mode)
 {
-    _plod->setRangeMode(mode);
+    _rangeMode = mode;
 }
 
 void PagedNode::setNode(osg::Node* node)
@@ -85,82 +326,280 @@ void PagedNode::setNode(osg::Node* node)
 
 void PagedNode::setupPaging()
 {
-    osg::BoundingSphere bs = getChildBound();
-
-    _plod->setCenter( bs.center() ); 
-    _plod->setRadius( bs.radius() );
+    _pagedBound = getChildBound();
+    dirtyBound();
 
-    if ( hasChild() )
-    {    
-        // Now setup a filename on the PagedLOD that will load all of the children of this node.
-        _plod->setFileName(1, ".osgearth_pseudo_pagednode");
-      
-        // assemble data to pass to the pseudoloader
-        osgDB::Options* options = new osgDB::Options();
-        OptionsData<PagedNode>::set(options, "osgEarth.PagedNode", this);
-        _plod->setDatabaseOptions( options );
+    bool pagingEnabled = hasChild();
 
-        // Setup the min and max ranges.
-        float minRange;
-        if ( _range.isSet() )
+    if (pagingEnabled)
+    {
+        // Setup the page-in range.
+        if (_range.isSet())
         {
-            minRange = _range.get();
+            _minRange = _range.get();
+        }
+        else if (_rangeMode == osg::LOD::DISTANCE_FROM_EYE_POINT)
+        {
+            _minRange = (float)(_pagedBound.radius() * _rangeFactor);
         }
         else
         {
-            if (_plod->getRangeMode() == _plod->DISTANCE_FROM_EYE_POINT)
-            {                
-                minRange = (float)(bs.radius() * _rangeFactor);
-            }
-            else
-            {
-                minRange = 256;
-            }
+            _minRange = 256;
+        }
+    }
+
+    // merging and expiration happen during the update traversal
+    if (pagingEnabled != _pagingEnabled)
+    {
+        ADJUST_UPDATE_TRAV_COUNT(this, pagingEnabled ? +1 : -1);
+        _pagingEnabled = pagingEnabled;
+    }
+}
+
+osg::BoundingSphere PagedNode::getChildBound() const
+{
+    return osg::BoundingSphere();
+}
+
+bool PagedNode::hasChild() const
+{
+    return true;
+}
+
+osg::BoundingSphere PagedNode::computeBound() const
+{
+    if (_pagedBound.valid())
+        return _pagedBound;
+    return osg::Group::computeBound();
+}
+
+bool PagedNode::inRange(osg::NodeVisitor& nv, float& closeness) const
+{
+    closeness = 0.0f;
+
+    if (_rangeMode == osg::LOD::DISTANCE_FROM_EYE_POINT)
+    {
+        float distance = nv.getDistanceToViewPoint(getBound().center(), true);
+        closeness = 1.0f - osg::clampBetween(distance / _minRange, 0.0f, 1.0f);
+        return distance < _minRange;
+    }
+
+    osg::CullStack* cs = dynamic_cast<osg::CullStack*>(&nv);
+    if (!cs)
+    {
+        // no notion of pixel size, so show whatever is loaded
+        return _child.valid();
+    }
+
+    float pixelSize = cs->clampedPixelSize(getBound());
+    if (pixelSize > 0.0f)
+        closeness = 1.0f - osg::clampBetween(_minRange / pixelSize, 0.0f, 1.0f);
+    return pixelSize >= _minRange;
+}
+
+void PagedNode::traverse(osg::NodeVisitor& nv)
+{
+    if (!_pagingEnabled)
+    {
+        osg::Group::traverse(nv);
+        return;
+    }
+
+    if (nv.getVisitorType() == nv.UPDATE_VISITOR)
+    {
+        merge(nv.getFrameStamp());
+        osg::Group::traverse(nv);
+        return;
+    }
+
+    bool isCull = nv.getVisitorType() == nv.CULL_VISITOR;
+
+    if (!isCull && nv.getTraversalMode() != nv.TRAVERSE_ACTIVE_CHILDREN)
+    {
+        osg::Group::traverse(nv);
+        return;
+    }
+
+    float closeness;
+    bool in = inRange(nv, closeness);
+
+    if (isCull && nv.getFrameStamp())
+    {
+        unsigned frame = nv.getFrameStamp()->getFrameNumber();
+        pager().frame = frame;
+        if (in)
+        {
+            _lastInRangeFrame = frame;
+            _lastInRangeTime = nv.getFrameStamp()->getReferenceTime();
+        }
+    }
+
+    if (in && _child.valid())
+    {
+        if (_additive)
+            _attachPoint->accept(nv);
+        _child->accept(nv);
+    }
+    else
+    {
+        _attachPoint->accept(nv);
+
+        if (in && isCull)
+            request(nv, closeness);
+    }
+}
+
+void PagedNode::request(osg::NodeVisitor& nv, float priority)
+{
+    // Many cameras may cull the same node
+    Threading::ScopedMutexLock lock(pager().requestMutex);
+
+    // A canceled request is either discarded by the arena or about to
+    // finish with nothing, so start over.
+    if (_loader.valid() &&
+        _loader->_state == Loader::LOADING &&
+        _loader->_progress->isCanceled())
+    {
+        _loader = NULL;
+    }
+
+    Threading::JobArena* arena = Registry::instance()->getJobArena("pager");
+
+    if (_loader.valid())
+    {
+        if (_loader->_state == Loader::LOADING)
+            arena->setPriority(_loader.get(), priority);
+        return;
+    }
+
+    // Compile with the view's ICO; if there is none, ask for the shared one.
+    osgUtil::IncrementalCompileOperation* ico = 0L;
+    osgUtil::CullVisitor* cv = Culling::asCullVisitor(nv);
+    osgViewer::View* view = cv && cv->getCurrentCamera() ?
+        dynamic_cast<osgViewer::View*>(cv->getCurrentCamera()->getView()) : 0L;
+
+    if (view && view->getDatabasePager())
+    {
+        ico = view->getDatabasePager()->getIncrementalCompileOperation();
+        if (!ico)
+        {
+            Threading::ScopedMutexLock lock(pager().mutex);
+            pager().viewsWithoutICO.push_back(view);
+        }
+    }
+
+    _loader = new Loader(this, ico);
+    arena->run(_loader.get(), priority, _loader->_progress.get());
+}
+
+void PagedNode::merge(const osg::FrameStamp* stamp)
+{
+    if (!stamp)
+        return;
+
+    Pager& p = pager();
+    unsigned frame = stamp->getFrameNumber();
+    double now = stamp->getReferenceTime();
+
+    p.installICO();
+
+    if (_loader.valid())
+    {
+        // give up on a compile that's taking too long
+        if (_loader->_state == Loader::COMPILING &&
+            millisecondsSince(_loader->_compileStart) > 1000.0 * p.expirationTime)
+        {
+            _loader->abandonCompile();
         }
 
-        if (!_additive)
+        if (_loader->_state == Loader::READY && p.canMerge(frame))
         {
-            // Replace mode, the parent is replaced by its children.
-            if (_plod->getRangeMode() == _plod->DISTANCE_FROM_EYE_POINT)
-            {
-                _plod->setRange( 0, minRange, FLT_MAX );
-                _plod->setRange( 1, 0, minRange );
-            }
-            else
+            OE_PROFILING_ZONE_NAMED("PagedNode::merge");
+            osg::Timer_t start = osg::Timer::instance()->tick();
+
+            osg::ref_ptr<Loader> loader;
             {
-                _plod->setRange(0, 0, minRange);
-                _plod->setRange(1, minRange, FLT_MAX);
+                Threading::ScopedMutexLock lock(p.requestMutex);
+                loader.swap(_loader);
             }
-        }
-        else
-        {
-            // Additive, the parent remains and new data is added
-            if (_plod->getRangeMode() == _plod->DISTANCE_FROM_EYE_POINT)
+            loader->setState(Loader::DONE);
+
+            if (loader->_result.valid() && !_child.valid())
             {
-                _plod->setRange( 0, 0, FLT_MAX );
-                _plod->setRange( 1, 0, minRange );
+                _child = loader->_result.get();
+                addChild(_child.get());
+                ++p.numLoaded;
             }
-            else
+            else if (!loader->_result.valid() && !loader->_progress->isCanceled())
             {
-                _plod->setRange(0, 0, FLT_MAX);
-                _plod->setRange(1, minRange, FLT_MAX);
+                // nothing to load here, so stop asking
+                ADJUST_UPDATE_TRAV_COUNT(this, -1);
+                _pagingEnabled = false;
             }
+
+            p.merged(millisecondsSince(start));
+
+            OE_PROFILING_PLOT("PagedNode requests", (float)p.numRequests);
+            OE_PROFILING_PLOT("PagedNode compiling", (float)p.numCompiling);
+            OE_PROFILING_PLOT("PagedNode merge time", (float)p.mergeTimeThisFrame);
         }
     }
-    else
+
+    // Unload the child once it has been out of range long enough
+    if (_child.valid() &&
+        frame - _lastInRangeFrame > 1u &&
+        now - _lastInRangeTime > p.expirationTime)
     {
-        // no children, so max out the visibility range.
-        _plod->setRange( 0, 0, FLT_MAX );
-    }   
+        removeChild(_child.get());
+        _child = NULL;
+        --p.numLoaded;
+    }
 }
 
-osg::BoundingSphere PagedNode::getChildBound() const
+PagedNode::Metrics PagedNode::getMetrics()
 {
-    return osg::BoundingSphere();
+    Pager& p = pager();
+    Threading::ScopedMutexLock lock(p.mutex);
+
+    Metrics m;
+    m.numRequests = p.numRequests;
+    m.numCompiling = p.numCompiling;
+    m.numMerging = p.numMerging;
+    m.numLoaded = p.numLoaded;
+    m.loadTime = p.loadTime;
+    m.compileTime = p.compileTime;
+    m.mergeTime = p.mergeTimeLastFrame;
+    return m;
 }
 
-bool PagedNode::hasChild() const
+void PagedNode::setMergeBudget(double milliseconds)
 {
-    return true;
+    pager().mergeBudget = milliseconds;
+}
+
+double PagedNode::getMergeBudget()
+{
+    return pager().mergeBudget;
+}
+
+void PagedNode::setCompileBudget(double milliseconds)
+{
+    pager().compileBudget = milliseconds;
+    if (pager().ico.valid())
+        pager().ico->setMinimumTimeAvailableForGLCompileAndDeletePerFrame(milliseconds * 0.001);
+}
+
+double PagedNode::getCompileBudget()
+{
+    return pager().compileBudget;
+}
+
+void PagedNode::setExpirationTime(double seconds)
+{
+    pager().expirationTime = seconds;
 }
 
+double PagedNode::getExpirationTime()
+{
+    return pager().expirationTime;
+}
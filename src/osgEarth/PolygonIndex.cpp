@@ -0,0 +1,153 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+ * Copyright 2020 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarth/PolygonIndex>
+#include <osgEarth/rtree.h>
+
+#ifdef OSGEARTH_HAVE_GEOS
+#  include <osgEarth/GEOS>
+#  include <geos/geom/Coordinate.h>
+#  include <geos/geom/Location.h>
+#  include <geos/algorithm/locate/IndexedPointInAreaLocator.h>
+#endif
+
+#define LC "[PolygonIndex] "
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+namespace
+{
+    void collectPolygons(const Geometry* geom, std::vector< osg::ref_ptr<const Polygon> >& output)
+    {
+        if (geom->getType() == Geometry::TYPE_MULTI)
+        {
+            const GeometryCollection& c = static_cast<const MultiGeometry*>(geom)->getComponents();
+            for (GeometryCollection::const_iterator i = c.begin(); i != c.end(); ++i)
+                collectPolygons(i->get(), output);
+        }
+        else if (geom->getType() == Geometry::TYPE_POLYGON)
+        {
+            output.push_back(static_cast<const Polygon*>(geom));
+        }
+        else if (geom->getType() == Geometry::TYPE_RING && geom->size() >= 3)
+        {
+            output.push_back(new Polygon(&geom->asVector()));
+        }
+    }
+}
+
+struct PolygonIndex::Data
+{
+    typedef RTree<unsigned, double, 2> SpatialIndex;
+
+    std::vector< osg::ref_ptr<const Polygon> > polygons;
+    SpatialIndex index;
+
+#ifdef OSGEARTH_HAVE_GEOS
+    typedef geos::algorithm::locate::IndexedPointInAreaLocator Locator;
+
+    GEOSContext context;
+    std::vector<geos::geom::Geometry*> geoms;
+    std::vector<Locator*> locators;
+#endif
+};
+
+PolygonIndex::PolygonIndex(const FeatureList& features) :
+_data(new Data())
+{
+    for (FeatureList::const_iterator i = features.begin(); i != features.end(); ++i)
+    {
+        if (i->valid() && i->get()->getGeometry())
+            collectPolygons(i->get()->getGeometry(), _data->polygons);
+    }
+
+#ifdef OSGEARTH_HAVE_GEOS
+    _data->geoms.resize(_data->polygons.size(), 0L);
+    _data->locators.resize(_data->polygons.size(), 0L);
+#endif
+
+    for (unsigned p = 0; p < _data->polygons.size(); ++p)
+    {
+        const Polygon* polygon = _data->polygons[p].get();
+        Bounds b = polygon->getBounds();
+        double a_min[2] = { b.xMin(), b.yMin() };
+        double a_max[2] = { b.xMax(), b.yMax() };
+        _data->index.Insert(a_min, a_max, p);
+
+#ifdef OSGEARTH_HAVE_GEOS
+        geos::geom::Geometry* geom = _data->context.importGeometry(polygon);
+        if (geom)
+        {
+            _data->geoms[p] = geom;
+            _data->locators[p] = new Data::Locator(*geom);
+
+            // The locator builds its own index on first use; do that now
+            // so concurrent queries only ever read it.
+            geos::geom::Coordinate c(b.center().x(), b.center().y());
+            _data->locators[p]->locate(&c);
+        }
+#endif
+    }
+
+    OE_DEBUG << LC << "Indexed " << _data->polygons.size() << " polygons" << std::endl;
+}
+
+PolygonIndex::~PolygonIndex()
+{
+#ifdef OSGEARTH_HAVE_GEOS
+    for (unsigned p = 0; p < _data->locators.size(); ++p)
+    {
+        delete _data->locators[p];
+        if (_data->geoms[p])
+            _data->context.disposeGeometry(_data->geoms[p]);
+    }
+#endif
+    delete _data;
+}
+
+unsigned
+PolygonIndex::size() const
+{
+    return (unsigned)_data->polygons.size();
+}
+
+bool
+PolygonIndex::contains(double x, double y) const
+{
+    double a_min[2] = { x, y };
+    double a_max[2] = { x, y };
+    std::vector<unsigned> hits;
+    _data->index.Search(a_min, a_max, &hits, std::numeric_limits<int>::max());
+
+    for (std::vector<unsigned>::const_iterator p = hits.begin(); p != hits.end(); ++p)
+    {
+#ifdef OSGEARTH_HAVE_GEOS
+        if (_data->locators[*p])
+        {
+            geos::geom::Coordinate c(x, y);
+            if (_data->locators[*p]->locate(&c) != geos::geom::Location::EXTERIOR)
+                return true;
+            continue;
+        }
+#endif
+        if (_data->polygons[*p]->contains2D(x, y))
+            return true;
+    }
+    return false;
+}
@@ -20,6 +20,9 @@
 #include <osgEarth/Profile>
 #include <osgEarth/Registry>
 #include <osgEarth/TileKey>
+#include <osgEarth/Containers>
+#include <osgEarth/Threading>
+#include <cmath>
 
 using namespace osgEarth;
 
@@ -328,6 +331,24 @@ Profile::create(const std::string& name)
 
 /****************************************************************************/
 
+struct Profile::Mappings
+{
+    struct Mapping
+    {
+        Mapping() : _geodeticMercator(false) { }
+
+        // one side is global-geodetic and the other spherical-mercator
+        bool _geodeticMercator;
+
+        // equivalent LOD for each LOD of the other profile; -1 = not yet computed
+        std::vector<int> _lods;
+    };
+
+    Mappings() : _mutex("Profile.mappings(OE)") { }
+
+    Threading::Mutex _mutex;
+    UnorderedMap<std::string, Mapping> _table;
+};
 
 Profile::Profile(const SpatialReference* srs,
                  double xmin, double ymin, double xmax, double ymax,
@@ -349,6 +370,8 @@ Profile::Profile(const SpatialReference* srs,
     _fullSignature =  Stringify() << std::hex << hashString( temp.getConfig().toJSON() );
     temp.vsrsString() = "";
     _horizSignature = Stringify() << std::hex << hashString( temp.getConfig().toJSON() );
+
+    _mappings = std::make_shared<Mappings>();
 }
 
 Profile::Profile(const SpatialReference* srs,
@@ -371,6 +394,8 @@ Profile::Profile(const SpatialReference* srs,
     _fullSignature =  Stringify() << std::hex << hashString( temp.getConfig().toJSON() );
     temp.vsrsString() = "";
     _horizSignature = Stringify() << std::hex << hashString( temp.getConfig().toJSON() );
+
+    _mappings = std::make_shared<Mappings>();
 }
 
 Profile::ProfileType
@@ -508,11 +533,9 @@ Profile::getTileDimensions(unsigned int lod, double& out_width, double& out_heig
     out_width  = (_extent.xMax() - _extent.xMin()) / (double)_numTilesWideAtLod0;
     out_height = (_extent.yMax() - _extent.yMin()) / (double)_numTilesHighAtLod0;
 
-    for (unsigned int i = 0; i < lod; ++i)
-    {
-        out_width /= 2.0;
-        out_height /= 2.0;
-    }
+    // halve once per level, exactly
+    out_width  = ldexp(out_width, -(int)lod);
+    out_height = ldexp(out_height, -(int)lod);
 }
 
 void
@@ -670,6 +693,18 @@ namespace
         int floored2 = (int)(in + epsilon);
         return floored == floored2 ? floored : floored2;
     }
+
+    // Spherical mercator row position (0 at the top, 1 at the bottom) of a latitude
+    double mercatorRowFraction(double lat)
+    {
+        return 0.5 - log(tan(osg::PI_4 + 0.5*osg::DegreesToRadians(lat))) / (2.0*osg::PI);
+    }
+
+    // Latitude of a spherical mercator row position
+    double mercatorLatitude(double rowFraction)
+    {
+        return osg::RadiansToDegrees(atan(sinh(osg::PI*(1.0 - 2.0*rowFraction))));
+    }
 }
 
 void
@@ -731,13 +766,89 @@ Profile::addIntersectingTiles(const GeoExtent& key_ext, unsigned localLOD, std::
 }
 
 
+bool
+Profile::isGeodeticMercatorPair(const Profile* rhs) const
+{
+    {
+        Threading::ScopedMutexLock lock(_mappings->_mutex);
+        UnorderedMap<std::string, Mappings::Mapping>::const_iterator i = _mappings->_table.find(rhs->getHorizSignature());
+        if (i != _mappings->_table.end())
+            return i->second._geodeticMercator;
+    }
+
+    const Profile* geodetic = Registry::instance()->getGlobalGeodeticProfile();
+    const Profile* mercator = Registry::instance()->getSphericalMercatorProfile();
+
+    bool pair =
+        (rhs->isHorizEquivalentTo(mercator) && isHorizEquivalentTo(geodetic)) ||
+        (rhs->isHorizEquivalentTo(geodetic) && isHorizEquivalentTo(mercator));
+
+    Threading::ScopedMutexLock lock(_mappings->_mutex);
+    _mappings->_table[rhs->getHorizSignature()]._geodeticMercator = pair;
+    return pair;
+}
+
+void
+Profile::addMappedTiles(const TileKey& key, unsigned localLOD, std::vector<TileKey>& out_intersectingKeys) const
+{
+    // Geodetic <-> mercator only. Both span all longitudes on the same
+    // axis, so the columns map by ratio and are exact in integers; the
+    // rows go through latitude. No SRS transformation required.
+    unsigned srcWide, srcHigh;
+    key.getProfile()->getNumTiles(key.getLOD(), srcWide, srcHigh);
+
+    unsigned numWide, numHigh;
+    getNumTiles(localLOD, numWide, numHigh);
+
+    unsigned long long x = key.getTileX();
+    int tileMinX = (int)((x * numWide) / srcWide);
+    int tileMaxX = (int)(((x + 1u) * numWide + srcWide - 1u) / srcWide) - 1;
+
+    double top = (double)key.getTileY() / (double)srcHigh;
+    double bottom = (double)(key.getTileY() + 1u) / (double)srcHigh;
+
+    if (getSRS()->isGeographic())
+    {
+        top = (90.0 - mercatorLatitude(top)) / 180.0;
+        bottom = (90.0 - mercatorLatitude(bottom)) / 180.0;
+    }
+    else
+    {
+        // clamp to the latitudes mercator can represent
+        double maxLat = _latlong_extent.yMax();
+        double latTop = 90.0 - 180.0*top;
+        double latBottom = 90.0 - 180.0*bottom;
+        if (latBottom >= maxLat || latTop <= -maxLat)
+            return;
+
+        top = mercatorRowFraction(osg::minimum(latTop, maxLat));
+        bottom = mercatorRowFraction(osg::maximum(latBottom, -maxLat));
+    }
+
+    int tileMinY = (int)floor(top * (double)numHigh);
+    int tileMaxY = (int)ceil(bottom * (double)numHigh) - 1;
+
+    tileMinX = osg::clampBetween(tileMinX, 0, (int)numWide-1);
+    tileMaxX = osg::clampBetween(tileMaxX, 0, (int)numWide-1);
+    tileMinY = osg::clampBetween(tileMinY, 0, (int)numHigh-1);
+    tileMaxY = osg::clampBetween(tileMaxY, tileMinY, (int)numHigh-1);
+
+    for (int i = tileMinX; i <= tileMaxX; ++i)
+    {
+        for (int j = tileMinY; j <= tileMaxY; ++j)
+        {
+            out_intersectingKeys.push_back( TileKey(localLOD, i, j, this) );
+        }
+    }
+}
+
 void
 Profile::getIntersectingTiles(const TileKey& key, std::vector<TileKey>& out_intersectingKeys) const
 {
     OE_DEBUG << "GET ISECTING TILES for key " << key.str() << " -----------------" << std::endl;
 
     //If the profiles are exactly equal, just add the given tile key.
-    if ( isHorizEquivalentTo( key.getProfile() ) )
+    if ( key.getProfile() == this || isHorizEquivalentTo( key.getProfile() ) )
     {
         //Clear the incoming list
         out_intersectingKeys.clear();
@@ -748,13 +859,64 @@ Profile::getIntersectingTiles(const TileKey& key, std::vector<TileKey>& out_inte
         // figure out which LOD in the local profile is a best match for the LOD
         // in the source LOD in terms of resolution.
         unsigned localLOD = getEquivalentLOD(key.getProfile(), key.getLOD());
-        getIntersectingTiles(key.getExtent(), localLOD, out_intersectingKeys);
+
+        if (isGeodeticMercatorPair(key.getProfile()))
+            addMappedTiles(key, localLOD, out_intersectingKeys);
+        else
+            getIntersectingTiles(key.getExtent(), localLOD, out_intersectingKeys);
 
         OE_DEBUG << LC << "GIT, key="<< key.str() << ", localLOD=" << localLOD
             << ", resulted in " << out_intersectingKeys.size() << " tiles" << std::endl;
     }
 }
 
+void
+Profile::getIntersectingTiles(const std::vector<TileKey>& keys, std::vector<std::vector<TileKey> >& out_intersectingKeys) const
+{
+    out_intersectingKeys.resize(keys.size());
+
+    // keys tend to come in runs from the same profile and LOD,
+    // so only look up the mapping when those change.
+    const Profile* profile = 0L;
+    bool same = false, pair = false;
+    unsigned lod = ~0u, localLOD = 0u;
+
+    for (unsigned i = 0; i < keys.size(); ++i)
+    {
+        const TileKey& key = keys[i];
+        std::vector<TileKey>& out = out_intersectingKeys[i];
+        out.clear();
+
+        if (!key.valid())
+            continue;
+
+        if (key.getProfile() != profile)
+        {
+            profile = key.getProfile();
+            same = profile == this || isHorizEquivalentTo(profile);
+            pair = !same && isGeodeticMercatorPair(profile);
+            lod = ~0u;
+        }
+
+        if (same)
+        {
+            out.push_back(key);
+            continue;
+        }
+
+        if (key.getLOD() != lod)
+        {
+            lod = key.getLOD();
+            localLOD = getEquivalentLOD(profile, lod);
+        }
+
+        if (pair)
+            addMappedTiles(key, localLOD, out);
+        else
+            getIntersectingTiles(key.getExtent(), localLOD, out);
+    }
+}
+
 void
 Profile::getIntersectingTiles(const GeoExtent& extent, unsigned localLOD, std::vector<TileKey>& out_intersectingKeys) const
 {
@@ -788,16 +950,37 @@ unsigned
 Profile::getEquivalentLOD( const Profile* rhsProfile, unsigned rhsLOD ) const
 {    
     //If the profiles are equivalent, just use the incoming lod
-    if (rhsProfile->isHorizEquivalentTo( this ) ) 
+    if (rhsProfile == this || rhsProfile->isHorizEquivalentTo( this ) ) 
         return rhsLOD;
 
     // Special check for geodetic to mercator or vise versa, they should match up in LOD.
-    if ((rhsProfile->isEquivalentTo(Registry::instance()->getSphericalMercatorProfile()) && isEquivalentTo(Registry::instance()->getGlobalGeodeticProfile())) ||
-        (rhsProfile->isEquivalentTo(Registry::instance()->getGlobalGeodeticProfile()) && isEquivalentTo(Registry::instance()->getSphericalMercatorProfile())))
-    {
+    if (isGeodeticMercatorPair(rhsProfile))
         return rhsLOD;
+
+    // callers sometimes pass an "unlimited" LOD; don't cache those
+    if (rhsLOD >= 64u)
+        return computeEquivalentLOD(rhsProfile, rhsLOD);
+
+    {
+        Threading::ScopedMutexLock lock(_mappings->_mutex);
+        const std::vector<int>& lods = _mappings->_table[rhsProfile->getHorizSignature()]._lods;
+        if (rhsLOD < lods.size() && lods[rhsLOD] >= 0)
+            return (unsigned)lods[rhsLOD];
     }
 
+    unsigned lod = computeEquivalentLOD(rhsProfile, rhsLOD);
+
+    Threading::ScopedMutexLock lock(_mappings->_mutex);
+    std::vector<int>& lods = _mappings->_table[rhsProfile->getHorizSignature()]._lods;
+    if (rhsLOD >= lods.size())
+        lods.resize(rhsLOD + 1u, -1);
+    lods[rhsLOD] = (int)lod;
+    return lod;
+}
+
+unsigned
+Profile::computeEquivalentLOD( const Profile* rhsProfile, unsigned rhsLOD ) const
+{
     double rhsWidth, rhsHeight;
     rhsProfile->getTileDimensions( rhsLOD, rhsWidth, rhsHeight );    
 
@@ -21,14 +21,172 @@
 #include <osgEarth/ImageUtils>
 #include <osgEarth/Registry>
 #include <osgEarth/GLUtils>
+#include <osgEarth/Threading>
 
 #include <osg/BlendFunc>
+#include <osg/GLExtensions>
+#include <osg/Version>
+#include <cstring>
+#include <set>
 
 using namespace osgEarth;
 using namespace osgEarth::Util;
 
 #define LC "[RTTPicker] "
 
+// Number of ID readbacks that can be in flight at once
+#define NUM_READBACKS 2
+
+// Frames to wait for a pick result before reporting a miss
+#define MAX_PICK_LATENCY 8u
+
+// Fence syncs arrived in osg::GLExtensions with OSG 3.6. Without them the
+// pick camera reads its image back synchronously.
+#if OSG_VERSION_GREATER_OR_EQUAL(3,6,0)
+#define OE_HAVE_GL_SYNC
+#endif
+
+#ifndef GL_PIXEL_PACK_BUFFER
+#define GL_PIXEL_PACK_BUFFER 0x88EB
+#endif
+
+#ifndef GL_STREAM_READ
+#define GL_STREAM_READ 0x88E1
+#endif
+
+#ifndef GL_READ_ONLY
+#define GL_READ_ONLY 0x88B8
+#endif
+
+#ifndef GL_SYNC_GPU_COMMANDS_COMPLETE
+#define GL_SYNC_GPU_COMMANDS_COMPLETE 0x9117
+#define GL_ALREADY_SIGNALED 0x911A
+#define GL_CONDITION_SATISFIED 0x911C
+#endif
+
+// Runs after the pick camera draws. Starts copying the ID texture into a
+// pixel buffer, and publishes earlier copies once the GPU has finished them.
+struct RTTPicker::Readback : public osg::Camera::DrawCallback
+{
+    struct Slot
+    {
+        Slot() : _fence(0L), _frame(0u) { }
+        osg::ref_ptr<GLBuffer> _pbo;
+#ifdef OE_HAVE_GL_SYNC
+        GLsync _fence;
+#else
+        void* _fence;
+#endif
+        unsigned _frame;
+    };
+
+    struct GCState
+    {
+        GCState() : _next(0u) { }
+        Slot _slots[NUM_READBACKS];
+        unsigned _next;
+    };
+
+    Readback(osg::Texture2D* tex, osg::Image* image) :
+        _tex(tex), _image(image), _frame(~0u) { }
+
+    //! Frame number the pixels in the image were rendered in, or ~0 if none
+    unsigned frame() const
+    {
+        Threading::ScopedMutexLock lock(_mutex);
+        return _frame;
+    }
+
+    void operator () (osg::RenderInfo& ri) const
+    {
+        osg::State& state = *ri.getState();
+        unsigned frame = state.getFrameStamp() ? state.getFrameStamp()->getFrameNumber() : 0u;
+
+#ifdef OE_HAVE_GL_SYNC
+        osg::GLExtensions* ext = state.get<osg::GLExtensions>();
+        GCState& gc = _gc[state.getContextID()];
+
+        collect(ext, gc);
+
+        // skip this frame if the oldest copy is still in flight
+        Slot& slot = gc._slots[gc._next];
+        if (slot._fence)
+            return;
+
+        GLsizeiptr size = _image->getTotalSizeInBytes();
+        if (!slot._pbo.valid())
+        {
+            slot._pbo = new GLBuffer();
+            ext->glGenBuffers(1, &slot._pbo->_handle);
+            ext->glBindBuffer(GL_PIXEL_PACK_BUFFER, slot._pbo->_handle);
+            ext->glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+            state.getGraphicsContext()->add(new GLBufferReleaser(slot._pbo.get()));
+        }
+
+        state.applyTextureAttribute(0, _tex.get());
+        ext->glBindBuffer(GL_PIXEL_PACK_BUFFER, slot._pbo->_handle);
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0L);
+        ext->glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        slot._fence = ext->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        slot._frame = frame;
+
+        gc._next = (gc._next + 1u) % NUM_READBACKS;
+#else
+        // the camera already read the image back
+        Threading::ScopedMutexLock lock(_mutex);
+        _frame = frame;
+#endif
+    }
+
+#ifdef OE_HAVE_GL_SYNC
+    void collect(osg::GLExtensions* ext, GCState& gc) const
+    {
+        for (unsigned i = 0; i < NUM_READBACKS; ++i)
+        {
+            Slot& slot = gc._slots[i];
+            if (!slot._fence)
+                continue;
+
+            GLenum status = ext->glClientWaitSync(slot._fence, 0, 0);
+            if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+                continue;
+
+            ext->glDeleteSync(slot._fence);
+            slot._fence = 0L;
+
+            ext->glBindBuffer(GL_PIXEL_PACK_BUFFER, slot._pbo->_handle);
+            const void* pixels = ext->glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+            if (pixels)
+            {
+                Threading::ScopedMutexLock lock(_mutex);
+                if (_frame == ~0u || slot._frame > _frame)
+                {
+                    ::memcpy(_image->data(), pixels, _image->getTotalSizeInBytes());
+                    _image->dirty();
+                    _frame = slot._frame;
+                }
+                ext->glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            }
+            ext->glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        }
+    }
+#endif
+
+    void releaseGLObjects(osg::State* state) const
+    {
+        if (state)
+            _gc[state->getContextID()] = GCState();
+    }
+
+    osg::ref_ptr<osg::Texture2D> _tex;
+    osg::ref_ptr<osg::Image> _image;
+    mutable Threading::Mutex _mutex;
+    mutable unsigned _frame;
+    mutable osg::buffered_object<GCState> _gc;
+};
+
 namespace
 {
     // Callback to set the "far plane" uniform just before drawing.
@@ -115,15 +273,6 @@ osg::Texture2D*
 RTTPicker::getOrCreateTexture(osg::View* view)
 {
     PickContext& pc = getOrCreatePickContext(view);
-    if ( !pc._tex.valid() )
-    {
-        pc._tex = new osg::Texture2D( pc._image.get() );
-        pc._tex->setTextureSize(pc._image->s(), pc._image->t());
-        pc._tex->setUnRefImageDataAfterApply(false);
-        pc._tex->setFilter(pc._tex->MIN_FILTER, pc._tex->NEAREST); // no filtering
-        pc._tex->setFilter(pc._tex->MAG_FILTER, pc._tex->NEAREST); // no filtering
-        pc._tex->setMaxAnisotropy(1.0f); // no filtering
-    }
     return pc._tex.get();
 }
 
@@ -174,6 +323,19 @@ RTTPicker::getOrCreatePickContext(osg::View* view)
     c._image = new osg::Image();
     c._image->allocateImage(_rttSize, _rttSize, 1, GL_RGBA, GL_UNSIGNED_BYTE);    
     memset(c._image->data(), 0, _rttSize * _rttSize * 4);
+
+    // The pick camera renders into this texture, and the readback copies it
+    // into the image a frame or two later.
+    c._tex = new osg::Texture2D();
+    c._tex->setTextureSize(_rttSize, _rttSize);
+    c._tex->setInternalFormat(GL_RGBA8);
+    c._tex->setSourceFormat(GL_RGBA);
+    c._tex->setSourceType(GL_UNSIGNED_BYTE);
+    c._tex->setFilter(c._tex->MIN_FILTER, c._tex->NEAREST); // no filtering
+    c._tex->setFilter(c._tex->MAG_FILTER, c._tex->NEAREST); // no filtering
+    c._tex->setMaxAnisotropy(1.0f); // no filtering
+
+    c._readback = new Readback(c._tex.get(), c._image.get());
     
     // Make an RTT camera and bind it to our image.
     // Note: don't use RF_INHERIT_VIEWPOINT because it's unnecessary and
@@ -189,7 +351,12 @@ RTTPicker::getOrCreatePickContext(osg::View* view)
     c._pickCamera->setViewport( 0, 0, _rttSize, _rttSize );
     c._pickCamera->setRenderOrder( osg::Camera::NESTED_RENDER );
     c._pickCamera->setRenderTargetImplementation( osg::Camera::FRAME_BUFFER_OBJECT );
+#ifdef OE_HAVE_GL_SYNC
+    c._pickCamera->attach( osg::Camera::COLOR_BUFFER0, c._tex.get() );
+#else
     c._pickCamera->attach( osg::Camera::COLOR_BUFFER0, c._image.get() );
+#endif
+    c._pickCamera->setPostDrawCallback( c._readback.get() );
     c._pickCamera->setSmallFeatureCullingPixelSize( -1.0f );
     c._pickCamera->setCullMask( _cullMask );
 
@@ -198,6 +365,9 @@ RTTPicker::getOrCreatePickContext(osg::View* view)
     
     osg::StateSet* rttSS = c._pickCamera->getOrCreateStateSet();
 
+    // the scissor follows the queued picks, see updateScissor
+    rttSS->setDataVariance(osg::Object::DYNAMIC);
+
     // disable all the things that break ObjectID picking:
     osg::StateAttribute::GLModeValue disable = 
         osg::StateAttribute::OFF | osg::StateAttribute::OVERRIDE | osg::StateAttribute::PROTECTED;
@@ -206,6 +376,11 @@ RTTPicker::getOrCreatePickContext(osg::View* view)
     rttSS->setMode(GL_CULL_FACE, disable );
     rttSS->setMode(GL_ALPHA_TEST, disable );
 
+    // only draw the pixels the picks will read
+    c._scissor = new osg::Scissor(0, 0, _rttSize, _rttSize);
+    rttSS->setAttributeAndModes(c._scissor.get(),
+        osg::StateAttribute::ON | osg::StateAttribute::OVERRIDE | osg::StateAttribute::PROTECTED);
+
 #if !(defined(OSG_GLES2_AVAILABLE) || defined(OSG_GLES3_AVAILABLE) || defined(OSG_GL3_AVAILABLE) )
     rttSS->setMode(GL_POINT_SMOOTH, disable );
     rttSS->setMode(GL_LINE_SMOOTH, disable );
@@ -326,15 +501,47 @@ RTTPicker::pick(osg::View* view, float mouseX, float mouseY, Callback* callback)
     {
         pick._context->_pickCamera->setNodeMask(~0u);
     }
+
+    updateScissor(context);
     
     return true;
 }
 
+void
+RTTPicker::updateScissor(PickContext& context)
+{
+    int ring = osg::maximum(_buffer, 1);
+    int xmin = _rttSize, ymin = _rttSize, xmax = 0, ymax = 0;
+
+    for (std::vector<Pick>::const_iterator i = _picks.begin(); i != _picks.end(); ++i)
+    {
+        if (i->_context == &context)
+        {
+            int x = (int)(i->_u * (float)_rttSize);
+            int y = (int)(i->_v * (float)_rttSize);
+            xmin = osg::minimum(xmin, x - ring);
+            ymin = osg::minimum(ymin, y - ring);
+            xmax = osg::maximum(xmax, x + ring + 1);
+            ymax = osg::maximum(ymax, y + ring + 1);
+        }
+    }
+
+    xmin = osg::maximum(xmin, 0), ymin = osg::maximum(ymin, 0);
+    xmax = osg::minimum(xmax, _rttSize), ymax = osg::minimum(ymax, _rttSize);
+
+    if (xmax > xmin && ymax > ymin)
+    {
+        context._scissor->setScissor(xmin, ymin, xmax - xmin, ymax - ymin);
+    }
+}
+
 void
 RTTPicker::runPicks(unsigned frameNumber)
 {
     if (_picks.size() > 0)
     {
+        std::set<PickContext*> changed;
+
         for (std::vector<Pick>::iterator i = _picks.begin(); i != _picks.end(); )
         {
             bool pickExpired = false;
@@ -352,6 +559,8 @@ RTTPicker::runPicks(unsigned frameNumber)
                         pick._context->_pickCamera->setNodeMask(0);
                     }
 
+                    changed.insert(pick._context);
+
                     // Remove the pick.
                     i = _picks.erase(i);
                 }
@@ -362,6 +571,11 @@ RTTPicker::runPicks(unsigned frameNumber)
                 ++i;
             }
         }
+
+        for (std::set<PickContext*>::iterator i = changed.begin(); i != changed.end(); ++i)
+        {
+            updateScissor(**i);
+        }
     }
 }
 
@@ -425,7 +639,23 @@ namespace
 bool
 RTTPicker::checkForPickResult(Pick& pick, unsigned frameNumber)
 {
+    Readback* readback = pick._context->_readback.get();
+
+    // The newest pixels may still predate this pick. Results come back
+    // a frame or two late; give up if they never arrive.
+    unsigned imageFrame = readback->frame();
+    if (imageFrame == ~0u || imageFrame < pick._frame)
+    {
+        bool pickExpired = frameNumber - pick._frame >= MAX_PICK_LATENCY;
+        if (pickExpired)
+        {
+            pick._callback->onMiss();
+        }
+        return pickExpired;
+    }
+
     // decode the results
+    Threading::ScopedMutexLock lock(readback->_mutex);
     osg::Image* image = pick._context->_image.get();
     ImageUtils::PixelReader read( image );
 
@@ -454,13 +684,13 @@ RTTPicker::checkForPickResult(Pick& pick, unsigned frameNumber)
     }
 
     // A pick expires if (a) it registers a hit, or (b) is registers a miss
-    // for 2 frames in a row. Why 2? Because the RTT picker itself delays 
-    // pick results by one frame, and the osgEarth draping/clamping systems
-    // also delay drawing by one frame. So we need 2 frames to positively
-    // register a hit on draped/clamped geometry.
+    // in the ID renders of 2 frames. Why 2? Because the osgEarth draping/
+    // clamping systems delay drawing by one frame, so we need 2 rendered
+    // frames to positively register a hit on draped/clamped geometry.
     bool pickExpired =
         hit == true ||
-        frameNumber - pick._frame >= 2u;
+        imageFrame >= pick._frame + 1u ||
+        frameNumber - pick._frame >= MAX_PICK_LATENCY;
 
     if ((hit == false) && (pickExpired == true))
     {
@@ -283,6 +283,7 @@ RadialLineOfSightNode::compute_line(osg::Node* node)
         osg::Vec3d spoke = quat * (side * _radius);
         osg::Vec3d end = _centerWorld + spoke;
         osg::ref_ptr<osgUtil::LineSegmentIntersector> dplsi = new osgUtil::LineSegmentIntersector( _centerWorld, end );
+        dplsi->setIntersectionLimit( osgUtil::Intersector::LIMIT_NEAREST );
         ivGroup->addIntersector( dplsi.get() );
     }
 
@@ -426,7 +427,10 @@ RadialLineOfSightNode::compute_fill(osg::Node* node)
         osg::Vec3d end = _centerWorld + spoke;        
         osg::ref_ptr<osgUtil::LineSegmentIntersector> dplsi = new osgUtil::LineSegmentIntersector( _centerWorld, end );
         if (dplsi)
+        {
+            dplsi->setIntersectionLimit( osgUtil::Intersector::LIMIT_NEAREST );
             ivGroup->addIntersector( dplsi.get() );
+        }
     }
 
     osgUtil::IntersectionVisitor iv;
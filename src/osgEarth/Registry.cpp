@@ -20,6 +20,7 @@
 #include <osgEarth/Capabilities>
 #include <osgEarth/Cube>
 #include <osgEarth/ShaderFactory>
+#include <osgEarth/SIMD>
 #include <osgEarth/ObjectIndex>
 #include <osgEarth/HTTPClient>
 #include <osgEarth/TerrainEngineNode>
@@ -30,6 +31,7 @@
 #include <gdal_priv.h>
 #include <ogr_api.h>
 #include <cstdlib>
+#include <algorithm>
 
 using namespace osgEarth;
 using namespace OpenThreads;
@@ -64,11 +66,18 @@ _cacheDriver        ( "filesystem" ),
 _overrideCachePolicyInitialized( false ),
 _devicePixelRatio(1.0f),
 _maxVertsPerDrawable(USHRT_MAX),
+_maxGDALDriversPerDataset(8u),
+#ifdef OSGEARTH_HEADLESS
+_headless           ( true ),
+#else
+_headless           ( false ),
+#endif
 _regMutex("Registry(OE)"),
 _activityMutex("Reg.Activity(OE)"),
 _capsMutex("Reg.Caps(OE)"),
 _srsCache("Reg.SRSCache(OE)"),
-_blacklist("Reg.BlackList(OE)")
+_blacklist("Reg.BlackList(OE)"),
+_jobArenasMutex("Reg.JobArenas(OE)")
 {
     // set up GDAL and OGR.
     OGRRegisterAll();
@@ -88,6 +97,10 @@ _blacklist("Reg.BlackList(OE)")
     if (::getenv("GDAL_DATA") == NULL)
         OE_INFO << LC << "Note: GDAL_DATA environment variable is not set" << std::endl;
 
+    // probe the CPU once, up front, for the SIMD kernels
+    OE_INFO << LC << "SIMD level: " << Util::SIMD::getName(Util::SIMD::getLevel())
+        << " (detected " << Util::SIMD::getName(Util::SIMD::getDetectedLevel()) << ")" << std::endl;
+
     // generates the basic shader code for the terrain engine and model layers.
     _shaderLib = new ShaderFactory();
 
@@ -170,12 +183,31 @@ _blacklist("Reg.BlackList(OE)")
             _maxVertsPerDrawable = 65536;
     }
 
+    // no GL at all?
+    if (getenv("OSGEARTH_HEADLESS"))
+    {
+        _headless = true;
+        OE_INFO << LC << "Headless mode: no graphics context will be created" << std::endl;
+    }
+
     // use the GDAL global mutex?
     if (getenv("OSGEARTH_DISABLE_GDAL_MUTEX"))
     {
         getGDALMutex().disable();
     }
 
+    const char* gdalDrivers = getenv("OSGEARTH_GDAL_MAX_DRIVERS");
+    if (gdalDrivers)
+    {
+        setMaxGDALDriversPerDataset(Strings::as<unsigned>(std::string(gdalDrivers), _maxGDALDriversPerDataset));
+    }
+
+    const char* gdalCache = getenv("OSGEARTH_GDAL_CACHE_SIZE");
+    if (gdalCache)
+    {
+        setGDALBlockCacheSize(Strings::as<unsigned>(std::string(gdalCache), getGDALBlockCacheSize()));
+    }
+
     // register the system stock Units.
     Units::registerAll( this );
 }
@@ -547,7 +579,18 @@ Registry::initCapabilities()
 {
     ScopedLock<Mutex> lock( _capsMutex ); // double-check pattern (see getCapabilities)
     if ( !_caps.valid() )
-        _caps = new Capabilities();
+        _caps = new Capabilities(_headless == false);
+}
+
+void
+Registry::setHeadless(bool value)
+{
+    if (_caps.valid() && value != _headless)
+    {
+        OE_WARN << LC << "setHeadless() called after the capabilities were initialized; "
+            "call it earlier for it to take effect" << std::endl;
+    }
+    _headless = value;
 }
 
 ShaderFactory*
@@ -683,6 +726,62 @@ Registry::getObjectIndex() const
     return _objectIndex.get();
 }
 
+Threading::ThreadPool*
+Registry::getJobThreadPool()
+{
+    Threading::ScopedMutexLock lock(_jobArenasMutex);
+    if (!_jobPool.valid())
+    {
+        unsigned numThreads = std::max(std::thread::hardware_concurrency(), 2u);
+
+        const char* value = ::getenv("OSGEARTH_NUM_JOB_THREADS");
+        if (value)
+        {
+            numThreads = std::max(osgEarth::Strings::as<unsigned>(std::string(value), numThreads), 1u);
+            OE_INFO << LC << "Job thread count set from environment: " << numThreads << std::endl;
+        }
+
+        _jobPool = new Threading::ThreadPool(numThreads);
+    }
+    return _jobPool.get();
+}
+
+Threading::JobArena*
+Registry::getJobArena(const std::string& name)
+{
+    Threading::ThreadPool* pool = getJobThreadPool();
+
+    Threading::ScopedMutexLock lock(_jobArenasMutex);
+    osg::ref_ptr<Threading::JobArena>& arena = _jobArenas[name];
+    if (!arena.valid())
+    {
+        // Default limits leave room for the other well-known arenas
+        // so that no single subsystem can starve the rest.
+        unsigned numThreads = pool->getNumThreads();
+        unsigned concurrency =
+            name == "terrain"   ? std::max(numThreads / 2u, 1u) :
+            name == "terrain.layers" ? std::max(numThreads, 2u) :
+            name == "terrain.cull" ? std::max(numThreads, 1u) :
+            name == "network"   ? std::max(numThreads / 2u, 4u) :
+            name == "features"  ? std::max(numThreads / 4u, 1u) :
+            name == "features.compile" ? std::max(numThreads / 2u, 1u) :
+            name == "features.build" ? std::max(numThreads / 2u, 1u) :
+            name == "features.edit" ? 1u :
+            name == "features.rasterize" ? std::max(numThreads / 2u, 1u) :
+            name == "features.package" ? std::max(numThreads, 1u) :
+            name == "features.prefetch" ? std::max(numThreads / 4u, 2u) :
+            name == "elevation" ? std::max(numThreads / 4u, 1u) :
+            name == "models.decode" ? std::max(numThreads / 2u, 1u) :
+            name == "pager"     ? std::max(numThreads / 2u, 2u) :
+            name == "kml"       ? std::max(numThreads / 2u, 1u) :
+            name == "layers.open" ? std::max(numThreads / 2u, 2u) :
+            2u;
+
+        arena = new Threading::JobArena(name, concurrency, pool);
+    }
+    return arena.get();
+}
+
 void
 Registry::startActivity(const std::string& activity)
 {
@@ -706,6 +805,12 @@ Registry::endActivity(const std::string& activity)
     _activities.erase(Activity(activity,std::string()));
 }
 
+void
+Registry::getMemoryReport(Util::Memory::Report& output) const
+{
+    Util::Memory::getReport(output);
+}
+
 void
 Registry::getActivities(std::set<std::string>& output)
 {
@@ -791,6 +896,31 @@ Registry::getMaxNumberOfVertsPerDrawable() const
     return _maxVertsPerDrawable;
 }
 
+void
+Registry::setMaxGDALDriversPerDataset(unsigned value)
+{
+    _maxGDALDriversPerDataset = osg::maximum(value, 1u);
+}
+
+unsigned
+Registry::getMaxGDALDriversPerDataset() const
+{
+    return _maxGDALDriversPerDataset;
+}
+
+void
+Registry::setGDALBlockCacheSize(unsigned megabytes)
+{
+    GDALSetCacheMax64((GIntBig)megabytes * 1024 * 1024);
+    OE_INFO << LC << "GDAL block cache size set to " << megabytes << " MB" << std::endl;
+}
+
+unsigned
+Registry::getGDALBlockCacheSize() const
+{
+    return (unsigned)(GDALGetCacheMax64() / (1024 * 1024));
+}
+
 namespace
 {
     //Simple class used to add a file extension alias for the earth_tile to the earth plugin
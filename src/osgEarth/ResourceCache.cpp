@@ -17,10 +17,219 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>
  */
 #include <osgEarth/ResourceCache>
+#include <osgEarth/Registry>
+#include <osgEarth/StateSetCache>
+#include <osgEarth/ImageUtils>
+#include <osg/Geometry>
 #include <osg/Texture2D>
+#include <osg/Texture2DArray>
+#include <unordered_map>
+#include <unordered_set>
 
 using namespace osgEarth;
 
+namespace
+{
+    // Adds up the memory of the geometry and images in a model,
+    // counting shared objects once.
+    struct ModelSizeVisitor : public osg::NodeVisitor
+    {
+        ModelSizeVisitor() : osg::NodeVisitor(TRAVERSE_ALL_CHILDREN), _bytes(0)
+        {
+            setNodeMaskOverride(~0);
+        }
+
+        void apply(osg::Node& node)
+        {
+            apply(node.getStateSet());
+            traverse(node);
+        }
+
+        void apply(osg::Drawable& drawable)
+        {
+            apply(drawable.getStateSet());
+
+            osg::Geometry* geom = drawable.asGeometry();
+            if (geom)
+            {
+                osg::Geometry::ArrayList arrays;
+                geom->getArrayList(arrays);
+                for (auto& array : arrays)
+                {
+                    if (array.valid() && _seen.insert(array.get()).second)
+                        _bytes += array->getTotalDataSize();
+                }
+
+                for (unsigned i = 0; i < geom->getNumPrimitiveSets(); ++i)
+                {
+                    osg::PrimitiveSet* prim = geom->getPrimitiveSet(i);
+                    if (prim && _seen.insert(prim).second)
+                        _bytes += prim->getTotalDataSize();
+                }
+            }
+        }
+
+        void apply(osg::StateSet* stateSet)
+        {
+            if (!stateSet || !_seen.insert(stateSet).second)
+                return;
+
+            for (unsigned unit = 0; unit < stateSet->getNumTextureAttributeLists(); ++unit)
+            {
+                osg::Texture* tex = dynamic_cast<osg::Texture*>(
+                    stateSet->getTextureAttribute(unit, osg::StateAttribute::TEXTURE));
+                if (!tex)
+                    continue;
+
+                for (unsigned i = 0; i < tex->getNumImages(); ++i)
+                {
+                    osg::Image* image = tex->getImage(i);
+                    if (image && _seen.insert(image).second)
+                        _bytes += image->getTotalSizeInBytesIncludingMipmaps();
+                }
+            }
+        }
+
+        std::size_t _bytes;
+        std::unordered_set<const osg::Referenced*> _seen;
+    };
+
+    // Instance models shared by all the resource caches in the process.
+    // Entries only observe their models, so a model goes away once the
+    // last cache and scene graph using it let go.
+    struct SharedModels
+    {
+        struct Entry
+        {
+            osg::observer_ptr<osg::Node> _node;
+            std::size_t _bytes;
+        };
+
+        SharedModels() : _mutex(OE_MUTEX_NAME), _loads(0u), _shared(0u), _bytesSaved(0u) { }
+
+        Threading::Mutex _mutex;
+        std::unordered_map<std::string, Entry> _models;
+        unsigned _loads;
+        unsigned _shared;
+        std::size_t _bytesSaved;
+    };
+
+    SharedModels& sharedModels()
+    {
+        static SharedModels s_models;
+        return s_models;
+    }
+
+    // GL 3 guarantees at least this many layers in an array texture
+    const unsigned MAX_SKIN_ARRAY_LAYERS = 256u;
+
+    // A skin can share the array when it's a single opaque image that
+    // needs no state of its own and isn't already a region of an atlas.
+    bool canShareArray(const SkinResource* skin)
+    {
+        return
+            skin->atlasHint() != false &&
+            !skin->texEnvMode().isSet() &&
+            !skin->imageBiasS().isSet() &&
+            !skin->imageBiasT().isSet() &&
+            !skin->imageScaleS().isSet() &&
+            !skin->imageScaleT().isSet() &&
+            !skin->imageLayer().isSet();
+    }
+
+    SkinArray* createSkinArray(ResourceLibrary* library, const SkinSymbol* symbol, const osgDB::Options* readOptions)
+    {
+        SkinResourceVector skins;
+        if (symbol)
+            library->getSkins(symbol, skins, readOptions);
+        else
+            library->getSkins(skins, readOptions);
+
+        SkinResourceVector members;
+        std::vector<osg::ref_ptr<osg::Image> > images;
+        unsigned width = 0u, height = 0u, maxSpan = ~0u;
+
+        for (auto& skin : skins)
+        {
+            if (members.size() >= MAX_SKIN_ARRAY_LAYERS)
+            {
+                OE_INFO << "[ResourceCache] Skin array for library \"" << library->getName()
+                    << "\" is full; remaining skins will use their own state" << std::endl;
+                break;
+            }
+
+            if (!canShareArray(skin.get()))
+                continue;
+
+            osg::ref_ptr<osg::Image> image = skin->createImage(readOptions);
+            if (!image.valid() ||
+                image->r() > 1 ||
+                ImageUtils::isCompressed(image.get()) ||
+                ImageUtils::hasTransparency(image.get()))
+            {
+                continue;
+            }
+
+            // private copy, so we can safely resize and mipmap it
+            image = ImageUtils::convertToRGBA8(image.get());
+            if (!image.valid())
+                continue;
+
+            width = osg::maximum(width, (unsigned)image->s());
+            height = osg::maximum(height, (unsigned)image->t());
+            maxSpan = osg::minimum(maxSpan, skin->maxTextureSpan().get());
+
+            members.push_back(skin);
+            images.push_back(image);
+        }
+
+        if (members.size() < 2u)
+            return 0L;
+
+        width = osg::minimum(width, maxSpan);
+        height = osg::minimum(height, maxSpan);
+
+        osg::Texture2DArray* tex = new osg::Texture2DArray();
+        tex->setTextureSize(width, height, members.size());
+        tex->setInternalFormat(GL_RGBA8);
+        tex->setSourceFormat(GL_RGBA);
+        tex->setSourceType(GL_UNSIGNED_BYTE);
+
+        SkinArray* result = new SkinArray();
+
+        for (unsigned i = 0; i < members.size(); ++i)
+        {
+            osg::ref_ptr<osg::Image> image = images[i].get();
+            if (image->s() != (int)width || image->t() != (int)height)
+            {
+                osg::ref_ptr<osg::Image> resized;
+                if (ImageUtils::resizeImage(image.get(), width, height, resized))
+                    image = resized.get();
+            }
+            ImageUtils::generateMipmaps(image.get());
+
+            tex->setImage(i, image.get());
+            result->layers[members[i]->getUniqueID()] = i;
+        }
+
+        // each layer repeats on its own, so tiled skins still work
+        tex->setWrap(osg::Texture::WRAP_S, osg::Texture::REPEAT);
+        tex->setWrap(osg::Texture::WRAP_T, osg::Texture::REPEAT);
+        tex->setFilter(osg::Texture::MIN_FILTER, osg::Texture::LINEAR_MIPMAP_LINEAR);
+        tex->setFilter(osg::Texture::MAG_FILTER, osg::Texture::LINEAR);
+        tex->setUnRefImageDataAfterApply(false);
+        tex->setResizeNonPowerOfTwoHint(false);
+
+        result->stateSet = new osg::StateSet();
+        result->stateSet->setTextureAttributeAndModes(0, tex, osg::StateAttribute::ON);
+
+        OE_INFO << "[ResourceCache] Merged " << members.size() << " skins from library \""
+            << library->getName() << "\" into a " << width << "x" << height << " texture array" << std::endl;
+
+        return result;
+    }
+}
+
 
 // internal thread-safety not required since we mutex it in this object.
 ResourceCache::ResourceCache() :
@@ -102,6 +311,50 @@ ResourceCache::getOrCreateStateSet(SkinResource*                skin,
 }
 
 
+bool
+ResourceCache::getOrCreateSkinArray(ResourceLibrary*           library,
+                                    const SkinSymbol*          symbol,
+                                    osg::ref_ptr<SkinArray>&   output,
+                                    const osgDB::Options*      readOptions)
+{
+    output = 0L;
+    if ( !library )
+        return false;
+
+    std::string key = library->getName();
+    if ( symbol )
+        key += ":" + symbol->getConfig().toJSON(false);
+
+    Threading::ScopedMutexLock exclusive( _skinMutex );
+
+    auto i = _skinArrays.find(key);
+    if ( i != _skinArrays.end() )
+    {
+        output = i->second.get();
+    }
+    else
+    {
+        // remember failures too, so we don't reload the skins for every tile
+        output = createSkinArray(library, symbol, readOptions);
+        _skinArrays[key] = output.get();
+    }
+
+    return output.valid();
+}
+
+bool
+ResourceCache::getOrCreateStateSet(ResourceLibrary*             library,
+                                   osg::ref_ptr<osg::StateSet>& output,
+                                   const osgDB::Options*        readOptions)
+{
+    output = 0L;
+    osg::ref_ptr<SkinArray> skins;
+    if ( getOrCreateSkinArray(library, 0L, skins, readOptions) )
+        output = skins->stateSet.get();
+    return output.valid();
+}
+
+
 bool
 ResourceCache::getOrCreateInstanceNode(InstanceResource*        res,
                                        osg::ref_ptr<osg::Node>& output,
@@ -123,7 +376,7 @@ ResourceCache::getOrCreateInstanceNode(InstanceResource*        res,
         else
         {
             // still not there, make it.
-            output = res->createNode(readOptions);
+            output = getOrCreateSharedModel(key, res, readOptions);
             if ( output.valid() )
             {
                 _instanceCache.insert( key, output.get() );
@@ -146,8 +399,14 @@ ResourceCache::cloneOrCreateInstanceNode(InstanceResource*        res,
     {
         Threading::ScopedMutexLock exclusive( _instanceMutex );
 
-        // Deep copy everything except for images.  Some models may share imagery so we only want one copy of it at a time.
-        osg::CopyOp copyOp = osg::CopyOp::DEEP_COPY_ALL & ~osg::CopyOp::DEEP_COPY_IMAGES & ~osg::CopyOp::DEEP_COPY_TEXTURES;
+        // Deep copy the nodes and geometry, but share the state. It's already merged
+        // through the state set cache, and cloning it per tile defeats that.
+        osg::CopyOp copyOp = osg::CopyOp::DEEP_COPY_ALL
+            & ~osg::CopyOp::DEEP_COPY_IMAGES
+            & ~osg::CopyOp::DEEP_COPY_TEXTURES
+            & ~osg::CopyOp::DEEP_COPY_STATESETS
+            & ~osg::CopyOp::DEEP_COPY_STATEATTRIBUTES
+            & ~osg::CopyOp::DEEP_COPY_UNIFORMS;
 
         // double check to avoid race condition
         InstanceCache::Record rec;
@@ -158,7 +417,7 @@ ResourceCache::cloneOrCreateInstanceNode(InstanceResource*        res,
         else
         {
             // still not there, make it.
-            output = res->createNode(readOptions);
+            output = getOrCreateSharedModel(key, res, readOptions);
             if ( output.valid() )
             {
                 _instanceCache.insert( key, output.get() );
@@ -169,3 +428,79 @@ ResourceCache::cloneOrCreateInstanceNode(InstanceResource*        res,
 
     return output.valid();
 }
+
+osg::Node*
+ResourceCache::getOrCreateSharedModel(const std::string& key,
+                                      InstanceResource*  res,
+                                      const osgDB::Options* readOptions)
+{
+    SharedModels& shared = sharedModels();
+    {
+        Threading::ScopedMutexLock lock(shared._mutex);
+        auto i = shared._models.find(key);
+        osg::ref_ptr<osg::Node> node;
+        if (i != shared._models.end() && i->second._node.lock(node))
+        {
+            ++shared._shared;
+            shared._bytesSaved += i->second._bytes;
+            return node.release();
+        }
+    }
+
+    // Load without the lock so unrelated models load in parallel.
+    osg::ref_ptr<osg::Node> node = res->createNode(readOptions);
+    if (!node.valid())
+        return 0L;
+
+    // Merge the model's state with everything else in the process.
+    Registry::stateSetCache()->optimize(node.get());
+
+    ModelSizeVisitor size;
+    node->accept(size);
+
+    Threading::ScopedMutexLock lock(shared._mutex);
+
+    // Another cache may have loaded it in the meantime; use theirs.
+    SharedModels::Entry& entry = shared._models[key];
+    osg::ref_ptr<osg::Node> existing;
+    if (entry._node.lock(existing))
+    {
+        ++shared._shared;
+        shared._bytesSaved += entry._bytes;
+        return existing.release();
+    }
+
+    entry._node = node.get();
+    entry._bytes = size._bytes;
+    ++shared._loads;
+
+    // forget models that have gone away
+    for (auto i = shared._models.begin(); i != shared._models.end(); )
+    {
+        if (!i->second._node.valid())
+            i = shared._models.erase(i);
+        else
+            ++i;
+    }
+
+    return node.release();
+}
+
+ResourceCache::SharedModelStats
+ResourceCache::getSharedModelStats()
+{
+    SharedModels& shared = sharedModels();
+    Threading::ScopedMutexLock lock(shared._mutex);
+
+    SharedModelStats stats;
+    stats.numModels = 0u;
+    for (auto& i : shared._models)
+    {
+        if (i.second._node.valid())
+            ++stats.numModels;
+    }
+    stats.numLoads = shared._loads;
+    stats.numShared = shared._shared;
+    stats.bytesSaved = shared._bytesSaved;
+    return stats;
+}
@@ -164,12 +164,11 @@ ResourceLibrary::initialize( const osgDB::Options* dbOptions )
             if ( _uri.isSet() )
             {
                 OE_INFO << LC << "Loading library from " << _uri->full() << std::endl;
-                osg::ref_ptr<XmlDocument> xml = XmlDocument::load( *_uri, dbOptions );
-                if ( xml.valid() )
+                Config conf;
+                if ( XmlDocument::readConfig( *_uri, dbOptions, conf ) )
                 {
                     ok = true;
 
-                    Config conf = xml->getConfig();
                     if ( conf.key() == "resources" )
                     {
                         mergeConfig( conf );
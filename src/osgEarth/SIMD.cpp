@@ -0,0 +1,199 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2020 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#include <osgEarth/SIMD>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(_MSC_VER) && defined(OE_SIMD_SSE2)
+    #include <intrin.h>
+#endif
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+namespace
+{
+    // NEON is the ARM counterpart of SSE2, so they share a rank and a
+    // cap of "sse2" or "neon" means the same thing on either family.
+    int rank(SIMD::Level level)
+    {
+        switch (level)
+        {
+        case SIMD::SSE2:   return 1;
+        case SIMD::AVX2:   return 2;
+        case SIMD::AVX512: return 3;
+        case SIMD::NEON:   return 1;
+        default:           return 0;
+        }
+    }
+
+#if defined(_MSC_VER) && defined(OE_SIMD_SSE2)
+    // The CPU has to support the instructions and the OS has to save the
+    // wider registers on context switches (XGETBV reports the latter).
+    bool msvcSupports(SIMD::Level level)
+    {
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7)
+            return false;
+
+        __cpuid(info, 1);
+        bool osxsave = (info[2] & (1 << 27)) != 0;
+        if (!osxsave)
+            return false;
+
+        unsigned long long xcr0 = _xgetbv(0);
+
+        __cpuidex(info, 7, 0);
+        if (level == SIMD::AVX2)
+            return (info[1] & (1 << 5)) != 0 && (xcr0 & 0x6) == 0x6;
+        if (level == SIMD::AVX512)
+            return (info[1] & (1 << 16)) != 0 && (xcr0 & 0xE6) == 0xE6;
+        return false;
+    }
+#endif
+
+    bool supports(SIMD::Level level)
+    {
+        switch (level)
+        {
+        case SIMD::SCALAR:
+            return true;
+
+        case SIMD::SSE2:
+#ifdef OE_SIMD_SSE2
+            return true;
+#else
+            return false;
+#endif
+
+        case SIMD::AVX2:
+#if defined(OE_SIMD_AVX2) && defined(_MSC_VER)
+            return msvcSupports(SIMD::AVX2);
+#elif defined(OE_SIMD_AVX2)
+            return __builtin_cpu_supports("avx2") != 0;
+#else
+            return false;
+#endif
+
+        case SIMD::AVX512:
+#if defined(OE_SIMD_AVX512) && defined(_MSC_VER)
+            return msvcSupports(SIMD::AVX512);
+#elif defined(OE_SIMD_AVX512)
+            return __builtin_cpu_supports("avx512f") != 0;
+#else
+            return false;
+#endif
+
+        case SIMD::NEON:
+#ifdef OE_SIMD_NEON
+            return true;
+#else
+            return false;
+#endif
+        }
+        return false;
+    }
+
+    struct Detected
+    {
+        bool _supported[SIMD::NEON + 1];
+        SIMD::Level _best;
+
+        Detected() : _best(SIMD::SCALAR)
+        {
+            for (int i = SIMD::SCALAR; i <= SIMD::NEON; ++i)
+            {
+                _supported[i] = supports((SIMD::Level)i);
+                if (_supported[i] && rank((SIMD::Level)i) > rank(_best))
+                    _best = (SIMD::Level)i;
+            }
+        }
+    };
+
+    const Detected& detected()
+    {
+        static Detected s_detected;
+        return s_detected;
+    }
+
+    int envCap()
+    {
+        const char* value = ::getenv("OSGEARTH_SIMD");
+        if (value == 0L)
+            return rank(SIMD::AVX512);
+        if (::strcmp(value, "scalar") == 0) return rank(SIMD::SCALAR);
+        if (::strcmp(value, "sse2") == 0) return rank(SIMD::SSE2);
+        if (::strcmp(value, "neon") == 0) return rank(SIMD::NEON);
+        if (::strcmp(value, "avx2") == 0) return rank(SIMD::AVX2);
+        return rank(SIMD::AVX512);
+    }
+
+    std::atomic<int> s_cap(envCap());
+}
+
+SIMD::Level
+SIMD::getDetectedLevel()
+{
+    return detected()._best;
+}
+
+SIMD::Level
+SIMD::getLevel()
+{
+    const Detected& d = detected();
+    for (int r = s_cap; r > 0; --r)
+    {
+        for (int i = SIMD::SSE2; i <= SIMD::NEON; ++i)
+        {
+            if (d._supported[i] && rank((Level)i) == r)
+                return (Level)i;
+        }
+    }
+    return SCALAR;
+}
+
+void
+SIMD::setLevel(Level value)
+{
+    s_cap = rank(value);
+}
+
+bool
+SIMD::isEnabled(Level level)
+{
+    return detected()._supported[level] && rank(level) <= s_cap;
+}
+
+const char*
+SIMD::getName(Level level)
+{
+    switch (level)
+    {
+    case SSE2:   return "sse2";
+    case AVX2:   return "avx2";
+    case AVX512: return "avx512";
+    case NEON:   return "neon";
+    default:     return "scalar";
+    }
+}
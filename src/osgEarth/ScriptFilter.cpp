@@ -86,10 +86,22 @@ ScriptFilter::push( FeatureList& input, FilterContext& context )
         return context;
     }
 
-    bool ok = true;
+    // drop features without geometry, then run the whole list in one batch
     for( FeatureList::iterator i = input.begin(); i != input.end(); )
     {
-        if ( push( i->get(), context ) )
+        if ( i->valid() && i->get()->getGeometry() )
+            ++i;
+        else
+            i = input.erase(i);
+    }
+
+    std::vector<ScriptResult> results;
+    _engine->run(_expression.get(), input, results, &context);
+
+    std::vector<ScriptResult>::const_iterator r = results.begin();
+    for( FeatureList::iterator i = input.begin(); i != input.end(); )
+    {
+        if ( r != results.end() && (r++)->asBool() )
         {
             ++i;
         }
@@ -21,6 +21,7 @@
 #include <osgEarth/ShaderLoader>
 #include <osgEarth/Registry>
 #include <osgEarth/Capabilities>
+#include <osgEarth/StringUtils>
 
 #define LC "[ShaderFactory] "
 
@@ -41,9 +42,15 @@ using namespace osgEarth::ShaderComp;
 using namespace osgEarth::Util;
 
 
-ShaderFactory::ShaderFactory()
+ShaderFactory::ShaderFactory() :
+    _maxFeatureVariants(4u),
+    _featureMutex(OE_MUTEX_NAME)
 {
     _fragStageOrder = FRAGMENT_STAGE_ORDER_COLORING_LIGHTING;
+
+    const char* value = ::getenv("OSGEARTH_MAX_SHADER_VARIANTS");
+    if (value)
+        _maxFeatureVariants = as<unsigned>(value, _maxFeatureVariants);
 }
 
 
@@ -1064,3 +1071,48 @@ ShaderFactory::createRangeUniform() const
 {
     return new osg::Uniform(osg::Uniform::FLOAT, getRangeUniformName());
 }
+
+void
+ShaderFactory::setFeature(osg::StateSet*     stateSet,
+                          const std::string& defineName,
+                          const std::string& uniformName,
+                          int                value)
+{
+    if (!stateSet)
+        return;
+
+    stateSet->getOrCreateUniform(uniformName, osg::Uniform::INT)->set(value);
+
+    std::string valueStr = Stringify() << value;
+
+    // Skip the lookup when nothing changed (callers may set it every frame)
+    const osg::StateSet::DefinePair* current = stateSet->getDefinePair(defineName);
+    if (current && current->first == valueStr && (current->second & osg::StateAttribute::ON))
+        return;
+
+    bool specialize;
+    {
+        Threading::ScopedMutexLock lock(_featureMutex);
+        std::set<int>& variants = _featureVariants[defineName];
+        specialize =
+            variants.find(value) != variants.end() ||
+            variants.size() < _maxFeatureVariants;
+        if (specialize)
+            variants.insert(value);
+    }
+
+    if (specialize)
+    {
+        stateSet->setDefine(defineName, valueStr, osg::StateAttribute::ON);
+    }
+    else
+    {
+        // out of budget: fall back on the generic variant
+        if (!current || (current->second & osg::StateAttribute::ON))
+        {
+            OE_DEBUG << LC << "Variant budget spent for " << defineName
+                << "; value " << value << " uses the uniform" << std::endl;
+        }
+        stateSet->setDefine(defineName, osg::StateAttribute::OFF);
+    }
+}
@@ -45,6 +45,8 @@
 #include <osgSim/LightPointNode>
 
 #include <osg/ValueObject>
+#include <osg/Timer>
+#include <functional>
 
 #define LC "[ShaderGenerator] "
 
@@ -295,6 +297,59 @@ namespace
         }
     };
 
+    inline void hashCombine(std::size_t& seed, std::size_t value)
+    {
+        seed ^= value + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+    }
+
+    void hashAttributes(std::size_t& seed, const osg::StateSet::AttributeList& attrs)
+    {
+        for (osg::StateSet::AttributeList::const_iterator i = attrs.begin(); i != attrs.end(); ++i)
+        {
+            const osg::StateAttribute* a = i->second.first.get();
+            hashCombine(seed, a ? std::hash<std::string>()(a->className()) : 0u);
+            hashCombine(seed, a ? a->getMember() : 0u);
+            hashCombine(seed, i->second.second);
+
+            const osg::TexGen* texgen = dynamic_cast<const osg::TexGen*>(a);
+            if (texgen)
+                hashCombine(seed, texgen->getMode());
+
+            const osg::TexEnv* texenv = dynamic_cast<const osg::TexEnv*>(a);
+            if (texenv)
+                hashCombine(seed, texenv->getMode());
+        }
+    }
+
+    // Structural signature of a stateset: the kinds of attributes it holds
+    // and the layout of its texture units, which decide what code the
+    // generator writes. Equal statesets always have equal signatures.
+    std::size_t getSignature(const osg::StateSet* ss)
+    {
+        std::size_t seed = 0u;
+        if (ss)
+        {
+            hashAttributes(seed, ss->getAttributeList());
+
+            const osg::StateSet::ModeList& modes = ss->getModeList();
+            for (osg::StateSet::ModeList::const_iterator i = modes.begin(); i != modes.end(); ++i)
+            {
+                hashCombine(seed, i->first);
+                hashCombine(seed, i->second);
+            }
+
+            const osg::StateSet::TextureAttributeList& texAttrs = ss->getTextureAttributeList();
+            for (unsigned unit = 0; unit < texAttrs.size(); ++unit)
+            {
+                hashCombine(seed, unit);
+                hashAttributes(seed, texAttrs[unit]);
+            }
+
+            hashCombine(seed, ss->getUniformList().size());
+        }
+        return seed;
+    }
+
     // if the node has a stateset, clone it and replace it with the clone.
     // otherwise, just create a new stateset on the node.
     osg::StateSet* cloneOrCreateStateSet(osg::Node* node)
@@ -407,9 +462,19 @@ ShaderGenerator::run(osg::Node*         graph,
 {
     if ( graph )
     {
+        _stats = Stats();
+
         // generate shaders:
         graph->accept( *this );
 
+        // the cache only holds for one graph, whose state we've seen
+        _cache.clear();
+
+        OE_DEBUG << LC << vpName << ": generated " << _stats._generated
+            << " statesets in " << _stats._generateTime << " ms; "
+            << _stats._cacheHits << " cache hits saved about "
+            << _stats._timeSaved << " ms" << std::endl;
+
         // perform GL state sharing
         optimizeStateSharing( graph, cache );
 
@@ -438,7 +503,7 @@ ShaderGenerator::run(osg::StateSet* ss)
 
     _state->pushStateSet(ss);
     osg::ref_ptr<osg::StateSet> replacement;
-    processGeometry(ss, replacement);
+    processGeometryCached(ss, replacement);
     _state->popStateSet();
     return replacement;
 }
@@ -546,7 +611,7 @@ ShaderGenerator::apply( osg::Geode& node )
         if (numInheritingGeometry == numDrawables )
         {
             osg::ref_ptr<osg::StateSet> replacement;
-            if ( processGeometry(stateset.get(), replacement) )
+            if ( processGeometryCached(stateset.get(), replacement) )
             {
                 node.setStateSet(replacement.get() );
                 traverseDrawables = false;
@@ -628,7 +693,7 @@ ShaderGenerator::apply( osg::Drawable* drawable )
                 geom->setUseDisplayList(false);
             }
 
-            if ( processGeometry(ss.get(), replacement) )
+            if ( processGeometryCached(ss.get(), replacement) )
             {
                 drawable->setStateSet(replacement.get());
             }
@@ -732,7 +797,7 @@ ShaderGenerator::apply(osgSim::LightPointNode& node)
         _state->pushStateSet( stateset.get() );
 
         osg::ref_ptr<osg::StateSet> replacement;
-        if ( processGeometry(stateset.get(), replacement) )
+        if ( processGeometryCached(stateset.get(), replacement) )
         {
             // remove the temporary sprite.
             replacement->removeTextureAttribute(0, sprite.get());
@@ -811,6 +876,56 @@ ShaderGenerator::processText(const osg::StateSet* ss, osg::ref_ptr<osg::StateSet
 }
 
 
+bool
+ShaderGenerator::processGeometryCached(const osg::StateSet*         original,
+                                       osg::ref_ptr<osg::StateSet>& replacement)
+{
+    if ( !_active )
+        return false;
+
+    osg::ref_ptr<osg::StateSet> current = static_cast<StateEx*>(_state.get())->capture();
+
+    std::size_t signature = getSignature(original);
+    hashCombine(signature, getSignature(current.get()));
+
+    std::pair<Cache::iterator, Cache::iterator> range = _cache.equal_range(signature);
+    for (Cache::iterator i = range.first; i != range.second; ++i)
+    {
+        const CacheEntry& entry = i->second;
+        if ((original == 0L) == (entry._original.valid() == false) &&
+            (original == 0L || original->compare(*entry._original.get(), true) == 0) &&
+            current->compare(*entry._current.get(), true) == 0)
+        {
+            // Same input, same output. Copy it so the caller still gets a
+            // stateset of its own.
+            if (entry._replacement.valid())
+                replacement = osg::clone(entry._replacement.get(), osg::CopyOp::SHALLOW_COPY);
+
+            _stats._cacheHits++;
+            _stats._timeSaved += _stats._generateTime / (double)_stats._generated;
+            return entry._result;
+        }
+    }
+
+    osg::Timer_t start = osg::Timer::instance()->tick();
+    bool result = processGeometry(original, replacement);
+    _stats._generateTime += osg::Timer::instance()->delta_m(start, osg::Timer::instance()->tick());
+    _stats._generated++;
+
+    // Keep copies; the caller may still change the original and the
+    // replacement (see disableUnsupportedAttributes)
+    CacheEntry entry;
+    if (original)
+        entry._original = osg::clone(original, osg::CopyOp::SHALLOW_COPY);
+    entry._current = current.get();
+    if (result && replacement.valid())
+        entry._replacement = osg::clone(replacement.get(), osg::CopyOp::SHALLOW_COPY);
+    entry._result = result;
+    _cache.insert(std::make_pair(signature, entry));
+
+    return result;
+}
+
 bool
 ShaderGenerator::processGeometry(const osg::StateSet*         original,
                                  osg::ref_ptr<osg::StateSet>& replacement)
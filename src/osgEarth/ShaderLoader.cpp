@@ -206,6 +206,41 @@ while (true)
     osgEarth::replaceIn(output, statement, newStatement);
 }
 
+// Process any "#pragma vp_feature" statements. A feature reads as a macro
+// that is either a compile-time #define (see ShaderFactory::setFeature)
+// or, in the generic variant, an int uniform.
+while (true)
+{
+    const std::string token("#pragma vp_feature");
+    std::string::size_type statementPos = output.find(token);
+    if (statementPos == std::string::npos)
+        break;
+
+    std::string::size_type endPos = output.find('\n', statementPos);
+    if (endPos == std::string::npos)
+        endPos = output.length();
+
+    std::string statement(output.substr(statementPos, endPos - statementPos));
+
+    std::vector<std::string> tokens;
+    StringTokenizer(output.substr(statementPos + token.length(), endPos - statementPos - token.length()), tokens, " \t\r", "", false, true);
+    if (tokens.size() < 2)
+    {
+        OE_WARN << LC << "Usage: #pragma vp_feature DEFINE uniformName (in " << filename << ")" << std::endl;
+        osgEarth::replaceIn(output, statement, "");
+        continue;
+    }
+
+    std::string newStatement = Stringify()
+        << "#pragma import_defines(" << tokens[0] << ")\n"
+        << "#ifndef " << tokens[0] << "\n"
+        << "uniform int " << tokens[1] << ";\n"
+        << "#define " << tokens[0] << " " << tokens[1] << "\n"
+        << "#endif";
+
+    osgEarth::replaceIn(output, statement, newStatement);
+}
+
 // Process any replacements.
 for (ShaderPackage::ReplaceMap::const_iterator i = package._replaces.begin();
     i != package._replaces.end();
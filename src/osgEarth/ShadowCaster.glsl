@@ -6,17 +6,26 @@ $GLSL_DEFAULT_PRECISION_FLOAT
 #pragma vp_location   vertex_view
 #pragma vp_order      last
 
+#pragma import_defines(OE_SHADOW_DYNAMIC)
 
 uniform mat4 oe_shadow_matrix[$OE_SHADOW_NUM_SLICES];
 
 out vec4 oe_shadow_coord[$OE_SHADOW_NUM_SLICES];
 
+#ifdef OE_SHADOW_DYNAMIC
+uniform mat4 oe_shadow_dynamic_matrix;
+out vec4 oe_shadow_dynamic_coord;
+#endif
+
 void oe_shadow_vertex(inout vec4 VertexVIEW)
 {
     for(int i=0; i < $OE_SHADOW_NUM_SLICES; ++i)
     {
         oe_shadow_coord[i] = oe_shadow_matrix[i] * VertexVIEW;
     }
+#ifdef OE_SHADOW_DYNAMIC
+    oe_shadow_dynamic_coord = oe_shadow_dynamic_matrix * VertexVIEW;
+#endif
 }
 
 
@@ -30,7 +39,7 @@ $GLSL_DEFAULT_PRECISION_FLOAT
 #pragma vp_location   fragment_lighting
 #pragma vp_order      0.9
 
-#pragma import_defines(OE_LIGHTING, OE_NUM_LIGHTS)
+#pragma import_defines(OE_LIGHTING, OE_NUM_LIGHTS, OE_SHADOW_DYNAMIC)
 
 uniform sampler2DArray oe_shadow_map;
 uniform float          oe_shadow_color;
@@ -39,6 +48,11 @@ uniform float          oe_shadow_blur;
 in vec3 vp_Normal; // stage global
 in vec4 oe_shadow_coord[$OE_SHADOW_NUM_SLICES];
 
+#ifdef OE_SHADOW_DYNAMIC
+uniform sampler2D oe_shadow_dynamic_map;
+in vec4 oe_shadow_dynamic_coord;
+#endif
+
 // Parameters of each light:
 struct osg_LightSourceParameters 
 {   
@@ -98,6 +112,26 @@ float oe_shadow_multisample(in vec3 c, in float refvalue, in float blur)
     return 1.0-(shadowed/OE_SHADOW_NUM_SAMPLES);
 }
 
+#ifdef OE_SHADOW_DYNAMIC
+// slow PCF sampling of the dynamic overlay.
+float oe_shadow_dynamic_multisample(in vec2 c, in float refvalue, in float blur)
+{
+    float shadowed = 0.0;
+    float randomAngle = 6.283185 * oe_shadow_rand(c.xy);
+    for(int i=0; i<OE_SHADOW_NUM_SAMPLES; ++i)
+    {
+        vec2 off = oe_shadow_rot(oe_shadow_samples[i], randomAngle);
+        float depth = texture(oe_shadow_dynamic_map, c + off*blur).r;
+
+        if (depth < 1.0 && depth < refvalue )
+        {
+           shadowed += 1.0;
+        }
+    }
+    return 1.0-(shadowed/OE_SHADOW_NUM_SAMPLES);
+}
+#endif
+
 void oe_shadow_fragment(inout vec4 color)
 {
     float alpha = color.a;
@@ -133,6 +167,24 @@ void oe_shadow_fragment(inout vec4 color)
         }
     }
 
+#ifdef OE_SHADOW_DYNAMIC
+    // moving casters, rendered apart from the cached static maps:
+    if ( factor > 0.0 )
+    {
+        vec4 c = oe_shadow_dynamic_coord;
+        if ( oe_shadow_blur > 0.0 )
+        {
+            factor = min(factor, oe_shadow_dynamic_multisample(c.xy, c.z-bias, oe_shadow_blur));
+        }
+        else
+        {
+            depth = texture(oe_shadow_dynamic_map, c.xy).r;
+            if ( depth < 1.0 && depth < c.z-bias )
+                factor = 0.0;
+        }
+    }
+#endif
+
     vec3 colorInFullShadow = color.rgb * oe_shadow_color;
     color = vec4( mix(colorInFullShadow, color.rgb, factor), alpha );
 
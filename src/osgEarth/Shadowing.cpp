@@ -25,6 +25,7 @@
 #include <osgEarth/Registry>
 #include <osgEarth/Capabilities>
 #include <osgEarth/CameraUtils>
+#include <osgEarth/FrameGovernor>
 #include <osg/CullFace>
 #include <osgShadow/ConvexPolyhedron>
 
@@ -53,9 +54,17 @@ _size         ( 2048 ),
 _texImageUnit ( 7 ),
 _blurFactor   ( 0.001f ),
 _color        ( 0.4f ),
-_traversalMask( ~0 )
+_traversalMask( ~0 ),
+_framesSinceRender( 0u ),
+_cacheStatic  ( false ),
+_staticRefreshAngle( 0.1f ),
+_staticPadding( 0.25f ),
+_dynamicSize  ( 1024 ),
+_dynamicTexImageUnit( 8 ),
+_dynamicActive( false )
 {
     _castingGroup = new osg::Group();
+    _dynamicCastingGroup = new osg::Group();
 
     _supported = Registry::capabilities().supportsGLSL();
     if ( _supported )
@@ -95,6 +104,27 @@ ShadowCaster::setTextureSize(unsigned size)
     reinitialize();
 }
 
+void
+ShadowCaster::setDynamicTextureImageUnit(int unit)
+{
+    _dynamicTexImageUnit = unit;
+    reinitialize();
+}
+
+void
+ShadowCaster::setDynamicTextureSize(unsigned size)
+{
+    _dynamicSize = size;
+    reinitialize();
+}
+
+void
+ShadowCaster::setCacheStaticShadows(bool value)
+{
+    _cacheStatic = value;
+    dirtyStaticShadows();
+}
+
 void
 ShadowCaster::setBlurFactor(float value)
 {
@@ -119,6 +149,10 @@ ShadowCaster::reinitialize()
 
     _shadowmap = 0L;
     _rttCameras.clear();
+    _lastVPS.clear(); // render the new maps on the next frame
+    _dynamicShadowmap = 0L;
+    _dynamicRttCamera = 0L;
+    _dynamicActive = false;
 
     int numSlices = (int)_ranges.size() - 1;
     if ( numSlices < 1 )
@@ -155,6 +189,30 @@ ShadowCaster::reinitialize()
         _rttCameras.push_back(rtt);
     }
 
+    // the dynamic overlay: a single map, covering the first slice, for the
+    // casters that move.
+    _dynamicShadowmap = new osg::Texture2D();
+    _dynamicShadowmap->setTextureSize( _dynamicSize, _dynamicSize );
+    _dynamicShadowmap->setInternalFormat( GL_DEPTH_COMPONENT );
+    _dynamicShadowmap->setFilter( osg::Texture::MIN_FILTER, osg::Texture::LINEAR );
+    _dynamicShadowmap->setFilter( osg::Texture::MAG_FILTER, osg::Texture::LINEAR );
+    _dynamicShadowmap->setWrap( osg::Texture::WRAP_S, osg::Texture::CLAMP_TO_BORDER );
+    _dynamicShadowmap->setWrap( osg::Texture::WRAP_T, osg::Texture::CLAMP_TO_BORDER );
+    _dynamicShadowmap->setBorderColor(osg::Vec4(1,1,1,1));
+
+    _dynamicRttCamera = new osg::Camera();
+    Shadowing::setIsShadowCamera(_dynamicRttCamera.get());
+    _dynamicRttCamera->setReferenceFrame( osg::Camera::ABSOLUTE_RF_INHERIT_VIEWPOINT );
+    _dynamicRttCamera->setClearDepth( 1.0 );
+    _dynamicRttCamera->setClearMask( GL_DEPTH_BUFFER_BIT );
+    _dynamicRttCamera->setComputeNearFarMode( osg::CullSettings::DO_NOT_COMPUTE_NEAR_FAR );
+    _dynamicRttCamera->setViewport( 0, 0, _dynamicSize, _dynamicSize );
+    _dynamicRttCamera->setRenderOrder( osg::Camera::PRE_RENDER );
+    _dynamicRttCamera->setRenderTargetImplementation( osg::Camera::FRAME_BUFFER_OBJECT );
+    _dynamicRttCamera->setImplicitBufferAttachmentMask(0, 0);
+    _dynamicRttCamera->attach( osg::Camera::DEPTH_BUFFER, _dynamicShadowmap.get() );
+    _dynamicRttCamera->addChild( _dynamicCastingGroup.get() );
+
     _rttStateSet = new osg::StateSet();
 
     // only draw back faces to the shadow depth map
@@ -191,6 +249,14 @@ ShadowCaster::reinitialize()
     _renderStateSet->setTextureAttribute(_texImageUnit, _shadowmap.get(), osg::StateAttribute::ON );
     _renderStateSet->addUniform( new osg::Uniform("oe_shadow_map", _texImageUnit) );
 
+    // the dynamic overlay; its define goes on once there are dynamic casters.
+    _dynamicShadowMapTexGenUniform = _renderStateSet->getOrCreateUniform(
+        "oe_shadow_dynamic_matrix",
+        osg::Uniform::FLOAT_MAT4 );
+
+    _renderStateSet->setTextureAttribute(_dynamicTexImageUnit, _dynamicShadowmap.get(), osg::StateAttribute::ON );
+    _renderStateSet->addUniform( new osg::Uniform("oe_shadow_dynamic_map", _dynamicTexImageUnit) );
+
     // blur factor:
     _shadowBlurUniform = _renderStateSet->getOrCreateUniform("oe_shadow_blur", osg::Uniform::FLOAT);
     _shadowBlurUniform->set(_blurFactor);
@@ -208,6 +274,10 @@ ShadowCaster::resizeGLObjectBuffers(unsigned maxSize)
         _light->resizeGLObjectBuffers(maxSize);
     if (_shadowmap.valid())
         _shadowmap->resizeGLObjectBuffers(maxSize);
+    if (_dynamicShadowmap.valid())
+        _dynamicShadowmap->resizeGLObjectBuffers(maxSize);
+    if (_dynamicRttCamera.valid())
+        _dynamicRttCamera->resizeGLObjectBuffers(maxSize);
     if (_rttStateSet.valid())
         _rttStateSet->resizeGLObjectBuffers(maxSize);
     if (_renderStateSet.valid())
@@ -223,6 +293,10 @@ ShadowCaster::releaseGLObjects(osg::State* state) const
         _light->releaseGLObjects(state);
     if (_shadowmap.valid())
         _shadowmap->releaseGLObjects(state);
+    if (_dynamicShadowmap.valid())
+        _dynamicShadowmap->releaseGLObjects(state);
+    if (_dynamicRttCamera.valid())
+        _dynamicRttCamera->releaseGLObjects(state);
     if (_rttStateSet.valid())
         _rttStateSet->releaseGLObjects(state);
     if (_renderStateSet.valid())
@@ -231,6 +305,38 @@ ShadowCaster::releaseGLObjects(osg::State* state) const
         _rttCameras[i]->releaseGLObjects(state);
 }
 
+osg::BoundingBoxd
+ShadowCaster::getSliceBounds(int slice, const osg::Matrix& MV, const osg::Matrix& lightViewMat) const
+{
+    double n = _ranges[slice];
+    double f = _ranges[slice+1];
+
+    // take the camera's projection matrix and clamp it's near and far planes
+    // to our shadow map slice range.
+    osg::Matrix proj = _prevProjMatrix;
+    double fovy,ar,zn,zf;
+    proj.getPerspective(fovy,ar,zn,zf);
+    proj.makePerspective(fovy,ar,osg::maximum(n,zn),osg::minimum(f,zf));
+
+    // extract the corner points of the camera frustum in world space.
+    osg::Matrix MVP = MV * proj;
+    osg::Matrix inverseMVP;
+    inverseMVP.invert(MVP);
+    osgShadow::ConvexPolyhedron frustumPH;
+    frustumPH.setToUnitFrustum(true, true);
+    frustumPH.transform( inverseMVP, MVP );
+    std::vector<osg::Vec3d> verts;
+    frustumPH.getPoints( verts );
+
+    // project those on to the plane of the light camera and fit them
+    // to a bounding box. That box will form the extent of our orthographic camera.
+    osg::BoundingBoxd bbox;
+    for( std::vector<osg::Vec3d>::iterator v = verts.begin(); v != verts.end(); ++v )
+        bbox.expandBy( (*v) * lightViewMat );
+
+    return bbox;
+}
+
 void
 ShadowCaster::traverse(osg::NodeVisitor& nv)
 {
@@ -267,78 +373,152 @@ ShadowCaster::traverse(osg::NodeVisitor& nv)
             lightUp.normalize();
             lightViewMat.makeLookAt(lightPosWorld, lightPosWorld+lightVectorWorld, lightUp);
 
+            // Under load the frame governor re-renders the shadow maps only
+            // every few frames. In between, receivers keep sampling the last
+            // maps through the light transforms they were rendered with.
+            float scale = FrameGovernor::getScale(FrameGovernor::SHADOWS);
+            unsigned interval = (unsigned)osg::round(1.0f / scale);
+            unsigned numSlices = _ranges.size() > 0 ? _ranges.size()-1 : 0;
+            bool render =
+                ++_framesSinceRender >= interval ||
+                _lastVPS.size() != numSlices;
+
+            int i;
+            std::vector<osg::BoundingBoxd> bounds(numSlices);
+
+            // Cached static maps stay valid until the light turns past the
+            // refresh angle or the view slices leave the padded areas they
+            // were rendered for.
+            bool renderStatic = render;
+            if ( render && _cacheStatic && _lastVPS.size() == numSlices )
+            {
+                double cosAngle = lightVectorWorld * _staticLightVector;
+                renderStatic = cosAngle < cos(osg::DegreesToRadians((double)_staticRefreshAngle));
+
+                for(i=0; !renderStatic && i < (int)numSlices; ++i)
+                {
+                    bounds[i] = getSliceBounds(i, MV, _staticLightViewMat);
+                    renderStatic =
+                        !_staticBounds[i].contains(bounds[i]._min) ||
+                        !_staticBounds[i].contains(bounds[i]._max);
+                }
+
+                if ( !renderStatic )
+                    lightViewMat = _staticLightViewMat;
+            }
+
             // set the primary-camera-to-shadow-camera transformation matrix,
             // which lets you perform vertex shader operations from the perspective
             // of the primary camera (morphing, etc.) so that things match up
             // between the two cameras.
             osg::Matrix lightViewMatInv = osg::Matrix::inverse(lightViewMat);
             _shadowToPrimaryMatrix->set( lightViewMatInv * MV);
-            
-            int i;
-            for(i=0; i < (int) _ranges.size()-1; ++i)
+
+            if ( renderStatic )
             {
-                double n = _ranges[i];
-                double f = _ranges[i+1];
-
-                // take the camera's projection matrix and clamp it's near and far planes
-                // to our shadow map slice range.
-                osg::Matrix proj = _prevProjMatrix;
-                double fovy,ar,zn,zf;
-                proj.getPerspective(fovy,ar,zn,zf);
-                proj.makePerspective(fovy,ar,osg::maximum(n,zn),osg::minimum(f,zf));
-                
-                // extract the corner points of the camera frustum in world space.
-                osg::Matrix MVP = MV * proj;
-                osg::Matrix inverseMVP;
-                inverseMVP.invert(MVP);
-                osgShadow::ConvexPolyhedron frustumPH;
-                frustumPH.setToUnitFrustum(true, true);
-                frustumPH.transform( inverseMVP, MVP );
-                std::vector<osg::Vec3d> verts;
-                frustumPH.getPoints( verts );
-
-                // project those on to the plane of the light camera and fit them
-                // to a bounding box. That box will form the extent of our orthographic camera.
-                osg::BoundingBoxd bbox;
-                for( std::vector<osg::Vec3d>::iterator v = verts.begin(); v != verts.end(); ++v )
-                    bbox.expandBy( (*v) * lightViewMat );
+                _framesSinceRender = 0u;
+                _lastVPS.resize(numSlices);
+                _staticBounds.resize(numSlices);
+                _staticLightVector = lightVectorWorld;
+                _staticLightViewMat = lightViewMat;
+            }
+            else
+            {
+                for(i=0; i < (int)numSlices; ++i)
+                    _shadowMapTexGenUniform->setElement(i, inverseMV * _lastVPS[i]);
+            }
+
+            // this xforms from clip [-1..1] to texture [0..1] space
+            static osg::Matrix s_scaleBiasMat = 
+                osg::Matrix::translate(1.0,1.0,1.0) * 
+                osg::Matrix::scale(0.5,0.5,0.5);
+
+            for(i=0; renderStatic && i < (int)numSlices; ++i)
+            {
+                osg::BoundingBoxd bbox = getSliceBounds(i, MV, lightViewMat);
+
+                // pad the cached maps so the view can move a while before
+                // it leaves them.
+                if ( _cacheStatic )
+                {
+                    osg::Vec3d pad = (bbox._max - bbox._min) * (double)_staticPadding;
+                    bbox._min -= pad;
+                    bbox._max += pad;
+                }
+                _staticBounds[i] = bbox;
 
                 osg::Matrix lightProjMat;
-                n = -osg::maximum(bbox.zMin(), bbox.zMax());
-                f = -osg::minimum(bbox.zMin(), bbox.zMax());
+                double n = -osg::maximum(bbox.zMin(), bbox.zMax());
+                double f = -osg::minimum(bbox.zMin(), bbox.zMax());
                 // TODO: consider extending "n" so that objects outside the main view can still cast shadows
                 lightProjMat.makeOrtho(bbox.xMin(), bbox.xMax(), bbox.yMin(), bbox.yMax(), n, f);
 
                 // configure the RTT camera for this slice:
                 _rttCameras[i]->setViewMatrix( lightViewMat );
                 _rttCameras[i]->setProjectionMatrix( lightProjMat );
-
-                // this xforms from clip [-1..1] to texture [0..1] space
-                static osg::Matrix s_scaleBiasMat = 
-                    osg::Matrix::translate(1.0,1.0,1.0) * 
-                    osg::Matrix::scale(0.5,0.5,0.5);
                 
                 // set the texture coordinate generation matrix that the shadow
                 // receiver will use to sample the shadow map. Doing this on the CPU
                 // prevents nasty precision issues!
                 osg::Matrix VPS = lightViewMat * lightProjMat * s_scaleBiasMat;
                 _shadowMapTexGenUniform->setElement(i, inverseMV * VPS);
+                _lastVPS[i] = VPS;
             }
 
-            // install the shadow-casting traversal mask:
-            unsigned saveMask = cv->getTraversalMask();
-            cv->setTraversalMask( _traversalMask & saveMask );
+            // The dynamic overlay re-renders whenever the governor allows,
+            // tightly fit to the first slice.
+            bool dynamicActive = _dynamicCastingGroup->getNumChildren() > 0 && numSlices > 0;
+            if ( dynamicActive != _dynamicActive )
+            {
+                if ( dynamicActive )
+                    _renderStateSet->setDefine("OE_SHADOW_DYNAMIC");
+                else
+                    _renderStateSet->removeDefine("OE_SHADOW_DYNAMIC");
+                _dynamicActive = dynamicActive;
+            }
+
+            bool renderDynamic = dynamicActive && render;
+            if ( renderDynamic )
+            {
+                osg::BoundingBoxd bbox = getSliceBounds(0, MV, lightViewMat);
+
+                osg::Matrix lightProjMat;
+                double n = -osg::maximum(bbox.zMin(), bbox.zMax());
+                double f = -osg::minimum(bbox.zMin(), bbox.zMax());
+                lightProjMat.makeOrtho(bbox.xMin(), bbox.xMax(), bbox.yMin(), bbox.yMax(), n, f);
+
+                _dynamicRttCamera->setViewMatrix( lightViewMat );
+                _dynamicRttCamera->setProjectionMatrix( lightProjMat );
 
-            // render the shadow maps.
-            cv->pushStateSet( _rttStateSet.get() );
-            for(i=0; i < (int) _rttCameras.size(); ++i)
+                _lastDynamicVPS = lightViewMat * lightProjMat * s_scaleBiasMat;
+                _framesSinceRender = 0u;
+            }
+            if ( dynamicActive )
             {
-                _rttCameras[i]->accept( nv );
+                _dynamicShadowMapTexGenUniform->set(inverseMV * _lastDynamicVPS);
             }
-            cv->popStateSet();
 
-            // restore the previous mask
-            cv->setTraversalMask( saveMask );
+            if ( renderStatic || renderDynamic )
+            {
+                // install the shadow-casting traversal mask:
+                unsigned saveMask = cv->getTraversalMask();
+                cv->setTraversalMask( _traversalMask & saveMask );
+
+                // render the shadow maps.
+                cv->pushStateSet( _rttStateSet.get() );
+                for(i=0; renderStatic && i < (int) _rttCameras.size(); ++i)
+                {
+                    _rttCameras[i]->accept( nv );
+                }
+                if ( renderDynamic )
+                {
+                    _dynamicRttCamera->accept( nv );
+                }
+                cv->popStateSet();
+
+                // restore the previous mask
+                cv->setTraversalMask( saveMask );
+            }
             
             // render the shadowed subgraph.
             cv->pushStateSet( _renderStateSet.get() );
@@ -2,6 +2,7 @@
 #include <osgEarth/TileKey>
 #include <osgEarth/Utils>
 #include <osgEarth/CullingUtils>
+#include <osgEarth/Registry>
 #include <osgDB/Registry>
 #include <osgDB/FileNameUtils>
 #include <osg/ShapeDrawable>
@@ -11,127 +12,148 @@ using namespace osgEarth::Util;
 
 #define LC "[SimplerPager] "
 
-namespace
+/**
+ * A tile in the pager's quadtree. Draws its own node, and once the camera
+ * is within range, the four child tiles that replace it (or in additive
+ * mode, draw alongside it).
+ */
+struct SimplePager::Tile : public osg::Group
 {
-    /**
-     * The master progress tracker keeps track of the current framestamp
-     * for the entire paged scene graph.
-     */
-    struct ProgressMaster : public osg::NodeCallback
+    Tile(const TileKey& key) :
+        _key(key),
+        _range(FLT_MAX),
+        _additive(false),
+        _hasChildren(false),
+        _childrenLoaded(false),
+        _lastInRangeFrame(0u),
+        _lastInRangeTime(0.0)
     {
-        unsigned _frame;
-        bool _canCancel;
+    }
 
-        void operator()(osg::Node* node, osg::NodeVisitor* nv)
-        {
-            _frame = nv->getFrameStamp() ? nv->getFrameStamp()->getFrameNumber() : 0u;
-            traverse(node, nv);
-        }
-    };
-
-    /**
-     * The ProgressCallback that gets passed to createNode() for the subclass
-     * to use. It will report cancelation if the last reported frame number is
-     * behind the current master frame number (as tracked by the ProgressMaster)
-     */
-    struct MyProgressCallback : public DatabasePagerProgressCallback
+    virtual osg::BoundingSphere computeBound() const
     {
-        MyProgressCallback(ProgressMaster* master) :
-            DatabasePagerProgressCallback()
-        {
-            _master = master;
-            _lastFrame = 0u;
-        }
-
-        virtual bool shouldCancel() const
-        {
-            osg::ref_ptr<ProgressMaster> master = _master.get();
-
-            return 
-                (DatabasePagerProgressCallback::shouldCancel()) ||
-                (master.valid() == false) ||
-                (master->_canCancel && _master->_frame - _lastFrame > 1u);
-        }
+        return _bound;
+    }
 
-        // called by ProgressUpdater
-        void touch(const osg::FrameStamp* stamp)
+    virtual void traverse(osg::NodeVisitor& nv)
+    {
+        if (nv.getVisitorType() != nv.CULL_VISITOR || !_hasChildren || getNumChildren() == 0)
         {
-            if ( stamp )
-                _lastFrame = stamp->getFrameNumber();
+            osg::Group::traverse(nv);
+            return;
         }
 
-        unsigned _lastFrame;
-        osg::observer_ptr<ProgressMaster> _master;
-    };
+        float distance = nv.getDistanceToViewPoint(_bound.center(), true);
+        bool inRange = distance < _range;
 
-
-    /**
-    * A pseudo-loader for paged feature tiles.
-    */
-    struct SimplePagerPseudoLoader : public osgDB::ReaderWriter
-    {
-        SimplePagerPseudoLoader()
+        if (inRange)
         {
-            supportsExtension( "osgearth_pseudo_simple", "" );
+            _lastInRangeFrame = nv.getFrameStamp() ? nv.getFrameStamp()->getFrameNumber() : 0u;
+            _lastInRangeTime = nv.getFrameStamp() ? nv.getFrameStamp()->getReferenceTime() : 0.0;
         }
 
-        const char* className() const
-        { // override
-            return "Simple Pager";
+        if (inRange && _childrenLoaded)
+        {
+            if (_additive)
+                getChild(0)->accept(nv);
+            getChild(1)->accept(nv);
         }
-
-        ReadResult readNode(const std::string& uri, const Options* options) const
+        else
         {
-            if ( !acceptsExtension( osgDB::getLowerCaseFileExtension(uri) ) )
-                return ReadResult::FILE_NOT_HANDLED;
-
-            unsigned int lod, x, y;
-            sscanf( uri.c_str(), "%u_%u_%u.%*s", &lod, &x, &y );
+            getChild(0)->accept(nv);
 
             osg::ref_ptr<SimplePager> pager;
-            if (!OptionsData<SimplePager>::lock(options, "osgEarth.SimplePager", pager))
+            if (inRange && _pager.lock(pager))
             {
-                OE_WARN << LC << "Internal error - no SimplePager object in OptionsData\n";
-                return ReadResult::ERROR_IN_READING_FILE;
+                // coarse levels first, then nearest first
+                float closeness = 1.0f - osg::clampBetween(distance / _range, 0.0f, 1.0f);
+                float priority = pager->_priorityOffset + pager->_priorityScale * (closeness - (float)_key.getLOD());
+                pager->requestChildren(this, priority);
             }
+        }
+    }
 
-            osg::ref_ptr<SimplePager::ProgressTracker> tracker;
-            if (!OptionsData<SimplePager::ProgressTracker>::lock(options, "osgEarth.SimplePager.ProgressTracker", tracker))
-            {
-                OE_WARN << LC << "Internal error - no ProgressTracker object in OptionsData\n";
-                return ReadResult::ERROR_IN_READING_FILE;
-            }
+    TileKey _key;
+    osg::BoundingSphere _bound;
+    float _range;
+    bool _additive;
+    bool _hasChildren;
+    bool _childrenLoaded;
+    osg::observer_ptr<SimplePager> _pager;
 
-            osg::ref_ptr<osg::Node> node = pager->loadKey(
-                TileKey(lod, x, y, pager->getProfile()),
-                tracker.get());
+    // last time the camera was in range of the children; read by requests
+    std::atomic_uint _lastInRangeFrame;
+    double _lastInRangeTime;
 
-            if (node.valid() && pager->getSceneGraphCallbacks())
-            {
-                pager->getSceneGraphCallbacks()->firePreMergeNode(node.get());
-            }
+    // outstanding request for the children, if any
+    osg::ref_ptr<LoadChildren> _request;
+};
 
-            return node.release();
-        }
-    };
+/**
+ * Progress of a request for a tile's children. Reports cancelation once
+ * the tile is gone or has not been visible and in range since the
+ * previous frame.
+ */
+struct SimplePager::LoadProgress : public ProgressCallback
+{
+    LoadProgress(SimplePager* pager, Tile* tile) : _pager(pager), _tile(tile) { }
 
-    REGISTER_OSGPLUGIN(osgearth_pseudo_simple, SimplePagerPseudoLoader);
-}
+    virtual bool shouldCancel() const
+    {
+        osg::ref_ptr<SimplePager> pager;
+        osg::ref_ptr<Tile> tile;
+        if (!_pager.lock(pager) || !_tile.lock(tile))
+            return true;
+
+        return
+            pager->getEnableCancalation() &&
+            pager->_frame - tile->_lastInRangeFrame > 1u;
+    }
 
+    osg::observer_ptr<SimplePager> _pager;
+    osg::observer_ptr<Tile> _tile;
+};
 
-SimplePager::ProgressTracker::ProgressTracker(osg::NodeCallback* master)
+/**
+ * Loads a tile's children on the pager's job arena, then hands them
+ * to the pager to merge.
+ */
+struct SimplePager::LoadChildren : public osg::Operation
 {
-    setName( "osgEarth::Util::SimplerPager::ProgressTracker" );
-    for(int i=0; i<4; ++i)
-        _progress[i] = new MyProgressCallback( static_cast<ProgressMaster*>(master) );
-}
+    LoadChildren(SimplePager* pager, Tile* tile) :
+        osg::Operation("SimplePager::LoadChildren", false),
+        _pager(pager),
+        _tile(tile),
+        _progress(new LoadProgress(pager, tile))
+    {
+    }
 
-void SimplePager::ProgressTracker::operator()(osg::Node* node, osg::NodeVisitor* nv)
-{
-    for(int i=0; i<4; ++i)
-        static_cast<MyProgressCallback*>(_progress[i].get())->touch( nv->getFrameStamp() );
-    traverse(node, nv);
-}
+    virtual void operator()(osg::Object*)
+    {
+        osg::ref_ptr<SimplePager> pager;
+        osg::ref_ptr<Tile> tile;
+        if (!_pager.lock(pager) || !_tile.lock(tile))
+            return;
+
+        if (!_progress->isCanceled())
+        {
+            _result = pager->loadKey(tile->_key, _progress.get());
+
+            if (_result.valid() && pager->getSceneGraphCallbacks())
+            {
+                pager->getSceneGraphCallbacks()->firePreMergeNode(_result.get());
+            }
+        }
+
+        Threading::ScopedMutexLock lock(pager->_requestMutex);
+        pager->_merges.push_back(this);
+    }
+
+    osg::observer_ptr<SimplePager> _pager;
+    osg::observer_ptr<Tile> _tile;
+    osg::ref_ptr<LoadProgress> _progress;
+    osg::ref_ptr<osg::Node> _result;
+};
 
 
 SimplePager::SimplePager(const osgEarth::Profile* profile):
@@ -143,24 +165,143 @@ _maxLevel(30),
 _priorityScale(1.0f),
 _priorityOffset(0.0f),
 _canCancel(true),
+_expirationTime(10.0),
+_frame(0u),
+_numRequests(0u),
+_requestMutex("SimplePager.requests(OE)"),
 _mutex("SimplePager(OE)")
 {
-    // required in order to pass our "this" pointer to the pseudo loader:
     this->setName( "osgEarth::Util::SimplerPager::this" );
-    
-    // install the master framestamp tracker:
-    _progressMaster = new ProgressMaster();
-    addCullCallback( _progressMaster.get() );
+
+    _arena = Registry::instance()->getJobArena("pager");
+
+    // merges happen during the update traversal
+    ADJUST_UPDATE_TRAV_COUNT(this, +1);
+}
+
+SimplePager::~SimplePager()
+{
+    // requests that are still waiting will see that we're gone and quit
 }
 
 void SimplePager::setEnableCancelation(bool value)
 {
-    static_cast<ProgressMaster*>(_progressMaster.get())->_canCancel = value;
+    _canCancel = value;
 }
 
 bool SimplePager::getEnableCancalation() const
 {
-    return static_cast<ProgressMaster*>(_progressMaster.get())->_canCancel;
+    return _canCancel;
+}
+
+void SimplePager::traverse(osg::NodeVisitor& nv)
+{
+    if (nv.getVisitorType() == nv.CULL_VISITOR && nv.getFrameStamp())
+    {
+        _frame = nv.getFrameStamp()->getFrameNumber();
+    }
+    else if (nv.getVisitorType() == nv.UPDATE_VISITOR)
+    {
+        update(nv.getFrameStamp());
+    }
+
+    osg::Group::traverse(nv);
+}
+
+void SimplePager::requestChildren(Tile* tile, float priority)
+{
+    // Many cameras may cull the same tile
+    Threading::ScopedMutexLock lock(_requestMutex);
+
+    // A canceled request is either discarded by the arena or about to
+    // finish with nothing, so start over.
+    if (tile->_request.valid() && tile->_request->_progress->isCanceled())
+    {
+        tile->_request = NULL;
+        --_numRequests;
+    }
+
+    if (!tile->_request.valid())
+    {
+        tile->_request = new LoadChildren(this, tile);
+        ++_numRequests;
+        _arena->run(tile->_request.get(), priority, tile->_request->_progress.get());
+    }
+    else
+    {
+        _arena->setPriority(tile->_request.get(), priority);
+    }
+}
+
+void SimplePager::update(const osg::FrameStamp* stamp)
+{
+    std::vector< osg::ref_ptr<LoadChildren> > merges;
+    {
+        Threading::ScopedMutexLock lock(_requestMutex);
+        merges.swap(_merges);
+    }
+
+    for (auto& request : merges)
+    {
+        osg::ref_ptr<Tile> tile;
+        if (!request->_tile.lock(tile))
+            continue;
+
+        {
+            Threading::ScopedMutexLock lock(_requestMutex);
+
+            // a newer request replaced this one
+            if (tile->_request.get() != request.get())
+                continue;
+
+            tile->_request = NULL;
+            --_numRequests;
+        }
+
+        if (request->_result.valid() && !tile->_childrenLoaded)
+        {
+            tile->addChild(request->_result.get());
+            tile->_childrenLoaded = true;
+            _loaded.push_back(tile.get());
+
+            if (getSceneGraphCallbacks())
+                getSceneGraphCallbacks()->firePostMergeNode(request->_result.get());
+        }
+        else if (!request->_result.valid() && !request->_progress->isCanceled())
+        {
+            // nothing to load here, so stop asking
+            tile->_hasChildren = false;
+        }
+    }
+
+    if (!stamp)
+        return;
+
+    // Expire children that have been out of range long enough
+    unsigned frame = stamp->getFrameNumber();
+    double now = stamp->getReferenceTime();
+
+    for (auto i = _loaded.begin(); i != _loaded.end(); )
+    {
+        osg::ref_ptr<Tile> tile;
+        if (!i->lock(tile) || !tile->_childrenLoaded)
+        {
+            i = _loaded.erase(i);
+        }
+        else if (frame - tile->_lastInRangeFrame > 1u && now - tile->_lastInRangeTime > _expirationTime)
+        {
+            if (getSceneGraphCallbacks())
+                getSceneGraphCallbacks()->fireRemoveNode(tile->getChild(1));
+
+            tile->removeChildren(1, tile->getNumChildren() - 1);
+            tile->_childrenLoaded = false;
+            i = _loaded.erase(i);
+        }
+        else
+        {
+            ++i;
+        }
+    }
 }
 
 void SimplePager::build()
@@ -263,15 +404,14 @@ osg::Node* SimplePager::createPagedNode(const TileKey& key, ProgressCallback* pr
 
     tileRadius = osg::maximum(tileBounds.radius(), static_cast<osg::BoundingSphere::value_type>(tileRadius));
 
-    //osg::PagedLOD* plod = new osg::PagedLOD;
-    osg::PagedLOD* plod = 
-        getSceneGraphCallbacks() ? new PagedLODWithSceneGraphCallbacks(getSceneGraphCallbacks()) :
-        new osg::PagedLOD();
-
-    plod->setCenter( tileBounds.center() ); 
-    plod->setRadius( tileRadius );
+    osg::ref_ptr<Tile> tile = new Tile(key);
+    tile->_pager = this;
+    tile->_bound.set(tileBounds.center(), tileRadius);
+    tile->_additive = _additive;
+    tile->_hasChildren = hasChildren;
+    tile->_range = (float)(tileRadius * _rangeFactor);
 
-    plod->addChild( node.get() );
+    tile->addChild( node.get() );
     
     // Assume geocentric for now.
     if (true)
@@ -294,70 +434,20 @@ osg::Node* SimplePager::createPagedNode(const TileKey& key, ProgressCallback* pr
                     ccExtent.getSRS()->transform(tileCenter, mapSRS->getGeocentricSRS(), centerECEF);
                     osg::NodeCallback* ccc = ClusterCullingFactory::create(geodeticExtent);
                     if (ccc)
-                        plod->addCullCallback(ccc);
+                        tile->addCullCallback(ccc);
                 }
             }
         }
     }
 
-    if ( hasChildren )
-    {
-        std::stringstream buf;
-        buf << key.getLevelOfDetail() << "_" << key.getTileX() << "_" << key.getTileY() << ".osgearth_pseudo_simple";
-
-        std::string uri = buf.str();
-
-        // Now setup a filename on the PagedLOD that will load all of the children of this node.
-        plod->setFileName(1, uri);
-        plod->setPriorityOffset(1, _priorityOffset);
-        plod->setPriorityScale (1, _priorityScale);
-        
-        // install a callback that will update the progress tracker whenever the PLOD
-        // gets traversed. The children, once activated, will have access to its
-        // ProgressCallback within and be able to check for cancelation, use stats, etc.
-        ProgressTracker* tracker = new ProgressTracker( _progressMaster.get() );
-        plod->addCullCallback( tracker );
-
-        // assemble data to pass to the pseudoloader
-        osgDB::Options* options = new osgDB::Options();
-        OptionsData<SimplePager>::set(options, "osgEarth.SimplePager", this);
-        OptionsData<ProgressTracker>::set(options, "osgEarth.SimplePager.ProgressTracker", tracker);
-        plod->setDatabaseOptions( options );
-        
-        // Install an FLC if the caller provided one
-        if ( _fileLocationCallback.valid() )
-            options->setFileLocationCallback( _fileLocationCallback.get() );
-
-        // Setup the min and max ranges.
-        float minRange = (float)(tileRadius * _rangeFactor);
-
-        if (!_additive)
-        {
-            // Replace mode, the parent is replaced by its children.
-            plod->setRange( 0, minRange, FLT_MAX );
-            plod->setRange( 1, 0, minRange );
-        }
-        else
-        {
-            // Additive, the parent remains and new data is added
-            plod->setRange( 0, 0, FLT_MAX );
-            plod->setRange( 1, 0, minRange );
-        }
-    }
-    else
-    {
-        // no children, so max out the visibility range.
-        plod->setRange( 0, 0, FLT_MAX );
-    }
-
-    return plod;
+    return tile.release();
 }
 
 
 /**
-* Loads the PagedLOD hierarchy for this key.
+* Loads the four child tiles of this key.
 */
-osg::Node* SimplePager::loadKey(const TileKey& key, ProgressTracker* tracker)
+osg::Node* SimplePager::loadKey(const TileKey& key, ProgressCallback* progress)
 {       
     osg::ref_ptr< osg::Group >  group = new osg::Group;
 
@@ -365,10 +455,16 @@ osg::Node* SimplePager::loadKey(const TileKey& key, ProgressTracker* tracker)
     {
         TileKey childKey = key.createChildKey( i );
 
-        osg::Node* plod = createPagedNode( childKey, tracker->_progress[i].get() );
-        if (plod)
+        osg::Node* tile = createPagedNode( childKey, progress );
+        if (tile)
+        {
+            group->addChild( tile );
+        }
+
+        // stale request; don't bother with the rest
+        if (progress && progress->isCanceled())
         {
-            group->addChild( plod );
+            return 0;
         }
     }
     if (group->getNumChildren() > 0)
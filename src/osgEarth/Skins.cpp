@@ -253,7 +253,8 @@ _minObjHeight(rhs._minObjHeight),
 _maxObjHeight(rhs._maxObjHeight),
 _isTiled(rhs._isTiled),
 _randomSeed(rhs._randomSeed),
-_name(rhs._name)
+_name(rhs._name),
+_atlas(rhs._atlas)
 {
 }
 
@@ -263,7 +264,8 @@ _objHeight    ( 0.0f ),
 _minObjHeight ( 0.0f ),
 _maxObjHeight ( FLT_MAX ),
 _isTiled      ( false ),
-_randomSeed   ( 0 )
+_randomSeed   ( 0 ),
+_atlas        ( false )
 {
     if ( !conf.empty() )
         mergeConfig( conf );
@@ -279,6 +281,7 @@ SkinSymbol::mergeConfig( const Config& conf )
     conf.get( "tiled",               _isTiled );
     conf.get( "random_seed",         _randomSeed );
     conf.get( "name",                _name );
+    conf.get( "atlas",               _atlas );
 
     addTags( conf.value("tags" ) );
 }
@@ -296,6 +299,7 @@ SkinSymbol::getConfig() const
     conf.set( "tiled",               _isTiled );
     conf.set( "random_seed",         _randomSeed );
     conf.set( "name",                _name );
+    conf.set( "atlas",               _atlas );
 
     std::string tagstring = this->tagString();
     if ( !tagstring.empty() )
@@ -333,4 +337,7 @@ SkinSymbol::parseSLD(const Config& c, Style& style)
     else if (match(c.key(), "skin-name")) {
         style.getOrCreate<SkinSymbol>()->name() = StringExpression(c.value());
     }
+    else if (match(c.key(), "skin-atlas")) {
+        style.getOrCreate<SkinSymbol>()->atlas() = as<bool>(c.value(), false);
+    }
 }
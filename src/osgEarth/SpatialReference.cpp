@@ -23,6 +23,7 @@
 #include <osgEarth/LocalTangentPlane>
 #include <ogr_spatialref.h>
 #include <cpl_conv.h>
+#include <cmath>
 
 #define LC "[SpatialReference] "
 
@@ -92,6 +93,170 @@ namespace
             minX, minY, 0.0, 1.0);
         return transform;
     }
+
+    // Built-in kernels for the most common transforms. Each one works on
+    // the same x[]/y[] arrays OCTTransform takes, in a plain loop without
+    // branches or calls other than libm, so the compiler can vectorize it.
+    // Like OCTTransform, a kernel writes HUGE_VAL to points it cannot
+    // transform and returns false if there were any.
+
+    const double WGS84_A = 6378137.0;
+    const double WGS84_F = 1.0/298.257223563;
+
+    // longitude into [-180, 180], like PROJ does
+    inline double wrapLongitude(double lon)
+    {
+        return (lon < -180.0 || lon > 180.0) ?
+            lon - 360.0*floor((lon + 180.0)/360.0) :
+            lon;
+    }
+
+    bool geographicToSphericalMercator(double* x, double* y, unsigned count)
+    {
+        unsigned bad = 0;
+        for (unsigned i = 0; i < count; ++i)
+        {
+            double lon = osg::DegreesToRadians(wrapLongitude(x[i]));
+            double lat = osg::DegreesToRadians(y[i]);
+            bool ok = fabs(y[i]) < 90.0;
+            x[i] = ok ? WGS84_A * lon : HUGE_VAL;
+            y[i] = ok ? WGS84_A * log(tan(0.25*osg::PI + 0.5*lat)) : HUGE_VAL;
+            bad += ok ? 0 : 1;
+        }
+        return bad == 0;
+    }
+
+    bool sphericalMercatorToGeographic(double* x, double* y, unsigned count)
+    {
+        for (unsigned i = 0; i < count; ++i)
+        {
+            x[i] = wrapLongitude(osg::RadiansToDegrees(x[i] / WGS84_A));
+            y[i] = osg::RadiansToDegrees(osg::PI_2 - 2.0*atan(exp(-y[i] / WGS84_A)));
+        }
+        return true;
+    }
+
+    // Transverse Mercator on the WGS84 ellipsoid, using Krueger's series
+    // to sixth order in n (the same approach as PROJ's default tmerc).
+    // Accurate to well under a millimeter within a few zones of the
+    // central meridian.
+    struct UTMSeries
+    {
+        double e;        // eccentricity
+        double A;        // rectifying radius
+        double alpha[6]; // forward series
+        double beta[6];  // inverse series
+
+        UTMSeries()
+        {
+            const double f = WGS84_F;
+            const double n = f / (2.0 - f);
+            const double n2 = n*n, n3 = n2*n, n4 = n3*n, n5 = n4*n, n6 = n5*n;
+
+            e = sqrt(f*(2.0 - f));
+            A = WGS84_A / (1.0 + n) * (1.0 + n2/4.0 + n4/64.0 + n6/256.0);
+
+            alpha[0] = n/2 - 2*n2/3 + 5*n3/16 + 41*n4/180 - 127*n5/288 + 7891*n6/37800;
+            alpha[1] = 13*n2/48 - 3*n3/5 + 557*n4/1440 + 281*n5/630 - 1983433*n6/1935360;
+            alpha[2] = 61*n3/240 - 103*n4/140 + 15061*n5/26880 + 167603*n6/181440;
+            alpha[3] = 49561*n4/161280 - 179*n5/168 + 6601661*n6/7257600;
+            alpha[4] = 34729*n5/80640 - 3418889*n6/1995840;
+            alpha[5] = 212378941*n6/319334400;
+
+            beta[0] = n/2 - 2*n2/3 + 37*n3/96 - n4/360 - 81*n5/512 + 96199*n6/604800;
+            beta[1] = n2/48 + n3/15 - 437*n4/1440 + 46*n5/105 - 1118711*n6/3870720;
+            beta[2] = 17*n3/480 - 37*n4/840 - 209*n5/4480 + 5569*n6/90720;
+            beta[3] = 4397*n4/161280 - 11*n5/504 - 830251*n6/7257600;
+            beta[4] = 4583*n5/161280 - 108847*n6/3991680;
+            beta[5] = 20648693*n6/638668800;
+        }
+
+        // tangent of the conformal latitude, from the tangent of the geodetic one
+        inline double taup(double tau) const
+        {
+            double sigma = sinh(e * atanh(e * tau / sqrt(1.0 + tau*tau)));
+            return tau*sqrt(1.0 + sigma*sigma) - sigma*sqrt(1.0 + tau*tau);
+        }
+    };
+
+    const double UTM_K0 = 0.9996;
+    const double UTM_E0 = 500000.0;
+    const double UTM_N0_SOUTH = 10000000.0;
+
+    bool geographicToUTM(double* x, double* y, unsigned count, int zone, bool north)
+    {
+        static const UTMSeries s;
+        const double lon0 = (double)((zone - 1) * 6 - 180 + 3);
+        const double N0 = north ? 0.0 : UTM_N0_SOUTH;
+        const double kA = UTM_K0 * s.A;
+
+        unsigned bad = 0;
+        for (unsigned i = 0; i < count; ++i)
+        {
+            double dlon = wrapLongitude(x[i] - lon0);
+            bool ok = fabs(dlon) < 90.0 && fabs(y[i]) <= 90.0;
+
+            double lam = osg::DegreesToRadians(dlon);
+            double tau = tan(osg::DegreesToRadians(osg::clampBetween(y[i], -89.9999999, 89.9999999)));
+            double tp = s.taup(tau);
+            double xip = atan2(tp, cos(lam));
+            double etap = asinh(sin(lam) / sqrt(tp*tp + cos(lam)*cos(lam)));
+
+            double xi = xip, eta = etap;
+            for (int j = 0; j < 6; ++j)
+            {
+                double k = 2.0*(j + 1);
+                xi  += s.alpha[j] * sin(k*xip) * cosh(k*etap);
+                eta += s.alpha[j] * cos(k*xip) * sinh(k*etap);
+            }
+
+            x[i] = ok ? UTM_E0 + kA * eta : HUGE_VAL;
+            y[i] = ok ? N0 + kA * xi : HUGE_VAL;
+            bad += ok ? 0 : 1;
+        }
+        return bad == 0;
+    }
+
+    bool utmToGeographic(double* x, double* y, unsigned count, int zone, bool north)
+    {
+        static const UTMSeries s;
+        const double lon0 = (double)((zone - 1) * 6 - 180 + 3);
+        const double N0 = north ? 0.0 : UTM_N0_SOUTH;
+        const double kA = UTM_K0 * s.A;
+        const double e2 = s.e * s.e;
+
+        for (unsigned i = 0; i < count; ++i)
+        {
+            double eta = (x[i] - UTM_E0) / kA;
+            double xi  = (y[i] - N0) / kA;
+
+            double xip = xi, etap = eta;
+            for (int j = 0; j < 6; ++j)
+            {
+                double k = 2.0*(j + 1);
+                xip  -= s.beta[j] * sin(k*xi) * cosh(k*eta);
+                etap -= s.beta[j] * cos(k*xi) * sinh(k*eta);
+            }
+
+            double sinhetap = sinh(etap);
+            double cosxip = cos(xip);
+            double tp = sin(xip) / sqrt(sinhetap*sinhetap + cosxip*cosxip);
+            double lam = atan2(sinhetap, cosxip);
+
+            // solve taup(tau) = tp with Newton's method
+            double tau = tp;
+            for (int j = 0; j < 5; ++j)
+            {
+                double t = s.taup(tau);
+                tau += (tp - t) / sqrt(1.0 + t*t) *
+                    (1.0 + (1.0 - e2)*tau*tau) / ((1.0 - e2)*sqrt(1.0 + tau*tau));
+            }
+
+            x[i] = wrapLongitude(lon0 + osg::RadiansToDegrees(lam));
+            y[i] = osg::RadiansToDegrees(atan(tau));
+        }
+        return true;
+    }
 }
 
 //------------------------------------------------------------------------
@@ -383,6 +548,9 @@ _is_user_defined( false ),
 _is_ltp         ( false ),
 _is_spherical_mercator( false ),
 _ellipsoidId(0u),
+_kernel         ( KERNEL_NONE ),
+_utmZone        ( 0 ),
+_utmNorth       ( true ),
 _mutex("SpatialReference(OE)")
 {
     // nop
@@ -403,6 +571,9 @@ _is_south_polar  ( false ),
 _is_cube         ( false ),
 _is_contiguous   ( false ),
 _is_user_defined ( false ),
+_kernel          ( KERNEL_NONE ),
+_utmZone         ( 0 ),
+_utmNorth        ( true ),
 _mutex("SpatialReference(OE)")
 {
     //nop
@@ -1062,6 +1233,22 @@ SpatialReference::transformXYPointArrays(double*  x,
                                          unsigned count,
                                          const SpatialReference* out_srs) const
 {  
+    // Built-in kernels for the common pairs:
+    if (_kernel == KERNEL_WGS84)
+    {
+        if (out_srs->_kernel == KERNEL_SPHERICAL_MERCATOR)
+            return geographicToSphericalMercator(x, y, count);
+        if (out_srs->_kernel == KERNEL_WGS84_UTM)
+            return geographicToUTM(x, y, count, out_srs->_utmZone, out_srs->_utmNorth);
+    }
+    else if (out_srs->_kernel == KERNEL_WGS84)
+    {
+        if (_kernel == KERNEL_SPHERICAL_MERCATOR)
+            return sphericalMercatorToGeographic(x, y, count);
+        if (_kernel == KERNEL_WGS84_UTM)
+            return utmToGeographic(x, y, count, _utmZone, _utmNorth);
+    }
+
     // Transform the X and Y values inside an exclusive GDAL/OGR lock
     GDAL_SCOPED_LOCK;
 
@@ -1526,6 +1713,66 @@ SpatialReference::_init()
         _key.vertLower = toLower(_key.vert);
     }
 
+    // See whether one of the built-in transform kernels applies:
+    _kernel = KERNEL_NONE;
+    bool wgs84Ellipsoid =
+        osg::equivalent(semi_major_axis, 6378137.0) &&
+        osg::equivalent(semi_minor_axis, 6356752.314245, 1e-3);
+
+    if (_is_geocentric)
+    {
+        // nop; geocentric conversions never reach OGR
+    }
+    else if (_is_geographic)
+    {
+        if (wgs84Ellipsoid && _datum == "wgs_1984" &&
+            OSRGetPrimeMeridian(_handle, 0L) == 0.0 &&
+            osg::equivalent(OSRGetAngularUnits(_handle, 0L), osg::PI/180.0))
+        {
+            _kernel = KERNEL_WGS84;
+        }
+    }
+    else if (_is_mercator && osg::equivalent(semi_major_axis, 6378137.0) &&
+             OSRGetLinearUnits(_handle, 0L) == 1.0)
+    {
+        // spherical math on the WGS84 semi-major axis, with lat/long taken
+        // as-is (either a sphere with a null datum shift, or EPSG:3857's
+        // WGS84 datum). GDAL reports EPSG:3857 on the WGS84 ellipsoid but
+        // projects it with the spherical PROJ4 string it exports.
+        std::string proj4 = toLower(_proj4);
+        std::string::size_type b = proj4.find("+b=");
+        bool sphere =
+            _is_spherical_mercator ||
+            proj.find("pseudo_mercator") != std::string::npos ||
+            (b != std::string::npos && osg::equivalent(as<double>(proj4.substr(b+3, proj4.find(' ', b)-b-3), 0.0), 6378137.0));
+
+        bool nullShift =
+            _datum == "wgs_1984" ||
+            proj4.find("+nadgrids=@null") != std::string::npos;
+
+        if (sphere && nullShift &&
+            OSRGetProjParm(_handle, SRS_PP_CENTRAL_MERIDIAN, 0.0, 0L) == 0.0 &&
+            OSRGetProjParm(_handle, SRS_PP_FALSE_EASTING, 0.0, 0L) == 0.0 &&
+            OSRGetProjParm(_handle, SRS_PP_FALSE_NORTHING, 0.0, 0L) == 0.0 &&
+            OSRGetProjParm(_handle, SRS_PP_SCALE_FACTOR, 1.0, 0L) == 1.0 &&
+            OSRGetProjParm(_handle, SRS_PP_STANDARD_PARALLEL_1, 0.0, 0L) == 0.0)
+        {
+            _kernel = KERNEL_SPHERICAL_MERCATOR;
+        }
+    }
+    else if (wgs84Ellipsoid && _datum == "wgs_1984" &&
+             OSRGetLinearUnits(_handle, 0L) == 1.0)
+    {
+        int north = 0;
+        int zone = OSRGetUTMZone(_handle, &north);
+        if (zone >= 1 && zone <= 60)
+        {
+            _kernel = KERNEL_WGS84_UTM;
+            _utmZone = zone;
+            _utmNorth = north != 0;
+        }
+    }
+
     _initialized = true;
 }
 
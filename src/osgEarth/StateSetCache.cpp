@@ -20,6 +20,8 @@
 #include <osg/NodeVisitor>
 #include <osg/BufferIndexBinding>
 #include <osg/ProxyNode>
+#include <osg/Texture>
+#include <functional>
 
 #define LC "[StateSetCache] "
 
@@ -89,6 +91,107 @@ namespace
 #endif
     }
 
+    inline void hashCombine(std::size_t& seed, std::size_t value)
+    {
+        seed ^= value + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+    }
+
+    // Hash of the parts of an attribute that compare() always checks, so
+    // that attributes comparing equal hash the same. Textures add their
+    // sampling and image descriptions, which tells most textures apart
+    // without touching pixels. (Images sharing one buffer under different
+    // file names compare equal but hash apart; that only costs a share.)
+    std::size_t hashStateAttribute(const osg::StateAttribute* attr)
+    {
+        std::size_t seed = std::hash<std::string>()(attr->className());
+        hashCombine(seed, (std::size_t)attr->getType());
+        hashCombine(seed, (std::size_t)attr->getMember());
+
+        const osg::Texture* tex = dynamic_cast<const osg::Texture*>(attr);
+        if (tex)
+        {
+            hashCombine(seed, tex->getWrap(osg::Texture::WRAP_S));
+            hashCombine(seed, tex->getWrap(osg::Texture::WRAP_T));
+            hashCombine(seed, tex->getWrap(osg::Texture::WRAP_R));
+            hashCombine(seed, tex->getFilter(osg::Texture::MIN_FILTER));
+            hashCombine(seed, tex->getFilter(osg::Texture::MAG_FILTER));
+            hashCombine(seed, tex->getNumImages());
+            for (unsigned i = 0; i < tex->getNumImages(); ++i)
+            {
+                const osg::Image* image = tex->getImage(i);
+                if (image)
+                {
+                    hashCombine(seed, image->s());
+                    hashCombine(seed, image->t());
+                    hashCombine(seed, image->getPixelFormat());
+                    hashCombine(seed, image->getDataType());
+                    hashCombine(seed, std::hash<std::string>()(image->getFileName()));
+                }
+            }
+        }
+        return seed;
+    }
+
+    void hashAttributeList(std::size_t& seed, const osg::StateSet::AttributeList& attrs)
+    {
+        for (osg::StateSet::AttributeList::const_iterator i = attrs.begin(); i != attrs.end(); ++i)
+        {
+            if (i->second.first.valid())
+                hashCombine(seed, hashStateAttribute(i->second.first.get()));
+            hashCombine(seed, i->second.second);
+        }
+    }
+
+    void hashModeList(std::size_t& seed, const osg::StateSet::ModeList& modes)
+    {
+        for (osg::StateSet::ModeList::const_iterator i = modes.begin(); i != modes.end(); ++i)
+        {
+            hashCombine(seed, i->first);
+            hashCombine(seed, i->second);
+        }
+    }
+
+    // Hash of a stateset's structure: its modes, the hashes of its attributes,
+    // its uniform and define names and its render bin. Like the attribute
+    // hash, it agrees with compare(rhs, true).
+    std::size_t hashStateSet(const osg::StateSet* stateSet)
+    {
+        std::size_t seed = 0;
+        hashModeList(seed, stateSet->getModeList());
+        hashAttributeList(seed, stateSet->getAttributeList());
+
+        const osg::StateSet::TextureModeList& texModes = stateSet->getTextureModeList();
+        for (unsigned unit = 0; unit < texModes.size(); ++unit)
+        {
+            hashCombine(seed, unit);
+            hashModeList(seed, texModes[unit]);
+        }
+
+        const osg::StateSet::TextureAttributeList& texAttrs = stateSet->getTextureAttributeList();
+        for (unsigned unit = 0; unit < texAttrs.size(); ++unit)
+        {
+            hashCombine(seed, unit);
+            hashAttributeList(seed, texAttrs[unit]);
+        }
+
+        const osg::StateSet::UniformList& uniforms = stateSet->getUniformList();
+        for (osg::StateSet::UniformList::const_iterator i = uniforms.begin(); i != uniforms.end(); ++i)
+        {
+            hashCombine(seed, std::hash<std::string>()(i->first));
+        }
+
+        const osg::StateSet::DefineList& defines = stateSet->getDefineList();
+        for (osg::StateSet::DefineList::const_iterator i = defines.begin(); i != defines.end(); ++i)
+        {
+            hashCombine(seed, std::hash<std::string>()(i->first));
+        }
+
+        hashCombine(seed, stateSet->getRenderingHint());
+        hashCombine(seed, stateSet->getBinNumber());
+        hashCombine(seed, std::hash<std::string>()(stateSet->getBinName()));
+        return seed;
+    }
+
     /**
     * Visitor that calls StateSetCache::share on all attributes found
     * in a scene graph.
@@ -247,41 +350,58 @@ namespace
 //------------------------------------------------------------------------
 
 StateSetCache::StateSetCache() :
-    _pruneCount       ( 0 ),
     _maxSize          ( DEFAULT_PRUNE_ACCESS_COUNT ),
     _attrShareAttempts( 0 ),
     _attrsIneligible  ( 0 ),
     _attrShareHits    ( 0 ),
-    _attrShareMisses  ( 0 ),
-    _mutex            ("StateSetCache(OE)")
+    _attrShareMisses  ( 0 )
 {
-    //nop
+    for (unsigned i = 0; i < NUM_SHARDS; ++i)
+        _shards[i]._mutex.setName("StateSetCache(OE)");
 }
 
 StateSetCache::~StateSetCache()
 {
-    Threading::ScopedMutexLock lock( _mutex );
-    prune();
+    for (unsigned i = 0; i < NUM_SHARDS; ++i)
+    {
+        Threading::ScopedMutexLock lock( _shards[i]._mutex );
+        prune( _shards[i] );
+    }
 }
 
 void
 StateSetCache::releaseGLObjects(osg::State* state) const
 {
-    Threading::ScopedMutexLock lock( _mutex );
-    for(StateSetSet::const_iterator i = _stateSetCache.begin(); i != _stateSetCache.end(); ++i)
+    for (unsigned s = 0; s < NUM_SHARDS; ++s)
     {
-        i->get()->releaseGLObjects(state);
+        Threading::ScopedMutexLock lock( _shards[s]._mutex );
+        for(StateSetMap::const_iterator i = _shards[s]._stateSets.begin(); i != _shards[s]._stateSets.end(); ++i)
+        {
+            i->second->releaseGLObjects(state);
+        }
     }
+}
 
+unsigned
+StateSetCache::size() const
+{
+    unsigned count = 0;
+    for (unsigned s = 0; s < NUM_SHARDS; ++s)
+    {
+        Threading::ScopedMutexLock lock( _shards[s]._mutex );
+        count += _shards[s]._stateSets.size();
+    }
+    return count;
 }
 
 void
 StateSetCache::setMaxSize(unsigned value)
 {
     _maxSize = value;
+    for (unsigned i = 0; i < NUM_SHARDS; ++i)
     {
-        Threading::ScopedMutexLock lock( _mutex );
-        pruneIfNecessary();
+        Threading::ScopedMutexLock lock( _shards[i]._mutex );
+        pruneIfNecessary( _shards[i] );
     }
 }
 
@@ -337,46 +457,33 @@ StateSetCache::share(osg::ref_ptr<osg::StateSet>& input,
     osg::ref_ptr<osg::StateSet>& output,
     bool                         checkEligible)
 {
-    bool shared     = false;
-    //bool shareattrs = true;
-
     if ( !checkEligible || eligible(input.get()) )
     {
-        Threading::ScopedMutexLock lock( _mutex );
+        // hash outside the lock; the input belongs to the caller
+        std::size_t hash = hashStateSet(input.get());
+        Shard& shard = _shards[hash % NUM_SHARDS];
 
-        pruneIfNecessary();
+        Threading::ScopedMutexLock lock( shard._mutex );
 
-        //shareattrs = false;
+        pruneIfNecessary( shard );
 
-        std::pair<StateSetSet::iterator,bool> result = _stateSetCache.insert( input );
-        if ( result.second )
+        std::pair<StateSetMap::iterator, StateSetMap::iterator> range = shard._stateSets.equal_range(hash);
+        for (StateSetMap::iterator i = range.first; i != range.second; ++i)
         {
-            // first use
-            output = input.get();
-            //shareattrs = true;
-            shared = false;
-        }
-        else
-        {
-            // found a share!
-            output = result.first->get();
-            shared = true;
+            if (i->second->compare(*input.get(), true) == 0)
+            {
+                // found a share!
+                output = i->second.get();
+                return true;
+            }
         }
-    }
-    else
-    {
-        output = input.get();
-        shared = false;
-    }
 
-    // OBE.
-    //if ( shareattrs )
-    //{
-    //    ShareStateAttributes sa(this);
-    //    sa.applyStateSet( input.get() );
-    //}
+        // first use
+        shard._stateSets.insert(std::make_pair(hash, input));
+    }
 
-    return shared;
+    output = input.get();
+    return false;
 }
 
 
@@ -390,25 +497,30 @@ StateSetCache::share(osg::ref_ptr<osg::StateAttribute>& input,
 
     if ( !checkEligible || eligible(input.get()) )
     {
-        Threading::ScopedMutexLock lock( _mutex );
+        std::size_t hash = hashStateAttribute(input.get());
+        Shard& shard = _shards[hash % NUM_SHARDS];
 
-        pruneIfNecessary();
+        Threading::ScopedMutexLock lock( shard._mutex );
 
-        std::pair<StateAttributeSet::iterator,bool> result = _stateAttributeCache.insert( input );
-        if ( result.second )
-        {
-            // first use
-            output = input.get();
-            _attrShareMisses++;
-            return false;
-        }
-        else
+        pruneIfNecessary( shard );
+
+        std::pair<StateAttributeMap::iterator, StateAttributeMap::iterator> range = shard._stateAttributes.equal_range(hash);
+        for (StateAttributeMap::iterator i = range.first; i != range.second; ++i)
         {
-            // found a share!
-            output = result.first->get();
-            _attrShareHits++;
-            return true;
+            if (i->second->compare(*input.get()) == 0)
+            {
+                // found a share!
+                output = i->second.get();
+                _attrShareHits++;
+                return true;
+            }
         }
+
+        // first use
+        shard._stateAttributes.insert(std::make_pair(hash, input));
+        output = input.get();
+        _attrShareMisses++;
+        return false;
     }
     else
     {
@@ -419,29 +531,29 @@ StateSetCache::share(osg::ref_ptr<osg::StateAttribute>& input,
 }
 
 void
-StateSetCache::pruneIfNecessary()
+StateSetCache::pruneIfNecessary(Shard& shard)
 {
-    // assume an exclusve mutex is taken
-    if ( _pruneCount++ >= _maxSize )
+    // assume the shard's mutex is taken
+    if ( shard._pruneCount++ >= _maxSize )
     {
-        prune();
-        _pruneCount = 0;
+        prune( shard );
+        shard._pruneCount = 0;
     }
 }
 
 void
-StateSetCache::prune()
+StateSetCache::prune(Shard& shard)
 {
-    // assume an exclusive mutex is taken.
+    // assume the shard's mutex is taken.
 
     unsigned ss_count = 0, sa_count = 0;
 
-    for( StateSetSet::iterator i = _stateSetCache.begin(); i != _stateSetCache.end(); )
+    for( StateSetMap::iterator i = shard._stateSets.begin(); i != shard._stateSets.end(); )
     {
-        if ( i->get()->referenceCount() <= 1 )
+        if ( i->second->referenceCount() <= 1 )
         {
             // do not call releaseGLObjects since the attrs themselves might still be shared
-            _stateSetCache.erase( i++ );
+            i = shard._stateSets.erase( i );
             ss_count++;
         }
         else
@@ -450,12 +562,12 @@ StateSetCache::prune()
         }
     }
 
-    for( StateAttributeSet::iterator i = _stateAttributeCache.begin(); i != _stateAttributeCache.end(); )
+    for( StateAttributeMap::iterator i = shard._stateAttributes.begin(); i != shard._stateAttributes.end(); )
     {
-        if ( i->get()->referenceCount() <= 1 )
+        if ( i->second->referenceCount() <= 1 )
         {
-            i->get()->releaseGLObjects( 0L );
-            _stateAttributeCache.erase( i++ );
+            i->second->releaseGLObjects( 0L );
+            i = shard._stateAttributes.erase( i );
             sa_count++;
         }
         else
@@ -470,22 +582,24 @@ StateSetCache::prune()
 void
 StateSetCache::clear()
 {
-    Threading::ScopedMutexLock lock( _mutex );
+    for (unsigned i = 0; i < NUM_SHARDS; ++i)
+    {
+        Threading::ScopedMutexLock lock( _shards[i]._mutex );
 
-    prune();
-    _stateAttributeCache.clear();
-    _stateSetCache.clear();
+        prune( _shards[i] );
+        _shards[i]._stateAttributes.clear();
+        _shards[i]._stateSets.clear();
+    }
 }
 
 
 void
 StateSetCache::dumpStats()
 {
-    Threading::ScopedMutexLock lock( _mutex );
-
     OE_NOTICE << LC << "StateSetCache Dump:" << std::endl
         << "    attr attempts     = " << _attrShareAttempts << std::endl
         << "    ineligibles attrs = " << _attrsIneligible << std::endl
         << "    attr share hits   = " << _attrShareHits << std::endl
-        << "    attr share misses = " << _attrShareMisses << std::endl;
+        << "    attr share misses = " << _attrShareMisses << std::endl
+        << "    statesets         = " << size() << std::endl;
 }
@@ -17,6 +17,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>
  */
 #include <osgEarth/SubstituteModelFilter>
+#include <osgEarth/LODGenerator>
 #include <osgEarth/FeatureSourceIndexNode>
 #include <osgEarth/FilterContext>
 #include <osgEarth/GeometryUtils>
@@ -377,12 +378,25 @@ SubstituteModelFilter::process(const FeatureList&           features,
             // already in the scene graph. -gw
             context.resourceCache()->cloneOrCreateInstanceNode(instance.get(), model, context.getDBOptions());
 
+            // Clustering merges all the geometry, which would merge every
+            // level of a generated LOD chain, so keep only the finest.
+            if ( _cluster && model.valid() )
+            {
+                if ( LODGenerator::isGenerated(model.get()) && model->asGroup()->getNumChildren() > 0 )
+                    model = model->asGroup()->getChild(0);
+                LODGenerator::removeChains(model.get());
+            }
+
             // if icon decluttering is off, install an AutoTransform.
             if ( iconSymbol )
             {
                 if ( iconSymbol->declutter() == true )
                 {
-                    ScreenSpaceLayout::activate(model->getOrCreateStateSet());
+                    // The clone shares its state with the cached model, so change a copy.
+                    model->setStateSet(model->getStateSet() ?
+                        osg::clone(model->getStateSet(), osg::CopyOp::SHALLOW_COPY) :
+                        new osg::StateSet());
+                    ScreenSpaceLayout::activate(model->getStateSet());
                 }
                 else if ( dynamic_cast<osg::AutoTransform*>(model.get()) == 0L )
                 {
@@ -513,6 +527,10 @@ SubstituteModelFilter::process(const FeatureList&           features,
     {
         DrawInstanced::convertGraphToUseDrawInstanced( attachPoint );
 
+        // All the instances of a model now draw through one LOD chain,
+        // so switch the whole set by its combined bounds.
+        LODGenerator::fitChains( attachPoint, attachPoint->getBound() );
+
         // install a shader program to render draw-instanced.
         DrawInstanced::install( attachPoint->getOrCreateStateSet() );
     }
@@ -24,12 +24,17 @@
 #include <osgEarth/NodeUtils>
 #include <osgEarth/FileUtils>
 #include <osgEarth/NetworkMonitor>
+#include <osgEarth/StateSetCache>
 #include <osgDB/FileNameUtils>
 #include <osgDB/Registry>
 #include <osgUtil/IncrementalCompileOperation>
 #include <osg/ShapeDrawable>
 #include <osg/PolygonMode>
+#include <osg/PolygonOffset>
+#include <osg/Texture>
+#include <set>
 #include <osgEarth/LineDrawable>
+#include <osgEarth/Memory>
 
 using namespace osgEarth;
 using namespace osgEarth::Util;
@@ -607,16 +612,322 @@ namespace
 
         return promise.getFuture();
     }
+
+    // Gets tile content ready for the GPU on the loading thread, so the
+    // draw thread only has to upload it.
+    struct PrepareContentVisitor : public TextureAndImageVisitor
+    {
+        PrepareContentVisitor(bool compressTextures) :
+            _compressTextures(compressTextures) { }
+
+        using TextureAndImageVisitor::apply;
+
+        void apply(osg::Drawable& drawable)
+        {
+            osg::Geometry* geom = drawable.asGeometry();
+            if (geom)
+            {
+                geom->setUseDisplayList(false);
+                geom->setUseVertexBufferObjects(true);
+
+                // Pack all the vertex arrays into one buffer object, and all
+                // the indices into another, so each uploads in one call.
+                osg::Geometry::ArrayList arrays;
+                geom->getArrayList(arrays);
+                if (arrays.size() > 1)
+                {
+                    osg::ref_ptr<osg::VertexBufferObject> vbo = new osg::VertexBufferObject();
+                    for (unsigned i = 0; i < arrays.size(); ++i)
+                        arrays[i]->setVertexBufferObject(vbo.get());
+                }
+
+                osg::ref_ptr<osg::ElementBufferObject> ebo;
+                for (unsigned i = 0; i < geom->getNumPrimitiveSets(); ++i)
+                {
+                    osg::DrawElements* de = geom->getPrimitiveSet(i)->getDrawElements();
+                    if (de)
+                    {
+                        if (!ebo.valid())
+                            ebo = new osg::ElementBufferObject();
+                        de->setElementBufferObject(ebo.get());
+                    }
+                }
+            }
+
+            apply(static_cast<osg::Node&>(drawable));
+        }
+
+        void apply(osg::Texture& texture)
+        {
+            if (!_seen.insert(&texture).second)
+                return;
+
+            // DXT-compress plain 2D textures; the compressed copy carries
+            // its own mipmaps.
+            if (_compressTextures &&
+                texture.getTextureTarget() == GL_TEXTURE_2D &&
+                texture.getNumImages() == 1)
+            {
+                osg::ref_ptr<osg::Image> compressed = ImageUtils::compressImage(texture.getImage(0));
+                if (compressed.valid())
+                {
+                    texture.setImage(0, compressed.get());
+                    texture.setInternalFormatMode(osg::Texture::USE_IMAGE_DATA_FORMAT);
+                    texture.setUseHardwareMipMapGeneration(false);
+                    return;
+                }
+            }
+
+            ImageUtils::generateMipmaps(&texture);
+        }
+
+        bool _compressTextures;
+        std::set<osg::Texture*> _seen;
+    };
+
+    class LoadContentOperation : public osg::Operation, public osgUtil::IncrementalCompileOperation::CompileCompletedCallback
+    {
+    public:
+        LoadContentOperation(ThreeDTilesetNode* tileset, const URI& uri, osgDB::Options* options, osgEarth::Threading::Promise<osg::Node> promise) :
+            _uri(uri),
+            _promise(promise),
+            _options(options),
+            _tileset(tileset)
+        {
+            // Get the currently active request layer and reuse it when the operator actually occurs, which will probably be on a different thread.
+            _requestLayer = NetworkMonitor::getRequestLayer();
+        }
+
+        void operator()(osg::Object*)
+        {
+            OE_PROFILING_ZONE_NAMED("3DTiles loadContent");
+            OE_PROFILING_ZONE_TEXT(_uri.full());
+
+            NetworkMonitor::ScopedRequestLayer layerRequest(_requestLayer);
+
+            osg::ref_ptr<ThreeDTilesetNode> tileset;
+            if (!_promise.isAbandoned() && _tileset.lock(tileset))
+            {
+                osgEarth::ReadResult result = _uri.readNode(_options.get());
+
+                if (result.succeeded() && !_promise.isAbandoned())
+                {
+                    {
+                        OE_PROFILING_ZONE_NAMED("Prepare");
+                        PrepareContentVisitor prepare(tileset->getCompressTextures());
+                        result.getNode()->accept(prepare);
+                    }
+
+                    {
+                        // Tiles from one tileset tend to repeat their materials;
+                        // share them before the compile so each uploads once.
+                        OE_PROFILING_ZONE_NAMED("Share state");
+                        Registry::stateSetCache()->optimize(result.getNode());
+                    }
+
+                    // If we have an ICO, wait for it to be compiled. If the viewer
+                    // has compile contexts, the ICO uploads on those.
+                    osg::ref_ptr<osgUtil::IncrementalCompileOperation> ico =
+                        OptionsData<osgUtil::IncrementalCompileOperation>::get(_options.get(), "osg::ico");
+
+                    if (ico.valid())
+                    {
+                        OE_PROFILING_ZONE_NAMED("ICO compile");
+
+                        _compileSet = new osgUtil::IncrementalCompileOperation::CompileSet(result.getNode());
+                        _compileSet->_compileCompletedCallback = this;
+                        ico->add(_compileSet.get());
+
+                        unsigned int numTries = 0;
+                        // block until the compile completes, checking once and a while for
+                        // an abandoned operation (to avoid deadlock)
+                        while (!_block.wait(10)) // 10ms
+                        {
+                            // Limit the number of tries and give up after awhile to avoid the case where the ICO still has work to do but the application has exited.
+                            ++numTries;
+                            if (_promise.isAbandoned() || numTries == 1000)
+                            {
+                                _compileSet->_compileCompletedCallback = NULL;
+                                ico->remove(_compileSet.get());
+                                _compileSet = 0;
+                                break;
+                            }
+                        }
+                    }
+                }
+
+                _promise.resolve(result.getNode());
+            }
+        }
+
+        bool compileCompleted(osgUtil::IncrementalCompileOperation::CompileSet* compileSet)
+        {
+            // Clear the _compileSet to avoid keeping a circular reference to the content.
+            _compileSet = 0;
+            // release the wait.
+            _block.set();
+            return true;
+        }
+
+        osgEarth::Threading::Promise<osg::Node> _promise;
+        osg::ref_ptr< osgDB::Options > _options;
+        osg::observer_ptr<ThreeDTilesetNode> _tileset;
+        osg::ref_ptr<osgUtil::IncrementalCompileOperation::CompileSet> _compileSet;
+        Threading::Event _block;
+        URI _uri;
+        std::string _requestLayer;
+    };
+
+    Threading::Future<osg::Node> readContentAsync(ThreeDTilesetNode* tileset, const URI& uri, osgDB::Options* options)
+    {
+        osg::ref_ptr<ThreadPool> threadPool;
+        if (options)
+        {
+            threadPool = ThreadPool::get(options);
+        }
+
+        Threading::Promise<osg::Node> promise;
+
+        osg::ref_ptr< osg::Operation > operation = new LoadContentOperation(tileset, uri, options, promise);
+
+        if (threadPool.valid())
+        {
+            threadPool->run(operation.get());
+        }
+        else
+        {
+            OE_WARN << "Immediately resolving async operation, please set a ThreadPool on the Options object" << std::endl;
+            operation->operator()(0);
+        }
+
+        return promise.getFuture();
+    }
+
+    // Adds up the sizes of the vertex, index and texture data under a node,
+    // counting shared data once. Nested tiles account for their own content.
+    struct ContentSizeVisitor : public osg::NodeVisitor
+    {
+        ContentSizeVisitor() :
+            osg::NodeVisitor(TRAVERSE_ALL_CHILDREN),
+            _bytes(0) { }
+
+        void apply(osg::Node& node)
+        {
+            apply(node.getStateSet());
+            traverse(node);
+        }
+
+        void apply(osg::Transform& node)
+        {
+            if (dynamic_cast<ThreeDTileNode*>(&node) == 0L)
+                apply(static_cast<osg::Node&>(node));
+        }
+
+        void apply(osg::Drawable& drawable)
+        {
+            apply(drawable.getStateSet());
+
+            osg::Geometry* geom = drawable.asGeometry();
+            if (geom)
+            {
+                osg::Geometry::ArrayList arrays;
+                geom->getArrayList(arrays);
+                for (unsigned i = 0; i < arrays.size(); ++i)
+                    add(arrays[i].get());
+
+                for (unsigned i = 0; i < geom->getNumPrimitiveSets(); ++i)
+                    add(geom->getPrimitiveSet(i)->getDrawElements());
+            }
+        }
+
+        void apply(osg::StateSet* stateSet)
+        {
+            if (stateSet == 0L)
+                return;
+
+            const osg::StateSet::TextureAttributeList& units = stateSet->getTextureAttributeList();
+            for (unsigned u = 0; u < units.size(); ++u)
+            {
+                for (osg::StateSet::AttributeList::const_iterator i = units[u].begin(); i != units[u].end(); ++i)
+                {
+                    osg::Texture* tex = dynamic_cast<osg::Texture*>(i->second.first.get());
+                    if (tex && _seen.insert(tex).second)
+                        add(tex);
+                }
+            }
+        }
+
+        void add(const osg::BufferData* data)
+        {
+            if (data && _seen.insert(data).second)
+                _bytes += data->getTotalDataSize();
+        }
+
+        void add(const osg::Texture* tex)
+        {
+            bool hasImages = false;
+            for (unsigned i = 0; i < tex->getNumImages(); ++i)
+            {
+                const osg::Image* image = tex->getImage(i);
+                if (image && image->data())
+                {
+                    _bytes += image->getTotalSizeInBytesIncludingMipmaps();
+                    hasImages = true;
+                }
+            }
+
+            // Images released after GL compilation: estimate RGBA8 plus mipmaps
+            if (!hasImages)
+            {
+                size_t texels =
+                    (size_t)osg::maximum(tex->getTextureWidth(), 1) *
+                    (size_t)osg::maximum(tex->getTextureHeight(), 1) *
+                    (size_t)osg::maximum(tex->getTextureDepth(), 1);
+
+                _bytes += (texels * 4u * 4u) / 3u;
+            }
+        }
+
+        size_t _bytes;
+        std::set<const osg::Object*> _seen;
+    };
+
+    std::atomic<size_t> s_globalMemoryUsage(0u);
+    std::atomic<size_t> s_globalMaxMemory(0u);
+    const Util::Gauge s_contentBytes = Util::Memory::getCPUGauge("3dtiles");
+
+    size_t computeContentSize(osg::Node* node)
+    {
+        if (node == 0L)
+            return 0u;
+
+        ContentSizeVisitor visitor;
+        node->accept(visitor);
+        return visitor._bytes;
+    }
+}
+
+namespace
+{
+    // Deepest tile level that gets its own fallback depth offset
+    const unsigned int MAX_FALLBACK_DEPTH = 31u;
 }
 
 ThreeDTileNode::ThreeDTileNode(ThreeDTilesetNode* tileset, Tile* tile, bool immediateLoad, osgDB::Options* options) :
     _tileset(tileset),
     _tile(tile),
     _requestedContent(false),
+    _contentBytes(0u),
+    _pendingContentBytes(0u),
+    _lastError(0.0),
     _immediateLoad(immediateLoad),
     _firstVisit(true),
     _options(options),
     _trackerItrValid(false),
+    _requestFrame(0),
+    _requestPriority(0.0),
+    _requestDistance(0.0),
+    _requestQueued(false),
     _lastCulledFrameNumber(0),
     _lastCulledFrameTime(0.0f),
     _refine(REFINE_ADD)
@@ -665,11 +976,17 @@ ThreeDTileNode::ThreeDTileNode(ThreeDTilesetNode* tileset, Tile* tile, bool imme
         else
         {
             _content = uri.getNode(_options.get());
+            if (_content.valid())
+            {
+                PrepareContentVisitor prepare(_tileset->getCompressTextures());
+                _content->accept(prepare);
+            }
         }
         if (_content.valid())
         {
             _tileset->runPreMergeOperations(_content.get());
             _tileset->runPostMergeOperations(_content.get());
+            setContentSize(computeContentSize(_content.get()));
         }
         OE_PROFILING_ZONE_TEXT("Immediate load");
     }
@@ -699,6 +1016,11 @@ ThreeDTileNode::ThreeDTileNode(ThreeDTilesetNode* tileset, Tile* tile, bool imme
     createDebugBounds();
 }
 
+ThreeDTileNode::~ThreeDTileNode()
+{
+    setContentSize(0u);
+}
+
 void ThreeDTileNode::setParentTile(ThreeDTileNode* parentTile)
 {
     _parentTile = parentTile;
@@ -897,7 +1219,19 @@ void ThreeDTileNode::resolveContent()
     // Resolve the future
     if (!_content.valid() && _requestedContent && _contentFuture.isAvailable())
     {
+        // Wait for room in this frame's upload budget
+        if (_pendingContentBytes == 0u)
+        {
+            _pendingContentBytes = osg::maximum(computeContentSize(_contentFuture.get()), (size_t)1u);
+        }
+
+        if (!_tileset->reserveUpload(_pendingContentBytes))
+        {
+            return;
+        }
+
         _content = _contentFuture.release();
+        _pendingContentBytes = 0u;
 
         if (_content.valid())
         {
@@ -914,21 +1248,66 @@ void ThreeDTileNode::resolveContent()
 
             _tileset->runPreMergeOperations(_content.get());
             _tileset->runPostMergeOperations(_content.get());
+
+            setContentSize(computeContentSize(_content.get()));
+        }
+    }
+}
+
+void ThreeDTileNode::setContentSize(size_t bytes)
+{
+    if (bytes != _contentBytes)
+    {
+        _tileset->adjustMemoryUsage(bytes, _contentBytes);
+        _contentBytes = bytes;
+    }
+}
+
+bool ThreeDTileNode::isRefinedByVisibleChild(unsigned int frameNumber) const
+{
+    if (_refine != REFINE_REPLACE || !_children.valid())
+        return false;
+
+    for (unsigned int i = 0; i < _children->getNumChildren(); ++i)
+    {
+        const ThreeDTileNode* child = dynamic_cast<const ThreeDTileNode*>(_children->getChild(i));
+        if (child &&
+            child->_content.valid() &&
+            child->getLastCulledFrameNumber() + 1u >= frameNumber)
+        {
+            return true;
         }
     }
+    return false;
 }
 
 
-void ThreeDTileNode::requestContent(osgUtil::IncrementalCompileOperation* ico)
+void ThreeDTileNode::requestContent(osgUtil::IncrementalCompileOperation* ico, osgUtil::CullVisitor* cv)
+{
+    if (!_content.valid() && hasContent())
+    {
+        _tileset->requestContent(
+            this,
+            computeScreenSpaceError(cv),
+            getDistanceToTile(cv),
+            cv->getFrameStamp()->getFrameNumber(),
+            ico);
+    }
+}
+
+void ThreeDTileNode::startContentRequest()
 {
     if (!_content.valid() && !_requestedContent && hasContent())
     {
         // if there's an ICO, install it:
+        osg::ref_ptr<osgUtil::IncrementalCompileOperation> ico;
+        _requestICO.lock(ico);
+
         osg::ref_ptr<osgDB::Options> localOptions;
-        if (ico)
+        if (ico.valid())
         {
             localOptions = Registry::instance()->cloneOrCreateOptions(_options.get());
-            OptionsData<osgUtil::IncrementalCompileOperation>::set(localOptions.get(), "osg::ico", ico);
+            OptionsData<osgUtil::IncrementalCompileOperation>::set(localOptions.get(), "osg::ico", ico.get());
         }
         else
         {
@@ -951,12 +1330,27 @@ void ThreeDTileNode::requestContent(osgUtil::IncrementalCompileOperation* ico)
         }
         else
         {
-            _contentFuture = uri.readNodeAsync(localOptions.get(), NULL);
+            _contentFuture = readContentAsync(_tileset, uri, localOptions.get());
         }
         _requestedContent = true;
     }
 }
 
+void ThreeDTileNode::cancelContentRequest()
+{
+    if (_requestedContent && !_content.valid())
+    {
+        _contentFuture.cancel();
+        _contentFuture = Future<osg::Node>();
+        _requestedContent = false;
+    }
+}
+
+bool ThreeDTileNode::isContentRequestComplete() const
+{
+    return _content.valid() || _contentFuture.isAvailable();
+}
+
 double ThreeDTileNode::getDistanceToTile(osgUtil::CullVisitor* cv)
 {
     osg::BoundingSphere bs = _localBoundingSphere;
@@ -1001,6 +1395,8 @@ bool ThreeDTileNode::unloadContent()
 
     _firstVisit = true;
     _content = 0;
+    setContentSize(0u);
+    _pendingContentBytes = 0u;
     _requestedContent = false;
     _contentFuture = Future<osg::Node>();
 
@@ -1089,8 +1485,14 @@ void ThreeDTileNode::traverse(osg::NodeVisitor& nv)
             ico = osgView->getDatabasePager()->getIncrementalCompileOperation();
         }
 
+        if (_tileset->getSkipLevelOfDetail())
+        {
+            traverseSkipLOD(cv, ico);
+            return;
+        }
+
         // This allows nodes to reload themselves
-        requestContent(ico);
+        requestContent(ico, cv);
         resolveContent();
 
         // Compute the SSE
@@ -1111,7 +1513,7 @@ void ThreeDTileNode::traverse(osg::NodeVisitor& nv)
                     // Can we traverse the child?
                     if (childTile->hasContent() && !childTile->isContentReady())
                     {
-                        childTile->requestContent(ico);
+                        childTile->requestContent(ico, cv);
                         areChildrenReady = false;
                     }
                 }
@@ -1212,14 +1614,130 @@ void ThreeDTileNode::traverse(osg::NodeVisitor& nv)
 
 }
 
+void ThreeDTileNode::traverseSkipLOD(osgUtil::CullVisitor* cv, osgUtil::IncrementalCompileOperation* ico)
+{
+    resolveContent();
+
+    double error = computeScreenSpaceError(cv);
+    _lastError = error;
+
+    updateTracking(cv);
+
+    bool refine =
+        error > _tileset->getMaximumScreenSpaceError() &&
+        _children.valid() &&
+        _children->getNumChildren() > 0;
+
+    // Find this tile's depth and its nearest ancestor with content
+    // loaded or on the way.
+    unsigned int depth = 0;
+    unsigned int levelsToAncestor = 0;
+    const ThreeDTileNode* ancestor = 0L;
+    const osg::NodePath& path = cv->getNodePath();
+    for (int i = (int)path.size() - 1; i >= 0; --i)
+    {
+        const ThreeDTileNode* tile = dynamic_cast<const ThreeDTileNode*>(path[i]);
+        if (tile && tile != this)
+        {
+            ++depth;
+            if (!ancestor && (tile->_content.valid() || tile->_requestedContent))
+            {
+                ancestor = tile;
+                levelsToAncestor = depth;
+            }
+        }
+    }
+
+    // Tiles at the desired level always load, as does additive content and
+    // anything coarser than the base error. In between, load only the tiles
+    // that make a big enough jump from the ancestor.
+    bool loadContent = true;
+    if (refine && _refine == REFINE_REPLACE && error <= _tileset->getBaseScreenSpaceError())
+    {
+        if (_tileset->getImmediatelyLoadDesiredLevelOfDetail())
+        {
+            loadContent = false;
+        }
+        else if (ancestor)
+        {
+            loadContent =
+                error * _tileset->getSkipScreenSpaceErrorFactor() <= ancestor->_lastError &&
+                levelsToAncestor > _tileset->getSkipLevels();
+        }
+    }
+
+    if (loadContent)
+    {
+        requestContent(ico, cv);
+    }
+
+    if (refine)
+    {
+        bool areChildrenReady = true;
+        for (unsigned int i = 0; i < _children->getNumChildren(); i++)
+        {
+            osg::ref_ptr< ThreeDTileNode > childTile = dynamic_cast<ThreeDTileNode*>(_children->getChild(i));
+            if (childTile.valid() && childTile->hasContent() && !childTile->isContentReady())
+            {
+                areChildrenReady = false;
+            }
+        }
+
+        if (_content.valid())
+        {
+            if (_refine == REFINE_ADD)
+            {
+                _content->accept(*cv);
+            }
+            else if (!areChildrenReady)
+            {
+                // Stand in for the missing descendants, behind the ones that are loaded.
+                cv->pushStateSet(_tileset->getFallbackStateSet(depth));
+                _content->accept(*cv);
+                cv->popStateSet();
+            }
+        }
+
+        if (_tileset->getShowBoundingVolumes() && _boundsDebug.valid())
+        {
+            _boundsDebug->accept(*cv);
+        }
+
+        _children->accept(*cv);
+    }
+    else
+    {
+        if (_content.valid())
+        {
+            _content->accept(*cv);
+        }
+
+        if (_tileset->getShowBoundingVolumes() && _boundsDebug.valid())
+        {
+            _boundsDebug->accept(*cv);
+        }
+    }
+}
+
 ThreeDTilesetNode::ThreeDTilesetNode(Tileset* tileset, const std::string& authorizationHeader, SceneGraphCallbacks* sceneGraphCallbacks, osgDB::Options* options) :
     _tileset(tileset),
     _options(options),
     _maximumScreenSpaceError(15.0f),
     _maxTiles(50),
+    _maxActiveRequests(8),
     _showBoundingVolumes(false),
     _showColorPerTile(false),
+    _skipLevelOfDetail(false),
+    _baseScreenSpaceError(1024.0f),
+    _skipScreenSpaceErrorFactor(16.0f),
+    _skipLevels(1u),
+    _immediatelyLoadDesiredLevelOfDetail(false),
     _maxAge(5.0f),
+    _maxMemory(0u),
+    _memoryUsage(0u),
+    _compressTextures(true),
+    _maxUploadBytesPerFrame(16u * 1048576u),
+    _uploadBytesThisFrame(0u),
     _lastExpiredFrame(0),
     _authorizationHeader(authorizationHeader),
     _sgCallbacks(sceneGraphCallbacks),
@@ -1238,6 +1756,48 @@ ThreeDTilesetNode::ThreeDTilesetNode(Tileset* tileset, const std::string& author
         setMaxAge((float)atof(c));
     }
 
+    c = ::getenv("OSGEARTH_3DTILES_MAX_REQUESTS");
+    if (c)
+    {
+        setMaxActiveRequests((unsigned)atoi(c));
+    }
+
+    // memory budgets are in megabytes
+    c = ::getenv("OSGEARTH_3DTILES_MAX_MEMORY");
+    if (c)
+    {
+        setMaxMemory((size_t)atof(c) * 1048576u);
+    }
+
+    c = ::getenv("OSGEARTH_3DTILES_GLOBAL_MAX_MEMORY");
+    if (c)
+    {
+        setGlobalMaxMemory((size_t)atof(c) * 1048576u);
+    }
+
+    c = ::getenv("OSGEARTH_3DTILES_MAX_UPLOAD");
+    if (c)
+    {
+        setMaxUploadBytesPerFrame((size_t)atof(c) * 1048576u);
+    }
+
+    c = ::getenv("OSGEARTH_3DTILES_SKIP_LOD");
+    if (c)
+    {
+        setSkipLevelOfDetail(atoi(c) != 0);
+    }
+
+    // Fallback tiles are pushed back in depth, coarser ones further, so
+    // every loaded descendant draws in front of its ancestors.
+    _fallbackStateSets.resize(MAX_FALLBACK_DEPTH + 1u);
+    for (unsigned int depth = 0; depth <= MAX_FALLBACK_DEPTH; ++depth)
+    {
+        osg::StateSet* stateSet = new osg::StateSet();
+        float units = 4.0f * (float)(MAX_FALLBACK_DEPTH + 1u - depth);
+        stateSet->setAttributeAndModes(new osg::PolygonOffset(1.0f, units), osg::StateAttribute::ON);
+        _fallbackStateSets[depth] = stateSet;
+    }
+
     _tracker.push_back(0);
     // Pointer to last element
     _sentryItr = --_tracker.end();
@@ -1252,6 +1812,14 @@ ThreeDTilesetNode::ThreeDTilesetNode(Tileset* tileset, const std::string& author
     }
 }
 
+ThreeDTilesetNode::~ThreeDTilesetNode()
+{
+    // Release the tiles while this node is intact, so they can settle
+    // their memory accounting
+    _tracker.clear();
+    removeChildren(0, getNumChildren());
+}
+
 const std::string&
 ThreeDTilesetNode::getOwnerName() const
 {
@@ -1285,6 +1853,100 @@ void ThreeDTilesetNode::setMaxAge(float maxAge)
     _maxAge = maxAge;
 }
 
+size_t ThreeDTilesetNode::getMaxMemory() const
+{
+    return _maxMemory;
+}
+
+void ThreeDTilesetNode::setMaxMemory(size_t bytes)
+{
+    _maxMemory = bytes;
+}
+
+size_t ThreeDTilesetNode::getMemoryUsage() const
+{
+    return _memoryUsage;
+}
+
+size_t ThreeDTilesetNode::getGlobalMaxMemory()
+{
+    return s_globalMaxMemory;
+}
+
+void ThreeDTilesetNode::setGlobalMaxMemory(size_t bytes)
+{
+    s_globalMaxMemory = bytes;
+}
+
+size_t ThreeDTilesetNode::getGlobalMemoryUsage()
+{
+    return s_globalMemoryUsage;
+}
+
+void ThreeDTilesetNode::adjustMemoryUsage(size_t addBytes, size_t removeBytes)
+{
+    _memoryUsage += addBytes;
+    _memoryUsage -= removeBytes;
+    s_globalMemoryUsage += addBytes;
+    s_globalMemoryUsage -= removeBytes;
+    s_contentBytes.add((std::int64_t)addBytes - (std::int64_t)removeBytes);
+}
+
+bool ThreeDTilesetNode::getCompressTextures() const
+{
+    return _compressTextures;
+}
+
+void ThreeDTilesetNode::setCompressTextures(bool compressTextures)
+{
+    _compressTextures = compressTextures;
+}
+
+size_t ThreeDTilesetNode::getMaxUploadBytesPerFrame() const
+{
+    return _maxUploadBytesPerFrame;
+}
+
+void ThreeDTilesetNode::setMaxUploadBytesPerFrame(size_t bytes)
+{
+    _maxUploadBytesPerFrame = bytes;
+}
+
+bool ThreeDTilesetNode::reserveUpload(size_t bytes)
+{
+    if (_maxUploadBytesPerFrame == 0u)
+        return true;
+
+    // Always let the first tile of a frame through, however large
+    size_t used = _uploadBytesThisFrame.load();
+    do
+    {
+        if (used > 0u && used + bytes > _maxUploadBytesPerFrame)
+            return false;
+    }
+    while (!_uploadBytesThisFrame.compare_exchange_weak(used, used + bytes));
+
+    return true;
+}
+
+bool ThreeDTilesetNode::isOverMemoryBudget() const
+{
+    size_t globalMax = s_globalMaxMemory;
+    return
+        (_maxMemory > 0u && _memoryUsage > _maxMemory) ||
+        (globalMax > 0u && s_globalMemoryUsage > globalMax);
+}
+
+unsigned int ThreeDTilesetNode::getMaxActiveRequests() const
+{
+    return _maxActiveRequests;
+}
+
+void ThreeDTilesetNode::setMaxActiveRequests(unsigned int maxActiveRequests)
+{
+    _maxActiveRequests = osg::maximum(maxActiveRequests, 1u);
+}
+
 float ThreeDTilesetNode::getMaximumScreenSpaceError() const
 {
     return _maximumScreenSpaceError;
@@ -1295,6 +1957,61 @@ void ThreeDTilesetNode::setMaximumScreenSpaceError(float maximumScreenSpaceError
     _maximumScreenSpaceError = maximumScreenSpaceError;
 }
 
+bool ThreeDTilesetNode::getSkipLevelOfDetail() const
+{
+    return _skipLevelOfDetail;
+}
+
+void ThreeDTilesetNode::setSkipLevelOfDetail(bool skipLevelOfDetail)
+{
+    _skipLevelOfDetail = skipLevelOfDetail;
+}
+
+float ThreeDTilesetNode::getBaseScreenSpaceError() const
+{
+    return _baseScreenSpaceError;
+}
+
+void ThreeDTilesetNode::setBaseScreenSpaceError(float baseScreenSpaceError)
+{
+    _baseScreenSpaceError = baseScreenSpaceError;
+}
+
+float ThreeDTilesetNode::getSkipScreenSpaceErrorFactor() const
+{
+    return _skipScreenSpaceErrorFactor;
+}
+
+void ThreeDTilesetNode::setSkipScreenSpaceErrorFactor(float skipScreenSpaceErrorFactor)
+{
+    _skipScreenSpaceErrorFactor = osg::maximum(skipScreenSpaceErrorFactor, 1.0f);
+}
+
+unsigned int ThreeDTilesetNode::getSkipLevels() const
+{
+    return _skipLevels;
+}
+
+void ThreeDTilesetNode::setSkipLevels(unsigned int skipLevels)
+{
+    _skipLevels = skipLevels;
+}
+
+bool ThreeDTilesetNode::getImmediatelyLoadDesiredLevelOfDetail() const
+{
+    return _immediatelyLoadDesiredLevelOfDetail;
+}
+
+void ThreeDTilesetNode::setImmediatelyLoadDesiredLevelOfDetail(bool value)
+{
+    _immediatelyLoadDesiredLevelOfDetail = value;
+}
+
+osg::StateSet* ThreeDTilesetNode::getFallbackStateSet(unsigned int depth) const
+{
+    return _fallbackStateSets[osg::minimum(depth, MAX_FALLBACK_DEPTH)].get();
+}
+
 bool ThreeDTilesetNode::getShowBoundingVolumes() const
 {
     return _showBoundingVolumes;
@@ -1372,6 +2089,114 @@ void ThreeDTilesetNode::touchTile(ThreeDTileNode* node)
     node->_trackerItr = --_tracker.end();
 }
 
+void ThreeDTilesetNode::requestContent(
+    ThreeDTileNode* node,
+    double screenSpaceError,
+    double distance,
+    unsigned int frameNumber,
+    osgUtil::IncrementalCompileOperation* ico)
+{
+    ScopedMutexLock lock(_requestMutex);
+
+    // keep the most urgent priority any camera asked for this frame
+    if (node->_requestFrame != frameNumber ||
+        screenSpaceError > node->_requestPriority)
+    {
+        node->_requestPriority = screenSpaceError;
+        node->_requestDistance = distance;
+    }
+    node->_requestFrame = frameNumber;
+    node->_requestICO = ico;
+
+    if (!node->_requestQueued && !node->isContentRequested())
+    {
+        node->_requestQueued = true;
+        _queuedRequests.push_back(node);
+    }
+}
+
+namespace
+{
+    // Coarse, nearby tiles first: highest screen-space error, then nearest
+    struct HigherRequestPriority
+    {
+        bool operator()(const osg::ref_ptr<ThreeDTileNode>& lhs, const osg::ref_ptr<ThreeDTileNode>& rhs) const
+        {
+            if (lhs->_requestPriority != rhs->_requestPriority)
+                return lhs->_requestPriority > rhs->_requestPriority;
+            return lhs->_requestDistance < rhs->_requestDistance;
+        }
+    };
+}
+
+void ThreeDTilesetNode::dispatchRequests(const osg::NodeVisitor& nv)
+{
+    OE_PROFILING_ZONE;
+
+    unsigned int frameNumber = nv.getFrameStamp()->getFrameNumber();
+
+    ScopedMutexLock lock(_requestMutex);
+
+    // Cull runs after update, so a tile still in view asked again last frame.
+    // Older requests belong to tiles that are no longer visible.
+    unsigned int oldestFrame = frameNumber > 0 ? frameNumber - 1 : 0;
+
+    // Retire finished requests and cancel those nobody wants anymore.
+    unsigned int numActive = 0;
+    for (unsigned int i = 0; i < _activeRequests.size(); ++i)
+    {
+        osg::ref_ptr<ThreeDTileNode> tile;
+        if (!_activeRequests[i].lock(tile) || !tile->isContentRequested() || tile->isContentRequestComplete())
+            continue;
+
+        if (tile->_requestFrame < oldestFrame)
+        {
+            tile->cancelContentRequest();
+            continue;
+        }
+
+        _activeRequests[numActive++] = tile.get();
+    }
+    _activeRequests.resize(numActive);
+
+    // Collect the queued requests that are still wanted, in priority order.
+    std::vector< osg::ref_ptr<ThreeDTileNode> > queued;
+    for (unsigned int i = 0; i < _queuedRequests.size(); ++i)
+    {
+        osg::ref_ptr<ThreeDTileNode> tile;
+        if (!_queuedRequests[i].lock(tile))
+            continue;
+
+        if (tile->_requestFrame < oldestFrame || tile->isContentRequested() || tile->getContent())
+        {
+            tile->_requestQueued = false;
+            continue;
+        }
+
+        queued.push_back(tile);
+    }
+    _queuedRequests.clear();
+
+    std::sort(queued.begin(), queued.end(), HigherRequestPriority());
+
+    // Start as many as the cap allows; the rest wait for a later frame.
+    for (unsigned int i = 0; i < queued.size(); ++i)
+    {
+        ThreeDTileNode* tile = queued[i].get();
+        if (_activeRequests.size() < _maxActiveRequests)
+        {
+            tile->_requestQueued = false;
+            tile->startContentRequest();
+            if (tile->isContentRequested())
+                _activeRequests.push_back(tile);
+        }
+        else
+        {
+            _queuedRequests.push_back(tile);
+        }
+    }
+}
+
 void ThreeDTilesetNode::expireTiles(const osg::NodeVisitor& nv)
 {
     OE_PROFILING_ZONE;
@@ -1391,18 +2216,31 @@ void ThreeDTilesetNode::expireTiles(const osg::NodeVisitor& nv)
 
     unsigned int numErased = 0;
     unsigned int numSkipped = 0;
-    while (_tracker.size() > _maxTiles && itr != _sentryItr)
+    bool overBudget = isOverMemoryBudget();
+    while ((_tracker.size() > _maxTiles || overBudget) && itr != _sentryItr)
     {
         osg::ref_ptr< ThreeDTileNode > tile = dynamic_cast<ThreeDTileNode*>(itr->get());
         if (tile.valid())
         {
+            // Over the memory budget, anything not drawn last frame can go.
             float age = frameTime - tile->getLastCulledFrameTime();
-            bool canUnload = age >= _maxAge;
+            bool canUnload =
+                age >= _maxAge ||
+                (overBudget && tile->getLastCulledFrameNumber() + 1u < frameNumber);
+
+            // Under REPLACE refinement a visible child falls back on its
+            // parent's content, so keep the parent around.
+            if (canUnload && tile->isRefinedByVisibleChild(frameNumber))
+            {
+                canUnload = false;
+            }
+
             if (canUnload && tile->unloadContent())
             {
                 tile->_trackerItrValid = false;
                 itr = _tracker.erase(itr);
                 ++numErased;
+                overBudget = isOverMemoryBudget();
             }
             else
             {
@@ -1423,7 +2261,7 @@ void ThreeDTilesetNode::expireTiles(const osg::NodeVisitor& nv)
     {
         OE_NOTICE << "Erased " << numErased << " and skipped " << numSkipped << " in " << osg::Timer::instance()->delta_m(startTime, endTime) << "ms" << std::endl;
     }
-    OE_NOTICE << "Tiles in memory " << _tracker.size() << " max tiles=" << _maxTiles << std::endl;
+    OE_NOTICE << "Tiles in memory " << _tracker.size() << " max tiles=" << _maxTiles << " bytes=" << _memoryUsage << std::endl;
 #endif
 
     // Erase the sentry and stick it at the end of the list
@@ -1441,6 +2279,8 @@ void ThreeDTilesetNode::traverse(osg::NodeVisitor& nv)
         if (nv.getFrameStamp()->getFrameNumber() > _lastExpiredFrame)
         {
             expireTiles(nv);
+            dispatchRequests(nv);
+            _uploadBytesThisFrame = 0u;
             _lastExpiredFrame = nv.getFrameStamp()->getFrameNumber();
         }
     }
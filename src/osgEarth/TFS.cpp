@@ -28,6 +28,7 @@
 #include <osgEarth/ScaleFilter>
 #include <osgEarth/MVT>
 #include <osgEarth/OgrUtils>
+#include <osgEarth/OGRFeatureSource>
 #include <osgEarth/FeatureCursor>
 
 #include <osg/Notify>
@@ -257,8 +258,6 @@ TFSFeatureSource::openImplementation()
 FeatureCursor*
 TFSFeatureSource::createFeatureCursorImplementation(const Query& query, ProgressCallback* progress)
 {
-    FeatureCursor* result = 0L;
-
     std::string url = createURL(query);
 
     // the URL wil lbe empty if it was invalid or outside the level bounds of the layer.
@@ -272,26 +271,50 @@ TFSFeatureSource::createFeatureCursorImplementation(const Query& query, Progress
     ReadResult r = uri.readString(getReadOptions(), progress);
 
     const std::string& buffer = r.getString();
-    const Config&      meta = r.metadata();
 
-    bool dataOK = false;
+    if (buffer.empty())
+    {
+        return new FeatureListCursor(FeatureList());
+    }
 
-    FeatureList features;
-    if (!buffer.empty())
+    // Get the mime-type from the metadata record if possible
+    std::string mimeType = r.metadata().value(IOMetadata::CONTENT_TYPE);
+    //If the mimetype is empty then try to set it from the format specification
+    if (mimeType.empty())
+    {
+        if (options().format().value() == "json") mimeType = "json";
+        else if (options().format().value().compare("gml") == 0) mimeType = "text/xml";
+        else if (options().format().value().compare("pbf") == 0) mimeType = "application/x-protobuf";
+    }
+
+    std::string fidAttribute = options().fidAttribute().isSet() ? options().fidAttribute().get() : std::string();
+
+    // GeoJSON and GML are decoded (and filtered) a chunk at a time as the caller
+    // reads them, instead of all at once up front.
+    if (isJSON(mimeType) || isGML(mimeType))
     {
-        // Get the mime-type from the metadata record if possible
-        std::string mimeType = r.metadata().value(IOMetadata::CONTENT_TYPE);
-        //If the mimetype is empty then try to set it from the format specification
-        if (mimeType.empty())
+        FeatureCursor* result = OGR::OGRFeatureCursor::openDocument(
+            buffer,
+            isJSON(mimeType) ? "GeoJSON" : "GML",
+            getExtensionForMimeType(mimeType),
+            this,
+            getFeatureProfile(),
+            query,
+            getFilters(),
+            fidAttribute,
+            progress,
+            *options().rewindPolygons());
+
+        if (!result)
         {
-            if (options().format().value() == "json") mimeType = "json";
-            else if (options().format().value().compare("gml") == 0) mimeType = "text/xml";
-            else if (options().format().value().compare("pbf") == 0) mimeType = "application/x-protobuf";
+            OE_WARN << LC << "Error reading TFS response" << std::endl;
+            result = new FeatureListCursor(FeatureList());
         }
-        dataOK = getFeatures(buffer, *query.tileKey(), mimeType, features);
+        return result;
     }
 
-    if (dataOK)
+    FeatureList features;
+    if (getFeatures(buffer, *query.tileKey(), mimeType, features))
     {
         OE_DEBUG << LC << "Read " << features.size() << " features" << std::endl;
     }
@@ -311,18 +334,17 @@ TFSFeatureSource::createFeatureCursorImplementation(const Query& query, Progress
     }
 
     // If we have any features and we have an fid attribute, override the fid of the features
-    if (options().fidAttribute().isSet())
+    if (!fidAttribute.empty())
     {
         for (FeatureList::iterator itr = features.begin(); itr != features.end(); ++itr)
         {
-            std::string attr = itr->get()->getString(options().fidAttribute().get());
+            std::string attr = itr->get()->getString(fidAttribute);
             FeatureID fid = as<FeatureID>(attr, 0);
             itr->get()->setFID(fid);
         }
     }
 
-    result = new FeatureListCursor(features);
-    return result;
+    return new FeatureListCursor(features);
 }
 
 
@@ -343,60 +365,10 @@ TFSFeatureSource::getFeatures(const std::string& buffer, const TileKey& key, con
         return false;
 #endif
     }
-    else
-    {
-        // find the right driver for the given mime type
-        //OGR_SCOPED_LOCK;
-
-        // find the right driver for the given mime type
-        OGRSFDriverH ogrDriver =
-            isJSON(mimeType) ? OGRGetDriverByName("GeoJSON") :
-            isGML(mimeType) ? OGRGetDriverByName("GML") :
-            0L;
-
-        // fail if we can't find an appropriate OGR driver:
-        if (!ogrDriver)
-        {
-            OE_WARN << LC << "Error reading TFS response; cannot grok content-type \"" << mimeType << "\""
-                << std::endl;
-            return false;
-        }
 
-        OGRDataSourceH ds = OGROpen(buffer.c_str(), FALSE, &ogrDriver);
-
-        if (!ds)
-        {
-            OE_WARN << LC << "Error reading TFS response" << std::endl;
-            return false;
-        }
-
-        // read the feature data.
-        OGRLayerH layer = OGR_DS_GetLayer(ds, 0);
-        if (layer)
-        {
-            const SpatialReference* srs = _layer.getSRS();
-
-            OGR_L_ResetReading(layer);
-            OGRFeatureH feat_handle;
-            while ((feat_handle = OGR_L_GetNextFeature(layer)) != NULL)
-            {
-                if (feat_handle)
-                {
-                    osg::ref_ptr<Feature> f = OgrUtils::createFeature(feat_handle, getFeatureProfile(), *_options->rewindPolygons());
-                    if (f.valid() && !isBlacklisted(f->getFID()))
-                    {
-                        features.push_back(f.release());
-                    }
-                    OGR_F_Destroy(feat_handle);
-                }
-            }
-        }
-
-        // Destroy the datasource
-        OGR_DS_Destroy(ds);
-    }
-
-    return true;
+    OE_WARN << LC << "Error reading TFS response; cannot grok content-type \"" << mimeType << "\""
+        << std::endl;
+    return false;
 }
 
 
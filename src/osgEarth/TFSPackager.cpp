@@ -22,11 +22,25 @@
 #include <osgEarth/TFSPackager>
 #include <osgEarth/FileUtils>
 #include <osgEarth/TFS>
+#include <osgEarth/GeneralizeFilter>
+#include <osgEarth/FilterContext>
+#include <osgEarth/Registry>
+#include <osgEarth/Threading>
+#include <osgEarth/MVT>
 #include <osgDB/FileUtils>
+#include <osgDB/Registry>
+#include <cstdio>
+#include <cctype>
+#include <iomanip>
+
+#if defined(OSGEARTH_HAVE_MVT) && defined(OSGEARTH_HAVE_SQLITE3)
+#include <sqlite3.h>
+#endif
 
 #define LC "[TFSPackager] "
 
 using namespace osgEarth;
+using namespace osgEarth::Util;
 using namespace osgEarth::Contrib;
 
 /******************************************************************************************/
@@ -209,82 +223,255 @@ namespace
 
 
     /******************************************************************************************/
-    class WriteFeaturesVisitor : public FeatureTileVisitor
+    class CollectTilesVisitor : public FeatureTileVisitor
     {
     public:
-        WriteFeaturesVisitor(FeatureSource* features, const std::string& dest, CropFilter::Method cropMethod, const SpatialReference* srs):
-          _dest( dest ),
-              _features( features ),
-              _cropMethod( cropMethod ),
-              _srs( srs )
+          virtual void traverse( FeatureTile* tile)
           {
+              if (tile->getFeatures().size() > 0)
+              {
+                  _tiles.push_back( tile );
+              }
+              tile->traverse( this );
+          }
+
+          std::vector< osg::ref_ptr< FeatureTile > > _tiles;
+    };
+
+    /******************************************************************************************/
+
+    // Case-insensitive set of the attributes to write; empty keeps them all.
+    typedef std::set<std::string, CIStringComp> AttributeNames;
+
+    Feature* pruneAttributes( Feature* feature, const AttributeNames& keep )
+    {
+        if (keep.empty())
+            return feature;
+
+        Feature* pruned = new Feature( feature->getGeometry(), feature->getSRS(), Style(), feature->getFID() );
+        const AttributeTable& attrs = feature->getAttrs();
+        for (AttributeTable::const_iterator i = attrs.begin(); i != attrs.end(); ++i)
+        {
+            if (keep.find( i->first ) != keep.end())
+                pruned->set( i->first, i->second );
+        }
+        return pruned;
+    }
+
+    // Crops the features to a tile, simplifies them and drops the unwanted attributes.
+    void prepare( FeatureList& features, const GeoExtent& extent, CropFilter::Method cropMethod, double tolerance, const AttributeNames& keep )
+    {
+        CropFilter cropFilter(cropMethod);
+        FilterContext context(0);
+        context.extent() = extent;
+        cropFilter.push( features, context );
+
+        if (tolerance > 0.0)
+        {
+            GeneralizeFilter generalize(tolerance);
+            generalize.push( features, context );
+        }
+
+        if (!keep.empty())
+        {
+            for (FeatureList::iterator i = features.begin(); i != features.end(); ++i)
+                *i = pruneAttributes( i->get(), keep );
+        }
+    }
+
+    bool isAttributeName( const std::string& name )
+    {
+        if (name.empty() || !(isalpha((unsigned char)name[0]) || name[0] == '_'))
+            return false;
+        for (std::string::const_iterator c = name.begin(); c != name.end(); ++c)
+        {
+            if (!(isalnum((unsigned char)*c) || *c == '_' || *c == ':' || *c == '.'))
+                return false;
+        }
+        return true;
+    }
 
+    /******************************************************************************************/
+
+    class TFSTileWriter
+    {
+    public:
+        TFSTileWriter(FeatureSource* features, const std::string& dest, CropFilter::Method cropMethod, const SpatialReference* srs, double tolerance, const AttributeNames& keep):
+          _features( features ),
+              _dest( dest ),
+              _cropMethod( cropMethod ),
+              _srs( srs ),
+              _tolerance( tolerance ),
+              _keep( keep )
+          {
           }
 
-          virtual void traverse( FeatureTile* tile)
+          void write( FeatureTile* tile )
           {
-              if (tile->getFeatures().size() > 0)
-              {                 
-                  //Actually load up the features
-                  FeatureList features;
-                  for (FeatureIDList::const_iterator i = tile->getFeatures().begin(); i != tile->getFeatures().end(); i++)
+              //Actually load up the features
+              FeatureList features;
+              for (FeatureIDList::const_iterator i = tile->getFeatures().begin(); i != tile->getFeatures().end(); i++)
+              {
+                  osg::ref_ptr< Feature > f;
                   {
-                      Feature* f = _features->getFeature( *i );                  
+                      // feature sources (OGR in particular) can't read concurrently
+                      Threading::ScopedMutexLock lock( _readMutex );
+                      f = _features->getFeature( *i );
+                  }
 
-                      if (f)
-                      {
-                          //Reproject the feature to the dest SRS if it's not already
-                          if (!f->getSRS()->isEquivalentTo( _srs.get() ) )
-                          {
-                              f->transform( _srs.get() );
-                          }
-                          features.push_back( f );
-                      }
-                      else
+                  if (f.valid())
+                  {
+                      //Reproject the feature to the dest SRS if it's not already
+                      if (!f->getSRS()->isEquivalentTo( _srs.get() ) )
                       {
-                          OE_NOTICE << "couldn't get feature " << *i << std::endl;
+                          f->transform( _srs.get() );
                       }
+                      features.push_back( f );
                   }
+                  else
+                  {
+                      OE_NOTICE << "couldn't get feature " << *i << std::endl;
+                  }
+              }
 
-                  //Need to do the cropping again since these are brand new features coming from the feature source.
-                  CropFilter cropFilter(_cropMethod);
-                  FilterContext context(0);
-                  context.extent() = tile->getExtent();
-                  cropFilter.push( features, context );
-
-                  std::string contents = Feature::featuresToGeoJSON( features );
-                  std::stringstream buf;
-                  int x =  tile->getKey().getTileX();
-                  unsigned int numRows, numCols;
-                  tile->getKey().getProfile()->getNumTiles(tile->getKey().getLevelOfDetail(), numCols, numRows);
-                  int y  = numRows - tile->getKey().getTileY() - 1;
+              //Need to do the cropping again since these are brand new features coming from the feature source.
+              prepare( features, tile->getExtent(), _cropMethod, _tolerance, _keep );
 
-                  buf << _dest << "/" << tile->getKey().getLevelOfDetail() << "/" << x << "/" << y << ".json";
-                  std::string filename = buf.str();
-                  //OE_NOTICE << "Writing " << features.size() << " features to " << filename << std::endl;
+              std::string contents = Feature::featuresToGeoJSON( features );
+              std::stringstream buf;
+              int x =  tile->getKey().getTileX();
+              unsigned int numRows, numCols;
+              tile->getKey().getProfile()->getNumTiles(tile->getKey().getLevelOfDetail(), numCols, numRows);
+              int y  = numRows - tile->getKey().getTileY() - 1;
 
-                  if ( !osgDB::fileExists( osgDB::getFilePath(filename) ) )
-                      osgEarth::makeDirectoryForFile( filename );
+              buf << _dest << "/" << tile->getKey().getLevelOfDetail() << "/" << x << "/" << y << ".json";
+              std::string filename = buf.str();
+              //OE_NOTICE << "Writing " << features.size() << " features to " << filename << std::endl;
 
+              if ( !osgDB::fileExists( osgDB::getFilePath(filename) ) )
+                  osgEarth::makeDirectoryForFile( filename );
 
-                  std::fstream output( filename.c_str(), std::ios_base::out );
-                  if ( output.is_open() )
-                  {
-                      output << contents;
-                      output.flush();
-                      output.close();                
-                  }            
+              std::fstream output( filename.c_str(), std::ios_base::out );
+              if ( output.is_open() )
+              {
+                  output << contents;
+                  output.flush();
+                  output.close();
               }
-              tile->traverse( this );        
           }
 
           osg::ref_ptr< FeatureSource > _features;
-          std::string _dest;      
+          std::string _dest;
           CropFilter::Method _cropMethod;
           osg::ref_ptr< const SpatialReference > _srs;
+          double _tolerance;
+          const AttributeNames& _keep;
+          Threading::Mutex _readMutex;
     };
-}
 
+#if defined(OSGEARTH_HAVE_MVT) && defined(OSGEARTH_HAVE_SQLITE3)
+
+    /******************************************************************************************/
+
+    // Minimal MBTiles writer: one transaction for the whole package.
+    class MBTilesWriter
+    {
+    public:
+        MBTilesWriter() : _db(0L), _insert(0L) { }
+
+        ~MBTilesWriter()
+        {
+            if (_insert)
+                sqlite3_finalize( _insert );
+            if (_db)
+            {
+                sqlite3_exec( _db, "COMMIT", 0L, 0L, 0L );
+                sqlite3_close( _db );
+            }
+        }
+
+        bool open( const std::string& filename )
+        {
+            if (osgDB::fileExists( filename ))
+                ::remove( filename.c_str() );
+            else
+                osgEarth::makeDirectoryForFile( filename );
+
+            if (sqlite3_open_v2( filename.c_str(), &_db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, 0L ) != SQLITE_OK)
+            {
+                OE_WARN << LC << "Failed to create " << filename << ": " << sqlite3_errmsg(_db) << std::endl;
+                return false;
+            }
+
+            const char* tables =
+                "CREATE TABLE metadata (name text PRIMARY KEY, value text);"
+                "CREATE TABLE tiles (zoom_level integer, tile_column integer, tile_row integer, tile_data blob);"
+                "CREATE UNIQUE INDEX tile_index on tiles (zoom_level, tile_column, tile_row);"
+                "BEGIN";
+
+            if (sqlite3_exec( _db, tables, 0L, 0L, 0L ) != SQLITE_OK ||
+                sqlite3_prepare_v2( _db, "INSERT OR REPLACE INTO tiles (zoom_level, tile_column, tile_row, tile_data) VALUES (?, ?, ?, ?)", -1, &_insert, 0L ) != SQLITE_OK)
+            {
+                OE_WARN << LC << "Failed to create tables in " << filename << ": " << sqlite3_errmsg(_db) << std::endl;
+                return false;
+            }
+            return true;
+        }
+
+        void putMetadata( const std::string& name, const std::string& value )
+        {
+            sqlite3_stmt* insert = 0L;
+            if (sqlite3_prepare_v2( _db, "INSERT OR REPLACE INTO metadata (name, value) VALUES (?, ?)", -1, &insert, 0L ) == SQLITE_OK)
+            {
+                sqlite3_bind_text( insert, 1, name.c_str(), -1, SQLITE_TRANSIENT );
+                sqlite3_bind_text( insert, 2, value.c_str(), -1, SQLITE_TRANSIENT );
+                sqlite3_step( insert );
+            }
+            sqlite3_finalize( insert );
+        }
+
+        void putTile( const TileKey& key, const std::string& data )
+        {
+            // MBTiles rows count from the bottom
+            unsigned int numRows, numCols;
+            key.getProfile()->getNumTiles( key.getLevelOfDetail(), numCols, numRows );
+
+            sqlite3_bind_int( _insert, 1, key.getLevelOfDetail() );
+            sqlite3_bind_int( _insert, 2, key.getTileX() );
+            sqlite3_bind_int( _insert, 3, numRows - key.getTileY() - 1 );
+            sqlite3_bind_blob( _insert, 4, data.data(), (int)data.size(), SQLITE_TRANSIENT );
+
+            if (sqlite3_step( _insert ) != SQLITE_DONE)
+            {
+                OE_WARN << LC << "Failed to write tile " << key.str() << ": " << sqlite3_errmsg(_db) << std::endl;
+            }
+            sqlite3_reset( _insert );
+            sqlite3_clear_bindings( _insert );
+        }
+
+    private:
+        sqlite3* _db;
+        sqlite3_stmt* _insert;
+    };
+
+    // A tile in the level being written and the features that touch it
+    struct MVTTile
+    {
+        TileKey key;
+        std::vector<unsigned> features;
+        std::string data;
+        std::vector<unsigned> children[4];
+    };
+
+    inline bool intersects( const Bounds& b, const GeoExtent& e )
+    {
+        return
+            b.xMin() <= e.xMax() && b.xMax() >= e.xMin() &&
+            b.yMin() <= e.yMax() && b.yMax() >= e.yMin();
+    }
+
+#endif
+}
 
 /******************************************************************************************/
 
@@ -292,12 +479,71 @@ TFSPackager::TFSPackager():
 _firstLevel( 0 ),
     _maxLevel( 10 ),
     _maxFeatures( 300 ),
-    _method( CropFilter::METHOD_CENTROID )
+    _method( CropFilter::METHOD_CENTROID ),
+    _format( FORMAT_TFS ),
+    _generalize( false ),
+    _generalizeResolution( 256 )
+{
+}
+
+void
+TFSPackager::addReferencedAttributes( const std::string& styles )
 {
+    // [attribute] expressions
+    for (std::string::size_type pos = styles.find('['); pos != std::string::npos; pos = styles.find('[', pos + 1))
+    {
+        std::string::size_type end = styles.find(']', pos + 1);
+        if (end == std::string::npos)
+            break;
+
+        std::string name = trim( styles.substr(pos + 1, end - pos - 1) );
+        if (isAttributeName( name ))
+            _attributes.insert( name );
+    }
+
+    // feature.properties.name and feature.properties["name"] in scripts
+    const std::string prefix = "feature.properties";
+    for (std::string::size_type pos = styles.find(prefix); pos != std::string::npos; pos = styles.find(prefix, pos + 1))
+    {
+        std::string::size_type p = pos + prefix.size();
+        std::string name;
+
+        if (p < styles.size() && styles[p] == '.')
+        {
+            std::string::size_type end = p + 1;
+            while (end < styles.size() && (isalnum((unsigned char)styles[end]) || styles[end] == '_'))
+                ++end;
+            name = styles.substr(p + 1, end - p - 1);
+        }
+        else if (p < styles.size() && styles[p] == '[')
+        {
+            std::string::size_type end = styles.find(']', p + 1);
+            if (end != std::string::npos)
+            {
+                name = trim( styles.substr(p + 1, end - p - 1) );
+                if (name.size() >= 2 && (name[0] == '"' || name[0] == '\'') && name[name.size() - 1] == name[0])
+                    name = name.substr(1, name.size() - 2);
+                else
+                    name.clear();
+            }
+        }
+
+        if (!name.empty())
+            _attributes.insert( name );
+    }
 }
 
 void
 TFSPackager::package( FeatureSource* features, const std::string& destination, const std::string& layername, const std::string& description )
+{
+    if (_format == FORMAT_MVT)
+        packageMVT( features, destination, layername, description );
+    else
+        packageTFS( features, destination, layername, description );
+}
+
+void
+TFSPackager::packageTFS( FeatureSource* features, const std::string& destination, const std::string& layername, const std::string& description )
 {   
     if (!_destSRSString.empty())
     {
@@ -380,8 +626,38 @@ TFSPackager::package( FeatureSource* features, const std::string& destination, c
     }
 #endif
 
-    WriteFeaturesVisitor write(features, destination, _method, _srs.get());
-    root->accept( &write );
+    // TFS tiles are displayed at every level below their own, so simplify them
+    // no further than the tiles deeper levels would show.
+    double tolerance = 0.0;
+    if (_generalize && _generalizeResolution > 0)
+    {
+        TileKey tileKey(highestLevel, 0, 0, profile.get());
+        tolerance = tileKey.getExtent().width() / (double)_generalizeResolution;
+    }
+
+    AttributeNames keep(_attributes.begin(), _attributes.end());
+
+    CollectTilesVisitor collect;
+    root->accept( &collect );
+
+    TFSTileWriter writer(features, destination, _method, _srs.get(), tolerance, keep);
+    Threading::JobArena* arena = Registry::instance()->getJobArena("features.package");
+
+    std::vector<Threading::Future<osg::Referenced> > futures;
+    for (unsigned i = 0; i < collect._tiles.size(); ++i)
+    {
+        Threading::Promise<osg::Referenced> promise;
+        futures.push_back(promise.getFuture());
+
+        FeatureTile* tile = collect._tiles[i].get();
+        Threading::runInJobArena(arena, [promise, tile, &writer]() mutable {
+            writer.write(tile);
+            promise.resolve(0L);
+        });
+    }
+
+    // Wait for everything; the jobs reference our stack.
+    Threading::when_all(futures).get();
 
     //Write out the meta doc
     TFS::Layer layer;
@@ -395,3 +671,215 @@ TFSPackager::package( FeatureSource* features, const std::string& destination, c
 
 }
 
+void
+TFSPackager::packageMVT( FeatureSource* features, const std::string& destination, const std::string& layername, const std::string& description )
+{
+#if defined(OSGEARTH_HAVE_MVT) && defined(OSGEARTH_HAVE_SQLITE3)
+
+    osg::ref_ptr< osgDB::BaseCompressor > compressor = osgDB::Registry::instance()->getObjectWrapperManager()->findCompressor("zlib");
+    if (!compressor.valid())
+    {
+        OE_WARN << LC << "No zlib compressor available; cannot write vector tiles" << std::endl;
+        return;
+    }
+
+    // Vector tiles always use the global mercator grid.
+    const Profile* profile = Registry::instance()->getSphericalMercatorProfile();
+    const SpatialReference* srs = profile->getSRS();
+    AttributeNames keep(_attributes.begin(), _attributes.end());
+
+    // Read everything once; each level is cut from these.
+    std::vector< osg::ref_ptr< Feature > > input;
+    std::vector< Bounds > bounds;
+    std::map< std::string, std::string > fields;
+    Bounds dataBounds;
+    int skipped = 0;
+
+    osg::ref_ptr< FeatureCursor > cursor = features->createFeatureCursor( _query, 0L );
+    while (cursor.valid() && cursor->hasMore())
+    {
+        osg::ref_ptr< Feature > feature = cursor->nextFeature();
+
+        // Mercator can't reach the poles
+        if (feature->getSRS() && feature->getSRS()->isGeographic())
+        {
+            FeatureList clip;
+            clip.push_back( feature );
+            CropFilter cropFilter(CropFilter::METHOD_CROPPING);
+            FilterContext context(0);
+            context.extent() = profile->getLatLongExtent().transform( feature->getSRS() );
+            cropFilter.push( clip, context );
+            if (clip.empty())
+            {
+                skipped++;
+                continue;
+            }
+        }
+
+        if (feature->getSRS() && !feature->getSRS()->isEquivalentTo( srs ))
+        {
+            feature->transform( srs );
+        }
+
+        if (!feature->getGeometry() || !feature->getGeometry()->getBounds().valid() || !feature->getGeometry()->isValid())
+        {
+            OE_NOTICE << "Skipping feature " << feature->getFID() << " with null or invalid geometry" << std::endl;
+            skipped++;
+            continue;
+        }
+
+        feature = pruneAttributes( feature.get(), keep );
+
+        const AttributeTable& attrs = feature->getAttrs();
+        for (AttributeTable::const_iterator i = attrs.begin(); i != attrs.end(); ++i)
+        {
+            fields[i->first] =
+                i->second.first == ATTRTYPE_STRING ? "String" :
+                i->second.first == ATTRTYPE_BOOL ? "Boolean" :
+                "Number";
+        }
+
+        input.push_back( feature );
+        bounds.push_back( feature->getGeometry()->getBounds() );
+        dataBounds.expandBy( bounds.back() );
+    }
+    OE_NOTICE << "Added=" << input.size() << " Skipped=" << skipped << std::endl;
+
+    if (input.empty())
+    {
+        OE_WARN << LC << "No features to package" << std::endl;
+        return;
+    }
+
+    MBTilesWriter db;
+    if (!db.open( destination ))
+        return;
+
+    // Level by level: each tile keeps the features that touch it,
+    // and hands its children the ones that touch them.
+    std::vector< MVTTile > level;
+    {
+        std::vector<TileKey> rootKeys;
+        profile->getRootKeys( rootKeys );
+        for (unsigned i = 0; i < rootKeys.size(); ++i)
+        {
+            MVTTile tile;
+            tile.key = rootKeys[i];
+            for (unsigned f = 0; f < input.size(); ++f)
+            {
+                if (intersects( bounds[f], tile.key.getExtent() ))
+                    tile.features.push_back( f );
+            }
+            if (!tile.features.empty())
+                level.push_back( tile );
+        }
+    }
+
+    Threading::JobArena* arena = Registry::instance()->getJobArena("features.package");
+    unsigned tiles = 0;
+
+    for (unsigned lod = 0; lod <= _maxLevel && !level.empty(); ++lod)
+    {
+        bool write = lod >= _firstLevel;
+        double tolerance = _generalize && _generalizeResolution > 0 ?
+            level[0].key.getExtent().width() / (double)_generalizeResolution : 0.0;
+
+        std::vector<Threading::Future<osg::Referenced> > futures;
+        for (unsigned t = 0; t < level.size(); ++t)
+        {
+            Threading::Promise<osg::Referenced> promise;
+            futures.push_back(promise.getFuture());
+
+            MVTTile* tile = &level[t];
+            Threading::runInJobArena(arena, [this, promise, tile, write, tolerance, lod, &input, &bounds, &keep, &layername, compressor]() mutable {
+                if (write)
+                {
+                    FeatureList clipped;
+                    for (unsigned i = 0; i < tile->features.size(); ++i)
+                        clipped.push_back( new Feature( *input[tile->features[i]].get(), osg::CopyOp::DEEP_COPY_ALL ) );
+
+                    prepare( clipped, tile->key.getExtent(), CropFilter::METHOD_CROPPING, tolerance, AttributeNames() );
+
+                    std::string encoded;
+                    if (!clipped.empty() && MVT::writeTile( clipped, tile->key, layername, encoded ))
+                    {
+                        std::stringstream buf;
+                        compressor->compress( buf, encoded );
+                        tile->data = buf.str();
+                    }
+                }
+
+                if (lod < _maxLevel)
+                {
+                    for (unsigned c = 0; c < 4; ++c)
+                    {
+                        GeoExtent childExtent = tile->key.createChildKey( c ).getExtent();
+                        for (unsigned i = 0; i < tile->features.size(); ++i)
+                        {
+                            if (intersects( bounds[tile->features[i]], childExtent ))
+                                tile->children[c].push_back( tile->features[i] );
+                        }
+                    }
+                }
+                promise.resolve(0L);
+            });
+        }
+
+        // Wait for everything; the jobs reference our stack.
+        Threading::when_all(futures).get();
+
+        std::vector< MVTTile > next;
+        for (unsigned t = 0; t < level.size(); ++t)
+        {
+            MVTTile& tile = level[t];
+            if (!tile.data.empty())
+            {
+                db.putTile( tile.key, tile.data );
+                tiles++;
+            }
+
+            for (unsigned c = 0; c < 4; ++c)
+            {
+                if (!tile.children[c].empty())
+                {
+                    next.push_back( MVTTile() );
+                    next.back().key = tile.key.createChildKey( c );
+                    next.back().features.swap( tile.children[c] );
+                }
+            }
+        }
+        level.swap( next );
+
+        OE_NOTICE << "Level " << lod << ": " << (write ? "wrote " : "skipped ") << futures.size() << " tiles" << std::endl;
+    }
+
+    // Describe the layer the way MBTiles readers expect
+    GeoExtent extent = GeoExtent( srs, dataBounds ).transform( srs->getGeographicSRS() );
+
+    std::stringstream json;
+    json << "{\"vector_layers\":[{\"id\":\"" << layername << "\",\"description\":\"" << description << "\",\"fields\":{";
+    for (std::map<std::string, std::string>::const_iterator i = fields.begin(); i != fields.end(); ++i)
+    {
+        json << (i == fields.begin() ? "" : ",") << "\"" << i->first << "\":\"" << i->second << "\"";
+    }
+    json << "},\"minzoom\":" << _firstLevel << ",\"maxzoom\":" << _maxLevel << "}]}";
+
+    std::stringstream extentBuf;
+    extentBuf << std::setprecision(10) << extent.xMin() << "," << extent.yMin() << "," << extent.xMax() << "," << extent.yMax();
+
+    db.putMetadata( "name", layername );
+    db.putMetadata( "description", description );
+    db.putMetadata( "format", "pbf" );
+    db.putMetadata( "type", "overlay" );
+    db.putMetadata( "version", "2" );
+    db.putMetadata( "minzoom", Stringify() << _firstLevel );
+    db.putMetadata( "maxzoom", Stringify() << _maxLevel );
+    db.putMetadata( "bounds", extentBuf.str() );
+    db.putMetadata( "json", json.str() );
+
+    OE_NOTICE << "Wrote " << tiles << " tiles to " << destination << std::endl;
+
+#else
+    OE_WARN << LC << "Vector tile output requires osgEarth built with protobuf and sqlite3 support" << std::endl;
+#endif
+}
@@ -919,6 +919,38 @@ TMS::Driver::open(const URI& uri,
     return STATUS_OK;
 }
 
+Status
+TMS::Driver::openFromTileMap(const URI& uri,
+                             const std::string& tileMapXML,
+                             bool isCoverage)
+{
+    _isCoverage = isCoverage;
+
+    Config conf;
+    std::stringstream buf(tileMapXML);
+    conf.fromXML(buf);
+
+    _tileMap = TMS::TileMapReaderWriter::read(conf);
+    if (!_tileMap.valid())
+    {
+        return Status::Error(Status::ResourceUnavailable, "Failed to read cached tile map");
+    }
+
+    _tileMap->setFilename(uri.full());
+    return STATUS_OK;
+}
+
+std::string
+TMS::Driver::getTileMapXML() const
+{
+    if (!_tileMap.valid())
+        return std::string();
+
+    std::stringstream buf;
+    TMS::TileMapReaderWriter::write(_tileMap.get(), buf);
+    return buf.str();
+}
+
 osgEarth::ReadResult
 TMS::Driver::read(const URI& uri,
                   const TileKey& key, 
@@ -1142,6 +1174,27 @@ TMSImageLayer::openImplementation()
 
     osg::ref_ptr<const Profile> profile = getProfile();
 
+    // Without an express profile, the tile map comes from the server;
+    // a cached copy saves the round trip.
+    bool fromServer = !profile.valid() && options().url()->isRemote();
+
+    Config cached;
+    if (fromServer && readCachedMetadata(cached))
+    {
+        Status status = _driver.openFromTileMap(
+            options().url().get(),
+            cached.value("tilemap"),
+            options().coverage().get());
+
+        if (status.isOK())
+            return Status::NoError;
+
+        // bad record; start over from the server
+        dataExtents().clear();
+        dirtyDataExtents();
+        setProfile(NULL);
+    }
+
     Status status = _driver.open(
         options().url().get(),
         profile,
@@ -1158,6 +1211,13 @@ TMSImageLayer::openImplementation()
         setProfile(profile.get());
     }
 
+    if (fromServer)
+    {
+        Config source;
+        source.set("tilemap", _driver.getTileMapXML());
+        writeCachedMetadata(source);
+    }
+
     return Status::NoError;
 }
 
@@ -1180,6 +1240,8 @@ TMSImageLayer::createImageImplementation(const TileKey& key, ProgressCallback* p
 
     if (r.succeeded())
         return GeoImage(r.releaseImage(), key.getExtent());
+    else if (r.code() == ReadResult::RESULT_NOT_FOUND)
+        return GeoImage(Status(Status::ResourceUnavailable, r.errorDetail()));
     else
         return GeoImage(Status(r.errorDetail()));
 }
@@ -1261,6 +1323,12 @@ TMSElevationLayer::openImplementation()
     return Status::NoError;
 }
 
+bool
+TMSElevationLayer::hasNewerMetadata() const
+{
+    return _imageLayer.valid() && _imageLayer->hasNewerMetadata();
+}
+
 Status
 TMSElevationLayer::closeImplementation()
 {
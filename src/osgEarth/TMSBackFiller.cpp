@@ -22,25 +22,198 @@
 #include <osgEarth/TMSBackFiller>
 #include <osgEarth/FileUtils>
 #include <osgEarth/ImageMosaic>
+#include <osgEarth/Registry>
+#include <osgEarth/SIMD>
 
 #include <osgDB/FileUtils>
 #include <osgDB/FileNameUtils>
 #include <osgDB/ReadFile>
 #include <osgDB/WriteFile>
 
+#include <atomic>
+#include <set>
+#include <cstring>
+#include <cmath>
+
+#if defined(OE_SIMD_SSE2)
+    #include <emmintrin.h>
+#endif
+
 #define LC "[TMSBackFiller] "
 
 using namespace osgEarth;
 using namespace osgEarth::Contrib;
 
+namespace
+{
+    // Averages each 2x2 block of two source rows into one output row,
+    // rounding to nearest.
+    void boxRow_scalar(const unsigned char* row0, const unsigned char* row1, unsigned width, unsigned comps, unsigned char* out)
+    {
+        for (unsigned i = 0; i < width; ++i)
+        {
+            const unsigned char* a = row0 + 2 * i * comps;
+            const unsigned char* b = row1 + 2 * i * comps;
+            for (unsigned c = 0; c < comps; ++c)
+            {
+                *out++ = (unsigned char)((a[c] + a[c + comps] + b[c] + b[c + comps] + 2) >> 2);
+            }
+        }
+    }
+
+#ifdef OE_SIMD_SSE2
+    // Sixteen bytes of each row at a time, widened to 16 bits so the
+    // rounding matches the scalar reference exactly. Only one and four
+    // component rows are vectorized; others take the scalar kernel.
+    void boxRow_sse2(const unsigned char* row0, const unsigned char* row1, unsigned width, unsigned comps, unsigned char* out)
+    {
+        if (comps != 1u && comps != 4u)
+        {
+            boxRow_scalar(row0, row1, width, comps, out);
+            return;
+        }
+
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i two = _mm_set1_epi16(2);
+        const __m128i ones = _mm_set1_epi16(1);
+
+        unsigned bytesOut = width * comps;
+        unsigned i = 0;
+        for (; i + 8 <= bytesOut; i += 8)
+        {
+            __m128i a = _mm_loadu_si128((const __m128i*)(row0 + 2 * i));
+            __m128i b = _mm_loadu_si128((const __m128i*)(row1 + 2 * i));
+
+            // vertical sums, low and high halves
+            __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+            __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+
+            __m128i sums;
+            if (comps == 1u)
+            {
+                // neighboring lanes are neighboring pixels
+                sums = _mm_packs_epi32(_mm_madd_epi16(lo, ones), _mm_madd_epi16(hi, ones));
+            }
+            else
+            {
+                // each half holds two pixels; add the second to the first
+                __m128i l = _mm_add_epi16(lo, _mm_srli_si128(lo, 8));
+                __m128i h = _mm_add_epi16(hi, _mm_srli_si128(hi, 8));
+                sums = _mm_unpacklo_epi64(l, h);
+            }
+
+            __m128i avg = _mm_srli_epi16(_mm_add_epi16(sums, two), 2);
+            _mm_storel_epi64((__m128i*)(out + i), _mm_packus_epi16(avg, zero));
+        }
+
+        if (i < bytesOut)
+        {
+            boxRow_scalar(row0 + 2 * i, row1 + 2 * i, (bytesOut - i) / comps, comps, out + i);
+        }
+    }
+#endif
+
+    typedef void (*BoxRowFunc)(const unsigned char*, const unsigned char*, unsigned, unsigned, unsigned char*);
+
+    struct BoxRowDispatch : public Util::SIMD::Dispatch<BoxRowFunc>
+    {
+        BoxRowDispatch() : Util::SIMD::Dispatch<BoxRowFunc>(boxRow_scalar)
+        {
+#ifdef OE_SIMD_SSE2
+            add(Util::SIMD::SSE2, boxRow_sse2);
+#endif
+        }
+    };
+
+    const BoxRowDispatch s_boxRow;
+
+    // 2-lobe Lanczos weights for halving: the eight source samples
+    // around each output sample, 0.5, 1.5, 2.5 and 3.5 source texels away.
+    struct LanczosWeights
+    {
+        float _w[8];
+
+        LanczosWeights()
+        {
+            float sum = 0.0f;
+            for (int k = 0; k < 8; ++k)
+            {
+                double x = fabs((double)k - 3.5) * 0.5;
+                _w[k] = (float)(sinc(x) * sinc(x * 0.5));
+                sum += _w[k];
+            }
+            for (int k = 0; k < 8; ++k)
+                _w[k] /= sum;
+        }
+
+        static double sinc(double x)
+        {
+            return x == 0.0 ? 1.0 : sin(osg::PI * x) / (osg::PI * x);
+        }
+    };
+
+    const LanczosWeights s_lanczos;
+
+    //! Halves a width x height image with "comps" bytes per pixel into "out"
+    void lanczos(const unsigned char* in, int width, int height, int comps, unsigned char* out)
+    {
+        int outWidth = width / 2, outHeight = height / 2;
+
+        // horizontal pass into floats
+        std::vector<float> temp(outWidth * height * comps);
+        for (int t = 0; t < height; ++t)
+        {
+            const unsigned char* row = in + t * width * comps;
+            float* dst = &temp[t * outWidth * comps];
+            for (int i = 0; i < outWidth; ++i)
+            {
+                for (int c = 0; c < comps; ++c)
+                {
+                    float sum = 0.0f;
+                    for (int k = 0; k < 8; ++k)
+                    {
+                        int s = osg::clampBetween(2 * i - 3 + k, 0, width - 1);
+                        sum += s_lanczos._w[k] * (float)row[s * comps + c];
+                    }
+                    *dst++ = sum;
+                }
+            }
+        }
+
+        // vertical pass
+        for (int j = 0; j < outHeight; ++j)
+        {
+            unsigned char* dst = out + j * outWidth * comps;
+            for (int i = 0; i < outWidth * comps; ++i)
+            {
+                float sum = 0.0f;
+                for (int k = 0; k < 8; ++k)
+                {
+                    int t = osg::clampBetween(2 * j - 3 + k, 0, height - 1);
+                    sum += s_lanczos._w[k] * temp[t * outWidth * comps + i];
+                }
+                *dst++ = (unsigned char)osg::clampBetween(sum + 0.5f, 0.0f, 255.0f);
+            }
+        }
+    }
+}
+
 TMSBackFiller::TMSBackFiller() :
 _minLevel(0u),
 _maxLevel(0u),
-_verbose(false)
+_verbose(false),
+_filter(FILTER_BOX),
+_incremental(false)
 {
     //nop
 }
 
+void TMSBackFiller::addChangedTile( unsigned int lod, unsigned int x, unsigned int y )
+{
+    _changedTiles.push_back( lod );
+    _changedTiles.push_back( x );
+    _changedTiles.push_back( y );
+}
 
 void TMSBackFiller::process( const std::string& tms, osgDB::Options* options )
 {               
@@ -65,23 +238,62 @@ void TMSBackFiller::process( const std::string& tms, osgDB::Options* options )
 
         GeoExtent extent( profile->getSRS(), _bounds );           
 
+        // In incremental mode these are the tiles whose parents need
+        // regenerating: the change list, then each level's output.
+        std::set<TileKey> changed;
+        for (unsigned i = 0; i + 2 < _changedTiles.size(); i += 3)
+        {
+            if (_changedTiles[i] > 0u && _changedTiles[i] <= _maxLevel)
+                changed.insert( TileKey(_changedTiles[i], _changedTiles[i+1], _changedTiles[i+2], profile.get()) );
+        }
+        bool useChangeList = _incremental && !_changedTiles.empty();
+
         //Process each level in it's entirety
         for (int level = firstLevel; level >= static_cast<int>(_minLevel); level--)
         {
             if (_verbose) OE_NOTICE << "Processing level " << level << std::endl;                
 
-            TileKey ll = profile->createTileKey(extent.xMin(), extent.yMin(), level);
-            TileKey ur = profile->createTileKey(extent.xMax(), extent.yMax(), level);
+            std::vector<TileKey> keys;
+            bool checkTimes = false;
 
-            for (unsigned int x = ll.getTileX(); x <= ur.getTileX(); x++)
+            if (_incremental && (useChangeList || level < firstLevel))
+            {
+                std::set<TileKey> parents;
+                for (std::set<TileKey>::const_iterator i = changed.begin(); i != changed.end(); ++i)
+                {
+                    if (i->getLOD() == (unsigned)level + 1u)
+                    {
+                        TileKey parent = i->createParentKey();
+                        if (parent.valid() && extent.intersects(parent.getExtent()))
+                            parents.insert( parent );
+                    }
+                }
+                keys.assign( parents.begin(), parents.end() );
+            }
+            else
             {
-                for (unsigned int y = ur.getTileY(); y <= ll.getTileY(); y++)
+                TileKey ll = profile->createTileKey(extent.xMin(), extent.yMin(), level);
+                TileKey ur = profile->createTileKey(extent.xMax(), extent.yMax(), level);
+
+                for (unsigned int x = ll.getTileX(); x <= ur.getTileX(); x++)
                 {
-                    TileKey key = TileKey(level, x, y, profile.get());
-                    processKey( key );
+                    for (unsigned int y = ur.getTileY(); y <= ll.getTileY(); y++)
+                    {
+                        keys.push_back( TileKey(level, x, y, profile.get()) );
+                    }
                 }
-            }                
 
+                // without a change list, compare file times to find what changed
+                checkTimes = _incremental;
+            }
+
+            std::vector<TileKey> written;
+            processKeys( keys, checkTimes, written );
+
+            if (_verbose) OE_NOTICE << "Wrote " << written.size() << " of " << keys.size() << " tiles" << std::endl;
+
+            if (_incremental)
+                changed.insert( written.begin(), written.end() );
         }            
     }
     else
@@ -90,7 +302,49 @@ void TMSBackFiller::process( const std::string& tms, osgDB::Options* options )
     }
 }
 
-void TMSBackFiller::processKey( const TileKey& key )
+void TMSBackFiller::processKeys( const std::vector<TileKey>& keys, bool checkTimes, std::vector<TileKey>& written )
+{
+    // Tiles in one level don't depend on each other, so the arena's
+    // threads and this one pull them off the list until it's empty.
+    std::vector<char> results(keys.size(), 0);
+    std::atomic_uint next(0u);
+
+    auto work = [this, &keys, &results, &next, checkTimes]()
+    {
+        for (unsigned i = next++; i < keys.size(); i = next++)
+        {
+            results[i] = processKey( keys[i], checkTimes ) ? 1 : 0;
+        }
+    };
+
+    Threading::JobArena* arena = Registry::instance()->getJobArena("oe.backfill");
+    unsigned numJobs = osg::minimum(arena->getConcurrency(), (unsigned)keys.size());
+
+    std::vector<Threading::Future<osg::Referenced> > futures;
+    for (unsigned j = 1; j < numJobs; ++j)
+    {
+        Threading::Promise<osg::Referenced> promise;
+        futures.push_back(promise.getFuture());
+
+        Threading::runInJobArena(arena, [promise, &work]() mutable {
+            work();
+            promise.resolve(0L);
+        });
+    }
+
+    work();
+
+    // Wait for everything; the jobs reference our stack.
+    Threading::when_all(futures).get();
+
+    for (unsigned i = 0; i < keys.size(); ++i)
+    {
+        if (results[i])
+            written.push_back( keys[i] );
+    }
+}
+
+bool TMSBackFiller::processKey( const TileKey& key, bool checkTimes )
 {
     if (_verbose) OE_NOTICE << "Processing key " << key.str() << std::endl;
 
@@ -100,6 +354,20 @@ void TMSBackFiller::processKey( const TileKey& key )
     TileKey llKey = key.createChildKey( 2 );
     TileKey lrKey = key.createChildKey( 3 );
 
+    // Skip tiles that are newer than all of their children.
+    if (checkTimes)
+    {
+        TimeStamp parentTime = getLastModifiedTime( getFilename(key) );
+        if (parentTime > 0 &&
+            parentTime >= getLastModifiedTime( getFilename(ulKey) ) &&
+            parentTime >= getLastModifiedTime( getFilename(urKey) ) &&
+            parentTime >= getLastModifiedTime( getFilename(llKey) ) &&
+            parentTime >= getLastModifiedTime( getFilename(lrKey) ))
+        {
+            return false;
+        }
+    }
+
     osg::ref_ptr< osg::Image > ul = readTile( ulKey );
     osg::ref_ptr< osg::Image > ur = readTile( urKey );
     osg::ref_ptr< osg::Image > ll = readTile( llKey );
@@ -107,25 +375,97 @@ void TMSBackFiller::processKey( const TileKey& key )
 
     if (ul.valid() && ur.valid() && ll.valid() && lr.valid())
     {            
-        //Merge them together
-        ImageMosaic mosaic;
-        mosaic.getImages().push_back( TileImage( ul.get(), ulKey ) );
-        mosaic.getImages().push_back( TileImage( ur.get(), urKey ) );
-        mosaic.getImages().push_back( TileImage( ll.get(), llKey ) );
-        mosaic.getImages().push_back( TileImage( lr.get(), lrKey ) );            
-
-        osg::ref_ptr< osg::Image> merged = mosaic.createImage();
-        if (merged.valid())
-        {
-            //Resize the image so it's the same size as one of the input files
-            osg::ref_ptr<osg::Image> resized;
-            ImageUtils::resizeImage( merged.get(), ul->s(), ul->t(), resized );
-            std::string outputFilename = getFilename( key );                
+        osg::ref_ptr< osg::Image > resized = downsample( ul.get(), ur.get(), ll.get(), lr.get() );
+
+        if (!resized.valid())
+        {
+            //Merge them together
+            ImageMosaic mosaic;
+            mosaic.getImages().push_back( TileImage( ul.get(), ulKey ) );
+            mosaic.getImages().push_back( TileImage( ur.get(), urKey ) );
+            mosaic.getImages().push_back( TileImage( ll.get(), llKey ) );
+            mosaic.getImages().push_back( TileImage( lr.get(), lrKey ) );            
+
+            osg::ref_ptr< osg::Image> merged = mosaic.createImage();
+            if (merged.valid())
+            {
+                //Resize the image so it's the same size as one of the input files
+                ImageUtils::resizeImage( merged.get(), ul->s(), ul->t(), resized );
+            }
+        }
+
+        if (resized.valid())
+        {
             writeTile( key, resized.get() );
+            return true;
         }
-    }                
+    }
+
+    return false;
 }    
 
+osg::Image* TMSBackFiller::downsample( osg::Image* ul, osg::Image* ur, osg::Image* ll, osg::Image* lr ) const
+{
+    // Only 8-bit images of one size and layout reduce directly; the rest
+    // go through the mosaic.
+    osg::Image* quads[4] = { ul, ur, ll, lr };
+    for (int q = 0; q < 4; ++q)
+    {
+        if (quads[q]->getDataType() != GL_UNSIGNED_BYTE ||
+            quads[q]->getPixelFormat() != ul->getPixelFormat() ||
+            quads[q]->getOrigin() != ul->getOrigin() ||
+            quads[q]->s() != ul->s() || quads[q]->t() != ul->t() || quads[q]->r() != 1 ||
+            quads[q]->getRowLength() != 0 || quads[q]->getPacking() != 1u ||
+            quads[q]->isCompressed())
+        {
+            return 0L;
+        }
+    }
+
+    int s = ul->s(), t = ul->t();
+    int comps = osg::Image::computeNumComponents(ul->getPixelFormat());
+    if ((s & 1) || (t & 1) || comps < 1 || comps > 4)
+        return 0L;
+
+    // Assemble the four children into one image twice the size. The upper
+    // children go on top, which is the end of the image unless its
+    // origin is the top left.
+    bool topLeft = ul->getOrigin() == osg::Image::TOP_LEFT;
+    int rowBytes = s * comps;
+    std::vector<unsigned char> mosaic(4 * rowBytes * t);
+    for (int q = 0; q < 4; ++q)
+    {
+        int col = q & 1;
+        int upper = q < 2 ? 1 : 0;
+        int rowOffset = (topLeft ? 1 - upper : upper) * t;
+        for (int j = 0; j < t; ++j)
+        {
+            ::memcpy(&mosaic[((rowOffset + j) * 2 * s + col * s) * comps], quads[q]->data(0, j), rowBytes);
+        }
+    }
+
+    osg::ref_ptr<osg::Image> out = new osg::Image();
+    out->allocateImage(s, t, 1, ul->getPixelFormat(), GL_UNSIGNED_BYTE);
+    out->setInternalTextureFormat(ul->getInternalTextureFormat());
+    out->setOrigin(ul->getOrigin());
+
+    if (_filter == FILTER_LANCZOS)
+    {
+        lanczos(&mosaic[0], 2 * s, 2 * t, comps, out->data());
+    }
+    else
+    {
+        BoxRowFunc boxRow = s_boxRow.get();
+        for (int j = 0; j < t; ++j)
+        {
+            const unsigned char* row0 = &mosaic[(2 * j) * 2 * rowBytes];
+            boxRow(row0, row0 + 2 * rowBytes, s, comps, out->data(0, j));
+        }
+    }
+
+    return out.release();
+}
+
 std::string TMSBackFiller::getFilename( const TileKey& key )
 {
     return _tileMap->getURL( key, false );        
@@ -21,6 +21,7 @@
 #include <osgEarth/ImageToHeightFieldConverter>
 #include <osgEarth/FileUtils>
 #include <osgEarth/ImageLayer>
+#include <osgEarth/HTTPClient>
 #include <osgDB/FileUtils>
 #include <osgDB/WriteFile>
 
@@ -58,6 +59,9 @@ bool WriteTMSTileHandler::handleTile(const TileKey& key, const TileVisitor& tv)
     ImageLayer* imageLayer = dynamic_cast< ImageLayer* >( _layer.get() );
     ElevationLayer* elevationLayer = dynamic_cast< ElevationLayer* >( _layer.get() );
 
+    // Packaging yields to interactive requests against the same servers
+    HTTPClient::ScopedPriority priority(HTTPClient::PRIORITY_BACKGROUND);
+
     // Get the path to write to
     std::string path = getPathForTile( key );
 
@@ -209,6 +213,7 @@ _visitor(new TileVisitor()),
     _extension(""),
     _destination("out"),
     _elevationPixelDepth(32),
+    _elevationExtension("tif"),
     _width(0),
     _height(0),
     _overwrite(false),
@@ -248,6 +253,16 @@ void TMSPackager::setExtension( const std::string& extension)
      return _elevationPixelDepth;
  }
 
+const std::string& TMSPackager::getElevationExtension() const
+{
+    return _elevationExtension;
+}
+
+void TMSPackager::setElevationExtension(const std::string& extension)
+{
+    _elevationExtension = extension;
+}
+
 osgDB::Options* TMSPackager::getOptions() const
 {
     return _writeOptions.get();
@@ -382,8 +397,9 @@ void TMSPackager::run( TileLayer* layer,  Map* map  )
     }
     else if (elevationLayer)
     {
-        // We must use tif no matter what with elevation layers.  It's the only format that currently can read/write single band imagery.
-        _extension = "tif";
+        // Elevation needs a format that can read/write single band imagery:
+        // tif, or the packed "qhf" quantized heightfield.
+        _extension = _elevationExtension == "qhf" ? "qhf" : "tif";
         int tileSize = elevationLayer->getTileSize();
         _width = tileSize;
         _height = tileSize;
@@ -416,6 +432,8 @@ void TMSPackager::writeXML(TileLayer* layer, Map* map)
         mimeType = "image/jpeg";
     else if ( _extension == "tif" || _extension == "tiff" )
         mimeType = "image/tiff";
+    else if ( _extension == "qhf" )
+        mimeType = "application/x-osgearth-qhf";
     else {
         OE_WARN << LC << "Unable to determine mime-type for extension \"" << _extension << "\"" << std::endl;
     }
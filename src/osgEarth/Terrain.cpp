@@ -18,12 +18,111 @@
  */
 
 #include <osgEarth/Terrain>
+#include <osgEarth/TerrainEngineNode>
+#include <osgEarth/Registry>
+#include <osgEarth/rtree.h>
 #include <osgViewer/View>
+#include <osgUtil/LineSegmentIntersector>
+#include <algorithm>
 
 #define LC "[Terrain] "
 
 using namespace osgEarth;
 
+// R-tree over the callbacks that were added with an extent, in map coords
+struct Terrain::CallbackIndex
+{
+    struct Entry
+    {
+        osg::ref_ptr<TerrainCallback> _callback;
+        std::vector<GeoExtent> _rects;
+    };
+
+    RTree<unsigned, double, 2> _tree;
+    std::map<unsigned, Entry> _entries;
+    std::map<TerrainCallback*, unsigned> _ids;
+    unsigned _nextId;
+
+    CallbackIndex() : _nextId(0u) { }
+
+    void insert(TerrainCallback* cb, const GeoExtent& extent)
+    {
+        Entry& entry = _entries[_nextId];
+        entry._callback = cb;
+
+        GeoExtent first, second;
+        if (extent.splitAcrossAntimeridian(first, second))
+        {
+            entry._rects.push_back(first);
+            entry._rects.push_back(second);
+        }
+        else
+        {
+            entry._rects.push_back(extent);
+        }
+
+        for (unsigned i = 0; i < entry._rects.size(); ++i)
+        {
+            const GeoExtent& e = entry._rects[i];
+            double a_min[2] = { e.xMin(), e.yMin() };
+            double a_max[2] = { e.xMax(), e.yMax() };
+            _tree.Insert(a_min, a_max, _nextId);
+        }
+
+        _ids[cb] = _nextId++;
+    }
+
+    bool remove(TerrainCallback* cb)
+    {
+        std::map<TerrainCallback*, unsigned>::iterator i = _ids.find(cb);
+        if (i == _ids.end())
+            return false;
+
+        Entry& entry = _entries[i->second];
+        for (unsigned r = 0; r < entry._rects.size(); ++r)
+        {
+            const GeoExtent& e = entry._rects[r];
+            double a_min[2] = { e.xMin(), e.yMin() };
+            double a_max[2] = { e.xMax(), e.yMax() };
+            _tree.Remove(a_min, a_max, i->second);
+        }
+
+        _entries.erase(i->second);
+        _ids.erase(i);
+        return true;
+    }
+
+    // Appends the callbacks interested in "extent" (all of them if it's invalid)
+    void search(const GeoExtent& extent, std::vector<osg::ref_ptr<TerrainCallback> >& out) const
+    {
+        if (!extent.isValid())
+        {
+            for (std::map<unsigned, Entry>::const_iterator i = _entries.begin(); i != _entries.end(); ++i)
+                out.push_back(i->second._callback);
+            return;
+        }
+
+        if (_entries.empty())
+            return;
+
+        std::vector<unsigned> hits;
+        double a_min[2] = { extent.xMin(), extent.yMin() };
+        double a_max[2] = { extent.xMax(), extent.yMax() };
+        _tree.Search(a_min, a_max, &hits, (int)(2 * _entries.size()));
+
+        // an extent split at the antimeridian may appear twice
+        std::sort(hits.begin(), hits.end());
+        hits.erase(std::unique(hits.begin(), hits.end()), hits.end());
+
+        for (unsigned i = 0; i < hits.size(); ++i)
+        {
+            std::map<unsigned, Entry>::const_iterator e = _entries.find(hits[i]);
+            if (e != _entries.end())
+                out.push_back(e->second._callback);
+        }
+    }
+};
+
 //---------------------------------------------------------------------------
 
 Terrain::onTileUpdateOperation::onTileUpdateOperation(const TileKey& key, osg::Node* node, Terrain* terrain)
@@ -63,16 +162,46 @@ void Terrain::onTileUpdateOperation::operator()(osg::Object*)
 
 Terrain::Terrain(osg::Node* graph, const Profile* mapProfile) :
 _graph         ( graph ),
+_pickMethod    ( PICK_ANALYTIC ),
 _profile       ( mapProfile ),
-_callbacksMutex(OE_MUTEX_NAME)
+_callbacksMutex(OE_MUTEX_NAME),
+_pendingMutex  (OE_MUTEX_NAME)
 {
     _updateQueue = new osg::OperationQueue();
+    _callbackIndex = std::make_shared<CallbackIndex>();
+}
+
+Terrain::~Terrain()
+{
+    //nop
 }
 
 void
 Terrain::update()
 {
     _updateQueue->runOperations();
+
+    PendingTileUpdates pending;
+    {
+        Threading::ScopedMutexLock lock(_pendingMutex);
+        pending.swap(_pendingTileUpdates);
+    }
+
+    if (!pending.empty())
+    {
+        std::vector<std::pair<TileKey, osg::ref_ptr<osg::Node> > > updates;
+        updates.reserve(pending.size());
+        for (PendingTileUpdates::iterator i = pending.begin(); i != pending.end(); ++i)
+        {
+            osg::ref_ptr<osg::Node> node;
+            if (i->second.lock(node))
+                updates.push_back(std::make_pair(i->first, node));
+            else
+                OE_DEBUG << "Tile expired before notification: " << i->first.str() << std::endl;
+        }
+
+        fireTileUpdates(updates);
+    }
 }
 
 bool
@@ -159,6 +288,77 @@ Terrain::getHeight(const SpatialReference* srs,
 }
 
 
+namespace
+{
+    // Reads the depth under the most recently requested window position
+    // at the end of each frame the camera draws.
+    struct DepthReadback : public osg::Camera::DrawCallback
+    {
+        DepthReadback(osg::Camera::DrawCallback* next) :
+            _next(next), _mutex(OE_MUTEX_NAME),
+            _requestX(-1), _requestY(-1), _readX(-1), _readY(-1), _depth(1.0f) { }
+
+        void operator()(osg::RenderInfo& ri) const
+        {
+            if (_next.valid())
+                (*_next)(ri);
+
+            int x, y;
+            {
+                Threading::ScopedMutexLock lock(_mutex);
+                x = _requestX, y = _requestY;
+            }
+            if (x < 0 || y < 0)
+                return;
+
+            GLfloat depth = 1.0f;
+            glReadPixels(x, y, 1, 1, GL_DEPTH_COMPONENT, GL_FLOAT, &depth);
+
+            Threading::ScopedMutexLock lock(_mutex);
+            _readX = x, _readY = y;
+            _depth = depth;
+            _viewMatrix = ri.getState()->getInitialViewMatrix();
+            _projectionMatrix = ri.getCurrentCamera()->getProjectionMatrix();
+        }
+
+        //! Requests the depth at (x, y) and returns the world point there
+        //! if the last frame already read it.
+        bool get(int x, int y, const osg::Viewport* vp, osg::Vec3d& out_world)
+        {
+            Threading::ScopedMutexLock lock(_mutex);
+            _requestX = x, _requestY = y;
+
+            if (x != _readX || y != _readY || _depth >= 1.0f || !vp)
+                return false;
+
+            osg::Matrixd inverse;
+            inverse.invert(_viewMatrix * _projectionMatrix * vp->computeWindowMatrix());
+            out_world = osg::Vec3d(x, y, _depth) * inverse;
+            return true;
+        }
+
+        osg::ref_ptr<osg::Camera::DrawCallback> _next;
+        mutable Threading::Mutex _mutex;
+        int _requestX, _requestY;
+        mutable int _readX, _readY;
+        mutable GLfloat _depth;
+        mutable osg::Matrixd _viewMatrix, _projectionMatrix;
+    };
+
+    bool getDepthUnderMouse(const osg::Camera* camera, float x, float y, osg::Vec3d& out_world)
+    {
+        osg::Camera* cam = const_cast<osg::Camera*>(camera);
+        DepthReadback* readback = dynamic_cast<DepthReadback*>(cam->getFinalDrawCallback());
+        if (!readback)
+        {
+            // chain to any existing callback so we don't displace it
+            readback = new DepthReadback(cam->getFinalDrawCallback());
+            cam->setFinalDrawCallback(readback);
+        }
+        return readback->get((int)x, (int)y, camera->getViewport(), out_world);
+    }
+}
+
 bool
 Terrain::getWorldCoordsUnderMouse(osg::View* view, float x, float y, osg::Vec3d& out_coords ) const
 {
@@ -197,6 +397,22 @@ Terrain::getWorldCoordsUnderMouse(osg::View* view, float x, float y, osg::Vec3d&
     osg::Vec3d startVertex = osg::Vec3d(local_x,local_y,zNear) * inverse;
     osg::Vec3d endVertex = osg::Vec3d(local_x,local_y,zFar) * inverse;
 
+    if (_pickMethod == PICK_DEPTH_READBACK && getDepthUnderMouse(camera, local_x, local_y, out_coords))
+    {
+        return true;
+    }
+
+    const TerrainEngineNode* engine = dynamic_cast<const TerrainEngineNode*>(_graph.get());
+    if (_pickMethod != PICK_GEOMETRY && engine && engine->supportsIntersect())
+    {
+        osg::Vec3d hit;
+        if (!engine->intersect(startVertex, endVertex, hit))
+            return false;
+
+        out_coords = hit * terrainRefFrame;
+        return true;
+    }
+
     osg::ref_ptr< osgUtil::LineSegmentIntersector > picker = 
         new osgUtil::LineSegmentIntersector(osgUtil::Intersector::MODEL, startVertex, endVertex);
 
@@ -228,6 +444,33 @@ Terrain::addTerrainCallback( TerrainCallback* cb )
     }
 }
 
+void
+Terrain::addTerrainCallback(TerrainCallback* cb, const GeoExtent& extent)
+{
+    if ( cb )
+    {
+        GeoExtent mapExtent;
+        if (extent.isValid())
+        {
+            mapExtent = extent.getSRS()->isHorizEquivalentTo(getSRS()) ?
+                extent : extent.transform(getSRS());
+        }
+
+        // with no usable extent the callback hears about every tile
+        if (!mapExtent.isValid())
+        {
+            addTerrainCallback(cb);
+            return;
+        }
+
+        removeTerrainCallback( cb );
+
+        Threading::ScopedWriteLock exclusiveLock( _callbacksMutex );
+        _callbackIndex->insert(cb, mapExtent);
+        ++_callbacksSize; // atomic increment
+    }
+}
+
 void
 Terrain::removeTerrainCallback( TerrainCallback* cb )
 {
@@ -245,6 +488,11 @@ Terrain::removeTerrainCallback( TerrainCallback* cb )
             ++i;
         }
     }
+
+    if (_callbackIndex->remove(cb))
+    {
+        --_callbacksSize;
+    }
 }
 
 void
@@ -258,27 +506,105 @@ Terrain::notifyTileUpdate( const TileKey& key, osg::Node* node )
     if (_callbacksSize > 0)
     {
         if (!key.valid())
+        {
             OE_WARN << LC << "notifyTileUpdate with key = NULL\n";
+            _updateQueue->add(new onTileUpdateOperation(key, node, this));
+            return;
+        }
 
-        _updateQueue->add(new onTileUpdateOperation(key, node, this));
+        // a tile that updates more than once before the next update
+        // traversal only gets one notification
+        Threading::ScopedMutexLock lock(_pendingMutex);
+        _pendingTileUpdates[key] = node;
     }
 }
 
 void
 Terrain::fireTileUpdate( const TileKey& key, osg::Node* node )
 {
-    Threading::ScopedReadLock sharedLock( _callbacksMutex );
+    std::vector<std::pair<TileKey, osg::ref_ptr<osg::Node> > > updates;
+    updates.push_back(std::make_pair(key, node));
+    fireTileUpdates(updates);
+}
 
-    for( CallbackList::iterator i = _callbacks.begin(); i != _callbacks.end(); )
-    {       
-        TerrainCallbackContext context( this );
-        i->get()->onTileUpdate( key, node, context );
+void
+Terrain::fireTileUpdates( const std::vector<std::pair<TileKey, osg::ref_ptr<osg::Node> > >& updates )
+{
+    typedef std::vector<osg::ref_ptr<TerrainCallback> > Callbacks;
 
-        // if the callback set the "remove" flag, discard the callback.
-        if ( context.markedForRemoval() )
-            i = _callbacks.erase( i );
-        else
-            ++i;
+    struct Dispatch {
+        TileKey _key;
+        osg::ref_ptr<osg::Node> _node;
+        Callbacks _callbacks;
+    };
+    std::vector<Dispatch> background;
+    Callbacks removals;
+
+    for (unsigned u = 0; u < updates.size(); ++u)
+    {
+        const TileKey& key = updates[u].first;
+        osg::Node* node = updates[u].second.get();
+
+        // copy the interested callbacks so they can add or remove
+        // callbacks themselves without deadlocking
+        Callbacks callbacks;
+        {
+            Threading::ScopedReadLock sharedLock( _callbacksMutex );
+            callbacks.assign(_callbacks.begin(), _callbacks.end());
+            _callbackIndex->search(key.valid() ? key.getExtent() : GeoExtent::INVALID, callbacks);
+        }
+
+        Dispatch dispatch;
+        for (Callbacks::iterator i = callbacks.begin(); i != callbacks.end(); ++i)
+        {
+            if (i->get()->isThreadSafe())
+            {
+                dispatch._callbacks.push_back(*i);
+                continue;
+            }
+
+            TerrainCallbackContext context( this );
+            i->get()->onTileUpdate( key, node, context );
+
+            // if the callback set the "remove" flag, discard the callback.
+            if ( context.markedForRemoval() )
+                removals.push_back(*i);
+        }
+
+        if (!dispatch._callbacks.empty())
+        {
+            dispatch._key = key;
+            dispatch._node = node;
+            background.push_back(dispatch);
+        }
+    }
+
+    for (Callbacks::iterator i = removals.begin(); i != removals.end(); ++i)
+    {
+        removeTerrainCallback(i->get());
+    }
+
+    // thread-safe callbacks all run in one job per frame
+    if (!background.empty())
+    {
+        osg::observer_ptr<Terrain> terrain(this);
+        Threading::runInJobArena(Registry::instance()->getJobArena("terrain.callbacks"), [terrain, background]() {
+            osg::ref_ptr<Terrain> safeTerrain;
+            if (!terrain.lock(safeTerrain))
+                return;
+
+            for (unsigned d = 0; d < background.size(); ++d)
+            {
+                const Dispatch& dispatch = background[d];
+                for (unsigned i = 0; i < dispatch._callbacks.size(); ++i)
+                {
+                    TerrainCallbackContext context( safeTerrain.get() );
+                    dispatch._callbacks[i]->onTileUpdate( dispatch._key, dispatch._node.get(), context );
+                    if ( context.markedForRemoval() )
+                        safeTerrain->removeTerrainCallback( dispatch._callbacks[i].get() );
+                }
+            }
+        });
     }
 }
 
@@ -90,6 +90,7 @@ _requireLandCoverTextures( false ),
 _requireParentTextures   ( false ),
 _requireElevationBorder  ( false ),
 _requireFullDataAtFirstLOD( false ),
+_supportVirtualTextures   ( false ),
 _redrawRequired          ( true ),
 _updateScheduled( false ),
 _createTileModelCallbacksMutex(OE_MUTEX_NAME)
@@ -57,12 +57,27 @@ TerrainOptions::getConfig() const
     conf.set( "expiration_threshold", expirationThreshold() );
     conf.set( "progressive", progressive() );
     conf.set( "normal_maps", normalMaps() );
+    conf.set( "gpu_normal_maps", gpuNormalMaps() );
+    conf.set( "half_float_elevation", halfFloatElevation() );
     conf.set( "normalize_edges", normalizeEdges() );
     conf.set( "morph_terrain", morphTerrain() );
     conf.set( "morph_elevation", morphTerrain() );
     conf.set( "morph_imagery", morphImagery() );
     conf.set( "merges_per_frame", mergesPerFrame() );
+    conf.set( "merge_budget", mergeBudget() );
     conf.set( "priority_scale", priorityScale() );
+    conf.set( "concurrent_layer_fetch", concurrentLayerFetch() );
+    conf.set( "prefetch_time", prefetchTime() );
+    conf.set( "max_cpu_memory", maxCPUMemory() );
+    conf.set( "max_gpu_memory", maxGPUMemory() );
+    conf.set( "bindless_textures", bindlessTextures() );
+    conf.set( "parallel_culling", parallelCulling() );
+    conf.set( "occlusion_culling", occlusionCulling() );
+    conf.set( "shared_view_culling", sharedViewCulling() );
+    conf.set( "texture_streaming", textureStreaming() );
+    conf.set( "texture_upload_budget", textureUploadBudget() );
+    conf.set( "virtual_texture_pages", virtualTexturePages() );
+    conf.set( "virtual_texture_uploads", virtualTextureUploads() );
 
     return conf;
 }
@@ -97,11 +112,26 @@ TerrainOptions::fromConfig(const Config& conf)
     expirationThreshold().init(300u);
     progressive().init(false);
     normalMaps().init(true);
+    gpuNormalMaps().init(false);
+    halfFloatElevation().init(false);
     normalizeEdges().init(false);
     morphTerrain().init(true);
     morphImagery().init(true);
     mergesPerFrame().init(20u);
+    mergeBudget().init(0.0f);
     priorityScale().init(1.0f);
+    concurrentLayerFetch().init(false);
+    prefetchTime().init(0.0f);
+    maxCPUMemory().init(0u);
+    maxGPUMemory().init(0u);
+    bindlessTextures().init(false);
+    parallelCulling().init(false);
+    occlusionCulling().init(false);
+    sharedViewCulling().init(false);
+    textureStreaming().init(false);
+    textureUploadBudget().init(8192u);
+    virtualTexturePages().init(1024u);
+    virtualTextureUploads().init(8u);
 
     conf.get( "tile_size", _tileSize );
     conf.get( "vertical_scale", _verticalScale );
@@ -132,11 +162,26 @@ TerrainOptions::fromConfig(const Config& conf)
     conf.get( "expiration_threshold", expirationThreshold() );
     conf.get( "progressive", progressive() );
     conf.get( "normal_maps", normalMaps() );
+    conf.get( "gpu_normal_maps", gpuNormalMaps() );
+    conf.get( "half_float_elevation", halfFloatElevation() );
     conf.get( "normalize_edges", normalizeEdges() );
     conf.get( "morph_terrain", morphTerrain() );
     conf.get( "morph_imagery", morphImagery() );
     conf.get( "merges_per_frame", mergesPerFrame() );
+    conf.get( "merge_budget", mergeBudget() );
     conf.get( "priority_scale", priorityScale());
+    conf.get( "concurrent_layer_fetch", concurrentLayerFetch() );
+    conf.get( "prefetch_time", prefetchTime() );
+    conf.get( "max_cpu_memory", maxCPUMemory() );
+    conf.get( "max_gpu_memory", maxGPUMemory() );
+    conf.get( "bindless_textures", bindlessTextures() );
+    conf.get( "parallel_culling", parallelCulling() );
+    conf.get( "occlusion_culling", occlusionCulling() );
+    conf.get( "shared_view_culling", sharedViewCulling() );
+    conf.get( "texture_streaming", textureStreaming() );
+    conf.get( "texture_upload_budget", textureUploadBudget() );
+    conf.get( "virtual_texture_pages", virtualTexturePages() );
+    conf.get( "virtual_texture_uploads", virtualTextureUploads() );
 }
 
 //...................................................................
@@ -174,11 +219,26 @@ OE_PROPERTY_IMPL(TerrainOptionsAPI, float, HeightFieldSkirtRatio, heightFieldSki
 OE_PROPERTY_IMPL(TerrainOptionsAPI, Color, Color, color);
 OE_PROPERTY_IMPL(TerrainOptionsAPI, bool, Progressive, progressive);
 OE_PROPERTY_IMPL(TerrainOptionsAPI, bool, NormalMaps, normalMaps);
+OE_PROPERTY_IMPL(TerrainOptionsAPI, bool, GPUNormalMaps, gpuNormalMaps);
+OE_PROPERTY_IMPL(TerrainOptionsAPI, bool, HalfFloatElevation, halfFloatElevation);
 OE_PROPERTY_IMPL(TerrainOptionsAPI, bool, NormalizeEdges, normalizeEdges);
 OE_PROPERTY_IMPL(TerrainOptionsAPI, bool, MorphTerrain, morphTerrain);
 OE_PROPERTY_IMPL(TerrainOptionsAPI, bool, MorphImagery, morphImagery);
 OE_PROPERTY_IMPL(TerrainOptionsAPI, unsigned, MergesPerFrame, mergesPerFrame);
+OE_PROPERTY_IMPL(TerrainOptionsAPI, float, MergeBudget, mergeBudget);
 OE_PROPERTY_IMPL(TerrainOptionsAPI, float, PriorityScale, priorityScale);
+OE_PROPERTY_IMPL(TerrainOptionsAPI, bool, ConcurrentLayerFetch, concurrentLayerFetch);
+OE_PROPERTY_IMPL(TerrainOptionsAPI, float, PrefetchTime, prefetchTime);
+OE_PROPERTY_IMPL(TerrainOptionsAPI, unsigned, MaxCPUMemory, maxCPUMemory);
+OE_PROPERTY_IMPL(TerrainOptionsAPI, unsigned, MaxGPUMemory, maxGPUMemory);
+OE_PROPERTY_IMPL(TerrainOptionsAPI, bool, BindlessTextures, bindlessTextures);
+OE_PROPERTY_IMPL(TerrainOptionsAPI, bool, ParallelCulling, parallelCulling);
+OE_PROPERTY_IMPL(TerrainOptionsAPI, bool, OcclusionCulling, occlusionCulling);
+OE_PROPERTY_IMPL(TerrainOptionsAPI, bool, SharedViewCulling, sharedViewCulling);
+OE_PROPERTY_IMPL(TerrainOptionsAPI, bool, TextureStreaming, textureStreaming);
+OE_PROPERTY_IMPL(TerrainOptionsAPI, unsigned, TextureUploadBudget, textureUploadBudget);
+OE_PROPERTY_IMPL(TerrainOptionsAPI, unsigned, VirtualTexturePages, virtualTexturePages);
+OE_PROPERTY_IMPL(TerrainOptionsAPI, unsigned, VirtualTextureUploads, virtualTextureUploads);
 
 void
 TerrainOptionsAPI::setDriver(const std::string& value)
@@ -22,6 +22,12 @@
 #include <osgEarth/TerrainProfile>
 #include <osgEarth/MapNode>
 #include <osgEarth/TerrainEngineNode>
+#include <osgEarth/Map>
+#include <osgEarth/ElevationPool>
+#include <osgEarth/Progress>
+#include <osgEarth/Registry>
+#include <osgEarth/Threading>
+#include <atomic>
 
 using namespace osgEarth;
 using namespace osgEarth::Contrib;
@@ -234,3 +240,153 @@ void TerrainProfileCalculator::computeTerrainProfile( osgEarth::MapNode* mapNode
         profile.addElevation( slice.getDistanceHeightIntersections()[i].first, slice.getDistanceHeightIntersections()[i].second);
     }
 }
+
+/***************************************************/
+namespace
+{
+    // Converts a resolution in map units to meters.
+    float resolutionToMeters(float res, const SpatialReference* srs)
+    {
+        if (srs->isGeographic())
+            return (float)(osg::DegreesToRadians((double)res) * srs->getEllipsoid()->getRadiusEquator());
+        else
+            return (float)Distance((double)res, srs->getUnits()).as(Units::METERS);
+    }
+
+    bool sampleProfile(
+        const Map* map,
+        const Distance& spacing,
+        const TerrainProfileSampler::Path& path,
+        TerrainProfileSampler::Profile& out,
+        ElevationPool::WorkingSet* ws,
+        ProgressCallback* progress)
+    {
+        out._distances.clear();
+        out._elevations.clear();
+        out._resolutions.clear();
+
+        if (path.empty())
+            return true;
+
+        const SpatialReference* srs = map->getSRS();
+        double step = osg::maximum(spacing.as(Units::METERS), 0.01);
+        double res = SpatialReference::transformUnits(spacing, srs, 0.0);
+
+        GeoPoint a = path.front().transform(srs);
+        if (!a.isValid())
+            return false;
+
+        // Walk the path, dropping a sample at each multiple of the
+        // spacing; the last vertex is added below.
+        std::vector<osg::Vec4d> points;
+        double segStart = 0.0;
+        double next = 0.0;
+        for (unsigned i = 1; i < path.size(); ++i)
+        {
+            GeoPoint b = path[i].transform(srs);
+            if (!b.isValid())
+                return false;
+
+            double len = a.distanceTo(b);
+            for (; next < segStart + len; next += step)
+            {
+                GeoPoint p = a.interpolate(b, (next - segStart) / len);
+                points.push_back(osg::Vec4d(p.x(), p.y(), 0.0, res));
+                out._distances.push_back(next);
+            }
+
+            segStart += len;
+            a = b;
+        }
+
+        points.push_back(osg::Vec4d(a.x(), a.y(), 0.0, res));
+        out._distances.push_back(segStart);
+
+        std::vector<float> resolutions;
+        if (map->getElevationPool()->sampleMapCoords(points, &resolutions, ws, progress) < 0)
+            return false;
+
+        out._elevations.resize(points.size());
+        out._resolutions.resize(points.size());
+        for (unsigned i = 0; i < points.size(); ++i)
+        {
+            out._elevations[i] = (float)points[i].z();
+            out._resolutions[i] = resolutionToMeters(resolutions[i], srs);
+        }
+
+        return true;
+    }
+}
+
+TerrainProfileSampler::TerrainProfileSampler(const Map* map) :
+    _map(map),
+    _spacing(30.0, Units::METERS)
+{
+    //nop
+}
+
+bool
+TerrainProfileSampler::compute(const Path& path, Profile& out_profile, ProgressCallback* progress) const
+{
+    osg::ref_ptr<const Map> map;
+    if (!_map.lock(map))
+        return false;
+
+    ElevationPool::WorkingSet ws;
+    return sampleProfile(map.get(), _spacing, path, out_profile, &ws, progress);
+}
+
+bool
+TerrainProfileSampler::compute(const Paths& paths, Profiles& out_profiles, ProgressCallback* progress) const
+{
+    osg::ref_ptr<const Map> map;
+    if (!_map.lock(map))
+        return false;
+
+    out_profiles.clear();
+    out_profiles.resize(paths.size());
+    if (paths.empty())
+        return true;
+
+    std::atomic<bool> ok(true);
+
+    // Each chunk gets a working set of its own.
+    auto sampleRange = [&](unsigned begin, unsigned end)
+    {
+        ElevationPool::WorkingSet ws;
+        for (unsigned i = begin; i < end; ++i)
+        {
+            if (progress && progress->isCanceled())
+            {
+                ok = false;
+                return;
+            }
+            if (!sampleProfile(map.get(), _spacing, paths[i], out_profiles[i], &ws, progress))
+                ok = false;
+        }
+    };
+
+    Threading::JobArena* arena = Registry::instance()->getJobArena("elevation");
+    unsigned size = paths.size();
+    unsigned numChunks = osg::maximum(1u, osg::minimum(arena->getConcurrency() + 1u, size));
+
+    std::vector<Threading::Future<osg::Referenced> > futures;
+    for (unsigned c = 1; c < numChunks; ++c)
+    {
+        Threading::Promise<osg::Referenced> promise;
+        futures.push_back(promise.getFuture());
+
+        unsigned begin = (c*size) / numChunks, end = ((c + 1)*size) / numChunks;
+        Threading::runInJobArena(arena, [promise, begin, end, &sampleRange]() mutable {
+            sampleRange(begin, end);
+            promise.resolve(0L);
+        });
+    }
+
+    sampleRange(0u, size / numChunks);
+
+    // Wait for everything; the jobs reference our stack.
+    Threading::when_all(futures).get();
+
+    return ok;
+}
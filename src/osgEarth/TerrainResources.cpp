@@ -20,7 +20,7 @@
 #include <osgEarth/TerrainResources>
 #include <osgEarth/Registry>
 #include <osgEarth/Capabilities>
-#include <osgEarth/Layer>
+#include <osgEarth/ImageLayer>
 
 using namespace osgEarth;
 
@@ -28,9 +28,10 @@ using namespace osgEarth;
 
 
 TerrainResources::TerrainResources() :
-    _reservedUnitsMutex("TerrainResources(OE)")
+    _reservedUnitsMutex("TerrainResources(OE)"),
+    _virtualTexturesMutex("TerrainResources.VirtualTextures(OE)")
 {
-    //nop
+    _decalAtlas = new DecalAtlas();
 }
 
 bool
@@ -205,6 +206,48 @@ TerrainResources::setTextureImageUnitOffLimits(int unit)
     return true;
 }
 
+VirtualTexture*
+TerrainResources::createVirtualTexture(ImageLayer* layer,
+                                       const Profile* profile,
+                                       unsigned numPages,
+                                       unsigned uploadsPerFrame)
+{
+    Threading::ScopedMutexLock lock(_virtualTexturesMutex);
+
+    osg::ref_ptr<VirtualTexture>& vt = _virtualTextures[layer];
+    if (!vt.valid())
+    {
+        vt = new VirtualTexture(layer, profile, numPages, uploadsPerFrame);
+    }
+    return vt.get();
+}
+
+VirtualTexture*
+TerrainResources::getVirtualTexture(const Layer* layer) const
+{
+    Threading::ScopedMutexLock lock(_virtualTexturesMutex);
+
+    VirtualTextures::const_iterator i = _virtualTextures.find(layer);
+    return i != _virtualTextures.end() ? i->second.get() : 0L;
+}
+
+void
+TerrainResources::releaseVirtualTexture(const Layer* layer)
+{
+    Threading::ScopedMutexLock lock(_virtualTexturesMutex);
+    _virtualTextures.erase(layer);
+}
+
+void
+TerrainResources::getVirtualTextures(std::vector<osg::ref_ptr<VirtualTexture> >& out) const
+{
+    Threading::ScopedMutexLock lock(_virtualTexturesMutex);
+
+    out.reserve(out.size() + _virtualTextures.size());
+    for (VirtualTextures::const_iterator i = _virtualTextures.begin(); i != _virtualTextures.end(); ++i)
+        out.push_back(i->second);
+}
+
 //........................................................................
 TextureImageUnitReservation::TextureImageUnitReservation()
 {
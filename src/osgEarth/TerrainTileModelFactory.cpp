@@ -22,14 +22,38 @@
 #include <osgEarth/Registry>
 #include <osgEarth/LandCoverLayer>
 #include <osgEarth/Metrics>
+#include <osgEarth/Trace>
 
 #include <osg/Texture2D>
 #include <osg/Texture2DArray>
 
+#include <functional>
+
 #define LC "[TerrainTileModelFactory] "
 
 using namespace osgEarth;
 
+namespace
+{
+    // The engine pages a virtual-texture layer's images itself, so its
+    // tiles carry the layer but no image.
+    bool pagedByEngine(const ImageLayer* layer, const TerrainEngineRequirements* reqs)
+    {
+        return
+            layer->getVirtualTexture() == true &&
+            reqs != 0L &&
+            reqs->virtualTexturesSupported();
+    }
+
+    TerrainTileColorLayerModel* createBareColorLayerModel(Layer* layer)
+    {
+        TerrainTileColorLayerModel* colorModel = new TerrainTileColorLayerModel();
+        colorModel->setLayer(layer);
+        colorModel->setRevision(layer->getRevision());
+        return colorModel;
+    }
+}
+
 //.........................................................................
 
 CreateTileManifest::CreateTileManifest()
@@ -52,6 +76,28 @@ void CreateTileManifest::insert(const Layer* layer)
     }
 }
 
+void CreateTileManifest::insert(const CreateTileManifest& rhs)
+{
+    if (empty())
+        return;
+
+    if (rhs.empty())
+    {
+        _layers.clear();
+        _includesElevation = false;
+        _includesLandCover = false;
+        return;
+    }
+
+    for(LayerTable::const_iterator i = rhs._layers.begin(); i != rhs._layers.end(); ++i)
+    {
+        _layers[i->first] = i->second;
+    }
+
+    _includesElevation = _includesElevation || rhs._includesElevation;
+    _includesLandCover = _includesLandCover || rhs._includesLandCover;
+}
+
 bool CreateTileManifest::excludes(const Layer* layer) const
 {
     return !empty() && _layers.find(layer->getUID()) == _layers.end();
@@ -139,6 +185,11 @@ TerrainTileModelFactory::createTileModel(
     const TerrainEngineRequirements* requirements,
     ProgressCallback*                progress)
 {
+    if (_options.concurrentLayerFetch() == true)
+    {
+        return createTileModelConcurrently(map, key, manifest, requirements, progress);
+    }
+
     OE_PROFILING_ZONE;
     // Make a new model:
     osg::ref_ptr<TerrainTileModel> model = new TerrainTileModel(
@@ -163,6 +214,130 @@ TerrainTileModelFactory::createTileModel(
     return model.release();
 }
 
+TerrainTileModel*
+TerrainTileModelFactory::createTileModelConcurrently(
+    const Map*                       map,
+    const TileKey&                   key,
+    const CreateTileManifest&        manifest,
+    const TerrainEngineRequirements* requirements,
+    ProgressCallback*                progress)
+{
+    OE_PROFILING_ZONE;
+
+    // Each task populates its own partial model so that no two threads
+    // touch the same data; we merge them in layer order at the end.
+    typedef std::function<void(TerrainTileModel*)> Task;
+    std::vector<Task> tasks;
+
+    LayerVector layers;
+    map->getLayers(layers);
+
+    for (LayerVector::const_iterator i = layers.begin(); i != layers.end(); ++i)
+    {
+        Layer* layer = i->get();
+
+        if (!layer->isOpen())
+            continue;
+
+        if (layer->getRenderType() != layer->RENDERTYPE_TERRAIN_SURFACE)
+            continue;
+
+        if (manifest.excludes(layer))
+            continue;
+
+        ImageLayer* imageLayer = dynamic_cast<ImageLayer*>(layer);
+        if (imageLayer && pagedByEngine(imageLayer, requirements))
+        {
+            tasks.push_back([imageLayer](TerrainTileModel* part) {
+                part->colorLayers().push_back(createBareColorLayerModel(imageLayer));
+            });
+        }
+        else if (imageLayer)
+        {
+            tasks.push_back([this, imageLayer, key, requirements, progress](TerrainTileModel* part) {
+                addImageLayer(part, imageLayer, key, requirements, progress);
+            });
+        }
+        else // non-image kind of TILE layer:
+        {
+            tasks.push_back([layer](TerrainTileModel* part) {
+                part->colorLayers().push_back(createBareColorLayerModel(layer));
+            });
+        }
+    }
+
+    if ( requirements == 0L || requirements->elevationTexturesRequired() )
+    {
+        unsigned border = (requirements && requirements->elevationBorderRequired()) ? 1u : 0u;
+
+        tasks.push_back([this, map, key, &manifest, border, progress](TerrainTileModel* part) {
+            addElevation(part, map, key, manifest, border, progress);
+        });
+    }
+
+    tasks.push_back([this, map, key, requirements, &manifest, progress](TerrainTileModel* part) {
+        addLandCover(part, map, key, requirements, manifest, progress);
+    });
+
+    // Dispatch all but the last task, which we run in this thread
+    // since it would otherwise just sit and wait.
+    Threading::JobArena* arena = Registry::instance()->getJobArena("terrain.layers");
+    int revision = map->getDataModelRevision();
+
+    std::vector<Threading::Future<TerrainTileModel> > futures;
+    for (unsigned i = 0; i + 1 < tasks.size(); ++i)
+    {
+        Threading::Promise<TerrainTileModel> promise;
+        futures.push_back(promise.getFuture());
+        Task task = tasks[i];
+
+        Threading::runInJobArena(arena, [promise, task, key, revision]() mutable {
+            osg::ref_ptr<TerrainTileModel> part = new TerrainTileModel(key, revision);
+            task(part.get());
+            promise.resolve(part.get());
+        });
+    }
+
+    osg::ref_ptr<TerrainTileModel> last = new TerrainTileModel(key, revision);
+    tasks.back()(last.get());
+
+    // Wait for everything, even if the progress callback cancels; the tasks
+    // reference data on our stack and will exit early on their own.
+    Threading::Future<Threading::FutureVector<TerrainTileModel> > all = Threading::when_all(futures);
+    osg::ref_ptr<Threading::FutureVector<TerrainTileModel> > parts = all.get();
+
+    // Assemble the final model in the original layer order.
+    osg::ref_ptr<TerrainTileModel> model = new TerrainTileModel(key, revision);
+
+    if (parts.valid())
+    {
+        parts->push_back(last.get());
+
+        for (auto& part : *parts)
+        {
+            if (!part.valid())
+                continue;
+
+            for (auto& colorLayer : part->colorLayers())
+                model->colorLayers().push_back(colorLayer.get());
+
+            for (auto& sharedLayer : part->sharedLayers())
+                model->sharedLayers().push_back(sharedLayer.get());
+
+            if (part->elevationModel().valid())
+                model->elevationModel() = part->elevationModel().get();
+
+            if (part->landCoverModel().valid())
+                model->landCoverModel() = part->landCoverModel().get();
+
+            if (part->requiresUpdateTraverse())
+                model->setRequiresUpdateTraverse(true);
+        }
+    }
+
+    return model.release();
+}
+
 TerrainTileModel*
 TerrainTileModelFactory::createStandaloneTileModel(
     const Map*                       map,
@@ -210,6 +385,10 @@ TerrainTileModelFactory::addImageLayer(
         
     if (imageLayer->isKeyInLegalRange(key) && imageLayer->mayHaveData(key))
     {
+        Trace::Scope trace("tile.imageLayer", "terrain");
+        if (trace.active())
+            trace.setDetail(imageLayer->getName() + " " + key.str());
+
         if (imageLayer->useCreateTexture())
         {
             window = imageLayer->createTexture(key, progress);
@@ -331,7 +510,11 @@ TerrainTileModelFactory::addColorLayers(
             continue;
 
         ImageLayer* imageLayer = dynamic_cast<ImageLayer*>(layer);
-        if (imageLayer)
+        if (imageLayer && !standalone && pagedByEngine(imageLayer, reqs))
+        {
+            model->colorLayers().push_back(createBareColorLayerModel(imageLayer));
+        }
+        else if (imageLayer)
         {
             if (standalone)
             {
@@ -344,10 +527,7 @@ TerrainTileModelFactory::addColorLayers(
         }
         else // non-image kind of TILE layer:
         {
-            TerrainTileColorLayerModel* colorModel = new TerrainTileColorLayerModel();
-            colorModel->setLayer(layer);
-            colorModel->setRevision(layer->getRevision());
-            model->colorLayers().push_back(colorModel);
+            model->colorLayers().push_back(createBareColorLayerModel(layer));
         }
     }
 }
@@ -425,10 +605,18 @@ TerrainTileModelFactory::addElevation(
 
     osg::ref_ptr<ElevationTexture> elevTex;
 
-    bool getNormalMap = (_options.normalMaps() == true);
+    // With GPU normal maps the shaders derive normals from the elevation
+    // texture, so there's nothing to build here.
+    bool getNormalMap =
+        _options.normalMaps() == true &&
+        _options.gpuNormalMaps() == false;
 
     const bool acceptLowerRes = false;
 
+    Trace::Scope trace("tile.elevation", "terrain");
+    if (trace.active())
+        trace.setDetail(key.str());
+
     if (map->getElevationPool()->getTile(key, acceptLowerRes, elevTex, NULL, progress))
     {
         osg::ref_ptr<TerrainTileElevationModel> layerModel = new TerrainTileElevationModel();
@@ -437,18 +625,27 @@ TerrainTileModelFactory::addElevation(
 
         if ( elevTex.valid() )
         {
+            // The driver converts the 32-bit heights at upload time, so the
+            // CPU copy that picking and tile bounds read from is unaffected.
+            GLint elevFormat = _options.halfFloatElevation() == true ? GL_R16F : GL_R32F;
+            if (elevTex->getInternalFormat() != elevFormat)
+                elevTex->setInternalFormat(elevFormat);
+
             // Make a normal map
-            NormalMapGenerator gen;
+            if (getNormalMap)
+            {
+                Trace::Scope trace("tile.normalMap", "terrain");
+                if (trace.active())
+                    trace.setDetail(key.str());
 
-            Distance resolution(
-                key.getExtent().height() / (osgEarth::ELEVATION_TILE_SIZE-1),
-                key.getProfile()->getSRS()->getUnits());
-            
-            osg::Texture2D* normalMap = gen.createNormalMap(key, map, &_workingSet, progress);
+                NormalMapGenerator gen;
 
-            if (normalMap)
-            {
-                elevTex->setNormalMapTexture(normalMap);
+                osg::Texture2D* normalMap = gen.createNormalMap(key, map, &_workingSet, progress);
+
+                if (normalMap)
+                {
+                    elevTex->setNormalMapTexture(normalMap);
+                }
             }
 
             // Made an image, so store this as a texture with no matrix.
@@ -688,7 +885,7 @@ TerrainTileModelFactory::createElevationTexture(osg::Image* image) const
 {
     osg::Texture2D* tex = new osg::Texture2D( image );
     tex->setDataVariance(osg::Object::STATIC);
-    tex->setInternalFormat(GL_R32F);
+    tex->setInternalFormat(_options.halfFloatElevation() == true ? GL_R16F : GL_R32F);
     tex->setFilter( osg::Texture::MAG_FILTER, osg::Texture::LINEAR );
     tex->setFilter( osg::Texture::MIN_FILTER, osg::Texture::NEAREST );
     tex->setWrap  ( osg::Texture::WRAP_S,     osg::Texture::CLAMP_TO_EDGE );
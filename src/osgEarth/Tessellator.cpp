@@ -30,15 +30,15 @@
 namespace mapbox {
     namespace util {
         template <>
-        struct nth<0, osg::Vec2> {
-            inline static float get(const osg::Vec2 &t) {
+        struct nth<0, osg::Vec2d> {
+            inline static double get(const osg::Vec2d &t) {
                 return t.x();
             };
         };
 
         template <>
-        struct nth<1, osg::Vec2> {
-            inline static float get(const osg::Vec2 &t) {
+        struct nth<1, osg::Vec2d> {
+            inline static double get(const osg::Vec2d &t) {
                 return t.y();
             };
         };
@@ -261,47 +261,95 @@ Tessellator::tessellateGeometry(osg::Geometry &geom)
     }
     return success;
 #else
-    // Create array
-    std::vector< std::vector< osg::Vec2 > > polygon;
-    osg::Vec3Array* verts = static_cast<osg::Vec3Array*>(geom.getVertexArray());
-    int areaPlane = polygonPlane(*verts);
+    osg::Vec3Array* verts = dynamic_cast<osg::Vec3Array*>(geom.getVertexArray());
+
+    if (!verts || verts->size() < 3 || geom.getPrimitiveSetList().empty()) return false;
 
+    // Collect the rings as runs of vertices. The first ring is the outer
+    // boundary and the rest are holes, which earcut bridges itself.
+    // Bail out (leaving the geometry alone) on anything that isn't a ring.
+    std::vector<std::pair<unsigned, unsigned> > runs; // first, count
     for (unsigned int i = 0; i < geom.getNumPrimitiveSets(); i++)
     {
-        std::vector< osg::Vec2 > ring;
-        osg::PrimitiveSet* pset = geom.getPrimitiveSet(i);
+        const osg::PrimitiveSet* pset = geom.getPrimitiveSet(i);
+        if (pset->getMode() != osg::PrimitiveSet::POLYGON && pset->getMode() != osg::PrimitiveSet::LINE_LOOP)
+            return false;
+
         if (pset->getType() == osg::PrimitiveSet::DrawArraysPrimitiveType)
         {
-            osg::DrawArrays* drawArray = static_cast<osg::DrawArrays*>(pset);
-            unsigned int first = drawArray->getFirst();
-            unsigned int last = first + drawArray->getCount();
-            ring.reserve(drawArray->getCount());
-            for (unsigned int j = first; j < last; j++)
+            const osg::DrawArrays* da = static_cast<const osg::DrawArrays*>(pset);
+            runs.push_back(std::make_pair((unsigned)da->getFirst(), (unsigned)da->getCount()));
+        }
+        else if (pset->getType() == osg::PrimitiveSet::DrawArrayLengthsPrimitiveType)
+        {
+            const osg::DrawArrayLengths* dal = static_cast<const osg::DrawArrayLengths*>(pset);
+            unsigned first = dal->getFirst();
+            for (osg::DrawArrayLengths::const_iterator len = dal->begin(); len != dal->end(); ++len)
             {
-                const osg::Vec3& v = verts->at(j);
-                switch (areaPlane) {
-                    case AREA_PLANE_XY: ring.push_back(osg::Vec2(v.x(), v.y())); break;
-                    case AREA_PLANE_XZ: ring.push_back(osg::Vec2(v.x(), v.z())); break;
-                    case AREA_PLANE_YZ: ring.push_back(osg::Vec2(v.y(), v.z())); break;
-                }
+                runs.push_back(std::make_pair(first, (unsigned)*len));
+                first += *len;
             }
         }
-        polygon.push_back(ring);
+        else
+        {
+            return false;
+        }
+    }
+
+    // Project onto the dominant plane, in double precision. Earcut numbers
+    // its output by position in the ring list, so record the source vertex
+    // behind each position.
+    int areaPlane = polygonPlane(*verts);
+
+    std::vector< std::vector< osg::Vec2d > > polygon(runs.size());
+    std::vector<unsigned> sourceIndex;
+    sourceIndex.reserve(verts->size());
+
+    for (unsigned r = 0; r < runs.size(); ++r)
+    {
+        unsigned first = runs[r].first, last = first + runs[r].second;
+        if (last > verts->size())
+            return false;
+
+        std::vector< osg::Vec2d >& ring = polygon[r];
+        ring.reserve(runs[r].second);
+        for (unsigned j = first; j < last; ++j)
+        {
+            const osg::Vec3& v = (*verts)[j];
+            switch (areaPlane) {
+                case AREA_PLANE_XY: ring.push_back(osg::Vec2d(v.x(), v.y())); break;
+                case AREA_PLANE_XZ: ring.push_back(osg::Vec2d(v.x(), v.z())); break;
+                case AREA_PLANE_YZ: ring.push_back(osg::Vec2d(v.y(), v.z())); break;
+            }
+            sourceIndex.push_back(j);
+        }
     }
 
-    // The index type. Defaults to uint32_t, but you can also pass uint16_t if you know that your
-    // data won't have more than 65536 vertices.
     std::vector<uint32_t> indices = mapbox::earcut<uint32_t>(polygon);
-    // Remove the existing primitive sets
+    if (indices.empty())
+        return false;
+
+    // Replace the rings with the triangles
     geom.removePrimitiveSet(0, geom.getNumPrimitiveSets());
     osg::DrawElementsUInt* drawElements = new osg::DrawElementsUInt(GL_TRIANGLES);
     drawElements->reserve(indices.size());
-    std::copy(indices.begin(), indices.end(), std::back_inserter(*drawElements));
+    for (std::vector<uint32_t>::const_iterator i = indices.begin(); i != indices.end(); ++i)
+        drawElements->push_back(sourceIndex[*i]);
     geom.addPrimitiveSet(drawElements);
     return true;
 #endif
 }
 
+bool
+Tessellator::supportsHoles()
+{
+#ifdef USE_EARCUT
+    return true;
+#else
+    return false;
+#endif
+}
+
 
 osg::PrimitiveSet*
 Tessellator::tessellatePrimitive(osg::PrimitiveSet* primitive, osg::Vec3Array* vertices)
@@ -19,6 +19,7 @@
 #include <osgEarth/Threading>
 #include <osgDB/Options>
 #include <osg/OperationThread>
+#include <algorithm>
 #include "Utils"
 #include "Metrics"
 
@@ -340,11 +341,25 @@ void ReadWriteMutex::setName(const std::string& name)
 #undef LC
 #define LC "[ThreadPool] "
 
+namespace
+{
+    // identifies the pool and worker index of the calling thread, if any,
+    // so that operations queued from a worker stay local to that worker.
+    thread_local const void* s_currentPool = nullptr;
+    thread_local unsigned s_currentWorker = 0u;
+}
+
 ThreadPool::ThreadPool(unsigned int numThreads) :
-    _numThreads(numThreads),
-    _done(false),
-    _queueMutex("ThreadPool")
+    _numThreads(std::max(numThreads, 1u)),
+    _numQueued(0u),
+    _next(0u),
+    _numSleeping(0u),
+    _sleepMutex("ThreadPool"),
+    _done(false)
 {
+    for (unsigned i = 0; i < _numThreads; ++i)
+        _queues.emplace_back(new WorkerQueue());
+
     startThreads();
 }
 
@@ -354,18 +369,154 @@ ThreadPool::~ThreadPool()
 }
 
 void ThreadPool::run(osg::Operation* op)
+{
+    run(op, 0.0f, nullptr);
+}
+
+void ThreadPool::run(osg::Operation* op, float priority, const Cancelable* cancelable)
 {
     if (op)
     {
-        Threading::ScopedMutexLock lock(_queueMutex);
-        _queue.push(op);
-        _block.notify_all();
+        unsigned index =
+            s_currentPool == this ? s_currentWorker :
+            (_next++) % _numThreads;
+
+        push(index, op, priority, cancelable);
+    }
+}
+
+void ThreadPool::push(unsigned worker, osg::Operation* op, float priority, const Cancelable* cancelable)
+{
+    // increment first so the count never undershoots, and so that a
+    // worker about to go to sleep will see the new job and stay awake.
+    ++_numQueued;
+
+    {
+        WorkerQueue& wq = *_queues[worker];
+        Threading::ScopedMutexLock lock(wq._mutex);
+        Job job;
+        job._op = op;
+        job._cancelable = cancelable;
+        wq._queue.emplace(priority, job);
+    }
+
+    if (_numSleeping > 0u)
+    {
+        Threading::ScopedMutexLock lock(_sleepMutex);
+        _block.notify_one();
+    }
+}
+
+bool ThreadPool::take(unsigned index, Job& out)
+{
+    WorkerQueue& wq = *_queues[index];
+    Threading::ScopedMutexLock lock(wq._mutex);
+    while (!wq._queue.empty())
+    {
+        Queue::iterator i = wq._queue.begin();
+        out = i->second;
+        wq._queue.erase(i);
+        --_numQueued;
+
+        if (out._cancelable == nullptr || !out._cancelable->isCanceled())
+            return true;
+    }
+    return false;
+}
+
+bool ThreadPool::pop(unsigned worker, Job& out)
+{
+    // own queue first:
+    if (take(worker, out))
+        return true;
+
+    // nothing local; try to steal from the other workers.
+    for (unsigned i = 1; i < _numThreads && _numQueued > 0u; ++i)
+    {
+        if (take((worker + i) % _numThreads, out))
+            return true;
+    }
+
+    return false;
+}
+
+bool ThreadPool::setPriority(osg::Operation* op, float priority)
+{
+    for (auto& wq : _queues)
+    {
+        Threading::ScopedMutexLock lock(wq->_mutex);
+        for (Queue::iterator i = wq->_queue.begin(); i != wq->_queue.end(); ++i)
+        {
+            if (i->second._op.get() == op)
+            {
+                Job job = i->second;
+                wq->_queue.erase(i);
+                wq->_queue.emplace(priority, job);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool ThreadPool::cancel(osg::Operation* op)
+{
+    for (auto& wq : _queues)
+    {
+        Threading::ScopedMutexLock lock(wq->_mutex);
+        for (Queue::iterator i = wq->_queue.begin(); i != wq->_queue.end(); ++i)
+        {
+            if (i->second._op.get() == op)
+            {
+                wq->_queue.erase(i);
+                --_numQueued;
+                return true;
+            }
+        }
     }
+    return false;
 }
 
 unsigned ThreadPool::getNumOperationsInQueue() const
 {
-    return _queue.size();
+    return _numQueued;
+}
+
+void ThreadPool::worker(unsigned index)
+{
+    OE_DEBUG << LC << "Thread " << std::this_thread::get_id() << " started." << std::endl;
+
+    s_currentPool = this;
+    s_currentWorker = index;
+
+    while (!_done)
+    {
+        Job job;
+        if (pop(index, job))
+        {
+            // run the op:
+            (*job._op.get())(nullptr);
+
+            // if it's a keeper, requeue it
+            if (job._op->getKeep() && !_done)
+            {
+                push(index, job._op.get(), 0.0f, job._cancelable);
+            }
+        }
+        else
+        {
+            std::unique_lock<Mutex> lock(_sleepMutex);
+            ++_numSleeping;
+            _block.wait(lock, [this] {
+                return _numQueued > 0u || _done;
+            });
+            --_numSleeping;
+        }
+    }
+
+    s_currentPool = nullptr;
+
+    OE_DEBUG << LC << "Thread " << std::this_thread::get_id() << " exiting." << std::endl;
 }
 
 void ThreadPool::startThreads()
@@ -374,51 +525,22 @@ void ThreadPool::startThreads()
 
     for(unsigned i=0; i<_numThreads; ++i)
     {
-        _threads.push_back(std::thread( [this]
+        _threads.push_back(std::thread( [this, i]
         {
-            OE_DEBUG << LC << "Thread " << std::this_thread::get_id() << " started." << std::endl;
-            while(!_done)
-            {
-                osg::ref_ptr<osg::Operation> op;
-                {
-                    std::unique_lock<Mutex> lock(_queueMutex);
-
-                    _block.wait(lock, [this] {
-                        return !_queue.empty() || _done;
-                    });
-
-                    if (!_queue.empty() && !_done)
-                    {
-                        op = _queue.front();
-                        _queue.pop();
-                    }
-                }
-
-                if (op.valid())
-                {
-                    // run the op:
-                    (*op.get())(nullptr);
-
-                    // if it's a keeper, requeue it
-                    if (op->getKeep())
-                    {
-                        Threading::ScopedMutexLock lock(_queueMutex);
-                        _queue.push(op);
-                    }
-                    op = nullptr;
-                }
-            }
-            OE_DEBUG << LC << "Thread " << std::this_thread::get_id() << " exiting." << std::endl;
+            worker(i);
         }));
     }
 }
 
 void ThreadPool::stopThreads()
 {
-    _done = true;
-    _block.notify_all();
+    {
+        Threading::ScopedMutexLock lock(_sleepMutex);
+        _done = true;
+        _block.notify_all();
+    }
 
-    for(unsigned i=0; i<_numThreads; ++i)
+    for(unsigned i=0; i<_threads.size(); ++i)
     {
         if (_threads[i].joinable())
         {
@@ -428,11 +550,13 @@ void ThreadPool::stopThreads()
 
     _threads.clear();
     
-    // Clear out the queue
+    // Clear out the queues
+    for (auto& wq : _queues)
     {
-        Threading::ScopedMutexLock lock(_queueMutex);
-        _queue.swap(Queue());
+        Threading::ScopedMutexLock lock(wq->_mutex);
+        wq->_queue.clear();
     }
+    _numQueued = 0u;
 }
 
 void
@@ -451,3 +575,172 @@ ThreadPool::get(const osgDB::Options* options)
     return OptionsData<ThreadPool>::get(options, "osgEarth::ThreadPool");
 }
 
+#undef LC
+#define LC "[JobArena] "
+
+namespace
+{
+    struct FunctionOperation : public osg::Operation
+    {
+        FunctionOperation(const std::function<void()>& func) :
+            osg::Operation("Function", false), _func(func) { }
+
+        void operator()(osg::Object*) override
+        {
+            _func();
+        }
+
+        std::function<void()> _func;
+    };
+}
+
+void
+osgEarth::Threading::runInJobArena(JobArena* arena, const std::function<void()>& func)
+{
+    if (arena)
+        arena->run(new FunctionOperation(func));
+    else
+        func();
+}
+
+//! Wraps an arena's operation so the arena knows when it completes
+struct JobArena::Dispatch : public osg::Operation
+{
+    Dispatch(JobArena* arena, const Job& job, float priority) :
+        osg::Operation("JobArena", false),
+        _arena(arena), _job(job), _priority(priority) { }
+
+    void operator()(osg::Object* obj) override
+    {
+        if (_job._cancelable == nullptr || !_job._cancelable->isCanceled())
+        {
+            (*_job._op.get())(obj);
+        }
+        _arena->finished(_job, _priority);
+    }
+
+    osg::ref_ptr<JobArena> _arena;
+    Job _job;
+    float _priority;
+};
+
+JobArena::JobArena(const std::string& name, unsigned concurrency, ThreadPool* pool) :
+    _name(name),
+    _concurrency(std::max(concurrency, 1u)),
+    _numActive(0u),
+    _pool(pool),
+    _mutex("JobArena(OE)"),
+    _queuedGauge("jobs." + name + ".queued"),
+    _runningGauge("jobs." + name + ".running")
+{
+    _mutex.setName("JobArena " + name);
+}
+
+void
+JobArena::setConcurrency(unsigned value)
+{
+    _concurrency = std::max(value, 1u);
+
+    // raising the limit may free up slots right away
+    dispatch();
+}
+
+void
+JobArena::run(osg::Operation* op, float priority, const Cancelable* cancelable)
+{
+    if (op && _pool.valid())
+    {
+        {
+            Threading::ScopedMutexLock lock(_mutex);
+            Job job;
+            job._op = op;
+            job._cancelable = cancelable;
+            _queue.emplace(priority, job);
+        }
+        dispatch();
+    }
+}
+
+bool
+JobArena::setPriority(osg::Operation* op, float priority)
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    for (Queue::iterator i = _queue.begin(); i != _queue.end(); ++i)
+    {
+        if (i->second._op.get() == op)
+        {
+            Job job = i->second;
+            _queue.erase(i);
+            _queue.emplace(priority, job);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool
+JobArena::cancel(osg::Operation* op)
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    for (Queue::iterator i = _queue.begin(); i != _queue.end(); ++i)
+    {
+        if (i->second._op.get() == op)
+        {
+            _queue.erase(i);
+            _queuedGauge.set(_queue.size());
+            return true;
+        }
+    }
+    return false;
+}
+
+unsigned
+JobArena::getNumOperationsInQueue() const
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    return _queue.size();
+}
+
+void
+JobArena::dispatch()
+{
+    std::vector<osg::ref_ptr<Dispatch> > ready;
+    {
+        Threading::ScopedMutexLock lock(_mutex);
+        while (_numActive < _concurrency && !_queue.empty())
+        {
+            Queue::iterator i = _queue.begin();
+            if (i->second._cancelable == nullptr || !i->second._cancelable->isCanceled())
+            {
+                ready.push_back(new Dispatch(this, i->second, i->first));
+                ++_numActive;
+            }
+            _queue.erase(i);
+        }
+        _queuedGauge.set(_queue.size());
+        _runningGauge.set(_numActive);
+    }
+
+    // submit outside the lock; the pool maintains its own ordering
+    for (auto& d : ready)
+    {
+        _pool->run(d.get(), d->_priority);
+    }
+}
+
+void
+JobArena::finished(const Job& job, float priority)
+{
+    {
+        Threading::ScopedMutexLock lock(_mutex);
+        --_numActive;
+
+        // if it's a keeper, requeue it
+        if (job._op->getKeep())
+        {
+            _queue.emplace(priority, job);
+        }
+    }
+    dispatch();
+}
+
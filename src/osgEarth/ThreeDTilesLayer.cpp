@@ -38,6 +38,13 @@ ThreeDTilesLayer::Options::getConfig() const
     Config conf = VisibleLayer::Options::getConfig();
     conf.set("url", _url);
     conf.set("max_sse", _maximumScreenSpaceError);
+    conf.set("max_memory", _maxMemory);
+    conf.set("skip_lod", _skipLevelOfDetail);
+    conf.set("base_sse", _baseScreenSpaceError);
+    conf.set("skip_sse_factor", _skipScreenSpaceErrorFactor);
+    conf.set("skip_levels", _skipLevels);
+    conf.set("immediately_load_desired_lod", _immediatelyLoadDesiredLevelOfDetail);
+    conf.set("compress_textures", _compressTextures);
     return conf;
 }
 
@@ -45,8 +52,21 @@ void
 ThreeDTilesLayer::Options::fromConfig( const Config& conf )
 {
     _maximumScreenSpaceError.init(15.0f);
+    _skipLevelOfDetail.init(false);
+    _baseScreenSpaceError.init(1024.0f);
+    _skipScreenSpaceErrorFactor.init(16.0f);
+    _skipLevels.init(1u);
+    _immediatelyLoadDesiredLevelOfDetail.init(false);
+    _compressTextures.init(true);
     conf.get("url", _url);
     conf.get("max_sse", _maximumScreenSpaceError);
+    conf.get("max_memory", _maxMemory);
+    conf.get("skip_lod", _skipLevelOfDetail);
+    conf.get("base_sse", _baseScreenSpaceError);
+    conf.get("skip_sse_factor", _skipScreenSpaceErrorFactor);
+    conf.get("skip_levels", _skipLevels);
+    conf.get("immediately_load_desired_lod", _immediatelyLoadDesiredLevelOfDetail);
+    conf.get("compress_textures", _compressTextures);
 }
 
 //........................................................................
@@ -65,7 +85,7 @@ ThreeDTilesLayer::init()
 {
     VisibleLayer::init();
 
-    // Make sure the b3dm plugin is loaded
+    // Make sure the b3dm, i3dm and pnts plugin is loaded
     std::string libname = osgDB::Registry::instance()->createLibraryNameForExtension("gltf");
     osgDB::Registry::instance()->loadLibrary(libname);
 }
@@ -102,6 +122,16 @@ ThreeDTilesLayer::openImplementation()
     _tilesetNode = new ThreeDTilesetNode(tileset, "", getSceneGraphCallbacks(), readOptions.get());
     _tilesetNode->setMaximumScreenSpaceError(*options().maximumScreenSpaceError());
     _tilesetNode->setOwnerName(getName());
+    _tilesetNode->setSkipLevelOfDetail(*options().skipLevelOfDetail());
+    _tilesetNode->setBaseScreenSpaceError(*options().baseScreenSpaceError());
+    _tilesetNode->setSkipScreenSpaceErrorFactor(*options().skipScreenSpaceErrorFactor());
+    _tilesetNode->setSkipLevels(*options().skipLevels());
+    _tilesetNode->setImmediatelyLoadDesiredLevelOfDetail(*options().immediatelyLoadDesiredLevelOfDetail());
+    _tilesetNode->setCompressTextures(*options().compressTextures());
+    if (options().maxMemory().isSet())
+    {
+        _tilesetNode->setMaxMemory((size_t)options().maxMemory().get() * 1048576u);
+    }
 
     return STATUS_OK;
 }
@@ -39,3 +39,13 @@ std::string TileHandler::getProcessString() const
 {
     return "";
 }
+
+bool TileHandler::isSubtreeComplete(const TileKey& key, const TileVisitor& tv) const
+{
+    return false;
+}
+
+void TileHandler::setSubtreeComplete(const TileKey& key, const TileVisitor& tv)
+{
+    //nop
+}
@@ -36,7 +36,9 @@ using namespace std;
 
 #define OGR_SCOPED_LOCK GDAL_SCOPED_LOCK
 
-TileIndex::TileIndex()
+TileIndex::TileIndex() :
+_treeDirty(true),
+_treeMutex("TileIndex(OE)")
 {
 }
 
@@ -102,25 +104,52 @@ TileIndex::create( const std::string& filename, const osgEarth::SpatialReference
 }
 
 
+void
+TileIndex::buildTree()
+{
+    // Read every footprint once; after that, queries never touch the
+    // feature source.
+    _locations.clear();
+    _tree = new PackedRTree();
+
+    osg::ref_ptr< osgEarth::FeatureCursor> cursor = _features->createFeatureCursor( osgEarth::Query(), 0L );
+    while (cursor.valid() && cursor->hasMore())
+    {
+        osg::ref_ptr< osgEarth::Feature> feature = cursor->nextFeature();
+        if (feature.valid() && feature->getGeometry())
+        {
+            _tree->add( (FeatureID)_locations.size(), feature->getGeometry()->getBounds() );
+            _locations.push_back( getFullPath(_filename, feature->getString("location")) );
+        }
+    }
+
+    _tree->build();
+    _treeDirty = false;
+}
+
 void
 TileIndex::getFiles(const osgEarth::GeoExtent& extent, std::vector< std::string >& files)
 {            
     files.clear();
-    osgEarth::Query query;    
 
     GeoExtent transformed = extent.transform( _features->getFeatureProfile()->getSRS() );
-    query.bounds() = transformed.bounds();
-    osg::ref_ptr< osgEarth::FeatureCursor> cursor = _features->createFeatureCursor( query, 0L );
+    if (!transformed.isValid())
+        return;
+
+    Threading::ScopedMutexLock lock(_treeMutex);
+
+    if (_treeDirty)
+        buildTree();
 
-    while (cursor->hasMore())
+    // results come back in the order the files were added
+    std::vector< FeatureID > hits;
+    _tree->search( transformed.bounds(), hits );
+
+    files.reserve( hits.size() );
+    for (std::vector< FeatureID >::const_iterator i = hits.begin(); i != hits.end(); ++i)
     {
-        osg::ref_ptr< osgEarth::Feature> feature = cursor->nextFeature();
-        if (feature.valid())
-        {
-            std::string location = getFullPath(_filename, feature->getString("location"));
-            files.push_back( location );
-        }
-    }    
+        files.push_back( _locations[*i] );
+    }
 }
 
 bool TileIndex::add( const std::string& filename, const GeoExtent& extent )
@@ -138,6 +167,10 @@ bool TileIndex::add( const std::string& filename, const GeoExtent& extent )
     const SpatialReference* wgs84 = SpatialReference::create("epsg:4326");
     feature->transform( wgs84 );
 
-    return _features->insertFeature( feature.get() );    
+    if (!_features->insertFeature( feature.get() ))
+        return false;
+
+    Threading::ScopedMutexLock lock(_treeMutex);
+    _treeDirty = true;
     return true;
 }
@@ -38,13 +38,20 @@ TileKey::TileKey(unsigned int lod, unsigned int tile_x, unsigned int tile_y, con
     rehash();
 }
 
+TileKey::TileKey(const PackedTileKey& packed, const Profile* profile)
+{
+    _x = packed.getTileX();
+    _y = packed.getTileY();
+    _lod = packed.getLOD();
+    _profile = packed.valid() ? profile : 0L;
+    rehash();
+}
+
 TileKey::TileKey(const TileKey& rhs) :
-    _key(rhs._key),
     _lod(rhs._lod),
     _x(rhs._x),
     _y(rhs._y),
     _profile(rhs._profile.get()),
-    _extent(rhs._extent),
     _hash(rhs._hash)
 {
     //NOP
@@ -142,23 +149,10 @@ TileKey::getResolution(unsigned tileSize) const
 TileKey
 TileKey::createChildKey( unsigned int quadrant ) const
 {
+    // quadrant 1 is +x, 2 is +y, 3 is both
     unsigned int lod = _lod + 1;
-    unsigned int x = _x * 2;
-    unsigned int y = _y * 2;
-
-    if (quadrant == 1)
-    {
-        x+=1;
-    }
-    else if (quadrant == 2)
-    {
-        y+=1;
-    }
-    else if (quadrant == 3)
-    {
-        x+=1;
-        y+=1;
-    }
+    unsigned int x = (_x << 1) | (quadrant & 1u);
+    unsigned int y = (_y << 1) | ((quadrant >> 1) & 1u);
     return TileKey( lod, x, y, _profile.get());
 }
 
@@ -168,10 +162,7 @@ TileKey::createParentKey() const
 {
     if (_lod == 0) return TileKey::INVALID;
 
-    unsigned int lod = _lod - 1;
-    unsigned int x = _x / 2;
-    unsigned int y = _y / 2;
-    return TileKey( lod, x, y, _profile.get());
+    return TileKey( _lod - 1, _x >> 1, _y >> 1, _profile.get());
 }
 
 bool
@@ -195,13 +186,12 @@ TileKey::createAncestorKey( int ancestorLod ) const
 {
     if ( ancestorLod > (int)_lod ) return TileKey::INVALID;
 
-    unsigned int x = _x, y = _y;
-    for( int i=_lod; i > ancestorLod; i-- )
-    {
-        x /= 2;
-        y /= 2;
-    }
-    return TileKey( ancestorLod, x, y, _profile.get() );
+    if ( ancestorLod < 0 ) return TileKey::INVALID;
+
+    unsigned int shift = _lod - (unsigned)ancestorLod;
+    return shift < 32u ?
+        TileKey( ancestorLod, _x >> shift, _y >> shift, _profile.get() ) :
+        TileKey( ancestorLod, 0u, 0u, _profile.get() );
 }
 
 TileKey
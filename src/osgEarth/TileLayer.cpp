@@ -22,6 +22,7 @@
 #include <osgEarth/URI>
 #include <osgEarth/Map>
 #include <osgEarth/MemCache>
+#include <osgEarth/rtree.h>
 
 using namespace osgEarth;
 using namespace OpenThreads;
@@ -45,6 +46,8 @@ TileLayer::Options::getConfig() const
     conf.set( "no_data_value", _noDataValue);
     conf.set( "min_valid_value", _minValidValue);
     conf.set( "max_valid_value", _maxValidValue);
+    conf.set( "missing_tile_ttl", _missingTileTTL);
+    conf.set( "metadata_ttl", _metadataTTL);
 
     return conf;
 }
@@ -59,6 +62,8 @@ TileLayer::Options::fromConfig(const Config& conf)
     _noDataValue.init( -32767.0f ); // SHRT_MIN
     _minValidValue.init( -32766.0f ); // -(2^15 - 2)
     _maxValidValue.init( 32767.0f );
+    _missingTileTTL.init( 0 );
+    _metadataTTL.init( 0 );
 
     conf.get( "min_level", _minLevel );
     conf.get( "max_level", _maxLevel );
@@ -71,6 +76,8 @@ TileLayer::Options::fromConfig(const Config& conf)
     conf.get( "nodata_value", _noDataValue); // back compat
     conf.get( "min_valid_value", _minValidValue);
     conf.get( "max_valid_value", _maxValidValue);
+    conf.get( "missing_tile_ttl", _missingTileTTL);
+    conf.get( "metadata_ttl", _metadataTTL);
 }
 
 //------------------------------------------------------------------------
@@ -285,6 +292,26 @@ float TileLayer::getMaxValidValue() const
     return options().maxValidValue().get();
 }
 
+void TileLayer::setMissingTileTTL(const TimeSpan& value)
+{
+    setOptionThatRequiresReopen(options().missingTileTTL(), value);
+}
+
+const TimeSpan& TileLayer::getMissingTileTTL() const
+{
+    return options().missingTileTTL().get();
+}
+
+void TileLayer::setMetadataTTL(const TimeSpan& value)
+{
+    setOptionThatRequiresReopen(options().metadataTTL(), value);
+}
+
+const TimeSpan& TileLayer::getMetadataTTL() const
+{
+    return options().metadataTTL().get();
+}
+
 void TileLayer::setTileSize(unsigned value)
 {
     setOptionThatRequiresReopen(options().tileSize(), value);
@@ -303,6 +330,9 @@ TileLayer::init()
 
     _writingRequested = false;
     _profileMatchesMapProfile = true;
+    _hasNewerMetadata = false;
+    _revalidatingMetadata = false;
+    _metadataRevalidated = false;
 
     // If the user asked for a custom profile, install it now
     if (options().profile().isSet())
@@ -354,17 +384,38 @@ TileLayer::setUpL2Cache(unsigned minSize)
         OE_INFO << LC << "L2 cache size set from environment = " << l2CacheSize << "\n";
     }
 
+    // Optional memory budget, which replaces the entry count
+    unsigned l2CacheSizeMB = layerHints().L2CacheSizeMB().getOrUse(0u);
+    char const* l2mbEnv = ::getenv("OSGEARTH_L2_CACHE_SIZE_MB");
+    if (l2mbEnv)
+    {
+        l2CacheSizeMB = as<unsigned>(std::string(l2mbEnv), 0u);
+        OE_INFO << LC << "L2 cache memory set from environment = " << l2CacheSizeMB << " MB\n";
+    }
+
     // Env cache-only mode also disables the L2 cache.
     char const* noCacheEnv = ::getenv("OSGEARTH_MEMORY_PROFILE");
     if (noCacheEnv)
     {
         l2CacheSize = 0;
+        l2CacheSizeMB = 0;
     }
 
     // Initialize the l2 cache if it's size is > 0
-    if (l2CacheSize > 0)
+    if (l2CacheSize > 0 || l2CacheSizeMB > 0)
     {
         _memCache = new MemCache(l2CacheSize);
+
+        if (l2CacheSizeMB > 0u)
+        {
+            _memCache->setMaxBinBytes((unsigned long long)l2CacheSizeMB * 1048576ull);
+        }
+
+        if (::getenv("OSGEARTH_L2_CACHE_CLOCK"))
+        {
+            _memCache->setUseClockEviction(true);
+        }
+
         OE_INFO << LC << "L2 cache size = " << l2CacheSize << std::endl;
     }
 }
@@ -379,9 +430,16 @@ TileLayer::openImplementation()
     if (isOpen())
         _cacheBinMetadata.clear();
 
+    _hasNewerMetadata = false;
+
     if (_memCache.valid())
         _memCache->clear();
 
+    _missingTiles = 0L;
+
+    _cacheHits = Util::Counter("cache.hits." + getName());
+    _cacheMisses = Util::Counter("cache.misses." + getName());
+
     return getStatus();
 }
 
@@ -400,6 +458,12 @@ TileLayer::openForWriting()
 Status
 TileLayer::closeImplementation()
 {    
+    if (_missingTiles.valid() && _missingTiles->getNumUnsavedKeys() > 0u)
+    {
+        saveMissingTiles();
+    }
+    _missingTiles = 0L;
+
     return Layer::closeImplementation();
 }
 
@@ -742,6 +806,109 @@ TileLayer::dirtyDataExtents()
 {
     Threading::ScopedMutexLock lock(layerMutex());
     _dataExtentsUnion = GeoExtent::INVALID;
+    std::atomic_store(&_dataExtentIndex, std::shared_ptr<DataExtentIndex>());
+}
+
+// R-tree over the data extents, all in one SRS
+struct TileLayer::DataExtentIndex
+{
+    RTree<unsigned, double, 2> _tree;
+    osg::ref_ptr<const SpatialReference> _srs; // null = can't index these extents
+    const DataExtentList* _source;
+    std::size_t _size;
+
+    // Collects the extents that might intersect "extent", or returns
+    // false if the caller has to check them all.
+    bool search(const GeoExtent& extent, std::vector<unsigned>& hits) const
+    {
+        if (!_srs.valid() || !extent.isValid())
+            return false;
+
+        bool sameSRS = extent.getSRS()->isHorizEquivalentTo(_srs.get());
+        GeoExtent e = sameSRS ? extent : extent.transform(_srs.get());
+        if (!e.isValid() || e.crossesAntimeridian())
+            return false;
+
+        // A transformed extent is only approximate; the exact test follows.
+        double pad = sameSRS ? 0.0 : 0.01 * std::max(e.width(), e.height());
+        double minv[2] = { e.xMin() - pad, e.yMin() - pad };
+        double maxv[2] = { e.xMax() + pad, e.yMax() + pad };
+        _tree.Search(minv, maxv, &hits, (int)_size);
+        return true;
+    }
+};
+
+bool
+TileLayer::intersectsDataExtents(const GeoExtent& extent) const
+{
+    const DataExtentList& de = getDataExtents();
+
+    std::vector<unsigned> candidates;
+    std::shared_ptr<DataExtentIndex> index = getDataExtentIndex();
+    if (index && index->search(extent, candidates))
+    {
+        for (auto i : candidates)
+            if (i < de.size() && de[i].intersects(extent))
+                return true;
+        return false;
+    }
+
+    for (DataExtentList::const_iterator i = de.begin(); i != de.end(); ++i)
+        if (i->intersects(extent))
+            return true;
+    return false;
+}
+
+std::shared_ptr<TileLayer::DataExtentIndex>
+TileLayer::getDataExtentIndex() const
+{
+    // A linear scan is faster for a handful of extents.
+    const DataExtentList& de = getDataExtents();
+    if (de.size() < 32u)
+        return std::shared_ptr<DataExtentIndex>();
+
+    std::shared_ptr<DataExtentIndex> index = std::atomic_load(&_dataExtentIndex);
+    if (index && index->_source == &de && index->_size == de.size())
+        return index;
+
+    Threading::ScopedMutexLock lock(layerMutex());
+
+    index = std::atomic_load(&_dataExtentIndex);
+    if (index && index->_source == &de && index->_size == de.size())
+        return index; // double-check
+
+    index = std::make_shared<DataExtentIndex>();
+    index->_source = &de;
+    index->_size = de.size();
+
+    // Only index extents that share an SRS and don't wrap the antimeridian;
+    // anything else takes the linear scan.
+    const SpatialReference* srs = de.front().getSRS();
+    bool indexable = srs != NULL;
+    for (unsigned i = 0; i < de.size() && indexable; ++i)
+    {
+        indexable =
+            de[i].isValid() &&
+            de[i].getSRS()->isHorizEquivalentTo(srs) &&
+            !de[i].crossesAntimeridian();
+    }
+
+    if (indexable)
+    {
+        double minv[2], maxv[2];
+        for (unsigned i = 0; i < de.size(); ++i)
+        {
+            minv[0] = de[i].xMin(), minv[1] = de[i].yMin();
+            maxv[0] = de[i].xMax(), maxv[1] = de[i].yMax();
+            index->_tree.Insert(minv, maxv, i);
+        }
+        index->_srs = srs;
+
+        OE_DEBUG << LC << "Indexed " << de.size() << " data extents" << std::endl;
+    }
+
+    std::atomic_store(&_dataExtentIndex, index);
+    return index;
 }
 
 const DataExtent&
@@ -840,9 +1007,21 @@ TileLayer::getBestAvailableTileKey(const TileKey& key) const
     bool     intersects = false;
     unsigned highestLOD = 0;
 
+    // With many extents, let the index pick the ones worth checking.
+    std::vector<unsigned> candidates;
+    std::shared_ptr<DataExtentIndex> index = getDataExtentIndex();
+    bool useIndex = index && index->search(key.getExtent(), candidates);
+    unsigned count = useIndex ? candidates.size() : de.size();
+
     // Check each data extent in turn:
-    for (DataExtentList::const_iterator itr = de.begin(); itr != de.end(); ++itr)
+    for (unsigned c = 0; c < count; ++c)
     {
+        unsigned i = useIndex ? candidates[c] : c;
+        if (i >= de.size())
+            continue;
+
+        DataExtentList::const_iterator itr = de.begin() + i;
+
         // check for 2D intersection:
         if (key.getExtent().intersects(*itr))
         {
@@ -889,3 +1068,214 @@ TileLayer::mayHaveData(const TileKey& key) const
 {
     return key == getBestAvailableTileKey(key);
 }
+
+NegativeTileCache*
+TileLayer::getMissingTiles() const
+{
+    if (getMissingTileTTL() <= 0 || !isOpen())
+        return 0L;
+
+    if (!_missingTiles.valid())
+    {
+        Threading::ScopedMutexLock lock(_missingTilesMutex);
+        if (!_missingTiles.valid()) // double-check
+        {
+            osg::ref_ptr<NegativeTileCache> missing = new NegativeTileCache(getMissingTileTTL());
+
+            // pick up where the last session left off
+            CacheBin* bin = const_cast<TileLayer*>(this)->getCacheBin(getProfile());
+            if (bin && getCacheSettings()->cachePolicy()->isCacheReadable())
+            {
+                std::string key = Stringify() << "_missing_tiles_" << getRevision();
+                if (missing->read(bin, key))
+                {
+                    OE_INFO << LC << "Restored " << missing->size() << " known missing tiles" << std::endl;
+                }
+            }
+
+            _missingTiles = missing.get();
+        }
+    }
+    return _missingTiles.get();
+}
+
+void
+TileLayer::saveMissingTiles() const
+{
+    CacheBin* bin = const_cast<TileLayer*>(this)->getCacheBin(getProfile());
+    if (_missingTiles.valid() && bin && getCacheSettings()->cachePolicy()->isCacheWriteable())
+    {
+        std::string key = Stringify() << "_missing_tiles_" << getRevision();
+        _missingTiles->write(bin, key);
+    }
+}
+
+bool
+TileLayer::isKnownMissing(const TileKey& key) const
+{
+    NegativeTileCache* missing = getMissingTiles();
+    return missing && missing->contains(key);
+}
+
+void
+TileLayer::setKnownMissing(const TileKey& key) const
+{
+    NegativeTileCache* missing = getMissingTiles();
+    if (missing)
+    {
+        missing->add(key);
+
+        // save every so often, so a crash doesn't lose it all
+        if (missing->getNumUnsavedKeys() >= 256u)
+        {
+            saveMissingTiles();
+        }
+    }
+}
+
+namespace
+{
+    const char* METADATA_KEY = "_layer_metadata";
+
+    // the parts of a metadata record that say what the source looks like
+    std::string metadataSignature(const Config& meta)
+    {
+        Config conf = meta;
+        conf.remove("cache_create_time");
+        return conf.toJSON(false);
+    }
+}
+
+bool
+TileLayer::readCachedMetadata(Config& out_source)
+{
+    if (getMetadataTTL() <= 0 || _revalidatingMetadata)
+        return false;
+
+    CacheSettings* cacheSettings = getCacheSettings();
+    if (!cacheSettings || !cacheSettings->cachePolicy()->isCacheReadable())
+        return false;
+
+    CacheBin* bin = cacheSettings->getCacheBin();
+    if (!bin)
+        return false;
+
+    ReadResult rr = bin->readString(METADATA_KEY, getReadOptions());
+    if (rr.failed())
+        return false;
+
+    Config conf;
+    conf.fromJSON(rr.getString());
+    osg::ref_ptr<CacheBinMetadata> meta = new CacheBinMetadata(conf);
+    if (!meta->isOK() || !meta->_cacheCreateTime.isSet())
+        return false;
+
+    if (DateTime().asTimeStamp() - meta->_cacheCreateTime.get() > getMetadataTTL())
+    {
+        OE_INFO << LC << "Cached metadata expired" << std::endl;
+        return false;
+    }
+
+    osg::ref_ptr<const Profile> profile = Profile::create(meta->_sourceProfile.get());
+    if (!profile.valid())
+        return false;
+
+    setProfile(profile.get());
+    dataExtents() = meta->_dataExtents;
+    dirtyDataExtents();
+    out_source = conf.child("source");
+
+    OE_INFO << LC << "Opened from cached metadata" << std::endl;
+
+    // Make sure the source still looks like this, for next time
+    // (or for now, if it doesn't).
+    if (!_metadataRevalidated)
+    {
+        revalidateMetadata(conf);
+    }
+
+    return true;
+}
+
+void
+TileLayer::writeCachedMetadata(const Config& source)
+{
+    if (getMetadataTTL() <= 0 || !getProfile())
+        return;
+
+    CacheSettings* cacheSettings = getCacheSettings();
+    if (!cacheSettings || !cacheSettings->cachePolicy()->isCacheWriteable())
+        return;
+
+    CacheBin* bin = cacheSettings->getCacheBin();
+    if (!bin)
+        return;
+
+    CacheBinMetadata meta;
+    meta._cacheBinId = getCacheID();
+    meta._sourceName = getName();
+    meta._sourceDriver = getConfigKey();
+    meta._sourceTileSize = getTileSize();
+    meta._sourceProfile = getProfile()->toProfileOptions();
+    meta._cacheProfile = meta._sourceProfile;
+    meta._cacheCreateTime = DateTime().asTimeStamp();
+    meta._dataExtents = getDataExtents();
+
+    Config conf = meta.getConfig();
+    if (!source.empty())
+        conf.add("source", source);
+
+    osg::ref_ptr<StringObject> temp = new StringObject(conf.toJSON(false));
+    if (bin->write(METADATA_KEY, temp.get(), getReadOptions()))
+    {
+        _writtenMetadata = conf;
+    }
+}
+
+void
+TileLayer::revalidateMetadata(const Config& cached)
+{
+    // Open a twin of this layer in the background that ignores the cached
+    // metadata (and the cached copies of anything it reads to build it).
+    // Its open() stores a fresh record for the next session.
+    Config conf = getConfig();
+    Config policy = conf.child("cache_policy");
+    policy.key() = "cache_policy";
+    policy.set("max_age", 0);
+    conf.set(policy);
+
+    osg::ref_ptr<const osgDB::Options> readOptions = getReadOptions();
+    osg::observer_ptr<TileLayer> layer_weak(this);
+    std::string cachedSignature = metadataSignature(cached);
+
+    Threading::runInJobArena(
+        Registry::instance()->getJobArena("layers.open"),
+        [conf, readOptions, layer_weak, cachedSignature]()
+        {
+            osg::ref_ptr<Layer> twinLayer = Layer::create(ConfigOptions(conf));
+            TileLayer* twin = dynamic_cast<TileLayer*>(twinLayer.get());
+            if (!twin)
+                return;
+
+            twin->_revalidatingMetadata = true;
+            twin->setReadOptions(readOptions.get());
+
+            // if the source is unreachable, keep what we have
+            if (twin->open().isOK() && !twin->_writtenMetadata.empty())
+            {
+                osg::ref_ptr<TileLayer> layer;
+                if (layer_weak.lock(layer))
+                {
+                    layer->_metadataRevalidated = true;
+
+                    if (metadataSignature(twin->_writtenMetadata) != cachedSignature)
+                    {
+                        OE_INFO << "[TileLayer] \"" << layer->getName() << "\" source metadata changed" << std::endl;
+                        layer->_hasNewerMetadata = true;
+                    }
+                }
+            }
+
+            twin->close();
+        });
+}
@@ -22,26 +22,50 @@
 #include <osgEarth/GLUtils>
 #include <osgViewer/Renderer>
 #include <osgViewer/Viewer>
+#include <osgUtil/RenderStage>
+#include <osg/FrameBufferObject>
+#include <osg/Version>
+#include <cstring>
 
 #define LC "[TileRasterizer] "
 
-#ifndef GL_ANY_SAMPLES_PASSED
-#define GL_ANY_SAMPLES_PASSED 0x8C2F
+#if OSG_VERSION_GREATER_OR_EQUAL(3,6,0)
+#define OE_HAVE_GL_SYNC
+#endif
+
+#ifndef GL_PIXEL_PACK_BUFFER
+#define GL_PIXEL_PACK_BUFFER 0x88EB
+#endif
+
+#ifndef GL_STREAM_READ
+#define GL_STREAM_READ 0x88E1
 #endif
 
 #ifndef GL_READ_ONLY
 #define GL_READ_ONLY 0x88B8
 #endif
 
-#ifndef GL_COLOR_ATTACHMENT0
-#define GL_COLOR_ATTACHMENT0 0x8CE0
-#endif
+// Largest atlas dimension, and most tiles along one side of it
+#define MAX_ATLAS_SIZE 2048u
+#define MAX_ATLAS_TILES 8u
 
 using namespace osgEarth;
 using namespace osgEarth::Util;
 
 
-TileRasterizer::RenderInstaller::RenderInstaller(TileRasterizer::RenderData& renderData) : 
+TileRasterizer::RenderData::RenderData() :
+    _width(0u),
+    _height(0u),
+    _cols(1u),
+    _rows(1u),
+    _mutex(OE_MUTEX_NAME),
+    _operationInstalled(false),
+    _fence(0L)
+{
+    //nop
+}
+
+TileRasterizer::RenderInstaller::RenderInstaller(TileRasterizer::RenderData* renderData) : 
     _renderData(renderData)
 {
     setCullingActive(false);
@@ -52,90 +76,209 @@ void
 TileRasterizer::RenderInstaller::drawImplementation(osg::RenderInfo& ri) const
 {
     // capture the GC and save it as our graphics op queue.
-    osg::ref_ptr<osg::GraphicsContext> gc = _renderData._gc.get();
+    osg::ref_ptr<osg::GraphicsContext> gc = _renderData->_gc.get();
     if (gc.valid() == false)
     {
-        static Threading::Mutex s_mutex(OE_MUTEX_NAME);
-        gc = _renderData._gc.get();
+        Threading::ScopedMutexLock lock(_renderData->_mutex);
+        gc = _renderData->_gc.get();
         if (gc.valid() == false)
         {
-            _renderData._gc = ri.getState()->getGraphicsContext();
-            _renderData._sv->setState(ri.getState());
-            OE_WARN << LC << "Installed on GC " << _renderData._gc.get() << std::endl;
+            _renderData->_gc = ri.getState()->getGraphicsContext();
+            _renderData->_sv->setState(ri.getState());
+            OE_WARN << LC << "Installed on GC " << _renderData->_gc.get() << std::endl;
         }
     }
 }
 
-TileRasterizer::RenderOperation::RenderOperation(osg::Node* node, const GeoExtent& extent, TileRasterizer::RenderData& renderData) :
-    osg::GraphicsOperation("TileRasterizer", false),
-    _node(node),
-    _extent(extent),
-    _renderData(renderData),
-    _pass(0)
+TileRasterizer::BatchOperation::BatchOperation(TileRasterizer::RenderData* renderData) :
+    osg::GraphicsOperation("TileRasterizer", true),
+    _renderData(renderData)
 {
     //nop
 }
 
-Future<osg::Image>
-TileRasterizer::RenderOperation::getFuture()
+void
+TileRasterizer::BatchOperation::operator () (osg::GraphicsContext* gc)
 {
-    return _promise.getFuture();
+    osg::State& state = *gc->getState();
+
+    // The atlas holds one batch at a time, so wait for the last one to
+    // come back before drawing over it.
+    if (!_renderData->_inFlight.empty() && !finishBatch(state))
+        return;
+
+    std::vector<Job> batch;
+    {
+        Threading::ScopedMutexLock lock(_renderData->_mutex);
+        unsigned capacity = _renderData->_cols * _renderData->_rows;
+        while (!_renderData->_queue.empty() && batch.size() < capacity)
+        {
+            batch.push_back(_renderData->_queue.front());
+            _renderData->_queue.pop();
+        }
+    }
+
+    if (!batch.empty())
+    {
+        renderBatch(state, batch);
+    }
 }
 
-void 
-TileRasterizer::RenderOperation::operator () (osg::GraphicsContext* gc)
+void
+TileRasterizer::BatchOperation::renderBatch(osg::State& state, std::vector<Job>& batch)
 {
-    osg::Camera* camera = _renderData._sv->getCamera();
+    RenderData& rd = *_renderData.get();
+    osg::Camera* camera = rd._sv->getCamera();
+
+    // Each job draws into its own cell of the atlas; the render stage
+    // clears only the viewport, so the other cells keep their content.
+    for (unsigned i = 0; i < batch.size(); ++i)
+    {
+        Job& job = batch[i];
+        unsigned col = i % rd._cols, row = i / rd._cols;
+
+        camera->setViewport(col*rd._width, row*rd._height, rd._width, rd._height);
+
+        // Look at the extent from its center, so that content placed near it
+        // (under a transform) keeps its precision in the float model-view matrix.
+        double cx, cy;
+        job._extent.getCentroid(cx, cy);
+        camera->setViewMatrix(osg::Matrix::translate(-cx, -cy, 0.0));
+        camera->setProjectionMatrixAsOrtho2D(
+            job._extent.xMin() - cx, job._extent.xMax() - cx,
+            job._extent.yMin() - cy, job._extent.yMax() - cy);
+
+        rd._sv->setSceneData(job._node.get());
+        rd._sv->cull();
+        rd._sv->draw();
+    }
+
+    rd._sv->setSceneData(NULL);
+
+    osg::FrameBufferObject* fbo = rd._sv->getRenderStage() ? rd._sv->getRenderStage()->getFrameBufferObject() : NULL;
+    if (!fbo)
+    {
+        // Could not render; let the callers try again.
+        for (std::vector<Job>::iterator i = batch.begin(); i != batch.end(); ++i)
+            i->_promise.getFuture().cancel();
+        return;
+    }
 
-    _image = new osg::Image();
-    _image->allocateImage(_renderData._width, _renderData._height, 1, GL_RGBA, GL_UNSIGNED_BYTE);
-    _image->setInternalTextureFormat(GL_RGBA8);
+    osg::GLExtensions* ext = state.get<osg::GLExtensions>();
 
-    // attaching an image tells OSG to automatically call glReadPixels at the 
-    // end of the RenderStage. No opportunity for async readback with a PBO however.
-    camera->detach(camera->COLOR_BUFFER0);
-    camera->attach(camera->COLOR_BUFFER0, _image.get());
-    camera->dirtyAttachmentMap();
+    // Start reading back only the rows of cells that we used.
+    GLsizei width = rd._cols * rd._width;
+    GLsizei height = (GLsizei)(((batch.size() + rd._cols - 1) / rd._cols) * rd._height);
 
-    camera->setProjectionMatrixAsOrtho2D(
-        _extent.xMin(), _extent.xMax(),
-        _extent.yMin(), _extent.yMax());
+    if (!rd._pbo.valid())
+    {
+        GLsizeiptr size = rd._atlas->getTextureWidth() * rd._atlas->getTextureHeight() * 4;
+        rd._pbo = new GLBuffer();
+        ext->glGenBuffers(1, &rd._pbo->_handle);
+        ext->glBindBuffer(GL_PIXEL_PACK_BUFFER, rd._pbo->_handle);
+        ext->glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+        state.getGraphicsContext()->add(new GLBufferReleaser(rd._pbo.get()));
+    }
+
+    fbo->apply(state, osg::FrameBufferObject::READ_FRAMEBUFFER);
+    ext->glBindBuffer(GL_PIXEL_PACK_BUFFER, rd._pbo->_handle);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, 0L);
+    ext->glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    ext->glBindFramebuffer(GL_FRAMEBUFFER_EXT, state.getGraphicsContext()->getDefaultFboId());
+
+#ifdef OE_HAVE_GL_SYNC
+    rd._fence = ext->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+#endif
 
-    _renderData._sv->setSceneData(_node.get());
-           
-    unsigned id = gc->getState()->getContextID();
-    osg::GLExtensions* ext = osg::GLExtensions::Get(id, true);
+    rd._inFlight.swap(batch);
+}
 
-    if (_renderData._samplesQuery[id] == INT_MAX)
+bool
+TileRasterizer::BatchOperation::finishBatch(osg::State& state)
+{
+    RenderData& rd = *_renderData.get();
+    osg::GLExtensions* ext = state.get<osg::GLExtensions>();
+
+#ifdef OE_HAVE_GL_SYNC
+    // Without fences this runs a frame after the readback started,
+    // which is usually long enough that mapping the buffer won't stall.
+    if (rd._fence)
     {
-        ext->glGenQueries(1, &_renderData._samplesQuery[id]);
+        GLsync fence = (GLsync)rd._fence;
+        GLenum status = ext->glClientWaitSync(fence, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+            return false;
+
+        ext->glDeleteSync(fence);
+        rd._fence = 0L;
     }
+#endif
 
-    _renderData._sv->cull();
+    unsigned rowBytes = rd._cols * rd._width * 4;
+    unsigned tileBytes = rd._width * 4;
 
-    // initiate a query for samples passing the fragment shader
-    // to see whether we drew anything.
-    GLuint samples = 0u;
-    ext->glBeginQuery(GL_ANY_SAMPLES_PASSED, _renderData._samplesQuery[id]);
+    ext->glBindBuffer(GL_PIXEL_PACK_BUFFER, rd._pbo->_handle);
+    const unsigned char* pixels = static_cast<const unsigned char*>(ext->glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY));
 
-    _renderData._sv->draw();
+    for (unsigned i = 0; i < rd._inFlight.size(); ++i)
+    {
+        Job& job = rd._inFlight[i];
+
+        if (!pixels)
+        {
+            job._promise.getFuture().cancel();
+            continue;
+        }
 
-    ext->glEndQuery(GL_ANY_SAMPLES_PASSED);
-    ext->glGetQueryObjectuiv(_renderData._samplesQuery[id], GL_QUERY_RESULT, &samples);
+        unsigned col = i % rd._cols, row = i / rd._cols;
 
-    // nothing rendered? return a NULL image.
-    if (samples == 0u)
-        _image = NULL;
+        osg::ref_ptr<osg::Image> image = new osg::Image();
+        image->allocateImage(rd._width, rd._height, 1, GL_RGBA, GL_UNSIGNED_BYTE);
+        image->setInternalTextureFormat(GL_RGBA8);
 
-    _promise.resolve(_image.release());
+        // the atlas clears to transparent black, so any other value
+        // means something was drawn
+        bool drewSomething = false;
+        for (unsigned t = 0; t < rd._height; ++t)
+        {
+            const unsigned char* src = pixels + (row*rd._height + t)*rowBytes + col*tileBytes;
+            unsigned char* dst = image->data(0, t);
+            ::memcpy(dst, src, tileBytes);
+
+            for (unsigned b = 0; b < tileBytes && !drewSomething; ++b)
+                drewSomething = src[b] != 0;
+        }
+
+        job._promise.resolve(drewSomething ? image.release() : NULL);
+    }
+
+    if (pixels)
+        ext->glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    ext->glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    rd._inFlight.clear();
+    return true;
 }
 
 
 TileRasterizer::TileRasterizer(unsigned width, unsigned height)
 {
-    _renderData._initialized = false;
-    _renderData._width = width;
-    _renderData._height = height;
+    _renderData = new RenderData();
+    _renderData->_width = width;
+    _renderData->_height = height;
+    _renderData->_cols = osg::clampBetween(MAX_ATLAS_SIZE / osg::maximum(width, 1u), 1u, MAX_ATLAS_TILES);
+    _renderData->_rows = osg::clampBetween(MAX_ATLAS_SIZE / osg::maximum(height, 1u), 1u, MAX_ATLAS_TILES);
+
+    // the shared render target
+    osg::Texture2D* atlas = new osg::Texture2D();
+    atlas->setTextureSize(_renderData->_cols * width, _renderData->_rows * height);
+    atlas->setInternalFormat(GL_RGBA8);
+    atlas->setSourceFormat(GL_RGBA);
+    atlas->setSourceType(GL_UNSIGNED_BYTE);
+    atlas->setFilter(osg::Texture::MIN_FILTER, osg::Texture::NEAREST);
+    atlas->setFilter(osg::Texture::MAG_FILTER, osg::Texture::NEAREST);
+    _renderData->_atlas = atlas;
 
     // set up the FBO camera
     osg::Camera* rtt = new osg::Camera();
@@ -149,6 +292,7 @@ TileRasterizer::TileRasterizer(unsigned width, unsigned height)
     rtt->setSmallFeatureCullingPixelSize(0.0f);
     rtt->setViewMatrix(osg::Matrix::identity());
     rtt->setViewport(0, 0, width, height);
+    rtt->attach(rtt->COLOR_BUFFER0, atlas);
 
     osg::StateSet* ss = rtt->getOrCreateStateSet();
     ss->setMode(GL_BLEND, 1);
@@ -160,33 +304,35 @@ TileRasterizer::TileRasterizer(unsigned width, unsigned height)
     vp->setName("TileRasterizer");
     vp->setInheritShaders(false);
 
-    // set up a container for our GL query
-    _renderData._samplesQuery.resize(128u);
-    _renderData._samplesQuery.setAllElementsTo(INT_MAX);
-    _renderData._pbo.resize(128u);
-    _renderData._pbo.setAllElementsTo(INT_MAX);
-
     // set up a sceneview to render the graph
-    _renderData._sv = new osgUtil::SceneView();
-    _renderData._sv->setAutomaticFlush(true);
-    _renderData._sv->setGlobalStateSet(rtt->getOrCreateStateSet());
-    _renderData._sv->setCamera(rtt, true);
-    _renderData._sv->setDefaults(0u);
-    _renderData._sv->getCullVisitor()->setIdentifier(new osgUtil::CullVisitor::Identifier());
-    _renderData._sv->setFrameStamp(new osg::FrameStamp());
-
-    _installer = new RenderInstaller(_renderData);
+    _renderData->_sv = new osgUtil::SceneView();
+    _renderData->_sv->setAutomaticFlush(true);
+    _renderData->_sv->setGlobalStateSet(rtt->getOrCreateStateSet());
+    _renderData->_sv->setCamera(rtt, true);
+    _renderData->_sv->setDefaults(0u);
+    _renderData->_sv->getCullVisitor()->setIdentifier(new osgUtil::CullVisitor::Identifier());
+    _renderData->_sv->setFrameStamp(new osg::FrameStamp());
+
+    _renderData->_operation = new BatchOperation(_renderData.get());
+
+    _installer = new RenderInstaller(_renderData.get());
 }
 
 bool
 TileRasterizer::valid() const
 {
-    return _renderData._sv.valid();
+    return _renderData->_sv.valid();
 }
 
 TileRasterizer::~TileRasterizer()
 {
-    //nop
+    // Jobs still in the queue go away with the render data, which
+    // abandons their futures.
+    osg::ref_ptr<osg::GraphicsContext> gc = _renderData->_gc.get();
+    if (gc.valid())
+    {
+        gc->remove(_renderData->_operation.get());
+    }
 }
 
 osg::Node*
@@ -198,14 +344,27 @@ TileRasterizer::getNode() const
 Future<osg::Image>
 TileRasterizer::render(osg::Node* node, const GeoExtent& extent)
 {
-    if (_renderData._sv.valid())
+    if (_renderData->_sv.valid())
     {
-        osg::ref_ptr<osg::GraphicsContext> gc = _renderData._gc.get();
+        osg::ref_ptr<osg::GraphicsContext> gc = _renderData->_gc.get();
         if (gc.valid())
         {
-            osg::ref_ptr<RenderOperation> op = new RenderOperation(node, extent, _renderData);
-            Future<osg::Image> result = op->getFuture();   
-            gc->add(op.get());
+            Job job;
+            job._node = node;
+            job._extent = extent;
+            Future<osg::Image> result = job._promise.getFuture();
+
+            Threading::ScopedMutexLock lock(_renderData->_mutex);
+            _renderData->_queue.push(job);
+
+            // one operation stays on the context and drains the queue
+            // a batch per frame
+            if (!_renderData->_operationInstalled)
+            {
+                gc->add(_renderData->_operation.get());
+                _renderData->_operationInstalled = true;
+            }
+
             return result;
         }
     }
@@ -0,0 +1,759 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+ * Copyright 2020 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarth/TileStream>
+#include <osgEarth/Endian>
+#include <osgEarth/MapNode>
+#include <osgEarth/NodeUtils>
+#include <osgEarth/Registry>
+#include <osgEarth/StringUtils>
+#include <osgEarth/TerrainEngineNode>
+#include <osg/Texture>
+#include <osgDB/ObjectWrapper>
+#include <osgDB/Registry>
+#include <cfloat>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+
+using namespace osgEarth;
+using namespace osgEarth::TileStream;
+
+#undef LC
+#define LC "[TileStream] "
+
+// arena in which background polls run
+#define ARENA_NAME "tilestream"
+
+namespace
+{
+    const char TILE_MAGIC[4] = { 'O', 'E', 'T', '1' };
+    const char CHANGES_MAGIC[4] = { 'O', 'E', 'C', '1' };
+
+    void appendU8(std::string& out, std::uint8_t value)
+    {
+        out.push_back((char)value);
+    }
+
+    void appendU16(std::string& out, std::uint16_t value)
+    {
+        value = htole16(value);
+        out.append((const char*)&value, 2);
+    }
+
+    void appendU32(std::string& out, std::uint32_t value)
+    {
+        value = htole32(value);
+        out.append((const char*)&value, 4);
+    }
+
+    void appendU64(std::string& out, std::uint64_t value)
+    {
+        value = htole64(value);
+        out.append((const char*)&value, 8);
+    }
+
+    void appendF64(std::string& out, double value)
+    {
+        std::uint64_t bits;
+        ::memcpy(&bits, &value, 8);
+        appendU64(out, bits);
+    }
+
+    // Reads fields in order, failing (for good) at the first one that
+    // runs past the end of the buffer.
+    struct Reader
+    {
+        Reader(const std::string& in) : _in(in), _pos(0u), _ok(true) { }
+
+        bool take(void* out, std::size_t n)
+        {
+            if (!_ok || _pos + n > _in.size())
+                return _ok = false;
+            ::memcpy(out, _in.data() + _pos, n);
+            _pos += n;
+            return true;
+        }
+
+        std::uint8_t u8() { std::uint8_t v = 0; take(&v, 1); return v; }
+        std::uint16_t u16() { std::uint16_t v = 0; take(&v, 2); return le16toh(v); }
+        std::uint32_t u32() { std::uint32_t v = 0; take(&v, 4); return le32toh(v); }
+        std::uint64_t u64() { std::uint64_t v = 0; take(&v, 8); return le64toh(v); }
+
+        double f64()
+        {
+            std::uint64_t bits = u64();
+            double value;
+            ::memcpy(&value, &bits, 8);
+            return value;
+        }
+
+        std::string bytes(std::size_t n)
+        {
+            if (!_ok || _pos + n > _in.size())
+            {
+                _ok = false;
+                return std::string();
+            }
+            std::string value = _in.substr(_pos, n);
+            _pos += n;
+            return value;
+        }
+
+        bool magic(const char* tag)
+        {
+            return bytes(4) == std::string(tag, 4);
+        }
+
+        const std::string& _in;
+        std::size_t _pos;
+        bool _ok;
+    };
+
+    osgDB::BaseCompressor* getCompressor()
+    {
+        return osgDB::Registry::instance()->getObjectWrapperManager()->findCompressor("zlib");
+    }
+
+    std::string formatDouble(double value)
+    {
+        return Stringify() << std::setprecision(17) << value;
+    }
+}
+
+//........................................................................
+
+bool
+TileStream::writeTile(const Tile& tile, bool compress, std::string& out)
+{
+    out.clear();
+    out.append(TILE_MAGIC, 4);
+    appendU8(out, (std::uint8_t)tile._type);
+    appendU64(out, tile._key.value());
+    appendU32(out, tile._revision);
+
+    if (tile._type == TILE_NOT_MODIFIED)
+        return true;
+
+    std::string data;
+    unsigned s, t, pixelFormat, dataType, internalFormat, packing;
+
+    if (tile._type == TILE_IMAGE)
+    {
+        const osg::Image* image = tile._image.get();
+        if (!image || !image->data() || image->r() != 1)
+            return false;
+
+        s = image->s();
+        t = image->t();
+        pixelFormat = image->getPixelFormat();
+        dataType = image->getDataType();
+        internalFormat = image->getInternalTextureFormat();
+        packing = image->getPacking();
+        data.assign((const char*)image->data(), image->getTotalSizeInBytes());
+    }
+    else if (tile._type == TILE_HEIGHTFIELD)
+    {
+        const osg::HeightField* hf = tile._heightField.get();
+        if (!hf || !hf->getFloatArray())
+            return false;
+
+        s = hf->getNumColumns();
+        t = hf->getNumRows();
+        pixelFormat = GL_RED;
+        dataType = GL_FLOAT;
+        internalFormat = GL_R32F;
+        packing = 4u;
+        data.assign((const char*)hf->getFloatArray()->getDataPointer(), s*t*sizeof(float));
+    }
+    else return false;
+
+    bool compressed = false;
+    if (compress)
+    {
+        osgDB::BaseCompressor* compressor = getCompressor();
+        std::ostringstream buf;
+        if (compressor && compressor->compress(buf, data))
+        {
+            data = buf.str();
+            compressed = true;
+        }
+    }
+
+    appendU32(out, s);
+    appendU32(out, t);
+    appendU32(out, pixelFormat);
+    appendU32(out, dataType);
+    appendU32(out, internalFormat);
+    appendU32(out, packing);
+    appendU8(out, compressed ? 1u : 0u);
+    appendU32(out, data.size());
+    out.append(data);
+    return true;
+}
+
+bool
+TileStream::readTile(const std::string& in, Tile& out)
+{
+    Reader r(in);
+    if (!r.magic(TILE_MAGIC))
+        return false;
+
+    out._type = (TileType)r.u8();
+    std::uint64_t key = r.u64();
+    out._key = PackedTileKey((unsigned)(key >> 58), (unsigned)(key >> 29) & 0x1FFFFFFFu, (unsigned)key & 0x1FFFFFFFu);
+    out._revision = r.u32();
+    out._image = 0L;
+    out._heightField = 0L;
+
+    if (!r._ok)
+        return false;
+
+    if (out._type == TILE_NOT_MODIFIED)
+        return true;
+
+    unsigned s = r.u32();
+    unsigned t = r.u32();
+    GLenum pixelFormat = r.u32();
+    GLenum dataType = r.u32();
+    GLint internalFormat = r.u32();
+    unsigned packing = r.u32();
+    bool compressed = r.u8() != 0u;
+    std::string data = r.bytes(r.u32());
+
+    if (!r._ok || s == 0u || t == 0u)
+        return false;
+
+    if (compressed)
+    {
+        osgDB::BaseCompressor* compressor = getCompressor();
+        if (!compressor)
+        {
+            OE_WARN << LC << "Tile is compressed, but there's no zlib compressor" << std::endl;
+            return false;
+        }
+
+        std::istringstream buf(data);
+        std::string value;
+        if (!compressor->decompress(buf, value))
+            return false;
+        data.swap(value);
+    }
+
+    if (out._type == TILE_IMAGE)
+    {
+        osg::ref_ptr<osg::Image> image = new osg::Image();
+        image->allocateImage(s, t, 1, pixelFormat, dataType, packing);
+        if (!image->data() || image->getTotalSizeInBytes() != data.size())
+            return false;
+
+        image->setInternalTextureFormat(internalFormat);
+        ::memcpy(image->data(), data.data(), data.size());
+        out._image = image;
+        return true;
+    }
+
+    else if (out._type == TILE_HEIGHTFIELD)
+    {
+        if (dataType != GL_FLOAT || data.size() != s*t*sizeof(float))
+            return false;
+
+        osg::ref_ptr<osg::HeightField> hf = new osg::HeightField();
+        hf->allocate(s, t);
+        ::memcpy(hf->getFloatArray()->getDataPointer(), data.data(), data.size());
+        out._heightField = hf;
+        return true;
+    }
+
+    return false;
+}
+
+void
+TileStream::writeChanges(unsigned revision, bool complete, const std::vector<Change>& changes, std::string& out)
+{
+    out.clear();
+    out.append(CHANGES_MAGIC, 4);
+    appendU32(out, revision);
+    appendU8(out, complete ? 1u : 0u);
+    appendU32(out, changes.size());
+
+    for (std::vector<Change>::const_iterator i = changes.begin(); i != changes.end(); ++i)
+    {
+        appendU32(out, i->_revision);
+        appendU32(out, i->_minLevel);
+        appendU32(out, i->_maxLevel);
+        appendF64(out, i->_extent.west());
+        appendF64(out, i->_extent.south());
+        appendF64(out, i->_extent.east());
+        appendF64(out, i->_extent.north());
+
+        std::uint16_t length = (std::uint16_t)osg::minimum(i->_layer.size(), (std::size_t)USHRT_MAX);
+        appendU16(out, length);
+        out.append(i->_layer, 0, length);
+    }
+}
+
+bool
+TileStream::readChanges(const std::string& in, unsigned& out_revision, bool& out_complete, std::vector<Change>& out_changes)
+{
+    Reader r(in);
+    if (!r.magic(CHANGES_MAGIC))
+        return false;
+
+    out_revision = r.u32();
+    out_complete = r.u8() != 0u;
+    unsigned count = r.u32();
+
+    const SpatialReference* wgs84 = SpatialReference::get("wgs84");
+
+    out_changes.clear();
+    for (unsigned i = 0; i < count && r._ok; ++i)
+    {
+        Change change;
+        change._revision = r.u32();
+        change._minLevel = r.u32();
+        change._maxLevel = r.u32();
+        double west = r.f64();
+        double south = r.f64();
+        double east = r.f64();
+        double north = r.f64();
+        change._layer = r.bytes(r.u16());
+        change._extent = GeoExtent(wgs84, west, south, east, north);
+
+        if (r._ok)
+            out_changes.push_back(change);
+    }
+
+    return r._ok;
+}
+
+//........................................................................
+
+Client::Client(const URI& url, const std::string& layer, unsigned cacheSize) :
+    _url(url),
+    _layer(layer),
+    _tiles(true, cacheSize),
+    _mutex(OE_MUTEX_NAME),
+    _polled(false),
+    _revision(0u),
+    _polling(false),
+    _everything(false)
+{
+    //nop
+}
+
+void
+Client::setSubscriptions(const std::vector<GeoExtent>& value)
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    _subscriptions = value;
+}
+
+std::vector<GeoExtent>
+Client::getSubscriptions() const
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    return _subscriptions;
+}
+
+bool
+Client::fetch(const TileKey& key, Tile& out, const osgDB::Options* readOptions, ProgressCallback* progress)
+{
+    PackedTileKey packed = key.pack();
+
+    LRUCache<PackedTileKey, Tile>::Record cached;
+    _tiles.get(packed, cached);
+
+    std::stringstream buf;
+    buf << _url.full() << "/tiles/" << URI::urlEncode(_layer)
+        << "/" << key.getLOD() << "/" << key.getTileX() << "/" << key.getTileY();
+    if (cached.valid())
+        buf << "?revision=" << cached.value()._revision;
+
+    URI uri(buf.str(), _url.context());
+    ReadResult result = uri.readString(readOptions, progress);
+    if (result.failed())
+        return false;
+
+    Tile tile;
+    if (!readTile(result.getString(), tile) || tile._key != packed)
+    {
+        OE_WARN << LC << "Bad tile payload from " << uri.full() << std::endl;
+        return false;
+    }
+
+    if (tile._type == TILE_NOT_MODIFIED)
+    {
+        if (!cached.valid())
+            return false;
+
+        out = cached.value();
+        return true;
+    }
+
+    _tiles.insert(packed, tile);
+    out = tile;
+    return true;
+}
+
+bool
+Client::poll(std::vector<Change>& out_changes, bool& out_everything, const osgDB::Options* readOptions)
+{
+    out_changes.clear();
+    out_everything = false;
+
+    std::stringstream buf;
+    buf << _url.full() << "/changes?layer=" << URI::urlEncode(_layer);
+
+    // without "since", the server only tells us its revision
+    bool polled;
+    {
+        Threading::ScopedMutexLock lock(_mutex);
+        polled = _polled;
+        if (polled)
+            buf << "&since=" << _revision;
+
+        const SpatialReference* wgs84 = SpatialReference::get("wgs84");
+        for (std::vector<GeoExtent>::const_iterator i = _subscriptions.begin(); i != _subscriptions.end(); ++i)
+        {
+            GeoExtent extent = i->transform(wgs84);
+            if (extent.isValid())
+            {
+                buf << "&extent="
+                    << formatDouble(extent.west()) << "," << formatDouble(extent.south()) << ","
+                    << formatDouble(extent.east()) << "," << formatDouble(extent.north());
+            }
+        }
+    }
+
+    URI uri(buf.str(), _url.context());
+    ReadResult result = uri.readString(readOptions, 0L);
+    if (result.failed())
+        return false;
+
+    unsigned revision = 0u;
+    bool complete = true;
+    std::vector<Change> changes;
+    if (!readChanges(result.getString(), revision, complete, changes))
+    {
+        OE_WARN << LC << "Bad change list from " << uri.full() << std::endl;
+        return false;
+    }
+
+    Threading::ScopedMutexLock lock(_mutex);
+    if (polled)
+    {
+        out_changes.swap(changes);
+        out_everything = !complete;
+    }
+    _polled = true;
+    _revision = revision;
+    return true;
+}
+
+void
+Client::pollAsync(const osgDB::Options* readOptions)
+{
+    if (_polling.exchange(true))
+        return;
+
+    osg::ref_ptr<Client> self = this;
+    osg::ref_ptr<const osgDB::Options> options = readOptions;
+
+    Threading::runInJobArena(
+        Registry::instance()->getJobArena(ARENA_NAME),
+        [self, options]()
+        {
+            std::vector<Change> changes;
+            bool everything = false;
+            if (self->poll(changes, everything, options.get()))
+            {
+                Threading::ScopedMutexLock lock(self->_mutex);
+                self->_changes.insert(self->_changes.end(), changes.begin(), changes.end());
+                self->_everything = self->_everything || everything;
+            }
+            self->_polling = false;
+        });
+}
+
+bool
+Client::takeChanges(std::vector<Change>& out_changes, bool& out_everything)
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    if (_changes.empty() && !_everything)
+        return false;
+
+    out_changes.clear();
+    out_changes.swap(_changes);
+    out_everything = _everything;
+    _everything = false;
+    return true;
+}
+
+//........................................................................
+
+namespace
+{
+    // Polls for changes and hands them to the terrain engine
+    // during the update traversal.
+    class UpdateNode : public osg::Group
+    {
+    public:
+        UpdateNode(Layer* layer, Client* client, double interval) :
+            _layer(layer),
+            _client(client),
+            _interval(interval),
+            _lastPoll(-DBL_MAX)
+        {
+            ADJUST_UPDATE_TRAV_COUNT(this, +1);
+        }
+
+        void traverse(osg::NodeVisitor& nv)
+        {
+            osg::ref_ptr<Layer> layer;
+            if (nv.getVisitorType() == nv.UPDATE_VISITOR && nv.getFrameStamp() && _layer.lock(layer))
+            {
+                double now = nv.getFrameStamp()->getReferenceTime();
+                if (now - _lastPoll >= _interval)
+                {
+                    _lastPoll = now;
+                    _client->pollAsync(layer->getReadOptions());
+                }
+
+                std::vector<Change> changes;
+                bool everything = false;
+                MapNode* mapNode = findInNodePath<MapNode>(nv);
+                if (mapNode && _client->takeChanges(changes, everything))
+                {
+                    std::vector<const Layer*> layers(1, layer.get());
+                    TerrainEngineNode* engine = mapNode->getTerrainEngine();
+
+                    if (everything)
+                    {
+                        engine->invalidateRegion(layers, GeoExtent::INVALID, 0u, INT_MAX);
+                    }
+                    else
+                    {
+                        for (std::vector<Change>::const_iterator i = changes.begin(); i != changes.end(); ++i)
+                        {
+                            engine->invalidateRegion(
+                                layers,
+                                i->_extent,
+                                i->_minLevel,
+                                osg::minimum(i->_maxLevel, (unsigned)INT_MAX));
+                        }
+                    }
+                }
+            }
+            osg::Group::traverse(nv);
+        }
+
+        osg::observer_ptr<Layer> _layer;
+        osg::ref_ptr<Client> _client;
+        double _interval;
+        double _lastPoll;
+    };
+}
+
+//........................................................................
+
+Config
+TileStreamImageLayerOptions::getConfig() const
+{
+    Config conf = ImageLayer::Options::getConfig();
+    conf.set("url", _url);
+    conf.set("remote_layer", _remoteLayer);
+    conf.set("poll_interval", _pollInterval);
+    conf.set("tile_cache_size", _tileCacheSize);
+    return conf;
+}
+
+void
+TileStreamImageLayerOptions::fromConfig(const Config& conf)
+{
+    pollInterval().init(1.0);
+    tileCacheSize().init(1024u);
+
+    conf.get("url", _url);
+    conf.get("remote_layer", _remoteLayer);
+    conf.get("poll_interval", _pollInterval);
+    conf.get("tile_cache_size", _tileCacheSize);
+}
+
+Config
+TileStreamElevationLayerOptions::getConfig() const
+{
+    Config conf = ElevationLayer::Options::getConfig();
+    conf.set("url", _url);
+    conf.set("remote_layer", _remoteLayer);
+    conf.set("poll_interval", _pollInterval);
+    conf.set("tile_cache_size", _tileCacheSize);
+    return conf;
+}
+
+void
+TileStreamElevationLayerOptions::fromConfig(const Config& conf)
+{
+    pollInterval().init(1.0);
+    tileCacheSize().init(1024u);
+
+    conf.get("url", _url);
+    conf.get("remote_layer", _remoteLayer);
+    conf.get("poll_interval", _pollInterval);
+    conf.get("tile_cache_size", _tileCacheSize);
+}
+
+//........................................................................
+
+REGISTER_OSGEARTH_LAYER(tilestreamimage, TileStreamImageLayer);
+
+OE_LAYER_PROPERTY_IMPL(TileStreamImageLayer, URI, URL, url);
+OE_LAYER_PROPERTY_IMPL(TileStreamImageLayer, std::string, RemoteLayer, remoteLayer);
+OE_LAYER_PROPERTY_IMPL(TileStreamImageLayer, double, PollInterval, pollInterval);
+OE_LAYER_PROPERTY_IMPL(TileStreamImageLayer, unsigned, TileCacheSize, tileCacheSize);
+
+void
+TileStreamImageLayer::init()
+{
+    ImageLayer::init();
+
+    // the server decides when a tile is stale; a local cache can't tell
+    layerHints().cachePolicy() = CachePolicy::NO_CACHE;
+}
+
+void
+TileStreamImageLayer::setSubscriptions(const std::vector<GeoExtent>& value)
+{
+    _subscriptions = value;
+    if (_client.valid())
+        _client->setSubscriptions(value);
+}
+
+Status
+TileStreamImageLayer::openImplementation()
+{
+    Status parent = ImageLayer::openImplementation();
+    if (parent.isError())
+        return parent;
+
+    if (options().url()->empty())
+        return Status(Status::ConfigurationError, "Valid URL is missing");
+
+    if (!getProfile())
+        return Status(Status::ConfigurationError, "Required explicit profile definition is missing");
+
+    _client = new Client(
+        options().url().get(),
+        options().remoteLayer().isSet() ? options().remoteLayer().get() : getName(),
+        options().tileCacheSize().get());
+
+    _client->setSubscriptions(_subscriptions);
+
+    _node = new UpdateNode(this, _client.get(), options().pollInterval().get());
+
+    return Status::NoError;
+}
+
+osg::Node*
+TileStreamImageLayer::getNode() const
+{
+    return _node.get();
+}
+
+GeoImage
+TileStreamImageLayer::createImageImplementation(const TileKey& key, ProgressCallback* progress) const
+{
+    Tile tile;
+    if (!_client->fetch(key, tile, getReadOptions(), progress) || !tile._image.valid())
+        return GeoImage(Status(Status::ResourceUnavailable, "No tile"));
+
+    // the client keeps its copy for revalidation
+    return GeoImage(new osg::Image(*tile._image.get()), key.getExtent());
+}
+
+//........................................................................
+
+REGISTER_OSGEARTH_LAYER(tilestreamelevation, TileStreamElevationLayer);
+
+OE_LAYER_PROPERTY_IMPL(TileStreamElevationLayer, URI, URL, url);
+OE_LAYER_PROPERTY_IMPL(TileStreamElevationLayer, std::string, RemoteLayer, remoteLayer);
+OE_LAYER_PROPERTY_IMPL(TileStreamElevationLayer, double, PollInterval, pollInterval);
+OE_LAYER_PROPERTY_IMPL(TileStreamElevationLayer, unsigned, TileCacheSize, tileCacheSize);
+
+void
+TileStreamElevationLayer::init()
+{
+    ElevationLayer::init();
+
+    // the server decides when a tile is stale; a local cache can't tell
+    layerHints().cachePolicy() = CachePolicy::NO_CACHE;
+}
+
+void
+TileStreamElevationLayer::setSubscriptions(const std::vector<GeoExtent>& value)
+{
+    _subscriptions = value;
+    if (_client.valid())
+        _client->setSubscriptions(value);
+}
+
+Status
+TileStreamElevationLayer::openImplementation()
+{
+    Status parent = ElevationLayer::openImplementation();
+    if (parent.isError())
+        return parent;
+
+    if (options().url()->empty())
+        return Status(Status::ConfigurationError, "Valid URL is missing");
+
+    if (!getProfile())
+        return Status(Status::ConfigurationError, "Required explicit profile definition is missing");
+
+    _client = new Client(
+        options().url().get(),
+        options().remoteLayer().isSet() ? options().remoteLayer().get() : getName(),
+        options().tileCacheSize().get());
+
+    _client->setSubscriptions(_subscriptions);
+
+    _node = new UpdateNode(this, _client.get(), options().pollInterval().get());
+
+    return Status::NoError;
+}
+
+osg::Node*
+TileStreamElevationLayer::getNode() const
+{
+    return _node.get();
+}
+
+GeoHeightField
+TileStreamElevationLayer::createHeightFieldImplementation(const TileKey& key, ProgressCallback* progress) const
+{
+    Tile tile;
+    if (!_client->fetch(key, tile, getReadOptions(), progress) || !tile._heightField.valid())
+        return GeoHeightField(Status(Status::ResourceUnavailable, "No tile"));
+
+    // the client keeps its copy for revalidation
+    return GeoHeightField(
+        new osg::HeightField(*tile._heightField.get(), osg::CopyOp::DEEP_COPY_ALL),
+        key.getExtent());
+}
@@ -0,0 +1,358 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+ * Copyright 2020 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarth/TileStreamService>
+#include <osgEarth/Map>
+#include <osgEarth/ImageLayer>
+#include <osgEarth/ElevationLayer>
+#include <osgEarth/StringUtils>
+#include <cstdlib>
+
+#define LC "[TileStreamService] "
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+using namespace osgEarth::TileStream;
+
+namespace
+{
+    int hexValue(char c)
+    {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    }
+
+    // inverse of URI::urlEncode
+    std::string urlDecode(const std::string& value)
+    {
+        std::string out;
+        for (std::size_t i = 0; i < value.size(); ++i)
+        {
+            int hi, lo;
+            if (value[i] == '%' && i + 2 < value.size() &&
+                (hi = hexValue(value[i+1])) >= 0 && (lo = hexValue(value[i+2])) >= 0)
+            {
+                out.push_back((char)((hi << 4) | lo));
+                i += 2;
+            }
+            else if (value[i] == '+')
+                out.push_back(' ');
+            else
+                out.push_back(value[i]);
+        }
+        return out;
+    }
+
+    bool parseUnsigned(const std::string& value, unsigned& out)
+    {
+        if (value.empty() || value.find_first_not_of("0123456789") != std::string::npos)
+            return false;
+        out = (unsigned)::strtoul(value.c_str(), 0L, 10);
+        return true;
+    }
+
+    GeoExtent wholeEarth()
+    {
+        return GeoExtent(SpatialReference::get("wgs84"), -180.0, -90.0, 180.0, 90.0);
+    }
+}
+
+//........................................................................
+
+TileStreamService::TileStreamService(const Map* map, unsigned journalSize) :
+    _map(map),
+    _journalSize(osg::maximum(journalSize, 1u)),
+    _compress(true),
+    _mutex("TileStreamService(OE)"),
+    _revision(0u),
+    _horizon(0u)
+{
+    //nop
+}
+
+unsigned
+TileStreamService::record(const std::string& layer, const GeoExtent& extent, unsigned minLevel, unsigned maxLevel)
+{
+    // assumes the mutex is locked
+    Change change;
+    change._revision = ++_revision;
+    change._layer = layer;
+    change._extent = extent;
+    change._minLevel = minLevel;
+    change._maxLevel = maxLevel;
+    _journal.push_back(change);
+
+    while (_journal.size() > _journalSize)
+    {
+        _horizon = _journal.front()._revision;
+        _journal.pop_front();
+    }
+
+    return change._revision;
+}
+
+unsigned
+TileStreamService::invalidate(const Layer* layer, const GeoExtent& extent, unsigned minLevel, unsigned maxLevel)
+{
+    if (!layer || minLevel > maxLevel)
+        return getRevision();
+
+    // The journal is kept in WGS84 so it can be matched against any
+    // client's subscriptions and any layer's tiles alike.
+    GeoExtent wgs84Extent =
+        extent.isValid() ? extent.transform(SpatialReference::get("wgs84")) : wholeEarth();
+
+    if (!wgs84Extent.isValid())
+    {
+        OE_WARN << LC << "Cannot express change extent in WGS84; invalidating all of " << layer->getName() << std::endl;
+        wgs84Extent = wholeEarth();
+    }
+
+    Threading::ScopedMutexLock lock(_mutex);
+    return record(layer->getName(), wgs84Extent, minLevel, maxLevel);
+}
+
+unsigned
+TileStreamService::getRevision() const
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    return _revision;
+}
+
+void
+TileStreamService::syncLayerRevisions()
+{
+    osg::ref_ptr<const Map> map;
+    if (!_map.lock(map))
+        return;
+
+    LayerVector layers;
+    map->getLayers(layers);
+
+    Threading::ScopedMutexLock lock(_mutex);
+
+    for (LayerVector::const_iterator i = layers.begin(); i != layers.end(); ++i)
+    {
+        const Layer* layer = i->get();
+
+        std::map<UID, unsigned>::iterator r = _layerRevisions.find(layer->getUID());
+        if (r == _layerRevisions.end())
+        {
+            _layerRevisions[layer->getUID()] = layer->getRevision();
+        }
+        else if (r->second != layer->getRevision())
+        {
+            r->second = layer->getRevision();
+            record(layer->getName(), wholeEarth(), 0u, ~0u);
+        }
+    }
+}
+
+bool
+TileStreamService::getChanges(unsigned since, const std::vector<GeoExtent>& extents, std::vector<Change>& out_changes) const
+{
+    out_changes.clear();
+
+    Threading::ScopedMutexLock lock(_mutex);
+
+    if (since < _horizon)
+        return false;
+
+    for (std::deque<Change>::const_iterator i = _journal.begin(); i != _journal.end(); ++i)
+    {
+        if (i->_revision <= since)
+            continue;
+
+        bool touches = extents.empty();
+        for (unsigned e = 0; e < extents.size() && !touches; ++e)
+            touches = i->_extent.intersects(extents[e]);
+
+        if (touches)
+            out_changes.push_back(*i);
+    }
+
+    return true;
+}
+
+unsigned
+TileStreamService::getRevision(const Layer* layer, const TileKey& key) const
+{
+    GeoExtent extent = key.getExtent().transform(SpatialReference::get("wgs84"));
+
+    Threading::ScopedMutexLock lock(_mutex);
+
+    for (std::deque<Change>::const_reverse_iterator i = _journal.rbegin(); i != _journal.rend(); ++i)
+    {
+        if (i->_layer == layer->getName() &&
+            key.getLOD() >= i->_minLevel &&
+            key.getLOD() <= i->_maxLevel &&
+            (!extent.isValid() || i->_extent.intersects(extent)))
+        {
+            return i->_revision;
+        }
+    }
+
+    // It may have changed any time before the journal begins.
+    return _horizon;
+}
+
+bool
+TileStreamService::handleRequest(const std::string& uri, std::string& out_response)
+{
+    out_response.clear();
+
+    osg::ref_ptr<const Map> map;
+    if (!_map.lock(map))
+        return false;
+
+    syncLayerRevisions();
+
+    std::string::size_type q = uri.find('?');
+    std::string path = uri.substr(0, q);
+    std::string query = q != std::string::npos ? uri.substr(q + 1) : std::string();
+
+    // query parameters, in order; "extent" may repeat
+    std::vector<std::pair<std::string, std::string> > params;
+    StringVector pairs;
+    StringTokenizer(query, pairs, "&", "", false, true);
+    for (StringVector::const_iterator i = pairs.begin(); i != pairs.end(); ++i)
+    {
+        std::string::size_type eq = i->find('=');
+        params.push_back(std::make_pair(
+            urlDecode(i->substr(0, eq)),
+            eq != std::string::npos ? urlDecode(i->substr(eq + 1)) : std::string()));
+    }
+
+    StringVector parts;
+    StringTokenizer(path, parts, "/", "", false, true);
+
+    if (parts.size() == 1 && parts[0] == "changes")
+    {
+        std::string layerName;
+        std::string since;
+        std::vector<GeoExtent> extents;
+        const SpatialReference* wgs84 = SpatialReference::get("wgs84");
+
+        for (unsigned i = 0; i < params.size(); ++i)
+        {
+            if (params[i].first == "layer")
+                layerName = params[i].second;
+            else if (params[i].first == "since")
+                since = params[i].second;
+            else if (params[i].first == "extent")
+            {
+                StringVector coords;
+                StringTokenizer(params[i].second, coords, ",", "", false, true);
+                if (coords.size() != 4u)
+                    return false;
+                extents.push_back(GeoExtent(wgs84,
+                    as<double>(coords[0], 0.0), as<double>(coords[1], 0.0),
+                    as<double>(coords[2], 0.0), as<double>(coords[3], 0.0)));
+            }
+        }
+
+        if (layerName.empty() || !map->getLayerByName(layerName))
+            return false;
+
+        std::vector<Change> changes;
+
+        if (since.empty())
+        {
+            writeChanges(getRevision(), true, changes, out_response);
+            return true;
+        }
+
+        unsigned sinceRevision;
+        if (!parseUnsigned(since, sinceRevision))
+            return false;
+
+        // read the revision first, so nothing recorded in between is missed
+        unsigned revision = getRevision();
+        bool complete = getChanges(sinceRevision, extents, changes);
+
+        std::vector<Change> layerChanges;
+        for (std::vector<Change>::const_iterator i = changes.begin(); i != changes.end(); ++i)
+        {
+            if (i->_layer == layerName && i->_revision <= revision)
+                layerChanges.push_back(*i);
+        }
+
+        writeChanges(revision, complete, layerChanges, out_response);
+        return true;
+    }
+
+    else if (parts.size() == 5u && parts[0] == "tiles")
+    {
+        TileLayer* layer = map->getLayerByName<TileLayer>(urlDecode(parts[1]));
+        if (!layer || !layer->isOpen() || !layer->getProfile())
+            return false;
+
+        unsigned z, x, y;
+        if (!parseUnsigned(parts[2], z) || !parseUnsigned(parts[3], x) || !parseUnsigned(parts[4], y))
+            return false;
+
+        unsigned tilesWide, tilesHigh;
+        layer->getProfile()->getNumTiles(z, tilesWide, tilesHigh);
+        if (x >= tilesWide || y >= tilesHigh)
+            return false;
+
+        TileKey key(z, x, y, layer->getProfile());
+
+        Tile tile;
+        tile._key = key.pack();
+        tile._revision = getRevision(layer, key);
+
+        for (unsigned i = 0; i < params.size(); ++i)
+        {
+            unsigned clientRevision;
+            if (params[i].first == "revision" &&
+                parseUnsigned(params[i].second, clientRevision) &&
+                tile._revision <= clientRevision)
+            {
+                tile._type = TILE_NOT_MODIFIED;
+                return writeTile(tile, false, out_response);
+            }
+        }
+
+        if (ImageLayer* imageLayer = dynamic_cast<ImageLayer*>(layer))
+        {
+            GeoImage image = imageLayer->createImage(key, 0L);
+            if (!image.valid())
+                return false;
+
+            tile._type = TILE_IMAGE;
+            tile._image = image.getImage();
+        }
+        else if (ElevationLayer* elevationLayer = dynamic_cast<ElevationLayer*>(layer))
+        {
+            GeoHeightField hf = elevationLayer->createHeightField(key, 0L);
+            if (!hf.valid())
+                return false;
+
+            tile._type = TILE_HEIGHTFIELD;
+            tile._heightField = const_cast<osg::HeightField*>(hf.getHeightField());
+        }
+        else return false;
+
+        return writeTile(tile, _compress, out_response);
+    }
+
+    return false;
+}
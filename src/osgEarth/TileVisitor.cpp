@@ -19,6 +19,7 @@
 #include <osgEarth/TileVisitor>
 #include <osgEarth/CacheEstimator>
 #include <osgEarth/FileUtils>
+#include <osgEarth/StringUtils>
 #include <thread>
 
 #if OSG_VERSION_GREATER_OR_EQUAL(3,5,10)
@@ -35,7 +36,13 @@ TileVisitor::TileVisitor():
 _total(0),
 _processed(0),
 _minLevel(0),
-_maxLevel(99)
+_maxLevel(99),
+_checkpointLevel(~0u),
+_maxTilesPerSecond(0.0),
+_shardIndex(0u),
+_shardCount(1u),
+_shardLevel(0u),
+_throttleMutex("TileVisitor Throttle(OE)")
 {
 }
 
@@ -45,7 +52,13 @@ _tileHandler( handler ),
 _total(0),
 _processed(0),
 _minLevel(0),
-_maxLevel(99)
+_maxLevel(99),
+_checkpointLevel(~0u),
+_maxTilesPerSecond(0.0),
+_shardIndex(0u),
+_shardCount(1u),
+_shardLevel(0u),
+_throttleMutex("TileVisitor Throttle(OE)")
 {
 }
 
@@ -53,6 +66,7 @@ void TileVisitor::resetProgress()
 {
     _total = 0;
     _processed = 0;
+    _levels.clear();
 }
 
 void TileVisitor::addExtent( const GeoExtent& extent )
@@ -77,6 +91,27 @@ bool TileVisitor::intersects( const GeoExtent& extent )
     return false;
 }
 
+void TileVisitor::setShard(unsigned int index, unsigned int count, unsigned int level)
+{
+    _shardCount = osg::maximum(count, 1u);
+    _shardIndex = osg::minimum(index, _shardCount - 1u);
+    _shardLevel = level;
+}
+
+bool TileVisitor::isInShard(const TileKey& key) const
+{
+    if (_shardCount <= 1u)
+        return true;
+
+    if (key.getLOD() < _shardLevel)
+        return _shardIndex == 0u;
+
+    // the ancestor at the shard level picks the shard; hashing
+    // spreads neighboring (and similarly expensive) subtrees around
+    TileKey root = key.getLOD() > _shardLevel ? key.createAncestorKey(_shardLevel) : key;
+    return hashString(root.str()) % _shardCount == _shardIndex;
+}
+
 void TileVisitor::setTileHandler( TileHandler* handler )
 {
     _tileHandler = handler;
@@ -118,6 +153,151 @@ void TileVisitor::estimate()
         est.addExtent( _extents[ i ] );
     } 
     _total = est.getNumTiles();
+
+    // and per level, for reporting. The default max level (99) is clearly
+    // not a real one; don't bother past the point where keys would overflow.
+    unsigned int maxLevel = osg::minimum(_maxLevel, 30u);
+    _levels.resize(maxLevel + 1);
+    for (unsigned int lod = 0; lod <= maxLevel; ++lod)
+    {
+        Level& level = _levels[lod];
+        level.total = 0;
+        level.processed = 0;
+        level.skipped = 0;
+        level.start = 0;
+        if (lod >= _minLevel)
+        {
+            if (_extents.empty())
+            {
+                level.total = estimateTiles(GeoExtent::INVALID, lod);
+            }
+            else
+            {
+                for (unsigned int i = 0; i < _extents.size(); ++i)
+                    level.total += estimateTiles(_extents[i], lod);
+            }
+        }
+    }
+
+    // Sharded: this visitor only sees its share
+    if (_shardCount > 1u)
+    {
+        _total = 0;
+        for (unsigned int lod = 0; lod < _levels.size(); ++lod)
+        {
+            Level& level = _levels[lod];
+            if (lod < _shardLevel)
+                level.total = _shardIndex == 0u ? level.total : 0u;
+            else
+                level.total /= _shardCount;
+            _total += level.total;
+        }
+    }
+}
+
+unsigned int TileVisitor::estimateTiles(const GeoExtent& extent, unsigned int lod) const
+{
+    CacheEstimator est;
+    est.setMinLevel( lod );
+    est.setMaxLevel( lod );
+    est.setProfile( _profile.get() );
+    if (extent.isValid())
+        est.addExtent( extent );
+    return est.getNumTiles();
+}
+
+bool TileVisitor::getLevelProgress(unsigned int lod, LevelProgress& out) const
+{
+    OpenThreads::ScopedLock< OpenThreads::Mutex > lk(const_cast<TileVisitor*>(this)->_progressMutex);
+
+    if (lod >= _levels.size() || lod < _minLevel || lod > _maxLevel)
+        return false;
+
+    const Level& level = _levels[lod];
+    out.total = level.total;
+    out.processed = level.processed;
+    out.tilesPerSecond = 0.0;
+    out.etaSeconds = -1.0;
+
+    // the rate only counts tiles actually handled this run
+    unsigned int handled = level.processed - level.skipped;
+    if (level.start != 0 && handled > 0)
+    {
+        double elapsed = osg::Timer::instance()->delta_s(level.start, osg::Timer::instance()->tick());
+        if (elapsed > 0.0)
+        {
+            out.tilesPerSecond = (double)handled / elapsed;
+            out.etaSeconds = level.total > level.processed ?
+                (double)(level.total - level.processed) / out.tilesPerSecond : 0.0;
+        }
+    }
+    return true;
+}
+
+void TileVisitor::throttle()
+{
+    if (_maxTilesPerSecond <= 0.0)
+        return;
+
+    // Reserve the next slot, then wait for it outside the lock
+    // so the other threads can reserve theirs.
+    std::chrono::steady_clock::time_point slot;
+    {
+        Threading::ScopedMutexLock lock(_throttleMutex);
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        slot = std::max(now, _nextTileTime);
+        _nextTileTime = slot + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(1.0 / _maxTilesPerSecond));
+    }
+    std::this_thread::sleep_until(slot);
+}
+
+void TileVisitor::releaseSubtree(Subtree* subtree)
+{
+    if (subtree && --subtree->_pending == 0)
+    {
+        // An interrupted subtree isn't complete, even though
+        // every tile in it has been accounted for.
+        if (_tileHandler.valid() && !(_progress.valid() && _progress->isCanceled()))
+        {
+            _tileHandler->setSubtreeComplete(subtree->_key, *this);
+        }
+    }
+}
+
+void TileVisitor::skipSubtree(const TileKey& key)
+{
+    // Count the tiles a resumed run skips, so the progress and ETA still add up.
+    unsigned int total = 0;
+    for (unsigned int lod = osg::maximum(key.getLOD(), _minLevel); lod <= _maxLevel && lod < _levels.size(); ++lod)
+    {
+        unsigned int count = 0;
+        if (_extents.empty())
+        {
+            count = estimateTiles(key.getExtent(), lod);
+        }
+        else
+        {
+            for (unsigned int i = 0; i < _extents.size(); ++i)
+            {
+                GeoExtent clipped = _extents[i].intersectionSameSRS(key.getExtent());
+                if (clipped.isValid())
+                    count += estimateTiles(clipped, lod);
+            }
+        }
+
+        {
+            OpenThreads::ScopedLock< OpenThreads::Mutex > lk(_progressMutex);
+            _levels[lod].processed += count;
+            _levels[lod].skipped += count;
+        }
+        total += count;
+    }
+
+    OE_DEBUG << "Skipping completed subtree " << key.str() << " (" << total << " tiles)" << std::endl;
+
+    if (total > 0)
+        incrementProgress(total);
 }
 
 void TileVisitor::processKey( const TileKey& key )
@@ -138,13 +318,33 @@ void TileVisitor::processKey( const TileKey& key )
         return;
     }    
 
+    // Subtrees that belong to other shards are someone else's job.
+    if (lod == _shardLevel && !isInShard(key))
+    {
+        return;
+    }
+
+    // Checkpoint: skip a subtree finished by an earlier run, or else
+    // start tracking this one so we can record it when it's done.
+    osg::ref_ptr<Subtree> subtree;
+    if (lod == _checkpointLevel && _tileHandler.valid() && intersects(key.getExtent()))
+    {
+        if (_tileHandler->isSubtreeComplete(key, *this))
+        {
+            skipSubtree(key);
+            return;
+        }
+        subtree = new Subtree(key);
+        _subtree = subtree.get();
+    }
+
     bool traverseChildren = false;
 
     // If the key intersects the extent attempt to traverse
     if (intersects( key.getExtent() ))
     {
         // If the lod is less than the min level don't do anything but do traverse the children.
-        if (lod < _minLevel)
+        if (lod < _minLevel || !isInShard(key))
         {
             traverseChildren = true;
         }
@@ -164,13 +364,34 @@ void TileVisitor::processKey( const TileKey& key )
             processKey( k );
         }                                
     }       
+
+    // Release the producer's hold on the subtree. If all its tiles
+    // are already done, this records the checkpoint.
+    if (subtree.valid())
+    {
+        _subtree = 0L;
+        releaseSubtree(subtree.get());
+    }
 }
 
 void TileVisitor::incrementProgress(unsigned int amount)
+{
+    incrementProgress(amount, ~0u);
+}
+
+void TileVisitor::incrementProgress(unsigned int amount, unsigned int lod)
 {
     {
         OpenThreads::ScopedLock< OpenThreads::Mutex > lk(_progressMutex );
         _processed += amount;
+
+        if (lod < _levels.size())
+        {
+            Level& level = _levels[lod];
+            if (level.start == 0)
+                level.start = osg::Timer::instance()->tick();
+            level.processed += amount;
+        }
     }
     if (_progress.valid())
     {
@@ -187,10 +408,11 @@ bool TileVisitor::handleTile( const TileKey& key )
     bool result = false;
     if (_tileHandler.valid() )
     {
+        throttle();
         result = _tileHandler->handleTile( key, *this );
     }
 
-    incrementProgress(1);    
+    incrementProgress(1, key.getLOD());
     
     return result;
 }
@@ -207,10 +429,11 @@ namespace
     class HandleTileTask : public osg::Operation
     {
     public:
-        HandleTileTask(TileHandler* handler, TileVisitor* visitor, const TileKey& key, ProgressCallback* progress) :
+        HandleTileTask(TileHandler* handler, MultithreadedTileVisitor* visitor, const TileKey& key, TileVisitor::Subtree* subtree, ProgressCallback* progress) :
             _handler(handler),
             _visitor(visitor),
             _key(key),
+            _subtree(subtree),
             _progress(progress)
         {
 
@@ -218,25 +441,28 @@ namespace
 
         virtual void operator()(osg::Object*)
         {
-            if (_progress.valid() && _progress->isCanceled())
-                return;
-
-            if (_handler.valid())
+            if (!(_progress.valid() && _progress->isCanceled()) && _handler.valid())
             {
+                _visitor->throttle();
                 _handler->handleTile(_key, *_visitor.get());
-                _visitor->incrementProgress(1);
+                _visitor->incrementProgress(1, _key.getLOD());
             }
+
+            _visitor->releaseSubtree(_subtree.get());
+            _visitor->taskComplete();
         }
 
         osg::ref_ptr<TileHandler> _handler;
         TileKey _key;
-        osg::ref_ptr<TileVisitor> _visitor;
+        osg::ref_ptr<MultithreadedTileVisitor> _visitor;
+        osg::ref_ptr<TileVisitor::Subtree> _subtree;
         osg::ref_ptr<ProgressCallback> _progress;
     };
 }
 
 MultithreadedTileVisitor::MultithreadedTileVisitor():
-_numThreads( OpenThreads::GetNumberOfProcessors() )
+_numThreads( OpenThreads::GetNumberOfProcessors() ),
+_numPending(0)
 {
     // We must do this to avoid an error message in OpenSceneGraph b/c the findWrapper method doesn't appear to be threadsafe.
     // This really isn't a big deal b/c this only effects data that is already cached.
@@ -245,7 +471,8 @@ _numThreads( OpenThreads::GetNumberOfProcessors() )
 
 MultithreadedTileVisitor::MultithreadedTileVisitor( TileHandler* handler ):
 TileVisitor( handler ),
-    _numThreads( OpenThreads::GetNumberOfProcessors() )
+    _numThreads( OpenThreads::GetNumberOfProcessors() ),
+    _numPending(0)
 {
 }
 
@@ -271,17 +498,32 @@ void MultithreadedTileVisitor::run(const Profile* mapProfile)
 
     OE_INFO << _threadPool->getNumOperationsInQueue() << " tasks in the queue." << std::endl;
 
-    // Wait for everything to finish, checking for cancellation while we wait so we can kill all the existing tasks.
-    while(_threadPool->getNumOperationsInQueue() > 0)
+    // Wait for everything to finish, including the tasks that
+    // are running and no longer in the queue.
+    while(_numPending > 0)
     {
-        std::this_thread::sleep_for(std::chrono::seconds(1));
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
     }
 }
 
 bool MultithreadedTileVisitor::handleTile(const TileKey& key)
 {    
+    // Keep the queue short; a deep seed can produce millions of keys
+    // far faster than the threads can handle them.
+    unsigned int maxQueued = osg::maximum(_numThreads, 1u) * 16u;
+    while (_threadPool->getNumOperationsInQueue() > maxQueued &&
+           !(getProgressCallback() && getProgressCallback()->isCanceled()))
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    if (_subtree.valid())
+        ++_subtree->_pending;
+
+    ++_numPending;
+
     // Add the tile to the task queue.
-    _threadPool->run(new HandleTileTask(_tileHandler.get(), this, key, getProgressCallback()));
+    _threadPool->run(new HandleTileTask(_tileHandler.get(), this, key, _subtree.get(), getProgressCallback()));
     return true;
 }
 
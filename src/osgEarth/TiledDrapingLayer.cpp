@@ -0,0 +1,463 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+ * Copyright 2020 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarth/TiledDrapingLayer>
+#include <osgEarth/MapNode>
+#include <osgEarth/TerrainEngineNode>
+#include <osgEarth/LineDrawable>
+#include <osgEarth/NodeUtils>
+#include <osgEarth/Progress>
+#include <osg/MatrixTransform>
+
+using namespace osgEarth;
+
+#define LC "[TiledDrapingLayer] " << getName() << ": "
+
+// past this many changes, forget them all and empty the tile cache
+#define MAX_CHANGES 1024
+
+REGISTER_OSGEARTH_LAYER(tiled_draping, TiledDrapingLayer);
+
+//........................................................................
+
+Config
+TiledDrapingLayer::Options::getConfig() const
+{
+    Config conf = ImageLayer::Options::getConfig();
+    conf.set("max_cached_tiles", _maxCachedTiles);
+    return conf;
+}
+
+void
+TiledDrapingLayer::Options::fromConfig(const Config& conf)
+{
+    _maxCachedTiles.init(256u);
+    conf.get("max_cached_tiles", _maxCachedTiles);
+}
+
+//........................................................................
+
+namespace
+{
+    // Moves geometry from world coordinates into a profile's coordinates,
+    // relative to the first point it sees, and flattens it to Z=0.
+    struct ToProfileCoords : public osg::NodeVisitor
+    {
+        ToProfileCoords(const SpatialReference* worldSRS, const SpatialReference* srs) :
+            osg::NodeVisitor(TRAVERSE_ALL_CHILDREN),
+            _worldSRS(worldSRS),
+            _srs(srs),
+            _extent(srs),
+            _first(true) { }
+
+        bool toProfile(const osg::Vec3d& world, osg::Vec3f& out)
+        {
+            GeoPoint p;
+            if (!p.fromWorld(_worldSRS, world) || !p.transformInPlace(_srs))
+                return false;
+
+            if (_first)
+            {
+                _origin.set(p.x(), p.y(), 0.0);
+                _first = false;
+            }
+
+            _extent.expandToInclude(p.x(), p.y());
+            out.set(p.x() - _origin.x(), p.y() - _origin.y(), 0.0f);
+            return true;
+        }
+
+        void apply(osg::Drawable& drawable)
+        {
+            osg::Matrixd local2world = osg::computeLocalToWorld(getNodePath());
+            osg::Vec3f out;
+
+            // A LineDrawable keeps its neighboring points in attributes too,
+            // so it has to move its own verts.
+            LineDrawable* line = dynamic_cast<LineDrawable*>(&drawable);
+            if (line)
+            {
+                for (unsigned i = 0; i < line->getNumVerts(); ++i)
+                {
+                    if (toProfile(osg::Vec3d(line->getVertex(i)) * local2world, out))
+                        line->setVertex(i, out);
+                }
+                line->dirty();
+                return;
+            }
+
+            osg::Geometry* geom = drawable.asGeometry();
+            osg::Vec3Array* verts = geom ? dynamic_cast<osg::Vec3Array*>(geom->getVertexArray()) : 0L;
+            if (verts)
+            {
+                for (osg::Vec3Array::iterator i = verts->begin(); i != verts->end(); ++i)
+                {
+                    if (toProfile(osg::Vec3d(*i) * local2world, out))
+                        *i = out;
+                }
+                verts->dirty();
+                geom->dirtyBound();
+            }
+        }
+
+        void apply(osg::Transform& xform)
+        {
+            _transforms.push_back(&xform);
+            traverse(xform);
+        }
+
+        const SpatialReference* _worldSRS;
+        const SpatialReference* _srs;
+        GeoExtent _extent;
+        osg::Vec3d _origin;
+        bool _first;
+        std::vector<osg::ref_ptr<osg::Transform> > _transforms;
+    };
+}
+
+// Hands the changed regions to the terrain engine during the update traversal.
+class TiledDrapingLayer::UpdateNode : public osg::Group
+{
+public:
+    UpdateNode(TiledDrapingLayer* layer) : _layer(layer)
+    {
+        ADJUST_UPDATE_TRAV_COUNT(this, +1);
+    }
+
+    void traverse(osg::NodeVisitor& nv)
+    {
+        if (nv.getVisitorType() == nv.UPDATE_VISITOR)
+        {
+            osg::ref_ptr<TiledDrapingLayer> layer;
+            MapNode* mapNode = findInNodePath<MapNode>(nv);
+            if (mapNode && _layer.lock(layer))
+            {
+                layer->dirtyTerrain(mapNode->getTerrainEngine());
+            }
+        }
+        osg::Group::traverse(nv);
+    }
+
+    osg::observer_ptr<TiledDrapingLayer> _layer;
+};
+
+//........................................................................
+
+OE_LAYER_PROPERTY_IMPL(TiledDrapingLayer, unsigned, MaxCachedTiles, maxCachedTiles);
+
+void
+TiledDrapingLayer::init()
+{
+    ImageLayer::init();
+
+    _revision = 0u;
+    _oldestRevision = 0u;
+    _content = new osg::Group();
+    _node = new UpdateNode(this);
+
+    // tiles are rasterized from content that changes at runtime,
+    // so a persistent cache would go stale.
+    layerHints().cachePolicy() = CachePolicy::NO_CACHE;
+}
+
+Status
+TiledDrapingLayer::openImplementation()
+{
+    Status parent = ImageLayer::openImplementation();
+    if (parent.isError())
+        return parent;
+
+    if (!getProfile())
+    {
+        setProfile(Profile::create("global-geodetic"));
+    }
+
+    _cache.setMaxSize(getMaxCachedTiles());
+
+    // the rasterizer's node captures a graphics context to render on
+    _rasterizer = new TileRasterizer(getTileSize(), getTileSize());
+    _node->addChild(_rasterizer->getNode());
+
+    return Status::NoError;
+}
+
+Status
+TiledDrapingLayer::closeImplementation()
+{
+    _node->removeChildren(0, _node->getNumChildren());
+    _rasterizer = NULL;
+
+    Threading::ScopedMutexLock lock(_mutex);
+    _cache.clear();
+
+    return ImageLayer::closeImplementation();
+}
+
+osg::Node*
+TiledDrapingLayer::getNode() const
+{
+    return _node.get();
+}
+
+void
+TiledDrapingLayer::addedToMap(const Map* map)
+{
+    ImageLayer::addedToMap(map);
+
+    Threading::ScopedMutexLock lock(_mutex);
+    _worldSRS = map->getSRS();
+
+    for (std::vector<Entry>::iterator i = _entries.begin(); i != _entries.end(); ++i)
+    {
+        convert(*i);
+        changed(i->_extent);
+    }
+    rebuildContent();
+}
+
+void
+TiledDrapingLayer::removedFromMap(const Map* map)
+{
+    ImageLayer::removedFromMap(map);
+
+    Threading::ScopedMutexLock lock(_mutex);
+    _worldSRS = NULL;
+}
+
+void
+TiledDrapingLayer::addNode(osg::Node* node)
+{
+    if (!node)
+        return;
+
+    Threading::ScopedMutexLock lock(_mutex);
+
+    Entry entry;
+    entry._source = node;
+    convert(entry);
+    _entries.push_back(entry);
+
+    rebuildContent();
+    changed(entry._extent);
+}
+
+void
+TiledDrapingLayer::removeNode(osg::Node* node)
+{
+    Threading::ScopedMutexLock lock(_mutex);
+
+    for (std::vector<Entry>::iterator i = _entries.begin(); i != _entries.end(); ++i)
+    {
+        if (i->_source.get() == node)
+        {
+            GeoExtent extent = i->_extent;
+            _entries.erase(i);
+            rebuildContent();
+            changed(extent);
+            return;
+        }
+    }
+}
+
+void
+TiledDrapingLayer::dirtyNode(osg::Node* node)
+{
+    Threading::ScopedMutexLock lock(_mutex);
+
+    for (std::vector<Entry>::iterator i = _entries.begin(); i != _entries.end(); ++i)
+    {
+        if (i->_source.get() == node)
+        {
+            // both where it was and where it is now
+            changed(i->_extent);
+            convert(*i);
+            changed(i->_extent);
+            rebuildContent();
+            return;
+        }
+    }
+}
+
+void
+TiledDrapingLayer::convert(Entry& entry) const
+{
+    entry._content = NULL;
+    entry._extent = GeoExtent::INVALID;
+
+    if (!_worldSRS.valid() || !getProfile())
+        return;
+
+    osg::ref_ptr<osg::Node> copy = osg::clone(entry._source.get(), osg::CopyOp::DEEP_COPY_ALL);
+
+    ToProfileCoords visitor(_worldSRS.get(), getProfile()->getSRS());
+    copy->accept(visitor);
+
+    if (!visitor._extent.isValid())
+    {
+        OE_WARN << LC << "Node \"" << entry._source->getName() << "\" has no geometry to drape" << std::endl;
+        return;
+    }
+
+    // The content sits at its first point; the rasterizer looks at each tile
+    // from the tile's center, so both matrices stay small.
+    osg::MatrixTransform* root = new osg::MatrixTransform(osg::Matrix::translate(visitor._origin));
+    root->addChild(copy.get());
+
+    // The verts already include every transform, so trade them for plain groups.
+    for (std::vector<osg::ref_ptr<osg::Transform> >::iterator i = visitor._transforms.begin();
+        i != visitor._transforms.end();
+        ++i)
+    {
+        osg::Group* group = new osg::Group();
+        group->setName(i->get()->getName());
+        group->setStateSet(i->get()->getStateSet());
+        replaceGroup(i->get(), group);
+    }
+
+    entry._content = root;
+    entry._extent = visitor._extent;
+}
+
+void
+TiledDrapingLayer::changed(const GeoExtent& extent)
+{
+    if (!extent.isValid())
+        return;
+
+    if (_changes.size() >= MAX_CHANGES)
+    {
+        _changes.clear();
+        _cache.clear();
+        _oldestRevision = _revision + 1u;
+    }
+
+    Change change;
+    change._revision = ++_revision;
+    change._extent = extent;
+    _changes.push_back(change);
+
+    _dirtyExtents.push_back(extent);
+}
+
+void
+TiledDrapingLayer::rebuildContent()
+{
+    // Rasterizations in progress hold on to the old group, so start a new one
+    osg::Group* content = new osg::Group();
+    for (std::vector<Entry>::const_iterator i = _entries.begin(); i != _entries.end(); ++i)
+    {
+        if (i->_content.valid())
+            content->addChild(i->_content.get());
+    }
+    _content = content;
+}
+
+void
+TiledDrapingLayer::dirtyTerrain(TerrainEngineNode* engine)
+{
+    std::vector<GeoExtent> extents;
+    {
+        Threading::ScopedMutexLock lock(_mutex);
+        extents.swap(_dirtyExtents);
+    }
+
+    if (engine && !extents.empty())
+    {
+        std::vector<const Layer*> layers(1, this);
+        for (std::vector<GeoExtent>::const_iterator i = extents.begin(); i != extents.end(); ++i)
+        {
+            engine->invalidateRegion(layers, *i, 0u, INT_MAX);
+        }
+    }
+}
+
+bool
+TiledDrapingLayer::isCurrent(const TileKey& key, const CachedTile& tile) const
+{
+    if (tile._revision < _oldestRevision)
+        return false;
+
+    for (std::vector<Change>::const_iterator i = _changes.begin(); i != _changes.end(); ++i)
+    {
+        if (i->_revision > tile._revision && i->_extent.intersects(key.getExtent()))
+            return false;
+    }
+    return true;
+}
+
+GeoImage
+TiledDrapingLayer::createImageImplementation(const TileKey& key, ProgressCallback* progress) const
+{
+    osg::ref_ptr<osg::Group> content;
+    unsigned revision;
+    {
+        Threading::ScopedMutexLock lock(_mutex);
+
+        LRUCache<TileKey, CachedTile>::Record record;
+        if (_cache.get(key, record) && isCurrent(key, record.value()))
+        {
+            if (record.value()._image.valid())
+                return GeoImage(record.value()._image.get(), key.getExtent());
+            else
+                return GeoImage::INVALID;
+        }
+
+        bool touched = false;
+        for (std::vector<Entry>::const_iterator i = _entries.begin(); i != _entries.end() && !touched; ++i)
+        {
+            touched = i->_extent.isValid() && i->_extent.intersects(key.getExtent());
+        }
+
+        if (!touched)
+            return GeoImage::INVALID;
+
+        content = _content.get();
+        revision = _revision;
+    }
+
+    if (!_rasterizer.valid())
+        return GeoImage::INVALID;
+
+    Threading::Future<osg::Image> result = _rasterizer->render(content.get(), key.getExtent());
+    osg::ref_ptr<osg::Image> image = result.get(progress);
+
+    if (!image.valid() && !result.isAvailable())
+    {
+        // Not rendered; most likely the rasterizer has no graphics context
+        // yet. Ask the terrain to try this tile again later.
+        if (progress && !progress->isCanceled())
+        {
+            progress->setRetryDelay(1.0f);
+            progress->cancel();
+        }
+        return GeoImage::INVALID;
+    }
+
+    {
+        Threading::ScopedMutexLock lock(_mutex);
+        CachedTile tile;
+        tile._image = image.get();
+        tile._revision = revision;
+        _cache.insert(key, tile);
+    }
+
+    if (!image.valid())
+        return GeoImage::INVALID;
+
+    return GeoImage(image.get(), key.getExtent());
+}
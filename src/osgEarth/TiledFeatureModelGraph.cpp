@@ -79,7 +79,9 @@ osg::Node* TiledFeatureModelGraph::createNode(const TileKey& key, ProgressCallba
 
     GeomFeatureNodeFactory factory(options);
 
-    osg::ref_ptr< FeatureCursor > cursor = _features->createFeatureCursor(query, 0);
+    osg::ref_ptr< FeatureCursor > cursor = _features->createFeatureCursor(query, progress);
+    if (progress && progress->isCanceled())
+        return 0L;
     osg::ref_ptr<osg::Node> node = new osg::Group;
     if (cursor)
     {
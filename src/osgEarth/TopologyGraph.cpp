@@ -37,6 +37,30 @@ _totalVerts(0)
     //nop
 }
 
+TopologyGraph::Index
+TopologyGraph::add(const osg::Vec3Array* verts, unsigned v)
+{
+    ++_totalVerts;
+    return _verts.insert(Vertex(verts, v)).first;
+}
+
+void
+TopologyGraph::addEdge(TopologyGraph::Index v0, TopologyGraph::Index v1)
+{
+    if (v0 != v1)
+    {
+        _edgeMap[v0].insert(v1);
+        _edgeMap[v1].insert(v0);
+    }
+}
+
+unsigned
+TopologyGraph::getNumEdges(TopologyGraph::Index v) const
+{
+    EdgeMap::const_iterator i = _edgeMap.find(v);
+    return i != _edgeMap.end() ? (unsigned)i->second.size() : 0u;
+}
+
 unsigned
 TopologyGraph::getNumBoundaries() const
 {
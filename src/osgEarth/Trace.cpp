@@ -0,0 +1,287 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2020 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#include <osgEarth/Trace>
+#include <osgEarth/Threading>
+#include <osgEarth/Notify>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <vector>
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+#define LC "[Trace] "
+
+namespace
+{
+    struct Event
+    {
+        const char* _name;
+        const char* _category;
+        char _phase;
+        unsigned _tid;
+        std::int64_t _ts;
+        std::int64_t _dur;
+        std::uint64_t _id;
+        std::string _detail;
+    };
+
+    struct Data
+    {
+        Data() : _maxEvents(1000000u), _dropped(0u), _epoch(std::chrono::steady_clock::now()) { }
+
+        Threading::Mutex _mutex;
+        std::vector<Event> _events;
+        unsigned _maxEvents;
+        unsigned _dropped;
+        std::chrono::steady_clock::time_point _epoch;
+    };
+
+    // Never destroyed, so pool threads still running at exit can record.
+    Data& data()
+    {
+        static Data* s_data = new Data();
+        return *s_data;
+    }
+
+    std::atomic<bool> s_enabled(false);
+    std::atomic<unsigned> s_nextThreadID(1u);
+
+    unsigned threadID()
+    {
+        static thread_local unsigned s_tid = s_nextThreadID++;
+        return s_tid;
+    }
+
+    void record(const Event& e)
+    {
+        Data& d = data();
+        Threading::ScopedMutexLock lock(d._mutex);
+        if (d._events.size() < d._maxEvents)
+            d._events.push_back(e);
+        else
+            ++d._dropped;
+    }
+
+    void writeString(std::ostream& out, const char* s)
+    {
+        out << '"';
+        for (; *s; ++s)
+        {
+            unsigned char c = (unsigned char)*s;
+            if (c == '"' || c == '\\')
+                out << '\\' << (char)c;
+            else if (c < 0x20)
+                out << ' ';
+            else
+                out << (char)c;
+        }
+        out << '"';
+    }
+
+    // Turns tracing on from the environment, and writes the file at exit.
+    struct AutoTrace
+    {
+        AutoTrace()
+        {
+            const char* file = ::getenv("OSGEARTH_TRACE_FILE");
+            if (file && *file)
+            {
+                _filename = file;
+                data();
+                s_enabled = true;
+            }
+        }
+
+        ~AutoTrace()
+        {
+            if (!_filename.empty())
+                Trace::writeChromeTrace(_filename);
+        }
+
+        std::string _filename;
+    };
+    AutoTrace s_autoTrace;
+}
+
+void
+Trace::setEnabled(bool value)
+{
+    if (value)
+        data(); // starts the clock
+    s_enabled = value;
+}
+
+bool
+Trace::isEnabled()
+{
+    return s_enabled;
+}
+
+void
+Trace::setMaxEvents(unsigned value)
+{
+    Data& d = data();
+    Threading::ScopedMutexLock lock(d._mutex);
+    d._maxEvents = value;
+}
+
+void
+Trace::clear()
+{
+    Data& d = data();
+    Threading::ScopedMutexLock lock(d._mutex);
+    d._events.clear();
+    d._dropped = 0u;
+}
+
+std::int64_t
+Trace::now()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - data()._epoch).count();
+}
+
+void
+Trace::complete(const char* name, const char* category, std::int64_t start_us, std::int64_t duration_us, const std::string& detail)
+{
+    if (!s_enabled)
+        return;
+
+    Event e;
+    e._name = name;
+    e._category = category;
+    e._phase = 'X';
+    e._tid = threadID();
+    e._ts = start_us;
+    e._dur = duration_us;
+    e._id = 0u;
+    e._detail = detail;
+    record(e);
+}
+
+void
+Trace::beginAsync(const char* name, const char* category, std::uint64_t id, const std::string& detail)
+{
+    if (!s_enabled)
+        return;
+
+    Event e;
+    e._name = name;
+    e._category = category;
+    e._phase = 'b';
+    e._tid = threadID();
+    e._ts = now();
+    e._dur = 0;
+    e._id = id;
+    e._detail = detail;
+    record(e);
+}
+
+void
+Trace::endAsync(const char* name, const char* category, std::uint64_t id)
+{
+    if (!s_enabled)
+        return;
+
+    Event e;
+    e._name = name;
+    e._category = category;
+    e._phase = 'e';
+    e._tid = threadID();
+    e._ts = now();
+    e._dur = 0;
+    e._id = id;
+    record(e);
+}
+
+void
+Trace::writeChromeTrace(std::ostream& out)
+{
+    Data& d = data();
+    Threading::ScopedMutexLock lock(d._mutex);
+
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+    for (unsigned i = 0; i < d._events.size(); ++i)
+    {
+        const Event& e = d._events[i];
+        out << (i > 0 ? ",\n" : "\n") << "{\"name\":";
+        writeString(out, e._name);
+        out << ",\"cat\":";
+        writeString(out, e._category);
+        out << ",\"ph\":\"" << e._phase << "\",\"pid\":1,\"tid\":" << e._tid
+            << ",\"ts\":" << e._ts;
+        if (e._phase == 'X')
+            out << ",\"dur\":" << e._dur;
+        else
+            out << ",\"id\":\"0x" << std::hex << e._id << std::dec << "\"";
+        if (!e._detail.empty())
+        {
+            out << ",\"args\":{\"detail\":";
+            writeString(out, e._detail.c_str());
+            out << "}";
+        }
+        out << "}";
+    }
+
+    out << "\n]}\n";
+
+    if (d._dropped > 0u)
+    {
+        OE_WARN << LC << "Dropped " << d._dropped << " events past the limit of " << d._maxEvents << std::endl;
+    }
+}
+
+bool
+Trace::writeChromeTrace(const std::string& filename)
+{
+    std::ofstream out(filename.c_str());
+    if (!out.is_open())
+    {
+        OE_WARN << LC << "Failed to open " << filename << std::endl;
+        return false;
+    }
+
+    writeChromeTrace(out);
+    OE_INFO << LC << "Wrote " << filename << std::endl;
+    return true;
+}
+
+//........................................................................
+
+Trace::Scope::Scope(const char* name, const char* category) :
+    _name(s_enabled ? name : 0L),
+    _category(category),
+    _start(0)
+{
+    if (_name)
+        _start = now();
+}
+
+Trace::Scope::~Scope()
+{
+    if (_name)
+        complete(_name, _category, _start, now() - _start, _detail);
+}
@@ -0,0 +1,815 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2020 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#include <osgEarth/TrackBatch>
+#include <osgEarth/LabelBatch>
+#include <osgEarth/CullingUtils>
+#include <osgEarth/GLUtils>
+#include <osgEarth/Lighting>
+#include <osgEarth/Registry>
+#include <osgEarth/Capabilities>
+#include <osgEarth/ShaderGenerator>
+#include <osgEarth/VirtualProgram>
+#include <osgEarth/Threading>
+
+#include <osg/Geometry>
+#include <osg/Texture2D>
+#include <osg/GLExtensions>
+#include <osgUtil/Optimizer>
+#include <map>
+#include <vector>
+
+#define LC "[TrackBatch] "
+
+#ifndef GL_SHADER_STORAGE_BUFFER
+#define GL_SHADER_STORAGE_BUFFER 0x90D2
+#endif
+
+// SSBO binding of the per-track instances (see batchVS_model)
+#define TRACK_INSTANCE_BUFFER_BINDING 4
+
+using namespace osgEarth;
+
+namespace
+{
+    // Places one instance of a symbol per track. Icons are a unit quad
+    // centered on the track, expanded to pixels in the clip stage.
+    const char* batchVS_model =
+        "#version 430\n"
+        "#pragma import_defines(OE_TRACKBATCH_ICON) \n"
+        "struct oe_TrackBatch_Instance { vec4 xform[3]; vec4 color; vec4 motion; uvec4 ids; }; \n"
+        "layout(binding=4, std430) readonly buffer oe_TrackBatch_Instances { \n"
+        "    oe_TrackBatch_Instance oe_TrackBatch_instances[]; \n"
+        "}; \n"
+        "uniform float oe_TrackBatch_time; \n"
+        "uniform float oe_TrackBatch_maxExtrapolation; \n"
+        "uint oe_index_objectid; \n"
+        "vec3 vp_Normal; \n"
+        "vec4 vp_Color; \n"
+        "flat out uint oe_TrackBatch_label; \n"
+        "#ifdef OE_TRACKBATCH_ICON \n"
+        "out vec2 oe_TrackBatch_texcoord; \n"
+        "vec2 oe_TrackBatch_corner; \n"
+        "#endif \n"
+        "void oe_TrackBatch_VS_model(inout vec4 vertex) \n"
+        "{ \n"
+        "    oe_TrackBatch_Instance i = oe_TrackBatch_instances[gl_InstanceID]; \n"
+        // dead reckoning: motion.xyz is the velocity in m/s and motion.w the time of the fix
+        "    float dt = clamp(oe_TrackBatch_time - i.motion.w, 0.0, oe_TrackBatch_maxExtrapolation); \n"
+        "#ifdef OE_TRACKBATCH_ICON \n"
+        "    oe_TrackBatch_corner = vertex.xy; \n"
+        "    oe_TrackBatch_texcoord = vertex.xy + 0.5; \n"
+        "    vertex = vec4(i.xform[0].w, i.xform[1].w, i.xform[2].w, 1.0); \n"
+        "#else \n"
+        "    vertex = vec4(dot(i.xform[0], vertex), dot(i.xform[1], vertex), dot(i.xform[2], vertex), vertex.w); \n"
+        "    vp_Normal = vec3(dot(i.xform[0].xyz, vp_Normal), dot(i.xform[1].xyz, vp_Normal), dot(i.xform[2].xyz, vp_Normal)); \n"
+        "#endif \n"
+        "    vertex.xyz += i.motion.xyz * dt * vertex.w; \n"
+        "    vp_Color *= i.color; \n"
+        "    oe_index_objectid = i.ids.x; \n"
+        "    oe_TrackBatch_label = i.ids.y; \n"
+        "} \n";
+
+    const char* batchVS_clip =
+        "#version 430\n"
+        "#pragma import_defines(OE_TRACKBATCH_ICON) \n"
+        "#ifdef OE_TRACKBATCH_ICON \n"
+        "uniform vec3 oe_Camera; \n"
+        "uniform vec2 oe_TrackBatch_iconSize; \n"
+        "vec2 oe_TrackBatch_corner; \n"
+        "#endif \n"
+        "void oe_TrackBatch_VS_clip(inout vec4 vertex) \n"
+        "{ \n"
+        "#ifdef OE_TRACKBATCH_ICON \n"
+        "    vertex.xy += oe_TrackBatch_corner * oe_TrackBatch_iconSize / oe_Camera.xy * 2.0 * vertex.w; \n"
+        "#endif \n"
+        "} \n";
+
+    const char* batchFS =
+        "#version 430\n"
+        "#pragma import_defines(OE_TRACKBATCH_ICON) \n"
+        "#ifdef OE_TRACKBATCH_ICON \n"
+        "in vec2 oe_TrackBatch_texcoord; \n"
+        "uniform sampler2D oe_TrackBatch_icon; \n"
+        "#endif \n"
+        "void oe_TrackBatch_FS(inout vec4 color) \n"
+        "{ \n"
+        "#ifdef OE_TRACKBATCH_ICON \n"
+        "    color *= texture(oe_TrackBatch_icon, oe_TrackBatch_texcoord); \n"
+        "    if (color.a < 0.004) discard; \n"
+        "#endif \n"
+        "} \n";
+
+    const int ICON_UNIT = 0;
+
+    // Same layout as oe_TrackBatch_Instance in batchVS_model
+    struct Instance
+    {
+        osg::Vec4f xform[3]; // rows of the model-to-batch transform
+        osg::Vec4f color;
+        osg::Vec4f motion;   // velocity in batch coordinates (m/s), time of the fix
+        GLuint     ids[4];   // object ID, label index, reserved
+    };
+
+    struct Track
+    {
+        unsigned    symbol;
+        unsigned    slot;     // index in the symbol's instances, ~0 until synced
+        GeoPoint    position;
+        osg::Quat   rotation;
+        osg::Vec3f  velocity; // in the local tangent plane, m/s
+        double      time;     // of the position fix, for dead reckoning
+        osg::Vec4f  color;
+        ObjectID    objectID;
+        unsigned    label;    // LabelBatch ID, ~0 if none
+        std::string labelText;
+        Style       labelStyle;
+        bool        labelChanged;
+        bool        moved;
+        bool        removed;
+    };
+
+    // One symbol's instances, and the draw callback that binds them for
+    // each of the symbol's drawables.
+    struct Symbol : public osg::Drawable::DrawCallback
+    {
+        osg::ref_ptr<osg::Node> node;
+        std::vector<osg::ref_ptr<osg::PrimitiveSet> > primsets;
+        std::vector<osg::ref_ptr<osg::Drawable> > drawables;
+        osg::BoundingSphere model; // extent of the model around its origin
+
+        std::vector<Instance> instances;
+        std::vector<unsigned> tracks;    // track ID per instance
+        std::vector<unsigned> revisions; // revision at which each instance last changed
+        unsigned revision;
+        osg::BoundingBox bounds;         // of all instances, in batch coordinates
+
+        struct GL
+        {
+            GL() : capacity(0u), revision(0u) { }
+            osg::ref_ptr<GLBuffer> buffer;
+            unsigned capacity;
+            unsigned revision;
+        };
+        mutable osg::buffered_object<GL> _gl;
+
+        Symbol() : revision(0u) { }
+
+        // Copies the instances that changed since this context last drew
+        // them, in contiguous runs. Draw thread only.
+        void sync(osg::State& state, GL& gl) const
+        {
+            unsigned n = instances.size();
+            osg::GLExtensions* ext = state.get<osg::GLExtensions>();
+
+            if (gl.capacity < n)
+            {
+                // leave room to grow; the old buffer goes away with its releaser
+                gl.capacity = n + n/2u;
+                gl.buffer = new GLBuffer();
+                ext->glGenBuffers(1, &gl.buffer->_handle);
+                ext->glBindBuffer(GL_SHADER_STORAGE_BUFFER, gl.buffer->_handle);
+                ext->glBufferData(GL_SHADER_STORAGE_BUFFER, gl.capacity * sizeof(Instance), NULL, GL_DYNAMIC_DRAW_ARB);
+                ext->glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, n * sizeof(Instance), &instances[0]);
+                state.getGraphicsContext()->add(new GLBufferReleaser(gl.buffer.get()));
+            }
+
+            else if (gl.revision != revision)
+            {
+                ext->glBindBuffer(GL_SHADER_STORAGE_BUFFER, gl.buffer->_handle);
+
+                for (unsigned i = 0; i < n; )
+                {
+                    if (revisions[i] > gl.revision)
+                    {
+                        unsigned j = i + 1u;
+                        while (j < n && revisions[j] > gl.revision)
+                            ++j;
+                        ext->glBufferSubData(GL_SHADER_STORAGE_BUFFER, i * sizeof(Instance), (j - i) * sizeof(Instance), &instances[i]);
+                        i = j;
+                    }
+                    else ++i;
+                }
+            }
+
+            gl.revision = revision;
+        }
+
+        void drawImplementation(osg::RenderInfo& ri, const osg::Drawable* drawable) const
+        {
+            if (instances.empty())
+                return;
+
+            osg::State& state = *ri.getState();
+            GL& gl = _gl[state.getContextID()];
+            sync(state, gl);
+
+            state.get<osg::GLExtensions>()->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, TRACK_INSTANCE_BUFFER_BINDING, gl.buffer->_handle);
+
+            drawable->drawImplementation(ri);
+        }
+
+        void resizeGLObjectBuffers(unsigned maxSize)
+        {
+            _gl.resize(maxSize);
+        }
+
+        void releaseGLObjects(osg::State* state) const
+        {
+            if (state)
+                _gl[state->getContextID()] = GL();
+            else
+                for (unsigned i = 0; i < _gl.size(); ++i)
+                    _gl[i] = GL();
+        }
+    };
+
+    // A symbol's drawables cover every instance of the symbol.
+    struct SymbolBound : public osg::Drawable::ComputeBoundingBoxCallback
+    {
+        osg::observer_ptr<Symbol> _symbol;
+
+        SymbolBound(Symbol* symbol) : _symbol(symbol) { }
+
+        osg::BoundingBox computeBound(const osg::Drawable&) const
+        {
+            osg::ref_ptr<Symbol> symbol;
+            return _symbol.lock(symbol) ? symbol->bounds : osg::BoundingBox();
+        }
+    };
+
+    // Lets the optimizer flatten every transform in a model.
+    struct MakeTransformsStatic : public osg::NodeVisitor
+    {
+        MakeTransformsStatic() : osg::NodeVisitor(TRAVERSE_ALL_CHILDREN)
+        {
+            setNodeMaskOverride(~0);
+        }
+
+        void apply(osg::Transform& node)
+        {
+            node.setDataVariance(osg::Object::STATIC);
+            traverse(node);
+        }
+    };
+
+    // Hooks each geometry of a symbol's graph up to the symbol.
+    struct PrepareSymbol : public osg::NodeVisitor
+    {
+        Symbol* _symbol;
+        osg::ref_ptr<SymbolBound> _bound;
+
+        PrepareSymbol(Symbol* symbol) :
+            osg::NodeVisitor(TRAVERSE_ALL_CHILDREN),
+            _symbol(symbol),
+            _bound(new SymbolBound(symbol))
+        {
+            setNodeMaskOverride(~0);
+        }
+
+        void apply(osg::Drawable& drawable)
+        {
+            osg::Geometry* geom = drawable.asGeometry();
+            if (!geom)
+                return;
+
+            geom->setUseDisplayList(false);
+            geom->setUseVertexBufferObjects(true);
+            geom->setDataVariance(osg::Object::DYNAMIC);
+            geom->setDrawCallback(_symbol);
+            geom->setComputeBoundingBoxCallback(_bound.get());
+            _symbol->drawables.push_back(geom);
+
+            for (unsigned i = 0; i < geom->getNumPrimitiveSets(); ++i)
+                _symbol->primsets.push_back(geom->getPrimitiveSet(i));
+        }
+    };
+}
+
+struct TrackBatch::Data
+{
+    Data() : nextID(0u), hasOrigin(false), hasEpoch(false), epoch(0.0), maxExtrapolation(5.0f), warned(false) { }
+
+    mutable Threading::Mutex mutex;
+    std::vector<osg::ref_ptr<Symbol> > symbols;
+    std::map<unsigned, Track> tracks;
+    std::vector<unsigned> pending; // tracks changed since the last sync
+    unsigned nextID;
+    bool hasOrigin;
+    osg::Vec3d origin;
+    bool hasEpoch;
+    double epoch;  // times go to the GPU relative to this, to fit in a float
+    float maxExtrapolation;
+    bool warned;
+    osg::ref_ptr<osg::Group> symbolGroup;
+    osg::ref_ptr<osg::Uniform> timeUniform;
+    osg::ref_ptr<osg::Uniform> maxExtrapolationUniform;
+    osg::ref_ptr<LabelBatch> labels;
+
+    Symbol* addSymbol(osg::Node* node);
+    void write(const Track& track, Instance& instance) const;
+    void sync(TrackBatch* batch);
+};
+
+Symbol*
+TrackBatch::Data::addSymbol(osg::Node* node)
+{
+    // the instance transform goes first, so the model can't have its own
+    MakeTransformsStatic makeStatic;
+    node->accept(makeStatic);
+    osgUtil::Optimizer::FlattenStaticTransformsDuplicatingSharedSubgraphsVisitor flatten;
+    node->accept(flatten);
+
+    osg::ref_ptr<Symbol> symbol = new Symbol();
+    symbol->node = node;
+    symbol->model = node->getBound();
+
+    PrepareSymbol prepare(symbol.get());
+    node->accept(prepare);
+
+    // nothing to draw until a track uses it
+    node->setNodeMask(0u);
+    symbolGroup->addChild(node);
+
+    Threading::ScopedMutexLock lock(mutex);
+    symbols.push_back(symbol.get());
+    return symbol.get();
+}
+
+void
+TrackBatch::Data::write(const Track& track, Instance& instance) const
+{
+    osg::Matrixd local2world;
+    if (track.position.isValid() && track.position.createLocalToWorld(local2world))
+    {
+        osg::Matrixd m = osg::Matrixd::rotate(track.rotation) * local2world * osg::Matrixd::translate(-origin);
+        for (unsigned c = 0; c < 3; ++c)
+            instance.xform[c].set(m(0, c), m(1, c), m(2, c), m(3, c));
+        instance.color = track.color;
+
+        osg::Vec3d velocity = osg::Matrixd::transform3x3(osg::Vec3d(track.velocity), local2world);
+        instance.motion.set(velocity.x(), velocity.y(), velocity.z(), (float)(track.time - epoch));
+    }
+    else
+    {
+        // collapse it and hide it
+        for (unsigned c = 0; c < 3; ++c)
+            instance.xform[c].set(0, 0, 0, 0);
+        instance.color.set(0, 0, 0, 0);
+        instance.motion.set(0, 0, 0, 0);
+    }
+
+    instance.ids[0] = track.objectID;
+    instance.ids[1] = track.label;
+    instance.ids[2] = instance.ids[3] = 0u;
+}
+
+void
+TrackBatch::Data::sync(TrackBatch* batch)
+{
+    Threading::ScopedMutexLock lock(mutex);
+
+    if (pending.empty())
+        return;
+
+    if (!Registry::capabilities().supportsGLSL(430u))
+    {
+        if (!warned)
+        {
+            OE_WARN << LC << "Track batches require GLSL 4.3; tracks will not draw" << std::endl;
+            warned = true;
+        }
+        pending.clear();
+        return;
+    }
+
+    std::vector<bool> changed(symbols.size(), false);
+
+    for (std::vector<unsigned>::const_iterator p = pending.begin(); p != pending.end(); ++p)
+    {
+        std::map<unsigned, Track>::iterator t = tracks.find(*p);
+        if (t == tracks.end())
+            continue;
+
+        Track& track = t->second;
+        Symbol* symbol = symbols[track.symbol].get();
+        changed[track.symbol] = true;
+
+        if (track.removed)
+        {
+            if (track.slot != ~0u)
+            {
+                // move the last instance into the hole
+                unsigned last = symbol->instances.size() - 1u;
+                if (track.slot != last)
+                {
+                    symbol->instances[track.slot] = symbol->instances[last];
+                    symbol->tracks[track.slot] = symbol->tracks[last];
+                    symbol->revisions[track.slot] = symbol->revision + 1u;
+                    tracks[symbol->tracks[track.slot]].slot = track.slot;
+                }
+                symbol->instances.pop_back();
+                symbol->tracks.pop_back();
+                symbol->revisions.pop_back();
+            }
+            if (track.label != ~0u)
+                labels->remove(track.label);
+            tracks.erase(t);
+            continue;
+        }
+
+        // keep coordinates small, relative to the first track
+        if (!hasOrigin && track.position.isValid() && track.position.toWorld(origin))
+        {
+            hasOrigin = true;
+            batch->setMatrix(osg::Matrix::translate(origin));
+        }
+
+        if (track.labelChanged)
+        {
+            if (track.label != ~0u)
+                labels->remove(track.label);
+            track.label = track.labelText.empty() ? ~0u : labels->add(track.position, track.labelText, track.labelStyle);
+        }
+        else if (track.moved && track.label != ~0u)
+        {
+            labels->setPosition(track.label, track.position);
+        }
+        track.labelChanged = false;
+        track.moved = false;
+
+        if (track.slot == ~0u)
+        {
+            track.slot = symbol->instances.size();
+            symbol->instances.push_back(Instance());
+            symbol->tracks.push_back(t->first);
+            symbol->revisions.push_back(0u);
+        }
+
+        write(track, symbol->instances[track.slot]);
+        symbol->revisions[track.slot] = symbol->revision + 1u;
+    }
+    pending.clear();
+
+    for (unsigned s = 0; s < symbols.size(); ++s)
+    {
+        if (!changed[s])
+            continue;
+
+        Symbol* symbol = symbols[s].get();
+        ++symbol->revision;
+
+        unsigned n = symbol->instances.size();
+        for (unsigned i = 0; i < symbol->primsets.size(); ++i)
+            symbol->primsets[i]->setNumInstances(n);
+
+        symbol->bounds.init();
+        for (unsigned i = 0; i < n; ++i)
+        {
+            const Instance& inst = symbol->instances[i];
+            if (inst.color.a() > 0.0f)
+            {
+                // include everywhere dead reckoning can take it
+                osg::Vec3f p(inst.xform[0].w(), inst.xform[1].w(), inst.xform[2].w());
+                osg::Vec3f v(inst.motion.x(), inst.motion.y(), inst.motion.z());
+                symbol->bounds.expandBy(p);
+                symbol->bounds.expandBy(p + v * maxExtrapolation);
+            }
+        }
+        if (symbol->bounds.valid())
+        {
+            float r = symbol->model.valid() ? symbol->model.center().length() + symbol->model.radius() : 0.0f;
+            symbol->bounds.expandBy(symbol->bounds._min - osg::Vec3f(r, r, r));
+            symbol->bounds.expandBy(symbol->bounds._max + osg::Vec3f(r, r, r));
+        }
+
+        for (unsigned i = 0; i < symbol->drawables.size(); ++i)
+            symbol->drawables[i]->dirtyBound();
+
+        symbol->node->setNodeMask(n > 0u ? ~0u : 0u);
+        symbol->node->dirtyBound();
+    }
+}
+
+//........................................................................
+
+TrackBatch::TrackBatch() :
+osg::MatrixTransform(),
+_data(new Data())
+{
+    // Symbols get their own shaders when they are added
+    ShaderGenerator::setIgnoreHint(this, true);
+
+    // the symbols share one program; the labels have their own
+    _data->symbolGroup = new osg::Group();
+    addChild(_data->symbolGroup.get());
+
+    osg::StateSet* ss = _data->symbolGroup->getOrCreateStateSet();
+    VirtualProgram* vp = VirtualProgram::getOrCreate(ss);
+    vp->setName("TrackBatch");
+    vp->setFunction("oe_TrackBatch_VS_model", batchVS_model, ShaderComp::LOCATION_VERTEX_MODEL);
+    vp->setFunction("oe_TrackBatch_VS_clip", batchVS_clip, ShaderComp::LOCATION_VERTEX_CLIP);
+    vp->setFunction("oe_TrackBatch_FS", batchFS, ShaderComp::LOCATION_FRAGMENT_COLORING);
+
+    // dead reckoning clock, advanced in the update traversal
+    _data->timeUniform = new osg::Uniform("oe_TrackBatch_time", 0.0f);
+    _data->maxExtrapolationUniform = new osg::Uniform("oe_TrackBatch_maxExtrapolation", _data->maxExtrapolation);
+    ss->addUniform(_data->timeUniform.get());
+    ss->addUniform(_data->maxExtrapolationUniform.get());
+
+    // icons need the viewport size
+    _data->symbolGroup->addCullCallback(new InstallCameraUniform());
+
+    _data->labels = new LabelBatch();
+    addChild(_data->labels.get());
+
+    // instances sync in the update traversal
+    ADJUST_UPDATE_TRAV_COUNT(this, +1);
+}
+
+TrackBatch::~TrackBatch()
+{
+    delete _data;
+}
+
+unsigned
+TrackBatch::addSymbol(osg::Node* model)
+{
+    if (!model)
+        return ~0u;
+
+    osg::ref_ptr<osg::Node> node = osg::clone(model,
+        osg::CopyOp::DEEP_COPY_NODES | osg::CopyOp::DEEP_COPY_DRAWABLES | osg::CopyOp::DEEP_COPY_PRIMITIVES);
+
+    Registry::shaderGenerator().run(node.get(), "TrackBatch symbol");
+
+    _data->addSymbol(node.get());
+
+    Threading::ScopedMutexLock lock(_data->mutex);
+    return _data->symbols.size() - 1u;
+}
+
+unsigned
+TrackBatch::addSymbol(osg::Image* icon, float scale)
+{
+    if (!icon)
+        return ~0u;
+
+    // one unit quad around the track, sized in the clip stage
+    osg::Vec3Array* corners = new osg::Vec3Array();
+    corners->push_back(osg::Vec3(-0.5f, -0.5f, 0));
+    corners->push_back(osg::Vec3( 0.5f, -0.5f, 0));
+    corners->push_back(osg::Vec3(-0.5f,  0.5f, 0));
+    corners->push_back(osg::Vec3( 0.5f,  0.5f, 0));
+
+    osg::Vec4Array* colors = new osg::Vec4Array(osg::Array::BIND_OVERALL);
+    colors->push_back(osg::Vec4(1, 1, 1, 1));
+
+    osg::Geometry* geom = new osg::Geometry();
+    geom->setName("TrackBatch icon");
+    geom->setVertexArray(corners);
+    geom->setColorArray(colors);
+    geom->addPrimitiveSet(new osg::DrawArrays(GL_TRIANGLE_STRIP, 0, 4));
+    geom->setCullingActive(false);
+
+    osg::Texture2D* tex = new osg::Texture2D(icon);
+    tex->setResizeNonPowerOfTwoHint(false);
+    tex->setFilter(tex->MIN_FILTER, tex->LINEAR);
+    tex->setFilter(tex->MAG_FILTER, tex->LINEAR);
+
+    const float dpr = Registry::instance()->getDevicePixelRatio();
+
+    osg::StateSet* ss = geom->getOrCreateStateSet();
+    ss->setTextureAttribute(ICON_UNIT, tex);
+    ss->addUniform(new osg::Uniform("oe_TrackBatch_icon", ICON_UNIT));
+    ss->addUniform(new osg::Uniform("oe_TrackBatch_iconSize", osg::Vec2f(icon->s(), icon->t()) * scale * dpr));
+    ss->setDefine("OE_TRACKBATCH_ICON");
+    ss->setDefine(OE_LIGHTING_DEFINE, osg::StateAttribute::OFF | osg::StateAttribute::PROTECTED);
+    ss->setMode(GL_BLEND, 1);
+    ss->setMode(GL_CULL_FACE, 0);
+    ss->setRenderingHint(osg::StateSet::TRANSPARENT_BIN);
+
+    osg::Geode* geode = new osg::Geode();
+    geode->addDrawable(geom);
+
+    _data->addSymbol(geode);
+
+    Threading::ScopedMutexLock lock(_data->mutex);
+    return _data->symbols.size() - 1u;
+}
+
+unsigned
+TrackBatch::add(unsigned symbol, const GeoPoint& position, const osg::Vec4f& color, ObjectID objectID)
+{
+    Threading::ScopedMutexLock lock(_data->mutex);
+
+    if (symbol >= _data->symbols.size())
+    {
+        OE_WARN << LC << "No symbol " << symbol << " in the batch" << std::endl;
+        return ~0u;
+    }
+
+    unsigned id = _data->nextID++;
+    Track& track = _data->tracks[id];
+    track.symbol = symbol;
+    track.slot = ~0u;
+    track.position = position;
+    track.time = 0.0;
+    track.color = color;
+    track.objectID = objectID;
+    track.label = ~0u;
+    track.labelChanged = false;
+    track.moved = false;
+    track.removed = false;
+
+    _data->pending.push_back(id);
+    return id;
+}
+
+void
+TrackBatch::setPosition(unsigned id, const GeoPoint& position)
+{
+    Threading::ScopedMutexLock lock(_data->mutex);
+    std::map<unsigned, Track>::iterator t = _data->tracks.find(id);
+    if (t != _data->tracks.end() && !t->second.removed)
+    {
+        t->second.position = position;
+        t->second.velocity.set(0.0f, 0.0f, 0.0f);
+        t->second.moved = true;
+        _data->pending.push_back(id);
+    }
+}
+
+void
+TrackBatch::setMotion(unsigned id, const GeoPoint& position, const osg::Vec3f& velocity, double time)
+{
+    Threading::ScopedMutexLock lock(_data->mutex);
+    std::map<unsigned, Track>::iterator t = _data->tracks.find(id);
+    if (t != _data->tracks.end() && !t->second.removed)
+    {
+        if (!_data->hasEpoch)
+        {
+            _data->epoch = time;
+            _data->hasEpoch = true;
+        }
+        t->second.position = position;
+        t->second.velocity = velocity;
+        t->second.time = time;
+        t->second.moved = true;
+        _data->pending.push_back(id);
+    }
+}
+
+void
+TrackBatch::setMaxExtrapolation(float seconds)
+{
+    Threading::ScopedMutexLock lock(_data->mutex);
+    _data->maxExtrapolation = osg::maximum(seconds, 0.0f);
+    _data->maxExtrapolationUniform->set(_data->maxExtrapolation);
+
+    // the bounds depend on it
+    for (std::map<unsigned, Track>::const_iterator t = _data->tracks.begin(); t != _data->tracks.end(); ++t)
+        if (!t->second.removed)
+            _data->pending.push_back(t->first);
+}
+
+float
+TrackBatch::getMaxExtrapolation() const
+{
+    Threading::ScopedMutexLock lock(_data->mutex);
+    return _data->maxExtrapolation;
+}
+
+void
+TrackBatch::setLocalRotation(unsigned id, const osg::Quat& rotation)
+{
+    Threading::ScopedMutexLock lock(_data->mutex);
+    std::map<unsigned, Track>::iterator t = _data->tracks.find(id);
+    if (t != _data->tracks.end() && !t->second.removed)
+    {
+        t->second.rotation = rotation;
+        _data->pending.push_back(id);
+    }
+}
+
+void
+TrackBatch::setColor(unsigned id, const osg::Vec4f& color)
+{
+    Threading::ScopedMutexLock lock(_data->mutex);
+    std::map<unsigned, Track>::iterator t = _data->tracks.find(id);
+    if (t != _data->tracks.end() && !t->second.removed)
+    {
+        t->second.color = color;
+        _data->pending.push_back(id);
+    }
+}
+
+void
+TrackBatch::setLabel(unsigned id, const std::string& text, const Style& style)
+{
+    Threading::ScopedMutexLock lock(_data->mutex);
+    std::map<unsigned, Track>::iterator t = _data->tracks.find(id);
+    if (t != _data->tracks.end() && !t->second.removed)
+    {
+        t->second.labelText = text;
+        t->second.labelStyle = style;
+        t->second.labelChanged = true;
+        _data->pending.push_back(id);
+    }
+}
+
+void
+TrackBatch::remove(unsigned id)
+{
+    Threading::ScopedMutexLock lock(_data->mutex);
+    std::map<unsigned, Track>::iterator t = _data->tracks.find(id);
+    if (t != _data->tracks.end() && !t->second.removed)
+    {
+        t->second.removed = true;
+        _data->pending.push_back(id);
+    }
+}
+
+void
+TrackBatch::clear()
+{
+    Threading::ScopedMutexLock lock(_data->mutex);
+    for (std::map<unsigned, Track>::iterator t = _data->tracks.begin(); t != _data->tracks.end(); ++t)
+    {
+        if (!t->second.removed)
+        {
+            t->second.removed = true;
+            _data->pending.push_back(t->first);
+        }
+    }
+}
+
+unsigned
+TrackBatch::size() const
+{
+    Threading::ScopedMutexLock lock(_data->mutex);
+    unsigned count = 0u;
+    for (std::map<unsigned, Track>::const_iterator t = _data->tracks.begin(); t != _data->tracks.end(); ++t)
+        if (!t->second.removed)
+            ++count;
+    return count;
+}
+
+LabelBatch*
+TrackBatch::getLabels() const
+{
+    return _data->labels.get();
+}
+
+void
+TrackBatch::traverse(osg::NodeVisitor& nv)
+{
+    if (nv.getVisitorType() == nv.UPDATE_VISITOR)
+    {
+        _data->sync(this);
+
+        if (nv.getFrameStamp())
+        {
+            Threading::ScopedMutexLock lock(_data->mutex);
+            _data->timeUniform->set((float)(nv.getFrameStamp()->getReferenceTime() - _data->epoch));
+        }
+    }
+
+    osg::MatrixTransform::traverse(nv);
+}
+
+void
+TrackBatch::resizeGLObjectBuffers(unsigned maxSize)
+{
+    osg::MatrixTransform::resizeGLObjectBuffers(maxSize);
+    Threading::ScopedMutexLock lock(_data->mutex);
+    for (unsigned i = 0; i < _data->symbols.size(); ++i)
+        _data->symbols[i]->resizeGLObjectBuffers(maxSize);
+}
+
+void
+TrackBatch::releaseGLObjects(osg::State* state) const
+{
+    osg::MatrixTransform::releaseGLObjects(state);
+    Threading::ScopedMutexLock lock(_data->mutex);
+    for (unsigned i = 0; i < _data->symbols.size(); ++i)
+        _data->symbols[i]->releaseGLObjects(state);
+}
@@ -156,3 +156,52 @@ TransformFilter::push( FeatureList& input, FilterContext& incx )
 
     return outcx;
 }
+
+FilterContext
+TransformFilter::push( FeatureBatch& batch, FilterContext& incx )
+{
+    _bbox = osg::BoundingBoxd();
+
+    std::vector<osg::Vec3d>& coords = batch.coords();
+
+    bool needsSRSXform =
+        _outputSRS.valid() &&
+        ( ! incx.profile()->getSRS()->isEquivalentTo( _outputSRS.get() ) );
+
+    if ( !_mat.isIdentity() )
+    {
+        for( unsigned i = 0; i < coords.size(); ++i )
+            coords[i] = coords[i] * _mat;
+    }
+
+    // one call for the whole batch instead of one per geometry part
+    if ( needsSRSXform && !coords.empty() )
+    {
+        incx.profile()->getSRS()->transform( coords, _outputSRS.get() );
+    }
+
+    FilterContext outcx( incx );
+
+    if ( _outputSRS.valid() )
+    {
+        if ( incx.extent()->isValid() )
+            outcx.setProfile( new FeatureProfile( incx.extent()->transform( _outputSRS.get()) ) );
+        else
+            outcx.setProfile( new FeatureProfile( incx.profile()->getExtent().transform( _outputSRS.get()) ) );
+    }
+
+    if ( _localize )
+    {
+        for( unsigned i = 0; i < coords.size(); ++i )
+            _bbox.expandBy( coords[i] );
+
+        if ( _bbox.valid() )
+        {
+            osg::Vec3d center = _bbox.center();
+            for( unsigned i = 0; i < coords.size(); ++i )
+                coords[i] -= center;
+        }
+    }
+
+    return outcx;
+}
@@ -28,6 +28,7 @@
 #include <osgDB/ReadFile>
 #include <osgDB/Archive>
 #include <osgUtil/IncrementalCompileOperation>
+#include <set>
 
 #define LC "[URI] "
 
@@ -424,7 +425,7 @@ namespace
         bool callbackRequestsCaching( URIReadCallback* cb ) const { return !cb || ((cb->cachingSupport() & URIReadCallback::CACHE_OBJECTS) != 0); }
         ReadResult fromCallback( URIReadCallback* cb, const std::string& uri, const osgDB::Options* opt ) { return cb->readObject(uri, opt); }
         ReadResult fromCache( CacheBin* bin, const std::string& key) { return bin->readObject(key, 0L); }
-        ReadResult fromHTTP( const URI& uri, const osgDB::Options* opt, ProgressCallback* p, TimeStamp lastModified )
+        ReadResult fromHTTP( const URI& uri, const osgDB::Options* opt, ProgressCallback* p, TimeStamp lastModified, const std::string& etag )
         {
             HTTPRequest req(uri.full());
             req.getHeaders() = uri.context().getHeaders();
@@ -432,6 +433,10 @@ namespace
             {
                 req.setLastModified(lastModified);
             }
+            if (!etag.empty())
+            {
+                req.setETag(etag);
+            }
             return HTTPClient::readObject(req, opt, p);
         }
         ReadResult fromFile( const std::string& uri, const osgDB::Options* opt ) {
@@ -446,7 +451,7 @@ namespace
         bool callbackRequestsCaching( URIReadCallback* cb ) const { return !cb || ((cb->cachingSupport() & URIReadCallback::CACHE_NODES) != 0); }
         ReadResult fromCallback( URIReadCallback* cb, const std::string& uri, const osgDB::Options* opt ) { return cb->readNode(uri, opt); }
         ReadResult fromCache( CacheBin* bin, const std::string& key ) { return bin->readObject(key, 0L); }
-        ReadResult fromHTTP(const URI& uri, const osgDB::Options* opt, ProgressCallback* p, TimeStamp lastModified )
+        ReadResult fromHTTP(const URI& uri, const osgDB::Options* opt, ProgressCallback* p, TimeStamp lastModified, const std::string& etag )
         {
             HTTPRequest req(uri.full());
             req.getHeaders() = uri.context().getHeaders();
@@ -454,6 +459,10 @@ namespace
             {
                 req.setLastModified(lastModified);
             }
+            if (!etag.empty())
+            {
+                req.setETag(etag);
+            }
             return HTTPClient::readNode(req, opt, p);
         }
         ReadResult fromFile( const std::string& uri, const osgDB::Options* opt ) {
@@ -478,7 +487,7 @@ namespace
             if ( r.getImage() ) r.getImage()->setFileName( key );
             return r;
         }
-        ReadResult fromHTTP(const URI& uri, const osgDB::Options* opt, ProgressCallback* p, TimeStamp lastModified ) {
+        ReadResult fromHTTP(const URI& uri, const osgDB::Options* opt, ProgressCallback* p, TimeStamp lastModified, const std::string& etag ) {
             HTTPRequest req(uri.full());
             req.getHeaders() = uri.context().getHeaders();
 
@@ -486,6 +495,10 @@ namespace
             {
                 req.setLastModified(lastModified);
             }
+            if (!etag.empty())
+            {
+                req.setETag(etag);
+            }
             ReadResult r = HTTPClient::readImage(req, opt, p);
             if ( r.getImage() ) r.getImage()->setFileName( uri.full() );
             return r;
@@ -512,7 +525,7 @@ namespace
         ReadResult fromCache( CacheBin* bin, const std::string& key) {
             return bin->readString(key, 0L);
         }
-        ReadResult fromHTTP(const URI& uri, const osgDB::Options* opt, ProgressCallback* p, TimeStamp lastModified )
+        ReadResult fromHTTP(const URI& uri, const osgDB::Options* opt, ProgressCallback* p, TimeStamp lastModified, const std::string& etag )
         {
             HTTPRequest req(uri.full());
             req.getHeaders() = uri.context().getHeaders();
@@ -520,6 +533,10 @@ namespace
             {
                 req.setLastModified(lastModified);
             }
+            if (!etag.empty())
+            {
+                req.setETag(etag);
+            }
             return HTTPClient::readString(req, opt, p);
         }
         ReadResult fromFile( const std::string& uri, const osgDB::Options* opt ) {
@@ -527,6 +544,67 @@ namespace
         }
     };
 
+    // Entity tag stored with a cache record (header names are case-insensitive)
+    std::string getCachedETag(const Config& meta)
+    {
+        for (auto& child : meta.children())
+        {
+            if (ciEquals(child.key(), "etag"))
+                return child.value();
+        }
+        return std::string();
+    }
+
+    Threading::Mutex s_revalidateMutex("URI revalidate(OE)");
+    std::set<std::string> s_revalidating;
+
+    // Refreshes an expired cache record from its source in the background
+    // (stale-while-revalidate). A 304 only touches the record. Only one
+    // refresh per record runs at a time.
+    template<typename READ_FUNCTOR>
+    void revalidateInBackground(
+        const URI& uri,
+        const osgDB::Options* localOptions,
+        CacheBin* bin,
+        TimeStamp lastModified,
+        const std::string& etag)
+    {
+        std::string key = bin->getID() + "/" + uri.cacheKey();
+        {
+            ScopedMutexLock lock(s_revalidateMutex);
+            if (s_revalidating.insert(key).second == false)
+                return;
+        }
+
+        osg::ref_ptr<osgDB::Options> remoteOptions =
+            Registry::instance()->cloneOrCreateOptions(localOptions);
+        remoteOptions->getDatabasePathList().push_front(osgDB::getFilePath(uri.full()));
+
+        osg::ref_ptr<CacheBin> binRef(bin);
+
+        runInJobArena(
+            Registry::instance()->getJobArena("network"),
+            [uri, remoteOptions, binRef, lastModified, etag, key]()
+            {
+                READ_FUNCTOR reader;
+                ReadResult r = reader.fromHTTP(uri, remoteOptions.get(), 0L, lastModified, etag);
+
+                if (r.code() == ReadResult::RESULT_NOT_MODIFIED)
+                {
+                    OE_DEBUG << LC << uri.full() << " revalidated (not modified)" << std::endl;
+                    binRef->touch(uri.cacheKey());
+                }
+                else if (r.succeeded())
+                {
+                    OE_DEBUG << LC << uri.full() << " refreshed in the background" << std::endl;
+                    binRef->write(uri.cacheKey(), r.getObject(), r.metadata(), remoteOptions.get());
+                }
+
+                ScopedMutexLock lock(s_revalidateMutex);
+                s_revalidating.erase(key);
+            });
+    }
+
     //--------------------------------------------------------------------
     // MASTER read template function. I templatized this so we wouldn't
     // have 4 95%-identical code paths to maintain...
@@ -633,6 +711,7 @@ namespace
                     }
 
                     bool expired = false;
+                    std::string etag;
                     // first try to go to the cache if there is one:
                     if ( bin && cp->isCacheReadable() )
                     {
@@ -644,6 +723,23 @@ namespace
                         }
                     }
 
+                    if ( expired )
+                    {
+                        // so the server can answer "304 not modified":
+                        etag = getCachedETag(result.metadata());
+
+                        // stale-while-revalidate: use the expired record now
+                        // and refresh it for next time.
+                        if ( cp->staleWhileRevalidate() == true &&
+                             cp->isCacheWriteable() &&
+                             !cb )
+                        {
+                            revalidateInBackground<READ_FUNCTOR>(
+                                uri, localOptions.get(), bin.get(), result.lastModifiedTime(), etag);
+                            expired = false;
+                        }
+                    }
+
                     // If it's not cached, or it is cached but is expired then try to hit the server.
                     if ( result.empty() || expired )
                     {
@@ -672,7 +768,7 @@ namespace
                             // still no data, go to the source:
                             if ( (result.empty() || expired) && cp->usage() != CachePolicy::USAGE_CACHE_ONLY )
                             {
-                                ReadResult remoteResult = reader.fromHTTP( uri, remoteOptions.get(), progress, result.lastModifiedTime() );
+                                ReadResult remoteResult = reader.fromHTTP( uri, remoteOptions.get(), progress, result.lastModifiedTime(), etag );
                                 if (remoteResult.code() == ReadResult::RESULT_NOT_MODIFIED)
                                 {
                                     OE_DEBUG << LC << uri.full() << " not modified, using cached result" << std::endl;
@@ -20,6 +20,8 @@
 
 #include <osgEarth/GeometryCompiler>
 #include <osgEarth/TextSymbolizer>
+#include <osgEarth/TessellateOperator>
+#include <osgEarth/LineDrawable>
 
 #include <osgEarth/Registry>
 #include <osgEarth/CullingUtils>
@@ -41,6 +43,78 @@ REGISTER_OSGEARTH_LAYER(utm_graticule, UTMGraticule);
 
 //---------------------------------------------------------------------------
 
+namespace
+{
+    //! Tessellates the GZD edge lines (at the granularity the compiler
+    //! would use) and draws them in one LineDrawable, which is much faster
+    //! than compiling over a thousand tiles' worth of features.
+    osg::Node* createGZDLines(const FeatureList& features, const LineSymbol* line)
+    {
+        const SpatialReference* geo = features.front()->getSRS();
+        unsigned tessellation = line->tessellation().getOrUse(20u);
+
+        std::vector<osg::Vec3d> points;
+        for (FeatureList::const_iterator i = features.begin(); i != features.end(); ++i)
+        {
+            const Geometry* geom = i->get()->getGeometry();
+            const osg::Vec3d& p0 = geom->front();
+            const osg::Vec3d& p1 = geom->back();
+            unsigned parts = osg::maximum(tessellation, (unsigned)ceil((p1 - p0).length()));
+
+            std::vector<osg::Vec3d> part;
+            TessellateOperator::tessellateGeo(p0, p1, parts, i->get()->geoInterp().get(), part);
+            for (unsigned p = 0; p+1 < part.size(); ++p)
+            {
+                points.push_back(part[p]);
+                points.push_back(part[p+1]);
+            }
+        }
+
+        geo->transform(points, geo->getGeocentricSRS());
+
+        osg::BoundingBoxd box;
+        for (unsigned i = 0; i < points.size(); ++i)
+            box.expandBy(points[i]);
+        osg::Vec3d center = box.center();
+
+        LineDrawable* drawable = new LineDrawable(GL_LINES);
+
+        if (line->useGLLines() == true)
+            drawable->setUseGPU(false);
+
+        drawable->reserve(points.size());
+        for (unsigned i = 0; i < points.size(); ++i)
+            drawable->pushVertex(points[i] - center);
+
+        if (line->stroke().isSet())
+        {
+            if (line->stroke()->width().isSet())
+                drawable->setLineWidth(line->stroke()->width().get());
+
+            if (line->stroke()->stipplePattern().isSet())
+                drawable->setStipplePattern(line->stroke()->stipplePattern().get());
+
+            if (line->stroke()->stippleFactor().isSet())
+                drawable->setStippleFactor(line->stroke()->stippleFactor().get());
+
+            if (line->stroke()->smooth().isSet())
+                drawable->setLineSmooth(line->stroke()->smooth().get());
+        }
+
+        drawable->setColor(line->stroke()->color());
+        drawable->finish();
+
+        LineGroup* group = new LineGroup();
+        group->addChild(drawable);
+
+        osg::MatrixTransform* mt = new osg::MatrixTransform(osg::Matrixd::translate(center));
+        mt->addChild(group);
+        return mt;
+    }
+}
+
+//---------------------------------------------------------------------------
+
 void
 UTMGraticule::UTMData::rebuild(const Profile* profile)
 {
@@ -133,7 +207,13 @@ UTMGraticule::UTMData::buildGZDTile(const std::string& name, const GeoExtent& ex
         features.push_back( latFeature );
     }
 
-    osg::Node* geomNode = compiler.compile(features, lineStyle, context);
+    // Plain lines don't need the feature compiler; clamped ones do.
+    osg::Node* geomNode = 0L;
+    if (lineStyle.has<LineSymbol>() && !lineStyle.has<AltitudeSymbol>())
+        geomNode = createGZDLines(features, lineStyle.get<LineSymbol>());
+    else
+        geomNode = compiler.compile(features, lineStyle, context);
+
     if ( geomNode ) 
         group->addChild( geomNode );
 
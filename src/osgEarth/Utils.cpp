@@ -18,6 +18,9 @@
  */
 #include <osgEarth/Utils>
 #include <osgUtil/MeshOptimizers>
+#include <osg/TriangleIndexFunctor>
+#include <algorithm>
+#include <deque>
 
 using namespace osgEarth;
 using namespace osgEarth::Util;
@@ -375,6 +378,246 @@ VertexCacheOptimizer::apply(osg::Drawable& drawable)
 
 //-----------------------------------------------------------------------------
 
+#undef  LC
+#define LC "[MeshOptimizer] "
+
+namespace
+{
+    struct CollectTriangles
+    {
+        std::vector<unsigned>* _out;
+        void operator()(unsigned i1, unsigned i2, unsigned i3) {
+            _out->push_back(i1); _out->push_back(i2); _out->push_back(i3);
+        }
+    };
+
+    void collectTriangles(osg::Geometry* geom, std::vector<unsigned>& out)
+    {
+        osg::TriangleIndexFunctor<CollectTriangles> f;
+        f._out = &out;
+        geom->accept(f);
+    }
+
+    bool isSurface(osg::Geometry* geom)
+    {
+        const osg::Geometry::PrimitiveSetList& psets = geom->getPrimitiveSetList();
+        if (psets.empty())
+            return false;
+
+        for (unsigned i = 0; i < psets.size(); ++i)
+        {
+            switch (psets[i]->getMode())
+            {
+            case GL_TRIANGLES:
+            case GL_TRIANGLE_FAN:
+            case GL_TRIANGLE_STRIP:
+            case GL_QUADS:
+            case GL_QUAD_STRIP:
+            case GL_POLYGON:
+                break;
+            default:
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Splits the triangle list into clusters wherever the vertex cache
+    // starts over (a triangle with no cached vertices), then orders the
+    // clusters so the ones facing away from the mesh center draw first.
+    // Those tend to occlude the rest, so later fragments fail the depth
+    // test. Since the splits fall where the cache is cold anyway, the
+    // reordering costs little vertex reuse.
+    void optimizeOverdraw(const osg::Vec3Array& verts, std::vector<unsigned>& tris)
+    {
+        const unsigned cacheSize = 16u;
+        unsigned numTris = tris.size() / 3;
+        if (numTris < 2)
+            return;
+
+        struct Cluster {
+            unsigned start, count;
+            float key;
+        };
+        std::vector<Cluster> clusters;
+        std::deque<unsigned> cache;
+
+        osg::Vec3d meshCenter;
+        double meshArea = 0.0;
+
+        for (unsigned t = 0; t < numTris; ++t)
+        {
+            unsigned misses = 0;
+            for (unsigned k = 0; k < 3; ++k)
+            {
+                unsigned v = tris[3*t+k];
+                if (std::find(cache.begin(), cache.end(), v) == cache.end())
+                {
+                    ++misses;
+                    cache.push_back(v);
+                    if (cache.size() > cacheSize)
+                        cache.pop_front();
+                }
+            }
+
+            if (clusters.empty() || misses == 3u)
+            {
+                Cluster c = { t, 0u, 0.0f };
+                clusters.push_back(c);
+            }
+            clusters.back().count++;
+
+            const osg::Vec3& a = verts[tris[3*t]];
+            const osg::Vec3& b = verts[tris[3*t+1]];
+            const osg::Vec3& c = verts[tris[3*t+2]];
+            double area = ((b-a)^(c-a)).length() * 0.5;
+            meshCenter += osg::Vec3d((a+b+c)/3.0f) * area;
+            meshArea += area;
+        }
+
+        if (clusters.size() < 2u || meshArea <= 0.0)
+            return;
+
+        meshCenter /= meshArea;
+
+        for (auto& cluster : clusters)
+        {
+            osg::Vec3d center, normal;
+            double area = 0.0;
+            for (unsigned t = cluster.start; t < cluster.start + cluster.count; ++t)
+            {
+                const osg::Vec3& a = verts[tris[3*t]];
+                const osg::Vec3& b = verts[tris[3*t+1]];
+                const osg::Vec3& c = verts[tris[3*t+2]];
+                osg::Vec3d n = (b-a)^(c-a); // length = 2x area
+                center += osg::Vec3d((a+b+c)/3.0f) * n.length();
+                normal += n;
+                area += n.length();
+            }
+            if (area > 0.0)
+                center /= area;
+            normal.normalize();
+            cluster.key = (float)((center - meshCenter) * normal);
+        }
+
+        std::stable_sort(clusters.begin(), clusters.end(),
+            [](const Cluster& lhs, const Cluster& rhs) { return lhs.key > rhs.key; });
+
+        std::vector<unsigned> sorted;
+        sorted.reserve(tris.size());
+        for (const auto& cluster : clusters)
+            sorted.insert(sorted.end(), tris.begin() + 3*cluster.start, tris.begin() + 3*(cluster.start + cluster.count));
+        tris.swap(sorted);
+    }
+
+    osg::DrawElements* makeElements(const std::vector<unsigned>& tris, unsigned numVerts)
+    {
+        if (numVerts <= 0xFFu)
+        {
+            osg::DrawElementsUByte* de = new osg::DrawElementsUByte(GL_TRIANGLES);
+            de->reserve(tris.size());
+            for (unsigned i : tris) de->push_back((GLubyte)i);
+            return de;
+        }
+        else if (numVerts <= 0xFFFFu)
+        {
+            osg::DrawElementsUShort* de = new osg::DrawElementsUShort(GL_TRIANGLES);
+            de->reserve(tris.size());
+            for (unsigned i : tris) de->push_back((GLushort)i);
+            return de;
+        }
+        else
+        {
+            osg::DrawElementsUInt* de = new osg::DrawElementsUInt(GL_TRIANGLES);
+            de->reserve(tris.size());
+            for (unsigned i : tris) de->push_back(i);
+            return de;
+        }
+    }
+}
+
+MeshOptimizer::MeshOptimizer() :
+osg::NodeVisitor( TRAVERSE_ALL_CHILDREN ),
+_triangles( 0u ),
+_missesBefore( 0u ),
+_missesAfter( 0u )
+{
+    //nop
+}
+
+unsigned
+MeshOptimizer::computeCacheMisses(const std::vector<unsigned>& tris, unsigned cacheSize)
+{
+    std::deque<unsigned> cache;
+    unsigned misses = 0u;
+    for (unsigned v : tris)
+    {
+        if (std::find(cache.begin(), cache.end(), v) == cache.end())
+        {
+            ++misses;
+            cache.push_back(v);
+            if (cache.size() > cacheSize)
+                cache.pop_front();
+        }
+    }
+    return misses;
+}
+
+void
+MeshOptimizer::apply(osg::Drawable& drawable)
+{
+    osg::Geometry* geom = drawable.asGeometry();
+
+    if (geom == 0L ||
+        geom->getDataVariance() == osg::Object::DYNAMIC ||
+        !isSurface(geom))
+    {
+        traverse(drawable);
+        return;
+    }
+
+    osg::Vec3Array* verts = dynamic_cast<osg::Vec3Array*>(geom->getVertexArray());
+    if (verts == 0L || verts->empty())
+    {
+        traverse(drawable);
+        return;
+    }
+
+    std::vector<unsigned> tris;
+    collectTriangles(geom, tris);
+    if (tris.empty())
+    {
+        traverse(drawable);
+        return;
+    }
+
+    _triangles += tris.size() / 3;
+    _missesBefore += computeCacheMisses(tris);
+
+    // vertex cache order
+    osgUtil::VertexCacheVisitor vcv;
+    vcv.optimizeVertices(*geom);
+
+    // overdraw order, written back as a single list with compact indices
+    tris.clear();
+    collectTriangles(geom, tris);
+    optimizeOverdraw(*verts, tris);
+    geom->removePrimitiveSet(0, geom->getNumPrimitiveSets());
+    geom->addPrimitiveSet(makeElements(tris, verts->size()));
+
+    // vertex fetch order (renumbers the vertices by first use)
+    osgUtil::VertexAccessOrderVisitor vaov;
+    vaov.optimizeOrder(*geom);
+
+    tris.clear();
+    collectTriangles(geom, tris);
+    _missesAfter += computeCacheMisses(tris);
+
+    traverse(drawable);
+}
+
+//-----------------------------------------------------------------------------
+
 #undef  LC
 #define LC "[SetDataVarianceVisitor] "
 
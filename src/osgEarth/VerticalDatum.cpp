@@ -20,6 +20,8 @@
 #include <osgEarth/VerticalDatum>
 #include <osgEarth/Threading>
 #include <osgEarth/GeoData>
+#include <osgEarth/TileKey>
+#include <osgEarth/Containers>
 
 #include <osgDB/ReadFile>
 
@@ -125,6 +127,99 @@ VerticalDatum::transform(const VerticalDatum* from,
     return ok;
 }
 
+namespace
+{
+    // Geoid heights at the posts of a heightfield, row-major
+    struct GeoidGrid : public osg::Referenced
+    {
+        std::vector<float> _heights;
+    };
+
+    struct GeoidGridKey
+    {
+        const Geoid* _geoid;
+        TileKey      _key;
+        unsigned     _cols, _rows;
+
+        bool operator < (const GeoidGridKey& rhs) const {
+            if (_geoid != rhs._geoid) return _geoid < rhs._geoid;
+            if (_cols != rhs._cols) return _cols < rhs._cols;
+            if (_rows != rhs._rows) return _rows < rhs._rows;
+            return _key < rhs._key;
+        }
+    };
+
+    typedef LRUCache<GeoidGridKey, osg::ref_ptr<GeoidGrid> > GeoidGridCache;
+    GeoidGridCache _geoidGrids(true, 32u);
+
+    // Geodetic location of the southwest post and the post spacing
+    void getPostLayout(const GeoExtent& extent, unsigned cols, unsigned rows,
+                       double& west, double& south, double& xstep, double& ystep)
+    {
+        osg::Vec3d sw(extent.west(), extent.south(), 0.0);
+        osg::Vec3d ne(extent.east(), extent.north(), 0.0);
+
+        xstep = std::abs(extent.east() - extent.west()) / double(cols-1);
+        ystep = std::abs(extent.north() - extent.south()) / double(rows-1);
+
+        if ( !extent.getSRS()->isGeographic() )
+        {
+            const SpatialReference* geoSRS = extent.getSRS()->getGeographicSRS();
+            extent.getSRS()->transform(sw, geoSRS, sw);
+            extent.getSRS()->transform(ne, geoSRS, ne);
+            xstep = (ne.x()-sw.x()) / double(cols-1);
+            ystep = (ne.y()-sw.y()) / double(rows-1);
+        }
+
+        west = sw.x();
+        south = sw.y();
+    }
+
+    GeoidGrid* createGeoidGrid(const Geoid* geoid, const GeoExtent& extent, unsigned cols, unsigned rows)
+    {
+        double west, south, xstep, ystep;
+        getPostLayout(extent, cols, rows, west, south, xstep, ystep);
+
+        GeoidGrid* grid = new GeoidGrid();
+        grid->_heights.resize(cols*rows);
+        geoid->getHeights(west, south, xstep, ystep, cols, rows, &grid->_heights[0], INTERP_BILINEAR);
+        return grid;
+    }
+
+    // Same arithmetic as the single-point transform (msl2hae, unit
+    // conversion, hae2msl) with the geoid heights read from the grids.
+    void applyGeoidGrids(const VerticalDatum* from,
+                         const VerticalDatum* to,
+                         const GeoidGrid*     fromGrid,
+                         const GeoidGrid*     toGrid,
+                         osg::HeightField*    hf)
+    {
+        Units fromUnits = from ? from->getUnits() : Units::METERS;
+        Units toUnits = to ? to->getUnits() : Units::METERS;
+
+        unsigned cols = hf->getNumColumns();
+        unsigned rows = hf->getNumRows();
+
+        for( unsigned r=0; r<rows; ++r)
+        {
+            for( unsigned c=0; c<cols; ++c)
+            {
+                float& h = hf->getHeight(c, r);
+                if (h != NO_DATA_VALUE)
+                {
+                    double z(h);
+                    if (fromGrid)
+                        z = z + fromGrid->_heights[r*cols + c];
+                    z = fromUnits.convertTo(toUnits, z);
+                    if (toGrid)
+                        z = z - toGrid->_heights[r*cols + c];
+                    h = float(z);
+                }
+            }
+        }
+    }
+}
+
 bool
 VerticalDatum::transform(const VerticalDatum* from,
                          const VerticalDatum* to,
@@ -136,36 +231,58 @@ VerticalDatum::transform(const VerticalDatum* from,
 
     unsigned cols = hf->getNumColumns();
     unsigned rows = hf->getNumRows();
-    
-    osg::Vec3d sw(extent.west(), extent.south(), 0.0);
-    osg::Vec3d ne(extent.east(), extent.north(), 0.0);
-    
-    double xstep = std::abs(extent.east() - extent.west()) / double(cols-1);
-    double ystep = std::abs(extent.north() - extent.south()) / double(rows-1);
 
-    if ( !extent.getSRS()->isGeographic() )
-    {
-        const SpatialReference* geoSRS = extent.getSRS()->getGeographicSRS();
-        extent.getSRS()->transform(sw, geoSRS, sw);
-        extent.getSRS()->transform(ne, geoSRS, ne);
-        xstep = (ne.x()-sw.x()) / double(cols-1);
-        ystep = (ne.y()-sw.y()) / double(rows-1);
-    }
+    osg::ref_ptr<GeoidGrid> fromGrid, toGrid;
+    if ( from && from->getGeoid() )
+        fromGrid = createGeoidGrid(from->getGeoid(), extent, cols, rows);
+    if ( to && to->getGeoid() )
+        toGrid = createGeoidGrid(to->getGeoid(), extent, cols, rows);
+
+    applyGeoidGrids(from, to, fromGrid.get(), toGrid.get(), hf);
+
+    return true;
+}
+
+bool
+VerticalDatum::transform(const VerticalDatum* from,
+                         const VerticalDatum* to,
+                         const TileKey&       key,
+                         osg::HeightField*    hf )
+{
+    if ( from == to )
+        return true;
+
+    unsigned cols = hf->getNumColumns();
+    unsigned rows = hf->getNumRows();
 
-    for( unsigned c=0; c<cols; ++c)
+    const VerticalDatum* datums[2] = { from, to };
+    osg::ref_ptr<GeoidGrid> grids[2];
+
+    for(unsigned i=0; i<2; ++i)
     {
-        double lon = sw.x() + xstep*double(c);
-        for( unsigned r=0; r<rows; ++r)
+        if ( !datums[i] || !datums[i]->getGeoid() )
+            continue;
+
+        GeoidGridKey gridKey;
+        gridKey._geoid = datums[i]->getGeoid();
+        gridKey._key = key;
+        gridKey._cols = cols;
+        gridKey._rows = rows;
+
+        GeoidGridCache::Record record;
+        if ( _geoidGrids.get(gridKey, record) )
         {
-            double lat = sw.y() + ystep*double(r);
-            float& h = hf->getHeight(c, r);
-            if (h != NO_DATA_VALUE)
-            {
-                VerticalDatum::transform( from, to, lat, lon, h );
-            }
+            grids[i] = record.value();
+        }
+        else
+        {
+            grids[i] = createGeoidGrid(gridKey._geoid, key.getExtent(), cols, rows);
+            _geoidGrids.insert(gridKey, grids[i]);
         }
     }
 
+    applyGeoidGrids(from, to, grids[0].get(), grids[1].get(), hf);
+
     return true;
 }
 
@@ -0,0 +1,505 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+ * Copyright 2020 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarth/ViewshedLayer>
+#include <osgEarth/LineOfSightEngine>
+#include <osgEarth/ElevationPool>
+#include <osgEarth/Map>
+#include <osgEarth/MapNode>
+#include <osgEarth/TerrainEngineNode>
+#include <osgEarth/NodeUtils>
+#include <osgEarth/CullingUtils>
+#include <osgEarth/VirtualProgram>
+#include <osg/Camera>
+#include <osgUtil/CullVisitor>
+#include <cfloat>
+
+#define LC "[ViewshedLayer] " << getName() << ": "
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+REGISTER_OSGEARTH_LAYER(viewshed, ViewshedLayer);
+
+namespace
+{
+    // Capture pass: writes each terrain fragment's distance from the
+    // observer (the capture camera's eye) to the cube map face.
+    const char* captureVS =
+        "#version " GLSL_VERSION_STR "\n"
+        "out vec3 oe_viewshed_capture_view; \n"
+        "void oe_viewshed_capture_vertex(inout vec4 vertex) \n"
+        "{ \n"
+        "    oe_viewshed_capture_view = vertex.xyz/vertex.w; \n"
+        "} \n";
+
+    const char* captureFS =
+        "#version " GLSL_VERSION_STR "\n"
+        "in vec3 oe_viewshed_capture_view; \n"
+        "layout(location=0) out vec4 oe_viewshed_distance; \n"
+        "void oe_viewshed_capture_output(inout vec4 color) \n"
+        "{ \n"
+        "    oe_viewshed_distance = vec4(length(oe_viewshed_capture_view)); \n"
+        "} \n";
+
+    // Terrain pass: compares each fragment's distance from the observer
+    // with the nearest captured distance in the same direction.
+    const char* shadeVS =
+        "#version " GLSL_VERSION_STR "\n"
+        "uniform vec3 oe_viewshed_observer_view; \n"
+        "uniform mat4 osg_ViewMatrixInverse; \n"
+        "out vec3 oe_viewshed_dir; \n"
+        "void oe_viewshed_vertex(inout vec4 vertex) \n"
+        "{ \n"
+        "    oe_viewshed_dir = mat3(osg_ViewMatrixInverse) * (vertex.xyz/vertex.w - oe_viewshed_observer_view); \n"
+        "} \n";
+
+    const char* shadeFS =
+        "#version " GLSL_VERSION_STR "\n"
+        "in vec3 oe_viewshed_dir; \n"
+        "uniform samplerCube oe_viewshed_map; \n"
+        "uniform float oe_viewshed_radius; \n"
+        "uniform float oe_viewshed_bias; \n"
+        "uniform vec4 oe_viewshed_visible_color; \n"
+        "uniform vec4 oe_viewshed_hidden_color; \n"
+        "uniform bool oe_viewshed_capture; \n"
+        "void oe_viewshed_fragment(inout vec4 color) \n"
+        "{ \n"
+        "    if (oe_viewshed_capture) \n"
+        "        return; \n"
+        "    float d = length(oe_viewshed_dir); \n"
+        "    if (d > oe_viewshed_radius) \n"
+        "        discard; \n"
+        "    float nearest = texture(oe_viewshed_map, oe_viewshed_dir).r; \n"
+        "    bool visible = d <= nearest*(1.0 + oe_viewshed_bias) + 1.0; \n"
+        "    color = visible ? oe_viewshed_visible_color : oe_viewshed_hidden_color; \n"
+        "} \n";
+
+    // Look vectors and up vectors of the six cube map faces, in
+    // osg::TextureCubeMap::Face order.
+    const osg::Vec3d faceLook[6] = {
+        osg::Vec3d( 1, 0, 0), osg::Vec3d(-1, 0, 0),
+        osg::Vec3d( 0, 1, 0), osg::Vec3d( 0,-1, 0),
+        osg::Vec3d( 0, 0, 1), osg::Vec3d( 0, 0,-1) };
+
+    const osg::Vec3d faceUp[6] = {
+        osg::Vec3d( 0,-1, 0), osg::Vec3d( 0,-1, 0),
+        osg::Vec3d( 0, 0, 1), osg::Vec3d( 0, 0,-1),
+        osg::Vec3d( 0,-1, 0), osg::Vec3d( 0,-1, 0) };
+
+    // Cull-only stand-in for the terrain under the capture cameras, so
+    // the terrain is not also updated once per camera.
+    struct TerrainProxy : public osg::Node
+    {
+        TerrainProxy()
+        {
+            setCullingActive(false);
+        }
+
+        void traverse(osg::NodeVisitor& nv)
+        {
+            osg::ref_ptr<osg::Node> terrain;
+            if (nv.getVisitorType() == nv.CULL_VISITOR && _terrain.lock(terrain))
+            {
+                terrain->accept(nv);
+            }
+        }
+
+        osg::observer_ptr<osg::Node> _terrain;
+    };
+}
+
+//........................................................................
+
+// Finds the terrain during the update traversal and aims the capture
+// cameras at the observer's current location during cull.
+class ViewshedLayer::CaptureNode : public osg::Group
+{
+public:
+    CaptureNode(ViewshedLayer* layer) : _layer(layer)
+    {
+        _proxy = new TerrainProxy();
+        setCullingActive(false);
+        ADJUST_UPDATE_TRAV_COUNT(this, +1);
+    }
+
+    void addFace(osg::Camera* camera)
+    {
+        camera->addChild(_proxy.get());
+        addChild(camera);
+    }
+
+    void traverse(osg::NodeVisitor& nv)
+    {
+        if (nv.getVisitorType() == nv.UPDATE_VISITOR)
+        {
+            if (!_proxy->_terrain.valid())
+            {
+                MapNode* mapNode = findInNodePath<MapNode>(nv);
+                if (mapNode)
+                    _proxy->_terrain = mapNode->getTerrainEngine();
+            }
+        }
+
+        else if (nv.getVisitorType() == nv.CULL_VISITOR)
+        {
+            osg::ref_ptr<ViewshedLayer> layer;
+            if (!_proxy->_terrain.valid() || !_layer.lock(layer) || !layer->isOpen())
+                return;
+
+            const osg::Vec3d& eye = layer->_observerWorld;
+            double range = layer->options().radius()->as(Units::METERS);
+
+            for (unsigned i = 0; i < getNumChildren(); ++i)
+            {
+                osg::Camera* camera = static_cast<osg::Camera*>(getChild(i));
+                camera->setViewMatrixAsLookAt(eye, eye + faceLook[i], faceUp[i]);
+                camera->setProjectionMatrixAsPerspective(90.0, 1.0, 1.0, range);
+            }
+        }
+
+        osg::Group::traverse(nv);
+    }
+
+    osg::observer_ptr<ViewshedLayer> _layer;
+    osg::ref_ptr<TerrainProxy> _proxy;
+};
+
+//........................................................................
+
+Config
+ViewshedLayer::Options::getMetadata()
+{
+    return Config::readJSON(OE_MULTILINE(
+        { "name" : "Viewshed",
+          "properties" : [
+            { "name": "observer", "description" : "Location of the observer", "type" : "GeoPoint", "default" : "" },
+            { "name": "radius", "description" : "Maximum range of visibility", "type" : "Distance", "default" : "5km" },
+            { "name": "visible_color", "description" : "Color of visible terrain", "type" : "Color", "default" : "#00FF007F" },
+            { "name": "hidden_color", "description" : "Color of hidden terrain", "type" : "Color", "default" : "#FF00007F" },
+            { "name": "texture_size", "description" : "Size of each cube map face", "type" : "unsigned", "default" : "1024" },
+          ]
+        }
+    ));
+}
+
+Config
+ViewshedLayer::Options::getConfig() const
+{
+    Config conf = VisibleLayer::Options::getConfig();
+    conf.set("observer", _observer);
+    conf.set("radius", _radius);
+    conf.set("visible_color", _visibleColor);
+    conf.set("hidden_color", _hiddenColor);
+    conf.set("texture_size", _textureSize);
+    return conf;
+}
+
+void
+ViewshedLayer::Options::fromConfig(const Config& conf)
+{
+    _radius.init(Distance(5.0, Units::KILOMETERS));
+    _visibleColor.init(Color(0.0f, 1.0f, 0.0f, 0.5f));
+    _hiddenColor.init(Color(1.0f, 0.0f, 0.0f, 0.5f));
+    _textureSize.init(1024u);
+
+    conf.get("observer", _observer);
+    conf.get("radius", _radius);
+    conf.get("visible_color", _visibleColor);
+    conf.get("hidden_color", _hiddenColor);
+    conf.get("texture_size", _textureSize);
+}
+
+//........................................................................
+
+OE_LAYER_PROPERTY_IMPL(ViewshedLayer, unsigned, TextureSize, textureSize);
+
+void
+ViewshedLayer::setObserver(const GeoPoint& value)
+{
+    options().observer() = value;
+    updateObserver();
+}
+
+const GeoPoint&
+ViewshedLayer::getObserver() const
+{
+    return options().observer().get();
+}
+
+void
+ViewshedLayer::setRadius(const Distance& value)
+{
+    options().radius() = value;
+    _radiusUniform->set((float)value.as(Units::METERS));
+}
+
+const Distance&
+ViewshedLayer::getRadius() const
+{
+    return options().radius().get();
+}
+
+void
+ViewshedLayer::setVisibleColor(const Color& value)
+{
+    options().visibleColor() = value;
+    _visibleColorUniform->set(value);
+}
+
+const Color&
+ViewshedLayer::getVisibleColor() const
+{
+    return options().visibleColor().get();
+}
+
+void
+ViewshedLayer::setHiddenColor(const Color& value)
+{
+    options().hiddenColor() = value;
+    _hiddenColorUniform->set(value);
+}
+
+const Color&
+ViewshedLayer::getHiddenColor() const
+{
+    return options().hiddenColor().get();
+}
+
+void
+ViewshedLayer::init()
+{
+    VisibleLayer::init();
+
+    setRenderType(RENDERTYPE_TERRAIN_SURFACE);
+
+    _observerWorld.set(0.0, 0.0, 0.0);
+
+    osg::StateSet* stateset = getOrCreateStateSet();
+
+    _distanceSampler = new osg::Uniform(osg::Uniform::SAMPLER_CUBE, "oe_viewshed_map");
+    stateset->addUniform(_distanceSampler.get());
+
+    _radiusUniform = new osg::Uniform("oe_viewshed_radius", (float)getRadius().as(Units::METERS));
+    stateset->addUniform(_radiusUniform.get());
+
+    _visibleColorUniform = new osg::Uniform("oe_viewshed_visible_color", osg::Vec4f(getVisibleColor()));
+    stateset->addUniform(_visibleColorUniform.get());
+
+    _hiddenColorUniform = new osg::Uniform("oe_viewshed_hidden_color", osg::Vec4f(getHiddenColor()));
+    stateset->addUniform(_hiddenColorUniform.get());
+
+    // A cube map texel covers about (pi/2)/size radians, so allow a
+    // fragment to be that much farther than the captured distance.
+    unsigned size = osg::maximum(getTextureSize(), 16u);
+    stateset->addUniform(new osg::Uniform("oe_viewshed_bias", 2.0f/(float)size));
+    stateset->addUniform(new osg::Uniform("oe_viewshed_capture", false));
+
+    VirtualProgram* vp = VirtualProgram::getOrCreate(stateset);
+    vp->setName("Viewshed");
+    vp->setFunction("oe_viewshed_vertex", shadeVS, ShaderComp::LOCATION_VERTEX_VIEW);
+    vp->setFunction("oe_viewshed_fragment", shadeFS, ShaderComp::LOCATION_FRAGMENT_COLORING, 0.5f);
+
+    // Distance from the observer, one float per texel. Empty texels
+    // are infinitely far away, i.e. visible.
+    _distanceMap = new osg::TextureCubeMap();
+    _distanceMap->setTextureSize(size, size);
+    _distanceMap->setInternalFormat(GL_R32F);
+    _distanceMap->setSourceFormat(GL_RED);
+    _distanceMap->setSourceType(GL_FLOAT);
+    _distanceMap->setFilter(osg::Texture::MIN_FILTER, osg::Texture::NEAREST);
+    _distanceMap->setFilter(osg::Texture::MAG_FILTER, osg::Texture::NEAREST);
+    _distanceMap->setWrap(osg::Texture::WRAP_S, osg::Texture::CLAMP_TO_EDGE);
+    _distanceMap->setWrap(osg::Texture::WRAP_T, osg::Texture::CLAMP_TO_EDGE);
+    _distanceMap->setWrap(osg::Texture::WRAP_R, osg::Texture::CLAMP_TO_EDGE);
+
+    // Bound in place of the distance map while capturing, so the
+    // capture never samples the texture it's rendering into.
+    _emptyMap = new osg::TextureCubeMap();
+    _emptyMap->setTextureSize(1, 1);
+    _emptyMap->setInternalFormat(GL_R32F);
+    _emptyMap->setSourceFormat(GL_RED);
+    _emptyMap->setSourceType(GL_FLOAT);
+
+    CaptureNode* node = new CaptureNode(this);
+    _node = node;
+
+    for (unsigned face = 0; face < 6; ++face)
+    {
+        osg::Camera* camera = new osg::Camera();
+        camera->setName("Viewshed face");
+        camera->setRenderOrder(osg::Camera::PRE_RENDER);
+        camera->setRenderTargetImplementation(osg::Camera::FRAME_BUFFER_OBJECT);
+        camera->setReferenceFrame(osg::Camera::ABSOLUTE_RF);
+        camera->setComputeNearFarMode(osg::CullSettings::DO_NOT_COMPUTE_NEAR_FAR);
+        camera->setViewport(0, 0, size, size);
+        camera->setClearColor(osg::Vec4(FLT_MAX, FLT_MAX, FLT_MAX, FLT_MAX));
+        camera->setClearMask(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        camera->attach(osg::Camera::COLOR_BUFFER0, _distanceMap.get(), 0u, face);
+        camera->attach(osg::Camera::DEPTH_BUFFER, GL_DEPTH_COMPONENT24);
+
+        osg::StateSet* ss = camera->getOrCreateStateSet();
+        ss->setMode(GL_BLEND, osg::StateAttribute::OFF | osg::StateAttribute::OVERRIDE);
+        ss->setMode(GL_CULL_FACE, osg::StateAttribute::OFF | osg::StateAttribute::OVERRIDE);
+        ss->addUniform(
+            new osg::Uniform("oe_viewshed_capture", true),
+            osg::StateAttribute::ON | osg::StateAttribute::OVERRIDE);
+
+        VirtualProgram* cvp = VirtualProgram::getOrCreate(ss);
+        cvp->setName("Viewshed capture");
+        cvp->setFunction("oe_viewshed_capture_vertex", captureVS, ShaderComp::LOCATION_VERTEX_VIEW);
+        cvp->setFunction("oe_viewshed_capture_output", captureFS, ShaderComp::LOCATION_FRAGMENT_OUTPUT);
+
+        node->addFace(camera);
+    }
+
+    // activate opacity support
+    installDefaultOpacityShader();
+}
+
+Status
+ViewshedLayer::openImplementation()
+{
+    Status parent = VisibleLayer::openImplementation();
+    if (parent.isError())
+        return parent;
+
+    if (!options().observer().isSet() || !options().observer()->isValid())
+    {
+        return Status(Status::ConfigurationError, "Missing required observer");
+    }
+
+    updateObserver();
+
+    return Status::NoError;
+}
+
+osg::Node*
+ViewshedLayer::getNode() const
+{
+    return _node.get();
+}
+
+void
+ViewshedLayer::addedToMap(const Map* map)
+{
+    VisibleLayer::addedToMap(map);
+    _map = map;
+    updateObserver();
+}
+
+void
+ViewshedLayer::removedFromMap(const Map* map)
+{
+    VisibleLayer::removedFromMap(map);
+    _map = 0L;
+}
+
+void
+ViewshedLayer::setTerrainResources(TerrainResources* res)
+{
+    if (!res->reserveTextureImageUnitForLayer(_reservation, this, "Viewshed"))
+    {
+        setStatus(Status::ResourceUnavailable, "No texture image units available");
+        return;
+    }
+
+    getOrCreateStateSet()->setTextureAttribute(_reservation.unit(), _distanceMap.get());
+    _distanceSampler->set(_reservation.unit());
+
+    for (unsigned i = 0; i < _node->getNumChildren(); ++i)
+    {
+        _node->getChild(i)->getOrCreateStateSet()->setTextureAttribute(
+            _reservation.unit(), _emptyMap.get(), osg::StateAttribute::OVERRIDE);
+    }
+}
+
+osg::StateSet*
+ViewshedLayer::getSharedStateSet(osg::NodeVisitor* nv) const
+{
+    if (!isOpen() || !getVisible())
+        return NULL;
+
+    osgUtil::CullVisitor* cv = Culling::asCullVisitor(nv);
+    if (!cv)
+        return NULL;
+
+    CameraState& cs = _cameraStates.get(cv->getCurrentCamera());
+    if (!cs._stateSet.valid())
+    {
+        cs._stateSet = new osg::StateSet();
+        cs._observerView = new osg::Uniform(osg::Uniform::FLOAT_VEC3, "oe_viewshed_observer_view");
+        cs._stateSet->addUniform(cs._observerView.get());
+    }
+
+    // Transform in double precision here; the observer is far from the
+    // world origin and a float would jitter.
+    cs._observerView->set(osg::Vec3f(_observerWorld * (*cv->getModelViewMatrix())));
+
+    return cs._stateSet.get();
+}
+
+void
+ViewshedLayer::updateObserver()
+{
+    GeoPoint observer = getObserver();
+    if (!observer.isValid())
+        return;
+
+    osg::ref_ptr<const Map> map;
+    if (_map.lock(map))
+    {
+        observer = observer.transform(map->getSRS());
+
+        if (observer.altitudeMode() == ALTMODE_RELATIVE)
+        {
+            std::vector<osg::Vec3d> points(1, observer.vec3d());
+            points[0].z() = 0.0;
+
+            Distance resolution(
+                getRadius().as(Units::METERS) / (double)getTextureSize(),
+                Units::METERS);
+
+            ElevationPool::WorkingSet ws;
+            if (map->getElevationPool()->sampleMapCoords(points, resolution, &ws, 0L) > 0 &&
+                points[0].z() != NO_DATA_VALUE)
+            {
+                observer.z() += points[0].z();
+            }
+            observer.altitudeMode() = ALTMODE_ABSOLUTE;
+        }
+    }
+
+    observer.toWorld(_observerWorld);
+}
+
+GeoImage
+ViewshedLayer::exportViewshed(const Distance& resolution, ProgressCallback* progress) const
+{
+    osg::ref_ptr<const Map> map;
+    if (!_map.lock(map))
+        return GeoImage::INVALID;
+
+    LineOfSightEngine engine(map.get());
+    engine.setResolution(resolution);
+    return engine.computeViewshed(
+        getObserver(),
+        getRadius(),
+        Distance(0.0, Units::METERS),
+        progress);
+}
@@ -26,7 +26,9 @@
 #include <osgEarth/StringUtils>
 #include <osgEarth/Containers>
 #include <osgEarth/Metrics>
+#include <osgEarth/Counters>
 #include <osgEarth/Cache>
+#include <osgEarth/Config>
 #include <osg/Shader>
 #include <osg/Program>
 #include <osg/State>
@@ -34,12 +36,20 @@
 #include <osg/Version>
 #include <osg/GL2Extensions>
 #include <osg/GLExtensions>
+#include <osg/GLObjects>
+#include <osg/GraphicsContext>
+#include <osg/Timer>
 #include <osgDB/FileUtils>
 #include <osgDB/FileNameUtils>
 #include <OpenThreads/Thread>
 #include <fstream>
 #include <sstream>
 #include <stdlib.h> // getenv
+#include <cstring>
+#include <cstdio>
+#include <deque>
+#include <thread>
+#include <chrono>
 
 using namespace osgEarth;
 using namespace osgEarth::ShaderComp;
@@ -118,13 +128,420 @@ namespace
 #undef  LC
 #define LC "[ProgramRepo] "
 
+namespace
+{
+    const Util::Counter s_programsCreated("shaders.programs.created");
+    const Util::Histogram s_linkTime("shaders.link_ms");
+
+    // Program binary cache file layout: a small header that lets us reject
+    // truncated files or binaries from another GPU/driver, then the blob.
+    const char     PROGRAM_BINARY_MAGIC[4] = { 'O', 'E', 'P', 'B' };
+    const unsigned PROGRAM_BINARY_VERSION = 1;
+
+    struct ProgramBinaryHeader
+    {
+        char     magic[4];
+        unsigned version;
+        unsigned identity;
+        GLenum   format;
+        unsigned size;
+    };
+
+    // Hash of everything that goes into the linked program: the final
+    // shader sources, their types, the defines and the attribute bindings.
+    unsigned hashProgramSource(const osg::Program* program, const std::string& defineStr)
+    {
+        std::stringstream buf;
+        for (unsigned i = 0; i < program->getNumShaders(); ++i)
+        {
+            const osg::Shader* shader = program->getShader(i);
+            buf << shader->getType() << "\n" << shader->getShaderSource() << "\n";
+        }
+        buf << defineStr << "\n";
+
+        const osg::Program::AttribBindingList& bindings = program->getAttribBindingList();
+        for (osg::Program::AttribBindingList::const_iterator i = bindings.begin(); i != bindings.end(); ++i)
+            buf << i->first << "=" << i->second << "\n";
+
+        return osgEarth::hashString(buf.str());
+    }
+
+    osg::Program::ProgramBinary* readProgramBinary(const std::string& filename, unsigned identity)
+    {
+        std::ifstream fin(filename.c_str(), std::ios::in | std::ios::binary);
+        if (!fin.is_open())
+            return 0L;
+
+        ProgramBinaryHeader header;
+        if (!fin.read((char*)&header, sizeof(header)) ||
+            ::memcmp(header.magic, PROGRAM_BINARY_MAGIC, 4) != 0 ||
+            header.version != PROGRAM_BINARY_VERSION ||
+            header.identity != identity ||
+            header.size == 0)
+        {
+            return 0L;
+        }
+
+        std::vector<unsigned char> buffer(header.size);
+        if (!fin.read((char*)&buffer[0], header.size))
+            return 0L;
+
+        osg::Program::ProgramBinary* binary = new osg::Program::ProgramBinary();
+        binary->setFormat(header.format);
+        binary->assign(header.size, &buffer[0]);
+        return binary;
+    }
+
+    // Binaries are only portable to the same GPU and driver, so they
+    // are keyed on the strings that identify both. Needs a current context.
+    unsigned computeGLIdentity()
+    {
+        std::stringstream buf;
+        const GLubyte* vendor = glGetString(GL_VENDOR);
+        const GLubyte* renderer = glGetString(GL_RENDERER);
+        const GLubyte* version = glGetString(GL_VERSION);
+        buf << (vendor ? (const char*)vendor : "")
+            << "|" << (renderer ? (const char*)renderer : "")
+            << "|" << (version ? (const char*)version : "")
+            << "|" << PROGRAM_BINARY_VERSION;
+        unsigned identity = osgEarth::hashString(buf.str());
+        return identity != 0u ? identity : 1u;
+    }
+
+    bool writeProgramBinary(const std::string& filename, unsigned identity, const osg::Program::ProgramBinary* binary)
+    {
+        ProgramBinaryHeader header;
+        ::memcpy(header.magic, PROGRAM_BINARY_MAGIC, 4);
+        header.version = PROGRAM_BINARY_VERSION;
+        header.identity = identity;
+        header.format = binary->getFormat();
+        header.size = binary->getSize();
+
+        // Write to a private temp file and rename it into place, so another
+        // process starting up never sees a partial binary.
+        std::stringstream temp;
+        temp << filename << "." << OpenThreads::Thread::CurrentThreadId() << "_" << ::rand() << ".tmp";
+        {
+            std::ofstream fout(temp.str().c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+            if (!fout.is_open())
+                return false;
+            fout.write((const char*)&header, sizeof(header));
+            fout.write((const char*)binary->getData(), binary->getSize());
+            if (!fout)
+            {
+                fout.close();
+                ::remove(temp.str().c_str());
+                return false;
+            }
+        }
+
+        ::remove(filename.c_str());
+        if (::rename(temp.str().c_str(), filename.c_str()) != 0)
+        {
+            ::remove(temp.str().c_str());
+            return false;
+        }
+        return true;
+    }
+}
+
+namespace
+{
+    // Source of a shader with the define string placed after its #version
+    // line, which is where OSG puts it when it compiles the shader.
+    std::string bakeDefines(const std::string& source, const std::string& defineStr)
+    {
+        if (defineStr.empty())
+            return source;
+
+        std::string::size_type version = source.find("#version");
+        if (version == std::string::npos)
+            return defineStr + source;
+
+        std::string::size_type eol = source.find_first_of("\r\n", version);
+        if (eol == std::string::npos)
+            return source + "\n" + defineStr;
+
+        std::string result(source);
+        result.insert(eol + 1, defineStr);
+        return result;
+    }
+
+    // Copy of a program with its defines baked into the shader sources,
+    // so it links to the same result in a context without those defines.
+    osg::Program* bakeProgram(const osg::Program* program, const std::string& defineStr)
+    {
+        osg::Program* copy = new osg::Program();
+        copy->setName(program->getName());
+
+        for (unsigned i = 0; i < program->getNumShaders(); ++i)
+        {
+            const osg::Shader* shader = program->getShader(i);
+            copy->addShader(new osg::Shader(shader->getType(), bakeDefines(shader->getShaderSource(), defineStr)));
+        }
+
+        const osg::Program::AttribBindingList& attribs = program->getAttribBindingList();
+        for (osg::Program::AttribBindingList::const_iterator i = attribs.begin(); i != attribs.end(); ++i)
+            copy->addBindAttribLocation(i->first, i->second);
+
+        const osg::Program::FragDataBindingList& fragData = program->getFragDataBindingList();
+        for (osg::Program::FragDataBindingList::const_iterator i = fragData.begin(); i != fragData.end(); ++i)
+            copy->addBindFragDataLocation(i->first, i->second);
+
+        const osg::Program::UniformBlockBindingList& blocks = program->getUniformBlockBindingList();
+        for (osg::Program::UniformBlockBindingList::const_iterator i = blocks.begin(); i != blocks.end(); ++i)
+            copy->addBindUniformBlock(i->first, i->second);
+
+        for (unsigned i = 0; i < program->getNumTransformFeedBackVaryings(); ++i)
+            copy->addTransformFeedBackVarying(program->getTransformFeedBackVarying(i));
+        copy->setTransformFeedBackMode(program->getTransformFeedBackMode());
+
+        return copy;
+    }
+
+    // Program that draws nothing, for a VP whose program is still linking
+    // and that has nothing else to fall back on.
+    osg::Program* getNullProgram()
+    {
+        static osg::ref_ptr<osg::Program> s_program;
+        static Threading::Mutex s_mutex(OE_MUTEX_NAME);
+
+        Threading::ScopedMutexLock lock(s_mutex);
+        if (!s_program.valid())
+        {
+            s_program = new osg::Program();
+            s_program->setName("oe_NullProgram");
+            s_program->addShader(new osg::Shader(osg::Shader::VERTEX,
+                "#version " GLSL_VERSION_STR "\n"
+                "void main() { gl_Position = vec4(0.0, 0.0, 2.0, 1.0); }\n"));
+            s_program->addShader(new osg::Shader(osg::Shader::FRAGMENT,
+                "#version " GLSL_VERSION_STR "\n"
+                "void main() { discard; }\n"));
+        }
+        return s_program.get();
+    }
+
+    typedef void (GL_APIENTRY * MaxShaderCompilerThreadsProc)(GLuint count);
+}
+
+/**
+ * Links programs in a pbuffer, on a thread of its own, and hands back the
+ * program binaries. The pbuffer shares objects with a drawing context when
+ * there is one; otherwise it stands alone on the default display.
+ */
+class ProgramRepo::ProgramCompiler : public osg::Referenced
+{
+public:
+    struct Job : public osg::Referenced
+    {
+        Job() : _writeToCache(false), _done(false), _linkTime(0.0) { }
+        osg::ref_ptr<osg::Program> _source;    // program as the VP built it
+        std::string _defineStr;
+        osg::ref_ptr<osg::Program> _program;   // copy with the defines baked in
+        bool _writeToCache;
+        osg::ref_ptr<osg::Program::ProgramBinary> _binary;
+        std::atomic<bool> _done;
+        double _linkTime; // ms
+    };
+
+    ProgramCompiler(const ProgramRepo* repo, osg::GraphicsContext* shared) :
+        _repo(repo),
+        _flushDeleted(false),
+        _mutex(OE_MUTEX_NAME),
+        _stop(false)
+    {
+        osg::ref_ptr<osg::GraphicsContext::Traits> traits;
+        if (shared && shared->getTraits())
+        {
+            traits = new osg::GraphicsContext::Traits(*shared->getTraits());
+            traits->sharedContext = shared;
+        }
+        else
+        {
+            shared = 0L;
+            traits = new osg::GraphicsContext::Traits();
+            traits->glContextVersion = osg::DisplaySettings::instance()->getGLContextVersion();
+            traits->glContextProfileMask = osg::DisplaySettings::instance()->getGLContextProfileMask();
+        }
+        traits->x = traits->y = 0;
+        traits->width = traits->height = 1;
+        traits->windowDecoration = false;
+        traits->doubleBuffer = false;
+        traits->pbuffer = true;
+
+        _gc = osg::GraphicsContext::createGraphicsContext(traits.get());
+        if (!_gc.valid() || !_gc->realize())
+        {
+            OE_WARN << LC << "Failed to create a background link context" << std::endl;
+            _gc = 0L;
+            return;
+        }
+
+        // the pbuffer compiles shaders the same way as the drawing context
+        if (shared && shared->getState())
+        {
+            osg::State* state = _gc->getState();
+            state->setUseVertexAttributeAliasing(shared->getState()->getUseVertexAttributeAliasing());
+            state->setUseModelViewAndProjectionUniforms(shared->getState()->getUseModelViewAndProjectionUniforms());
+        }
+
+        // A shared pbuffer takes the context ID of the drawing context, whose
+        // thread flushes the deleted objects; a standalone one flushes its own.
+        _flushDeleted = (shared == 0L);
+
+        _thread = std::thread(&ProgramCompiler::run, this);
+    }
+
+    ~ProgramCompiler()
+    {
+        if (_thread.joinable())
+        {
+            {
+                Threading::ScopedMutexLock lock(_mutex);
+                _stop = true;
+            }
+            _cond.notify_all();
+            _thread.join();
+        }
+        if (_gc.valid())
+            _gc->close();
+    }
+
+    bool valid() const
+    {
+        return _gc.valid();
+    }
+
+    //! The job linking a program with a define string, if there is one
+    Job* find(osg::Program* program, const std::string& defineStr)
+    {
+        Threading::ScopedMutexLock lock(_mutex);
+        JobMap::iterator i = _jobs.find(std::make_pair(osg::ref_ptr<osg::Program>(program), defineStr));
+        return i != _jobs.end() ? i->second.get() : 0L;
+    }
+
+    //! Starts linking a program with a define string. With "writeToCache",
+    //! the binary also goes to the repo's binary cache, if it has one.
+    Job* start(osg::Program* program, const std::string& defineStr, bool writeToCache = false)
+    {
+        Threading::ScopedMutexLock lock(_mutex);
+        osg::ref_ptr<Job>& job = _jobs[std::make_pair(osg::ref_ptr<osg::Program>(program), defineStr)];
+        if (!job.valid())
+        {
+            job = new Job();
+            job->_source = program;
+            job->_defineStr = defineStr;
+            job->_program = bakeProgram(program, defineStr);
+            job->_writeToCache = writeToCache;
+            _queue.push_back(job.get());
+            _cond.notify_one();
+        }
+        OE_PROFILING_PLOT("VP async link queue", (float)_queue.size());
+        return job.get();
+    }
+
+    //! Forgets a finished job
+    void finish(osg::Program* program, const std::string& defineStr)
+    {
+        Threading::ScopedMutexLock lock(_mutex);
+        _jobs.erase(std::make_pair(osg::ref_ptr<osg::Program>(program), defineStr));
+    }
+
+private:
+    void run()
+    {
+        _gc->makeCurrent();
+        osg::State& state = *_gc->getState();
+        unsigned contextID = state.getContextID();
+        unsigned identity = computeGLIdentity();
+
+        // let the driver spread each link across its own threads when it can
+        if (osg::isGLExtensionSupported(contextID, "GL_KHR_parallel_shader_compile"))
+        {
+            MaxShaderCompilerThreadsProc maxThreads = 0L;
+            osg::setGLExtensionFuncPtr(maxThreads, "glMaxShaderCompilerThreadsKHR", "glMaxShaderCompilerThreadsARB");
+            if (maxThreads)
+                maxThreads(0xFFFFFFFF);
+        }
+
+        while (true)
+        {
+            osg::ref_ptr<Job> job;
+            {
+                Threading::ScopedMutexLock lock(_mutex);
+                while (_queue.empty() && !_stop)
+                    _cond.wait(_mutex);
+                if (_stop)
+                    break;
+                job = _queue.front();
+                _queue.pop_front();
+            }
+
+            OE_PROFILING_ZONE_NAMED("VP async link");
+            OE_PROFILING_ZONE_TEXT(job->_program->getName());
+
+            osg::Timer_t start = osg::Timer::instance()->tick();
+
+            // An empty binary tells OSG to set the retrievable hint
+            osg::Program* program = job->_program.get();
+            program->setProgramBinary(new osg::Program::ProgramBinary());
+            program->compileGLObjects(state);
+
+            osg::Program::PerContextProgram* pcp = program->getPCP(state);
+            if (pcp && pcp->isLinked())
+                job->_binary = pcp->compileProgramBinary(state);
+
+            program->releaseGLObjects(&state);
+            if (_flushDeleted)
+                osg::flushAllDeletedGLObjects(contextID);
+
+            if (job->_writeToCache && job->_binary.valid() && job->_binary->getSize() > 0 &&
+                _repo->isProgramBinaryCachingActive())
+            {
+                std::string filename = _repo->getProgramCacheName(job->_source.get(), job->_defineStr, identity);
+                if (!writeProgramBinary(filename, identity, job->_binary.get()))
+                    OE_WARN << LC << "Failed to write program binary (" << filename << ")" << std::endl;
+            }
+
+            job->_linkTime = osg::Timer::instance()->delta_m(start, osg::Timer::instance()->tick());
+            s_linkTime.record(job->_linkTime);
+            job->_done = true;
+        }
+
+        _gc->releaseContext();
+    }
+
+    const ProgramRepo* _repo;
+    osg::ref_ptr<osg::GraphicsContext> _gc;
+    bool _flushDeleted;
+    typedef std::map<std::pair<osg::ref_ptr<osg::Program>, std::string>, osg::ref_ptr<Job> > JobMap;
+    JobMap _jobs;
+    std::deque<osg::ref_ptr<Job> > _queue;
+    Threading::Mutex _mutex;
+    std::condition_variable_any _cond;
+    bool _stop;
+    std::thread _thread;
+};
+
 ProgramRepo::ProgramRepo() :
     Threading::Mutexed<osg::Referenced>("ProgramRepo(OE)"),
-    _releaseUnusedPrograms(true)
+    _releaseUnusedPrograms(true),
+    _asyncLinking(false),
+    _manifestMutex(OE_MUTEX_NAME)
 {
+
     const char* value = ::getenv("OSGEARTH_PROGRAM_BINARY_CACHE_PATH");
     if (value)
         setProgramBinaryCacheLocation(value);
+
+    if (::getenv("OSGEARTH_ASYNC_PROGRAM_LINKING"))
+        setAsyncLinking(true);
+
+    value = ::getenv("OSGEARTH_PROGRAM_MANIFEST_PATH");
+    if (value)
+        setManifestRecordingPath(value);
+
+    _compilers.resize(MAX_CONTEXTS);
 }
 
 ProgramRepo::~ProgramRepo()
@@ -161,6 +578,46 @@ ProgramRepo::isProgramBinaryCachingActive() const
     return _programBinaryCacheFolder.empty() == false;
 }
 
+std::uint64_t
+ProgramRepo::hashKey(const ProgramKey& key)
+{
+    std::uint64_t hash = EMPTY_KEY_HASH;
+    for (ProgramKey::const_iterator i = key.begin(); i != key.end(); ++i)
+        hash = hashKey(hash, (std::uint64_t)(*i));
+    return hash;
+}
+
+osg::ref_ptr<osg::Program>
+ProgramRepo::find(const ProgramKey& key, std::uint64_t hash) const
+{
+    std::shared_ptr<const ProgramIndex> index = std::atomic_load(&_index);
+    if (index)
+    {
+        ProgramIndex::const_iterator i = index->find(hash);
+        if (i != index->end())
+        {
+            for (IndexBucket::const_iterator j = i->second.begin(); j != i->second.end(); ++j)
+            {
+                if (j->first == key)
+                    return j->second;
+            }
+        }
+    }
+    return 0L;
+}
+
+void
+ProgramRepo::publishIndex() const
+{
+    std::shared_ptr<ProgramIndex> index = std::make_shared<ProgramIndex>();
+    index->reserve(_db.size());
+    for (ProgramMap::const_iterator i = _db.begin(); i != _db.end(); ++i)
+    {
+        (*index)[hashKey(i->first)].push_back(std::make_pair(i->first, i->second->_program));
+    }
+    std::atomic_store(&_index, std::shared_ptr<const ProgramIndex>(index));
+}
+
 osg::ref_ptr<osg::Program>
 ProgramRepo::use(const ProgramKey& key, unsigned frameNumber, UID user)
 {
@@ -184,6 +641,8 @@ ProgramRepo::release(UID user, osg::State* state)
     if (user <= 0 || _releaseUnusedPrograms == false)
         return;
 
+    bool erased = false;
+
     for (ProgramMap::iterator i = _db.begin(); i != _db.end(); )
     {
         Entry* e = i->second.get();
@@ -206,12 +665,16 @@ ProgramRepo::release(UID user, osg::State* state)
                 // remove from the repo
                 _db.erase(i++);
                 increment = false;
+                erased = true;
             }
         }
 
         if (increment)
             ++i;
     }
+
+    if (erased)
+        publishIndex();
 }
 
 void
@@ -232,6 +695,7 @@ ProgramRepo::add(const ProgramKey& key, osg::ref_ptr<osg::Program>& in_out, unsi
 
             OE_TEST << LC << "PR SHR1 prog=" << e->_program.get() << " user=" << (user) << " total=" << e->_users.size() << std::endl;
 
+            publishIndex();
             return;
         }
 
@@ -246,6 +710,7 @@ ProgramRepo::add(const ProgramKey& key, osg::ref_ptr<osg::Program>& in_out, unsi
 
             OE_TEST << LC << "PR SHR2 prog=" << e->_program.get() << " user=" << (user) << " total=" << e->_users.size() << std::endl;
 
+            publishIndex();
             return;
         }
     }
@@ -255,6 +720,10 @@ ProgramRepo::add(const ProgramKey& key, osg::ref_ptr<osg::Program>& in_out, unsi
     newEntry->_program = in_out.get();
     newEntry->_frameLastUsed = frameNumber;
     newEntry->_users.insert(user);
+
+    s_programsCreated.add();
+
+    publishIndex();
 }
 
 void
@@ -284,6 +753,36 @@ ProgramRepo::releaseGLObjects(osg::State* state) const
         OE_TEST << LC << "...released program " << e->_program->getName() << std::endl;
     }
     _db.clear();
+    publishIndex();
+}
+
+unsigned
+ProgramRepo::getGLIdentity(osg::State& state) const
+{
+    unsigned& identity = _glIdentity[state.getContextID()];
+    if (identity == 0u)
+    {
+        identity = computeGLIdentity();
+    }
+    return identity;
+}
+
+std::string
+ProgramRepo::getProgramCacheName(
+    const osg::Program* program,
+    const std::string& defineStr,
+    unsigned identity) const
+{
+    std::stringstream programCacheNameStream;
+    programCacheNameStream
+        << program->getName()
+        << "_" << std::hex << hashProgramSource(program, defineStr)
+        << "_" << identity
+        << ".bin";
+
+    return osgDB::concatPaths(
+        _programBinaryCacheFolder,
+        osgEarth::toLegalFileName(programCacheNameStream.str(), false, "-"));
 }
 
 void
@@ -295,117 +794,424 @@ ProgramRepo::linkProgram(
 {
     OE_PROFILING_ZONE_NAMED("link");
 
-    if (isProgramBinaryCachingActive())
+#if OSG_VERSION_LESS_THAN(3,7,0)
+    const std::string& defineStr = state.getDefineString(program->getShaderDefines());
+#else
+    const std::string& defineStr = pcp->getDefineString();
+#endif
+
+    if (!_manifestPath.empty() && !key.empty())
     {
-        bool readFromCache = false;
-        std::fstream fStream;
-        std::string programCacheName;
+        record(key, program, defineStr);
+    }
 
-        // hash the program metadata
-        std::stringstream programCacheNameStream;
-        programCacheNameStream << program->getName();
-        unsigned int hash = 0;
-        for (int i = 0; i < key.size(); i++)
+    if (!isProgramBinaryCachingActive())
+    {
+        program->compileGLObjects(state);
+
+        // A binary from the background linker is only needed once
+        if (pcp->loadedBinary())
         {
-            //same as boost hash_combine
-            hash ^= key[i] + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+            program->setProgramBinary(0L);
+            if (!pcp->isLinked())
+            {
+                OE_INFO << LC << "Program binary rejected, recompiling (" << program->getName() << ")" << std::endl;
+                pcp->requestLink();
+                program->compileGLObjects(state);
+            }
         }
-        programCacheNameStream << "_" << hash;
+        return;
+    }
+
+    unsigned identity = getGLIdentity(state);
+    std::string programCacheName = getProgramCacheName(program, defineStr, identity);
+
+    osg::ref_ptr<osg::Program::ProgramBinary> cached;
+    {
+        OE_PROFILING_ZONE_NAMED("LoadShaderProgramBinary");
+        OE_PROFILING_ZONE_TEXT(programCacheName);
+        cached = readProgramBinary(programCacheName, identity);
+    }
+
+    // Nothing on disk, but the background linker made one?
+    if (!cached.valid() && program->getProgramBinary() && program->getProgramBinary()->getSize() > 0)
+    {
+        cached = program->getProgramBinary();
+    }
+
+    if (cached.valid())
+    {
+        program->setProgramBinary(cached.get());
+        program->compileGLObjects(state);
+
+        if (pcp->isLinked() && pcp->loadedBinary())
+        {
+            OE_DEBUG << LC << "Read a program binary from the cache (" << programCacheName << ")" << std::endl;
+            return;
+        }
+
+        // The driver rejected the binary (usually after an update that
+        // kept the version string). Build from source and replace it.
+        OE_INFO << LC << "Program binary rejected, recompiling (" << programCacheName << ")" << std::endl;
+        if (!pcp->isLinked())
+        {
+            program->setProgramBinary(new osg::Program::ProgramBinary());
+            pcp->requestLink();
+            program->compileGLObjects(state);
+        }
+    }
+    else
+    {
+        // An empty binary tells OSG to set the retrievable hint
+        // so we can fetch the linked binary below.
+        program->setProgramBinary(new osg::Program::ProgramBinary());
+        program->compileGLObjects(state);
+    }
+
+    if (!pcp->isLinked())
+    {
+        OE_WARN << LC << "Failed to link program (" << programCacheName << ")" << std::endl;
+        ::remove(programCacheName.c_str());
+        return;
+    }
+
+    osg::ref_ptr<osg::Program::ProgramBinary> binary = pcp->compileProgramBinary(state);
+    if (binary.valid() && binary->getSize() > 0)
+    {
+        OE_PROFILING_ZONE_NAMED("SaveShaderProgramBinary");
+        if (writeProgramBinary(programCacheName, identity, binary.get()))
+        {
+            OE_DEBUG << LC << "Wrote a program binary to the cache (" << programCacheName << ")" << std::endl;
+        }
+        else
+        {
+            OE_WARN << LC << "Failed to write program binary (" << programCacheName << ")" << std::endl;
+        }
+
+        // other contexts on the same GPU can start from this one
+        program->setProgramBinary(binary.get());
+    }
+    else
+    {
+        OE_INFO << LC << "Driver returned no program binary (" << programCacheName << ")" << std::endl;
+        ::remove(programCacheName.c_str());
+    }
+}
+
+void
+ProgramRepo::setAsyncLinking(bool value)
+{
+    _asyncLinking = value;
+}
+
+bool
+ProgramRepo::isAsyncLinkingActive() const
+{
+    return _asyncLinking;
+}
+
+bool
+ProgramRepo::linkProgramAsync(
+    osg::Program* program,
+    osg::Program::PerContextProgram* pcp,
+    osg::State& state)
+{
+    unsigned contextID = state.getContextID();
+    osg::ref_ptr<ProgramCompiler>& compiler = _compilers[contextID];
+    if (!compiler.valid())
+        compiler = new ProgramCompiler(this, state.getGraphicsContext());
+    if (!compiler->valid())
+        return true;
 
 #if OSG_VERSION_LESS_THAN(3,7,0)
-        const std::string& defineStr = state.getDefineString(program->getShaderDefines());
+    const std::string& defineStr = state.getDefineString(program->getShaderDefines());
 #else
-        const std::string& defineStr = pcp->getDefineString();
+    const std::string& defineStr = pcp->getDefineString();
 #endif
 
-        unsigned defineHash = osgEarth::hashString(defineStr);
-        programCacheNameStream << "_" << defineHash;
-        programCacheNameStream << ".bin";
+    ProgramCompiler::Job* job = compiler->find(program, defineStr);
+    if (!job)
+    {
+        // a binary on disk loads fast enough on the draw thread
+        if (isProgramBinaryCachingActive() &&
+            osgDB::fileExists(getProgramCacheName(program, defineStr, getGLIdentity(state))))
+        {
+            return true;
+        }
 
-        programCacheName = osgDB::concatPaths(
-            _programBinaryCacheFolder, 
-            osgEarth::toLegalFileName(programCacheNameStream.str(), false, "-"));
+        job = compiler->start(program, defineStr);
+    }
+
+    if (!job->_done)
+        return false;
 
-        //currently set to be able to read and write to the binary file so only need to open file once.
-        fStream.open(programCacheName.c_str(), std::fstream::in | std::fstream::out | std::fstream::app | std::fstream::binary);
-        if (fStream.is_open())
+    OE_PROFILING_PLOT("VP async link ms", (float)job->_linkTime);
+
+    if (job->_binary.valid() && job->_binary->getSize() > 0)
+    {
+        OE_DEBUG << LC << "Linked " << program->getName() << " in the background (" << job->_linkTime << " ms)" << std::endl;
+        program->setProgramBinary(job->_binary.get());
+    }
+    else
+    {
+        // link on the draw thread, which reports the errors
+        OE_INFO << LC << "Background link failed for " << program->getName() << std::endl;
+    }
+
+    compiler->finish(program, defineStr);
+    return true;
+}
+
+
+namespace
+{
+    // Programs from the manifest stay in the repo for the whole session;
+    // release() ignores users that aren't positive.
+    const UID PREWARM_USER = -1;
+
+    std::string keyToString(const ProgramKey& key)
+    {
+        std::stringstream buf;
+        for (ProgramKey::const_iterator i = key.begin(); i != key.end(); ++i)
+            buf << (i != key.begin() ? "," : "") << (std::uint64_t)(*i);
+        return buf.str();
+    }
+
+    Config programToConfig(const ProgramKey& key, const osg::Program* program, const std::string& defineStr)
+    {
+        Config conf("program");
+        conf.set("name", program->getName());
+        conf.set("key", keyToString(key));
+        conf.set("defines", defineStr);
+
+        for (unsigned i = 0; i < program->getNumShaders(); ++i)
         {
-            // get length of file:
-            fStream.seekg(0, fStream.end);
-            int length = fStream.tellg();
-            fStream.seekg(0, fStream.beg);
+            const osg::Shader* shader = program->getShader(i);
+            Config shaderConf("shader");
+            shaderConf.set("type", (unsigned)shader->getType());
+            shaderConf.set("source", shader->getShaderSource());
+            conf.add(shaderConf);
+        }
 
-            if (length > 1)
-            {
-                OE_PROFILING_ZONE_NAMED("LoadShaderProgramBinary");
-                OE_PROFILING_ZONE_TEXT(programCacheName);
-                unsigned char* buffer = new unsigned char[length];
-
-                // read data as a block:
-                GLenum format;
-                fStream.read((char*)&format, sizeof(GLenum));
-                fStream.read((char*)buffer, length - sizeof(GLenum));
-
-                osg::Program::ProgramBinary* binary = new osg::Program::ProgramBinary();
-                binary->setFormat(format);
-                binary->assign(length - sizeof(GLenum), buffer);
-                program->setProgramBinary(binary);
-                readFromCache = true;
-                OE_DEBUG << LC << "Read a program binary from the cache (" << programCacheName << ")" << std::endl;
-            }
-            else
-            {
-                OE_PROFILING_ZONE_NAMED("LoadShaderNotFound");
-                OE_PROFILING_ZONE_TEXT(programCacheName);
-            }
+        const osg::Program::AttribBindingList& attribs = program->getAttribBindingList();
+        for (osg::Program::AttribBindingList::const_iterator i = attribs.begin(); i != attribs.end(); ++i)
+        {
+            Config attribConf("attrib");
+            attribConf.set("name", i->first);
+            attribConf.set("location", i->second);
+            conf.add(attribConf);
+        }
 
-            //If there is not a programBinary then we need to add one
-            // This sets an openGL hint so we can grab it later.
-            if (program->getProgramBinary() == NULL)
-            {
-                program->setProgramBinary(new osg::Program::ProgramBinary());
-            }
+        const osg::Program::FragDataBindingList& fragData = program->getFragDataBindingList();
+        for (osg::Program::FragDataBindingList::const_iterator i = fragData.begin(); i != fragData.end(); ++i)
+        {
+            Config fragConf("frag_data");
+            fragConf.set("name", i->first);
+            fragConf.set("location", i->second);
+            conf.add(fragConf);
         }
 
-        program->compileGLObjects(state);
+        return conf;
+    }
 
-        if (fStream.is_open())
+    osg::Program* programFromConfig(const Config& conf)
+    {
+        osg::Program* program = new osg::Program();
+        program->setName(conf.value("name"));
+
+        const ConfigSet shaders = conf.children("shader");
+        for (ConfigSet::const_iterator i = shaders.begin(); i != shaders.end(); ++i)
         {
-            if (pcp->isLinked())
-            {
-                if (!readFromCache)
-                {
-                    osg::ref_ptr<osg::Program::ProgramBinary> binary = pcp->compileProgramBinary(state);
-                    if (binary && binary->getSize() > 0)
-                    {
-                        OE_PROFILING_ZONE_NAMED("SaveShaderProgramBinary");
-                        GLenum format = binary->getFormat();
-                        fStream.write((char*)&format, sizeof(GLenum));
-                        fStream.write((char*)binary->getData(), binary->getSize());
-                        fStream.close();
-                        OE_DEBUG << LC << "Wrote a shader binary from the cache (" << programCacheName << ")" << std::endl;
-                    }
-                    else
-                    {
-                        //Should we save off something so we know it is a bad shader instead of just deleting the empty cache file?
-                        fStream.close();
-                        OE_WARN << LC << "Failed to compile program binary (" << programCacheName << ")" << std::endl;
-                        remove(programCacheName.c_str());
-                    }
-                }
-            }
-            else
-            {
-                OE_WARN << LC << "Failed to link program binary (" << programCacheName << ")" << std::endl;
-                fStream.close();
-                remove(programCacheName.c_str());
-            }
+            program->addShader(new osg::Shader(
+                (osg::Shader::Type)i->value<unsigned>("type", 0u),
+                i->value("source")));
         }
+
+        const ConfigSet attribs = conf.children("attrib");
+        for (ConfigSet::const_iterator i = attribs.begin(); i != attribs.end(); ++i)
+            program->addBindAttribLocation(i->value("name"), i->value<unsigned>("location", 0u));
+
+        const ConfigSet fragData = conf.children("frag_data");
+        for (ConfigSet::const_iterator i = fragData.begin(); i != fragData.end(); ++i)
+            program->addBindFragDataLocation(i->value("name"), i->value<unsigned>("location", 0u));
+
+        return program;
     }
-    else
+
+    ProgramKey keyFromConfig(const Config& conf)
     {
-        program->compileGLObjects(state);
+        ProgramKey key;
+#ifdef OE_USE_HASH_FOR_PROGRAM_KEY
+        // a key of shader pointers would mean nothing in another session
+        StringTokenizer tok(",");
+        StringVector values;
+        tok.tokenize(conf.value("key"), values);
+        for (StringVector::const_iterator i = values.begin(); i != values.end(); ++i)
+            key.push_back(as<unsigned>(*i, 0u));
+#endif
+        return key;
+    }
+
+    // Identifies one program with one define string in a manifest
+    std::uint64_t manifestEntryID(const ProgramKey& key, const std::string& defineStr)
+    {
+        return ProgramRepo::hashKey(ProgramRepo::hashKey(key), osgEarth::hashString(defineStr));
+    }
+
+    // A manifest is one JSON object per line, so recording only appends
+    bool readManifest(const std::string& filename, std::vector<Config>& entries)
+    {
+        std::ifstream fin(filename.c_str());
+        if (!fin.is_open())
+            return false;
+
+        std::string line;
+        while (std::getline(fin, line))
+        {
+            if (trim(line).empty())
+                continue;
+            Config conf;
+            if (conf.fromJSON(line))
+                entries.push_back(conf);
+        }
+        return true;
+    }
+}
+
+void
+ProgramRepo::setManifestRecordingPath(const std::string& filename)
+{
+    Threading::ScopedMutexLock lock(_manifestMutex);
+
+    // Keep adding to an existing manifest without repeating its entries
+    _manifestEntries.clear();
+    std::vector<Config> entries;
+    readManifest(filename, entries);
+    for (std::vector<Config>::const_iterator i = entries.begin(); i != entries.end(); ++i)
+    {
+        _manifestEntries.insert(manifestEntryID(keyFromConfig(*i), i->value("defines")));
+    }
+
+    _manifestPath = filename;
+    OE_INFO << LC << "Recording programs to " << filename << std::endl;
+}
+
+void
+ProgramRepo::record(const ProgramKey& key, const osg::Program* program, const std::string& defineStr)
+{
+    Threading::ScopedMutexLock lock(_manifestMutex);
+
+    if (!_manifestEntries.insert(manifestEntryID(key, defineStr)).second)
+        return;
+
+    std::ofstream fout(_manifestPath.c_str(), std::ios::out | std::ios::app);
+    if (!fout.is_open())
+    {
+        OE_WARN << LC << "Failed to write the program manifest " << _manifestPath << std::endl;
+        return;
     }
+
+    // the compact writer puts each program on a single line
+    fout << programToConfig(key, program, defineStr).toJSON(false);
+}
+
+unsigned
+ProgramRepo::prewarm(const std::string& manifest, osg::GraphicsContext* gc)
+{
+    OE_PROFILING_ZONE_NAMED("VP prewarm");
+
+    if (Registry::instance()->isHeadless())
+        return 0u;
+
+    std::vector<Config> entries;
+    if (!readManifest(manifest, entries))
+    {
+        OE_WARN << LC << "Failed to read the program manifest " << manifest << std::endl;
+        return 0u;
+    }
+
+    osg::Timer_t start = osg::Timer::instance()->tick();
+
+    unsigned numThreads = osg::clampBetween(std::thread::hardware_concurrency(), 1u, 4u);
+    std::vector< osg::ref_ptr<ProgramCompiler> > compilers;
+    for (unsigned i = 0; i < numThreads; ++i)
+    {
+        osg::ref_ptr<ProgramCompiler> compiler = new ProgramCompiler(this, gc);
+        if (!compiler->valid())
+            break;
+        compilers.push_back(compiler.get());
+    }
+    if (compilers.empty())
+    {
+        return 0u;
+    }
+
+    struct Item
+    {
+        ProgramKey key;
+        osg::ref_ptr<osg::Program> program;
+        osg::ref_ptr<ProgramCompiler::Job> job;
+    };
+    std::vector<Item> items;
+    std::set<std::uint64_t> seen;
+    std::map<ProgramKey, unsigned> variants;
+
+    for (std::vector<Config>::const_iterator i = entries.begin(); i != entries.end(); ++i)
+    {
+        Item item;
+        item.key = keyFromConfig(*i);
+        std::string defineStr = i->value("defines");
+        if (!seen.insert(manifestEntryID(item.key, defineStr)).second)
+            continue;
+
+        item.program = programFromConfig(*i);
+        if (item.program->getNumShaders() == 0)
+            continue;
+
+        item.job = compilers[items.size() % compilers.size()]->start(item.program.get(), defineStr, true);
+        ++variants[item.key];
+        items.push_back(item);
+    }
+
+    unsigned count = 0u;
+    for (std::vector<Item>::iterator i = items.begin(); i != items.end(); ++i)
+    {
+        while (!i->job->_done)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        if (i->job->_binary.valid() && i->job->_binary->getSize() > 0)
+            ++count;
+        else
+            OE_INFO << LC << "Failed to prewarm " << i->program->getName() << std::endl;
+    }
+
+    // Stops the threads and closes their contexts
+    compilers.clear();
+
+#ifdef OE_USE_HASH_FOR_PROGRAM_KEY
+    lock();
+    for (std::vector<Item>::iterator i = items.begin(); i != items.end(); ++i)
+    {
+        if (i->key.empty() || _db.find(i->key) != _db.end())
+            continue;
+
+        if (!i->job->_binary.valid() || i->job->_binary->getSize() == 0)
+            continue;
+
+        // Without a binary cache, hand over the binary directly. One binary
+        // can only serve one define string, though.
+        if (!isProgramBinaryCachingActive() && variants[i->key] == 1u)
+            i->program->setProgramBinary(i->job->_binary.get());
+
+        add(i->key, i->program, 0u, PREWARM_USER);
+    }
+    unlock();
+#endif
+
+    double ms = osg::Timer::instance()->delta_m(start, osg::Timer::instance()->tick());
+    OE_PROFILING_PLOT("VP prewarm ms", (float)ms);
+    OE_INFO << LC << "Prewarmed " << count << " of " << items.size() << " programs in " << ms << " ms" << std::endl;
+
+    return count;
 }
 
 //------------------------------------------------------------------------
@@ -952,6 +1758,24 @@ VirtualProgram::setProgramBinaryCacheLocation(const std::string& folder)
     Registry::programRepo().setProgramBinaryCacheLocation(folder);
 }
 
+void
+VirtualProgram::setAsyncProgramLinking(bool value)
+{
+    Registry::programRepo().setAsyncLinking(value);
+}
+
+void
+VirtualProgram::recordProgramManifest(const std::string& filename)
+{
+    Registry::programRepo().setManifestRecordingPath(filename);
+}
+
+unsigned
+VirtualProgram::prewarmPrograms(const std::string& manifest, osg::GraphicsContext* gc)
+{
+    return Registry::programRepo().prewarm(manifest, gc);
+}
+
 //------------------------------------------------------------------------
 
 VirtualProgram::VirtualProgram(unsigned mask) :
@@ -963,7 +1787,8 @@ VirtualProgram::VirtualProgram(unsigned mask) :
     _logPath(""),
     _acceptCallbacksVaryPerFrame(false),
     _isAbstract(false),
-    _dataModelMutex("VirtualProgram(OE)")
+    _dataModelMutex("VirtualProgram(OE)"),
+    _releaseCount(0u)
 {
     // Note: we cannot set _active here. Wait until apply().
     // It will cause a conflict in the Registry.
@@ -1000,6 +1825,8 @@ VirtualProgram::VirtualProgram(unsigned mask) :
     _apply.resize(MAX_CONTEXTS);
 #endif
 
+    _lookup.resize(MAX_CONTEXTS);
+
 #ifdef USE_STACK_MEMORY
     _vpStackMemory._item.resize(MAX_CONTEXTS);
 #endif
@@ -1017,7 +1844,8 @@ VirtualProgram::VirtualProgram(const VirtualProgram& rhs, const osg::CopyOp& cop
     _logPath(rhs._logPath),
     _template(osg::clone(rhs._template.get())),
     _acceptCallbacksVaryPerFrame(rhs._acceptCallbacksVaryPerFrame),
-    _isAbstract(rhs._isAbstract)
+    _isAbstract(rhs._isAbstract),
+    _releaseCount(0u)
 {
     _id = osgEarth::Registry::instance()->createUID();
 
@@ -1037,6 +1865,8 @@ VirtualProgram::VirtualProgram(const VirtualProgram& rhs, const osg::CopyOp& cop
     _apply.resize(MAX_CONTEXTS);
 #endif
 
+    _lookup.resize(MAX_CONTEXTS);
+
 #ifdef USE_STACK_MEMORY
     _vpStackMemory._item.resize(MAX_CONTEXTS);
 #endif
@@ -1179,6 +2009,7 @@ VirtualProgram::releaseGLObjects(osg::State* state) const
     Registry::programRepo().lock();
     Registry::programRepo().release(_id, state);
     Registry::programRepo().unlock();
+    ++_releaseCount;
 #endif
 
 #ifdef USE_LAST_USED_PROGRAM
@@ -1426,6 +2257,7 @@ VirtualProgram::setInheritShaders(bool value)
             Registry::programRepo().lock();
             Registry::programRepo().release(_id, 0L);
             Registry::programRepo().unlock();
+            ++_releaseCount;
         }
 #endif
 
@@ -1509,7 +2341,6 @@ VirtualProgram::apply(osg::State& state) const
     // we cannot store the program in stack memory -- the accept callback can
     // exclude shaders based on any condition.
     bool acceptCallbacksVary = _acceptCallbacksVaryPerFrame;
-    ProgramKey key;
     if (!program.valid())
     {
 #ifdef PREALLOCATE_APPLY_VARS
@@ -1567,7 +2398,9 @@ VirtualProgram::apply(osg::State& state) const
         // issue; it is unlikely one would have two identical shader programs with different
         // bindings.)
         // We're also going to detect the precense of a fragment shader.
+        // The key's hash builds up along with it.
         unsigned numFragShaders = 0u;
+        std::uint64_t keyHash = ProgramRepo::EMPTY_KEY_HASH;
         for (ShaderMap::iterator i = local.accumShaderMap.begin(); i != local.accumShaderMap.end(); ++i)
         {
             PolyShader* ps = i->second._shader.get();
@@ -1577,6 +2410,7 @@ VirtualProgram::apply(osg::State& state) const
 #else
             local.programKey.push_back(ps);
 #endif
+            keyHash = ProgramRepo::hashKey(keyHash, (std::uint64_t)local.programKey.back());
 
             if (ps->isFragmentStage())
                 ++numFragShaders;
@@ -1593,73 +2427,106 @@ VirtualProgram::apply(osg::State& state) const
         // current frame number, for shader program expiry.
         unsigned frameNumber = state.getFrameStamp() ? state.getFrameStamp()->getFrameNumber() : 0;
 
-#ifdef USE_PROGRAM_REPO
-        // LOCK the program repo to look up the program.
-        Registry::programRepo().lock();
-
-        program = Registry::programRepo().use(local.programKey, frameNumber, _id);
-#endif
-
-        if (!program.valid())
+        ProgramLookup& lookup = _lookup[contextID];
+        unsigned releaseCount = _releaseCount;
+        if (lookup.releaseCount != releaseCount)
         {
-            // build a new set of accumulated functions, to support the creation of main()
-            ShaderComp::FunctionLocationMap accumFunctions;
-            accumulateFunctions(state, accumFunctions);
-
-            local.programKey.clear();
-
-            //OE_NOTICE << LC << "Building new Program for VP " << getName() << std::endl;
-
-            program = buildProgram(
-                getName(),
-                state,
-                accumFunctions,
-                local.accumShaderMap,
-                _globalExtensions,
-                local.accumAttribBindings,
-                local.accumAttribAliases,
-                _template.get(),
-                local.programKey);
+            lookup.program = 0L;
+            lookup.key.clear();
+            lookup.registered.clear();
+            lookup.linked = 0L;
+            lookup.releaseCount = releaseCount;
+        }
 
-            if (_logShaders && program.valid())
+        // Same key as the last apply in this context? Same program.
+        if (lookup.program.valid() && lookup.keyHash == keyHash && lookup.key == local.programKey)
+        {
+            program = lookup.program;
+        }
+        else
+        {
+            // Next search the repo without locking it. A hit only counts if
+            // this VP is already one of the program's users, since registering
+            // a user takes the lock.
+            program = Registry::programRepo().find(local.programKey, keyHash);
+            if (program.valid() && lookup.registered.find(program) == lookup.registered.end())
+                program = 0L;
+
+            if (!program.valid())
             {
-                std::stringstream buf;
-                for (unsigned i = 0; i < program->getNumShaders(); i++)
-                {
-                    buf << program->getShader(i)->getShaderSource() << std::endl << std::endl;
-                }
+                // LOCK the program repo to look up the program.
+                Registry::programRepo().lock();
 
-                if (_logPath.length() > 0)
+                program = Registry::programRepo().use(local.programKey, frameNumber, _id);
+
+                if (!program.valid())
                 {
-                    std::fstream outStream;
-                    outStream.open(_logPath.c_str(), std::ios::out);
-                    if (outStream.fail())
-                    {
-                        OE_WARN << LC << "Unable to open " << _logPath << " for logging shaders." << std::endl;
-                    }
-                    else
+                    // build a new set of accumulated functions, to support the creation of main()
+                    ShaderComp::FunctionLocationMap accumFunctions;
+                    accumulateFunctions(state, accumFunctions);
+
+                    local.programKey.clear();
+
+                    //OE_NOTICE << LC << "Building new Program for VP " << getName() << std::endl;
+
+                    program = buildProgram(
+                        getName(),
+                        state,
+                        accumFunctions,
+                        local.accumShaderMap,
+                        _globalExtensions,
+                        local.accumAttribBindings,
+                        local.accumAttribAliases,
+                        _template.get(),
+                        local.programKey);
+
+                    if (_logShaders && program.valid())
                     {
-                        outStream << buf.str();
-                        outStream.close();
+                        std::stringstream buf;
+                        for (unsigned i = 0; i < program->getNumShaders(); i++)
+                        {
+                            buf << program->getShader(i)->getShaderSource() << std::endl << std::endl;
+                        }
+
+                        if (_logPath.length() > 0)
+                        {
+                            std::fstream outStream;
+                            outStream.open(_logPath.c_str(), std::ios::out);
+                            if (outStream.fail())
+                            {
+                                OE_WARN << LC << "Unable to open " << _logPath << " for logging shaders." << std::endl;
+                            }
+                            else
+                            {
+                                outStream << buf.str();
+                                outStream.close();
+                            }
+                        }
+                        else
+                        {
+                            OE_NOTICE << LC << "Shader source: " << getName() << std::endl << "===============" << std::endl << buf.str() << std::endl << "===============" << std::endl;
+                        }
                     }
-                }
-                else
-                {
-                    OE_NOTICE << LC << "Shader source: " << getName() << std::endl << "===============" << std::endl << buf.str() << std::endl << "===============" << std::endl;
-                }
-            }
 
 #ifdef USE_PROGRAM_REPO
-            // Adds this program to the repo, or finds an equivalent pre-existing program
-            // in the repo and associates this program key with it.
-            Registry::programRepo().add(local.programKey, program, frameNumber, _id);
+                    // Adds this program to the repo, or finds an equivalent pre-existing program
+                    // in the repo and associates this program key with it.
+                    Registry::programRepo().add(local.programKey, program, frameNumber, _id);
 
-            // purge expired programs.
-            Registry::programRepo().prune(frameNumber, &state);
+                    // purge expired programs.
+                    Registry::programRepo().prune(frameNumber, &state);
 #endif
+                }
+                Registry::programRepo().unlock();
+
+                if (program.valid())
+                    lookup.registered.insert(program);
+            }
+
+            lookup.program = program;
+            lookup.keyHash = keyHash;
+            lookup.key = local.programKey;
         }
-        Registry::programRepo().unlock();
-        key = local.programKey;
     }
 
     // finally, apply the program attribute.
@@ -1681,6 +2548,21 @@ VirtualProgram::apply(osg::State& state) const
 
         pcp = program->getPCP(state);
 
+        // Still linking in the background? Meanwhile draw with the last
+        // program this VP drew with in this context, or draw nothing.
+        bool fallingBack = false;
+        if (pcp->needsLink() &&
+            Registry::programRepo().isAsyncLinkingActive() &&
+            !Registry::programRepo().linkProgramAsync(program.get(), pcp, state))
+        {
+            osg::Program* fallback = _lookup[contextID].linked.get();
+            if (!fallback || fallback->getPCP(state)->needsLink())
+                fallback = getNullProgram();
+            program = fallback;
+            pcp = program->getPCP(state);
+            fallingBack = true;
+        }
+
         bool useProgram = state.getLastAppliedProgramObject() != pcp;
 
 #ifdef DEBUG_APPLY_COUNTS
@@ -1719,7 +2601,7 @@ VirtualProgram::apply(osg::State& state) const
 
             if (pcp->needsLink())
             {
-                Registry::programRepo().linkProgram(key, program.get(), pcp, state);
+                Registry::programRepo().linkProgram(_lookup[contextID].key, program.get(), pcp, state);
             }
 
             if (pcp->isLinked())
@@ -1740,6 +2622,11 @@ VirtualProgram::apply(osg::State& state) const
             }
         }
 
+        if (!fallingBack && pcp->isLinked() && _lookup[contextID].linked != program)
+        {
+            _lookup[contextID].linked = program;
+        }
+
 #if 0 // test code for detecting race conditions
         for (int i = 0; i < 10000; ++i) {
             state.setLastAppliedProgramObject(0L);
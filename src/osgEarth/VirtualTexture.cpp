@@ -0,0 +1,614 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+ * Copyright 2020 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarth/VirtualTexture>
+#include <osgEarth/ImageLayer>
+#include <osgEarth/ImageUtils>
+#include <osgEarth/Profile>
+#include <osgEarth/Registry>
+#include <osg/State>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+using namespace osgEarth;
+using namespace osgEarth::Threading;
+
+#define LC "[VirtualTexture] "
+
+#define ARENA_VIRTUAL_TEXTURE "oe.virtualtexture"
+
+// Largest atlas dimension, in texels
+#define MAX_ATLAS_SIZE 16384u
+
+// Frames an unused empty page stays in the table
+#define PRUNE_FRAMES 256u
+
+//........................................................................
+
+// Uploads the pages from inside the atlas's apply, since that's where
+// the atlas is bound.
+class VirtualTexture::Subloader : public osg::Texture2D::SubloadCallback
+{
+public:
+    Subloader(VirtualTexture* vt) : _vt(vt) { }
+
+    void load(const osg::Texture2D& texture, osg::State& state) const
+    {
+        glTexImage2D(
+            GL_TEXTURE_2D, 0, GL_RGBA8,
+            texture.getTextureWidth(), texture.getTextureHeight(), 0,
+            GL_RGBA, GL_UNSIGNED_BYTE, 0L);
+
+        osg::ref_ptr<VirtualTexture> vt;
+        if (_vt.lock(vt))
+            vt->allocate(state);
+    }
+
+    void subload(const osg::Texture2D& texture, osg::State& state) const
+    {
+        osg::ref_ptr<VirtualTexture> vt;
+        if (_vt.lock(vt))
+            vt->upload(state);
+    }
+
+private:
+    osg::observer_ptr<VirtualTexture> _vt;
+};
+
+//........................................................................
+
+VirtualTexture::VirtualTexture(
+    ImageLayer* layer,
+    const Profile* profile,
+    unsigned numPages,
+    unsigned uploadsPerFrame) :
+
+    _layer(layer),
+    _profile(profile),
+    _uploadsPerFrame(osg::maximum(uploadsPerFrame, 1u)),
+    _mutex(OE_MUTEX_NAME),
+    _numLoading(0u),
+    _numResident(0u),
+    _frame(0u),
+    _serial(0u),
+    _layerRevision(-1),
+    _uploadsBegin(0ull),
+    _numContexts(0u)
+{
+    _pageSize = layer ? layer->getTileSize() : 256u;
+    _cellSize = _pageSize + 2u;
+
+    // square-ish atlas, as big as the page count calls for and the
+    // size limit allows:
+    unsigned maxCellsWide = osg::maximum(MAX_ATLAS_SIZE / _cellSize, 1u);
+    numPages = osg::maximum(numPages, 1u);
+    _cellsWide = osg::minimum((unsigned)std::ceil(std::sqrt((double)numPages)), maxCellsWide);
+    unsigned cellsHigh = osg::minimum((numPages + _cellsWide - 1u) / _cellsWide, maxCellsWide);
+    _numCells = _cellsWide * cellsHigh;
+
+    if (_numCells < numPages)
+    {
+        OE_WARN << LC << "Atlas holds " << _numCells << " of the " << numPages << " pages requested" << std::endl;
+    }
+
+    _cells.resize(_numCells);
+    _freeCells.reserve(_numCells);
+    for (unsigned c = _numCells; c > 0u; --c)
+        _freeCells.push_back(c - 1u);
+
+    _texture = new osg::Texture2D();
+    _texture->setName(layer ? layer->getName() + " pages" : "pages");
+    _texture->setTextureSize(_cellsWide * _cellSize, cellsHigh * _cellSize);
+    _texture->setInternalFormat(GL_RGBA8);
+    _texture->setSourceFormat(GL_RGBA);
+    _texture->setSourceType(GL_UNSIGNED_BYTE);
+    _texture->setFilter(osg::Texture::MIN_FILTER, osg::Texture::LINEAR);
+    _texture->setFilter(osg::Texture::MAG_FILTER, osg::Texture::LINEAR);
+    _texture->setWrap(osg::Texture::WRAP_S, osg::Texture::CLAMP_TO_EDGE);
+    _texture->setWrap(osg::Texture::WRAP_T, osg::Texture::CLAMP_TO_EDGE);
+    _texture->setResizeNonPowerOfTwoHint(false);
+    _texture->setUseHardwareMipMapGeneration(false);
+    _texture->setSubloadCallback(new Subloader(this));
+}
+
+VirtualTexture::Page*
+VirtualTexture::find(const PackedTileKey& key)
+{
+    UnorderedMap<PackedTileKey, Page>::iterator i = _table.find(key);
+    return i != _table.end() ? &i->second : 0L;
+}
+
+bool
+VirtualTexture::isCurrent(const Upload& upload)
+{
+    Page* page = find(upload._key);
+    return
+        page != 0L &&
+        page->_state == PAGE_UPLOADING &&
+        page->_serial == upload._serial;
+}
+
+bool
+VirtualTexture::getPage(const TileKey& key, unsigned frame, osg::Vec4f& out_page)
+{
+    PackedTileKey pk = key.pack();
+    if (!pk.valid())
+        return false;
+
+    ScopedMutexLock lock(_mutex);
+
+    Page& page = _table[pk];
+    page._lastUsed = frame;
+
+    if (page._state == PAGE_EMPTY && page._lastRequested != frame)
+    {
+        page._lastRequested = frame;
+        _requested.push_back(pk);
+    }
+
+    // Nearest resident page, the tile's own or an ancestor's:
+    Page* source = 0L;
+    PackedTileKey sk = pk;
+    for (; sk.valid(); sk = sk.getLOD() > 0u ? sk.createParentKey() : PackedTileKey())
+    {
+        Page* p = (sk == pk) ? &page : find(sk);
+        if (p && p->_state == PAGE_RESIDENT)
+        {
+            source = p;
+            break;
+        }
+    }
+
+    if (source == 0L)
+        return false;
+
+    source->_lastUsed = frame;
+
+    // The tile covers 1/n of its ancestor's page on each axis. Page rows
+    // run south to north while key rows run north to south.
+    unsigned levels = pk.getLOD() - sk.getLOD();
+    unsigned long long n = 1ull << levels;
+    unsigned long long cx = pk.getTileX() - ((unsigned long long)sk.getTileX() << levels);
+    unsigned long long cy = (n - 1ull) - (pk.getTileY() - ((unsigned long long)sk.getTileY() << levels));
+
+    double width = (double)_texture->getTextureWidth();
+    double height = (double)_texture->getTextureHeight();
+    double cellX = (double)((source->_cell % _cellsWide) * _cellSize + 1u);
+    double cellY = (double)((source->_cell / _cellsWide) * _cellSize + 1u);
+    double span = (double)_pageSize / (double)n;
+
+    out_page.set(
+        (float)(span / width),
+        (float)(span / height),
+        (float)((cellX + (double)cx * span) / width),
+        (float)((cellY + (double)cy * span) / height));
+
+    return true;
+}
+
+void
+VirtualTexture::update(unsigned frame)
+{
+    osg::ref_ptr<ImageLayer> layer;
+    if (!_layer.lock(layer))
+        return;
+
+    std::vector<std::pair<PackedTileKey, unsigned> > loads;
+    {
+        ScopedMutexLock lock(_mutex);
+
+        _frame = frame;
+
+        if ((int)layer->getRevision() != _layerRevision)
+        {
+            _layerRevision = layer->getRevision();
+            clear();
+        }
+
+        // Give loaded pages cells, coarsest first, since finer tiles
+        // fall back on them:
+        std::sort(_loaded.begin(), _loaded.end());
+        unsigned placed = 0u;
+        for (; placed < _loaded.size(); ++placed)
+        {
+            const PackedTileKey& key = _loaded[placed];
+            Page* page = find(key);
+            if (page == 0L || page->_state != PAGE_LOADED)
+                continue;
+
+            unsigned cell = allocateCell(frame);
+            if (cell == ~0u)
+                break;
+
+            page->_state = PAGE_UPLOADING;
+            page->_cell = cell;
+            _cells[cell] = key;
+
+            Upload upload;
+            upload._key = key;
+            upload._cell = cell;
+            upload._serial = page->_serial;
+            upload._image = page->_image;
+            upload._done = 0u;
+            _uploads.push_back(upload);
+            page->_image = 0L;
+        }
+        _loaded.erase(_loaded.begin(), _loaded.begin() + placed);
+
+        // Start loading the pages asked for, again coarsest first. Keep
+        // only as much in flight as a couple of frames can upload.
+        unsigned maxLoads = 2u * _uploadsPerFrame;
+        std::sort(_requested.begin(), _requested.end());
+        for (const auto& key : _requested)
+        {
+            if (_numLoading + _loaded.size() >= maxLoads)
+                break;
+
+            Page* page = find(key);
+            if (page == 0L || page->_state != PAGE_EMPTY)
+                continue;
+
+            page->_state = PAGE_LOADING;
+            page->_serial = ++_serial;
+            ++_numLoading;
+            loads.push_back(std::make_pair(key, page->_serial));
+        }
+
+        // The rest get asked for again if still in view.
+        _requested.clear();
+
+        if (frame % PRUNE_FRAMES == 0u)
+        {
+            for (UnorderedMap<PackedTileKey, Page>::iterator i = _table.begin(); i != _table.end(); )
+            {
+                const Page& page = i->second;
+                if ((page._state == PAGE_EMPTY || page._state == PAGE_NO_DATA) &&
+                    page._lastUsed + PRUNE_FRAMES < frame)
+                {
+                    i = _table.erase(i);
+                }
+                else ++i;
+            }
+        }
+    }
+
+    if (!loads.empty())
+    {
+        osg::ref_ptr<VirtualTexture> self(this);
+        JobArena* arena = Registry::instance()->getJobArena(ARENA_VIRTUAL_TEXTURE);
+        for (const auto& load : loads)
+        {
+            PackedTileKey key = load.first;
+            unsigned serial = load.second;
+            runInJobArena(arena, [self, key, serial]() {
+                self->load(key, serial);
+            });
+        }
+    }
+}
+
+void
+VirtualTexture::load(const PackedTileKey& key, unsigned serial)
+{
+    osg::ref_ptr<ImageLayer> layer;
+    {
+        ScopedMutexLock lock(_mutex);
+
+        // Skip pages no longer in view, or dropped since the job started
+        Page* page = find(key);
+        bool current = page && page->_state == PAGE_LOADING && page->_serial == serial;
+        if (current && (page->_lastUsed + 2u < _frame || !_layer.lock(layer)))
+        {
+            page->_state = PAGE_EMPTY;
+            current = false;
+        }
+
+        if (!current)
+        {
+            --_numLoading;
+            return;
+        }
+    }
+
+    TileKey tileKey(key, _profile.get());
+
+    osg::ref_ptr<osg::Image> image;
+    if (layer->isKeyInLegalRange(tileKey) && layer->mayHaveData(tileKey))
+    {
+        GeoImage geoImage = layer->createImage(tileKey);
+        if (geoImage.valid())
+            image = makePage(geoImage.getImage());
+    }
+
+    ScopedMutexLock lock(_mutex);
+
+    --_numLoading;
+
+    Page* page = find(key);
+    if (page && page->_state == PAGE_LOADING && page->_serial == serial)
+    {
+        if (image.valid())
+        {
+            page->_state = PAGE_LOADED;
+            page->_image = image.get();
+            _loaded.push_back(key);
+        }
+        else
+        {
+            // Finer tiles draw from an ancestor.
+            page->_state = PAGE_NO_DATA;
+        }
+    }
+}
+
+osg::Image*
+VirtualTexture::makePage(const osg::Image* image) const
+{
+    if (image == 0L || image->r() != 1)
+        return 0L;
+
+    osg::ref_ptr<const osg::Image> rgba = image;
+    if (image->getPixelFormat() != GL_RGBA ||
+        image->getDataType() != GL_UNSIGNED_BYTE ||
+        ImageUtils::isCompressed(image))
+    {
+        rgba = ImageUtils::convertToRGBA8(image);
+        if (!rgba.valid())
+            return 0L;
+    }
+
+    if (rgba->s() != (int)_pageSize || rgba->t() != (int)_pageSize)
+    {
+        osg::ref_ptr<osg::Image> resized;
+        if (!ImageUtils::resizeImage(rgba.get(), _pageSize, _pageSize, resized))
+            return 0L;
+        rgba = resized.get();
+    }
+
+    // Copy into a cell, replicating the edge texels into a one-texel
+    // gutter so filtering never reads a neighboring page.
+    osg::Image* page = new osg::Image();
+    page->allocateImage(_cellSize, _cellSize, 1, GL_RGBA, GL_UNSIGNED_BYTE);
+    page->setInternalTextureFormat(GL_RGBA8);
+
+    for (unsigned t = 0u; t < _cellSize; ++t)
+    {
+        unsigned srcRow = osg::clampBetween(t, 1u, _pageSize) - 1u;
+        const unsigned char* src = rgba->data(0, srcRow);
+        unsigned char* dst = page->data(0, t);
+
+        ::memcpy(dst, src, 4u);
+        ::memcpy(dst + 4u, src, 4u * _pageSize);
+        ::memcpy(dst + 4u * (_pageSize + 1u), src + 4u * (_pageSize - 1u), 4u);
+    }
+
+    return page;
+}
+
+void
+VirtualTexture::invalidate(const GeoExtent& extent, unsigned minLevel, unsigned maxLevel)
+{
+    ScopedMutexLock lock(_mutex);
+
+    if (!extent.isValid() && minLevel == 0u && maxLevel == ~0u)
+    {
+        clear();
+        return;
+    }
+
+    for (auto& i : _table)
+    {
+        const PackedTileKey& key = i.first;
+        if (key.getLOD() < minLevel || key.getLOD() > maxLevel)
+            continue;
+
+        if (extent.isValid() && !TileKey(key, _profile.get()).getExtent().intersects(extent))
+            continue;
+
+        dropPage(i.second);
+    }
+}
+
+void
+VirtualTexture::dropPage(Page& page)
+{
+    if (page._state == PAGE_UPLOADING || page._state == PAGE_RESIDENT)
+    {
+        if (page._state == PAGE_RESIDENT)
+            --_numResident;
+        _cells[page._cell] = PackedTileKey();
+        _freeCells.push_back(page._cell);
+    }
+
+    // a new serial makes any load or upload of the old page stale
+    page._state = PAGE_EMPTY;
+    page._cell = ~0u;
+    page._serial = ++_serial;
+    page._image = 0L;
+}
+
+void
+VirtualTexture::clear()
+{
+    // Loads and uploads in flight find their pages gone and drop out.
+    _table.clear();
+    _requested.clear();
+    _loaded.clear();
+    _numResident = 0u;
+
+    _cells.assign(_numCells, PackedTileKey());
+    _freeCells.clear();
+    for (unsigned c = _numCells; c > 0u; --c)
+        _freeCells.push_back(c - 1u);
+}
+
+unsigned
+VirtualTexture::allocateCell(unsigned frame)
+{
+    if (_freeCells.empty())
+    {
+        // Evict the least recently used page not drawn in the last two
+        // frames, which might still be in flight to the GPU.
+        Page* lru = 0L;
+        for (const auto& key : _cells)
+        {
+            Page* page = key.valid() ? find(key) : 0L;
+            if (page &&
+                page->_state == PAGE_RESIDENT &&
+                page->_lastUsed + 2u <= frame &&
+                (lru == 0L || page->_lastUsed < lru->_lastUsed))
+            {
+                lru = page;
+            }
+        }
+
+        if (lru == 0L)
+            return ~0u;
+
+        dropPage(*lru);
+    }
+
+    unsigned cell = _freeCells.back();
+    _freeCells.pop_back();
+    return cell;
+}
+
+void
+VirtualTexture::allocate(osg::State& state)
+{
+    ScopedMutexLock lock(_mutex);
+
+    PerContext& pc = _pcs[state.getContextID()];
+    if (!pc._loaded)
+    {
+        pc._loaded = true;
+        ++_numContexts;
+    }
+
+    // Pages already resident elsewhere aren't in this context's copy,
+    // so start over.
+    if (_numResident > 0u)
+        clear();
+
+    pc._cursor = _uploadsBegin;
+}
+
+void
+VirtualTexture::upload(osg::State& state)
+{
+    unsigned frame = state.getFrameStamp() ? state.getFrameStamp()->getFrameNumber() : 0u;
+
+    std::vector<Upload> batch;
+    std::vector<unsigned long long> sequence;
+    {
+        ScopedMutexLock lock(_mutex);
+
+        PerContext& pc = _pcs[state.getContextID()];
+        if (!pc._loaded || pc._lastFrame == frame)
+            return;
+        pc._lastFrame = frame;
+
+        pc._cursor = osg::maximum(pc._cursor, _uploadsBegin);
+        unsigned long long end = _uploadsBegin + _uploads.size();
+
+        while (batch.size() < _uploadsPerFrame && pc._cursor < end)
+        {
+            const Upload& upload = _uploads[pc._cursor - _uploadsBegin];
+            if (isCurrent(upload))
+            {
+                batch.push_back(upload);
+                sequence.push_back(pc._cursor);
+            }
+            ++pc._cursor;
+        }
+    }
+
+    if (batch.empty())
+        return;
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+
+    for (const auto& upload : batch)
+    {
+        glTexSubImage2D(
+            GL_TEXTURE_2D, 0,
+            (upload._cell % _cellsWide) * _cellSize,
+            (upload._cell / _cellsWide) * _cellSize,
+            _cellSize, _cellSize,
+            GL_RGBA, GL_UNSIGNED_BYTE,
+            upload._image->data());
+    }
+
+    ScopedMutexLock lock(_mutex);
+
+    for (auto seq : sequence)
+    {
+        if (seq < _uploadsBegin)
+            continue;
+
+        Upload& upload = _uploads[seq - _uploadsBegin];
+        if (++upload._done >= _numContexts && isCurrent(upload))
+        {
+            find(upload._key)->_state = PAGE_RESIDENT;
+            ++_numResident;
+        }
+    }
+
+    while (!_uploads.empty() &&
+        (_uploads.front()._done >= _numContexts || !isCurrent(_uploads.front())))
+    {
+        _uploads.pop_front();
+        ++_uploadsBegin;
+    }
+}
+
+unsigned
+VirtualTexture::getNumResidentPages() const
+{
+    ScopedMutexLock lock(_mutex);
+    return _numResident;
+}
+
+void
+VirtualTexture::resizeGLObjectBuffers(unsigned maxSize)
+{
+    _texture->resizeGLObjectBuffers(maxSize);
+
+    ScopedMutexLock lock(_mutex);
+    if (_pcs.size() < maxSize)
+        _pcs.resize(maxSize);
+}
+
+void
+VirtualTexture::releaseGLObjects(osg::State* state) const
+{
+    _texture->releaseGLObjects(state);
+
+    ScopedMutexLock lock(_mutex);
+    for (unsigned i = 0; i < _pcs.size(); ++i)
+    {
+        if (state == 0L || state->getContextID() == i)
+        {
+            if (_pcs[i]._loaded)
+                --_numContexts;
+            _pcs[i] = PerContext();
+        }
+    }
+}
@@ -99,6 +99,10 @@ VisibleLayer::setVisible(bool value)
 {
     options().visible() = value;
 
+    // a layer that put off opening until it was shown opens now
+    if (value && isOpenDeferred())
+        openOnDemand();
+
     // if this layer has a scene graph node, toggle its node mask
     osg::Node* node = getNode();
     if (node)
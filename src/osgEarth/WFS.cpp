@@ -25,6 +25,7 @@
 
 #include <osgEarth/Filter>
 #include <osgEarth/OgrUtils>
+#include <osgEarth/OGRFeatureSource>
 
 #include <osg/Notify>
 #include <osgDB/FileNameUtils>
@@ -314,97 +315,6 @@ WFSFeatureSource::openImplementation()
 
 
 
-void
-WFSFeatureSource::saveResponse(const std::string buffer, const std::string& filename)
-{
-    std::ofstream fout;
-    fout.open(filename.c_str(), std::ios::out | std::ios::binary);
-    fout.write(buffer.c_str(), buffer.size());
-    fout.close();
-}
-
-bool
-WFSFeatureSource::getFeatures(const std::string& buffer, const std::string& mimeType, FeatureList& features)
-{
-    // Unnecessary - dataset is created and destroyed locally
-    //OGR_SCOPED_LOCK;
-
-    bool json = isJSON(mimeType);
-    bool gml = isGML(mimeType);
-
-    // find the right driver for the given mime type
-    OGRSFDriverH ogrDriver =
-        json ? OGRGetDriverByName("GeoJSON") :
-        gml ? OGRGetDriverByName("GML") :
-        0L;
-
-    // fail if we can't find an appropriate OGR driver:
-    if (!ogrDriver)
-    {
-        OE_WARN << LC << "Error reading WFS response; cannot grok content-type \"" << mimeType << "\""
-            << std::endl;
-        return false;
-    }
-
-    std::string tmpName;
-
-    OGRDataSourceH ds = 0;
-    //GML needs to be saved to a temp file to load from disk.  GeoJSON can be loaded directly from memory
-    if (gml)
-    {
-        std::string ext = getExtensionForMimeType(mimeType);
-        //Save the response to a temp file
-        std::string tmpPath = getTempPath();
-        tmpName = getTempName(tmpPath, ext);
-        saveResponse(buffer, tmpName);
-        ds = OGROpen(tmpName.c_str(), FALSE, &ogrDriver);
-    }
-    else if (json)
-    {
-        //Open GeoJSON directly from memory
-        ds = OGROpen(buffer.c_str(), FALSE, &ogrDriver);
-    }
-
-
-    if (!ds)
-    {
-        OE_WARN << LC << "Error reading WFS response" << std::endl;
-        return false;
-    }
-
-    // read the feature data.
-    OGRLayerH layer = OGR_DS_GetLayer(ds, 0);
-    if (layer)
-    {
-        OGR_L_ResetReading(layer);
-        OGRFeatureH feat_handle;
-        while ((feat_handle = OGR_L_GetNextFeature(layer)) != NULL)
-        {
-            if (feat_handle)
-            {
-                osg::ref_ptr<Feature> f = OgrUtils::createFeature(feat_handle, getFeatureProfile(), *_options->rewindPolygons());
-                if (f.valid() && !isBlacklisted(f->getFID()))
-                {
-                    features.push_back(f.release());
-                }
-                OGR_F_Destroy(feat_handle);
-            }
-        }
-    }
-
-    // Destroy the datasource
-    OGR_DS_Destroy(ds);
-
-    //Delete the temp file if one was created
-    if (!tmpName.empty())
-    {
-        remove(tmpName.c_str());
-    }
-
-    return true;
-}
-
-
 std::string
 WFSFeatureSource::getExtensionForMimeType(const std::string& mime)
 {
@@ -506,8 +416,6 @@ WFSFeatureSource::createURL(const Query& query) const
 FeatureCursor*
 WFSFeatureSource::createFeatureCursorImplementation(const Query& query, ProgressCallback* progress)
 {
-    FeatureCursor* result = 0L;
-
     std::string url = createURL(query);
 
     OE_DEBUG << LC << url << std::endl;
@@ -517,48 +425,44 @@ WFSFeatureSource::createFeatureCursorImplementation(const Query& query, Progress
     ReadResult r = uri.readString(getReadOptions(), progress);
 
     const std::string& buffer = r.getString();
-    const Config&      meta = r.metadata();
+    if (buffer.empty())
+        return 0L;
 
-    bool dataOK = false;
+    // Get the mime-type from the metadata record if possible
+    const std::string& mimeType = r.metadata().value(IOMetadata::CONTENT_TYPE);
 
-    FeatureList features;
-    if (!buffer.empty())
-    {
-        // Get the mime-type from the metadata record if possible
-        const std::string& mimeType = r.metadata().value(IOMetadata::CONTENT_TYPE);
-        dataOK = getFeatures(buffer, mimeType, features);
-    }
-
-    if (dataOK)
-    {
-        OE_DEBUG << LC << "Read " << features.size() << " features" << std::endl;
-    }
+    // find the right driver for the given mime type
+    std::string driverName =
+        isJSON(mimeType) ? "GeoJSON" :
+        isGML(mimeType) ? "GML" :
+        "";
 
-    //If we have any filters, process them here before the cursor is created
-    if (getFilters() && !getFilters()->empty() && !features.empty())
+    // fail if we can't find an appropriate OGR driver:
+    if (driverName.empty())
     {
-        FilterContext cx;
-        cx.setProfile(getFeatureProfile());
-
-        for (FeatureFilterChain::const_iterator i = getFilters()->begin(); i != getFilters()->end(); ++i)
-        {
-            FeatureFilter* filter = i->get();
-            cx = filter->push(features, cx);
-        }
+        OE_WARN << LC << "Error reading WFS response; cannot grok content-type \"" << mimeType << "\""
+            << std::endl;
+        return 0L;
     }
 
-    // If we have any features and we have an fid attribute, override the fid of the features
-    if (options().fidAttribute().isSet())
+    // Features are decoded (and filtered) a chunk at a time as the caller reads them,
+    // instead of all at once up front.
+    FeatureCursor* result = OGR::OGRFeatureCursor::openDocument(
+        buffer,
+        driverName,
+        getExtensionForMimeType(mimeType),
+        this,
+        getFeatureProfile(),
+        query,
+        getFilters(),
+        options().fidAttribute().isSet() ? options().fidAttribute().get() : std::string(),
+        progress,
+        *options().rewindPolygons());
+
+    if (!result)
     {
-        for (FeatureList::iterator itr = features.begin(); itr != features.end(); ++itr)
-        {
-            std::string attr = itr->get()->getString(options().fidAttribute().get());
-            FeatureID fid = as<FeatureID>(attr, 0);
-            itr->get()->setFID(fid);
-        }
+        OE_WARN << LC << "Error reading WFS response" << std::endl;
     }
 
-    result = dataOK ? new FeatureListCursor(features) : 0L;
-
     return result;
 }
\ No newline at end of file
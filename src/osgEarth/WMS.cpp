@@ -21,6 +21,11 @@
 #include <osgEarth/Registry>
 #include <osgEarth/StringUtils>
 #include <osgEarth/Registry>
+#include <osgEarth/ImageUtils>
+#include <osgEarth/MapNode>
+#include <osgEarth/NodeUtils>
+#include <osgEarth/TerrainEngineNode>
+#include <osgEarth/Threading>
 #include <osg/ImageSequence>
 #include <osgDB/FileNameUtils>
 #include <osgDB/FileUtils>
@@ -31,6 +36,15 @@ using namespace osgEarth::Util;
 #undef LC
 #define LC "[WMS] "
 
+// arena in which WMS-T time steps are fetched for texture-array tiles
+#define FRAME_ARENA_NAME "wms.frames"
+
+// number of fetched time steps (single tile images) kept in memory
+#define FRAME_CACHE_SIZE 512
+
+// most tiles remembered for prefetching the next window of time steps
+#define MAX_RECENT_KEYS 1024
+
 //........................................................................
 
 WMS::Style::Style()
@@ -360,6 +374,8 @@ WMS::WMSImageLayerOptions::getMetadata()
             { "name": "crs", "description", "CRS name to request", "type": "string", "default": "" },
             { "name": "transparent", "description", "Whether to set the transparent flag in WMS requests", "type": "boolean", "default": "false" },
             { "name": "times", "description", "List of timestamps for WMS-T", "type": "string", "default": "" },
+            { "name": "frames_per_tile", "description", "Number of WMS-T time steps per tile texture array; 0 for image sequences", "type": "integer", "default": "0" },
+            { "name": "interpolate_frames", "description", "Whether to blend between WMS-T time steps", "type": "boolean", "default": "true" },
           ]
         }
     ) );
@@ -381,6 +397,8 @@ WMS::WMSImageLayerOptions::getConfig() const
     conf.set("transparent", _transparent);
     conf.set("times", _times);
     conf.set("seconds_per_frame", _secondsPerFrame);
+    conf.set("frames_per_tile", _framesPerTile);
+    conf.set("interpolate_frames", _interpolateFrames);
     return conf;
 }
 
@@ -390,6 +408,8 @@ WMS::WMSImageLayerOptions::fromConfig(const Config& conf)
     _wmsVersion.init("1.1.1");
     _transparent.init(true);
     _secondsPerFrame.init(1.0);
+    _framesPerTile.init(0u);
+    _interpolateFrames.init(true);
 
     conf.get("url", _url);
     conf.get("capabilities_url", _capabilitiesUrl);
@@ -404,6 +424,8 @@ WMS::WMSImageLayerOptions::fromConfig(const Config& conf)
     conf.get("times", _times);
     conf.get("time", _times); // alternative
     conf.get("seconds_per_frame", _secondsPerFrame);
+    conf.get("frames_per_tile", _framesPerTile);
+    conf.get("interpolate_frames", _interpolateFrames);
 }
 
 //........................................................................
@@ -428,7 +450,11 @@ namespace osgEarth {  namespace WMS
 //! Construct the WMS driver
 WMS::Driver::Driver(const WMS::WMSImageLayerOptions& myOptions,
                     SequenceControl* sequence,
-                    const osgDB::Options* readOptions)
+                    const osgDB::Options* readOptions) :
+    _framesPerTile(0u),
+    _windowBase(0u),
+    _frameCache(true, FRAME_CACHE_SIZE),
+    _recentKeysMutex(OE_MUTEX_NAME)
 {
     _sequence = sequence;
     _options = &myOptions;
@@ -456,6 +482,12 @@ WMS::Driver::open(osg::ref_ptr<const Profile>& profile,
             _seqFrameInfoVec.push_back(SequenceFrameInfo());
             _seqFrameInfoVec.back().timeIdentifier = _timesVec[i];
         }
+
+        if (_timesVec.size() > 1u && options().framesPerTile().get() > 0u)
+        {
+            // at least two, to blend between
+            _framesPerTile = osg::clampBetween(options().framesPerTile().get(), 2u, (unsigned)_timesVec.size());
+        }
     }
 
     // localize it since we might override them:
@@ -643,7 +675,11 @@ WMS::Driver::createImage(const TileKey& key, ProgressCallback* progress) const
 {
     osg::ref_ptr<osg::Image> image;
 
-    if (_timesVec.size() > 1)
+    if (_timesVec.size() > 1 && _framesPerTile > 0u)
+    {
+        image = createImageArray(key, progress);
+    }
+    else if (_timesVec.size() > 1)
     {
         image = createImageSequence(key, progress);
     }
@@ -695,6 +731,162 @@ WMS::Driver::createImageSequence(const TileKey& key, ProgressCallback* progress)
     return seq.release();
 }
 
+void
+WMS::Driver::fetchFrames(const TileKey& key,
+                         const std::vector<unsigned>& frames,
+                         std::vector<osg::ref_ptr<osg::Image> >& out_images,
+                         ProgressCallback* progress) const
+{
+    typedef Threading::Future<osg::Image> ImageFuture;
+    std::vector<ImageFuture> futures(frames.size());
+    out_images.assign(frames.size(), 0L);
+
+    Threading::JobArena* arena = Registry::instance()->getJobArena(FRAME_ARENA_NAME);
+    osg::ref_ptr<const Driver> self = this;
+    osg::ref_ptr<ProgressCallback> safeProgress = progress;
+
+    // start a fetch for every time step that isn't in memory...
+    for (unsigned i = 0; i < frames.size(); ++i)
+    {
+        LRUCache<FrameKey, osg::ref_ptr<osg::Image> >::Record rec;
+        if (_frameCache.get(FrameKey(key, frames[i]), rec))
+        {
+            out_images[i] = rec.value();
+            continue;
+        }
+
+        Threading::Promise<osg::Image> promise;
+        futures[i] = promise.getFuture();
+        unsigned frame = frames[i];
+
+        Threading::runInJobArena(arena, [self, key, frame, promise, safeProgress]() mutable
+        {
+            if (promise.isCanceled())
+                return;
+
+            ReadResult response;
+            osg::ref_ptr<osg::Image> image = self->fetchTileImage(
+                key, std::string("TIME=") + self->_timesVec[frame], safeProgress.get(), response);
+
+            if (image.valid())
+                self->_frameCache.insert(FrameKey(key, frame), image);
+
+            promise.resolve(image.get());
+        });
+    }
+
+    // ...and wait for them together.
+    for (unsigned i = 0; i < frames.size(); ++i)
+    {
+        if (!out_images[i].valid() && !futures[i].isAbandoned())
+            out_images[i] = futures[i].get(progress);
+    }
+}
+
+//! Creates a texture array with one time step per slice
+osg::Image*
+WMS::Driver::createImageArray(const TileKey& key, ProgressCallback* progress) const
+{
+    {
+        Threading::ScopedMutexLock lock(_recentKeysMutex);
+        if (_recentKeys.size() < MAX_RECENT_KEYS)
+            _recentKeys.insert(key);
+    }
+
+    unsigned base = _windowBase;
+    std::vector<unsigned> frames(_framesPerTile);
+    for (unsigned i = 0; i < _framesPerTile; ++i)
+        frames[i] = (base + i) % _timesVec.size();
+
+    std::vector<osg::ref_ptr<osg::Image> > images;
+    fetchFrames(key, frames, images, progress);
+
+    if (progress && progress->isCanceled())
+        return 0L;
+
+    // every slice takes the size of the first time step that came back
+    const osg::Image* first = 0L;
+    for (unsigned i = 0; i < images.size() && !first; ++i)
+        first = images[i].get();
+
+    if (!first)
+        return 0L;
+
+    osg::ref_ptr<osg::Image> output = new osg::Image();
+    output->allocateImage(first->s(), first->t(), images.size(), GL_RGBA, GL_UNSIGNED_BYTE);
+    output->setInternalTextureFormat(GL_RGBA8);
+    ::memset(output->data(), 0, output->getTotalSizeInBytes());
+
+    for (unsigned r = 0; r < images.size(); ++r)
+    {
+        osg::ref_ptr<osg::Image> slice = images[r].get();
+        if (!slice.valid())
+            continue; // leave the missing time step transparent
+
+        if (slice->getPixelFormat() != GL_RGBA || slice->getDataType() != GL_UNSIGNED_BYTE || slice->getPacking() != 1)
+            slice = ImageUtils::convertToRGBA8(slice.get());
+
+        if (slice.valid() && (slice->s() != output->s() || slice->t() != output->t()))
+        {
+            osg::ref_ptr<osg::Image> resized;
+            ImageUtils::resizeImage(slice.get(), output->s(), output->t(), resized);
+            slice = resized.get();
+        }
+
+        if (slice.valid())
+            ::memcpy(output->data(0, 0, r), slice->data(), output->getImageSizeInBytes());
+    }
+
+    return output.release();
+}
+
+void
+WMS::Driver::setFrameWindow(unsigned base)
+{
+    _windowBase = base % _timesVec.size();
+
+    // Tiles will reload with the new window, so fetch the one after it
+    // for the tiles that are showing now.
+    std::set<TileKey> keys;
+    {
+        Threading::ScopedMutexLock lock(_recentKeysMutex);
+        keys.swap(_recentKeys);
+    }
+
+    if (keys.empty())
+        return;
+
+    unsigned next = _windowBase + _framesPerTile - 1u;
+    std::vector<unsigned> frames;
+    for (unsigned i = 0; i < _framesPerTile; ++i)
+        frames.push_back((next + i) % _timesVec.size());
+
+    Threading::JobArena* arena = Registry::instance()->getJobArena(FRAME_ARENA_NAME);
+    osg::ref_ptr<const Driver> self = this;
+
+    // one job per time step; a job that waited on others in the same
+    // arena could starve it
+    for (std::set<TileKey>::const_iterator key = keys.begin(); key != keys.end(); ++key)
+    {
+        for (unsigned i = 0; i < frames.size(); ++i)
+        {
+            TileKey k = *key;
+            unsigned frame = frames[i];
+            if (_frameCache.has(FrameKey(k, frame)))
+                continue;
+
+            Threading::runInJobArena(arena, [self, k, frame]()
+            {
+                ReadResult response;
+                osg::ref_ptr<osg::Image> image = self->fetchTileImage(
+                    k, std::string("TIME=") + self->_timesVec[frame], 0L, response);
+                if (image.valid())
+                    self->_frameCache.insert(FrameKey(k, frame), image);
+            });
+        }
+    }
+}
+
 //! Generates a URI for a tile key using the WMS request prototype
 std::string
 WMS::Driver::createURI(const TileKey& key) const
@@ -755,6 +947,34 @@ OE_LAYER_PROPERTY_IMPL(WMSImageLayer, std::string, CRS, crs);
 OE_LAYER_PROPERTY_IMPL(WMSImageLayer, bool, Transparent, transparent);
 OE_LAYER_PROPERTY_IMPL(WMSImageLayer, std::string, Times, times);
 OE_LAYER_PROPERTY_IMPL(WMSImageLayer, double, SecondsPerFrame, secondsPerFrame);
+OE_LAYER_PROPERTY_IMPL(WMSImageLayer, unsigned, FramesPerTile, framesPerTile);
+OE_LAYER_PROPERTY_IMPL(WMSImageLayer, bool, InterpolateFrames, interpolateFrames);
+
+// Advances time-series animation during the update traversal.
+class WMSImageLayer::UpdateNode : public osg::Group
+{
+public:
+    UpdateNode(WMSImageLayer* layer) : _layer(layer)
+    {
+        ADJUST_UPDATE_TRAV_COUNT(this, +1);
+    }
+
+    void traverse(osg::NodeVisitor& nv)
+    {
+        if (nv.getVisitorType() == nv.UPDATE_VISITOR && nv.getFrameStamp())
+        {
+            osg::ref_ptr<WMSImageLayer> layer;
+            if (_layer.lock(layer))
+            {
+                MapNode* mapNode = findInNodePath<MapNode>(nv);
+                layer->updateTimeSeries(nv.getFrameStamp(), mapNode ? mapNode->getTerrainEngine() : 0L);
+            }
+        }
+        osg::Group::traverse(nv);
+    }
+
+    osg::observer_ptr<WMSImageLayer> _layer;
+};
 
 
 void
@@ -762,11 +982,22 @@ WMSImageLayer::init()
 {
     ImageLayer::init();
     _isPlaying = false;
+    _time = 0.0;
+    _lastSimulationTime = -1.0;
 }
 
 Status
 WMSImageLayer::openImplementation()
 {
+    // A moving window of time steps would go stale in a persistent cache
+    if (options().framesPerTile().get() > 0u && options().times().isSet())
+    {
+        StringVector times;
+        StringTokenizer(options().times().get(), times, ",", "", false, true);
+        if (times.size() > options().framesPerTile().get())
+            layerHints().cachePolicy() = CachePolicy::NO_CACHE;
+    }
+
     Status parent = ImageLayer::openImplementation();
     if (parent.isError())
         return parent;
@@ -788,9 +1019,70 @@ WMSImageLayer::openImplementation()
         setProfile(profile.get());
     }
 
+    // Texture-array tiles: the terrain shader blends the two time steps
+    // around the current time, which the update node advances.
+    if (driver->getFramesPerTile() > 0u)
+    {
+        osg::StateSet* ss = getOrCreateStateSet();
+        ss->setDefine("OE_LAYER_TIME_SERIES");
+        _timeFrameUniform = new osg::Uniform("oe_layer_timeFrame", osg::Vec3f(0.0f, 1.0f, 0.0f));
+        ss->addUniform(_timeFrameUniform.get());
+        _node = new UpdateNode(this);
+    }
+
     return Status::NoError;
 }
 
+osg::Node*
+WMSImageLayer::getNode() const
+{
+    return _node.get();
+}
+
+void
+WMSImageLayer::updateTimeSeries(const osg::FrameStamp* fs, TerrainEngineNode* engine)
+{
+    WMS::Driver* driver = static_cast<WMS::Driver*>(_driver.get());
+    if (!driver || driver->getFramesPerTile() == 0u)
+        return;
+
+    double simTime = fs->getSimulationTime();
+    if (_isPlaying && _lastSimulationTime >= 0.0 && getSecondsPerFrame() > 0.0)
+    {
+        _time += (simTime - _lastSimulationTime) / getSecondsPerFrame();
+    }
+    _lastSimulationTime = simTime;
+
+    unsigned count = driver->getSequenceFrameInfo().size();
+    _time = fmod(_time, (double)count);
+    if (_time < 0.0)
+        _time += (double)count;
+
+    unsigned frame = osg::minimum((unsigned)_time, count - 1u);
+    float blend = getInterpolateFrames() ? (float)(_time - floor(_time)) : 0.0f;
+
+    unsigned n = driver->getFramesPerTile();
+    unsigned offset = (frame + count - driver->getFrameWindow()) % count;
+
+    // When the tiles don't hold both time steps around the current time,
+    // move the window to start at the current one and reload the tiles.
+    if (n < count && offset + 1u >= n)
+    {
+        driver->setFrameWindow(frame);
+        offset = 0u;
+        bumpRevision();
+
+        if (engine)
+        {
+            std::vector<const Layer*> layers(1, this);
+            engine->invalidateRegion(layers, GeoExtent::INVALID, 0u, INT_MAX);
+        }
+    }
+
+    unsigned next = n < count ? offset + 1u : (offset + 1u) % count;
+    _timeFrameUniform->set(osg::Vec3f((float)offset, (float)next, blend));
+}
+
 GeoImage
 WMSImageLayer::createImageImplementation(const TileKey& key, ProgressCallback* progress) const
 {
@@ -829,7 +1121,8 @@ WMSImageLayer::pauseSequence()
 void
 WMSImageLayer::seekToSequenceFrame(unsigned frame)
 {
-    //todo
+    // only texture-array tiles can seek
+    _time = (double)frame;
 }
 
 /** Whether the object is in playback mode */
@@ -852,5 +1145,7 @@ int
 WMSImageLayer::getCurrentSequenceFrameIndex(const osg::FrameStamp* fs) const
 {
     WMS::Driver* driver = static_cast<WMS::Driver*>(_driver.get());
+    if (driver->getFramesPerTile() > 0u)
+        return (int)_time;
     return driver->getCurrentSequenceFrameIndex(fs, options().secondsPerFrame().get());
 }
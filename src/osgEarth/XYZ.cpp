@@ -237,6 +237,8 @@ XYZImageLayer::createImageImplementation(const TileKey& key, ProgressCallback* p
 
     if (r.succeeded())
         return GeoImage(r.releaseImage(), key.getExtent());
+    else if (r.code() == ReadResult::RESULT_NOT_FOUND)
+        return GeoImage(Status(Status::ResourceUnavailable, r.errorDetail()));
     else
         return GeoImage(Status(r.errorDetail()));
 }
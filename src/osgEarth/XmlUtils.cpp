@@ -20,7 +20,9 @@
 #include <osgEarth/XmlUtils>
 
 #include "tinyxml.h"
-
+#include <osgEarth/rapidxml.hpp>
+#include <cctype>
+#include <memory>
 
 using namespace osgEarth;
 using namespace osgEarth::Util;
@@ -491,6 +493,182 @@ XmlDocument::getConfig() const
     return conf;
 }
 
+namespace
+{
+    typedef rapidxml::xml_node<> RNode;
+    typedef rapidxml::xml_attribute<> RAttr;
+
+    // Lowercases a name in the parse buffer (which we own) and makes a key of it
+    std::string toKey(char* name, std::size_t size)
+    {
+        for (std::size_t i = 0; i < size; ++i)
+            name[i] = (char)::tolower((unsigned char)name[i]);
+        return std::string(name, size);
+    }
+
+    // Replaces an xi:include element with the root of the document it names.
+    void buildInclude(RNode* node, const std::string& referrer, ConfigSet& siblings)
+    {
+        std::string href;
+        for (RAttr* a = node->first_attribute(); a; a = a->next_attribute())
+        {
+            if (osgEarth::ciEquals(a->name(), "href"))
+                href.assign(a->value(), a->value_size());
+        }
+
+        if (href.empty())
+        {
+            OE_WARN << "Missing href with xi:include" << std::endl;
+            siblings.push_back(Config());
+            return;
+        }
+
+        URIContext uriContext(referrer);
+        URI uri(href, uriContext);
+        std::string fullURI = uri.full();
+        OE_DEBUG << "Loading href from " << fullURI << std::endl;
+
+        Config doc;
+        if (XmlDocument::readConfig(URI(fullURI), 0L, doc) && !doc.children().empty())
+        {
+            // splice rather than copy; the included tree might be big
+            siblings.splice(siblings.end(), doc.children(), doc.children().begin());
+            siblings.back().setExternalRef(href);
+            siblings.back().setReferrer(fullURI);
+        }
+        else
+        {
+            OE_WARN << "Failed to load xi:include from " << fullURI << std::endl;
+            siblings.push_back(Config());
+        }
+    }
+
+    // Same semantics as XmlElement::getConfig. Children are built in place
+    // and get their referrer before they have children of their own, so
+    // nothing is copied or re-walked on the way up.
+    void buildConfig(RNode* node, const std::string& referrer, Config& conf)
+    {
+        conf.setReferrer(referrer);
+
+        // attributes come first, sorted, last one wins
+        XmlAttributes attrs;
+        for (RAttr* a = node->first_attribute(); a; a = a->next_attribute())
+        {
+            attrs[toKey(a->name(), a->name_size())].assign(a->value(), a->value_size());
+        }
+        for (XmlAttributes::const_iterator a = attrs.begin(); a != attrs.end(); ++a)
+        {
+            conf.add(a->first, a->second);
+        }
+
+        std::string text;
+        for (RNode* c = node->first_node(); c; c = c->next_sibling())
+        {
+            if (c->type() == rapidxml::node_element)
+            {
+                std::string key = toKey(c->name(), c->name_size());
+                if (key == "xi:include")
+                {
+                    buildInclude(c, referrer, conf.children());
+                }
+                else
+                {
+                    conf.children().push_back(Config(key));
+                    buildConfig(c, referrer, conf.children().back());
+                }
+            }
+            else if (c->type() == rapidxml::node_data || c->type() == rapidxml::node_cdata)
+            {
+                text.append(c->value(), c->value_size());
+            }
+        }
+
+        conf.setValue(trim(text));
+    }
+
+    // Parses with rapidxml; false means "use the TinyXML path instead", either
+    // because the document is malformed (TinyXML reports errors in more detail)
+    // or because it has no root element.
+    bool parseConfig(std::string& xmlStr, const std::string& referrer, Config& out)
+    {
+        std::unique_ptr<rapidxml::xml_document<> > doc(new rapidxml::xml_document<>());
+        try
+        {
+            doc->parse<
+                rapidxml::parse_trim_whitespace |
+                rapidxml::parse_normalize_whitespace |
+                rapidxml::parse_validate_closing_tags>(&xmlStr[0]);
+        }
+        catch (const rapidxml::parse_error& e)
+        {
+            OE_DEBUG << "rapidxml: " << e.what() << "; retrying with TinyXML" << std::endl;
+            return false;
+        }
+
+        RNode* root = doc->first_node();
+        while (root && root->type() != rapidxml::node_element)
+            root = root->next_sibling();
+        if (!root)
+            return false;
+
+        // resolve the referrer once here instead of once per node
+        out = Config("Document");
+        out.setReferrer(referrer);
+
+        std::string key = toKey(root->name(), root->name_size());
+        if (key == "xi:include")
+        {
+            buildInclude(root, out.referrer(), out.children());
+        }
+        else
+        {
+            out.children().push_back(Config(key));
+            buildConfig(root, out.referrer(), out.children().back());
+        }
+        return true;
+    }
+}
+
+bool
+XmlDocument::readConfig( std::istream& in, const URIContext& uriContext, Config& out )
+{
+    std::stringstream buffer;
+    buffer << in.rdbuf();
+    std::string xmlStr = buffer.str();
+
+    // rapidxml parses in place, so keep the original for the fallback
+    std::string parseBuf = xmlStr;
+    if (parseConfig(parseBuf, URI("", uriContext).full(), out))
+        return true;
+
+    std::stringstream buf(xmlStr);
+    osg::ref_ptr<XmlDocument> doc = load(buf, uriContext);
+    if (doc.valid())
+        out = doc->getConfig();
+    return doc.valid();
+}
+
+bool
+XmlDocument::readConfig( const URI& uri, const osgDB::Options* dbOptions, Config& out )
+{
+    ReadResult r = uri.readString( dbOptions );
+    if ( !r.succeeded() )
+        return false;
+
+    std::string parseBuf = r.getString();
+    if (parseConfig(parseBuf, uri.full(), out))
+        return true;
+
+    std::stringstream buf( r.getString() );
+    osg::ref_ptr<XmlDocument> doc = load( buf, URIContext(uri.full()) );
+    if (doc.valid())
+    {
+        doc->_sourceURI = uri;
+        out = doc->getConfig();
+    }
+    return doc.valid();
+}
+
 namespace
 {
     void storeNode(const XmlNode* node, TiXmlNode* parent)
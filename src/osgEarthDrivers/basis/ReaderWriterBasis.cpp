@@ -26,6 +26,16 @@
 #include <osgDB/FileUtils>
 
 #include <basisu/transcoder/basisu_transcoder.h>
+#include <cstring>
+
+// Basis Universal 1.16 added the KTX2 container (and dropped the global
+// selector codebook along with the old block size call).
+#if defined(BASISD_SUPPORT_KTX2) && BASISD_SUPPORT_KTX2
+#define OE_BASIS_KTX2 1
+#define OE_BASIS_BYTES_PER_BLOCK basist::basis_get_bytes_per_block_or_pixel
+#else
+#define OE_BASIS_BYTES_PER_BLOCK basist::basis_get_bytes_per_block
+#endif
 
 using namespace basisu;
 
@@ -35,10 +45,15 @@ public:
     ReaderWriterBasis()
     {
         supportsExtension("basis", "Basis image format");
+#ifdef OE_BASIS_KTX2
+        supportsExtension("ktx2", "KTX2 image format (Basis Universal)");
+#endif
 
         // one-time initialization at startup
         basist::basisu_transcoder_init();
+#ifndef OE_BASIS_KTX2
         sel_codebook = basist::etc1_global_selector_codebook(basist::g_global_selector_cb_size, basist::g_global_selector_cb);
+#endif
     }
 
     virtual const char* className() const { return "Basis Universal Image Reader/Writer"; }
@@ -62,7 +77,18 @@ public:
         char* data = new char[length];
         fin.read(data, length);
 
+#ifdef OE_BASIS_KTX2
+        if (isKTX2(data, length))
+        {
+            ReadResult result = readKTX2(data, length);
+            delete [] data;
+            return result;
+        }
+
+        basist::basisu_transcoder transcoder;
+#else
         basist::basisu_transcoder transcoder(&sel_codebook);
+#endif
 
         unsigned int numImages = transcoder.get_total_images(data, length);
 
@@ -116,7 +142,7 @@ public:
                 basist::basisu_image_level_info level_info;
                 transcoder.get_image_level_info(data, length, level_info, 0, levelIndex);
 
-                unsigned int bytesPerBlock = basist::basis_get_bytes_per_block(transcoder_texture_format);
+                unsigned int bytesPerBlock = OE_BASIS_BYTES_PER_BLOCK(transcoder_texture_format);
                 unsigned int levelSize = bytesPerBlock * level_info.m_total_blocks;
                 totalSize += levelSize;
             }
@@ -168,7 +194,72 @@ public:
     }
 
 private:
+#ifdef OE_BASIS_KTX2
+    static bool isKTX2(const char* data, int length)
+    {
+        static const unsigned char identifier[12] = {
+            0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+        return length >= 12 && ::memcmp(data, identifier, 12) == 0;
+    }
+
+    // Transcodes the first layer and face of a KTX2 (Basis Universal)
+    // image, with all its mipmaps, to DXT.
+    ReadResult readKTX2(const char* data, int length) const
+    {
+        basist::ktx2_transcoder transcoder;
+        if (!transcoder.init(data, length) || !transcoder.start_transcoding())
+            return ReadResult::ERROR_IN_READING_FILE;
+
+        basist::transcoder_texture_format transcoder_texture_format = basist::transcoder_texture_format::cTFBC1;
+        GLenum pixelFormat = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        if (transcoder.get_has_alpha())
+        {
+            transcoder_texture_format = basist::transcoder_texture_format::cTFBC3;
+            pixelFormat = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        }
+
+        unsigned int bytesPerBlock = OE_BASIS_BYTES_PER_BLOCK(transcoder_texture_format);
+        unsigned int numLevels = osg::maximum(transcoder.get_levels(), 1u);
+
+        std::vector< basist::ktx2_image_level_info > levels(numLevels);
+        std::vector< unsigned int > mipmapDataOffsets;
+        unsigned int totalSize = 0;
+        for (unsigned int levelIndex = 0; levelIndex < numLevels; levelIndex++)
+        {
+            if (!transcoder.get_image_level_info(levels[levelIndex], levelIndex, 0, 0))
+                return ReadResult::ERROR_IN_READING_FILE;
+
+            if (levelIndex > 0)
+                mipmapDataOffsets.push_back(totalSize);
+
+            totalSize += bytesPerBlock * levels[levelIndex].m_total_blocks;
+        }
+
+        unsigned char* decoded = new unsigned char[totalSize];
+        unsigned int offset = 0;
+        for (unsigned int levelIndex = 0; levelIndex < numLevels; levelIndex++)
+        {
+            if (!transcoder.transcode_image_level(levelIndex, 0, 0, &decoded[offset], levels[levelIndex].m_total_blocks, transcoder_texture_format))
+            {
+                delete [] decoded;
+                return ReadResult::ERROR_IN_READING_FILE;
+            }
+            offset += bytesPerBlock * levels[levelIndex].m_total_blocks;
+        }
+
+        osg::Image* image = new osg::Image;
+        image->setImage(transcoder.get_width(), transcoder.get_height(), 1, pixelFormat, pixelFormat, GL_UNSIGNED_BYTE, decoded, osg::Image::USE_NEW_DELETE);
+        if (!mipmapDataOffsets.empty())
+        {
+            image->setMipmapLevels(mipmapDataOffsets);
+        }
+
+        image->flipVertical();
+        return image;
+    }
+#else
     basist::etc1_global_selector_codebook sel_codebook;
+#endif
 };
 
 REGISTER_OSGPLUGIN(basis, ReaderWriterBasis)
\ No newline at end of file
@@ -27,9 +27,14 @@
 #include <osgEarth/Registry>
 #include <osgEarth/NetworkMonitor>
 #include <osgEarth/Metrics>
+#include <osgEarth/DateTime>
 #include <osgDB/FileUtils>
 #include <osgDB/FileNameUtils>
+#include <algorithm>
+#include <atomic>
 #include <fstream>
+#include <queue>
+#include <thread>
 #include <sys/stat.h>
 
 using namespace osgEarth;
@@ -42,8 +47,30 @@ using namespace osgEarth::Drivers;
 #define OSG_FORMAT "osgb"
 #define OSG_EXT   ".osgb"
 
+#define OSGEARTH_ENV_CACHE_MAX_SIZE_MB "OSGEARTH_CACHE_MAX_SIZE_MB"
+
 namespace
 {
+    /**
+     * Running total of the cache's size on disk. Bins keep it up to date
+     * as they write and remove records, so reporting or enforcing a size
+     * limit never requires walking the cache.
+     */
+    struct Usage : public osg::Referenced
+    {
+        Usage() : _bytes(0), _maxBytes(0) { }
+
+        bool isOverLimit() const {
+            return _maxBytes > 0 && _bytes > _maxBytes;
+        }
+
+        std::atomic<std::int64_t> _bytes;
+        std::int64_t _maxBytes; // zero means no limit
+
+        // wakes up the maintenance thread
+        Threading::Event _wake;
+    };
+
     /**
      * Cache that stores data in the local file system.
      */
@@ -67,11 +94,30 @@ namespace
 
         CacheBin* getOrCreateDefaultBin() override;
 
+        off_t getApproximateSize() const override;
+
     protected:
 
+        virtual ~FileSystemCache();
+
         std::string _rootPath;
 
         osg::ref_ptr<ThreadPool> _threadPool;
+
+        // size accounting and eviction
+        osg::ref_ptr<Usage> _usage;
+        optional<TimeSpan> _maxAge;
+        Threading::Mutex _maintainedBinsMutex;
+        std::vector<osg::ref_ptr<CacheBin> > _maintainedBins;
+        std::vector<osg::ref_ptr<CacheBin> > _unmeasuredBins;
+        std::thread _maintenance;
+        std::atomic<bool> _done;
+
+        CacheBin* maintain(CacheBin* bin);
+
+        void runMaintenance();
+
+        void evict();
     };
 
     struct WriteCacheRecord {
@@ -80,6 +126,20 @@ namespace
     };
     typedef std::unordered_map<std::string, WriteCacheRecord> WriteCache;
 
+    class FileSystemCacheBin;
+
+    // A record that might be evicted
+    struct EvictionCandidate
+    {
+        std::string path; // without extension
+        TimeStamp time;   // last write or touch
+        FileSystemCacheBin* bin;
+        bool operator < (const EvictionCandidate& rhs) const {
+            return time < rhs.time;
+        }
+    };
+    typedef std::priority_queue<EvictionCandidate> EvictionCandidates;
+
     /**
      * Cache bin implementation for a FileSystemCache.
      * You don't need to create this object directly; use FileSystemCache::createBin instead.
@@ -90,7 +150,8 @@ namespace
         FileSystemCacheBin( 
             const std::string& name, 
             const std::string& rootPath,
-            ThreadPool* threadPool);
+            ThreadPool* threadPool,
+            Usage* usage);
 
         static bool _s_debug;
 
@@ -112,6 +173,23 @@ namespace
 
         bool clear() override;
 
+        unsigned getStorageSize() override;
+
+    public: // size accounting and eviction
+
+        //! Records a change in the size of the bin on disk
+        void account(std::int64_t delta);
+
+        //! Walks the bin and counts its current size (slow)
+        void measure();
+
+        //! Gathers at most max of the bin's least recently used records
+        //! into candidates, which holds the oldest records seen so far
+        void collect(EvictionCandidates& candidates, unsigned max);
+
+        //! Deletes a record found by collect()
+        bool evict(const std::string& path);
+
     protected:
         bool purgeDirectory( const std::string& dir );
 
@@ -131,6 +209,10 @@ namespace
         // pool for asynchronous writes
         ThreadPool* _threadPool;
 
+        // size of the bin on disk, and of the whole cache
+        std::atomic<std::int64_t> _size;
+        osg::ref_ptr<Usage> _usage;
+
     public:
         // cache for objects waiting to be written; this supports reading from
         // the cache before the object has been asynchronously written to disk.
@@ -156,6 +238,34 @@ namespace
         }
     }
 
+    std::int64_t fileSize( const std::string& fullPath )
+    {
+        struct stat buf;
+        return ::stat(fullPath.c_str(), &buf) == 0 ? (std::int64_t)buf.st_size : 0;
+    }
+
+    // Calls f(path, stat) for each regular file under dir
+    template<typename FUNC>
+    void walk( const std::string& dir, FUNC& f )
+    {
+        osgDB::DirectoryContents dc = osgDB::getDirectoryContents( dir );
+        for( osgDB::DirectoryContents::iterator i = dc.begin(); i != dc.end(); ++i )
+        {
+            if ( i->compare(".") == 0 || i->compare("..") == 0 )
+                continue;
+
+            std::string full = osgDB::concatPaths(dir, *i);
+            struct stat buf;
+            if ( ::stat(full.c_str(), &buf) != 0 )
+                continue;
+
+            if ( (buf.st_mode & S_IFMT) == S_IFDIR )
+                walk( full, f );
+            else if ( (buf.st_mode & S_IFMT) == S_IFREG )
+                f( full, buf );
+        }
+    }
+
     void readMeta( const std::string& fullPath, Config& meta )
     {
         std::ifstream inmeta( fullPath.c_str() );
@@ -210,6 +320,159 @@ namespace
         // create a thread pool dedicated to asynchronous cache writes
         _threadPool = new ThreadPool(
             osg::maximum(fsco.threads().get(), 1u) );
+
+        const char* maxsize = ::getenv(OSGEARTH_ENV_CACHE_MAX_SIZE_MB);
+        if ( maxsize )
+        {
+            unsigned mb = as<unsigned>(std::string(maxsize), 0u);
+            if ( mb > 0 )
+                fsco.maxSizeMB() = mb;
+        }
+
+        _usage = new Usage();
+        if ( fsco.maxSizeMB().isSet() && fsco.maxSizeMB().get() > 0u )
+        {
+            _usage->_maxBytes = (std::int64_t)fsco.maxSizeMB().get() * 1048576;
+            OE_INFO << LC << "Cache size limit is " << fsco.maxSizeMB().get() << " MB\n";
+        }
+        _maxAge = fsco.maxAge();
+
+        // background thread that measures bins and evicts old records
+        _done = false;
+        _maintenance = std::thread(&FileSystemCache::runMaintenance, this);
+    }
+
+    FileSystemCache::~FileSystemCache()
+    {
+        _done = true;
+        if ( _maintenance.joinable() )
+        {
+            _usage->_wake.set();
+            _maintenance.join();
+        }
+    }
+
+    off_t
+    FileSystemCache::getApproximateSize() const
+    {
+        return _usage.valid() ? (off_t)_usage->_bytes : 0;
+    }
+
+    CacheBin*
+    FileSystemCache::maintain(CacheBin* bin)
+    {
+        if ( bin )
+        {
+            Threading::ScopedMutexLock lock( _maintainedBinsMutex );
+            for (unsigned i = 0; i < _maintainedBins.size(); ++i)
+                if ( _maintainedBins[i].get() == bin )
+                    return bin;
+
+            _maintainedBins.push_back( bin );
+            _unmeasuredBins.push_back( bin );
+            _usage->_wake.set();
+        }
+        return bin;
+    }
+
+    void
+    FileSystemCache::runMaintenance()
+    {
+        // how often to look for expired records when nothing else happens
+        const unsigned AGE_SWEEP_INTERVAL_MS = 3600000u;
+
+        while ( !_done )
+        {
+            _usage->_wake.wait( AGE_SWEEP_INTERVAL_MS );
+            _usage->_wake.reset();
+            if ( _done )
+                break;
+
+            // Count up the size of each new bin once. After that the bins
+            // keep their own totals current.
+            std::vector<osg::ref_ptr<CacheBin> > unmeasured;
+            {
+                Threading::ScopedMutexLock lock( _maintainedBinsMutex );
+                unmeasured.swap( _unmeasuredBins );
+            }
+            for (unsigned i = 0; i < unmeasured.size() && !_done; ++i)
+            {
+                static_cast<FileSystemCacheBin*>(unmeasured[i].get())->measure();
+            }
+
+            if ( _usage->isOverLimit() || _maxAge.isSet() )
+            {
+                evict();
+            }
+        }
+    }
+
+    void
+    FileSystemCache::evict()
+    {
+        OE_PROFILING_ZONE;
+
+        // Evict down to 90% of the limit so we aren't back after a few more writes.
+        const std::int64_t target = _usage->_maxBytes - _usage->_maxBytes / 10;
+
+        // Looking at a bounded number of candidates per pass keeps memory
+        // in check on huge caches; the result is an approximate LRU.
+        const unsigned MAX_CANDIDATES = 65536u;
+
+        const TimeStamp expiry = _maxAge.isSet() ?
+            DateTime().asTimeStamp() - _maxAge.get() : (TimeStamp)0;
+
+        std::vector<osg::ref_ptr<CacheBin> > bins;
+        {
+            Threading::ScopedMutexLock lock( _maintainedBinsMutex );
+            bins = _maintainedBins;
+        }
+
+        unsigned count = 0u;
+        bool more = true;
+
+        while ( more && !_done )
+        {
+            EvictionCandidates heap;
+            for (unsigned i = 0; i < bins.size(); ++i)
+            {
+                static_cast<FileSystemCacheBin*>(bins[i].get())->collect( heap, MAX_CANDIDATES );
+            }
+
+            // oldest first
+            std::vector<EvictionCandidate> candidates;
+            candidates.reserve( heap.size() );
+            for ( ; !heap.empty(); heap.pop() )
+                candidates.push_back( heap.top() );
+            std::reverse( candidates.begin(), candidates.end() );
+
+            more = false;
+            unsigned evicted = 0u;
+            for (unsigned i = 0; i < candidates.size() && !_done; ++i)
+            {
+                const EvictionCandidate& c = candidates[i];
+
+                bool expired = c.time < expiry;
+                bool full = _usage->_maxBytes > 0 && _usage->_bytes > target;
+                if ( !expired && !full )
+                    break;
+
+                if ( c.bin->evict(c.path) )
+                    ++evicted;
+
+                // ran out of candidates while still over the limit
+                more = full && i+1 == candidates.size() && candidates.size() == MAX_CANDIDATES;
+            }
+
+            count += evicted;
+            more = more && evicted > 0u;
+        }
+
+        if ( count > 0u )
+        {
+            OE_INFO << LC << "Evicted " << count << " records; cache size = "
+                << (_usage->_bytes / 1048576) << " MB\n";
+        }
     }
 
     CacheBin*
@@ -218,7 +481,7 @@ namespace
         if (getStatus().isError())
             return NULL;
 
-        return _bins.getOrCreate( name, new FileSystemCacheBin( name, _rootPath, _threadPool.get() ) );
+        return maintain( _bins.getOrCreate( name, new FileSystemCacheBin( name, _rootPath, _threadPool.get(), _usage.get() ) ) );
     }
 
     CacheBin*
@@ -233,7 +496,8 @@ namespace
             Threading::ScopedMutexLock lock( s_defaultBinMutex );
             if ( !_defaultBin.valid() ) // double-check
             {
-                _defaultBin = new FileSystemCacheBin( "__default", _rootPath, _threadPool.get() );
+                _defaultBin = new FileSystemCacheBin( "__default", _rootPath, _threadPool.get(), _usage.get() );
+                maintain( _defaultBin.get() );
             }
         }
         return _defaultBin.get();
@@ -304,10 +568,13 @@ namespace
     FileSystemCacheBin::FileSystemCacheBin(
         const std::string& binID,
         const std::string& rootPath,
-        ThreadPool* threadPool) :
+        ThreadPool* threadPool,
+        Usage* usage) :
 
         CacheBin(binID),
         _threadPool(threadPool),
+        _size(0),
+        _usage(usage),
         _binPathExists(false),
         _ok(true),
         _fileGate("CacheBinFileGate(OE)"),
@@ -556,6 +823,10 @@ namespace
                     osgEarth::makeDirectoryForFile(_uri.full());
                 }
 
+                // size of whatever we're about to replace
+                std::string metaname = _uri.full() + ".meta";
+                std::int64_t oldSize = fileSize(_uri.full() + OSG_EXT) + fileSize(metaname);
+
                 osgDB::ReaderWriter::WriteResult r;
 
                 bool writeOK = false;
@@ -582,10 +853,11 @@ namespace
                 // write metadata
                 if (!_meta.empty() && writeOK)
                 {
-                    std::string metaname = _uri.full() + ".meta";
                     writeMeta(metaname, _meta);
                 }
 
+                _bin->account(fileSize(_uri.full() + OSG_EXT) + fileSize(metaname) - oldSize);
+
                 if (!writeOK)
                 {
                     OE_WARN << LC << "FAILED to write \"" << _uri.full() << "\" to cache bin \"" << 
@@ -674,7 +946,17 @@ namespace
 
         // exclusive file access:
         Threading::ScopedGate<std::string> lockURI(_fileGate, fileURI.full());
-        return ::unlink( path.c_str() ) == 0;
+
+        std::int64_t size = fileSize(path);
+        if ( ::unlink( path.c_str() ) != 0 )
+            return false;
+
+        std::string metaname = fileURI.full() + ".meta";
+        size += fileSize(metaname);
+        ::unlink( metaname.c_str() );
+
+        account( -size );
+        return true;
     }
 
     bool
@@ -739,7 +1021,111 @@ namespace
             return false;
 
         std::string binDir = osgDB::getFilePath( _metaPath );
-        return purgeDirectory( binDir );
+        bool ok = purgeDirectory( binDir );
+
+        account( -(std::int64_t)_size );
+        return ok;
+    }
+
+    unsigned
+    FileSystemCacheBin::getStorageSize()
+    {
+        std::int64_t size = _size;
+        return size <= 0 ? 0u : size > 0xffffffff ? 0xffffffffu : (unsigned)size;
+    }
+
+    void
+    FileSystemCacheBin::account(std::int64_t delta)
+    {
+        if ( delta != 0 )
+        {
+            _size += delta;
+            _usage->_bytes += delta;
+
+            if ( delta > 0 && _usage->isOverLimit() )
+                _usage->_wake.set();
+        }
+    }
+
+    void
+    FileSystemCacheBin::measure()
+    {
+        struct Counter {
+            std::int64_t total;
+            void operator()(const std::string&, const struct stat& buf) {
+                total += (std::int64_t)buf.st_size;
+            }
+        };
+        Counter counter;
+        counter.total = 0;
+        walk( _binPath, counter );
+
+        // writes made during the walk may get counted twice;
+        // close enough for a size limit.
+        account( counter.total );
+
+        if (_s_debug)
+            OE_NOTICE << LC << "Bin [" << getID() << "] holds " << (counter.total/1048576) << " MB" << std::endl;
+    }
+
+    void
+    FileSystemCacheBin::collect(EvictionCandidates& candidates, unsigned max)
+    {
+        struct Collector {
+            EvictionCandidates* candidates;
+            unsigned max;
+            FileSystemCacheBin* bin;
+            void operator()(const std::string& path, const struct stat& buf) {
+                if ( !endsWith(path, OSG_EXT) )
+                    return;
+
+                TimeStamp t = (TimeStamp)buf.st_mtime;
+                if ( candidates->size() >= max && !(t < candidates->top().time) )
+                    return;
+
+                EvictionCandidate c;
+                c.path = path.substr(0, path.length() - std::string(OSG_EXT).length());
+                c.time = t;
+                c.bin = bin;
+                candidates->push(c);
+                if ( candidates->size() > max )
+                    candidates->pop(); // drop the newest
+            }
+        };
+        Collector collector;
+        collector.candidates = &candidates;
+        collector.max = max;
+        collector.bin = this;
+        walk( _binPath, collector );
+    }
+
+    bool
+    FileSystemCacheBin::evict(const std::string& path)
+    {
+        // leave it alone if a write is pending
+        {
+            ScopedReadLock lock(_writeCacheRWM);
+            if ( _writeCache.find(path) != _writeCache.end() )
+                return false;
+        }
+
+        Threading::ScopedGate<std::string> lockURI(_fileGate, path);
+
+        std::string dataname = path + OSG_EXT;
+        std::int64_t size = fileSize(dataname);
+        if ( ::unlink( dataname.c_str() ) != 0 )
+            return false;
+
+        std::string metaname = path + ".meta";
+        size += fileSize(metaname);
+        ::unlink( metaname.c_str() );
+
+        account( -size );
+
+        if (_s_debug)
+            OE_NOTICE << LC << "Evicted " << path << std::endl;
+
+        return true;
     }
 }
 
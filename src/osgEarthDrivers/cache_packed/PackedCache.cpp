@@ -0,0 +1,1053 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2020 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include "PackedCache"
+#include <osgEarth/Cache>
+#include <osgEarth/StringUtils>
+#include <osgEarth/Threading>
+#include <osgEarth/URI>
+#include <osgEarth/FileUtils>
+#include <osgEarth/DateTime>
+#include <osgEarth/Registry>
+#include <osgEarth/Metrics>
+#include <osgDB/FileUtils>
+#include <osgDB/FileNameUtils>
+#include <osgDB/Registry>
+#include <osg/Image>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <streambuf>
+#include <typeinfo>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _WIN32
+#   ifndef WIN32_LEAN_AND_MEAN
+#       define WIN32_LEAN_AND_MEAN
+#   endif
+#   include <windows.h>
+#   include <io.h>
+#   include <fcntl.h>
+#   include <sys/stat.h>
+#else
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <fcntl.h>
+#   include <unistd.h>
+#endif
+
+using namespace osgEarth;
+using namespace osgEarth::Drivers;
+
+#define OSG_FORMAT "osgb"
+
+#undef  LC
+#define LC "[PackedCache] "
+
+namespace
+{
+    // Pack file layout:
+    //   FileHeader
+    //   Record*
+    // where each record is
+    //   RecordHeader, key, metadata (JSON), padding, payload, padding
+    // and every record and payload starts on an ALIGNMENT boundary.
+    // A raw image payload is an ImageHeader, its mipmap offsets, padding,
+    // then the pixels. Other payloads are OSGB streams.
+
+    const std::uint32_t FILE_MAGIC   = 0x4b50454f; // "OEPK"
+    const std::uint32_t RECORD_MAGIC = 0x4345524f; // "OREC"
+    const std::uint32_t PACK_VERSION = 1;
+    const std::uint64_t ALIGNMENT    = 16;
+
+    enum RecordKind
+    {
+        KIND_TOMBSTONE = 0,  // removes an earlier record with the same key
+        KIND_IMAGE_RAW,      // pixels are stored as-is
+        KIND_IMAGE_OSGB,
+        KIND_NODE_OSGB,
+        KIND_OBJECT_OSGB
+    };
+
+    struct FileHeader
+    {
+        std::uint32_t magic;
+        std::uint32_t version;
+        std::uint32_t reserved[2];
+    };
+
+    struct RecordHeader
+    {
+        std::uint32_t magic;
+        std::uint32_t kind;
+        std::uint32_t keyLength;
+        std::uint32_t metaLength;
+        std::uint64_t payloadLength;
+        std::int64_t  timestamp;
+    };
+
+    struct ImageHeader
+    {
+        std::int32_t  s, t, r;
+        std::int32_t  internalFormat;
+        std::uint32_t pixelFormat;
+        std::uint32_t dataType;
+        std::uint32_t packing;
+        std::int32_t  rowLength;
+        std::uint32_t origin;
+        std::uint32_t numMipmapLevels;
+        std::uint64_t dataLength;
+    };
+
+    inline std::uint64_t align(std::uint64_t n)
+    {
+        return (n + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+    }
+
+    inline std::uint64_t payloadOffset(const RecordHeader& h)
+    {
+        return align(sizeof(RecordHeader) + h.keyLength + h.metaLength);
+    }
+
+    inline std::uint64_t recordLength(const RecordHeader& h)
+    {
+        return payloadOffset(h) + align(h.payloadLength);
+    }
+
+    inline std::uint64_t imageDataOffset(const ImageHeader& h)
+    {
+        return align(sizeof(ImageHeader) + h.numMipmapLevels * sizeof(std::uint32_t));
+    }
+
+    bool truncateFile(const std::string& path, std::uint64_t size)
+    {
+#ifdef _WIN32
+        int fd = -1;
+        if (_sopen_s(&fd, path.c_str(), _O_RDWR | _O_BINARY, _SH_DENYNO, _S_IREAD | _S_IWRITE) != 0)
+            return false;
+        bool ok = _chsize_s(fd, (__int64)size) == 0;
+        _close(fd);
+        return ok;
+#else
+        return ::truncate(path.c_str(), (off_t)size) == 0;
+#endif
+    }
+
+    /**
+     * Read-only, copy-on-write view of an entire pack file. Images
+     * decoded in place keep a reference to the view that holds their
+     * pixels, so it lives until the last of them goes away. The pack
+     * is append-only, so the bytes under a view never change.
+     */
+    class MappedFile : public osg::Referenced
+    {
+    public:
+        static MappedFile* open(const std::string& path)
+        {
+            osg::ref_ptr<MappedFile> m = new MappedFile();
+#ifdef _WIN32
+            HANDLE file = ::CreateFileA(path.c_str(), GENERIC_READ,
+                FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+            if (file == INVALID_HANDLE_VALUE)
+                return 0L;
+
+            LARGE_INTEGER size;
+            if (::GetFileSizeEx(file, &size) && size.QuadPart > 0)
+            {
+                HANDLE mapping = ::CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+                if (mapping)
+                {
+                    m->_data = (char*)::MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+                    m->_size = (std::uint64_t)size.QuadPart;
+                    ::CloseHandle(mapping);
+                }
+            }
+            ::CloseHandle(file);
+#else
+            int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0)
+                return 0L;
+
+            struct stat st;
+            if (::fstat(fd, &st) == 0 && st.st_size > 0)
+            {
+                // private + writable, so that anyone who modifies an image
+                // decoded in place gets their own copy of the page.
+                void* ptr = ::mmap(0L, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+                if (ptr != MAP_FAILED)
+                {
+                    m->_data = (char*)ptr;
+                    m->_size = (std::uint64_t)st.st_size;
+                }
+            }
+            ::close(fd);
+#endif
+            return m->_data ? m.release() : 0L;
+        }
+
+        const char* data() const { return _data; }
+
+        std::uint64_t size() const { return _size; }
+
+    protected:
+        MappedFile() : _data(0L), _size(0u) { }
+
+        virtual ~MappedFile()
+        {
+            if (_data)
+            {
+#ifdef _WIN32
+                ::UnmapViewOfFile(_data);
+#else
+                ::munmap(_data, (size_t)_size);
+#endif
+            }
+        }
+
+        char* _data;
+        std::uint64_t _size;
+    };
+
+    // istream source over memory, so OSGB records decode from the
+    // mapping without first being copied into a string.
+    struct MemoryStreamBuf : public std::streambuf
+    {
+        MemoryStreamBuf(const char* data, std::size_t length)
+        {
+            char* p = const_cast<char*>(data);
+            setg(p, p, p + length);
+        }
+
+        // OSGB peeks at the stream header and rewinds
+        pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode) override
+        {
+            char* p =
+                dir == std::ios_base::beg ? eback() + off :
+                dir == std::ios_base::cur ? gptr() + off :
+                egptr() + off;
+
+            if (p < eback() || p > egptr())
+                return pos_type(off_type(-1));
+
+            setg(eback(), p, egptr());
+            return pos_type(p - eback());
+        }
+
+        pos_type seekpos(pos_type pos, std::ios_base::openmode which) override
+        {
+            return seekoff(off_type(pos), std::ios_base::beg, which);
+        }
+    };
+
+    /**
+     * Cache that stores each bin in a single memory-mapped pack file.
+     */
+    class PackedCache : public Cache
+    {
+    public:
+        PackedCache() { } // unused
+        PackedCache( const PackedCache& rhs, const osg::CopyOp& op ) { } // unused
+        META_Object( osgEarth, PackedCache );
+
+        /**
+         * Constructs a new packed cache.
+         * @param options Options structure that comes from a serialized description of
+         *        the object.
+         */
+        PackedCache( const CacheOptions& options );
+
+    public: // Cache interface
+
+        CacheBin* addBin( const std::string& binID ) override;
+
+        CacheBin* getOrCreateDefaultBin() override;
+
+    protected:
+
+        std::string _rootPath;
+    };
+
+    /**
+     * Cache bin implementation for a PackedCache. Records are appended
+     * to the bin's pack file; an in-memory index maps each key to its
+     * latest record and is rebuilt from the record headers on open.
+     */
+    class PackedCacheBin : public CacheBin
+    {
+    public:
+        PackedCacheBin(
+            const std::string& name,
+            const std::string& rootPath);
+
+        static bool _s_debug;
+
+    public: // CacheBin interface
+
+        ReadResult readObject(const std::string& key, const osgDB::Options* dbo) override;
+
+        ReadResult readImage(const std::string& key, const osgDB::Options* dbo) override;
+
+        ReadResult readString(const std::string& key, const osgDB::Options* dbo) override;
+
+        bool write(const std::string& key, const osg::Object* object, const Config& meta, const osgDB::Options* dbo) override;
+
+        bool remove(const std::string& key) override;
+
+        bool touch(const std::string& key) override;
+
+        RecordStatus getRecordStatus(const std::string& key) override;
+
+        bool clear() override;
+
+        unsigned getStorageSize() override;
+
+    protected:
+
+        virtual ~PackedCacheBin();
+
+        struct Entry
+        {
+            std::uint64_t offset;
+            std::uint64_t length;
+            TimeStamp     time;
+        };
+        typedef std::unordered_map<std::string, Entry> Index;
+
+        // the parts of a record we found, pointing into a mapping
+        struct Located
+        {
+            osg::ref_ptr<MappedFile> mapping;
+            RecordHeader header;
+            const char* meta;
+            const char* payload;
+            TimeStamp time;
+        };
+
+        bool open();
+
+        bool create();
+
+        void scan(const MappedFile* mapping);
+
+        bool locate(const std::string& key, Located& out);
+
+        bool append(
+            RecordKind kind,
+            const std::string& key,
+            const std::string& meta,
+            const char* prefix, std::uint64_t prefixLength,
+            const char* data, std::uint64_t dataLength,
+            TimeStamp time);
+
+        // same as append(), with _mutex already held
+        bool appendLocked(
+            RecordKind kind,
+            const std::string& key,
+            const std::string& meta,
+            const char* prefix, std::uint64_t prefixLength,
+            const char* data, std::uint64_t dataLength,
+            TimeStamp time);
+
+        ReadResult read(const std::string& key, bool wantImage, const osgDB::Options* dbo);
+
+        const osgDB::Options* mergeOptions(const osgDB::Options* in);
+
+        std::string                       _packPath;
+        std::string                       _compressorName;
+        osg::ref_ptr<osgDB::Options>      _zlibOptions;
+        osg::ref_ptr<osgDB::ReaderWriter> _rw;
+
+        Threading::Mutex                  _mutex;
+        std::fstream                      _file;
+        std::uint64_t                     _end;
+        Index                             _index;
+        osg::ref_ptr<MappedFile>          _mapping;
+        bool                              _ok;
+    };
+}
+
+//------------------------------------------------------------------------
+
+bool PackedCacheBin::_s_debug = false;
+
+namespace
+{
+    PackedCache::PackedCache(const CacheOptions& options) :
+        Cache(options)
+    {
+        PackedCacheOptions pco( options );
+
+        // read the root path from ENV is necessary:
+        if ( !pco.rootPath().isSet())
+        {
+            const char* cachePath = ::getenv(OSGEARTH_ENV_CACHE_PATH);
+            if ( cachePath )
+                pco.rootPath() = cachePath;
+        }
+
+        _rootPath = URI( *pco.rootPath(), options.referrer() ).full();
+
+        if (osgDB::makeDirectory(_rootPath) == false)
+        {
+            _status.set(Status::ResourceUnavailable, Stringify()
+                << "Failed to create or access folder \"" << _rootPath << "\"");
+            return;
+        }
+        OE_INFO << LC << "Opened a packed cache at \"" << _rootPath << "\"\n";
+    }
+
+    CacheBin*
+    PackedCache::addBin( const std::string& name )
+    {
+        if (getStatus().isError())
+            return NULL;
+
+        return _bins.getOrCreate( name, new PackedCacheBin( name, _rootPath ) );
+    }
+
+    CacheBin*
+    PackedCache::getOrCreateDefaultBin()
+    {
+        if (getStatus().isError())
+            return NULL;
+
+        static Threading::Mutex s_defaultBinMutex(OE_MUTEX_NAME);
+        if ( !_defaultBin.valid() )
+        {
+            Threading::ScopedMutexLock lock( s_defaultBinMutex );
+            if ( !_defaultBin.valid() ) // double-check
+            {
+                _defaultBin = new PackedCacheBin( "__default", _rootPath );
+            }
+        }
+        return _defaultBin.get();
+    }
+
+    //------------------------------------------------------------------------
+
+    PackedCacheBin::PackedCacheBin(
+        const std::string& binID,
+        const std::string& rootPath) :
+
+        CacheBin(binID),
+        _mutex("PackedCacheBin(OE)"),
+        _end(0u),
+        _ok(false)
+    {
+        _packPath = osgDB::concatPaths(osgDB::concatPaths(rootPath, binID), "tiles.pack");
+
+        _rw = osgDB::Registry::instance()->getReaderWriterForExtension(OSG_FORMAT);
+
+        _zlibOptions = Registry::instance()->cloneOrCreateOptions();
+
+        if (::getenv(OSGEARTH_ENV_DEFAULT_COMPRESSOR) != 0L)
+        {
+            _compressorName = ::getenv(OSGEARTH_ENV_DEFAULT_COMPRESSOR);
+        }
+        else
+        {
+            _compressorName = "zlib";
+        }
+
+        if (_compressorName.length() > 0)
+        {
+            _zlibOptions->setPluginStringData("Compressor", _compressorName);
+        }
+
+        _s_debug = ::getenv("OSGEARTH_CACHE_DEBUG") != 0L;
+
+        _ok = _rw.valid() && open();
+    }
+
+    PackedCacheBin::~PackedCacheBin()
+    {
+        if (_file.is_open())
+            _file.close();
+    }
+
+    bool
+    PackedCacheBin::create()
+    {
+        _file.close();
+        _file.clear();
+
+        // truncates any existing file:
+        {
+            std::ofstream out(_packPath.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+            if (!out.is_open())
+                return false;
+
+            FileHeader fh;
+            fh.magic = FILE_MAGIC;
+            fh.version = PACK_VERSION;
+            fh.reserved[0] = fh.reserved[1] = 0u;
+            out.write((const char*)&fh, sizeof(fh));
+        }
+
+        _end = sizeof(FileHeader);
+        _index.clear();
+        _mapping = 0L;
+
+        _file.open(_packPath.c_str(), std::ios::in | std::ios::out | std::ios::binary);
+        return _file.is_open();
+    }
+
+    bool
+    PackedCacheBin::open()
+    {
+        osgEarth::makeDirectoryForFile(_packPath);
+
+        if (!osgDB::fileExists(_packPath))
+        {
+            if (!create())
+            {
+                OE_WARN << LC << "FAILED to create cache bin at [" << _packPath << "]" << std::endl;
+                return false;
+            }
+            return true;
+        }
+
+        osg::ref_ptr<MappedFile> mapping = MappedFile::open(_packPath);
+        FileHeader fh;
+        if (mapping.valid() && mapping->size() >= sizeof(FileHeader))
+            ::memcpy(&fh, mapping->data(), sizeof(FileHeader));
+
+        if (!mapping.valid() || mapping->size() < sizeof(FileHeader) ||
+            fh.magic != FILE_MAGIC || fh.version != PACK_VERSION)
+        {
+            OE_WARN << LC << "Cache bin at [" << _packPath << "] is unreadable or out of date; starting over" << std::endl;
+            mapping = 0L;
+            return create();
+        }
+
+        scan(mapping.get());
+
+        if (_end < mapping->size())
+        {
+            // the tail is a partial record from an interrupted write;
+            // cut it off so the next record follows the last good one.
+            OE_WARN << LC << "Discarding " << (mapping->size() - _end)
+                << " bytes of incomplete data from [" << _packPath << "]" << std::endl;
+
+            mapping = 0L;
+            if (!truncateFile(_packPath, _end))
+                return create();
+        }
+        else
+        {
+            _mapping = mapping;
+        }
+
+        _file.open(_packPath.c_str(), std::ios::in | std::ios::out | std::ios::binary);
+        if (!_file.is_open())
+        {
+            OE_WARN << LC << "FAILED to open cache bin at [" << _packPath << "]" << std::endl;
+            return false;
+        }
+
+        if (_s_debug)
+            OE_NOTICE << LC << "Opened bin [" << getID() << "] with " << _index.size() << " records" << std::endl;
+
+        return true;
+    }
+
+    void
+    PackedCacheBin::scan(const MappedFile* mapping)
+    {
+        const char* data = mapping->data();
+        std::uint64_t size = mapping->size();
+        std::uint64_t pos = sizeof(FileHeader);
+
+        _index.clear();
+
+        // only the headers are touched, not the payloads.
+        while (pos + sizeof(RecordHeader) <= size)
+        {
+            RecordHeader h;
+            ::memcpy(&h, data + pos, sizeof(RecordHeader));
+            if (h.magic != RECORD_MAGIC)
+                break;
+
+            std::uint64_t length = recordLength(h);
+            if (pos + length > size)
+                break;
+
+            std::string key(data + pos + sizeof(RecordHeader), h.keyLength);
+            if (h.kind == KIND_TOMBSTONE)
+            {
+                _index.erase(key);
+            }
+            else
+            {
+                Entry& e = _index[key];
+                e.offset = pos;
+                e.length = length;
+                e.time = (TimeStamp)h.timestamp;
+            }
+
+            pos += length;
+        }
+
+        _end = pos;
+    }
+
+    bool
+    PackedCacheBin::locate(const std::string& key, Located& out)
+    {
+        Entry entry;
+        {
+            Threading::ScopedMutexLock lock(_mutex);
+
+            if (!_ok)
+                return false;
+
+            Index::const_iterator i = _index.find(key);
+            if (i == _index.end())
+                return false;
+            entry = i->second;
+
+            // remap if the record was appended after the current view
+            if (!_mapping.valid() || _mapping->size() < entry.offset + entry.length)
+            {
+                _file.flush();
+                _mapping = MappedFile::open(_packPath);
+                if (!_mapping.valid() || _mapping->size() < entry.offset + entry.length)
+                {
+                    OE_WARN << LC << "Failed to map [" << _packPath << "]" << std::endl;
+                    _mapping = 0L;
+                    return false;
+                }
+            }
+
+            out.mapping = _mapping;
+        }
+
+        const char* record = out.mapping->data() + entry.offset;
+        ::memcpy(&out.header, record, sizeof(RecordHeader));
+        out.meta = record + sizeof(RecordHeader) + out.header.keyLength;
+        out.payload = record + payloadOffset(out.header);
+        out.time = entry.time;
+        return true;
+    }
+
+    bool
+    PackedCacheBin::append(
+        RecordKind kind,
+        const std::string& key,
+        const std::string& meta,
+        const char* prefix, std::uint64_t prefixLength,
+        const char* data, std::uint64_t dataLength,
+        TimeStamp time)
+    {
+        Threading::ScopedMutexLock lock(_mutex);
+        return appendLocked(kind, key, meta, prefix, prefixLength, data, dataLength, time);
+    }
+
+    bool
+    PackedCacheBin::appendLocked(
+        RecordKind kind,
+        const std::string& key,
+        const std::string& meta,
+        const char* prefix, std::uint64_t prefixLength,
+        const char* data, std::uint64_t dataLength,
+        TimeStamp time)
+    {
+        static const char zeros[ALIGNMENT] = { 0 };
+
+        RecordHeader h;
+        h.magic = RECORD_MAGIC;
+        h.kind = kind;
+        h.keyLength = key.size();
+        h.metaLength = meta.size();
+        h.payloadLength = prefixLength + dataLength;
+        h.timestamp = (std::int64_t)time;
+
+        std::uint64_t headerPad = payloadOffset(h) - (sizeof(RecordHeader) + key.size() + meta.size());
+        std::uint64_t payloadPad = align(h.payloadLength) - h.payloadLength;
+
+        if (!_ok)
+            return false;
+
+        _file.seekp((std::streamoff)_end);
+        _file.write((const char*)&h, sizeof(RecordHeader));
+        _file.write(key.data(), key.size());
+        _file.write(meta.data(), meta.size());
+        _file.write(zeros, headerPad);
+        if (prefixLength > 0)
+            _file.write(prefix, prefixLength);
+        if (dataLength > 0)
+            _file.write(data, dataLength);
+        _file.write(zeros, payloadPad);
+
+        if (!_file.good())
+        {
+            // the partial record gets overwritten by the next append,
+            // or cut off the next time the bin opens.
+            _file.clear();
+            return false;
+        }
+
+        if (kind == KIND_TOMBSTONE)
+        {
+            _index.erase(key);
+        }
+        else
+        {
+            Entry& e = _index[key];
+            e.offset = _end;
+            e.length = recordLength(h);
+            e.time = time;
+        }
+
+        _end += recordLength(h);
+        return true;
+    }
+
+    const osgDB::Options*
+    PackedCacheBin::mergeOptions(const osgDB::Options* dbo)
+    {
+        if (!dbo)
+        {
+            return _zlibOptions.get();
+        }
+        else if (!_zlibOptions.valid())
+        {
+            return dbo;
+        }
+        else
+        {
+            osgDB::Options* merged = Registry::cloneOrCreateOptions(dbo);
+            if (_compressorName.length())
+            {
+                merged->setPluginStringData("Compressor", _compressorName);
+            }
+            return merged;
+        }
+    }
+
+    ReadResult
+    PackedCacheBin::read(const std::string& key, bool wantImage, const osgDB::Options* dbo)
+    {
+        OE_PROFILING_ZONE;
+
+        Located rec;
+        if (!locate(key, rec))
+            return ReadResult(ReadResult::RESULT_NOT_FOUND);
+
+        Config meta;
+        if (rec.header.metaLength > 0)
+            meta.fromJSON(std::string(rec.meta, rec.header.metaLength));
+
+        osg::ref_ptr<osg::Object> result;
+
+        if (rec.header.kind == KIND_IMAGE_RAW)
+        {
+            ImageHeader ih;
+            ::memcpy(&ih, rec.payload, sizeof(ImageHeader));
+
+            osg::Image::MipmapDataType mipmaps(ih.numMipmapLevels);
+            if (ih.numMipmapLevels > 0)
+                ::memcpy(&mipmaps[0], rec.payload + sizeof(ImageHeader), ih.numMipmapLevels * sizeof(std::uint32_t));
+
+            // zero-copy: the pixels stay in the mapping, which the image
+            // holds on to through its user data.
+            unsigned char* pixels = (unsigned char*)(rec.payload + imageDataOffset(ih));
+
+            osg::ref_ptr<osg::Image> image = new osg::Image();
+            image->setImage(
+                ih.s, ih.t, ih.r,
+                ih.internalFormat, ih.pixelFormat, ih.dataType,
+                pixels, osg::Image::NO_DELETE,
+                ih.packing, ih.rowLength);
+            image->setMipmapLevels(mipmaps);
+            image->setOrigin((osg::Image::Origin)ih.origin);
+            image->setUserData(rec.mapping.get());
+            result = image.get();
+        }
+        else if (wantImage && rec.header.kind != KIND_IMAGE_OSGB)
+        {
+            return ReadResult();
+        }
+        else
+        {
+            // only these records went through the compressor.
+            MemoryStreamBuf buf(rec.payload, rec.header.payloadLength);
+            std::istream in(&buf);
+
+            osgDB::ReaderWriter::ReadResult r =
+                rec.header.kind == KIND_IMAGE_OSGB ? _rw->readImage(in, dbo) :
+                rec.header.kind == KIND_NODE_OSGB ? _rw->readNode(in, dbo) :
+                _rw->readObject(in, dbo);
+
+            if (!r.success())
+            {
+                OE_WARN << LC << "Cache read failure for \"" << key << "\" in bin [" << getID() << "]: "
+                    << r.message() << std::endl;
+                return ReadResult(ReadResult::RESULT_READER_ERROR);
+            }
+            result = r.getObject();
+        }
+
+        ReadResult rr(result.get(), meta);
+        rr.setLastModifiedTime(rec.time);
+
+        if (_s_debug)
+            OE_NOTICE << LC << "Read \"" << key << "\" from cache bin [" << getID() << "]" << std::endl;
+
+        return rr;
+    }
+
+    ReadResult
+    PackedCacheBin::readImage(const std::string& key, const osgDB::Options* readOptions)
+    {
+        return read(key, true, readOptions);
+    }
+
+    ReadResult
+    PackedCacheBin::readObject(const std::string& key, const osgDB::Options* readOptions)
+    {
+        return read(key, false, readOptions);
+    }
+
+    ReadResult
+    PackedCacheBin::readString(const std::string& key, const osgDB::Options* readOptions)
+    {
+        ReadResult r = readObject(key, readOptions);
+        if ( r.succeeded() )
+        {
+            if ( r.get<StringObject>() )
+                return r;
+            else
+                return ReadResult();
+        }
+        else
+        {
+            return r;
+        }
+    }
+
+    bool
+    PackedCacheBin::write(
+        const std::string& key, 
+        const osg::Object* object, 
+        const Config& meta, 
+        const osgDB::Options* writeOptions)
+    {
+        if ( !_ok || !object )
+            return false;
+
+        OE_PROFILING_ZONE;
+
+        TimeStamp now = DateTime().asTimeStamp();
+        std::string metaJSON = meta.empty() ? std::string() : meta.toJSON(false);
+
+        // Plain images (including DXT/BC7/ETC2 compressed ones) are stored as
+        // their raw bytes so they can be read back in place. Anything fancier
+        // goes through OSGB.
+        const osg::Image* image = dynamic_cast<const osg::Image*>(object);
+        if (image &&
+            typeid(*image) == typeid(osg::Image) &&
+            image->data() != 0L &&
+            image->isDataContiguous())
+        {
+            const osg::Image::MipmapDataType& mipmaps = image->getMipmapLevels();
+
+            ImageHeader ih;
+            ih.s = image->s();
+            ih.t = image->t();
+            ih.r = image->r();
+            ih.internalFormat = image->getInternalTextureFormat();
+            ih.pixelFormat = image->getPixelFormat();
+            ih.dataType = image->getDataType();
+            ih.packing = image->getPacking();
+            ih.rowLength = image->getRowLength();
+            ih.origin = image->getOrigin();
+            ih.numMipmapLevels = mipmaps.size();
+            ih.dataLength = image->getTotalSizeInBytesIncludingMipmaps();
+
+            std::string prefix(imageDataOffset(ih), '\0');
+            ::memcpy(&prefix[0], &ih, sizeof(ImageHeader));
+            for (unsigned i = 0; i < mipmaps.size(); ++i)
+            {
+                std::uint32_t offset = mipmaps[i];
+                ::memcpy(&prefix[sizeof(ImageHeader) + i * sizeof(std::uint32_t)], &offset, sizeof(std::uint32_t));
+            }
+
+            if (!append(KIND_IMAGE_RAW, key, metaJSON,
+                        prefix.data(), prefix.size(),
+                        (const char*)image->data(), ih.dataLength,
+                        now))
+            {
+                OE_WARN << LC << "FAILED to write \"" << key << "\" to cache bin [" << getID() << "]" << std::endl;
+                return false;
+            }
+            return true;
+        }
+
+        osg::ref_ptr<const osgDB::Options> dbo = mergeOptions(writeOptions);
+
+        std::stringstream buf;
+        osgDB::ReaderWriter::WriteResult r;
+        RecordKind kind;
+
+        if (image)
+        {
+            r = _rw->writeImage(*image, buf, dbo.get());
+            kind = KIND_IMAGE_OSGB;
+        }
+        else if (dynamic_cast<const osg::Node*>(object))
+        {
+            r = _rw->writeNode(*static_cast<const osg::Node*>(object), buf, dbo.get());
+            kind = KIND_NODE_OSGB;
+        }
+        else
+        {
+            r = _rw->writeObject(*object, buf, dbo.get());
+            kind = KIND_OBJECT_OSGB;
+        }
+
+        if (!r.success())
+        {
+            OE_WARN << LC << "FAILED to write \"" << key << "\" to cache bin [" << getID() << "]; msg = \""
+                << r.message() << "\"" << std::endl;
+            return false;
+        }
+
+        std::string data = buf.str();
+        if (!append(kind, key, metaJSON, 0L, 0u, data.data(), data.size(), now))
+        {
+            OE_WARN << LC << "FAILED to write \"" << key << "\" to cache bin [" << getID() << "]" << std::endl;
+            return false;
+        }
+
+        if (_s_debug)
+            OE_NOTICE << LC << "Wrote \"" << key << "\" to cache bin [" << getID() << "]" << std::endl;
+
+        return true;
+    }
+
+    CacheBin::RecordStatus
+    PackedCacheBin::getRecordStatus(const std::string& key)
+    {
+        Threading::ScopedMutexLock lock(_mutex);
+        return _index.find(key) != _index.end() ? STATUS_OK : STATUS_NOT_FOUND;
+    }
+
+    bool
+    PackedCacheBin::remove(const std::string& key)
+    {
+        {
+            Threading::ScopedMutexLock lock(_mutex);
+            if (_index.find(key) == _index.end())
+                return false;
+        }
+        return append(KIND_TOMBSTONE, key, std::string(), 0L, 0u, 0L, 0u, DateTime().asTimeStamp());
+    }
+
+    bool
+    PackedCacheBin::touch(const std::string& key)
+    {
+        // Updates the age used for expiration. This is not persisted;
+        // after a restart the record's age is its write time again.
+        Threading::ScopedMutexLock lock(_mutex);
+        Index::iterator i = _index.find(key);
+        if (i == _index.end())
+            return false;
+        i->second.time = DateTime().asTimeStamp();
+        return true;
+    }
+
+    bool
+    PackedCacheBin::clear()
+    {
+        Threading::ScopedMutexLock lock(_mutex);
+
+        if (!_ok)
+            return false;
+
+        // Images decoded in place may still reference the old file. POSIX
+        // keeps an unlinked file alive for them, so we can start a new one.
+        _file.close();
+        _mapping = 0L;
+        std::remove(_packPath.c_str());
+
+        if (!create())
+        {
+            // Still in use (Windows won't delete or truncate a mapped file).
+            // Keep appending to it, and bury the old records so they don't
+            // come back the next time the bin opens.
+            _file.clear();
+            _file.open(_packPath.c_str(), std::ios::in | std::ios::out | std::ios::binary);
+            _ok = _file.is_open();
+
+            std::vector<std::string> keys;
+            keys.reserve(_index.size());
+            for (Index::const_iterator i = _index.begin(); i != _index.end(); ++i)
+                keys.push_back(i->first);
+
+            TimeStamp now = DateTime().asTimeStamp();
+            for (unsigned i = 0; i < keys.size() && _ok; ++i)
+                appendLocked(KIND_TOMBSTONE, keys[i], std::string(), 0L, 0u, 0L, 0u, now);
+        }
+
+        if (_s_debug)
+            OE_NOTICE << LC << "Cleared bin [" << getID() << "]" << std::endl;
+
+        return _ok;
+    }
+
+    unsigned
+    PackedCacheBin::getStorageSize()
+    {
+        Threading::ScopedMutexLock lock(_mutex);
+        return _end > 0xffffffffu ? 0xffffffffu : (unsigned)_end;
+    }
+}
+
+//------------------------------------------------------------------------
+
+/**
+ * Cache driver that stores each bin in a single memory-mapped file.
+ */
+class PackedCacheDriver : public CacheDriver
+{
+public:
+    PackedCacheDriver()
+    {
+        supportsExtension( "osgearth_cache_packed", "Packed file cache for osgEarth" );
+    }
+
+    virtual const char* className() const
+    {
+        return "Packed file cache for osgEarth";
+    }
+
+    virtual ReadResult readObject(const std::string& file_name, const Options* options) const
+    {
+        if ( !acceptsExtension(osgDB::getLowerCaseFileExtension( file_name )))
+            return ReadResult::FILE_NOT_HANDLED;
+
+        return ReadResult( new PackedCache( getCacheOptions(options) ) );
+    }
+};
+
+REGISTER_OSGPLUGIN(osgearth_cache_packed, PackedCacheDriver)
@@ -105,6 +105,16 @@ _active        ( true )
 
 RocksDBCacheImpl::~RocksDBCacheImpl()
 {
+    if ( _writeQueue.valid() )
+    {
+        _writeQueue->stop();
+
+        // with no write-ahead log, records still in the memtable
+        // would be lost since we never close the database.
+        if ( _options.disableWAL() == true )
+            _db->Flush(rocksdb::FlushOptions());
+    }
+
     if ( _db )
     {
         // problem. This destructor causes a lockup sometimes. Perhaps try
@@ -134,6 +144,7 @@ RocksDBCacheImpl::init()
     // Do an initial size check.
     if ( _db )
     {
+        _writeQueue = new WriteQueue(_db, _options);
         _tracker->calcSize();
     }
 
@@ -200,7 +211,7 @@ CacheBin*
 RocksDBCacheImpl::addBin( const std::string& name )
 {
     return _db ?
-        _bins.getOrCreate(name, new RocksDBCacheBin(name, _db, _tracker.get())) :
+        _bins.getOrCreate(name, new RocksDBCacheBin(name, _db, _tracker.get(), _writeQueue.get())) :
         0L;
 }
 
@@ -216,7 +227,7 @@ RocksDBCacheImpl::getOrCreateDefaultBin()
         Threading::ScopedMutexLock lock( s_defaultBinMutex );
         if ( !_defaultBin.valid() ) // double-check
         {
-            _defaultBin = new RocksDBCacheBin("_default", _db, _tracker.get());
+            _defaultBin = new RocksDBCacheBin("_default", _db, _tracker.get(), _writeQueue.get());
         }
     }
     return _defaultBin.get();
@@ -234,6 +245,7 @@ RocksDBCacheImpl::compact()
     if ( !_db )
         return false;
 
+    _writeQueue->flush();
     _db->CompactRange(0L, 0L);
 
     return true;
@@ -245,6 +257,8 @@ RocksDBCacheImpl::clear()
     if ( !_db )
         return false;
 
+    _writeQueue->flush();
+
     // No WriteBatch because it doesn't seem to allow compaction to occur
     // -- need to figure out why someday.
 
@@ -81,10 +81,12 @@ namespace
 
 RocksDBCacheBin::RocksDBCacheBin(const std::string& binID,
                                  rocksdb::DB*       db,
-                                 Tracker*           tracker) :
+                                 Tracker*           tracker,
+                                 WriteQueue*        writeQueue) :
 osgEarth::CacheBin( binID ),
 _db               ( db ),
 _tracker          ( tracker ),
+_writeQueue       ( writeQueue ),
 _debug            ( false )
 {
     // reader to parse data:
@@ -226,6 +228,20 @@ RocksDBCacheBin::timeEndGlobal() const
     return "t" + SEP + "\xff";
 }
 
+bool
+RocksDBCacheBin::get(const std::string& dbkey, std::string& value) const
+{
+    switch( _writeQueue->get(dbkey, value) )
+    {
+    case WriteQueue::QUEUED_PUT:
+        return true;
+    case WriteQueue::QUEUED_REMOVE:
+        return false;
+    default:
+        return _db->Get(rocksdb::ReadOptions(), dbkey, &value).ok();
+    }
+}
+
 ReadResult
 RocksDBCacheBin::readImage(const std::string& key, const osgDB::Options* readOptions)
 {
@@ -248,14 +264,11 @@ RocksDBCacheBin::read(const std::string& key, const Reader& reader)
     ++_tracker->reads;
 
     Config metadata;
-    rocksdb::Status status;
-    rocksdb::ReadOptions ro;
 
     // first read the metadata record.
     std::string metavalue;
-    status = _db->Get( ro, metaKey(key), &metavalue );
     TimeStamp lastModified = (TimeStamp)0;
-    if ( status.ok() )
+    if ( get(metaKey(key), metavalue) )
     {        
         decodeMeta(metavalue, metadata);
         DateTime t( metadata.value(TIME_FIELD));
@@ -265,8 +278,7 @@ RocksDBCacheBin::read(const std::string& key, const Reader& reader)
     // next read the data record.
     std::string datakey = dataKey(key);
     std::string datavalue;
-    status = _db->Get( ro, datakey, &datavalue );
-    if ( !status.ok() )
+    if ( !get(datakey, datavalue) )
     {
         // main record not found for some reason.
         return ReadResult(ReadResult::RESULT_NOT_FOUND);
@@ -372,24 +384,24 @@ RocksDBCacheBin::write(const std::string& key, const osg::Object* object, const
     if (objWriteOK)
     {
         DateTime now;
-        rocksdb::WriteBatch batch;
+        WriteQueue::Batch batch;
 
         // write the data:
         data = datastream.str();
         if ( _tracker->seed().isSet() )
             blend(data, _tracker->seed().value());
-        batch.Put( dataKey(key), data );
+        batch.put( dataKey(key), data );
 
         // write the timestamp index:
-        batch.Put( timeKey(now, key), binDataKeyTuple(key) );
+        batch.put( timeKey(now, key), binDataKeyTuple(key) );
 
         // write the metadata:
         Config metadata(meta);
         metadata.set( TIME_FIELD, now.asCompactISO8601() );
         encodeMeta( metadata, data );
-        batch.Put( metaKey(key), data );
+        batch.put( metaKey(key), data );
 
-        objWriteOK = _db->Write( rocksdb::WriteOptions(), &batch ).ok();
+        objWriteOK = _writeQueue->write( batch );
 
         if ( objWriteOK )
         {
@@ -455,13 +467,9 @@ RocksDBCacheBin::getRecordStatus(const std::string& key)
     if ( !binValidForReading() ) 
         return STATUS_NOT_FOUND;
 
-    rocksdb::Status status;
-    rocksdb::ReadOptions ro;
-
     // read the metadata record.
     std::string metavalue;
-    status = _db->Get( ro, metaKey(key), &metavalue );
-    if ( status.ok() )
+    if ( get(metaKey(key), metavalue) )
     {        
         return STATUS_OK;
     }
@@ -479,20 +487,19 @@ RocksDBCacheBin::remove(const std::string& key)
 
     // first read in the time from the metadata record.
     std::string metavalue;
-    if ( _db->Get(rocksdb::ReadOptions(), metaKey(key), &metavalue).ok() == false )
+    if ( get(metaKey(key), metavalue) == false )
         return false;
 
     Config metadata;
     decodeMeta(metavalue, metadata);
     DateTime t(metadata.value(TIME_FIELD));
 
-    rocksdb::WriteBatch batch;
-    batch.Delete( dataKey(key) );
-    batch.Delete( metaKey(key) );
-    batch.Delete( timeKey(t, key) );
+    WriteQueue::Batch batch;
+    batch.remove( dataKey(key) );
+    batch.remove( metaKey(key) );
+    batch.remove( timeKey(t, key) );
         
-    rocksdb::Status status = _db->Write(rocksdb::WriteOptions(), &batch);
-    if ( !status.ok() )
+    if ( !_writeQueue->write(batch) )
     {
         OE_WARN << LC << "Failed to remove (" << key << ") from bin " << getID() << std::endl;
         return false;
@@ -513,29 +520,29 @@ RocksDBCacheBin::touch(const std::string& key)
 
     // first read in the time from the metadata record.
     std::string metavalue;
-    if ( _db->Get(rocksdb::ReadOptions(), metaKey(key), &metavalue).ok() == false )
+    if ( get(metaKey(key), metavalue) == false )
         return false;
 
     Config metadata;
     decodeMeta(metavalue, metadata);
     DateTime oldtime(metadata.value(TIME_FIELD));
         
-    rocksdb::WriteBatch batch;
+    WriteQueue::Batch batch;
 
     // In a transaction, update the metadata record with the current time.
     std::string newtime = DateTime().asCompactISO8601();
     metadata.set(TIME_FIELD, newtime);
     encodeMeta(metadata, metavalue);
-    batch.Put(metaKey(key), metavalue);
+    batch.put(metaKey(key), metavalue);
 
     // ...remove the old time index record:
-    batch.Delete( timeKey(oldtime, key) );
+    batch.remove( timeKey(oldtime, key) );
 
     // ...and write a new time index record.
-    batch.Put( timeKey(newtime, key), binDataKeyTuple(key) );
+    batch.put( timeKey(newtime, key), binDataKeyTuple(key) );
 
-    rocksdb::Status status = _db->Write(rocksdb::WriteOptions(), &batch);
-    if ( !status.ok() )
+    bool ok = _writeQueue->write(batch);
+    if ( !ok )
     {
         OE_WARN << LC << "Failed to touch (" << key << ") in bin " << getID() << std::endl;
     }
@@ -543,7 +550,7 @@ RocksDBCacheBin::touch(const std::string& key)
     {
         OE_NOTICE << LC << "Bin " << getID() << ": touch (" << key << ")\n";
     }
-    return status.ok();
+    return ok;
 }
 
 bool
@@ -552,6 +559,8 @@ RocksDBCacheBin::clear()
     if ( !binValidForWriting() )
         return false;
     
+    _writeQueue->flush();
+
     rocksdb::WriteOptions wo;
     std::string binphrase = binPhrase();
     rocksdb::WriteBatch batch;
@@ -581,6 +590,7 @@ RocksDBCacheBin::compact()
         return false;
 
     // This could take a while.
+    _writeQueue->flush();
     _db->CompactRange(0L, 0L);
 
     return false;
@@ -0,0 +1,238 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2016 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include "WriteQueue"
+#include <osgEarth/Notify>
+#include <osg/Math>
+#include <rocksdb/write_batch.h>
+
+using namespace osgEarth;
+using namespace osgEarth::RocksDBCache;
+
+#undef  LC
+#define LC "[RocksDBCache] "
+
+namespace
+{
+    inline std::size_t sizeOf(const std::string& key, const std::string& value)
+    {
+        return key.size() + value.size();
+    }
+}
+
+WriteQueue::WriteQueue(rocksdb::DB* db, const RocksDBCacheOptions& options) :
+_db          ( db ),
+_writeBehind ( options.writeBehind().get() ),
+_maxBytes    ( (std::size_t)options.writeQueueSizeMB().get() * 1048576 ),
+_maxBatchSize( osg::maximum(options.writeBatchSize().get(), 1u) ),
+_mutex       ( "RocksDBCache.WriteQueue" ),
+_pendingBytes( 0 ),
+_seq         ( 0 ),
+_committed   ( 0 ),
+_done        ( false )
+{
+    // A cache can always be rebuilt from its source, so skipping the
+    // write-ahead log is a reasonable trade for throughput.
+    _writeOptions.disableWAL = options.disableWAL().get();
+
+    if ( _writeBehind )
+    {
+        _thread = std::thread(&WriteQueue::run, this);
+    }
+}
+
+WriteQueue::~WriteQueue()
+{
+    stop();
+}
+
+bool
+WriteQueue::write(Batch& batch)
+{
+    if ( batch._records.empty() )
+        return true;
+
+    if ( _writeBehind )
+    {
+        std::size_t bytes = 0u;
+        for (auto& r : batch._records)
+            bytes += sizeOf(r._key, r._value);
+
+        std::unique_lock<Threading::Mutex> lock(_mutex);
+
+        // Back-pressure: wait for the writer to make room. A batch bigger
+        // than the whole budget still goes in once the queue is empty.
+        _drained.wait(lock, [&]() {
+            return _done || _pendingBytes == 0u || _pendingBytes + bytes <= _maxBytes;
+        });
+
+        if ( !_done )
+        {
+            for (auto& r : batch._records)
+            {
+                auto result = _pending.emplace(r._key, Pending());
+                Pending& p = result.first->second;
+                if ( !result.second )
+                    _pendingBytes -= sizeOf(r._key, p._value);
+
+                p._value.swap(r._value);
+                p._remove = r._remove;
+                p._seq = ++_seq;
+                _pendingBytes += sizeOf(r._key, p._value);
+
+                Queued q;
+                q._key = r._key;
+                q._seq = p._seq;
+                _queue.push_back(q);
+            }
+            batch._records.clear();
+
+            _queued.notify_one();
+            return true;
+        }
+
+        // stopped while we were waiting; write it ourselves.
+    }
+
+    rocksdb::WriteBatch wb;
+    for (auto& r : batch._records)
+    {
+        if ( r._remove )
+            wb.Delete(r._key);
+        else
+            wb.Put(r._key, r._value);
+    }
+    return _db->Write(_writeOptions, &wb).ok();
+}
+
+WriteQueue::Lookup
+WriteQueue::get(const std::string& key, std::string& value) const
+{
+    if ( !_writeBehind )
+        return NOT_QUEUED;
+
+    Threading::ScopedMutexLock lock(_mutex);
+
+    PendingMap::const_iterator i = _pending.find(key);
+    if ( i == _pending.end() )
+        return NOT_QUEUED;
+
+    if ( i->second._remove )
+        return QUEUED_REMOVE;
+
+    value = i->second._value;
+    return QUEUED_PUT;
+}
+
+void
+WriteQueue::flush()
+{
+    if ( !_writeBehind )
+        return;
+
+    std::unique_lock<Threading::Mutex> lock(_mutex);
+    unsigned target = _seq;
+    _drained.wait(lock, [&]() {
+        return _done || _committed >= target;
+    });
+}
+
+void
+WriteQueue::stop()
+{
+    {
+        Threading::ScopedMutexLock lock(_mutex);
+        _done = true;
+    }
+    _queued.notify_all();
+    _drained.notify_all();
+
+    if ( _thread.joinable() )
+    {
+        _thread.join();
+    }
+}
+
+void
+WriteQueue::run()
+{
+    std::unique_lock<Threading::Mutex> lock(_mutex);
+
+    while (true)
+    {
+        _queued.wait(lock, [this]() {
+            return _done || !_queue.empty();
+        });
+
+        // when stopping, keep going until the queue is empty.
+        if ( _queue.empty() )
+            break;
+
+        // Gather everything queued, up to the batch limit. An entry whose
+        // key was written again afterwards is skipped, since the later
+        // entry carries the newer value.
+        rocksdb::WriteBatch wb;
+        std::vector<Queued> batch;
+        unsigned last = 0u;
+
+        while (!_queue.empty() && batch.size() < _maxBatchSize)
+        {
+            Queued& q = _queue.front();
+            PendingMap::const_iterator i = _pending.find(q._key);
+            if ( i != _pending.end() && i->second._seq == q._seq )
+            {
+                if ( i->second._remove )
+                    wb.Delete(q._key);
+                else
+                    wb.Put(q._key, i->second._value);
+
+                batch.push_back(q);
+            }
+            last = q._seq;
+            _queue.pop_front();
+        }
+
+        if ( !batch.empty() )
+        {
+            lock.unlock();
+
+            rocksdb::Status status = _db->Write(_writeOptions, &wb);
+            if ( !status.ok() )
+            {
+                OE_WARN << LC << "Failed to write " << batch.size() << " record(s): "
+                    << status.ToString() << std::endl;
+            }
+
+            lock.lock();
+
+            // Retire the records, unless they were written again meanwhile.
+            for (auto& q : batch)
+            {
+                PendingMap::iterator i = _pending.find(q._key);
+                if ( i != _pending.end() && i->second._seq == q._seq )
+                {
+                    _pendingBytes -= sizeOf(q._key, i->second._value);
+                    _pending.erase(i);
+                }
+            }
+        }
+
+        _committed = last;
+        _drained.notify_all();
+    }
+}
@@ -0,0 +1,227 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+ * Copyright 2008-2014 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include "BindlessTextures"
+#include <osgEarth/Notify>
+#include <osg/Texture2D>
+#include <osg/GLExtensions>
+
+using namespace osgEarth::REX;
+
+#undef  LC
+#define LC "[BindlessTextures] "
+
+#ifndef GL_TEXTURE_MAX_ANISOTROPY_EXT
+#define GL_TEXTURE_MAX_ANISOTROPY_EXT 0x84FE
+#endif
+
+BindlessTextures::PerContext::PerContext() :
+_lastFrame(~0u),
+_initialized(-1),
+glGetTextureHandle(0L),
+glMakeTextureHandleResident(0L),
+glMakeTextureHandleNonResident(0L),
+glCopyImageSubData(0L),
+glTexStorage2D(0L),
+glUniformHandleui64(0L)
+{
+    //nop
+}
+
+bool
+BindlessTextures::PerContext::init(osg::State& state)
+{
+    if (_initialized < 0)
+    {
+        osg::setGLExtensionFuncPtr(glGetTextureHandle, "glGetTextureHandleARB");
+        osg::setGLExtensionFuncPtr(glMakeTextureHandleResident, "glMakeTextureHandleResidentARB");
+        osg::setGLExtensionFuncPtr(glMakeTextureHandleNonResident, "glMakeTextureHandleNonResidentARB");
+        osg::setGLExtensionFuncPtr(glUniformHandleui64, "glUniformHandleui64ARB");
+        osg::setGLExtensionFuncPtr(glCopyImageSubData, "glCopyImageSubData", "glCopyImageSubDataARB");
+        osg::setGLExtensionFuncPtr(glTexStorage2D, "glTexStorage2D", "glTexStorage2DARB");
+
+        _initialized =
+            glGetTextureHandle && glMakeTextureHandleResident && glMakeTextureHandleNonResident &&
+            glUniformHandleui64 && glCopyImageSubData && glTexStorage2D ? 1 : 0;
+
+        if (_initialized == 0)
+        {
+            OE_WARN << LC << "Bindless texture entry points not found; falling back on texture binding" << std::endl;
+        }
+    }
+    return _initialized == 1;
+}
+
+void
+BindlessTextures::PerContext::flush(bool all)
+{
+    for (Entries::iterator i = _entries.begin(); i != _entries.end(); )
+    {
+        if (all || !i->second._source.valid())
+        {
+            if (i->second._handle != 0)
+                glMakeTextureHandleNonResident(i->second._handle);
+            glDeleteTextures(1, &i->second._name);
+            i = _entries.erase(i);
+        }
+        else ++i;
+    }
+}
+
+BindlessTextures::BindlessTextures()
+{
+    //nop
+}
+
+BindlessTextures::Handle
+BindlessTextures::getHandle(osg::Texture* texture, osg::State& state)
+{
+    if (texture == 0L)
+        return 0;
+
+    PerContext& pc = _pcs[state.getContextID()];
+    if (!pc.init(state))
+        return 0;
+
+    // Once per frame, release the copies of textures that no longer exist.
+    unsigned frame = state.getFrameStamp() ? state.getFrameStamp()->getFrameNumber() : 0u;
+    if (frame != pc._lastFrame)
+    {
+        pc.flush(false);
+        pc._lastFrame = frame;
+    }
+
+    PerContext::Entries::iterator i = pc._entries.find(texture);
+    if (i != pc._entries.end() && i->second._source.get() == texture)
+    {
+        return i->second._handle;
+    }
+
+    // an expired texture whose address was reused; start over
+    if (i != pc._entries.end())
+    {
+        if (i->second._handle != 0)
+            pc.glMakeTextureHandleNonResident(i->second._handle);
+        glDeleteTextures(1, &i->second._name);
+        pc._entries.erase(i);
+    }
+
+    return createHandle(texture, state, pc);
+}
+
+BindlessTextures::Handle
+BindlessTextures::createHandle(osg::Texture* texture, osg::State& state, PerContext& pc)
+{
+    // Only static 2D textures qualify; anything that OSG might update
+    // after the fact has to keep going through normal binding.
+    osg::Texture2D* tex2d = dynamic_cast<osg::Texture2D*>(texture);
+    if (tex2d == 0L)
+        return 0;
+
+    const osg::Image* image = tex2d->getImage();
+    if (image && image->requiresUpdateCall())
+        return 0;
+
+    // Subloaded textures (like virtual texture atlases) change in place.
+    if (tex2d->getSubloadCallback())
+        return 0;
+
+    unsigned contextID = state.getContextID();
+
+    // Make sure OSG has compiled the texture so there's something to copy.
+    osg::Texture::TextureObject* to = tex2d->getTextureObject(contextID);
+    if (to == 0L || tex2d->isDirty(contextID))
+    {
+        tex2d->apply(state);
+        state.haveAppliedTextureAttribute(state.getActiveTextureUnit(), tex2d);
+        to = tex2d->getTextureObject(contextID);
+        if (to == 0L)
+            return 0;
+    }
+
+    const osg::Texture::TextureProfile& profile = to->_profile;
+    GLsizei levels = osg::maximum(profile._numMipmapLevels, 1);
+    GLsizei width = profile._width;
+    GLsizei height = profile._height;
+    if (width <= 0 || height <= 0)
+        return 0;
+
+    Entry& entry = pc._entries[texture];
+    entry._source = texture;
+    entry._handle = 0;
+
+    glGenTextures(1, &entry._name);
+    glBindTexture(GL_TEXTURE_2D, entry._name);
+    pc.glTexStorage2D(GL_TEXTURE_2D, levels, profile._internalFormat, width, height);
+
+    for (GLint level = 0; level < levels; ++level)
+    {
+        pc.glCopyImageSubData(
+            to->id(), GL_TEXTURE_2D, level, 0, 0, 0,
+            entry._name, GL_TEXTURE_2D, level, 0, 0, 0,
+            osg::maximum(width >> level, 1), osg::maximum(height >> level, 1), 1);
+    }
+
+    // Sampling parameters become part of the handle, so set them first.
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, levels > 1 ? tex2d->getFilter(osg::Texture::MIN_FILTER) : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, tex2d->getFilter(osg::Texture::MAG_FILTER));
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, tex2d->getWrap(osg::Texture::WRAP_S));
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, tex2d->getWrap(osg::Texture::WRAP_T));
+    if (tex2d->getMaxAnisotropy() > 1.0f)
+        glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, tex2d->getMaxAnisotropy());
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    // We bypassed OSG's texture state, so force it to re-apply next time.
+    state.haveAppliedTextureAttribute(state.getActiveTextureUnit(), osg::StateAttribute::TEXTURE);
+
+    entry._handle = pc.glGetTextureHandle(entry._name);
+    if (entry._handle != 0)
+    {
+        pc.glMakeTextureHandleResident(entry._handle);
+    }
+
+    return entry._handle;
+}
+
+void
+BindlessTextures::setUniform(GLint location, Handle handle, osg::State& state) const
+{
+    const PerContext& pc = _pcs[state.getContextID()];
+    if (pc.glUniformHandleui64)
+    {
+        pc.glUniformHandleui64(location, handle);
+    }
+}
+
+void
+BindlessTextures::releaseGLObjects(osg::State* state) const
+{
+    if (state)
+    {
+        PerContext& pc = _pcs[state->getContextID()];
+        if (pc._initialized == 1)
+            pc.flush(true);
+    }
+    else
+    {
+        // no context current; just forget the objects
+        for (unsigned i = 0; i < _pcs.size(); ++i)
+            _pcs[i]._entries.clear();
+    }
+}
@@ -41,11 +41,12 @@ PerProgramState::refresh(osg::RenderInfo& ri, const RenderBindings* bindings)
         clear();
 
         // for each sampler binding, initialize its state tracking structure 
-        // and resolve its matrix uniform location:
+        // and resolve its matrix and sampler uniform locations:
         for (unsigned i = 0; i < bindings->size(); ++i)
         {
             const SamplerBinding& binding = (*bindings)[i];
             _samplerState._samplers[i]._matrixUL = pcp->getUniformLocation(osg::Uniform::getNameID(binding.matrixName()));
+            _samplerState._samplers[i]._samplerUL = pcp->getUniformLocation(osg::Uniform::getNameID(binding.samplerName()));
         }
 
         // resolve all the other uniform locations:
@@ -55,6 +56,9 @@ PerProgramState::refresh(osg::RenderInfo& ri, const RenderBindings* bindings)
         _layerUidUL = pcp->getUniformLocation(osg::Uniform::getNameID("oe_layer_uid"));
         _layerOrderUL = pcp->getUniformLocation(osg::Uniform::getNameID("oe_layer_order"));
         _morphConstantsUL = pcp->getUniformLocation(osg::Uniform::getNameID("oe_tile_morph"));
+        _decalCountUL = pcp->getUniformLocation(osg::Uniform::getNameID("oe_tile_decalCount"));
+        _decalRectsUL = pcp->getUniformLocation(osg::Uniform::getNameID("oe_tile_decalRects"));
+        _decalLayersUL = pcp->getUniformLocation(osg::Uniform::getNameID("oe_tile_decalLayers"));
     }
 }
 
@@ -64,6 +68,8 @@ PerProgramState::clear()
     _elevTexelCoeff.clear();
     _morphConstants.clear();
     _parentTextureExists.clear();
+    _decalCount.clear();
+    _decalTextureApplied = false;
     _samplerState.clear();
 }
 
@@ -57,6 +57,34 @@ DrawTileCommand::draw(osg::RenderInfo& ri, DrawState& dsMaster, osg::Referenced*
         ds._morphConstants = _morphConstants;
     }
 
+    // GPU decals for this tile. The list changes from tile to tile, so
+    // only skip the upload when neither this tile nor the last had any.
+    if (ds._decalCountUL >= 0)
+    {
+        unsigned count = _decals.valid() ? _decals->_num : 0u;
+        if (count > 0u || !ds._decalCount.isSetTo(0u))
+        {
+            ext->glUniform1i(ds._decalCountUL, (GLint)count);
+            ds._decalCount = count;
+        }
+
+        if (count > 0u)
+        {
+            if (ds._decalRectsUL >= 0)
+                ext->glUniform4fv(ds._decalRectsUL, count, _decals->_rects[0].ptr());
+
+            if (ds._decalLayersUL >= 0)
+                ext->glUniform1fv(ds._decalLayersUL, count, _decals->_layers);
+
+            if (!ds._decalTextureApplied && dsMaster._decalTexture.valid() && dsMaster._decalUnit >= 0)
+            {
+                state.setActiveTextureUnit(dsMaster._decalUnit);
+                dsMaster._decalTexture->apply(state);
+                ds._decalTextureApplied = true;
+            }
+        }
+    }
+
     // MVM for this tile:
     state.applyModelViewMatrix(_modelViewMatrix.get());
     
@@ -73,9 +101,53 @@ DrawTileCommand::draw(osg::RenderInfo& ri, DrawState& dsMaster, osg::Referenced*
     {
         for (s = 0; s <= SamplerBinding::COLOR_PARENT; ++s)
         {
-            const Sampler& sampler = (*_colorSamplers)[s];
+            // Virtual texture pages map into the atlas like an inherited
+            // texture maps into its ancestor's.
+            Sampler page;
+            if (_virtualTexture && _virtualPages[s].x() > 0.0f)
+            {
+                const osg::Vec4f& p = _virtualPages[s];
+                page._texture = _virtualTexture;
+                page._matrix.set(
+                    p.x(), 0, 0, 0,
+                    0, p.y(), 0, 0,
+                    0, 0, 1, 0,
+                    p.z(), p.w(), 0, 1);
+            }
+
+            const Sampler& sampler = _virtualTexture ? page : (*_colorSamplers)[s];
             SamplerState& samplerState = ds._samplerState._samplers[s];
 
+            // Bindless color textures: set the handle instead of binding.
+            // Textures without a handle fall back on their texture unit.
+            if (dsMaster._bindless && samplerState._samplerUL >= 0 && sampler._texture.valid())
+            {
+                if (!samplerState._texture.isSetTo(sampler._texture.get()))
+                {
+                    BindlessTextures::Handle handle = dsMaster._bindless->getHandle(sampler._texture.get(), state);
+                    if (handle != 0)
+                    {
+                        if (!samplerState._handle.isSetTo(handle))
+                        {
+                            dsMaster._bindless->setUniform(samplerState._samplerUL, handle, state);
+                            samplerState._handle = handle;
+                        }
+                    }
+                    else
+                    {
+                        GLint unit = (*dsMaster._bindings)[s].unit();
+                        if (!samplerState._handle.isSetTo(0))
+                        {
+                            ext->glUniform1i(samplerState._samplerUL, unit);
+                            samplerState._handle = 0;
+                        }
+                        state.setActiveTextureUnit(unit);
+                        sampler._texture->apply(state);
+                    }
+                    samplerState._texture = sampler._texture.get();
+                }
+            }
+            else
             if (sampler._texture.valid() && !samplerState._texture.isSetTo(sampler._texture.get()))
             {
                 state.setActiveTextureUnit((*dsMaster._bindings)[s].unit());
@@ -130,6 +202,7 @@ DrawTileCommand::draw(osg::RenderInfo& ri, DrawState& dsMaster, osg::Referenced*
         tileData._key = _key;
         tileData._geomBBox = &_geom->getBoundingBox();
         tileData._tileBBox = &_tile->getBoundingBox();
+        tileData._revision = _tileRevision;
         _drawCallback->drawTile(ri, tileData);
     }
 
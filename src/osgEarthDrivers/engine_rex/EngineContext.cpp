@@ -21,6 +21,7 @@
 #include <osgEarth/TraversalData>
 #include <osgEarth/CullingUtils>
 #include <osgEarth/Registry>
+#include <osgEarth/Capabilities>
 
 using namespace osgEarth::REX;
 using namespace osgEarth;
@@ -51,10 +52,22 @@ _options       ( options ),
 _selectionInfo ( selectionInfo ),
 _tick(0),
 _tilesLastCull(0),
-_clock(clock)
+_clock(clock),
+_decalUnit(-1)
 {
     _expirationRange2 = _options.minExpiryRange().get() * _options.minExpiryRange().get();
     _bboxCB = new ModifyBoundingBoxCallback(this);
+
+    if (_options.bindlessTextures() == true &&
+        Registry::capabilities().supportsBindlessTexture())
+    {
+        _bindless = new BindlessTextures();
+    }
+
+    if (_options.textureStreaming() == true)
+    {
+        _streamer = new TextureStreamer(_options.textureUploadBudget().get() * 1024u);
+    }
 }
 
 osg::ref_ptr<const Map>
@@ -35,6 +35,7 @@ GeometryPool::GeometryPool(const TerrainOptions& options) :
 _options ( options ),
 _enabled ( true ),
 _debug   ( false ),
+_useVertexArena( true ),
 _geometryMapMutex("GeometryPool(OE)")
 {
     ADJUST_UPDATE_TRAV_COUNT(this, +1);
@@ -51,6 +52,12 @@ _geometryMapMutex("GeometryPool(OE)")
         OE_INFO << LC << "Geometry pool disabled (environment)" << std::endl;
     }
 
+    if ( ::getenv("OSGEARTH_REX_NO_VERTEX_ARENA") )
+    {
+        _useVertexArena = false;
+        OE_INFO << LC << "Vertex arena disabled (environment)" << std::endl;
+    }
+
     //if ( ::getenv( "OSGEARTH_MEMORY_PROFILE" ) )
     //{
     //    _enabled = false;
@@ -71,7 +78,7 @@ GeometryPool::getPooledGeometry(const TileKey&                tileKey,
     if ( _enabled )
     {
         // Look it up in the pool:
-        Threading::ScopedMutexLock lock(_geometryMapMutex);
+        std::unique_lock<Threading::Mutex> lock(_geometryMapMutex);
 
         // make our globally shared EBO if we need it
         if ( !_defaultPrimSet.valid())
@@ -87,8 +94,18 @@ GeometryPool::getPooledGeometry(const TileKey&                tileKey,
 
         bool masking = maskSet && maskSet->hasMasks();
 
+        // Masked geometry is unique to its tile and never pooled, so build
+        // it outside the lock; it is the slow kind, and tiles loading on
+        // other threads shouldn't have to wait for it.
+        if ( masking )
+        {
+            lock.unlock();
+            out = createGeometry( tileKey, tileSize, maskSet );
+            return;
+        }
+
         GeometryMap::iterator i = _geometryMap.find( geomKey );
-        if ( !masking && i != _geometryMap.end() )
+        if ( i != _geometryMap.end() )
         {
             // Found. return it.
             out = i->second.get();
@@ -98,8 +115,13 @@ GeometryPool::getPooledGeometry(const TileKey&                tileKey,
             // Not found. Create it.
             out = createGeometry( tileKey, tileSize, maskSet );
 
-            if (!masking && out.valid())
+            if (out.valid())
             {
+                if (_useVertexArena)
+                {
+                    addToVertexArena(out.get());
+                }
+
                 _geometryMap[ geomKey ] = out.get();
             }
 
@@ -116,6 +138,34 @@ GeometryPool::getPooledGeometry(const TileKey&                tileKey,
     }
 }
 
+// Size at which we stop adding geometries to an arena and start a new one.
+// Every time a geometry joins or leaves an arena, OSG re-uploads the whole
+// buffer, so we keep them modest.
+#define VERTEX_ARENA_CAPACITY (4u*1024u*1024u)
+
+void
+GeometryPool::addToVertexArena(SharedGeometry* geom)
+{
+    // ASSUME _geometryMapMutex IS LOCKED
+
+    unsigned size = 0u;
+    if (geom->getVertexArray()) size += geom->getVertexArray()->getTotalDataSize();
+    if (geom->getNormalArray()) size += geom->getNormalArray()->getTotalDataSize();
+    if (geom->getTexCoordArray()) size += geom->getTexCoordArray()->getTotalDataSize();
+    if (geom->getNeighborArray()) size += geom->getNeighborArray()->getTotalDataSize();
+    if (geom->getNeighborNormalArray()) size += geom->getNeighborNormalArray()->getTotalDataSize();
+
+    if (!_arena.valid() || _arena->_size + size > VERTEX_ARENA_CAPACITY)
+    {
+        _arena = new VertexArena();
+        _arena->_vbo = new osg::VertexBufferObject();
+        _arenas.push_back(_arena.get());
+    }
+
+    geom->setVertexArena(_arena.get());
+    _arena->_size += size;
+}
+
 void
 GeometryPool::createKeyForTileKey(const TileKey&             tileKey,
                                   unsigned                   tileSize,
@@ -142,6 +192,42 @@ namespace
         return 1;
     }
 
+    // Octahedral encoding of a unit vector, quantized to 12 bits per axis
+    // and packed into the 24-bit integer range a float holds exactly.
+    // Decoded by oe_rex_unpackNormal in RexEngine.Morphing.glsl; the
+    // round trip is within about 0.05 degrees.
+    float packNormal(const osg::Vec3& v)
+    {
+        float d = fabs(v.x()) + fabs(v.y()) + fabs(v.z());
+        float x = d > 0.0f ? v.x() / d : 0.0f;
+        float y = d > 0.0f ? v.y() / d : 0.0f;
+        if (v.z() < 0.0f)
+        {
+            float ox = x;
+            x = (1.0f - fabs(y)) * (ox >= 0.0f ? 1.0f : -1.0f);
+            y = (1.0f - fabs(ox)) * (y >= 0.0f ? 1.0f : -1.0f);
+        }
+        unsigned qx = (unsigned)osg::clampBetween((int)floorf((x*0.5f + 0.5f)*4095.0f + 0.5f), 0, 4095);
+        unsigned qy = (unsigned)osg::clampBetween((int)floorf((y*0.5f + 0.5f)*4095.0f + 0.5f), 0, 4095);
+        return (float)(qx * 4096u + qy);
+    }
+
+    // Folds the neighbor normals into the w component of the neighbor
+    // positions, so morphing reads one vec4 stream instead of two vec3s.
+    osg::Vec4Array* packNeighbors(const osg::Vec3Array* neighbors, const osg::Vec3Array* neighborNormals)
+    {
+        osg::Vec4Array* packed = new osg::Vec4Array();
+        packed->setBinding(packed->BIND_PER_VERTEX);
+        packed->setVertexBufferObject(neighbors->getVertexBufferObject());
+        packed->reserve(neighbors->size());
+        for (unsigned i = 0; i < neighbors->size(); ++i)
+        {
+            const osg::Vec3& p = (*neighbors)[i];
+            packed->push_back(osg::Vec4(p, packNormal((*neighborNormals)[i])));
+        }
+        return packed;
+    }
+
     struct Sort_by_X {
         osg::Vec3Array& _verts;
         Sort_by_X(osg::Vec3Array* verts) : _verts(*verts) { }
@@ -583,6 +669,14 @@ GeometryPool::createGeometry(const TileKey& tileKey,
         }
     }
 
+    if (neighbors.valid())
+    {
+        geom->setNeighborArray(packNeighbors(
+            static_cast<osg::Vec3Array*>(geom->getNeighborArray()),
+            static_cast<osg::Vec3Array*>(geom->getNeighborNormalArray())));
+        geom->setNeighborNormalArray(0L);
+    }
+
     if (primSet)
     {
         geom->setDrawElements(primSet);
@@ -619,6 +713,18 @@ GeometryPool::traverse(osg::NodeVisitor& nv)
         {
             _geometryMap.erase(*key);
         }
+
+        // Release any arenas whose geometries are all gone.
+        for (unsigned i = 0; i < _arenas.size(); )
+        {
+            if (_arenas[i]->referenceCount() == 1 && _arenas[i] != _arena)
+            {
+                _arenas[i]->_vbo->releaseGLObjects(NULL);
+                _arenas[i] = _arenas.back();
+                _arenas.pop_back();
+            }
+            else ++i;
+        }
     }
 
     osg::Group::traverse(nv);
@@ -630,6 +736,8 @@ GeometryPool::clear()
     releaseGLObjects(NULL);
     Threading::ScopedMutexLock lock(_geometryMapMutex);
     _geometryMap.clear();
+    _arena = NULL;
+    _arenas.clear();
 }
 
 void
@@ -668,6 +776,14 @@ GeometryPool::releaseGLObjects(osg::State* state) const
                     i->second->releaseGLObjects(state);
             }
 
+            for (unsigned i = 0; i < _arenas.size(); ++i)
+            {
+                if (_releaser.valid())
+                    objects.push_back(_arenas[i]->_vbo.get());
+                else
+                    _arenas[i]->_vbo->releaseGLObjects(state);
+            }
+
             if (_releaser.valid() && !objects.empty())
             {
                 OE_INFO << LC << "Released " << objects.size() << " objects in the geometry pool\n";
@@ -708,7 +824,32 @@ SharedGeometry::SharedGeometry(const SharedGeometry& rhs,const osg::CopyOp& copy
 
 SharedGeometry::~SharedGeometry()
 {
-    //nop
+    // Leave the arena under its lock, since the draw thread may be using its VBO.
+    if (_arena.valid())
+    {
+        Threading::ScopedMutexLock lock(_arena->_mutex);
+        if (_vertexArray.valid()) _vertexArray->setVertexBufferObject(0L);
+        if (_normalArray.valid()) _normalArray->setVertexBufferObject(0L);
+        if (_texcoordArray.valid()) _texcoordArray->setVertexBufferObject(0L);
+        if (_neighborArray.valid()) _neighborArray->setVertexBufferObject(0L);
+        if (_neighborNormalArray.valid()) _neighborNormalArray->setVertexBufferObject(0L);
+    }
+}
+
+void
+SharedGeometry::setVertexArena(VertexArena* arena)
+{
+    _arena = arena;
+    if (_arena.valid())
+    {
+        Threading::ScopedMutexLock lock(_arena->_mutex);
+        osg::VertexBufferObject* vbo = _arena->_vbo.get();
+        if (_vertexArray.valid()) _vertexArray->setVertexBufferObject(vbo);
+        if (_normalArray.valid()) _normalArray->setVertexBufferObject(vbo);
+        if (_texcoordArray.valid()) _texcoordArray->setVertexBufferObject(vbo);
+        if (_neighborArray.valid()) _neighborArray->setVertexBufferObject(vbo);
+        if (_neighborNormalArray.valid()) _neighborNormalArray->setVertexBufferObject(vbo);
+    }
 }
 
 bool
@@ -719,6 +860,21 @@ SharedGeometry::empty() const
         (_maskElements.valid() == false || _maskElements->getNumIndices() == 0);
 }
 
+unsigned
+SharedGeometry::getTotalDataSize() const
+{
+    unsigned size = 0u;
+    if (_vertexArray.valid()) size += _vertexArray->getTotalDataSize();
+    if (_normalArray.valid()) size += _normalArray->getTotalDataSize();
+    if (_colorArray.valid()) size += _colorArray->getTotalDataSize();
+    if (_texcoordArray.valid()) size += _texcoordArray->getTotalDataSize();
+    if (_neighborArray.valid()) size += _neighborArray->getTotalDataSize();
+    if (_neighborNormalArray.valid()) size += _neighborNormalArray->getTotalDataSize();
+    if (_drawElements.valid()) size += _drawElements->getTotalDataSize();
+    if (_maskElements.valid()) size += _maskElements->getTotalDataSize();
+    return size;
+}
+
 #ifdef SUPPORTS_VAO
 #if OSG_MIN_VERSION_REQUIRED(3,5,9)
 osg::VertexArrayState* SharedGeometry::createVertexArrayStateImplementation(osg::RenderInfo& renderInfo) const
@@ -733,10 +889,14 @@ osg::VertexArrayState* SharedGeometry::createVertexArrayState(osg::RenderInfo& r
     if (_vertexArray.valid()) vas->assignVertexArrayDispatcher();
     if (_normalArray.valid()) vas->assignNormalArrayDispatcher();
     unsigned texUnits = 0;
-    if (_neighborArray.valid())
+    if (_neighborNormalArray.valid())
     {
         texUnits = 3;
     }
+    else if (_neighborArray.valid())
+    {
+        texUnits = 2;
+    }
     else if (_texcoordArray.valid())
     {
         texUnits = 1;
@@ -777,12 +937,17 @@ void SharedGeometry::releaseGLObjects(osg::State* state) const
 {
     osg::Drawable::releaseGLObjects(state);
 
-    if (_vertexArray.valid()) _vertexArray->releaseGLObjects(state);
-    if (_normalArray.valid()) _normalArray->releaseGLObjects(state);
-    if (_colorArray.valid()) _colorArray->releaseGLObjects(state);
-    if (_texcoordArray.valid()) _texcoordArray->releaseGLObjects(state);
-    if (_neighborArray.valid()) _neighborArray->releaseGLObjects(state);
-    if (_neighborNormalArray.valid()) _neighborNormalArray->releaseGLObjects(state);
+    // Arena VBOs are shared with other geometries, and the pool releases them
+    // once they're empty.
+    if (!_arena.valid())
+    {
+        if (_vertexArray.valid()) _vertexArray->releaseGLObjects(state);
+        if (_normalArray.valid()) _normalArray->releaseGLObjects(state);
+        if (_colorArray.valid()) _colorArray->releaseGLObjects(state);
+        if (_texcoordArray.valid()) _texcoordArray->releaseGLObjects(state);
+        if (_neighborArray.valid()) _neighborArray->releaseGLObjects(state);
+        if (_neighborNormalArray.valid()) _neighborNormalArray->releaseGLObjects(state);
+    }
     if (_drawElements.valid()) _drawElements->releaseGLObjects(state);
     if (_maskElements.valid()) _maskElements->releaseGLObjects(state);
 
@@ -798,6 +963,11 @@ void SharedGeometry::drawImplementation(osg::RenderInfo& renderInfo) const
 {
     osg::State& state = *renderInfo.getState();
 
+    // Keep the arena's layout stable while we (possibly) compile and draw from it.
+    osg::ref_ptr<VertexArena> arena = _arena;
+    if (arena.valid())
+        arena->_mutex.lock();
+
 #if OSG_VERSION_LESS_THAN(3,5,6)
     osg::ArrayDispatchers& dispatchers = state.getArrayDispatchers();
 #else
@@ -957,10 +1127,15 @@ void SharedGeometry::drawImplementation(osg::RenderInfo& renderInfo) const
 
     // unbind the VBO's if any are used.
     // Absolutely required if not using VAOs (OSG3.4)
-    if (request_bind_unbind)
+    // An arena VBO stays bound so the next tile can draw from it without
+    // rebinding; LayerDrawable unbinds it after drawing all its tiles.
+    if (request_bind_unbind && !arena.valid())
     {
         state.unbindVertexBufferObject();
     }
+
+    if (arena.valid())
+        arena->_mutex.unlock();
 }
 
 void SharedGeometry::accept(osg::Drawable::AttributeFunctor& af)
@@ -1003,9 +1178,20 @@ SharedGeometry::makeOsgGeometry()
     osg::Geometry* geom = new osg::Geometry();
     geom->setUseVertexBufferObjects(true);
 
-    geom->setVertexArray(getVertexArray());
-    geom->setNormalArray(getNormalArray());
-    geom->setTexCoordArray(0, getTexCoordArray());
+    if (_arena.valid())
+    {
+        // Arena arrays belong to a shared VBO that only the terrain may draw
+        // from, so give the new geometry its own copies.
+        geom->setVertexArray(osg::clone(getVertexArray(), osg::CopyOp::DEEP_COPY_ALL));
+        geom->setNormalArray(osg::clone(getNormalArray(), osg::CopyOp::DEEP_COPY_ALL));
+        geom->setTexCoordArray(0, osg::clone(getTexCoordArray(), osg::CopyOp::DEEP_COPY_ALL));
+    }
+    else
+    {
+        geom->setVertexArray(getVertexArray());
+        geom->setNormalArray(getNormalArray());
+        geom->setTexCoordArray(0, getTexCoordArray());
+    }
     if (getDrawElements())
         geom->addPrimitiveSet(getDrawElements());
     if (getMaskElements())
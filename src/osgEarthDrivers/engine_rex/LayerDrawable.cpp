@@ -110,11 +110,26 @@ LayerDrawable::drawTiles(osg::RenderInfo& ri) const
         ext->glUniform1i(pps._layerUidUL, uid);
     }
 
+    // Apply the page atlas once per draw so it uploads this frame's pages,
+    // then let the tiles rebind it on the color units.
+    if (_virtualTexture.valid())
+    {
+        osg::State& state = *ri.getState();
+        state.setActiveTextureUnit((*_drawState->_bindings)[SamplerBinding::COLOR].unit());
+        _virtualTexture->getTexture()->apply(state);
+        pps._samplerState._samplers[SamplerBinding::COLOR]._texture.clear();
+        pps._samplerState._samplers[SamplerBinding::COLOR_PARENT]._texture.clear();
+    }
+
     for (DrawTileCommands::const_iterator tile = _tiles.begin(); tile != _tiles.end(); ++tile)
     {
         //_drawState->getPPS(ri).refresh(ri, _drawState->_bindings);
         tile->draw(ri, *_drawState, NULL);
     }
+
+    // Pooled tiles leave their shared vertex arena bound for the next tile,
+    // so unbind it once we're done.
+    ri.getState()->unbindVertexBufferObject();
 }
 
 void
@@ -125,6 +140,8 @@ LayerDrawable::drawImplementation(osg::RenderInfo& ri) const
     sprintf(buf, "%.36s (%zd tiles)", _layer ? _layer->getName().c_str() : "unknown layer", _tiles.size());
     OE_PROFILING_ZONE_TEXT(buf);
 
+    Util::GPUTimer::Scope gpuTimer(_gpuTimer.get(), ri);
+
     if (_patchLayer && _patchLayer->getDrawCallback())
     {        
         _patchLayer->getDrawCallback()->draw(ri, this);
@@ -21,6 +21,8 @@
 #include <osgEarth/TerrainEngineNode>
 #include <osgEarth/Terrain>
 #include <osgEarth/Metrics>
+#include <osgEarth/HTTPClient>
+#include <osgEarth/Trace>
 #include <osg/NodeVisitor>
 
 using namespace osgEarth::REX;
@@ -28,11 +30,37 @@ using namespace osgEarth;
 
 #define LC "[LoadTileData] "
 
+namespace
+{
+    // Everything in the model that needs to be on the GPU; the same
+    // set that TerrainTileModel::compileGLObjects() compiles.
+    void getTextures(const TerrainTileModel* model, TextureStreamer::Textures& out)
+    {
+        const TerrainTileColorLayerModelVector& colors = model->colorLayers();
+        for (TerrainTileColorLayerModelVector::const_iterator i = colors.begin(); i != colors.end(); ++i)
+        {
+            if (i->get()->getTexture())
+                out.push_back(i->get()->getTexture());
+        }
+
+        if (model->getNormalTexture())
+            out.push_back(model->getNormalTexture());
+
+        if (model->getElevationTexture())
+            out.push_back(model->getElevationTexture());
+
+        if (model->getLandCoverTexture())
+            out.push_back(model->getLandCoverTexture());
+    }
+}
 
 LoadTileData::LoadTileData(TileNode* tilenode, EngineContext* context) :
 _tilenode(tilenode),
 _context(context),
-_enableCancel(true)
+_enableCancel(true),
+_refresh(false),
+_decalSerial(0u),
+_decalSerialAfter(0u)
 {
     this->setTileKey(tilenode->getKey());
     _map = context->getMap();
@@ -43,7 +71,10 @@ LoadTileData::LoadTileData(const CreateTileManifest& manifest, TileNode* tilenod
     _manifest(manifest),
     _tilenode(tilenode),
     _context(context),
-    _enableCancel(true)
+    _enableCancel(true),
+    _refresh(false),
+    _decalSerial(0u),
+    _decalSerialAfter(0u)
 {
     this->setTileKey(tilenode->getKey());
     _map = context->getMap();
@@ -66,6 +97,8 @@ LoadTileData::run(ProgressCallback* progress)
     if (!_map.lock(map))
         return false;
 
+    _ticket = 0L;
+
     // if the operation was canceled, set the request to abandoned
     // so it can potentially retry later.
     if (progress && progress->isCanceled())
@@ -76,6 +109,19 @@ LoadTileData::run(ProgressCallback* progress)
         return false;
     }
 
+    // Requests for tiles the camera wants go ahead of prefetch and seeding
+    HTTPClient::ScopedPriority priority(HTTPClient::PRIORITY_VISIBLE);
+
+    Util::Trace::Scope trace("createTileModel", "terrain");
+    if (trace.active())
+        trace.setDetail(tilenode->getKey().str());
+
+    // GPU decals up to this serial will be in the elevation data.
+    osg::ref_ptr<EngineContext> context;
+    _context.lock(context);
+    DecalAtlas* decals = context.valid() ? context->getDecalAtlas() : 0L;
+    _decalSerial = decals ? decals->getSerial() : 0u;
+
     // Assemble all the components necessary to display this tile
     _dataModel = engine->createTileModel(
         map.get(),
@@ -83,6 +129,8 @@ LoadTileData::run(ProgressCallback* progress)
         _manifest,
         _enableCancel? progress : 0L);
 
+    _decalSerialAfter = decals ? decals->getSerial() : 0u;
+
     // if the operation was canceled, set the request to abandoned
     // so it can potentially retry later.
     if (progress && progress->isCanceled())
@@ -100,14 +148,31 @@ LoadTileData::run(ProgressCallback* progress)
         _dataModel->getElevationTexture()->setUnRefImageDataAfterApply(false);
     }
 
+    // Start the textures on their way to the GPU; the tile merges once
+    // they get there.
+    if (_dataModel.valid() && context.valid() && context->getTextureStreamer())
+    {
+        TextureStreamer::Textures textures;
+        getTextures(_dataModel.get(), textures);
+        _ticket = context->getTextureStreamer()->stream(textures);
+    }
+
     return _dataModel.valid();
 }
 
+bool
+LoadTileData::isReadyToMerge() const
+{
+    return !_ticket.valid() || _ticket->isReady();
+}
+
 
 // apply() runs in the update traversal and can safely alter the scene graph
 bool
 LoadTileData::merge()
 {
+    _ticket = 0L;
+
     // context went out of scope - bail
     osg::ref_ptr<EngineContext> context;
     if (!_context.lock(context))
@@ -133,6 +198,10 @@ LoadTileData::merge()
 
     OE_PROFILING_ZONE;
 
+    Util::Trace::Scope trace("merge", "terrain");
+    if (trace.active())
+        trace.setDetail(_key.str());
+
     // Check the map data revision and scan the manifest and see if any
     // revisions don't match the revisions in the original manifest.
     // If there are mismatches, that means the map has changed since we
@@ -147,6 +216,18 @@ LoadTileData::merge()
         return false;
     }
 
+    // A decal added while the data was being built may or may not be in
+    // it, so there's no telling whether the tile should draw it on the GPU.
+    DecalAtlas* decals = context->getDecalAtlas();
+    if (decals &&
+        _dataModel->elevationModel().valid() &&
+        decals->intersects(_key.getExtent(), _decalSerial, _decalSerialAfter))
+    {
+        _dataModel = 0L;
+        OE_DEBUG << LC << "Request for tile " << _key.str() << " raced a new decal and will be requeued" << std::endl;
+        return false;
+    }
+
     // Merge the new data into the tile.
     tilenode->merge(_dataModel.get(), this);
 
@@ -201,6 +282,10 @@ LoadTileData::createStateSet() const
     if (!_map.lock(map))
         return NULL;
 
+    // streamed textures don't need the ICO
+    if (_ticket.valid())
+        return NULL;
+
     if (_dataModel.valid() && map.valid() &&
         _dataModel->getRevision() == map->getDataModelRevision())
     {
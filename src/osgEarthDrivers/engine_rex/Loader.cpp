@@ -23,6 +23,9 @@
 #include <osgEarth/Utils>
 #include <osgEarth/NodeUtils>
 #include <osgEarth/Metrics>
+#include <osgEarth/Counters>
+#include <osgEarth/FrameGovernor>
+#include <osgEarth/Trace>
 
 #include <osgDB/FileNameUtils>
 #include <osgDB/FileUtils>
@@ -35,6 +38,16 @@
 
 using namespace osgEarth::REX;
 
+namespace
+{
+    const osgEarth::Util::Counter s_tilesRequested("terrain.tiles.requested");
+    const osgEarth::Util::Counter s_tilesLoaded("terrain.tiles.loaded");
+    const osgEarth::Util::Counter s_tilesMerged("terrain.tiles.merged");
+    const osgEarth::Util::Histogram s_mergeTime("terrain.merge_ms");
+    const osgEarth::Util::Gauge s_numRequests("terrain.requests");
+    const osgEarth::Util::Gauge s_mergeQueueSize("terrain.merge_queue");
+}
+
 
 Loader::Request::Request() :
     _delay_s(0.0),
@@ -233,6 +246,11 @@ namespace
 PagerLoader::PagerLoader(TerrainEngineNode* engine) :
 _checkpoint    (0.0),
 _mergesPerFrame( 0 ),
+_mergeBudget_s ( 0.0 ),
+_mergeQueueRequired( false ),
+_numMerged     ( 0u ),
+_mergeTime_s   ( 0.0 ),
+_updateTraversalRequired( false ),
 _frameLastUpdated( 0u ),
 _numLODs       ( 20u ),
 _requests(OE_MUTEX_NAME)
@@ -249,6 +267,7 @@ _requests(OE_MUTEX_NAME)
     {
         _priorityScales[i] = 1.0f;
         _priorityOffsets[i] = 0.0f;
+        _mergeCost_s[i] = 0.0;
     }
 }
 
@@ -262,12 +281,49 @@ void
 PagerLoader::setMergesPerFrame(int value)
 {
     _mergesPerFrame = osg::maximum(value, 0);
-    //ADJUST_EVENT_TRAV_COUNT(this, +1);
-    ADJUST_UPDATE_TRAV_COUNT(this, +1);
+    requireUpdateTraversal();
     OE_DEBUG << LC << "Merges per frame = " << _mergesPerFrame << std::endl;
     
 }
 
+void
+PagerLoader::setMergeBudget(double milliseconds)
+{
+    _mergeBudget_s = osg::maximum(milliseconds, 0.0) * 0.001;
+    requireUpdateTraversal();
+    OE_DEBUG << LC << "Merge budget = " << milliseconds << " ms" << std::endl;
+}
+
+void
+PagerLoader::setMergeQueueRequired(bool value)
+{
+    _mergeQueueRequired = value;
+    requireUpdateTraversal();
+}
+
+void
+PagerLoader::getStats(TerrainEngineNode::LoadingStats& out) const
+{
+    _requests.lock();
+    out._numRequests = _requests.size();
+    _requests.unlock();
+
+    out._numMergesPending = _mergeQueue.size();
+    out._numMerged = _numMerged;
+    out._mergeTime_s = _mergeTime_s;
+}
+
+void
+PagerLoader::requireUpdateTraversal()
+{
+    if (!_updateTraversalRequired)
+    {
+        //ADJUST_EVENT_TRAV_COUNT(this, +1);
+        ADJUST_UPDATE_TRAV_COUNT(this, +1);
+        _updateTraversalRequired = true;
+    }
+}
+
 void
 PagerLoader::setLODPriorityScale(unsigned lod, float priorityScale)
 {
@@ -335,6 +391,13 @@ PagerLoader::load(Loader::Request* request, float priority, osg::NodeVisitor& nv
                 _dboptions.get() );
         }
 
+        if ( addToRequestSet )
+        {
+            s_tilesRequested.add();
+            if (Util::Trace::isEnabled())
+                Util::Trace::beginAsync("tile", "terrain", request->getUID(), request->getTileKey().str());
+        }
+
         // remember the request:
         //if ( addToRequestSet )
         {
@@ -369,33 +432,8 @@ PagerLoader::traverse(osg::NodeVisitor& nv)
             _frameLastUpdated = frame;
 
             // process pending merges.
-            {
-                OE_PROFILING_ZONE_NAMED("loader.merge");
-                int count;
-                for(count=0; count < _mergesPerFrame && !_mergeQueue.empty(); ++count)
-                {
-                    Request* req = _mergeQueue.begin()->get();
-                    if ( req && req->_lastTick >= _checkpoint )
-                    {
-                        bool merged = req->merge();
-                    
-                        if (merged)
-                        {
-                            req->setState(Request::FINISHED);
-                            //OE_INFO << LC << req->_key.str() << " finished (delays = " << req->_delayCount << ")" << std::endl;
-                        }
-                        else
-                        {
-                            // if apply() returns false, that means the results were invalid
-                            // for some reason (probably revision mismatch) and the request
-                            // must be requeued.
-                            req->setState(Request::IDLE);
-                        }
-                    }
-
-                    _mergeQueue.erase( _mergeQueue.begin() );
-                }
-            }
+            collectCompleted();
+            mergeQueued();
 
             // cull finished requests.
             {
@@ -417,6 +455,7 @@ PagerLoader::traverse(osg::NodeVisitor& nv)
                         //OE_INFO << LC << req->getName() << "(" << i->second->getUID() << ") finished." << std::endl; 
                         if ( REPORT_ACTIVITY )
                             Registry::instance()->endActivity( req->getName() );
+                        Util::Trace::endAsync("tile", "terrain", req->getUID());
                         _requests.erase( i++ );
                     }
 
@@ -429,6 +468,7 @@ PagerLoader::traverse(osg::NodeVisitor& nv)
                         req->setState(Request::IDLE);
                         if ( REPORT_ACTIVITY )
                             Registry::instance()->endActivity( req->getName() );
+                        Util::Trace::endAsync("tile", "terrain", req->getUID());
                         _requests.erase( i++ );
                     }
 
@@ -451,6 +491,9 @@ PagerLoader::traverse(osg::NodeVisitor& nv)
                     }
                 }
 
+                s_numRequests.set(_requests.size());
+                s_mergeQueueSize.set(_mergeQueue.size());
+
                 _requests.unlock();
 
                 //OE_NOTICE << LC << "PagerLoader: requests=" << _requests.size() << "; mergeQueue=" << _mergeQueue.size() << std::endl;
@@ -461,6 +504,115 @@ PagerLoader::traverse(osg::NodeVisitor& nv)
     LoaderGroup::traverse( nv );
 }
 
+void
+PagerLoader::collectCompleted()
+{
+    RefRequest req;
+    while (_completed.pop(req))
+    {
+        if (req->_lastTick < _checkpoint)
+        {
+            // allow it to complete and disappear.
+            req->setState(Request::FINISHED);
+        }
+
+        // Make sure the request is still running (i.e. has not been
+        // canceled along the way)
+        else if (req->isRunning())
+        {
+            req->setState(Request::MERGING);
+            _mergeQueue.insert(req);
+        }
+
+        else
+        {
+            OE_DEBUG << LC << "Request " << req->getName() << " abandoned before merge" << std::endl;
+            //GW: allow to requeue (leave idle)
+        }
+    }
+
+    OE_PROFILING_PLOT("REX Merge Queue", (float)_mergeQueue.size());
+}
+
+void
+PagerLoader::mergeQueued()
+{
+    OE_PROFILING_ZONE_NAMED("loader.merge");
+
+    const osg::Timer* timer = osg::Timer::instance();
+    osg::Timer_t start = timer->tick();
+
+    // When frames run long the governor shrinks the configured limits
+    float scale = Util::FrameGovernor::getScale(Util::FrameGovernor::MERGES);
+    int mergesPerFrame = _mergesPerFrame > 0 ?
+        osg::maximum((int)(_mergesPerFrame * scale), 1) : 0;
+    double mergeBudget_s = _mergeBudget_s * scale;
+
+    int count = 0;
+    for(MergeQueue::iterator i = _mergeQueue.begin(); i != _mergeQueue.end(); )
+    {
+        if (mergesPerFrame > 0 && count >= mergesPerFrame)
+            break;
+
+        Request* req = i->get();
+        unsigned lod = osg::minimum(req->getTileKey().getLOD(), 63u);
+
+        // Stop if the estimated cost of this merge would exceed the
+        // frame's budget. Always merge at least one so we make progress.
+        if (mergeBudget_s > 0.0 && count > 0)
+        {
+            double elapsed = timer->delta_s(start, timer->tick());
+            if (elapsed + _mergeCost_s[lod] > mergeBudget_s)
+                break;
+        }
+
+        if ( req->_lastTick >= _checkpoint )
+        {
+            // not ready yet; leave it queued and look at the next one
+            if (!req->isReadyToMerge())
+            {
+                ++i;
+                continue;
+            }
+
+            osg::Timer_t t0 = timer->tick();
+
+            bool merged = req->merge();
+
+            // update the running estimate of merge cost at this LOD:
+            double cost = timer->delta_s(t0, timer->tick());
+            _mergeTime_s += cost;
+            s_mergeTime.record(cost*1000.0);
+            _mergeCost_s[lod] = _mergeCost_s[lod] > 0.0 ?
+                0.8*_mergeCost_s[lod] + 0.2*cost :
+                cost;
+
+            if (merged)
+            {
+                req->setState(Request::FINISHED);
+                ++_numMerged;
+                s_tilesMerged.add();
+            }
+            else
+            {
+                // if apply() returns false, that means the results were invalid
+                // for some reason (probably revision mismatch) and the request
+                // must be requeued.
+                req->setState(Request::IDLE);
+            }
+        }
+        else
+        {
+            req->setState(Request::FINISHED);
+        }
+
+        _mergeQueue.erase( i++ );
+        ++count;
+    }
+
+    OE_PROFILING_PLOT("REX Merges Per Frame", (float)count);
+}
+
 
 bool
 PagerLoader::addChild(osg::Node* node)
@@ -479,25 +631,35 @@ PagerLoader::addChild(osg::Node* node)
                     Registry::instance()->endActivity( req->getName() );
             }
 
+            // When the loader schedules its own merges, the pager thread already
+            // posted this request to the completion queue; the result node only
+            // exists so the pager can pre-compile its GL objects.
+            else if (usesMergeQueue())
+            {
+                //nop
+            }
+
             // Make sure the request is both current (newer than the last checkpoint)
             // and running (i.e. has not been canceled along the way)
             else if (req->isRunning())
             {
-                if ( _mergesPerFrame > 0 )
+                osg::Timer_t t0 = osg::Timer::instance()->tick();
+                bool merged = req->merge();
+                double cost = osg::Timer::instance()->delta_s(t0, osg::Timer::instance()->tick());
+                _mergeTime_s += cost;
+                s_mergeTime.record(cost*1000.0);
+
+                if (merged)
                 {
-                    _mergeQueue.insert( req );
-                    req->setState( Request::MERGING );
+                    req->setState( Request::FINISHED );
+                    ++_numMerged;
+                    s_tilesMerged.add();
                 }
                 else
-                {
-                    if (req->merge())
-                        req->setState( Request::FINISHED );
-                    else
-                        req->setState( Request::IDLE ); // retry
+                    req->setState( Request::IDLE ); // retry
 
-                    if ( REPORT_ACTIVITY )
-                        Registry::instance()->endActivity( req->getName() );
-                }
+                if ( REPORT_ACTIVITY )
+                    Registry::instance()->endActivity( req->getName() );
             }                
 
             else
@@ -560,6 +722,17 @@ PagerLoader::runAndRelease(UID requestUID)
         {
             request->setState(Request::IDLE);
         }
+        else
+        {
+            s_tilesLoaded.add();
+        }
+
+        // hand it straight to the merge scheduler without waiting for
+        // the pager to call addChild:
+        if (request->isRunning() && usesMergeQueue())
+        {
+            _completed.push(request.get());
+        }
     }
 
     else
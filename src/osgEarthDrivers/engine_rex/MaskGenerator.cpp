@@ -25,7 +25,11 @@
 #include <osgEarth/ModelLayer>
 #include <osgEarth/Geometry>
 #include <osgEarth/Math>
+#include <osgEarth/Containers>
+#include <osgEarth/Registry>
 #include <osgUtil/DelaunayTriangulator>
+#include <algorithm>
+#include <cstring>
 
 #define LC "[MaskGenerator] "
 
@@ -94,6 +98,236 @@ namespace
             else return lhs[1] < rhs[1];
         }
     };
+
+    // Fraction of a tile's size by which its boundary clip extends past
+    // each edge, so the edges the clip creates stay clear of the tile.
+    #define BOUNDARY_CLIP_MARGIN 0.05
+
+    typedef std::vector<osg::ref_ptr<osg::Vec3dArray> > BoundaryParts;
+
+    //! What is left of a mask boundary after clipping it to one tile.
+    struct TileBoundary : public osg::Referenced
+    {
+        osg::ref_ptr<const osg::Vec3dArray> _source; // keeps the key's address from being reused
+        BoundaryParts _parts;                        // empty if the boundary misses the tile
+    };
+
+    typedef std::pair<const osg::Vec3dArray*, TileKey> TileBoundaryKey;
+    typedef LRUCache<TileBoundaryKey, osg::ref_ptr<TileBoundary> > TileBoundaryCache;
+
+    TileBoundaryCache& tileBoundaries()
+    {
+        static TileBoundaryCache s_cache(true, 4096);
+        return s_cache;
+    }
+
+    //! Cropping strips Z values, so put them back on a clipped part by
+    //! finding the input segment each vertex lies on. The segments go into
+    //! a grid of buckets over the clip bounds to keep the search short.
+    void restoreZ(const osg::Vec3dArray& input, const Bounds& bounds, Geometry* part)
+    {
+        const int n = osg::clampBetween((int)sqrt((double)input.size()), 1, 256);
+        const double cellWidth = bounds.width() / (double)n;
+        const double cellHeight = bounds.height() / (double)n;
+        const double epsilon = 1e-6 * std::min(cellWidth, cellHeight);
+
+        auto column = [&](double x) {
+            return osg::clampBetween((int)floor((x - bounds.xMin()) / cellWidth), 0, n - 1);
+        };
+        auto row = [&](double y) {
+            return osg::clampBetween((int)floor((y - bounds.yMin()) / cellHeight), 0, n - 1);
+        };
+
+        std::vector<std::vector<unsigned> > cells(n * n);
+        for (unsigned i = 0; i < input.size(); ++i)
+        {
+            const osg::Vec3d& a = input[i];
+            const osg::Vec3d& b = input[(i + 1) % input.size()];
+            if (std::max(a.x(), b.x()) < bounds.xMin() || std::min(a.x(), b.x()) > bounds.xMax() ||
+                std::max(a.y(), b.y()) < bounds.yMin() || std::min(a.y(), b.y()) > bounds.yMax())
+                continue;
+
+            int c0 = column(std::min(a.x(), b.x()) - epsilon), c1 = column(std::max(a.x(), b.x()) + epsilon);
+            int r0 = row(std::min(a.y(), b.y()) - epsilon), r1 = row(std::max(a.y(), b.y()) + epsilon);
+            for (int r = r0; r <= r1; ++r)
+                for (int c = c0; c <= c1; ++c)
+                    cells[r * n + c].push_back(i);
+        }
+
+        for (Geometry::iterator v = part->begin(); v != part->end(); ++v)
+        {
+            // Corners of the clip bounds lie on no segment, so they take
+            // the nearest one's Z:
+            double closest = DBL_MAX;
+            v->z() = 0.0;
+
+            const std::vector<unsigned>& cell = cells[row(v->y()) * n + column(v->x())];
+            for (std::vector<unsigned>::const_iterator i = cell.begin(); i != cell.end(); ++i)
+            {
+                const osg::Vec3d& a = input[*i];
+                const osg::Vec3d& b = input[(*i + 1) % input.size()];
+                osg::Vec2d ab(b.x() - a.x(), b.y() - a.y());
+                double len2 = ab.length2();
+                double t = len2 > 0.0 ?
+                    osg::clampBetween(((v->x() - a.x()) * ab.x() + (v->y() - a.y()) * ab.y()) / len2, 0.0, 1.0) :
+                    0.0;
+                osg::Vec2d d(a.x() + ab.x() * t - v->x(), a.y() + ab.y() * t - v->y());
+                if (d.length2() < closest)
+                {
+                    closest = d.length2();
+                    v->z() = a.z() + (b.z() - a.z()) * t;
+                }
+            }
+        }
+    }
+
+    //! The parts of a mask boundary that touch a tile. Each tile clips what
+    //! its parent kept, so the boundary gets split up a LOD at a time and
+    //! no tile has to work through all of it. Cached by tile key.
+    osg::ref_ptr<TileBoundary> getTileBoundary(osg::Vec3dArray* boundary, const TileKey& key)
+    {
+        TileBoundaryKey cacheKey(boundary, key);
+        TileBoundaryCache::Record record;
+        if (tileBoundaries().get(cacheKey, record))
+            return record.value();
+
+        osg::ref_ptr<TileBoundary> result = new TileBoundary();
+        result->_source = boundary;
+
+        BoundaryParts inputs;
+        if (key.getLOD() > 0)
+            inputs = getTileBoundary(boundary, key.createParentKey())->_parts;
+        else
+            inputs.push_back(boundary);
+
+        const GeoExtent& extent = key.getExtent();
+        Bounds bounds(
+            extent.xMin() - extent.width() * BOUNDARY_CLIP_MARGIN,
+            extent.yMin() - extent.height() * BOUNDARY_CLIP_MARGIN,
+            extent.xMax() + extent.width() * BOUNDARY_CLIP_MARGIN,
+            extent.yMax() + extent.height() * BOUNDARY_CLIP_MARGIN);
+
+        for (BoundaryParts::const_iterator input = inputs.begin(); input != inputs.end(); ++input)
+        {
+            osg::BoundingBoxd bbox = polygonBBox2d(*input->get());
+
+            if (bbox.xMax() < bounds.xMin() || bbox.xMin() > bounds.xMax() ||
+                bbox.yMax() < bounds.yMin() || bbox.yMin() > bounds.yMax())
+            {
+                continue;
+            }
+
+            if (bbox.xMin() >= bounds.xMin() && bbox.xMax() <= bounds.xMax() &&
+                bbox.yMin() >= bounds.yMin() && bbox.yMax() <= bounds.yMax())
+            {
+                result->_parts.push_back(*input);
+                continue;
+            }
+
+            osg::ref_ptr<Polygon> poly = new Polygon();
+            poly->insert(poly->end(), (*input)->begin(), (*input)->end());
+
+            osg::ref_ptr<Geometry> clipped;
+            if (!poly->crop(bounds, clipped))
+            {
+                // An empty result means the part misses the tile; otherwise
+                // the crop failed, and the unclipped part will still do.
+                if (!clipped.valid())
+                    result->_parts.push_back(*input);
+                continue;
+            }
+
+            GeometryIterator i(clipped.get(), false);
+            while (i.hasMore())
+            {
+                Geometry* part = i.next();
+                if (part && part->getType() == Geometry::TYPE_POLYGON && part->size() >= 3)
+                {
+                    restoreZ(*input->get(), bounds, part);
+                    result->_parts.push_back(part->createVec3dArray());
+                }
+            }
+        }
+
+        tileBoundaries().insert(cacheKey, result);
+        return result;
+    }
+
+    //! A tile's mask geometry, ready to append to its arrays.
+    struct MaskPrimitives : public osg::Referenced
+    {
+        MaskGenerator::Result _result;
+        osg::ref_ptr<osg::Vec3Array> _verts, _texCoords, _normals;
+        osg::ref_ptr<osg::DrawElementsUInt> _elements;          // indices from zero
+        std::vector<osg::ref_ptr<osg::Vec3dArray> > _sources;  // keeps the key's addresses from being reused
+    };
+
+    struct MaskPrimitivesKey
+    {
+        TileKey _key;
+        unsigned _tileSize;
+        std::vector<const osg::Vec3dArray*> _sources;
+
+        bool operator < (const MaskPrimitivesKey& rhs) const
+        {
+            if (_key < rhs._key) return true;
+            if (rhs._key < _key) return false;
+            if (_tileSize != rhs._tileSize) return _tileSize < rhs._tileSize;
+            return _sources < rhs._sources;
+        }
+    };
+
+    typedef LRUCache<MaskPrimitivesKey, osg::ref_ptr<MaskPrimitives> > MaskPrimitivesCache;
+
+    //! Mask geometry of recently built tiles, so that a tile reloading
+    //! after the pager evicts it doesn't have to triangulate again.
+    MaskPrimitivesCache& maskPrimitives()
+    {
+        static MaskPrimitivesCache s_cache(true, 256);
+        return s_cache;
+    }
+
+    //! Maps a mask boundary into the tile's unit space, resamples it to the
+    //! tile grid and crops it to the patch polygon. Masks are independent
+    //! up to this point, so a tile prepares them all in parallel.
+    Geometry* prepareBoundary(MaskRecord& record, const GeoExtent& extent, unsigned tileSize, const Polygon* patchPoly)
+    {
+        GeoLocator geoLocator(extent);
+
+        //Create local polygon representing mask
+        record._boundaryPoly = new Polygon();
+        record._boundaryPoly->reserve(record._boundary->size());
+        for (osg::Vec3dArray::iterator it = record._boundary->begin(); it != record._boundary->end(); ++it)
+        {
+            osg::Vec3d local;
+            geoLocator.mapToUnit(*it, local);
+            record._boundaryPoly->push_back(local);
+        }
+
+        // Resample the masking polygon to closely match the resolution of the 
+        // current tile grid, which will result in a better tessellation.
+        // Ideally we would do this after cropping, but that is causing some
+        // triangulation errors. TODO -gw
+        if (!record._boundaryPoly->empty())
+        {
+            const double interval = 1.0 / double(tileSize-1);
+            resample(record._boundaryPoly.get(), interval);
+        }
+
+        // Crop the boundary to the patch polygon (i.e. the bounding box)
+        // for case where mask crosses tile edges
+        osg::ref_ptr<Geometry> boundaryPolyCroppedToTile;
+        record._boundaryPoly->crop(patchPoly, boundaryPolyCroppedToTile);
+
+        // See the comment for the call to resample above. -gw
+        //if (boundaryPolyCroppedToTile.valid() && !boundaryPolyCroppedToTile->empty())
+        //{
+        //    const double interval = 1.0 / double(_tileSize-1);
+        //    resample(boundaryPolyCroppedToTile.get(), interval);
+        //}
+
+        return boundaryPolyCroppedToTile.release();
+    }
 }
 
 // Use our own high-performance (hah!) tests for point-in-polygon
@@ -148,6 +382,27 @@ MaskGenerator::MaskGenerator(const TileKey& key, unsigned tileSize, const Map* m
 
 void
 MaskGenerator::setupMaskRecord(osg::Vec3dArray* boundary)
+{
+    if ( boundary )
+    {
+        // Only the parts of the boundary near this tile matter:
+        osg::ref_ptr<TileBoundary> tileBoundary = getTileBoundary(boundary, _key);
+
+        unsigned numRecords = _maskRecords.size();
+        for (BoundaryParts::const_iterator part = tileBoundary->_parts.begin(); part != tileBoundary->_parts.end(); ++part)
+        {
+            addMaskRecord(part->get());
+        }
+
+        if (_maskRecords.size() > numRecords)
+        {
+            _sources.push_back(boundary);
+        }
+    }
+}
+
+void
+MaskGenerator::addMaskRecord(osg::Vec3dArray* boundary)
 {
     // Make a "locator" for this key so we can do coordinate conversion:
     GeoLocator geoLocator(_key.getExtent());
@@ -204,7 +459,68 @@ MaskGenerator::createMaskPrimitives(osg::Vec3Array* verts, osg::Vec3Array* texCo
     {
         return R_BOUNDARY_DOES_NOT_INTERSECT_TILE;
     }
-    
+
+    MaskPrimitivesKey cacheKey;
+    cacheKey._key = _key;
+    cacheKey._tileSize = _tileSize;
+    for (unsigned i = 0; i < _sources.size(); ++i)
+        cacheKey._sources.push_back(_sources[i].get());
+
+    osg::ref_ptr<MaskPrimitives> prims;
+    MaskPrimitivesCache::Record record;
+    if (maskPrimitives().get(cacheKey, record))
+    {
+        prims = record.value();
+    }
+    else
+    {
+        prims = new MaskPrimitives();
+        prims->_verts = new osg::Vec3Array();
+        prims->_texCoords = new osg::Vec3Array();
+        prims->_normals = new osg::Vec3Array();
+        prims->_result = buildMaskPrimitives(prims->_verts.get(), prims->_texCoords.get(), prims->_normals.get(), prims->_elements);
+        prims->_sources = _sources;
+        maskPrimitives().insert(cacheKey, prims);
+    }
+
+    if (prims->_result != R_BOUNDARY_INTERSECTS_TILE)
+    {
+        return prims->_result;
+    }
+
+    unsigned vertsOffset = verts->size();
+
+    verts->insert(verts->end(), prims->_verts->begin(), prims->_verts->end());
+    texCoords->insert(texCoords->end(), prims->_texCoords->begin(), prims->_texCoords->end());
+    normals->insert(normals->end(), prims->_normals->begin(), prims->_normals->end());
+
+    // use same data for neighbor to prevent morphing
+    if ( neighbors )
+        neighbors->insert(neighbors->end(), prims->_verts->begin(), prims->_verts->end());
+    if ( neighborNormals )
+        neighborNormals->insert(neighborNormals->end(), prims->_normals->begin(), prims->_normals->end());
+
+    // Construct the output triangle set.
+    unsigned numIndicies = prims->_elements->size();
+    out_elements =
+        numIndicies > 0xFFFF || verts->size() > 0xFFFF ? (osg::DrawElements*)new osg::DrawElementsUInt(prims->_elements->getMode()) :
+        (osg::DrawElements*)new osg::DrawElementsUShort(prims->_elements->getMode());
+
+    out_elements->reserveElements(numIndicies);
+
+    for (osg::DrawElementsUInt::const_iterator it = prims->_elements->begin(); it != prims->_elements->end(); ++it)
+    {
+        out_elements->addElement(vertsOffset + *it);
+    }
+
+    return R_BOUNDARY_INTERSECTS_TILE;
+}
+
+MaskGenerator::Result
+MaskGenerator::buildMaskPrimitives(osg::Vec3Array* verts, osg::Vec3Array* texCoords,
+                                   osg::Vec3Array* normals,
+                                   osg::ref_ptr<osg::DrawElementsUInt>& out_elements)
+{
     GeoLocator geoLocator(_key.getExtent());
 
     // Configure up a local tangent plane at the centroid of the tile:
@@ -303,40 +619,36 @@ MaskGenerator::createMaskPrimitives(osg::Vec3Array* verts, osg::Vec3Array* texCo
     osg::Vec3Array* constraintVerts = new osg::Vec3Array();
     dc->setVertexArray(constraintVerts);
 
-    // Use delaunay triangulation for stitching:
-    for (MaskRecordVector::iterator mr = _maskRecords.begin();mr != _maskRecords.end();mr++)
+    // Prepare the boundaries in parallel. The first one runs in this thread,
+    // which would otherwise just sit and wait.
+    std::vector<osg::ref_ptr<Geometry> > croppedBoundaries(_maskRecords.size());
+    std::vector<Threading::Future<Geometry> > futures;
+    Threading::JobArena* arena = Registry::instance()->getJobArena("terrain.masks");
+    for (unsigned r = 1; r < _maskRecords.size(); ++r)
     {
-        //Create local polygon representing mask
-        mr->_boundaryPoly = new Polygon();
-        mr->_boundaryPoly->reserve(mr->_boundary->size());
-        for (osg::Vec3dArray::iterator it = (*mr)._boundary->begin(); it != (*mr)._boundary->end(); ++it)
-        {
-            osg::Vec3d local;
-            geoLocator.mapToUnit(*it, local);
-            mr->_boundaryPoly->push_back(local);
-        }
-            
-        // Resample the masking polygon to closely match the resolution of the 
-        // current tile grid, which will result in a better tessellation.
-        // Ideally we would do this after cropping, but that is causing some
-        // triangulation errors. TODO -gw
-        if (!mr->_boundaryPoly->empty())
-        {
-            const double interval = 1.0 / double(_tileSize-1);
-            resample(mr->_boundaryPoly.get(), interval);
-        }
+        Threading::Promise<Geometry> promise;
+        futures.push_back(promise.getFuture());
 
-        // Crop the boundary to the patch polygon (i.e. the bounding box)
-        // for case where mask crosses tile edges
-        osg::ref_ptr<Geometry> boundaryPolyCroppedToTile;
-        mr->_boundaryPoly->crop(patchPoly.get(), boundaryPolyCroppedToTile);
+        Threading::runInJobArena(arena, [this, promise, r, &patchPoly]() mutable {
+            osg::ref_ptr<Geometry> cropped = prepareBoundary(_maskRecords[r], _key.getExtent(), _tileSize, patchPoly.get());
+            promise.resolve(cropped.get());
+        });
+    }
 
-        // See the comment for the call to resample above. -gw
-        //if (boundaryPolyCroppedToTile.valid() && !boundaryPolyCroppedToTile->empty())
-        //{
-        //    const double interval = 1.0 / double(_tileSize-1);
-        //    resample(boundaryPolyCroppedToTile.get(), interval);
-        //}
+    croppedBoundaries[0] = prepareBoundary(_maskRecords[0], _key.getExtent(), _tileSize, patchPoly.get());
+
+    // Wait for everything; the jobs reference our stack.
+    Threading::Future<Threading::FutureVector<Geometry> > all = Threading::when_all(futures);
+    osg::ref_ptr<Threading::FutureVector<Geometry> > results = all.get();
+    for (unsigned r = 0; results.valid() && r < results->size(); ++r)
+    {
+        croppedBoundaries[r + 1] = (*results)[r];
+    }
+
+    // Use delaunay triangulation for stitching:
+    for (MaskRecordVector::iterator mr = _maskRecords.begin();mr != _maskRecords.end();mr++)
+    {
+        osg::ref_ptr<Geometry> boundaryPolyCroppedToTile = croppedBoundaries[mr - _maskRecords.begin()];
 
         // Add the cropped boundary geometry as a Triangulation Constraint.
         unsigned start = constraintVerts->size();
@@ -545,10 +857,6 @@ MaskGenerator::createMaskPrimitives(osg::Vec3Array* verts, osg::Vec3Array* texCo
     verts->reserve(verts->size() + trigPoints->size());
     texCoords->reserve(texCoords->size() + trigPoints->size());
     normals->reserve(normals->size() + trigPoints->size());
-    if ( neighbors )
-        neighbors->reserve(neighbors->size() + trigPoints->size()); 
-    if ( neighborNormals )
-        neighborNormals->reserve(neighborNormals->size() + trigPoints->size()); 
 
     // Iterate through point to convert to model coords, calculate normals, and set up tex coords
     //osg::ref_ptr<GeoLocator> locator = GeoLocator::createForKey( _key, mapInfo );
@@ -578,12 +886,6 @@ MaskGenerator::createMaskPrimitives(osg::Vec3Array* verts, osg::Vec3Array* texCo
 
         verts->push_back(local);
 
-        // use same data for neighbor to prevent morphing
-        if ( neighbors )
-            neighbors->push_back( local );
-        if ( neighborNormals )
-            neighborNormals->push_back( normal );
-
         // set up text coords
         texCoords->push_back( osg::Vec3f(it->x(), it->y(), isBoundary ? VERTEX_MARKER_BOUNDARY : VERTEX_MARKER_PATCH) );
     }
@@ -599,12 +901,8 @@ MaskGenerator::createMaskPrimitives(osg::Vec3Array* verts, osg::Vec3Array* texCo
     }
 
     // Construct the output triangle set.
-    unsigned numIndicies = tris->size() * 6;
-    out_elements =
-        numIndicies > 0xFFFF ? (osg::DrawElements*)new osg::DrawElementsUInt(tris->getMode()) :
-        (osg::DrawElements*)new osg::DrawElementsUShort(tris->getMode());
-
-    out_elements->reserveElements(numIndicies);
+    out_elements = new osg::DrawElementsUInt(tris->getMode());
+    out_elements->reserveElements(tris->size());
 
     const osg::MixinVector<GLuint> ins = tris->asVector();
 
@@ -673,3 +971,83 @@ MaskGenerator::getMarker(float nx, float ny) const
 
     return marker;
 }
+
+MaskGenerator::Result
+MaskGenerator::createMaskImage(unsigned size, osg::ref_ptr<osg::Image>& out_image) const
+{
+    if (_maskRecords.empty() || size == 0u)
+    {
+        return R_BOUNDARY_DOES_NOT_INTERSECT_TILE;
+    }
+
+    GeoLocator geoLocator(_key.getExtent());
+
+    osg::ref_ptr<osg::Image> image = new osg::Image();
+    image->allocateImage(size, size, 1, GL_RED, GL_UNSIGNED_BYTE);
+    image->setInternalTextureFormat(GL_R8);
+    ::memset(image->data(), 0, image->getTotalSizeInBytes());
+
+    unsigned numMasked = 0u;
+    std::vector<osg::Vec3d> unit;
+    std::vector<double> crossings;
+
+    for (MaskRecordVector::const_iterator mr = _maskRecords.begin(); mr != _maskRecords.end(); ++mr)
+    {
+        const osg::Vec3dArray& boundary = *mr->_boundary.get();
+        if (boundary.size() < 3)
+            continue;
+
+        unit.resize(boundary.size());
+        for (unsigned i = 0; i < boundary.size(); ++i)
+        {
+            geoLocator.mapToUnit(boundary[i], unit[i]);
+        }
+
+        // Scan-convert the polygon at the texel centers (even-odd rule):
+        for (unsigned t = 0; t < size; ++t)
+        {
+            double v = ((double)t + 0.5) / (double)size;
+
+            crossings.clear();
+            for (unsigned i = 0, j = unit.size() - 1; i < unit.size(); j = i++)
+            {
+                const osg::Vec3d& a = unit[j];
+                const osg::Vec3d& b = unit[i];
+                if ((a.y() <= v) != (b.y() <= v))
+                {
+                    crossings.push_back(a.x() + (v - a.y()) * (b.x() - a.x()) / (b.y() - a.y()));
+                }
+            }
+            std::sort(crossings.begin(), crossings.end());
+
+            GLubyte* row = image->data(0, t);
+            for (unsigned k = 0; k + 1 < crossings.size(); k += 2)
+            {
+                // texels whose centers fall within [crossings[k], crossings[k+1])
+                int s0 = std::max(0, (int)ceil(crossings[k] * size - 0.5));
+                int s1 = std::min((int)size, (int)ceil(crossings[k + 1] * size - 0.5));
+                for (int s = s0; s < s1; ++s)
+                {
+                    if (row[s] == 0)
+                    {
+                        row[s] = 255;
+                        ++numMasked;
+                    }
+                }
+            }
+        }
+    }
+
+    if (numMasked == 0u)
+    {
+        return R_BOUNDARY_DOES_NOT_INTERSECT_TILE;
+    }
+
+    if (numMasked == size * size)
+    {
+        return R_BOUNDARY_CONTAINS_ENTIRE_TILE;
+    }
+
+    out_image = image.get();
+    return R_BOUNDARY_INTERSECTS_TILE;
+}
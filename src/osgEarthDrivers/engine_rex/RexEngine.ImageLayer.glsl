@@ -39,13 +39,32 @@ $GLSL_DEFAULT_PRECISION_FLOAT
 #pragma import_defines(OE_IS_PICK_CAMERA)
 #pragma import_defines(OE_IS_SHADOW_CAMERA)
 #pragma import_defines(OE_IS_DEPTH_CAMERA)
+#pragma import_defines(OE_TERRAIN_BINDLESS_TEXTURES)
+#pragma import_defines(OE_LAYER_TIME_SERIES)
+#pragma import_defines(OE_TERRAIN_MASK_TEXTURES)
+
+// A time-series layer's tiles are texture arrays holding one time step
+// per slice; see WMSImageLayer's frames_per_tile.
+#ifdef OE_LAYER_TIME_SERIES
+#define OE_LAYER_SAMPLER_TYPE sampler2DArray
+#else
+#define OE_LAYER_SAMPLER_TYPE sampler2D
+#endif
+
+// Tile color textures may arrive as bindless handles (see BindlessTextures)
+#ifdef OE_TERRAIN_BINDLESS_TEXTURES
+#extension GL_ARB_bindless_texture : require
+#define OE_LAYER_SAMPLER layout(bindless_sampler) uniform OE_LAYER_SAMPLER_TYPE
+#else
+#define OE_LAYER_SAMPLER uniform OE_LAYER_SAMPLER_TYPE
+#endif
 
-uniform sampler2D oe_layer_tex;
+OE_LAYER_SAMPLER oe_layer_tex;
 uniform int       oe_layer_uid;
 uniform int       oe_layer_order;
 
 #ifdef OE_TERRAIN_MORPH_IMAGERY
-uniform sampler2D oe_layer_texParent;
+OE_LAYER_SAMPLER oe_layer_texParent;
 uniform float oe_layer_texParentExists;
 in vec2 oe_layer_texcParent;
 in float oe_rex_morphFactor;
@@ -55,6 +74,26 @@ in vec2 oe_layer_texc;
 in vec4 oe_layer_tilec;
 in float oe_layer_opacity;
 
+#ifdef OE_TERRAIN_MASK_TEXTURES
+// masked areas of the tile (> 0.5) when masks aren't cut from the geometry
+uniform sampler2D oe_tile_maskTex;
+uniform mat4 oe_tile_maskTexMatrix;
+#endif
+
+#ifdef OE_LAYER_TIME_SERIES
+// slices of the two time steps around the current time, and the blend between them
+uniform vec3 oe_layer_timeFrame;
+
+vec4 oe_rex_sampleLayer(in OE_LAYER_SAMPLER_TYPE tex, in vec2 texc)
+{
+    vec4 a = texture(tex, vec3(texc, oe_layer_timeFrame.x));
+    vec4 b = texture(tex, vec3(texc, oe_layer_timeFrame.y));
+    return mix(a, b, oe_layer_timeFrame.z);
+}
+#else
+#define oe_rex_sampleLayer(TEX, TEXC) texture(TEX, TEXC)
+#endif
+
 //in float oe_layer_rangeOpacity;
 
 // Vertex Markers:
@@ -74,6 +113,14 @@ void oe_rex_imageLayer_FS(inout vec4 color)
         return;
     }
 
+#ifdef OE_TERRAIN_MASK_TEXTURES
+    if (texture(oe_tile_maskTex, (oe_tile_maskTexMatrix * vec4(oe_layer_tilec.st, 0.0, 1.0)).st).r > 0.5)
+    {
+        discard;
+        return;
+    }
+#endif
+
     // If this is a shadow camera and the terrain doesn't cast shadows, no render:
 #if defined(OE_IS_SHADOW_CAMERA) && !defined(OE_TERRAIN_CAST_SHADOWS)
     discard;
@@ -109,13 +156,13 @@ void oe_rex_imageLayer_FS(inout vec4 color)
 
     if (isTexelLayer)
     {
-        texel = texture(oe_layer_tex, oe_layer_texc);
+        texel = oe_rex_sampleLayer(oe_layer_tex, oe_layer_texc);
 
 #ifdef OE_TERRAIN_MORPH_IMAGERY
         // sample the main texture:
 
         // sample the parent texture:
-        vec4 texelParent = texture(oe_layer_texParent, oe_layer_texcParent);
+        vec4 texelParent = oe_rex_sampleLayer(oe_layer_texParent, oe_layer_texcParent);
 
         // if the parent texture does not exist, use the current texture with alpha=0 as the parent
         // so we can "fade in" an image layer that starts at LOD > 0:
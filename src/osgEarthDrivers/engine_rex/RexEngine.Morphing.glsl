@@ -111,15 +111,30 @@ float oe_rex_ComputeMorphFactor(in vec4 position, in vec3 up)
     return fMorphLerpK;
 }
 
+// Decodes a neighbor normal packed by the GeometryPool: two 12-bit
+// octahedral coordinates in one float (hi*4096 + lo).
+vec3 oe_rex_unpackNormal(in float packed)
+{
+    float hi = floor(packed / 4096.0);
+    vec2 e = vec2(hi, packed - hi*4096.0) * (2.0/4095.0) - 1.0;
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0)
+    {
+        vec2 s = vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+        n.xy = (1.0 - abs(n.yx)) * s;
+    }
+    return normalize(n);
+}
+
 // In the transition from an LOD to the next lower LOD, morphing moves
 // tile grid points that will disappear towards grid points that exist
 // in the lower LOD. When the transition is complete
 // (oe_rex_morphFactor == 1.0), those points are coincident. If we
 // consider grid points numbered on x,y from 0 to tilesize - 1, then
 // the points that "survive" have even x,y indices and don't move. The
-// neighbor vertex coordinates and normals are passed in as vertex
-// attributes, but the neighbor texture coordinates are calculated
-// here.
+// neighbor vertex coordinates and normals are passed in as one vertex
+// attribute (normal packed in w), but the neighbor texture coordinates
+// are calculated here.
 //
 // XXX constraints
 
@@ -133,7 +148,7 @@ void oe_rex_morph(inout vec4 vertexModel)
         oe_rex_morphFactor = oe_rex_ComputeMorphFactor(vertexModel, vp_Normal);
 #ifdef OE_TERRAIN_MORPH_GEOMETRY
         vec4 neighborVertexModel = vec4(gl_MultiTexCoord1.xyz, 1.0);
-        vec3 neighborNormal = gl_MultiTexCoord2.xyz;
+        vec3 neighborNormal = oe_rex_unpackNormal(gl_MultiTexCoord1.w);
 
         float halfSize        = (0.5*oe_tile_size)-0.5;
         float twoOverHalfSize = 2.0/(oe_tile_size-1.0);
@@ -3,12 +3,17 @@ $GLSL_DEFAULT_PRECISION_FLOAT
 
 #pragma vp_name Rex Terrain SDK
 
+#pragma import_defines(OE_TERRAIN_GPU_NORMALS)
+#pragma import_defines(OE_TERRAIN_GPU_DECALS)
+
 /**
  * SDK functions for the Rex engine.
  * Declare and call these from any shader that runs on the terrain.
  */
 
 // uniforms from terrain engine
+// Elevation is R32F, or R16F with half_float_elevation (heights within 1/2048
+// of their value); either way texture().r is the height in meters.
 uniform sampler2D oe_tile_elevationTex;
 uniform mat4 oe_tile_elevationTexMatrix;
 uniform vec2 oe_tile_elevTexelCoeff;
@@ -18,9 +23,44 @@ uniform mat4 oe_tile_normalTexMatrix;
 
 uniform vec4 oe_tile_key;
 
+#ifdef OE_TERRAIN_GPU_DECALS
+// Decals newer than the tile's elevation data: their areas in tile
+// coordinates and their layers in the atlas. The array size matches
+// DecalAtlas::MAX_DECALS_PER_TILE.
+uniform sampler2DArray oe_terrain_decalTex;
+uniform int oe_tile_decalCount;
+uniform vec4 oe_tile_decalRects[8];
+uniform float oe_tile_decalLayers[8];
+#endif
+
 // Stage global
 vec4 oe_layer_tilec;
 
+/**
+ * Sum of the GPU decal offsets at a UV tile coordinate.
+ */
+float oe_terrain_getDecalElevation(in vec2 uv)
+{
+    float h = 0.0;
+#ifdef OE_TERRAIN_GPU_DECALS
+    // sample on texel centers, like the CPU does on posts
+    float size = float(textureSize(oe_terrain_decalTex, 0).x);
+    float scale = (size - 1.0) / size;
+    float bias = 0.5 / size;
+
+    for (int i = 0; i < oe_tile_decalCount; ++i)
+    {
+        vec4 rect = oe_tile_decalRects[i];
+        if (all(greaterThanEqual(uv, rect.xy)) && all(lessThanEqual(uv, rect.zw)))
+        {
+            vec2 st = (uv - rect.xy) / (rect.zw - rect.xy);
+            h += texture(oe_terrain_decalTex, vec3(st*scale + bias, oe_tile_decalLayers[i])).r;
+        }
+    }
+#endif
+    return h;
+}
+
 
 /**
  * Sample the elevation data at a UV tile coordinate.
@@ -48,7 +88,7 @@ float oe_terrain_getElevation(in vec2 uv)
         + oe_tile_elevTexelCoeff.x * oe_tile_elevationTexMatrix[3].st     // bias
         + oe_tile_elevTexelCoeff.y;
 
-    return texture(oe_tile_elevationTex, elevc).r;
+    return texture(oe_tile_elevationTex, elevc).r + oe_terrain_getDecalElevation(uv);
 }
 
 /**
@@ -64,6 +104,35 @@ float oe_terrain_getElevation()
  */
 vec4 oe_terrain_getNormalAndCurvature(in vec2 uv_scaledBiased)
 {
+#ifdef OE_TERRAIN_GPU_NORMALS
+    // Derive the normal from the elevation texture with central differences
+    // one post apart (one-sided at the texture edges). The coordinates are
+    // elevation texture coordinates, as with the normal map.
+    vec2 size = vec2(textureSize(oe_tile_elevationTex, 0));
+    vec2 texel = 1.0/size;
+    vec2 lo = 0.5*texel;
+    vec2 hi = 1.0 - 0.5*texel;
+
+    vec2 w = vec2(max(uv_scaledBiased.s - texel.s, lo.s), uv_scaledBiased.t);
+    vec2 e = vec2(min(uv_scaledBiased.s + texel.s, hi.s), uv_scaledBiased.t);
+    vec2 s = vec2(uv_scaledBiased.s, max(uv_scaledBiased.t - texel.t, lo.t));
+    vec2 n = vec2(uv_scaledBiased.s, min(uv_scaledBiased.t + texel.t, hi.t));
+
+    // oe_tile_key.w is the tile's width in meters, and the tile covers
+    // oe_tile_elevationTexMatrix[0][0] of the elevation texture's posts.
+    float tileMeters = oe_tile_key.w;
+    if (tileMeters <= 0.0)
+        return vec4(0.0, 0.0, 1.0, 0.0);
+
+    vec2 metersPerTexel = vec2(tileMeters / oe_tile_elevationTexMatrix[0][0]) / (size - 1.0);
+    float dx = max(e.s - w.s, lo.s) * size.s * metersPerTexel.s;
+    float dy = max(n.t - s.t, lo.t) * size.t * metersPerTexel.t;
+
+    float hx = texture(oe_tile_elevationTex, e).r - texture(oe_tile_elevationTex, w).r;
+    float hy = texture(oe_tile_elevationTex, n).r - texture(oe_tile_elevationTex, s).r;
+
+    return vec4(normalize(vec3(-hx/dx, -hy/dy, 1.0)), 0.0);
+#else
     vec4 n = texture(oe_tile_normalTex, uv_scaledBiased);
     n.xyz = n.xyz*2.0-1.0;
     float curv = n.z;
@@ -73,14 +142,22 @@ vec4 oe_terrain_getNormalAndCurvature(in vec2 uv_scaledBiased)
     //n.x += (n.x > 0)? -t : t;
     //n.y += (n.y > 0)? -t : t;
     return vec4(normalize(n.xyz), curv);
+#endif
 }
 
 vec4 oe_terrain_getNormalAndCurvature()
 {
+#ifdef OE_TERRAIN_GPU_NORMALS
+    vec2 uv_scaledBiased = oe_layer_tilec.st
+        * oe_tile_elevTexelCoeff.x * oe_tile_elevationTexMatrix[0][0]
+        + oe_tile_elevTexelCoeff.x * oe_tile_elevationTexMatrix[3].st
+        + oe_tile_elevTexelCoeff.y;
+#else
     vec2 uv_scaledBiased = oe_layer_tilec.st
         * oe_tile_elevTexelCoeff.x * oe_tile_normalTexMatrix[0][0]
         + oe_tile_elevTexelCoeff.x * oe_tile_normalTexMatrix[3].st
         + oe_tile_elevTexelCoeff.y;
+#endif
 
     return oe_terrain_getNormalAndCurvature(uv_scaledBiased);
 }
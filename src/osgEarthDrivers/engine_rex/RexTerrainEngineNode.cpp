@@ -33,6 +33,7 @@
 #include <osgEarth/ObjectIndex>
 #include <osgEarth/Metrics>
 #include <osgEarth/ElevationConstraintLayer>
+#include <osgEarth/Elevation>
 
 #include <osg/Version>
 #include <osg/BlendFunc>
@@ -41,6 +42,8 @@
 #include <osg/ValueObject>
 
 #include <cstdlib> // for getenv
+#include <cfloat>
+#include <algorithm>
 
 #define LC "[RexTerrainEngineNode] "
 
@@ -72,13 +75,26 @@ namespace
     * TileNode can update its render model and get rid of passes
     * that no longer exist.
     */
+    // Removes rendering passes whose layer is gone from the map. When
+    // constructed with a layer UID, only that layer's passes are removed
+    // and the shared samplers are left alone unless asked.
     struct PurgeOrphanedLayers : public osg::NodeVisitor
     {
         const Map* _map;
         const RenderBindings& _bindings;
+        UID _layerUID;
+        bool _refreshSharedSamplers;
         unsigned _count;
 
-        PurgeOrphanedLayers(const Map* map, RenderBindings& bindings) : _map(map), _bindings(bindings), _count(0u)
+        PurgeOrphanedLayers(const Map* map, RenderBindings& bindings) :
+            _map(map), _bindings(bindings), _layerUID(-1), _refreshSharedSamplers(true), _count(0u)
+        {
+            setTraversalMode(TRAVERSE_ALL_CHILDREN);
+            setNodeMaskOverride(~0);
+        }
+
+        PurgeOrphanedLayers(const Map* map, RenderBindings& bindings, UID layerUID, bool refreshSharedSamplers) :
+            _map(map), _bindings(bindings), _layerUID(layerUID), _refreshSharedSamplers(refreshSharedSamplers), _count(0u)
         {
             setTraversalMode(TRAVERSE_ALL_CHILDREN);
             setNodeMaskOverride(~0);
@@ -102,10 +118,20 @@ namespace
             {
                 RenderingPass& pass = model._passes[p];
 
-                // if the map doesn't contain a layer with a matching UID,
-                // or if the layer is now disabled, remove it from the render model.
-                Layer* layer = _map->getLayerByUID(pass.sourceUID());
-                if (layer == NULL || layer->getEnabled() == false)
+                bool purge;
+                if (_layerUID >= 0)
+                {
+                    purge = (pass.sourceUID() == _layerUID);
+                }
+                else
+                {
+                    // if the map doesn't contain a layer with a matching UID,
+                    // or if the layer is now disabled, remove it from the render model.
+                    Layer* layer = _map->getLayerByUID(pass.sourceUID());
+                    purge = (layer == NULL || layer->getEnabled() == false);
+                }
+
+                if (purge)
                 {
                     model._passes.erase(model._passes.begin()+p);
                     --p;
@@ -115,7 +141,8 @@ namespace
 
             // For shared samplers we need to refresh the list if one of them
             // goes inactive (as is the case when removing a shared layer)
-            tileNode.refreshSharedSamplers(_bindings);
+            if (_refreshSharedSamplers)
+                tileNode.refreshSharedSamplers(_bindings);
         }
     };
 }
@@ -130,6 +157,7 @@ RexTerrainEngineNode::RexTerrainEngineNode() :
     _stateUpdateRequired  ( false ),
     _renderModelUpdateRequired( false ),
     _morphTerrainSupported(true),
+    _decalUnit(-1),
     _frameLastUpdated(0u)
 {
     // Necessary for pager object data
@@ -202,6 +230,16 @@ RexTerrainEngineNode::releaseGLObjects(osg::State* state) const
         _imageLayerStateSet.get()->releaseGLObjects(state);
     }
 
+    if (_engineContext.valid() && _engineContext->getBindlessTextures())
+    {
+        _engineContext->getBindlessTextures()->releaseGLObjects(state);
+    }
+
+    if (_engineContext.valid() && _engineContext->getTextureStreamer())
+    {
+        _engineContext->getTextureStreamer()->releaseGLObjects(state);
+    }
+
     //if (_geometryPool.valid())
     //{
     //    _geometryPool->clear();
@@ -251,6 +289,13 @@ RexTerrainEngineNode::setMap(const Map* map, const TerrainOptions& inOptions)
     else
         if (getStateSet()) getStateSet()->removeDefine("OE_DEBUG_NORMALS");
 
+    // Bindless color textures (see EngineContext):
+    if (options().bindlessTextures() == true &&
+        Registry::capabilities().supportsBindlessTexture())
+        getOrCreateStateSet()->setDefine("OE_TERRAIN_BINDLESS_TEXTURES");
+    else
+        if (getStateSet()) getStateSet()->removeDefine("OE_TERRAIN_BINDLESS_TEXTURES");
+
     // check for normal map generation (required for lighting).
     if (options().normalMaps() == true )
     {
@@ -263,6 +308,9 @@ RexTerrainEngineNode::setMap(const Map* map, const TerrainOptions& inOptions)
     // ensure we get full coverage at the first LOD.
     this->_requireFullDataAtFirstLOD = true;
 
+    // image layers can page their tiles through one atlas (see VirtualTexture)
+    this->_supportVirtualTextures = true;
+
     // A shared registry for tile nodes in the scene graph. Enable revision tracking
     // if requested in the options. Revision tracking lets the registry notify all
     // live tiles of the current map revision so they can inrementally update
@@ -287,6 +335,8 @@ RexTerrainEngineNode::setMap(const Map* map, const TerrainOptions& inOptions)
     loader->setFrameClock(&_clock);
     loader->setNumLODs(options().maxLOD().getOrUse(DEFAULT_MAX_LOD));
     loader->setMergesPerFrame(options().mergesPerFrame().get() );
+    loader->setMergeBudget(options().mergeBudget().get());
+    loader->setMergeQueueRequired(options().textureStreaming() == true);
     loader->setOverallPriorityScale(options().priorityScale().get());
 
     _loader = loader;
@@ -308,6 +358,8 @@ RexTerrainEngineNode::setMap(const Map* map, const TerrainOptions& inOptions)
     _unloader->setMaxAge(options().minExpiryTime().get());
     _unloader->setMaxTilesToUnloadPerFrame(options().maxTilesToUnloadPerFrame().get());
     _unloader->setMinimumRange(options().minExpiryRange().get());
+    _unloader->setMaxCPUMemory((unsigned long long)options().maxCPUMemory().get() * 1048576u);
+    _unloader->setMaxGPUMemory((unsigned long long)options().maxGPUMemory().get() * 1048576u);
     //_unloader->setReleaser(_releaser.get());
     this->addChild( _unloader.get() );
 
@@ -342,6 +394,20 @@ RexTerrainEngineNode::setMap(const Map* map, const TerrainOptions& inOptions)
         _selectionInfo,
         &_clock);
 
+    // Elevation decals the shaders draw on top of the tile data
+    if (_decalUnit >= 0)
+    {
+        _engineContext->_decalAtlas = getResources()->getDecalAtlas();
+        _engineContext->_decalUnit = _decalUnit;
+    }
+
+    // Tiles without masks of their own still need a mask texture bound,
+    // or they'd pick up whatever the last masked tile left there.
+    if (_renderBindings[SamplerBinding::MASK].isActive())
+    {
+        _engineContext->_emptyMaskTexture = _emptyTexture.get();
+    }
+
     // Calculate the LOD morphing parameters:
     unsigned maxLOD = options().maxLOD().getOrUse(DEFAULT_MAX_LOD);
 
@@ -389,6 +455,14 @@ RexTerrainEngineNode::invalidateRegion(const GeoExtent& extent,
             manifest.insert(i->get());
         }
 
+        // Virtual textures reload their own pages.
+        std::vector<osg::ref_ptr<VirtualTexture> > vts;
+        getResources()->getVirtualTextures(vts);
+        for (unsigned i = 0; i < vts.size(); ++i)
+        {
+            vts[i]->invalidate(extentLocal, minLevel, maxLevel);
+        }
+
         _liveTiles->setDirty(extentLocal, minLevel, maxLevel, manifest);
     }
 }
@@ -417,6 +491,14 @@ RexTerrainEngineNode::invalidateRegion(const std::vector<const Layer*> layers,
             if (*i)
             {
                 manifest.insert(*i);
+
+                // A virtual texture reloads its own pages; the tiles only
+                // carry the layer's pass, which is cheap to rebuild.
+                VirtualTexture* vt = getResources()->getVirtualTexture(*i);
+                if (vt)
+                {
+                    vt->invalidate(extentLocal, minLevel, maxLevel);
+                }
             }
         }
 
@@ -459,6 +541,12 @@ RexTerrainEngineNode::setupRenderBindings()
     }
     _renderBindings.clear();
 
+    if (_decalUnit >= 0)
+    {
+        getResources()->releaseTextureImageUnit(_decalUnit);
+        _decalUnit = -1;
+    }
+
     // "SHARED" is the start of shared layers, so we always want the bindings
     // vector to be at least that size.
     _renderBindings.resize(SamplerBinding::SHARED);
@@ -499,11 +587,26 @@ RexTerrainEngineNode::setupRenderBindings()
     getOrCreateStateSet()->setDefine("OE_LANDCOVER_TEX", landCover.samplerName());
     getOrCreateStateSet()->setDefine("OE_LANDCOVER_TEX_MATRIX", landCover.matrixName());
 
+    // With GPU tessellation, masked tiles draw the pooled geometry like any
+    // other tile and the surface shader cuts the masks out with a texture.
+    SamplerBinding& mask = _renderBindings[SamplerBinding::MASK];
+    mask.usage()       = SamplerBinding::MASK;
+    mask.samplerName() = "oe_tile_maskTex";
+    mask.matrixName()  = "oe_tile_maskTexMatrix";
+    if (options().gpuTessellation() == true)
+        getResources()->reserveTextureImageUnit(mask.unit(), "Terrain Masks");
+
+    // GPU decals go on top of the elevation data. Tiles bind the atlas
+    // only when they have decals to draw.
+    if (this->elevationTexturesRequired())
+        getResources()->reserveTextureImageUnit(_decalUnit, "Terrain Decals");
+
     // Apply a default, empty texture to each render binding.
     OE_DEBUG << LC << "Render Bindings:\n";
     osg::StateSet* terrainSS = _terrain->getOrCreateStateSet();
     osg::ref_ptr<osg::Texture> tex = new osg::Texture2D(ImageUtils::createEmptyImage(1, 1));
     tex->setUnRefImageDataAfterApply(Registry::instance()->unRefImageDataAfterApply().get());
+    _emptyTexture = tex.get();
     for (unsigned i = 0; i < _renderBindings.size(); ++i)
     {
         SamplerBinding& b = _renderBindings[i];
@@ -514,6 +617,11 @@ RexTerrainEngineNode::setupRenderBindings()
             OE_DEBUG << LC << " > Bound \"" << b.samplerName() << "\" to unit " << b.unit() << "\n";
         }
     }
+
+    if (_decalUnit >= 0)
+    {
+        terrainSS->addUniform(new osg::Uniform("oe_terrain_decalTex", _decalUnit));
+    }
 }
 
 void
@@ -576,24 +684,6 @@ RexTerrainEngineNode::dirtyTerrain()
     TerrainEngineNode::dirtyTerrain();
 }
 
-namespace
-{
-    // debugging
-    struct CheckForOrphans : public TileNodeRegistry::ConstOperation {
-        void operator()( const TileNodeRegistry::TileTable& tiles ) const {
-            unsigned count = 0;
-            for(TileNodeRegistry::TileTable::const_iterator i = tiles.begin(); i != tiles.end(); ++i ) {
-                if ( i->second._tile->referenceCount() == 1 ) {
-                    count++;
-                }
-            }
-            if ( count > 0 )
-                OE_WARN << LC << "Oh no! " << count << " orphaned tiles in the reg" << std::endl;
-        }
-    };
-}
-
-
 void
 RexTerrainEngineNode::dirtyState()
 {
@@ -616,30 +706,285 @@ RexTerrainEngineNode::cacheAllLayerExtentsInMapSRS()
     }
 }
 void
-RexTerrainEngineNode::cull_traverse(osg::NodeVisitor& nv)
+RexTerrainEngineNode::updatePrefetchEye(TerrainCuller& culler)
 {
-    OE_PROFILING_ZONE;
+    float lookahead = options().prefetchTime().get();
+    if (lookahead <= 0.0f ||
+        culler._isSpy ||
+        options().rangeMode() == osg::LOD::PIXEL_SIZE_ON_SCREEN)
+    {
+        return;
+    }
 
-    _clock.cull();
+    // Only cameras that drive subdivision get a prediction.
+    const osg::Camera* cam = culler.getCamera();
+    if (cam == 0L || cam->getReferenceFrame() == osg::Camera::ABSOLUTE_RF_INHERIT_VIEWPOINT)
+        return;
 
-    osgUtil::CullVisitor* cv = static_cast<osgUtil::CullVisitor*>(&nv);
+    const osg::FrameStamp* fs = culler.getFrameStamp();
+    if (fs == 0L)
+        return;
 
-    // Initialize a new culler
-    TerrainCuller culler(cv, this->getEngineContext());
+    double now = fs->getReferenceTime();
+    osg::Vec3d eye = culler.getViewPointLocal();
+
+    CameraMotion& motion = _cameraMotion.get(cam);
 
+    if (motion._time >= 0.0 && now > motion._time)
+    {
+        // Smooth the velocity a bit so one jittery frame doesn't send us
+        // off loading tiles in the wrong direction. A change of course
+        // moves the prediction within a few frames, and the loader drops
+        // any requests that stop getting pinged.
+        osg::Vec3d v = (eye - motion._eye) / (now - motion._time);
+        motion._velocity = motion._velocity*0.5 + v*0.5;
+    }
+    else if (now < motion._time)
+    {
+        motion._velocity.set(0, 0, 0);
+    }
+
+    motion._eye = eye;
+    motion._time = now;
+
+    osg::Vec3d offset = motion._velocity * lookahead;
+
+    // Ignore trivial motion, which the regular cull traversal covers, and
+    // jumps (like a viewpoint change) that would predict us off the map.
+    double maxOffset = _selectionInfo.getLOD(options().firstLOD().get())._visibilityRange;
+    if (offset.length2() > 1.0 && offset.length2() < maxOffset*maxOffset)
+    {
+        culler._prefetch = true;
+        culler._prefetchEyeLocal = eye + offset;
+    }
+}
+
+void
+RexTerrainEngineNode::cullTerrain(TerrainCuller& culler)
+{
     // Prepare the culler with the set of renderable layers:
     culler.setup(getMap(), _cachedLayerExtents, this->getEngineContext()->getRenderBindings());
 
+    // Predict where the camera is headed so we can prefetch tiles there:
+    updatePrefetchEye(culler);
+
     // Assemble the terrain drawables:
     _terrain->accept(culler);
 
+    // Finish any subtrees the culler queued up for parallel culling:
+    culler.cullParallelTiles();
+
     // If we're using geometry pooling, optimize the drawable for shared state
     // by sorting the draw commands.
     // TODO: benchmark this further to see whether it's worthwhile
-    unsigned totalTiles = 0L;
     if (getEngineContext()->getGeometryPool()->isEnabled())
     {
-        totalTiles = culler._terrain.sortDrawCommands();
+        culler._terrain.sortDrawCommands();
+    }
+
+    // If the culler found any orphaned data, we need to update the render model
+    // during the next update cycle.
+    if (culler._orphanedPassesDetected > 0u)
+    {
+        _renderModelUpdateRequired = true;
+        OE_DEBUG << LC << "Detected " << culler._orphanedPassesDetected << " orphaned rendering passes\n";
+    }
+}
+
+namespace
+{
+    // Eye points closer than this (in meters) count as the same, so a
+    // stereo pair can share a cull too.
+    #define SHARED_VIEW_EYE_TOLERANCE 1.0
+
+    //! The cameras of a view that can share one terrain cull with "camera":
+    //! perspective cameras of its view, drawing its scene from the same eye.
+    void collectChannels(const osg::Camera* camera, std::vector<const osg::Camera*>& out)
+    {
+        const osg::View* view = camera->getView();
+        if (view == 0L)
+            return;
+
+        std::vector<const osg::Camera*> candidates;
+        if (view->getCamera() && view->getCamera()->getGraphicsContext())
+            candidates.push_back(view->getCamera());
+        for (unsigned i = 0; i < view->getNumSlaves(); ++i)
+        {
+            const osg::View::Slave& slave = view->getSlave(i);
+            if (slave._camera.valid() && slave._useMastersSceneData)
+                candidates.push_back(slave._camera.get());
+        }
+
+        osg::Vec3d eye = osg::Vec3d(0, 0, 0) * camera->getInverseViewMatrix();
+
+        for (unsigned i = 0; i < candidates.size(); ++i)
+        {
+            const osg::Camera* c = candidates[i];
+            if (c->getNodeMask() != 0 &&
+                c->getCullMask() == camera->getCullMask() &&
+                c->getReferenceFrame() == osg::Camera::RELATIVE_RF &&
+                c->getViewport() != 0L &&
+                c->getProjectionMatrix()(3, 3) == 0.0 &&
+                (osg::Vec3d(0, 0, 0) * c->getInverseViewMatrix() - eye).length() < SHARED_VIEW_EYE_TOLERANCE)
+            {
+                out.push_back(c);
+            }
+        }
+    }
+
+    //! A perspective projection, from the eye of the camera with the given view
+    //! matrix, whose frustum takes in the frusta of all the cameras. False if
+    //! they are too far apart for one frustum to take them all in.
+    bool computeUnionProjection(
+        const osg::Matrix& view,
+        const std::vector<const osg::Camera*>& cameras,
+        osg::Matrix& out)
+    {
+        double left = DBL_MAX, right = -DBL_MAX, bottom = DBL_MAX, top = -DBL_MAX;
+        double zNear = DBL_MAX, zFar = 0.0;
+
+        for (unsigned c = 0; c < cameras.size(); ++c)
+        {
+            osg::Matrix clipToEye =
+                osg::Matrix::inverse(cameras[c]->getViewMatrix() * cameras[c]->getProjectionMatrix()) * view;
+
+            for (unsigned i = 0; i < 8; ++i)
+            {
+                osg::Vec3d p = osg::Vec3d(i & 1 ? 1 : -1, i & 2 ? 1 : -1, i & 4 ? 1 : -1) * clipToEye;
+                if (p.z() >= 0.0)
+                    return false;
+
+                double depth = -p.z();
+                left = std::min(left, p.x() / depth);
+                right = std::max(right, p.x() / depth);
+                bottom = std::min(bottom, p.y() / depth);
+                top = std::max(top, p.y() / depth);
+                if (i & 4)
+                    zFar = std::max(zFar, depth);
+                else
+                    zNear = std::min(zNear, depth);
+            }
+        }
+
+        out.makeFrustum(left*zNear, right*zNear, bottom*zNear, top*zNear, zNear, zFar);
+        return true;
+    }
+}
+
+osg::ref_ptr<RexTerrainEngineNode::SharedViewCull>
+RexTerrainEngineNode::getSharedViewCull(osgUtil::CullVisitor* cv)
+{
+    // LODs selected by pixel size would depend on each camera's projection
+    if (options().rangeMode() != osg::LOD::DISTANCE_FROM_EYE_POINT)
+        return 0L;
+
+    osg::Camera* camera = cv->getCurrentCamera();
+    if (camera == 0L || camera->getView() == 0L || cv->getFrameStamp() == 0L)
+        return 0L;
+
+    unsigned frame = cv->getFrameStamp()->getFrameNumber();
+    Threading::Promise<SharedViewCull> promise;
+    Threading::Future<SharedViewCull> result;
+    std::vector<const osg::Camera*> channels;
+    {
+        Threading::ScopedMutexLock lock(_sharedViewCullsMutex);
+
+        SharedViewCullRecord& record = _sharedViewCulls[camera->getView()];
+        if (record._frame == frame)
+        {
+            // Another channel got here first this frame; a camera it
+            // didn't cull for (one with another eye point) culls alone.
+            if (std::find(record._cameras.begin(), record._cameras.end(), camera) == record._cameras.end())
+                return 0L;
+
+            result = record._result;
+        }
+        else
+        {
+            collectChannels(camera, channels);
+            if (channels.size() < 2u)
+                return 0L;
+
+            record._frame = frame;
+            record._cameras = channels;
+            record._result = promise.getFuture();
+        }
+    }
+
+    // Wait for the channel that is culling for us.
+    if (channels.empty())
+    {
+        return result.get();
+    }
+
+    osg::ref_ptr<SharedViewCull> shared;
+
+    osg::Matrix projection;
+    if (computeUnionProjection(*cv->getModelViewMatrix(), channels, projection) ||
+        computeUnionProjection(camera->getViewMatrix(), channels, projection))
+    {
+        // Cull with a copy of our CullVisitor that sees the union of the
+        // channels' frusta instead of just ours.
+        osg::ref_ptr<osgUtil::CullVisitor> unionCV = cv->clone();
+        unionCV->setRenderStage(cv->getRenderStage());
+        unionCV->setFrameStamp(new osg::FrameStamp(*cv->getFrameStamp()));
+        unionCV->setTraversalNumber(cv->getTraversalNumber());
+        unionCV->setTraversalMask(cv->getTraversalMask());
+        unionCV->setDatabaseRequestHandler(cv->getDatabaseRequestHandler());
+        unionCV->setUserDataContainer(cv->getUserDataContainer());
+        unionCV->setLODScale(cv->getLODScale());
+        unionCV->pushReferenceViewPoint(cv->getReferenceViewPoint());
+        unionCV->pushViewport(cv->getViewport());
+        unionCV->pushProjectionMatrix(new osg::RefMatrix(projection));
+        unionCV->pushModelViewMatrix(cv->getModelViewMatrix(), camera->getReferenceFrame());
+
+        TerrainCuller culler(unionCV.get(), this->getEngineContext());
+        cullTerrain(culler);
+
+        shared = new SharedViewCull();
+        shared->_terrain = culler._terrain;
+        shared->_modelView = *cv->getModelViewMatrix();
+    }
+
+    // NULL tells the other channels to cull for themselves.
+    promise.resolve(shared.get());
+    return shared;
+}
+
+void
+RexTerrainEngineNode::cull_traverse(osg::NodeVisitor& nv)
+{
+    OE_PROFILING_ZONE;
+
+    _clock.cull();
+
+    osgUtil::CullVisitor* cv = static_cast<osgUtil::CullVisitor*>(&nv);
+
+    // Initialize a new culler
+    TerrainCuller culler(cv, this->getEngineContext());
+
+    // Channel cameras of one view can share a single traversal of the
+    // tile tree; each one then keeps just the tiles in its own frustum.
+    osg::ref_ptr<SharedViewCull> shared;
+    if (options().sharedViewCulling() == true && !culler._isSpy)
+    {
+        shared = getSharedViewCull(cv);
+    }
+
+    if (shared.valid())
+    {
+        osg::Matrix viewDelta = osg::Matrix::inverse(shared->_modelView) * (*cv->getModelViewMatrix());
+        culler._terrain.setupView(shared->_terrain, viewDelta, *cv->getProjectionMatrix());
+    }
+    else
+    {
+        cullTerrain(culler);
+    }
+
+    // Start uploading the textures of tiles that are waiting to merge:
+    if (getEngineContext()->getTextureStreamer())
+    {
+        getEngineContext()->getTextureStreamer()->cull(cv);
     }
 
     // The common stateset for the terrain group:
@@ -749,14 +1094,6 @@ RexTerrainEngineNode::cull_traverse(osg::NodeVisitor& nv)
     // pop the common terrain state set
     cv->popStateSet();
 
-    // If the culler found any orphaned data, we need to update the render model
-    // during the next update cycle.
-    if (culler._orphanedPassesDetected > 0u)
-    {
-        _renderModelUpdateRequired = true;
-        OE_DEBUG << LC << "Detected " << culler._orphanedPassesDetected << " orphaned rendering passes\n";
-    }
-
     // we don't call this b/c we don't want _terrain
     //TerrainEngineNode::traverse(nv);
 
@@ -781,6 +1118,14 @@ RexTerrainEngineNode::update_traverse(osg::NodeVisitor& nv)
         // advance the frame clock for this new frame.
         _clock.update();
 
+        // start loading the pages last frame's tiles asked for
+        std::vector<osg::ref_ptr<VirtualTexture> > vts;
+        getResources()->getVirtualTextures(vts);
+        for (unsigned i = 0; i < vts.size(); ++i)
+        {
+            vts[i]->update(osgFrame);
+        }
+
         if (_renderModelUpdateRequired)
         {
             PurgeOrphanedLayers visitor(getMap(), _renderBindings);
@@ -942,6 +1287,8 @@ RexTerrainEngineNode::onMapModelChanged( const MapModelChange& change )
                 break;
 
             case MapModelChange::MOVE_LAYER:
+                // Image layers draw in map order, which the culler reads
+                // every frame, so moving one needs no reload.
                 if (change.getElevationLayer())
                     moveElevationLayer(change.getElevationLayer());
                 break;
@@ -971,6 +1318,9 @@ RexTerrainEngineNode::addLayer(Layer* layer)
 {
     if (layer)
     {
+        // cache the extent first so the add can limit its reload to it
+        cacheLayerExtentInMapSRS(layer);
+
         if (layer->getEnabled())
         {
             if (layer->getRenderType() == Layer::RENDERTYPE_TERRAIN_SURFACE)
@@ -978,8 +1328,6 @@ RexTerrainEngineNode::addLayer(Layer* layer)
             else if (dynamic_cast<ElevationLayer*>(layer))
                 addElevationLayer(dynamic_cast<ElevationLayer*>(layer));
         }
-
-        cacheLayerExtentInMapSRS(layer);        
     }
 }
 
@@ -991,6 +1339,17 @@ RexTerrainEngineNode::addTileLayer(Layer* tileLayer)
         ImageLayer* imageLayer = dynamic_cast<ImageLayer*>(tileLayer);
         if (imageLayer)
         {
+            // The tiles of a virtual-texture layer draw from one atlas of
+            // pages. Shared layers bind their own textures, so they can't.
+            if (imageLayer->getVirtualTexture() == true && !imageLayer->isShared())
+            {
+                getResources()->createVirtualTexture(
+                    imageLayer,
+                    getMap()->getProfile(),
+                    options().virtualTexturePages().get(),
+                    options().virtualTextureUploads().get());
+            }
+
             // for a shared layer, allocate a shared image unit if necessary.
             if ( imageLayer->isShared() )
             {
@@ -1071,23 +1430,52 @@ RexTerrainEngineNode::addTileLayer(Layer* tileLayer)
 
         if (_terrain)
         {
-            // Update the existing render models, and trigger a data reload.
-            // Later we can limit the reload to an update of only the new data.
+            // Queue a load of just the new layer's data on the tiles it covers.
+            // Tiles only submit their load queues when culled, so the data
+            // arrives lazily for visible tiles and the other layers stay put.
             std::vector<const Layer*> layers;
             layers.push_back(tileLayer);
-            invalidateRegion(layers, GeoExtent::INVALID, 0u, INT_MAX);
+            invalidateRegion(layers, getLayerExtentInMapSRS(tileLayer), 0u, INT_MAX);
         }
 
-        updateState();
+        // The terrain shaders only depend on shared layers and color filters;
+        // a plain layer just adds a pass, so skip the (expensive) rebuild.
+        if (layerRequiresStateUpdate(tileLayer))
+        {
+            updateState();
+        }
     }
 }
 
+bool
+RexTerrainEngineNode::layerRequiresStateUpdate(const Layer* layer) const
+{
+    const ImageLayer* imageLayer = dynamic_cast<const ImageLayer*>(layer);
+    if (imageLayer == 0L)
+        return true;
+
+    return
+        imageLayer->isShared() ||
+        imageLayer->getColorFilters().empty() == false;
+}
+
+const GeoExtent&
+RexTerrainEngineNode::getLayerExtentInMapSRS(const Layer* layer) const
+{
+    LayerExtentMap::const_iterator i = _cachedLayerExtents.find(layer->getUID());
+    if (i != _cachedLayerExtents.end() && i->second._computed && i->second._extent.isValid())
+        return i->second._extent;
+    return GeoExtent::INVALID;
+}
+
 
 void
 RexTerrainEngineNode::removeImageLayer( ImageLayer* layerRemoved )
 {
     if ( layerRemoved )
     {
+        getResources()->releaseVirtualTexture(layerRemoved);
+
         // for a shared layer, release the shared image unit.
         if ( layerRemoved->getEnabled() && layerRemoved->isShared() )
         {
@@ -1114,17 +1502,20 @@ RexTerrainEngineNode::removeImageLayer( ImageLayer* layerRemoved )
             }
         }
 
-        updateState();
-    }
+        if (layerRequiresStateUpdate(layerRemoved))
+        {
+            updateState();
+        }
 
-    if (_terrain)
-    {
-        // Run the update visitor, which will clean out any rendering passes
-        // associated with the layer we just removed. This would happen
-        // automatically during cull/update anyway, but it's more efficient
-        // to do it all at once.
-        PurgeOrphanedLayers updater(getMap(), _renderBindings);
-        _terrain->accept(updater);
+        if (_terrain)
+        {
+            // Run the update visitor, which will clean out any rendering passes
+            // associated with the layer we just removed. This would happen
+            // automatically during cull/update anyway, but it's more efficient
+            // to do it all at once.
+            PurgeOrphanedLayers updater(getMap(), _renderBindings, layerRemoved->getUID(), layerRemoved->isShared());
+            _terrain->accept(updater);
+        }
     }
 
     //OE_INFO << LC << " Updated " << updater._count << " tiles\n";
@@ -1229,6 +1620,19 @@ RexTerrainEngineNode::updateState()
             surfaceStateSet->setDefine("OE_TERRAIN_RENDER_ELEVATION");
         }
 
+        // GPU decals apply wherever the SDK reads elevation, patch
+        // layers included.
+        if (_decalUnit >= 0)
+        {
+            terrainStateSet->setDefine("OE_TERRAIN_GPU_DECALS");
+        }
+
+        // Masks cut out of the surface by the fragment shader:
+        if (_renderBindings[SamplerBinding::MASK].isActive())
+        {
+            terrainStateSet->setDefine("OE_TERRAIN_MASK_TEXTURES");
+        }
+
         // Normal mapping shaders:
         //if (this->normalTexturesRequired())
         {
@@ -1248,6 +1652,11 @@ RexTerrainEngineNode::updateState()
             surfaceStateSet->setDefine("OE_COMPRESSED_NORMAL_MAP");
         }
 
+        if (options().gpuNormalMaps() == true)
+        {
+            surfaceStateSet->setDefine("OE_TERRAIN_GPU_NORMALS");
+        }
+
         // Morphing?
         if (_morphingSupported)
         {
@@ -1392,3 +1801,194 @@ RexTerrainEngineNode::createStandaloneTile(
     CreateTileImplementation impl;
     return impl.createTile(getEngineContext(), model, createTileFlags, referenceLOD, subRegion);
 }
+
+namespace
+{
+    // Longest piece of a pick segment that's treated as straight in map
+    // coordinates; at 1km the earth's curvature bends it by 2cm.
+    const double MAX_PICK_PIECE_LENGTH = 1000.0;
+
+    // A leaf tile the pick segment passes through, and the range of the
+    // segment parameter inside its bounding box
+    struct PickCandidate
+    {
+        TileNode* _tile;
+        double _t0, _t1;
+        bool operator < (const PickCandidate& rhs) const { return _t0 < rhs._t0; }
+    };
+
+    // Clips the segment start + t*(end-start), t in [0..1], to a tile's
+    // bounding box. A tile's box only covers the heights in its own raster,
+    // so pad it for the peaks its subtiles' finer rasters may resolve.
+    bool clipToTile(TileNode* tile, const osg::Vec3d& start, const osg::Vec3d& end, double& t0, double& t1)
+    {
+        SurfaceNode* surface = tile->getSurfaceNode();
+        if (!surface)
+            return false;
+
+        osg::BoundingBoxd box(surface->getAlignedBoundingBox());
+        if (!box.valid())
+            return false;
+
+        double pad = 0.01 * osg::maximum(box.xMax() - box.xMin(), box.yMax() - box.yMin());
+        box.zMin() -= pad;
+        box.zMax() += pad;
+
+        osg::Matrixd world2local;
+        world2local.invert(surface->getMatrix());
+        osg::Vec3d a = start * world2local;
+        osg::Vec3d d = end * world2local - a;
+
+        t0 = 0.0, t1 = 1.0;
+        for (int i = 0; i < 3; ++i)
+        {
+            if (fabs(d[i]) < 1e-12)
+            {
+                if (a[i] < box._min[i] || a[i] > box._max[i])
+                    return false;
+            }
+            else
+            {
+                double u0 = (box._min[i] - a[i]) / d[i];
+                double u1 = (box._max[i] - a[i]) / d[i];
+                if (u0 > u1)
+                    std::swap(u0, u1);
+                t0 = osg::maximum(t0, u0);
+                t1 = osg::minimum(t1, u1);
+                if (t0 > t1)
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    // Descends the quadtree through the boxes the segment touches and
+    // collects the deepest loaded tiles.
+    void collectPickCandidates(TileNode* tile, const osg::Vec3d& start, const osg::Vec3d& end, std::vector<PickCandidate>& out)
+    {
+        PickCandidate c;
+        if (!clipToTile(tile, start, end, c._t0, c._t1))
+            return;
+
+        if (tile->getNumChildren() == 4)
+        {
+            for (unsigned i = 0; i < 4; ++i)
+                collectPickCandidates(tile->getSubTile(i), start, end, out);
+        }
+        else
+        {
+            c._tile = tile;
+            out.push_back(c);
+        }
+    }
+
+    // Intersects a map-coordinate segment with the ellipsoid, for tiles
+    // with no elevation data.
+    bool intersectEllipsoid(const osg::Vec3d& a, const osg::Vec3d& b, osg::Vec3d& out_hit)
+    {
+        if (a.z() < 0.0 || b.z() > 0.0 || a.z() == b.z())
+            return false;
+        out_hit = a + (b - a) * (a.z() / (a.z() - b.z()));
+        out_hit.z() = 0.0;
+        return true;
+    }
+
+    // Intersects the part of the segment inside a candidate with the
+    // candidate's elevation raster, piece by piece in map coordinates.
+    // Updates inout_t and out_world if it finds a hit nearer than inout_t.
+    void intersectPickCandidate(
+        const PickCandidate& c,
+        const SpatialReference* srs,
+        const osg::Vec3d& start,
+        const osg::Vec3d& end,
+        double& inout_t,
+        osg::Vec3d& out_world)
+    {
+        const Sampler& elevation = c._tile->renderModel()._sharedSamplers[SamplerBinding::ELEVATION];
+        const ElevationTexture* tex = dynamic_cast<const ElevationTexture*>(elevation._texture.get());
+
+        // an inherited raster covers more than this tile, so discard hits
+        // that belong to a neighbor
+        const GeoExtent& extent = c._tile->getKey().getExtent();
+
+        osg::Vec3d dir = end - start;
+        double len = dir.length() * (c._t1 - c._t0);
+        unsigned numPieces = osg::clampBetween((unsigned)ceil(len / MAX_PICK_PIECE_LENGTH), 1u, 64u);
+
+        osg::Vec3d a;
+        if (!srs->transformFromWorld(start + dir * c._t0, a))
+            return;
+
+        for (unsigned i = 1; i <= numPieces; ++i)
+        {
+            double ta = c._t0 + (c._t1 - c._t0) * (double)(i - 1) / (double)numPieces;
+            if (ta >= inout_t)
+                return;
+
+            double tb = c._t0 + (c._t1 - c._t0) * (double)i / (double)numPieces;
+            osg::Vec3d b;
+            if (!srs->transformFromWorld(start + dir * tb, b))
+                return;
+
+            osg::Vec3d hit;
+            bool found = tex ? tex->intersect(a, b, hit) : intersectEllipsoid(a, b, hit);
+            if (found && extent.contains(hit.x(), hit.y()))
+            {
+                osg::Vec3d world;
+                if (srs->transformToWorld(hit, world))
+                {
+                    double t = ((world - start) * dir) / dir.length2();
+                    if (t < inout_t)
+                    {
+                        inout_t = t;
+                        out_world = world;
+                    }
+                }
+                return;
+            }
+
+            a = b;
+        }
+    }
+}
+
+bool
+RexTerrainEngineNode::getLoadingStats(LoadingStats& out) const
+{
+    out = LoadingStats();
+    out._numTiles = _liveTiles.valid() ? _liveTiles->size() : 0u;
+
+    const PagerLoader* loader = dynamic_cast<const PagerLoader*>(_loader.get());
+    if (loader)
+        loader->getStats(out);
+
+    return true;
+}
+
+bool
+RexTerrainEngineNode::intersect(const osg::Vec3d& start, const osg::Vec3d& end, osg::Vec3d& out_hit) const
+{
+    if (!getMap() || !_terrain.valid() || start == end)
+        return false;
+
+    std::vector<PickCandidate> candidates;
+    for (unsigned i = 0; i < _terrain->getNumChildren(); ++i)
+    {
+        TileNode* tile = dynamic_cast<TileNode*>(_terrain->getChild(i));
+        if (tile)
+            collectPickCandidates(tile, start, end, candidates);
+    }
+
+    // visit the tiles in the order the segment enters them, and stop at
+    // the first one that starts past the nearest hit so far
+    std::sort(candidates.begin(), candidates.end());
+
+    const SpatialReference* srs = getMap()->getSRS();
+    double t = DBL_MAX;
+    for (unsigned i = 0; i < candidates.size() && candidates[i]._t0 < t; ++i)
+    {
+        intersectPickCandidate(candidates[i], srs, start, end, t, out_hit);
+    }
+
+    return t <= 1.0;
+}
@@ -23,9 +23,18 @@
 #include <osgEarth/TraversalData>
 #include <osgEarth/VisibleLayer>
 #include <osgEarth/Shadowing>
+#include <osgEarth/Registry>
+#include <osgEarth/Threading>
+#include <osgEarth/Metrics>
+#include <osgEarth/FrameGovernor>
+#include <osgEarth/TerrainEngineNode>
 
 #define LC "[TerrainCuller] "
 
+// Number of LODs below the first LOD that the cull thread traverses
+// itself before queueing subtrees for parallel culling
+#define PARALLEL_CULL_LOD_OFFSET 2u
+
 using namespace osgEarth::REX;
 
 
@@ -34,7 +43,10 @@ _camera(0L),
 _currentTileNode(0L),
 _orphanedPassesDetected(0u),
 _cv(cullVisitor),
-_context(context)
+_context(context),
+_prefetch(false),
+_parallelLOD(0u),
+_isSlice(false)
 {
     setVisitorType(CULL_VISITOR);
     setTraversalMode(TRAVERSE_ALL_CHILDREN);
@@ -46,7 +58,9 @@ _context(context)
     pushViewport(_cv->getViewport());
     pushProjectionMatrix(_cv->getProjectionMatrix());
     pushModelViewMatrix(_cv->getModelViewMatrix(), _cv->getCurrentCamera()->getReferenceFrame());
-    setLODScale(_cv->getLODScale());
+
+    // the governor raises the LOD scale under load, so tiles subdivide later
+    setLODScale(_cv->getLODScale() / Util::FrameGovernor::getScale(Util::FrameGovernor::LOD_SCALE));
     _camera = _cv->getCurrentCamera();
     _isSpy = VisitorData::isSet(*cullVisitor, "osgEarth.Spy");
 
@@ -62,6 +76,165 @@ TerrainCuller::setup(const Map* map, LayerExtentMap& layerExtents, const RenderB
     unsigned frameNum = getFrameStamp() ? getFrameStamp()->getFrameNumber() : 0u;
     _layerExtents = &layerExtents;
     _terrain.setup(map, bindings, frameNum, _cv);
+    _terrain._drawState->_bindless = _context->getBindlessTextures();
+
+    // Image layers drawn from a page cache:
+    TerrainEngineNode* engine = _context->getEngine();
+    if (engine && engine->getResources())
+    {
+        for (LayerDrawableList::iterator i = _terrain.layers().begin(); i != _terrain.layers().end(); ++i)
+        {
+            LayerDrawable* drawable = i->get();
+            if (drawable->_imageLayer && drawable->_imageLayer->getVirtualTexture() == true)
+            {
+                drawable->_virtualTexture = engine->getResources()->getVirtualTexture(drawable->_imageLayer);
+            }
+        }
+    }
+
+    // The atlas makes its texture on the first decal
+    if (_context->getDecalAtlas())
+    {
+        _terrain._drawState->_decalTexture = _context->getDecalAtlas()->getTexture();
+        _terrain._drawState->_decalUnit = _context->getDecalUnit();
+    }
+
+    // Spy traversals only visit tiles culled by another camera, so they
+    // are cheap enough to leave on the cull thread.
+    if (_context->options().parallelCulling() == true && !_isSpy)
+    {
+        _parallelLOD = _context->options().firstLOD().get() + PARALLEL_CULL_LOD_OFFSET;
+    }
+
+    if (_context->options().occlusionCulling() == true && !_isSpy)
+    {
+        _occlusion = OcclusionPyramid::cull(_cv);
+    }
+}
+
+namespace
+{
+    // One contiguous run of the queued subtrees, culled by its own TerrainCuller
+    // (and its own copy of the CullVisitor) into its own render data.
+    struct CullSlice
+    {
+        osg::ref_ptr<osgUtil::CullVisitor> _cv;
+        osg::ref_ptr<TerrainCuller> _culler;
+        unsigned _begin, _end;
+    };
+
+    struct ParallelCull : public osg::Referenced
+    {
+        ParallelCull() : _next(0u), _finished(0u) { }
+
+        std::vector<TileNode*> _tiles;
+        std::vector<CullSlice> _slices;
+        std::atomic_uint _next;
+        std::atomic_uint _finished;
+        Threading::Event _done;
+
+        // Claim and cull slices until none are left. The cull thread runs this
+        // too, so it never waits on a slice that a busy pool hasn't started.
+        void run()
+        {
+            unsigned i;
+            while ((i = _next++) < _slices.size())
+            {
+                CullSlice& slice = _slices[i];
+                for (unsigned t = slice._begin; t < slice._end; ++t)
+                {
+                    _tiles[t]->accept(*slice._culler.get());
+                }
+
+                if (++_finished == _slices.size())
+                {
+                    _done.set();
+                }
+            }
+        }
+    };
+}
+
+void
+TerrainCuller::cullParallelTiles()
+{
+    if (_parallelTiles.empty())
+        return;
+
+    OE_PROFILING_ZONE;
+
+    // Stop queueing; anything culled from here on happens directly.
+    _parallelLOD = 0u;
+
+    Threading::JobArena* arena = Registry::instance()->getJobArena("terrain.cull");
+    unsigned numSlices = osg::minimum((unsigned)_parallelTiles.size(), 2u * (arena->getConcurrency() + 1u));
+
+    if (numSlices < 2u)
+    {
+        for (unsigned i = 0; i < _parallelTiles.size(); ++i)
+            _parallelTiles[i]->accept(*this);
+        _parallelTiles.clear();
+        return;
+    }
+
+    osg::ref_ptr<ParallelCull> job = new ParallelCull();
+    job->_tiles.swap(_parallelTiles);
+    job->_slices.resize(numSlices);
+
+    unsigned numTiles = job->_tiles.size();
+    for (unsigned i = 0; i < numSlices; ++i)
+    {
+        CullSlice& slice = job->_slices[i];
+        slice._begin = (i * numTiles) / numSlices;
+        slice._end = ((i + 1) * numTiles) / numSlices;
+
+        // The subtrees hang directly off the terrain root, so each slice's
+        // CullVisitor starts with exactly the state ours has now.
+        osgUtil::CullVisitor* cv = _cv->clone();
+        cv->setRenderStage(_cv->getRenderStage());
+        cv->setFrameStamp(new osg::FrameStamp(*_cv->getFrameStamp()));
+        cv->setTraversalNumber(_cv->getTraversalNumber());
+        cv->setTraversalMask(_cv->getTraversalMask());
+        cv->setDatabaseRequestHandler(_cv->getDatabaseRequestHandler());
+        cv->setUserDataContainer(_cv->getUserDataContainer());
+        cv->setLODScale(_cv->getLODScale());
+        cv->pushReferenceViewPoint(_cv->getReferenceViewPoint());
+        cv->pushViewport(_cv->getViewport());
+        cv->pushProjectionMatrix(_cv->getProjectionMatrix());
+        cv->pushModelViewMatrix(_cv->getModelViewMatrix(), _cv->getCurrentCamera()->getReferenceFrame());
+        slice._cv = cv;
+
+        TerrainCuller* culler = new TerrainCuller(cv, _context);
+        culler->_isSlice = true;
+        culler->_layerExtents = _layerExtents;
+        culler->_prefetch = _prefetch;
+        culler->_prefetchEyeLocal = _prefetchEyeLocal;
+        culler->_occlusion = _occlusion;
+        culler->_terrain.setupSlice(_terrain);
+        slice._culler = culler;
+    }
+
+    for (unsigned i = 1; i < numSlices; ++i)
+    {
+        Threading::runInJobArena(arena, [job]() { job->run(); });
+    }
+
+    job->run();
+    job->_done.wait();
+
+    // Merge in queue order so the draw order doesn't depend on thread timing.
+    for (unsigned i = 0; i < numSlices; ++i)
+    {
+        TerrainCuller* culler = job->_slices[i]._culler.get();
+        _terrain.merge(culler->_terrain);
+        _orphanedPassesDetected += culler->_orphanedPassesDetected;
+
+        // debug geometry goes straight to the real CullVisitor
+        for (unsigned d = 0; d < culler->_debugSurfaces.size(); ++d)
+        {
+            culler->_debugSurfaces[d]->accept(*_cv);
+        }
+    }
 }
 
 float
@@ -99,10 +272,12 @@ TerrainCuller::addDrawCommand(UID uid, const TileRenderModel* model, const Rende
             // Cull based on the layer extent.
             if (drawable->_layer)
             {
-                const LayerExtent& le = (*_layerExtents)[drawable->_layer->getUID()];
-                if (le._computed && 
-                    le._extent.isValid() &&
-                    le._extent.intersects(tileNode->getKey().getExtent()) == false)
+                // find() rather than [] since slices share the map across threads
+                LayerExtentMap::const_iterator le = _layerExtents->find(drawable->_layer->getUID());
+                if (le != _layerExtents->end() &&
+                    le->second._computed &&
+                    le->second._extent.isValid() &&
+                    le->second._extent.intersects(tileNode->getKey().getExtent()) == false)
                 {
                     // culled out!
                     //OE_DEBUG << LC << "Skippping " << drawable->_layer->getName() 
@@ -112,9 +287,32 @@ TerrainCuller::addDrawCommand(UID uid, const TileRenderModel* model, const Rende
                 }            
             }
 
+            // A virtual texture tile draws from the best pages resident in
+            // the atlas. Looking them up also asks for the tile's own page.
+            osg::Vec4f pages[2];
+            if (drawable->_virtualTexture.valid())
+            {
+                VirtualTexture* vt = drawable->_virtualTexture.get();
+                unsigned frame = getFrameStamp() ? getFrameStamp()->getFrameNumber() : 0u;
+                const TileKey& key = tileNode->getKey();
+
+                if (!vt->getPage(key, frame, pages[0]))
+                    return 0L;
+
+                if (key.getLOD() == 0u || !vt->getPage(key.createParentKey(), frame, pages[1]))
+                    pages[1].set(0.0f, 0.0f, 0.0f, 0.0f);
+            }
+
             drawable->_tiles.push_back(DrawTileCommand());
             DrawTileCommand* tile = &drawable->_tiles.back();
 
+            if (drawable->_virtualTexture.valid())
+            {
+                tile->_virtualTexture = drawable->_virtualTexture->getTexture();
+                tile->_virtualPages[0] = pages[0];
+                tile->_virtualPages[1] = pages[1];
+            }
+
             // install everything we need in the Draw Command:
             tile->_colorSamplers = pass ? &(pass->samplers()) : 0L;
             tile->_sharedSamplers = &model->_sharedSamplers;
@@ -126,6 +324,7 @@ TerrainCuller::addDrawCommand(UID uid, const TileRenderModel* model, const Rende
             tile->_morphConstants = tileNode->getMorphConstants();
             tile->_key = &tileNode->getKey();
             tile->_tileRevision = tileNode->getRevision();
+            tile->_decals = _currentTileDecals;
 
             osg::Vec3 c = surface->getBound().center() * surface->getInverseMatrix();
             tile->_range = getDistanceToViewPoint(c, true);
@@ -212,6 +411,11 @@ TerrainCuller::apply(TileNode& node)
     // we can set it's "layerOrder" member to zero at the end, so the rendering engine
     // knows to blend it with the terrain geometry color.
     _firstDrawCommandForTile = 0L;
+
+    // GPU decals newer than the tile's elevation data
+    _currentTileDecals = _context->getDecalAtlas() ?
+        node.getDecals(_context->getDecalAtlas()) :
+        0L;
         
     if (!_terrain.patchLayers().empty() && node.getSurfaceNode() && !node.isEmpty())
     {
@@ -282,13 +486,23 @@ TerrainCuller::apply(SurfaceNode& node)
     _cv->pushModelViewMatrix(matrix, node.getReferenceFrame());
 
     // now test against the local bounding box for tighter culling:
-    if (!_cv->isCulled(node.getAlignedBoundingBox()))
+    bool visible = !_cv->isCulled(node.getAlignedBoundingBox());
+
+    if (visible && !_isSpy)
     {
-        if (!_isSpy)
-        {
-            node.setLastFramePassedCull(getFrameStamp()->getFrameNumber());
-        }
+        node.setLastFramePassedCull(getFrameStamp()->getFrameNumber());
+    }
 
+    // Skip the draws of a tile hidden behind last frame's depth. It still
+    // counts as passing cull above, so it stays resident and keeps
+    // subdividing, and can draw at full detail the moment it's revealed.
+    if (visible && _occlusion.valid() && _occlusion->isOccluded(node.getAlignedBoundingBox(), *matrix))
+    {
+        visible = false;
+    }
+
+    if (visible)
+    {
         int order = 0;
         unsigned count = 0;
 
@@ -348,7 +562,10 @@ TerrainCuller::apply(SurfaceNode& node)
 
     if (node.getDebugNode())
     {
-        node.accept(*_cv);
+        if (_isSlice)
+            _debugSurfaces.push_back(&node);
+        else
+            node.accept(*_cv);
     }
 }
 
@@ -20,6 +20,8 @@
 #include "TileNode"
 #include "SurfaceNode"
 #include <osgEarth/CameraUtils>
+#include <osg/Polytope>
+#include <unordered_map>
 
 using namespace osgEarth::REX;
 
@@ -114,6 +116,114 @@ TerrainRenderData::setup(const Map* map,
     LayerDrawable* blank = addLayerDrawable(0L);
 }
 
+void
+TerrainRenderData::setupSlice(const TerrainRenderData& parent)
+{
+    _bindings = parent._bindings;
+
+    // Private draw state; the slice only uses it to accumulate bounds.
+    _drawState = new DrawState();
+    _drawState->_bindings = _bindings;
+
+    _patchLayers = parent._patchLayers;
+
+    // Mirror the parent's layers in the same order so merge() can
+    // match them up by index.
+    for (LayerDrawableList::const_iterator i = parent._layerList.begin(); i != parent._layerList.end(); ++i)
+    {
+        const LayerDrawable* rhs = i->get();
+
+        LayerDrawable* drawable = new LayerDrawable();
+        drawable->_drawOrder = rhs->_drawOrder;
+        drawable->_drawState = _drawState.get();
+        drawable->_layer = rhs->_layer;
+        drawable->_visibleLayer = rhs->_visibleLayer;
+        drawable->_imageLayer = rhs->_imageLayer;
+        drawable->_patchLayer = rhs->_patchLayer;
+        drawable->_virtualTexture = rhs->_virtualTexture;
+        drawable->_renderType = rhs->_renderType;
+        drawable->_draw = rhs->_draw;
+        drawable->_gpuTimer = rhs->_gpuTimer;
+        _layerList.push_back(drawable);
+
+        _layerMap[rhs->_layer ? rhs->_layer->getUID() : -1] = drawable;
+    }
+}
+
+void
+TerrainRenderData::merge(const TerrainRenderData& slice)
+{
+    for (unsigned i = 0; i < _layerList.size() && i < slice._layerList.size(); ++i)
+    {
+        const DrawTileCommands& rhs = slice._layerList[i]->_tiles;
+        if (!rhs.empty())
+        {
+            DrawTileCommands& cmds = _layerList[i]->_tiles;
+            cmds.insert(cmds.end(), rhs.begin(), rhs.end());
+        }
+    }
+
+    if (slice._drawState.valid() && slice._drawState->_bs.valid())
+    {
+        _drawState->_bs.expandBy(slice._drawState->_bs);
+        _drawState->_box.expandBy(_drawState->_bs);
+    }
+}
+
+void
+TerrainRenderData::setupView(const TerrainRenderData& shared,
+                             const osg::Matrix& viewDelta,
+                             const osg::Matrix& projection)
+{
+    setupSlice(shared);
+
+    _drawState->_bindless = shared._drawState->_bindless;
+    _drawState->_decalTexture = shared._drawState->_decalTexture;
+    _drawState->_decalUnit = shared._drawState->_decalUnit;
+    _drawState->_bs = shared._drawState->_bs;
+    _drawState->_box = shared._drawState->_box;
+
+    // A tile has a draw command in each of its layers, but the test and
+    // the new matrix are the same for all of them.
+    typedef std::unordered_map<const TileDrawable*, osg::ref_ptr<const osg::RefMatrix> > VisibleTiles;
+    VisibleTiles tiles;
+
+    for (unsigned i = 0; i < _layerList.size() && i < shared._layerList.size(); ++i)
+    {
+        const LayerDrawable* rhs = shared._layerList[i].get();
+        LayerDrawable* drawable = _layerList[i].get();
+
+        // slices don't need the layer state, but a view draws with it
+        drawable->setStateSet(const_cast<osg::StateSet*>(rhs->getStateSet()));
+
+        drawable->_tiles.reserve(rhs->_tiles.size());
+
+        for (DrawTileCommands::const_iterator cmd = rhs->_tiles.begin(); cmd != rhs->_tiles.end(); ++cmd)
+        {
+            VisibleTiles::iterator tile = tiles.find(cmd->_tile);
+            if (tile == tiles.end())
+            {
+                osg::ref_ptr<osg::RefMatrix> mv = new osg::RefMatrix((*cmd->_modelViewMatrix) * viewDelta);
+
+                // This camera's frustum in the tile's local space. Near and far
+                // are left out; the shared cull already took care of them.
+                osg::Polytope frustum;
+                frustum.setToUnitFrustum(false, false);
+                frustum.transformProvidingInverse((*mv) * projection);
+                bool visible = frustum.contains(cmd->_tile->getBoundingBox());
+
+                tile = tiles.insert(std::make_pair(cmd->_tile, visible ? mv.get() : 0L)).first;
+            }
+
+            if (tile->second.valid())
+            {
+                drawable->_tiles.push_back(*cmd);
+                drawable->_tiles.back()._modelViewMatrix = tile->second.get();
+            }
+        }
+    }
+}
+
 namespace
 {
     struct DebugCallback : public osg::Drawable::DrawCallback
@@ -146,6 +256,9 @@ TerrainRenderData::addLayerDrawable(const Layer* layer)
         drawable->_patchLayer = dynamic_cast<const PatchLayer*>(layer);
         drawable->setStateSet(layer->getStateSet());
         drawable->_renderType = layer->getRenderType();
+
+        if (Util::GPUTimer::isEnabled())
+            drawable->_gpuTimer = Util::GPUTimer::get("terrain." + layer->getName());
     }
     else
     {
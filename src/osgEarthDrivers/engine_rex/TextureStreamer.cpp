@@ -0,0 +1,569 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+ * Copyright 2008-2014 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include "TextureStreamer"
+#include <osgEarth/Notify>
+#include <osg/Texture2D>
+#include <osg/GLExtensions>
+#include <osg/GraphicsContext>
+#include <osg/GraphicsThread>
+#include <climits>
+
+using namespace osgEarth::REX;
+
+#undef  LC
+#define LC "[TextureStreamer] "
+
+// The pixel buffer ring holds this many frames' worth of uploads
+#define RING_FRAMES 3
+
+// Ring offsets are aligned to this many bytes
+#define RING_ALIGNMENT 256
+
+#ifndef GL_PIXEL_UNPACK_BUFFER
+#define GL_PIXEL_UNPACK_BUFFER 0x88EC
+#endif
+
+#ifndef GL_MAP_WRITE_BIT
+#define GL_MAP_WRITE_BIT 0x0002
+#endif
+
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+
+#ifndef GL_SYNC_GPU_COMMANDS_COMPLETE
+#define GL_SYNC_GPU_COMMANDS_COMPLETE 0x9117
+#endif
+
+#ifndef GL_ALREADY_SIGNALED
+#define GL_ALREADY_SIGNALED 0x911A
+#endif
+
+#ifndef GL_CONDITION_SATISFIED
+#define GL_CONDITION_SATISFIED 0x911C
+#endif
+
+#ifndef GL_SYNC_FLUSH_COMMANDS_BIT
+#define GL_SYNC_FLUSH_COMMANDS_BIT 0x00000001
+#endif
+
+#ifndef GL_UNPACK_ROW_LENGTH
+#define GL_UNPACK_ROW_LENGTH 0x0CF2
+#endif
+
+namespace
+{
+    bool usesMipmaps(const osg::Texture* tex)
+    {
+        osg::Texture::FilterMode f = tex->getFilter(osg::Texture::MIN_FILTER);
+        return f != osg::Texture::LINEAR && f != osg::Texture::NEAREST;
+    }
+
+    GLint fullMipmapLevels(GLsizei width, GLsizei height)
+    {
+        GLint levels = 1;
+        for (GLsizei s = osg::maximum(width, height); s > 1; s >>= 1)
+            ++levels;
+        return levels;
+    }
+}
+
+//........................................................................
+
+// Starts the uploads from the terrain's render stage
+struct TextureStreamer::UploadDrawable : public osg::Drawable
+{
+    UploadDrawable(TextureStreamer* streamer) :
+        _streamer(streamer)
+    {
+        setUseDisplayList(false);
+        setUseVertexBufferObjects(false);
+        setCullingActive(false);
+    }
+
+    void drawImplementation(osg::RenderInfo& ri) const;
+
+    osg::observer_ptr<TextureStreamer> _streamer;
+};
+
+// Runs the uploads on a compile context's thread
+struct TextureStreamer::UploadOperation : public osg::GraphicsOperation
+{
+    UploadOperation(TextureStreamer* streamer, unsigned frame) :
+        osg::GraphicsOperation("oe.rex.TextureStreamer", false),
+        _streamer(streamer),
+        _frame(frame)
+    {
+        //nop
+    }
+
+    void operator()(osg::GraphicsContext* gc)
+    {
+        osg::ref_ptr<TextureStreamer> streamer;
+        if (!_streamer.lock(streamer) || gc->getState() == 0L)
+            return;
+
+        osg::State& state = *gc->getState();
+        streamer->upload(state, _frame);
+
+        // Submit now, or the fence may never signal for the other context
+        glFlush();
+
+        Threading::ScopedMutexLock lock(streamer->_queueMutex);
+        streamer->_pcs[state.getContextID()]._scheduled = false;
+    }
+
+    osg::observer_ptr<TextureStreamer> _streamer;
+    unsigned _frame;
+};
+
+void
+TextureStreamer::UploadDrawable::drawImplementation(osg::RenderInfo& ri) const
+{
+    osg::ref_ptr<TextureStreamer> streamer;
+    if (!_streamer.lock(streamer))
+        return;
+
+    osg::State& state = *ri.getState();
+    unsigned contextID = state.getContextID();
+    unsigned frame = state.getFrameStamp() ? state.getFrameStamp()->getFrameNumber() : 0u;
+
+    // Prefer the compile context when the application has made one, so
+    // the uploads stay off the draw thread entirely:
+    osg::GraphicsContext* cc = osg::GraphicsContext::getCompileContext(contextID);
+    if (cc && cc->getGraphicsThread())
+    {
+        {
+            Threading::ScopedMutexLock lock(streamer->_queueMutex);
+            PerContext& pc = streamer->_pcs[contextID];
+            if (pc._scheduled)
+                return;
+            pc._scheduled = true;
+        }
+        cc->getGraphicsThread()->add(new UploadOperation(streamer.get(), frame));
+    }
+    else
+    {
+        streamer->upload(state, frame);
+    }
+}
+
+//........................................................................
+
+TextureStreamer::PerContext::PerContext() :
+_pbo(0u),
+_mapped(0L),
+_size(0),
+_head(0),
+_frameBegin(-1),
+_lastFrame(~0u),
+_scheduled(false),
+_initialized(-1),
+glBufferStorage(0L),
+glMapBufferRange(0L),
+glFenceSync(0L),
+glClientWaitSync(0L),
+glDeleteSync(0L)
+{
+    //nop
+}
+
+bool
+TextureStreamer::PerContext::init(osg::State& state)
+{
+    if (_initialized < 0)
+    {
+        osg::setGLExtensionFuncPtr(glFenceSync, "glFenceSync", "glFenceSyncARB");
+        osg::setGLExtensionFuncPtr(glClientWaitSync, "glClientWaitSync", "glClientWaitSyncARB");
+        osg::setGLExtensionFuncPtr(glDeleteSync, "glDeleteSync", "glDeleteSyncARB");
+        osg::setGLExtensionFuncPtr(glBufferStorage, "glBufferStorage", "glBufferStorageARB");
+        osg::setGLExtensionFuncPtr(glMapBufferRange, "glMapBufferRange", "glMapBufferRangeARB");
+
+        _initialized = glFenceSync && glClientWaitSync && glDeleteSync ? 1 : 0;
+
+        if (_initialized == 0)
+        {
+            OE_WARN << LC << "Fence syncs not available; tile textures will upload when first drawn" << std::endl;
+        }
+    }
+    return _initialized == 1;
+}
+
+void
+TextureStreamer::PerContext::release(osg::State& state)
+{
+    if (_pbo != 0u)
+    {
+        // deleting the buffer also unmaps it
+        state.get<osg::GLExtensions>()->glDeleteBuffers(1, &_pbo);
+        _pbo = 0u;
+        _mapped = 0L;
+    }
+
+    _size = 0;
+    _head = 0;
+    _current = 0L;
+}
+
+//........................................................................
+
+TextureStreamer::TextureStreamer(unsigned bytesPerFrame) :
+_bytesPerFrame(osg::maximum(bytesPerFrame, 1u))
+{
+    _drawable = new UploadDrawable(this);
+
+    // First thing in the render stage, ahead of the terrain:
+    _drawableStateSet = new osg::StateSet();
+    _drawableStateSet->setRenderBinDetails(INT_MIN, "RenderBin");
+    _drawableStateSet->setNestRenderBins(false);
+}
+
+TextureStreamer::~TextureStreamer()
+{
+    //nop
+}
+
+TextureStreamer::Ticket*
+TextureStreamer::stream(const Textures& textures)
+{
+    Ticket* ticket = new Ticket();
+    for (Textures::const_iterator i = textures.begin(); i != textures.end(); ++i)
+    {
+        if (i->valid())
+            ticket->_textures.push_back(i->get());
+    }
+
+    ticket->_remaining = ticket->_textures.size();
+
+    if (ticket->_textures.empty())
+    {
+        ticket->_ready = true;
+    }
+    else
+    {
+        Threading::ScopedMutexLock lock(_queueMutex);
+        _queue.push_back(ticket);
+    }
+
+    return ticket;
+}
+
+void
+TextureStreamer::cull(osgUtil::CullVisitor* cv)
+{
+    cv->pushStateSet(_drawableStateSet.get());
+    cv->addDrawable(_drawable.get(), cv->getModelViewMatrix());
+    cv->popStateSet();
+}
+
+void
+TextureStreamer::upload(osg::State& state, unsigned frame)
+{
+    PerContext& pc = _pcs[state.getContextID()];
+    if (!pc.init(state))
+    {
+        // No fences, so nothing can be tracked; release everything and
+        // let OSG upload the textures the usual way.
+        Threading::ScopedMutexLock lock(_queueMutex);
+        for (std::deque<osg::ref_ptr<Ticket> >::iterator i = _queue.begin(); i != _queue.end(); ++i)
+            i->get()->_ready = true;
+        _queue.clear();
+        return;
+    }
+
+    // Once per frame, even with several cameras:
+    if (pc._lastFrame == frame)
+        return;
+    pc._lastFrame = frame;
+
+    retire(pc, false);
+
+    osg::GLExtensions* ext = state.get<osg::GLExtensions>();
+
+    // Make the ring the first time through. Without persistent mapping
+    // the textures still upload under the budget, just without the ring.
+    if (pc._pbo == 0u && pc.glBufferStorage && pc.glMapBufferRange)
+    {
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        pc._size = (GLsizeiptr)_bytesPerFrame * RING_FRAMES;
+        ext->glGenBuffers(1, &pc._pbo);
+        ext->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pc._pbo);
+        pc.glBufferStorage(GL_PIXEL_UNPACK_BUFFER, pc._size, NULL, flags);
+        pc._mapped = static_cast<unsigned char*>(pc.glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, pc._size, flags));
+        ext->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+        if (pc._mapped == 0L)
+        {
+            OE_WARN << LC << "Failed to map a " << (pc._size >> 10) << "KB pixel buffer ring; uploading directly" << std::endl;
+            ext->glDeleteBuffers(1, &pc._pbo);
+            pc._pbo = 0u;
+            pc.glMapBufferRange = 0L;
+        }
+    }
+
+    // OSG tracks the bound pixel buffer, so tell it we're taking over:
+    state.unbindPixelBufferObject();
+
+    Batch batch;
+    batch._fence = 0L;
+    pc._frameBegin = -1;
+
+    unsigned bytes = 0u;
+    while (bytes < _bytesPerFrame)
+    {
+        if (!pc._current.valid())
+        {
+            Threading::ScopedMutexLock lock(_queueMutex);
+            while (!_queue.empty() && !pc._current.valid())
+            {
+                pc._current = _queue.front();
+                _queue.pop_front();
+
+                // a ticket nobody is waiting on any more
+                if (pc._current->referenceCount() == 1)
+                    pc._current = 0L;
+            }
+            if (!pc._current.valid())
+                break;
+        }
+
+        Ticket* ticket = pc._current.get();
+        int size = upload(ticket->_textures[ticket->_next].get(), state, pc);
+        if (size < 0)
+            break; // ring is full until a fence signals
+
+        bytes += size;
+        batch._tickets.push_back(ticket);
+
+        if (++ticket->_next == ticket->_textures.size())
+            pc._current = 0L;
+    }
+
+    if (!batch._tickets.empty())
+    {
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        // We bypassed OSG's texture state, so force it to re-apply next time.
+        state.haveAppliedTextureAttribute(state.getActiveTextureUnit(), osg::StateAttribute::TEXTURE);
+
+        batch._begin = pc._frameBegin >= 0 ? pc._frameBegin : pc._head;
+        batch._end = pc._head;
+        batch._fence = pc.glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        pc._batches.push_back(batch);
+    }
+}
+
+int
+TextureStreamer::upload(osg::Texture* texture, osg::State& state, PerContext& pc)
+{
+    unsigned contextID = state.getContextID();
+
+    osg::Texture2D* tex2d = dynamic_cast<osg::Texture2D*>(texture);
+    osg::Image* image = tex2d ? tex2d->getImage() : 0L;
+
+    // already there (a shared texture, say)
+    if (texture->getTextureObject(contextID) && !texture->isDirty(contextID))
+        return 0;
+
+    // Only plain 2D images go through the ring; anything else uploads
+    // the usual way, still within the budget and behind the fence.
+    if (pc._mapped == 0L || image == 0L || image->data() == 0L ||
+        !image->isDataContiguous() || image->requiresUpdateCall() ||
+        (GLsizeiptr)image->getTotalSizeInBytesIncludingMipmaps() + RING_ALIGNMENT > pc._size)
+    {
+        texture->apply(state);
+        state.haveAppliedTextureAttribute(state.getActiveTextureUnit(), texture);
+        return image ? image->getTotalSizeInBytesIncludingMipmaps() : 0;
+    }
+
+    GLsizeiptr size = image->getTotalSizeInBytesIncludingMipmaps();
+    GLintptr offset = allocate(size, pc);
+    if (offset < 0)
+        return -1;
+
+    memcpy(pc._mapped + offset, image->data(), size);
+
+    osg::GLExtensions* ext = state.get<osg::GLExtensions>();
+    ext->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pc._pbo);
+
+    GLenum internalFormat = tex2d->getInternalFormat();
+    GLsizei width = image->s(), height = image->t();
+    GLint imageLevels = image->getNumMipmapLevels();
+    bool generate = imageLevels == 1 && usesMipmaps(tex2d) && ext->glGenerateMipmap != 0L;
+    GLint levels = generate ? fullMipmapLevels(width, height) : imageLevels;
+    bool compressed = osg::Texture::isCompressedInternalFormat(internalFormat);
+
+    osg::Texture::TextureObject* to = tex2d->generateAndAssignTextureObject(
+        contextID, GL_TEXTURE_2D, levels, internalFormat, width, height, 1, 0);
+
+    // a recycled texture object may already have (immutable) storage
+    bool allocated = to->isAllocated();
+
+    glBindTexture(GL_TEXTURE_2D, to->id());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, image->getPacking());
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, image->getRowLength());
+
+    for (GLint level = 0; level < imageLevels; ++level)
+    {
+        GLsizei w = osg::maximum(width >> level, 1);
+        GLsizei h = osg::maximum(height >> level, 1);
+        GLintptr levelOffset = offset + image->getMipmapOffset(level);
+        const GLvoid* ptr = reinterpret_cast<const GLvoid*>(levelOffset);
+
+        if (compressed)
+        {
+            GLsizei levelSize = (level + 1 < imageLevels ?
+                image->getMipmapOffset(level + 1) :
+                image->getTotalSizeInBytesIncludingMipmaps()) - image->getMipmapOffset(level);
+
+            if (allocated)
+                ext->glCompressedTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, w, h, internalFormat, levelSize, ptr);
+            else
+                ext->glCompressedTexImage2D(GL_TEXTURE_2D, level, internalFormat, w, h, 0, levelSize, ptr);
+        }
+        else
+        {
+            if (allocated)
+                glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, w, h, image->getPixelFormat(), image->getDataType(), ptr);
+            else
+                glTexImage2D(GL_TEXTURE_2D, level, internalFormat, w, h, 0, image->getPixelFormat(), image->getDataType(), ptr);
+        }
+    }
+
+    if (generate)
+    {
+        ext->glGenerateMipmap(GL_TEXTURE_2D);
+    }
+
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    ext->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    to->setAllocated(levels, internalFormat, width, height, 1, 0);
+
+    // Tell OSG the texture is current so its apply() just binds it:
+    tex2d->setTextureSize(width, height);
+    tex2d->dirtyTextureParameters();
+    tex2d->getModifiedCount(contextID) = image->getModifiedCount();
+
+    // The ring has a copy now, so the image can go if OSG would drop it too:
+    if (tex2d->getUnRefImageDataAfterApply() &&
+        tex2d->areAllTextureObjectsLoaded() &&
+        image->getDataVariance() == osg::Object::STATIC)
+    {
+        tex2d->setImage(0L);
+    }
+
+    return size;
+}
+
+GLintptr
+TextureStreamer::allocate(GLsizeiptr size, PerContext& pc) const
+{
+    GLsizeiptr aligned = ((size + RING_ALIGNMENT - 1) / RING_ALIGNMENT) * RING_ALIGNMENT;
+
+    // Start of the oldest data the GPU may still be reading. The ring is
+    // in use from there up to the head, wrapping around the end.
+    GLintptr tail = !pc._batches.empty() ? pc._batches.front()._begin : pc._frameBegin;
+    GLintptr offset = -1;
+
+    if (tail < 0)
+    {
+        offset = pc._head + aligned <= pc._size ? pc._head : 0;
+    }
+    else if (pc._head > tail)
+    {
+        if (pc._head + aligned <= pc._size)
+            offset = pc._head;
+        else if (aligned < tail)
+            offset = 0;
+    }
+    else if (pc._head + aligned < tail)
+    {
+        offset = pc._head;
+    }
+
+    if (offset >= 0)
+    {
+        if (pc._frameBegin < 0)
+            pc._frameBegin = offset;
+        pc._head = offset + aligned;
+    }
+
+    return offset;
+}
+
+void
+TextureStreamer::retire(PerContext& pc, bool all) const
+{
+    while (!pc._batches.empty())
+    {
+        Batch& batch = pc._batches.front();
+
+        if (!all)
+        {
+            GLenum status = pc.glClientWaitSync(batch._fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+            if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+                break;
+        }
+
+        pc.glDeleteSync(batch._fence);
+
+        for (std::vector<osg::ref_ptr<Ticket> >::iterator i = batch._tickets.begin(); i != batch._tickets.end(); ++i)
+        {
+            Ticket* ticket = i->get();
+            if (--ticket->_remaining == 0u)
+                ticket->_ready = true;
+        }
+
+        pc._batches.pop_front();
+    }
+}
+
+void
+TextureStreamer::releaseGLObjects(osg::State* state) const
+{
+    if (state)
+    {
+        PerContext& pc = _pcs[state->getContextID()];
+        if (pc._initialized == 1)
+        {
+            // hand over anything in flight as done; the textures are
+            // going away with the context anyway
+            retire(pc, true);
+            pc.release(*state);
+        }
+    }
+    else
+    {
+        // no context current; just forget the objects
+        for (unsigned i = 0; i < _pcs.size(); ++i)
+        {
+            _pcs[i]._batches.clear();
+            _pcs[i]._pbo = 0u;
+            _pcs[i]._mapped = 0L;
+            _pcs[i]._size = 0;
+            _pcs[i]._head = 0;
+            _pcs[i]._current = 0L;
+        }
+    }
+}
@@ -32,6 +32,9 @@
 #include <osgEarth/Utils>
 #include <osgEarth/NodeUtils>
 #include <osgEarth/Metrics>
+#include <osgEarth/Registry>
+
+#include <osg/Texture2D>
 
 using namespace osgEarth::REX;
 using namespace osgEarth;
@@ -45,8 +48,56 @@ using namespace osgEarth::Util;
 
 #define LC "[TileNode] "
 
+// Resolution of the per-tile textures used to cut out masks
+#define MASK_TEXTURE_SIZE 256
+
 namespace
 {
+    // Adds the memory used by a texture's images to the running totals.
+    void accumulateTextureFootprint(const osg::Texture* tex, unsigned& cpuBytes, unsigned& gpuBytes)
+    {
+        bool mipmapped =
+            tex->getFilter(osg::Texture::MIN_FILTER) != osg::Texture::LINEAR &&
+            tex->getFilter(osg::Texture::MIN_FILTER) != osg::Texture::NEAREST;
+
+        // after a GL apply with unref-after-apply only the texture dimensions remain
+        const osg::Texture2D* tex2d = dynamic_cast<const osg::Texture2D*>(tex);
+        if (tex2d && tex2d->getImage() == 0L && tex2d->getTextureWidth() > 0)
+        {
+            unsigned bits = osg::Image::computePixelSizeInBits(tex->getInternalFormat(), GL_UNSIGNED_BYTE);
+            unsigned bytes = tex2d->getTextureWidth() * tex2d->getTextureHeight() * bits / 8u;
+            gpuBytes += mipmapped ? bytes + bytes/3u : bytes;
+            return;
+        }
+
+        for (unsigned i = 0; i < tex->getNumImages(); ++i)
+        {
+            const osg::Image* image = tex->getImage(i);
+            if (image == 0L)
+                continue;
+
+            unsigned bytes = image->getTotalSizeInBytesIncludingMipmaps();
+
+            // image data may be gone after the GL apply
+            if (image->data())
+                cpuBytes += bytes;
+
+            // float images stored as half-floats (e.g. elevation) take half the space
+            GLint format = tex->getInternalFormat();
+            if (image->getDataType() == GL_FLOAT &&
+                (format == GL_R16F || format == GL_RG16F || format == GL_RGB16F_ARB || format == GL_RGBA16F_ARB))
+            {
+                bytes /= 2u;
+            }
+
+            // the driver generates mipmaps for images that don't carry them
+            if (mipmapped && !image->isMipmap())
+                bytes += bytes / 3u;
+
+            gpuBytes += bytes;
+        }
+    }
+
     // Scale and bias matrices, one for each TileKey quadrant.
     const osg::Matrixf scaleBias[4] =
     {
@@ -66,6 +117,10 @@ _empty(false),              // an "empty" node exists but has no geometry or chi
 _imageUpdatesActive(false),
 _doNotExpire(false),
 _revision(0u),
+_decalSerial(0u),
+_decalsRevision(0u),
+_decalsSerial(0u),
+_decalsMutex("TileNode Decals(OE)"),
 _mutex("TileNode(OE)"),
 _loadQueue("TileNode LoadQueue(OE)")
 {
@@ -104,12 +159,41 @@ TileNode::create(const TileKey& key, TileNode* parent, EngineContext* context)
     // Mask generator creates geometry from masking boundaries when they exist.
     osg::ref_ptr<MaskGenerator> masks = new MaskGenerator(key, tileSize, map.get());
 
+    // Or, when the engine cuts masks out in the shader, a mask texture; then
+    // masked tiles can share the pooled geometry like all the others.
+    bool maskWithTexture = context->getEmptyMaskTexture() != 0L;
+    osg::ref_ptr<osg::Texture> maskTexture;
+    if (maskWithTexture && masks->hasMasks())
+    {
+        osg::ref_ptr<osg::Image> maskImage;
+        MaskGenerator::Result r = masks->createMaskImage(MASK_TEXTURE_SIZE, maskImage);
+
+        if (r == MaskGenerator::R_BOUNDARY_CONTAINS_ENTIRE_TILE)
+        {
+            OE_DEBUG << LC << "Tile " << _key.str() << " is empty.\n";
+            _empty = true;
+            return;
+        }
+
+        if (r == MaskGenerator::R_BOUNDARY_INTERSECTS_TILE)
+        {
+            maskTexture = new osg::Texture2D(maskImage.get());
+            maskTexture->setName(key.str() + ":mask");
+            maskTexture->setFilter(osg::Texture::MIN_FILTER, osg::Texture::LINEAR);
+            maskTexture->setFilter(osg::Texture::MAG_FILTER, osg::Texture::LINEAR);
+            maskTexture->setWrap(osg::Texture::WRAP_S, osg::Texture::CLAMP_TO_EDGE);
+            maskTexture->setWrap(osg::Texture::WRAP_T, osg::Texture::CLAMP_TO_EDGE);
+            maskTexture->setResizeNonPowerOfTwoHint(false);
+            maskTexture->setUnRefImageDataAfterApply(Registry::instance()->unRefImageDataAfterApply().get());
+        }
+    }
+
     // Get a shared geometry from the pool that corresponds to this tile key:
     osg::ref_ptr<SharedGeometry> geom;
     context->getGeometryPool()->getPooledGeometry(
         key,
         tileSize,
-        masks.get(), 
+        maskWithTexture ? 0L : masks.get(), 
         geom);
 
     // If we donget an empty, that most likely means the tile was completely
@@ -171,6 +255,8 @@ TileNode::create(const TileKey& key, TileNode* parent, EngineContext* context)
 
         const RenderBindings& bindings = context->getRenderBindings();
 
+        _renderModel._passes.reserve(parent->_renderModel._passes.size());
+
         for (unsigned p = 0; p < parent->_renderModel._passes.size(); ++p)
         {
             const RenderingPass& parentPass = parent->_renderModel._passes[p];
@@ -184,7 +270,7 @@ TileNode::create(const TileKey& key, TileNode* parent, EngineContext* context)
             RenderingPass& myPass = _renderModel._passes.back();
 
             // Scale/bias each matrix for this key quadrant.
-            Samplers& samplers = myPass.samplers();
+            ColorSamplers& samplers = myPass.samplers();
             for (unsigned s = 0; s < samplers.size(); ++s)
             {
                 samplers[s]._matrix.preMult(scaleBias[quadrant]);
@@ -200,6 +286,7 @@ TileNode::create(const TileKey& key, TileNode* parent, EngineContext* context)
 
         // Copy the parent's shared samplers and scale+bias each matrix to the new quadrant:
         _renderModel._sharedSamplers = parent->_renderModel._sharedSamplers;
+        _decalSerial = parent->_decalSerial;
 
         for (unsigned s = 0; s<_renderModel._sharedSamplers.size(); ++s)
         {
@@ -220,17 +307,63 @@ TileNode::create(const TileKey& key, TileNode* parent, EngineContext* context)
         }
     }
 
+    // A tile's own mask overrides the inherited one. Root tiles start off
+    // with an empty mask that their descendants inherit.
+    if (maskTexture.valid())
+    {
+        _renderModel.setSharedSampler(SamplerBinding::MASK, maskTexture.get(), 0);
+    }
+    else if (maskWithTexture && !parent)
+    {
+        _renderModel.setSharedSampler(SamplerBinding::MASK, context->getEmptyMaskTexture(), 0);
+    }
+
     // register me.
     context->liveTiles()->add( this );
 
     // signal the tile to start loading data:
-    refreshAllLayers();
+    queueLoad(CreateTileManifest(), false);
 
     // tell the world.
     OE_DEBUG << LC << "notify (create) key " << getKey().str() << std::endl;
     context->getEngine()->getTerrain()->notifyTileUpdate(getKey(), this);
 }
 
+void
+TileNode::getMemoryFootprint(unsigned& cpuBytes, unsigned& gpuBytes) const
+{
+    cpuBytes = 0u, gpuBytes = 0u;
+
+    for (unsigned p = 0; p < _renderModel._passes.size(); ++p)
+    {
+        const ColorSamplers& samplers = _renderModel._passes[p].samplers();
+        for (unsigned s = 0; s < samplers.size(); ++s)
+        {
+            if (samplers[s].ownsTexture())
+                accumulateTextureFootprint(samplers[s]._texture.get(), cpuBytes, gpuBytes);
+        }
+    }
+
+    for (unsigned s = 0; s < _renderModel._sharedSamplers.size(); ++s)
+    {
+        const Sampler& sampler = _renderModel._sharedSamplers[s];
+        if (sampler.ownsTexture())
+            accumulateTextureFootprint(sampler._texture.get(), cpuBytes, gpuBytes);
+    }
+
+    // Pooled geometry belongs to the pool, which is bounded by LOD and latitude,
+    // so we only charge the tile when it has a geometry all to itself.
+    if (_surface.valid() &&
+        _surface->getDrawable() &&
+        _surface->getDrawable()->_geom.valid() &&
+        _context->getGeometryPool()->isEnabled() == false)
+    {
+        unsigned bytes = _surface->getDrawable()->_geom->getTotalDataSize();
+        cpuBytes += bytes;
+        gpuBytes += bytes;
+    }
+}
+
 osg::BoundingSphere
 TileNode::computeBound() const
 {
@@ -244,6 +377,34 @@ TileNode::computeBound() const
     return bs;
 }
 
+osg::ref_ptr<const DecalAtlas::TileDecals>
+TileNode::getDecals(const DecalAtlas* atlas)
+{
+    // nothing to do until the first decal comes along
+    unsigned revision = atlas->getRevision();
+    if (revision == 0u)
+        return NULL;
+
+    Threading::ScopedMutexLock lock(_decalsMutex);
+
+    if (revision != _decalsRevision || _decalSerial != _decalsSerial)
+    {
+        _decals = atlas->getTileDecals(_key.getExtent(), _decalSerial);
+        _decalsRevision = revision;
+        _decalsSerial = _decalSerial;
+
+        osg::ref_ptr<const Layer> overflow;
+        if (_decals.valid() && _decals->_overflow.lock(overflow))
+        {
+            CreateTileManifest manifest;
+            manifest.insert(overflow.get());
+            refreshLayers(manifest);
+        }
+    }
+
+    return _decals.get();
+}
+
 bool
 TileNode::isDormant() const
 {
@@ -307,16 +468,30 @@ TileNode::refreshAllLayers()
 void
 TileNode::refreshLayers(const CreateTileManifest& manifest)
 {
-    LoadTileData* r = new LoadTileData(manifest, this, _context.get());
-    r->setName(_key.str());
-    r->setTileKey(_key);
-
-    // if the set is empty, the load job will refresh ALL data
-    //for (std::set<UID>::const_iterator i = layers.begin(); i != layers.end(); ++i)
-    //    r->addLayerToFilter(*i);
+    queueLoad(manifest, true);
+}
 
+void
+TileNode::queueLoad(const CreateTileManifest& manifest, bool refresh)
+{
     _loadQueue.lock();
-    _loadQueue.push(r);
+
+    // Only the front of the queue is ever submitted to the loader, so a
+    // refresh waiting behind it is still untouched; fold this one into it
+    // so that repeated invalidations between loads cost a single reload.
+    if (refresh && _loadQueue.size() > 1u && _loadQueue.back()->isRefresh())
+    {
+        _loadQueue.back()->addToManifest(manifest);
+    }
+    else
+    {
+        LoadTileData* r = new LoadTileData(manifest, this, _context.get());
+        r->setName(_key.str());
+        r->setTileKey(_key);
+        r->setRefresh(refresh);
+        _loadQueue.push(r);
+    }
+
     _loadsInQueue = _loadQueue.size();
     _loadQueue.unlock();
 }
@@ -449,6 +624,9 @@ TileNode::cull(TerrainCuller* culler)
     // whether to accept the current surface node and not the children.
     bool canAcceptSurface = false;
 
+    // whether it is OK to prefetch children near the predicted viewpoint.
+    bool canPrefetch = culler->_prefetch;
+
     // If this is an inherit-viewpoint camera, we don't need it to invoke subdivision
     // because we want only the tiles loaded by the true viewpoint.
     const osg::Camera* cam = culler->getCamera();
@@ -456,6 +634,7 @@ TileNode::cull(TerrainCuller* culler)
     {
         canCreateChildren = false;
         canLoadData = false;
+        canPrefetch = false;
     }
     
     else
@@ -472,6 +651,7 @@ TileNode::cull(TerrainCuller* culler)
                 // this will allow the terrain to always show the higest tessellation level
                 // even as the data is still loading ..
                 canCreateChildren = false;
+                canPrefetch = false;
             }
         }
     }    
@@ -498,14 +678,22 @@ TileNode::cull(TerrainCuller* culler)
             _mutex.unlock();
         }
 
-        // If all are ready, traverse them now.
+        // If all are ready, traverse them now (or queue them for parallel culling
+        // once we are deep enough into the tree).
         if ( _childrenReady )
         {
+            bool queue = culler->_parallelLOD > 0u && _key.getLOD() + 1u >= culler->_parallelLOD;
+
             for(int i=0; i<4; ++i)
             {
                 TileNode* child = getSubTile(i);
                 if (child)
-                    child->accept(*culler);
+                {
+                    if (queue)
+                        culler->_parallelTiles.push_back(child);
+                    else
+                        child->accept(*culler);
+                }
             }
         }
 
@@ -516,10 +704,16 @@ TileNode::cull(TerrainCuller* culler)
         }
     }
 
-    // If children are outside camera range, draw the payload and expire the children.
+    // If children are outside camera range, draw the payload and expire the children
+    // (unless the camera is headed their way).
     else
     {
         canAcceptSurface = true;
+
+        if (canPrefetch)
+        {
+            prefetch(culler);
+        }
     }
 
     // accept this surface if necessary.
@@ -607,7 +801,7 @@ TileNode::traverse(osg::NodeVisitor& nv)
             for (unsigned p = 0; p < _renderModel._passes.size(); ++p)
             {
                 RenderingPass& pass = _renderModel._passes[p];
-                Samplers& samplers = pass.samplers();
+                ColorSamplers& samplers = pass.samplers();
                 for (unsigned s = 0; s < samplers.size(); ++s)
                 {
                     Sampler& sampler = samplers[s];
@@ -803,6 +997,9 @@ TileNode::merge(const TerrainTileModel* model, LoadTileData* request)
 
             _renderModel.setSharedSampler(SamplerBinding::ELEVATION, tex, revision);
 
+            // decals up to this one are in the new data
+            _decalSerial = request->getDecalSerial();
+
             //setElevationRaster(tex->getImage(0), osg::Matrixf::identity());
             updateElevationRaster();
 
@@ -971,6 +1168,9 @@ TileNode::merge(const TerrainTileModel* model, LoadTileData* request)
 
     // Bump the data revision for the tile.
     ++_revision;
+
+    // Account for the memory of the new data.
+    _context->liveTiles()->updateFootprint(this);
 }
 
 void TileNode::inheritSharedSampler(int binding)
@@ -983,10 +1183,16 @@ void TileNode::inheritSharedSampler(int binding)
         mySampler = parentModel._sharedSamplers[binding];
         if (mySampler._texture.valid())
             mySampler._matrix.preMult(scaleBias[_key.getQuadrant()]);
+
+        if (binding == SamplerBinding::ELEVATION)
+            _decalSerial = parent->_decalSerial;
     }
     else
     {
         _renderModel.clearSharedSampler(binding);
+
+        if (binding == SamplerBinding::ELEVATION)
+            _decalSerial = 0u;
     }
 
     // Bump the data revision for the tile.
@@ -1149,6 +1355,8 @@ TileNode::refreshInheritedData(TileNode* parent, const RenderBindings& bindings)
             // Update the local elevation raster cache (for culling and intersection testing).
             if (binding == SamplerBinding::ELEVATION)
             {
+                _decalSerial = parent->_decalSerial;
+
                 //osg::Image* raster = mySampler._texture.valid() ? mySampler._texture->getImage(0) : NULL;
                 //this->setElevationRaster(raster, mySampler._matrix);
                 updateElevationRaster();
@@ -1214,11 +1422,89 @@ TileNode::load(TerrainCuller* culler)
     if (_loadQueue.empty() == false)
     {
         LoadTileData* r = _loadQueue.front().get();
+
+        // A visible tile replacing stale data (e.g. a live elevation edit)
+        // goes ahead of all first-time loads so the update shows promptly.
+        if (r->isRefresh())
+            priority += (float)numLods + 1.0f;
+
         _context->getLoader()->load(r, priority, *culler);
     }
     _loadQueue.unlock(); // unlock the load queue
 }
 
+void
+TileNode::prefetch(TerrainCuller* culler)
+{
+    // Wait for this tile's own data so children have something to inherit.
+    if (dirty())
+        return;
+
+    const SelectionInfo& si = _context->getSelectionInfo();
+    unsigned lod = _key.getLOD();
+    unsigned numLods = si.getNumLODs();
+
+    if (lod >= numLods || lod == numLods-1)
+        return;
+
+    // Would we subdivide if the camera were at its predicted location?
+    float range = si.getRange(_subdivideTestKey) / culler->getLODScale();
+    if (!_surface->anyChildBoxIntersectsSphere(culler->_prefetchEyeLocal, range*range))
+        return;
+
+    if (!_childrenReady)
+    {
+        _mutex.lock();
+
+        if (!_childrenReady) // double check inside mutex
+        {
+            createChildren(_context.get());
+            _childrenReady = true;
+        }
+
+        _mutex.unlock();
+
+        // Like cull(), wait a frame before loading the new children.
+        return;
+    }
+
+    unsigned frame = _context->getClock()->getFrame();
+    double now = _context->getClock()->getTime();
+    float maxRange = si.getLOD(0)._visibilityRange;
+
+    for (int i = 0; i < 4; ++i)
+    {
+        TileNode* child = getSubTile(i);
+        if (child == 0L)
+            continue;
+
+        // Keep the child from going dormant while we still expect to need it.
+        child->_lastTraversalFrame.exchange(frame);
+        child->_lastTraversalTime = now;
+
+        if (child->dirty())
+        {
+            // Same scheme as load(), but measured from the predicted viewpoint and
+            // pushed below every request for a tile that's visible right now.
+            float distance = (child->getBound().center() - culler->_prefetchEyeLocal).length() * culler->getLODScale();
+            float distPriority = 1.0 - distance/maxRange;
+            float priority = (float)child->getKey().getLOD() + distPriority - (float)(numLods+1);
+
+            child->_loadQueue.lock();
+            if (child->_loadQueue.empty() == false)
+            {
+                LoadTileData* r = child->_loadQueue.front().get();
+                _context->getLoader()->load(r, priority, *culler);
+            }
+            child->_loadQueue.unlock();
+        }
+        else
+        {
+            child->prefetch(culler);
+        }
+    }
+}
+
 void
 TileNode::loadSync()
 {
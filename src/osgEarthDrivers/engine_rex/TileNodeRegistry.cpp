@@ -20,6 +20,8 @@
 
 #include <osgEarth/Metrics>
 
+#include <algorithm>
+
 using namespace osgEarth::REX;
 using namespace osgEarth;
 
@@ -28,7 +30,11 @@ using namespace osgEarth;
 #define OE_TEST OE_NULL
 //#define OE_TEST OE_INFO
 
-#define SENTRY_VALUE NULL
+// The LRU list is circular through the HEAD slot. Cull moves the tiles
+// it visits to the front, ahead of the SENTRY slot.
+#define HEAD   0u
+#define SENTRY 1u
+#define NO_SLOT (~0u)
 
 #define PROFILING_REX_TILES "Live Terrain Tiles"
 
@@ -39,10 +45,14 @@ _name              ( name ),
 _revisioningEnabled( false ),
 _notifyNeighbors   ( false ),
 _firstLOD          ( 0u ),
-_mutex("TileNodeRegistry(OE)")
+_freeSlots         ( NO_SLOT ),
+_mutex("TileNodeRegistry(OE)"),
+_totalCPUBytes     ( 0u ),
+_totalGPUBytes     ( 0u )
 {
-    _tracker.push_front(SENTRY_VALUE);
-    _sentryptr = _tracker.begin();
+    _slots.resize(2);
+    _slots[HEAD]._prev = _slots[HEAD]._next = SENTRY;
+    _slots[SENTRY]._prev = _slots[SENTRY]._next = HEAD;
 }
 
 TileNodeRegistry::~TileNodeRegistry()
@@ -76,11 +86,12 @@ TileNodeRegistry::setMapRevision(const Revision& rev,
             {
                 _maprev = rev;
 
-                for( TileTable::iterator i = _tiles.begin(); i != _tiles.end(); ++i )
+                if ( setToDirty )
                 {
-                    if ( setToDirty )
+                    for (std::vector<Slot>::iterator i = _slots.begin(); i != _slots.end(); ++i)
                     {
-                        i->second._tile->refreshAllLayers();
+                        if (i->_tile.valid())
+                            i->_tile->refreshAllLayers();
                     }
                 }
             }
@@ -98,21 +109,55 @@ TileNodeRegistry::setDirty(const GeoExtent& extent,
 {
     _mutex.lock();
     
-    for( TileTable::iterator i = _tiles.begin(); i != _tiles.end(); ++i )
+    for (std::vector<Slot>::iterator i = _slots.begin(); i != _slots.end(); ++i)
     {
-        const TileKey& key = i->first;
+        if (!i->_tile.valid())
+            continue;
+
+        const TileKey& key = i->_tile->getKey();
 
         if (minLevel <= key.getLOD() && 
             maxLevel >= key.getLOD() &&
             (extent.isInvalid() || extent.intersects(key.getExtent())))
         {
-            i->second._tile->refreshLayers(manifest);
+            i->_tile->refreshLayers(manifest);
         }
     }
 
     _mutex.unlock();
 }
 
+TileNodeRegistry::Slot*
+TileNodeRegistry::find(const PackedTileKey& key)
+{
+    // ASSUME EXCLUSIVE LOCK
+
+    UnorderedMap<PackedTileKey, unsigned>::const_iterator i = _index.find(key);
+    return i != _index.end() ? &_slots[i->second] : 0L;
+}
+
+void
+TileNodeRegistry::unlink(unsigned slot)
+{
+    // ASSUME EXCLUSIVE LOCK
+
+    Slot& s = _slots[slot];
+    _slots[s._prev]._next = s._next;
+    _slots[s._next]._prev = s._prev;
+}
+
+void
+TileNodeRegistry::pushFront(unsigned slot)
+{
+    // ASSUME EXCLUSIVE LOCK
+
+    Slot& s = _slots[slot];
+    s._prev = HEAD;
+    s._next = _slots[HEAD]._next;
+    _slots[s._next]._prev = slot;
+    _slots[HEAD]._next = slot;
+}
+
 void
 TileNodeRegistry::add(TileNode* tile)
 {
@@ -123,73 +168,51 @@ TileNodeRegistry::add(TileNode* tile)
     // the registry records for its descendants, but the orphaned record has
     // not yet itself been removed by the Unloader. So we have to check!
 
-    bool recyclingOrphan = false;
-    TrackerEntry* se;
-    TableEntry* te;
+    PackedTileKey packedKey = tile->getKey().pack();
 
-    TileTable::iterator i = _tiles.find(tile->getKey());
-    if (i != _tiles.end())
+    unsigned slot;
+    UnorderedMap<PackedTileKey, unsigned>::const_iterator i = _index.find(packedKey);
+    if (i != _index.end())
     {
         // found an orphan! Reuse and overwrite it.
-        recyclingOrphan = true;
-        te = &i->second;
-        se = (*te->_trackerptr);
-        _tracker.erase(te->_trackerptr); // since we need to move it to the front
+        slot = i->second;
+        unlink(slot); // since we need to move it to the front
+        _totalCPUBytes -= _slots[slot]._cpuBytes;
+        _totalGPUBytes -= _slots[slot]._gpuBytes;
         OE_DEBUG << "Reused orphaned tile record " << tile->getKey().str() << std::endl;
     }
+    else if (_freeSlots != NO_SLOT)
+    {
+        slot = _freeSlots;
+        _freeSlots = _slots[slot]._next;
+        _index[packedKey] = slot;
+    }
     else
     {
-        te = &_tiles[tile->getKey()];
-        se = new TrackerEntry();
+        slot = _slots.size();
+        _slots.push_back(Slot());
+        _index[packedKey] = slot;
     }
 
-    // init the tracker entry and place it at the front of the tracker:
-    se->_tile = tile;
-    se->_lastTime = DBL_MAX;
-    se->_lastFrame = ~0;
-    se->_lastRange = FLT_MAX;
-    _tracker.push_front(se);
-
-    // init the table entry:
-    te->_tile = tile;
-    te->_trackerptr = _tracker.begin();
+    // init the slot and place it at the front of the LRU list:
+    Slot& s = _slots[slot];
+    s._tile = tile;
+    s._lastTime = DBL_MAX;
+    s._lastFrame = ~0;
+    s._lastRange = FLT_MAX;
+    s._visitRange = FLT_MAX;
+    s._waitingFor = 0u;
+    tile->getMemoryFootprint(s._cpuBytes, s._gpuBytes);
+    _totalCPUBytes += s._cpuBytes;
+    _totalGPUBytes += s._gpuBytes;
+    pushFront(slot);
     
-    // Start waiting on our neighbors.
-    // (If we're recycling and orphaned record, we need to remove old listeners first)
     if (_notifyNeighbors)
     {
-        const TileKey& key = tile->getKey();
-
-        // If we're recycling, we need to remove the old listeners first
-        if (recyclingOrphan)
-        {
-            stopListeningFor(key.createNeighborKey(1, 0), key);
-            stopListeningFor(key.createNeighborKey(0, 1), key);
-        }
-
-        startListeningFor(key.createNeighborKey(1, 0), tile);
-        startListeningFor(key.createNeighborKey(0, 1), tile);
-
-        // check for tiles that are waiting on this tile, and notify them!
-        TileKeyOneToMany::iterator notifier = _notifiers.find( tile->getKey() );
-        if ( notifier != _notifiers.end() )
-        {
-            TileKeySet& listeners = notifier->second;
-
-            for(TileKeySet::iterator listener = listeners.begin(); listener != listeners.end(); ++listener)
-            {
-                TileTable::iterator i = _tiles.find( *listener );
-                if ( i != _tiles.end())
-                {
-                    i->second._tile->notifyOfArrival( tile );
-                }
-            }
-            _notifiers.erase( notifier );
-        }
+        meetNeighbors(slot);
 
         OE_DEBUG << LC << _name 
-            << ": tiles=" << _tiles.size()
-            << ", notifiers=" << _notifiers.size()
+            << ": tiles=" << _index.size()
             << std::endl;
     }
 
@@ -197,43 +220,53 @@ TileNodeRegistry::add(TileNode* tile)
 }
 
 void
-TileNodeRegistry::startListeningFor(const TileKey& tileToWaitFor, TileNode* waiter)
+TileNodeRegistry::meetNeighbors(unsigned slot)
 {
     // ASSUME EXCLUSIVE LOCK
 
-    TileTable::iterator i = _tiles.find(tileToWaitFor);
-    if (i != _tiles.end())
-    {
-        TileNode* tile = i->second._tile.get();
+    // A tile waits on its east and south neighbors, so the tiles that might
+    // be waiting on it are its west and north neighbors. Neighbor keys wrap
+    // around the profile, so each direction still checks the inverse.
 
-        OE_DEBUG << LC << waiter->getKey().str() << " listened for " << tileToWaitFor.str()
-            << ", but it was already in the repo.\n";
+    TileNode* tile = _slots[slot]._tile.get();
+    const TileKey& key = tile->getKey();
+    const PackedTileKey packedKey = key.pack();
 
-        waiter->notifyOfArrival( tile );
-    }
+    const PackedTileKey east = key.createNeighborKey(1, 0).pack();
+    const PackedTileKey south = key.createNeighborKey(0, 1).pack();
+
+    // Start waiting on our neighbors, unless they're already here:
+    Slot* neighbor = find(east);
+    if (neighbor)
+        tile->notifyOfArrival(neighbor->_tile.get());
     else
+        _slots[slot]._waitingFor |= NEIGHBOR_EAST;
+
+    neighbor = find(south);
+    if (neighbor)
+        tile->notifyOfArrival(neighbor->_tile.get());
+    else
+        _slots[slot]._waitingFor |= NEIGHBOR_SOUTH;
+
+    // Notify the tiles that are waiting on this tile:
+    TileKey west = key.createNeighborKey(-1, 0);
+    neighbor = find(west.pack());
+    if (neighbor &&
+        (neighbor->_waitingFor & NEIGHBOR_EAST) &&
+        west.createNeighborKey(1, 0).pack() == packedKey)
     {
-        OE_DEBUG << LC << waiter->getKey().str() << " listened for " << tileToWaitFor.str() << ".\n";
-        _notifiers[tileToWaitFor].insert( waiter->getKey() );
+        neighbor->_waitingFor &= ~NEIGHBOR_EAST;
+        neighbor->_tile->notifyOfArrival(tile);
     }
-}
 
-void
-TileNodeRegistry::stopListeningFor(const TileKey& tileToWaitFor, const TileKey& waiterKey)
-{
-    // ASSUME EXCLUSIVE LOCK
-
-    TileKeyOneToMany::iterator i = _notifiers.find(tileToWaitFor);
-    if (i != _notifiers.end())
+    TileKey north = key.createNeighborKey(0, -1);
+    neighbor = find(north.pack());
+    if (neighbor &&
+        (neighbor->_waitingFor & NEIGHBOR_SOUTH) &&
+        north.createNeighborKey(0, 1).pack() == packedKey)
     {
-        // remove the waiter from this set:
-        i->second.erase(waiterKey);
-
-        // if the set is now empty, remove the set entirely
-        if (i->second.empty())
-        {
-            _notifiers.erase(i);
-        }
+        neighbor->_waitingFor &= ~NEIGHBOR_SOUTH;
+        neighbor->_tile->notifyOfArrival(tile);
     }
 }
 
@@ -246,26 +279,24 @@ TileNodeRegistry::releaseAll(ResourceReleaser* releaser)
 
     if (releaser)
     {
-        for (TileTable::iterator i = _tiles.begin(); i != _tiles.end(); ++i)
+        for (std::vector<Slot>::iterator i = _slots.begin(); i != _slots.end(); ++i)
         {
-            objects.push_back(i->second._tile.get());
+            if (i->_tile.valid())
+                objects.push_back(i->_tile.get());
         }
     }
 
-    _tiles.clear();
+    _index.clear();
 
-    for (Tracker::iterator i = _tracker.begin(); i != _tracker.end(); ++i)
-    {
-        TrackerEntry* e = *i;
-        delete e;
-    }
-    _tracker.clear();
-    _tracker.push_front(SENTRY_VALUE);
-    _sentryptr = _tracker.begin();
+    _slots.resize(2);
+    _slots[HEAD]._prev = _slots[HEAD]._next = SENTRY;
+    _slots[SENTRY]._prev = _slots[SENTRY]._next = HEAD;
+    _freeSlots = NO_SLOT;
 
-    _notifiers.clear();
+    _totalCPUBytes = 0u;
+    _totalGPUBytes = 0u;
 
-    OE_PROFILING_PLOT(PROFILING_REX_TILES, (float)(_tiles.size()));
+    OE_PROFILING_PLOT(PROFILING_REX_TILES, (float)(_index.size()));
 
     _mutex.unlock();
 
@@ -280,25 +311,25 @@ TileNodeRegistry::update(TileNode* tile, osg::NodeVisitor& nv)
 {
     _mutex.lock();
 
-    // Find the tracker for this tile and update its timestamp
-    TileTable::iterator i = _tiles.find(tile->getKey());
-    if (i != _tiles.end())
+    // Find the slot for this tile and update its timestamp
+    UnorderedMap<PackedTileKey, unsigned>::const_iterator i = _index.find(tile->getKey().pack());
+    if (i != _index.end())
     {
-        TableEntry& e = i->second;
-        TrackerEntry* se = (*e._trackerptr);
-        se->_lastTime = _clock->getTime();
-        se->_lastFrame = _clock->getFrame();
+        unsigned slot = i->second;
+        Slot& s = _slots[slot];
+        s._lastTime = _clock->getTime();
+        s._lastFrame = _clock->getFrame();
 
         const osg::BoundingSphere& bs = tile->getBound();
         float range = nv.getDistanceToViewPoint(bs.center(), true) - bs.radius();
-        se->_lastRange = osg::minimum(se->_lastRange, range);
+        s._lastRange = osg::minimum(s._lastRange, range);
+        s._visitRange = s._lastRange;
 
-        // Move the tracker to the front of the list (ahead of the sentry).
+        // Move the slot to the front of the list (ahead of the sentry).
         // Once a cull traversal is complete, all visited tiles will be
         // in front of the sentry, leaving all non-visited tiles behind it.
-        _tracker.erase(e._trackerptr);
-        _tracker.push_front(se);
-        e._trackerptr = _tracker.begin();
+        unlink(slot);
+        pushFront(slot);
     }
     else
     {
@@ -324,56 +355,169 @@ TileNodeRegistry::collectDormantTiles(
     // After cull, all visited tiles are in front of the sentry, and all
     // non-visited tiles are behind it. Start at the sentry position and
     // iterate over the non-visited tiles, checking them for deletion.
-    Tracker::iterator i = _sentryptr;
-    Tracker::iterator tmp;
-    for(++i; i != _tracker.end() && count < maxTiles; ++i)
+    for (unsigned slot = _slots[SENTRY]._next; slot != HEAD && count < maxTiles; )
     {
-        TrackerEntry* se = *i;
+        Slot& s = _slots[slot];
+        unsigned next = s._next;
+
+        if (s._tile->getDoNotExpire() == false &&
+            s._lastTime < oldestAllowableTime &&
+            s._lastFrame < oldestAllowableFrame &&
+            s._lastRange > farthestAllowableRange &&
+            s._tile->areSiblingsDormant())
+        {
+            collect(slot, output);
+            ++count;
+        }
+        else
+        {
+            // reset the range in preparation for the next frame.
+            s._lastRange = FLT_MAX;
+        }
 
-        const TileKey& key = se->_tile->getKey();
+        slot = next;
+    }
 
-        if (se->_tile->getDoNotExpire() == false &&
-            se->_lastTime < oldestAllowableTime &&
-            se->_lastFrame < oldestAllowableFrame &&
-            se->_lastRange > farthestAllowableRange &&
-            se->_tile->areSiblingsDormant())
-        {
-            if (_notifyNeighbors)
-            {
-                // remove neighbor listeners:
-                stopListeningFor(key.createNeighborKey(1, 0), key);
-                stopListeningFor(key.createNeighborKey(0, 1), key);
-            }
+    // reset the sentry.
+    unlink(SENTRY);
+    pushFront(SENTRY);
+
+    _mutex.unlock();
+
+    OE_PROFILING_PLOT(PROFILING_REX_TILES, (float)(_index.size()));
+}
+
+unsigned long long
+TileNodeRegistry::getTotalCPUBytes() const
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    return _totalCPUBytes;
+}
+
+unsigned long long
+TileNodeRegistry::getTotalGPUBytes() const
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    return _totalGPUBytes;
+}
+
+void
+TileNodeRegistry::updateFootprint(TileNode* tile)
+{
+    unsigned cpuBytes, gpuBytes;
+    tile->getMemoryFootprint(cpuBytes, gpuBytes);
 
-            // back up the iterator so we can safely erase the tracker entry:
-            tmp = i;
-            --i;
+    _mutex.lock();
 
-            // put the tile on the output list:
-            output.push_back(se->_tile);
+    Slot* s = find(tile->getKey().pack());
+    if (s && s->_tile.get() == tile)
+    {
+        _totalCPUBytes = _totalCPUBytes - s->_cpuBytes + cpuBytes;
+        _totalGPUBytes = _totalGPUBytes - s->_gpuBytes + gpuBytes;
+        s->_cpuBytes = cpuBytes;
+        s->_gpuBytes = gpuBytes;
+    }
 
-            // remove it from the main tile table:
-            _tiles.erase(key);
+    _mutex.unlock();
+}
 
-            // remove it from the tracker list:
-            _tracker.erase(tmp);
-            delete se;
+void
+TileNodeRegistry::collect(unsigned slot, std::vector<osg::observer_ptr<TileNode> >& output)
+{
+    // ASSUME EXCLUSIVE LOCK
 
+    Slot& s = _slots[slot];
+
+    // put the tile on the output list:
+    output.push_back(s._tile.get());
+
+    _totalCPUBytes -= s._cpuBytes;
+    _totalGPUBytes -= s._gpuBytes;
+
+    // remove it from the index and the LRU list, which also drops the
+    // neighbors it was waiting on:
+    _index.erase(s._tile->getKey().pack());
+    unlink(slot);
+
+    // and free the slot:
+    s._tile = 0L;
+    s._waitingFor = 0u;
+    s._next = _freeSlots;
+    _freeSlots = slot;
+}
+
+namespace
+{
+    struct EvictionCandidate
+    {
+        float _score;
+        unsigned _slot;
+        bool operator < (const EvictionCandidate& rhs) const { return _score > rhs._score; }
+    };
+}
+
+void
+TileNodeRegistry::collectTilesOverBudget(
+    unsigned long long maxCPUBytes,
+    unsigned long long maxGPUBytes,
+    unsigned oldestAllowableFrame,
+    unsigned maxTiles,
+    std::vector<osg::observer_ptr<TileNode> >& output)
+{
+    _mutex.lock();
+
+    bool overCPU = maxCPUBytes > 0u && _totalCPUBytes > maxCPUBytes;
+    bool overGPU = maxGPUBytes > 0u && _totalGPUBytes > maxGPUBytes;
+
+    if (overCPU || overGPU)
+    {
+        double now = _clock->getTime();
+
+        // Score each candidate by how long it's been since a cull visited it
+        // and how far away (in tile radii) it was at the time. Old, distant
+        // tiles go first.
+        std::vector<EvictionCandidate> candidates;
+
+        for (unsigned slot = 0u; slot < _slots.size(); ++slot)
+        {
+            const Slot& s = _slots[slot];
+            if (!s._tile.valid())
+                continue;
+
+            if (s._tile->getDoNotExpire() == false &&
+                s._lastFrame < oldestAllowableFrame &&
+                s._tile->areSiblingsDormant())
+            {
+                float radius = osg::maximum(s._tile->getBound().radius(), 1.0f);
+                float range = osg::clampBetween(s._visitRange, 0.0f, FLT_MAX/4.0f);
+                float age = (float)(now - s._lastTime);
+
+                EvictionCandidate c;
+                c._score = (1.0f + age) * (1.0f + range / radius);
+                c._slot = slot;
+                candidates.push_back(c);
+            }
+        }
+
+        std::sort(candidates.begin(), candidates.end());
+
+        unsigned count = 0u;
+        for (std::vector<EvictionCandidate>::iterator c = candidates.begin();
+            c != candidates.end() && (overCPU || overGPU) && count < maxTiles;
+            ++c)
+        {
+            collect(c->_slot, output);
             ++count;
+
+            overCPU = maxCPUBytes > 0u && _totalCPUBytes > maxCPUBytes;
+            overGPU = maxGPUBytes > 0u && _totalGPUBytes > maxGPUBytes;
         }
-        else
+
+        if (overCPU || overGPU)
         {
-            // reset the range in preparation for the next frame.
-            se->_lastRange = FLT_MAX;
+            OE_DEBUG << LC << "Terrain is over its memory budget but no more tiles are eligible for unloading" << std::endl;
         }
     }
 
-    // reset the sentry.
-    _tracker.erase(_sentryptr);
-    _tracker.push_front(SENTRY_VALUE);
-    _sentryptr =_tracker.begin();
-
     _mutex.unlock();
-
-    OE_PROFILING_PLOT(PROFILING_REX_TILES, (float)(_tiles.size()));
 }
@@ -22,12 +22,21 @@
 
 #include <osgEarth/Metrics>
 #include <osgEarth/NodeUtils>
+#include <osgEarth/Memory>
 
 #undef  LC
 #define LC "[UnloaderGroup] "
 
 using namespace osgEarth::REX;
 
+namespace
+{
+    const osgEarth::Util::Counter s_tilesExpired("terrain.tiles.expired");
+    const osgEarth::Util::Gauge s_numTiles("terrain.tiles");
+    const osgEarth::Util::Gauge s_cpuBytes = osgEarth::Util::Memory::getCPUGauge("terrain");
+    const osgEarth::Util::Gauge s_gpuBytes = osgEarth::Util::Memory::getGPUGauge("terrain");
+}
+
 
 UnloaderGroup::UnloaderGroup(TileNodeRegistry* tiles) :
 _tiles(tiles),
@@ -35,6 +44,8 @@ _cacheSize(0u),
 _maxAge(0.1),
 _minRange(0.0f),
 _maxTilesToUnloadPerFrame(~0),
+_maxCPUBytes(0u),
+_maxGPUBytes(0u),
 _frameLastUpdated(0u)
 {
     ADJUST_UPDATE_TRAV_COUNT(this, +1);
@@ -71,6 +82,28 @@ UnloaderGroup::traverse(osg::NodeVisitor& nv)
                 _minRange,
                 _maxTilesToUnloadPerFrame, _deadpool);
 
+            // If we're still over the memory budget, unload more tiles without
+            // waiting for them to age out. Tiles still need to miss a few frames
+            // so we don't unload anything that's visible.
+            if (_maxCPUBytes > 0u || _maxGPUBytes > 0u)
+            {
+                unsigned maxCount = _maxTilesToUnloadPerFrame - osg::minimum(
+                    _maxTilesToUnloadPerFrame, (unsigned)_deadpool.size());
+
+                _tiles->collectTilesOverBudget(
+                    _maxCPUBytes,
+                    _maxGPUBytes,
+                    oldestAllowableFrame,
+                    maxCount,
+                    _deadpool);
+            }
+
+            OE_PROFILING_PLOT("REX Tile CPU Memory (MB)", (float)(_tiles->getTotalCPUBytes() / 1048576.0));
+            OE_PROFILING_PLOT("REX Tile GPU Memory (MB)", (float)(_tiles->getTotalGPUBytes() / 1048576.0));
+
+            s_cpuBytes.set(_tiles->getTotalCPUBytes());
+            s_gpuBytes.set(_tiles->getTotalGPUBytes());
+
             // Remove them from the scene graph:
             for(std::vector<osg::observer_ptr<TileNode> >::iterator i = _deadpool.begin();
                 i != _deadpool.end();
@@ -94,6 +127,10 @@ UnloaderGroup::traverse(osg::NodeVisitor& nv)
                 }
             }
 
+            // each removeSubTiles() call unloads a quad of four tiles
+            s_tilesExpired.add(4 * count);
+            s_numTiles.set(_tiles->size());
+
             if (_deadpool.empty() == false)
             {
                 OE_DEBUG << LC << "Unloaded " << count << " of " << _deadpool.size() << " dormant tiles; " << _tiles->size() << " remain active." << std::endl;
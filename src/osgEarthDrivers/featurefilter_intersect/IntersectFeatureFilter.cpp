@@ -28,6 +28,8 @@
 #include <osgEarth/FilterContext>
 
 #include <osgEarth/Geometry>
+#include <osgEarth/PolygonIndex>
+#include <osgEarth/Threading>
 
 #include <osgDB/FileNameUtils>
 #include <osgDB/FileUtils>
@@ -35,15 +37,24 @@
 #define LC "[Intersect FeatureFilter] "
 
 using namespace osgEarth;
+using namespace osgEarth::Util;
 using namespace osgEarth::Drivers;
 
 
 
+// features per job when testing in parallel
+#define MIN_FEATURES_PER_CHUNK 256u
+
 class IntersectFeatureFilter : public FeatureFilter, public IntersectFeatureFilterOptions
 {
 private:
     osg::ref_ptr< FeatureSource > _featureSource;
 
+    // Boundaries indexed once per SRS they are used in; read-only after that
+    typedef std::vector< std::pair< osg::ref_ptr<const SpatialReference>, osg::ref_ptr<PolygonIndex> > > IndexList;
+    IndexList _indexes;
+    Threading::Mutex _indexesMutex;
+
 public:
     IntersectFeatureFilter(const ConfigOptions& options)
         : FeatureFilter(), IntersectFeatureFilterOptions(options)
@@ -68,100 +79,101 @@ public: // FeatureFilter
     }
 
     /**
-     * Gets all the features that intersect the extent
+     * Gets the index of all the boundary features in the given SRS,
+     * reading and converting them the first time that SRS comes along.
      */
-    void getFeatures(const GeoExtent& extent, FeatureList& features, ProgressCallback* progress)
+    const PolygonIndex* getIndex(const SpatialReference* srs, ProgressCallback* progress)
     {
-        GeoExtent localExtent = extent.transform( _featureSource->getFeatureProfile()->getSRS() );
-        Query query;
-        query.bounds() = localExtent.bounds();
-        if (localExtent.intersects( _featureSource->getFeatureProfile()->getExtent()))
+        Threading::ScopedMutexLock lock(_indexesMutex);
+
+        for (IndexList::const_iterator i = _indexes.begin(); i != _indexes.end(); ++i)
         {
-            osg::ref_ptr< FeatureCursor > cursor = _featureSource->createFeatureCursor(query, progress);
-            if (cursor)
-            {
-                cursor->fill( features );
-            }
-        }     
+            if (i->first->isHorizEquivalentTo(srs))
+                return i->second.get();
+        }
+
+        FeatureList boundaries;
+        osg::ref_ptr< FeatureCursor > cursor = _featureSource->createFeatureCursor(Query(), progress);
+        if (cursor.valid())
+        {
+            cursor->fill( boundaries );
+        }
+
+        // Transform the boundaries into the coordinate system of the features
+        for (FeatureList::iterator itr = boundaries.begin(); itr != boundaries.end(); ++itr)
+        {
+            itr->get()->transform( srs );
+        }
+
+        osg::ref_ptr<PolygonIndex> index = new PolygonIndex(boundaries);
+        _indexes.push_back(std::make_pair(osg::ref_ptr<const SpatialReference>(srs), index));
+
+        OE_INFO << LC << "Indexed " << index->size() << " boundaries from " << boundaries.size() << " features\n";
+        return index.get();
     }
 
     FilterContext push(FeatureList& input, FilterContext& context)
     {
-        if (_featureSource.valid())
+        if (_featureSource.valid() && context.profile())
         {
             osg::ref_ptr<ProgressCallback> progress = new ProgressCallback();
 
-            // Get any features that intersect this query.
-            FeatureList boundaries;
-            getFeatures(context.extent().get(), boundaries, progress.get());
-            
-            
-            // The list of output features
-            FeatureList output;
+            const PolygonIndex* index = getIndex(context.profile()->getSRS(), progress.get());
 
-            if (boundaries.empty())
-            {
-                // No intersecting features.  If contains is false, then just the output to the input.
-                if (contains() == false)
-                {
-                    output = input;
-                }
-            }
-            else
-            {
-                // Transform the boundaries into the coordinate system of the features
-                for (FeatureList::iterator itr = boundaries.begin(); itr != boundaries.end(); ++itr)
-                {
-                    itr->get()->transform( context.profile()->getSRS() );
-                }
+            std::vector<Feature*> features;
+            features.reserve(input.size());
+            for (FeatureList::const_iterator f = input.begin(); f != input.end(); ++f)
+                features.push_back(f->get());
+
+            // Whether each feature's centroid falls in the boundaries
+            std::vector<char> inside(features.size(), 0);
 
-                for(FeatureList::const_iterator f = input.begin(); f != input.end(); ++f)
+            auto testChunk = [&features, &inside, index](unsigned begin, unsigned end)
+            {
+                for (unsigned i = begin; i < end; ++i)
                 {
-                    Feature* feature = f->get();
+                    Feature* feature = features[i];
                     if ( feature && feature->getGeometry() )
                     {
                         osg::Vec2d c = feature->getGeometry()->getBounds().center2d();
-
-                        if ( contains() == true )
-                        {
-                            // coarsest:
-                            if (_featureSource->getFeatureProfile()->getExtent().contains(GeoPoint(feature->getSRS(), c.x(), c.y())))
-                            {
-                                for (FeatureList::iterator itr = boundaries.begin(); itr != boundaries.end(); ++itr)
-                                {
-                                    Ring* ring = dynamic_cast< Ring*>(itr->get()->getGeometry());
-                                    if (ring && ring->contains2D(c.x(), c.y()))
-                                    {
-                                        output.push_back( feature );
-                                    }
-                                }                        
-                            }
-                        }
-
-                        else
-                        {    
-                            bool contained = false;
-
-                            // coarsest:
-                            if (_featureSource->getFeatureProfile()->getExtent().contains(GeoPoint(feature->getSRS(), c.x(), c.y())))
-                            {
-                                for (FeatureList::iterator itr = boundaries.begin(); itr != boundaries.end(); ++itr)
-                                {
-                                    Ring* ring = dynamic_cast< Ring*>(itr->get()->getGeometry());
-                                    if (ring && ring->contains2D(c.x(), c.y()))
-                                    {                             
-                                        contained = true;
-                                        break;
-                                    }
-                                }
-                            }
-                            if ( !contained )
-                            {
-                                output.push_back( feature );
-                            }
-                        }
+                        inside[i] = index->contains(c.x(), c.y()) ? 1 : 0;
                     }
                 }
+            };
+
+            // The index is read-only, so contiguous chunks can be tested concurrently.
+            Threading::JobArena* arena = Registry::instance()->getJobArena("features.build");
+            unsigned size = (unsigned)features.size();
+            unsigned numChunks = osg::maximum(1u, osg::minimum(arena->getConcurrency() + 1u, size / MIN_FEATURES_PER_CHUNK));
+
+            std::vector<Threading::Future<osg::Referenced> > futures;
+            for (unsigned c = 1; c < numChunks; ++c)
+            {
+                Threading::Promise<osg::Referenced> promise;
+                futures.push_back(promise.getFuture());
+
+                unsigned begin = (c*size)/numChunks, end = ((c+1)*size)/numChunks;
+                Threading::runInJobArena(arena, [promise, begin, end, &testChunk]() mutable {
+                    testChunk(begin, end);
+                    promise.resolve(0L);
+                });
+            }
+
+            testChunk(0u, size/numChunks);
+
+            // Wait for everything; the jobs reference our stack.
+            Threading::when_all(futures).get();
+
+            // The list of output features
+            FeatureList output;
+            bool keepInside = contains() == true;
+            unsigned n = 0u;
+            for (FeatureList::const_iterator f = input.begin(); f != input.end(); ++f, ++n)
+            {
+                if ( features[n] && features[n]->getGeometry() && (inside[n] != 0) == keepInside )
+                {
+                    output.push_back( *f );
+                }
             }
 
             OE_INFO << LC << "Allowed " << output.size() << " out of " << input.size() << " features\n";
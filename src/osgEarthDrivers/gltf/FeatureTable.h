@@ -0,0 +1,164 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2020 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#ifndef OSGEARTH_3DTILES_FEATURE_TABLE_H
+#define OSGEARTH_3DTILES_FEATURE_TABLE_H
+
+#include <osgEarth/Endian>
+#include <osgEarth/JsonUtils>
+#include <osgDB/ObjectWrapper>
+#include <osgDB/Registry>
+#include <osg/Vec3d>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <sstream>
+#include <vector>
+
+/**
+ * The feature table of an i3dm or pnts tile: a JSON header whose
+ * per-feature properties point into a binary body by byteOffset, and
+ * whose global properties are inline JSON values.
+ */
+class FeatureTable
+{
+public:
+    //! Returns the tile data, zlib-decompressed into "storage" if it
+    //! does not start with the expected magic string.
+    static const std::string* decompress(const std::string& input, const std::string& magic, std::string& storage)
+    {
+        if (input.compare(0, 4, magic) == 0)
+            return &input;
+
+        osg::ref_ptr<osgDB::BaseCompressor> compressor = osgDB::Registry::instance()->getObjectWrapperManager()->findCompressor("zlib");
+        if (compressor.valid())
+        {
+            std::stringstream in_data(input);
+            if (compressor->decompress(in_data, storage) && storage.compare(0, 4, magic) == 0)
+                return &storage;
+        }
+        return 0L;
+    }
+
+    bool parse(const std::string& json, const std::string& binary)
+    {
+        _binary = binary;
+        if (json.empty())
+            return true;
+        osgEarth::Json::Reader reader;
+        return reader.parse(json, _json);
+    }
+
+    bool has(const char* name) const
+    {
+        return _json.isMember(name);
+    }
+
+    bool hasExtension(const char* name) const
+    {
+        const osgEarth::Json::Value& extensions = _json["extensions"];
+        return extensions.isObject() && extensions.isMember(name);
+    }
+
+    unsigned getUInt(const char* name, unsigned defaultValue) const
+    {
+        const osgEarth::Json::Value& value = _json[name];
+        return value.isNumeric() ? value.asUInt() : defaultValue;
+    }
+
+    bool getBool(const char* name, bool defaultValue) const
+    {
+        const osgEarth::Json::Value& value = _json[name];
+        return value.isBool() ? value.asBool() : defaultValue;
+    }
+
+    //! Reads a global vec3 property such as RTC_CENTER
+    bool getVec3(const char* name, osg::Vec3d& out) const
+    {
+        const osgEarth::Json::Value& value = _json[name];
+        if (!value.isArray() || value.size() < 3)
+            return false;
+        out.set(value[0u].asDouble(), value[1u].asDouble(), value[2u].asDouble());
+        return true;
+    }
+
+    //! Reads a global array property such as CONSTANT_RGBA
+    template<typename T>
+    bool getGlobal(const char* name, unsigned count, std::vector<T>& out) const
+    {
+        const osgEarth::Json::Value& value = _json[name];
+        if (!value.isArray() || value.size() < count)
+            return false;
+        out.resize(count);
+        for (unsigned i = 0; i < count; ++i)
+            out[i] = (T)value[i].asDouble();
+        return true;
+    }
+
+    //! Copies "count" values of a per-feature property out of the binary body.
+    //! False if the property is missing or runs past the end of the body.
+    template<typename T>
+    bool getArray(const char* name, unsigned count, std::vector<T>& out) const
+    {
+        const osgEarth::Json::Value& value = _json[name];
+        if (!value.isObject() || !value.isMember("byteOffset"))
+            return false;
+
+        size_t offset = value["byteOffset"].asUInt();
+        size_t size = (size_t)count * sizeof(T);
+        if (offset + size > _binary.size())
+            return false;
+
+        out.resize(count);
+        if (count > 0)
+            ::memcpy(&out[0], &_binary[offset], size);
+
+#ifdef OE_IS_BIG_ENDIAN
+        // 3D Tiles are little-endian
+        for (unsigned i = 0; i < count; ++i)
+        {
+            unsigned char* p = (unsigned char*)&out[i];
+            std::reverse(p, p + sizeof(T));
+        }
+#endif
+        return true;
+    }
+
+    //! Decodes a unit vector stored in oct-encoded form, with x and y in [-1, 1]
+    static osg::Vec3f octDecode(float x, float y)
+    {
+        osg::Vec3f v(x, y, 1.0f - fabs(x) - fabs(y));
+        if (v.z() < 0.0f)
+        {
+            float ox = v.x();
+            v.x() = (1.0f - fabs(v.y())) * (ox >= 0.0f ? 1.0f : -1.0f);
+            v.y() = (1.0f - fabs(ox)) * (v.y() >= 0.0f ? 1.0f : -1.0f);
+        }
+        v.normalize();
+        return v;
+    }
+
+private:
+    osgEarth::Json::Value _json;
+    std::string _binary;
+};
+
+#endif // OSGEARTH_3DTILES_FEATURE_TABLE_H
@@ -39,6 +39,13 @@
 #include <osgEarth/Registry>
 #include <osgEarth/ShaderUtils>
 #include <osgEarth/InstanceBuilder>
+#include <osgEarth/Threading>
+#include <atomic>
+#include <sstream>
+
+#ifdef OSGEARTH_HAVE_MESHOPT
+#include <meshoptimizer.h>
+#endif
 
 
 
@@ -69,6 +76,16 @@ public:
         const osgDB::Options* readOptions;
     };
 
+    //! tinygltf image callback that keeps the encoded bytes, so that
+    //! makeNodeFromModel can decode all the images in parallel
+    static bool DeferImageData(tinygltf::Image* image, const int, std::string*, std::string*,
+                               int, int, const unsigned char* bytes, int size, void*)
+    {
+        image->image.assign(bytes, bytes + size);
+        image->as_is = true;
+        return true;
+    }
+
 public:
     mutable TextureCache* _texCache;
 
@@ -97,6 +114,7 @@ public:
         fs.WriteWholeFile = &tinygltf::WriteWholeFile;
         fs.user_data = (void*)&location;
         loader.SetFsCallbacks(fs);
+        loader.SetImageLoader(&GLTFReader::DeferImageData, nullptr);
 
         tinygltf::Options opt;
         opt.skip_imagery = readOptions && readOptions->getOptionString().find("gltfSkipImagery") != std::string::npos;
@@ -155,6 +173,7 @@ public:
         fs.WriteWholeFile = &tinygltf::WriteWholeFile;
         fs.user_data = (void*)&location;
         loader.SetFsCallbacks(fs);
+        loader.SetImageLoader(&GLTFReader::DeferImageData, nullptr);
 
         tinygltf::Options opt;
         opt.skip_imagery = readOptions && readOptions->getOptionString().find("gltfSkipImagery") != std::string::npos;
@@ -184,9 +203,12 @@ public:
         return makeNodeFromModel(model, env);
     }
 
-    osg::Node* makeNodeFromModel(const tinygltf::Model &model, const Env& env) const
+    osg::Node* makeNodeFromModel(tinygltf::Model &model, const Env& env) const
     {
-        NodeBuilder builder(this, model, env);
+        std::vector< osg::ref_ptr<osg::Image> > images;
+        decode(model, images);
+
+        NodeBuilder builder(this, model, env, images);
         // Rotate y-up to z-up
         osg::MatrixTransform* transform = new osg::MatrixTransform;
         transform->setMatrix(osg::Matrixd::rotate(osg::Vec3d(0.0, 1.0, 0.0), osg::Vec3d(0.0, 0.0, 1.0)));
@@ -207,19 +229,233 @@ public:
         return transform;
     }
 
+    //! Runs func(0) .. func(count-1), spread across the "models.decode" job arena
+    template<typename FUNC>
+    static void runParallel(unsigned count, const FUNC& func)
+    {
+        osgEarth::Threading::JobArena* arena = osgEarth::Registry::instance()->getJobArena("models.decode");
+
+        std::atomic_uint next(0u);
+        auto work = [&]()
+        {
+            for (unsigned i = next++; i < count; i = next++)
+                func(i);
+        };
+
+        // This thread works too, so it doesn't just sit and wait.
+        unsigned numJobs = osg::minimum(count, arena->getConcurrency() + 1u);
+        std::vector< osgEarth::Threading::Future<osg::Referenced> > futures;
+        for (unsigned j = 1; j < numJobs; ++j)
+        {
+            osgEarth::Threading::Promise<osg::Referenced> promise;
+            futures.push_back(promise.getFuture());
+            osgEarth::Threading::runInJobArena(arena, [promise, &work]() mutable {
+                work();
+                promise.resolve(0L);
+            });
+        }
+
+        work();
+
+        // Wait for everything; the jobs reference our stack.
+        if (!futures.empty())
+            osgEarth::Threading::when_all(futures).get();
+    }
+
+    //! Decodes EXT_meshopt_compression buffer views in place and the
+    //! deferred images into out_images, all in parallel
+    void decode(tinygltf::Model& model, std::vector< osg::ref_ptr<osg::Image> >& out_images) const
+    {
+        std::vector<int> meshoptViews;
+        for (unsigned i = 0; i < model.bufferViews.size(); ++i)
+        {
+            if (model.bufferViews[i].extensions.count("EXT_meshopt_compression") > 0)
+                meshoptViews.push_back(i);
+        }
+
+#ifndef OSGEARTH_HAVE_MESHOPT
+        if (!meshoptViews.empty())
+        {
+            OE_WARN << LC << "Model uses EXT_meshopt_compression, but osgEarth was built without meshoptimizer" << std::endl;
+            meshoptViews.clear();
+        }
+#endif
+
+        std::vector< std::vector<unsigned char> > decodedViews(meshoptViews.size());
+        out_images.resize(model.images.size());
+
+        const tinygltf::Model& input = model;
+        unsigned numViews = meshoptViews.size();
+        runParallel(numViews + (unsigned)model.images.size(), [&](unsigned i)
+        {
+            if (i < numViews)
+            {
+                const tinygltf::Value& ext = input.bufferViews[meshoptViews[i]].extensions.at("EXT_meshopt_compression");
+                if (!decodeMeshopt(input, ext, decodedViews[i]))
+                {
+                    OE_WARN << LC << "Failed to decode meshopt buffer view " << meshoptViews[i] << std::endl;
+                    decodedViews[i].clear();
+                }
+            }
+            else
+            {
+                out_images[i - numViews] = decodeImage(input.images[i - numViews]);
+            }
+        });
+
+        // Point each decoded view at its own new buffer
+        for (unsigned i = 0; i < numViews; ++i)
+        {
+            if (decodedViews[i].empty())
+                continue;
+
+            tinygltf::Buffer buffer;
+            buffer.data.swap(decodedViews[i]);
+
+            tinygltf::BufferView& view = model.bufferViews[meshoptViews[i]];
+            view.buffer = (int)model.buffers.size();
+            view.byteOffset = 0;
+            view.byteLength = buffer.data.size();
+            model.buffers.push_back(buffer);
+        }
+    }
+
+    static bool decodeMeshopt(const tinygltf::Model& model, const tinygltf::Value& ext, std::vector<unsigned char>& out)
+    {
+#ifdef OSGEARTH_HAVE_MESHOPT
+        if (!ext.IsObject() || !ext.Has("buffer") || !ext.Has("byteLength") || !ext.Has("byteStride") || !ext.Has("count") || !ext.Has("mode"))
+            return false;
+
+        int bufferIndex = (int)ext.Get("buffer").GetNumberAsInt();
+        size_t byteOffset = ext.Has("byteOffset") ? (size_t)ext.Get("byteOffset").GetNumberAsInt() : 0u;
+        size_t byteLength = (size_t)ext.Get("byteLength").GetNumberAsInt();
+        size_t byteStride = (size_t)ext.Get("byteStride").GetNumberAsInt();
+        size_t count = (size_t)ext.Get("count").GetNumberAsInt();
+        const std::string& mode = ext.Get("mode").Get<std::string>();
+        std::string filter = ext.Has("filter") ? ext.Get("filter").Get<std::string>() : "NONE";
+
+        if (bufferIndex < 0 || bufferIndex >= (int)model.buffers.size())
+            return false;
+
+        const std::vector<unsigned char>& source = model.buffers[bufferIndex].data;
+        if (byteOffset + byteLength > source.size())
+            return false;
+
+        out.resize(count * byteStride);
+        const unsigned char* encoded = source.data() + byteOffset;
+
+        int rc = -1;
+        if (mode == "ATTRIBUTES")
+            rc = meshopt_decodeVertexBuffer(out.data(), count, byteStride, encoded, byteLength);
+        else if (mode == "TRIANGLES")
+            rc = meshopt_decodeIndexBuffer(out.data(), count, byteStride, encoded, byteLength);
+        else if (mode == "INDICES")
+            rc = meshopt_decodeIndexSequence(out.data(), count, byteStride, encoded, byteLength);
+
+        if (rc != 0)
+            return false;
+
+        if (filter == "OCTAHEDRAL")
+            meshopt_decodeFilterOct(out.data(), count, byteStride);
+        else if (filter == "QUATERNION")
+            meshopt_decodeFilterQuat(out.data(), count, byteStride);
+        else if (filter == "EXPONENTIAL")
+            meshopt_decodeFilterExp(out.data(), count, byteStride);
+
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    static bool isKTX2(const unsigned char* bytes, size_t size)
+    {
+        static const unsigned char identifier[12] = {
+            0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+        return size >= 12 && ::memcmp(bytes, identifier, 12) == 0;
+    }
+
+    //! Whether a KTX2 reader (the basis plugin built against Basis Universal 1.16+) is available
+    static bool canReadKTX2()
+    {
+        static bool s_canRead = osgDB::Registry::instance()->getReaderWriterForExtension("ktx2") != 0L;
+        return s_canRead;
+    }
+
+    //! Decodes an image that DeferImageData kept encoded
+    static osg::Image* decodeImage(const tinygltf::Image& image)
+    {
+        if (!image.as_is || image.image.empty())
+            return 0L;
+
+        const unsigned char* bytes = image.image.data();
+        int size = (int)image.image.size();
+
+        if (isKTX2(bytes, size))
+        {
+            osgDB::ReaderWriter* rw = osgDB::Registry::instance()->getReaderWriterForExtension("ktx2");
+            if (!rw)
+                return 0L;
+
+            std::istringstream in(std::string((const char*)bytes, size));
+            osgDB::ReaderWriter::ReadResult rr = rw->readImage(in);
+            osg::Image* result = rr.takeImage();
+            if (result)
+            {
+                // readers return images bottom-up, glTF expects top-down
+                result->flipVertical();
+            }
+            return result;
+        }
+
+        int width = 0, height = 0, components = 0;
+        if (!stbi_info_from_memory(bytes, size, &width, &height, &components))
+            return 0L;
+
+        int requested = components == 3 ? 3 : 4;
+        unsigned char* data = stbi_load_from_memory(bytes, size, &width, &height, &components, requested);
+        if (!data)
+            return 0L;
+
+        osg::Image* result = new osg::Image();
+        result->setImage(
+            width, height, 1,
+            requested == 4 ? GL_RGBA8 : GL_RGB8,
+            requested == 4 ? GL_RGBA : GL_RGB,
+            GL_UNSIGNED_BYTE,
+            data,
+            osg::Image::USE_MALLOC_FREE);
+        return result;
+    }
+
     struct NodeBuilder
     {
         const GLTFReader* reader;
         const tinygltf::Model &model;
         const Env& env;
         std::vector< osg::ref_ptr< osg::Array > > arrays;
+        const std::vector< osg::ref_ptr< osg::Image > >& images;
 
-        NodeBuilder(const GLTFReader* reader_, const tinygltf::Model &model_, const Env& env_)
-            : reader(reader_), model(model_), env(env_)
+        NodeBuilder(const GLTFReader* reader_, const tinygltf::Model &model_, const Env& env_, const std::vector< osg::ref_ptr< osg::Image > >& images_)
+            : reader(reader_), model(model_), env(env_), images(images_)
         {
             extractArrays(arrays);
         }
 
+        //! The image a texture draws, preferring its KHR_texture_basisu
+        //! source when KTX2 can be read
+        int getTextureSource(const tinygltf::Texture& texture) const
+        {
+            auto ext = texture.extensions.find("KHR_texture_basisu");
+            if (ext != texture.extensions.end() && ext->second.Has("source") && canReadKTX2())
+            {
+                int source = (int)ext->second.Get("source").GetNumberAsInt();
+                if (source >= 0 && source < (int)model.images.size())
+                    return source;
+            }
+            return texture.source;
+        }
+
         osg::Node* createNode(const tinygltf::Node& node) const
         {
             osg::MatrixTransform* mt = new osg::MatrixTransform;
@@ -282,7 +518,11 @@ public:
         osg::Texture2D* makeTextureFromModel(const tinygltf::Texture& texture) const
 
         {
-            const tinygltf::Image& image = model.images[texture.source];
+            int source = getTextureSource(texture);
+            if (source < 0 || source >= (int)model.images.size())
+                return 0L;
+
+            const tinygltf::Image& image = model.images[source];
             bool imageEmbedded =
                 tinygltf::IsDataURI(image.uri) ||
                 image.image.size() > 0;
@@ -296,7 +536,12 @@ public:
             // First load the image
             osg::ref_ptr<osg::Image> img;
 
-            if (image.image.size() > 0)
+            if (images[source].valid())
+            {
+                img = images[source].get();
+            }
+
+            else if (image.image.size() > 0 && !image.as_is)
             {
                 GLenum format = GL_RGB, texFormat = GL_RGB8;
                 if (image.component == 4) format = GL_RGBA, texFormat = GL_RGBA8;
@@ -324,7 +569,9 @@ public:
             // If the image loaded OK, create the texture
             if (img.valid())
             {
-                if(img->getPixelFormat() == GL_RGB)
+                if (img->isCompressed())
+                    img->setInternalTextureFormat(img->getPixelFormat());
+                else if(img->getPixelFormat() == GL_RGB)
                     img->setInternalTextureFormat(GL_RGB8);
                 else if (img->getPixelFormat() == GL_RGBA)
                     img->setInternalTextureFormat(GL_RGBA8);
@@ -437,7 +684,10 @@ public:
                             {
                                 int index = i->second;
                                 const tinygltf::Texture& texture = model.textures[index];
-                                const tinygltf::Image& image = model.images[texture.source];
+                                int source = getTextureSource(texture);
+                                if (source < 0 || source >= (int)model.images.size())
+                                    continue;
+                                const tinygltf::Image& image = model.images[source];
                                 // don't cache embedded textures!
                                 bool imageEmbedded =
                                     tinygltf::IsDataURI(image.uri) ||
@@ -681,6 +931,13 @@ public:
                 const tinygltf::Buffer& buffer = model.buffers[bufferView.buffer];
                 osg::ref_ptr< osg::Array > osgArray;
 
+                // e.g. a meshopt fallback buffer that could not be decoded
+                if (buffer.data.empty())
+                {
+                    arrays.push_back(osgArray);
+                    continue;
+                }
+
                 switch (accessor.componentType)
                 {
                 case TINYGLTF_COMPONENT_TYPE_BYTE:
@@ -0,0 +1,317 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2020 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#ifndef OSGEARTH_I3DM_READER_H
+#define OSGEARTH_I3DM_READER_H
+
+#include <osgEarth/InstanceCloud>
+#include <osgEarth/StringUtils>
+#include <osgEarth/URI>
+#include <osg/CoordinateSystemNode>
+#include <osg/MatrixTransform>
+#include <osgUtil/Optimizer>
+#include <cfloat>
+#include "GLTFReader.h"
+#include "FeatureTable.h"
+
+using namespace osgEarth;
+
+#undef LC
+#define LC "[I3DMReader] "
+
+struct i3dmheader
+{
+    char magic[4];
+    unsigned int version;
+    unsigned int byteLength;
+    unsigned int featureTableJSONByteLength;
+    unsigned int featureTableBinaryByteLength;
+    unsigned int batchTableJSONByteLength;
+    unsigned int batchTableBinaryByteLength;
+    unsigned int gltfFormat;
+};
+
+/**
+ * Reads an instanced 3D model tile (i3dm). All the instances draw in one
+ * CulledInstanceCloud, which culls them on the GPU and draws the
+ * survivors with a single indirect call.
+ */
+class I3DMReader
+{
+public:
+    mutable GLTFReader::TextureCache* _texCache;
+
+    I3DMReader() : _texCache(NULL)
+    {
+    }
+
+    void setTextureCache(GLTFReader::TextureCache* cache) const
+    {
+        _texCache = cache;
+    }
+
+    //! Read an I3DM data package and return a node.
+    osg::Node* read(const std::string& location, const std::string& inputStream, const osgDB::Options* readOptions) const
+    {
+        std::string decompressedData;
+        const std::string* data = FeatureTable::decompress(inputStream, "i3dm", decompressedData);
+        if (!data || data->size() < sizeof(i3dmheader))
+        {
+            OE_WARN << LC << "Invalid i3dm" << std::endl;
+            return NULL;
+        }
+
+        i3dmheader header;
+        ::memcpy(&header, data->data(), sizeof(i3dmheader));
+
+#ifdef OE_IS_BIG_ENDIAN
+        byteSwapInPlace(header.version);
+        byteSwapInPlace(header.byteLength);
+        byteSwapInPlace(header.featureTableJSONByteLength);
+        byteSwapInPlace(header.featureTableBinaryByteLength);
+        byteSwapInPlace(header.batchTableJSONByteLength);
+        byteSwapInPlace(header.batchTableBinaryByteLength);
+        byteSwapInPlace(header.gltfFormat);
+#endif
+
+        size_t offset = sizeof(i3dmheader);
+        size_t bodyLength =
+            (size_t)header.featureTableJSONByteLength + header.featureTableBinaryByteLength +
+            header.batchTableJSONByteLength + header.batchTableBinaryByteLength;
+
+        if (header.byteLength > data->size() || offset + bodyLength > header.byteLength)
+        {
+            OE_WARN << LC << "Truncated i3dm: " << location << std::endl;
+            return NULL;
+        }
+
+        FeatureTable features;
+        if (!features.parse(
+            data->substr(offset, header.featureTableJSONByteLength),
+            data->substr(offset + header.featureTableJSONByteLength, header.featureTableBinaryByteLength)))
+        {
+            OE_WARN << LC << "Invalid i3dm feature table: " << location << std::endl;
+            return NULL;
+        }
+
+        // The batch table only holds application metadata, so skip it.
+        offset += bodyLength;
+
+        osg::ref_ptr<osg::Node> model = readModel(
+            location, data->substr(offset, header.byteLength - offset), header.gltfFormat, readOptions);
+
+        if (!model.valid())
+        {
+            OE_WARN << LC << "Failed to read the instanced model of " << location << std::endl;
+            return NULL;
+        }
+
+        std::vector<osg::Matrixd> instances;
+        if (!readInstances(features, instances))
+        {
+            OE_WARN << LC << "Invalid i3dm instances: " << location << std::endl;
+            return NULL;
+        }
+
+        if (instances.empty())
+            return new osg::Group();
+
+        // Put the instances relative to their center so they fit in floats.
+        osg::BoundingBoxd bounds;
+        for (auto& xform : instances)
+            bounds.expandBy(xform.getTrans());
+        osg::Vec3d center = bounds.center();
+
+        osg::MatrixTransform* root = new osg::MatrixTransform();
+        root->setMatrix(osg::Matrixd::translate(center));
+
+        if (CulledInstanceCloud::isSupported())
+        {
+            // The cloud merges the model into one geometry, which ignores
+            // transforms, so bake them into the vertices first.
+            osg::ref_ptr<osg::Group> flat = new osg::Group();
+            flat->addChild(model.get());
+            osgUtil::Optimizer optimizer;
+            optimizer.optimize(flat.get(), osgUtil::Optimizer::FLATTEN_STATIC_TRANSFORMS_DUPLICATING_SHARED_SUBGRAPHS);
+
+            osg::ref_ptr<CulledInstanceCloud> cloud = new CulledInstanceCloud();
+            cloud->addLOD(flat.get(), 0.0f, FLT_MAX);
+            for (auto& xform : instances)
+            {
+                osg::Matrixd local = xform * osg::Matrixd::translate(-center);
+                cloud->addInstance(osg::Matrixf(local));
+            }
+            root->addChild(cloud.get());
+        }
+        else
+        {
+            // Without GPU culling, share the model under one transform per instance.
+            for (auto& xform : instances)
+            {
+                osg::MatrixTransform* mt = new osg::MatrixTransform();
+                mt->setMatrix(xform * osg::Matrixd::translate(-center));
+                mt->addChild(model.get());
+                root->addChild(mt);
+            }
+        }
+
+        return root;
+    }
+
+private:
+
+    //! The glTF of an i3dm is either embedded (format 1) or a URI to it (format 0).
+    osg::Node* readModel(const std::string& location, const std::string& gltf, unsigned format, const osgDB::Options* readOptions) const
+    {
+        if (format == 1)
+        {
+            GLTFReader reader;
+            reader.setTextureCache(_texCache);
+            return reader.read(location, gltf, readOptions);
+        }
+
+        // the URI may be padded out with spaces or nulls
+        std::string uri(gltf.c_str());
+        uri = osgEarth::Util::trim(uri);
+        if (uri.empty())
+            return NULL;
+
+        return URI(uri, URIContext(location)).getNode(readOptions);
+    }
+
+    //! Computes the world matrix of every instance from the feature table.
+    static bool readInstances(const FeatureTable& features, std::vector<osg::Matrixd>& out)
+    {
+        unsigned count = features.getUInt("INSTANCES_LENGTH", 0u);
+        if (count == 0)
+            return true;
+
+        osg::Vec3d rtc;
+        features.getVec3("RTC_CENTER", rtc);
+
+        // positions, either floating point or quantized to a volume
+        std::vector<osg::Vec3d> positions(count);
+        std::vector<float> floats;
+        std::vector<unsigned short> shorts;
+        if (features.getArray("POSITION", count * 3, floats))
+        {
+            for (unsigned i = 0; i < count; ++i)
+                positions[i].set(floats[i * 3], floats[i * 3 + 1], floats[i * 3 + 2]);
+        }
+        else
+        {
+            osg::Vec3d volumeOffset, volumeScale;
+            if (!features.getArray("POSITION_QUANTIZED", count * 3, shorts) ||
+                !features.getVec3("QUANTIZED_VOLUME_OFFSET", volumeOffset) ||
+                !features.getVec3("QUANTIZED_VOLUME_SCALE", volumeScale))
+            {
+                return false;
+            }
+
+            for (unsigned i = 0; i < count; ++i)
+            {
+                positions[i].set(
+                    volumeOffset.x() + volumeScale.x() * (double)shorts[i * 3] / 65535.0,
+                    volumeOffset.y() + volumeScale.y() * (double)shorts[i * 3 + 1] / 65535.0,
+                    volumeOffset.z() + volumeScale.z() * (double)shorts[i * 3 + 2] / 65535.0);
+            }
+        }
+
+        // orientations as "up" and "right" vectors
+        std::vector<osg::Vec3f> ups, rights;
+        std::vector<float> upFloats, rightFloats;
+        std::vector<unsigned short> upShorts, rightShorts;
+        if (features.getArray("NORMAL_UP", count * 3, upFloats) &&
+            features.getArray("NORMAL_RIGHT", count * 3, rightFloats))
+        {
+            ups.resize(count);
+            rights.resize(count);
+            for (unsigned i = 0; i < count; ++i)
+            {
+                ups[i].set(upFloats[i * 3], upFloats[i * 3 + 1], upFloats[i * 3 + 2]);
+                rights[i].set(rightFloats[i * 3], rightFloats[i * 3 + 1], rightFloats[i * 3 + 2]);
+            }
+        }
+        else if (
+            features.getArray("NORMAL_UP_OCT32P", count * 2, upShorts) &&
+            features.getArray("NORMAL_RIGHT_OCT32P", count * 2, rightShorts))
+        {
+            ups.resize(count);
+            rights.resize(count);
+            for (unsigned i = 0; i < count; ++i)
+            {
+                ups[i] = FeatureTable::octDecode(
+                    (float)upShorts[i * 2] / 65535.0f * 2.0f - 1.0f,
+                    (float)upShorts[i * 2 + 1] / 65535.0f * 2.0f - 1.0f);
+                rights[i] = FeatureTable::octDecode(
+                    (float)rightShorts[i * 2] / 65535.0f * 2.0f - 1.0f,
+                    (float)rightShorts[i * 2 + 1] / 65535.0f * 2.0f - 1.0f);
+            }
+        }
+
+        bool eastNorthUp = ups.empty() && features.getBool("EAST_NORTH_UP", false);
+        osg::ref_ptr<osg::EllipsoidModel> ellipsoid = eastNorthUp ? new osg::EllipsoidModel() : 0L;
+
+        // scales, uniform or per axis
+        std::vector<float> scales, scalesNonUniform;
+        bool hasScale = features.getArray("SCALE", count, scales);
+        bool hasScaleNonUniform = !hasScale && features.getArray("SCALE_NON_UNIFORM", count * 3, scalesNonUniform);
+
+        out.resize(count);
+        for (unsigned i = 0; i < count; ++i)
+        {
+            osg::Vec3d world = positions[i] + rtc;
+
+            osg::Vec3d right(1, 0, 0), up(0, 1, 0);
+            if (!ups.empty())
+            {
+                right = rights[i];
+                up = ups[i];
+            }
+            else if (ellipsoid.valid())
+            {
+                osg::Matrixd enu;
+                ellipsoid->computeLocalToWorldTransformFromXYZ(world.x(), world.y(), world.z(), enu);
+                right.set(enu(0, 0), enu(0, 1), enu(0, 2));
+                up.set(enu(1, 0), enu(1, 1), enu(1, 2));
+            }
+            osg::Vec3d forward = right ^ up;
+
+            osg::Matrixd rotation(
+                right.x(), right.y(), right.z(), 0.0,
+                up.x(), up.y(), up.z(), 0.0,
+                forward.x(), forward.y(), forward.z(), 0.0,
+                0.0, 0.0, 0.0, 1.0);
+
+            osg::Vec3d scale(1, 1, 1);
+            if (hasScale)
+                scale.set(scales[i], scales[i], scales[i]);
+            else if (hasScaleNonUniform)
+                scale.set(scalesNonUniform[i * 3], scalesNonUniform[i * 3 + 1], scalesNonUniform[i * 3 + 2]);
+
+            out[i] = osg::Matrixd::scale(scale) * rotation * osg::Matrixd::translate(world);
+        }
+
+        return true;
+    }
+};
+
+#endif // OSGEARTH_I3DM_READER_H
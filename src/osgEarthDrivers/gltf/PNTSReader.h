@@ -0,0 +1,381 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2020 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#ifndef OSGEARTH_PNTS_READER_H
+#define OSGEARTH_PNTS_READER_H
+
+#include <osgEarth/GLUtils>
+#include <osgEarth/Notify>
+#include <osgEarth/Threading>
+#include <osgEarth/VirtualProgram>
+#include <osg/Geometry>
+#include <osg/MatrixTransform>
+#include <osg/PointSprite>
+#include <osg/BlendFunc>
+#include "FeatureTable.h"
+
+using namespace osgEarth;
+
+#undef LC
+#define LC "[PNTSReader] "
+
+struct pntsheader
+{
+    char magic[4];
+    unsigned int version;
+    unsigned int byteLength;
+    unsigned int featureTableJSONByteLength;
+    unsigned int featureTableBinaryByteLength;
+    unsigned int batchTableJSONByteLength;
+    unsigned int batchTableBinaryByteLength;
+};
+
+/**
+ * Reads a point cloud tile (pnts) into a single GL_POINTS geometry.
+ *
+ * Positions are kept as 16-bit integers in the tile's bounding volume,
+ * with the dequantization in the parent transform, and colors and normals
+ * as bytes. The points grow with proximity: each one covers the tile's
+ * average point spacing in world units (times oe_pnts_scale, capped at
+ * oe_pnts_max_size pixels), and is shaded as a small sphere so that
+ * overlapping points read as a surface. Set those uniforms with
+ * OVERRIDE on a parent to tune all the point clouds at once.
+ */
+class PNTSReader
+{
+public:
+    //! Read a PNTS data package and return a node.
+    osg::Node* read(const std::string& location, const std::string& inputStream, const osgDB::Options* readOptions) const
+    {
+        std::string decompressedData;
+        const std::string* data = FeatureTable::decompress(inputStream, "pnts", decompressedData);
+        if (!data || data->size() < sizeof(pntsheader))
+        {
+            OE_WARN << LC << "Invalid pnts" << std::endl;
+            return NULL;
+        }
+
+        pntsheader header;
+        ::memcpy(&header, data->data(), sizeof(pntsheader));
+
+#ifdef OE_IS_BIG_ENDIAN
+        byteSwapInPlace(header.version);
+        byteSwapInPlace(header.byteLength);
+        byteSwapInPlace(header.featureTableJSONByteLength);
+        byteSwapInPlace(header.featureTableBinaryByteLength);
+        byteSwapInPlace(header.batchTableJSONByteLength);
+        byteSwapInPlace(header.batchTableBinaryByteLength);
+#endif
+
+        size_t offset = sizeof(pntsheader);
+        if (header.byteLength > data->size() ||
+            offset + header.featureTableJSONByteLength + header.featureTableBinaryByteLength > header.byteLength)
+        {
+            OE_WARN << LC << "Truncated pnts: " << location << std::endl;
+            return NULL;
+        }
+
+        FeatureTable features;
+        if (!features.parse(
+            data->substr(offset, header.featureTableJSONByteLength),
+            data->substr(offset + header.featureTableJSONByteLength, header.featureTableBinaryByteLength)))
+        {
+            OE_WARN << LC << "Invalid pnts feature table: " << location << std::endl;
+            return NULL;
+        }
+
+        if (features.hasExtension("3DTILES_draco_point_compression"))
+        {
+            OE_WARN << LC << "Compressed point clouds are not supported: " << location << std::endl;
+            return NULL;
+        }
+
+        unsigned count = features.getUInt("POINTS_LENGTH", 0u);
+        if (count == 0)
+            return new osg::Group();
+
+        osg::Vec3d rtc;
+        features.getVec3("RTC_CENTER", rtc);
+
+        // Quantize the positions, keeping the volume they span.
+        osg::ref_ptr<osg::Vec3sArray> verts = new osg::Vec3sArray(count);
+        osg::Vec3d volumeOffset, volumeScale;
+        if (!readPositions(features, count, *verts, volumeOffset, volumeScale))
+        {
+            OE_WARN << LC << "Invalid pnts positions: " << location << std::endl;
+            return NULL;
+        }
+
+        osg::ref_ptr<osg::Geometry> geom = new osg::Geometry();
+        geom->setName(location);
+        geom->setUseVertexBufferObjects(true);
+        geom->setUseDisplayList(false);
+        geom->setVertexArray(verts.get());
+
+        bool translucent = false;
+        osg::Vec4ubArray* colors = readColors(features, count, translucent);
+        if (colors)
+        {
+            colors->setNormalize(true);
+            geom->setColorArray(colors, colors->size() == count ? osg::Array::BIND_PER_VERTEX : osg::Array::BIND_OVERALL);
+        }
+
+        osg::Vec3bArray* normals = readNormals(features, count, volumeScale);
+        if (normals)
+        {
+            normals->setNormalize(true);
+            geom->setNormalArray(normals, osg::Array::BIND_PER_VERTEX);
+        }
+
+        geom->addPrimitiveSet(new osg::DrawArrays(GL_POINTS, 0, count));
+        geom->setStateSet(getSharedStateSet());
+
+        osg::MatrixTransform* root = new osg::MatrixTransform();
+        root->setMatrix(
+            osg::Matrixd::scale(volumeScale / 65535.0) *
+            osg::Matrixd::translate(volumeOffset + volumeScale * (32768.0 / 65535.0) + rtc));
+        root->addChild(geom.get());
+
+        osg::StateSet* stateSet = root->getOrCreateStateSet();
+        stateSet->addUniform(new osg::Uniform("oe_pnts_spacing", (float)computeSpacing(volumeScale, count)));
+
+        if (!normals)
+        {
+            GLUtils::setLighting(stateSet, osg::StateAttribute::OFF);
+        }
+
+        if (translucent)
+        {
+            stateSet->setAttributeAndModes(new osg::BlendFunc(), osg::StateAttribute::ON);
+            stateSet->setRenderingHint(osg::StateSet::TRANSPARENT_BIN);
+        }
+
+        return root;
+    }
+
+private:
+
+    //! Reads POSITION or POSITION_QUANTIZED into 16-bit positions in the
+    //! volume [offset, offset+scale]. The positions are stored signed, less
+    //! 32768, since fixed-function GL has no unsigned short vertex arrays.
+    static bool readPositions(const FeatureTable& features, unsigned count, osg::Vec3sArray& verts, osg::Vec3d& volumeOffset, osg::Vec3d& volumeScale)
+    {
+        std::vector<unsigned short> shorts;
+        if (features.getArray("POSITION_QUANTIZED", count * 3, shorts) &&
+            features.getVec3("QUANTIZED_VOLUME_OFFSET", volumeOffset) &&
+            features.getVec3("QUANTIZED_VOLUME_SCALE", volumeScale))
+        {
+            for (unsigned i = 0; i < count; ++i)
+            {
+                verts[i].set(
+                    (short)((int)shorts[i * 3] - 32768),
+                    (short)((int)shorts[i * 3 + 1] - 32768),
+                    (short)((int)shorts[i * 3 + 2] - 32768));
+            }
+            return true;
+        }
+
+        std::vector<float> floats;
+        if (!features.getArray("POSITION", count * 3, floats))
+            return false;
+
+        osg::BoundingBoxd bounds;
+        for (unsigned i = 0; i < count; ++i)
+            bounds.expandBy(floats[i * 3], floats[i * 3 + 1], floats[i * 3 + 2]);
+
+        volumeOffset = bounds._min;
+        volumeScale = bounds._max - bounds._min;
+        for (unsigned k = 0; k < 3; ++k)
+            volumeScale[k] = osg::maximum(volumeScale[k], 1e-6);
+
+        for (unsigned i = 0; i < count; ++i)
+        {
+            osg::Vec3d q;
+            for (unsigned k = 0; k < 3; ++k)
+                q[k] = osg::round(((double)floats[i * 3 + k] - volumeOffset[k]) / volumeScale[k] * 65535.0) - 32768.0;
+            verts[i].set((short)q.x(), (short)q.y(), (short)q.z());
+        }
+        return true;
+    }
+
+    //! Reads RGBA, RGB, RGB565 or CONSTANT_RGBA. Returns NULL to use the default color.
+    static osg::Vec4ubArray* readColors(const FeatureTable& features, unsigned count, bool& translucent)
+    {
+        std::vector<unsigned char> bytes;
+        std::vector<unsigned short> shorts;
+
+        if (features.getArray("RGBA", count * 4, bytes))
+        {
+            osg::Vec4ubArray* colors = new osg::Vec4ubArray(count);
+            for (unsigned i = 0; i < count; ++i)
+            {
+                (*colors)[i].set(bytes[i * 4], bytes[i * 4 + 1], bytes[i * 4 + 2], bytes[i * 4 + 3]);
+                translucent = translucent || bytes[i * 4 + 3] < 255;
+            }
+            return colors;
+        }
+
+        if (features.getArray("RGB", count * 3, bytes))
+        {
+            osg::Vec4ubArray* colors = new osg::Vec4ubArray(count);
+            for (unsigned i = 0; i < count; ++i)
+                (*colors)[i].set(bytes[i * 3], bytes[i * 3 + 1], bytes[i * 3 + 2], 255);
+            return colors;
+        }
+
+        if (features.getArray("RGB565", count, shorts))
+        {
+            osg::Vec4ubArray* colors = new osg::Vec4ubArray(count);
+            for (unsigned i = 0; i < count; ++i)
+            {
+                unsigned short c = shorts[i];
+                (*colors)[i].set(
+                    (unsigned char)(((c >> 11) & 0x1f) * 255 / 31),
+                    (unsigned char)(((c >> 5) & 0x3f) * 255 / 63),
+                    (unsigned char)((c & 0x1f) * 255 / 31),
+                    255);
+            }
+            return colors;
+        }
+
+        std::vector<unsigned> constant;
+        if (features.getGlobal("CONSTANT_RGBA", 4, constant))
+        {
+            osg::Vec4ubArray* colors = new osg::Vec4ubArray(1);
+            (*colors)[0].set(constant[0], constant[1], constant[2], constant[3]);
+            translucent = constant[3] < 255;
+            return colors;
+        }
+
+        return NULL;
+    }
+
+    //! Reads NORMAL or NORMAL_OCT16P into bytes. The dequantization scale in
+    //! the parent transform would skew the normals, so they are pre-scaled
+    //! to come out right.
+    static osg::Vec3bArray* readNormals(const FeatureTable& features, unsigned count, const osg::Vec3d& volumeScale)
+    {
+        std::vector<osg::Vec3f> normals;
+        std::vector<float> floats;
+        std::vector<unsigned char> bytes;
+
+        if (features.getArray("NORMAL", count * 3, floats))
+        {
+            normals.resize(count);
+            for (unsigned i = 0; i < count; ++i)
+                normals[i].set(floats[i * 3], floats[i * 3 + 1], floats[i * 3 + 2]);
+        }
+        else if (features.getArray("NORMAL_OCT16P", count * 2, bytes))
+        {
+            normals.resize(count);
+            for (unsigned i = 0; i < count; ++i)
+            {
+                normals[i] = FeatureTable::octDecode(
+                    (float)bytes[i * 2] / 255.0f * 2.0f - 1.0f,
+                    (float)bytes[i * 2 + 1] / 255.0f * 2.0f - 1.0f);
+            }
+        }
+        else
+        {
+            return NULL;
+        }
+
+        osg::Vec3f skew(volumeScale.x(), volumeScale.y(), volumeScale.z());
+        osg::Vec3bArray* out = new osg::Vec3bArray(count);
+        for (unsigned i = 0; i < count; ++i)
+        {
+            osg::Vec3f n(normals[i].x() * skew.x(), normals[i].y() * skew.y(), normals[i].z() * skew.z());
+            n.normalize();
+            (*out)[i].set(
+                (signed char)osg::round(n.x() * 127.0f),
+                (signed char)osg::round(n.y() * 127.0f),
+                (signed char)osg::round(n.z() * 127.0f));
+        }
+        return out;
+    }
+
+    //! Average distance between neighboring points, from the density of
+    //! the points in their volume (or area, for flat clouds).
+    static double computeSpacing(const osg::Vec3d& volumeScale, unsigned count)
+    {
+        double e[3] = { volumeScale.x(), volumeScale.y(), volumeScale.z() };
+        std::sort(e, e + 3);
+        if (e[0] < 0.1 * e[1])
+            return sqrt(e[1] * e[2] / (double)count);
+        else
+            return cbrt(e[0] * e[1] * e[2] / (double)count);
+    }
+
+    //! State shared by every point cloud, so they sort together
+    static osg::StateSet* getSharedStateSet()
+    {
+        static osg::ref_ptr<osg::StateSet> s_stateSet;
+        static Threading::Mutex s_mutex(OE_MUTEX_NAME);
+        Threading::ScopedMutexLock lock(s_mutex);
+
+        if (!s_stateSet.valid())
+        {
+            const char* VS =
+                "#version " GLSL_VERSION_STR "\n"
+                GLSL_DEFAULT_PRECISION_FLOAT "\n"
+                "uniform vec3 oe_Camera;\n"
+                "uniform float oe_pnts_spacing;\n"
+                "uniform float oe_pnts_scale;\n"
+                "uniform float oe_pnts_max_size;\n"
+                "void oe_pnts_VS(inout vec4 vertexView)\n"
+                "{\n"
+                "    vec4 clip = gl_ProjectionMatrix * vertexView;\n"
+                "    float pixelsPerMeter = gl_ProjectionMatrix[1][1] * 0.5 * oe_Camera.y / clip.w;\n"
+                "    gl_PointSize = clamp(oe_pnts_scale * oe_pnts_spacing * pixelsPerMeter, 1.0, oe_pnts_max_size);\n"
+                "}\n";
+
+            const char* FS =
+                "#version " GLSL_VERSION_STR "\n"
+                GLSL_DEFAULT_PRECISION_FLOAT "\n"
+                "uniform float oe_pnts_shading;\n"
+                "void oe_pnts_FS(inout vec4 color)\n"
+                "{\n"
+                "    vec2 c = 2.0*gl_PointCoord - 1.0;\n"
+                "    float r2 = dot(c, c);\n"
+                "    if (r2 > 1.0)\n"
+                "        discard;\n"
+                "    color.rgb *= mix(1.0 - oe_pnts_shading, 1.0, sqrt(1.0 - r2));\n"
+                "}\n";
+
+            osg::ref_ptr<osg::StateSet> stateSet = new osg::StateSet();
+            VirtualProgram* vp = VirtualProgram::getOrCreate(stateSet.get());
+            vp->setName("3D Tiles Points");
+            vp->setFunction("oe_pnts_VS", VS, ShaderComp::LOCATION_VERTEX_VIEW);
+            vp->setFunction("oe_pnts_FS", FS, ShaderComp::LOCATION_FRAGMENT_COLORING);
+
+            stateSet->setMode(GL_PROGRAM_POINT_SIZE, osg::StateAttribute::ON);
+            stateSet->setTextureAttributeAndModes(0, new osg::PointSprite(), osg::StateAttribute::ON);
+            stateSet->addUniform(new osg::Uniform("oe_pnts_scale", 1.0f));
+            stateSet->addUniform(new osg::Uniform("oe_pnts_max_size", 16.0f));
+            stateSet->addUniform(new osg::Uniform("oe_pnts_shading", 0.5f));
+
+            s_stateSet = stateSet.get();
+        }
+        return s_stateSet.get();
+    }
+};
+
+#endif // OSGEARTH_PNTS_READER_H
@@ -40,6 +40,8 @@ using namespace tinygltf;
 #include "GLTFWriter.h"
 #include "B3DMReader.h"
 #include "B3DMWriter.h"
+#include "I3DMReader.h"
+#include "PNTSReader.h"
 
 #include <osgDB/FileNameUtils>
 #include <osgDB/Registry>
@@ -59,6 +61,8 @@ public:
         supportsExtension("gltf", "glTF ascii loader");
         supportsExtension("glb", "glTF binary loader");
         supportsExtension("b3dm", "b3dm loader");
+        supportsExtension("i3dm", "i3dm loader");
+        supportsExtension("pnts", "pnts loader");
     }
 
     virtual const char* className() const { return "glTF plugin"; }
@@ -95,6 +99,19 @@ public:
             reader.setTextureCache(&_cache);
             return reader.read(location, data, options);
         }
+        else if (ext == "i3dm")
+        {
+            std::string data = URI(location).getString(options);
+            I3DMReader reader;
+            reader.setTextureCache(&_cache);
+            return reader.read(location, data, options);
+        }
+        else if (ext == "pnts")
+        {
+            std::string data = URI(location).getString(options);
+            PNTSReader reader;
+            return reader.read(location, data, options);
+        }
         else return ReadResult::FILE_NOT_HANDLED;
     }
 
@@ -123,6 +140,17 @@ public:
             reader.setTextureCache(&_cache);
             return reader.read(context.referrer(), buffer, options);
         }
+        else if (magic == "i3dm")
+        {
+            I3DMReader reader;
+            reader.setTextureCache(&_cache);
+            return reader.read(context.referrer(), buffer, options);
+        }
+        else if (magic == "pnts")
+        {
+            PNTSReader reader;
+            return reader.read(context.referrer(), buffer, options);
+        }
         else return ReadResult::FILE_NOT_HANDLED;
     }
 
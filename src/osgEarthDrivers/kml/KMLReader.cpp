@@ -20,6 +20,7 @@
 #include "KML_Root"
 #include "KML_Geometry"
 #include <osgEarth/Registry>
+#include <osgEarth/StateSetCache>
 #include <osgEarth/Capabilities>
 #include <osgEarth/XmlUtils>
 #include <osgEarth/VirtualProgram>
@@ -47,16 +48,13 @@ KMLReader::read( std::istream& in, const osgDB::Options* dbOptions )
     // pull the URI context out of the DB options:
     URIContext context(dbOptions);
 
-	// Load the XML
+	// Load the XML. The source outlives the read when regions build later.
     osg::Timer_t start = osg::Timer::instance()->tick();
-	std::stringstream buffer;
-    buffer << in.rdbuf();
-    std::string xmlStr;
-    xmlStr = buffer.str();
-	xml_document<> doc;
-	doc.parse<0>(&xmlStr[0]);
+    osg::ref_ptr<KMLSource> source = new KMLSource();
+    source->_xml.assign( std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>() );
+	source->_doc.parse<0>(&source->_xml[0]);
 
-	osg::Node* node = read(doc, dbOptions);
+	osg::Node* node = read(source->_doc, dbOptions, source.get());
 
     osg::Timer_t end = osg::Timer::instance()->tick();
 	OE_INFO << LC << "Loaded KML in " << osg::Timer::instance()->delta_s(start, end) << std::endl;
@@ -67,6 +65,12 @@ KMLReader::read( std::istream& in, const osgDB::Options* dbOptions )
 
 osg::Node*
 KMLReader::read( xml_document<>& doc, const osgDB::Options* dbOptions )
+{
+    return read( doc, dbOptions, 0L );
+}
+
+osg::Node*
+KMLReader::read( xml_document<>& doc, const osgDB::Options* dbOptions, KMLSource* source )
 {
     osg::Group* root = new osg::Group();
     root->ref();
@@ -104,6 +108,14 @@ KMLReader::read( xml_document<>& doc, const osgDB::Options* dbOptions )
     if ( cx._options == 0L )
         cx._options = &blankOptions;
 
+    // contents built after the read need their own copy of the options
+    if ( source )
+    {
+        source->_options = *cx._options;
+        cx._options = &source->_options;
+        cx._source = source;
+    }
+
     //if ( cx._options->iconAndLabelGroup().valid() && cx._options->declutter() == true )
     //{
     //    Decluttering::setEnabled( cx._options->iconAndLabelGroup()->getOrCreateStateSet(), true );
@@ -136,6 +148,11 @@ KMLReader::read( xml_document<>& doc, const osgDB::Options* dbOptions )
     CacheStats stats = cacheUsed->getStats();
     OE_INFO << LC << "  URI Cache: " << stats._queries << " reads, " << (stats._hitRatio*100.0) << "% hits" << std::endl;
 
+    // Placemarks repeat a handful of styles; share their attributes before
+    // the graph goes live. Statesets stay separate since annotations edit
+    // their own state later.
+    Registry::stateSetCache()->consolidateStateAttributes(root);
+
     // Make sure the KML gets rendered after the terrain.
     root->getOrCreateStateSet()->setRenderBinDetails(2, "RenderBin");
 
@@ -24,6 +24,7 @@
 #include "KML_GroundOverlay"
 #include "KML_NetworkLink"
 #include "KML_Placemark"
+#include "KML_Region"
 
 using namespace osgEarth_kml;
 
@@ -50,7 +51,19 @@ KML_Folder::build( xml_node<>* node, KMLContext& cx )
     cx._groupStack.push( group );
 
     KML_Container::build(node, cx, group);
-    for_features(build, node, cx);
+
+    // region-bound contents build once the region is in view
+    osg::Node* paged = KML_Region::createPagedContents(node, cx, &KML_Folder::buildContents);
+    if ( paged )
+        group->addChild( paged );
+    else
+        buildContents(node, cx);
 
     cx._groupStack.pop();
 }
+
+void
+KML_Folder::buildContents( xml_node<>* node, KMLContext& cx )
+{
+    for_features_build(node, cx);
+}
@@ -17,11 +17,9 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>
  */
 #include "KML_NetworkLink"
-#include <osgEarth/GeoMath>
+#include "KML_Region"
 #include <osgEarth/Registry>
-#include <osg/PagedLOD>
-#include <osg/ProxyNode>
-#include <osg/Version>
+#include <osgDB/ReadFile>
 
 #undef  LC
 #define LC "[KML_NetworkLink] "
@@ -46,78 +44,28 @@ KML_NetworkLink::build( xml_node<>* node, KMLContext& cx )
     // "open" determines whether to load it immediately
     bool open = as<bool>(getValue(node, "open"), false);
 
-    // if it's region-bound, parse it as a paged LOD:
-    xml_node<>* region = node->first_node("region", 0, false);
-    if ( region )
-    {
-        xml_node<>* llaBox = region->first_node("latlonaltbox", 0, false);
-        if ( !llaBox )
-            return;
-
-        const SpatialReference* geoSRS = cx._mapNode->getMapSRS()->getGeographicSRS();
-
-        GeoExtent llaExtent(
-            geoSRS,
-            as<double>(getValue(llaBox, "west"), 0.0),
-			as<double>(getValue(llaBox, "south"), 0.0),
-			as<double>(getValue(llaBox, "east"), 0.0),
-			as<double>(getValue(llaBox, "north"), 0.0));
-
-        // find the ECEF LOD center point:
-        double x, y;
-        llaExtent.getCentroid( x, y );
-        osg::Vec3d lodCenter;
-        llaExtent.getSRS()->transform( osg::Vec3d(x,y,0), geoSRS->getGeocentricSRS(), lodCenter );
-        //llaExtent.getSRS()->transformToECEF( osg::Vec3d(x,y,0), lodCenter );
-
-        // figure the tile radius:
-        double d = 0.5 * GeoMath::distance(
-            osg::DegreesToRadians(llaExtent.yMin()), osg::DegreesToRadians(llaExtent.xMin()),
-            osg::DegreesToRadians(llaExtent.yMax()), osg::DegreesToRadians(llaExtent.xMax()) );
-
-        // parse the LOD ranges:
-        float minRange = 0, maxRange = 1e6;
-        xml_node<>* lod = region->first_node("lod", 0, false);
-        if ( lod ) 
-        {
-            // swapped
-            minRange = as<float>(getValue(lod, "minlodpixels"), 0.0f);
-            if ( minRange < 0.0f )
-                minRange = 0.0f;
-			maxRange = as<float>(getValue(lod, "maxlodpixels"), FLT_MAX);
-            if ( maxRange < 0.0f )
-                maxRange = FLT_MAX;
-        }
-
-        // build the node
-        osg::PagedLOD* plod = new osg::PagedLOD();
-        plod->setRangeMode( osg::LOD::PIXEL_SIZE_ON_SCREEN );
+    osg::ref_ptr<osgDB::Options> options = Registry::instance()->cloneOrCreateOptions();
+    options->setPluginData( "osgEarth::MapNode", cx._mapNode );
 
-        plod->setFileName( 0, href );
-        plod->setRange( 0, minRange, maxRange );
-        plod->setCenter( lodCenter );
-        plod->setRadius( d );
-
-        osgDB::Options* options = Registry::instance()->cloneOrCreateOptions();
-        options->setPluginData( "osgEarth::MapNode", cx._mapNode );
-        plod->setDatabaseOptions( options );
+    // loads the linked document on the pager, off the frame
+    KMLPagedNode::Loader loader = [href, options]() -> osg::Node*
+    {
+        return osgDB::readRefNodeFile( href, options.get() ).release();
+    };
 
+    // if it's region-bound, load it when the region comes into view:
+    osg::BoundingSphere bound;
+    float minRange, maxRange;
+    if ( KML_Region::parse(node, cx, bound, minRange, maxRange) )
+    {
         OE_DEBUG << LC << 
-            "PLOD: radius = " << d << ", minRange=" << minRange << ", maxRange=" << maxRange << std::endl;
+            "Region: radius = " << bound.radius() << ", minRange=" << minRange << ", maxRange=" << maxRange << std::endl;
 
-        cx._groupStack.top()->addChild( plod );
+        cx._groupStack.top()->addChild( new KMLPagedNode(bound, minRange, maxRange, loader) );
     }
 
-    else 
+    else if ( node->first_node("region", 0, false) == 0L )
     {
-        osg::ProxyNode* proxy = new osg::ProxyNode();
-        proxy->setFileName( 0, href );                
-
-        osgDB::Options* options = Registry::instance()->cloneOrCreateOptions();
-        options->setPluginData( "osgEarth::MapNode", cx._mapNode );
-        proxy->setDatabaseOptions( options );
-
-        cx._groupStack.top()->addChild( proxy );
+        cx._groupStack.top()->addChild( new KMLPagedNode(loader) );
     }
-
 }
@@ -26,15 +26,125 @@
 #include <osgEarth/ModelNode>
 #include <osgEarth/ObjectIndex>
 #include <osgEarth/Registry>
+#include <osgEarth/Threading>
 
 #include <osg/Depth>
 #include <osgDB/WriteFile>
+#include <atomic>
+#include <memory>
 
 using namespace osgEarth_kml;
 using namespace osgEarth;
 
-void 
+namespace
+{
+    // placemarks per job when building in parallel
+    const unsigned BATCH_SIZE = 64u;
+
+    // State of a parallel build; shared with jobs that may start after
+    // the build is over and find nothing left to do.
+    struct BatchState
+    {
+        BatchState(unsigned count) : _count(count), _next(0u), _done(0u) { }
+        unsigned _count;
+        std::atomic_uint _next;
+        std::atomic_uint _done;
+        Threading::Event _finished;
+    };
+
+    // Runs func(i) for i in [0, count) on the "kml" job arena, with the
+    // calling thread working too. Waits only on batches that already
+    // started, so it can't deadlock when called from a job thread.
+    template<typename FUNC>
+    void runBatches(unsigned count, const FUNC& func)
+    {
+        std::shared_ptr<BatchState> state = std::make_shared<BatchState>(count);
+
+        auto work = [state, &func]()
+        {
+            for (unsigned i = state->_next++; i < state->_count; i = state->_next++)
+            {
+                func(i);
+                if (++state->_done == state->_count)
+                    state->_finished.set();
+            }
+        };
+
+        Threading::JobArena* arena = Registry::instance()->getJobArena("kml");
+        unsigned numJobs = osg::minimum(count, arena->getConcurrency());
+        for (unsigned j = 0; j < numJobs; ++j)
+        {
+            Threading::runInJobArena(arena, [state, work]() { work(); });
+        }
+
+        work();
+        state->_finished.wait();
+    }
+}
+
+void
+KML_Placemark::buildAll( xml_node<>* parent, KMLContext& cx )
+{
+    if ( !parent )
+        return;
+
+    std::vector<xml_node<>*> nodes;
+    for (xml_node<>* n = parent->first_node("placemark", 0, false); n; n = n->next_sibling("placemark", 0, false))
+        nodes.push_back( n );
+
+    // Screen-space items go to a shared group; keep those in order on one thread.
+    if ( nodes.size() < 2u * BATCH_SIZE || cx._options->iconAndLabelGroup().valid() )
+    {
+        for (auto n : nodes)
+        {
+            KML_Placemark instance;
+            instance.build( n, cx );
+        }
+        return;
+    }
+
+    // Styles can write to the shared style sheet, so resolve them up front.
+    std::vector<Style> styles( nodes.size() );
+    for (unsigned i = 0; i < nodes.size(); ++i)
+    {
+        KML_Placemark instance;
+        styles[i] = instance.getStyle( nodes[i], cx );
+    }
+
+    // Each batch builds into its own group; add them in document order.
+    unsigned numBatches = ((unsigned)nodes.size() + BATCH_SIZE - 1u) / BATCH_SIZE;
+    std::vector< osg::ref_ptr<osg::Group> > results( numBatches );
+
+    runBatches( numBatches, [&](unsigned b)
+    {
+        KMLContext local = cx;
+        results[b] = new osg::Group();
+        local._groupStack.push( results[b].get() );
+
+        unsigned end = osg::minimum( (b + 1u) * BATCH_SIZE, (unsigned)nodes.size() );
+        for (unsigned i = b * BATCH_SIZE; i < end; ++i)
+        {
+            KML_Placemark instance;
+            instance.build( nodes[i], local, styles[i] );
+        }
+    });
+
+    osg::Group* group = cx._groupStack.top().get();
+    for (auto& batch : results)
+    {
+        for (unsigned i = 0; i < batch->getNumChildren(); ++i)
+            group->addChild( batch->getChild(i) );
+    }
+}
+
+void
 KML_Placemark::build( xml_node<>* node, KMLContext& cx )
+{
+    build( node, cx, getStyle(node, cx) );
+}
+
+Style
+KML_Placemark::getStyle( xml_node<>* node, KMLContext& cx )
 {
 	Style masterStyle;
 
@@ -57,6 +167,12 @@ KML_Placemark::build( xml_node<>* node, KMLContext& cx )
 		masterStyle = masterStyle.combineWith(cx._activeStyle);
 	}
 
+    return masterStyle;
+}
+
+void
+KML_Placemark::build( xml_node<>* node, KMLContext& cx, Style masterStyle )
+{
     // parse the geometry. the placemark must have geometry to be valid. The 
     // geometry parse may optionally specify an altitude mode as well.
     KML_Geometry geometry;
@@ -0,0 +1,150 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+ * Copyright 2020 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include "KML_Region"
+#include <osgEarth/GeoMath>
+#include <osg/LOD>
+
+using namespace osgEarth_kml;
+using namespace osgEarth;
+
+bool
+KML_Region::parse( xml_node<>* node, KMLContext& cx, osg::BoundingSphere& bound, float& minPixels, float& maxPixels )
+{
+    xml_node<>* region = node ? node->first_node("region", 0, false) : 0L;
+    if ( !region )
+        return false;
+
+    xml_node<>* llaBox = region->first_node("latlonaltbox", 0, false);
+    if ( !llaBox )
+        return false;
+
+    const SpatialReference* geoSRS = cx._mapNode->getMapSRS()->getGeographicSRS();
+
+    GeoExtent llaExtent(
+        geoSRS,
+        as<double>(getValue(llaBox, "west"), 0.0),
+        as<double>(getValue(llaBox, "south"), 0.0),
+        as<double>(getValue(llaBox, "east"), 0.0),
+        as<double>(getValue(llaBox, "north"), 0.0));
+
+    // find the ECEF LOD center point:
+    double x, y;
+    llaExtent.getCentroid( x, y );
+    osg::Vec3d lodCenter;
+    llaExtent.getSRS()->transform( osg::Vec3d(x,y,0), geoSRS->getGeocentricSRS(), lodCenter );
+
+    // figure the tile radius:
+    double d = 0.5 * GeoMath::distance(
+        osg::DegreesToRadians(llaExtent.yMin()), osg::DegreesToRadians(llaExtent.xMin()),
+        osg::DegreesToRadians(llaExtent.yMax()), osg::DegreesToRadians(llaExtent.xMax()) );
+
+    bound.set( lodCenter, d );
+
+    // parse the LOD ranges:
+    minPixels = 0.0f;
+    maxPixels = FLT_MAX;
+    xml_node<>* lod = region->first_node("lod", 0, false);
+    if ( lod )
+    {
+        minPixels = as<float>(getValue(lod, "minlodpixels"), 0.0f);
+        if ( minPixels < 0.0f )
+            minPixels = 0.0f;
+        maxPixels = as<float>(getValue(lod, "maxlodpixels"), FLT_MAX);
+        if ( maxPixels < 0.0f )
+            maxPixels = FLT_MAX;
+    }
+
+    return true;
+}
+
+osg::Node*
+KML_Region::createPagedContents( xml_node<>* node, KMLContext& cx, void (*build)(xml_node<>*, KMLContext&) )
+{
+    // Contents built later need the document text to still be around,
+    // and must not touch the shared screen-space group off the frame.
+    if ( !cx._source.valid() || cx._options->iconAndLabelGroup().valid() )
+        return 0L;
+
+    osg::BoundingSphere bound;
+    float minPixels, maxPixels;
+    if ( !parse(node, cx, bound, minPixels, maxPixels) )
+        return 0L;
+
+    KMLContext lazy = cx;
+    lazy._groupStack = std::stack<osg::ref_ptr<osg::Group> >();
+    osg::observer_ptr<MapNode> mapNode = cx._mapNode;
+
+    KMLPagedNode::Loader loader = [node, lazy, mapNode, build]() -> osg::Node*
+    {
+        osg::ref_ptr<MapNode> mapNodeSafe;
+        if ( !mapNode.lock(mapNodeSafe) )
+            return 0L;
+
+        KMLContext local = lazy;
+
+        // Inline styles write to the sheet, and regions may load in
+        // parallel, so each load gets its own copy.
+        local._sheet = new StyleSheet();
+        for (auto& style : lazy._sheet->getStyles())
+            local._sheet->addStyle( style.second );
+
+        osg::Group* group = new osg::Group();
+        local._groupStack.push( group );
+        build( node, local );
+        return group;
+    };
+
+    return new KMLPagedNode( bound, minPixels, maxPixels, loader );
+}
+
+KMLPagedNode::KMLPagedNode( const osg::BoundingSphere& bound, float minPixels, float maxPixels, const Loader& loader ) :
+    _bound( bound ),
+    _maxPixels( maxPixels ),
+    _loader( loader )
+{
+    setRangeMode( osg::LOD::PIXEL_SIZE_ON_SCREEN );
+    setRange( minPixels );
+    setupPaging();
+}
+
+KMLPagedNode::KMLPagedNode( const Loader& loader ) :
+    _maxPixels( FLT_MAX ),
+    _loader( loader )
+{
+    // no region, so always in range
+    setRangeMode( osg::LOD::DISTANCE_FROM_EYE_POINT );
+    setRange( FLT_MAX );
+    setupPaging();
+}
+
+osg::Node*
+KMLPagedNode::loadChild()
+{
+    osg::ref_ptr<osg::Node> node = _loader();
+    if ( !node.valid() || _maxPixels == FLT_MAX || !_bound.valid() )
+        return node.release();
+
+    // hide the content once the region is larger than maxLodPixels
+    osg::LOD* lod = new osg::LOD();
+    lod->setRangeMode( osg::LOD::PIXEL_SIZE_ON_SCREEN );
+    lod->setCenter( _bound.center() );
+    lod->setRadius( _bound.radius() );
+    lod->addChild( node.get(), 0.0f, _maxPixels );
+    return lod;
+}
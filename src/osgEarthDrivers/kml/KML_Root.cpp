@@ -45,6 +45,6 @@ KML_Root::scan2( xml_node<>* node, KMLContext& cx )
 void
 KML_Root::build( xml_node<>* node, KMLContext& cx )
 {
-    for_features( build, node, cx );
+    for_features_build( node, cx );
     for_one( NetworkLink, build, node, cx );
 }
@@ -1,7 +1,7 @@
 #ifndef RAPIDXML_EXT_HPP_INCLUDED 
 #define RAPIDXML_EXT_HPP_INCLUDED 1
 
-#include "rapidxml.hpp"
+#include <osgEarth/rapidxml.hpp>
 #include <string>
 
 #include <osgEarth/StringUtils>
@@ -21,6 +21,8 @@
 
 #include <osgEarth/FeatureNode>
 #include <osgEarth/Style>
+#include <osgEarth/Memory>
+#include <osgEarth/Registry>
 
 #include <osgGA/GUIEventHandler>
 
@@ -43,6 +45,15 @@ namespace
             {
                 _ext->frame(aa.asView()->getFrameStamp());
             }
+
+            // dump the memory report to the console
+            else if (ea.getEventType() == ea.KEYDOWN && ea.getKey() == 'M')
+            {
+                Memory::Report report;
+                Registry::instance()->getMemoryReport(report);
+                OE_NOTICE << LC << "Memory report:\n";
+                Memory::writeReport(report, osg::notify(osg::NOTICE));
+            }
             return false;
         }
 
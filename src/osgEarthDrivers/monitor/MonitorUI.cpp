@@ -28,6 +28,14 @@ namespace ui = osgEarth::Util::Controls;
 
 #define LC "[MonitorUI] "
 
+namespace
+{
+    std::string megabytes(std::int64_t bytes)
+    {
+        return Stringify() << (bytes / 1048576) << " M";
+    }
+}
+
 MonitorUI::MonitorUI()
 {
     this->setHorizAlign(ALIGN_LEFT);
@@ -52,6 +60,20 @@ MonitorUI::MonitorUI()
     _ppb->setHorizAlign(ALIGN_RIGHT);
     this->setControl(1, r, _ppb.get());
     ++r;
+
+    this->setControl(0, r, new ui::LabelControl("GL Textures:"));
+    _tex = new ui::LabelControl();
+    _tex->setHorizAlign(ALIGN_RIGHT);
+    this->setControl(2, r, _tex.get());
+    ++r;
+
+    this->setControl(0, r, new ui::LabelControl("GL Buffers:"));
+    _buf = new ui::LabelControl();
+    _buf->setHorizAlign(ALIGN_RIGHT);
+    this->setControl(2, r, _buf.get());
+    ++r;
+
+    _numRows = r;
 }
 
 void
@@ -63,6 +85,31 @@ MonitorUI::update(const osg::FrameStamp* fs)
         _pb->setText(Stringify() << (Memory::getProcessPrivateUsage() / 1048576) << " M");
         _ppb->setText(Stringify() << (Memory::getProcessPeakPrivateUsage() / 1048576) << " M");
 
+        Memory::Report report;
+        Registry::instance()->getMemoryReport(report);
+
+        _tex->setText(megabytes(report._glTextureBytes));
+        _buf->setText(megabytes(report._glBufferBytes));
+
+        // one row per subsystem: name, CPU, GPU
+        for (const auto& c : report._categories)
+        {
+            CategoryRow& row = _categories[c._name];
+            if (!row._cpu.valid())
+            {
+                this->setControl(0, _numRows, new ui::LabelControl(c._name + ":"));
+                row._cpu = new ui::LabelControl();
+                row._cpu->setHorizAlign(ALIGN_RIGHT);
+                this->setControl(1, _numRows, row._cpu.get());
+                row._gpu = new ui::LabelControl();
+                row._gpu->setHorizAlign(ALIGN_RIGHT);
+                this->setControl(2, _numRows, row._gpu.get());
+                ++_numRows;
+            }
+            row._cpu->setText(c._cpuBytes != 0 ? megabytes(c._cpuBytes) : std::string());
+            row._gpu->setText(c._gpuBytes != 0 ? megabytes(c._gpuBytes) : std::string());
+        }
+
         //Registry::instance()->startActivity("Current Mem", Stringify() <<  (bytes / 1048576) << " M");
         //Registry::instance()->startActivity("Peak Mem", Stringify() << (Memory::getProcessPeakUsage() / 1048576) << " M");
     }
@@ -0,0 +1,1055 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+ * Copyright 2020 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include <osgEarth/Notify>
+#include <osgEarth/StringUtils>
+#include <osg/BoundingBox>
+#include <osg/Geode>
+#include <osg/Geometry>
+#include <osg/Math>
+#include <osg/MatrixTransform>
+#include <osg/StateSet>
+#include <osgDB/ReaderWriter>
+#include <osgDB/Registry>
+#include <osgDB/ObjectWrapper>
+#include <osgDB/FileNameUtils>
+#include <osgDB/FileUtils>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <sstream>
+#include <vector>
+
+#define LC "[OEFT] "
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+/**
+ * Compact binary format for compiled feature tiles ("osgEarth feature tile").
+ *
+ * Covers the plain scene graphs the feature compilers emit: Groups, Geodes,
+ * MatrixTransforms and osg::Geometry with float or unsigned byte vertex
+ * arrays and DrawArrays/DrawArrayLengths/DrawElements primitive sets.
+ * Each array is stored as one block that loads with a single memcpy unless
+ * it was quantized:
+ *
+ *   - vertices:  16 bits per component over the array's bounding box, when
+ *                that stays within the write precision; floats otherwise
+ *   - normals:   16-bit signed normalized
+ *   - colors:    8-bit unsigned normalized, when all components are in [0..1]
+ *
+ * State sets go into a material table, each one written once with the osgb
+ * serializer and referenced by index. Anything else (node subclasses,
+ * callbacks, user data, other array types) makes writeNode return
+ * FILE_NOT_HANDLED so the caller can fall back to a full osgb record.
+ *
+ * Layout (little-endian):
+ *   char[4]  "OEFT"
+ *   uint32   version
+ *   uint32   flags
+ *   uint32   uncompressed payload size
+ *   ...      payload (zlib-compressed if FLAG_COMPRESSED is set):
+ *            material table, then the node tree, depth first
+ *
+ * Option string tokens: "OEFT_PRECISION <meters>" sets the vertex precision
+ * (default 1mm) and "OEFT_UNCOMPRESSED" skips the zlib pass.
+ */
+namespace
+{
+    const char     OEFT_MAGIC[4] = { 'O', 'E', 'F', 'T' };
+    const unsigned OEFT_VERSION = 1u;
+    const double   OEFT_DEFAULT_PRECISION = 0.001;
+
+    enum
+    {
+        FLAG_COMPRESSED = 1 << 0
+    };
+
+    enum NodeType
+    {
+        NODE_GROUP     = 1,
+        NODE_TRANSFORM = 2,
+        NODE_GEODE     = 3,
+        NODE_GEOMETRY  = 4
+    };
+
+    enum Encoding
+    {
+        ENCODING_RAW     = 0,
+        ENCODING_QUANT16 = 1,
+        ENCODING_SNORM16 = 2,
+        ENCODING_UNORM8  = 3
+    };
+
+    enum PrimitiveType
+    {
+        PRIM_DRAW_ARRAYS        = 0,
+        PRIM_DRAW_ARRAY_LENGTHS = 1,
+        PRIM_ELEMENTS_UBYTE     = 2,
+        PRIM_ELEMENTS_USHORT    = 3,
+        PRIM_ELEMENTS_UINT      = 4
+    };
+
+    // array slots, as in MeshConsolidator
+    enum
+    {
+        SLOT_VERTEX   = 0,
+        SLOT_NORMAL   = 1,
+        SLOT_COLOR    = 2,
+        SLOT_TEXCOORD = 16,
+        SLOT_ATTRIB   = 64
+    };
+
+    inline void put8(std::string& buf, unsigned v)
+    {
+        buf.push_back((char)(v & 0xff));
+    }
+
+    inline void put32(std::string& buf, unsigned v)
+    {
+        for (int i = 0; i < 4; ++i)
+            buf.push_back((char)((v >> (8 * i)) & 0xff));
+    }
+
+    inline void putFloat(std::string& buf, float f)
+    {
+        unsigned v;
+        ::memcpy(&v, &f, 4);
+        put32(buf, v);
+    }
+
+    inline void putDouble(std::string& buf, double d)
+    {
+        unsigned long long v;
+        ::memcpy(&v, &d, 8);
+        put32(buf, (unsigned)(v & 0xffffffffull));
+        put32(buf, (unsigned)(v >> 32));
+    }
+
+    inline void putString(std::string& buf, const std::string& s)
+    {
+        put32(buf, (unsigned)s.size());
+        buf.append(s);
+    }
+
+    inline void putBlock(std::string& buf, const void* data, unsigned size)
+    {
+        if (size > 0)
+            buf.append((const char*)data, size);
+    }
+
+    struct Reader
+    {
+        Reader(const std::string& buf) : _buf(buf), _pos(0), _ok(true) { }
+
+        unsigned get8()
+        {
+            if (_pos + 1 > _buf.size()) { _ok = false; return 0; }
+            return (unsigned)(unsigned char)_buf[_pos++];
+        }
+
+        unsigned get32()
+        {
+            if (_pos + 4 > _buf.size()) { _ok = false; return 0; }
+            unsigned v = 0;
+            for (int i = 0; i < 4; ++i)
+                v |= (unsigned)(unsigned char)_buf[_pos++] << (8 * i);
+            return v;
+        }
+
+        float getFloat()
+        {
+            unsigned v = get32();
+            float f;
+            ::memcpy(&f, &v, 4);
+            return f;
+        }
+
+        double getDouble()
+        {
+            unsigned long long lo = get32();
+            unsigned long long hi = get32();
+            unsigned long long v = lo | (hi << 32);
+            double d;
+            ::memcpy(&d, &v, 8);
+            return d;
+        }
+
+        std::string getString()
+        {
+            unsigned size = get32();
+            if (!_ok || _pos + size > _buf.size()) { _ok = false; return std::string(); }
+            std::string s = _buf.substr(_pos, size);
+            _pos += size;
+            return s;
+        }
+
+        // pointer to the next size bytes, or NULL if there aren't that many
+        const char* getBlock(std::size_t size)
+        {
+            if (!_ok || _pos + size > _buf.size()) { _ok = false; return NULL; }
+            const char* p = _buf.data() + _pos;
+            _pos += size;
+            return p;
+        }
+
+        const std::string& _buf;
+        std::size_t _pos;
+        bool _ok;
+    };
+
+    osgDB::BaseCompressor* getCompressor()
+    {
+        return osgDB::Registry::instance()->getObjectWrapperManager()->findCompressor("zlib");
+    }
+
+    osgDB::ReaderWriter* getStateSetSerializer()
+    {
+        return osgDB::Registry::instance()->getReaderWriterForExtension("osgb");
+    }
+
+    double getPrecision(const osgDB::Options* options)
+    {
+        if (options)
+        {
+            std::istringstream iss(options->getOptionString());
+            std::string token;
+            while (iss >> token)
+            {
+                if (ciEquals(token, "OEFT_PRECISION"))
+                {
+                    double value;
+                    if (iss >> value && value > 0.0)
+                        return value;
+                }
+            }
+        }
+        return OEFT_DEFAULT_PRECISION;
+    }
+
+    bool getCompress(const osgDB::Options* options)
+    {
+        if (options)
+        {
+            std::istringstream iss(options->getOptionString());
+            std::string token;
+            while (iss >> token)
+            {
+                if (ciEquals(token, "OEFT_UNCOMPRESSED"))
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    // exactly the named osg class, not a subclass with extra state
+    inline bool isPlain(const osg::Object& object, const char* className)
+    {
+        return
+            ::strcmp(object.libraryName(), "osg") == 0 &&
+            ::strcmp(object.className(), className) == 0;
+    }
+
+    inline bool isSupportedArrayType(osg::Array::Type type)
+    {
+        return
+            type == osg::Array::FloatArrayType ||
+            type == osg::Array::Vec2ArrayType ||
+            type == osg::Array::Vec3ArrayType ||
+            type == osg::Array::Vec4ArrayType ||
+            type == osg::Array::Vec4ubArrayType;
+    }
+
+    osg::Array* createArray(unsigned type, unsigned size)
+    {
+        switch (type)
+        {
+        case osg::Array::FloatArrayType:  return new osg::FloatArray(size);
+        case osg::Array::Vec2ArrayType:   return new osg::Vec2Array(size);
+        case osg::Array::Vec3ArrayType:   return new osg::Vec3Array(size);
+        case osg::Array::Vec4ArrayType:   return new osg::Vec4Array(size);
+        case osg::Array::Vec4ubArrayType: return new osg::Vec4ubArray(size);
+        default: return NULL;
+        }
+    }
+
+    inline unsigned short quantize16(float v, float offset, float scale)
+    {
+        if (scale <= 0.0f)
+            return 0;
+        float q = std::floor((v - offset) / scale + 0.5f);
+        return (unsigned short)osg::clampBetween(q, 0.0f, 65535.0f);
+    }
+
+    class Encoder
+    {
+    public:
+        Encoder(const osgDB::Options* options) :
+            _options(options),
+            _precision(getPrecision(options))
+        {
+            _stateSetSerializer = getStateSetSerializer();
+        }
+
+        //! Encodes the graph under node into the payload. False if any part
+        //! of it is outside what the format covers.
+        bool encode(const osg::Node& node, std::string& payload)
+        {
+            std::string nodes;
+            if (!writeNode(node, nodes))
+                return false;
+
+            put32(payload, (unsigned)_materials.size());
+            for (unsigned i = 0; i < _materials.size(); ++i)
+                putString(payload, _materials[i]);
+
+            payload.append(nodes);
+            return true;
+        }
+
+    private:
+        const osgDB::Options* _options;
+        double _precision;
+        osgDB::ReaderWriter* _stateSetSerializer;
+        std::vector<std::string> _materials;
+        std::map<const osg::StateSet*, int> _materialIndex;
+
+        bool hasExtras(const osg::Node& node) const
+        {
+            return
+                node.getUserDataContainer() != NULL ||
+                node.getUpdateCallback() != NULL ||
+                node.getEventCallback() != NULL ||
+                node.getCullCallback() != NULL;
+        }
+
+        // index of the state set in the material table (-1 for none)
+        bool getMaterial(const osg::StateSet* stateSet, int& index)
+        {
+            index = -1;
+            if (!stateSet)
+                return true;
+
+            std::map<const osg::StateSet*, int>::const_iterator i = _materialIndex.find(stateSet);
+            if (i != _materialIndex.end())
+            {
+                index = i->second;
+                return true;
+            }
+
+            if (!_stateSetSerializer)
+                return false;
+
+            std::stringstream buf;
+            if (!_stateSetSerializer->writeObject(*stateSet, buf, _options).success())
+                return false;
+
+            index = (int)_materials.size();
+            _materials.push_back(buf.str());
+            _materialIndex[stateSet] = index;
+            return true;
+        }
+
+        bool writeHeader(const osg::Node& node, NodeType type, std::string& out)
+        {
+            if (hasExtras(node))
+                return false;
+
+            int material;
+            if (!getMaterial(node.getStateSet(), material))
+                return false;
+
+            put8(out, type);
+            putString(out, node.getName());
+            put32(out, node.getNodeMask());
+            put32(out, (unsigned)material);
+            return true;
+        }
+
+        bool writeChildren(const osg::Group& group, std::string& out)
+        {
+            put32(out, group.getNumChildren());
+            for (unsigned i = 0; i < group.getNumChildren(); ++i)
+            {
+                if (!group.getChild(i) || !writeNode(*group.getChild(i), out))
+                    return false;
+            }
+            return true;
+        }
+
+        bool writeNode(const osg::Node& node, std::string& out)
+        {
+            const osg::Geometry* geom = node.asGeometry();
+            if (geom)
+            {
+                return isPlain(*geom, "Geometry") && writeGeometry(*geom, out);
+            }
+
+            if (isPlain(node, "MatrixTransform"))
+            {
+                const osg::MatrixTransform& xform = static_cast<const osg::MatrixTransform&>(node);
+                if (!writeHeader(node, NODE_TRANSFORM, out))
+                    return false;
+                put8(out, xform.getReferenceFrame());
+                const osg::Matrixd::value_type* m = xform.getMatrix().ptr();
+                for (unsigned i = 0; i < 16; ++i)
+                    putDouble(out, m[i]);
+                return writeChildren(xform, out);
+            }
+
+            if (isPlain(node, "Geode"))
+            {
+                return
+                    writeHeader(node, NODE_GEODE, out) &&
+                    writeChildren(*node.asGroup(), out);
+            }
+
+            if (isPlain(node, "Group"))
+            {
+                return
+                    writeHeader(node, NODE_GROUP, out) &&
+                    writeChildren(*node.asGroup(), out);
+            }
+
+            return false;
+        }
+
+        bool writeArray(unsigned slot, const osg::Array* array, std::string& out)
+        {
+            if (!isSupportedArrayType(array->getType()) || array->getUserDataContainer() != NULL)
+                return false;
+
+            unsigned numElements = array->getNumElements();
+            Encoding encoding = ENCODING_RAW;
+            osg::Vec3f offset, scale;
+
+            if (slot == SLOT_VERTEX && array->getType() == osg::Array::Vec3ArrayType && numElements > 0)
+            {
+                const osg::Vec3Array& v = static_cast<const osg::Vec3Array&>(*array);
+                osg::BoundingBoxf box;
+                for (unsigned i = 0; i < numElements; ++i)
+                    box.expandBy(v[i]);
+
+                // quantize only when the half-step error stays within precision
+                bool fits = true;
+                for (unsigned c = 0; c < 3; ++c)
+                {
+                    double extent = (double)box._max[c] - (double)box._min[c];
+                    offset[c] = box._min[c];
+                    scale[c] = (float)(extent / 65535.0);
+                    if (0.5 * extent / 65535.0 > _precision)
+                        fits = false;
+                }
+                if (fits)
+                    encoding = ENCODING_QUANT16;
+            }
+
+            else if (slot == SLOT_NORMAL && array->getType() == osg::Array::Vec3ArrayType)
+            {
+                encoding = ENCODING_SNORM16;
+            }
+
+            else if (slot == SLOT_COLOR && array->getType() == osg::Array::Vec4ArrayType)
+            {
+                const osg::Vec4Array& c = static_cast<const osg::Vec4Array&>(*array);
+                bool unit = true;
+                for (unsigned i = 0; i < numElements && unit; ++i)
+                    for (unsigned k = 0; k < 4 && unit; ++k)
+                        unit = c[i][k] >= 0.0f && c[i][k] <= 1.0f;
+                if (unit)
+                    encoding = ENCODING_UNORM8;
+            }
+
+            put8(out, slot);
+            put8(out, array->getType());
+            put32(out, (unsigned)array->getBinding());
+            put8(out, array->getNormalize() ? 1 : 0);
+            put8(out, encoding);
+            put32(out, numElements);
+
+            if (encoding == ENCODING_QUANT16)
+            {
+                const osg::Vec3Array& v = static_cast<const osg::Vec3Array&>(*array);
+                for (unsigned c = 0; c < 3; ++c) putFloat(out, offset[c]);
+                for (unsigned c = 0; c < 3; ++c) putFloat(out, scale[c]);
+
+                std::vector<unsigned short> q(numElements * 3);
+                for (unsigned i = 0; i < numElements; ++i)
+                    for (unsigned c = 0; c < 3; ++c)
+                        q[i * 3 + c] = quantize16(v[i][c], offset[c], scale[c]);
+                putBlock(out, &q.front(), (unsigned)(q.size() * sizeof(unsigned short)));
+            }
+
+            else if (encoding == ENCODING_SNORM16)
+            {
+                const osg::Vec3Array& n = static_cast<const osg::Vec3Array&>(*array);
+                std::vector<short> q(numElements * 3);
+                for (unsigned i = 0; i < numElements; ++i)
+                    for (unsigned c = 0; c < 3; ++c)
+                        q[i * 3 + c] = (short)std::floor(osg::clampBetween(n[i][c], -1.0f, 1.0f) * 32767.0f + 0.5f);
+                if (!q.empty())
+                    putBlock(out, &q.front(), (unsigned)(q.size() * sizeof(short)));
+            }
+
+            else if (encoding == ENCODING_UNORM8)
+            {
+                const osg::Vec4Array& c = static_cast<const osg::Vec4Array&>(*array);
+                std::vector<unsigned char> q(numElements * 4);
+                for (unsigned i = 0; i < numElements; ++i)
+                    for (unsigned k = 0; k < 4; ++k)
+                        q[i * 4 + k] = (unsigned char)std::floor(c[i][k] * 255.0f + 0.5f);
+                if (!q.empty())
+                    putBlock(out, &q.front(), (unsigned)q.size());
+            }
+
+            else
+            {
+                putBlock(out, array->getDataPointer(), array->getTotalDataSize());
+            }
+
+            return true;
+        }
+
+        bool writePrimitiveSet(const osg::PrimitiveSet* p, std::string& out)
+        {
+            if (p->getUserDataContainer() != NULL)
+                return false;
+
+            PrimitiveType type;
+            switch (p->getType())
+            {
+            case osg::PrimitiveSet::DrawArraysPrimitiveType:          type = PRIM_DRAW_ARRAYS; break;
+            case osg::PrimitiveSet::DrawArrayLengthsPrimitiveType:    type = PRIM_DRAW_ARRAY_LENGTHS; break;
+            case osg::PrimitiveSet::DrawElementsUBytePrimitiveType:   type = PRIM_ELEMENTS_UBYTE; break;
+            case osg::PrimitiveSet::DrawElementsUShortPrimitiveType:  type = PRIM_ELEMENTS_USHORT; break;
+            case osg::PrimitiveSet::DrawElementsUIntPrimitiveType:    type = PRIM_ELEMENTS_UINT; break;
+            default: return false;
+            }
+
+            put8(out, type);
+            put32(out, p->getMode());
+            put32(out, p->getNumInstances());
+
+            if (type == PRIM_DRAW_ARRAYS)
+            {
+                const osg::DrawArrays* da = static_cast<const osg::DrawArrays*>(p);
+                put32(out, (unsigned)da->getFirst());
+                put32(out, (unsigned)da->getCount());
+            }
+            else if (type == PRIM_DRAW_ARRAY_LENGTHS)
+            {
+                const osg::DrawArrayLengths* dal = static_cast<const osg::DrawArrayLengths*>(p);
+                put32(out, (unsigned)dal->getFirst());
+                put32(out, (unsigned)dal->size());
+                if (!dal->empty())
+                    putBlock(out, &dal->front(), (unsigned)(dal->size() * sizeof(GLsizei)));
+            }
+            else
+            {
+                const osg::DrawElements* de = p->getDrawElements();
+                put32(out, de->getNumIndices());
+                putBlock(out, de->getDataPointer(), de->getTotalDataSize());
+            }
+            return true;
+        }
+
+        bool writeGeometry(const osg::Geometry& geom, std::string& out)
+        {
+            if (geom.getDrawCallback() ||
+                geom.getComputeBoundingBoxCallback() ||
+                geom.getSecondaryColorArray() ||
+                geom.getFogCoordArray())
+            {
+                return false;
+            }
+
+            if (!writeHeader(geom, NODE_GEOMETRY, out))
+                return false;
+
+            unsigned flags =
+                (geom.getUseDisplayList() ? 1u : 0u) |
+                (geom.getUseVertexBufferObjects() ? 2u : 0u);
+            put8(out, flags);
+
+            std::vector< std::pair<unsigned, const osg::Array*> > arrays;
+            if (geom.getVertexArray())
+                arrays.push_back(std::make_pair((unsigned)SLOT_VERTEX, geom.getVertexArray()));
+            if (geom.getNormalArray())
+                arrays.push_back(std::make_pair((unsigned)SLOT_NORMAL, geom.getNormalArray()));
+            if (geom.getColorArray())
+                arrays.push_back(std::make_pair((unsigned)SLOT_COLOR, geom.getColorArray()));
+            for (unsigned i = 0; i < geom.getNumTexCoordArrays(); ++i)
+                if (geom.getTexCoordArray(i))
+                    arrays.push_back(std::make_pair((unsigned)SLOT_TEXCOORD + i, geom.getTexCoordArray(i)));
+            for (unsigned i = 0; i < geom.getNumVertexAttribArrays(); ++i)
+                if (geom.getVertexAttribArray(i))
+                    arrays.push_back(std::make_pair((unsigned)SLOT_ATTRIB + i, geom.getVertexAttribArray(i)));
+
+            // slots must fit in a byte
+            for (unsigned i = 0; i < arrays.size(); ++i)
+                if (arrays[i].first > 255u)
+                    return false;
+
+            put32(out, (unsigned)arrays.size());
+            for (unsigned i = 0; i < arrays.size(); ++i)
+            {
+                if (!writeArray(arrays[i].first, arrays[i].second, out))
+                    return false;
+            }
+
+            put32(out, geom.getNumPrimitiveSets());
+            for (unsigned i = 0; i < geom.getNumPrimitiveSets(); ++i)
+            {
+                if (!geom.getPrimitiveSet(i) || !writePrimitiveSet(geom.getPrimitiveSet(i), out))
+                    return false;
+            }
+
+            return true;
+        }
+    };
+
+    class Decoder
+    {
+    public:
+        Decoder(const std::string& payload, const osgDB::Options* options) :
+            _in(payload),
+            _options(options)
+        {
+            //nop
+        }
+
+        osg::Node* decode()
+        {
+            osgDB::ReaderWriter* serializer = getStateSetSerializer();
+
+            unsigned numMaterials = _in.get32();
+            for (unsigned i = 0; i < numMaterials && _in._ok; ++i)
+            {
+                std::string data = _in.getString();
+                osg::ref_ptr<osg::StateSet> stateSet;
+                if (serializer && _in._ok)
+                {
+                    std::istringstream buf(data);
+                    osgDB::ReaderWriter::ReadResult rr = serializer->readObject(buf, _options);
+                    if (rr.validObject())
+                        stateSet = dynamic_cast<osg::StateSet*>(rr.getObject());
+                }
+                if (!stateSet.valid())
+                {
+                    OE_WARN << LC << "Failed to read material " << i << std::endl;
+                    return NULL;
+                }
+                _materials.push_back(stateSet.get());
+            }
+
+            if (!_in._ok)
+                return NULL;
+
+            osg::ref_ptr<osg::Node> node = readNode();
+            return _in._ok ? node.release() : NULL;
+        }
+
+    private:
+        Reader _in;
+        const osgDB::Options* _options;
+        std::vector< osg::ref_ptr<osg::StateSet> > _materials;
+
+        bool readHeader(osg::Node* node)
+        {
+            node->setName(_in.getString());
+            node->setNodeMask(_in.get32());
+            int material = (int)_in.get32();
+            if (material >= 0)
+            {
+                if (material >= (int)_materials.size())
+                    return false;
+                node->setStateSet(_materials[material].get());
+            }
+            return _in._ok;
+        }
+
+        bool readChildren(osg::Group* group)
+        {
+            unsigned numChildren = _in.get32();
+            for (unsigned i = 0; i < numChildren && _in._ok; ++i)
+            {
+                osg::ref_ptr<osg::Node> child = readNode();
+                if (!child.valid())
+                    return false;
+                group->addChild(child.get());
+            }
+            return _in._ok;
+        }
+
+        osg::Node* readNode()
+        {
+            unsigned type = _in.get8();
+            osg::ref_ptr<osg::Node> node;
+
+            if (type == NODE_GROUP || type == NODE_GEODE)
+            {
+                osg::ref_ptr<osg::Group> group = type == NODE_GEODE ? new osg::Geode() : new osg::Group();
+                if (readHeader(group.get()) && readChildren(group.get()))
+                    node = group.get();
+            }
+
+            else if (type == NODE_TRANSFORM)
+            {
+                osg::ref_ptr<osg::MatrixTransform> xform = new osg::MatrixTransform();
+                if (readHeader(xform.get()))
+                {
+                    xform->setReferenceFrame((osg::Transform::ReferenceFrame)_in.get8());
+                    osg::Matrixd m;
+                    for (unsigned i = 0; i < 16; ++i)
+                        m.ptr()[i] = _in.getDouble();
+                    xform->setMatrix(m);
+                    if (readChildren(xform.get()))
+                        node = xform.get();
+                }
+            }
+
+            else if (type == NODE_GEOMETRY)
+            {
+                osg::ref_ptr<osg::Geometry> geom = new osg::Geometry();
+                if (readHeader(geom.get()) && readGeometry(geom.get()))
+                    node = geom.get();
+            }
+
+            return _in._ok ? node.release() : NULL;
+        }
+
+        osg::Array* readArray(unsigned& slot)
+        {
+            slot = _in.get8();
+            unsigned type = _in.get8();
+            unsigned binding = _in.get32();
+            bool normalize = _in.get8() != 0;
+            unsigned encoding = _in.get8();
+            unsigned numElements = _in.get32();
+            if (!_in._ok)
+                return NULL;
+
+            osg::ref_ptr<osg::Array> array = createArray(type, numElements);
+            if (!array.valid())
+                return NULL;
+
+            GLvoid* data = const_cast<GLvoid*>(array->getDataPointer());
+
+            if (encoding == ENCODING_RAW)
+            {
+                const char* src = _in.getBlock(array->getTotalDataSize());
+                if (!src)
+                    return NULL;
+                if (numElements > 0)
+                    ::memcpy(data, src, array->getTotalDataSize());
+            }
+
+            else if (encoding == ENCODING_QUANT16 && type == osg::Array::Vec3ArrayType)
+            {
+                osg::Vec3f offset, scale;
+                for (unsigned c = 0; c < 3; ++c) offset[c] = _in.getFloat();
+                for (unsigned c = 0; c < 3; ++c) scale[c] = _in.getFloat();
+                const char* src = _in.getBlock(numElements * 3 * sizeof(unsigned short));
+                if (!src)
+                    return NULL;
+                osg::Vec3Array& v = static_cast<osg::Vec3Array&>(*array);
+                const unsigned short* q = (const unsigned short*)src;
+                for (unsigned i = 0; i < numElements; ++i, q += 3)
+                    v[i].set(offset.x() + scale.x()*q[0], offset.y() + scale.y()*q[1], offset.z() + scale.z()*q[2]);
+            }
+
+            else if (encoding == ENCODING_SNORM16 && type == osg::Array::Vec3ArrayType)
+            {
+                const char* src = _in.getBlock(numElements * 3 * sizeof(short));
+                if (!src)
+                    return NULL;
+                osg::Vec3Array& n = static_cast<osg::Vec3Array&>(*array);
+                const short* q = (const short*)src;
+                const float k = 1.0f / 32767.0f;
+                for (unsigned i = 0; i < numElements; ++i, q += 3)
+                    n[i].set(k*q[0], k*q[1], k*q[2]);
+            }
+
+            else if (encoding == ENCODING_UNORM8 && type == osg::Array::Vec4ArrayType)
+            {
+                const char* src = _in.getBlock(numElements * 4);
+                if (!src)
+                    return NULL;
+                osg::Vec4Array& c = static_cast<osg::Vec4Array&>(*array);
+                const unsigned char* q = (const unsigned char*)src;
+                const float k = 1.0f / 255.0f;
+                for (unsigned i = 0; i < numElements; ++i, q += 4)
+                    c[i].set(k*q[0], k*q[1], k*q[2], k*q[3]);
+            }
+
+            else
+            {
+                return NULL;
+            }
+
+            array->setBinding((osg::Array::Binding)binding);
+            array->setNormalize(normalize);
+            return array.release();
+        }
+
+        osg::PrimitiveSet* readPrimitiveSet()
+        {
+            unsigned type = _in.get8();
+            GLenum mode = _in.get32();
+            unsigned numInstances = _in.get32();
+            if (!_in._ok)
+                return NULL;
+
+            osg::ref_ptr<osg::PrimitiveSet> p;
+
+            if (type == PRIM_DRAW_ARRAYS)
+            {
+                GLint first = (GLint)_in.get32();
+                GLsizei count = (GLsizei)_in.get32();
+                p = new osg::DrawArrays(mode, first, count);
+            }
+            else if (type == PRIM_DRAW_ARRAY_LENGTHS)
+            {
+                GLint first = (GLint)_in.get32();
+                unsigned size = _in.get32();
+                const char* src = _in.getBlock(size * sizeof(GLsizei));
+                if (!src)
+                    return NULL;
+                osg::DrawArrayLengths* dal = new osg::DrawArrayLengths(mode, first, size);
+                if (size > 0)
+                    ::memcpy(&dal->front(), src, size * sizeof(GLsizei));
+                p = dal;
+            }
+            else if (type == PRIM_ELEMENTS_UBYTE || type == PRIM_ELEMENTS_USHORT || type == PRIM_ELEMENTS_UINT)
+            {
+                unsigned size = _in.get32();
+                osg::DrawElements* de =
+                    type == PRIM_ELEMENTS_UBYTE  ? (osg::DrawElements*)new osg::DrawElementsUByte(mode, size) :
+                    type == PRIM_ELEMENTS_USHORT ? (osg::DrawElements*)new osg::DrawElementsUShort(mode, size) :
+                                                   (osg::DrawElements*)new osg::DrawElementsUInt(mode, size);
+                p = de;
+                const char* src = _in.getBlock(de->getTotalDataSize());
+                if (!src)
+                    return NULL;
+                if (size > 0)
+                    ::memcpy(const_cast<GLvoid*>(de->getDataPointer()), src, de->getTotalDataSize());
+            }
+            else
+            {
+                return NULL;
+            }
+
+            p->setNumInstances(numInstances);
+            return p.release();
+        }
+
+        bool readGeometry(osg::Geometry* geom)
+        {
+            unsigned flags = _in.get8();
+            geom->setUseDisplayList((flags & 1u) != 0);
+            geom->setUseVertexBufferObjects((flags & 2u) != 0);
+
+            unsigned numArrays = _in.get32();
+            for (unsigned i = 0; i < numArrays && _in._ok; ++i)
+            {
+                unsigned slot;
+                osg::Array* array = readArray(slot);
+                if (!array)
+                    return false;
+
+                if (slot == SLOT_VERTEX)
+                    geom->setVertexArray(array);
+                else if (slot == SLOT_NORMAL)
+                    geom->setNormalArray(array);
+                else if (slot == SLOT_COLOR)
+                    geom->setColorArray(array);
+                else if (slot >= SLOT_ATTRIB)
+                    geom->setVertexAttribArray(slot - SLOT_ATTRIB, array);
+                else if (slot >= SLOT_TEXCOORD)
+                    geom->setTexCoordArray(slot - SLOT_TEXCOORD, array);
+                else
+                {
+                    osg::ref_ptr<osg::Array> discard = array;
+                    return false;
+                }
+            }
+
+            unsigned numPrimitiveSets = _in.get32();
+            for (unsigned i = 0; i < numPrimitiveSets && _in._ok; ++i)
+            {
+                osg::PrimitiveSet* p = readPrimitiveSet();
+                if (!p)
+                    return false;
+                geom->addPrimitiveSet(p);
+            }
+
+            return _in._ok;
+        }
+    };
+
+    bool encode(const osg::Node& node, const osgDB::Options* options, std::ostream& out)
+    {
+        std::string payload;
+        Encoder encoder(options);
+        if (!encoder.encode(node, payload))
+            return false;
+
+        std::string compressed;
+        if (getCompress(options))
+        {
+            osgDB::BaseCompressor* compressor = getCompressor();
+            if (compressor)
+            {
+                std::stringstream buf;
+                if (compressor->compress(buf, payload))
+                    compressed = buf.str();
+            }
+        }
+
+        unsigned flags = 0;
+        if (!compressed.empty()) flags |= FLAG_COMPRESSED;
+
+        std::string header;
+        header.append(OEFT_MAGIC, 4);
+        put32(header, OEFT_VERSION);
+        put32(header, flags);
+        put32(header, (unsigned)payload.size());
+
+        out.write(header.data(), header.size());
+        if (flags & FLAG_COMPRESSED)
+            out.write(compressed.data(), compressed.size());
+        else
+            out.write(payload.data(), payload.size());
+
+        return out.good();
+    }
+
+    osg::Node* decode(std::istream& in, const osgDB::Options* options)
+    {
+        std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        if (data.size() < 4 || data.compare(0, 4, OEFT_MAGIC, 4) != 0)
+            return NULL;
+
+        Reader header(data);
+        header._pos = 4;
+        unsigned version     = header.get32();
+        unsigned flags       = header.get32();
+        unsigned payloadSize = header.get32();
+
+        if (!header._ok || version != OEFT_VERSION)
+            return NULL;
+
+        std::string payload;
+        if (flags & FLAG_COMPRESSED)
+        {
+            osgDB::BaseCompressor* compressor = getCompressor();
+            if (!compressor)
+            {
+                OE_WARN << LC << "Data is compressed but no zlib compressor is available" << std::endl;
+                return NULL;
+            }
+            std::istringstream compressed(data.substr(header._pos));
+            if (!compressor->decompress(compressed, payload))
+                return NULL;
+        }
+        else
+        {
+            payload = data.substr(header._pos);
+        }
+
+        if (payload.size() != payloadSize)
+            return NULL;
+
+        Decoder decoder(payload, options);
+        return decoder.decode();
+    }
+}
+
+class ReaderWriterOEFT : public osgDB::ReaderWriter
+{
+public:
+    ReaderWriterOEFT()
+    {
+        supportsExtension("oeft", "osgEarth compact feature tile");
+        supportsOption("OEFT_PRECISION <meters>", "Precision of quantized vertices (default 0.001)");
+        supportsOption("OEFT_UNCOMPRESSED", "Do not zlib-compress written tiles");
+    }
+
+    virtual const char* className() const
+    {
+        return "osgEarth Feature Tile Reader/Writer";
+    }
+
+    virtual ReadResult readNode(const std::string& file, const Options* options) const
+    {
+        std::string fileName;
+        ReadResult r = findFile(file, options, fileName);
+        if (!fileName.empty())
+        {
+            std::ifstream in(fileName.c_str(), std::ios::in | std::ios::binary);
+            return readNode(in, options);
+        }
+        return r;
+    }
+
+    virtual ReadResult readNode(std::istream& in, const Options* options) const
+    {
+        osg::Node* node = decode(in, options);
+        if (!node)
+            return ReadResult::ERROR_IN_READING_FILE;
+        return node;
+    }
+
+    virtual WriteResult writeNode(const osg::Node& node, const std::string& file, const Options* options) const
+    {
+        if (!acceptsExtension(osgDB::getLowerCaseFileExtension(file)))
+            return WriteResult::FILE_NOT_HANDLED;
+
+        std::ofstream out(file.c_str(), std::ios::out | std::ios::binary);
+        return writeNode(node, out, options);
+    }
+
+    //! Writes the graph, or returns FILE_NOT_HANDLED (writing nothing) if
+    //! it contains anything the format doesn't cover.
+    virtual WriteResult writeNode(const osg::Node& node, std::ostream& out, const Options* options) const
+    {
+        return encode(node, options, out) ?
+            WriteResult::FILE_SAVED :
+            WriteResult::FILE_NOT_HANDLED;
+    }
+
+private:
+
+    ReadResult findFile(const std::string& file, const Options* options, std::string& fileName) const
+    {
+        if (!acceptsExtension(osgDB::getLowerCaseFileExtension(file)))
+            return ReadResult::FILE_NOT_HANDLED;
+
+        fileName = osgDB::findDataFile(file, options);
+        if (fileName.empty())
+            return ReadResult::FILE_NOT_FOUND;
+
+        return ReadResult::FILE_LOADED;
+    }
+};
+
+REGISTER_OSGPLUGIN(oeft, ReaderWriterOEFT)
@@ -0,0 +1,575 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+ * Copyright 2020 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include <osgEarth/GeoCommon>
+#include <osgEarth/Notify>
+#include <osgEarth/StringUtils>
+#include <osg/Image>
+#include <osg/Shape>
+#include <osgDB/ReaderWriter>
+#include <osgDB/Registry>
+#include <osgDB/ObjectWrapper>
+#include <osgDB/FileNameUtils>
+#include <osgDB/FileUtils>
+#include <cfloat>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <vector>
+
+#define LC "[QHF] "
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+/**
+ * Packed, quantized elevation grid ("quantized heightfield").
+ *
+ * Heights are quantized to a fixed vertical precision, predicted from their
+ * left, lower and lower-left neighbors, and the residuals are stored as
+ * zigzag varints. Smooth terrain yields residuals of a byte or less, and the
+ * residual stream is then zlib-compressed. A separate bitmask preserves
+ * NO_DATA samples when there are any.
+ *
+ * Layout (little-endian):
+ *   char[4]  "QHF1"
+ *   uint32   flags
+ *   uint32   columns, rows
+ *   float64  precision, base
+ *   float32  origin x, y, z, x interval, y interval, skirt height
+ *   uint32   uncompressed payload size
+ *   ...      payload (zlib-compressed if FLAG_COMPRESSED is set)
+ *
+ * Reads as a 32-bit float luminance image (what ImageToHeightFieldConverter
+ * expects) through readImage, or as an osg::HeightField through readObject.
+ * The write precision comes from the "QHF_PRECISION <meters>" option string
+ * token and defaults to one centimeter.
+ */
+namespace
+{
+    const char   QHF_MAGIC[4] = { 'Q', 'H', 'F', '1' };
+    const double QHF_DEFAULT_PRECISION = 0.01;
+    const double QHF_MAX_QUANTA = (double)(1 << 28);
+
+    enum
+    {
+        FLAG_COMPRESSED = 1 << 0,
+        FLAG_NODATA     = 1 << 1
+    };
+
+    struct Grid
+    {
+        Grid() : cols(0), rows(0), xInterval(1.0f), yInterval(1.0f), skirtHeight(0.0f) { }
+        unsigned cols, rows;
+        osg::Vec3f origin;
+        float xInterval, yInterval, skirtHeight;
+        std::vector<float> heights;
+    };
+
+    inline bool isNoData(float h)
+    {
+        return h == NO_DATA_VALUE || std::isnan(h);
+    }
+
+    inline void put32(std::string& buf, unsigned v)
+    {
+        for (int i = 0; i < 4; ++i)
+            buf.push_back((char)((v >> (8 * i)) & 0xff));
+    }
+
+    inline void put64(std::string& buf, unsigned long long v)
+    {
+        for (int i = 0; i < 8; ++i)
+            buf.push_back((char)((v >> (8 * i)) & 0xff));
+    }
+
+    inline void putFloat(std::string& buf, float f)
+    {
+        unsigned v;
+        ::memcpy(&v, &f, 4);
+        put32(buf, v);
+    }
+
+    inline void putDouble(std::string& buf, double d)
+    {
+        unsigned long long v;
+        ::memcpy(&v, &d, 8);
+        put64(buf, v);
+    }
+
+    inline void putVarint(std::string& buf, int n)
+    {
+        unsigned v = ((unsigned)n << 1) ^ (unsigned)(n >> 31);
+        while (v >= 0x80)
+        {
+            buf.push_back((char)((v & 0x7f) | 0x80));
+            v >>= 7;
+        }
+        buf.push_back((char)v);
+    }
+
+    struct Reader
+    {
+        Reader(const std::string& buf) : _buf(buf), _pos(0), _ok(true) { }
+
+        unsigned get32()
+        {
+            if (_pos + 4 > _buf.size()) { _ok = false; return 0; }
+            unsigned v = 0;
+            for (int i = 0; i < 4; ++i)
+                v |= (unsigned)(unsigned char)_buf[_pos++] << (8 * i);
+            return v;
+        }
+
+        unsigned long long get64()
+        {
+            if (_pos + 8 > _buf.size()) { _ok = false; return 0; }
+            unsigned long long v = 0;
+            for (int i = 0; i < 8; ++i)
+                v |= (unsigned long long)(unsigned char)_buf[_pos++] << (8 * i);
+            return v;
+        }
+
+        float getFloat()
+        {
+            unsigned v = get32();
+            float f;
+            ::memcpy(&f, &v, 4);
+            return f;
+        }
+
+        double getDouble()
+        {
+            unsigned long long v = get64();
+            double d;
+            ::memcpy(&d, &v, 8);
+            return d;
+        }
+
+        int getVarint()
+        {
+            unsigned v = 0;
+            for (int shift = 0; shift < 35; shift += 7)
+            {
+                if (_pos >= _buf.size()) { _ok = false; return 0; }
+                unsigned char b = (unsigned char)_buf[_pos++];
+                v |= (unsigned)(b & 0x7f) << shift;
+                if ((b & 0x80) == 0)
+                    return (int)(v >> 1) ^ -(int)(v & 1);
+            }
+            _ok = false;
+            return 0;
+        }
+
+        const std::string& _buf;
+        std::size_t _pos;
+        bool _ok;
+    };
+
+    // Planar prediction from the already-decoded neighbors of (c, r).
+    inline int predict(const std::vector<int>& q, unsigned cols, unsigned c, unsigned r)
+    {
+        if (r == 0)
+            return c == 0 ? 0 : q[c - 1];
+        if (c == 0)
+            return q[(r - 1)*cols];
+        unsigned i = r*cols + c;
+        return q[i - 1] + q[i - cols] - q[i - cols - 1];
+    }
+
+    osgDB::BaseCompressor* getCompressor()
+    {
+        return osgDB::Registry::instance()->getObjectWrapperManager()->findCompressor("zlib");
+    }
+
+    double getPrecision(const osgDB::Options* options)
+    {
+        if (options)
+        {
+            std::istringstream iss(options->getOptionString());
+            std::string token;
+            while (iss >> token)
+            {
+                if (ciEquals(token, "QHF_PRECISION"))
+                {
+                    double value;
+                    if (iss >> value && value > 0.0)
+                        return value;
+                }
+            }
+        }
+        return QHF_DEFAULT_PRECISION;
+    }
+
+    bool encode(const Grid& grid, double precision, std::ostream& out)
+    {
+        unsigned count = grid.cols * grid.rows;
+        if (count == 0 || grid.heights.size() != count)
+            return false;
+
+        // find the valid range; the base is the lowest valid height.
+        bool hasNoData = false;
+        double minH = DBL_MAX, maxH = -DBL_MAX;
+        for (unsigned i = 0; i < count; ++i)
+        {
+            float h = grid.heights[i];
+            if (isNoData(h))
+            {
+                hasNoData = true;
+            }
+            else
+            {
+                minH = osg::minimum(minH, (double)h);
+                maxH = osg::maximum(maxH, (double)h);
+            }
+        }
+        if (minH > maxH)
+        {
+            minH = maxH = 0.0;
+        }
+
+        // coarsen the precision if the range won't fit the quanta
+        if ((maxH - minH) / precision > QHF_MAX_QUANTA)
+        {
+            precision = (maxH - minH) / QHF_MAX_QUANTA;
+        }
+
+        std::vector<int> q(count);
+        std::string payload;
+        payload.reserve(count);
+
+        for (unsigned r = 0; r < grid.rows; ++r)
+        {
+            for (unsigned c = 0; c < grid.cols; ++c)
+            {
+                unsigned i = r*grid.cols + c;
+                int p = predict(q, grid.cols, c, r);
+                float h = grid.heights[i];
+                if (isNoData(h))
+                    q[i] = osg::clampBetween(p, 0, (int)QHF_MAX_QUANTA);
+                else
+                    q[i] = (int)std::floor(((double)h - minH) / precision + 0.5);
+                putVarint(payload, q[i] - p);
+            }
+        }
+
+        if (hasNoData)
+        {
+            std::string mask((count + 7) / 8, '\0');
+            for (unsigned i = 0; i < count; ++i)
+                if (isNoData(grid.heights[i]))
+                    mask[i >> 3] |= (char)(1 << (i & 7));
+            payload.append(mask);
+        }
+
+        std::string compressed;
+        osgDB::BaseCompressor* compressor = getCompressor();
+        if (compressor)
+        {
+            std::stringstream buf;
+            if (compressor->compress(buf, payload))
+                compressed = buf.str();
+        }
+
+        unsigned flags = 0;
+        if (!compressed.empty()) flags |= FLAG_COMPRESSED;
+        if (hasNoData) flags |= FLAG_NODATA;
+
+        std::string header;
+        header.append(QHF_MAGIC, 4);
+        put32(header, flags);
+        put32(header, grid.cols);
+        put32(header, grid.rows);
+        putDouble(header, precision);
+        putDouble(header, minH);
+        putFloat(header, grid.origin.x());
+        putFloat(header, grid.origin.y());
+        putFloat(header, grid.origin.z());
+        putFloat(header, grid.xInterval);
+        putFloat(header, grid.yInterval);
+        putFloat(header, grid.skirtHeight);
+        put32(header, (unsigned)payload.size());
+
+        out.write(header.data(), header.size());
+        if (flags & FLAG_COMPRESSED)
+            out.write(compressed.data(), compressed.size());
+        else
+            out.write(payload.data(), payload.size());
+
+        return out.good();
+    }
+
+    bool decode(std::istream& in, Grid& grid)
+    {
+        std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        if (data.size() < 4 || data.compare(0, 4, QHF_MAGIC, 4) != 0)
+            return false;
+
+        Reader header(data);
+        header._pos = 4;
+        unsigned flags  = header.get32();
+        grid.cols       = header.get32();
+        grid.rows       = header.get32();
+        double precision = header.getDouble();
+        double base      = header.getDouble();
+        float ox        = header.getFloat();
+        float oy        = header.getFloat();
+        float oz        = header.getFloat();
+        grid.origin.set(ox, oy, oz);
+        grid.xInterval   = header.getFloat();
+        grid.yInterval   = header.getFloat();
+        grid.skirtHeight = header.getFloat();
+        unsigned payloadSize = header.get32();
+
+        if (!header._ok || grid.cols == 0 || grid.rows == 0 || grid.cols > 65536 || grid.rows > 65536)
+            return false;
+
+        std::string payload;
+        if (flags & FLAG_COMPRESSED)
+        {
+            osgDB::BaseCompressor* compressor = getCompressor();
+            if (!compressor)
+            {
+                OE_WARN << LC << "Data is compressed but no zlib compressor is available" << std::endl;
+                return false;
+            }
+            std::istringstream compressed(data.substr(header._pos));
+            if (!compressor->decompress(compressed, payload))
+                return false;
+        }
+        else
+        {
+            payload = data.substr(header._pos);
+        }
+
+        if (payload.size() != payloadSize)
+            return false;
+
+        unsigned count = grid.cols * grid.rows;
+        std::vector<int> q(count);
+        grid.heights.resize(count);
+
+        Reader reader(payload);
+        for (unsigned r = 0; r < grid.rows && reader._ok; ++r)
+        {
+            for (unsigned c = 0; c < grid.cols; ++c)
+            {
+                unsigned i = r*grid.cols + c;
+                q[i] = predict(q, grid.cols, c, r) + reader.getVarint();
+                grid.heights[i] = (float)(base + (double)q[i] * precision);
+            }
+        }
+        if (!reader._ok)
+            return false;
+
+        if (flags & FLAG_NODATA)
+        {
+            if (reader._pos + (count + 7) / 8 > payload.size())
+                return false;
+            const char* mask = payload.data() + reader._pos;
+            for (unsigned i = 0; i < count; ++i)
+                if (mask[i >> 3] & (1 << (i & 7)))
+                    grid.heights[i] = NO_DATA_VALUE;
+        }
+
+        return true;
+    }
+
+    // Single-band 16- or 32-bit elevation image to grid
+    bool imageToGrid(const osg::Image& image, Grid& grid)
+    {
+        if (osg::Image::computeNumComponents(image.getPixelFormat()) != 1)
+            return false;
+
+        GLenum type = image.getDataType();
+        if (type != GL_FLOAT && type != GL_SHORT)
+            return false;
+
+        grid.cols = image.s();
+        grid.rows = image.t();
+        grid.heights.resize(grid.cols * grid.rows);
+
+        for (unsigned r = 0; r < grid.rows; ++r)
+        {
+            for (unsigned c = 0; c < grid.cols; ++c)
+            {
+                float h;
+                if (type == GL_FLOAT)
+                {
+                    h = *(const float*)image.data(c, r);
+                }
+                else
+                {
+                    short v = *(const short*)image.data(c, r);
+                    h = (v == SHRT_MAX || v == -SHRT_MAX) ? NO_DATA_VALUE : (float)v;
+                }
+                grid.heights[r*grid.cols + c] = h;
+            }
+        }
+        return true;
+    }
+}
+
+
+class ReaderWriterQHF : public osgDB::ReaderWriter
+{
+public:
+    ReaderWriterQHF()
+    {
+        supportsExtension("qhf", "osgEarth quantized heightfield");
+        supportsOption("QHF_PRECISION <meters>", "Vertical precision of written heights (default 0.01)");
+    }
+
+    virtual const char* className() const
+    {
+        return "osgEarth Quantized Heightfield Reader/Writer";
+    }
+
+    virtual ReadResult readObject(const std::string& file, const Options* options) const
+    {
+        std::string fileName;
+        ReadResult r = findFile(file, options, fileName);
+        if (!fileName.empty())
+        {
+            std::ifstream in(fileName.c_str(), std::ios::in | std::ios::binary);
+            return readObject(in, options);
+        }
+        return r;
+    }
+
+    //! Reads the file as an osg::HeightField
+    virtual ReadResult readObject(std::istream& in, const Options* options) const
+    {
+        Grid grid;
+        if (!decode(in, grid))
+            return ReadResult::ERROR_IN_READING_FILE;
+
+        osg::ref_ptr<osg::HeightField> hf = new osg::HeightField();
+        hf->allocate(grid.cols, grid.rows);
+        hf->setOrigin(grid.origin);
+        hf->setXInterval(grid.xInterval);
+        hf->setYInterval(grid.yInterval);
+        hf->setSkirtHeight(grid.skirtHeight);
+        ::memcpy(&hf->getFloatArray()->front(), &grid.heights.front(), sizeof(float) * grid.heights.size());
+        return hf.release();
+    }
+
+    virtual ReadResult readImage(const std::string& file, const Options* options) const
+    {
+        std::string fileName;
+        ReadResult r = findFile(file, options, fileName);
+        if (!fileName.empty())
+        {
+            std::ifstream in(fileName.c_str(), std::ios::in | std::ios::binary);
+            return readImage(in, options);
+        }
+        return r;
+    }
+
+    //! Reads the file as a single-band float image
+    virtual ReadResult readImage(std::istream& in, const Options* options) const
+    {
+        Grid grid;
+        if (!decode(in, grid))
+            return ReadResult::ERROR_IN_READING_FILE;
+
+        osg::ref_ptr<osg::Image> image = new osg::Image();
+        image->allocateImage(grid.cols, grid.rows, 1, GL_LUMINANCE, GL_FLOAT);
+        ::memcpy(image->data(), &grid.heights.front(), sizeof(float) * grid.heights.size());
+        return image.release();
+    }
+
+    virtual WriteResult writeObject(const osg::Object& object, const std::string& file, const Options* options) const
+    {
+        if (!acceptsExtension(osgDB::getLowerCaseFileExtension(file)))
+            return WriteResult::FILE_NOT_HANDLED;
+
+        std::ofstream out(file.c_str(), std::ios::out | std::ios::binary);
+        return writeObject(object, out, options);
+    }
+
+    virtual WriteResult writeObject(const osg::Object& object, std::ostream& out, const Options* options) const
+    {
+        const osg::HeightField* hf = dynamic_cast<const osg::HeightField*>(&object);
+        if (hf)
+        {
+            Grid grid;
+            grid.cols = hf->getNumColumns();
+            grid.rows = hf->getNumRows();
+            grid.origin = hf->getOrigin();
+            grid.xInterval = hf->getXInterval();
+            grid.yInterval = hf->getYInterval();
+            grid.skirtHeight = hf->getSkirtHeight();
+            grid.heights = hf->getHeightList();
+            return encode(grid, getPrecision(options), out) ?
+                WriteResult::FILE_SAVED :
+                WriteResult::ERROR_IN_WRITING_FILE;
+        }
+
+        const osg::Image* image = dynamic_cast<const osg::Image*>(&object);
+        if (image)
+        {
+            return writeImage(*image, out, options);
+        }
+
+        return WriteResult::FILE_NOT_HANDLED;
+    }
+
+    virtual WriteResult writeImage(const osg::Image& image, const std::string& file, const Options* options) const
+    {
+        if (!acceptsExtension(osgDB::getLowerCaseFileExtension(file)))
+            return WriteResult::FILE_NOT_HANDLED;
+
+        std::ofstream out(file.c_str(), std::ios::out | std::ios::binary);
+        return writeImage(image, out, options);
+    }
+
+    virtual WriteResult writeImage(const osg::Image& image, std::ostream& out, const Options* options) const
+    {
+        Grid grid;
+        if (!imageToGrid(image, grid))
+        {
+            OE_WARN << LC << "Only single-band 16- or 32-bit elevation images are supported" << std::endl;
+            return WriteResult::FILE_NOT_HANDLED;
+        }
+
+        return encode(grid, getPrecision(options), out) ?
+            WriteResult::FILE_SAVED :
+            WriteResult::ERROR_IN_WRITING_FILE;
+    }
+
+private:
+
+    ReadResult findFile(const std::string& file, const Options* options, std::string& fileName) const
+    {
+        if (!acceptsExtension(osgDB::getLowerCaseFileExtension(file)))
+            return ReadResult::FILE_NOT_HANDLED;
+
+        fileName = osgDB::findDataFile(file, options);
+        if (fileName.empty())
+            return ReadResult::FILE_NOT_FOUND;
+
+        return ReadResult::FILE_LOADED;
+    }
+};
+
+REGISTER_OSGPLUGIN(qhf, ReaderWriterQHF)
@@ -140,73 +140,240 @@ namespace
 
 namespace
 {
-    // Create a "feature" object in the global namespace.
-    void setFeature(duk_context* ctx, Feature const* feature, bool complete)
+    // heap stash keys
+    const char* OE_FEATURE_PTR = "oe_feature_ptr";  // feature bound to feature.properties
+    const char* OE_OVERLAY     = "oe_overlay";      // values the script assigned to feature.properties
+    const char* OE_WRITTEN     = "oe_written";      // whether the overlay has anything in it
+    const char* OE_FUNCTIONS   = "oe_functions";    // compiled snippets
+
+    // the most compiled snippets a context keeps before starting over
+    const unsigned MAX_FUNCTIONS = 1024u;
+
+    void pushStash(duk_context* ctx, const char* key)
     {
-        duk_push_global_object(ctx);                             // [global]
+        duk_push_heap_stash(ctx);
+        duk_get_prop_string(ctx, -1, key);
+        duk_remove(ctx, -2);
+    }
 
-        // Complete profile: properties, geometry, and API bindings.
-        if ( complete )
+    void putStash(duk_context* ctx, const char* key)
+    {
+        // [value]
+        duk_push_heap_stash(ctx);   // [value, stash]
+        duk_insert(ctx, -2);        // [stash, value]
+        duk_put_prop_string(ctx, -2, key); // [stash]
+        duk_pop(ctx);
+    }
+
+    const Feature* boundFeature(duk_context* ctx)
+    {
+        pushStash(ctx, OE_FEATURE_PTR);
+        const Feature* feature = reinterpret_cast<const Feature*>(duk_get_pointer(ctx, -1));
+        duk_pop(ctx);
+        return feature;
+    }
+
+    // Pushes the named attribute of the bound feature. Returns false (and
+    // pushes nothing) if there's no such attribute.
+    bool pushAttribute(duk_context* ctx, const char* name)
+    {
+        const Feature* feature = boundFeature(ctx);
+        if (!feature || !name)
+            return false;
+
+        const AttributeTable& attrs = feature->getAttrs();
+        AttributeTable::const_iterator a = attrs.find(name);
+        if (a == attrs.end())
+            return false;
+
+        switch(a->second.first) {
+        case ATTRTYPE_DOUBLE: duk_push_number (ctx, a->second.getDouble()); break;
+        case ATTRTYPE_INT:    duk_push_number(ctx, (double)a->second.getInt()); break;
+        case ATTRTYPE_BOOL:   duk_push_boolean(ctx, a->second.getBool()); break;
+        case ATTRTYPE_DOUBLEARRAY: return false;
+        case ATTRTYPE_STRING:
+        default:              duk_push_string (ctx, a->second.getString().c_str()); break;
+        }
+        return true;
+    }
+
+    // Proxy traps for feature.properties. Attributes are read from the bound
+    // feature only when the script asks for them; assignments go to an
+    // overlay object that is discarded when the next feature is bound.
+
+    static duk_ret_t props_get(duk_context* ctx)
+    {
+        // [target, key, receiver]
+        pushStash(ctx, OE_OVERLAY);     // [..., overlay]
+        duk_dup(ctx, 1);
+        if (duk_has_prop(ctx, -2))
         {
-            std::string geojson = feature->getGeoJSON();
-            duk_push_string(ctx, geojson.c_str());               // [global, json]
-            duk_json_decode(ctx, -1);                            // [global, feature]
-            duk_push_pointer(ctx, (void*)feature);               // [global, feature, ptr]
-            duk_put_prop_string(ctx, -2, "__ptr");               // [global, feature]
-            duk_put_prop_string(ctx, -2, "feature");             // [global]
-
-            // add the save() function and the "attributes" alias.
-            duk_eval_string_noresult(ctx,
-                "feature.save = function() {"
-                "    oe_duk_save_feature(this.__ptr);"
-                "} ");
-
-            duk_eval_string_noresult(ctx,
-                "Object.defineProperty(feature, 'attributes', {get:function() {return feature.properties;}});");
-
-            GeometryAPI::bindToFeature(ctx);
+            duk_dup(ctx, 1);
+            duk_get_prop(ctx, -2);      // [..., overlay, value]
+            return 1;
         }
 
-        // Minimal profile: ID and properties only. MUCH faster!
-        else
+        if (duk_is_string(ctx, 1) && pushAttribute(ctx, duk_get_string(ctx, 1)))
+            return 1;
+
+        // anything else (toString, hasOwnProperty...) comes from the target
+        duk_dup(ctx, 1);
+        duk_get_prop(ctx, 0);
+        return 1;
+    }
+
+    static duk_ret_t props_set(duk_context* ctx)
+    {
+        // [target, key, value, receiver]
+        pushStash(ctx, OE_OVERLAY);
+        duk_dup(ctx, 1);
+        duk_dup(ctx, 2);
+        duk_put_prop(ctx, -3);
+        duk_push_true(ctx);
+        putStash(ctx, OE_WRITTEN);
+        duk_push_true(ctx);
+        return 1;
+    }
+
+    static duk_ret_t props_has(duk_context* ctx)
+    {
+        // [target, key]
+        pushStash(ctx, OE_OVERLAY);
+        duk_dup(ctx, 1);
+        bool has = duk_has_prop(ctx, -2) != 0;
+
+        if (!has && duk_is_string(ctx, 1) && pushAttribute(ctx, duk_get_string(ctx, 1)))
         {
-            duk_idx_t feature_i = duk_push_object(ctx);     // [global] [feature]
-            {
-                duk_push_number(ctx, feature->getFID());       // [global] [feature] [id]
-                duk_put_prop_string(ctx, feature_i, "id");  // [global] [feature]
+            duk_pop(ctx);
+            has = true;
+        }
 
-                duk_idx_t props_i = duk_push_object(ctx);   // [global] [feature] [properties]
-                {
-                    const AttributeTable& attrs = feature->getAttrs();
-                    for(AttributeTable::const_iterator a = attrs.begin(); a != attrs.end(); ++a)
-                    {
-                        AttributeType type = a->second.first;
-                        switch(type) {
-                        case ATTRTYPE_DOUBLE: duk_push_number (ctx, a->second.getDouble()); break;          // [global] [feature] [properties] [name]
-                        case ATTRTYPE_INT:    duk_push_number(ctx, (double)a->second.getInt()); break;             // [global] [feature] [properties] [name]
-                        case ATTRTYPE_BOOL:   duk_push_boolean(ctx, a->second.getBool()); break;            // [global] [feature] [properties] [name]
-                        case ATTRTYPE_DOUBLEARRAY: break;
-                        case ATTRTYPE_STRING:
-                        default:              duk_push_string (ctx, a->second.getString().c_str()); break;  // [global] [feature] [properties] [name]
-                        }
-                        duk_put_prop_string(ctx, props_i, a->first.c_str()); // [global] [feature] [properties]
-                    }
-                }
-                duk_put_prop_string(ctx, feature_i, "properties"); // [global] [feature]
+        if (!has)
+        {
+            duk_dup(ctx, 1);
+            has = duk_has_prop(ctx, 0) != 0;
+        }
 
-                duk_idx_t geometry_i = duk_push_object(ctx);  // [global] [feature] [geometry]
-                {
-                    duk_push_string(ctx, Geometry::toString(feature->getGeometry()->getType()).c_str()); // [global] [feature] [geometry] [type]
-                    duk_put_prop_string(ctx, geometry_i, "type"); // [global] [feature] [geometry]
-                }
-                duk_put_prop_string(ctx, feature_i, "geometry");
+        duk_push_boolean(ctx, has);
+        return 1;
+    }
+
+    static duk_ret_t props_delete(duk_context* ctx)
+    {
+        // [target, key]
+        pushStash(ctx, OE_OVERLAY);
+        duk_dup(ctx, 1);
+        duk_del_prop(ctx, -2);
+        duk_push_true(ctx);
+        return 1;
+    }
+
+    static duk_ret_t props_keys(duk_context* ctx)
+    {
+        // [target]
+        duk_idx_t keys_i = duk_push_array(ctx);
+        duk_uarridx_t n = 0;
+
+        const Feature* feature = boundFeature(ctx);
+        if (feature)
+        {
+            const AttributeTable& attrs = feature->getAttrs();
+            for(AttributeTable::const_iterator a = attrs.begin(); a != attrs.end(); ++a)
+            {
+                if (a->second.first == ATTRTYPE_DOUBLEARRAY)
+                    continue;
+                duk_push_string(ctx, a->first.c_str());
+                duk_put_prop_index(ctx, keys_i, n++);
             }
-            duk_put_prop_string(ctx, -2, "feature"); // [global] [feature]
         }
 
-        duk_pop(ctx);
+        pushStash(ctx, OE_OVERLAY);                        // [target, keys, overlay]
+        duk_enum(ctx, -1, DUK_ENUM_OWN_PROPERTIES_ONLY);   // [target, keys, overlay, enum]
+        while (duk_next(ctx, -1, 0))                       // [target, keys, overlay, enum, key]
+        {
+            if (!feature || feature->getAttrs().find(duk_get_string(ctx, -1)) == feature->getAttrs().end())
+                duk_put_prop_index(ctx, keys_i, n++);
+            else
+                duk_pop(ctx);
+        }
+        duk_pop_2(ctx);                                    // [target, keys]
+        return 1;
     }
 
+    // Installs the global "feature" object, whose properties member is a
+    // proxy over whatever feature is bound.
+    void installFeatureProxy(duk_context* ctx)
+    {
+        duk_push_pointer(ctx, 0L);
+        putStash(ctx, OE_FEATURE_PTR);
+
+        duk_push_object(ctx);
+        duk_push_undefined(ctx);
+        duk_set_prototype(ctx, -2);   // no inherited properties in the overlay
+        putStash(ctx, OE_OVERLAY);
+
+        duk_push_false(ctx);
+        putStash(ctx, OE_WRITTEN);
+
+        duk_push_global_object(ctx);                           // [global]
+        duk_idx_t feature_i = duk_push_object(ctx);            // [global, feature]
+
+        duk_push_number(ctx, 0);
+        duk_put_prop_string(ctx, feature_i, "id");
+
+        duk_get_global_string(ctx, "Proxy");                   // [global, feature, Proxy]
+        duk_push_object(ctx);                                  // [global, feature, Proxy, target]
+        duk_idx_t handler_i = duk_push_object(ctx);            // [global, feature, Proxy, target, handler]
+        duk_push_c_function(ctx, props_get, 3);
+        duk_put_prop_string(ctx, handler_i, "get");
+        duk_push_c_function(ctx, props_set, 4);
+        duk_put_prop_string(ctx, handler_i, "set");
+        duk_push_c_function(ctx, props_has, 2);
+        duk_put_prop_string(ctx, handler_i, "has");
+        duk_push_c_function(ctx, props_delete, 2);
+        duk_put_prop_string(ctx, handler_i, "deleteProperty");
+        duk_push_c_function(ctx, props_keys, 1);
+        duk_put_prop_string(ctx, handler_i, "enumerate");
+        duk_push_c_function(ctx, props_keys, 1);
+        duk_put_prop_string(ctx, handler_i, "ownKeys");
+        duk_new(ctx, 2);                                       // [global, feature, proxy]
+        duk_put_prop_string(ctx, feature_i, "properties");     // [global, feature]
+
+        duk_push_object(ctx);                                  // [global, feature, geometry]
+        duk_push_string(ctx, "");
+        duk_put_prop_string(ctx, -2, "type");
+        duk_put_prop_string(ctx, feature_i, "geometry");       // [global, feature]
+
+        duk_put_prop_string(ctx, -2, "feature");               // [global]
+        duk_pop(ctx);                                          // []
+    }
+
+    // Create a "feature" object in the global namespace, with its properties,
+    // geometry, and API bindings.
+    void setCompleteFeature(duk_context* ctx, Feature const* feature)
+    {
+        duk_push_global_object(ctx);                             // [global]
+
+        std::string geojson = feature->getGeoJSON();
+        duk_push_string(ctx, geojson.c_str());                   // [global, json]
+        duk_json_decode(ctx, -1);                                // [global, feature]
+        duk_push_pointer(ctx, (void*)feature);                   // [global, feature, ptr]
+        duk_put_prop_string(ctx, -2, "__ptr");                   // [global, feature]
+        duk_put_prop_string(ctx, -2, "feature");                 // [global]
+
+        // add the save() function and the "attributes" alias.
+        duk_eval_string_noresult(ctx,
+            "feature.save = function() {"
+            "    oe_duk_save_feature(this.__ptr);"
+            "} ");
+
+        duk_eval_string_noresult(ctx,
+            "Object.defineProperty(feature, 'attributes', {get:function() {return feature.properties;}});");
+
+        GeometryAPI::bindToFeature(ctx);
+
+        duk_pop(ctx);
+    }
 }
 
 //............................................................................
@@ -253,7 +420,130 @@ DuktapeEngine::Context::initialize(const ScriptEngineOptions& options, bool comp
         }
 
         duk_pop(_ctx); // []
+
+        duk_push_array(_ctx);
+        putStash(_ctx, OE_FUNCTIONS);
+
+        if ( !complete )
+        {
+            installFeatureProxy(_ctx);
+        }
+    }
+}
+
+void
+DuktapeEngine::Context::bind(const Feature* feature, bool complete)
+{
+    if ( complete )
+    {
+        if ( feature && feature != _feature.get() )
+            setCompleteFeature(_ctx, feature);
+    }
+
+    else
+    {
+        // Minimal profile: the proxy reads from whichever feature is bound, so
+        // binding is a pointer swap plus the id and geometry type.
+        if ( !feature )
+            feature = _feature.get();
+
+        duk_push_pointer(_ctx, (void*)feature);
+        putStash(_ctx, OE_FEATURE_PTR);
+
+        if ( feature && feature != _feature.get() )
+        {
+            duk_get_global_string(_ctx, "feature");  // [feature]
+            duk_push_number(_ctx, feature->getFID());
+            duk_put_prop_string(_ctx, -2, "id");
+            duk_get_prop_string(_ctx, -1, "geometry"); // [feature, geometry]
+            duk_push_string(_ctx, feature->getGeometry() ? Geometry::toString(feature->getGeometry()->getType()).c_str() : "");
+            duk_put_prop_string(_ctx, -2, "type");
+            duk_pop_2(_ctx); // []
+
+            // forget what the script assigned to the last feature's properties
+            pushStash(_ctx, OE_WRITTEN);
+            bool written = duk_get_boolean(_ctx, -1) != 0;
+            duk_pop(_ctx);
+            if ( written )
+            {
+                duk_push_object(_ctx);
+                duk_push_undefined(_ctx);
+                duk_set_prototype(_ctx, -2);
+                putStash(_ctx, OE_OVERLAY);
+                duk_push_false(_ctx);
+                putStash(_ctx, OE_WRITTEN);
+            }
+        }
+    }
+
+    // remember the feature so we don't re-bind it if not necessary
+    if ( feature )
+        _feature = feature;
+}
+
+bool
+DuktapeEngine::Context::pushFunction(const std::string& code)
+{
+    pushStash(_ctx, OE_FUNCTIONS); // [functions]
+
+    Functions::const_iterator f = _functions.find(code);
+    if ( f != _functions.end() )
+    {
+        duk_get_prop_index(_ctx, -1, f->second); // [functions, function]
+        duk_remove(_ctx, -2);                    // [function]
+        return true;
+    }
+
+    if ( _functions.size() >= MAX_FUNCTIONS )
+    {
+        // start over rather than grow without bound
+        duk_pop(_ctx);
+        duk_push_array(_ctx);
+        duk_dup_top(_ctx);
+        putStash(_ctx, OE_FUNCTIONS);
+        _functions.clear();
+    }
+
+    // compile the snippet as a program, so calling it returns the value
+    // of its last statement just like eval would.
+    if ( duk_pcompile_string(_ctx, 0, code.c_str()) != 0 ) // [functions, error]
+    {
+        duk_remove(_ctx, -2); // [error]
+        return false;
     }
+
+    duk_uarridx_t index = (duk_uarridx_t)_functions.size();
+    duk_dup_top(_ctx);                        // [functions, function, function]
+    duk_put_prop_index(_ctx, -3, index);      // [functions, function]
+    duk_remove(_ctx, -2);                     // [function]
+    _functions[code] = index;
+    return true;
+}
+
+ScriptResult
+DuktapeEngine::Context::call()
+{
+    // [function]: run it. On error, the top of stack will hold the error
+    // message instead of the return value.
+    std::string resultString;
+
+    duk_int_t r = (duk_pcall(_ctx, 0) == 0); // [ "result" ]
+    const char* resultVal = duk_to_string(_ctx, -1);
+    if ( resultVal )
+        resultString = resultVal;
+
+    if (resultString.find("Error:") != std::string::npos)
+    {
+        OE_WARN << LC << "Javascript ERROR: " << resultString << std::endl;
+        r = -1;
+    }
+
+    // pop the return value:
+    duk_pop(_ctx); // []
+
+    return r >= 0 ?
+        ScriptResult(resultString, true) :
+        ScriptResult("", false, resultString);
 }
 
 DuktapeEngine::Context::~Context()
@@ -297,42 +587,62 @@ DuktapeEngine::run(const std::string&   code,
     // brand new context every time
     Context c;
     c.initialize( _options, complete );
-    duk_context* ctx = c._ctx;
 #else
     // cache the Context on a per-thread basis
     Context& c = _contexts.get();
     c.initialize( _options, complete );
-    duk_context* ctx = c._ctx;
 #endif
 
-	if ( feature && feature != c._feature.get() )
+    c.bind( feature, complete );
+
+    if ( !c.pushFunction(code) ) // [error]
     {
-		// encode the feature in the global object and push a native pointer:
-		setFeature(ctx, feature, complete);
-	}
+        std::string error = duk_safe_to_string(c._ctx, -1);
+        duk_pop(c._ctx);
+        OE_WARN << LC << "Javascript ERROR: " << error << std::endl;
+        return ScriptResult("", false, error);
+    }
 
-    // remember the feature so we don't re-create it if not necessary
-    c._feature = feature;
+    return c.call();
+}
 
-    // run the script. On error, the top of stack will hold the error
-    // message instead of the return value.
-    std::string resultString;
+void
+DuktapeEngine::run(const std::string&        code,
+                   const FeatureList&        features,
+                   std::vector<ScriptResult>& results,
+                   FilterContext const*      context)
+{
+    results.clear();
+    results.reserve(features.size());
 
-    duk_int_t r = (duk_peval_string(ctx, code.c_str()) == 0); // [ "result" ]
-    const char* resultVal = duk_to_string(ctx, -1);
-    if ( resultVal )
-        resultString = resultVal;
+    if (code.empty())
+    {
+        results.resize(features.size(), ScriptResult(EMPTY_STRING, false, "Script is empty."));
+        return;
+    }
 
-    if (resultString.find("Error:") != std::string::npos)
+    bool complete = false;
+
+    Context& c = _contexts.get();
+    c.initialize( _options, complete );
+
+    // look up (or compile) the snippet once for the whole batch
+    if ( !c.pushFunction(code) ) // [error]
     {
-        OE_WARN << LC << "Javascript ERROR: " << resultString << std::endl;
-        r = -1;
+        std::string error = duk_safe_to_string(c._ctx, -1);
+        duk_pop(c._ctx);
+        OE_WARN << LC << "Javascript ERROR: " << error << std::endl;
+        results.resize(features.size(), ScriptResult("", false, error));
+        return;
     }
 
-    // pop the return value:
-    duk_pop(ctx); // []
+    // [function]
+    for (FeatureList::const_iterator f = features.begin(); f != features.end(); ++f)
+    {
+        c.bind( f->get(), complete );
+        duk_dup_top( c._ctx ); // [function, function]
+        results.push_back( c.call() ); // [function]
+    }
 
-    return r >= 0 ?
-        ScriptResult(resultString, true) :
-        ScriptResult("", false, resultString);
+    duk_pop( c._ctx ); // []
 }
@@ -39,6 +39,7 @@
 #include <osgEarth/GLUtils>
 #include <osgEarth/Lighting>
 #include <osgEarth/PointDrawable>
+#include <osgEarth/GPUTimer>
 
 #include <osg/MatrixTransform>
 #include <osg/ShapeDrawable>
@@ -534,6 +535,7 @@ SimpleSkyNode::makeAtmosphere(const osg::EllipsoidModel* em)
 {
     // create some skeleton geometry to shade:
     osg::Geometry* drawable = s_makeEllipsoidGeometry( em, _outerRadius, false );
+    drawable->setDrawCallback( new GPUTimer::DrawCallback("sky.atmosphere") );
 
     // disable wireframe/point rendering on the atmosphere, since it is distracting.
     if ( _options.allowWireframe() == false )
@@ -23,6 +23,7 @@
 #include <osgEarth/FileUtils>
 #include <osgEarth/Registry>
 #include <osgEarth/ImageUtils>
+#include <osgEarth/ImageMosaic>
 #include <osgEarth/URI>
 
 #include <osgEarthUtil/TileIndex>
@@ -55,7 +56,7 @@ public:
     TileIndexSource( const TileSourceOptions& options ):
       TileSource( options ),
       _options( options ),
-	  _tileSourceCache( true )
+	  _tileSourceCache( true, osg::maximum(TileIndexOptions(options).maxOpenFiles().get(), 1u) )
     {
     }
 
@@ -84,9 +85,12 @@ public:
         OE_DEBUG << "Got " << files.size() << " files in " << osg::Timer::instance()->delta_m( start, end) << " ms" << std::endl;
 
         // The result image
-        osg::Image* result = 0;
+        osg::ref_ptr< osg::Image > result;
         
-        for (unsigned int i = 0; i < files.size(); i++)
+        // Later files take precedence, so mosaic from the last one down,
+        // and stop as soon as the result is fully covered.
+        bool covered = false;
+        for (int i = (int)files.size() - 1; i >= 0 && !covered; --i)
         {            
             osg::ref_ptr< TileSource> source;
             {
@@ -116,29 +120,32 @@ public:
                     else
                     {
                         OE_WARN << "Failed to open " << files[i] << std::endl;
+                        source = 0L;
                     }
                     end = osg::Timer::instance()->tick();
                     //OE_NOTICE << "init took " << osg::Timer::instance()->delta_m( start, end) << "ms" << std::endl;
                 }               
             }
 
-            
-            
+            if (!source.valid())
+                continue;
+
             start = osg::Timer::instance()->tick();
-            osg::ref_ptr< osg::Image > image = source->createImage( key);
+            osg::ref_ptr< osg::Image > image = source->createImage( key, progress );
             end = osg::Timer::instance()->tick();
             OE_DEBUG << "createImage " << osg::Timer::instance()->delta_m( start, end) << "ms" << std::endl;
             if (image)
             {                                
-                if (!result)
+                if (!result.valid())
                 {
                     // Initialize the result
-                     result = new osg::Image( *image.get() );
+                    result = new osg::Image( *image.get() );
+                    covered = !ImageUtils::hasAlphaChannel( result.get() );
                 }
                 else
                 {
-                    // Composite the new image with the result
-                     ImageUtils::mix( result, image.get(), 1.0);
+                    // Fill in what the higher priority files didn't cover
+                    covered = ImageMosaic::compositeUnder( result.get(), image.get() );
                 }                
             }
             else
@@ -147,7 +154,7 @@ public:
             }
         }
 
-        return result;
+        return result.release();
     }
 
     //std::map< std::string, osg::ref_ptr< TileSource> > _tileSourceCache;
@@ -29,6 +29,143 @@
 
 #include <sstream>
 #include <cstdio>
+#include <cstring>
+#include <climits>
+
+#ifdef _WIN32
+#   ifndef WIN32_LEAN_AND_MEAN
+#       define WIN32_LEAN_AND_MEAN
+#   endif
+#   include <windows.h>
+#else
+#   include <sys/mman.h>
+#   include <fcntl.h>
+#   include <unistd.h>
+#endif
+
+#ifdef OSGEARTH_ZIP_HAVE_ZLIB
+#   include <zlib.h>
+#endif
+
+namespace
+{
+    // ZIP structures are little-endian and unaligned
+    inline zip_uint64_t get16(const char* p)
+    {
+        const unsigned char* b = (const unsigned char*)p;
+        return (zip_uint64_t)b[0] | ((zip_uint64_t)b[1] << 8);
+    }
+
+    inline zip_uint64_t get32(const char* p)
+    {
+        return get16(p) | (get16(p + 2) << 16);
+    }
+
+    inline zip_uint64_t get64(const char* p)
+    {
+        return get32(p) | (get32(p + 4) << 32);
+    }
+
+    const zip_uint64_t SIG_LOCAL_HEADER   = 0x04034b50;
+    const zip_uint64_t SIG_CENTRAL_HEADER = 0x02014b50;
+    const zip_uint64_t SIG_END            = 0x06054b50;
+    const zip_uint64_t SIG_END64          = 0x06064b50;
+    const zip_uint64_t SIG_END64_LOCATOR  = 0x07064b50;
+
+    const zip_uint64_t LOCAL_HEADER_SIZE   = 30;
+    const zip_uint64_t CENTRAL_HEADER_SIZE = 46;
+    const zip_uint64_t END_SIZE            = 22;
+    const zip_uint64_t END64_LOCATOR_SIZE  = 20;
+    const zip_uint64_t END64_SIZE          = 56;
+}
+
+//------------------------------------------------------------------------
+
+ZipArchive::MappedFile*
+ZipArchive::MappedFile::open(const std::string& filename)
+{
+    osg::ref_ptr<MappedFile> m = new MappedFile();
+#ifdef _WIN32
+    HANDLE file = ::CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ,
+        NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return 0L;
+
+    LARGE_INTEGER size;
+    if (::GetFileSizeEx(file, &size) && size.QuadPart > 0)
+    {
+        HANDLE mapping = ::CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping)
+        {
+            m->_data = (char*)::MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            m->_size = (zip_uint64_t)size.QuadPart;
+            ::CloseHandle(mapping);
+        }
+    }
+    ::CloseHandle(file);
+#else
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        return 0L;
+
+    struct stat st;
+    if (::fstat(fd, &st) == 0 && st.st_size > 0)
+    {
+        void* ptr = ::mmap(0L, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (ptr != MAP_FAILED)
+        {
+            // lookups are random, so don't let the kernel read ahead
+            ::madvise(ptr, (size_t)st.st_size, MADV_RANDOM);
+            m->_data = (char*)ptr;
+            m->_size = (zip_uint64_t)st.st_size;
+        }
+    }
+    ::close(fd);
+#endif
+    return m->_data ? m.release() : 0L;
+}
+
+ZipArchive::MappedFile::~MappedFile()
+{
+    if (_data)
+    {
+#ifdef _WIN32
+        ::UnmapViewOfFile(_data);
+#else
+        ::munmap(_data, (size_t)_size);
+#endif
+    }
+}
+
+void ZipArchive::EntryStream::setData(const char* data, std::size_t length)
+{
+    char* p = const_cast<char*>(data);
+    setg(p, p, p + length);
+    clear();
+}
+
+ZipArchive::EntryStream::pos_type
+ZipArchive::EntryStream::seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode)
+{
+    char* p =
+        dir == std::ios_base::beg ? eback() + off :
+        dir == std::ios_base::cur ? gptr() + off :
+        egptr() + off;
+
+    if (p < eback() || p > egptr())
+        return pos_type(off_type(-1));
+
+    setg(eback(), p, egptr());
+    return pos_type(p - eback());
+}
+
+ZipArchive::EntryStream::pos_type
+ZipArchive::EntryStream::seekpos(pos_type pos, std::ios_base::openmode which)
+{
+    return seekoff(off_type(pos), std::ios_base::beg, which);
+}
+
+//------------------------------------------------------------------------
 
 ZipArchive::ZipArchive()  :
 _zipLoaded( false )
@@ -48,15 +185,18 @@ void ZipArchive::close()
         OpenThreads::ScopedLock<OpenThreads::Mutex> exclusive(_zipMutex);
         if ( _zipLoaded )
         {
-            // close the file (on one thread since it's a shared file)
-            const PerThreadData& data = getDataNoLock();
-
-            zip_close(data._zipHandle);
+            // close the libzip handles, if any were opened
+            for (PerThreadDataMap::iterator i = _perThreadData.begin(); i != _perThreadData.end(); ++i)
+            {
+                if (i->second._zipHandle != NULL)
+                    zip_close(i->second._zipHandle);
+            }
             // clear out the file handles
             _perThreadData.clear();
 
-            // clear out the index.
+            // clear out the index and the mapping.
             _zipIndex.clear();
+            _mapping = 0L;
 
             _zipLoaded = false;
         }
@@ -124,15 +264,29 @@ bool ZipArchive::open(const std::string& file, ArchiveStatus /*status*/, const o
 
             _password = ReadPassword(options);
 
-            // open the zip file in this thread:
-            const PerThreadData& data = getDataNoLock();
-
-            // establish a shared (read-only) index:
-            if ( data._zipHandle != NULL )
+            // Map the archive and index its central directory ourselves.
+            // That serves entries without any per-thread libzip handles,
+            // which would each re-read the central directory on open.
+            _mapping = MappedFile::open(_filename);
+            if (_mapping.valid() && IndexCentralDirectory())
             {
-                IndexZipFiles( data._zipHandle );
                 _zipLoaded = true;
             }
+            else
+            {
+                _mapping = 0L;
+                _zipIndex.clear();
+
+                // open the zip file in this thread:
+                const PerThreadData& data = getDataNoLock();
+
+                // establish a shared (read-only) index:
+                if ( data._zipHandle != NULL )
+                {
+                    IndexZipFiles( data._zipHandle );
+                    _zipLoaded = true;
+                }
+            }
         }
     }
 
@@ -146,7 +300,7 @@ osgDB::ReaderWriter::ReadResult ZipArchive::readObject(const std::string& file,
     std::string ext = osgDB::getLowerCaseFileExtension(file);
     if (!_zipLoaded || !acceptsExtension(ext)) return osgDB::ReaderWriter::ReadResult::FILE_NOT_HANDLED;
 
-    std::stringstream buffer;
+    EntryStream buffer;
 
     osgDB::ReaderWriter* rw = ReadFromZipIndex(file, options, buffer);
     if (rw != NULL)
@@ -174,7 +328,7 @@ osgDB::ReaderWriter::ReadResult ZipArchive::readImage(const std::string& file,co
     std::string ext = osgDB::getLowerCaseFileExtension(file);
     if (!_zipLoaded || !acceptsExtension(ext)) return osgDB::ReaderWriter::ReadResult::FILE_NOT_HANDLED;
 
-    std::stringstream buffer;
+    EntryStream buffer;
     osgDB::ReaderWriter* rw = ReadFromZipIndex(file, options, buffer);
     if (rw != NULL)
     {
@@ -201,7 +355,7 @@ osgDB::ReaderWriter::ReadResult ZipArchive::readHeightField(const std::string& f
     std::string ext = osgDB::getLowerCaseFileExtension(file);
     if (!_zipLoaded || !acceptsExtension(ext)) return osgDB::ReaderWriter::ReadResult::FILE_NOT_HANDLED;
 
-    std::stringstream buffer;
+    EntryStream buffer;
 
     osgDB::ReaderWriter* rw = ReadFromZipIndex(file, options, buffer);
     if (rw != NULL)
@@ -230,7 +384,7 @@ osgDB::ReaderWriter::ReadResult ZipArchive::readNode(const std::string& file,con
     std::string ext = osgDB::getLowerCaseFileExtension(file);
     if (!_zipLoaded || !acceptsExtension(ext)) return osgDB::ReaderWriter::ReadResult::FILE_NOT_HANDLED;
 
-    std::stringstream buffer;
+    EntryStream buffer;
 
     osgDB::ReaderWriter* rw = ReadFromZipIndex(file, options, buffer);
     if (rw != NULL)
@@ -259,7 +413,7 @@ osgDB::ReaderWriter::ReadResult ZipArchive::readScript(const std::string& file,c
     std::string ext = osgDB::getLowerCaseFileExtension(file);
     if (!_zipLoaded || !acceptsExtension(ext)) return osgDB::ReaderWriter::ReadResult::FILE_NOT_HANDLED;
 
-    std::stringstream buffer;
+    EntryStream buffer;
 
     osgDB::ReaderWriter* rw = ReadFromZipIndex(file, options, buffer);
     if (rw != NULL)
@@ -288,7 +442,7 @@ osgDB::ReaderWriter::ReadResult ZipArchive::readShader(const std::string& file,c
     std::string ext = osgDB::getLowerCaseFileExtension(file);
     if (!_zipLoaded || !acceptsExtension(ext)) return osgDB::ReaderWriter::ReadResult::FILE_NOT_HANDLED;
 
-    std::stringstream buffer;
+    EntryStream buffer;
 
     osgDB::ReaderWriter* rw = ReadFromZipIndex(file, options, buffer);
     if (rw != NULL)
@@ -340,36 +494,103 @@ osgDB::ReaderWriter::WriteResult ZipArchive::writeShader(const osg::Shader& /*sh
     return osgDB::ReaderWriter::WriteResult(osgDB::ReaderWriter::WriteResult::FILE_NOT_HANDLED);
 }
 
-osgDB::ReaderWriter* ZipArchive::ReadFromZipIndex(const std::string& filename, const osgDB::ReaderWriter::Options* options, std::stringstream& streamIn) const
+bool ZipArchive::ReadFromMapping(const ZipEntry& entry, EntryStream& streamIn) const
 {
-    zip_uint64_t idx;
-    if (GetZipIndex(filename, idx))
+    if (!_mapping.valid() || entry._encrypted)
+        return false;
+
+    const char*  base = _mapping->data();
+    zip_uint64_t size = _mapping->size();
+
+    zip_uint64_t lho = entry._localHeaderOffset;
+    if (lho + LOCAL_HEADER_SIZE > size || get32(base + lho) != SIG_LOCAL_HEADER)
+        return false;
+
+    // the local header's name/extra lengths can differ from the central directory's
+    zip_uint64_t offset = lho + LOCAL_HEADER_SIZE + get16(base + lho + 26) + get16(base + lho + 28);
+    if (offset + entry._compressedSize > size)
+        return false;
+
+    if (entry._method == ZIP_CM_STORE)
     {
-        // fetch the handle for the current thread:
+        // zero-copy: the stream reads straight from the mapping
+        streamIn.setData(base + offset, (std::size_t)entry._size);
+        return true;
+    }
+
+#ifdef OSGEARTH_ZIP_HAVE_ZLIB
+    if (entry._method == ZIP_CM_DEFLATE && entry._compressedSize <= UINT_MAX && entry._size <= UINT_MAX)
+    {
+        std::string& out = streamIn.scratch();
+        out.resize((std::size_t)entry._size);
+
+        // raw deflate stream; no zlib header
+        z_stream zs;
+        ::memset(&zs, 0, sizeof(zs));
+        if (inflateInit2(&zs, -MAX_WBITS) != Z_OK)
+            return false;
+
+        zs.next_in = (Bytef*)(base + offset);
+        zs.avail_in = (uInt)entry._compressedSize;
+        zs.next_out = (Bytef*)(out.empty() ? NULL : &out[0]);
+        zs.avail_out = (uInt)out.size();
+
+        int rc = inflate(&zs, Z_FINISH);
+        inflateEnd(&zs);
+
+        if (rc != Z_STREAM_END || zs.total_out != entry._size)
+            return false;
+
+        streamIn.setData(out.data(), out.size());
+        return true;
+    }
+#endif
+
+    return false;
+}
+
+osgDB::ReaderWriter* ZipArchive::ReadFromZipIndex(const std::string& filename, const osgDB::ReaderWriter::Options* options, EntryStream& streamIn) const
+{
+    const ZipEntry* entry = GetZipEntry(filename);
+    if (entry == NULL)
+        return NULL;
+
+    bool ok = ReadFromMapping(*entry, streamIn);
+
+    if (!ok)
+    {
+        // encrypted, or compressed with a method we don't decode ourselves;
+        // fetch the libzip handle for the current thread.
         const PerThreadData& data = getData();
         if (data._zipHandle != NULL)
         {
             zip_file_t* zf;
-            if ((zf = zip_fopen_index(data._zipHandle, idx, 0)) != NULL)
+            if ((zf = zip_fopen_index(data._zipHandle, entry->_index, 0)) != NULL)
             {
+                std::string& out = streamIn.scratch();
                 char buf[8192];
                 zip_int64_t n;
                 while ((n = zip_fread(zf, buf, sizeof(buf))) > 0) {
-                    streamIn.write(buf, (size_t)n);
+                    out.append(buf, (size_t)n);
                 }
                 zip_fclose(zf);
 
-                std::string file_ext = osgDB::getFileExtension(filename);
-                osgDB::ReaderWriter* rw = osgDB::Registry::instance()->getReaderWriterForExtension(file_ext);
-                if (rw != NULL)
-                {
-                    return rw;
-                }
-
+                streamIn.setData(out.data(), out.size());
+                ok = true;
             }
         }
     }
 
+    if (ok)
+    {
+        std::string file_ext = osgDB::getFileExtension(filename);
+        osgDB::ReaderWriter* rw = osgDB::Registry::instance()->getReaderWriterForExtension(file_ext);
+        if (rw != NULL)
+        {
+            return rw;
+        }
+    }
+
     return NULL;
 }
 
@@ -402,29 +623,154 @@ void ZipArchive::IndexZipFiles(zip_t* zip)
     if (zip != NULL && !_zipLoaded)
     {
         zip_uint64_t  count = zip_get_num_entries(zip, 0);
+        _zipIndex.reserve((size_t)count);
         for (zip_uint64_t i = 0; i < count; i++)
         {
             std::string name(zip_get_name(zip, i, 0));
             CleanupFileString(name);
             if (!name.empty())
             {
-                _zipIndex.insert(ZipEntryMapping(name, i));
+                // no mapping on this path, so every read goes through libzip
+                ZipEntry entry;
+                entry._index = i;
+                entry._localHeaderOffset = 0;
+                entry._compressedSize = 0;
+                entry._size = 0;
+                entry._method = ZIP_CM_STORE;
+                entry._encrypted = false;
+                _zipIndex.insert(ZipEntryMapping(name, entry));
             }
         }
     }
 }
 
+bool ZipArchive::IndexCentralDirectory()
+{
+    const char*  base = _mapping->data();
+    zip_uint64_t size = _mapping->size();
+
+    if (size < END_SIZE)
+        return false;
+
+    // find the end of central directory record, which is followed
+    // by a comment of up to 64K:
+    zip_uint64_t end = size - END_SIZE;
+    zip_uint64_t stop = end > 0xFFFF ? end - 0xFFFF : 0;
+    while (get32(base + end) != SIG_END)
+    {
+        if (end == stop)
+            return false;
+        --end;
+    }
+
+    zip_uint64_t count  = get16(base + end + 10);
+    zip_uint64_t cdSize = get32(base + end + 12);
+    zip_uint64_t cdOffset = get32(base + end + 16);
+
+    // ZIP64 archives keep the real values in another record
+    if (count == 0xFFFF || cdSize == 0xFFFFFFFF || cdOffset == 0xFFFFFFFF)
+    {
+        if (end < END64_LOCATOR_SIZE)
+            return false;
+
+        const char* locator = base + end - END64_LOCATOR_SIZE;
+        if (get32(locator) != SIG_END64_LOCATOR)
+            return false;
+
+        zip_uint64_t end64 = get64(locator + 8);
+        if (end64 + END64_SIZE > size || get32(base + end64) != SIG_END64)
+            return false;
+
+        count    = get64(base + end64 + 32);
+        cdSize   = get64(base + end64 + 40);
+        cdOffset = get64(base + end64 + 48);
+    }
+
+    if (cdOffset + cdSize > size)
+        return false;
+
+    _zipIndex.reserve((size_t)count);
+
+    zip_uint64_t pos = cdOffset;
+    for (zip_uint64_t i = 0; i < count; ++i)
+    {
+        if (pos + CENTRAL_HEADER_SIZE > size)
+            return false;
+
+        const char* h = base + pos;
+        if (get32(h) != SIG_CENTRAL_HEADER)
+            return false;
+
+        zip_uint64_t nameLength    = get16(h + 28);
+        zip_uint64_t extraLength   = get16(h + 30);
+        zip_uint64_t commentLength = get16(h + 32);
+
+        if (pos + CENTRAL_HEADER_SIZE + nameLength + extraLength + commentLength > size)
+            return false;
+
+        ZipEntry entry;
+        entry._index             = i;
+        entry._encrypted         = (get16(h + 8) & 0x0001) != 0;
+        entry._method            = (unsigned short)get16(h + 10);
+        entry._compressedSize    = get32(h + 20);
+        entry._size              = get32(h + 24);
+        entry._localHeaderOffset = get32(h + 42);
+
+        // ZIP64 extended information replaces the saturated fields, in order
+        const char* extra = h + CENTRAL_HEADER_SIZE + nameLength;
+        const char* extraEnd = extra + extraLength;
+        while (extra + 4 <= extraEnd)
+        {
+            zip_uint64_t id = get16(extra);
+            zip_uint64_t length = get16(extra + 2);
+            const char* field = extra + 4;
+            const char* fieldEnd = field + length;
+            if (fieldEnd > extraEnd)
+                break;
+
+            if (id == 0x0001)
+            {
+                if (entry._size == 0xFFFFFFFF && field + 8 <= fieldEnd)
+                    entry._size = get64(field), field += 8;
+                if (entry._compressedSize == 0xFFFFFFFF && field + 8 <= fieldEnd)
+                    entry._compressedSize = get64(field), field += 8;
+                if (entry._localHeaderOffset == 0xFFFFFFFF && field + 8 <= fieldEnd)
+                    entry._localHeaderOffset = get64(field), field += 8;
+                break;
+            }
+            extra = fieldEnd;
+        }
+
+        std::string name(h + CENTRAL_HEADER_SIZE, (size_t)nameLength);
+        CleanupFileString(name);
+        if (!name.empty())
+        {
+            _zipIndex.insert(ZipEntryMapping(name, entry));
+        }
+
+        pos += CENTRAL_HEADER_SIZE + nameLength + extraLength + commentLength;
+    }
+
+    return true;
+}
+
 bool ZipArchive::GetZipIndex(const std::string& filename, zip_uint64_t& idx) const
 {
-    const ZipEntryMap::iterator iter = const_cast<ZipEntryMap*>(&_zipIndex)->find(filename);
-    if (iter != _zipIndex.end())
+    const ZipEntry* entry = GetZipEntry(filename);
+    if (entry != NULL)
     {
-        idx = (*iter).second;
+        idx = entry->_index;
         return true;
     }
     return false;
 }
 
+const ZipArchive::ZipEntry* ZipArchive::GetZipEntry(const std::string& filename) const
+{
+    ZipEntryMap::const_iterator iter = _zipIndex.find(filename);
+    return iter != _zipIndex.end() ? &iter->second : NULL;
+}
+
 osgDB::FileType ZipArchive::getFileType(const std::string& filename) const
 {
     zip_uint64_t idx;
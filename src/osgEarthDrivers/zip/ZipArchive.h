@@ -9,6 +9,10 @@
 
 #include <zip.h>
 
+#include <istream>
+#include <streambuf>
+#include <unordered_map>
+
 class ZipArchive : public osgDB::Archive
 {
     public:
@@ -62,21 +66,68 @@ class ZipArchive : public osgDB::Archive
 
     protected:
 
+        /** Read-only memory mapping of the whole archive file. */
+        class MappedFile : public osg::Referenced
+        {
+        public:
+            static MappedFile* open(const std::string& filename);
+            const char* data() const { return _data; }
+            zip_uint64_t size() const { return _size; }
+        protected:
+            MappedFile() : _data(0L), _size(0u) { }
+            virtual ~MappedFile();
+            char* _data;
+            zip_uint64_t _size;
+        };
+
+        /** Input stream over an entry's bytes, either pointing straight into
+          * the mapping (stored entries) or into its own decompressed copy. */
+        class EntryStream : private std::streambuf, public std::istream
+        {
+        public:
+            typedef std::streambuf::pos_type pos_type;
+            typedef std::streambuf::off_type off_type;
+
+            EntryStream() : std::istream(this) { }
+            void setData(const char* data, std::size_t length);
+            std::string& scratch() { return _scratch; }
+        protected:
+            pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which);
+            pos_type seekpos(pos_type pos, std::ios_base::openmode which);
+        private:
+            std::string _scratch;
+        };
+
+        /** Central directory record for one archived file. */
+        struct ZipEntry
+        {
+            zip_uint64_t   _index;             // libzip index, for the fallback path
+            zip_uint64_t   _localHeaderOffset;
+            zip_uint64_t   _compressedSize;
+            zip_uint64_t   _size;
+            unsigned short _method;
+            bool           _encrypted;
+        };
+
         void IndexZipFiles(zip_t* zip);
+        bool IndexCentralDirectory();
         bool GetZipIndex(const std::string& filename, zip_uint64_t& idx) const;
-        osgDB::ReaderWriter* ReadFromZipIndex(const std::string& filename, const osgDB::ReaderWriter::Options* options, std::stringstream& streamIn) const;
+        const ZipEntry* GetZipEntry(const std::string& filename) const;
+        bool ReadFromMapping(const ZipEntry& entry, EntryStream& streamIn) const;
+        osgDB::ReaderWriter* ReadFromZipIndex(const std::string& filename, const osgDB::ReaderWriter::Options* options, EntryStream& streamIn) const;
         std::string ReadPassword(const osgDB::ReaderWriter::Options* options) const;
 
     private:
 
-        typedef std::pair<std::string, zip_uint64_t > ZipEntryMapping;
-        typedef std::map<std::string, zip_uint64_t > ZipEntryMap;
+        typedef std::pair<std::string, ZipEntry > ZipEntryMapping;
+        typedef std::unordered_map<std::string, ZipEntry > ZipEntryMap;
 
         std::string _filename, _password, _membuffer;
 
         OpenThreads::Mutex _zipMutex;
         bool               _zipLoaded;
-        ZipEntryMap        _zipIndex;        
+        ZipEntryMap        _zipIndex;
+        osg::ref_ptr<MappedFile> _mapping;
 
         struct PerThreadData {
             zip_t* _zipHandle;
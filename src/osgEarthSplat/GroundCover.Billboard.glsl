@@ -8,6 +8,7 @@ $GLSL_DEFAULT_PRECISION_FLOAT
 #pragma import_defines(OE_GROUNDCOVER_MASK_SAMPLER)
 #pragma import_defines(OE_GROUNDCOVER_MASK_MATRIX)
 #pragma import_defines(OE_IS_SHADOW_CAMERA)
+#pragma import_defines(OE_GROUNDCOVER_USE_IMPOSTORS)
 
 // Instance data from compute shader
 struct RenderData
@@ -19,7 +20,7 @@ struct RenderData
     float width;      // 4
     float height;     // 4
     float fillEdge;   // 4
-    float _padding;   // 4
+    int impostorIndex; // 4
 };
 
 layout(binding=1, std430) readonly buffer RenderBuffer {
@@ -53,6 +54,18 @@ out vec2 oe_GroundCover_texCoord;
 // Output that selects the land cover texture from the texture array (non interpolated)
 flat out float oe_GroundCover_atlasIndex;
 
+#ifdef OE_GROUNDCOVER_USE_IMPOSTORS
+uniform float oe_GroundCover_impostorFrames;
+
+// impostor layer (-1 = not an impostor), the frames to blend, and the
+// local frame at the instance, in view space
+flat out float oe_GroundCover_impostor;
+flat out vec4 oe_GroundCover_impostorFrame;
+flat out vec3 oe_GroundCover_impostorE;
+flat out vec3 oe_GroundCover_impostorN;
+flat out vec3 oe_GroundCover_impostorU;
+#endif
+
 
 // Generate a wind-perturbation value
 float oe_GroundCover_applyWind(float time, float factor, float randOffset)
@@ -89,6 +102,9 @@ void oe_GroundCover_VS(inout vec4 vertex_view)
 {
     // intialize with a "no draw" value (consider using a compute/gs cull instead)
     oe_GroundCover_atlasIndex = -1.0;
+#ifdef OE_GROUNDCOVER_USE_IMPOSTORS
+    oe_GroundCover_impostor = -1.0;
+#endif
 
     vertex_view = gl_ModelViewMatrix * render[gl_InstanceID].vertex;
     oe_layer_tilec = vec4(render[gl_InstanceID].tilec, 0, 1);
@@ -116,6 +132,64 @@ void oe_GroundCover_VS(inout vec4 vertex_view)
 
     int which = gl_VertexID & 7; // mod8 - there are 8 verts per instance
 
+#ifdef OE_GROUNDCOVER_USE_IMPOSTORS
+
+    // A model impostor is a camera-facing square around the model that
+    // shows the baked frames nearest to the direction it's seen from.
+    if (render[gl_InstanceID].impostorIndex >= 0)
+    {
+        oe_GroundCover_atlasIndex = -1.0;
+
+        // only the first quad draws
+        if (which >= 4)
+            return;
+
+        // local frame at the instance
+        vec3 U = oe_UpVectorView;
+        vec3 E = cross(mat3(osg_ViewMatrix) * vec3(0,0,1), U);
+        if (dot(E,E) < 1e-6)
+            E = mat3(osg_ViewMatrix) * vec3(1,0,0);
+        E = normalize(E);
+        vec3 N = cross(U, E);
+
+        vec3 C = vertex_view.xyz + U * render[gl_InstanceID].height * falloff;
+        vec3 V = normalize(-C);
+        vec3 R = cross(U, V);
+        R = dot(R,R) < 1e-6 ? E : normalize(R);
+        vec3 T = cross(V, R);
+
+        float k = 0.5 * width;
+        vertex_view.xyz = C
+            + R * (which == 0 || which == 2 ? -k : k)
+            + T * (which < 2 ? -k : k);
+
+        // hemi-octahedral coordinates of the view direction select the
+        // four frames around it and their blend weights
+        vec3 L = vec3(dot(V,E), dot(V,N), max(dot(V,U), 0.0));
+        vec2 p = L.xy / max(abs(L.x) + abs(L.y) + L.z, 1e-5);
+        float maxFrame = max(oe_GroundCover_impostorFrames - 1.0, 1.0);
+        vec2 g = (vec2(p.x + p.y, p.x - p.y) * 0.5 + 0.5) * maxFrame;
+        vec2 f0 = clamp(floor(g), vec2(0.0), vec2(maxFrame - 1.0));
+        oe_GroundCover_impostorFrame = vec4(f0, clamp(g - f0, 0.0, 1.0));
+
+        oe_GroundCover_impostor = float(render[gl_InstanceID].impostorIndex);
+        oe_GroundCover_impostorE = E;
+        oe_GroundCover_impostorN = N;
+        oe_GroundCover_impostorU = U;
+
+        vp_Color = vec4(1.0);
+        vp_Normal = V;
+
+        oe_GroundCover_texCoord =
+            which == 0? vec2(0, 0) :
+            which == 1? vec2(1, 0) :
+            which == 2? vec2(0, 1) :
+            vec2(1, 1);
+        return;
+    }
+
+#endif // OE_GROUNDCOVER_USE_IMPOSTORS
+
 #ifdef OE_IS_SHADOW_CAMERA
 
     // For a shadow camera, draw the tree as a cross hatch model instead of a billboard.
@@ -240,6 +314,7 @@ void oe_GroundCover_VS(inout vec4 vertex_view)
 #pragma vp_location   fragment_coloring
 
 #pragma import_defines(OE_IS_SHADOW_CAMERA)
+#pragma import_defines(OE_GROUNDCOVER_USE_IMPOSTORS)
 
 uniform sampler2DArray oe_GroundCover_billboardTex;
 uniform float oe_GroundCover_maxAlpha;
@@ -248,15 +323,56 @@ uniform int oe_GroundCover_A2C;
 in vec2 oe_GroundCover_texCoord;
 flat in float oe_GroundCover_atlasIndex;
 
+#ifdef OE_GROUNDCOVER_USE_IMPOSTORS
+uniform sampler2DArray oe_GroundCover_impostorTex;
+uniform float oe_GroundCover_impostorFrames;
+flat in float oe_GroundCover_impostor;
+flat in vec4 oe_GroundCover_impostorFrame;
+flat in vec3 oe_GroundCover_impostorE;
+flat in vec3 oe_GroundCover_impostorN;
+flat in vec3 oe_GroundCover_impostorU;
+vec3 vp_Normal;
+
+// Location of the fragment in one frame of the impostor
+vec3 oe_GroundCover_impostorCoord(in vec2 frame, in float layer)
+{
+    return vec3((frame + oe_GroundCover_texCoord) / oe_GroundCover_impostorFrames, layer);
+}
+#endif
+
 void oe_GroundCover_FS(inout vec4 color)
 {
-    if (oe_GroundCover_atlasIndex < 0.0)
+#ifdef OE_GROUNDCOVER_USE_IMPOSTORS
+    if (oe_GroundCover_impostor >= 0.0)
     {
-        discard;
+        // blend the four frames around the view direction
+        vec2 f0 = oe_GroundCover_impostorFrame.xy;
+        vec2 w = oe_GroundCover_impostorFrame.zw;
+        float layer = oe_GroundCover_impostor;
+        vec4 c00 = texture(oe_GroundCover_impostorTex, oe_GroundCover_impostorCoord(f0, layer));
+        vec4 c10 = texture(oe_GroundCover_impostorTex, oe_GroundCover_impostorCoord(f0 + vec2(1,0), layer));
+        vec4 c01 = texture(oe_GroundCover_impostorTex, oe_GroundCover_impostorCoord(f0 + vec2(0,1), layer));
+        vec4 c11 = texture(oe_GroundCover_impostorTex, oe_GroundCover_impostorCoord(f0 + vec2(1,1), layer));
+        color *= mix(mix(c00, c10, w.x), mix(c01, c11, w.x), w.y);
+
+        // light with the local normal of the nearest frame
+        vec3 n = texture(oe_GroundCover_impostorTex, oe_GroundCover_impostorCoord(f0 + step(0.5, w), layer + 1.0)).xyz * 2.0 - 1.0;
+        vp_Normal = normalize(
+            oe_GroundCover_impostorE * n.x +
+            oe_GroundCover_impostorN * n.y +
+            oe_GroundCover_impostorU * n.z);
     }
+    else
+#endif
+    {
+        if (oe_GroundCover_atlasIndex < 0.0)
+        {
+            discard;
+        }
 
-    // modulate the texture
-    color *= texture(oe_GroundCover_billboardTex, vec3(oe_GroundCover_texCoord, oe_GroundCover_atlasIndex));
+        // modulate the texture
+        color *= texture(oe_GroundCover_billboardTex, vec3(oe_GroundCover_texCoord, oe_GroundCover_atlasIndex));
+    }
 
 #ifdef OE_IS_SHADOW_CAMERA
     if (color.a < oe_GroundCover_maxAlpha)
@@ -11,9 +11,12 @@ struct oe_gc_LandCoverGroup {
 struct oe_gc_Asset {
     int atlasIndexSide;
     int atlasIndexTop;
+    int atlasIndexImpostor;
     float width;
     float height;
     float sizeVariation;
+    float impostorRadius;
+    float impostorCenter;
 };
 bool oe_gc_getLandCoverGroup(in int zone, in int code, out oe_gc_LandCoverGroup result);
 bool oe_gc_getAsset(in int index, out oe_gc_Asset result);
@@ -42,7 +45,7 @@ struct RenderData
     float width;      // 4
     float height;     // 4
     float fillEdge;   // 4
-    float _padding;   // 4
+    int impostorIndex; // 4
 };
 
 layout(binding=1, std430) writeonly buffer RenderBuffer
@@ -57,7 +60,7 @@ uniform sampler2D oe_GroundCover_noiseTex;
 #define NOISE_CLUMPY   3
 
 // (LLx, LLy, URx, URy, tileNum
-uniform float oe_tile[5];
+uniform float oe_tile[6];
 uniform int oe_gc_zone;
 
 uniform vec2 oe_tile_elevTexelCoeff;
@@ -191,6 +194,10 @@ void main()
 
     noise[NOISE_SMOOTH] /= group.fill;
 
+    // thin out instances evenly when the density is turned down
+    if (noise[NOISE_RANDOM_2] > oe_tile[5])
+        return;
+
     vec2 LL = vec2(oe_tile[0], oe_tile[1]);
     vec2 UR = vec2(oe_tile[2], oe_tile[3]);
 
@@ -209,9 +216,9 @@ void main()
 #endif
 
     // It's a keeper. Populate the render buffer.
+    // the render buffer is bound to this tile's range
     uint tileNum = uint(oe_tile[4]);
-    uint start = tileNum * gl_NumWorkGroups.y * gl_NumWorkGroups.x;
-    uint slot = start + atomicAdd(cmd[tileNum].instanceCount, 1);
+    uint slot = atomicAdd(cmd[tileNum].instanceCount, 1);
 
     render[slot].fillEdge = 1.0;
     const float xx = 0.5;
@@ -242,4 +249,13 @@ void main()
     float sizeScale = asset.sizeVariation * (noise[NOISE_RANDOM_2]*2.0-1.0);
     render[slot].width = asset.width + asset.width*sizeScale;
     render[slot].height = asset.height + asset.height*sizeScale;
+
+    // An impostor draws as a square around the model's bounding sphere,
+    // so store the square's size and the height of its center instead.
+    render[slot].impostorIndex = asset.atlasIndexImpostor;
+    if (asset.atlasIndexImpostor >= 0)
+    {
+        render[slot].width = 2.0 * asset.impostorRadius * render[slot].height;
+        render[slot].height = asset.impostorCenter * render[slot].height;
+    }
 }
@@ -17,7 +17,7 @@ struct RenderData
     float width;      // 4
     float height;     // 4
     float fillEdge;   // 4
-    float _padding;   // 4
+    int impostorIndex; // 4
 };
 
 layout(binding=1, std430) readonly buffer RenderBuffer
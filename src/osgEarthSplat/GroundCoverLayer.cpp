@@ -30,9 +30,17 @@
 #include <osgEarth/Registry>
 #include <osgEarth/Capabilities>
 #include <osgEarth/Math>
+#include <osgEarth/ImageUtils>
+#include <osgEarth/Threading>
+#include <osgEarth/ImpostorBaker>
+#include <osgEarth/ShaderGenerator>
+#include <osgEarth/GPUTimer>
+#include <osgEarth/FrameGovernor>
 #include <osg/BlendFunc>
+#include <osg/ComputeBoundsVisitor>
 #include <osg/Multisample>
 #include <osg/Texture2D>
+#include <osg/Texture2DArray>
 #include <osg/Depth>
 #include <osg/Version>
 #include <osgDB/ReadFile>
@@ -45,6 +53,7 @@
 
 #define GCTEX_SAMPLER "oe_GroundCover_billboardTex"
 #define NOISE_SAMPLER "oe_GroundCover_noiseTex"
+#define IMPOSTOR_SAMPLER "oe_GroundCover_impostorTex"
 
 #ifndef GL_MULTISAMPLE
 #define GL_MULTISAMPLE 0x809D
@@ -74,6 +83,7 @@ GroundCoverLayer::Options::getConfig() const
     conf.set("cast_shadows", _castShadows);
     conf.set("max_alpha", maxAlpha());
     conf.set("alpha_to_coverage", alphaToCoverage());
+    conf.set("max_gpu_memory", maxGPUMemory());
 
     Config zones("zones");
     for (int i = 0; i < _biomeZones.size(); ++i) {
@@ -94,6 +104,7 @@ GroundCoverLayer::Options::fromConfig(const Config& conf)
     castShadows().setDefault(false);
     maxAlpha().setDefault(0.15f);
     alphaToCoverage().setDefault(true);
+    maxGPUMemory().setDefault(128u);
 
     maskLayer().get(conf, "mask_layer");
     colorLayer().get(conf, "color_layer");
@@ -102,6 +113,7 @@ GroundCoverLayer::Options::fromConfig(const Config& conf)
     conf.get("cast_shadows", _castShadows);
     conf.get("max_alpha", maxAlpha());
     conf.get("alpha_to_coverage", alphaToCoverage());
+    conf.get("max_gpu_memory", maxGPUMemory());
 
     const Config* zones = conf.child_ptr("zones");
     if (zones)
@@ -240,6 +252,10 @@ GroundCoverLayer::init()
 
     _isModel = false;
 
+    _impostorBakes = new osg::Group();
+    _impostorBakes->setName("GroundCover impostor bakes");
+    _impostorFrames = 0u;
+
     _debug = (::getenv("OSGEARTH_GROUNDCOVER_DEBUG") != NULL);
 
 }
@@ -286,9 +302,13 @@ GroundCoverLayer::closeImplementation()
 
     _noiseBinding.release();
     _groundCoverTexBinding.release();
+    _impostorTexBinding.release();
     
     _liveAssets.clear();
-    _atlasImages.clear();
+    _atlas = NULL;
+
+    _impostorBakes->removeChildren(0, _impostorBakes->getNumChildren());
+    _impostorTex = NULL;
 
     return PatchLayer::closeImplementation();
 }
@@ -379,6 +399,18 @@ GroundCoverLayer::getUseAlphaToCoverage() const
     return options().alphaToCoverage().get();
 }
 
+void
+GroundCoverLayer::setMaxGPUMemory(unsigned value)
+{
+    options().maxGPUMemory() = value;
+}
+
+unsigned
+GroundCoverLayer::getMaxGPUMemory() const
+{
+    return options().maxGPUMemory().get();
+}
+
 void
 GroundCoverLayer::addedToMap(const Map* map)
 {
@@ -455,6 +487,14 @@ GroundCoverLayer::setTerrainResources(TerrainResources* res)
             }
         }
 
+        if (_impostorTexBinding.valid() == false)
+        {
+            if (res->reserveTextureImageUnitForLayer(_impostorTexBinding, this, "Ground cover impostor atlas") == false)
+            {
+                OE_WARN << LC << "No texture unit available for ground cover impostors\n";
+            }
+        }
+
         if (_groundCoverTexBinding.valid())
         {
             buildStateSets();
@@ -462,6 +502,12 @@ GroundCoverLayer::setTerrainResources(TerrainResources* res)
     }
 }
 
+osg::Node*
+GroundCoverLayer::getNode() const
+{
+    return _impostorBakes.get();
+}
+
 //Returns true if any billboard in the data model uses a "top-down" image.
 bool 
 GroundCoverLayer::shouldEnableTopDownBillboards() const
@@ -500,7 +546,7 @@ GroundCoverLayer::buildStateSets()
 
 
     NoiseTextureFactory noise;
-    osg::ref_ptr<osg::Texture> noiseTexture = noise.create(256u, 4u);
+    osg::ref_ptr<osg::Texture> noiseTexture = noise.getShared(256u);
 
     GroundCoverShaders shaders;
 
@@ -558,6 +604,15 @@ GroundCoverLayer::buildStateSets()
     stateset->setTextureAttribute(_groundCoverTexBinding.unit(), tex);
     stateset->addUniform(new osg::Uniform(GCTEX_SAMPLER, _groundCoverTexBinding.unit()));
 
+    // Model assets draw as impostors
+    if (_impostorTex.valid() && _impostorTexBinding.valid())
+    {
+        stateset->setDefine("OE_GROUNDCOVER_USE_IMPOSTORS");
+        stateset->setTextureAttribute(_impostorTexBinding.unit(), _impostorTex.get());
+        stateset->addUniform(new osg::Uniform(IMPOSTOR_SAMPLER, _impostorTexBinding.unit()));
+        stateset->addUniform(new osg::Uniform("oe_GroundCover_impostorFrames", (float)_impostorFrames));
+    }
+
     // Assemble zone-specific statesets:
     float maxVisibleRange = getMaxVisibleRange();
     _zoneStateSets.clear();
@@ -740,10 +795,49 @@ GroundCoverLayer::Renderer::UniformState::UniformState()
     // when the program is active
     _computeDataUL = -1;
     _A2CUL = -1;
-    _tileCounter = 0;
     _numInstances1D = 0;
 }
 
+GroundCoverLayer::Renderer::TileSlot*
+GroundCoverLayer::Renderer::TileCache::acquire(const TileKey& key, unsigned frame)
+{
+    Slots::iterator i = _slots.find(key);
+    if (i != _slots.end())
+        return &i->second;
+
+    unsigned slot;
+    if (!_freeSlots.empty())
+    {
+        slot = _freeSlots.back();
+        _freeSlots.pop_back();
+    }
+    else
+    {
+        Slots::iterator lru = _slots.end();
+        for (Slots::iterator j = _slots.begin(); j != _slots.end(); ++j)
+        {
+            if (j->second._lastFrame != frame &&
+                (lru == _slots.end() || j->second._lastFrame < lru->second._lastFrame))
+            {
+                lru = j;
+            }
+        }
+
+        if (lru == _slots.end())
+            return NULL;
+
+        slot = lru->second._slot;
+        _slots.erase(lru);
+    }
+
+    TileSlot& ts = _slots[key];
+    ts._slot = slot;
+    ts._revision = ~0u; // not computed yet
+    ts._lastFrame = frame;
+    ts._density = 0.0f;
+    return &ts;
+}
+
 GroundCoverLayer::Renderer::Renderer(GroundCoverLayer* layer)
 {
     _layer = layer;
@@ -803,6 +897,17 @@ GroundCoverLayer::Renderer::draw(osg::RenderInfo& ri, const PatchLayer::TileBatc
         needsCompute = true;
     }
 
+    ds._frame = state->getFrameStamp() ? state->getFrameStamp()->getFrameNumber() : 0u;
+
+    // A new density means recomputing every tile's placement, so the
+    // governor only changes it in coarse steps.
+    float density = Util::FrameGovernor::getScale(Util::FrameGovernor::GROUND_COVER);
+    if (density != ds._density)
+    {
+        ds._density = density;
+        needsCompute = true;
+    }
+
     if (needsCompute)
     {
         // I'm not sure why we have to push the layer's stateset here.
@@ -811,15 +916,32 @@ GroundCoverLayer::Renderer::draw(osg::RenderInfo& ri, const PatchLayer::TileBatc
         
         state->pushStateSet(_layer->getStateSet());
 
-        // First pass: render with compute shader
+        // First pass: render with compute shader. Only tiles that aren't
+        // in the cache (or whose data changed) get computed.
         state->apply(_computeStateSet.get());
         applyLocalState(ri, ds);
 
-        instancer->allocateGLObjects(ri, tiles->size());
-        instancer->preCull(ri);
-        _pass = 0;
-        tiles->drawTiles(ri);
-        instancer->postCull(ri);
+        // Grow the cache to hold the whole batch, up to the memory limit:
+        TileCache& cache = ds._tileCaches[sa->_obj];
+        unsigned wanted = osg::minimum((unsigned)tiles->size(), cache._maxSlots);
+        if (cache._numSlots < wanted)
+        {
+            unsigned numSlots = osg::minimum(osg::maximum(wanted, cache._numSlots * 2u), cache._maxSlots);
+            instancer->allocateGLObjects(ri, numSlots);
+            for (unsigned i = numSlots; i > cache._numSlots; --i)
+                cache._freeSlots.push_back(i - 1);
+            cache._numSlots = numSlots;
+        }
+
+        {
+            static const osg::ref_ptr<Util::GPUTimer> s_computeTimer = Util::GPUTimer::get("groundcover.compute");
+            Util::GPUTimer::Scope gpuTimer(s_computeTimer.get(), ri);
+
+            instancer->preCull(ri);
+            _pass = 0;
+            tiles->drawTiles(ri);
+            instancer->postCull(ri);
+        }
 
         // restore previous program
         state->apply();
@@ -829,6 +951,8 @@ GroundCoverLayer::Renderer::draw(osg::RenderInfo& ri, const PatchLayer::TileBatc
         _pass = 1;
         tiles->drawTiles(ri);
 
+        instancer->endFrame(ri);
+
         state->popStateSet();
     }
 
@@ -868,8 +992,6 @@ GroundCoverLayer::Renderer::applyLocalState(osg::RenderInfo& ri, DrawState& ds)
         u._A2CUL = pcp->getUniformLocation(_A2CName);
     }
 
-    u._tileCounter = 0;
-
     // Check for initialization in this zone:
     const BiomeZone* bz = ZoneSA::extract(ri.getState())->_obj;
     osg::ref_ptr<InstanceCloud>& instancer = ds._instancers[bz];
@@ -894,6 +1016,12 @@ GroundCoverLayer::Renderer::applyLocalState(osg::RenderInfo& ri, DrawState& ds)
             instancer->setGeometry(_layer->createGeometry());
             instancer->setNumInstances(u._numInstances1D, u._numInstances1D);
 
+            // How many tiles' worth of instances fit in the memory limit
+            // (see RenderData in GroundCover.CS.glsl):
+            double bytesPerTile = (double)instancer->getNumInstances() * 48.0 + sizeof(InstanceCloud::DrawElementsIndirectCommand);
+            double maxBytes = (double)_layer->getMaxGPUMemory() * 1048576.0;
+            ds._tileCaches[bz]._maxSlots = osg::maximum((unsigned)(maxBytes / bytesPerTile), 1u);
+
             // TODO: review this. I don't like it but have no good reason. -gw
             // This is here to integrate the model's texture atlas into the stateset
             if (instancer->_geom->getStateSet())
@@ -926,9 +1054,20 @@ GroundCoverLayer::Renderer::drawTile(osg::RenderInfo& ri, const PatchLayer::Draw
         return;
 
     UniformState& u = ds._uniforms[pcp];
+    TileCache& cache = ds._tileCaches[sa->_obj];
 
     if (_pass == 0) // COMPUTE shader
     {
+        TileSlot* ts = cache.acquire(*tile._key, ds._frame);
+        if (ts == NULL)
+            return; // cache is full of tiles in use this frame
+
+        ts->_lastFrame = ds._frame;
+
+        // already computed and still current, so there's nothing to do
+        if (ts->_revision == tile._revision && ts->_density == ds._density)
+            return;
+
         osg::GLExtensions* ext = osg::GLExtensions::Get(ri.getContextID(), true);
 
         if (u._computeDataUL >= 0)
@@ -938,22 +1077,28 @@ GroundCoverLayer::Renderer::drawTile(osg::RenderInfo& ri, const PatchLayer::Draw
             u._computeData[2] = tile._tileBBox->xMax();
             u._computeData[3] = tile._tileBBox->yMax();
 
-            u._computeData[4] = (float)u._tileCounter;
+            u._computeData[4] = (float)ts->_slot;
+
+            u._computeData[5] = ds._density;
 
             // TODO: check whether this changed before calling it
-            ext->glUniform1fv(u._computeDataUL, 5, &u._computeData[0]);
+            ext->glUniform1fv(u._computeDataUL, 6, &u._computeData[0]);
 
-            instancer->cullTile(ri, u._tileCounter);
+            instancer->cullTile(ri, ts->_slot);
+            ts->_revision = tile._revision;
+            ts->_density = ds._density;
         }
     }
 
     else // DRAW shader
     {
-        // check valid flag
-        instancer->drawTile(ri, u._tileCounter);
+        TileCache::Slots::iterator i = cache._slots.find(*tile._key);
+        if (i != cache._slots.end() && i->second._revision == tile._revision)
+        {
+            i->second._lastFrame = ds._frame;
+            instancer->drawTile(ri, i->second._slot);
+        }
     }
-
-    ++u._tileCounter;
 }
 
 void
@@ -976,7 +1121,18 @@ GroundCoverLayer::Renderer::releaseGLObjects(osg::State* state) const
             {
                 j->second->releaseGLObjects(state);
             }
-        }        
+        }
+
+        // the cached placements went with the buffers
+        for (DrawState::TileCachePerGroundCover::iterator j = ds._tileCaches.begin();
+            j != ds._tileCaches.end();
+            ++j)
+        {
+            TileCache& cache = j->second;
+            cache._slots.clear();
+            cache._freeSlots.clear();
+            cache._numSlots = 0u;
+        }
     }
 }
 
@@ -1007,12 +1163,90 @@ namespace {
     }
 }
 
+// Texture array of billboard images, shared by every ground cover layer
+// whose billboards have the same (power-of-two) size. An image is stored
+// once per URI no matter how many layers and zones use it, and the array
+// lives as long as any layer still refers to it.
+struct GroundCoverLayer::Atlas : public osg::Referenced
+{
+    //! Atlas for billboards of size s x t, creating it if necessary
+    static Atlas* get(int s, int t)
+    {
+        static Threading::Mutex s_mutex(OE_MUTEX_NAME);
+        static std::map<std::pair<int, int>, osg::observer_ptr<Atlas> > s_atlases;
+
+        Threading::ScopedMutexLock lock(s_mutex);
+        osg::ref_ptr<Atlas> atlas;
+        osg::observer_ptr<Atlas>& entry = s_atlases[std::make_pair(s, t)];
+        if (!entry.lock(atlas))
+        {
+            atlas = new Atlas(s, t);
+            entry = atlas.get();
+        }
+        // the caller takes the reference
+        return atlas.release();
+    }
+
+    //! Index of the image for this URI, adding it to the array if it's new
+    int add(const URI& uri, osg::Image* image)
+    {
+        Threading::ScopedMutexLock lock(_mutex);
+
+        std::map<URI, int>::const_iterator i = _indices.find(uri);
+        if (i != _indices.end())
+            return i->second;
+
+        osg::ref_ptr<osg::Image> temp;
+        if (image->s() != _s || image->t() != _t)
+            ImageUtils::resizeImage(image, _s, _t, temp);
+        else
+            temp = image;
+
+        int index = _indices.size();
+        _indices[uri] = index;
+        _tex->setTextureSize(_s, _t, index + 1);
+        _tex->setImage(index, temp.get());
+        return index;
+    }
+
+    osg::Texture2DArray* getTexture() const { return _tex.get(); }
+
+    unsigned size() const { return _indices.size(); }
+
+private:
+    Atlas(int s, int t) : _s(s), _t(t), _mutex(OE_MUTEX_NAME)
+    {
+        _tex = new osg::Texture2DArray();
+        _tex->setFilter(_tex->MIN_FILTER, _tex->NEAREST_MIPMAP_LINEAR);
+        _tex->setFilter(_tex->MAG_FILTER, _tex->LINEAR);
+        _tex->setWrap(_tex->WRAP_S, _tex->CLAMP_TO_EDGE);
+        _tex->setWrap(_tex->WRAP_T, _tex->CLAMP_TO_EDGE);
+        _tex->setMaxAnisotropy(4.0);
+
+        // Keep the images: another layer may grow the array later, and
+        // that re-uploads every layer of it.
+        _tex->setUnRefImageDataAfterApply(false);
+
+        // Let the GPU do it since we only download this at startup
+        _tex->setUseHardwareMipMapGeneration(true);
+    }
+
+    int _s, _t;
+    std::map<URI, int> _indices;
+    osg::ref_ptr<osg::Texture2DArray> _tex;
+    Threading::Mutex _mutex;
+};
+
 void
 GroundCoverLayer::loadAssets()
 {
     typedef std::map<URI, osg::ref_ptr<osg::Object> > Cache;
     Cache _cache;
 
+    // unique billboard images and their URIs, in local atlas order
+    std::vector<osg::ref_ptr<osg::Image> > _atlasImages;
+    std::vector<URI> atlasURIs;
+
     osg::ref_ptr<osg::Image> standIn = new osg::Image();
 
     int landCoverGroupIndex = 0;
@@ -1060,6 +1294,9 @@ GroundCoverLayer::loadAssets()
                 data->_codes = codes;
                 data->_sideImageAtlasIndex = -1;
                 data->_topImageAtlasIndex = -1;
+                data->_impostorAtlasIndex = -1;
+                data->_impostorRadius = 0.0f;
+                data->_impostorCenter = 0.0f;
 
                 if (asset.options().sideBillboardURI().isSet())
                 {
@@ -1081,7 +1318,8 @@ GroundCoverLayer::loadAssets()
                         }
                         _cache[uri] = data->_sideImage.get();
                         data->_sideImageAtlasIndex = _atlasImages.size();
-                       _atlasImages.push_back(data->_sideImage.get());
+                        _atlasImages.push_back(data->_sideImage.get());
+                        atlasURIs.push_back(uri);
                     }
                 }
 
@@ -1102,6 +1340,7 @@ GroundCoverLayer::loadAssets()
                             _cache[uri] = data->_topImage.get();
                             data->_topImageAtlasIndex = _atlasImages.size();
                             _atlasImages.push_back(data->_topImage.get());
+                            atlasURIs.push_back(uri);
                         }
                         else
                         {
@@ -1147,57 +1386,113 @@ GroundCoverLayer::loadAssets()
         OE_WARN << LC << "Failed to load any assets!" << std::endl;
         // TODO: something?
     }
-}
-
-osg::Texture*
-GroundCoverLayer::createTextureAtlas() const
-{
-    // Creates a texture array containing all the billboard images.
-    // Each image is included only once.
-    osg::Texture2DArray* tex = new osg::Texture2DArray();
 
-    int arrayIndex = 0;
-    float s = -1.0f, t = -1.0f;
-
-    for(unsigned i=0; i<_atlasImages.size(); ++i)
+    // Move the images into the atlas shared with other layers, and point
+    // the assets at their slots in it. The texture array must be POT -
+    // required now for mipmapping to work.
+    if (!_atlasImages.empty())
     {
-        osg::Image* image = _atlasImages[i].get();
+        _atlas = Atlas::get(
+            osgEarth::nextPowerOf2(_atlasImages[0]->s()),
+            osgEarth::nextPowerOf2(_atlasImages[0]->t()));
 
-        osg::ref_ptr<osg::Image> temp;
+        std::vector<int> slots(_atlasImages.size());
+        for (unsigned i = 0; i < _atlasImages.size(); ++i)
+        {
+            slots[i] = _atlas->add(atlasURIs[i], _atlasImages[i].get());
+        }
 
-        // make sure the texture array is POT - required now for mipmapping to work
-        if (s < 0)
+        for (AssetDataVector::iterator i = _liveAssets.begin(); i != _liveAssets.end(); ++i)
         {
-            s = osgEarth::nextPowerOf2(image->s());
-            t = osgEarth::nextPowerOf2(image->t());
-            tex->setTextureSize(s, t, _atlasImages.size());
+            AssetData* data = i->get();
+            if (data->_sideImageAtlasIndex >= 0)
+                data->_sideImageAtlasIndex = slots[data->_sideImageAtlasIndex];
+            if (data->_topImageAtlasIndex >= 0)
+                data->_topImageAtlasIndex = slots[data->_topImageAtlasIndex];
         }
 
-        if (image->s() != s || image->t() != t)
+        OE_INFO << LC << "Using " << _atlasImages.size() << " unique images from a shared atlas of "
+            << _atlas->size() << std::endl;
+    }
+
+    createImpostors();
+}
+
+void
+GroundCoverLayer::createImpostors()
+{
+    // Models with no billboard image draw as octahedral impostors. Each
+    // unique model gets two layers (color, normals) of the impostor atlas,
+    // which a camera under getNode() bakes the first time it renders.
+    std::vector<osg::ref_ptr<osg::Node> > models;
+
+    for (AssetDataVector::iterator i = _liveAssets.begin(); i != _liveAssets.end(); ++i)
+    {
+        AssetData* data = i->get();
+        if (!data->_model.valid() || data->_sideImageAtlasIndex >= 0)
+            continue;
+
+        osg::ComputeBoundsVisitor cbv;
+        data->_model->accept(cbv);
+        const osg::BoundingBox& box = cbv.getBoundingBox();
+        float height = box.valid() ? box.zMax() - box.zMin() : 0.0f;
+        if (height <= 0.0f)
         {
-            ImageUtils::resizeImage(image, s, t, temp);
+            OE_WARN << LC << "Skipping an impostor for a model with no height" << std::endl;
+            continue;
         }
-        else
+
+        int index = indexOf(models, data->_model.get());
+        if (index < 0)
         {
-            temp = image;
+            index = models.size();
+            models.push_back(data->_model.get());
         }
 
-        tex->setImage(i, temp.get());
+        osg::BoundingSphere bs = ImpostorBaker::getFrameBound(data->_model.get());
+        data->_impostorAtlasIndex = index * 2;
+        data->_impostorRadius = bs.radius() / height;
+        data->_impostorCenter = (bs.center().z() - box.zMin()) / height;
     }
 
-    OE_INFO << LC << "Created atlas with " << _atlasImages.size() << " unique images" << std::endl;
+    if (models.empty())
+        return;
 
-    tex->setFilter(tex->MIN_FILTER, tex->NEAREST_MIPMAP_LINEAR);
-    tex->setFilter(tex->MAG_FILTER, tex->LINEAR);
-    tex->setWrap(tex->WRAP_S, tex->CLAMP_TO_EDGE);
-    tex->setWrap(tex->WRAP_T, tex->CLAMP_TO_EDGE);
-    tex->setUnRefImageDataAfterApply(Registry::instance()->unRefImageDataAfterApply().get());
-    tex->setMaxAnisotropy(4.0);
+    ImpostorBaker baker;
+    _impostorFrames = baker.getNumFrames();
+    unsigned size = baker.getAtlasSize();
+
+    _impostorTex = new osg::Texture2DArray();
+    _impostorTex->setTextureSize(size, size, models.size() * 2);
+    _impostorTex->setInternalFormat(GL_RGBA8);
+    _impostorTex->setSourceFormat(GL_RGBA);
+    _impostorTex->setSourceType(GL_UNSIGNED_BYTE);
+    _impostorTex->setFilter(_impostorTex->MIN_FILTER, _impostorTex->LINEAR_MIPMAP_LINEAR);
+    _impostorTex->setFilter(_impostorTex->MAG_FILTER, _impostorTex->LINEAR);
+    _impostorTex->setWrap(_impostorTex->WRAP_S, _impostorTex->CLAMP_TO_EDGE);
+    _impostorTex->setWrap(_impostorTex->WRAP_T, _impostorTex->CLAMP_TO_EDGE);
+
+    for (unsigned i = 0; i < models.size(); ++i)
+    {
+        Registry::shaderGenerator().run(models[i].get());
+        _impostorBakes->addChild(baker.createCamera(models[i].get(), _impostorTex.get(), i * 2));
+    }
 
-    // Let the GPU do it since we only download this at startup
-    tex->setUseHardwareMipMapGeneration(true);
+    OE_INFO << LC << "Baking " << models.size() << " model impostors" << std::endl;
+}
+
+osg::Texture*
+GroundCoverLayer::createTextureAtlas() const
+{
+    // The billboard images live in an atlas shared by all the layers that
+    // use the same billboard size, so layers (and zones) that use the same
+    // images share the one texture array.
+    if (_atlas.valid())
+    {
+        return _atlas->getTexture();
+    }
 
-    return tex;
+    return new osg::Texture2DArray();
 }
 
 namespace {
@@ -1211,7 +1506,7 @@ GroundCoverLayer::createLUTShader() const
     landCoverGroupBuf << std::fixed << std::setprecision(2);
 
     std::stringstream assetBuf;
-    assetBuf << std::fixed << std::setprecision(1);
+    assetBuf << std::fixed << std::setprecision(3);
 
     int numBiomeZones = options().biomeZones().size();
     int numBiomeLayouts = numBiomeZones; // one per zone.
@@ -1291,9 +1586,12 @@ GroundCoverLayer::createLUTShader() const
             assetBuf << "    oe_gc_Asset("
                 << data->_sideImageAtlasIndex
                 << ", " << data->_topImageAtlasIndex
+                << ", " << data->_impostorAtlasIndex
                 << ", " << width
                 << ", " << height
                 << ", " << sizeVariation
+                << ", " << data->_impostorRadius
+                << ", " << data->_impostorCenter
                 << ")";
 
             ++data->_numInstances;
@@ -1338,9 +1636,12 @@ GroundCoverLayer::createLUTShader() const
         "struct oe_gc_Asset { \n"
         "    int atlasIndexSide; \n" // or 3D model texture..todo
         "    int atlasIndexTop; \n"
+        "    int atlasIndexImpostor; \n"
         "    float width; \n"
         "    float height; \n"
         "    float sizeVariation; \n"
+        "    float impostorRadius; \n"
+        "    float impostorCenter; \n"
         "}; \n"
         "const oe_gc_Asset oe_gc_assets[" << numAssetInstancesAdded << "] = oe_gc_Asset[" << numAssetInstancesAdded << "]( \n"
         << assetBuf.str()
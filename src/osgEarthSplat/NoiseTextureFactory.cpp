@@ -23,7 +23,10 @@
 #include <osgEarth/SimplexNoise>
 #include <osgEarth/Registry>
 #include <osgEarth/Metrics>
+#include <osgEarth/Threading>
 #include <osg/Texture2D>
+#include <osg/observer_ptr>
+#include <map>
 
 using namespace osgEarth;
 using namespace osgEarth::Splat;
@@ -126,3 +129,21 @@ NoiseTextureFactory::create(unsigned dim, unsigned chans) const
 
     return tex;
 }
+
+osg::Texture*
+NoiseTextureFactory::getShared(unsigned dim) const
+{
+    static Threading::Mutex s_mutex(OE_MUTEX_NAME);
+    static std::map<unsigned, osg::observer_ptr<osg::Texture> > s_textures;
+
+    Threading::ScopedMutexLock lock(s_mutex);
+
+    // held weakly, so the texture goes away with the last layer using it
+    osg::ref_ptr<osg::Texture> tex;
+    if (!s_textures[dim].lock(tex))
+    {
+        tex = create(dim, 4u);
+        s_textures[dim] = tex.get();
+    }
+    return tex.release();
+}
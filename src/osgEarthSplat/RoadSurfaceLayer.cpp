@@ -24,7 +24,11 @@
 #include <osgEarth/FilterContext>
 #include <osgEarth/GeometryCompiler>
 #include <osgEarth/Containers>
+#include <osgEarth/Threading>
+#include <osgEarth/rtree.h>
 #include <osgDB/WriteFile>
+#include <algorithm>
+#include <limits>
 
 using namespace osgEarth;
 using namespace osgEarth::Splat;
@@ -44,6 +48,7 @@ RoadSurfaceLayer::Options::getConfig() const
     featureSource().set(conf, "features");
     styleSheet().set(conf, "styles");
     conf.set("buffer_width", featureBufferWidth() );
+    conf.set("feature_cache_levels", featureCacheLevels());
     return conf;
 }
 
@@ -52,13 +57,61 @@ RoadSurfaceLayer::Options::fromConfig(const Config& conf)
 {
     featureSource().get(conf, "features");
     styleSheet().get(conf, "styles");
+    featureCacheLevels().init(2u);
+
     conf.get("buffer_width", featureBufferWidth() );
+    conf.get("feature_cache_levels", featureCacheLevels());
 }
 
 //........................................................................
 
+struct RoadSurfaceLayer::FeatureCache
+{
+    typedef RTree<unsigned, double, 2> SpatialIndex;
+
+    // Features queried for one ancestor tile, indexed by their bounds
+    struct Entry : public osg::Referenced
+    {
+        FeatureList _features;
+        SpatialIndex _index;
+    };
+
+    FeatureCache(unsigned levels) :
+        _levels(levels),
+        _entries(true, 16u),
+        _inFlight("RoadSurfaceLayer.FeatureCache(OE)") { }
+
+    unsigned _levels;
+    LRUCache<std::string, osg::ref_ptr<Entry> > _entries;
+    Threading::SingleFlight<std::string, osg::ref_ptr<Entry> > _inFlight;
+};
+
+//........................................................................
+
 OE_LAYER_PROPERTY_IMPL(RoadSurfaceLayer, Distance, FeatureBufferWidth, featureBufferWidth);
 
+void
+RoadSurfaceLayer::setFeatureCacheLevels(const unsigned& value)
+{
+    options().featureCacheLevels() = value;
+    resetFeatureCache();
+}
+
+const unsigned&
+RoadSurfaceLayer::getFeatureCacheLevels() const
+{
+    return options().featureCacheLevels().get();
+}
+
+void
+RoadSurfaceLayer::resetFeatureCache()
+{
+    if (options().featureCacheLevels() > 0u)
+        _featureCache = std::make_shared<FeatureCache>(options().featureCacheLevels().get());
+    else
+        _featureCache = nullptr;
+}
+
 void
 RoadSurfaceLayer::init()
 {
@@ -93,6 +146,8 @@ RoadSurfaceLayer::openImplementation()
         _rasterizer = new TileRasterizer(getTileSize(), getTileSize());
     }
 
+    resetFeatureCache();
+
     return Status::NoError;
 }
 
@@ -125,6 +180,7 @@ RoadSurfaceLayer::setFeatureSource(FeatureSource* layer)
     if (getFeatureSource() != layer)
     {
         options().featureSource().setLayer(layer);
+        resetFeatureCache();
         if (layer && layer->getStatus().isError())
         {
             setStatus(layer->getStatus());
@@ -249,6 +305,92 @@ namespace
     }
 }
 
+bool
+RoadSurfaceLayer::getCachedFeatures(const TileKey& key, FeatureList& features, ProgressCallback* progress) const
+{
+    // A tiled source already returns one tile's features per query, so
+    // there's nothing to share.
+    std::shared_ptr<FeatureCache> cache = _featureCache;
+    FeatureSource* fs = getFeatureSource();
+    const FeatureProfile* fp = fs->getFeatureProfile();
+
+    if (!cache || fp->isTiled())
+        return false;
+
+    TileKey ancestorKey = key.createAncestorKey(key.getLOD() > cache->_levels ? key.getLOD() - cache->_levels : 0u);
+    if (!ancestorKey.valid())
+        return false;
+
+    const Distance& buffer = options().featureBufferWidth().get();
+
+    std::string cacheKey = Stringify()
+        << fs->getRevision() << ';'
+        << ancestorKey.str() << ';'
+        << buffer.as(Units::METERS);
+
+    osg::ref_ptr<FeatureCache::Entry> entry = cache->_inFlight.run(cacheKey, [&](bool& share) -> osg::ref_ptr<FeatureCache::Entry>
+    {
+        LRUCache<std::string, osg::ref_ptr<FeatureCache::Entry> >::Record record;
+        if (cache->_entries.get(cacheKey, record))
+            return record.value();
+
+        osg::ref_ptr<FeatureCache::Entry> result = new FeatureCache::Entry();
+
+        osg::ref_ptr<FeatureCursor> cursor = fs->createFeatureCursor(ancestorKey, buffer, progress);
+        if (cursor.valid())
+            cursor->fill(result->_features);
+
+        if (progress && progress->isCanceled())
+        {
+            share = false;
+            return 0L;
+        }
+
+        unsigned n = 0u;
+        for (FeatureList::const_iterator i = result->_features.begin(); i != result->_features.end(); ++i, ++n)
+        {
+            Bounds b = i->get()->getGeometry()->getBounds();
+            double a_min[2] = { b.xMin(), b.yMin() };
+            double a_max[2] = { b.xMax(), b.yMax() };
+            result->_index.Insert(a_min, a_max, n);
+        }
+
+        cache->_entries.insert(cacheKey, result);
+        return result;
+    },
+    progress);
+
+    // only a canceled request comes back empty-handed
+    if (!entry.valid())
+        return true;
+
+    // Same buffered extent the uncached path would query:
+    GeoExtent localExtent = key.getExtent().transform(fp->getSRS());
+    if (localExtent.isValid())
+    {
+        localExtent.expand(buffer*2.0, buffer*2.0);
+        Bounds queryBounds = localExtent.bounds();
+        double a_min[2] = { queryBounds.xMin(), queryBounds.yMin() };
+        double a_max[2] = { queryBounds.xMax(), queryBounds.yMax() };
+
+        std::vector<unsigned> hits;
+        entry->_index.Search(a_min, a_max, &hits, std::numeric_limits<int>::max());
+
+        // keep the source's order, and copy the features because
+        // compiling transforms them in place
+        std::vector<const Feature*> all(entry->_features.size());
+        unsigned n = 0u;
+        for (FeatureList::const_iterator i = entry->_features.begin(); i != entry->_features.end(); ++i)
+            all[n++] = i->get();
+
+        std::sort(hits.begin(), hits.end());
+        for (std::vector<unsigned>::const_iterator i = hits.begin(); i != hits.end(); ++i)
+            features.push_back(new Feature(*all[*i]));
+    }
+
+    return true;
+}
+
 GeoImage
 RoadSurfaceLayer::createImageImplementation(const TileKey& key, ProgressCallback* progress) const
 {
@@ -285,14 +427,17 @@ RoadSurfaceLayer::createImageImplementation(const TileKey& key, ProgressCallback
 
     GeoExtent featureExtent = key.getExtent().transform(featureSRS);
 
-    osg::ref_ptr<FeatureCursor> cursor = getFeatureSource()->createFeatureCursor(
-        key,
-        options().featureBufferWidth().get(),
-        progress);
-
     FeatureList features;
-    if (cursor.valid())
-        cursor->fill(features);
+    if (!getCachedFeatures(key, features, progress))
+    {
+        osg::ref_ptr<FeatureCursor> cursor = getFeatureSource()->createFeatureCursor(
+            key,
+            options().featureBufferWidth().get(),
+            progress);
+
+        if (cursor.valid())
+            cursor->fill(features);
+    }
 
     if (!features.empty())
     {
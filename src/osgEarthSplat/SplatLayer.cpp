@@ -313,8 +313,10 @@ SplatLayer::buildStateSets()
         
     if (_noiseBinding.valid())
     {
+        // same texture as the ground cover layers; splatting only uses
+        // the first channel.
         NoiseTextureFactory noise;
-        osg::ref_ptr<osg::Texture> noiseTexture = noise.create(256u, 1u);
+        osg::ref_ptr<osg::Texture> noiseTexture = noise.getShared(256u);
         stateset->setTextureAttribute(_noiseBinding.unit(), noiseTexture.get());
         stateset->addUniform(new osg::Uniform(NOISE_SAMPLER, _noiseBinding.unit()));
         stateset->setDefine("OE_SPLAT_NOISE_SAMPLER", NOISE_SAMPLER);
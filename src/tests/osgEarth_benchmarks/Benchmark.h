@@ -0,0 +1,130 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2020 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#ifndef OSGEARTH_BENCHMARK_H
+#define OSGEARTH_BENCHMARK_H 1
+
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <vector>
+
+/**
+ * Minimal microbenchmark harness for osgEarth_benchmarks.
+ *
+ * A benchmark is a function that does its setup, then loops on
+ * State::keepRunning() around the code under test:
+ *
+ *   OE_BENCHMARK(TileKey_createParentKey)
+ *   {
+ *       TileKey key(...);
+ *       while (state.keepRunning())
+ *           Benchmarks::doNotOptimize(key.createParentKey());
+ *   }
+ *
+ * The runner calls the function with more and more iterations until a run
+ * lasts at least the minimum time, and reports that run. Command-line flags
+ * and the JSON output follow Google Benchmark's, so the same comparison
+ * tools work on both.
+ */
+namespace Benchmarks
+{
+    class State
+    {
+    public:
+        State(std::uint64_t iterations);
+
+        //! True while there are iterations left to run; starts the timer
+        //! on the first call and stops it on the last.
+        inline bool keepRunning()
+        {
+            if (_remaining > 0)
+            {
+                if (_remaining == _iterations)
+                    resumeTiming();
+                --_remaining;
+                return true;
+            }
+            pauseTiming();
+            return false;
+        }
+
+        //! Stops the timer, e.g. to rebuild input the code under test consumes
+        void pauseTiming();
+
+        //! Restarts the timer after pauseTiming()
+        void resumeTiming();
+
+        //! Records how many items (points, pixels, etc.) all iterations
+        //! processed, to report a rate along with the time
+        void setItemsProcessed(std::uint64_t value) { _items = value; }
+
+        //! Records how many bytes all iterations processed
+        void setBytesProcessed(std::uint64_t value) { _bytes = value; }
+
+        //! Reports that the benchmark couldn't run, e.g. for lack of a dependency
+        void skip(const std::string& reason);
+
+        std::uint64_t iterations() const { return _iterations; }
+
+    private:
+        std::uint64_t _iterations;
+        std::uint64_t _remaining;
+        std::uint64_t _items;
+        std::uint64_t _bytes;
+        bool _running;
+        std::string _skipped;
+        std::chrono::steady_clock::time_point _realStart;
+        std::clock_t _cpuStart;
+        double _realTime;
+        double _cpuTime;
+
+        friend class Runner;
+    };
+
+    typedef void (*Function)(State&);
+
+    //! Adds a benchmark to the suite; used by OE_BENCHMARK
+    struct Registrar
+    {
+        Registrar(const char* name, Function function);
+    };
+
+    //! Keeps the compiler from optimizing away a value the benchmark computes
+    template<typename T>
+    inline void doNotOptimize(const T& value)
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        asm volatile("" : : "r,m"(value) : "memory");
+#else
+        static const volatile char* sink;
+        sink = reinterpret_cast<const volatile char*>(&value);
+#endif
+    }
+}
+
+#define OE_BENCHMARK(NAME) \
+    static void NAME(Benchmarks::State& state); \
+    static Benchmarks::Registrar NAME##_registrar(#NAME, NAME); \
+    static void NAME(Benchmarks::State& state)
+
+#endif // OSGEARTH_BENCHMARK_H
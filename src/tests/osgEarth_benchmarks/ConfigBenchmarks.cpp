@@ -0,0 +1,147 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2020 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#include "Benchmark.h"
+#include <osgEarth/Config>
+#include <osgEarth/JsonUtils>
+#include <osgEarth/XmlUtils>
+#include <sstream>
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+namespace
+{
+    const unsigned NUM_ELEMENTS = 500u;
+
+    //! An earth file with many layers
+    std::string createXML()
+    {
+        std::stringstream buf;
+        buf << "<map name=\"benchmark\" type=\"geocentric\">\n";
+        for (unsigned i = 0; i < NUM_ELEMENTS; ++i)
+        {
+            buf << "  <xyz name=\"layer" << i << "\" enabled=\"true\" opacity=\"0.5\">\n"
+                << "    <url>http://tiles.example.com/" << i << "/{z}/{x}/{y}.png</url>\n"
+                << "    <profile>spherical-mercator</profile>\n"
+                << "    <cache_policy usage=\"read_write\" max_age=\"86400\"/>\n"
+                << "  </xyz>\n";
+        }
+        buf << "</map>\n";
+        return buf.str();
+    }
+
+    //! A GeoJSON feature collection of small polygons
+    std::string createJSON()
+    {
+        std::stringstream buf;
+        buf << "{\"type\":\"FeatureCollection\",\"features\":[";
+        for (unsigned i = 0; i < NUM_ELEMENTS; ++i)
+        {
+            double x = -80.0 + 0.01*(double)i, y = 35.0;
+            buf << (i > 0 ? "," : "")
+                << "{\"type\":\"Feature\",\"id\":" << i
+                << ",\"properties\":{\"name\":\"building " << i << "\",\"height\":" << 10 + i % 20 << "}"
+                << ",\"geometry\":{\"type\":\"Polygon\",\"coordinates\":[["
+                << "[" << x << "," << y << "],[" << x + 0.001 << "," << y << "],"
+                << "[" << x + 0.001 << "," << y + 0.001 << "],[" << x << "," << y + 0.001 << "],"
+                << "[" << x << "," << y << "]]]}}";
+        }
+        buf << "]}";
+        return buf.str();
+    }
+}
+
+OE_BENCHMARK(XmlDocument_load)
+{
+    const std::string xml = createXML();
+    while (state.keepRunning())
+    {
+        std::istringstream in(xml);
+        osg::ref_ptr<XmlDocument> doc = XmlDocument::load(in);
+        Benchmarks::doNotOptimize(doc);
+    }
+    state.setBytesProcessed(state.iterations() * xml.size());
+}
+
+OE_BENCHMARK(XmlDocument_load_to_Config)
+{
+    const std::string xml = createXML();
+    while (state.keepRunning())
+    {
+        std::istringstream in(xml);
+        osg::ref_ptr<XmlDocument> doc = XmlDocument::load(in);
+        Config conf = doc->getConfig();
+        Benchmarks::doNotOptimize(conf);
+    }
+    state.setBytesProcessed(state.iterations() * xml.size());
+}
+
+OE_BENCHMARK(XmlDocument_readConfig)
+{
+    const std::string xml = createXML();
+    while (state.keepRunning())
+    {
+        std::istringstream in(xml);
+        Config conf;
+        XmlDocument::readConfig(in, URIContext(), conf);
+        Benchmarks::doNotOptimize(conf);
+    }
+    state.setBytesProcessed(state.iterations() * xml.size());
+}
+
+OE_BENCHMARK(Json_Reader_parse)
+{
+    const std::string json = createJSON();
+    while (state.keepRunning())
+    {
+        Json::Value root;
+        Json::Reader().parse(json, root);
+        Benchmarks::doNotOptimize(root);
+    }
+    state.setBytesProcessed(state.iterations() * json.size());
+}
+
+OE_BENCHMARK(Config_fromJSON)
+{
+    const std::string json = createJSON();
+    while (state.keepRunning())
+    {
+        Config conf;
+        conf.fromJSON(json);
+        Benchmarks::doNotOptimize(conf);
+    }
+    state.setBytesProcessed(state.iterations() * json.size());
+}
+
+OE_BENCHMARK(Config_toJSON)
+{
+    Config conf;
+    conf.fromJSON(createJSON());
+    std::size_t bytes = 0u;
+    while (state.keepRunning())
+    {
+        std::string json = conf.toJSON();
+        bytes += json.size();
+        Benchmarks::doNotOptimize(json);
+    }
+    state.setBytesProcessed(bytes);
+}
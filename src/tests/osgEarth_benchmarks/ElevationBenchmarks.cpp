@@ -0,0 +1,107 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2020 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#include "Benchmark.h"
+#include <osgEarth/ElevationPool>
+#include <osgEarth/FractalElevationLayer>
+#include <osgEarth/Map>
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+namespace
+{
+    const unsigned NUM_POINTS = 10000u;
+
+    //! A map with procedural elevation, so the benchmarks need no data files
+    Map* createMap()
+    {
+        Map* map = new Map();
+        FractalElevationLayer* layer = new FractalElevationLayer();
+        layer->setBaseLOD(8u);
+        layer->setAmplitude(500.0f);
+        map->addLayer(layer);
+        return map;
+    }
+
+    //! Points in a 0.1 degree square, sampled at about 30m
+    std::vector<osg::Vec4d> createPoints()
+    {
+        std::vector<osg::Vec4d> points(NUM_POINTS);
+        for (unsigned i = 0; i < NUM_POINTS; ++i)
+            points[i].set(10.0 + 0.1*(double)(i % 100)/100.0, 45.0 + 0.1*(double)(i / 100)/100.0, 0.0, 0.0003);
+        return points;
+    }
+}
+
+OE_BENCHMARK(ElevationPool_getSample)
+{
+    osg::ref_ptr<Map> map = createMap();
+    ElevationPool* pool = map->getElevationPool();
+    ElevationPool::WorkingSet ws;
+    const std::vector<osg::Vec4d> points = createPoints();
+    Distance resolution(30.0, Units::METERS);
+
+    // warm the working set so the loop measures sampling, not tile creation
+    pool->getSample(GeoPoint(map->getSRS(), points[0].x(), points[0].y()), resolution, &ws);
+
+    unsigned i = 0;
+    while (state.keepRunning())
+    {
+        const osg::Vec4d& p = points[i++ % NUM_POINTS];
+        ElevationSample sample = pool->getSample(GeoPoint(map->getSRS(), p.x(), p.y()), resolution, &ws);
+        Benchmarks::doNotOptimize(sample);
+    }
+    state.setItemsProcessed(state.iterations());
+}
+
+OE_BENCHMARK(ElevationPool_sampleMapCoords)
+{
+    osg::ref_ptr<Map> map = createMap();
+    ElevationPool* pool = map->getElevationPool();
+    ElevationPool::WorkingSet ws;
+    std::vector<osg::Vec4d> points = createPoints();
+    pool->sampleMapCoords(points, &ws, 0L);
+
+    while (state.keepRunning())
+    {
+        pool->sampleMapCoords(points, &ws, 0L);
+        Benchmarks::doNotOptimize(points[0]);
+    }
+    state.setItemsProcessed(state.iterations() * NUM_POINTS);
+}
+
+OE_BENCHMARK(ElevationPool_sampleMapCoords_batch)
+{
+    osg::ref_ptr<Map> map = createMap();
+    ElevationPool* pool = map->getElevationPool();
+    ElevationPool::WorkingSet ws;
+    std::vector<osg::Vec4d> points = createPoints();
+    std::vector<float> resolutions;
+    pool->sampleMapCoords(points, &resolutions, &ws, 0L);
+
+    while (state.keepRunning())
+    {
+        pool->sampleMapCoords(points, &resolutions, &ws, 0L);
+        Benchmarks::doNotOptimize(points[0]);
+    }
+    state.setItemsProcessed(state.iterations() * NUM_POINTS);
+}
@@ -0,0 +1,215 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2020 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#include "Benchmark.h"
+#include <osgEarth/BuildGeometryFilter>
+#include <osgEarth/ExtrudeGeometryFilter>
+#include <osgEarth/Expression>
+#include <osgEarth/Feature>
+#include <osgEarth/FilterContext>
+#include <osgEarth/Tessellator>
+#include <osgEarth/ExtrusionSymbol>
+#include <osgEarth/PolygonSymbol>
+#include <cmath>
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+namespace
+{
+    const unsigned NUM_FEATURES = 1000u;
+
+    //! A jagged, many-sided building footprint with a courtyard
+    Polygon* createFootprint(double x0, double y0, unsigned sides)
+    {
+        Polygon* poly = new Polygon();
+        for (unsigned i = 0; i < sides; ++i)
+        {
+            double a = 2.0 * osg::PI * (double)i / (double)sides;
+            double r = (i % 2) == 0 ? 20.0 : 18.0;
+            poly->push_back(osg::Vec3d(x0 + r*cos(a), y0 + r*sin(a), 0.0));
+        }
+
+        Ring* hole = new Ring();
+        hole->push_back(osg::Vec3d(x0 - 5, y0 - 5, 0));
+        hole->push_back(osg::Vec3d(x0 - 5, y0 + 5, 0));
+        hole->push_back(osg::Vec3d(x0 + 5, y0 + 5, 0));
+        hole->push_back(osg::Vec3d(x0 + 5, y0 - 5, 0));
+        poly->getHoles().push_back(hole);
+
+        return poly;
+    }
+
+    //! Footprints in a projected (non-georeferenced) grid
+    FeatureList createFeatures()
+    {
+        const SpatialReference* srs = SpatialReference::get("spherical-mercator");
+        FeatureList features;
+        for (unsigned i = 0; i < NUM_FEATURES; ++i)
+        {
+            Feature* f = new Feature(createFootprint(50.0*(i % 32), 50.0*(i / 32), 16 + (i % 48)), srs);
+            f->set("height", 10.0 + (double)(i % 20));
+            f->set("floors", (double)(i % 7));
+            features.push_back(f);
+        }
+        return features;
+    }
+
+    FeatureList copyFeatures(const FeatureList& input)
+    {
+        FeatureList output;
+        for (FeatureList::const_iterator i = input.begin(); i != input.end(); ++i)
+            output.push_back(new Feature(*i->get()));
+        return output;
+    }
+
+    osg::Geometry* createGeometry(const Polygon* poly)
+    {
+        osg::Geometry* geom = new osg::Geometry();
+        osg::Vec3Array* verts = new osg::Vec3Array();
+        geom->setVertexArray(verts);
+
+        ConstGeometryIterator parts(poly, true);
+        while (parts.hasMore())
+        {
+            const Geometry* part = parts.next();
+            unsigned first = verts->size();
+            for (Geometry::const_iterator p = part->begin(); p != part->end(); ++p)
+                verts->push_back(*p);
+            geom->addPrimitiveSet(new osg::DrawArrays(GL_LINE_LOOP, first, part->size()));
+        }
+        return geom;
+    }
+}
+
+OE_BENCHMARK(Tessellator_footprints)
+{
+    std::vector<osg::ref_ptr<Polygon> > polys;
+    for (unsigned i = 0; i < NUM_FEATURES; ++i)
+        polys.push_back(createFootprint(50.0*i, 0.0, 16 + (i % 48)));
+
+    std::vector<osg::ref_ptr<osg::Geometry> > geoms(NUM_FEATURES);
+    Tessellator tess;
+
+    while (state.keepRunning())
+    {
+        state.pauseTiming();
+        for (unsigned i = 0; i < NUM_FEATURES; ++i)
+            geoms[i] = createGeometry(polys[i].get());
+        state.resumeTiming();
+
+        for (unsigned i = 0; i < NUM_FEATURES; ++i)
+            tess.tessellateGeometry(*geoms[i].get());
+    }
+    state.setItemsProcessed(state.iterations() * NUM_FEATURES);
+}
+
+OE_BENCHMARK(BuildGeometryFilter_polygons)
+{
+    const FeatureList source = createFeatures();
+    Style style;
+    style.getOrCreate<PolygonSymbol>()->fill()->color() = Color::Gray;
+    BuildGeometryFilter filter(style);
+
+    while (state.keepRunning())
+    {
+        state.pauseTiming();
+        FeatureList features = copyFeatures(source);
+        FilterContext cx;
+        state.resumeTiming();
+
+        osg::ref_ptr<osg::Node> node = filter.push(features, cx);
+        Benchmarks::doNotOptimize(node);
+    }
+    state.setItemsProcessed(state.iterations() * NUM_FEATURES);
+}
+
+OE_BENCHMARK(ExtrudeGeometryFilter_buildings)
+{
+    const FeatureList source = createFeatures();
+    Style style;
+    style.getOrCreate<ExtrusionSymbol>()->heightExpression() = NumericExpression("[height]");
+    style.getOrCreate<PolygonSymbol>()->fill()->color() = Color::Gray;
+    ExtrudeGeometryFilter filter;
+    filter.setStyle(style);
+
+    while (state.keepRunning())
+    {
+        state.pauseTiming();
+        FeatureList features = copyFeatures(source);
+        FilterContext cx;
+        state.resumeTiming();
+
+        osg::ref_ptr<osg::Node> node = filter.push(features, cx);
+        Benchmarks::doNotOptimize(node);
+    }
+    state.setItemsProcessed(state.iterations() * NUM_FEATURES);
+}
+
+OE_BENCHMARK(NumericExpression_eval)
+{
+    const FeatureList features = createFeatures();
+    NumericExpression expr("max([height], [floors] * 3.5) + 2");
+
+    double sum = 0.0;
+    while (state.keepRunning())
+    {
+        for (FeatureList::const_iterator f = features.begin(); f != features.end(); ++f)
+            sum += (*f)->eval(expr, (FilterContext*)0L);
+    }
+    Benchmarks::doNotOptimize(sum);
+    state.setItemsProcessed(state.iterations() * NUM_FEATURES);
+}
+
+OE_BENCHMARK(CompiledNumericExpression_eval)
+{
+    const FeatureList features = createFeatures();
+    CompiledNumericExpression expr(NumericExpression("max([height], [floors] * 3.5) + 2"));
+
+    double sum = 0.0;
+    while (state.keepRunning())
+    {
+        for (FeatureList::const_iterator f = features.begin(); f != features.end(); ++f)
+            sum += (*f)->eval(expr, (FilterContext*)0L);
+    }
+    Benchmarks::doNotOptimize(sum);
+    state.setItemsProcessed(state.iterations() * NUM_FEATURES);
+}
+
+OE_BENCHMARK(CompiledNumericExpression_eval_columns)
+{
+    CompiledNumericExpression expr(NumericExpression("max([height], [floors] * 3.5) + 2"));
+    std::vector<double> heights(NUM_FEATURES), floors(NUM_FEATURES), output(NUM_FEATURES);
+    for (unsigned i = 0; i < NUM_FEATURES; ++i)
+        heights[i] = 10.0 + (double)(i % 20), floors[i] = (double)(i % 7);
+
+    // column order follows the compiled variable order
+    const double* columns[2];
+    for (unsigned v = 0; v < expr.getNumVariables(); ++v)
+        columns[v] = expr.getVariable(v) == "height" ? &heights[0] : &floors[0];
+
+    while (state.keepRunning())
+    {
+        expr.eval(columns, NUM_FEATURES, &output[0]);
+        Benchmarks::doNotOptimize(output[0]);
+    }
+    state.setItemsProcessed(state.iterations() * NUM_FEATURES);
+}
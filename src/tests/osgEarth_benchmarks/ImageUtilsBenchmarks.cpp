@@ -0,0 +1,154 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2020 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#include "Benchmark.h"
+#include <osgEarth/ImageUtils>
+#include <cstdlib>
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+namespace
+{
+    const int SIZE = 512;
+
+    osg::Image* createImage(GLenum pixelFormat, GLenum dataType)
+    {
+        osg::Image* image = new osg::Image();
+        image->allocateImage(SIZE, SIZE, 1, pixelFormat, dataType);
+        image->setInternalTextureFormat(pixelFormat);
+        srand(42);
+        if (dataType == GL_FLOAT)
+        {
+            float* data = (float*)image->data();
+            for (unsigned i = 0; i < image->getTotalSizeInBytes() / sizeof(float); ++i)
+                data[i] = (float)(rand() % 10000) * 0.5f;
+        }
+        else
+        {
+            unsigned char* data = image->data();
+            for (unsigned i = 0; i < image->getTotalSizeInBytes(); ++i)
+                data[i] = (unsigned char)(rand() % 256);
+        }
+        return image;
+    }
+
+    void resize(Benchmarks::State& state, GLenum pixelFormat, GLenum dataType)
+    {
+        osg::ref_ptr<osg::Image> src = createImage(pixelFormat, dataType);
+        while (state.keepRunning())
+        {
+            osg::ref_ptr<osg::Image> out;
+            ImageUtils::resizeImage(src.get(), SIZE/2 + 1, SIZE/2 + 1, out);
+            Benchmarks::doNotOptimize(out);
+        }
+        state.setItemsProcessed(state.iterations() * (SIZE/2 + 1) * (SIZE/2 + 1));
+    }
+}
+
+OE_BENCHMARK(ImageUtils_resizeImage_RGBA8)
+{
+    resize(state, GL_RGBA, GL_UNSIGNED_BYTE);
+}
+
+OE_BENCHMARK(ImageUtils_resizeImage_R32F)
+{
+    resize(state, GL_RED, GL_FLOAT);
+}
+
+OE_BENCHMARK(ImageUtils_mix_RGBA8)
+{
+    osg::ref_ptr<osg::Image> src = createImage(GL_RGBA, GL_UNSIGNED_BYTE);
+    osg::ref_ptr<osg::Image> dest = createImage(GL_RGBA, GL_UNSIGNED_BYTE);
+    while (state.keepRunning())
+    {
+        ImageUtils::mix(dest.get(), src.get(), 0.5f);
+        Benchmarks::doNotOptimize(dest->data());
+    }
+    state.setItemsProcessed(state.iterations() * SIZE * SIZE);
+}
+
+OE_BENCHMARK(ImageUtils_convert_RGB8_to_RGBA8)
+{
+    osg::ref_ptr<osg::Image> src = createImage(GL_RGB, GL_UNSIGNED_BYTE);
+    while (state.keepRunning())
+    {
+        osg::ref_ptr<osg::Image> out = ImageUtils::convert(src.get(), GL_RGBA, GL_UNSIGNED_BYTE);
+        Benchmarks::doNotOptimize(out);
+    }
+    state.setItemsProcessed(state.iterations() * SIZE * SIZE);
+}
+
+OE_BENCHMARK(ImageUtils_convert_R32F_to_RGBA8)
+{
+    osg::ref_ptr<osg::Image> src = createImage(GL_RED, GL_FLOAT);
+    while (state.keepRunning())
+    {
+        osg::ref_ptr<osg::Image> out = ImageUtils::convert(src.get(), GL_RGBA, GL_UNSIGNED_BYTE);
+        Benchmarks::doNotOptimize(out);
+    }
+    state.setItemsProcessed(state.iterations() * SIZE * SIZE);
+}
+
+OE_BENCHMARK(PixelReader_read_pixel)
+{
+    osg::ref_ptr<osg::Image> image = createImage(GL_RGBA, GL_UNSIGNED_BYTE);
+    ImageUtils::PixelReader read(image.get());
+    osg::Vec4f value;
+    while (state.keepRunning())
+    {
+        for (int t = 0; t < SIZE; ++t)
+            for (int s = 0; s < SIZE; ++s)
+                read(value, s, t);
+        Benchmarks::doNotOptimize(value);
+    }
+    state.setItemsProcessed(state.iterations() * SIZE * SIZE);
+}
+
+OE_BENCHMARK(PixelReader_readSpan)
+{
+    osg::ref_ptr<osg::Image> image = createImage(GL_RGBA, GL_UNSIGNED_BYTE);
+    ImageUtils::PixelReader read(image.get());
+    std::vector<osg::Vec4f> row(SIZE);
+    while (state.keepRunning())
+    {
+        for (int t = 0; t < SIZE; ++t)
+            read.readSpan(&row[0], 0, t, SIZE);
+        Benchmarks::doNotOptimize(row[0]);
+    }
+    state.setItemsProcessed(state.iterations() * SIZE * SIZE);
+}
+
+OE_BENCHMARK(PixelReader_read_bilinear)
+{
+    osg::ref_ptr<osg::Image> image = createImage(GL_RED, GL_FLOAT);
+    ImageUtils::PixelReader read(image.get());
+    read.setBilinear(true);
+    osg::Vec4f value;
+    const int count = 65536;
+    while (state.keepRunning())
+    {
+        for (int i = 0; i < count; ++i)
+            read(value, (double)(i % 256) / 255.0, (double)(i / 256) / 255.0);
+        Benchmarks::doNotOptimize(value);
+    }
+    state.setItemsProcessed(state.iterations() * count);
+}
@@ -0,0 +1,113 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2020 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#include "Benchmark.h"
+#include <osgEarth/SpatialReference>
+#include <osgEarth/GeoData>
+
+using namespace osgEarth;
+
+namespace
+{
+    const unsigned NUM_POINTS = 10000u;
+
+    //! A grid of geographic points over the southeastern US
+    std::vector<osg::Vec3d> createPoints()
+    {
+        std::vector<osg::Vec3d> points(NUM_POINTS);
+        for (unsigned i = 0; i < NUM_POINTS; ++i)
+            points[i].set(-84.0 + 6.0*(double)(i % 100)/100.0, 30.0 + 6.0*(double)(i / 100)/100.0, 100.0);
+        return points;
+    }
+
+    void transformBatch(Benchmarks::State& state, const char* target)
+    {
+        const SpatialReference* wgs84 = SpatialReference::get("wgs84");
+        const SpatialReference* srs = target ? SpatialReference::get(target) : wgs84->getGeocentricSRS();
+        if (!srs)
+        {
+            state.skip(std::string("SRS unavailable: ") + target);
+            return;
+        }
+
+        const std::vector<osg::Vec3d> source = createPoints();
+        std::vector<osg::Vec3d> points;
+
+        while (state.keepRunning())
+        {
+            state.pauseTiming();
+            points = source;
+            state.resumeTiming();
+
+            wgs84->transform(points, srs);
+            Benchmarks::doNotOptimize(points[0]);
+        }
+        state.setItemsProcessed(state.iterations() * NUM_POINTS);
+    }
+}
+
+OE_BENCHMARK(SpatialReference_transform_WGS84_to_Mercator)
+{
+    transformBatch(state, "spherical-mercator");
+}
+
+OE_BENCHMARK(SpatialReference_transform_WGS84_to_ECEF)
+{
+    transformBatch(state, 0L);
+}
+
+OE_BENCHMARK(SpatialReference_transform_WGS84_to_UTM)
+{
+    transformBatch(state, "+proj=utm +zone=17 +datum=WGS84 +units=m +no_defs");
+}
+
+OE_BENCHMARK(SpatialReference_transform_WGS84_to_LCC)
+{
+    transformBatch(state, "+proj=lcc +lat_1=33 +lat_2=45 +lat_0=39 +lon_0=-96 +datum=WGS84 +units=m +no_defs");
+}
+
+OE_BENCHMARK(SpatialReference_transform_single_point)
+{
+    const SpatialReference* wgs84 = SpatialReference::get("wgs84");
+    const SpatialReference* merc = SpatialReference::get("spherical-mercator");
+    osg::Vec3d input(-80.0, 35.0, 0.0), output;
+
+    while (state.keepRunning())
+    {
+        wgs84->transform(input, merc, output);
+        Benchmarks::doNotOptimize(output);
+    }
+    state.setItemsProcessed(state.iterations());
+}
+
+OE_BENCHMARK(GeoPoint_transform_to_world)
+{
+    const SpatialReference* wgs84 = SpatialReference::get("wgs84");
+    GeoPoint point(wgs84, -80.0, 35.0, 100.0, ALTMODE_ABSOLUTE);
+    osg::Vec3d world;
+
+    while (state.keepRunning())
+    {
+        point.toWorld(world);
+        Benchmarks::doNotOptimize(world);
+    }
+    state.setItemsProcessed(state.iterations());
+}
@@ -0,0 +1,139 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2020 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#include "Benchmark.h"
+#include <osgEarth/Containers>
+#include <osgEarth/Profile>
+#include <osgEarth/Registry>
+#include <osgEarth/TileKey>
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+namespace
+{
+    const unsigned NUM_KEYS = 4096u;
+
+    void lruInsertAndGet(Benchmarks::State& state, bool threadsafe)
+    {
+        typedef LRUCache<unsigned, unsigned> Cache;
+        Cache cache(threadsafe, NUM_KEYS / 2);
+        Cache::Record rec;
+        unsigned hits = 0u;
+
+        // a skewed access pattern: half the lookups go to 1/16th of the keys
+        unsigned i = 0u;
+        while (state.keepRunning())
+        {
+            unsigned key = (i & 1) ? (i * 2654435761u) % NUM_KEYS : (i * 2654435761u) % (NUM_KEYS / 16);
+            if (cache.get(key, rec))
+                ++hits;
+            else
+                cache.insert(key, i);
+            ++i;
+        }
+        Benchmarks::doNotOptimize(hits);
+        state.setItemsProcessed(state.iterations());
+    }
+}
+
+OE_BENCHMARK(LRUCache_get_or_insert)
+{
+    lruInsertAndGet(state, false);
+}
+
+OE_BENCHMARK(LRUCache_get_or_insert_threadsafe)
+{
+    lruInsertAndGet(state, true);
+}
+
+OE_BENCHMARK(TileKey_createChildKey)
+{
+    const Profile* profile = Registry::instance()->getGlobalGeodeticProfile();
+    TileKey root(0, 0, 0, profile);
+    while (state.keepRunning())
+    {
+        TileKey key = root;
+        for (unsigned lod = 0; lod < 16; ++lod)
+            key = key.createChildKey(lod & 3);
+        Benchmarks::doNotOptimize(key);
+    }
+    state.setItemsProcessed(state.iterations() * 16);
+}
+
+OE_BENCHMARK(TileKey_createParentKey)
+{
+    const Profile* profile = Registry::instance()->getSphericalMercatorProfile();
+    TileKey leaf(16, 19295, 24641, profile);
+    while (state.keepRunning())
+    {
+        TileKey key = leaf;
+        while (key.getLOD() > 0)
+            key = key.createParentKey();
+        Benchmarks::doNotOptimize(key);
+    }
+    state.setItemsProcessed(state.iterations() * 16);
+}
+
+OE_BENCHMARK(TileKey_getExtent)
+{
+    const Profile* profile = Registry::instance()->getSphericalMercatorProfile();
+    std::vector<TileKey> keys;
+    for (unsigned i = 0; i < 256; ++i)
+        keys.push_back(TileKey(12, 1100 + i % 16, 1600 + i / 16, profile));
+
+    while (state.keepRunning())
+    {
+        for (unsigned i = 0; i < keys.size(); ++i)
+        {
+            GeoExtent extent = keys[i].getExtent();
+            Benchmarks::doNotOptimize(extent);
+        }
+    }
+    state.setItemsProcessed(state.iterations() * keys.size());
+}
+
+OE_BENCHMARK(Profile_createTileKey)
+{
+    const Profile* profile = Registry::instance()->getGlobalGeodeticProfile();
+    double sum = 0.0;
+    unsigned i = 0u;
+    while (state.keepRunning())
+    {
+        TileKey key = profile->createTileKey(-180.0 + (double)(i % 3600)*0.1, -89.0 + (double)(i % 1780)*0.1, 14);
+        sum += key.getTileX();
+        ++i;
+    }
+    Benchmarks::doNotOptimize(sum);
+    state.setItemsProcessed(state.iterations());
+}
+
+OE_BENCHMARK(TileKey_str)
+{
+    const Profile* profile = Registry::instance()->getGlobalGeodeticProfile();
+    TileKey key(14, 4321, 1234, profile);
+    while (state.keepRunning())
+    {
+        std::string s = key.str();
+        Benchmarks::doNotOptimize(s);
+    }
+    state.setItemsProcessed(state.iterations());
+}
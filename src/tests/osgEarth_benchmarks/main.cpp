@@ -0,0 +1,334 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2020 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#include "Benchmark.h"
+#include <osgEarth/Registry>
+#include <osgEarth/Version>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+using namespace Benchmarks;
+
+// Usage:
+//   osgEarth_benchmarks [--benchmark_filter=<substring>]
+//                       [--benchmark_min_time=<seconds>]
+//                       [--benchmark_repetitions=<n>]
+//                       [--benchmark_out=<file.json>]
+//                       [--benchmark_format=console|json]
+//                       [--benchmark_list_tests]
+
+namespace
+{
+    struct Entry
+    {
+        std::string _name;
+        Function _function;
+    };
+
+    std::vector<Entry>& registry()
+    {
+        static std::vector<Entry> entries;
+        return entries;
+    }
+
+    struct Result
+    {
+        Result() : _iterations(0u), _realTime(0.0), _cpuTime(0.0), _itemsPerSecond(0.0), _bytesPerSecond(0.0) { }
+
+        std::string _name;
+        std::uint64_t _iterations;
+        double _realTime;   // ns per iteration
+        double _cpuTime;    // ns per iteration
+        double _itemsPerSecond;
+        double _bytesPerSecond;
+        std::string _skipped;
+    };
+
+    std::string flagValue(const char* arg, const char* flag)
+    {
+        std::size_t len = ::strlen(flag);
+        if (::strncmp(arg, flag, len) == 0 && arg[len] == '=')
+            return std::string(arg + len + 1);
+        return std::string();
+    }
+
+    void writeJSON(std::ostream& out, const std::vector<Result>& results, double minTime)
+    {
+        char date[64];
+        std::time_t now = std::time(0L);
+        std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", std::localtime(&now));
+
+        out << std::setprecision(10);
+        out << "{\n"
+            << "  \"context\": {\n"
+            << "    \"date\": \"" << date << "\",\n"
+            << "    \"executable\": \"osgEarth_benchmarks\",\n"
+            << "    \"library_version\": \"" << osgEarthGetVersion() << "\",\n"
+            << "    \"num_cpus\": " << std::thread::hardware_concurrency() << ",\n"
+            << "    \"min_time\": " << minTime << ",\n"
+#ifdef NDEBUG
+            << "    \"library_build_type\": \"release\"\n"
+#else
+            << "    \"library_build_type\": \"debug\"\n"
+#endif
+            << "  },\n"
+            << "  \"benchmarks\": [";
+
+        for (unsigned i = 0; i < results.size(); ++i)
+        {
+            const Result& r = results[i];
+            out << (i > 0 ? ",\n" : "\n")
+                << "    {\n"
+                << "      \"name\": \"" << r._name << "\",\n"
+                << "      \"run_type\": \"iteration\",\n";
+
+            if (!r._skipped.empty())
+            {
+                out << "      \"error_occurred\": true,\n"
+                    << "      \"error_message\": \"" << r._skipped << "\"\n"
+                    << "    }";
+                continue;
+            }
+
+            out << "      \"iterations\": " << r._iterations << ",\n"
+                << "      \"real_time\": " << r._realTime << ",\n"
+                << "      \"cpu_time\": " << r._cpuTime << ",\n"
+                << "      \"time_unit\": \"ns\"";
+            if (r._itemsPerSecond > 0.0)
+                out << ",\n      \"items_per_second\": " << r._itemsPerSecond;
+            if (r._bytesPerSecond > 0.0)
+                out << ",\n      \"bytes_per_second\": " << r._bytesPerSecond;
+            out << "\n    }";
+        }
+
+        out << "\n  ]\n}\n";
+    }
+
+    void writeConsole(std::ostream& out, const Result& r)
+    {
+        out << std::left << std::setw(48) << r._name << std::right;
+        if (!r._skipped.empty())
+        {
+            out << " SKIPPED: " << r._skipped << std::endl;
+            return;
+        }
+
+        out << std::fixed << std::setprecision(1)
+            << std::setw(14) << r._realTime << " ns"
+            << std::setw(14) << r._cpuTime << " ns"
+            << std::setw(12) << r._iterations;
+        if (r._itemsPerSecond > 0.0)
+            out << std::setprecision(3) << std::setw(12) << r._itemsPerSecond / 1e6 << " M items/s";
+        if (r._bytesPerSecond > 0.0)
+            out << std::setprecision(1) << std::setw(12) << r._bytesPerSecond / (1024.0*1024.0) << " MiB/s";
+        out << std::endl;
+    }
+}
+
+//........................................................................
+
+State::State(std::uint64_t iterations) :
+    _iterations(iterations),
+    _remaining(iterations),
+    _items(0u),
+    _bytes(0u),
+    _running(false),
+    _cpuStart(0),
+    _realTime(0.0),
+    _cpuTime(0.0)
+{
+    //nop
+}
+
+void
+State::pauseTiming()
+{
+    if (_running)
+    {
+        _realTime += std::chrono::duration<double>(std::chrono::steady_clock::now() - _realStart).count();
+        _cpuTime += (double)(std::clock() - _cpuStart) / (double)CLOCKS_PER_SEC;
+        _running = false;
+    }
+}
+
+void
+State::resumeTiming()
+{
+    if (!_running)
+    {
+        _running = true;
+        _cpuStart = std::clock();
+        _realStart = std::chrono::steady_clock::now();
+    }
+}
+
+void
+State::skip(const std::string& reason)
+{
+    pauseTiming();
+    _skipped = reason;
+    _remaining = 0u;
+}
+
+Registrar::Registrar(const char* name, Function function)
+{
+    Entry entry;
+    entry._name = name;
+    entry._function = function;
+    registry().push_back(entry);
+}
+
+namespace Benchmarks
+{
+    class Runner
+    {
+    public:
+        // Grows the iteration count until one run lasts minTime, like
+        // Google Benchmark, and returns the per-iteration times of that run.
+        static Result run(const Entry& entry, double minTime)
+        {
+            Result result;
+            result._name = entry._name;
+
+            const std::uint64_t maxIterations = 1000000000u;
+            std::uint64_t iterations = 1u;
+
+            for (;;)
+            {
+                State state(iterations);
+                entry._function(state);
+                state.pauseTiming();
+
+                if (!state._skipped.empty())
+                {
+                    result._skipped = state._skipped;
+                    return result;
+                }
+
+                if (state._realTime >= minTime || iterations >= maxIterations)
+                {
+                    result._iterations = iterations;
+                    result._realTime = 1e9 * state._realTime / (double)iterations;
+                    result._cpuTime = 1e9 * state._cpuTime / (double)iterations;
+                    result._itemsPerSecond = state._realTime > 0.0 ? (double)state._items / state._realTime : 0.0;
+                    result._bytesPerSecond = state._realTime > 0.0 ? (double)state._bytes / state._realTime : 0.0;
+                    return result;
+                }
+
+                // aim 40% past the minimum, growing at most 10x per step
+                double multiplier = state._realTime > 0.0 ? 1.4 * minTime / state._realTime : 10.0;
+                multiplier = std::min(10.0, std::max(2.0, multiplier));
+                iterations = std::min(maxIterations, (std::uint64_t)((double)iterations * multiplier));
+            }
+        }
+    };
+}
+
+int
+main(int argc, char** argv)
+{
+    std::string filter, outFile, format("console");
+    double minTime = 0.5;
+    unsigned repetitions = 1u;
+    bool listOnly = false;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string value;
+        if (!(value = flagValue(argv[i], "--benchmark_filter")).empty())
+            filter = value;
+        else if (!(value = flagValue(argv[i], "--benchmark_min_time")).empty())
+            minTime = std::max(0.0, atof(value.c_str()));
+        else if (!(value = flagValue(argv[i], "--benchmark_repetitions")).empty())
+            repetitions = std::max(1, atoi(value.c_str()));
+        else if (!(value = flagValue(argv[i], "--benchmark_out")).empty())
+            outFile = value;
+        else if (!(value = flagValue(argv[i], "--benchmark_format")).empty())
+            format = value;
+        else if (::strcmp(argv[i], "--benchmark_list_tests") == 0)
+            listOnly = true;
+        else
+        {
+            std::cerr << "Unrecognized argument: " << argv[i] << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<Entry> entries = registry();
+    std::sort(entries.begin(), entries.end(),
+        [](const Entry& a, const Entry& b) { return a._name < b._name; });
+
+    std::vector<Result> results;
+    bool console = format != "json";
+
+    if (console && !listOnly)
+    {
+        std::cout << std::left << std::setw(48) << "Benchmark" << std::right
+            << std::setw(17) << "Time" << std::setw(17) << "CPU"
+            << std::setw(12) << "Iterations" << std::endl;
+    }
+
+    for (unsigned i = 0; i < entries.size(); ++i)
+    {
+        if (!filter.empty() && entries[i]._name.find(filter) == std::string::npos)
+            continue;
+
+        if (listOnly)
+        {
+            std::cout << entries[i]._name << std::endl;
+            continue;
+        }
+
+        for (unsigned r = 0; r < repetitions; ++r)
+        {
+            results.push_back(Runner::run(entries[i], minTime));
+            if (console)
+                writeConsole(std::cout, results.back());
+        }
+    }
+
+    if (listOnly)
+        return 0;
+
+    if (!console)
+        writeJSON(std::cout, results, minTime);
+
+    if (!outFile.empty())
+    {
+        std::ofstream out(outFile.c_str());
+        if (!out.is_open())
+        {
+            std::cerr << "Failed to open " << outFile << std::endl;
+            return 1;
+        }
+        writeJSON(out, results, minTime);
+    }
+
+    osgEarth::Registry::instance()->release();
+    return 0;
+}
@@ -24,6 +24,7 @@
 #include <osgEarth/GeoData>
 #include <osgEarth/Registry>
 #include <osgEarth/MemCache>
+#include <osgEarth/StringUtils>
 
 using namespace osgEarth;
 
@@ -83,3 +84,64 @@ TEST_CASE( "Cache" ) {
         REQUIRE(r2.failed());
     }  
 }
+
+TEST_CASE( "MemCache eviction" ) {
+
+    SECTION("LRU")
+    {
+        osg::ref_ptr<MemCache> cache = new MemCache(2);
+        osg::ref_ptr<CacheBin> bin = cache->addBin("lru");
+
+        bin->write("a", new StringObject("a"), 0L);
+        bin->write("b", new StringObject("b"), 0L);
+        REQUIRE(bin->readString("a", 0L).succeeded());
+
+        // "b" is now the least recently used entry
+        bin->write("c", new StringObject("c"), 0L);
+        REQUIRE(bin->getRecordStatus("a") == CacheBin::STATUS_OK);
+        REQUIRE(bin->getRecordStatus("b") == CacheBin::STATUS_NOT_FOUND);
+        REQUIRE(bin->getRecordStatus("c") == CacheBin::STATUS_OK);
+    }
+
+    SECTION("CLOCK")
+    {
+        osg::ref_ptr<MemCache> cache = new MemCache(2);
+        cache->setUseClockEviction(true);
+        osg::ref_ptr<CacheBin> bin = cache->addBin("clock");
+
+        bin->write("a", new StringObject("a"), 0L);
+        bin->write("b", new StringObject("b"), 0L);
+        REQUIRE(bin->readString("a", 0L).succeeded());
+
+        // "a" was read, so it gets a second chance and "b" goes
+        bin->write("c", new StringObject("c"), 0L);
+        REQUIRE(bin->getRecordStatus("a") == CacheBin::STATUS_OK);
+        REQUIRE(bin->getRecordStatus("b") == CacheBin::STATUS_NOT_FOUND);
+        REQUIRE(bin->getRecordStatus("c") == CacheBin::STATUS_OK);
+    }
+
+    SECTION("Bytes")
+    {
+        osg::ref_ptr<osg::Image> image = ImageUtils::createEmptyImage(4, 4);
+        unsigned imageBytes = image->getTotalSizeInBytesIncludingMipmaps();
+
+        // room for at most 32 images, however the keys are distributed
+        osg::ref_ptr<MemCache> cache = new MemCache(1000);
+        cache->setMaxBinBytes(32u * imageBytes);
+        osg::ref_ptr<CacheBin> bin = cache->addBin("bytes");
+
+        for (int i = 0; i < 100; ++i)
+        {
+            bin->write(Stringify() << i, osg::clone(image.get(), osg::CopyOp::DEEP_COPY_ALL), 0L);
+        }
+
+        unsigned found = 0u;
+        for (int i = 0; i < 100; ++i)
+        {
+            if (bin->getRecordStatus(Stringify() << i) == CacheBin::STATUS_OK)
+                ++found;
+        }
+        REQUIRE(found > 0u);
+        REQUIRE(found <= 32u);
+    }
+}
@@ -0,0 +1,64 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2020 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/catch.hpp>
+#include <osgEarth/XmlUtils>
+#include <sstream>
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+TEST_CASE( "XmlDocument::readConfig matches XmlDocument::load" ) {
+
+    const std::string xml =
+        "<?xml version=\"1.0\"?>\n"
+        "<!DOCTYPE map>\n"
+        "<!-- comment -->\n"
+        "<Map Name=\"test\" version=\"2\">\n"
+        "  <GDALImage name=\"world\" B=\"2\" a=\"1\">\n"
+        "    <URL>  world.tif  </URL>\n"
+        "  </GDALImage>\n"
+        "  <styles>\n"
+        "    <style type=\"text/css\"><![CDATA[ roads { stroke: #ff0000; } ]]></style>\n"
+        "  </styles>\n"
+        "  <options>some   spaced &amp; escaped    text</options>\n"
+        "</Map>\n";
+
+    std::stringstream in1(xml);
+    osg::ref_ptr<XmlDocument> doc = XmlDocument::load(in1);
+    REQUIRE(doc.valid());
+    Config legacy = doc->getConfig();
+
+    std::stringstream in2(xml);
+    Config fast;
+    REQUIRE(XmlDocument::readConfig(in2, URIContext(), fast));
+
+    REQUIRE(fast.toJSON() == legacy.toJSON());
+    REQUIRE(fast.child("map").child("gdalimage").value("url") == "world.tif");
+    REQUIRE(fast.child("map").child("options").value() == "some spaced & escaped text");
+
+    SECTION("Malformed documents fail") {
+        std::stringstream bad("<map><image></map>");
+        Config out;
+        REQUIRE_FALSE(XmlDocument::readConfig(bad, URIContext(), out));
+    }
+}
@@ -0,0 +1,203 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2018 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/catch.hpp>
+
+#include <osgEarth/Elevation>
+#include <osgEarth/ElevationQueryService>
+#include <osgEarth/LineOfSightEngine>
+#include <osgEarth/Map>
+#include <osgEarth/Registry>
+#include <osgEarth/TerrainProfile>
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+TEST_CASE( "ElevationTexture" ) {
+
+    const Profile* profile = Registry::instance()->getGlobalGeodeticProfile();
+    TileKey key(4, 3, 2, profile);
+
+    // 9x9 posts, flat at 10m with a 100m spike at post (6,2)
+    osg::ref_ptr<osg::HeightField> hf = new osg::HeightField();
+    hf->allocate(9, 9);
+    for(unsigned i=0; i<hf->getHeightList().size(); ++i)
+        hf->getHeightList()[i] = 10.0f;
+    hf->setHeight(6, 2, 100.0f);
+
+    osg::ref_ptr<ElevationTexture> tex = new ElevationTexture(
+        key,
+        GeoHeightField(hf.get(), key.getExtent()),
+        new float[hf->getHeightList().size()]);
+
+    const GeoExtent& e = key.getExtent();
+
+    SECTION("Min/max pyramid") {
+        float lo, hi;
+        REQUIRE(tex->getElevationRange(lo, hi));
+        REQUIRE(lo == 10.0f);
+        REQUIRE(hi == 100.0f);
+
+        // left half misses the spike; a small box around it does not
+        REQUIRE(tex->getElevationRangeUV(0.0, 0.0, 0.5, 1.0, lo, hi));
+        REQUIRE(hi == 10.0f);
+        REQUIRE(tex->getElevationRangeUV(0.7, 0.2, 0.8, 0.3, lo, hi));
+        REQUIRE(hi == 100.0f);
+    }
+
+    SECTION("Segment intersection") {
+        osg::Vec3d hit;
+
+        // passes over everything
+        REQUIRE_FALSE(tex->intersect(
+            osg::Vec3d(e.xMin(), e.yMin(), 200.0),
+            osg::Vec3d(e.xMax(), e.yMax(), 150.0),
+            hit));
+
+        // descends through the flat part, on the left side of the tile
+        double x = e.xMin() + 0.25*e.width();
+        REQUIRE(tex->intersect(
+            osg::Vec3d(x, e.yMin(), 20.0),
+            osg::Vec3d(x, e.yMax(), 0.0),
+            hit));
+        REQUIRE(hit.z() == Approx(10.0));
+        REQUIRE(hit.y() == Approx(e.yMin() + 0.5*e.height()));
+
+        // flies at 50m and clips the spike
+        double y = e.yMin() + 0.25*e.height();
+        REQUIRE(tex->intersect(
+            osg::Vec3d(e.xMin(), y, 50.0),
+            osg::Vec3d(e.xMax(), y, 50.0),
+            hit));
+        REQUIRE(hit.x() > e.xMin() + 0.625*e.width());
+        REQUIRE(hit.x() < e.xMin() + 0.75*e.width());
+    }
+}
+
+TEST_CASE( "LineOfSightEngine" ) {
+
+    // no elevation layers, so the terrain is the bare ellipsoid
+    osg::ref_ptr<Map> map = new Map();
+    LineOfSightEngine los(map.get());
+    los.setResolution(Distance(30.0, Units::METERS));
+
+    GeoPoint observer(map->getSRS(), 10.0, 45.0, 2.0, ALTMODE_RELATIVE);
+
+    SECTION("Rays over flat ground are clear") {
+        LineOfSightEngine::Rays rays;
+        rays.push_back(LineOfSightEngine::Ray(observer, GeoPoint(map->getSRS(), 10.01, 45.0, 2.0, ALTMODE_RELATIVE)));
+        rays.push_back(LineOfSightEngine::Ray(observer, GeoPoint(map->getSRS(), 10.0, 45.01, 0.0, ALTMODE_RELATIVE)));
+
+        LineOfSightEngine::Results results;
+        REQUIRE(los.compute(rays, results));
+        REQUIRE(results.size() == 2);
+        REQUIRE(results[0]._valid);
+        REQUIRE(results[0]._visible);
+        REQUIRE(results[1]._visible);
+    }
+
+    SECTION("Viewshed covers the radius") {
+        GeoImage vs = los.computeViewshed(observer, Distance(600.0, Units::METERS), Distance(0.0, Units::METERS));
+        REQUIRE(vs.valid());
+
+        const osg::Image* image = vs.getImage();
+        REQUIRE(image->s() == 41);
+        REQUIRE(image->t() == 41);
+
+        // observer, a point near the edge, and a corner outside the radius
+        REQUIRE(*image->data(20, 20) == 255);
+        REQUIRE(*image->data(38, 20) == 255);
+        REQUIRE(*image->data(0, 0) == 0);
+        REQUIRE(vs.getExtent().contains(10.0, 45.0));
+    }
+}
+
+TEST_CASE( "TerrainProfileSampler" ) {
+
+    osg::ref_ptr<Map> map = new Map();
+    Contrib::TerrainProfileSampler sampler(map.get());
+    sampler.setSpacing(Distance(30.0, Units::METERS));
+
+    Contrib::TerrainProfileSampler::Path path;
+    path.push_back(GeoPoint(map->getSRS(), 10.0, 45.0));
+    path.push_back(GeoPoint(map->getSRS(), 10.0, 45.01));
+    double length = path[0].distanceTo(path[1]);
+
+    SECTION("Samples at the spacing and ends on the last point") {
+        Contrib::TerrainProfileSampler::Profile profile;
+        REQUIRE(sampler.compute(path, profile));
+        REQUIRE(profile._distances.size() == (unsigned)ceil(length / 30.0) + 1u);
+        REQUIRE(profile._elevations.size() == profile._distances.size());
+        REQUIRE(profile._resolutions.size() == profile._distances.size());
+        REQUIRE(profile._distances[0] == 0.0);
+        REQUIRE(profile._distances[1] == Approx(30.0));
+        REQUIRE(profile._distances.back() == Approx(length));
+    }
+
+    SECTION("Batch returns one profile per path") {
+        Contrib::TerrainProfileSampler::Paths paths(3, path);
+        Contrib::TerrainProfileSampler::Profiles profiles;
+        REQUIRE(sampler.compute(paths, profiles));
+        REQUIRE(profiles.size() == 3);
+        REQUIRE(profiles[2]._distances.size() == profiles[0]._distances.size());
+    }
+}
+
+TEST_CASE( "ElevationQueryService" ) {
+
+    osg::ref_ptr<Map> map = new Map();
+    osg::ref_ptr<ElevationQueryService> service = new ElevationQueryService(map.get());
+
+    SECTION("Batches answer each request separately") {
+        std::vector<osg::Vec4d> a(3, osg::Vec4d(10.0, 45.0, 0.0, 0.0));
+        std::vector<osg::Vec4d> b(5, osg::Vec4d(11.0, 46.0, 0.0, 0.0));
+        ElevationQueryService::Future fa = service->submit(a);
+        ElevationQueryService::Future fb = service->submit(b);
+        REQUIRE(fa.get() != 0L);
+        REQUIRE(fb.get() != 0L);
+        REQUIRE(fa.get()->_ok);
+        REQUIRE(fa.get()->_elevations.size() == 3);
+        REQUIRE(fb.get()->_elevations.size() == 5);
+    }
+
+    SECTION("JSON protocol") {
+        std::string response;
+        REQUIRE(service->handleJSON("{\"points\": [[10, 45], [11, 46]]}", response));
+        REQUIRE(response.find("\"elevations\"") != std::string::npos);
+        REQUIRE_FALSE(service->handleJSON("{\"nope\": 1}", response));
+        REQUIRE(response.find("\"error\"") != std::string::npos);
+    }
+
+    SECTION("Binary protocol") {
+        std::string request("OEQ1", 4);
+        std::uint32_t count = 1;
+        request.append((const char*)&count, 4);
+        double p[3] = { 10.0, 45.0, 0.0 };
+        request.append((const char*)p, sizeof(p));
+
+        std::string response;
+        REQUIRE(service->handleBinary(request, response));
+        REQUIRE(response.size() == 16);
+        REQUIRE(response.compare(0, 4, "OER1") == 0);
+        REQUIRE_FALSE(service->handleBinary("junk", response));
+    }
+}
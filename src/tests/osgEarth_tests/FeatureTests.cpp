@@ -23,7 +23,12 @@
 #include <osgEarth/catch.hpp>
 
 #include <osgEarth/Feature>
+#include <osgEarth/FeatureBatch>
 #include <osgEarth/GeometryUtils>
+#include <osgEarth/GeneralizeFilter>
+#include <osgEarth/FilterContext>
+#include <osgEarth/PolygonIndex>
+#include <osgEarth/BlockPool>
 
 using namespace osgEarth;
 
@@ -109,3 +114,160 @@ TEST_CASE("Feature handles attributes correctly.") {
         REQUIRE(feature->getBool("bool") == false);
     }
 }
+
+TEST_CASE("FeatureBatch round-trips features through its columns") {
+    osg::ref_ptr<const SpatialReference> wgs84 = osgEarth::SpatialReference::create("wgs84");
+
+    osg::ref_ptr< Feature > road = new Feature(GeometryUtils::geometryFromWKT("LINESTRING(0 0, 1 1, 2 0)"), wgs84.get(), Style(), 7);
+    road->set("name", std::string("Main St"));
+    road->set("lanes", 4);
+
+    osg::ref_ptr< Feature > lot = new Feature(GeometryUtils::geometryFromWKT("POLYGON((0 0, 10 0, 10 10, 0 10),(2 2, 2 4, 4 4, 4 2))"), wgs84.get(), Style(), 8);
+    lot->set("area", 96.0);
+
+    FeatureList input;
+    input.push_back(road);
+    input.push_back(lot);
+
+    osg::ref_ptr<FeatureBatch> batch = new FeatureBatch();
+    batch->add(input);
+
+    REQUIRE(batch->size() == 2);
+    REQUIRE(batch->coords().size() == (unsigned)(road->getGeometry()->getTotalPointCount() + lot->getGeometry()->getTotalPointCount()));
+    REQUIRE(batch->getNumParts(1) == 2);
+    REQUIRE(batch->getPart(batch->getFirstPart(1) + 1).hole == true);
+
+    int lanes = batch->getSlot("LANES");
+    REQUIRE(lanes >= 0);
+    REQUIRE(batch->getInt(lanes, 0) == 4);
+    REQUIRE(batch->isSet(lanes, 1) == false);
+    REQUIRE(batch->getString(batch->getSlot("name"), 0) == "Main St");
+
+    FeatureList output;
+    batch->getFeatures(output);
+    REQUIRE(output.size() == 2);
+    REQUIRE(output.front()->getFID() == 7);
+    REQUIRE(output.front()->getString("name") == "Main St");
+    REQUIRE(output.front()->hasAttr("area") == false);
+    REQUIRE(output.back()->getGeometry()->getType() == Geometry::TYPE_POLYGON);
+    REQUIRE(static_cast<const Polygon*>(output.back()->getGeometry())->getHoles().size() == 1);
+    REQUIRE(output.back()->getDouble("area") == 96.0);
+}
+
+TEST_CASE("Compiled expressions match the interpreted ones") {
+    osg::ref_ptr<const SpatialReference> wgs84 = osgEarth::SpatialReference::create("wgs84");
+
+    osg::ref_ptr< Feature > a = new Feature(GeometryUtils::geometryFromWKT("POINT(0 0)"), wgs84.get(), Style(), 1);
+    a->set("height", 10.0);
+    a->set("levels", 3);
+    a->set("name", std::string("A"));
+
+    osg::ref_ptr< Feature > b = new Feature(GeometryUtils::geometryFromWKT("POINT(1 1)"), wgs84.get(), Style(), 2);
+    b->set("levels", 5);
+    b->set("name", std::string("B"));
+
+    NumericExpression numeric("max([height], [levels]*3.5) + (2*4) - [height]");
+    CompiledNumericExpression compiledNumeric(numeric);
+    REQUIRE(compiledNumeric.getNumVariables() == 2);
+
+    StringExpression string("\"bldg_\" + [name]");
+    CompiledStringExpression compiledString(string);
+
+    FeatureList features;
+    features.push_back(a);
+    features.push_back(b);
+
+    for (FeatureList::iterator f = features.begin(); f != features.end(); ++f)
+    {
+        REQUIRE((*f)->eval(compiledNumeric, (FilterContext*)0L) == (*f)->eval(numeric, (FilterContext*)0L));
+        REQUIRE((*f)->eval(compiledString, (FilterContext*)0L) == (*f)->eval(string, (FilterContext*)0L));
+    }
+
+    osg::ref_ptr<FeatureBatch> batch = new FeatureBatch();
+    batch->add(features);
+
+    std::vector<double> results;
+    REQUIRE(batch->eval(compiledNumeric, results) == true);
+    REQUIRE(results.size() == 2);
+    REQUIRE(results[0] == a->eval(numeric, (FilterContext*)0L));
+    REQUIRE(results[1] == b->eval(numeric, (FilterContext*)0L));
+
+    CompiledNumericExpression missing(NumericExpression("[nope] + 1"));
+    REQUIRE(batch->eval(missing, results) == false);
+}
+
+TEST_CASE("GeneralizeFilter keeps shared edges intact") {
+    const SpatialReference* srs = SpatialReference::get("wgs84");
+
+    // two squares that share a jagged edge along x=10, and a tiny island
+    FeatureList features;
+    features.push_back(new Feature(GeometryUtils::geometryFromWKT(
+        "POLYGON((0 0, 10 0, 10 2, 10.01 4, 9.99 6, 10.02 8, 10 10, 0 10, 0.05 5))"), srs, Style(), 1));
+    features.push_back(new Feature(GeometryUtils::geometryFromWKT(
+        "POLYGON((10 0, 20 0, 20 10, 10 10, 10.02 8, 9.99 6, 10.01 4, 10 2))"), srs, Style(), 2));
+    features.push_back(new Feature(GeometryUtils::geometryFromWKT(
+        "POLYGON((30 30, 30.1 30, 30.1 30.1))"), srs, Style(), 3));
+
+    FilterContext cx;
+    GeneralizeFilter filter(0.5);
+    filter.push(features, cx);
+
+    // the island is gone
+    REQUIRE(features.size() == 2);
+
+    const Geometry* a = features.front()->getGeometry();
+    const Geometry* b = features.back()->getGeometry();
+    unsigned na = a->size() - (a->front() == a->back() ? 1 : 0);
+    unsigned nb = b->size() - (b->front() == b->back() ? 1 : 0);
+    REQUIRE(na == 4);
+    REQUIRE(nb == 4);
+
+    // and both squares kept the same two corners of the shared edge
+    unsigned shared = 0;
+    for (unsigned i = 0; i < na; ++i)
+        for (unsigned j = 0; j < nb; ++j)
+            if ((*a)[i] == (*b)[j]) ++shared;
+    REQUIRE(shared == 2);
+}
+
+TEST_CASE("PolygonIndex finds points in polygons with holes")
+{
+    const SpatialReference* srs = SpatialReference::get("wgs84");
+
+    FeatureList features;
+    features.push_back(new Feature(GeometryUtils::geometryFromWKT(
+        "POLYGON((0 0, 10 0, 10 10, 0 10, 0 0), (4 4, 6 4, 6 6, 4 6, 4 4))"), srs));
+    features.push_back(new Feature(GeometryUtils::geometryFromWKT(
+        "MULTIPOLYGON(((20 0, 30 0, 30 10, 20 10, 20 0)), ((40 0, 50 0, 50 10, 40 10, 40 0)))"), srs));
+
+    osg::ref_ptr<PolygonIndex> index = new PolygonIndex(features);
+    REQUIRE(index->size() == 3u);
+
+    REQUIRE(index->contains(1.0, 1.0));
+    REQUIRE_FALSE(index->contains(5.0, 5.0));   // in the hole
+    REQUIRE(index->contains(45.0, 5.0));
+    REQUIRE_FALSE(index->contains(35.0, 5.0));  // between the parts
+    REQUIRE_FALSE(index->contains(5.0, 50.0));
+}
+
+TEST_CASE("BlockPool recycles freed blocks within a size class") {
+    bool enabled = Util::BlockPool::isEnabled();
+    Util::BlockPool::setEnabled(true);
+
+    void* a = Util::BlockPool::allocate(40);
+    Util::BlockPool::deallocate(a, 40);
+
+    // 48 bytes is in the same 16-byte class as 40
+    void* b = Util::BlockPool::allocate(48);
+    REQUIRE(b == a);
+    Util::BlockPool::deallocate(b, 48);
+
+    // pooled features keep their attributes through a copy
+    osg::ref_ptr<Feature> feature = new Feature(new Geometry(), SpatialReference::create("wgs84"));
+    feature->set("name", std::string("pooled"));
+    osg::ref_ptr<Feature> copy = new Feature(*feature.get());
+    feature = 0L;
+    REQUIRE(copy->getString("name") == "pooled");
+
+    Util::BlockPool::setEnabled(enabled);
+}
@@ -25,6 +25,7 @@
 #include <osgEarth/ImageLayer>
 #include <osgEarth/Registry>
 #include <osgEarth/GDAL>
+#include <osgEarth/Map>
 
 using namespace osgEarth;
 
@@ -70,4 +71,74 @@ TEST_CASE("Attribution works")
 
     REQUIRE(status.isOK());
     REQUIRE(layer->getAttribution() == attribution);
-}
\ No newline at end of file
+}
+TEST_CASE("Invisible layers open on demand")
+{
+    Map::Options mapOptions;
+    mapOptions.openLayersOnDemand() = true;
+    osg::ref_ptr<Map> map = new Map(mapOptions);
+
+    GDALImageLayer* layer = new GDALImageLayer();
+    layer->setURL("../data/world.tif");
+    layer->setVisible(false);
+    map->addLayer(layer);
+
+    REQUIRE(layer->isOpenDeferred());
+    REQUIRE(!layer->isOpen());
+
+    SECTION("Queries open the layer")
+    {
+        TileKey key(0, 0, 0, Registry::instance()->getGlobalGeodeticProfile());
+        REQUIRE(layer->createImage(key).valid());
+        REQUIRE(layer->isOpen());
+        REQUIRE(!layer->isOpenDeferred());
+    }
+
+    SECTION("Showing the layer opens it")
+    {
+        layer->setVisible(true);
+        REQUIRE(layer->isOpen());
+    }
+}
+
+namespace
+{
+    class ManyExtentsLayer : public ImageLayer
+    {
+    public:
+        META_Layer(osgEarth, ManyExtentsLayer, ImageLayer::Options, ImageLayer, many_extents);
+
+        void addDataExtent(const DataExtent& value) {
+            dataExtents().push_back(value);
+            dirtyDataExtents();
+        }
+    };
+}
+
+TEST_CASE("Data extent checks work with many extents")
+{
+    const Profile* profile = Registry::instance()->getGlobalGeodeticProfile();
+
+    osg::ref_ptr<ManyExtentsLayer> layer = new ManyExtentsLayer();
+    layer->setProfile(profile);
+
+    // an 8x8 grid of 1-degree boxes one degree apart, enough to use the index
+    for (int i = 0; i < 8; ++i)
+        for (int j = 0; j < 8; ++j)
+            layer->addDataExtent(DataExtent(
+                GeoExtent(profile->getSRS(), 2 * i, 2 * j, 2 * i + 1, 2 * j + 1), 0u, 12u));
+
+    REQUIRE(layer->getDataExtents().size() == 64u);
+
+    TileKey inBox = profile->createTileKey(4.5, 6.5, 10);
+    REQUIRE(layer->mayHaveData(inBox));
+
+    TileKey inGap = profile->createTileKey(5.5, 6.5, 10);
+    REQUIRE(layer->getBestAvailableTileKey(inGap).valid() == false);
+
+    TileKey tooDeep = profile->createTileKey(4.5, 6.5, 14);
+    REQUIRE(layer->getBestAvailableTileKey(tooDeep).getLOD() == 12u);
+
+    REQUIRE(layer->intersectsDataExtents(inBox.getExtent()));
+    REQUIRE(layer->intersectsDataExtents(inGap.getExtent()) == false);
+}
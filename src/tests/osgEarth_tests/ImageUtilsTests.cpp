@@ -0,0 +1,202 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2018 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/catch.hpp>
+#include <osgEarth/ImageUtils>
+#include <osgEarth/BufferPool>
+#include <osg/Timer>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+namespace
+{
+    osg::Image* makeImage(int s, int t, GLenum pixelFormat, GLenum dataType)
+    {
+        osg::Image* image = new osg::Image();
+        image->allocateImage(s, t, 1, pixelFormat, dataType);
+        image->setInternalTextureFormat(pixelFormat);
+        unsigned char* data = image->data();
+        srand(42);
+        if (dataType == GL_FLOAT)
+        {
+            for (unsigned i = 0; i < image->getTotalSizeInBytes() / sizeof(float); ++i)
+                ((float*)data)[i] = (float)(rand() % 10000) * 0.5f;
+        }
+        else
+        {
+            for (unsigned i = 0; i < image->getTotalSizeInBytes(); ++i)
+                data[i] = (unsigned char)(rand() & 0xFF);
+        }
+        return image;
+    }
+
+    // Same pixels in BGRA order, which has no fast kernel
+    osg::Image* toBGRA(const osg::Image* rgba)
+    {
+        osg::Image* bgra = new osg::Image();
+        bgra->allocateImage(rgba->s(), rgba->t(), 1, GL_BGRA, GL_UNSIGNED_BYTE);
+        bgra->setInternalTextureFormat(GL_RGBA);
+        for (unsigned i = 0; i < rgba->getTotalSizeInBytes(); i += 4)
+        {
+            bgra->data()[i+0] = rgba->data()[i+2];
+            bgra->data()[i+1] = rgba->data()[i+1];
+            bgra->data()[i+2] = rgba->data()[i+0];
+            bgra->data()[i+3] = rgba->data()[i+3];
+        }
+        return bgra;
+    }
+}
+
+TEST_CASE("ImageUtils RGBA8 kernels match the generic path") {
+
+    osg::ref_ptr<osg::Image> rgba = makeImage(64, 64, GL_RGBA, GL_UNSIGNED_BYTE);
+    osg::ref_ptr<osg::Image> bgra = toBGRA(rgba.get());
+
+    SECTION("resizeImage") {
+        osg::ref_ptr<osg::Image> fast, generic;
+        REQUIRE(ImageUtils::resizeImage(rgba.get(), 100, 100, fast));
+        REQUIRE(ImageUtils::resizeImage(bgra.get(), 100, 100, generic));
+
+        ImageUtils::PixelReader readFast(fast.get()), readGeneric(generic.get());
+        for (int t = 0; t < 100; ++t)
+        {
+            for (int s = 0; s < 100; ++s)
+            {
+                osg::Vec4 a = readFast(s, t), b = readGeneric(s, t);
+                for (int i = 0; i < 4; ++i)
+                    REQUIRE(std::abs(a[i] - b[i]) <= 2.0f / 255.0f);
+            }
+        }
+    }
+
+    SECTION("mix") {
+        osg::ref_ptr<osg::Image> fast = makeImage(64, 64, GL_RGBA, GL_UNSIGNED_BYTE);
+        osg::ref_ptr<osg::Image> generic = toBGRA(fast.get());
+        srand(7);
+        for (unsigned i = 0; i < rgba->getTotalSizeInBytes(); ++i)
+            rgba->data()[i] = (unsigned char)(rand() & 0xFF); // a different source
+        bgra = toBGRA(rgba.get());
+
+        REQUIRE(ImageUtils::mix(fast.get(), rgba.get(), 0.6f));
+        REQUIRE(ImageUtils::mix(generic.get(), bgra.get(), 0.6f));
+
+        ImageUtils::PixelReader readFast(fast.get()), readGeneric(generic.get());
+        for (int t = 0; t < 64; ++t)
+        {
+            for (int s = 0; s < 64; ++s)
+            {
+                osg::Vec4 a = readFast(s, t), b = readGeneric(s, t);
+                for (int i = 0; i < 4; ++i)
+                    REQUIRE(std::abs(a[i] - b[i]) <= 2.0f / 255.0f);
+            }
+        }
+    }
+}
+
+TEST_CASE("ImageUtils::generateMipmaps box-filters each level") {
+    osg::ref_ptr<osg::Image> image = new osg::Image();
+    image->allocateImage(2, 2, 1, GL_RGBA, GL_UNSIGNED_BYTE);
+    const unsigned char pixels[16] = {
+        0, 10, 20, 255,    4, 10, 20, 255,
+        8, 10, 20, 255,   12, 10, 21, 0 };
+    memcpy(image->data(), pixels, 16);
+
+    REQUIRE(ImageUtils::generateMipmaps(image.get()));
+    REQUIRE(image->getNumMipmapLevels() == 2);
+
+    const unsigned char* level1 = image->getMipmapData(1);
+    REQUIRE(level1[0] == 6);
+    REQUIRE(level1[1] == 10);
+    REQUIRE(level1[2] == 20);
+    REQUIRE(level1[3] == 191);
+}
+
+TEST_CASE("ImageUtils::cloneImage copies into a recycled buffer") {
+    osg::ref_ptr<osg::Image> image = new osg::Image();
+    image->allocateImage(4, 4, 1, GL_RGBA, GL_UNSIGNED_BYTE);
+    for (unsigned i = 0; i < image->getTotalSizeInBytes(); ++i)
+        image->data()[i] = (unsigned char)i;
+
+    Util::BufferPool::clear();
+
+    osg::ref_ptr<osg::Image> clone = ImageUtils::cloneImage(image.get());
+    REQUIRE(clone.valid());
+    REQUIRE(clone->s() == 4);
+    REQUIRE(clone->t() == 4);
+    REQUIRE(memcmp(clone->data(), image->data(), image->getTotalSizeInBytes()) == 0);
+
+    // destroying the clone returns its buffer to the pool (if enabled)
+    clone = 0L;
+    if (Util::BufferPool::isEnabled())
+    {
+        REQUIRE(Util::BufferPool::getBytes() == image->getTotalSizeInBytes());
+        clone = ImageUtils::cloneImage(image.get());
+        REQUIRE(Util::BufferPool::getBytes() == 0u);
+        REQUIRE(memcmp(clone->data(), image->data(), image->getTotalSizeInBytes()) == 0);
+    }
+}
+
+// Throughput of the image kernels, fast formats against the generic path.
+// Hidden; run with: osgEarth_tests "[benchmark]"
+TEST_CASE("ImageUtils kernel throughput", "[.][benchmark]") {
+    struct Format { const char* name; GLenum pixelFormat; GLenum dataType; };
+    const Format formats[] = {
+        { "RGBA8", GL_RGBA, GL_UNSIGNED_BYTE },
+        { "RGB8", GL_RGB, GL_UNSIGNED_BYTE },
+        { "R32F", GL_RED, GL_FLOAT },
+        { "BGRA8 (generic)", GL_BGRA, GL_UNSIGNED_BYTE }
+    };
+    const int size = 1024;
+    const double mp = (double)(size * size) / 1e6;
+
+    for (unsigned f = 0; f < sizeof(formats) / sizeof(formats[0]); ++f)
+    {
+        osg::ref_ptr<osg::Image> src = makeImage(size, size, formats[f].pixelFormat, formats[f].dataType);
+        osg::ref_ptr<osg::Image> dest = makeImage(size, size, formats[f].pixelFormat, formats[f].dataType);
+
+        osg::Timer_t start = osg::Timer::instance()->tick();
+        osg::ref_ptr<osg::Image> resized;
+        REQUIRE(ImageUtils::resizeImage(src.get(), size + 1, size + 1, resized));
+        double resizeS = osg::Timer::instance()->delta_s(start, osg::Timer::instance()->tick());
+
+        double mixS = 0.0;
+        if (formats[f].dataType == GL_UNSIGNED_BYTE)
+        {
+            start = osg::Timer::instance()->tick();
+            REQUIRE(ImageUtils::mix(dest.get(), src.get(), 0.5f));
+            mixS = osg::Timer::instance()->delta_s(start, osg::Timer::instance()->tick());
+        }
+
+        start = osg::Timer::instance()->tick();
+        REQUIRE(ImageUtils::generateMipmaps(src.get()));
+        double mipS = osg::Timer::instance()->delta_s(start, osg::Timer::instance()->tick());
+
+        std::cout << formats[f].name << ": resize " << mp / resizeS << " MP/s";
+        if (mixS > 0.0)
+            std::cout << ", mix " << mp / mixS << " MP/s";
+        std::cout << ", mipmaps " << mp / mipS << " MP/s" << std::endl;
+    }
+}
@@ -0,0 +1,68 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2018 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#include <osgEarth/catch.hpp>
+#include <osgEarth/ObjectIndex>
+
+using namespace osgEarth;
+
+TEST_CASE( "ObjectIndex stores and removes ID ranges" ) {
+    osg::ref_ptr<ObjectIndex> index = new ObjectIndex();
+    osg::ref_ptr<osg::Referenced> a = new osg::Referenced();
+    osg::ref_ptr<osg::Referenced> b = new osg::Referenced();
+
+    ObjectID single = index->insert(a.get());
+    ObjectID first = index->insertRange(3u);
+    REQUIRE(first == single + 1u);
+
+    index->set(first + 1u, b.get());
+    REQUIRE(index->get<osg::Referenced>(single).get() == a.get());
+    REQUIRE(index->get<osg::Referenced>(first + 1u).get() == b.get());
+    REQUIRE(!index->get<osg::Referenced>(first).valid());
+
+    index->remove(single);
+    REQUIRE(!index->get<osg::Referenced>(single).valid());
+    REQUIRE(index->get<osg::Referenced>(first + 1u).get() == b.get());
+
+    index->removeRange(first, 3u);
+    REQUIRE(!index->get<osg::Referenced>(first + 1u).valid());
+
+    // IDs are never reused
+    REQUIRE(index->insert(a.get()) == first + 3u);
+}
+
+TEST_CASE( "ObjectIndex packs selection flags per object" ) {
+    osg::ref_ptr<ObjectIndex> index = new ObjectIndex();
+    ObjectID first = index->insertRange(20u);
+
+    index->setSelection(first, ObjectIndex::SELECTION_HIGHLIGHT);
+    index->setSelection(first + 17u, ObjectIndex::SELECTION_HIDDEN);
+    REQUIRE(index->getSelection(first) == ObjectIndex::SELECTION_HIGHLIGHT);
+    REQUIRE(index->getSelection(first + 1u) == ObjectIndex::SELECTION_NONE);
+    REQUIRE(index->getSelection(first + 17u) == ObjectIndex::SELECTION_HIDDEN);
+
+    index->setSelection(first, ObjectIndex::SELECTION_NONE);
+    REQUIRE(index->getSelection(first) == ObjectIndex::SELECTION_NONE);
+    REQUIRE(index->getSelection(first + 17u) == ObjectIndex::SELECTION_HIDDEN);
+
+    index->clearSelection();
+    REQUIRE(index->getSelection(first + 17u) == ObjectIndex::SELECTION_NONE);
+}
@@ -0,0 +1,151 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2018 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/catch.hpp>
+#include <osgEarth/ScreenSpaceLayoutImpl>
+#include <osg/Geode>
+#include <osg/Timer>
+#include <iostream>
+
+using namespace osgEarth;
+using namespace osgEarth::Internal;
+
+namespace ScreenSpaceLayoutTest
+{
+    // label-sized boxes scattered over (and a little past) a 1920x1080 window
+    void makeBoxes(unsigned count, std::vector<osg::BoundingBox>& boxes)
+    {
+        boxes.resize(count);
+        unsigned seed = 12345u;
+        for (unsigned i = 0; i < count; ++i)
+        {
+            seed = seed * 1103515245u + 12345u;
+            float x = (float)((seed >> 8) % 2100u) - 90.0f;
+            seed = seed * 1103515245u + 12345u;
+            float y = (float)((seed >> 8) % 1260u) - 90.0f;
+            float w = 20.0f + (float)(i % 7u) * 15.0f;
+            float h = 12.0f + (float)(i % 3u) * 6.0f;
+            boxes[i].set(x, y, 0.0f, x + w, y + h, 0.0f);
+        }
+    }
+
+    // the brute-force declutter the grid replaced
+    unsigned declutterLinear(const std::vector<osg::BoundingBox>& boxes, const std::vector<const osg::Node*>& parents)
+    {
+        std::vector<ScreenSpaceGrid::OwnedBox> used;
+        unsigned passed = 0u;
+        for (unsigned i = 0; i < boxes.size(); ++i)
+        {
+            bool visible = true;
+            for (unsigned j = 0; j < used.size() && visible; ++j)
+            {
+                bool isClear =
+                    boxes[i].xMin() > used[j].second.xMax() ||
+                    boxes[i].xMax() < used[j].second.xMin() ||
+                    boxes[i].yMin() > used[j].second.yMax() ||
+                    boxes[i].yMax() < used[j].second.yMin();
+                if (!isClear && parents[i] != used[j].first)
+                    visible = false;
+            }
+            if (visible)
+            {
+                used.push_back(std::make_pair(parents[i], boxes[i]));
+                ++passed;
+            }
+        }
+        return passed;
+    }
+
+    unsigned declutterGrid(ScreenSpaceGrid& grid, const std::vector<osg::BoundingBox>& boxes, const std::vector<const osg::Node*>& parents)
+    {
+        grid.reset(0.0f, 0.0f, 1920.0f, 1080.0f);
+        for (unsigned i = 0; i < boxes.size(); ++i)
+        {
+            if (!grid.overlaps(boxes[i], parents[i]))
+                grid.insert(parents[i], boxes[i]);
+        }
+        return grid.size();
+    }
+}
+
+using namespace ScreenSpaceLayoutTest;
+
+TEST_CASE("ScreenSpaceGrid declutters like the brute-force test") {
+    std::vector<osg::ref_ptr<osg::Node> > nodes(50);
+    for (unsigned i = 0; i < nodes.size(); ++i)
+        nodes[i] = new osg::Geode();
+
+    std::vector<osg::BoundingBox> boxes;
+    makeBoxes(2000u, boxes);
+
+    // some neighbors share a parent, and are allowed to overlap
+    std::vector<const osg::Node*> parents(boxes.size());
+    for (unsigned i = 0; i < boxes.size(); ++i)
+        parents[i] = nodes[(i / 3u) % nodes.size()].get();
+
+    ScreenSpaceGrid grid;
+    unsigned passed = declutterGrid(grid, boxes, parents);
+    REQUIRE(passed == declutterLinear(boxes, parents));
+    REQUIRE(passed > 0u);
+    REQUIRE(passed < boxes.size());
+
+    // reusing the grid gives the same answer
+    REQUIRE(declutterGrid(grid, boxes, parents) == passed);
+
+    SECTION("Boxes far off screen still collide") {
+        grid.reset(0.0f, 0.0f, 1920.0f, 1080.0f);
+        grid.insert(nodes[0].get(), osg::BoundingBox(-5000, -5000, 0, -4000, -4000, 0));
+        REQUIRE(grid.overlaps(osg::BoundingBox(-4100, -4100, 0, -4050, -4050, 0), nodes[1].get()));
+        REQUIRE(!grid.overlaps(osg::BoundingBox(-3900, -3900, 0, -3800, -3800, 0), nodes[1].get()));
+    }
+}
+
+// Declutter cost versus label count, grid against brute force.
+// Hidden; run with: osgEarth_tests "[benchmark]"
+TEST_CASE("ScreenSpaceGrid declutter cost", "[.][benchmark]") {
+    const unsigned counts[] = { 100u, 1000u, 5000u, 20000u };
+    ScreenSpaceGrid grid;
+
+    for (unsigned c = 0; c < sizeof(counts) / sizeof(counts[0]); ++c)
+    {
+        std::vector<osg::BoundingBox> boxes;
+        makeBoxes(counts[c], boxes);
+
+        std::vector<osg::ref_ptr<osg::Node> > nodes(counts[c]);
+        std::vector<const osg::Node*> parents(counts[c]);
+        for (unsigned i = 0; i < counts[c]; ++i)
+            parents[i] = (nodes[i] = new osg::Geode()).get();
+
+        osg::Timer_t start = osg::Timer::instance()->tick();
+        unsigned linear = declutterLinear(boxes, parents);
+        double linearMS = osg::Timer::instance()->delta_m(start, osg::Timer::instance()->tick());
+
+        start = osg::Timer::instance()->tick();
+        unsigned gridded = declutterGrid(grid, boxes, parents);
+        double gridMS = osg::Timer::instance()->delta_m(start, osg::Timer::instance()->tick());
+
+        REQUIRE(linear == gridded);
+
+        std::cout << counts[c] << " labels, " << gridded << " visible: brute force "
+            << linearMS << " ms, grid " << gridMS << " ms" << std::endl;
+    }
+}
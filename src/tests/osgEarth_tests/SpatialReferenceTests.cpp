@@ -23,6 +23,8 @@
 #include <osgEarth/catch.hpp>
 
 #include <osgEarth/SpatialReference>
+#include <osg/Timer>
+#include <iostream>
 
 using namespace osgEarth;
 
@@ -139,3 +141,71 @@ TEST_CASE("Vertical Datum Tests") {
     REQUIRE(wgs84->transform(osg::Vec3d(-90, 0, -4.29), wgs84_egm96, output));
     REQUIRE(osg::equivalent(output.z(), 0.0, eps));
 }
+
+TEST_CASE("Built-in transform kernels") {
+    const SpatialReference* wgs84 = SpatialReference::get("wgs84");
+    const SpatialReference* merc = SpatialReference::get("spherical-mercator");
+    const SpatialReference* utm17n = SpatialReference::get("+proj=utm +zone=17 +datum=WGS84 +units=m +no_defs");
+    REQUIRE(utm17n != 0L);
+
+    // CN Tower, Toronto
+    osg::Vec3d cnTower(-79.387139, 43.642567, 0.0);
+    osg::Vec3d output;
+
+    SECTION("WGS84 to UTM") {
+        REQUIRE(wgs84->transform(cnTower, utm17n, output));
+        REQUIRE(osg::equivalent(output.x(), 630084.30, 0.01));
+        REQUIRE(osg::equivalent(output.y(), 4833438.59, 0.01));
+
+        REQUIRE(utm17n->transform(output, wgs84, output));
+        REQUIRE(osg::equivalent(output.x(), cnTower.x(), 1e-9));
+        REQUIRE(osg::equivalent(output.y(), cnTower.y(), 1e-9));
+    }
+
+    SECTION("WGS84 to Spherical Mercator") {
+        REQUIRE(wgs84->transform(cnTower, merc, output));
+        REQUIRE(osg::equivalent(output.x(), -8837335.89, 0.01));
+        REQUIRE(osg::equivalent(output.y(), 5410294.20, 0.01));
+
+        REQUIRE(merc->transform(output, wgs84, output));
+        REQUIRE(osg::equivalent(output.x(), cnTower.x(), 1e-9));
+        REQUIRE(osg::equivalent(output.y(), cnTower.y(), 1e-9));
+    }
+
+    SECTION("Poles do not project to Mercator") {
+        REQUIRE(!wgs84->transform(osg::Vec3d(0, 90, 0), merc, output));
+    }
+}
+
+// Throughput of the built-in kernels versus a PROJ transform.
+// Hidden; run with: osgEarth_tests "[benchmark]"
+TEST_CASE("SpatialReference transform throughput", "[.][benchmark]") {
+    const SpatialReference* wgs84 = SpatialReference::get("wgs84");
+    const char* targets[] = {
+        "spherical-mercator",
+        "+proj=utm +zone=17 +datum=WGS84 +units=m +no_defs",
+        "+proj=lcc +lat_1=33 +lat_2=45 +lat_0=39 +lon_0=-96 +datum=WGS84 +units=m +no_defs"
+    };
+
+    const unsigned count = 1000000;
+    std::vector<osg::Vec3d> source(count);
+    for (unsigned i = 0; i < count; ++i)
+        source[i].set(-84.0 + 6.0*(double)(i % 1000)/1000.0, 30.0 + 20.0*(double)(i / 1000)/1000.0, 0.0);
+
+    const unsigned numTargets = sizeof(targets) / sizeof(targets[0]);
+
+    // the extra pass is WGS84 to ECEF
+    for (unsigned t = 0; t <= numTargets; ++t)
+    {
+        const SpatialReference* target =
+            t < numTargets ? SpatialReference::get(targets[t]) : wgs84->getGeocentricSRS();
+        REQUIRE(target != 0L);
+
+        std::vector<osg::Vec3d> points(source);
+        osg::Timer_t start = osg::Timer::instance()->tick();
+        REQUIRE(wgs84->transform(points, target));
+        double s = osg::Timer::instance()->delta_s(start, osg::Timer::instance()->tick());
+
+        std::cout << (t < numTargets ? targets[t] : "ecef") << ": " << (unsigned)((double)count / s) << " points/s" << std::endl;
+    }
+}
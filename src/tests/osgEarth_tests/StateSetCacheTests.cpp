@@ -0,0 +1,96 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2018 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/catch.hpp>
+#include <osgEarth/StateSetCache>
+#include <osg/Material>
+#include <osg/BlendFunc>
+#include <thread>
+#include <vector>
+
+using namespace osgEarth;
+
+namespace
+{
+    osg::StateSet* createStateSet(float red)
+    {
+        osg::StateSet* ss = new osg::StateSet();
+        osg::Material* m = new osg::Material();
+        m->setDiffuse(osg::Material::FRONT_AND_BACK, osg::Vec4(red, 0, 0, 1));
+        ss->setAttributeAndModes(m, osg::StateAttribute::ON);
+        ss->setAttributeAndModes(new osg::BlendFunc(), osg::StateAttribute::ON);
+        return ss;
+    }
+}
+
+TEST_CASE("StateSetCache shares equivalent statesets")
+{
+    osg::ref_ptr<StateSetCache> cache = new StateSetCache();
+
+    osg::ref_ptr<osg::StateSet> a = createStateSet(1.0f);
+    osg::ref_ptr<osg::StateSet> b = createStateSet(1.0f);
+    osg::ref_ptr<osg::StateSet> c = createStateSet(0.5f);
+    osg::ref_ptr<osg::StateSet> out;
+
+    REQUIRE(cache->share(a, out) == false);
+    REQUIRE(out.get() == a.get());
+
+    REQUIRE(cache->share(b, out) == true);
+    REQUIRE(out.get() == a.get());
+
+    REQUIRE(cache->share(c, out) == false);
+    REQUIRE(out.get() == c.get());
+
+    REQUIRE(cache->size() == 2u);
+}
+
+TEST_CASE("StateSetCache shares across threads")
+{
+    osg::ref_ptr<StateSetCache> cache = new StateSetCache();
+
+    const unsigned numThreads = 4u;
+    const unsigned numPerThread = 100u;
+    std::vector<osg::ref_ptr<osg::StateSet> > results(numThreads * numPerThread);
+
+    std::vector<std::thread> threads;
+    for (unsigned t = 0; t < numThreads; ++t)
+    {
+        threads.push_back(std::thread([&, t]()
+        {
+            for (unsigned i = 0; i < numPerThread; ++i)
+            {
+                // ten distinct statesets, built over and over
+                osg::ref_ptr<osg::StateSet> in = createStateSet((float)(i % 10u) / 10.0f);
+                cache->share(in, results[t*numPerThread + i]);
+            }
+        }));
+    }
+    for (unsigned t = 0; t < numThreads; ++t)
+        threads[t].join();
+
+    REQUIRE(cache->size() == 10u);
+
+    for (unsigned i = 0; i < results.size(); ++i)
+    {
+        REQUIRE(results[i].get() == results[i % 10u].get());
+    }
+}
@@ -0,0 +1,146 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2018 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/catch.hpp>
+#include <osgEarth/Tessellator>
+#include <osg/TriangleFunctor>
+#include <osg/Timer>
+#include <osgUtil/Tessellator>
+#include <cmath>
+#include <iostream>
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+namespace TessellatorTest
+{
+    struct SumArea
+    {
+        double _area;
+        SumArea() : _area(0.0) { }
+        void operator()(const osg::Vec3& a, const osg::Vec3& b, const osg::Vec3& c, bool)
+        {
+            _area += 0.5 * fabs(((b - a) ^ (c - a)).z());
+        }
+    };
+
+    double area(const osg::Geometry& geom)
+    {
+        osg::TriangleFunctor<SumArea> f;
+        geom.accept(f);
+        return f._area;
+    }
+
+    void addRing(osg::Geometry* geom, const osg::Vec3* points, unsigned count)
+    {
+        osg::Vec3Array* verts = static_cast<osg::Vec3Array*>(geom->getVertexArray());
+        geom->addPrimitiveSet(new osg::DrawArrays(GL_LINE_LOOP, verts->size(), count));
+        verts->insert(verts->end(), points, points + count);
+    }
+
+    //! A building-like footprint: a jagged, many-sided outline around
+    //! a rectangular courtyard
+    osg::Geometry* createFootprint(double x0, double y0, unsigned sides)
+    {
+        osg::Geometry* geom = new osg::Geometry();
+        geom->setVertexArray(new osg::Vec3Array());
+
+        std::vector<osg::Vec3> outer;
+        for (unsigned i = 0; i < sides; ++i)
+        {
+            double a = 2.0 * osg::PI * (double)i / (double)sides;
+            double r = (i % 2) == 0 ? 20.0 : 18.0;
+            outer.push_back(osg::Vec3(x0 + r*cos(a), y0 + r*sin(a), 0.0f));
+        }
+        addRing(geom, &outer[0], outer.size());
+
+        osg::Vec3 hole[4] = {
+            osg::Vec3(x0 - 5, y0 - 5, 0), osg::Vec3(x0 - 5, y0 + 5, 0),
+            osg::Vec3(x0 + 5, y0 + 5, 0), osg::Vec3(x0 + 5, y0 - 5, 0) };
+        addRing(geom, hole, 4);
+
+        return geom;
+    }
+}
+
+TEST_CASE("Tessellator triangulates a square") {
+    osg::ref_ptr<osg::Geometry> geom = new osg::Geometry();
+    geom->setVertexArray(new osg::Vec3Array());
+    osg::Vec3 square[4] = { osg::Vec3(0,0,0), osg::Vec3(10,0,0), osg::Vec3(10,10,0), osg::Vec3(0,10,0) };
+    TessellatorTest::addRing(geom.get(), square, 4);
+
+    Tessellator tess;
+    REQUIRE(tess.tessellateGeometry(*geom.get()));
+    REQUIRE(geom->getNumPrimitiveSets() == 1);
+    REQUIRE(geom->getPrimitiveSet(0)->getMode() == GL_TRIANGLES);
+    REQUIRE(TessellatorTest::area(*geom.get()) == Approx(100.0));
+
+    if (Tessellator::supportsHoles())
+    {
+        SECTION("Holes are cut out of the outer ring") {
+            osg::ref_ptr<osg::Geometry> holey = new osg::Geometry();
+            holey->setVertexArray(new osg::Vec3Array());
+            osg::Vec3 hole[4] = { osg::Vec3(4,4,0), osg::Vec3(4,6,0), osg::Vec3(6,6,0), osg::Vec3(6,4,0) };
+            TessellatorTest::addRing(holey.get(), square, 4);
+            TessellatorTest::addRing(holey.get(), hole, 4);
+
+            REQUIRE(tess.tessellateGeometry(*holey.get()));
+            REQUIRE(TessellatorTest::area(*holey.get()) == Approx(96.0));
+        }
+    }
+}
+
+// Not run by default; run with: osgEarth_tests "[benchmark]"
+TEST_CASE("Tessellator versus the OSG tessellator on footprints", "[.][benchmark]") {
+    const unsigned count = 5000;
+
+    std::vector<osg::ref_ptr<osg::Geometry> > a, b;
+    for (unsigned i = 0; i < count; ++i)
+    {
+        a.push_back(TessellatorTest::createFootprint(i * 50.0, 0.0, 16 + (i % 48)));
+        b.push_back(TessellatorTest::createFootprint(i * 50.0, 0.0, 16 + (i % 48)));
+    }
+
+    osg::Timer_t t0 = osg::Timer::instance()->tick();
+    Tessellator oeTess;
+    for (unsigned i = 0; i < count; ++i)
+        oeTess.tessellateGeometry(*a[i].get());
+
+    osg::Timer_t t1 = osg::Timer::instance()->tick();
+    for (unsigned i = 0; i < count; ++i)
+    {
+        osgUtil::Tessellator tess;
+        tess.setTessellationType(osgUtil::Tessellator::TESS_TYPE_GEOMETRY);
+        tess.setWindingType(osgUtil::Tessellator::TESS_WINDING_ODD);
+        tess.retessellatePolygons(*b[i].get());
+    }
+    osg::Timer_t t2 = osg::Timer::instance()->tick();
+
+    std::cout << count << " footprints: osgEarth " << osg::Timer::instance()->delta_m(t0, t1)
+        << "ms, osgUtil " << osg::Timer::instance()->delta_m(t1, t2) << "ms" << std::endl;
+
+    if (Tessellator::supportsHoles())
+    {
+        for (unsigned i = 0; i < count; i += count / 10)
+            REQUIRE(TessellatorTest::area(*a[i].get()) == Approx(TessellatorTest::area(*b[i].get())).epsilon(0.001));
+    }
+}
@@ -133,4 +133,184 @@ TEST_CASE( "ReadWriteMutex can handle multiple read locks from the same thread w
     REQUIRE(!thread2.isRunning());
     REQUIRE(elapsedTime < maxTimeSeconds);
 }
-*/
\ No newline at end of file
+*/
+namespace ThreadPoolTest
+{
+    struct Record : public osg::Operation
+    {
+        Record(std::vector<int>& order, int id, Threading::Mutex& m) :
+            osg::Operation("Record", false), _order(order), _id(id), _m(m) { }
+
+        void operator()(osg::Object*) override
+        {
+            Threading::ScopedMutexLock lock(_m);
+            _order.push_back(_id);
+        }
+
+        std::vector<int>& _order;
+        int _id;
+        Threading::Mutex& _m;
+    };
+
+    struct Block : public osg::Operation
+    {
+        Block(Threading::Event& started, Threading::Event& release) :
+            osg::Operation("Block", false), _started(started), _release(release) { }
+
+        void operator()(osg::Object*) override
+        {
+            _started.set();
+            _release.wait();
+        }
+
+        Threading::Event& _started;
+        Threading::Event& _release;
+    };
+
+    struct Canceled : public Threading::Cancelable
+    {
+        bool isCanceled() const override { return true; }
+    };
+}
+
+TEST_CASE( "ThreadPool runs queued operations in priority order" ) {
+
+    using namespace ThreadPoolTest;
+
+    std::vector<int> order;
+    Threading::Mutex m;
+    Threading::Event started, release;
+    Canceled canceled;
+
+    osg::ref_ptr<Threading::ThreadPool> pool = new Threading::ThreadPool(1u);
+
+    // occupy the only worker so everything else stays queued
+    pool->run(new Block(started, release));
+    started.wait();
+
+    osg::ref_ptr<osg::Operation> reprioritized = new Record(order, 4, m);
+    osg::ref_ptr<osg::Operation> removed = new Record(order, 5, m);
+
+    pool->run(new Record(order, 2, m), 1.0f);
+    pool->run(new Record(order, 1, m), 2.0f);
+    pool->run(new Record(order, 3, m), 1.0f);
+    pool->run(reprioritized.get(), 0.0f);
+    pool->run(removed.get(), 10.0f);
+    pool->run(new Record(order, 6, m), 10.0f, &canceled);
+
+    REQUIRE(pool->getNumOperationsInQueue() == 6u);
+    REQUIRE(pool->setPriority(reprioritized.get(), 3.0f));
+    REQUIRE(pool->cancel(removed.get()));
+    REQUIRE(!pool->cancel(removed.get()));
+
+    release.set();
+
+    while (pool->getNumOperationsInQueue() > 0u)
+        std::this_thread::yield();
+
+    // destroying the pool joins the worker
+    pool = nullptr;
+
+    REQUIRE(order == std::vector<int>({ 4, 1, 2, 3 }));
+}
+
+namespace FutureTest
+{
+    struct Value : public osg::Referenced
+    {
+        Value(int v) : _v(v) { }
+        int _v;
+    };
+}
+
+TEST_CASE( "Future continuations and combinators" ) {
+
+    using namespace FutureTest;
+
+    SECTION("then() runs the continuation when the promise resolves") {
+        Threading::Promise<Value> promise;
+        Threading::Future<Value> doubled = promise.getFuture().then<Value>(
+            [](Value* v) { return new Value(v->_v * 2); });
+
+        REQUIRE(!doubled.isAvailable());
+        promise.resolve(new Value(21));
+        REQUIRE(doubled.isAvailable());
+        REQUIRE(doubled.get()->_v == 42);
+    }
+
+    SECTION("when_all() resolves after every input resolves") {
+        std::vector<Threading::Promise<Value> > promises(3);
+        std::vector<Threading::Future<Value> > futures;
+        for (auto& p : promises)
+            futures.push_back(p.getFuture());
+
+        Threading::Future<Threading::FutureVector<Value> > all = Threading::when_all(futures);
+
+        promises[2].resolve(new Value(2));
+        promises[0].resolve(new Value(0));
+        REQUIRE(!all.isAvailable());
+        promises[1].resolve(new Value(1));
+        REQUIRE(all.isAvailable());
+
+        Threading::FutureVector<Value>* results = all.get();
+        REQUIRE(results->size() == 3u);
+        for (int i = 0; i < 3; ++i)
+            REQUIRE((*results)[i]->_v == i);
+    }
+
+    SECTION("when_any() resolves with the first result") {
+        std::vector<Threading::Promise<Value> > promises(2);
+        std::vector<Threading::Future<Value> > futures;
+        for (auto& p : promises)
+            futures.push_back(p.getFuture());
+
+        Threading::Future<Value> any = Threading::when_any(futures);
+        promises[1].resolve(new Value(7));
+        promises[0].resolve(new Value(3));
+        REQUIRE(any.get()->_v == 7);
+    }
+
+    SECTION("cancel() propagates to dependent futures") {
+        Threading::Promise<Value> promise;
+        Threading::Future<Value> input = promise.getFuture();
+        Threading::Future<Value> next = input.then<Value>(
+            [](Value* v) { return new Value(v->_v + 1); });
+
+        input.cancel();
+        REQUIRE(promise.isCanceled());
+        REQUIRE(next.isCanceled());
+        REQUIRE(next.get() == nullptr);
+    }
+}
+
+TEST_CASE( "MPSCQueue delivers every value pushed from multiple threads" ) {
+
+    Threading::MPSCQueue<int> queue;
+    const int numThreads = 4, perThread = 1000;
+
+    std::vector<std::thread> producers;
+    for (int t = 0; t < numThreads; ++t)
+    {
+        producers.push_back(std::thread([&queue, t, perThread]() {
+            for (int i = 0; i < perThread; ++i)
+                queue.push(t*perThread + i);
+        }));
+    }
+    for (auto& p : producers)
+        p.join();
+
+    REQUIRE(queue.size() == (unsigned)(numThreads*perThread));
+
+    std::vector<int> last(numThreads, -1);
+    int value, count = 0;
+    while (queue.pop(value))
+    {
+        // values from any one producer arrive in the order pushed
+        int t = value / perThread;
+        REQUIRE(value > last[t]);
+        last[t] = value;
+        ++count;
+    }
+    REQUIRE(count == numThreads*perThread);
+    REQUIRE(queue.size() == 0u);
+}
@@ -0,0 +1,88 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2020 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/catch.hpp>
+
+#include <osgEarth/TileKey>
+
+using namespace osgEarth;
+
+TEST_CASE( "TileKey" ) {
+
+    osg::ref_ptr<const Profile> profile = Profile::create("global-geodetic");
+    TileKey key(12, 3001, 1207, profile.get());
+
+    SECTION("Packed keys round trip") {
+        PackedTileKey packed = key.pack();
+        REQUIRE(packed.valid());
+        REQUIRE(packed.getLOD() == 12u);
+        REQUIRE(packed.getTileX() == 3001u);
+        REQUIRE(packed.getTileY() == 1207u);
+        REQUIRE(TileKey(packed, profile.get()) == key);
+        REQUIRE(packed.str() == key.str());
+    }
+
+    SECTION("Packed keys match their TileKeys") {
+        PackedTileKey packed = key.pack();
+        REQUIRE(packed.createParentKey() == key.createParentKey().pack());
+        REQUIRE(packed.createAncestorKey(4) == key.createAncestorKey(4).pack());
+        for (unsigned q = 0; q < 4; ++q)
+        {
+            REQUIRE(packed.createChildKey(q) == key.createChildKey(q).pack());
+            REQUIRE(packed.createChildKey(q).getQuadrant() == key.createChildKey(q).getQuadrant());
+        }
+    }
+
+    SECTION("Packed keys sort like TileKeys") {
+        TileKey neighbor = key.createNeighborKey(0, 1);
+        REQUIRE((key < neighbor) == (key.pack() < neighbor.pack()));
+        REQUIRE((key.createParentKey() < key) == (key.createParentKey().pack() < key.pack()));
+    }
+
+    SECTION("Keys that don't fit are invalid") {
+        REQUIRE(!PackedTileKey(3, 1u << 29, 0).valid());
+        REQUIRE(!TileKey::INVALID.pack().valid());
+        REQUIRE(!PackedTileKey().createParentKey().valid());
+        REQUIRE(!PackedTileKey(0, 0, 0).createParentKey().valid());
+    }
+
+    SECTION("Mercator keys map onto geodetic tiles") {
+        osg::ref_ptr<const Profile> mercator = Profile::create("spherical-mercator");
+        std::vector<TileKey> keys;
+        keys.push_back(TileKey(1, 0, 0, mercator.get()));
+        keys.push_back(TileKey(1, 1, 1, mercator.get()));
+
+        std::vector<std::vector<TileKey> > out;
+        profile->getIntersectingTiles(keys, out);
+        REQUIRE(out.size() == 2u);
+        REQUIRE(out[0].size() == 2u);
+        REQUIRE(out[0][0] == TileKey(1, 0, 0, profile.get()));
+        REQUIRE(out[0][1] == TileKey(1, 1, 0, profile.get()));
+        REQUIRE(out[1].size() == 2u);
+        REQUIRE(out[1][0] == TileKey(1, 2, 1, profile.get()));
+        REQUIRE(out[1][1] == TileKey(1, 3, 1, profile.get()));
+
+        std::vector<TileKey> single;
+        profile->getIntersectingTiles(keys[1], single);
+        REQUIRE(single == out[1]);
+    }
+}
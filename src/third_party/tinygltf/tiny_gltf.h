@@ -3848,6 +3848,18 @@ static bool ParseBuffer(Buffer *buffer, std::string *err, const json &o,
   buffer->uri.clear();
   ParseStringProperty(&buffer->uri, err, o, "uri", false, "Buffer");
 
+  // EXT_meshopt_compression fallback buffers carry no data of their own;
+  // the decoder provides the contents of the views that reference them.
+  if (buffer->uri.empty()) {
+    json_const_iterator extensionsIt;
+    json_const_iterator meshoptIt;
+    if (FindMember(o, "extensions", extensionsIt) &&
+        FindMember(GetValue(extensionsIt), "EXT_meshopt_compression",
+                   meshoptIt)) {
+      return true;
+    }
+  }
+
   // having an empty uri for a non embedded image should not be valid
   if (!is_binary && buffer->uri.empty()) {
     if (err) {